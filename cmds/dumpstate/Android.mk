@@ -9,7 +9,9 @@ LOCAL_SRC_FILES := dumpstate.c utils.c
 
 LOCAL_MODULE := dumpstate
 
-LOCAL_SHARED_LIBRARIES := libcutils
+LOCAL_SHARED_LIBRARIES := libcutils libz
+
+LOCAL_C_INCLUDES := external/zlib
 
 ifdef BOARD_LIB_DUMPSTATE
 LOCAL_STATIC_LIBRARIES := $(BOARD_LIB_DUMPSTATE)
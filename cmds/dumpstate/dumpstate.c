@@ -75,226 +75,317 @@ static void dumpstate() {
     printf("Command line: %s\n", strtok(cmdline_buf, "\n"));
     printf("\n");
 
-    run_command("UPTIME", 10, "uptime", NULL);
-    dump_file("MEMORY INFO", "/proc/meminfo");
-    run_command("CPU INFO", 10, "top", "-n", "1", "-d", "1", "-m", "30", "-t", NULL);
-    run_command("PROCRANK", 20, "procrank", NULL);
-    dump_file("VIRTUAL MEMORY STATS", "/proc/vmstat");
-    dump_file("VMALLOC INFO", "/proc/vmallocinfo");
-    dump_file("SLAB INFO", "/proc/slabinfo");
-    dump_file("ZONEINFO", "/proc/zoneinfo");
-    dump_file("PAGETYPEINFO", "/proc/pagetypeinfo");
-    dump_file("BUDDYINFO", "/proc/buddyinfo");
-    dump_file("FRAGMENTATION INFO", "/d/extfrag/unusable_index");
-
-
-    dump_file("KERNEL WAKELOCKS", "/proc/wakelocks");
-    dump_file("KERNEL WAKE SOURCES", "/d/wakeup_sources");
-    dump_file("KERNEL CPUFREQ", "/sys/devices/system/cpu/cpu0/cpufreq/stats/time_in_state");
-    dump_file("KERNEL SYNC", "/d/sync");
-
-    run_command("PROCESSES", 10, "ps", "-P", NULL);
-    run_command("PROCESSES AND THREADS", 10, "ps", "-t", "-p", "-P", NULL);
-    run_command("LIBRANK", 10, "librank", NULL);
-
-    do_dmesg();
-
-    run_command("LIST OF OPEN FILES", 10, SU_PATH, "root", "lsof", NULL);
-
-    for_each_pid(do_showmap, "SMAPS OF ALL PROCESSES");
-    for_each_pid(show_wchan, "BLOCKED PROCESS WAIT-CHANNELS");
-
-    // dump_file("EVENT LOG TAGS", "/etc/event-log-tags");
-    run_command("SYSTEM LOG", 20, "logcat", "-v", "threadtime", "-d", "*:v", NULL);
-    run_command("EVENT LOG", 20, "logcat", "-b", "events", "-v", "threadtime", "-d", "*:v", NULL);
-    run_command("RADIO LOG", 20, "logcat", "-b", "radio", "-v", "threadtime", "-d", "*:v", NULL);
-
-
-    /* show the traces we collected in main(), if that was done */
-    if (dump_traces_path != NULL) {
-        dump_file("VM TRACES JUST NOW", dump_traces_path);
-    }
-
-    /* only show ANR traces if they're less than 15 minutes old */
-    struct stat st;
-    char anr_traces_path[PATH_MAX];
-    property_get("dalvik.vm.stack-trace-file", anr_traces_path, "");
-    if (!anr_traces_path[0]) {
-        printf("*** NO VM TRACES FILE DEFINED (dalvik.vm.stack-trace-file)\n\n");
-    } else if (stat(anr_traces_path, &st)) {
-        printf("*** NO ANR VM TRACES FILE (%s): %s\n\n", anr_traces_path, strerror(errno));
-    } else {
-        dump_file("VM TRACES AT LAST ANR", anr_traces_path);
-    }
-
-    /* slow traces for slow operations */
-    if (anr_traces_path[0] != 0) {
-        int tail = strlen(anr_traces_path)-1;
-        while (tail > 0 && anr_traces_path[tail] != '/') {
-            tail--;
+    if (section_begin("MEMORY INFO")) {
+        run_command("UPTIME", 10, "uptime", NULL);
+        dump_file("MEMORY INFO", "/proc/meminfo");
+        section_end();
+    }
+
+    if (section_begin("CPU INFO")) {
+        run_command("CPU INFO", 10, "top", "-n", "1", "-d", "1", "-m", "30", "-t", NULL);
+        section_end();
+    }
+
+    if (section_begin("PROCRANK")) {
+        run_command("PROCRANK", 20, "procrank", NULL);
+        section_end();
+    }
+
+    if (section_begin("KERNEL MEMORY AND WAKELOCKS")) {
+        dump_file("VIRTUAL MEMORY STATS", "/proc/vmstat");
+        dump_file("VMALLOC INFO", "/proc/vmallocinfo");
+        dump_file("SLAB INFO", "/proc/slabinfo");
+        dump_file("ZONEINFO", "/proc/zoneinfo");
+        dump_file("PAGETYPEINFO", "/proc/pagetypeinfo");
+        dump_file("BUDDYINFO", "/proc/buddyinfo");
+        dump_file("FRAGMENTATION INFO", "/d/extfrag/unusable_index");
+
+
+        dump_file("KERNEL WAKELOCKS", "/proc/wakelocks");
+        dump_file("KERNEL WAKE SOURCES", "/d/wakeup_sources");
+        dump_file("KERNEL CPUFREQ", "/sys/devices/system/cpu/cpu0/cpufreq/stats/time_in_state");
+        dump_file("KERNEL SYNC", "/d/sync");
+        section_end();
+    }
+
+    if (section_begin("PROCESSES")) {
+        run_command("PROCESSES", 10, "ps", "-P", NULL);
+        run_command("PROCESSES AND THREADS", 10, "ps", "-t", "-p", "-P", NULL);
+        section_end();
+    }
+
+    if (section_begin("LIBRANK")) {
+        run_command("LIBRANK", 10, "librank", NULL);
+        section_end();
+    }
+
+    if (section_begin("KERNEL LOG")) {
+        do_dmesg();
+        section_end();
+    }
+
+    if (section_begin("LIST OF OPEN FILES")) {
+        run_command("LIST OF OPEN FILES", 10, SU_PATH, "root", "lsof", NULL);
+        section_end();
+    }
+
+    if (section_begin("SMAPS OF ALL PROCESSES")) {
+        for_each_pid(do_showmap, "SMAPS OF ALL PROCESSES");
+        section_end();
+    }
+
+    if (section_begin("BLOCKED PROCESS WAIT-CHANNELS")) {
+        for_each_pid(show_wchan, "BLOCKED PROCESS WAIT-CHANNELS");
+        section_end();
+    }
+
+    if (section_begin("SYSTEM LOG")) {
+        // dump_file("EVENT LOG TAGS", "/etc/event-log-tags");
+        run_command("SYSTEM LOG", 20, "logcat", "-v", "threadtime", "-d", "*:v", NULL);
+        section_end();
+    }
+
+    if (section_begin("EVENT LOG")) {
+        run_command("EVENT LOG", 20, "logcat", "-b", "events", "-v", "threadtime", "-d", "*:v", NULL);
+        section_end();
+    }
+
+    if (section_begin("RADIO LOG")) {
+        run_command("RADIO LOG", 20, "logcat", "-b", "radio", "-v", "threadtime", "-d", "*:v", NULL);
+        section_end();
+    }
+
+    if (section_begin("VM TRACES")) {
+        /* show the traces we collected in main(), if that was done */
+        if (dump_traces_path != NULL) {
+            dump_file("VM TRACES JUST NOW", dump_traces_path);
+        }
+
+        /* only show ANR traces if they're less than 15 minutes old */
+        struct stat st;
+        char anr_traces_path[PATH_MAX];
+        property_get("dalvik.vm.stack-trace-file", anr_traces_path, "");
+        if (!anr_traces_path[0]) {
+            printf("*** NO VM TRACES FILE DEFINED (dalvik.vm.stack-trace-file)\n\n");
+        } else if (stat(anr_traces_path, &st)) {
+            printf("*** NO ANR VM TRACES FILE (%s): %s\n\n", anr_traces_path, strerror(errno));
+        } else {
+            dump_file("VM TRACES AT LAST ANR", anr_traces_path);
         }
-        int i = 0;
-        while (1) {
-            sprintf(anr_traces_path+tail+1, "slow%02d.txt", i);
-            if (stat(anr_traces_path, &st)) {
-                // No traces file at this index, done with the files.
-                break;
+
+        /* slow traces for slow operations */
+        if (anr_traces_path[0] != 0) {
+            int tail = strlen(anr_traces_path)-1;
+            while (tail > 0 && anr_traces_path[tail] != '/') {
+                tail--;
+            }
+            int i = 0;
+            while (1) {
+                sprintf(anr_traces_path+tail+1, "slow%02d.txt", i);
+                if (stat(anr_traces_path, &st)) {
+                    // No traces file at this index, done with the files.
+                    break;
+                }
+                dump_file("VM TRACES WHEN SLOW", anr_traces_path);
+                i++;
             }
-            dump_file("VM TRACES WHEN SLOW", anr_traces_path);
-            i++;
         }
+        section_end();
+    }
+
+    if (section_begin("NETWORK AND PANIC INFO")) {
+        dump_file("NETWORK DEV INFO", "/proc/net/dev");
+        dump_file("QTAGUID NETWORK INTERFACES INFO", "/proc/net/xt_qtaguid/iface_stat_all");
+        dump_file("QTAGUID NETWORK INTERFACES INFO (xt)", "/proc/net/xt_qtaguid/iface_stat_fmt");
+        dump_file("QTAGUID CTRL INFO", "/proc/net/xt_qtaguid/ctrl");
+        dump_file("QTAGUID STATS INFO", "/proc/net/xt_qtaguid/stats");
+
+        dump_file("NETWORK ROUTES", "/proc/net/route");
+        dump_file("NETWORK ROUTES IPV6", "/proc/net/ipv6_route");
+
+        /* TODO: Make last_kmsg CAP_SYSLOG protected. b/5555691 */
+        dump_file("LAST KMSG", "/proc/last_kmsg");
+        dump_file("LAST PANIC CONSOLE", "/data/dontpanic/apanic_console");
+        dump_file("LAST PANIC THREADS", "/data/dontpanic/apanic_threads");
+        section_end();
+    }
+
+    if (section_begin("SCREENSHOT")) {
+        if (screenshot_path[0]) {
+            ALOGI("taking screenshot\n");
+            run_command(NULL, 5, SU_PATH, "root", "screenshot", screenshot_path, NULL);
+            ALOGI("wrote screenshot: %s\n", screenshot_path);
+        }
+        section_end();
+    }
+
+    if (section_begin("SYSTEM SETTINGS")) {
+        run_command("SYSTEM SETTINGS", 20, SU_PATH, "root", "sqlite3",
+                "/data/data/com.android.providers.settings/databases/settings.db",
+                "pragma user_version; select * from system; select * from secure; select * from global;", NULL);
+        section_end();
     }
 
-    dump_file("NETWORK DEV INFO", "/proc/net/dev");
-    dump_file("QTAGUID NETWORK INTERFACES INFO", "/proc/net/xt_qtaguid/iface_stat_all");
-    dump_file("QTAGUID NETWORK INTERFACES INFO (xt)", "/proc/net/xt_qtaguid/iface_stat_fmt");
-    dump_file("QTAGUID CTRL INFO", "/proc/net/xt_qtaguid/ctrl");
-    dump_file("QTAGUID STATS INFO", "/proc/net/xt_qtaguid/stats");
-
-    dump_file("NETWORK ROUTES", "/proc/net/route");
-    dump_file("NETWORK ROUTES IPV6", "/proc/net/ipv6_route");
-
-    /* TODO: Make last_kmsg CAP_SYSLOG protected. b/5555691 */
-    dump_file("LAST KMSG", "/proc/last_kmsg");
-    dump_file("LAST PANIC CONSOLE", "/data/dontpanic/apanic_console");
-    dump_file("LAST PANIC THREADS", "/data/dontpanic/apanic_threads");
-
-    if (screenshot_path[0]) {
-        ALOGI("taking screenshot\n");
-        run_command(NULL, 5, SU_PATH, "root", "screenshot", screenshot_path, NULL);
-        ALOGI("wrote screenshot: %s\n", screenshot_path);
-    }
-
-    run_command("SYSTEM SETTINGS", 20, SU_PATH, "root", "sqlite3",
-            "/data/data/com.android.providers.settings/databases/settings.db",
-            "pragma user_version; select * from system; select * from secure; select * from global;", NULL);
-
-    /* The following have a tendency to get wedged when wifi drivers/fw goes belly-up. */
-    run_command("NETWORK INTERFACES", 10, SU_PATH, "root", "netcfg", NULL);
-    run_command("IP RULES", 10, "ip", "rule", "show", NULL);
-    run_command("IP RULES v6", 10, "ip", "-6", "rule", "show", NULL);
-    run_command("ROUTE TABLE 60", 10, "ip", "route", "show", "table", "60", NULL);
-    run_command("ROUTE TABLE 61 v6", 10, "ip", "-6", "route", "show", "table", "60", NULL);
-    run_command("ROUTE TABLE 61", 10, "ip", "route", "show", "table", "61", NULL);
-    run_command("ROUTE TABLE 61 v6", 10, "ip", "-6", "route", "show", "table", "61", NULL);
-    dump_file("ARP CACHE", "/proc/net/arp");
-    run_command("IPTABLES", 10, SU_PATH, "root", "iptables", "-L", "-nvx", NULL);
-    run_command("IP6TABLES", 10, SU_PATH, "root", "ip6tables", "-L", "-nvx", NULL);
-    run_command("IPTABLE NAT", 10, SU_PATH, "root", "iptables", "-t", "nat", "-L", "-nvx", NULL);
-    /* no ip6 nat */
-    run_command("IPTABLE RAW", 10, SU_PATH, "root", "iptables", "-t", "raw", "-L", "-nvx", NULL);
-    run_command("IP6TABLE RAW", 10, SU_PATH, "root", "ip6tables", "-t", "raw", "-L", "-nvx", NULL);
-
-    run_command("WIFI NETWORKS", 20,
-            SU_PATH, "root", "wpa_cli", "list_networks", NULL);
+    if (section_begin("NETWORK INTERFACES")) {
+        /* The following have a tendency to get wedged when wifi drivers/fw goes belly-up. */
+        run_command("NETWORK INTERFACES", 10, SU_PATH, "root", "netcfg", NULL);
+        run_command("IP RULES", 10, "ip", "rule", "show", NULL);
+        run_command("IP RULES v6", 10, "ip", "-6", "rule", "show", NULL);
+        run_command("ROUTE TABLE 60", 10, "ip", "route", "show", "table", "60", NULL);
+        run_command("ROUTE TABLE 61 v6", 10, "ip", "-6", "route", "show", "table", "60", NULL);
+        run_command("ROUTE TABLE 61", 10, "ip", "route", "show", "table", "61", NULL);
+        run_command("ROUTE TABLE 61 v6", 10, "ip", "-6", "route", "show", "table", "61", NULL);
+        dump_file("ARP CACHE", "/proc/net/arp");
+        run_command("IPTABLES", 10, SU_PATH, "root", "iptables", "-L", "-nvx", NULL);
+        run_command("IP6TABLES", 10, SU_PATH, "root", "ip6tables", "-L", "-nvx", NULL);
+        run_command("IPTABLE NAT", 10, SU_PATH, "root", "iptables", "-t", "nat", "-L", "-nvx", NULL);
+        /* no ip6 nat */
+        run_command("IPTABLE RAW", 10, SU_PATH, "root", "iptables", "-t", "raw", "-L", "-nvx", NULL);
+        run_command("IP6TABLE RAW", 10, SU_PATH, "root", "ip6tables", "-t", "raw", "-L", "-nvx", NULL);
+
+        run_command("WIFI NETWORKS", 20,
+                SU_PATH, "root", "wpa_cli", "list_networks", NULL);
 
 #ifdef FWDUMP_bcmdhd
-    run_command("DUMP WIFI INTERNAL COUNTERS", 20,
-            SU_PATH, "root", "wlutil", "counters", NULL);
+        run_command("DUMP WIFI INTERNAL COUNTERS", 20,
+                SU_PATH, "root", "wlutil", "counters", NULL);
 #endif
-    dump_file("INTERRUPTS (1)", "/proc/interrupts");
-
-    property_get("dhcp.wlan0.gateway", network, "");
-    if (network[0])
-        run_command("PING GATEWAY", 10, SU_PATH, "root", "ping", "-c", "3", "-i", ".5", network, NULL);
-    property_get("dhcp.wlan0.dns1", network, "");
-    if (network[0])
-        run_command("PING DNS1", 10, SU_PATH, "root", "ping", "-c", "3", "-i", ".5", network, NULL);
-    property_get("dhcp.wlan0.dns2", network, "");
-    if (network[0])
-        run_command("PING DNS2", 10, SU_PATH, "root", "ping", "-c", "3", "-i", ".5", network, NULL);
+        dump_file("INTERRUPTS (1)", "/proc/interrupts");
+
+        property_get("dhcp.wlan0.gateway", network, "");
+        if (network[0])
+            run_command("PING GATEWAY", 10, SU_PATH, "root", "ping", "-c", "3", "-i", ".5", network, NULL);
+        property_get("dhcp.wlan0.dns1", network, "");
+        if (network[0])
+            run_command("PING DNS1", 10, SU_PATH, "root", "ping", "-c", "3", "-i", ".5", network, NULL);
+        property_get("dhcp.wlan0.dns2", network, "");
+        if (network[0])
+            run_command("PING DNS2", 10, SU_PATH, "root", "ping", "-c", "3", "-i", ".5", network, NULL);
 #ifdef FWDUMP_bcmdhd
-    run_command("DUMP WIFI STATUS", 20,
-            SU_PATH, "root", "dhdutil", "-i", "wlan0", "dump", NULL);
-    run_command("DUMP WIFI INTERNAL COUNTERS", 20,
-            SU_PATH, "root", "wlutil", "counters", NULL);
+        run_command("DUMP WIFI STATUS", 20,
+                SU_PATH, "root", "dhdutil", "-i", "wlan0", "dump", NULL);
+        run_command("DUMP WIFI INTERNAL COUNTERS", 20,
+                SU_PATH, "root", "wlutil", "counters", NULL);
 #endif
-    dump_file("INTERRUPTS (2)", "/proc/interrupts");
+        dump_file("INTERRUPTS (2)", "/proc/interrupts");
+        section_end();
+    }
 
-    print_properties();
+    if (section_begin("SYSTEM PROPERTIES")) {
+        print_properties();
+        section_end();
+    }
 
-    run_command("VOLD DUMP", 10, "vdc", "dump", NULL);
-    run_command("SECURE CONTAINERS", 10, "vdc", "asec", "list", NULL);
+    if (section_begin("STORAGE AND PACKAGES")) {
+        run_command("VOLD DUMP", 10, "vdc", "dump", NULL);
+        run_command("SECURE CONTAINERS", 10, "vdc", "asec", "list", NULL);
 
-    run_command("FILESYSTEMS & FREE SPACE", 10, SU_PATH, "root", "df", NULL);
+        run_command("FILESYSTEMS & FREE SPACE", 10, SU_PATH, "root", "df", NULL);
 
-    run_command("PACKAGE SETTINGS", 20, SU_PATH, "root", "cat", "/data/system/packages.xml", NULL);
-    dump_file("PACKAGE UID ERRORS", "/data/system/uiderrors.txt");
+        run_command("PACKAGE SETTINGS", 20, SU_PATH, "root", "cat", "/data/system/packages.xml", NULL);
+        dump_file("PACKAGE UID ERRORS", "/data/system/uiderrors.txt");
 
-    run_command("LAST RADIO LOG", 10, "parse_radio_log", "/proc/last_radio_log", NULL);
+        run_command("LAST RADIO LOG", 10, "parse_radio_log", "/proc/last_radio_log", NULL);
+        section_end();
+    }
 
-    printf("------ BACKLIGHTS ------\n");
-    printf("LCD brightness=");
-    dump_file(NULL, "/sys/class/leds/lcd-backlight/brightness");
-    printf("Button brightness=");
-    dump_file(NULL, "/sys/class/leds/button-backlight/brightness");
-    printf("Keyboard brightness=");
-    dump_file(NULL, "/sys/class/leds/keyboard-backlight/brightness");
-    printf("ALS mode=");
-    dump_file(NULL, "/sys/class/leds/lcd-backlight/als");
-    printf("LCD driver registers:\n");
-    dump_file(NULL, "/sys/class/leds/lcd-backlight/registers");
-    printf("\n");
+    if (section_begin("BACKLIGHTS")) {
+        printf("------ BACKLIGHTS ------\n");
+        printf("LCD brightness=");
+        dump_file(NULL, "/sys/class/leds/lcd-backlight/brightness");
+        printf("Button brightness=");
+        dump_file(NULL, "/sys/class/leds/button-backlight/brightness");
+        printf("Keyboard brightness=");
+        dump_file(NULL, "/sys/class/leds/keyboard-backlight/brightness");
+        printf("ALS mode=");
+        dump_file(NULL, "/sys/class/leds/lcd-backlight/als");
+        printf("LCD driver registers:\n");
+        dump_file(NULL, "/sys/class/leds/lcd-backlight/registers");
+        printf("\n");
+        section_end();
+    }
 
-    /* Binder state is expensive to look at as it uses a lot of memory. */
-    dump_file("BINDER FAILED TRANSACTION LOG", "/sys/kernel/debug/binder/failed_transaction_log");
-    dump_file("BINDER TRANSACTION LOG", "/sys/kernel/debug/binder/transaction_log");
-    dump_file("BINDER TRANSACTIONS", "/sys/kernel/debug/binder/transactions");
-    dump_file("BINDER STATS", "/sys/kernel/debug/binder/stats");
-    dump_file("BINDER STATE", "/sys/kernel/debug/binder/state");
+    if (section_begin("BINDER")) {
+        /* Binder state is expensive to look at as it uses a lot of memory. */
+        dump_file("BINDER FAILED TRANSACTION LOG", "/sys/kernel/debug/binder/failed_transaction_log");
+        dump_file("BINDER TRANSACTION LOG", "/sys/kernel/debug/binder/transaction_log");
+        dump_file("BINDER TRANSACTIONS", "/sys/kernel/debug/binder/transactions");
+        dump_file("BINDER STATS", "/sys/kernel/debug/binder/stats");
+        dump_file("BINDER STATE", "/sys/kernel/debug/binder/state");
+        section_end();
+    }
 
 #ifdef BOARD_HAS_DUMPSTATE
-    printf("========================================================\n");
-    printf("== Board\n");
-    printf("========================================================\n");
-
-    dumpstate_board();
-    printf("\n");
+    if (section_begin("BOARD")) {
+        printf("========================================================\n");
+        printf("== Board\n");
+        printf("========================================================\n");
+
+        dumpstate_board();
+        printf("\n");
+        section_end();
+    }
 #endif
 
-    /* Migrate the ril_dumpstate to a dumpstate_board()? */
-    char ril_dumpstate_timeout[PROPERTY_VALUE_MAX] = {0};
-    property_get("ril.dumpstate.timeout", ril_dumpstate_timeout, "30");
-    if (strnlen(ril_dumpstate_timeout, PROPERTY_VALUE_MAX - 1) > 0) {
-        if (0 == strncmp(build_type, "user", PROPERTY_VALUE_MAX - 1)) {
-            // su does not exist on user builds, so try running without it.
-            // This way any implementations of vril-dump that do not require
-            // root can run on user builds.
-            run_command("DUMP VENDOR RIL LOGS", atoi(ril_dumpstate_timeout),
-                    "vril-dump", NULL);
-        } else {
-            run_command("DUMP VENDOR RIL LOGS", atoi(ril_dumpstate_timeout),
-                    SU_PATH, "root", "vril-dump", NULL);
+    if (section_begin("VENDOR RIL LOGS")) {
+        /* Migrate the ril_dumpstate to a dumpstate_board()? */
+        char ril_dumpstate_timeout[PROPERTY_VALUE_MAX] = {0};
+        property_get("ril.dumpstate.timeout", ril_dumpstate_timeout, "30");
+        if (strnlen(ril_dumpstate_timeout, PROPERTY_VALUE_MAX - 1) > 0) {
+            if (0 == strncmp(build_type, "user", PROPERTY_VALUE_MAX - 1)) {
+                // su does not exist on user builds, so try running without it.
+                // This way any implementations of vril-dump that do not require
+                // root can run on user builds.
+                run_command("DUMP VENDOR RIL LOGS", atoi(ril_dumpstate_timeout),
+                        "vril-dump", NULL);
+            } else {
+                run_command("DUMP VENDOR RIL LOGS", atoi(ril_dumpstate_timeout),
+                        SU_PATH, "root", "vril-dump", NULL);
+            }
         }
+        section_end();
     }
 
-    printf("========================================================\n");
-    printf("== Android Framework Services\n");
-    printf("========================================================\n");
+    if (section_begin("DUMPSYS")) {
+        printf("========================================================\n");
+        printf("== Android Framework Services\n");
+        printf("========================================================\n");
 
-    /* the full dumpsys is starting to take a long time, so we need
-       to increase its timeout.  we really need to do the timeouts in
-       dumpsys itself... */
-    run_command("DUMPSYS", 60, "dumpsys", NULL);
+        /* the full dumpsys is starting to take a long time, so we need
+           to increase its timeout.  we really need to do the timeouts in
+           dumpsys itself... */
+        run_command("DUMPSYS", 60, "dumpsys", NULL);
+        section_end();
+    }
 
-    printf("========================================================\n");
-    printf("== Running Application Activities\n");
-    printf("========================================================\n");
+    if (section_begin("APP ACTIVITIES")) {
+        printf("========================================================\n");
+        printf("== Running Application Activities\n");
+        printf("========================================================\n");
 
-    run_command("APP ACTIVITIES", 30, "dumpsys", "activity", "all", NULL);
+        run_command("APP ACTIVITIES", 30, "dumpsys", "activity", "all", NULL);
+        section_end();
+    }
 
-    printf("========================================================\n");
-    printf("== Running Application Services\n");
-    printf("========================================================\n");
+    if (section_begin("APP SERVICES")) {
+        printf("========================================================\n");
+        printf("== Running Application Services\n");
+        printf("========================================================\n");
 
-    run_command("APP SERVICES", 30, "dumpsys", "activity", "service", "all", NULL);
+        run_command("APP SERVICES", 30, "dumpsys", "activity", "service", "all", NULL);
+        section_end();
+    }
 
-    printf("========================================================\n");
-    printf("== Running Application Providers\n");
-    printf("========================================================\n");
+    if (section_begin("APP PROVIDERS")) {
+        printf("========================================================\n");
+        printf("== Running Application Providers\n");
+        printf("========================================================\n");
 
-    run_command("APP SERVICES", 30, "dumpsys", "activity", "provider", "all", NULL);
+        run_command("APP SERVICES", 30, "dumpsys", "activity", "provider", "all", NULL);
+        section_end();
+    }
 
+    sections_finish();
 
     printf("========================================================\n");
     printf("== dumpstate: done\n");
@@ -302,15 +393,17 @@ static void dumpstate() {
 }
 
 static void usage() {
-    fprintf(stderr, "usage: dumpstate [-b soundfile] [-e soundfile] [-o file [-d] [-p] [-z]] [-s] [-q]\n"
+    fprintf(stderr, "usage: dumpstate [-b soundfile] [-e soundfile] [-o file [-d] [-p] [-z]] [-s] [-q] [-j jobs] [-t]\n"
             "  -o: write to file (instead of stdout)\n"
             "  -d: append date to filename (requires -o)\n"
-            "  -z: gzip output (requires -o)\n"
+            "  -z: gzip output (requires -o), with as many threads as -j\n"
             "  -p: capture screenshot to filename.png (requires -o)\n"
             "  -s: write output to control socket (for init)\n"
             "  -b: play sound file instead of vibrate, at beginning of job\n"
             "  -e: play sound file instead of vibrate, at end of job\n"
             "  -q: disable vibrate\n"
+            "  -j: dump up to this many sections of the report in parallel\n"
+            "  -t: collect the stack traces of all processes concurrently\n"
 		);
 }
 
@@ -323,6 +416,8 @@ int main(int argc, char *argv[]) {
     char* end_sound = 0;
     int use_socket = 0;
     int do_fb = 0;
+    int max_workers = 1;
+    bool concurrent_traces = false;
 
     if (getuid() != 0) {
         // Old versions of the adb client would call the
@@ -344,11 +439,8 @@ int main(int argc, char *argv[]) {
         fclose(oom_adj);
     }
 
-    /* very first thing, collect stack traces from Dalvik and native processes (needs root) */
-    dump_traces_path = dump_traces();
-
     int c;
-    while ((c = getopt(argc, argv, "b:de:ho:svqzp")) != -1) {
+    while ((c = getopt(argc, argv, "b:de:ho:svqzpj:t")) != -1) {
         switch (c) {
             case 'b': begin_sound = optarg;  break;
             case 'd': do_add_date = 1;       break;
@@ -359,6 +451,8 @@ int main(int argc, char *argv[]) {
             case 'q': do_vibrate = 0;        break;
             case 'z': do_compress = 6;       break;
             case 'p': do_fb = 1;             break;
+            case 'j': max_workers = atoi(optarg); break;
+            case 't': concurrent_traces = true; break;
             case '?': printf("\n");
             case 'h':
                 usage();
@@ -366,6 +460,9 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    /* first thing after the options, collect stack traces from Dalvik and native processes (needs root) */
+    dump_traces_path = dump_traces(concurrent_traces);
+
     FILE *vibrator = 0;
     if (do_vibrate) {
         /* open the vibrator before dropping root */
@@ -410,6 +507,9 @@ int main(int argc, char *argv[]) {
 
     capdata[CAP_TO_INDEX(CAP_SYSLOG)].permitted = CAP_TO_MASK(CAP_SYSLOG);
     capdata[CAP_TO_INDEX(CAP_SYSLOG)].effective = CAP_TO_MASK(CAP_SYSLOG);
+    /* needed to read /proc/<pid>/smaps of other users */
+    capdata[CAP_TO_INDEX(CAP_SYS_PTRACE)].permitted |= CAP_TO_MASK(CAP_SYS_PTRACE);
+    capdata[CAP_TO_INDEX(CAP_SYS_PTRACE)].effective |= CAP_TO_MASK(CAP_SYS_PTRACE);
     capdata[0].inheritable = 0;
     capdata[1].inheritable = 0;
 
@@ -419,7 +519,6 @@ int main(int argc, char *argv[]) {
     }
 
     char path[PATH_MAX], tmp_path[PATH_MAX];
-    pid_t gzip_pid = -1;
 
     if (use_socket) {
         redirect_to_socket(stdout, "dumpstate");
@@ -439,7 +538,7 @@ int main(int argc, char *argv[]) {
         if (do_compress) strlcat(path, ".gz", sizeof(path));
         strlcpy(tmp_path, path, sizeof(tmp_path));
         strlcat(tmp_path, ".tmp", sizeof(tmp_path));
-        gzip_pid = redirect_to_file(stdout, tmp_path, do_compress);
+        redirect_to_file(stdout, tmp_path, do_compress, max_workers);
     }
 
     if (begin_sound) {
@@ -449,6 +548,7 @@ int main(int argc, char *argv[]) {
         fflush(vibrator);
     }
 
+    sections_init(max_workers);
     dumpstate();
 
     if (end_sound) {
@@ -463,11 +563,8 @@ int main(int argc, char *argv[]) {
         fclose(vibrator);
     }
 
-    /* wait for gzip to finish, otherwise it might get killed when we exit */
-    if (gzip_pid > 0) {
-        fclose(stdout);
-        waitpid(gzip_pid, NULL, 0);
-    }
+    /* wait for the compression to finish, otherwise the end of the report is lost */
+    finish_redirect(stdout);
 
     /* rename the (now complete) .tmp file to its final location */
     if (use_outfile && rename(tmp_path, path)) {
@@ -35,11 +35,15 @@ void print_properties();
 /* redirect output to a service control socket */
 void redirect_to_socket(FILE *redirect, const char *service);
 
-/* redirect output to a file, optionally gzipping; returns gzip pid */
-pid_t redirect_to_file(FILE *redirect, char *path, int gzip_level);
+/* redirect output to a file, optionally gzipping it with gzip_threads threads */
+void redirect_to_file(FILE *redirect, char *path, int gzip_level, int gzip_threads);
 
-/* dump Dalvik and native stack traces, return the trace file location (NULL if none) */
-const char *dump_traces();
+/* closes the redirected output, and waits for its compression (if any) to finish */
+void finish_redirect(FILE *redirect);
+
+/* dump Dalvik and native stack traces, return the trace file location (NULL if none);
+   concurrently dumps all the processes at once rather than one after the other */
+const char *dump_traces(bool concurrently);
 
 /* for each process in the system, run the specified function */
 void for_each_pid(void (*func)(int, const char *), const char *header);
@@ -47,7 +51,7 @@ void for_each_pid(void (*func)(int, const char *), const char *header);
 /* Displays a blocked processes in-kernel wait channel */
 void show_wchan(int pid, const char *name);
 
-/* Runs "showmap" for a process */
+/* Summarizes the memory maps of a process, like "showmap" */
 void do_showmap(int pid, const char *name);
 
 /* Gets the dmesg output for the kernel */
@@ -56,6 +60,19 @@ void do_dmesg();
 /* Play a sound via Stagefright */
 void play_sound(const char* path);
 
+/* run the sections that follow in up to max_workers processes at once (1: in sequence) */
+void sections_init(int max_workers);
+
+/* starts a section of the report, which should be dumped only if this returns true;
+   in parallel mode, that happens in a worker process, and the output is buffered */
+bool section_begin(const char *name);
+
+/* ends the section started by the last successful section_begin() */
+void section_end();
+
+/* waits for all sections, prints their output in order and how long they took */
+void sections_finish();
+
 /* Implemented by libdumpstate_board to dump board-specific info */
 void dumpstate_board();
 
@@ -19,6 +19,7 @@
 #include <fcntl.h>
 #include <limits.h>
 #include <poll.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -37,6 +38,8 @@
 #include <cutils/sockets.h>
 #include <private/android_filesystem_config.h>
 
+#include <zlib.h>
+
 #include "dumpstate.h"
 
 /* list of native processes to include in the native dumps */
@@ -132,24 +135,153 @@ void do_dmesg() {
     return;
 }
 
+struct smap {
+    char name[128];
+    bool is_bss;
+    int count;
+    int size, rss, pss;
+    int shared_clean, shared_dirty, private_clean, private_dirty;
+};
+
+static int compare_smap(const void *a, const void *b) {
+    const struct smap *ma = (const struct smap *) a, *mb = (const struct smap *) b;
+    int cmp = strcmp(ma->name, mb->name);
+    return cmp ? cmp : (int) ma->is_bss - (int) mb->is_bss;
+}
+
+/* adds one "Key:   123 kB" line of /proc/<pid>/smaps to the mapping */
+static void parse_smap_field(struct smap *map, const char *line) {
+    char key[32];
+    int value;
+    if (sscanf(line, "%31[^:]: %d kB", key, &value) != 2) return;
+    if (!strcmp(key, "Size")) map->size += value;
+    else if (!strcmp(key, "Rss")) map->rss += value;
+    else if (!strcmp(key, "Pss")) map->pss += value;
+    else if (!strcmp(key, "Shared_Clean")) map->shared_clean += value;
+    else if (!strcmp(key, "Shared_Dirty")) map->shared_dirty += value;
+    else if (!strcmp(key, "Private_Clean")) map->private_clean += value;
+    else if (!strcmp(key, "Private_Dirty")) map->private_dirty += value;
+}
+
+/* summarizes /proc/<pid>/smaps per object, in the format of showmap */
 void do_showmap(int pid, const char *name) {
-    static bool ran = false, skip = false;
-    char title[255];
-    char arg[255];
+    char path[255];
+    char buffer[4096];
+    struct smap *maps = NULL;
+    size_t num_maps = 0, max_maps = 0;
+    unsigned long prev_end = 0;
 
-    sprintf(title, "SHOW MAP %d (%s)", pid, name);
-    sprintf(arg, "%d", pid);
+    printf("------ SHOW MAP %d (%s) ------\n", pid, name);
 
-    if (skip) {
-        /* Skip due to non-zero exit status on first run. */
-        printf("------ %s: Skipped. ------\n", title);
-    } else {
-        int status = run_command(title, 10, SU_PATH, "root", "showmap", arg, NULL);
-        if (!ran) {
-            ran  = true;
-            skip = !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+    sprintf(path, "/proc/%d/smaps", pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        printf("*** %s: %s\n\n", path, strerror(errno));
+        return;
+    }
+
+    /* the file is read through a fixed buffer, a line at a time */
+    size_t len = 0;
+    bool eof = false;
+    while (!eof || len > 0) {
+        if (!eof && len < sizeof(buffer) - 1) {
+            ssize_t ret = TEMP_FAILURE_RETRY(read(fd, buffer + len, sizeof(buffer) - 1 - len));
+            if (ret < 0) printf("*** %s: %s\n", path, strerror(errno));
+            if (ret <= 0) eof = true;
+            else len += ret;
         }
+        buffer[len] = 0;
+
+        char *line = buffer, *nl;
+        while ((nl = strchr(line, '\n')) || (eof && *line)) {
+            if (nl) *nl = 0;
+
+            unsigned long start, end;
+            int name_pos = 0;
+            if (sscanf(line, "%lx-%lx %*s %*x %*s %*d %n", &start, &end, &name_pos) == 2) {
+                if (num_maps == max_maps) {
+                    max_maps = max_maps ? max_maps * 2 : 64;
+                    maps = realloc(maps, max_maps * sizeof(struct smap));
+                    if (maps == NULL) {
+                        printf("*** %s: out of memory\n\n", path);
+                        close(fd);
+                        return;
+                    }
+                }
+                struct smap *map = &maps[num_maps];
+                memset(map, 0, sizeof(*map));
+                map->count = 1;
+                strlcpy(map->name, name_pos ? line + name_pos : "", sizeof(map->name));
+
+                /* an anonymous mapping right after a file is its .bss */
+                if (!map->name[0] && num_maps > 0 && prev_end == start && maps[num_maps - 1].name[0]
+                        && !maps[num_maps - 1].is_bss) {
+                    strlcpy(map->name, maps[num_maps - 1].name, sizeof(map->name));
+                    map->is_bss = true;
+                }
+                prev_end = end;
+                num_maps++;
+            } else if (num_maps > 0) {
+                parse_smap_field(&maps[num_maps - 1], line);
+            }
+
+            line = nl ? nl + 1 : line + strlen(line);
+        }
+
+        len -= line - buffer;
+        memmove(buffer, line, len);
+        if (len == sizeof(buffer) - 1) len = 0;  /* overlong line, drop it */
     }
+    close(fd);
+
+    /* merge the mappings of each object */
+    qsort(maps, num_maps, sizeof(struct smap), compare_smap);
+    size_t num_objects = 0;
+    for (size_t i = 0; i < num_maps; ++i) {
+        struct smap *obj = &maps[num_objects];
+        if (num_objects > 0 && !compare_smap(obj - 1, &maps[i])) {
+            --obj;
+            obj->count++;
+            obj->size += maps[i].size;
+            obj->rss += maps[i].rss;
+            obj->pss += maps[i].pss;
+            obj->shared_clean += maps[i].shared_clean;
+            obj->shared_dirty += maps[i].shared_dirty;
+            obj->private_clean += maps[i].private_clean;
+            obj->private_dirty += maps[i].private_dirty;
+        } else {
+            if (obj != &maps[i]) *obj = maps[i];
+            num_objects++;
+        }
+    }
+
+    struct smap total;
+    memset(&total, 0, sizeof(total));
+    printf(" virtual                     shared   shared  private  private\n");
+    printf("    size      RSS      PSS    clean    dirty    clean    dirty    # object\n");
+    printf("-------- -------- -------- -------- -------- -------- -------- ---- "
+            "------------------------------\n");
+    for (size_t i = 0; i < num_objects; ++i) {
+        struct smap *obj = &maps[i];
+        printf("%8d %8d %8d %8d %8d %8d %8d %4d %s%s\n",
+                obj->size, obj->rss, obj->pss, obj->shared_clean, obj->shared_dirty,
+                obj->private_clean, obj->private_dirty, obj->count, obj->name,
+                obj->is_bss ? " [bss]" : "");
+        total.size += obj->size;
+        total.rss += obj->rss;
+        total.pss += obj->pss;
+        total.shared_clean += obj->shared_clean;
+        total.shared_dirty += obj->shared_dirty;
+        total.private_clean += obj->private_clean;
+        total.private_dirty += obj->private_dirty;
+        total.count += obj->count;
+    }
+    printf("-------- -------- -------- -------- -------- -------- -------- ---- "
+            "------------------------------\n");
+    printf("%8d %8d %8d %8d %8d %8d %8d %4d TOTAL\n\n",
+            total.size, total.rss, total.pss, total.shared_clean, total.shared_dirty,
+            total.private_clean, total.private_dirty, total.count);
+    free(maps);
 }
 
 /* prints the contents of a file */
@@ -323,8 +455,204 @@ void redirect_to_socket(FILE *redirect, const char *service) {
     close(fd);
 }
 
-/* redirect output to a file, optionally gzipping; returns gzip pid (or -1) */
-pid_t redirect_to_file(FILE *redirect, char *path, int gzip_level) {
+/* the output is compressed in blocks of this size, each written as its own gzip member */
+#define GZIP_BLOCK_SIZE (256 * 1024)
+
+/* a partial block is written out after this long without output, so that the
+   report can be read while it's being written */
+#define GZIP_IDLE_MS 1000
+
+#define GZIP_MAX_THREADS 8
+
+enum { SLOT_FREE, SLOT_FILLED, SLOT_BUSY, SLOT_DONE };
+
+struct gzip_slot {
+    int state;
+    char *in;
+    size_t in_len;
+    char *out;
+    size_t out_len;
+};
+
+static struct {
+    int in_fd, out_fd;
+    int level, threads;
+    struct gzip_slot *slots;
+    size_t num_slots, out_size;
+    size_t num_read, num_written;   /* blocks */
+    bool eof;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t reader, writer, workers[GZIP_MAX_THREADS];
+} gz;
+
+/* reads the output into the slots, a block at a time, in order */
+static void *gzip_reader(void *arg) {
+    for (;;) {
+        pthread_mutex_lock(&gz.lock);
+        struct gzip_slot *slot = &gz.slots[gz.num_read % gz.num_slots];
+        while (slot->state != SLOT_FREE) {
+            pthread_cond_wait(&gz.cond, &gz.lock);
+        }
+        pthread_mutex_unlock(&gz.lock);
+
+        size_t len = 0;
+        bool eof = false;
+        while (len < GZIP_BLOCK_SIZE) {
+            struct pollfd pfd = { gz.in_fd, POLLIN, 0 };
+            if (len > 0 && poll(&pfd, 1, GZIP_IDLE_MS) == 0) break;
+            ssize_t ret = read(gz.in_fd, slot->in + len, GZIP_BLOCK_SIZE - len);
+            if (ret < 0 && errno == EINTR) continue;
+            if (ret <= 0) {
+                eof = true;
+                break;
+            }
+            len += ret;
+        }
+
+        pthread_mutex_lock(&gz.lock);
+        if (len > 0) {
+            slot->in_len = len;
+            slot->state = SLOT_FILLED;
+            gz.num_read++;
+        }
+        gz.eof = eof;
+        pthread_cond_broadcast(&gz.cond);
+        pthread_mutex_unlock(&gz.lock);
+        if (eof) return NULL;
+    }
+}
+
+static void gzip_block(struct gzip_slot *slot) {
+    z_stream z;
+    memset(&z, 0, sizeof(z));
+    slot->out_len = 0;
+
+    /* 16 + MAX_WBITS: wrap the block in a gzip header and trailer */
+    if (deflateInit2(&z, gz.level, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        fprintf(stderr, "deflateInit2: %s\n", z.msg ? z.msg : "failed");
+        return;
+    }
+    z.next_in = (Bytef *) slot->in;
+    z.avail_in = slot->in_len;
+    z.next_out = (Bytef *) slot->out;
+    z.avail_out = gz.out_size;
+    if (deflate(&z, Z_FINISH) == Z_STREAM_END) {
+        slot->out_len = z.total_out;
+    } else {
+        fprintf(stderr, "deflate: %s\n", z.msg ? z.msg : "failed");
+    }
+    deflateEnd(&z);
+}
+
+/* compresses filled slots, in any order */
+static void *gzip_worker(void *arg) {
+    pthread_mutex_lock(&gz.lock);
+    for (;;) {
+        struct gzip_slot *slot = NULL;
+        for (size_t i = 0; i < gz.num_slots; ++i) {
+            if (gz.slots[i].state == SLOT_FILLED) {
+                slot = &gz.slots[i];
+                break;
+            }
+        }
+        if (slot == NULL) {
+            if (gz.eof) break;
+            pthread_cond_wait(&gz.cond, &gz.lock);
+            continue;
+        }
+
+        slot->state = SLOT_BUSY;
+        pthread_mutex_unlock(&gz.lock);
+        gzip_block(slot);
+        pthread_mutex_lock(&gz.lock);
+        slot->state = SLOT_DONE;
+        pthread_cond_broadcast(&gz.cond);
+    }
+    pthread_mutex_unlock(&gz.lock);
+    return NULL;
+}
+
+/* writes the compressed slots to the file, in order */
+static void *gzip_writer(void *arg) {
+    pthread_mutex_lock(&gz.lock);
+    for (;;) {
+        if (gz.num_written == gz.num_read) {
+            if (gz.eof) break;
+            pthread_cond_wait(&gz.cond, &gz.lock);
+            continue;
+        }
+        struct gzip_slot *slot = &gz.slots[gz.num_written % gz.num_slots];
+        if (slot->state != SLOT_DONE) {
+            pthread_cond_wait(&gz.cond, &gz.lock);
+            continue;
+        }
+
+        pthread_mutex_unlock(&gz.lock);
+        size_t written = 0;
+        while (written < slot->out_len) {
+            ssize_t ret = write(gz.out_fd, slot->out + written, slot->out_len - written);
+            if (ret < 0 && errno == EINTR) continue;
+            if (ret <= 0) {
+                fprintf(stderr, "write: %s\n", strerror(errno));
+                break;
+            }
+            written += ret;
+        }
+        pthread_mutex_lock(&gz.lock);
+
+        slot->state = SLOT_FREE;
+        gz.num_written++;
+        pthread_cond_broadcast(&gz.cond);
+    }
+    pthread_mutex_unlock(&gz.lock);
+    return NULL;
+}
+
+/* starts compressing what is written to the returned fd into out_fd, with up to threads threads */
+static int start_gzip(int out_fd, int level, int threads) {
+    int fds[2];
+    if (pipe(fds)) {
+        fprintf(stderr, "pipe: %s\n", strerror(errno));
+        exit(1);
+    }
+    /* commands we run shouldn't hold on to either end of the compression */
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(out_fd, F_SETFD, FD_CLOEXEC);
+
+    memset(&gz, 0, sizeof(gz));
+    gz.in_fd = fds[0];
+    gz.out_fd = out_fd;
+    gz.level = level;
+    gz.threads = threads < 1 ? 1 : (threads > GZIP_MAX_THREADS ? GZIP_MAX_THREADS : threads);
+    gz.num_slots = gz.threads * 2;
+    gz.out_size = compressBound(GZIP_BLOCK_SIZE) + 32;  /* + gzip header and trailer */
+    gz.slots = calloc(gz.num_slots, sizeof(struct gzip_slot));
+    if (gz.slots == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < gz.num_slots; ++i) {
+        gz.slots[i].in = malloc(GZIP_BLOCK_SIZE);
+        gz.slots[i].out = malloc(gz.out_size);
+        if (gz.slots[i].in == NULL || gz.slots[i].out == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    pthread_mutex_init(&gz.lock, NULL);
+    pthread_cond_init(&gz.cond, NULL);
+
+    pthread_create(&gz.reader, NULL, gzip_reader, NULL);
+    pthread_create(&gz.writer, NULL, gzip_writer, NULL);
+    for (int i = 0; i < gz.threads; ++i) {
+        pthread_create(&gz.workers[i], NULL, gzip_worker, NULL);
+    }
+    return fds[1];
+}
+
+/* redirect output to a file, optionally gzipping it with gzip_threads threads */
+void redirect_to_file(FILE *redirect, char *path, int gzip_level, int gzip_threads) {
     char *chp = path;
 
     /* skip initial slash */
@@ -347,46 +675,34 @@ pid_t redirect_to_file(FILE *redirect, char *path, int gzip_level) {
         exit(1);
     }
 
-    pid_t gzip_pid = -1;
     if (gzip_level > 0) {
-        int fds[2];
-        if (pipe(fds)) {
-            fprintf(stderr, "pipe: %s\n", strerror(errno));
-            exit(1);
-        }
-
         fflush(redirect);
-        fflush(stdout);
-
-        gzip_pid = fork();
-        if (gzip_pid < 0) {
-            fprintf(stderr, "fork: %s\n", strerror(errno));
-            exit(1);
-        }
-
-        if (gzip_pid == 0) {
-            dup2(fds[0], STDIN_FILENO);
-            dup2(fd, STDOUT_FILENO);
+        fd = start_gzip(fd, gzip_level, gzip_threads);
+    }
 
-            close(fd);
-            close(fds[0]);
-            close(fds[1]);
+    dup2(fd, fileno(redirect));
+    close(fd);
+}
 
-            char level[10];
-            snprintf(level, sizeof(level), "-%d", gzip_level);
-            execlp("gzip", "gzip", level, NULL);
-            fprintf(stderr, "exec(gzip): %s\n", strerror(errno));
-            _exit(-1);
-        }
+/* closes the redirected output, and waits for its compression (if any) to finish */
+void finish_redirect(FILE *redirect) {
+    if (gz.slots == NULL) return;
 
-        close(fd);
-        close(fds[0]);
-        fd = fds[1];
+    fclose(redirect);
+    pthread_join(gz.reader, NULL);
+    for (int i = 0; i < gz.threads; ++i) {
+        pthread_join(gz.workers[i], NULL);
     }
+    pthread_join(gz.writer, NULL);
 
-    dup2(fd, fileno(redirect));
-    close(fd);
-    return gzip_pid;
+    close(gz.in_fd);
+    close(gz.out_fd);
+    for (size_t i = 0; i < gz.num_slots; ++i) {
+        free(gz.slots[i].in);
+        free(gz.slots[i].out);
+    }
+    free(gz.slots);
+    gz.slots = NULL;
 }
 
 static bool should_dump_native_traces(const char* path) {
@@ -398,8 +714,216 @@ static bool should_dump_native_traces(const char* path) {
     return false;
 }
 
+static uint64_t nanotime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+enum { TRACE_NONE, TRACE_DALVIK, TRACE_NATIVE };
+
+/* tells how the stack traces of a process are dumped, if they are at all */
+static int get_trace_kind(int pid) {
+    char path[PATH_MAX];
+    char data[PATH_MAX];
+    snprintf(path, sizeof(path), "/proc/%d/exe", pid);
+    ssize_t len = readlink(path, data, sizeof(data) - 1);
+    if (len <= 0) {
+        return TRACE_NONE;
+    }
+    data[len] = '\0';
+
+    if (!strcmp(data, "/system/bin/app_process")) {
+        /* skip zygote -- it won't dump its stack anyway */
+        snprintf(path, sizeof(path), "/proc/%d/cmdline", pid);
+        int fd = open(path, O_RDONLY);
+        len = read(fd, data, sizeof(data) - 1);
+        close(fd);
+        if (len <= 0) {
+            return TRACE_NONE;
+        }
+        data[len] = '\0';
+        return strcmp(data, "zygote") ? TRACE_DALVIK : TRACE_NONE;
+    }
+    return should_dump_native_traces(data) ? TRACE_NATIVE : TRACE_NONE;
+}
+
+#define DALVIK_TRACES_TIMEOUT_MS 200    /* for each process */
+#define NATIVE_TRACES_TIMEOUT_MS 10000  /* for all of them */
+
+struct native_trace {
+    pid_t pid;              /* process dumped */
+    pid_t worker;           /* process dumping it */
+    int fd;                 /* unlinked temp file the worker writes to */
+};
+
+/* appends the contents of the file open as in_fd to out_fd */
+static void append_file(int in_fd, int out_fd) {
+    char buf[32768];
+    ssize_t len;
+    if (lseek(in_fd, 0, SEEK_SET) < 0 || lseek(out_fd, 0, SEEK_END) < 0) {
+        fprintf(stderr, "lseek: %s\n", strerror(errno));
+        return;
+    }
+    while ((len = TEMP_FAILURE_RETRY(read(in_fd, buf, sizeof(buf)))) > 0) {
+        if (TEMP_FAILURE_RETRY(write(out_fd, buf, len)) != len) {
+            fprintf(stderr, "write: %s\n", strerror(errno));
+            return;
+        }
+    }
+}
+
+/* signals the Dalvik processes and dumps the native ones found in /proc, waiting
+   for each before moving on to the next; returns the number of Dalvik processes */
+static int dump_traces_one_by_one(DIR *proc, int ifd, int fd) {
+    int dalvik_found = 0;
+    struct dirent *d;
+    while ((d = readdir(proc))) {
+        int pid = atoi(d->d_name);
+        if (pid <= 0) continue;
+
+        int kind = get_trace_kind(pid);
+        if (kind == TRACE_DALVIK) {
+            ++dalvik_found;
+            if (kill(pid, SIGQUIT)) {
+                fprintf(stderr, "kill(%d, SIGQUIT): %s\n", pid, strerror(errno));
+                continue;
+            }
+
+            /* wait for the writable-close notification from inotify */
+            struct pollfd pfd = { ifd, POLLIN, 0 };
+            int ret = poll(&pfd, 1, DALVIK_TRACES_TIMEOUT_MS);
+            if (ret < 0) {
+                fprintf(stderr, "poll: %s\n", strerror(errno));
+            } else if (ret == 0) {
+                fprintf(stderr, "warning: timed out dumping pid %d\n", pid);
+            } else {
+                struct inotify_event ie;
+                read(ifd, &ie, sizeof(ie));
+            }
+        } else if (kind == TRACE_NATIVE) {
+            /* dump native process if appropriate */
+            if (lseek(fd, 0, SEEK_END) < 0) {
+                fprintf(stderr, "lseek: %s\n", strerror(errno));
+            } else {
+                dump_backtrace_to_file(pid, fd);
+            }
+        }
+    }
+
+    return dalvik_found;
+}
+
+/* does what dump_traces_one_by_one() does, but signals all the Dalvik processes
+   at once and dumps each native one from its own worker into its own temp file;
+   these are appended to fd in /proc order once done or timed out. Dalvik
+   processes all append to traces_path themselves, in the order they finish.
+   Returns the number of Dalvik processes found. */
+static int dump_traces_concurrently(DIR *proc, int ifd, int fd, const char *traces_path) {
+    struct native_trace *natives = NULL;
+    size_t num_natives = 0, max_natives = 0;
+    int dalvik_found = 0, dalvik_pending = 0;
+    uint64_t start = nanotime();
+
+    struct dirent *d;
+    while ((d = readdir(proc))) {
+        int pid = atoi(d->d_name);
+        if (pid <= 0) continue;
+
+        int kind = get_trace_kind(pid);
+        if (kind == TRACE_DALVIK) {
+            ++dalvik_found;
+            if (kill(pid, SIGQUIT)) {
+                fprintf(stderr, "kill(%d, SIGQUIT): %s\n", pid, strerror(errno));
+                continue;
+            }
+            ++dalvik_pending;
+        } else if (kind == TRACE_NATIVE) {
+            if (num_natives == max_natives) {
+                size_t count = max_natives ? max_natives * 2 : 8;
+                struct native_trace *n = realloc(natives, count * sizeof(*n));
+                if (n == NULL) {
+                    fprintf(stderr, "out of memory dumping pid %d\n", pid);
+                    continue;
+                }
+                natives = n;
+                max_natives = count;
+            }
+
+            char path[PATH_MAX];
+            snprintf(path, sizeof(path), "%s.%d", traces_path, pid);
+            int tmp_fd = open(path, O_CREAT | O_RDWR | O_TRUNC | O_NOFOLLOW, 0600);
+            if (tmp_fd < 0) {
+                fprintf(stderr, "%s: %s\n", path, strerror(errno));
+                continue;
+            }
+            unlink(path);
+
+            pid_t worker = fork();
+            if (worker < 0) {
+                fprintf(stderr, "fork: %s\n", strerror(errno));
+                close(tmp_fd);
+                continue;
+            }
+            if (worker == 0) {
+                dump_backtrace_to_file(pid, tmp_fd);
+                _exit(0);
+            }
+
+            struct native_trace *n = &natives[num_natives++];
+            n->pid = pid;
+            n->worker = worker;
+            n->fd = tmp_fd;
+        }
+    }
+
+    /* wait for as many writable-close notifications as processes signaled */
+    uint64_t deadline = start + dalvik_pending * DALVIK_TRACES_TIMEOUT_MS * 1000000ULL;
+    while (dalvik_pending > 0) {
+        uint64_t now = nanotime();
+        if (now >= deadline) {
+            fprintf(stderr, "warning: timed out dumping %d Dalvik processes\n",
+                    dalvik_pending);
+            break;
+        }
+        struct pollfd pfd = { ifd, POLLIN, 0 };
+        int ret = poll(&pfd, 1, (deadline - now + 999999) / 1000000);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "poll: %s\n", strerror(errno));
+            break;
+        } else if (ret > 0) {
+            struct inotify_event ie[32];
+            ssize_t len = read(ifd, ie, sizeof(ie));
+            if (len > 0) {
+                dalvik_pending -= len / sizeof(ie[0]);
+            }
+        }
+    }
+
+    /* the native workers have been running meanwhile */
+    deadline = start + NATIVE_TRACES_TIMEOUT_MS * 1000000ULL;
+    for (size_t i = 0; i < num_natives; ++i) {
+        struct native_trace *n = &natives[i];
+        while (waitpid(n->worker, NULL, WNOHANG) == 0) {
+            if (nanotime() >= deadline) {
+                fprintf(stderr, "warning: timed out dumping pid %d\n", n->pid);
+                kill(n->worker, SIGKILL);
+                waitpid(n->worker, NULL, 0);
+                break;
+            }
+            usleep(10000);
+        }
+        append_file(n->fd, fd);
+        close(n->fd);
+    }
+    free(natives);
+
+    return dalvik_found;
+}
+
 /* dump Dalvik and native stack traces, return the trace file location (NULL if none) */
-const char *dump_traces() {
+const char *dump_traces(bool concurrently) {
     const char* result = NULL;
 
     char traces_path[PROPERTY_VALUE_MAX] = "";
@@ -463,61 +987,8 @@ const char *dump_traces() {
         goto error_close_ifd;
     }
 
-    struct dirent *d;
-    int dalvik_found = 0;
-    while ((d = readdir(proc))) {
-        int pid = atoi(d->d_name);
-        if (pid <= 0) continue;
-
-        char path[PATH_MAX];
-        char data[PATH_MAX];
-        snprintf(path, sizeof(path), "/proc/%d/exe", pid);
-        ssize_t len = readlink(path, data, sizeof(data) - 1);
-        if (len <= 0) {
-            continue;
-        }
-        data[len] = '\0';
-
-        if (!strcmp(data, "/system/bin/app_process")) {
-            /* skip zygote -- it won't dump its stack anyway */
-            snprintf(path, sizeof(path), "/proc/%d/cmdline", pid);
-            int fd = open(path, O_RDONLY);
-            len = read(fd, data, sizeof(data) - 1);
-            close(fd);
-            if (len <= 0) {
-                continue;
-            }
-            data[len] = '\0';
-            if (!strcmp(data, "zygote")) {
-                continue;
-            }
-
-            ++dalvik_found;
-            if (kill(pid, SIGQUIT)) {
-                fprintf(stderr, "kill(%d, SIGQUIT): %s\n", pid, strerror(errno));
-                continue;
-            }
-
-            /* wait for the writable-close notification from inotify */
-            struct pollfd pfd = { ifd, POLLIN, 0 };
-            int ret = poll(&pfd, 1, 200);  /* 200 msec timeout */
-            if (ret < 0) {
-                fprintf(stderr, "poll: %s\n", strerror(errno));
-            } else if (ret == 0) {
-                fprintf(stderr, "warning: timed out dumping pid %d\n", pid);
-            } else {
-                struct inotify_event ie;
-                read(ifd, &ie, sizeof(ie));
-            }
-        } else if (should_dump_native_traces(data)) {
-            /* dump native process if appropriate */
-            if (lseek(fd, 0, SEEK_END) < 0) {
-                fprintf(stderr, "lseek: %s\n", strerror(errno));
-            } else {
-                dump_backtrace_to_file(pid, fd);
-            }
-        }
-    }
+    int dalvik_found = concurrently ? dump_traces_concurrently(proc, ifd, fd, traces_path)
+                                    : dump_traces_one_by_one(proc, ifd, fd);
 
     if (dalvik_found == 0) {
         fprintf(stderr, "Warning: no Dalvik processes found to dump stacks\n");
@@ -545,3 +1016,169 @@ error_close_fd:
 void play_sound(const char* path) {
     run_command(NULL, 5, "/system/bin/stagefright", "-o", "-a", path, NULL);
 }
+
+struct section {
+    char name[64];
+    pid_t pid;
+    int fd;                 /* read end of the worker's stdout, -1 once at EOF */
+    char *buf;              /* output not printed yet */
+    size_t len, size;
+    bool done;
+    uint64_t start, end;    /* nanoseconds */
+};
+
+static int max_section_workers = 1;
+static bool in_section_worker = false;
+static struct section *sections = NULL;
+static size_t num_sections = 0, max_sections = 0;
+static size_t next_section = 0;     /* first section whose output isn't all printed */
+static int running_sections = 0;
+
+/* prints what it can of the sections' output, in order */
+static void print_sections() {
+    while (next_section < num_sections) {
+        struct section *sec = &sections[next_section];
+        if (sec->len) {
+            fwrite(sec->buf, sec->len, 1, stdout);
+            sec->len = 0;
+        }
+        if (!sec->done) break;
+        free(sec->buf);
+        sec->buf = NULL;
+        next_section++;
+    }
+    fflush(stdout);
+}
+
+/* waits for output from the running sections, and collects it */
+static void poll_sections() {
+    struct pollfd pfds[max_section_workers];
+    size_t index[max_section_workers];
+    int n = 0;
+
+    for (size_t i = next_section; i < num_sections && n < max_section_workers; ++i) {
+        if (sections[i].fd >= 0) {
+            pfds[n].fd = sections[i].fd;
+            pfds[n].events = POLLIN;
+            pfds[n].revents = 0;
+            index[n++] = i;
+        }
+    }
+    if (n == 0 || poll(pfds, n, -1) <= 0) return;
+
+    for (int i = 0; i < n; ++i) {
+        if (!pfds[i].revents) continue;
+        struct section *sec = &sections[index[i]];
+
+        if (sec->size - sec->len < 32768) {
+            size_t size = sec->size ? sec->size * 2 : 65536;
+            char *buf = realloc(sec->buf, size);
+            if (buf == NULL) {
+                fprintf(stderr, "out of memory buffering %s\n", sec->name);
+                continue;
+            }
+            sec->buf = buf;
+            sec->size = size;
+        }
+
+        ssize_t ret = read(sec->fd, sec->buf + sec->len, sec->size - sec->len);
+        if (ret > 0) {
+            sec->len += ret;
+        } else if (ret == 0 || errno != EINTR) {
+            close(sec->fd);
+            sec->fd = -1;
+            waitpid(sec->pid, NULL, 0);
+            sec->end = nanotime();
+            sec->done = true;
+            running_sections--;
+        }
+    }
+    print_sections();
+}
+
+void sections_init(int max_workers) {
+    max_section_workers = max_workers > 1 ? max_workers : 1;
+}
+
+bool section_begin(const char *name) {
+    if (max_section_workers <= 1 || in_section_worker) return true;
+
+    while (running_sections >= max_section_workers) {
+        poll_sections();
+    }
+
+    if (num_sections == max_sections) {
+        size_t count = max_sections ? max_sections * 2 : 32;
+        struct section *s = realloc(sections, count * sizeof(struct section));
+        if (s == NULL) {
+            fprintf(stderr, "out of memory starting %s\n", name);
+            return false;
+        }
+        sections = s;
+        max_sections = count;
+    }
+
+    int fds[2];
+    if (pipe(fds)) {
+        printf("*** pipe: %s\n", strerror(errno));
+        return false;
+    }
+
+    fflush(stdout);
+    uint64_t start = nanotime();
+    pid_t pid = fork();
+    if (pid < 0) {
+        printf("*** fork: %s\n", strerror(errno));
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+
+    if (pid == 0) {
+        /* the worker dumps the section to the pipe, and exits in section_end() */
+        in_section_worker = true;
+        close(fds[0]);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[1]);
+        return true;
+    }
+
+    close(fds[1]);
+    struct section *sec = &sections[num_sections++];
+    memset(sec, 0, sizeof(*sec));
+    strlcpy(sec->name, name, sizeof(sec->name));
+    sec->pid = pid;
+    sec->fd = fds[0];
+    sec->start = start;
+    running_sections++;
+    return false;
+}
+
+void section_end() {
+    if (in_section_worker) {
+        fflush(stdout);
+        _exit(0);
+    }
+}
+
+void sections_finish() {
+    if (num_sections == 0) return;
+
+    while (running_sections > 0) {
+        poll_sections();
+    }
+    print_sections();
+
+    uint64_t first = sections[0].start, last = sections[0].end;
+    printf("------ SECTION DURATIONS (%d workers) ------\n", max_section_workers);
+    for (size_t i = 0; i < num_sections; ++i) {
+        printf("%-40s %6.2fs\n", sections[i].name,
+                (sections[i].end - sections[i].start) / 1e9);
+        if (sections[i].end > last) last = sections[i].end;
+    }
+    printf("%-40s %6.2fs\n\n", "TOTAL", (last - first) / 1e9);
+
+    free(sections);
+    sections = NULL;
+    num_sections = max_sections = next_section = 0;
+}
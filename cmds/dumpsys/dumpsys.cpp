@@ -9,10 +9,16 @@
 #include <binder/Parcel.h>
 #include <binder/ProcessState.h>
 #include <binder/IServiceManager.h>
+#include <utils/String8.h>
 #include <utils/TextOutput.h>
+#include <utils/Timers.h>
 #include <utils/Vector.h>
 
+#include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -21,11 +27,83 @@
 
 using namespace android;
 
+// default time a service gets to dump itself
+static const int DEFAULT_TIMEOUT_SECONDS = 10;
+
 static int sort_func(const String16* lhs, const String16* rhs)
 {
     return lhs->compare(*rhs);
 }
 
+static void writeAll(int fd, const char* data, size_t len)
+{
+    while (len > 0) {
+        ssize_t written = write(fd, data, len);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return;
+        data += written;
+        len -= written;
+    }
+}
+
+/*
+ * A service being dumped: a thread makes the (blocking) dump call into a
+ * pipe, and the main thread reads the other end, so that it can give up on
+ * a service which doesn't finish in time.  Only the first unfinished dump
+ * is copied to stdout as it comes; the others are buffered until their
+ * turn, so that the output is in order.
+ */
+struct DumpJob {
+    String16 name;
+    sp<IBinder> service;
+    const Vector<String16>* args;
+    pthread_t thread;
+    int readFd;
+    int writeFd;
+    status_t err;
+    nsecs_t deadline;
+    String8 output;
+    bool started;
+    bool finished;
+    bool timedOut;
+
+    DumpJob() : args(NULL), readFd(-1), writeFd(-1), err(NO_ERROR), deadline(0),
+            started(false), finished(false), timedOut(false) { }
+};
+
+static void* dumpThread(void* arg)
+{
+    DumpJob* job = static_cast<DumpJob*>(arg);
+    job->err = job->service->dump(job->writeFd, *job->args);
+    // the reader sees EOF once the service is done with its copy too
+    close(job->writeFd);
+    return NULL;
+}
+
+static bool startJob(DumpJob* job, nsecs_t timeout)
+{
+    job->started = true;
+    int fds[2];
+    if (pipe(fds) < 0) {
+        aerr << "Can't create pipe for " << job->name << ": " << strerror(errno) << endl;
+        job->finished = true;
+        return false;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    job->readFd = fds[0];
+    job->writeFd = fds[1];
+    job->deadline = timeout > 0 ? systemTime(SYSTEM_TIME_MONOTONIC) + timeout : 0;
+    if (pthread_create(&job->thread, NULL, dumpThread, job) != 0) {
+        aerr << "Can't create thread for " << job->name << endl;
+        close(job->readFd);
+        close(job->writeFd);
+        job->finished = true;
+        return false;
+    }
+    return true;
+}
+
 int main(int argc, char* const argv[])
 {
     signal(SIGPIPE, SIG_IGN);
@@ -37,15 +115,33 @@ int main(int argc, char* const argv[])
         return 20;
     }
 
+    // option parsing stops at the service name, the rest are its arguments
+    int timeoutSeconds = DEFAULT_TIMEOUT_SECONDS;
+    size_t maxJobs = 1;
+    int argi = 1;
+    while (argi < argc && argv[argi][0] == '-') {
+        if (!strcmp(argv[argi], "-t") && argi + 1 < argc) {
+            timeoutSeconds = atoi(argv[argi + 1]);
+        } else if (!strcmp(argv[argi], "-j") && argi + 1 < argc) {
+            int jobs = atoi(argv[argi + 1]);
+            maxJobs = jobs > 1 ? jobs : 1;
+        } else {
+            aerr << "usage: dumpsys [-t timeout_seconds] [-j jobs] [service [args...]]" << endl;
+            return 1;
+        }
+        argi += 2;
+    }
+    const nsecs_t timeout = seconds_to_nanoseconds(timeoutSeconds);
+
     Vector<String16> services;
     Vector<String16> args;
-    if (argc == 1) {
+    if (argi == argc) {
         services = sm->listServices();
         services.sort(sort_func);
         args.add(String16("-a"));
     } else {
-        services.add(String16(argv[1]));
-        for (int i=2; i<argc; i++) {
+        services.add(String16(argv[argi]));
+        for (int i=argi+1; i<argc; i++) {
             args.add(String16(argv[i]));
         }
     }
@@ -64,21 +160,112 @@ int main(int argc, char* const argv[])
         }
     }
 
+    // never freed: the threads of timed-out dumps may still be using them
+    DumpJob* jobs = new DumpJob[N];
     for (size_t i=0; i<N; i++) {
-        sp<IBinder> service = sm->checkService(services[i]);
-        if (service != NULL) {
-            if (N > 1) {
-                aout << "------------------------------------------------------------"
-                        "-------------------" << endl;
-                aout << "DUMP OF SERVICE " << services[i] << ":" << endl;
+        jobs[i].name = services[i];
+        jobs[i].args = &args;
+    }
+
+    size_t head = 0;        // first job whose output isn't all printed
+    size_t next = 0;        // next job to start
+    size_t running = 0;
+    bool headStarted = false;
+    Vector<struct pollfd> fds;
+    Vector<size_t> fdJobs;
+
+    while (head < N) {
+        // start as many dumps as allowed
+        while (running < maxJobs && next < N) {
+            DumpJob& job = jobs[next++];
+            job.service = sm->checkService(job.name);
+            if (job.service == NULL) {
+                job.started = job.finished = true;
+            } else if (startJob(&job, timeout)) {
+                running++;
             }
-            int err = service->dump(STDOUT_FILENO, args);
-            if (err != 0) {
-                aerr << "Error dumping service info: (" << strerror(err)
-                        << ") " << services[i] << endl;
+        }
+
+        // print the head job's header and what is buffered for it, then
+        // move on if it is done
+        DumpJob& h = jobs[head];
+        if (h.started && !headStarted) {
+            headStarted = true;
+            if (h.service == NULL) {
+                aerr << "Can't find service: " << h.name << endl;
+            } else if (N > 1) {
+                String8 header("------------------------------------------------------------"
+                        "-------------------\n");
+                header.appendFormat("DUMP OF SERVICE %s:\n", String8(h.name).string());
+                writeAll(STDOUT_FILENO, header.string(), header.length());
+            }
+        }
+        if (headStarted && h.output.length()) {
+            writeAll(STDOUT_FILENO, h.output.string(), h.output.length());
+            h.output = String8();
+        }
+        if (h.finished) {
+            if (h.timedOut) {
+                String8 msg;
+                msg.appendFormat("*** SERVICE %s DUMP TIMEOUT (%ds) EXPIRED ***\n",
+                        String8(h.name).string(), timeoutSeconds);
+                writeAll(STDOUT_FILENO, msg.string(), msg.length());
+                aerr << "Timed out dumping service: " << h.name << endl;
+            } else if (h.err != 0) {
+                aerr << "Error dumping service info: (" << strerror(h.err)
+                        << ") " << h.name << endl;
+            }
+            head++;
+            headStarted = false;
+            continue;
+        }
+
+        // wait for output from the running dumps, or the first deadline
+        nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        nsecs_t wait = -1;
+        fds.clear();
+        fdJobs.clear();
+        for (size_t i=head; i<next; i++) {
+            DumpJob& job = jobs[i];
+            if (job.finished) continue;
+            if (job.deadline && job.deadline <= now) {
+                // the dump thread is left behind, blocked in the service
+                job.timedOut = job.finished = true;
+                close(job.readFd);
+                pthread_detach(job.thread);
+                running--;
+                continue;
+            }
+            if (job.deadline && (wait < 0 || job.deadline - now < wait)) {
+                wait = job.deadline - now;
+            }
+            struct pollfd pfd = { job.readFd, POLLIN, 0 };
+            fds.add(pfd);
+            fdJobs.add(i);
+        }
+        if (fds.isEmpty()) continue;
+
+        int timeoutMs = wait < 0 ? -1 : int(nanoseconds_to_milliseconds(wait)) + 1;
+        if (poll(fds.editArray(), fds.size(), timeoutMs) <= 0) continue;
+
+        for (size_t i=0; i<fds.size(); i++) {
+            if (!fds[i].revents) continue;
+            DumpJob& job = jobs[fdJobs[i]];
+            char buffer[4096];
+            ssize_t len = read(job.readFd, buffer, sizeof(buffer));
+            if (len < 0 && errno == EINTR) continue;
+            if (len > 0) {
+                if (fdJobs[i] == head && headStarted) {
+                    writeAll(STDOUT_FILENO, buffer, len);
+                } else {
+                    job.output.append(buffer, len);
+                }
+            } else {
+                close(job.readFd);
+                pthread_join(job.thread, NULL);
+                job.finished = true;
+                running--;
             }
-        } else {
-            aerr << "Can't find service: " << services[i] << endl;
         }
     }
 
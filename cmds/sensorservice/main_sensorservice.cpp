@@ -20,6 +20,10 @@
 using namespace android;
 
 int main(int argc, char** argv) {
+    // binder threads that stay idle leave the pool
+    sp<ProcessState> ps(ProcessState::self());
+    ps->setThreadPoolMinThreadCount(2);
+    ps->setThreadPoolIdleTimeout(s2ns(10));
     SensorService::publishAndJoinThreadPool();
     return 0;
 }
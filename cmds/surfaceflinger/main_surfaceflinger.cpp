@@ -20,9 +20,13 @@
 using namespace android;
 
 int main(int argc, char** argv) {
-    SurfaceFlinger::publishAndJoinThreadPool(true);
     // When SF is launched in its own process, limit the number of
-    // binder threads to 4.
-    ProcessState::self()->setThreadPoolMaxThreadCount(4);
+    // binder threads to 4, and let the ones that stay idle go. Screenshots
+    // and buffer traffic need more room for transactions than the default.
+    sp<ProcessState> ps(ProcessState::initWithVMSize(2*1024*1024 - 4096*2));
+    ps->setThreadPoolMaxThreadCount(4);
+    ps->setThreadPoolMinThreadCount(2);
+    ps->setThreadPoolIdleTimeout(s2ns(10));
+    SurfaceFlinger::publishAndJoinThreadPool(true);
     return 0;
 }
@@ -61,6 +61,25 @@ public:
             status_t    setConstantData(const void* data, size_t size);
             void        sendObituary();
 
+            // Asks the remote object for a token to send instead of its
+            // descriptor "interface" in the header of later calls, which
+            // is then cheaper to check.  This is a blocking call the first
+            // time only; returns the token, or 0 if the remote object
+            // doesn't support tokens or has another descriptor.
+            int32_t     negotiateInterfaceToken(const String16& interface);
+            // The token negotiated for "interface", or 0.  Never blocks.
+            int32_t     interfaceToken(const String16& interface) const;
+
+            // The proxy created last for the interface with this
+            // descriptor, if it is still in use.  The address of the
+            // interface's descriptor is the key, see interface_cast().
+            sp<IInterface> findProxy(const String16* descriptor) const;
+            // Remembers "proxy", a new proxy for the interface "descriptor",
+            // without holding on to it.  Returns the proxy to use, which is
+            // an older one if another thread attached it meanwhile.
+            sp<IInterface> attachProxy(const String16* descriptor,
+                                       const sp<IInterface>& proxy);
+
     class ObjectManager
     {
     public:
@@ -115,6 +134,9 @@ private:
             ObjectManager       mObjects;
             Parcel*             mConstantData;
     mutable String16            mDescriptorCache;
+            // 0 until negotiated, -1 if the remote object has no token
+            volatile int32_t    mInterfaceToken;
+            String16            mTokenDescriptor;
 };
 
 }; // namespace android
@@ -19,6 +19,7 @@
 #define ANDROID_IINTERFACE_H
 
 #include <binder/Binder.h>
+#include <binder/BpBinder.h>
 
 namespace android {
 
@@ -71,6 +72,13 @@ protected:
 
 // ----------------------------------------------------------------------
 
+// Returns a PROXY for the remote binder "obj", the one already in use
+// for INTERFACE if there is one.
+template<typename INTERFACE, typename PROXY>
+sp<INTERFACE> proxy_cast(const sp<IBinder>& obj);
+
+// ----------------------------------------------------------------------
+
 #define DECLARE_META_INTERFACE(INTERFACE)                               \
     static const android::String16 descriptor;                          \
     static android::sp<I##INTERFACE> asInterface(                       \
@@ -95,7 +103,8 @@ protected:
                 obj->queryLocalInterface(                               \
                         I##INTERFACE::descriptor).get());               \
             if (intr == NULL) {                                         \
-                intr = new Bp##INTERFACE(obj);                          \
+                intr = android::proxy_cast<I##INTERFACE,                \
+                        Bp##INTERFACE>(obj);                            \
             }                                                           \
         }                                                               \
         return intr;                                                    \
@@ -115,7 +124,9 @@ template<typename INTERFACE>
 inline sp<IInterface> BnInterface<INTERFACE>::queryLocalInterface(
         const String16& _descriptor)
 {
-    if (_descriptor == INTERFACE::descriptor) return this;
+    // asInterface() passes the descriptor itself
+    if (&_descriptor == &INTERFACE::descriptor
+            || _descriptor == INTERFACE::descriptor) return this;
     return NULL;
 }
 
@@ -142,6 +153,19 @@ inline IBinder* BpInterface<INTERFACE>::onAsBinder()
 {
     return remote();
 }
+
+template<typename INTERFACE, typename PROXY>
+sp<INTERFACE> proxy_cast(const sp<IBinder>& obj)
+{
+    BpBinder* remote = obj->remoteBinder();
+    if (remote == NULL) return new PROXY(obj);
+
+    sp<IInterface> proxy(remote->findProxy(&INTERFACE::descriptor));
+    if (proxy == NULL) {
+        proxy = remote->attachProxy(&INTERFACE::descriptor, new PROXY(obj));
+    }
+    return static_cast<INTERFACE*>(proxy.get());
+}
     
 // ----------------------------------------------------------------------
 
@@ -37,7 +37,8 @@ public:
     // flags returned by getFlags()
     enum {
         READ_ONLY   = 0x00000001,
-        USE_ION_FD  = 0x00000008
+        USE_ION_FD  = 0x00000008,
+        NO_CACHING  = 0x00000200
     };
 
     virtual int         getHeapID() const = 0;
@@ -46,6 +47,14 @@ public:
     virtual uint32_t    getFlags() const = 0;
     virtual uint32_t    getOffset() const = 0;
 
+    // Cache maintenance of [offset, offset+size) for memory shared with
+    // hardware: flushCache() writes back what the CPU wrote before the
+    // hardware reads it, invalidateCache() drops stale lines before the CPU
+    // reads what the hardware wrote. Nothing to do for uncached heaps,
+    // which is the default.
+    virtual status_t    flushCache(size_t offset, size_t size) const;
+    virtual status_t    invalidateCache(size_t offset, size_t size) const;
+
     // these are there just for backward source compatibility
     int32_t heapID() const { return getHeapID(); }
     void*   base() const  { return getBase(); }
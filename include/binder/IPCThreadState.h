@@ -20,6 +20,7 @@
 #include <utils/Errors.h>
 #include <binder/Parcel.h>
 #include <binder/ProcessState.h>
+#include <utils/Timers.h>
 #include <utils/Vector.h>
 
 #ifdef HAVE_WIN32_PROC
@@ -62,6 +63,17 @@ public:
                                          uint32_t code, const Parcel& data,
                                          Parcel* reply, uint32_t flags);
 
+            // While enabled, the one-way transactions this thread sends to
+            // the same handle are queued and handed to the driver together,
+            // when the next synchronous call, reply or flushCommands() is
+            // made, when another handle is called, or once the batch is
+            // full (16 calls) or its oldest call is older than 2 ms when
+            // another one-way call is sent.
+            // Errors of batched calls are only seen by flushOneWayBatch().
+            // Disabling the batching flushes the pending calls.
+            void                setOneWayBatching(bool enabled);
+            status_t            flushOneWayBatch();
+
             void                incStrongHandle(int32_t handle);
             void                decStrongHandle(int32_t handle);
             void                incWeakHandle(int32_t handle);
@@ -97,6 +109,10 @@ private:
                                                      const Parcel& data,
                                                      status_t* statusBuffer);
             status_t            executeCommand(int32_t command);
+            status_t            queueOneWayTransaction(int32_t handle,
+                                                       uint32_t code,
+                                                       const Parcel& data,
+                                                       uint32_t flags);
             
             void                clearCaller();
             
@@ -118,6 +134,13 @@ private:
             uid_t               mCallingUid;
             int32_t             mStrictModePolicy;
             int32_t             mLastTransactionBinderFlags;
+
+            // copies of the batched one-way transactions' data, which the
+            // BC_TRANSACTIONs in mOut point to until they are sent
+            bool                mOneWayBatching;
+            Vector<Parcel*>     mBatchedData;
+            int32_t             mBatchHandle;
+            nsecs_t             mBatchStartTime;
 };
 
 }; // namespace android
@@ -22,6 +22,7 @@
 #include <binder/IPermissionController.h>
 #include <utils/Vector.h>
 #include <utils/String16.h>
+#include <utils/Timers.h>
 
 namespace android {
 
@@ -33,13 +34,14 @@ public:
     DECLARE_META_INTERFACE(ServiceManager);
 
     /**
-     * Retrieve an existing service, blocking for a few seconds
+     * Retrieve an existing service, blocking for up to 5 seconds
      * if it doesn't yet exist.
      */
     virtual sp<IBinder>         getService( const String16& name) const = 0;
 
     /**
      * Retrieve an existing service, non-blocking.
+     * Services already found are cached by the process until they die.
      */
     virtual sp<IBinder>         checkService( const String16& name) const = 0;
 
@@ -65,6 +67,12 @@ public:
 
 sp<IServiceManager> defaultServiceManager();
 
+/**
+ * Retrieve a service, waiting up to timeout for it to be registered. The
+ * service manager is polled with a delay growing from 5 ms to 500 ms.
+ */
+sp<IBinder> waitForService(const String16& name, nsecs_t timeout);
+
 template<typename INTERFACE>
 status_t getService(const String16& name, sp<INTERFACE>* outService)
 {
@@ -34,7 +34,13 @@ class SimpleBestFitAllocator;
 class MemoryDealer : public RefBase
 {
 public:
-    MemoryDealer(size_t size, const char* name = 0);
+    enum {
+        // take blocks from free lists segregated by size instead of
+        // searching the whole heap for the best fit
+        SEGREGATED_FIT = 0x00000001
+    };
+
+    MemoryDealer(size_t size, const char* name = 0, uint32_t flags = 0);
 
     virtual sp<IMemory> allocate(size_t size);
     virtual void        deallocate(size_t offset);
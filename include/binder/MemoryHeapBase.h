@@ -35,7 +35,7 @@ public:
         // memory won't be mapped locally, but will be mapped in the remote
         // process.
         DONT_MAP_LOCALLY = 0x00000100,
-        NO_CACHING = 0x00000200
+        NO_CACHING = IMemoryHeap::NO_CACHING
     };
 
     /*
@@ -40,10 +40,23 @@ public:
     enum {
         USE_ION_FD = IMemoryHeap::USE_ION_FD
     };
+    /*
+     * allocates from the exynos heap, mapped cached by the CPU unless
+     * NO_CACHING is given
+     */
     MemoryHeapBaseIon(size_t size, uint32_t flags = 0, char const* name = NULL);
+    /*
+     * maps an existing ion buffer, flags must carry NO_CACHING if it was
+     * allocated uncached
+     */
     MemoryHeapBaseIon(int fd, size_t size, uint32_t flags = 0, uint32_t offset = 0);
     ~MemoryHeapBaseIon();
+
+    virtual status_t flushCache(size_t offset, size_t size) const;
+    virtual status_t invalidateCache(size_t offset, size_t size) const;
 private:
+    status_t syncCache(size_t offset, size_t size, long flags) const;
+
     int mIonClient;
 };
 
@@ -69,6 +69,17 @@ public:
     // Writes the RPC header.
     status_t            writeInterfaceToken(const String16& interface);
 
+    // Writes the RPC header of a call to "target", with the token it
+    // handed out for "interface" instead of the name if it has been
+    // negotiated, see BpBinder::negotiateInterfaceToken().
+    status_t            writeInterfaceToken(const String16& interface,
+                                            IBinder* target);
+
+    // Returns the token standing in for "interface", one of the interfaces
+    // this process implements, in the RPC header of calls from processes
+    // that negotiated it.  Returns 0 if the process ran out of tokens.
+    static int32_t      registerInterfaceToken(const String16& interface);
+
     // Parses the RPC header, returning true if the interface name
     // in the header matches the expected interface from the caller.
     //
@@ -124,8 +135,10 @@ public:
     status_t            writeDupFileDescriptor(int fd);
 
     // Writes a blob to the parcel.
-    // If the blob is small, then it is stored in-place, otherwise it is
-    // transferred by way of an anonymous shared memory region.
+    // If the blob is small (40KB or less) or the parcel doesn't allow file
+    // descriptors, then it is stored in-place, otherwise it is transferred
+    // by way of an anonymous shared memory region: it is written directly
+    // into the region and isn't copied into the transaction buffer.
     // The caller should call release() on the blob after writing its contents.
     status_t            writeBlob(size_t len, WritableBlob* outBlob);
 
@@ -181,6 +194,7 @@ public:
     int                 readFileDescriptor() const;
 
     // Reads a blob from the parcel.
+    // A blob transferred by shared memory is mapped read-only, not copied.
     // The caller should call release() on the blob after reading its contents.
     status_t            readBlob(size_t len, ReadableBlob* outBlob) const;
 
@@ -217,6 +231,15 @@ private:
     void                freeDataNoInit();
     void                initState();
     void                scanForFds() const;
+
+    // Storage for mData and mObjects: small parcels use the inline arrays
+    // below, larger ones heap buffers recycled per thread.
+    uint8_t*            allocData(size_t desired, size_t* outCapacity);
+    uint8_t*            reallocData(size_t desired, size_t* outCapacity);
+    void                freeDataBuffer();
+    size_t*             allocObjects(size_t count, size_t* outCapacity);
+    size_t*             reallocObjects(size_t count, size_t* outCapacity);
+    void                freeObjectsBuffer();
                         
     template<class T>
     status_t            readAligned(T *pArg) const;
@@ -243,6 +266,14 @@ private:
     release_func        mOwner;
     void*               mOwnerCookie;
 
+    enum {
+        INLINE_DATA_SIZE    = 256,
+        INLINE_OBJECTS      = 4
+    };
+    // size_t, so that flattened objects are aligned
+    size_t              mInlineData[INLINE_DATA_SIZE / sizeof(size_t)];
+    size_t              mInlineObjects[INLINE_OBJECTS];
+
     class Blob {
     public:
         Blob();
@@ -20,9 +20,12 @@
 #include <stdint.h>
 #include <unistd.h>
 
+#include <utils/ScalableRWLock.h>
 #include <utils/String16.h>
 #include <utils/Singleton.h>
 #include <utils/SortedVector.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
 
 namespace android {
 // ---------------------------------------------------------------------------
@@ -30,8 +33,11 @@ namespace android {
 /*
  * PermissionCache caches permission checks for a given uid.
  *
- * Currently the cache is not updated when there is a permission change,
- * for instance when an application is uninstalled.
+ * Granted permissions are cached until the cache is purged; denials expire
+ * after 10 seconds so that a permission granted later is eventually seen.
+ * The cache is not otherwise updated when there is a permission change,
+ * for instance when an application is uninstalled, unless purge() or
+ * purge(uid) is called.
  *
  * IMPORTANT: for the reason stated above, only system permissions are safe
  * to cache. This restriction may be lifted at a later time.
@@ -43,19 +49,23 @@ class PermissionCache : Singleton<PermissionCache> {
         String16    name;
         uid_t       uid;
         bool        granted;
+        nsecs_t     expires;    // 0 means never
         inline bool operator < (const Entry& e) const {
             return (uid == e.uid) ? (name < e.name) : (uid < e.uid);
         }
     };
-    mutable Mutex mLock;
+    // check() is called for every incoming permission check and rarely
+    // misses, so its readers take the lock without sharing a cache line
+    mutable ScalableRWLock mLock;
     // we pool all the permission names we see, as many permissions checks
     // will have identical names
     SortedVector< String16 > mPermissionNamesPool;
     // this is our cache per say. it stores pooled names.
     SortedVector< Entry > mCache;
-
-    // free the whole cache, but keep the permission name pool
-    void purge();
+    // statistics, updated atomically by concurrent readers
+    mutable volatile int32_t mHits;
+    mutable volatile int32_t mMisses;
+    mutable volatile int32_t mExpired;
 
     status_t check(bool* granted,
             const String16& permission, uid_t uid) const;
@@ -72,6 +82,13 @@ public:
 
     static bool checkPermission(const String16& permission,
             pid_t pid, uid_t uid);
+
+    // invalidation: drops all the cached checks, or those of one uid, but
+    // keeps the permission name pool
+    static void purge();
+    static void purge(uid_t uid);
+
+    static void dump(String8& result);
 };
 
 // ---------------------------------------------------------------------------
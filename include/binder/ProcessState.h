@@ -21,6 +21,7 @@
 #include <utils/KeyedVector.h>
 #include <utils/String8.h>
 #include <utils/String16.h>
+#include <utils/Timers.h>
 
 #include <utils/threads.h>
 
@@ -39,6 +40,12 @@ class ProcessState : public virtual RefBase
 public:
     static  sp<ProcessState>    self();
 
+            // Same as self(), but the process receives transactions in a
+            // "vmSize" byte mapping instead of the default one, which is
+            // just under 1 MB.  Only takes effect if called before self();
+            // the driver caps the mapping at 4 MB.
+    static  sp<ProcessState>    initWithVMSize(size_t vmSize);
+
             void                setContextObject(const sp<IBinder>& object);
             sp<IBinder>         getContextObject(const sp<IBinder>& caller);
         
@@ -72,10 +79,39 @@ public:
             
             status_t            setThreadPoolMaxThreadCount(size_t maxThreads);
 
+            // Pooled threads (other than the main one) leave the pool once
+            // they have waited longer than the idle timeout for work, as long
+            // as that leaves at least minThreads in the pool. The driver
+            // spawns new ones again when all of them are busy.
+            // A timeout of 0 (the default) keeps the threads forever.
+            void                setThreadPoolMinThreadCount(size_t minThreads);
+            void                setThreadPoolIdleTimeout(nsecs_t timeout);
+
+            void                dumpThreadPool(String8& result) const;
+
+            // How much of the mapping holds transactions and replies that
+            // haven't been freed yet.  Transactions fail once the driver
+            // can't fit a new one in.
+            size_t              getVMSize() const;
+            void                dumpTransactionBuffer(String8& result) const;
+
 private:
     friend class IPCThreadState;
+
+            // called by the threads in joinThreadPool()
+            void                pooledThreadEntered();
+            void                pooledThreadExited(bool reaped);
+            bool                reapIdlePooledThread(nsecs_t idleTime);
+            nsecs_t             getThreadPoolIdleTimeout() const;
+
+            // called by IPCThreadState for each buffer the driver hands
+            // over, and when it is given back
+            void                transactionBufferReceived(size_t dataSize,
+                                                          size_t offsetsSize);
+            void                transactionBufferFreed(size_t dataSize,
+                                                       size_t offsetsSize);
     
-                                ProcessState();
+                                ProcessState(size_t vmSize);
                                 ~ProcessState();
 
                                 ProcessState(const ProcessState& o);
@@ -89,7 +125,14 @@ private:
             handle_entry*       lookupHandleLocked(int32_t handle);
 
             int                 mDriverFD;
+            size_t              mVMSize;
             void*               mVMStart;
+
+            // bytes of the mapping in use, not counting the driver's own
+            // headers, and the most that was ever in use
+    volatile int32_t            mBufferBytes;
+    volatile int32_t            mMaxBufferBytes;
+    volatile int32_t            mBufferCount;
             
     mutable Mutex               mLock;  // protects everything below.
             
@@ -106,6 +149,14 @@ private:
             String8             mRootDir;
             bool                mThreadPoolStarted;
     volatile int32_t            mThreadPoolSeq;
+
+            size_t              mMaxThreads;
+            size_t              mMinThreads;
+            nsecs_t             mIdleTimeout;
+            size_t              mPooledThreads;
+            size_t              mReapedThreads;
+    volatile int32_t            mBusyThreads;
+            int32_t             mMaxBusyThreads;
 };
     
 }; // namespace android
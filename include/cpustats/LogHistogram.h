@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LOG_HISTOGRAM_H
+#define _LOG_HISTOGRAM_H
+
+#include <stdint.h>
+
+// Histogram of unsigned integer samples (typically durations in ns or us)
+// with log-linear buckets: every power of two is split into SUB_BUCKETS
+// linear buckets, so the whole 64 bit range fits in constant memory and
+// any percentile is within 1/SUB_BUCKETS of the true value.  Values below
+// SUB_BUCKETS are counted exactly.  Histograms with the same layout can be
+// merged, e.g. to combine per-thread or per-connection statistics.
+// Not multithread safe
+class LogHistogram {
+
+public:
+
+    enum {
+        SUB_BUCKET_BITS = 4,
+        SUB_BUCKETS = 1 << SUB_BUCKET_BITS,
+        NUM_BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS
+    };
+
+    LogHistogram() { reset(); }
+
+    ~LogHistogram() { }
+
+    // add x to the set of samples
+    void sample(uint64_t x);
+
+    // add all the samples of another histogram to this one
+    void merge(const LogHistogram& other);
+
+    // return the p-th percentile (0 to 100) of all samples so far, accurate
+    // to the width of its bucket, or 0 if there are no samples
+    uint64_t percentile(double p) const;
+
+    // return the arithmetic mean of all samples so far
+    double mean() const { return mN ? mSum / mN : 0; }
+
+    // return the minimum of all samples so far
+    uint64_t minimum() const { return mN ? mMinimum : 0; }
+
+    // return the maximum of all samples so far
+    uint64_t maximum() const { return mMaximum; }
+
+    // return the number of samples added so far
+    uint64_t n() const { return mN; }
+
+    // reset the set of samples to be empty
+    void reset();
+
+    // bucket layout, exposed for serialization
+    static unsigned bucketOf(uint64_t x);
+    static uint64_t bucketLowerBound(unsigned bucket);
+    uint32_t count(unsigned bucket) const { return mCounts[bucket]; }
+
+private:
+    uint64_t mN;            // number of samples so far
+    double mSum;
+    uint64_t mMinimum;
+    uint64_t mMaximum;
+    uint32_t mCounts[NUM_BUCKETS];
+
+};
+
+#endif // _LOG_HISTOGRAM_H
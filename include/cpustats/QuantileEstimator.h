@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _QUANTILE_ESTIMATOR_H
+#define _QUANTILE_ESTIMATOR_H
+
+#include <math.h>
+
+// Streaming estimate of one quantile using the P-square algorithm
+// (Jain and Chlamtac, 1985): five markers are kept and adjusted as samples
+// arrive, so memory and time per sample are constant.  The estimate is exact
+// for the first five samples.  Estimators can't be merged; use LogHistogram
+// to combine statistics from several sources.
+// Not multithread safe
+class QuantileEstimator {
+
+public:
+
+    // p is the quantile to track, between 0 and 1 (0.5 for the median)
+    explicit QuantileEstimator(double p = 0.5);
+
+    ~QuantileEstimator() { }
+
+    // add x to the set of samples
+    void sample(double x);
+
+    // return the estimated p-quantile of all samples so far, or NAN if none
+    double value() const;
+
+    // return the quantile being tracked
+    double quantile() const { return mP; }
+
+    // return the number of samples added so far
+    unsigned n() const { return mN; }
+
+    // reset the set of samples to be empty
+    void reset();
+
+private:
+    double parabolic(int i, int d) const;
+    double linear(int i, int d) const;
+
+    double mP;
+    unsigned mN;            // number of samples so far
+    double mHeight[5];      // marker heights; the first samples until there are 5
+    int mPosition[5];       // actual marker positions, 1-based
+    double mDesired[5];     // desired marker positions
+    double mIncrement[5];   // increment of the desired positions per sample
+
+};
+
+#endif // _QUANTILE_ESTIMATOR_H
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _THREAD_CPU_SAMPLER_H
+#define _THREAD_CPU_SAMPLER_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/KeyedVector.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+#include <cpustats/ThreadCpuUsage.h>
+
+namespace android {
+
+// Periodically samples the CPU time of some threads of the current process,
+// from /proc/self/task/<tid>, on a thread of its own.
+// For each thread it keeps a histogram of its CPU usage per sampling period,
+// so that percentiles can be reported and not just an average, and it
+// attributes the CPU time of each period to the CPU the thread was last seen
+// on, and to that CPU's clock frequency at the end of the period.  This is
+// approximate: a thread may have moved between CPUs, or the frequency may
+// have changed, during the period; shorter periods make it less so.
+// All methods are thread-safe.
+
+class ThreadCpuSampler
+{
+
+public:
+    explicit ThreadCpuSampler(uint32_t periodMs = 100);
+    ~ThreadCpuSampler();
+
+    // Samples the thread with the given id, which must be in this process;
+    // the name is what dump() shows.
+    void addThread(pid_t tid, const char* name);
+
+    // Samples the threads of this process whose name starts with prefix,
+    // including the ones created later, e.g. "Binder_" for the binder pool.
+    void addThreadsNamed(const char* prefix);
+
+    void removeThread(pid_t tid);
+
+    // Starts and stops the sampling thread.
+    bool start();
+    void stop();
+
+    // Clears the statistics gathered so far.
+    void reset();
+
+    // Appends a report of the statistics gathered so far.
+    void dump(String8& result) const;
+
+private:
+    // usage per period, in percent of one CPU
+    static const int HISTOGRAM_BINS = 101;
+    static const int MAX_CPU = 8;
+
+    struct Record {
+        pid_t tid;
+        String8 name;
+        bool exited;
+        bool primed;                        // whether lastNs is valid
+        uint64_t lastNs;                    // CPU time at the previous sample
+        uint64_t totalNs;
+        uint64_t cpuNs[MAX_CPU];
+        KeyedVector<uint32_t, uint64_t> kHzNs;
+        uint32_t histogram[HISTOGRAM_BINS];
+        uint32_t samples;
+        uint32_t maxPercent;
+    };
+
+    static void* threadLoop(void* arg);
+    void sampleLocked(int64_t periodNs);
+    void scanThreadsLocked();
+    ssize_t indexOfLocked(pid_t tid) const;
+    void addThreadLocked(pid_t tid, const char* name);
+    static void resetRecord(Record& r);
+    static bool readThread(pid_t tid, uint64_t* ns, int* cpu);
+    static uint32_t percentile(const Record& r, int p);
+
+    const uint32_t mPeriodMs;
+    mutable pthread_mutex_t mLock;
+    pthread_cond_t mCond;
+    pthread_t mThread;
+    bool mRunning;
+    Vector<Record> mRecords;
+    Vector<String8> mPrefixes;
+    ThreadCpuUsage mCpuUsage;               // for getCpukHz()
+    int64_t mStartNs;                       // of the statistics
+    uint32_t mTicks;
+};
+
+}   // namespace android
+
+#endif //  _THREAD_CPU_SAMPLER_H
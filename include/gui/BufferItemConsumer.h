@@ -42,6 +42,16 @@ class BufferItemConsumer: public ConsumerBase
 
     typedef BufferQueue::BufferItem BufferItem;
 
+    struct FramesAvailableListener : public virtual RefBase {
+        // onFramesAvailable() is called when a frame is queued while none
+        // were pending, that is once per batch of frames rather than once
+        // per frame: after it is called, it isn't called again until
+        // acquireBuffer or acquireBuffers found the queue empty.
+        //
+        // This is called without any lock held.
+        virtual void onFramesAvailable() = 0;
+    };
+
     enum { INVALID_BUFFER_SLOT = BufferQueue::INVALID_BUFFER_SLOT };
     enum { NO_BUFFER_AVAILABLE = BufferQueue::NO_BUFFER_AVAILABLE };
 
@@ -73,6 +83,16 @@ class BufferItemConsumer: public ConsumerBase
     // acquireBuffer will wait on the fence with no timeout before returning.
     status_t acquireBuffer(BufferItem *item, bool waitForFence = true);
 
+    // Gets up to max pending graphics buffers at once, in queue order, filling
+    // items with them. Returns OK if any buffer was acquired, otherwise
+    // NO_BUFFER_AVAILABLE or INVALID_OPERATION as acquireBuffer would. Fewer
+    // than max buffers are returned when the queue has run empty or when
+    // the maximum number of buffers is acquired. Each acquired buffer must
+    // be released with releaseBuffer, and fence waits are done for each
+    // of them as acquireBuffer would.
+    status_t acquireBuffers(size_t max, Vector<BufferItem>& items,
+            bool waitForFence = true);
+
     // Returns an acquired buffer to the queue, allowing it to be reused. Since
     // only a fixed number of buffers may be acquired at a time, old buffers
     // must be released by calling releaseBuffer to ensure new buffers can be
@@ -82,8 +102,25 @@ class BufferItemConsumer: public ConsumerBase
     status_t releaseBuffer(const BufferItem &item,
             const sp<Fence>& releaseFence = Fence::NO_FENCE);
 
+    // setFramesAvailableListener sets the listener notified once per batch
+    // of frames, for consumers that drain the queue with acquireBuffers.
+    // The FrameAvailableListener, if any, is still called for every frame.
+    void setFramesAvailableListener(
+            const sp<FramesAvailableListener>& listener);
+
     sp<ISurfaceTexture> getProducerInterface() const { return getBufferQueue(); }
 
+  protected:
+    virtual void onFrameAvailable();
+
+  private:
+    // mFramesAvailableListener is notified when mFramesPending goes from
+    // false to true.
+    sp<FramesAvailableListener> mFramesAvailableListener;
+
+    // mFramesPending is set when onFramesAvailable is called, and cleared
+    // once an acquire finds the queue empty.
+    bool mFramesPending;
 };
 
 } // namespace android
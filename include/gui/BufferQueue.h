@@ -31,6 +31,8 @@
 #include <utils/threads.h>
 
 namespace android {
+
+class ProtoOutput;
 // ----------------------------------------------------------------------------
 
 #ifdef QCOM_BSP
@@ -56,7 +58,7 @@ public:
     enum { NUM_BUFFER_SLOTS = 32 };
     enum { NO_CONNECTED_API = 0 };
     enum { INVALID_BUFFER_SLOT = -1 };
-    enum { STALE_BUFFER_SLOT = 1, NO_BUFFER_AVAILABLE };
+    enum { STALE_BUFFER_SLOT = 1, NO_BUFFER_AVAILABLE, PRESENT_LATER };
 
     // When in async mode we reserve two slots in order to guarantee that the
     // producer and consumer can run asynchronously.
@@ -165,6 +167,19 @@ public:
     // The default mode is asynchronous.
     virtual status_t setSynchronousMode(bool enabled);
 
+    // allocateBuffers allocates buffers of the given geometry for up to count
+    // of the free slots that don't already have a matching one, so that the
+    // following dequeueBuffer calls don't have to wait for an allocation.
+    // The allocation happens without the BufferQueue lock held. A width,
+    // height or format of zero selects the default, as with dequeueBuffer.
+    virtual void allocateBuffers(uint32_t w, uint32_t h, uint32_t format,
+            uint32_t usage, int count);
+
+    // setQueueMode selects how queued frames are retired and whether
+    // dequeueBuffer may block. See ISurfaceTexture::setQueueMode.
+    // QUEUE_MODE_FIFO is refused if synchronous mode isn't allowed.
+    virtual status_t setQueueMode(int mode, int depth);
+
 #ifdef QCOM_BSP
     // setBufferSize enables us to specify user defined sizes for the buffers
     // that need to be allocated by surfaceflinger for its client. This is
@@ -202,6 +217,10 @@ public:
     virtual void dump(String8& result) const;
     virtual void dump(String8& result, const char* prefix, char* buffer, size_t SIZE) const;
 
+    // dumpProto writes our state as the fields of a BufferQueue message, as
+    // described in services/surfaceflinger/surfaceflinger.proto
+    virtual void dumpProto(ProtoOutput& proto) const;
+
     // public facing structure for BufferSlot
     struct BufferItem {
 
@@ -210,6 +229,7 @@ public:
            mTransform(0),
            mScalingMode(NATIVE_WINDOW_SCALING_MODE_FREEZE),
            mTimestamp(0),
+           mIsAutoTimestamp(true),
            mFrameNumber(0),
            mBuf(INVALID_BUFFER_SLOT) {
              mCrop.makeInvalid();
@@ -231,6 +251,10 @@ public:
         // to set by queueBuffer each time this slot is queued.
         int64_t mTimestamp;
 
+        // mIsAutoTimestamp is false when the producer set mTimestamp, which
+        // is then the time the buffer is meant to be presented at.
+        bool mIsAutoTimestamp;
+
         // mFrameNumber is the number of the queued frame for this slot.
         uint64_t mFrameNumber;
 
@@ -250,7 +274,23 @@ public:
     // acquired then the BufferItem::mGraphicBuffer field of buffer is set to
     // NULL and it is assumed that the consumer still holds a reference to the
     // buffer.
-    status_t acquireBuffer(BufferItem *buffer);
+    //
+    // If presentWhen isn't 0, it's the time the acquired buffer will be
+    // presented at. Queued buffers whose producer set a timestamp are then
+    // presented at the time they ask for: PRESENT_LATER is returned while
+    // the next one is due after presentWhen, and the ones followed by a
+    // buffer that is also due by then are dropped. Timestamps more than a
+    // second away from presentWhen are ignored as bogus.
+    status_t acquireBuffer(BufferItem *buffer, nsecs_t presentWhen = 0);
+
+    // acquireBuffers acquires up to max pending buffers in queue order, as
+    // that many acquireBuffer calls would, but taking the lock only once.
+    // The acquired buffers are appended to items. OK is returned when max
+    // buffers were acquired; otherwise acquisition stopped at the first
+    // error, which is returned even though items may have been appended
+    // before it: NO_BUFFER_AVAILABLE means the queue is now empty, and
+    // INVALID_OPERATION that the maximum acquired buffer count was reached.
+    status_t acquireBuffers(size_t max, Vector<BufferItem>* items);
 
     // releaseBuffer releases a buffer slot from the consumer back to the
     // BufferQueue pending a fence sync.
@@ -265,6 +305,32 @@ public:
     status_t releaseBuffer(int buf, EGLDisplay display, EGLSyncKHR fence,
             const sp<Fence>& releaseFence);
 
+    // ReleaseItem is a buffer slot given back by releaseBuffers, with what
+    // would be passed to releaseBuffer for it.
+    struct ReleaseItem {
+        ReleaseItem()
+         : mBuf(INVALID_BUFFER_SLOT),
+           mEglDisplay(EGL_NO_DISPLAY),
+           mEglFence(EGL_NO_SYNC_KHR),
+           mResult(OK) { }
+
+        int mBuf;
+        EGLDisplay mEglDisplay;
+        EGLSyncKHR mEglFence;
+        sp<Fence> mFence;
+
+        // mResult is set by releaseBuffers to what releaseBuffer would have
+        // returned for this slot.
+        status_t mResult;
+    };
+
+    // releaseBuffers releases several buffer slots as releaseBuffer would,
+    // taking the lock and waking up dequeueBuffer only once. It returns OK
+    // when every slot was released, or the error of the first that wasn't;
+    // the consumer must check the mResult of each item for
+    // STALE_BUFFER_SLOT.
+    status_t releaseBuffers(ReleaseItem* items, size_t count);
+
     // consumerConnect connects a consumer to the BufferQueue.  Only one
     // consumer may be connected, and when that consumer disconnects the
     // BufferQueue is placed into the "abandoned" state, causing most
@@ -282,6 +348,13 @@ public:
     // but have not yet been released by the consumer.
     status_t getReleasedBuffers(uint32_t* slotMask);
 
+    // freeIdleBuffers frees the buffers that are neither queued, dequeued nor
+    // acquired, and returns how many bytes they held. The consumer is told
+    // through onBuffersReleased, the producer drops its references the next
+    // time it dequeues a buffer. The memory is reallocated if the producer
+    // needs more buffers again.
+    size_t freeIdleBuffers();
+
     // setDefaultBufferSize is used to set the size of buffers returned by
     // requestBuffers when a with and height of zero is requested.
     status_t setDefaultBufferSize(uint32_t w, uint32_t h);
@@ -291,6 +364,11 @@ public:
     // take effect once the client sets the count back to zero.
     status_t setDefaultMaxBufferCount(int bufferCount);
 
+    // getDequeueBlockedTime returns how long, in total, dequeueBuffer has
+    // been blocked waiting for a buffer to be released. Consumers can sample
+    // it to tell whether they give buffers back too late for the producer.
+    nsecs_t getDequeueBlockedTime() const;
+
     // setMaxAcquiredBufferCount sets the maximum number of buffers that can
     // be acquired by the consumer at one time.  This call will fail if a
     // producer is connected to the BufferQueue.
@@ -300,6 +378,10 @@ public:
     // synchronous mode.
     bool isSynchronousMode() const;
 
+    // getQueuedBufferFence returns the acquire fence of the buffer that the
+    // next acquireBuffer call would return, or NULL if none is queued.
+    sp<Fence> getQueuedBufferFence() const;
+
     // setConsumerName sets the name used in logging
     void setConsumerName(const String8& name);
 
@@ -327,6 +409,14 @@ private:
     // and EGLImage) for all slots except the head of mQueue
     void freeAllBuffersExceptHeadLocked();
 
+    // acquireBufferLocked does the work of acquireBuffer once mMutex is held.
+    status_t acquireBufferLocked(BufferItem *buffer, nsecs_t presentWhen);
+
+    // releaseBufferLocked does the work of releaseBuffer, except waking up
+    // the producers blocked in dequeueBuffer.
+    status_t releaseBufferLocked(int buf, EGLDisplay display,
+            EGLSyncKHR eglFence, const sp<Fence>& fence);
+
     // drainQueueLocked drains the buffer queue if we're in synchronous mode
     // returns immediately otherwise. It returns NO_INIT if the BufferQueue
     // became abandoned or disconnected during this call.
@@ -337,6 +427,16 @@ private:
     // are freed except the current buffer.
     status_t drainQueueAndFreeBuffersLocked();
 
+    // getQueueModeLocked returns the queue mode in effect, which is the one
+    // set by setQueueMode or, by default, QUEUE_MODE_FIFO in synchronous
+    // mode and QUEUE_MODE_MAILBOX otherwise.
+    int getQueueModeLocked() const;
+
+    // dropQueuedBufferLocked frees the slot at the given position in mQueue
+    // without it reaching the consumer and counts it as dropped in the
+    // current queue mode.
+    void dropQueuedBufferLocked(size_t index);
+
     // setDefaultMaxBufferCountLocked sets the maximum number of buffer slots
     // that will be used if the producer does not override the buffer slot
     // count.
@@ -355,6 +455,7 @@ private:
     // variables:
     //
     //      mSynchronousMode
+    //      mQueueMode
     //      mMaxAcquiredBufferCount
     //      mDefaultMaxBufferCount
     //      mOverrideMaxBufferCount
@@ -372,10 +473,12 @@ private:
           mTransform(0),
           mScalingMode(NATIVE_WINDOW_SCALING_MODE_FREEZE),
           mTimestamp(0),
+          mIsAutoTimestamp(true),
           mFrameNumber(0),
           mEglFence(EGL_NO_SYNC_KHR),
           mAcquireCalled(false),
-          mNeedsCleanupOnRelease(false) {
+          mNeedsCleanupOnRelease(false),
+          mPreallocated(false) {
             mCrop.makeInvalid();
         }
 
@@ -445,6 +548,9 @@ private:
         // to set by queueBuffer each time this slot is queued.
         int64_t mTimestamp;
 
+        // mIsAutoTimestamp is false when the producer set mTimestamp.
+        bool mIsAutoTimestamp;
+
         // mFrameNumber is the number of the queued frame for this slot.
         uint64_t mFrameNumber;
 
@@ -470,8 +576,19 @@ private:
 
         // Indicates whether this buffer needs to be cleaned up by consumer
         bool mNeedsCleanupOnRelease;
+
+        // mPreallocated indicates that mGraphicBuffer was allocated by
+        // allocateBuffers and hasn't been handed to the producer yet, so the
+        // next dequeueBuffer of this slot must return
+        // BUFFER_NEEDS_REALLOCATION for the producer to call requestBuffer.
+        bool mPreallocated;
     };
 
+    // setBufferStateLocked moves the given slot to a new state. All slot state
+    // transitions must go through here so that mQueuedCount and
+    // mAcquiredCount stay in sync with mSlots.
+    void setBufferStateLocked(int slot, BufferSlot::BufferState state);
+
     // mSlots is the array of buffer slots that must be mirrored on the client
     // side. This allows buffer ownership to be transferred between the client
     // and server without sending a GraphicBuffer over binder. The entire array
@@ -521,6 +638,19 @@ private:
     // mSynchronousMode whether we're in synchronous mode or not
     bool mSynchronousMode;
 
+    // mQueueMode is the queue mode selected with setQueueMode, or
+    // QUEUE_MODE_DEFAULT to follow mSynchronousMode.
+    int mQueueMode;
+
+    // mQueueDepth is the maximum number of queued buffers in
+    // QUEUE_MODE_DROP_OLDEST.
+    int mQueueDepth;
+
+    // mDroppedFrames counts the frames that were queued but freed before
+    // the consumer acquired them, indexed by the queue mode in effect when
+    // they were dropped.
+    uint32_t mDroppedFrames[ISurfaceTexture::QUEUE_MODE_DROP_OLDEST + 1];
+
     // mAllowSynchronousMode whether we allow synchronous mode or not
     const bool mAllowSynchronousMode;
 
@@ -556,10 +686,18 @@ private:
     // with the surface Texture.
     uint64_t mFrameCounter;
 
+    // mDequeueBlockedTime is the time dequeueBuffer has spent waiting on
+    // mDequeueCondition for a free buffer.
+    nsecs_t mDequeueBlockedTime;
+
     // mBufferHasBeenQueued is true once a buffer has been queued.  It is reset
     // by changing the buffer count.
     bool mBufferHasBeenQueued;
 
+    // mReleaseAllOnDequeue is set by freeIdleBuffers, so that the next
+    // dequeueBuffer tells the producer to release its buffer references.
+    bool mReleaseAllOnDequeue;
+
     // mDefaultBufferFormat can be set so it will override
     // the buffer format when it isn't specified in dequeueBuffer
     uint32_t mDefaultBufferFormat;
@@ -570,6 +708,12 @@ private:
     // mTransformHint is used to optimize for screen rotations
     uint32_t mTransformHint;
 
+    // mQueuedCount and mAcquiredCount are the number of slots in the QUEUED
+    // and ACQUIRED states. They are only written by setBufferStateLocked, but
+    // may be read atomically without holding mMutex.
+    volatile int32_t mQueuedCount;
+    volatile int32_t mAcquiredCount;
+
 #ifdef QCOM_BSP
     // holds the updated buffer geometry info of the new video resolution.
     QBufGeometry mNextBufferInfo;
@@ -141,8 +141,18 @@ protected:
     // Derived classes should override this method to perform any
     // initialization that must take place the first time a buffer is assigned
     // to a slot.  If it is overridden the derived class's implementation must
-    // call ConsumerBase::acquireBufferLocked.
-    virtual status_t acquireBufferLocked(BufferQueue::BufferItem *item);
+    // call ConsumerBase::acquireBufferLocked. presentWhen is passed to
+    // BufferQueue::acquireBuffer.
+    virtual status_t acquireBufferLocked(BufferQueue::BufferItem *item,
+            nsecs_t presentWhen = 0);
+
+    // acquireBuffersLocked fetches up to max buffers from the BufferQueue
+    // with BufferQueue::acquireBuffers, appending them to items and updating
+    // their buffer slots.  Like releaseBuffersLocked it does not go through
+    // the derived classes' acquireBufferLocked overrides, so it must only be
+    // used by classes that don't need them.
+    status_t acquireBuffersLocked(size_t max,
+            Vector<BufferQueue::BufferItem>* items);
 
     // releaseBufferLocked relinquishes control over a buffer, returning that
     // control to the BufferQueue.
@@ -162,6 +172,19 @@ protected:
     status_t addReleaseFence(int slot, const sp<Fence>& fence);
     status_t addReleaseFenceLocked(int slot, const sp<Fence>& fence);
 
+    // releaseBuffersLocked releases the buffers in the given slots back to the
+    // BufferQueue with a single lock round trip, passing each slot's release
+    // fence and no EGL fence.  Unlike releaseBufferLocked it is not virtual
+    // and does not go through the derived classes' overrides, so it must only
+    // be used for slots that need no per-class cleanup.  The first error
+    // encountered is returned, but every slot is processed.
+    status_t releaseBuffersLocked(const int* slots, size_t count);
+
+    // getReleaseFenceLocked merges the fences accumulated for the given slot
+    // into the one to hand back to the BufferQueue and clears the slot's
+    // fence state.
+    sp<Fence> getReleaseFenceLocked(int slot);
+
     // Slot contains the information and object references that
     // ConsumerBase maintains about a BufferQueue buffer slot.
     struct Slot {
@@ -174,6 +197,12 @@ protected:
         // overwritten. The buffer can be dequeued before the fence signals;
         // the producer is responsible for delaying writes until it signals.
         sp<Fence> mFence;
+
+        // mPendingFences holds the release fences added after mFence. They
+        // are merged with mFence in a single pass when the buffer is released
+        // rather than one sync_merge per addReleaseFence call, which would
+        // copy the accumulated sync points over and over.
+        Vector< sp<Fence> > mPendingFences;
     };
 
     // mSlots stores the buffers that have been allocated by the BufferQueue
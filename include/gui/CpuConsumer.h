@@ -35,6 +35,10 @@ namespace android {
  * buffers may be acquired by it at once, to be used concurrently by the
  * CpuConsumer owner. Sets gralloc usage flags to be software-read-only.
  * This queue is synchronous by default.
+ *
+ * lockNextBuffer and unlockBuffer may be called from several threads at
+ * once, each getting its own buffer; waiting for a buffer's fence and
+ * mapping it doesn't block the other threads.
  */
 
 class CpuConsumer: public ConsumerBase
@@ -53,11 +57,28 @@ class CpuConsumer: public ConsumerBase
         uint32_t    scalingMode;
         int64_t     timestamp;
         uint64_t    frameNumber;
+        // Chroma planes of YCbCr 4:2:0 formats (YV12 and YCrCb_420_SP),
+        // NULL for other formats. The plane of data is then the luma plane.
+        // chromaStride is the distance in bytes between two rows of chroma
+        // samples and chromaStep the distance between two samples of a row,
+        // 1 for planar and 2 for semi-planar (interleaved) chroma.
+        uint8_t    *dataCb;
+        uint8_t    *dataCr;
+        uint32_t    chromaStride;
+        uint32_t    chromaStep;
     };
 
     // Create a new CPU consumer. The maxLockedBuffers parameter specifies
     // how many buffers can be locked for user access at the same time.
-    CpuConsumer(uint32_t maxLockedBuffers);
+    //
+    // If cacheMappings is true, buffers stay mapped after unlockBuffer so
+    // that locking the same buffer again doesn't go through gralloc. This
+    // also skips the CPU cache maintenance gralloc does when locking, so it
+    // is only safe with buffers the producer writes coherently with the CPU,
+    // and with gralloc implementations that let the producer lock a buffer
+    // the consumer still has mapped. Mappings are dropped when the buffer is
+    // freed.
+    CpuConsumer(uint32_t maxLockedBuffers, bool cacheMappings = false);
 
     virtual ~CpuConsumer();
 
@@ -84,15 +105,40 @@ class CpuConsumer: public ConsumerBase
 
     sp<ISurfaceTexture> getProducerInterface() const { return getBufferQueue(); }
 
+    // Converts a locked YCbCr 4:2:0 buffer to RGBA_8888 using the BT.601
+    // video range matrix. dst receives width x height pixels, with rows of
+    // dstStride pixels. Uses NEON when available. Returns BAD_VALUE if the
+    // buffer has no chroma planes.
+    static status_t convertToRgba8888(const LockedBuffer& buffer,
+            uint8_t* dst, uint32_t dstStride);
+
   private:
     // Maximum number of buffers that can be locked at a time
     uint32_t mMaxLockedBuffers;
 
+    // Whether mappings are kept after unlockBuffer
+    const bool mCacheMappings;
+
     virtual void freeBufferLocked(int slotIndex);
 
-    // Array for tracking pointers passed to the consumer, matching the
-    // mSlots indexing
-    void *mBufferPointers[BufferQueue::NUM_BUFFER_SLOTS];
+    // Returns a buffer that was acquired by lockNextBuffer but couldn't be
+    // handed to the user.
+    void cancelLockLocked(int slotIndex, const sp<GraphicBuffer>& buffer);
+
+    // Tracks the mappings passed to the consumer, matching the mSlots
+    // indexing
+    struct LockedSlot {
+        LockedSlot() : mBufferPointer(NULL), mLocked(false) {}
+        // The buffer that is mapped, which is kept here as the slot may be
+        // freed while the buffer is locked
+        sp<GraphicBuffer> mGraphicBuffer;
+        // CPU address of mGraphicBuffer, or NULL if it isn't mapped
+        void *mBufferPointer;
+        // Whether the buffer is locked by the user, or about to be
+        bool mLocked;
+    };
+    LockedSlot mLockedSlots[BufferQueue::NUM_BUFFER_SLOTS];
+
     // Count of currently locked buffers
     uint32_t mCurrentLockedBuffers;
 
@@ -34,6 +34,8 @@ namespace android {
 
 class BitTube;
 class IDisplayEventConnection;
+class Looper;
+class LooperCallback;
 
 // ----------------------------------------------------------------------------
 
@@ -105,6 +107,18 @@ public:
     static ssize_t getEvents(const sp<BitTube>& dataChannel,
             Event* events, size_t count);
 
+    /*
+     * getEventsWithLatestVsync drains the queue like getEvents, except that
+     * all the pending Event::VSync are collapsed into the most recent one,
+     * which comes after the other events. It returns how many events were
+     * stored, without waiting, and stops early only when events is full.
+     * This is what clients catching up with a backlog of stale vsync events
+     * want.
+     */
+    ssize_t getEventsWithLatestVsync(Event* events, size_t count);
+    static ssize_t getEventsWithLatestVsync(const sp<BitTube>& dataChannel,
+            Event* events, size_t count);
+
     /*
      * sendEvents write events to the queue and returns how many events were
      * written.
@@ -126,9 +140,41 @@ public:
      */
     status_t requestNextVsync();
 
+    /*
+     * EventListener receives the events of a DisplayEventReceiver attached
+     * to a Looper, on the thread polling it.
+     */
+    class EventListener : public virtual RefBase {
+    public:
+        /*
+         * onDisplayEvents is called with the events read as with
+         * getEventsWithLatestVsync, and once with none when the connection
+         * with SurfaceFlinger is broken, after which the receiver is
+         * detached.
+         */
+        virtual void onDisplayEvents(Event const* events, size_t count) = 0;
+    protected:
+        virtual ~EventListener() { }
+    };
+
+    /*
+     * attachLooper() has looper's thread read the events and hand them to
+     * listener, so that one thread can serve several receivers and sensor
+     * event queues with a single poll. getEvents() must not be called
+     * until detachLooper(), which the destructor calls; destroying the
+     * receiver from another thread than looper's while it is attached
+     * races with the delivery of its events.
+     */
+    status_t attachLooper(const sp<Looper>& looper,
+            const sp<EventListener>& listener);
+    status_t detachLooper();
+
 private:
     sp<IDisplayEventConnection> mEventConnection;
     sp<BitTube> mDataChannel;
+    // set by attachLooper()
+    sp<Looper> mLooper;
+    sp<LooperCallback> mLooperCallback;
 };
 
 // ----------------------------------------------------------------------------
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_GUI_GRAPHIC_MEMORY_USAGE_H
+#define ANDROID_GUI_GRAPHIC_MEMORY_USAGE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/String8.h>
+
+namespace android {
+// ----------------------------------------------------------------------------
+
+/*
+ * The live buffers SurfaceFlinger allocated for one owner, see
+ * ISurfaceComposer::getGraphicMemoryUsage().
+ */
+struct GraphicMemoryUsage {
+    // the process the buffers were allocated for
+    pid_t pid;
+    // the name of the layer they were allocated for, empty for the buffers
+    // a process allocated for its own BufferQueues
+    String8 name;
+    // the gralloc usage bits of all the buffers, or'ed
+    uint32_t usage;
+    uint32_t count;
+    uint64_t bytes;
+
+    GraphicMemoryUsage() : pid(0), usage(0), count(0), bytes(0) { }
+};
+
+// ----------------------------------------------------------------------------
+}; // namespace android
+
+#endif // ANDROID_GUI_GRAPHIC_MEMORY_USAGE_H
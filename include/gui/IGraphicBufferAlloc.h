@@ -23,6 +23,7 @@
 #include <binder/IInterface.h>
 #include <ui/PixelFormat.h>
 #include <utils/RefBase.h>
+#include <utils/Vector.h>
 
 namespace android {
 // ----------------------------------------------------------------------------
@@ -38,6 +39,14 @@ public:
      */
     virtual sp<GraphicBuffer> createGraphicBuffer(uint32_t w, uint32_t h,
             PixelFormat format, uint32_t usage, status_t* error) = 0;
+
+    /* Create count new GraphicBuffers with the same parameters in a single
+     * call. The buffers successfully created are appended to outBuffers,
+     * the first error encountered, if any, is returned.
+     */
+    virtual status_t createGraphicBuffers(uint32_t w, uint32_t h,
+            PixelFormat format, uint32_t usage, size_t count,
+            Vector< sp<GraphicBuffer> >* outBuffers) = 0;
 #ifdef QCOM_BSP
     virtual void setGraphicBufferSize(int size) = 0;
 #endif
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_GUI_ISCREEN_CAPTURE_LISTENER_H
+#define ANDROID_GUI_ISCREEN_CAPTURE_LISTENER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/Errors.h>
+#include <utils/RefBase.h>
+
+#include <binder/IInterface.h>
+
+namespace android {
+// ----------------------------------------------------------------------------
+
+class Fence;
+class GraphicBuffer;
+
+class IScreenCaptureListener : public IInterface
+{
+public:
+
+    DECLARE_META_INTERFACE(ScreenCaptureListener);
+
+    /*
+     * onScreenCaptured() is called once a request made with
+     * ISurfaceComposer::captureScreenAsync() has been processed. On success
+     * buffer holds the capture, which is complete once fence has signaled.
+     * On failure buffer is NULL and result holds the error.
+     */
+    virtual void onScreenCaptured(status_t result,
+            const sp<GraphicBuffer>& buffer,
+            const sp<Fence>& fence) = 0;    // asynchronous
+};
+
+// ----------------------------------------------------------------------------
+
+class BnScreenCaptureListener : public BnInterface<IScreenCaptureListener>
+{
+public:
+    virtual status_t    onTransact( uint32_t code,
+                                    const Parcel& data,
+                                    Parcel* reply,
+                                    uint32_t flags = 0);
+};
+
+// ----------------------------------------------------------------------------
+}; // namespace android
+
+#endif // ANDROID_GUI_ISCREEN_CAPTURE_LISTENER_H
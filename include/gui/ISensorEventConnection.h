@@ -29,6 +29,7 @@ namespace android {
 // ----------------------------------------------------------------------------
 
 class BitTube;
+class IMemoryHeap;
 
 class ISensorEventConnection : public IInterface
 {
@@ -38,6 +39,26 @@ public:
     virtual sp<BitTube> getSensorChannel() const = 0;
     virtual status_t enableDisable(int handle, bool enabled) = 0;
     virtual status_t setEventRate(int handle, nsecs_t ns) = 0;
+
+    // getSensorEventRing returns the shared memory of a SensorEventRing the
+    // events are written to from then on, the BitTube returned by
+    // getSensorChannel only rings the doorbell. NULL means the events keep
+    // coming through the BitTube.
+    virtual sp<IMemoryHeap> getSensorEventRing() = 0;
+
+    // batch sets the sampling period of an enabled sensor like
+    // setEventRate, and lets its events be held back for up to
+    // maxReportLatency before the client is woken up, in the sensor's
+    // hardware FIFO when it has one. flush delivers the events held back
+    // for a sensor right away.
+    virtual status_t batch(int handle, nsecs_t period,
+            nsecs_t maxReportLatency) = 0;
+    virtual status_t flush(int handle) = 0;
+
+    // setWakeUp makes SensorService keep the device awake until the
+    // events it has for this connection are delivered. Otherwise, the
+    // default, events wait in the connection if the device suspends.
+    virtual status_t setWakeUp(bool wakeUp) = 0;
 };
 
 // ----------------------------------------------------------------------------
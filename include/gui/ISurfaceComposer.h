@@ -22,11 +22,14 @@
 
 #include <utils/RefBase.h>
 #include <utils/Errors.h>
+#include <utils/Vector.h>
 
 #include <binder/IInterface.h>
 
 #include <ui/PixelFormat.h>
+#include <ui/Rect.h>
 
+#include <gui/GraphicMemoryUsage.h>
 #include <gui/IGraphicBufferAlloc.h>
 #include <gui/ISurfaceComposerClient.h>
 
@@ -36,8 +39,11 @@ namespace android {
 class ComposerState;
 class DisplayState;
 class DisplayInfo;
+class GraphicBuffer;
 class IDisplayEventConnection;
 class IMemoryHeap;
+class IScreenCaptureListener;
+class ITransactionCompletedListener;
 
 class ISurfaceComposer: public IInterface {
 public:
@@ -81,6 +87,15 @@ public:
     virtual void setTransactionState(const Vector<ComposerState>& state,
             const Vector<DisplayState>& displays, uint32_t flags) = 0;
 
+    /* same as setTransactionState() but never blocks: eSynchronous is
+     * ignored and animation transactions aren't throttled. Instead each
+     * listener is told when the transaction has been latched and composed.
+     * requires ACCESS_SURFACE_FLINGER permission
+     */
+    virtual void setTransactionStateAsync(const Vector<ComposerState>& state,
+            const Vector<DisplayState>& displays, uint32_t flags,
+            const Vector< sp<ITransactionCompletedListener> >& listeners) = 0;
+
     /* signal that we're done booting.
      * Requires ACCESS_SURFACE_FLINGER permission
      */
@@ -99,6 +114,30 @@ public:
             uint32_t reqWidth, uint32_t reqHeight,
             uint32_t minLayerZ, uint32_t maxLayerZ) = 0;
 
+    /* Capture the specified screen into a new GraphicBuffer, the screen is
+     * rendered directly into it, no copy of the pixels is made.
+     * requires READ_FRAME_BUFFER permission
+     * This function will fail if there is a secure window on screen.
+     */
+    virtual status_t captureScreenToBuffer(const sp<IBinder>& display,
+            sp<GraphicBuffer>* outBuffer,
+            uint32_t reqWidth, uint32_t reqHeight,
+            uint32_t minLayerZ, uint32_t maxLayerZ) = 0;
+
+    /* Schedule a capture of the sourceCrop area of the specified screen,
+     * scaled to reqWidth x reqHeight, in the given format (RGBA_8888 or
+     * RGB_565). An empty sourceCrop selects the whole screen and a zero size
+     * the size of sourceCrop. The call returns immediately, the capture
+     * is taken after the next composition and delivered to listener.
+     * requires READ_FRAME_BUFFER permission
+     * The capture will fail if there is a secure window on screen.
+     */
+    virtual status_t captureScreenAsync(const sp<IBinder>& display,
+            const sp<IScreenCaptureListener>& listener,
+            const Rect& sourceCrop,
+            uint32_t reqWidth, uint32_t reqHeight, PixelFormat format,
+            uint32_t minLayerZ, uint32_t maxLayerZ) = 0;
+
 
     /* triggers screen off and waits for it to complete */
     virtual void blank(const sp<IBinder>& display) = 0;
@@ -109,6 +148,13 @@ public:
     /* returns information about a display
      * intended to be used to get information about built-in displays */
     virtual status_t getDisplayInfo(const sp<IBinder>& display, DisplayInfo* info) = 0;
+
+    /* replaces the content of usage with the live buffers allocated by
+     * SurfaceFlinger, one entry per layer and per process for the others.
+     * requires ACCESS_SURFACE_FLINGER permission.
+     */
+    virtual status_t getGraphicMemoryUsage(
+            Vector<GraphicMemoryUsage>* usage) = 0;
 };
 
 // ----------------------------------------------------------------------------
@@ -131,6 +177,10 @@ public:
         UNBLANK,
         GET_DISPLAY_INFO,
         CONNECT_DISPLAY,
+        CAPTURE_SCREEN_TO_BUFFER,
+        CAPTURE_SCREEN_ASYNC,
+        SET_TRANSACTION_STATE_ASYNC,
+        GET_GRAPHIC_MEMORY_USAGE,
     };
 
     virtual status_t onTransact(uint32_t code, const Parcel& data,
@@ -24,6 +24,7 @@
 #include <utils/RefBase.h>
 
 #include <binder/IInterface.h>
+#include <binder/IMemory.h>
 
 #include <ui/PixelFormat.h>
 
@@ -72,6 +73,21 @@ public:
      * Requires ACCESS_SURFACE_FLINGER permission
      */
     virtual status_t destroySurface(SurfaceID sid) = 0;
+
+    /*
+     * Returns the shared memory of this client's LayerStateChannel,
+     * creating it the first time, or NULL if there can't be one.
+     *
+     * Requires ACCESS_SURFACE_FLINGER permission
+     */
+    virtual sp<IMemoryHeap> getStateChannel() = 0;
+
+    /*
+     * Doorbell of the LayerStateChannel, one-way.
+     *
+     * Requires ACCESS_SURFACE_FLINGER permission
+     */
+    virtual void signalStateChannel() = 0;
 };
 
 // ----------------------------------------------------------------------------
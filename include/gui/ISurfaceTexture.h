@@ -44,6 +44,14 @@ public:
         RELEASE_ALL_BUFFERS       = 0x2,
     };
 
+    // queue modes, see setQueueMode()
+    enum {
+        QUEUE_MODE_DEFAULT        = 0,
+        QUEUE_MODE_FIFO           = 1,
+        QUEUE_MODE_MAILBOX        = 2,
+        QUEUE_MODE_DROP_OLDEST    = 3,
+    };
+
     // requestBuffer requests a new buffer for the given index. The server (i.e.
     // the ISurfaceTexture implementation) assigns the newly created buffer to
     // the given slot index, and the client is expected to mirror the
@@ -88,15 +96,18 @@ public:
 
     struct QueueBufferInput : public Flattenable {
         inline QueueBufferInput(const Parcel& parcel);
+        // isAutoTimestamp is false if timestamp was set by the producer, in
+        // which case it is the time the buffer should be presented at.
         inline QueueBufferInput(int64_t timestamp,
                 const Rect& crop, int scalingMode, uint32_t transform,
-                sp<Fence> fence)
-        : timestamp(timestamp), crop(crop), scalingMode(scalingMode),
-          transform(transform), fence(fence) { }
-        inline void deflate(int64_t* outTimestamp, Rect* outCrop,
-                int* outScalingMode, uint32_t* outTransform,
+                sp<Fence> fence, bool isAutoTimestamp = true)
+        : timestamp(timestamp), isAutoTimestamp(isAutoTimestamp), crop(crop),
+          scalingMode(scalingMode), transform(transform), fence(fence) { }
+        inline void deflate(int64_t* outTimestamp, bool* outIsAutoTimestamp,
+                Rect* outCrop, int* outScalingMode, uint32_t* outTransform,
                 sp<Fence>* outFence) const {
             *outTimestamp = timestamp;
+            *outIsAutoTimestamp = isAutoTimestamp;
             *outCrop = crop;
             *outScalingMode = scalingMode;
             *outTransform = transform;
@@ -113,6 +124,7 @@ public:
 
     private:
         int64_t timestamp;
+        bool isAutoTimestamp;
         Rect crop;
         int scalingMode;
         uint32_t transform;
@@ -148,6 +160,19 @@ public:
     virtual status_t queueBuffer(int slot,
             const QueueBufferInput& input, QueueBufferOutput* output) = 0;
 
+    // queueAndDequeueBuffer queues the buffer in slot as queueBuffer does
+    // and, if that succeeded, dequeues the next buffer as dequeueBuffer does
+    // with the given geometry, format and usage, saving the client a round
+    // trip per frame. The queueBuffer result is returned, the dequeueBuffer
+    // result is stored in outDequeueResult and the dequeued slot and its
+    // fence in outSlot and fence. The dequeue isn't attempted when the
+    // queue failed. Since it blocks like dequeueBuffer, clients should only
+    // use it when the queue isn't in synchronous mode.
+    virtual status_t queueAndDequeueBuffer(int slot,
+            const QueueBufferInput& input, QueueBufferOutput* output,
+            int* outSlot, sp<Fence>& fence, uint32_t w, uint32_t h,
+            uint32_t format, uint32_t usage, status_t* outDequeueResult);
+
     // cancelBuffer indicates that the client does not wish to fill in the
     // buffer associated with slot and transfers ownership of the slot back to
     // the server.
@@ -164,6 +189,30 @@ public:
     // The default mode is asynchronous.
     virtual status_t setSynchronousMode(bool enabled) = 0;
 
+    // allocateBuffers asks the server to allocate buffers with the given
+    // geometry ahead of time for up to count free slots, so that subsequent
+    // calls to dequeueBuffer don't stall on an allocation. The call doesn't
+    // wait for the allocation to complete. A preallocated slot is still
+    // reported with BUFFER_NEEDS_REALLOCATION the first time it is dequeued,
+    // requestBuffer must be called for it as usual.
+    virtual void allocateBuffers(uint32_t w, uint32_t h, uint32_t format,
+            uint32_t usage, int count) = 0;
+
+    // setQueueMode selects what happens to queued frames the consumer hasn't
+    // acquired yet:
+    // - QUEUE_MODE_FIFO retires every frame in order, dequeueBuffer blocks
+    //   until a buffer is released, as in synchronous mode.
+    // - QUEUE_MODE_MAILBOX keeps only the most recent frame, as in
+    //   asynchronous mode, and dequeueBuffer never blocks: when no slot is
+    //   free it takes back the pending frame.
+    // - QUEUE_MODE_DROP_OLDEST keeps up to depth frames in order and drops
+    //   the oldest one to make room for a new frame or to satisfy
+    //   dequeueBuffer, which never blocks either.
+    // QUEUE_MODE_DEFAULT goes back to the behavior chosen by
+    // setSynchronousMode. depth is only used by QUEUE_MODE_DROP_OLDEST and
+    // must be at least 1. Frames that are dropped are counted per mode.
+    virtual status_t setQueueMode(int mode, int depth) = 0;
+
 #ifdef QCOM_BSP
    // setBufferSize enables to specify the user defined size of the buffer
    // that needs to be allocated by surfaceflinger for its client. This is
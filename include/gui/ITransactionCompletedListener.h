@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_GUI_ITRANSACTION_COMPLETED_LISTENER_H
+#define ANDROID_GUI_ITRANSACTION_COMPLETED_LISTENER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/Errors.h>
+#include <utils/RefBase.h>
+
+#include <binder/IInterface.h>
+
+namespace android {
+// ----------------------------------------------------------------------------
+
+class Fence;
+
+class ITransactionCompletedListener : public IInterface
+{
+public:
+
+    DECLARE_META_INTERFACE(TransactionCompletedListener);
+
+    /*
+     * onTransactionCompleted() is called once a transaction applied with
+     * ISurfaceComposer::setTransactionStateAsync() has been latched and
+     * the frame showing it composed. The composition's rendering is
+     * complete once fence has signaled; fence is NO_FENCE if that can't
+     * be tracked.
+     */
+    virtual void onTransactionCompleted(const sp<Fence>& fence) = 0; // asynchronous
+};
+
+// ----------------------------------------------------------------------------
+
+class BnTransactionCompletedListener :
+        public BnInterface<ITransactionCompletedListener>
+{
+public:
+    virtual status_t    onTransact( uint32_t code,
+                                    const Parcel& data,
+                                    Parcel* reply,
+                                    uint32_t flags = 0);
+};
+
+// ----------------------------------------------------------------------------
+}; // namespace android
+
+#endif // ANDROID_GUI_ITRANSACTION_COMPLETED_LISTENER_H
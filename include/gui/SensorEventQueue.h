@@ -42,7 +42,9 @@ namespace android {
 
 class ISensorEventConnection;
 class Sensor;
+class SensorEventRing;
 class Looper;
+class LooperCallback;
 
 // ----------------------------------------------------------------------------
 
@@ -63,20 +65,56 @@ public:
     status_t waitForEvent() const;
     status_t wake() const;
 
+    // Receives the events of a queue attached to a Looper, on the thread
+    // polling it.
+    class EventListener : public virtual RefBase {
+    public:
+        // called with the events read from queue, and once with none when
+        // the connection is broken, after which queue is detached.
+        virtual void onSensorEvents(const sp<SensorEventQueue>& queue,
+                ASensorEvent const* events, size_t count) = 0;
+    protected:
+        virtual ~EventListener() { }
+    };
+
+    // attachLooper has looper's thread read the events and hand them to
+    // listener, so that one thread can serve several queues. Until
+    // detachLooper is called, waitForEvent and wake fail and read must
+    // not be called.
+    status_t attachLooper(const sp<Looper>& looper,
+            const sp<EventListener>& listener);
+    status_t detachLooper();
+
     status_t enableSensor(Sensor const* sensor) const;
     status_t disableSensor(Sensor const* sensor) const;
     status_t setEventRate(Sensor const* sensor, nsecs_t ns) const;
+    status_t batch(Sensor const* sensor, nsecs_t ns,
+            nsecs_t maxReportLatency) const;
+    status_t flush(Sensor const* sensor) const;
+    status_t setWakeUp(bool wakeUp) const;
 
     // these are here only to support SensorManager.java
     status_t enableSensor(int32_t handle, int32_t us) const;
+    status_t enableSensor(int32_t handle, int32_t us,
+            int64_t maxReportLatencyUs) const;
     status_t disableSensor(int32_t handle) const;
 
 private:
+    class LooperEventCallback;
+
     sp<Looper> getLooper() const;
+    // forgets looper, if the queue is attached to it with callback
+    void onDetached(const sp<LooperCallback>& callback);
     sp<ISensorEventConnection> mSensorEventConnection;
     sp<BitTube> mSensorChannel;
+    // when set, events come through this ring and mSensorChannel only
+    // carries doorbells
+    sp<SensorEventRing> mSensorEventRing;
     mutable Mutex mLock;
     mutable sp<Looper> mLooper;
+    // set by attachLooper
+    sp<Looper> mAttachedLooper;
+    sp<LooperCallback> mAttachedCallback;
 };
 
 // ----------------------------------------------------------------------------
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef ANDROID_GUI_SENSOR_EVENT_RING_H
+#define ANDROID_GUI_SENSOR_EVENT_RING_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/Errors.h>
+#include <utils/RefBase.h>
+
+#include <binder/IMemory.h>
+
+// ----------------------------------------------------------------------------
+
+struct ASensorEvent;
+
+// ----------------------------------------------------------------------------
+namespace android {
+// ----------------------------------------------------------------------------
+
+/*
+ * A SensorEventRing is a single producer, single consumer ring of sensor
+ * events in shared memory. SensorService writes events in it and the
+ * client drains them without a system call. The connection's BitTube is
+ * only used as a doorbell: a client that finds the ring empty calls
+ * setWaiting() before going back to sleep on the BitTube, and the next
+ * write() reports that the client must be woken up.
+ *
+ * Neither side trusts the indices the other one keeps in shared memory
+ * beyond what's needed to stay within the ring.
+ */
+class SensorEventRing : public RefBase
+{
+public:
+    // Creates a ring with room for at least capacity events, rounded up to
+    // a power of two, for the producer side.
+    SensorEventRing(size_t capacity);
+
+    // Maps a ring created by the producer, for the consumer side.
+    SensorEventRing(const sp<IMemoryHeap>& heap);
+
+    status_t initCheck() const;
+    sp<IMemoryHeap> getHeap() const { return mHeap; }
+    size_t getCapacity() const { return mCapacity; }
+
+    // Producer side. Copies as many events as fit in the ring and returns
+    // how many were written, the others are dropped and counted. wake is
+    // set if the consumer is waiting for a doorbell.
+    size_t write(ASensorEvent const* events, size_t count, bool* wake);
+    uint32_t getDroppedCount() const { return mDropped; }
+
+    // Producer side. Number of events written that the consumer hasn't
+    // read yet.
+    size_t getUnreadCount() const;
+
+    // Consumer side. Copies up to count events out of the ring and returns
+    // how many were read.
+    size_t read(ASensorEvent* events, size_t count);
+
+    // Consumer side. Asks the producer to ring the doorbell for the next
+    // events. read() must be called once more afterwards, for the events
+    // written before the producer saw the request.
+    void setWaiting();
+
+private:
+    // lives at the start of the shared memory, followed by the events
+    struct Control {
+        volatile int32_t writeIndex;    // written by the producer only
+        volatile int32_t readIndex;     // written by the consumer only
+        volatile int32_t waiting;       // set by the consumer, cleared by
+                                        // the producer
+        uint32_t capacity;
+    };
+
+    virtual ~SensorEventRing();
+
+    ASensorEvent* events() const;
+
+    sp<IMemoryHeap> mHeap;
+    Control* mControl;
+    size_t mCapacity;
+    // private copy of the index this side advances
+    uint32_t mIndex;
+    uint32_t mDropped;
+    status_t mInitCheck;
+};
+
+// ----------------------------------------------------------------------------
+}; // namespace android
+
+#endif // ANDROID_GUI_SENSOR_EVENT_RING_H
@@ -40,6 +40,7 @@ namespace android {
 class ISensorServer;
 class Sensor;
 class SensorEventQueue;
+class SharedSensorList;
 
 // ----------------------------------------------------------------------------
 
@@ -64,8 +65,8 @@ private:
 private:
     mutable Mutex mLock;
     mutable sp<ISensorServer> mSensorServer;
-    mutable Sensor const** mSensorList;
-    mutable Vector<Sensor> mSensors;
+    // shared by all the SensorManagers of the process
+    mutable sp<SharedSensorList> mSensorList;
     mutable sp<IBinder::DeathRecipient> mDeathObserver;
 };
 
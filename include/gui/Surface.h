@@ -71,6 +71,7 @@ public:
     status_t    setAlpha(float alpha=1.0f);
     status_t    setMatrix(float dsdx, float dtdx, float dsdy, float dtdy);
     status_t    setCrop(const Rect& crop);
+    status_t    setFrameRate(float frameRate);
 
     static status_t writeSurfaceToParcel(
             const sp<SurfaceControl>& control, Parcel* parcel);
@@ -94,12 +95,43 @@ private:
 
     status_t validate() const;
     void destroy();
+
+    // the values last given to the composer, a value set again isn't
+    // added to the transaction. Only the properties whose bit is set in
+    // cached are known, protected by mLock.
+    struct CachedState {
+        enum {
+            eLayerStack = 0x01,
+            eLayer      = 0x02,
+            ePosition   = 0x04,
+            eSize       = 0x08,
+            eAlpha      = 0x10,
+            eMatrix     = 0x20,
+            eCrop       = 0x40,
+            eFrameRate  = 0x80
+        };
+        CachedState();
+        uint32_t cached;
+        int32_t layerStack;
+        int32_t layer;
+        int32_t x, y;
+        uint32_t w, h;
+        float alpha;
+        float matrix[4];
+        Rect crop;
+        float frameRate;
+        // the flags whose bit is set in flagsMask are known
+        uint32_t flags;
+        uint32_t flagsMask;
+    };
+    status_t setFlagsCached(uint32_t flags, uint32_t mask);
     
     sp<SurfaceComposerClient>   mClient;
     sp<ISurface>                mSurface;
     SurfaceID                   mToken;
     uint32_t                    mIdentity;
     mutable Mutex               mLock;
+    CachedState                 mCachedState;
     
     mutable sp<Surface>         mSurfaceData;
 };
@@ -40,6 +40,7 @@ class Composer;
 class IMemoryHeap;
 class ISurfaceComposerClient;
 class ISurfaceTexture;
+class ITransactionCompletedListener;
 class Region;
 
 // ---------------------------------------------------------------------------
@@ -107,7 +108,9 @@ public:
     // All composer parameters must be changed within a transaction
     // several surfaces can be updated in one transaction, all changes are
     // committed at once when the transaction is closed.
-    // closeGlobalTransaction() requires an IPC with the server.
+    // closeGlobalTransaction() requires an IPC with the server, unless
+    // nothing changed. Transactions can be nested, only closing the
+    // outermost one sends the changes.
 
     //! Open a composer transaction on all active SurfaceComposerClients.
     static void openGlobalTransaction();
@@ -115,6 +118,12 @@ public:
     //! Close a composer transaction on all active SurfaceComposerClients.
     static void closeGlobalTransaction(bool synchronous = false);
 
+    //! Close a composer transaction without ever blocking, listener is
+    //! told once the transaction has been latched and composed. This takes
+    //! precedence over synchronous closes of nested transactions.
+    static void closeGlobalTransactionAsync(
+            const sp<ITransactionCompletedListener>& listener);
+
     static int setOrientation(int32_t dpy, int orientation, uint32_t flags);
 
     //! Flag the currently open transaction as an animation transaction.
@@ -131,8 +140,15 @@ public:
     status_t    setSize(SurfaceID id, uint32_t w, uint32_t h);
     status_t    setCrop(SurfaceID id, const Rect& crop);
     status_t    setLayerStack(SurfaceID id, uint32_t layerStack);
+    //! Hint the rate (in Hz) this surface's content updates at, 0 for none.
+    status_t    setFrameRate(SurfaceID id, float frameRate);
     status_t    destroySurface(SurfaceID sid);
 
+    //! Opt in to sending this client's changes through shared memory
+    //! rather than a binder transaction, for the transactions that only
+    //! change this client's surfaces and that nothing waits for.
+    status_t    enableStateChannel();
+
     static void setDisplaySurface(const sp<IBinder>& token,
             const sp<ISurfaceTexture>& surface);
     static void setDisplayLayerStack(const sp<IBinder>& token,
@@ -95,6 +95,15 @@ public:
     // override the limit.
     status_t setDefaultMaxBufferCount(int bufferCount);
 
+    // setImageCacheSize sets how many EGLImages may be kept for buffers that
+    // are no longer in any slot, so that the image doesn't have to be
+    // recreated if the same GraphicBuffer comes back.  This helps producers
+    // that cycle one pool of buffers through several queues.  Cached images
+    // keep their buffer alive, they are evicted in least recently used order
+    // or when they haven't been needed for a while.  The default of 0
+    // disables the cache.
+    void setImageCacheSize(size_t size);
+
     // getTransformMatrix retrieves the 4x4 texture coordinate transform matrix
     // associated with the texture image set by the most recent call to
     // updateTexImage.
@@ -157,6 +166,11 @@ public:
     // ready to be read from.
     sp<Fence> getCurrentFence() const;
 
+    // getQueuedBufferFence returns the fence indicating when the buffer the
+    // next updateTexImage call would latch is ready to be read from, or
+    // NULL if no buffer is queued.
+    sp<Fence> getQueuedBufferFence() const;
+
     // doGLFenceWait inserts a wait command into the OpenGL ES command stream
     // to ensure that it is safe for future OpenGL ES commands to access the
     // current texture buffer.  This must be called each time updateTexImage
@@ -224,7 +238,8 @@ protected:
 
     // acquireBufferLocked overrides the ConsumerBase method to update the
     // mEglSlots array in addition to the ConsumerBase behavior.
-    virtual status_t acquireBufferLocked(BufferQueue::BufferItem *item);
+    virtual status_t acquireBufferLocked(BufferQueue::BufferItem *item,
+            nsecs_t presentWhen = 0);
 
     // releaseBufferLocked overrides the ConsumerBase method to update the
     // mEglSlots array in addition to the ConsumerBase.
@@ -246,12 +261,49 @@ private:
         virtual ~BufferRejecter() { }
     };
     friend class Layer;
-    status_t updateTexImage(BufferRejecter* rejecter, bool skipSync);
+    // presentWhen is passed to BufferQueue::acquireBuffer, PRESENT_LATER is
+    // returned when no buffer is due yet.
+    status_t updateTexImage(BufferRejecter* rejecter, bool skipSync,
+            nsecs_t presentWhen = 0);
+
+    // setLazyBinding makes updateTexImage() only latch the buffer when
+    // enabled: its EGLImage isn't created nor bound to the texture until
+    // bindTextureImage() is called, which SurfaceFlinger only does if it
+    // composes the buffer with GLES.
+    void setLazyBinding(bool enabled);
+
+    // bindTextureImage binds the current buffer to the texture, after
+    // creating its EGLImage if needed. It does nothing if it is bound
+    // already.
+    status_t bindTextureImage();
+
+    // createImageLocked creates the EGLImage of the given slot if it
+    // doesn't have one.
+    status_t createImageLocked(int slot);
 
     // createImage creates a new EGLImage from a GraphicBuffer.
     EGLImageKHR createImage(EGLDisplay dpy,
             const sp<GraphicBuffer>& graphicBuffer);
 
+    // releaseImageLocked takes the EGLImage out of the given slot and moves
+    // it to the image cache, or destroys it if the cache is disabled or
+    // canCache is false.
+    void releaseImageLocked(int slot, bool canCache);
+
+    // takeCachedImageLocked removes the cached EGLImage for the given buffer
+    // from the image cache and returns it, or returns EGL_NO_IMAGE_KHR if
+    // there is none.
+    EGLImageKHR takeCachedImageLocked(const sp<GraphicBuffer>& graphicBuffer);
+
+    // trimImageCacheLocked destroys the cached EGLImages that are unused for
+    // too long, then the least recently used ones until at most maxSize
+    // remain.
+    void trimImageCacheLocked(size_t maxSize);
+
+    // probeFenceSyncLocked sets mNativeFenceSync and mWaitSync for the given
+    // EGLDisplay.
+    void probeFenceSyncLocked(EGLDisplay dpy);
+
     // freeBufferLocked frees up the given buffer slot.  If the slot has been
     // initialized this will release the reference to the GraphicBuffer in that
     // slot and destroy the EGLImage in that slot.  Otherwise it has no effect.
@@ -331,6 +383,20 @@ private:
     // never changes.
     const bool mUseFenceSync;
 
+    // mNativeFenceSync and mWaitSync indicate whether the EGLDisplay in use
+    // supports EGL_ANDROID_native_fence_sync and EGL_ANDROID_wait_sync, in
+    // which case release fences are native fences and doGLFenceWait waits on
+    // the GPU instead of the CPU.  They are probed whenever mEglDisplay is
+    // set, unless the compile options force them on.
+    bool mNativeFenceSync;
+    bool mWaitSync;
+
+    // mCpuFenceWaits counts the times a fence wasn't signaled yet and the
+    // calling thread had to block on it, mCpuFenceWaitTime is the total
+    // time spent blocked.
+    mutable uint32_t mCpuFenceWaits;
+    mutable nsecs_t mCpuFenceWaitTime;
+
     // mTexTarget is the GL texture target with which the GL texture object is
     // associated.  It is set in the constructor and never changed.  It is
     // almost always GL_TEXTURE_EXTERNAL_OES except for one use case in Android
@@ -351,6 +417,10 @@ private:
         // mEglImage is the EGLImage created from mGraphicBuffer.
         EGLImageKHR mEglImage;
 
+        // mImageBuffer is the buffer mEglImage was created from. The slot may
+        // have been given a new buffer since.
+        sp<GraphicBuffer> mImageBuffer;
+
         // mFence is the EGL sync object that must signal before the buffer
         // associated with this buffer slot may be dequeued. It is initialized
         // to EGL_NO_SYNC_KHR when the buffer is created and (optionally, based
@@ -379,6 +449,31 @@ private:
     // of the buffer allocated to a slot.
     EGLSlot mEglSlots[BufferQueue::NUM_BUFFER_SLOTS];
 
+    // CachedImage is an EGLImage kept after its buffer left the slots.
+    struct CachedImage {
+        sp<GraphicBuffer> mGraphicBuffer;
+        EGLImageKHR mEglImage;
+        // mLastUsed is the value of mImageCacheClock when the image was
+        // cached.
+        uint32_t mLastUsed;
+    };
+
+    // mImageCache holds the cached EGLImages, created on mEglDisplay, least
+    // recently used first.
+    Vector<CachedImage> mImageCache;
+
+    // mImageCacheSize is the maximum number of entries in mImageCache.
+    size_t mImageCacheSize;
+
+    // mImageCacheClock counts the acquired buffers, it is used to expire
+    // cached images.
+    uint32_t mImageCacheClock;
+
+    // image cache statistics, shown in dump
+    uint32_t mImageCacheHits;
+    uint32_t mImageCacheMisses;
+    uint32_t mImageCacheEvictions;
+
     // mCurrentTexture is the buffer slot index of the buffer that is currently
     // bound to the OpenGL texture. It is initialized to INVALID_BUFFER_SLOT,
     // indicating that no buffer slot is currently bound to the texture. Note,
@@ -394,6 +489,12 @@ private:
     // It is set to false by detachFromContext, and then set to true again by
     // attachToContext.
     bool mAttached;
+
+    // mLazyBinding is set by setLazyBinding, mCurrentTextureBound is whether
+    // the current buffer is bound to the texture; it is always true unless
+    // mLazyBinding is.
+    bool mLazyBinding;
+    bool mCurrentTextureBound;
 };
 
 // ----------------------------------------------------------------------------
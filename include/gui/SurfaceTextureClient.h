@@ -49,6 +49,12 @@ public:
 
     sp<ISurfaceTexture> getISurfaceTexture() const;
 
+    // setDequeueAhead enables or disables dequeue-ahead: in synchronous
+    // mode, each queueBuffer then has a helper thread dequeue the next
+    // buffer, so that the next dequeueBuffer seldom waits for the consumer
+    // to release one. The thread is started the first time it is enabled.
+    status_t setDequeueAhead(bool enabled);
+
 protected:
     SurfaceTextureClient();
     virtual ~SurfaceTextureClient();
@@ -131,11 +137,20 @@ protected:
     enum { DEFAULT_FORMAT = PIXEL_FORMAT_RGBA_8888 };
 
 private:
+    class DequeueAheadThread;
+
     void freeAllBuffers();
+    void cancelPrefetchedBufferLocked();
+    // waits for the dequeue-ahead in flight, if any, to complete
+    void waitForDequeueAheadLocked();
+    // run by mDequeueAheadThread, returns false when it must exit
+    bool dequeueAhead();
     int getSlotFromBufferLocked(android_native_buffer_t* buffer) const;
 
     struct BufferSlot {
         sp<GraphicBuffer> buffer;
+        // area where this buffer differs from the last posted buffer,
+        // which lock() copies back before handing the buffer out
         Region dirtyRegion;
     };
 
@@ -217,6 +232,34 @@ private:
     // one buffer behind the producer.
     mutable bool mConsumerRunningBehind;
 
+    // mSwapIntervalZero is true once setSwapInterval(0) has put the
+    // SurfaceTexture in asynchronous mode, in which queueBuffer also
+    // dequeues the next buffer, in the same transaction.
+    bool mSwapIntervalZero;
+
+    // mPrefetchedSlot is the slot dequeued along with the last queued
+    // buffer, or -1. The next dequeueBuffer call hands it out if the
+    // requested geometry, format and usage still match mPrefetchedWidth,
+    // mPrefetchedHeight, mPrefetchedFormat and mPrefetchedUsage, otherwise
+    // the slot is canceled. mPrefetchedResult and mPrefetchedFence are
+    // what ISurfaceTexture::dequeueBuffer returned for it.
+    int mPrefetchedSlot;
+    status_t mPrefetchedResult;
+    sp<Fence> mPrefetchedFence;
+    uint32_t mPrefetchedWidth;
+    uint32_t mPrefetchedHeight;
+    uint32_t mPrefetchedFormat;
+    uint32_t mPrefetchedUsage;
+
+    // mDequeueAhead is set by setDequeueAhead. queueBuffer sets
+    // mDequeueAheadPending to have mDequeueAheadThread dequeue the next
+    // buffer, with the mPrefetched* parameters, into mPrefetchedSlot; it is
+    // cleared, and mDequeueAheadCondition signaled, when that is done.
+    bool mDequeueAhead;
+    bool mDequeueAheadPending;
+    Condition mDequeueAheadCondition;
+    sp<DequeueAheadThread> mDequeueAheadThread;
+
     // mMutex is the mutex used to prevent concurrent access to the member
     // variables of SurfaceTexture objects. It must be locked whenever the
     // member variables are accessed.
@@ -228,6 +271,7 @@ private:
     bool                        mConnectedToCpu;
 
     // must be accessed from lock/unlock thread only
+    // area of the locked buffer the client promised to redraw
     Region mDirtyRegion;
 };
 
@@ -30,8 +30,12 @@ class IPowerManager : public IInterface
 public:
     DECLARE_META_INTERFACE(PowerManager);
 
-    virtual status_t acquireWakeLock(int flags, const sp<IBinder>& lock, const String16& tag) = 0;
-    virtual status_t releaseWakeLock(const sp<IBinder>& lock, int flags) = 0;
+    // with isOneWay the call returns without waiting for the power manager,
+    // and so can't report its errors
+    virtual status_t acquireWakeLock(int flags, const sp<IBinder>& lock, const String16& tag,
+            bool isOneWay = false) = 0;
+    virtual status_t releaseWakeLock(const sp<IBinder>& lock, int flags,
+            bool isOneWay = false) = 0;
 };
 
 // ----------------------------------------------------------------------------
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_WAKELOCKPROXY_H
+#define ANDROID_WAKELOCKPROXY_H
+
+#include <utils/Errors.h>
+#include <utils/KeyedVector.h>
+#include <utils/Singleton.h>
+#include <utils/String16.h>
+#include <utils/Thread.h>
+#include <utils/Timers.h>
+
+#include <powermanager/IPowerManager.h>
+#include <powermanager/PowerManager.h>
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+
+/*
+ * Process-wide wake locks, counted per tag. Only the first acquire() of a
+ * tag and the last release() reach the power manager, with one-way binder
+ * calls, and that release is deferred by a short delay so that a lock
+ * acquired again right away costs no transaction at all.
+ */
+class WakeLockProxy : public Singleton<WakeLockProxy>
+{
+public:
+    // how long a released wake lock stays held in case it is acquired again
+    static const nsecs_t DEFAULT_RELEASE_DELAY = 100000000; // 100 ms
+
+    status_t acquire(const String16& tag,
+            int flags = POWERMANAGER_PARTIAL_WAKE_LOCK);
+    status_t release(const String16& tag);
+
+    // 0 releases wake locks right away
+    void setReleaseDelay(nsecs_t delay);
+
+private:
+    friend class Singleton<WakeLockProxy>;
+    WakeLockProxy();
+    ~WakeLockProxy();
+
+    struct WakeLock {
+        WakeLock() : count(0), flags(0), releaseTime(0) { }
+        size_t count;
+        int flags;
+        // the token the power manager knows, NULL when not held
+        sp<IBinder> token;
+        // when count dropped to 0, the lock is released after the delay
+        nsecs_t releaseTime;
+    };
+
+    class ReleaseThread : public Thread {
+        WakeLockProxy& mProxy;
+        virtual bool threadLoop();
+    public:
+        ReleaseThread(WakeLockProxy& proxy) : mProxy(proxy) { }
+    };
+
+    // returns the time of the next deferred release, or 0 if there's none
+    nsecs_t releaseExpiredLocked(nsecs_t now);
+    void releaseLocked(WakeLock& lock);
+    sp<IPowerManager> getPowerManagerLocked();
+
+    Mutex mLock;
+    Condition mCondition;
+    KeyedVector<String16, WakeLock> mWakeLocks;
+    sp<IPowerManager> mPowerManager;
+    sp<ReleaseThread> mReleaseThread;
+    nsecs_t mReleaseDelay;
+};
+
+// ----------------------------------------------------------------------------
+
+}; // namespace android
+
+#endif // ANDROID_WAKELOCKPROXY_H
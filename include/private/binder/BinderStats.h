@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_BINDER_STATS_H
+#define ANDROID_BINDER_STATS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <cutils/atomic.h>
+#include <cutils/compiler.h>
+
+#include <utils/String16.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+#include <utils/KeyedVector.h>
+#include <utils/threads.h>
+
+// ---------------------------------------------------------------------------
+namespace android {
+
+/*
+ * BinderStats is a per-process table of the binder transactions sent and
+ * received, keyed by interface descriptor and transaction code: count,
+ * bytes and a latency histogram.
+ *
+ * Collection is off unless the debug.binder.stats property is set to 1;
+ * like the atrace tags, the property is re-read when a sysprops change is
+ * reported to the process. The table is dumped by passing --binder-stats
+ * to any binder service's dump, e.g. "dumpsys SurfaceFlinger --binder-stats".
+ */
+class BinderStats
+{
+public:
+    enum Direction {
+        OUTGOING = 0,
+        INCOMING = 1
+    };
+
+    enum {
+        // bucket i counts latencies below FIRST_BUCKET_US << i, the last
+        // bucket counts the rest
+        FIRST_BUCKET_US     = 16,
+        NUM_BUCKETS         = 16,
+        // the table stops growing past this many keys
+        MAX_ENTRIES         = 256
+    };
+
+    static inline bool isEnabled() {
+        if (CC_UNLIKELY(!android_atomic_acquire_load(&sIsReady))) {
+            init();
+        }
+        return sEnabled;
+    }
+
+    static void record(Direction direction, const String16& descriptor,
+            uint32_t code, size_t dataSize, size_t replySize, nsecs_t latency);
+
+    static void reset();
+    static void dump(String8& result);
+
+private:
+    struct Key {
+        String16 descriptor;
+        uint32_t code;
+        uint32_t direction;
+        bool operator < (const Key& rhs) const;
+    };
+
+    struct Entry {
+        Entry();
+        nsecs_t getPercentile(uint32_t percentile) const;
+        uint32_t count;
+        uint64_t dataBytes;
+        uint64_t replyBytes;
+        nsecs_t latencyTotal;
+        nsecs_t latencyMax;
+        uint32_t buckets[NUM_BUCKETS];
+    };
+
+    static void init();
+    static void changeCallback();
+    static void loadSystemProperty();
+
+    static volatile int32_t sIsReady;
+    static bool sEnabled;
+    static Mutex sMutex;
+    static KeyedVector<Key, Entry>* sEntries;
+};
+
+}; // namespace android
+// ---------------------------------------------------------------------------
+
+#endif // ANDROID_BINDER_STATS_H
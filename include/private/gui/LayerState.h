@@ -48,13 +48,14 @@ struct layer_state_t {
         eVisibilityChanged          = 0x00000040,
         eLayerStackChanged          = 0x00000080,
         eCropChanged                = 0x00000100,
+        eFrameRateChanged           = 0x00000200,
     };
 
     layer_state_t()
         :   surface(0), what(0),
             x(0), y(0), z(0), w(0), h(0), layerStack(0),
             alpha(0), flags(0), mask(0),
-            reserved(0)
+            reserved(0), frameRate(0)
     {
         matrix.dsdx = matrix.dtdy = 1.0f;
         matrix.dsdy = matrix.dtdx = 0.0f;
@@ -64,6 +65,13 @@ struct layer_state_t {
     status_t    write(Parcel& output) const;
     status_t    read(const Parcel& input);
 
+    // compact form used by ISurfaceComposer::setTransactionState(): the
+    // surface, 'what' and only the fields 'what' says have changed, as
+    // 32-bit words. The cursors are advanced past the state.
+    size_t      getCompactSize() const;
+    void        writeCompact(uint32_t*& cursor) const;
+    status_t    readCompact(uint32_t const*& cursor, uint32_t const* end);
+
             struct matrix22_t {
                 float   dsdx;
                 float   dtdx;
@@ -84,6 +92,8 @@ struct layer_state_t {
             uint8_t         reserved;
             matrix22_t      matrix;
             Rect            crop;
+            // preferred frame rate in Hz, 0 means no preference
+            float           frameRate;
             // non POD must be last. see write/read
             Region          transparentRegion;
 };
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SF_LAYER_STATE_CHANNEL_H
+#define ANDROID_SF_LAYER_STATE_CHANNEL_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/Errors.h>
+#include <utils/RefBase.h>
+#include <utils/Vector.h>
+
+#include <binder/IMemory.h>
+
+namespace android {
+
+/*
+ * A LayerStateChannel is a single producer, single consumer ring of layer
+ * transactions in shared memory, allocated by SurfaceFlinger for a client
+ * that asks for one. The client writes the compact layer states of a
+ * transaction (see layer_state_t::writeCompact()) straight into the ring
+ * and SurfaceFlinger applies them when it handles its next transaction.
+ * ISurfaceComposerClient::signalStateChannel() is only used as a doorbell,
+ * at most once until SurfaceFlinger has looked at the ring again.
+ *
+ * A transaction never wraps around the end of the ring, so the producer
+ * writes it in place. The consumer copies each transaction out before
+ * parsing it, and doesn't trust the producer's indices beyond what's
+ * needed to stay within the ring.
+ */
+class LayerStateChannel : public RefBase
+{
+public:
+    // Creates a channel with room for at least size bytes of states,
+    // for the consumer side.
+    LayerStateChannel(size_t size);
+
+    // Maps a channel created by the consumer, for the producer side.
+    LayerStateChannel(const sp<IMemoryHeap>& heap);
+
+    status_t initCheck() const;
+    sp<IMemoryHeap> getHeap() const { return mHeap; }
+
+    // Producer side. Returns where to write a transaction of the given
+    // number of words, or NULL if it doesn't fit in the ring right now.
+    uint32_t* beginWrite(size_t words);
+
+    // Producer side. Publishes the transaction started with beginWrite().
+    // wake is set if the doorbell must be rung.
+    void endWrite(bool* wake);
+
+    // Producer side. Whether the consumer has read everything written.
+    bool isEmpty() const;
+
+    // Consumer side. Must be called before reading the transactions a
+    // doorbell announced, so that the next write rings it again.
+    void clearSignaled();
+
+    // Consumer side. Returns a copy of the next transaction and its size
+    // in words, or NULL if there's none.
+    uint32_t const* read(size_t* words);
+
+private:
+    // lives at the start of the shared memory, followed by the words
+    struct Control {
+        volatile int32_t writeIndex;    // written by the producer only
+        volatile int32_t readIndex;     // written by the consumer only
+        volatile int32_t signaled;      // set by the producer, cleared by
+                                        // the consumer
+        uint32_t capacity;
+    };
+
+    // a transaction is its size in words followed by its states, this
+    // size means the rest of the ring must be skipped
+    enum { WRAP = 0xFFFFFFFF };
+
+    virtual ~LayerStateChannel();
+
+    uint32_t* words() const;
+
+    sp<IMemoryHeap> mHeap;
+    Control* mControl;
+    uint32_t mCapacity;
+    // private copy of the index this side advances
+    uint32_t mIndex;
+    // producer side, the transaction being written
+    uint32_t mPending;
+    // consumer side, the last transaction read
+    Vector<uint32_t> mBuffer;
+    status_t mInitCheck;
+};
+
+}; // namespace android
+
+#endif // ANDROID_SF_LAYER_STATE_CHANNEL_H
@@ -25,6 +25,8 @@
 #include <ui/Rect.h>
 #include <utils/Flattenable.h>
 #include <utils/String8.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
 
 struct ANativeWindowBuffer;
 
@@ -77,9 +79,30 @@ public:
     // becomes signaled when both f1 and f2 are signaled (even if f1 or f2 is
     // destroyed before it becomes signaled).  The name argument specifies the
     // human-readable name to associated with the new Fence object.
+    //
+    // No new fence is created when one of f1 and f2 has already signaled (or
+    // is invalid) or both are the same object, the other one is returned
+    // instead.
     static sp<Fence> merge(const String8& name, const sp<Fence>& f1,
             const sp<Fence>& f2);
 
+    // merge combines any number of Fence objects into one that becomes
+    // signaled when all of them are. Fences that have already signaled are
+    // left out and, if a single fence remains, it is returned as is. The
+    // others are merged two by two so the fewest sync points get copied.
+    static sp<Fence> merge(const String8& name,
+            const Vector< sp<Fence> >& fences);
+
+    // getSignalTime returns the time at which the fence signaled, that is the
+    // latest signal time of its sync points, as reported by the sync driver
+    // in the SYSTEM_TIME_MONOTONIC time base. SIGNAL_TIME_PENDING is returned
+    // if the fence hasn't signaled yet and SIGNAL_TIME_INVALID if the Fence
+    // has no file descriptor, signaled with an error, or couldn't be queried.
+    nsecs_t getSignalTime() const;
+
+    static const nsecs_t SIGNAL_TIME_PENDING = 0x7fffffffffffffffLL;
+    static const nsecs_t SIGNAL_TIME_INVALID = -1;
+
     // Return a duplicate of the fence file descriptor. The caller is
     // responsible for closing the returned file descriptor. On error, -1 will
     // be returned and errno will indicate the problem.
@@ -103,6 +126,9 @@ private:
     Fence& operator = (const Fence& rhs);
     const Fence& operator = (const Fence& rhs) const;
 
+    // isPending returns whether fence is valid and hasn't signaled yet.
+    static bool isPending(const sp<Fence>& fence);
+
     int mFenceFd;
 };
 
@@ -24,6 +24,7 @@
 
 #include <utils/threads.h>
 #include <utils/String8.h>
+#include <utils/Timers.h>
 
 #include <ui/ANativeObjectBase.h>
 #include <ui/Rect.h>
@@ -82,6 +83,10 @@ private:
     static int queueBuffer_DEPRECATED(ANativeWindow* window, ANativeWindowBuffer* buffer);
     static int lockBuffer_DEPRECATED(ANativeWindow* window, ANativeWindowBuffer* buffer);
 
+    // allocates the framebuffer at index mNumBuffers, must be called with
+    // no buffer dequeued
+    bool addBufferLocked();
+
     framebuffer_device_t* fbDev;
     alloc_device_t* grDev;
 
@@ -95,6 +100,22 @@ private:
     int32_t mBufferHead;
     int32_t mCurrentBufferIndex;
     bool mUpdateOnDemand;
+
+    // mMaxBuffers is how many buffers may be allocated. When it's larger
+    // than mNumBuffers, a buffer is added once posting stalls often enough
+    // (debug.sf.fb_buffers=auto).
+    int32_t mMaxBuffers;
+    uint32_t mRecentFrames;
+    uint32_t mRecentStalls;
+
+    // time spent waiting in dequeueBuffer for a free buffer and in the
+    // HAL's post, for dump()
+    uint32_t mFrames;
+    uint32_t mDequeueStalls;
+    nsecs_t mDequeueWaitTime;
+    nsecs_t mMaxDequeueWaitTime;
+    nsecs_t mPostTime;
+    nsecs_t mMaxPostTime;
 #ifdef SAMSUNG_HDMI_SUPPORT
     SecHdmiClient *mHdmiClient;
 #endif
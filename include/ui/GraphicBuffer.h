@@ -100,15 +100,27 @@ public:
     
     status_t reallocate(uint32_t w, uint32_t h, PixelFormat f, uint32_t usage);
 
+    // allocates the buffer of an empty GraphicBuffer on behalf of owner,
+    // possibly recycling one owner freed, see
+    // GraphicBufferAllocator::allocOwned()
+    status_t allocOwned(uint32_t w, uint32_t h, PixelFormat f, uint32_t usage,
+            int32_t owner);
+
     status_t lock(uint32_t usage, void** vaddr);
     status_t lock(uint32_t usage, const Rect& rect, void** vaddr);
     status_t unlock();
+    status_t unlockAsync(int* fenceFd);
 #ifdef QCOM_BSP
     status_t perform(buffer_handle_t hnd, int operation,
                      uint32_t w, uint32_t h, PixelFormat format);
 #endif
 
     ANativeWindowBuffer* getNativeBuffer() const;
+
+    // identifies the buffer memory across processes: a buffer keeps the id
+    // of the one it was unflattened from, 0 if it wasn't allocated through
+    // GraphicBuffer
+    uint64_t getId() const              { return mId; }
     
     void setIndex(int index);
     int getIndex() const;
@@ -123,6 +135,8 @@ private:
         ownNone   = 0,
         ownHandle = 1,
         ownData   = 2,
+        // the handle came from the import cache, which owns it
+        ownImport = 3,
     };
 
     inline const GraphicBufferMapper& getBufferMapper() const {
@@ -150,6 +164,8 @@ private:
             uint32_t usage, uint32_t bufferSize);
 #endif
     void free_handle();
+    status_t importHandle(uint64_t id, int const* ints, int fds[],
+            size_t numFds, size_t numInts);
 
     // Flattenable interface
     size_t getFlattenedSize() const;
@@ -163,6 +179,7 @@ private:
     GraphicBufferMapper& mBufferMapper;
     ssize_t mInitCheck;
     int mIndex;
+    uint64_t mId;
 
     // If we're wrapping another buffer then this reference will make sure it
     // doesn't get freed.
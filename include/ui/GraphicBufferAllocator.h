@@ -73,8 +73,42 @@ public:
             buffer_handle_t* handle, int32_t* stride, uint32_t bufferSize);
 #endif
 
+    // allocOwned is alloc() for a buffer accounted to owner (see setOwner).
+    // It may hand back one of the buffers owner itself freed.
+    status_t allocOwned(uint32_t w, uint32_t h, PixelFormat format, int usage,
+            int32_t owner, buffer_handle_t* handle, int32_t* stride);
+
     status_t free(buffer_handle_t handle);
 
+    // setRecyclingPoolSize enables recycling of freed buffers: up to maxBytes
+    // worth of them are kept around and handed out again when a buffer with
+    // the same size, format and usage is requested, the least recently freed
+    // ones are released first when the pool is full. Zero (the default)
+    // disables the pool and releases its current content.
+    //
+    // A recycled buffer still has its previous content, and the processes
+    // that used it may still have it mapped, so only owned buffers are
+    // pooled and they only go back to allocOwned() for the same owner.
+    void setRecyclingPoolSize(size_t maxBytes);
+
+    // setOwner accounts the allocation of handle to owner, an id chosen by
+    // the caller, until it is freed. Zero is no owner.
+    void setOwner(buffer_handle_t handle, int32_t owner);
+
+    // releaseOwner releases the buffers owner freed into the recycling pool,
+    // once it won't allocate anymore.
+    void releaseOwner(int32_t owner);
+
+    struct owner_usage_t {
+        uint32_t usage;     // or'ed over the buffers owned so far
+        uint32_t count;
+        size_t size;
+    };
+
+    // getOwnerUsage replaces the content of usage with the totals of the
+    // owners that have allocated buffers.
+    void getOwnerUsage(KeyedVector<int32_t, owner_usage_t>* usage) const;
+
     void dump(String8& res) const;
     static void dumpToSystemLog();
 
@@ -86,10 +120,39 @@ private:
         PixelFormat format;
         uint32_t usage;
         size_t size;
+        int32_t owner;
     };
     
     static Mutex sLock;
     static KeyedVector<buffer_handle_t, alloc_rec_t> sAllocList;
+    // the totals of the owned allocations in sAllocList
+    static KeyedVector<int32_t, owner_usage_t> sOwners;
+
+    struct pooled_buffer_t {
+        buffer_handle_t handle;
+        int32_t owner;      // when it was freed
+    };
+
+    // the recycling pool, ordered from least to most recently freed.
+    // Its buffers are still in sAllocList.
+    static Vector<pooled_buffer_t> sPool;
+    static size_t sPoolSize;
+    static size_t sPoolMaxSize;
+    static uint32_t sPoolHits;
+    static uint32_t sPoolMisses;
+
+    // trimPoolLocked removes the least recently freed buffers from the
+    // pool until it holds no more than maxSize bytes, they are then
+    // released asynchronously.
+    static void trimPoolLocked(size_t maxSize);
+
+    // takeFromPoolLocked removes the most recently freed buffer of owner
+    // matching the request from the pool, returns false if there is none.
+    static bool takeFromPoolLocked(uint32_t w, uint32_t h, PixelFormat format,
+            int usage, int32_t owner, buffer_handle_t* handle, int32_t* stride);
+
+    // setOwnerLocked moves the allocation rec to owner's totals.
+    static void setOwnerLocked(alloc_rec_t& rec, int32_t owner);
     
     friend class Singleton<GraphicBufferAllocator>;
     friend class BufferLiberatorThread;
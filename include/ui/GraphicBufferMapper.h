@@ -20,7 +20,11 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+#include <utils/KeyedVector.h>
 #include <utils/Singleton.h>
+#include <utils/threads.h>
+
+#include <ui/Rect.h>
 
 #include <hardware/gralloc.h>
 
@@ -31,8 +35,6 @@ namespace android {
 
 // ---------------------------------------------------------------------------
 
-class Rect;
-
 class GraphicBufferMapper : public Singleton<GraphicBufferMapper>
 {
 public:
@@ -42,11 +44,22 @@ public:
 
     status_t unregisterBuffer(buffer_handle_t handle);
     
+    // lock maps the buffer for CPU access. Locking a buffer for reading
+    // while it is already locked for reading through the mapper, with a
+    // subset of its usage and within its bounds, returns the active mapping
+    // without calling into gralloc; each lock must still be matched by an
+    // unlock. Writers always go through gralloc.
     status_t lock(buffer_handle_t handle,
             int usage, const Rect& bounds, void** vaddr);
 
     status_t unlock(buffer_handle_t handle);
 
+    // unlockAsync unlocks the buffer like unlock, but lets the HAL finish
+    // the cache maintenance in the background, in which case fenceFd is set
+    // to a fence that signals when the buffer contents are coherent.
+    // Otherwise the unlock happens synchronously and fenceFd is set to -1.
+    status_t unlockAsync(buffer_handle_t handle, int* fenceFd);
+
 #ifdef EXYNOS4_ENHANCEMENTS
     status_t getphys(buffer_handle_t handle, void** paddr);
 #endif
@@ -63,6 +76,21 @@ private:
     friend class Singleton<GraphicBufferMapper>;
     GraphicBufferMapper();
     gralloc_module_t const *mAllocMod;
+
+    // an active gralloc lock, shared by nested read-only lock calls. count
+    // is the number of outstanding lock calls, grallocLocks how many of them
+    // went to gralloc; the last unlock releases the first gralloc lock.
+    struct Mapping {
+        int usage;
+        Rect bounds;
+        void* vaddr;
+        uint32_t count;
+        uint32_t grallocLocks;
+    };
+
+    // mLock protects mMappings, it is never held while calling gralloc
+    Mutex mLock;
+    KeyedVector<buffer_handle_t, Mapping> mMappings;
 };
 
 // ---------------------------------------------------------------------------
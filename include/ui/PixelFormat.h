@@ -25,6 +25,7 @@
 #ifndef UI_PIXELFORMAT_H
 #define UI_PIXELFORMAT_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/types.h>
 #include <utils/Errors.h>
@@ -117,8 +118,43 @@ struct PixelFormatInfo {
     uint32_t    reserved1;
 };
 
-// Consider caching the results of these functions are they're not
-// guaranteed to be fast.
+// The fixed properties of a real pixel format. They live in a table built
+// at compile time, cheap enough to look up for every frame.
+struct PixelFormatDescriptor {
+    uint8_t     bytesPerPixel;  // of the first plane
+    uint8_t     bitsPerPixel;   // over all the planes
+    uint8_t     components;     // as in PixelFormatInfo, OTHER for YUV
+    uint8_t     planes;         // 2 for semi-planar, 3 for planar YUV
+    PixelFormatInfo::szinfo cinfo[4];   // PixelFormatInfo::INDEX_* bits
+
+    size_t getSize(size_t ci) const {
+        return (ci <= 3) ? (cinfo[ci].h - cinfo[ci].l) : 0;
+    }
+    bool isOpaque() const {
+        return cinfo[PixelFormatInfo::INDEX_ALPHA].h <=
+                cinfo[PixelFormatInfo::INDEX_ALPHA].l;
+    }
+};
+
+// Indexed by format, the YUV formats from the HAL included, but YV12.
+enum { NUM_PIXEL_FORMAT_DESCRIPTORS = HAL_PIXEL_FORMAT_YCbCr_422_I + 1 };
+extern const PixelFormatDescriptor
+        gPixelFormatDescriptors[NUM_PIXEL_FORMAT_DESCRIPTORS];
+extern const PixelFormatDescriptor gPixelFormatDescriptorYV12;
+
+// Returns the descriptor of "format", or NULL if it isn't a real pixel
+// format we know about.
+inline const PixelFormatDescriptor* getPixelFormatDescriptor(PixelFormat format)
+{
+    const PixelFormatDescriptor* d = NULL;
+    if (uint32_t(format) < NUM_PIXEL_FORMAT_DESCRIPTORS) {
+        d = &gPixelFormatDescriptors[format];
+    } else if (format == HAL_PIXEL_FORMAT_YV12) {
+        d = &gPixelFormatDescriptorYV12;
+    }
+    return (d != NULL && d->bitsPerPixel != 0) ? d : NULL;
+}
+
 ssize_t     bytesPerPixel(PixelFormat format);
 ssize_t     bitsPerPixel(PixelFormat format);
 status_t    getPixelFormatInfo(PixelFormat format, PixelFormatInfo* info);
@@ -43,9 +43,9 @@ public:
         Region& operator = (const Region& rhs);
 
     inline  bool        isEmpty() const     { return getBounds().isEmpty(); }
-    inline  bool        isRect() const      { return mStorage.size() == 1; }
+    inline  bool        isRect() const      { return storageSize() == 1; }
 
-    inline  Rect        getBounds() const   { return mStorage[mStorage.size() - 1]; }
+    inline  Rect        getBounds() const   { return storageArray()[storageSize() - 1]; }
     inline  Rect        bounds() const      { return getBounds(); }
 
             // the region becomes its bounds
@@ -148,6 +148,13 @@ private:
     const Region operation(const Region& rhs, int op) const;
     const Region operation(const Region& rhs, int dx, int dy, int op) const;
 
+    // handles the trivial cases (empty operands, disjoint bounds, rect/rect
+    // and containment) without going through region_operator<>. returns
+    // false if the generic path must be used.
+    static bool boolean_operation_fast(int op, Region& dst,
+            const Region& lhs, Rect const* rhs, size_t rhsCount,
+            const Rect& rhsBounds, int dx, int dy);
+
     static void boolean_operation(int op, Region& dst,
             const Region& lhs, const Region& rhs, int dx, int dy);
     static void boolean_operation(int op, Region& dst,
@@ -163,12 +170,30 @@ private:
 
     static bool validate(const Region& reg,
             const char* name, bool silent = false);
-    
-    // mStorage is a (manually) sorted array of Rects describing the region
+
+    // the storage is either inline (mInlineCount > 0) or in mStorage
+    inline  Rect const* storageArray() const {
+        return mInlineCount ? mInline : mStorage.array();
+    }
+    inline  size_t      storageSize() const {
+        return mInlineCount ? mInlineCount : mStorage.size();
+    }
+            Rect*       editStorageArray();
+            void        setStorage(const Vector<Rect>& storage);
+            void        setStorage(Rect const* rects, size_t count);
+
+    // The storage is a (manually) sorted array of Rects describing the region
     // with an extra Rect as the last element which is set to the
     // bounds of the region. However, if the region is
-    // a simple Rect then mStorage contains only that rect.
+    // a simple Rect then the storage contains only that rect.
+    //
+    // Most regions only have a handful of rects, they're kept in mInline
+    // to avoid a heap allocation. Larger regions are kept in mStorage,
+    // in which case mInlineCount is 0.
+    enum { INLINE_CAPACITY = 5 };
     Vector<Rect> mStorage;
+    size_t mInlineCount;
+    Rect mInline[INLINE_CAPACITY];
 };
 
 
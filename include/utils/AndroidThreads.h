@@ -83,6 +83,38 @@ extern int androidSetThreadPriority(pid_t tid, int prio);
 // Get the current priority of a particular thread. Returns one of the
 // ANDROID_PRIORITY constants or a negative result in case of error.
 extern int androidGetThreadPriority(pid_t tid);
+
+// Scheduling attributes of a thread beyond its priority, for threads which
+// need to run on specific CPUs or with a real-time policy.
+typedef struct {
+    // CPUs the thread may run on, one bit per CPU; 0 leaves it unchanged
+    uint32_t cpuMask;
+    // SCHED_OTHER, SCHED_FIFO or SCHED_RR; -1 leaves it unchanged
+    int schedPolicy;
+    // real-time priority, used with SCHED_FIFO and SCHED_RR
+    int rtPriority;
+    // one of the SchedPolicy cgroups of cutils; -1 leaves it unchanged
+    int schedGroup;
+} android_thread_attrs_t;
+
+// Initialize attributes that leave everything unchanged.
+extern void androidInitThreadAttributes(android_thread_attrs_t* attrs);
+
+// Read the attributes configured for the given name by the "sys.sched.<name>"
+// property, a comma separated list of "cpus=<mask>", "policy=other|fifo|rr",
+// "priority=<real-time priority>" and "group=fg|bg", e.g.
+// "cpus=0xf0,policy=fifo,priority=2".  Returns NAME_NOT_FOUND and leaves
+// attrs alone if the property isn't set, BAD_VALUE if it can't be parsed.
+extern int androidGetThreadAttributes(const char* name, android_thread_attrs_t* attrs);
+
+// Apply scheduling attributes to a thread.  Returns 0 on success, else -1
+// with errno set; the attributes which could be set are still set.
+// Thread ID zero means current thread.
+extern int androidSetThreadAttributes(pid_t tid, const android_thread_attrs_t* attrs);
+
+// Apply the attributes configured for the given name to a thread, if any.
+// Returns 0 if there are none.
+extern int androidConfigureThread(pid_t tid, const char* name);
 #endif
 
 #ifdef __cplusplus
@@ -19,10 +19,11 @@
 
 #include <stddef.h>
 
+#include <utils/BasicHashtable.h>
 #include <utils/Flattenable.h>
 #include <utils/RefBase.h>
-#include <utils/SortedVector.h>
 #include <utils/threads.h>
+#include <utils/Vector.h>
 
 namespace android {
 
@@ -109,15 +110,27 @@ public:
     virtual status_t unflatten(void const* buffer, size_t size, int fds[],
             size_t count);
 
+    // unflattenInPlace is like unflatten, except that the cache entries refer
+    // to the memory pointed to by 'buffer' rather than copying it.  Values are
+    // only read when they are retrieved with get, so unflattening an mmap'd
+    // file doesn't page in the whole file.  The memory must remain valid and
+    // unchanged for as long as the BlobCache exists.
+    status_t unflattenInPlace(void const* buffer, size_t size);
+
 private:
     // Copying is disallowed.
     BlobCache(const BlobCache&);
     void operator=(const BlobCache&);
 
-    // A random function helper to get around MinGW not having nrand48()
-    long int blob_random();
+    // unflattenImpl implements unflatten and unflattenInPlace.
+    status_t unflattenImpl(void const* buffer, size_t size, bool copyData);
+
+    // setImpl implements set; the key and value are copied only if copyData
+    // is true.
+    void setImpl(const void* key, size_t keySize, const void* value,
+            size_t valueSize, bool copyData);
 
-    // clean evicts a randomly chosen set of entries from the cache such that
+    // clean evicts the least recently used entries from the cache such that
     // the total size of all remaining entries is less than mMaxTotalSize/2.
     void clean();
 
@@ -131,8 +144,6 @@ private:
         Blob(const void* data, size_t size, bool copyData);
         ~Blob();
 
-        bool operator<(const Blob& rhs) const;
-
         const void* getData() const;
         size_t getSize() const;
 
@@ -152,20 +163,39 @@ private:
         bool mOwnsData;
     };
 
+    // A BlobKey refers to key data without owning it.  It is what the cache
+    // entries are looked up with, so that lookups don't allocate.
+    class BlobKey {
+    public:
+        BlobKey(const void* data, size_t size);
+
+        bool operator==(const BlobKey& rhs) const;
+        bool operator!=(const BlobKey& rhs) const;
+
+        hash_t hash() const;
+
+    private:
+        const void* mData;
+        size_t mSize;
+    };
+
     // A CacheEntry is a single key/value pair in the cache.
     class CacheEntry {
     public:
         CacheEntry();
-        CacheEntry(const sp<Blob>& key, const sp<Blob>& value);
+        CacheEntry(const sp<Blob>& key, const sp<Blob>& value,
+                uint32_t lastUse);
         CacheEntry(const CacheEntry& ce);
 
-        bool operator<(const CacheEntry& rhs) const;
         const CacheEntry& operator=(const CacheEntry&);
 
-        sp<Blob> getKey() const;
+        BlobKey getKey() const;
+        sp<Blob> getKeyBlob() const;
         sp<Blob> getValue() const;
+        uint32_t getLastUse() const;
 
         void setValue(const sp<Blob>& value);
+        void setLastUse(uint32_t lastUse);
 
     private:
 
@@ -174,8 +204,16 @@ private:
 
         // mValue is the cached data associated with the key.
         sp<Blob> mValue;
+
+        // mLastUse is the value of mUseCount when the entry was last set or
+        // retrieved.
+        uint32_t mLastUse;
     };
 
+    // getEntriesByAge returns the indices of the entries in mCacheEntries,
+    // least recently used first.
+    Vector<size_t> getEntriesByAge() const;
+
     // A Header is the header for the entire BlobCache serialization format. No
     // need to make this portable, so we simply write the struct out.
     struct Header {
@@ -237,13 +275,15 @@ private:
     // the cache.
     size_t mTotalSize;
 
-    // mRandState is the pseudo-random number generator state. It is passed to
-    // nrand48 to generate random numbers when needed.
-    unsigned short mRandState[3];
+    // mUseCount is incremented each time an entry is set or retrieved, and is
+    // used to order the entries from least to most recently used.  Entry ages
+    // are computed modulo 2^32 so it may safely wrap around.
+    uint32_t mUseCount;
 
-    // mCacheEntries stores all the cache entries that are resident in memory.
-    // Cache entries are added to it by the 'set' method.
-    SortedVector<CacheEntry> mCacheEntries;
+    // mCacheEntries stores all the cache entries that are resident in memory,
+    // indexed by the hash of their key.  Cache entries are added to it by the
+    // 'set' method.
+    BasicHashtable<BlobKey, CacheEntry> mCacheEntries;
 };
 
 }
@@ -61,7 +61,18 @@ public:
     
     size_t size() const { return mCount; }
 
+    // Return a hash of the frame addresses
+    uint32_t hash() const;
+
+    // Return the copy of this stack kept in a process-wide table, adding
+    // it if there isn't one. Stacks with the same frame addresses share a
+    // copy, which is never freed, so a stack recorded many times is only
+    // stored once.
+    const CallStack* intern() const;
+
 private:
+    bool sameFrames(const CallStack& rhs) const;
+
     size_t mCount;
     backtrace_frame_t mStack[MAX_DEPTH];
 };
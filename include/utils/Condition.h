@@ -90,14 +90,19 @@ inline Condition::~Condition() {
     pthread_cond_destroy(&mCond);
 }
 inline status_t Condition::wait(Mutex& mutex) {
-    return -pthread_cond_wait(&mCond, &mutex.mMutex);
+    status_t err = -pthread_cond_wait(&mCond, &mutex.mMutex);
+    if (mutex.mExtra) {
+        // others may have held the mutex meanwhile
+        mutex.setOwner();
+    }
+    return err;
 }
 inline status_t Condition::waitRelative(Mutex& mutex, nsecs_t reltime) {
 #if defined(HAVE_PTHREAD_COND_TIMEDWAIT_RELATIVE)
     struct timespec ts;
     ts.tv_sec  = reltime/1000000000;
     ts.tv_nsec = reltime%1000000000;
-    return -pthread_cond_timedwait_relative_np(&mCond, &mutex.mMutex, &ts);
+    status_t err = -pthread_cond_timedwait_relative_np(&mCond, &mutex.mMutex, &ts);
 #else // HAVE_PTHREAD_COND_TIMEDWAIT_RELATIVE
     struct timespec ts;
 #if defined(HAVE_POSIX_CLOCKS)
@@ -115,8 +120,12 @@ inline status_t Condition::waitRelative(Mutex& mutex, nsecs_t reltime) {
         ts.tv_nsec -= 1000000000;
         ts.tv_sec  += 1;
     }
-    return -pthread_cond_timedwait(&mCond, &mutex.mMutex, &ts);
+    status_t err = -pthread_cond_timedwait(&mCond, &mutex.mMutex, &ts);
 #endif // HAVE_PTHREAD_COND_TIMEDWAIT_RELATIVE
+    if (mutex.mExtra) {
+        mutex.setOwner();
+    }
+    return err;
 }
 inline void Condition::signal() {
     pthread_cond_signal(&mCond);
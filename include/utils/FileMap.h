@@ -48,16 +48,68 @@ class FileMap {
 public:
     FileMap(void);
 
+    /*
+     * This maps directly to madvise() values, but allows us to avoid
+     * including <sys/mman.h> everywhere.
+     */
+    enum MapAdvice {
+        NORMAL, RANDOM, SEQUENTIAL, WILLNEED, DONTNEED
+    };
+
+    /*
+     * How the pages of a new mapping are expected to be used, so that the
+     * I/O can be started or tuned when the map is created.
+     */
+    struct CreateOptions {
+        CreateOptions()
+            : advice(NORMAL), readAheadLength(0), populate(false) {}
+
+        /* madvise() hint applied to the whole map right after mmap() */
+        MapAdvice   advice;
+
+        /*
+         * Number of bytes at the start of the requested data to start
+         * reading into the page cache right away, or 0 for none.  Clamped
+         * to the length of the map.
+         */
+        size_t      readAheadLength;
+
+        /*
+         * Fault in the whole map before create() returns.  This is only
+         * done for maps of up to kMaxPopulateLength bytes, which are
+         * cheaper to read in one go than page by page; larger maps are
+         * read ahead asynchronously instead.
+         */
+        bool        populate;
+    };
+
+    /* largest map create() will populate synchronously */
+    static const size_t kMaxPopulateLength = 1024 * 1024;
+
     /*
      * Create a new mapping on an open file.
      *
      * Closing the file descriptor does not unmap the pages, so we don't
      * claim ownership of the fd.
      *
+     * The first form uses the process-wide default options, see
+     * setDefaultCreateOptions().
+     *
      * Returns "false" on failure.
      */
     bool create(const char* origFileName, int fd,
                 off64_t offset, size_t length, bool readOnly);
+    bool create(const char* origFileName, int fd,
+                off64_t offset, size_t length, bool readOnly,
+                const CreateOptions& options);
+
+    /*
+     * Set the options used by maps created without explicit options, which
+     * is how ZipFileRO and most other callers create theirs.  This is meant
+     * to tune the startup I/O of a process in one place.
+     */
+    static void setDefaultCreateOptions(const CreateOptions& options);
+    static CreateOptions getDefaultCreateOptions();
 
     /*
      * Return the name of the file this map came from, if known.
@@ -93,19 +145,39 @@ public:
     }
 
     /*
-     * This maps directly to madvise() values, but allows us to avoid
-     * including <sys/mman.h> everywhere.
+     * Apply an madvise() call to the entire file.
+     *
+     * Returns 0 on success, -1 on failure.
      */
-    enum MapAdvice {
-        NORMAL, RANDOM, SEQUENTIAL, WILLNEED, DONTNEED
+    int advise(MapAdvice advice);
+
+    /*
+     * Start reading a range of the requested data into the page cache,
+     * without waiting for it.  "offset" is relative to getDataPtr(), and
+     * the range is clamped to the map.
+     *
+     * Returns 0 on success, -1 on failure.
+     */
+    int readAhead(size_t offset, size_t length);
+
+    /*
+     * Page statistics of a map.  Pages of a shared file mapping are
+     * resident once they have been faulted in or read ahead by anyone, so
+     * "residentPages" going up between two calls is an upper bound on the
+     * page faults the map will take to cover that part of the file.
+     */
+    struct PageStats {
+        size_t      totalPages;     // pages spanned by the map
+        size_t      residentPages;  // pages currently in memory
+        bool        populated;      // whether create() populated the map
     };
 
     /*
-     * Apply an madvise() call to the entire file.
+     * Fill out the page statistics of the map.
      *
      * Returns 0 on success, -1 on failure.
      */
-    int advise(MapAdvice advice);
+    int getPageStats(PageStats* outStats) const;
 
 protected:
     // don't delete objects; call release()
@@ -123,6 +195,7 @@ private:
     off64_t     mDataOffset;    // offset used when map was created
     void*       mDataPtr;       // start of requested data, offset from base
     size_t      mDataLength;    // length, measured from "mDataPtr"
+    bool        mPopulated;     // whether create() populated the map
 #ifdef HAVE_WIN32_FILEMAP
     HANDLE      mFileHandle;    // Win32 file handle
     HANDLE      mFileMapping;   // Win32 file mapping handle
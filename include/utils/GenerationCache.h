@@ -103,7 +103,7 @@ GenerationCache<K, V>::~GenerationCache() {
 };
 
 template<typename K, typename V>
-uint32_t GenerationCache<K, V>::size() const {
+size_t GenerationCache<K, V>::size() const {
     return mCache.size();
 }
 
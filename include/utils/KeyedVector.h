@@ -135,7 +135,9 @@ bool KeyedVector<KEY,VALUE>::isIdenticalTo(const KeyedVector<KEY,VALUE>& rhs) co
 
 template<typename KEY, typename VALUE> inline
 ssize_t KeyedVector<KEY,VALUE>::indexOfKey(const KEY& key) const {
-    return mVector.indexOf( key_value_pair_t<KEY,VALUE>(key) );
+    // mVector is a plain SortedVector, ordered by strictly_order_type()
+    return strictly_ordered_index_of(mVector.array(), mVector.size(),
+            key_value_pair_t<KEY,VALUE>(key));
 }
 
 template<typename KEY, typename VALUE> inline
@@ -0,0 +1,280 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LINEAR_HASHTABLE_H
+#define ANDROID_LINEAR_HASHTABLE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <utils/SharedBuffer.h>
+#include <utils/TypeHelpers.h>
+
+namespace android {
+
+/* Implementation type.  Nothing to see here. */
+class LinearHashtableImpl {
+protected:
+    struct Bucket {
+        // The bucket has never been used since the last rehash, it ends probing.
+        static const uint32_t EMPTY     = 0;
+
+        // The bucket contains an initialized entry value.
+        static const uint32_t PRESENT   = 0x80000000UL;
+
+        // The bucket held an entry that was removed, probing goes on past it.
+        static const uint32_t DELETED   = 0x40000000UL;
+
+        // Mask of 30 bits available for storing the (mixed) hash code.
+        static const uint32_t HASH_MASK = 0x3fffffffUL;
+
+        // Combined value that stores the present and deleted flags as well
+        // as the hash code.
+        uint32_t cookie;
+
+        // Storage for the entry begins here.
+        char entry[0];
+    };
+
+    LinearHashtableImpl(size_t entrySize, bool hasTrivialDestructor,
+            size_t minimumInitialCapacity, float loadFactor);
+    LinearHashtableImpl(const LinearHashtableImpl& other);
+
+    void dispose();
+
+    inline void edit() {
+        if (mBuckets && !SharedBuffer::bufferFromData(mBuckets)->onlyOwner()) {
+            clone();
+        }
+    }
+
+    void setTo(const LinearHashtableImpl& other);
+    void clear();
+
+    ssize_t next(ssize_t index) const;
+    ssize_t find(ssize_t index, hash_t hash, const void* __restrict__ key) const;
+    size_t add(hash_t hash, const void* __restrict__ entry);
+    void removeAt(size_t index);
+    void rehash(size_t minimumCapacity, float loadFactor);
+
+    const size_t mBucketSize; // number of bytes per bucket including the entry
+    const bool mHasTrivialDestructor; // true if the entry type does not require destruction
+    size_t mCapacity;         // number of buckets that can be filled before exceeding load factor
+    float mLoadFactor;        // load factor
+    size_t mSize;             // number of elements actually in the table
+    size_t mFilledBuckets;    // number of buckets which are not EMPTY
+    size_t mBucketCount;      // number of slots in the mBuckets array, a power of 2
+    void* mBuckets;           // array of buckets, as a SharedBuffer
+
+    inline const Bucket& bucketAt(const void* __restrict__ buckets, size_t index) const {
+        return *reinterpret_cast<const Bucket*>(
+                static_cast<const uint8_t*>(buckets) + index * mBucketSize);
+    }
+
+    inline Bucket& bucketAt(void* __restrict__ buckets, size_t index) const {
+        return *reinterpret_cast<Bucket*>(static_cast<uint8_t*>(buckets) + index * mBucketSize);
+    }
+
+    virtual bool compareBucketKey(const Bucket& bucket, const void* __restrict__ key) const = 0;
+    virtual void initializeBucketEntry(Bucket& bucket, const void* __restrict__ entry) const = 0;
+    virtual void destroyBucketEntry(Bucket& bucket) const = 0;
+
+private:
+    void clone();
+
+    // Rebuilds the table in a bucket array of the specified size, dropping
+    // the DELETED buckets.
+    void resize(size_t newBucketCount);
+
+    // Allocates a bucket array as a SharedBuffer, with all its buckets EMPTY.
+    void* allocateBuckets(size_t count) const;
+
+    // Releases a bucket array's associated SharedBuffer.
+    void releaseBuckets(void* __restrict__ buckets, size_t count) const;
+
+    // Destroys the contents of buckets (invokes destroyBucketEntry for each
+    // populated bucket if needed).
+    void destroyBuckets(void* __restrict__ buckets, size_t count) const;
+
+    // Determines the appropriate size of a bucket array to store a certain minimum
+    // number of entries and returns its effective capacity.
+    static void determineCapacity(size_t minimumCapacity, float loadFactor,
+            size_t* __restrict__ outBucketCount, size_t* __restrict__ outCapacity);
+
+    // Spreads the hash code over all its bits, since only the low bits pick
+    // the bucket and hash codes like those of integers are poorly distributed,
+    // then trims it to fit in the cookie.
+    inline static hash_t mixHash(hash_t hash) {
+        hash ^= hash >> 16;
+        hash *= 0x85ebca6bU;
+        hash ^= hash >> 13;
+        hash *= 0xc2b2ae35U;
+        hash ^= hash >> 16;
+        return hash & Bucket::HASH_MASK;
+    }
+};
+
+/*
+ * A LinearHashtable has the same interface and semantics as BasicHashtable,
+ * so that one can be used in place of the other, but it is implemented with
+ * linear probing in a power of two sized array.  Finding the bucket of a key
+ * is a mask instead of a division, and probing walks the buckets in
+ * sequence, usually within the cache line of the first one, instead of
+ * jumping around the array.  The trade-off is a sensitivity to clustering at
+ * high load factors, so the default load factor is lower than
+ * BasicHashtable's.
+ *
+ * Removed entries leave a tombstone so that removeAt() does not move any
+ * other entry, and iterating with next() or find() while removing entries
+ * works as it does with BasicHashtable.  Tombstones are dropped when the
+ * hashtable is rehashed.
+ *
+ * See BasicHashtable for the contracts of TKey and TEntry and the details
+ * of each method.
+ */
+template <typename TKey, typename TEntry>
+class LinearHashtable : private LinearHashtableImpl {
+public:
+    /* Creates a hashtable with the specified minimum initial capacity.
+     * The underlying array will be created when the first entry is added.
+     */
+    LinearHashtable(size_t minimumInitialCapacity = 0, float loadFactor = 0.5f);
+
+    /* Copies a hashtable.
+     * The underlying storage is shared copy-on-write.
+     */
+    LinearHashtable(const LinearHashtable& other);
+
+    /* Clears and destroys the hashtable.
+     */
+    virtual ~LinearHashtable();
+
+    inline LinearHashtable<TKey, TEntry>& operator =(const LinearHashtable<TKey, TEntry> & other) {
+        setTo(other);
+        return *this;
+    }
+
+    inline size_t size() const {
+        return mSize;
+    }
+
+    inline size_t capacity() const {
+        return mCapacity;
+    }
+
+    inline size_t bucketCount() const {
+        return mBucketCount;
+    }
+
+    inline float loadFactor() const {
+        return mLoadFactor;
+    };
+
+    inline const TEntry& entryAt(size_t index) const {
+        return entryFor(bucketAt(mBuckets, index));
+    }
+
+    inline TEntry& editEntryAt(size_t index) {
+        edit();
+        return entryFor(bucketAt(mBuckets, index));
+    }
+
+    inline void clear() {
+        LinearHashtableImpl::clear();
+    }
+
+    inline ssize_t next(ssize_t index) const {
+        return LinearHashtableImpl::next(index);
+    }
+
+    inline ssize_t find(ssize_t index, hash_t hash, const TKey& key) const {
+        return LinearHashtableImpl::find(index, hash, &key);
+    }
+
+    inline size_t add(hash_t hash, const TEntry& entry) {
+        return LinearHashtableImpl::add(hash, &entry);
+    }
+
+    inline void removeAt(size_t index) {
+        LinearHashtableImpl::removeAt(index);
+    }
+
+    inline void rehash(size_t minimumCapacity, float loadFactor) {
+        LinearHashtableImpl::rehash(minimumCapacity, loadFactor);
+    }
+
+protected:
+    static inline const TEntry& entryFor(const Bucket& bucket) {
+        return reinterpret_cast<const TEntry&>(bucket.entry);
+    }
+
+    static inline TEntry& entryFor(Bucket& bucket) {
+        return reinterpret_cast<TEntry&>(bucket.entry);
+    }
+
+    virtual bool compareBucketKey(const Bucket& bucket, const void* __restrict__ key) const;
+    virtual void initializeBucketEntry(Bucket& bucket, const void* __restrict__ entry) const;
+    virtual void destroyBucketEntry(Bucket& bucket) const;
+
+private:
+    // For dumping the raw contents of a hashtable during testing.
+    friend class BasicHashtableTest;
+    inline uint32_t cookieAt(size_t index) const {
+        return bucketAt(mBuckets, index).cookie;
+    }
+};
+
+template <typename TKey, typename TEntry>
+LinearHashtable<TKey, TEntry>::LinearHashtable(size_t minimumInitialCapacity, float loadFactor) :
+        LinearHashtableImpl(sizeof(TEntry), traits<TEntry>::has_trivial_dtor,
+                minimumInitialCapacity, loadFactor) {
+}
+
+template <typename TKey, typename TEntry>
+LinearHashtable<TKey, TEntry>::LinearHashtable(const LinearHashtable<TKey, TEntry>& other) :
+        LinearHashtableImpl(other) {
+}
+
+template <typename TKey, typename TEntry>
+LinearHashtable<TKey, TEntry>::~LinearHashtable() {
+    dispose();
+}
+
+template <typename TKey, typename TEntry>
+bool LinearHashtable<TKey, TEntry>::compareBucketKey(const Bucket& bucket,
+        const void* __restrict__ key) const {
+    return entryFor(bucket).getKey() == *static_cast<const TKey*>(key);
+}
+
+template <typename TKey, typename TEntry>
+void LinearHashtable<TKey, TEntry>::initializeBucketEntry(Bucket& bucket,
+        const void* __restrict__ entry) const {
+    if (!traits<TEntry>::has_trivial_copy) {
+        new (&entryFor(bucket)) TEntry(*(static_cast<const TEntry*>(entry)));
+    } else {
+        memcpy(&entryFor(bucket), entry, sizeof(TEntry));
+    }
+}
+
+template <typename TKey, typename TEntry>
+void LinearHashtable<TKey, TEntry>::destroyBucketEntry(Bucket& bucket) const {
+    if (!traits<TEntry>::has_trivial_dtor) {
+        entryFor(bucket).~TEntry();
+    }
+}
+
+}; // namespace android
+
+#endif // ANDROID_LINEAR_HASHTABLE_H
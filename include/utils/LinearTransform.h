@@ -18,6 +18,7 @@
 #define _LIBS_UTILS_LINEAR_TRANSFORM_H
 
 #include <stdint.h>
+#include <sys/types.h>
 
 namespace android {
 
@@ -53,6 +54,14 @@ struct LinearTransform {
   // overflow.
   bool doReverseTransform(int64_t b_in, int64_t* a_out) const;
 
+  // Transform count values from A->B, or from B->A, the values may be
+  // converted in place. Returns the number of values converted, which is
+  // less than count if a singularity or an overflow stopped the conversion.
+  size_t doForwardTransform(const int64_t* a_in, int64_t* b_out,
+                            size_t count) const;
+  size_t doReverseTransform(const int64_t* b_in, int64_t* a_out,
+                            size_t count) const;
+
   // Helpers which will reduce the fraction N/D using Euclid's method.
   template <class T> static void reduce(T* N, T* D);
   static void reduce(int32_t* N, uint32_t* D);
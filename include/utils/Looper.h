@@ -321,8 +321,11 @@ public:
 
 private:
     struct Request {
+        Request() : fd(-1), ident(0), seq(0), data(NULL) { }
+
         int fd;
         int ident;
+        uint32_t seq;   // 0 while the entry isn't in use
         sp<LooperCallback> callback;
         void* data;
     };
@@ -333,30 +336,44 @@ private:
     };
 
     struct MessageEnvelope {
-        MessageEnvelope() : uptime(0) { }
+        MessageEnvelope() : uptime(0), sequence(0) { }
 
         MessageEnvelope(nsecs_t uptime, const sp<MessageHandler> handler,
-                const Message& message) : uptime(uptime), handler(handler), message(message) {
+                const Message& message, uint32_t sequence) : uptime(uptime),
+                sequence(sequence), handler(handler), message(message) {
+        }
+
+        // messages with the same uptime are sent in the order they were sent
+        inline bool isBefore(const MessageEnvelope& other) const {
+            return uptime < other.uptime || (uptime == other.uptime
+                    && int32_t(sequence - other.sequence) < 0);
         }
 
         nsecs_t uptime;
+        uint32_t sequence;
         sp<MessageHandler> handler;
         Message message;
     };
 
     const bool mAllowNonCallbacks; // immutable
 
-    int mWakeReadPipeFd;  // immutable
-    int mWakeWritePipeFd; // immutable
+    int mWakeEventFd;  // immutable
     Mutex mLock;
 
+    // Binary heap of pending messages, the next one to send is first.
     Vector<MessageEnvelope> mMessageEnvelopes; // guarded by mLock
+    uint32_t mNextMessageSequence; // guarded by mLock
     bool mSendingMessage; // guarded by mLock
 
     int mEpollFd; // immutable
 
-    // Locked list of file descriptor monitoring requests.
-    KeyedVector<int, Request> mRequests;  // guarded by mLock
+    // Locked table of file descriptor monitoring requests, indexed by fd so
+    // that epoll events are matched to their request without a search. The
+    // epoll data of an fd holds the request's sequence number next to the fd,
+    // so that events polled for a request that has since been removed are
+    // told apart from those of a new request for the same fd, and dropped.
+    Vector<Request> mRequests;  // guarded by mLock
+    uint32_t mNextRequestSeq;   // guarded by mLock
 
     // This state is only used privately by pollOnce and does not require a lock since
     // it runs on a single thread.
@@ -368,6 +385,11 @@ private:
     void awoken();
     void pushResponse(int events, const Request& request);
 
+    size_t pushMessageEnvelopeLocked(const MessageEnvelope& messageEnvelope);
+    void popMessageEnvelopeLocked();
+    void siftDownMessageEnvelopeLocked(size_t index);
+    void rebuildMessageEnvelopesLocked();
+
     static void initTLSKey();
     static void threadDestructor(void *st);
 };
@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_UTILS_LRU_CACHE_H
+#define ANDROID_UTILS_LRU_CACHE_H
+
+#include <utils/BasicHashtable.h>
+#include <utils/GenerationCache.h>
+
+namespace android {
+
+/**
+ * A LRU type cache, like GenerationCache but indexed by a hash table, so
+ * that get(), put() and remove() don't depend on the number of entries.
+ *
+ * K must have a hash_type() specialization, see <utils/TypeHelpers.h>.
+ * Unlike GenerationCache, entries can't be accessed by index; use an
+ * Iterator instead. The order of iteration is unspecified.
+ */
+template<typename K, typename V>
+class LruCache {
+public:
+    LruCache(uint32_t maxCapacity);
+    virtual ~LruCache();
+
+    enum Capacity {
+        kUnlimitedCapacity,
+    };
+
+    void setOnEntryRemovedListener(OnEntryRemoved<K, V>* listener);
+
+    size_t size() const;
+
+    void clear();
+
+    bool contains(const K& key) const;
+
+    const V& get(const K& key);
+    bool put(const K& key, const V& value);
+
+    bool remove(const K& key);
+    bool removeOldest();
+
+    class Iterator {
+    public:
+        Iterator(const LruCache<K, V>& cache) : mCache(cache), mIndex(-1) { }
+
+        bool next() {
+            mIndex = mCache.mTable.next(mIndex);
+            return mIndex >= 0;
+        }
+
+        const K& key() const {
+            return mCache.mTable.entryAt(mIndex).entry->key;
+        }
+
+        const V& value() const {
+            return mCache.mTable.entryAt(mIndex).entry->value;
+        }
+
+    private:
+        const LruCache<K, V>& mCache;
+        ssize_t mIndex;
+    };
+
+private:
+    LruCache(const LruCache& that); // disallow copy constructor
+
+    struct Entry {
+        Entry(const K& key, const V& value) :
+                key(key), value(value), parent(NULL), child(NULL) { }
+
+        K key;
+        V value;
+
+        Entry* parent; // next older entry
+        Entry* child;  // next younger entry
+    };
+
+    // what the table stores; the entries themselves don't move on rehash
+    struct Link {
+        Entry* entry;
+
+        Link(Entry* entry) : entry(entry) { }
+        const K& getKey() const { return entry->key; }
+    };
+
+    ssize_t find(const K& key) const;
+    void removeAt(ssize_t index);
+    void attachToCache(Entry* entry);
+    void detachFromCache(Entry* entry);
+
+    BasicHashtable<K, Link> mTable;
+    uint32_t mMaxCapacity;
+
+    OnEntryRemoved<K, V>* mListener;
+
+    Entry* mOldest;
+    Entry* mYoungest;
+
+    const V mNullValue;
+}; // class LruCache
+
+template<typename K, typename V>
+LruCache<K, V>::LruCache(uint32_t maxCapacity): mMaxCapacity(maxCapacity),
+    mListener(NULL), mOldest(NULL), mYoungest(NULL), mNullValue(NULL) {
+};
+
+template<typename K, typename V>
+LruCache<K, V>::~LruCache() {
+    clear();
+};
+
+template<typename K, typename V>
+size_t LruCache<K, V>::size() const {
+    return mTable.size();
+}
+
+/**
+ * Should be set by the user of the Cache so that the callback is called whenever an item is
+ * removed from the cache
+ */
+template<typename K, typename V>
+void LruCache<K, V>::setOnEntryRemovedListener(OnEntryRemoved<K, V>* listener) {
+    mListener = listener;
+}
+
+template<typename K, typename V>
+void LruCache<K, V>::clear() {
+    for (Entry* entry = mOldest; entry != NULL; ) {
+        Entry* const next = entry->child;
+        if (mListener) {
+            (*mListener)(entry->key, entry->value);
+        }
+        delete entry;
+        entry = next;
+    }
+    mTable.clear();
+    mYoungest = mOldest = NULL;
+}
+
+template<typename K, typename V>
+ssize_t LruCache<K, V>::find(const K& key) const {
+    return mTable.find(-1, hash_type(key), key);
+}
+
+template<typename K, typename V>
+bool LruCache<K, V>::contains(const K& key) const {
+    return find(key) >= 0;
+}
+
+template<typename K, typename V>
+const V& LruCache<K, V>::get(const K& key) {
+    ssize_t index = find(key);
+    if (index >= 0) {
+        Entry* entry = mTable.entryAt(index).entry;
+        detachFromCache(entry);
+        attachToCache(entry);
+        return entry->value;
+    }
+
+    return mNullValue;
+}
+
+template<typename K, typename V>
+bool LruCache<K, V>::put(const K& key, const V& value) {
+    if (mMaxCapacity != kUnlimitedCapacity && mTable.size() >= mMaxCapacity) {
+        removeOldest();
+    }
+
+    ssize_t index = find(key);
+    if (index < 0) {
+        Entry* entry = new Entry(key, value);
+        mTable.add(hash_type(key), Link(entry));
+        attachToCache(entry);
+        return true;
+    }
+
+    return false;
+}
+
+template<typename K, typename V>
+bool LruCache<K, V>::remove(const K& key) {
+    ssize_t index = find(key);
+    if (index >= 0) {
+        removeAt(index);
+        return true;
+    }
+
+    return false;
+}
+
+template<typename K, typename V>
+void LruCache<K, V>::removeAt(ssize_t index) {
+    Entry* entry = mTable.entryAt(index).entry;
+    if (mListener) {
+        (*mListener)(entry->key, entry->value);
+    }
+    mTable.removeAt(index);
+    detachFromCache(entry);
+    delete entry;
+}
+
+template<typename K, typename V>
+bool LruCache<K, V>::removeOldest() {
+    if (mOldest != NULL) {
+        ssize_t index = find(mOldest->key);
+        if (index >= 0) {
+            removeAt(index);
+            return true;
+        }
+        ALOGE("LruCache: removeOldest failed to find the item in the cache "
+                "with the given key, but we know it must be in there.  "
+                "Is the key comparator kaput?");
+    }
+
+    return false;
+}
+
+template<typename K, typename V>
+void LruCache<K, V>::attachToCache(Entry* entry) {
+    if (mYoungest == NULL) {
+        mYoungest = mOldest = entry;
+    } else {
+        entry->parent = mYoungest;
+        mYoungest->child = entry;
+        mYoungest = entry;
+    }
+}
+
+template<typename K, typename V>
+void LruCache<K, V>::detachFromCache(Entry* entry) {
+    if (entry->parent != NULL) {
+        entry->parent->child = entry->child;
+    } else {
+        mOldest = entry->child;
+    }
+
+    if (entry->child != NULL) {
+        entry->child->parent = entry->parent;
+    } else {
+        mYoungest = entry->parent;
+    }
+
+    entry->parent = NULL;
+    entry->child = NULL;
+}
+
+}; // namespace android
+
+#endif // ANDROID_UTILS_LRU_CACHE_H
@@ -32,6 +32,7 @@ namespace android {
 // ---------------------------------------------------------------------------
 
 class Condition;
+class String8;
 
 /*
  * Simple mutex class.  The implementation is system-dependent.
@@ -41,9 +42,20 @@ class Condition;
  */
 class Mutex {
 public:
+    // the type given to the constructor is a combination of these
     enum {
         PRIVATE = 0,
-        SHARED = 1
+        SHARED = 1,
+        // the thread holding the mutex runs at the priority of the highest
+        // priority thread waiting for it. ignored where pthreads don't
+        // support PTHREAD_PRIO_INHERIT.
+        PRIO_INHERIT = 2,
+        // lock() retries for a little while before sleeping when the mutex
+        // is held, for mutexes that are never held for long
+        ADAPTIVE = 4,
+        // records the time threads spend waiting for the mutex, and who
+        // held it meanwhile, see dumpContention(). The name is required.
+        TRACK_CONTENTION = 8
     };
     
                 Mutex();
@@ -58,6 +70,10 @@ public:
     // lock if possible; returns 0 on success, error otherwise
     status_t    tryLock();
 
+    // appends the contention of the TRACK_CONTENTION mutexes, summed
+    // by name
+    static void dumpContention(String8& result);
+
     // Manages the mutex automatically. It'll be locked when Autolock is
     // constructed and released when Autolock goes out of scope.
     class Autolock {
@@ -77,7 +93,17 @@ private:
     Mutex&      operator = (const Mutex&);
     
 #if defined(HAVE_PTHREADS)
+    // what the types other than PRIVATE and SHARED need, NULL if unused
+    struct Extra;
+    void        init(int type, const char* name);
+    void        fini();
+    status_t    lockSlow();
+    void        unlockSlow();
+    status_t    tryLockSlow();
+    void        setOwner();
+
     pthread_mutex_t mMutex;
+    Extra*          mExtra;
 #else
     void    _init();
     void*   mState;
@@ -88,14 +114,16 @@ private:
 
 #if defined(HAVE_PTHREADS)
 
-inline Mutex::Mutex() {
+inline Mutex::Mutex() : mExtra(NULL) {
     pthread_mutex_init(&mMutex, NULL);
 }
-inline Mutex::Mutex(const char* name) {
+inline Mutex::Mutex(const char* name) : mExtra(NULL) {
     pthread_mutex_init(&mMutex, NULL);
 }
-inline Mutex::Mutex(int type, const char* name) {
-    if (type == SHARED) {
+inline Mutex::Mutex(int type, const char* name) : mExtra(NULL) {
+    if (type & ~SHARED) {
+        init(type, name);
+    } else if (type == SHARED) {
         pthread_mutexattr_t attr;
         pthread_mutexattr_init(&attr);
         pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
@@ -106,15 +134,27 @@ inline Mutex::Mutex(int type, const char* name) {
     }
 }
 inline Mutex::~Mutex() {
+    if (__builtin_expect(mExtra != NULL, 0)) {
+        fini();
+    }
     pthread_mutex_destroy(&mMutex);
 }
 inline status_t Mutex::lock() {
+    if (__builtin_expect(mExtra != NULL, 0)) {
+        return lockSlow();
+    }
     return -pthread_mutex_lock(&mMutex);
 }
 inline void Mutex::unlock() {
+    if (__builtin_expect(mExtra != NULL, 0)) {
+        unlockSlow();
+    }
     pthread_mutex_unlock(&mMutex);
 }
 inline status_t Mutex::tryLock() {
+    if (__builtin_expect(mExtra != NULL, 0)) {
+        return tryLockSlow();
+    }
     return -pthread_mutex_trylock(&mMutex);
 }
 
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_PROFILER_H
+#define ANDROID_PROFILER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+// ---------------------------------------------------------------------------
+
+// PROFILE_SCOPE aggregates the time spent in the rest of the enclosing
+// scope under "name", when "tag" is enabled:
+//
+//     void SurfaceFlinger::handleMessageRefresh() {
+//         PROFILE_SCOPE("surfaceflinger", "handleMessageRefresh");
+//         ...
+//
+// Scopes entered from within another scope are shown under it.
+#define PROFILE_SCOPE(tag, name) \
+        PROFILE_SCOPE_AT(tag, name, __LINE__)
+#define PROFILE_SCOPE_AT(tag, name, line) \
+        PROFILE_SCOPE_AT_(tag, name, line)
+#define PROFILE_SCOPE_AT_(tag, name, line) \
+        static android::ProfilePoint ___profilePoint##line(tag, name); \
+        android::ProfileScope ___profileScope##line(___profilePoint##line)
+
+namespace android {
+
+/*
+ * A named place in the code whose timings are aggregated. Points must have
+ * static storage duration; at most Profiler::MAX_POINTS exist per process
+ * and the ones beyond are never enabled.
+ */
+class ProfilePoint
+{
+public:
+    ProfilePoint(const char* tag, const char* name);
+
+    inline bool isEnabled() const { return mEnabled != 0; }
+    inline const char* getTag() const { return mTag; }
+    inline const char* getName() const { return mName; }
+    inline int32_t getId() const { return mId; }
+    inline int32_t getParent() const { return mParent; }
+
+private:
+    friend class Profiler;
+    friend class ProfileScope;
+
+    const char*         mTag;
+    const char*         mName;
+    int32_t             mId;
+    // the point whose scope this one was first entered from, or -1
+    volatile int32_t    mParent;
+    volatile int32_t    mEnabled;
+};
+
+/*
+ * Times the scope it lives in. Nothing is timed, and no clock is read, when
+ * the point's tag is disabled.
+ */
+class ProfileScope
+{
+public:
+    inline ProfileScope(ProfilePoint& point) : mPoint(point), mStart(0) {
+        if (point.isEnabled()) {
+            enter();
+        }
+    }
+    inline ~ProfileScope() {
+        if (mStart) {
+            exit();
+        }
+    }
+
+private:
+    friend class Profiler;
+
+    void enter();
+    void exit();
+
+    ProfilePoint&   mPoint;
+    nsecs_t         mStart;
+    // time spent in the nested scopes
+    nsecs_t         mChildTime;
+    ProfileScope*   mOuter;
+};
+
+/*
+ * Process-wide access to the aggregated timings. Each thread accumulates its
+ * own statistics without locks or atomics; dump() sums them up while they
+ * are being updated, so a line can be off by the scope being recorded.
+ */
+class Profiler
+{
+public:
+    enum {
+        MAX_POINTS = 64,
+        // log2 buckets of microseconds: < 2us, < 4us ... and the rest
+        HISTOGRAM_BUCKETS = 16
+    };
+
+    // comma-separated list of tags to time, "all" or "" for none. The
+    // initial set comes from the debug.profile.tags property.
+    static void setEnabledTags(const char* tags);
+
+    static void clear();
+    static void dump(String8& result);
+};
+
+}; // namespace android
+
+// ---------------------------------------------------------------------------
+
+#endif // ANDROID_PROFILER_H
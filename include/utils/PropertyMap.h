@@ -77,9 +77,15 @@ public:
     /* Gets the underlying property map. */
     inline const KeyedVector<String8, String8>& getProperties() const { return mProperties; }
 
-    /* Loads a property map from a file. */
+    /* Loads a property map from a file.
+     * The maps parsed from regular files are cached, the file is only parsed
+     * again if its modification time or its size changed.
+     */
     static status_t load(const String8& filename, PropertyMap** outMap);
 
+    /* Forgets the property maps cached by load(). */
+    static void clearCache();
+
 private:
     class Parser {
         PropertyMap* mMap;
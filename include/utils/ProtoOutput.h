@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBS_UTILS_PROTO_OUTPUT_H
+#define _LIBS_UTILS_PROTO_OUTPUT_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+/*
+ * Writes fields in the protocol buffer wire format, for services that dump
+ * their state in binary form.  There is no schema or generated code: the
+ * caller writes each field with its number, and the .proto file describing
+ * the output is maintained next to the code that writes it.
+ *
+ * Nested messages are written between beginMessage() and endMessage(); the
+ * length is filled in once the message is complete.
+ */
+class ProtoOutput {
+public:
+    ProtoOutput();
+
+    void writeInt32(uint32_t field, int32_t value);
+    void writeInt64(uint32_t field, int64_t value);
+    void writeUInt32(uint32_t field, uint32_t value);
+    void writeUInt64(uint32_t field, uint64_t value);
+    void writeBool(uint32_t field, bool value);
+    void writeFloat(uint32_t field, float value);
+    void writeDouble(uint32_t field, double value);
+    void writeString(uint32_t field, const char* value);
+    void writeString(uint32_t field, const String8& value);
+    void writeBytes(uint32_t field, const void* data, size_t size);
+
+    /* Starts a nested message; returns the token to pass to endMessage(). */
+    size_t beginMessage(uint32_t field);
+    void endMessage(size_t token);
+
+    const uint8_t* data() const { return mBuffer.array(); }
+    size_t size() const { return mBuffer.size(); }
+
+private:
+    enum {
+        WIRE_VARINT = 0,
+        WIRE_FIXED64 = 1,
+        WIRE_LENGTH_DELIMITED = 2,
+        WIRE_FIXED32 = 5
+    };
+
+    void writeTag(uint32_t field, uint32_t wireType);
+    void writeVarint(uint64_t value);
+    void writeRaw(const void* data, size_t size);
+
+    Vector<uint8_t> mBuffer;
+};
+
+} // namespace android
+
+#endif // _LIBS_UTILS_PROTO_OUTPUT_H
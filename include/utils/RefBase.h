@@ -30,6 +30,7 @@
 // ---------------------------------------------------------------------------
 namespace android {
 
+class String8;
 class TextOutput;
 TextOutput& printWeakPointer(TextOutput& to, const void* val);
 
@@ -118,6 +119,24 @@ public:
         getWeakRefs()->trackMe(enable, retain); 
     }
 
+            //! DEBUGGING ONLY: Record a call stack for each strong
+            // reference held on 1 in period of the objects whose
+            // getSampledTypeName() is typeName, getting their first strong
+            // reference from now on, 0 stops sampling the class.
+            // Unlike DEBUG_REFS this is always built in, objects that
+            // aren't sampled only pay for a test of a pointer.
+    static  void            sampleReferences(const char* typeName, uint32_t period);
+
+            //! DEBUGGING ONLY: The name sampleReferences() knows the
+            // objects of this class by, NULL (the default) if they can't
+            // be sampled. It must stay valid as long as the object lives,
+            // usually a string literal.
+    virtual const char*     getSampledTypeName() const;
+
+            //! DEBUGGING ONLY: Append the strong references held on the
+            // live sampled objects, with their call stacks.
+    static  void            dumpSampledReferences(String8* out);
+
     typedef RefBase basetype;
 
 protected:
@@ -169,7 +188,10 @@ public:
         android_atomic_inc(&mCount);
     }
     inline void decStrong(const void* id) const {
-        if (android_atomic_dec(&mCount) == 1) {
+        // The last reference can't be raced by an incStrong(), nothing else
+        // holds a reference to get it from, so skip the atomic decrement.
+        if (android_atomic_acquire_load(&mCount) == 1 ||
+                android_atomic_dec(&mCount) == 1) {
             delete static_cast<const T*>(this);
         }
     }
@@ -192,6 +214,14 @@ private:
     mutable volatile int32_t mCount;
 };
 
+// This is a LightRefBase with a virtual destructor, for class hierarchies
+// that want a single allocation and a single atomic per reference count but
+// can't name their concrete type in the base class.
+class VirtualLightRefBase : public LightRefBase<VirtualLightRefBase> {
+public:
+    virtual ~VirtualLightRefBase() { }
+};
+
 // ---------------------------------------------------------------------------
 
 template <typename T>
@@ -494,6 +524,13 @@ public:
     }
 };
 
+// sp<> and wp<> can be relocated with memcpy(): moving one doesn't change
+// the object's reference counts, so vectors of them can realloc their
+// storage instead of copying (and releasing) every reference. Note that
+// RefBase's DEBUG_REFS tracking of reference addresses doesn't follow them.
+template<typename T> struct trait_trivial_move<sp<T> > { enum { value = true }; };
+template<typename T> struct trait_trivial_move<wp<T> > { enum { value = true }; };
+
 // specialization for moving sp<> and wp<> types.
 // these are used by the [Sorted|Keyed]Vector<> implementations
 // sp<> and wp<> need to be handled specially, because they do not
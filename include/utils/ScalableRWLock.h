@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBS_UTILS_SCALABLE_RWLOCK_H
+#define _LIBS_UTILS_SCALABLE_RWLOCK_H
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#if defined(HAVE_PTHREADS)
+# include <pthread.h>
+#endif
+
+#include <cutils/atomic.h>
+
+#include <utils/Condition.h>
+#include <utils/Errors.h>
+#include <utils/Mutex.h>
+
+// ---------------------------------------------------------------------------
+namespace android {
+// ---------------------------------------------------------------------------
+
+#if defined(HAVE_PTHREADS)
+
+/*
+ * Reader-writer lock for read-mostly data, with the same interface as
+ * RWLock.
+ *
+ * Readers only touch one of several counters, picked by hashing the calling
+ * thread and each on its own cache line, so concurrent readers on different
+ * cores don't bounce a shared line the way pthread_rwlock_t does. A writer
+ * raises a flag that sends new readers to a slow path and then waits for
+ * the counters to drain; writers are therefore never starved by readers,
+ * but taking the lock for writing is comparatively expensive.
+ *
+ * The lock is about 1 KB and is private to the process. It is not
+ * recursive, for readers either: a thread holding the lock for reading
+ * deadlocks if it reads again while a writer is waiting.
+ */
+class ScalableRWLock {
+public:
+                ScalableRWLock();
+                ScalableRWLock(const char* name);
+                ~ScalableRWLock();
+
+    status_t    readLock();
+    status_t    tryReadLock();
+    status_t    writeLock();
+    status_t    tryWriteLock();
+    void        unlock();
+    // cheaper than unlock() when the caller knows how it holds the lock
+    void        readUnlock();
+    void        writeUnlock();
+
+    class AutoRLock {
+    public:
+        inline AutoRLock(ScalableRWLock& rwlock) : mLock(rwlock) {
+            mLock.readLock();
+        }
+        inline ~AutoRLock() { mLock.readUnlock(); }
+    private:
+        ScalableRWLock& mLock;
+    };
+
+    class AutoWLock {
+    public:
+        inline AutoWLock(ScalableRWLock& rwlock) : mLock(rwlock) {
+            mLock.writeLock();
+        }
+        inline ~AutoWLock() { mLock.writeUnlock(); }
+    private:
+        ScalableRWLock& mLock;
+    };
+
+private:
+    // A ScalableRWLock cannot be copied
+                ScalableRWLock(const ScalableRWLock&);
+    ScalableRWLock& operator = (const ScalableRWLock&);
+
+    enum {
+        SLOT_COUNT = 16,
+        CACHE_LINE_SIZE = 64
+    };
+
+    // mWriter states
+    enum {
+        WRITER_NONE = 0,
+        WRITER_PENDING = 1, // waiting for the readers to drain
+        WRITER_HELD = 2
+    };
+
+    struct Slot {
+        volatile int32_t readers;
+        char pad[CACHE_LINE_SIZE - sizeof(int32_t)];
+    };
+
+    inline Slot* slotForCaller() {
+        // pthread_t is an address or a small id; mix the bits that differ
+        // between threads into the top ones
+        const uint32_t h = uint32_t(uintptr_t(pthread_self()) >> 4) * 2654435761U;
+        return &mSlots[h >> 28];
+    }
+
+    void        readLockSlow(Slot* slot);
+    void        wakeWriter();
+    bool        drainedLocked() const;
+
+    // only written by writers, so readers keep it in their caches
+    volatile int32_t mWriter;
+    char mPad[CACHE_LINE_SIZE - sizeof(int32_t)];
+    Slot mSlots[SLOT_COUNT];
+    // protects the slow paths
+    Mutex mLock;
+    Condition mCondition;
+};
+
+inline ScalableRWLock::ScalableRWLock() : mWriter(WRITER_NONE) {
+    memset(mSlots, 0, sizeof(mSlots));
+}
+inline ScalableRWLock::ScalableRWLock(const char* name)
+    : mWriter(WRITER_NONE), mLock(name) {
+    memset(mSlots, 0, sizeof(mSlots));
+}
+inline ScalableRWLock::~ScalableRWLock() {
+}
+inline status_t ScalableRWLock::readLock() {
+    Slot* slot = slotForCaller();
+    android_atomic_inc(&slot->readers);
+    // orders our count before the flag read; a writer does the opposite
+    android_memory_barrier();
+    if (android_atomic_acquire_load(&mWriter) != WRITER_NONE) {
+        readLockSlow(slot);
+    }
+    return NO_ERROR;
+}
+inline status_t ScalableRWLock::tryReadLock() {
+    Slot* slot = slotForCaller();
+    android_atomic_inc(&slot->readers);
+    android_memory_barrier();
+    if (android_atomic_acquire_load(&mWriter) != WRITER_NONE) {
+        android_atomic_dec(&slot->readers);
+        wakeWriter();
+        return -EBUSY;
+    }
+    return NO_ERROR;
+}
+inline void ScalableRWLock::readUnlock() {
+    Slot* slot = slotForCaller();
+    android_atomic_dec(&slot->readers);
+    android_memory_barrier();
+    if (android_atomic_acquire_load(&mWriter) != WRITER_NONE) {
+        wakeWriter();
+    }
+}
+inline void ScalableRWLock::unlock() {
+    // readers can't hold the lock once a writer does, so a held write lock
+    // can only be released by its owner
+    if (android_atomic_acquire_load(&mWriter) == WRITER_HELD) {
+        writeUnlock();
+    } else {
+        readUnlock();
+    }
+}
+
+#endif // HAVE_PTHREADS
+
+// ---------------------------------------------------------------------------
+}; // namespace android
+// ---------------------------------------------------------------------------
+
+#endif // _LIBS_UTILS_SCALABLE_RWLOCK_H
@@ -86,9 +86,25 @@ public:
     
     //! returns wether or not we're the only owner
     inline          bool                    onlyOwner() const;
-    
+
+    /*! statistics of the per-thread cache of small buffers. The counters
+     * are folded in periodically by each thread, and when it exits, so they
+     * lag slightly behind.
+     */
+    struct CacheStats {
+        uint32_t    hits;           // allocations served from a cache
+        uint32_t    misses;         // small allocations that went to malloc
+        uint32_t    trimmed;        // cached buffers given back to malloc
+        size_t      cachedBytes;    // bytes the caches may hold right now
+        size_t      maxCachedBytes; // process-wide bound of the above
+    };
+    static          void                    getCacheStats(CacheStats* stats);
 
 private:
+        // like malloc()/free(), through the cache when possible
+        static SharedBuffer*    allocStorage(size_t size);
+        static void             freeStorage(const SharedBuffer* sb);
+
         inline SharedBuffer() { }
         inline ~SharedBuffer() { }
         SharedBuffer(const SharedBuffer&);
@@ -97,6 +113,8 @@ private:
         // 16 bytes. must be sized to preserve correct alignment.
         mutable int32_t        mRefs;
                 size_t         mSize;
+                // mReserved[0] is the size class + 1 of a buffer that came
+                // from the cache, 0 if it came from malloc()
                 uint32_t       mReserved[2];
 };
 
@@ -133,6 +133,17 @@ protected:
     virtual int     do_compare(const void* lhs, const void* rhs) const;
 };
 
+/*
+ * Index of 'item' in the array [a, a + size) sorted with strictly_order_type(),
+ * or NAME_NOT_FOUND. It compares TYPEs directly instead of calling the virtual
+ * do_compare() on every probe, so it's only meant for containers that own a
+ * plain SortedVector, like KeyedVector. SortedVector subclasses may override
+ * do_compare() (SurfaceFlinger's LayerVector does), so SortedVector itself
+ * always searches through SortedVectorImpl.
+ */
+template<typename TYPE>
+ssize_t strictly_ordered_index_of(const TYPE* a, size_t size, const TYPE& item);
+
 // SortedVector<T> can be trivially moved using memcpy() because moving does not
 // require any change to the underlying SharedBuffer contents or reference count.
 template<typename T> struct trait_trivial_move<SortedVector<T> > { enum { value = true }; };
@@ -146,7 +157,8 @@ SortedVector<TYPE>::SortedVector()
     : SortedVectorImpl(sizeof(TYPE),
                 ((traits<TYPE>::has_trivial_ctor   ? HAS_TRIVIAL_CTOR   : 0)
                 |(traits<TYPE>::has_trivial_dtor   ? HAS_TRIVIAL_DTOR   : 0)
-                |(traits<TYPE>::has_trivial_copy   ? HAS_TRIVIAL_COPY   : 0))
+                |(traits<TYPE>::has_trivial_copy   ? HAS_TRIVIAL_COPY   : 0)
+                |(traits<TYPE>::has_trivial_move   ? HAS_TRIVIAL_MOVE   : 0))
                 )
 {
 }
@@ -274,6 +286,30 @@ int SortedVector<TYPE>::do_compare(const void* lhs, const void* rhs) const {
     return compare_type( *reinterpret_cast<const TYPE*>(lhs), *reinterpret_cast<const TYPE*>(rhs) );
 }
 
+/*
+ * The search only narrows a [base, base + n) window with a select the
+ * compiler can turn into a conditional move, so there's no mispredicted
+ * branch per probe.
+ */
+template<typename TYPE> inline
+ssize_t strictly_ordered_index_of(const TYPE* a, size_t size, const TYPE& item) {
+    size_t n = size;
+    if (n == 0) {
+        return NAME_NOT_FOUND;
+    }
+    const TYPE* base = a;
+    while (n > 1) {
+        const size_t half = n / 2;
+        base = strictly_order_type(base[half], item) ? base + half : base;
+        n -= half;
+    }
+    const size_t order = (base - a) + strictly_order_type(*base, item);
+    if (order < size && !strictly_order_type(item, a[order])) {
+        return order;
+    }
+    return NAME_NOT_FOUND;
+}
+
 }; // namespace android
 
 
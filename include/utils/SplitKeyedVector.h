@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SPLIT_KEYED_VECTOR_H
+#define ANDROID_SPLIT_KEYED_VECTOR_H
+
+#include <assert.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <cutils/log.h>
+
+#include <utils/Errors.h>
+#include <utils/SortedVector.h>
+#include <utils/TypeHelpers.h>
+#include <utils/Vector.h>
+
+// ---------------------------------------------------------------------------
+
+namespace android {
+
+/*
+ * A KeyedVector that keeps its keys and its values in two parallel arrays
+ * instead of one array of key/value pairs, so looking a key up only touches
+ * the dense array of keys. Use it instead of KeyedVector when the values are
+ * large compared to the keys and lookups dominate; inserting and removing
+ * move both arrays.
+ */
+template <typename KEY, typename VALUE>
+class SplitKeyedVector
+{
+public:
+    typedef KEY    key_type;
+    typedef VALUE  value_type;
+
+    inline                  SplitKeyedVector();
+
+    /*
+     * empty the vector
+     */
+
+    inline  void            clear()         { mKeys.clear(); mValues.clear(); }
+
+    /*!
+     * vector stats
+     */
+
+    //! returns number of items in the vector
+    inline  size_t          size() const                { return mKeys.size(); }
+    //! returns whether or not the vector is empty
+    inline  bool            isEmpty() const             { return mKeys.isEmpty(); }
+    //! returns how many items can be stored without reallocating the backing store
+    inline  size_t          capacity() const            { return mKeys.capacity(); }
+    //! sets the capacity. capacity can never be reduced less than size()
+    inline ssize_t          setCapacity(size_t size);
+
+    // returns true if the arguments is known to be identical to this vector
+    inline bool isIdenticalTo(const SplitKeyedVector& rhs) const;
+
+    /*!
+     * accessors
+     */
+            const VALUE&    valueFor(const KEY& key) const;
+            const VALUE&    valueAt(size_t index) const;
+            const KEY&      keyAt(size_t index) const;
+            ssize_t         indexOfKey(const KEY& key) const;
+            const VALUE&    operator[] (size_t index) const;
+
+    /*!
+     * modifying the array
+     */
+
+            VALUE&          editValueFor(const KEY& key);
+            VALUE&          editValueAt(size_t index);
+
+            /*!
+             * add/insert/replace items
+             */
+
+            ssize_t         add(const KEY& key, const VALUE& item);
+            ssize_t         replaceValueFor(const KEY& key, const VALUE& item);
+            ssize_t         replaceValueAt(size_t index, const VALUE& item);
+
+    /*!
+     * remove items
+     */
+
+            ssize_t         removeItem(const KEY& key);
+            ssize_t         removeItemsAt(size_t index, size_t count = 1);
+
+private:
+            SortedVector<KEY>   mKeys;
+            // mValues[i] is the value of mKeys[i]
+            Vector<VALUE>       mValues;
+};
+
+// SplitKeyedVector<KEY, VALUE> can be trivially moved using memcpy() because
+// both of its underlying vectors can be trivially moved.
+template<typename KEY, typename VALUE> struct trait_trivial_move<SplitKeyedVector<KEY, VALUE> > {
+    enum { value = trait_trivial_move<SortedVector<KEY> >::value &&
+            trait_trivial_move<Vector<VALUE> >::value };
+};
+
+// ---------------------------------------------------------------------------
+
+template<typename KEY, typename VALUE> inline
+SplitKeyedVector<KEY,VALUE>::SplitKeyedVector()
+{
+}
+
+template<typename KEY, typename VALUE> inline
+ssize_t SplitKeyedVector<KEY,VALUE>::setCapacity(size_t size) {
+    ssize_t err = mKeys.setCapacity(size);
+    if (err >= 0) {
+        err = mValues.setCapacity(size);
+    }
+    return err;
+}
+
+template<typename KEY, typename VALUE> inline
+bool SplitKeyedVector<KEY,VALUE>::isIdenticalTo(const SplitKeyedVector<KEY,VALUE>& rhs) const {
+    return mKeys.array() == rhs.mKeys.array() &&
+            mValues.array() == rhs.mValues.array();
+}
+
+template<typename KEY, typename VALUE> inline
+ssize_t SplitKeyedVector<KEY,VALUE>::indexOfKey(const KEY& key) const {
+    return strictly_ordered_index_of(mKeys.array(), mKeys.size(), key);
+}
+
+template<typename KEY, typename VALUE> inline
+const VALUE& SplitKeyedVector<KEY,VALUE>::valueFor(const KEY& key) const {
+    ssize_t i = this->indexOfKey(key);
+    LOG_ALWAYS_FATAL_IF(i<0, "%s: key not found", __PRETTY_FUNCTION__);
+    return mValues.itemAt(i);
+}
+
+template<typename KEY, typename VALUE> inline
+const VALUE& SplitKeyedVector<KEY,VALUE>::valueAt(size_t index) const {
+    return mValues.itemAt(index);
+}
+
+template<typename KEY, typename VALUE> inline
+const VALUE& SplitKeyedVector<KEY,VALUE>::operator[] (size_t index) const {
+    return valueAt(index);
+}
+
+template<typename KEY, typename VALUE> inline
+const KEY& SplitKeyedVector<KEY,VALUE>::keyAt(size_t index) const {
+    return mKeys.itemAt(index);
+}
+
+template<typename KEY, typename VALUE> inline
+VALUE& SplitKeyedVector<KEY,VALUE>::editValueFor(const KEY& key) {
+    ssize_t i = this->indexOfKey(key);
+    LOG_ALWAYS_FATAL_IF(i<0, "%s: key not found", __PRETTY_FUNCTION__);
+    return mValues.editItemAt(i);
+}
+
+template<typename KEY, typename VALUE> inline
+VALUE& SplitKeyedVector<KEY,VALUE>::editValueAt(size_t index) {
+    return mValues.editItemAt(index);
+}
+
+template<typename KEY, typename VALUE> inline
+ssize_t SplitKeyedVector<KEY,VALUE>::add(const KEY& key, const VALUE& value) {
+    const size_t count = mKeys.size();
+    const ssize_t index = mKeys.add(key);
+    if (index < 0) {
+        return index;
+    }
+    if (mKeys.size() == count) {
+        // the key was already there
+        mValues.editItemAt(index) = value;
+        return index;
+    }
+    const ssize_t err = mValues.insertAt(value, index);
+    if (err < 0) {
+        mKeys.removeItemsAt(index);
+        return err;
+    }
+    return index;
+}
+
+template<typename KEY, typename VALUE> inline
+ssize_t SplitKeyedVector<KEY,VALUE>::replaceValueFor(const KEY& key, const VALUE& value) {
+    return add(key, value);
+}
+
+template<typename KEY, typename VALUE> inline
+ssize_t SplitKeyedVector<KEY,VALUE>::replaceValueAt(size_t index, const VALUE& item) {
+    if (index<size()) {
+        mValues.editItemAt(index) = item;
+        return index;
+    }
+    return BAD_INDEX;
+}
+
+template<typename KEY, typename VALUE> inline
+ssize_t SplitKeyedVector<KEY,VALUE>::removeItem(const KEY& key) {
+    const ssize_t index = mKeys.remove(key);
+    if (index >= 0) {
+        mValues.removeItemsAt(index);
+    }
+    return index;
+}
+
+template<typename KEY, typename VALUE> inline
+ssize_t SplitKeyedVector<KEY, VALUE>::removeItemsAt(size_t index, size_t count) {
+    const ssize_t err = mKeys.removeItemsAt(index, count);
+    if (err >= 0) {
+        mValues.removeItemsAt(index, count);
+    }
+    return err;
+}
+
+}; // namespace android
+
+// ---------------------------------------------------------------------------
+
+#endif // ANDROID_SPLIT_KEYED_VECTOR_H
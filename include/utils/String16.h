@@ -53,6 +53,14 @@ public:
     explicit                    String16(const char* o, size_t len);
 
                                 ~String16();
+
+    // Returns a string equal to "str" sharing its buffer with all the other
+    // interned strings of the same value, so that comparing them is a
+    // pointer comparison and interning it again doesn't allocate.
+    // Interned strings live as long as the process: only use this for
+    // identifiers drawn from a small set, like interface descriptors.
+    static  String16            intern(const char16_t* str, size_t len);
+    static  String16            intern(const String16& str);
     
     inline  const char16_t*     string() const;
     inline  size_t              size() const;
@@ -93,6 +101,11 @@ public:
 
     inline  int                 compare(const String16& other) const;
 
+    // A 32-bit hash of the characters, for hash tables keyed by String16.
+    // Equal strings have equal hashes whatever their buffers.
+    inline  hash_t              hash() const;
+    static  hash_t              hash(const char16_t* str, size_t len);
+
     inline  bool                operator<(const String16& other) const;
     inline  bool                operator<=(const String16& other) const;
     inline  bool                operator==(const String16& other) const;
@@ -132,6 +145,11 @@ inline int strictly_order_type(const String16& lhs, const String16& rhs)
     return compare_type(lhs, rhs) < 0;
 }
 
+template<> inline hash_t hash_type(const String16& value)
+{
+    return value.hash();
+}
+
 inline const char16_t* String16::string() const
 {
     return mString;
@@ -168,7 +186,8 @@ inline String16 String16::operator+(const String16& other) const
 
 inline int String16::compare(const String16& other) const
 {
-    return strzcmp16(mString, size(), other.mString, other.size());
+    return (mString == other.mString) ? 0 :
+            strzcmp16(mString, size(), other.mString, other.size());
 }
 
 inline bool String16::operator<(const String16& other) const
@@ -181,14 +200,21 @@ inline bool String16::operator<=(const String16& other) const
     return strzcmp16(mString, size(), other.mString, other.size()) <= 0;
 }
 
+inline hash_t String16::hash() const
+{
+    return hash(mString, size());
+}
+
 inline bool String16::operator==(const String16& other) const
 {
-    return strzcmp16(mString, size(), other.mString, other.size()) == 0;
+    const size_t n = size();
+    return (mString == other.mString) ||
+            (n == other.size() && strzcmp16(mString, n, other.mString, n) == 0);
 }
 
 inline bool String16::operator!=(const String16& other) const
 {
-    return strzcmp16(mString, size(), other.mString, other.size()) != 0;
+    return !(*this == other);
 }
 
 inline bool String16::operator>=(const String16& other) const
@@ -54,6 +54,14 @@ public:
     static String8              format(const char* fmt, ...) __attribute__((format (printf, 1, 2)));
     static String8              formatV(const char* fmt, va_list args);
 
+    // Returns a string equal to "str" sharing its buffer with all the other
+    // interned strings of the same value, so that comparing them is a
+    // pointer comparison and interning it again doesn't allocate.
+    // Interned strings live as long as the process: only use this for
+    // identifiers drawn from a small set, like names and descriptors.
+    static String8              intern(const char* str);
+    static String8              intern(const String8& str);
+
     inline  const char*         string() const;
     inline  size_t              size() const;
     inline  size_t              length() const;
@@ -313,7 +321,7 @@ inline String8 String8::operator+(const char* other) const
 
 inline int String8::compare(const String8& other) const
 {
-    return strcmp(mString, other.mString);
+    return (mString == other.mString) ? 0 : strcmp(mString, other.mString);
 }
 
 inline bool String8::operator<(const String8& other) const
@@ -328,12 +336,12 @@ inline bool String8::operator<=(const String8& other) const
 
 inline bool String8::operator==(const String8& other) const
 {
-    return strcmp(mString, other.mString) == 0;
+    return (mString == other.mString) || strcmp(mString, other.mString) == 0;
 }
 
 inline bool String8::operator!=(const String8& other) const
 {
-    return strcmp(mString, other.mString) != 0;
+    return (mString != other.mString) && strcmp(mString, other.mString) != 0;
 }
 
 inline bool String8::operator>=(const String8& other) const
@@ -71,6 +71,11 @@ public:
     // Return the thread's kernel ID, same as the thread itself calling gettid() or
     // androidGetTid(), or -1 if the thread is not running.
             pid_t       getTid() const;
+
+    // Apply the scheduling attributes (CPU affinity, real-time policy,
+    // cgroup) configured for 'name' by the "sys.sched.<name>" property, if
+    // any, see androidGetThreadAttributes(). Call after run().
+            status_t    configureScheduling(const char* name);
 #endif
 
 protected:
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBS_UTILS_THREAD_POOL_H
+#define _LIBS_UTILS_THREAD_POOL_H
+
+#include <pthread.h>
+
+#include <utils/Errors.h>
+#include <utils/RefBase.h>
+#include <utils/Vector.h>
+#include <utils/threads.h>
+
+namespace android {
+
+/*
+ * A pool of threads that run tasks, with work stealing.
+ *
+ * Each thread has its own deque of tasks.  Tasks scheduled from a pool
+ * thread go to the back of its deque and are run from the back, so that
+ * the work a task fans out is run while its data is still in the cache.
+ * A thread without work steals from the front of the other threads' deques.
+ * Tasks scheduled from other threads are spread over the deques.
+ *
+ * Tasks have a priority, and a thread always looks for the highest
+ * priority task first, in its own deque and then in the other ones.
+ *
+ * Unlike WorkQueue, tasks are reference counted objects the caller may keep
+ * to wait for their completion, and a task can depend on other tasks, in
+ * which case it only runs once all of them have completed.
+ */
+class ThreadPool {
+public:
+    enum Priority {
+        PRIORITY_HIGH = 0,
+        PRIORITY_NORMAL,
+        PRIORITY_LOW,
+        PRIORITY_COUNT
+    };
+
+    class Task : public VirtualLightRefBase {
+    public:
+        Task();
+        virtual ~Task();
+
+        /* Runs the task, on a thread of the pool. */
+        virtual void run() = 0;
+
+        /* Called on the same thread after run(), before the task is marked
+         * as completed and the tasks that depend on it are scheduled.
+         */
+        virtual void onCompleted() { }
+
+        /* Makes this task wait for the completion of another task before
+         * running.  Must be called before this task is scheduled, and the
+         * other task must be scheduled on the same pool.  Does nothing if
+         * the other task has already completed.
+         */
+        void addDependency(const sp<Task>& other);
+
+        /* Waits for the task to complete. */
+        void wait() const;
+
+        /* Returns whether the task has completed. */
+        bool isCompleted() const;
+
+    private:
+        friend class ThreadPool;
+
+        mutable Mutex mLock;
+        mutable Condition mCompletedCondition;
+        bool mCompleted;
+        Vector<sp<Task> > mDependents;
+
+        // one for each dependency not yet completed, plus one until the
+        // task is scheduled; the task is queued when this drops to 0
+        volatile int32_t mPendingDependencies;
+
+        ThreadPool* mPool;
+        Priority mPriority;
+    };
+
+    /* Creates a pool with the specified number of threads, which are started
+     * right away.
+     */
+    ThreadPool(size_t threadCount, bool canCallJava = true);
+
+    /* Waits for all scheduled tasks to complete, then stops the threads. */
+    ~ThreadPool();
+
+    /* Schedules a task to run, once all its dependencies have completed.
+     * Returns INVALID_OPERATION if the task has already been scheduled.
+     */
+    status_t schedule(const sp<Task>& task, Priority priority = PRIORITY_NORMAL);
+
+    /* Waits for all scheduled tasks to complete. */
+    void wait();
+
+    inline size_t getThreadCount() const {
+        return mWorkers.size();
+    }
+
+private:
+    class Worker : public Thread {
+    public:
+        Worker(ThreadPool* pool, size_t index, bool canCallJava);
+        virtual ~Worker();
+
+        // tasks waiting to run, for each priority; guarded by mLock
+        Mutex mLock;
+        Vector<sp<Task> > mTasks[PRIORITY_COUNT];
+
+    private:
+        virtual status_t readyToRun();
+        virtual bool threadLoop();
+
+        ThreadPool* const mPool;
+        const size_t mIndex;
+    };
+
+    void enqueue(const sp<Task>& task);
+    sp<Task> takeTask(size_t workerIndex);
+    void completeTask(const sp<Task>& task);
+    bool threadLoop(size_t workerIndex); // called from each worker thread
+
+    pthread_key_t mTLSKey; // the Worker running on the current thread
+
+    Vector<sp<Worker> > mWorkers;
+    volatile int32_t mNextWorker; // where to queue tasks from outside the pool
+
+    // number of tasks queued in all the workers' deques
+    volatile int32_t mQueuedTasks;
+
+    // number of tasks scheduled and not yet completed
+    volatile int32_t mScheduledTasks;
+
+    Mutex mLock;
+    Condition mWorkAvailableCondition;
+    Condition mIdleCondition;
+    bool mExiting;
+};
+
+}; // namespace android
+
+#endif // _LIBS_UTILS_THREAD_POOL_H
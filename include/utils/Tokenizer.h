@@ -66,6 +66,12 @@ public:
      */
     inline String8 getFilename() const { return mFilename; }
 
+    /**
+     * Returns true if the file is mapped rather than read, which is the case
+     * of regular files but not of the files in sysfs.
+     */
+    inline bool isMapped() const { return mFileMap != NULL; }
+
     /**
      * Gets a 1-based line number index for the current position.
      */
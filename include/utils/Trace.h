@@ -78,6 +78,17 @@
 // value changes over time in a trace.
 #define ATRACE_INT(name, value) android::Tracer::traceCounter(ATRACE_TAG, name, value)
 
+// ATRACE_INT64 traces a named 64-bit integer value.
+#define ATRACE_INT64(name, value) android::Tracer::traceCounter64(ATRACE_TAG, name, value)
+
+// ATRACE_ASYNC_BEGIN and ATRACE_ASYNC_END trace a span which may begin and
+// end on different threads, e.g. a buffer between its queueing and its
+// composition.  Spans with the same name must have different cookies.
+#define ATRACE_ASYNC_BEGIN(name, cookie) \
+        android::Tracer::traceAsyncBegin(ATRACE_TAG, name, cookie)
+#define ATRACE_ASYNC_END(name, cookie) \
+        android::Tracer::traceAsyncEnd(ATRACE_TAG, name, cookie)
+
 // ATRACE_ENABLED returns true if the trace tag is enabled.  It can be used as a
 // guard condition around more expensive trace calculations.
 #define ATRACE_ENABLED() android::Tracer::isTagEnabled(ATRACE_TAG)
@@ -102,16 +113,44 @@ public:
             int32_t value) {
         if (CC_UNLIKELY(isTagEnabled(tag))) {
             char buf[1024];
-            snprintf(buf, 1024, "C|%d|%s|%d", getpid(), name, value);
-            write(sTraceFD, buf, strlen(buf));
+            int len = snprintf(buf, sizeof(buf), "C|%d|%s|%d", sPid, name, value);
+            writeMarker(buf, len);
+        }
+    }
+
+    static inline void traceCounter64(uint64_t tag, const char* name,
+            int64_t value) {
+        if (CC_UNLIKELY(isTagEnabled(tag))) {
+            char buf[1024];
+            int len = snprintf(buf, sizeof(buf), "C|%d|%s|%lld", sPid, name,
+                    (long long) value);
+            writeMarker(buf, len);
         }
     }
 
     static inline void traceBegin(uint64_t tag, const char* name) {
         if (CC_UNLIKELY(isTagEnabled(tag))) {
             char buf[1024];
-            size_t len = snprintf(buf, 1024, "B|%d|%s", getpid(), name);
-            write(sTraceFD, buf, len);
+            int len = snprintf(buf, sizeof(buf), "B|%d|%s", sPid, name);
+            writeMarker(buf, len);
+        }
+    }
+
+    static inline void traceAsyncBegin(uint64_t tag, const char* name,
+            int32_t cookie) {
+        if (CC_UNLIKELY(isTagEnabled(tag))) {
+            char buf[1024];
+            int len = snprintf(buf, sizeof(buf), "S|%d|%s|%d", sPid, name, cookie);
+            writeMarker(buf, len);
+        }
+    }
+
+    static inline void traceAsyncEnd(uint64_t tag, const char* name,
+            int32_t cookie) {
+        if (CC_UNLIKELY(isTagEnabled(tag))) {
+            char buf[1024];
+            int len = snprintf(buf, sizeof(buf), "F|%d|%s|%d", sPid, name, cookie);
+            writeMarker(buf, len);
         }
     }
 
@@ -124,6 +163,15 @@ public:
 
 private:
 
+    // Writes a marker formatted into a 1024 bytes buffer, truncated if
+    // snprintf() ran out of room.
+    static inline void writeMarker(const char* buf, int len) {
+        if (len > 1023) {
+            len = 1023;
+        }
+        write(sTraceFD, buf, len);
+    }
+
     static inline void initIfNeeded() {
         if (!android_atomic_acquire_load(&sIsReady)) {
             init();
@@ -132,6 +180,9 @@ private:
 
     static void changeCallback();
 
+    // refreshes sPid in the child of a fork()
+    static void atForkChild();
+
     // init opens the trace marker file for writing and reads the
     // atrace.tags.enableflags system property.  It does this only the first
     // time it is run, using sMutex for synchronization.
@@ -169,6 +220,11 @@ private:
     // This value is only ever non-zero when tracing is initialized and sTraceFD is not -1.
     static uint64_t sEnabledTags;
 
+    // sPid is the process id included in every trace marker, cached by
+    // init() rather than calling getpid() for every marker, and updated in
+    // the child of a fork().
+    static int sPid;
+
     // sMutex is used to protect the execution of init().
     static Mutex sMutex;
 };
@@ -114,6 +114,15 @@ ssize_t utf16_to_utf8_length(const char16_t *src, size_t src_len);
  */
 void utf16_to_utf8(const char16_t* src, size_t src_len, char* dst);
 
+/**
+ * Converts a UTF-16 string to UTF-8 and returns the number of bytes written,
+ * not counting the NULL terminator, which is always what utf16_to_utf8_length
+ * would have returned. This saves measuring the string before converting it
+ * when "dst" is known to be large enough, i.e. when it can hold 3 bytes per
+ * UTF-16 code unit plus a NULL terminator.
+ */
+size_t utf16_to_utf8_and_length(const char16_t* src, size_t src_len, char* dst);
+
 /**
  * Returns the length of "src" when "src" is valid UTF-8 string.
  * Returns 0 if src is NULL or 0-length string. Returns -1 when the source
@@ -163,6 +172,16 @@ char16_t* utf8_to_utf16_no_null_terminator(const uint8_t* src, size_t srcLen, ch
  */
 void utf8_to_utf16(const uint8_t* src, size_t srcLen, char16_t* dst);
 
+/**
+ * Converts UTF-8 to UTF-16 including surrogate pairs, adds a NULL terminator
+ * and returns the number of UTF-16 code units written before it, or -1 if
+ * the last code point of "src" is truncated (as utf8_to_utf16_length does).
+ * UTF-8 never needs more UTF-16 code units than it has bytes, so this saves
+ * measuring the string first when "dst" can hold "srcLen" code units plus a
+ * NULL terminator.
+ */
+ssize_t utf8_to_utf16_and_length(const uint8_t* src, size_t srcLen, char16_t* dst);
+
 }
 
 #endif
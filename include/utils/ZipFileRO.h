@@ -35,6 +35,7 @@
 #include <utils/FileMap.h>
 #include <utils/threads.h>
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -48,6 +49,8 @@ namespace android {
  */
 typedef void* ZipEntryRO;
 
+class ThreadPool;
+
 /*
  * Open a Zip archive for reading.
  *
@@ -74,15 +77,37 @@ public:
         : mFd(-1), mFileName(NULL), mFileLength(-1),
           mDirectoryMap(NULL),
           mNumEntries(-1), mDirectoryOffset(-1),
-          mHashTableSize(-1), mHashTable(NULL)
+          mHashTableSize(-1), mHashTable(NULL), mIndexMap(NULL)
         {}
 
     ~ZipFileRO();
 
     /*
      * Open an archive.
+     *
+     * If "indexFileName" names an index written by writeIndex() for this
+     * very archive (same length, modification time and central directory),
+     * the lookup table is mapped from it instead of being built by walking
+     * the central directory, and its pages are shared by every process that
+     * maps it.  A missing or stale index is ignored.
+     */
+    status_t open(const char* zipFileName, const char* indexFileName = NULL);
+
+    /*
+     * Save the lookup table of the open archive to "indexFileName", for
+     * later calls to open().  The file is replaced atomically, and is only
+     * valid on devices with the same byte order and until the archive is
+     * modified.  The index is trusted as much as the archive, so it must
+     * not be writable by anybody who can't write the archive.
      */
-    status_t open(const char* zipFileName);
+    status_t writeIndex(const char* indexFileName) const;
+
+    /*
+     * Returns "true" if the lookup table was mapped from an index file.
+     */
+    bool isIndexMapped(void) const {
+        return mIndexMap != NULL;
+    }
 
     /*
      * Find an entry, by name.  Returns the entry identifier, or NULL if
@@ -156,6 +181,20 @@ public:
      */
     bool uncompressEntry(ZipEntryRO entry, int fd) const;
 
+    /*
+     * Uncompress several entries at once, each into its own buffer, in
+     * parallel on the threads of "pool".  If "pool" is NULL, a temporary
+     * pool with up to one thread per online CPU is used; callers that do
+     * this often should keep a pool around instead.
+     *
+     * "entries" and "buffers" both hold "count" elements, and each buffer
+     * must be at least "uncompLen" bytes long as for uncompressEntry().
+     *
+     * Returns "true" if every entry was uncompressed successfully.
+     */
+    bool uncompressEntries(const ZipEntryRO* entries, void* const* buffers,
+        size_t count, ThreadPool* pool = NULL) const;
+
     /* Zip compression methods we support */
     enum {
         kCompressStored     = 0,        // no compression
@@ -205,13 +244,17 @@ private:
     ZipFileRO& operator=(const ZipFileRO& src);
 
     /* locate and parse the central directory */
-    bool mapCentralDirectory(void);
+    bool mapCentralDirectory(const char* indexFileName);
+
+    /* map the lookup table from an index file, if it matches the archive */
+    bool mapIndex(const char* indexFileName, off64_t dirOffset,
+        size_t dirSize, int numEntries);
 
     /* parse the archive, prepping internal structures */
     bool parseZipArchive(void);
 
     /* add a new entry to the hash table */
-    void addToHash(const char* str, int strLen, unsigned int hash);
+    void addToHash(uint32_t nameOffset, int strLen, unsigned int hash);
 
     /* compute string hash code */
     static unsigned int computeHash(const char* str, int len);
@@ -220,14 +263,23 @@ private:
     int entryToIndex(const ZipEntryRO entry) const;
 
     /*
-     * One entry in the hash table.
+     * One entry in the hash table.  The name is found by its offset in the
+     * central directory rather than by address, so the table can be saved
+     * to and mapped from an index file as it is.
      */
     typedef struct HashEntry {
-        const char*     name;
-        unsigned short  nameLen;
-        //unsigned int    hash;
+        uint32_t        nameOffset;     // 0 if the slot is empty
+        uint16_t        nameLen;
+        uint16_t        reserved;
     } HashEntry;
 
+    /* name of a hash table entry, or NULL if it is outside the directory */
+    const char* entryName(const HashEntry& entry) const {
+        if (entry.nameOffset + entry.nameLen > mDirectoryMap->getDataLength())
+            return NULL;
+        return (const char*) mDirectoryMap->getDataPtr() + entry.nameOffset;
+    }
+
     /* open Zip archive */
     int         mFd;
 
@@ -255,6 +307,75 @@ private:
      */
     int         mHashTableSize;
     HashEntry*  mHashTable;
+
+    /* index file the hash table is mapped from, or NULL if we built it */
+    FileMap*    mIndexMap;
+};
+
+/*
+ * Read the uncompressed data of a Zip entry a piece at a time.
+ *
+ * Instead of expanding the whole entry in one go, each read() uncompresses
+ * only as much as fits in the caller's buffer, and picks up where it left
+ * off on the next call.  This lets a parser consume the data while it is
+ * being inflated, with a small window rather than a buffer for the whole
+ * entry.
+ *
+ * A reader must not be shared between threads, but any number of readers
+ * can be open on the same ZipFileRO at once.
+ */
+class ZipEntryReader {
+public:
+    ZipEntryReader();
+    ~ZipEntryReader();
+
+    /*
+     * Prepare to read "entry" of "zip", which must stay open until the
+     * reader is closed.  Any entry previously open is closed first.
+     *
+     * Returns "false" if "entry" is bogus or uses an unsupported
+     * compression method.
+     */
+    bool open(const ZipFileRO& zip, ZipEntryRO entry);
+
+    /*
+     * Uncompress up to "len" bytes of the entry into "buffer".
+     *
+     * Returns the number of bytes stored, which is only less than "len"
+     * at the end of the entry, 0 once the entry has been read entirely,
+     * or -1 if the data is corrupt or the reader isn't open.
+     */
+    ssize_t read(void* buffer, size_t len);
+
+    /*
+     * Release the mapping and inflater state of the entry.
+     */
+    void close();
+
+    /* total uncompressed length of the entry */
+    size_t getUncompressedLength() const { return mUncompLen; }
+
+    /* number of uncompressed bytes read so far */
+    size_t getOffset() const { return mOffset; }
+
+private:
+    /* these are private and not defined */
+    ZipEntryReader(const ZipEntryReader& src);
+    ZipEntryReader& operator=(const ZipEntryReader& src);
+
+    /* compressed data of the entry */
+    FileMap*    mMap;
+
+    /* zlib state, a z_stream, for deflated entries */
+    void*       mZStream;
+
+    int         mMethod;
+    size_t      mCompLen;
+    size_t      mUncompLen;
+    size_t      mOffset;
+
+    /* set when the data turned out to be corrupt */
+    bool        mFailed;
 };
 
 }; // namespace android
@@ -15,6 +15,7 @@
 # we have the common sources, plus some device-specific stuff
 sources := \
     Binder.cpp \
+    BinderStats.cpp \
     BpBinder.cpp \
     IInterface.cpp \
     IMemory.cpp \
@@ -59,3 +60,7 @@ LOCAL_MODULE := libbinder
 LOCAL_SRC_FILES := $(sources)
 
 include $(BUILD_STATIC_LIBRARY)
+
+ifeq (,$(ONE_SHOT_MAKEFILE))
+include $(call first-makefiles-under,$(LOCAL_PATH))
+endif
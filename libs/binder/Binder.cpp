@@ -20,9 +20,16 @@
 #include <utils/misc.h>
 #include <binder/BpBinder.h>
 #include <binder/IInterface.h>
+#include <binder/IPCThreadState.h>
 #include <binder/Parcel.h>
+#include <binder/PermissionCache.h>
+#include <binder/ProcessState.h>
+#include <utils/String8.h>
+
+#include <private/binder/BinderStats.h>
 
 #include <stdio.h>
+#include <unistd.h>
 
 namespace android {
 
@@ -191,6 +198,16 @@ status_t BBinder::onTransact(
             reply->writeString16(getInterfaceDescriptor());
             return NO_ERROR;
 
+        case INTERFACE_TOKEN_TRANSACTION: {
+            // only for our own descriptor, so that a token we handed out
+            // always stands for the interface the caller expects
+            const String16& descriptor(getInterfaceDescriptor());
+            const String16 interface(data.readString16());
+            reply->writeInt32(descriptor.size() && interface == descriptor ?
+                    Parcel::registerInterfaceToken(descriptor) : 0);
+            return NO_ERROR;
+        }
+
         case DUMP_TRANSACTION: {
             int fd = data.readFileDescriptor();
             int argc = data.readInt32();
@@ -198,6 +215,29 @@ status_t BBinder::onTransact(
             for (int i = 0; i < argc && data.dataAvail() > 0; i++) {
                args.add(data.readString16());
             }
+            if (args.size() && args[0] == String16("--binder-stats")) {
+                // handled here for every service, so the DUMP permission
+                // the services check in dump() has to be checked here too
+                String8 result;
+                if (!PermissionCache::checkCallingPermission(
+                        String16("android.permission.DUMP"))) {
+                    char buffer[128];
+                    snprintf(buffer, sizeof(buffer), "Permission Denial: "
+                            "can't dump binder stats from pid=%d, uid=%d\n",
+                            IPCThreadState::self()->getCallingPid(),
+                            IPCThreadState::self()->getCallingUid());
+                    result.append(buffer);
+                } else if (args.size() > 1 && args[1] == String16("reset")) {
+                    BinderStats::reset();
+                    result.append("Binder transaction stats reset\n");
+                } else {
+                    ProcessState::self()->dumpThreadPool(result);
+                    ProcessState::self()->dumpTransactionBuffer(result);
+                    BinderStats::dump(result);
+                }
+                write(fd, result.string(), result.size());
+                return NO_ERROR;
+            }
             return dump(fd, args);
         }
 
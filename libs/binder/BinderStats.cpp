@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "BinderStats"
+
+#include <private/binder/BinderStats.h>
+
+#include <cutils/properties.h>
+#include <utils/Log.h>
+#include <utils/misc.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+volatile int32_t BinderStats::sIsReady = 0;
+bool BinderStats::sEnabled = false;
+Mutex BinderStats::sMutex;
+KeyedVector<BinderStats::Key, BinderStats::Entry>* BinderStats::sEntries = NULL;
+
+bool BinderStats::Key::operator < (const Key& rhs) const {
+    if (direction != rhs.direction) return direction < rhs.direction;
+    if (code != rhs.code) return code < rhs.code;
+    return descriptor < rhs.descriptor;
+}
+
+BinderStats::Entry::Entry()
+    : count(0), dataBytes(0), replyBytes(0), latencyTotal(0), latencyMax(0)
+{
+    memset(buckets, 0, sizeof(buckets));
+}
+
+nsecs_t BinderStats::Entry::getPercentile(uint32_t percentile) const {
+    const uint64_t target = (uint64_t(count) * percentile + 99) / 100;
+    uint64_t sum = 0;
+    for (size_t i=0 ; i<NUM_BUCKETS-1 ; i++) {
+        sum += buckets[i];
+        if (sum >= target) {
+            return us2ns(nsecs_t(FIRST_BUCKET_US) << i);
+        }
+    }
+    return latencyMax;
+}
+
+void BinderStats::init() {
+    Mutex::Autolock _l(sMutex);
+    if (!sIsReady) {
+        add_sysprop_change_callback(changeCallback, 0);
+        sEntries = new KeyedVector<Key, Entry>();
+        loadSystemProperty();
+        android_atomic_release_store(1, &sIsReady);
+    }
+}
+
+void BinderStats::changeCallback() {
+    Mutex::Autolock _l(sMutex);
+    if (sIsReady) {
+        loadSystemProperty();
+    }
+}
+
+void BinderStats::loadSystemProperty() {
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.binder.stats", value, "0");
+    sEnabled = atoi(value) != 0;
+}
+
+void BinderStats::record(Direction direction, const String16& descriptor,
+        uint32_t code, size_t dataSize, size_t replySize, nsecs_t latency)
+{
+    size_t bucket = 0;
+    nsecs_t bound = us2ns(FIRST_BUCKET_US);
+    while (bucket < NUM_BUCKETS-1 && latency >= bound) {
+        bucket++;
+        bound <<= 1;
+    }
+
+    Key key;
+    key.descriptor = descriptor;
+    key.code = code;
+    key.direction = direction;
+
+    Mutex::Autolock _l(sMutex);
+    if (!sEntries) {
+        return;
+    }
+    ssize_t index = sEntries->indexOfKey(key);
+    if (index < 0) {
+        if (sEntries->size() >= MAX_ENTRIES) {
+            return;
+        }
+        index = sEntries->add(key, Entry());
+        if (index < 0) {
+            return;
+        }
+    }
+    Entry& e(sEntries->editValueAt(index));
+    e.count++;
+    e.dataBytes += dataSize;
+    e.replyBytes += replySize;
+    e.latencyTotal += latency;
+    if (latency > e.latencyMax) {
+        e.latencyMax = latency;
+    }
+    e.buckets[bucket]++;
+}
+
+void BinderStats::reset() {
+    Mutex::Autolock _l(sMutex);
+    if (sEntries) {
+        sEntries->clear();
+    }
+}
+
+void BinderStats::dump(String8& result) {
+    // make sure the property was looked at
+    const bool enabled = isEnabled();
+
+    Mutex::Autolock _l(sMutex);
+    const size_t count = sEntries ? sEntries->size() : 0;
+    result.appendFormat("Binder transaction stats (pid %d, %s, %u entries)\n",
+            getpid(), enabled ? "enabled" : "disabled, set debug.binder.stats to 1",
+            count);
+    for (size_t i=0 ; i<count ; i++) {
+        const Key& k(sEntries->keyAt(i));
+        const Entry& e(sEntries->valueAt(i));
+        result.appendFormat("  %s %s code=%u: count=%u, "
+                "data=%llu bytes, reply=%llu bytes\n",
+                k.direction == OUTGOING ? "out" : "in ",
+                k.descriptor.size() ? String8(k.descriptor).string() : "<none>",
+                k.code, e.count, e.dataBytes, e.replyBytes);
+        result.appendFormat("    latency avg=%.1f us, max=%.1f us, "
+                "p50<=%.1f us, p90<=%.1f us, p99<=%.1f us\n",
+                e.count ? e.latencyTotal / 1e3 / e.count : 0.0,
+                e.latencyMax / 1e3,
+                e.getPercentile(50) / 1e3,
+                e.getPercentile(90) / 1e3,
+                e.getPercentile(99) / 1e3);
+        result.append("    histogram (us):");
+        for (size_t b=0 ; b<NUM_BUCKETS ; b++) {
+            if (e.buckets[b]) {
+                if (b < NUM_BUCKETS-1) {
+                    result.appendFormat(" <%u:%u",
+                            uint32_t(FIRST_BUCKET_US) << b, e.buckets[b]);
+                } else {
+                    result.appendFormat(" >=%u:%u",
+                            uint32_t(FIRST_BUCKET_US) << (b-1), e.buckets[b]);
+                }
+            }
+        }
+        result.append("\n");
+    }
+}
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
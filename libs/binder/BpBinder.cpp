@@ -18,9 +18,11 @@
 //#define LOG_NDEBUG 0
 
 #include <binder/BpBinder.h>
+#include <binder/IInterface.h>
 
 #include <binder/IPCThreadState.h>
 #include <utils/Log.h>
+#include <cutils/atomic.h>
 
 #include <stdio.h>
 
@@ -91,6 +93,7 @@ BpBinder::BpBinder(int32_t handle)
     , mAlive(1)
     , mObitsSent(0)
     , mObituaries(NULL)
+    , mInterfaceToken(0)
 {
     ALOGV("Creating BpBinder %p handle %d\n", this, mHandle);
 
@@ -127,6 +130,36 @@ const String16& BpBinder::getInterfaceDescriptor() const
     return mDescriptorCache;
 }
 
+int32_t BpBinder::negotiateInterfaceToken(const String16& interface)
+{
+    if (android_atomic_acquire_load(&mInterfaceToken) == 0) {
+        Parcel send, reply;
+        send.writeString16(interface);
+        // do the IPC without a lock held; peers that don't know about
+        // tokens fail the transaction or reply with nothing
+        int32_t token = -1;
+        if (transact(INTERFACE_TOKEN_TRANSACTION, send, &reply) == NO_ERROR) {
+            const int32_t t = reply.readInt32();
+            if (t > 0) {
+                token = t;
+            }
+        }
+        Mutex::Autolock _l(mLock);
+        if (mInterfaceToken == 0) {
+            mTokenDescriptor = interface;
+            android_atomic_release_store(token, &mInterfaceToken);
+        }
+    }
+    return interfaceToken(interface);
+}
+
+int32_t BpBinder::interfaceToken(const String16& interface) const
+{
+    const int32_t token = android_atomic_acquire_load(&mInterfaceToken);
+    // mTokenDescriptor is set before the token and never changes after
+    return token > 0 && mTokenDescriptor == interface ? token : 0;
+}
+
 bool BpBinder::isBinderAlive() const
 {
     return mAlive != 0;
@@ -266,7 +299,16 @@ void BpBinder::sendObituary()
     if (obits != NULL) {
         const size_t N = obits->size();
         for (size_t i=0; i<N; i++) {
-            reportOneDeath(obits->itemAt(i));
+            // binderDied() doesn't get the cookie, a recipient linked
+            // several times (with different cookies) is only told once
+            const wp<DeathRecipient>& recipient(obits->itemAt(i).recipient);
+            bool reported = false;
+            for (size_t j=0; j<i && !reported; j++) {
+                reported = (obits->itemAt(j).recipient == recipient);
+            }
+            if (!reported) {
+                reportOneDeath(obits->itemAt(i));
+            }
         }
 
         delete obits;
@@ -304,6 +346,37 @@ void BpBinder::detachObject(const void* objectID)
     mObjects.detach(objectID);
 }
 
+static void cleanupProxy(const void* /*id*/, void* obj, void* /*cookie*/)
+{
+    delete static_cast<wp<IInterface>*>(obj);
+}
+
+sp<IInterface> BpBinder::findProxy(const String16* descriptor) const
+{
+    AutoMutex _l(mLock);
+    wp<IInterface>* proxy = static_cast<wp<IInterface>*>(mObjects.find(descriptor));
+    return proxy != NULL ? proxy->promote() : NULL;
+}
+
+sp<IInterface> BpBinder::attachProxy(const String16* descriptor,
+        const sp<IInterface>& proxy)
+{
+    AutoMutex _l(mLock);
+    wp<IInterface>* cached = static_cast<wp<IInterface>*>(mObjects.find(descriptor));
+    if (cached == NULL) {
+        // only a weak reference, the proxy holds this binder strongly
+        mObjects.attach(descriptor, new wp<IInterface>(proxy), NULL, cleanupProxy);
+        return proxy;
+    }
+
+    sp<IInterface> other(cached->promote());
+    if (other != NULL) {
+        return other;
+    }
+    *cached = proxy;
+    return proxy;
+}
+
 BpBinder* BpBinder::remoteBinder()
 {
     return this;
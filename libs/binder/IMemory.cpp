@@ -26,11 +26,15 @@
 #include <sys/mman.h>
 
 #include <binder/IMemory.h>
+#include <cutils/properties.h>
 #include <utils/KeyedVector.h>
+#include <utils/misc.h>
 #include <utils/threads.h>
 #include <utils/Atomic.h>
 #include <binder/Parcel.h>
 #include <utils/CallStack.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
 
 #ifdef USE_V4L2_ION
 #include "ion.h"
@@ -41,6 +45,17 @@
 namespace android {
 // ---------------------------------------------------------------------------
 
+/*
+ * HeapCache keeps the mapping of each remote heap used by this process.
+ *
+ * It is split in shards, each with its own lock, so that threads using
+ * different heaps don't contend. When the last user of a heap goes away
+ * its mapping can be retained for a while (see loadRetentionPolicy()), so
+ * that a heap handed back and forth doesn't get mapped and unmapped each
+ * time. Retention is off by default, since a retained mapping also keeps
+ * the remote heap alive. Expired mappings are dropped from a heap's shard
+ * whenever it is used, and from all the shards at most every retain_ms.
+ */
 class HeapCache : public IBinder::DeathRecipient
 {
 public:
@@ -59,12 +74,37 @@ private:
     struct heap_info_t {
         sp<IMemoryHeap> heap;
         int32_t         count;
+        // when the mapping was retained, if count is 0
+        nsecs_t         released;
+    };
+
+    enum { NUM_SHARDS = 8 };
+
+    struct shard_t {
+        Mutex lock;
+        KeyedVector< wp<IBinder>, heap_info_t > heaps;
     };
 
     void free_heap(const wp<IBinder>& binder);
 
-    Mutex mHeapCacheLock;
-    KeyedVector< wp<IBinder>, heap_info_t > mHeapCache;
+    shard_t& shard_for(const wp<IBinder>& binder);
+    void trim_l(shard_t& shard, nsecs_t now, Vector< sp<IMemoryHeap> >* rel);
+    // trims every shard if retain_ms passed since the last time, must be
+    // called without any shard lock held
+    void trim_all(nsecs_t now);
+    void retain_l(heap_info_t& info, nsecs_t now);
+    void unretain_l(heap_info_t& info);
+    void init_policy();
+    void loadRetentionPolicy();
+    static void policyChanged();
+
+    shard_t mShards[NUM_SHARDS];
+    volatile int32_t mPolicyLoaded;
+    volatile int32_t mRetainMs;
+    volatile int32_t mRetainBytes;
+    volatile int32_t mRetainedBytes;
+    // when all the shards were last trimmed, in ms
+    volatile int32_t mLastTrimMs;
 };
 
 static sp<HeapCache> gHeapCache = new HeapCache();
@@ -87,6 +127,9 @@ public:
     virtual uint32_t getFlags() const;
     virtual uint32_t getOffset() const;
 
+    virtual status_t flushCache(size_t offset, size_t size) const;
+    virtual status_t invalidateCache(size_t offset, size_t size) const;
+
 private:
     friend class IMemory;
     friend class HeapCache;
@@ -107,6 +150,9 @@ private:
 
     void assertMapped() const;
     void assertReallyMapped() const;
+#ifdef USE_V4L2_ION
+    status_t syncCache(size_t offset, size_t size, long flags) const;
+#endif
 
     mutable volatile int32_t mHeapId;
     mutable void*       mBase;
@@ -380,10 +426,63 @@ uint32_t BpMemoryHeap::getOffset() const {
     return mOffset;
 }
 
+#ifdef USE_V4L2_ION
+status_t BpMemoryHeap::flushCache(size_t offset, size_t size) const {
+    return syncCache(offset, size, IMSYNC_DEV_TO_READ | IMSYNC_SYNC_FOR_DEV);
+}
+
+status_t BpMemoryHeap::invalidateCache(size_t offset, size_t size) const {
+    return syncCache(offset, size, IMSYNC_DEV_TO_WRITE | IMSYNC_SYNC_FOR_CPU);
+}
+
+status_t BpMemoryHeap::syncCache(size_t offset, size_t size, long flags) const
+{
+    assertMapped();
+    if (offset > mSize || size > mSize - offset) {
+        return BAD_VALUE;
+    }
+    if (!(mFlags & USE_ION_FD) || (mFlags & NO_CACHING)) {
+        return NO_ERROR;
+    }
+    // we don't keep the client we mapped the heap with around, the
+    // buffer is identified by its fd
+    int ion_client = ion_client_create();
+    if (ion_client < 0) {
+        ALOGE("BpMemoryHeap : ion client creation error");
+        return NO_INIT;
+    }
+    status_t err = NO_ERROR;
+    if (ion_msync(ion_client, mHeapId, flags, size, offset) < 0) {
+        err = -errno;
+        ALOGE("BpMemoryHeap : cache sync failed (%s)", strerror(-err));
+    }
+    ion_client_destroy(ion_client);
+    return err;
+}
+#else
+status_t BpMemoryHeap::flushCache(size_t offset, size_t size) const {
+    return IMemoryHeap::flushCache(offset, size);
+}
+
+status_t BpMemoryHeap::invalidateCache(size_t offset, size_t size) const {
+    return IMemoryHeap::invalidateCache(offset, size);
+}
+#endif
+
 // ---------------------------------------------------------------------------
 
 IMPLEMENT_META_INTERFACE(MemoryHeap, "android.utils.IMemoryHeap");
 
+status_t IMemoryHeap::flushCache(size_t offset, size_t size) const {
+    size_t heapSize = getSize();
+    return (offset > heapSize || size > heapSize - offset) ? BAD_VALUE : NO_ERROR;
+}
+
+status_t IMemoryHeap::invalidateCache(size_t offset, size_t size) const {
+    size_t heapSize = getSize();
+    return (offset > heapSize || size > heapSize - offset) ? BAD_VALUE : NO_ERROR;
+}
+
 BnMemoryHeap::BnMemoryHeap() {
 }
 
@@ -410,7 +509,8 @@ status_t BnMemoryHeap::onTransact(
 /*****************************************************************************/
 
 HeapCache::HeapCache()
-    : DeathRecipient()
+    : DeathRecipient(), mPolicyLoaded(0), mRetainMs(0), mRetainBytes(0),
+      mRetainedBytes(0), mLastTrimMs(0)
 {
 }
 
@@ -418,6 +518,114 @@ HeapCache::~HeapCache()
 {
 }
 
+void HeapCache::init_policy()
+{
+    if (!android_atomic_acquire_load(&mPolicyLoaded)) {
+        // racing here only loads the properties twice, but the callback
+        // must be added once
+        if (android_atomic_cmpxchg(0, 1, &mPolicyLoaded) == 0) {
+            add_sysprop_change_callback(policyChanged, 0);
+            loadRetentionPolicy();
+        }
+    }
+}
+
+void HeapCache::policyChanged()
+{
+    gHeapCache->loadRetentionPolicy();
+}
+
+void HeapCache::loadRetentionPolicy()
+{
+    // a released mapping is kept up to debug.binder.heap.retain_ms, as
+    // long as all retained mappings add up to at most
+    // debug.binder.heap.retain_kb
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.binder.heap.retain_ms", value, "0");
+    android_atomic_release_store(atoi(value), &mRetainMs);
+    property_get("debug.binder.heap.retain_kb", value, "4096");
+    android_atomic_release_store(atoi(value) * 1024, &mRetainBytes);
+}
+
+HeapCache::shard_t& HeapCache::shard_for(const wp<IBinder>& binder)
+{
+    const uintptr_t p = uintptr_t(binder.unsafe_get());
+    return mShards[((p >> 4) ^ (p >> 12)) & (NUM_SHARDS-1)];
+}
+
+void HeapCache::retain_l(heap_info_t& info, nsecs_t now)
+{
+    BpMemoryHeap const* h = static_cast<BpMemoryHeap const*>(info.heap.get());
+    info.released = now;
+    android_atomic_add(h->mSize, &mRetainedBytes);
+}
+
+void HeapCache::unretain_l(heap_info_t& info)
+{
+    BpMemoryHeap const* h = static_cast<BpMemoryHeap const*>(info.heap.get());
+    info.released = 0;
+    android_atomic_add(-int32_t(h->mSize), &mRetainedBytes);
+}
+
+void HeapCache::trim_l(shard_t& shard, nsecs_t now,
+        Vector< sp<IMemoryHeap> >* rel)
+{
+    // drop the retained mappings that expired or whose heap is gone
+    const nsecs_t retainTime = ms2ns(android_atomic_acquire_load(&mRetainMs));
+    for (size_t i=0 ; i<shard.heaps.size() ; ) {
+        heap_info_t& info(shard.heaps.editValueAt(i));
+        if (info.count == 0 && (now - info.released >= retainTime ||
+                !info.heap->asBinder()->isBinderAlive())) {
+            unretain_l(info);
+            rel->add(info.heap);
+            shard.heaps.removeItemsAt(i);
+        } else {
+            i++;
+        }
+    }
+
+    // then the oldest ones of this shard, until we're within budget
+    while (android_atomic_acquire_load(&mRetainedBytes) >
+            android_atomic_acquire_load(&mRetainBytes)) {
+        ssize_t oldest = -1;
+        for (size_t i=0 ; i<shard.heaps.size() ; i++) {
+            const heap_info_t& info(shard.heaps.valueAt(i));
+            if (info.count == 0 && (oldest < 0 ||
+                    info.released < shard.heaps.valueAt(oldest).released)) {
+                oldest = i;
+            }
+        }
+        if (oldest < 0) {
+            break;
+        }
+        unretain_l(shard.heaps.editValueAt(oldest));
+        rel->add(shard.heaps.valueAt(oldest).heap);
+        shard.heaps.removeItemsAt(oldest);
+    }
+}
+
+void HeapCache::trim_all(nsecs_t now)
+{
+    const int32_t retainMs = android_atomic_acquire_load(&mRetainMs);
+    if (retainMs <= 0 || !android_atomic_acquire_load(&mRetainedBytes)) {
+        return;
+    }
+    // only one thread does the pass, the time wraps harmlessly
+    const int32_t nowMs = int32_t(ns2ms(now));
+    const int32_t last = android_atomic_acquire_load(&mLastTrimMs);
+    if (nowMs - last < retainMs ||
+            android_atomic_cmpxchg(last, nowMs, &mLastTrimMs)) {
+        return;
+    }
+    // the heaps are released after the locks are dropped
+    Vector< sp<IMemoryHeap> > rel;
+    for (size_t s=0 ; s<NUM_SHARDS ; s++) {
+        shard_t& shard(mShards[s]);
+        Mutex::Autolock _l(shard.lock);
+        trim_l(shard, now, &rel);
+    }
+}
+
 void HeapCache::binderDied(const wp<IBinder>& binder)
 {
     //ALOGD("binderDied binder=%p", binder.unsafe_get());
@@ -426,25 +634,38 @@ void HeapCache::binderDied(const wp<IBinder>& binder)
 
 sp<IMemoryHeap> HeapCache::find_heap(const sp<IBinder>& binder)
 {
-    Mutex::Autolock _l(mHeapCacheLock);
-    ssize_t i = mHeapCache.indexOfKey(binder);
+    init_policy();
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    trim_all(now);
+    // the heaps are released after the lock is dropped
+    Vector< sp<IMemoryHeap> > rel;
+    shard_t& shard(shard_for(binder));
+    Mutex::Autolock _l(shard.lock);
+    // an expired mapping of this heap is remapped rather than reused
+    trim_l(shard, now, &rel);
+    ssize_t i = shard.heaps.indexOfKey(binder);
     if (i>=0) {
-        heap_info_t& info = mHeapCache.editValueAt(i);
+        heap_info_t& info = shard.heaps.editValueAt(i);
         ALOGD_IF(VERBOSE,
                 "found binder=%p, heap=%p, size=%d, fd=%d, count=%d",
                 binder.get(), info.heap.get(),
                 static_cast<BpMemoryHeap*>(info.heap.get())->mSize,
                 static_cast<BpMemoryHeap*>(info.heap.get())->mHeapId,
                 info.count);
+        if (info.count == 0) {
+            // in use again, the mapping isn't retained anymore
+            unretain_l(info);
+        }
         android_atomic_inc(&info.count);
         return info.heap;
     } else {
         heap_info_t info;
         info.heap = interface_cast<IMemoryHeap>(binder);
         info.count = 1;
+        info.released = 0;
         //ALOGD("adding binder=%p, heap=%p, count=%d",
         //      binder.get(), info.heap.get(), info.count);
-        mHeapCache.add(binder, info);
+        shard.heaps.add(binder, info);
         return info.heap;
     }
 }
@@ -455,50 +676,74 @@ void HeapCache::free_heap(const sp<IBinder>& binder)  {
 
 void HeapCache::free_heap(const wp<IBinder>& binder)
 {
-    sp<IMemoryHeap> rel;
+    // the heaps are released after the lock is dropped
+    Vector< sp<IMemoryHeap> > rel;
     {
-        Mutex::Autolock _l(mHeapCacheLock);
-        ssize_t i = mHeapCache.indexOfKey(binder);
+        const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        shard_t& shard(shard_for(binder));
+        Mutex::Autolock _l(shard.lock);
+        ssize_t i = shard.heaps.indexOfKey(binder);
         if (i>=0) {
-            heap_info_t& info(mHeapCache.editValueAt(i));
-            int32_t c = android_atomic_dec(&info.count);
-            if (c == 1) {
+            heap_info_t& info(shard.heaps.editValueAt(i));
+            BpMemoryHeap const* h =
+                    static_cast<BpMemoryHeap const*>(info.heap.get());
+            if (info.count == 0) {
+                // a retained mapping whose heap died
+                unretain_l(info);
+                rel.add(info.heap);
+                shard.heaps.removeItemsAt(i);
+            } else if (android_atomic_dec(&info.count) == 1) {
                 ALOGD_IF(VERBOSE,
                         "removing binder=%p, heap=%p, size=%d, fd=%d, count=%d",
                         binder.unsafe_get(), info.heap.get(),
-                        static_cast<BpMemoryHeap*>(info.heap.get())->mSize,
-                        static_cast<BpMemoryHeap*>(info.heap.get())->mHeapId,
-                        info.count);
-                rel = mHeapCache.valueAt(i).heap;
-                mHeapCache.removeItemsAt(i);
+                        h->mSize, h->mHeapId, info.count);
+                if (android_atomic_acquire_load(&mRetainMs) > 0 &&
+                        h->mHeapId != -1 && int32_t(h->mSize) <=
+                                android_atomic_acquire_load(&mRetainBytes)) {
+                    retain_l(info, now);
+                } else {
+                    rel.add(info.heap);
+                    shard.heaps.removeItemsAt(i);
+                }
             }
         } else {
             ALOGE("free_heap binder=%p not found!!!", binder.unsafe_get());
         }
+        trim_l(shard, now, &rel);
     }
+    trim_all(systemTime(SYSTEM_TIME_MONOTONIC));
 }
 
 sp<IMemoryHeap> HeapCache::get_heap(const sp<IBinder>& binder)
 {
     sp<IMemoryHeap> realHeap;
-    Mutex::Autolock _l(mHeapCacheLock);
-    ssize_t i = mHeapCache.indexOfKey(binder);
-    if (i>=0)   realHeap = mHeapCache.valueAt(i).heap;
+    shard_t& shard(shard_for(binder));
+    Mutex::Autolock _l(shard.lock);
+    ssize_t i = shard.heaps.indexOfKey(binder);
+    if (i>=0)   realHeap = shard.heaps.valueAt(i).heap;
     else        realHeap = interface_cast<IMemoryHeap>(binder);
     return realHeap;
 }
 
 void HeapCache::dump_heaps()
 {
-    Mutex::Autolock _l(mHeapCacheLock);
-    int c = mHeapCache.size();
-    for (int i=0 ; i<c ; i++) {
-        const heap_info_t& info = mHeapCache.valueAt(i);
-        BpMemoryHeap const* h(static_cast<BpMemoryHeap const *>(info.heap.get()));
-        ALOGD("hey=%p, heap=%p, count=%d, (fd=%d, base=%p, size=%d)",
-                mHeapCache.keyAt(i).unsafe_get(),
-                info.heap.get(), info.count,
-                h->mHeapId, h->mBase, h->mSize);
+    ALOGD("retained=%d bytes (max %d bytes for %d ms)",
+            android_atomic_acquire_load(&mRetainedBytes),
+            android_atomic_acquire_load(&mRetainBytes),
+            android_atomic_acquire_load(&mRetainMs));
+    for (size_t s=0 ; s<NUM_SHARDS ; s++) {
+        shard_t& shard(mShards[s]);
+        Mutex::Autolock _l(shard.lock);
+        int c = shard.heaps.size();
+        for (int i=0 ; i<c ; i++) {
+            const heap_info_t& info = shard.heaps.valueAt(i);
+            BpMemoryHeap const* h(static_cast<BpMemoryHeap const *>(info.heap.get()));
+            ALOGD("hey=%p, heap=%p, count=%d, (fd=%d, base=%p, size=%d)%s",
+                    shard.heaps.keyAt(i).unsafe_get(),
+                    info.heap.get(), info.count,
+                    h->mHeapId, h->mBase, h->mSize,
+                    info.count ? "" : " retained");
+        }
     }
 }
 
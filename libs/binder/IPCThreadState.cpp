@@ -21,11 +21,14 @@
 #include <binder/Binder.h>
 #include <binder/BpBinder.h>
 #include <cutils/sched_policy.h>
+#include <utils/Atomic.h>
 #include <utils/Debug.h>
 #include <utils/Log.h>
+#include <utils/Profiler.h>
 #include <utils/TextOutput.h>
 #include <utils/threads.h>
 
+#include <private/binder/BinderStats.h>
 #include <private/binder/binder_module.h>
 #include <private/binder/Static.h>
 
@@ -295,6 +298,10 @@ static pthread_key_t gTLS = 0;
 static bool gShutdown = false;
 static bool gDisableBackgroundScheduling = false;
 
+// bounds of a batch of one-way calls, see setOneWayBatching()
+static const size_t MAX_BATCHED_TRANSACTIONS = 16;
+static const nsecs_t MAX_BATCH_DELAY = 2000000;    // 2 ms
+
 IPCThreadState* IPCThreadState::self()
 {
     if (gHaveTLS) {
@@ -414,9 +421,77 @@ void IPCThreadState::flushCommands()
 {
     if (mProcess->mDriverFD <= 0)
         return;
+    if (!mBatchedData.isEmpty()) {
+        flushOneWayBatch();
+    }
     talkWithDriver(false);
 }
 
+void IPCThreadState::setOneWayBatching(bool enabled)
+{
+    mOneWayBatching = enabled;
+    if (!enabled && !mBatchedData.isEmpty()) {
+        flushOneWayBatch();
+    }
+}
+
+status_t IPCThreadState::flushOneWayBatch()
+{
+    // the batch is detached first, in case a command processed while
+    // waiting sends one-way calls of its own
+    Vector<Parcel*> batch(mBatchedData);
+    mBatchedData.clear();
+
+    // each batched call gets its own BR_TRANSACTION_COMPLETE (or error),
+    // all of them are usually read back by the first round-trip
+    status_t result = NO_ERROR;
+    const size_t count = batch.size();
+    for (size_t i=0 ; i<count ; i++) {
+        const status_t err = waitForResponse(NULL, NULL);
+        if (err != NO_ERROR && result == NO_ERROR) {
+            result = err;
+        }
+    }
+    for (size_t i=0 ; i<count ; i++) {
+        delete batch[i];
+    }
+    return result;
+}
+
+status_t IPCThreadState::queueOneWayTransaction(int32_t handle,
+        uint32_t code, const Parcel& data, uint32_t flags)
+{
+    if (!mBatchedData.isEmpty() && handle != mBatchHandle) {
+        flushOneWayBatch();
+    }
+
+    // the caller's parcel goes away when we return, the driver reads
+    // the data only when the batch is sent
+    Parcel* copy = new Parcel;
+    status_t err = copy->appendFrom(&data, 0, data.dataSize());
+    if (err == NO_ERROR) {
+        err = writeTransactionData(BC_TRANSACTION, flags, handle, code,
+                *copy, NULL);
+    }
+    if (err != NO_ERROR) {
+        delete copy;
+        return err;
+    }
+
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (mBatchedData.isEmpty()) {
+        mBatchHandle = handle;
+        mBatchStartTime = now;
+    }
+    mBatchedData.add(copy);
+
+    if (mBatchedData.size() >= MAX_BATCHED_TRANSACTIONS ||
+            now - mBatchStartTime >= MAX_BATCH_DELAY) {
+        return flushOneWayBatch();
+    }
+    return NO_ERROR;
+}
+
 void IPCThreadState::joinThreadPool(bool isMain)
 {
     LOG_THREADPOOL("**** THREAD %p (PID %d) IS JOINING THE THREAD POOL\n", (void*)pthread_self(), getpid());
@@ -427,13 +502,18 @@ void IPCThreadState::joinThreadPool(bool isMain)
     // scheduling group, so first we will make sure it is in the foreground
     // one to avoid performing an initial transaction in the background.
     set_sched_policy(mMyThreadId, SP_FOREGROUND);
+
+    mProcess->pooledThreadEntered();
+    const nsecs_t idleTimeout = isMain ? 0 : mProcess->getThreadPoolIdleTimeout();
+    bool reaped = false;
         
     status_t result;
     do {
         int32_t cmd;
         
         // When we've cleared the incoming command queue, process any pending derefs
-        if (mIn.dataPosition() >= mIn.dataSize()) {
+        const bool willWait = mIn.dataPosition() >= mIn.dataSize();
+        if (willWait) {
             size_t numPending = mPendingWeakDerefs.size();
             if (numPending > 0) {
                 for (size_t i = 0; i < numPending; i++) {
@@ -451,9 +531,23 @@ void IPCThreadState::joinThreadPool(bool isMain)
                 }
                 mPendingStrongDerefs.clear();
             }
+
+            // calls batched while executing the last command are sent
+            // before waiting
+            if (!mBatchedData.isEmpty()) {
+                flushOneWayBatch();
+            }
+
+            if (reaped) {
+                // this thread was idle for too long and now has nothing
+                // left to do
+                break;
+            }
         }
 
         // now get the next command to be processed, waiting if necessary
+        const nsecs_t waitStart = (idleTimeout && willWait) ?
+                systemTime(SYSTEM_TIME_MONOTONIC) : 0;
         result = talkWithDriver();
         if (result >= NO_ERROR) {
             size_t IN = mIn.dataAvail();
@@ -464,8 +558,18 @@ void IPCThreadState::joinThreadPool(bool isMain)
                     << getReturnString(cmd) << endl;
             }
 
+            if (waitStart) {
+                reaped = mProcess->reapIdlePooledThread(
+                        systemTime(SYSTEM_TIME_MONOTONIC) - waitStart);
+            }
 
+            const int32_t busy = android_atomic_inc(&mProcess->mBusyThreads) + 1;
+            if (busy > mProcess->mMaxBusyThreads) {
+                // high-water mark, races are harmless
+                mProcess->mMaxBusyThreads = busy;
+            }
             result = executeCommand(cmd);
+            android_atomic_dec(&mProcess->mBusyThreads);
         }
         
         // After executing the command, ensure that the thread is returned to the
@@ -487,6 +591,7 @@ void IPCThreadState::joinThreadPool(bool isMain)
     LOG_THREADPOOL("**** THREAD %p (PID %d) IS LEAVING THE THREAD POOL err=%p\n",
         (void*)pthread_self(), getpid(), (void*)result);
     
+    mProcess->pooledThreadExited(reaped);
     mOut.writeInt32(BC_EXIT_LOOPER);
     talkWithDriver(false);
 }
@@ -501,11 +606,29 @@ void IPCThreadState::stopProcess(bool immediate)
     //kill(getpid(), SIGKILL);
 }
 
+// returns the interface descriptor written by writeInterfaceToken(), if
+// the transaction has one
+static String16 peekInterfaceDescriptor(const Parcel& data, uint32_t code)
+{
+    if (code < IBinder::FIRST_CALL_TRANSACTION ||
+            code > IBinder::LAST_CALL_TRANSACTION) {
+        return String16();
+    }
+    const size_t pos = data.dataPosition();
+    data.setDataPosition(0);
+    data.readInt32();   // strict mode policy
+    String16 descriptor(data.readString16());
+    data.setDataPosition(pos);
+    return descriptor;
+}
+
 status_t IPCThreadState::transact(int32_t handle,
                                   uint32_t code, const Parcel& data,
                                   Parcel* reply, uint32_t flags)
 {
     status_t err = data.errorCheck();
+    const nsecs_t statsStart = BinderStats::isEnabled() ?
+            systemTime(SYSTEM_TIME_MONOTONIC) : 0;
 
     flags |= TF_ACCEPT_FDS;
 
@@ -516,10 +639,18 @@ status_t IPCThreadState::transact(int32_t handle,
             << indent << data << dedent << endl;
     }
     
+    const bool batched = (flags & TF_ONE_WAY) && mOneWayBatching;
     if (err == NO_ERROR) {
         LOG_ONEWAY(">>>> SEND from pid %d uid %d %s", getpid(), getuid(),
             (flags & TF_ONE_WAY) == 0 ? "READ REPLY" : "ONE WAY");
-        err = writeTransactionData(BC_TRANSACTION, flags, handle, code, data, NULL);
+        if (batched) {
+            err = queueOneWayTransaction(handle, code, data, flags);
+        } else {
+            if (CC_UNLIKELY(!mBatchedData.isEmpty())) {
+                flushOneWayBatch();
+            }
+            err = writeTransactionData(BC_TRANSACTION, flags, handle, code, data, NULL);
+        }
     }
     
     if (err != NO_ERROR) {
@@ -527,7 +658,9 @@ status_t IPCThreadState::transact(int32_t handle,
         return (mLastError = err);
     }
     
-    if ((flags & TF_ONE_WAY) == 0) {
+    if (batched) {
+        // sent with the rest of the batch
+    } else if ((flags & TF_ONE_WAY) == 0) {
         #if 0
         if (code == 4) { // relayout
             ALOGI(">>>>>> CALLING transaction 4");
@@ -559,6 +692,13 @@ status_t IPCThreadState::transact(int32_t handle,
     } else {
         err = waitForResponse(NULL, NULL);
     }
+
+    if (CC_UNLIKELY(statsStart)) {
+        BinderStats::record(BinderStats::OUTGOING,
+                peekInterfaceDescriptor(data, code), code, data.ipcDataSize(),
+                reply ? reply->ipcDataSize() : 0,
+                systemTime(SYSTEM_TIME_MONOTONIC) - statsStart);
+    }
     
     return err;
 }
@@ -594,6 +734,9 @@ void IPCThreadState::decWeakHandle(int32_t handle)
 status_t IPCThreadState::attemptIncStrongHandle(int32_t handle)
 {
     LOG_REMOTEREFS("IPCThreadState::attemptIncStrongHandle(%d)\n", handle);
+    if (!mBatchedData.isEmpty()) {
+        flushOneWayBatch();
+    }
     mOut.writeInt32(BC_ATTEMPT_ACQUIRE);
     mOut.writeInt32(0); // xxx was thread priority
     mOut.writeInt32(handle);
@@ -637,7 +780,10 @@ IPCThreadState::IPCThreadState()
     : mProcess(ProcessState::self()),
       mMyThreadId(androidGetTid()),
       mStrictModePolicy(0),
-      mLastTransactionBinderFlags(0)
+      mLastTransactionBinderFlags(0),
+      mOneWayBatching(false),
+      mBatchHandle(0),
+      mBatchStartTime(0)
 {
     pthread_setspecific(gTLS, this);
     clearCaller();
@@ -647,12 +793,19 @@ IPCThreadState::IPCThreadState()
 
 IPCThreadState::~IPCThreadState()
 {
+    // only left if the driver went away before they could be sent
+    for (size_t i=0 ; i<mBatchedData.size() ; i++) {
+        delete mBatchedData[i];
+    }
 }
 
 status_t IPCThreadState::sendReply(const Parcel& reply, uint32_t flags)
 {
     status_t err;
     status_t statusBuffer;
+    if (CC_UNLIKELY(!mBatchedData.isEmpty())) {
+        flushOneWayBatch();
+    }
     err = writeTransactionData(BC_REPLY, flags, -1, 0, reply, &statusBuffer);
     if (err < NO_ERROR) return err;
     
@@ -705,6 +858,7 @@ status_t IPCThreadState::waitForResponse(Parcel *reply, status_t *acquireResult)
                 err = mIn.read(&tr, sizeof(tr));
                 ALOG_ASSERT(err == NO_ERROR, "Not enough command data for brREPLY");
                 if (err != NO_ERROR) goto finish;
+                mProcess->transactionBufferReceived(tr.data_size, tr.offsets_size);
 
                 if (reply) {
                     if ((tr.flags & TF_STATUS_CODE) == 0) {
@@ -895,6 +1049,7 @@ void setTheContextObject(sp<BBinder> obj)
 
 status_t IPCThreadState::executeCommand(int32_t cmd)
 {
+    PROFILE_SCOPE("binder", "executeCommand");
     BBinder* obj;
     RefBase::weakref_type* refs;
     status_t result = NO_ERROR;
@@ -979,6 +1134,7 @@ status_t IPCThreadState::executeCommand(int32_t cmd)
             ALOG_ASSERT(result == NO_ERROR,
                 "Not enough command data for brTRANSACTION");
             if (result != NO_ERROR) break;
+            mProcess->transactionBufferReceived(tr.data_size, tr.offsets_size);
             
             Parcel buffer;
             buffer.ipcSetDataReference(
@@ -1027,6 +1183,8 @@ status_t IPCThreadState::executeCommand(int32_t cmd)
                     << ", offsets addr="
                     << reinterpret_cast<const size_t*>(tr.data.ptr.offsets) << endl;
             }
+            const nsecs_t statsStart = BinderStats::isEnabled() ?
+                    systemTime(SYSTEM_TIME_MONOTONIC) : 0;
             if (tr.target.ptr) {
                 sp<BBinder> b((BBinder*)tr.cookie);
                 const status_t error = b->transact(tr.code, buffer, &reply, tr.flags);
@@ -1036,6 +1194,13 @@ status_t IPCThreadState::executeCommand(int32_t cmd)
                 const status_t error = the_context_object->transact(tr.code, buffer, &reply, tr.flags);
                 if (error < NO_ERROR) reply.setError(error);
             }
+
+            if (CC_UNLIKELY(statsStart)) {
+                BinderStats::record(BinderStats::INCOMING,
+                        peekInterfaceDescriptor(buffer, tr.code), tr.code,
+                        buffer.ipcDataSize(), reply.ipcDataSize(),
+                        systemTime(SYSTEM_TIME_MONOTONIC) - statsStart);
+            }
             
             //ALOGI("<<<< TRANSACT from pid %d restore pid %d uid %d\n",
             //     mCallingPid, origPid, origUid);
@@ -1123,6 +1288,7 @@ void IPCThreadState::freeBuffer(Parcel* parcel, const uint8_t* data, size_t data
     ALOG_ASSERT(data != NULL, "Called with NULL data");
     if (parcel != NULL) parcel->closeFileDescriptors();
     IPCThreadState* state = self();
+    state->mProcess->transactionBufferFreed(dataSize, objectsSize*sizeof(size_t));
     state->mOut.writeInt32(BC_FREE_BUFFER);
     state->mOut.writeInt32((int32_t)data);
 }
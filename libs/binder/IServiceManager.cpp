@@ -23,7 +23,9 @@
 #include <binder/IPCThreadState.h>
 #include <binder/Parcel.h>
 #include <utils/String8.h>
+#include <utils/KeyedVector.h>
 #include <utils/SystemClock.h>
+#include <utils/Timers.h>
 
 #include <private/binder/Static.h>
 
@@ -122,33 +124,119 @@ bool checkPermission(const String16& permission, pid_t pid, uid_t uid)
 
 // ----------------------------------------------------------------------
 
+// polls checkService() with a growing delay, so that a service registered
+// shortly after is found without waiting for a whole second
+static sp<IBinder> waitForServiceWithBackoff(const IServiceManager* sm,
+        const String16& name, nsecs_t timeout)
+{
+    const nsecs_t MIN_DELAY = ms2ns(5);
+    const nsecs_t MAX_DELAY = ms2ns(500);
+    const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    nsecs_t delay = MIN_DELAY;
+    for (;;) {
+        sp<IBinder> svc = sm->checkService(name);
+        if (svc != NULL) return svc;
+        const nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+        if (elapsed >= timeout) break;
+        if (delay == MIN_DELAY) {
+            ALOGI("Waiting for service %s...\n", String8(name).string());
+        }
+        const nsecs_t remaining = timeout - elapsed;
+        usleep(ns2us(delay < remaining ? delay : remaining));
+        delay = (delay * 2 < MAX_DELAY) ? delay * 2 : MAX_DELAY;
+    }
+    return NULL;
+}
+
+sp<IBinder> waitForService(const String16& name, nsecs_t timeout)
+{
+    const sp<IServiceManager> sm = defaultServiceManager();
+    if (sm == NULL) {
+        return NULL;
+    }
+    return waitForServiceWithBackoff(sm.get(), name, timeout);
+}
+
+// ----------------------------------------------------------------------
+
+/*
+ * The services this process looked up, forgotten when they die. A service
+ * registered again under the same name without dying first is not seen
+ * until then.
+ */
+class ServiceCache : public IBinder::DeathRecipient
+{
+public:
+    sp<IBinder> get(const String16& name) {
+        Mutex::Autolock _l(mLock);
+        ssize_t index = mServices.indexOfKey(name);
+        if (index < 0) {
+            return NULL;
+        }
+        const sp<IBinder>& svc(mServices.valueAt(index));
+        if (svc->remoteBinder() != NULL && !svc->isBinderAlive()) {
+            mServices.removeItemsAt(index);
+            return NULL;
+        }
+        return svc;
+    }
+
+    void add(const String16& name, const sp<IBinder>& svc) {
+        if (svc->remoteBinder() != NULL &&
+                svc->linkToDeath(this) != NO_ERROR) {
+            // it's already dead
+            return;
+        }
+        Mutex::Autolock _l(mLock);
+        mServices.add(name, svc);
+    }
+
+private:
+    virtual void binderDied(const wp<IBinder>& who) {
+        Mutex::Autolock _l(mLock);
+        size_t i = mServices.size();
+        while (i--) {
+            if (mServices.valueAt(i) == who) {
+                mServices.removeItemsAt(i);
+            }
+        }
+    }
+
+    Mutex mLock;
+    KeyedVector<String16, sp<IBinder> > mServices;
+};
+
+// ----------------------------------------------------------------------
+
 class BpServiceManager : public BpInterface<IServiceManager>
 {
 public:
     BpServiceManager(const sp<IBinder>& impl)
-        : BpInterface<IServiceManager>(impl)
+        : BpInterface<IServiceManager>(impl),
+          mCache(new ServiceCache)
     {
     }
 
     virtual sp<IBinder> getService(const String16& name) const
     {
-        unsigned n;
-        for (n = 0; n < 5; n++){
-            sp<IBinder> svc = checkService(name);
-            if (svc != NULL) return svc;
-            ALOGI("Waiting for service %s...\n", String8(name).string());
-            sleep(1);
-        }
-        return NULL;
+        return waitForServiceWithBackoff(this, name, s2ns(5));
     }
 
     virtual sp<IBinder> checkService( const String16& name) const
     {
+        sp<IBinder> svc(mCache->get(name));
+        if (svc != NULL) {
+            return svc;
+        }
         Parcel data, reply;
         data.writeInterfaceToken(IServiceManager::getInterfaceDescriptor());
         data.writeString16(name);
         remote()->transact(CHECK_SERVICE_TRANSACTION, data, &reply);
-        return reply.readStrongBinder();
+        svc = reply.readStrongBinder();
+        if (svc != NULL) {
+            mCache->add(name, svc);
+        }
+        return svc;
     }
 
     virtual status_t addService(const String16& name, const sp<IBinder>& service,
@@ -179,6 +267,9 @@ public:
         }
         return res;
     }
+
+private:
+    const sp<ServiceCache> mCache;
 };
 
 IMPLEMENT_META_INTERFACE(ServiceManager, "android.os.IServiceManager");
@@ -20,6 +20,7 @@
 #include <binder/IPCThreadState.h>
 #include <binder/MemoryBase.h>
 
+#include <utils/BasicHashtable.h>
 #include <utils/Log.h>
 #include <utils/SortedVector.h>
 #include <utils/String8.h>
@@ -126,7 +127,7 @@ class SimpleBestFitAllocator
         PAGE_ALIGNED = 0x00000001
     };
 public:
-    SimpleBestFitAllocator(size_t size);
+    SimpleBestFitAllocator(size_t size, uint32_t flags = 0);
     ~SimpleBestFitAllocator();
 
     size_t      allocate(size_t size, uint32_t flags = 0);
@@ -139,24 +140,44 @@ private:
 
     struct chunk_t {
         chunk_t(size_t start, size_t size)
-        : start(start), size(size), free(1), prev(0), next(0) {
+        : start(start), size(size), free(1), prev(0), next(0),
+          freePrev(0), freeNext(0) {
         }
         size_t              start;
         size_t              size : 28;
         int                 free : 4;
         mutable chunk_t*    prev;
         mutable chunk_t*    next;
+        // links in the free list of the chunk's size class
+        chunk_t*            freePrev;
+        chunk_t*            freeNext;
     };
 
+    // free chunks are kept in one list per power of two of their size
+    // (in kMemoryAlign units); chunk sizes are 28 bits wide
+    enum { NUM_BINS = 28 };
+
+    // allocated chunks, by start (in kMemoryAlign units)
+    typedef key_value_pair_t<uint32_t, chunk_t*> busy_t;
+
     ssize_t  alloc(size_t size, uint32_t flags);
     chunk_t* dealloc(size_t start);
+    chunk_t* findBestFit(size_t size, uint32_t flags) const;
+    chunk_t* findSegregatedFit(size_t size) const;
+    void     insertFree(chunk_t* chunk);
+    void     removeFree(chunk_t* chunk);
     void     dump_l(const char* what) const;
     void     dump_l(String8& res, const char* what) const;
 
+    static size_t binFor(size_t size);
+
     static const int    kMemoryAlign;
     mutable Mutex       mLock;
     LinkedList<chunk_t> mList;
+    chunk_t*            mBins[NUM_BINS];
+    BasicHashtable<uint32_t, busy_t> mBusy;
     size_t              mHeapSize;
+    const uint32_t      mFlags;
 };
 
 // ----------------------------------------------------------------------------
@@ -225,9 +246,9 @@ Allocation::~Allocation()
 
 // ----------------------------------------------------------------------------
 
-MemoryDealer::MemoryDealer(size_t size, const char* name)
+MemoryDealer::MemoryDealer(size_t size, const char* name, uint32_t flags)
     : mHeap(new MemoryHeapBase(size, 0, name)),
-    mAllocator(new SimpleBestFitAllocator(size))
+    mAllocator(new SimpleBestFitAllocator(size, flags))
 {    
 }
 
@@ -269,13 +290,16 @@ SimpleBestFitAllocator* MemoryDealer::allocator() const {
 // align all the memory blocks on a cache-line boundary
 const int SimpleBestFitAllocator::kMemoryAlign = 32;
 
-SimpleBestFitAllocator::SimpleBestFitAllocator(size_t size)
+SimpleBestFitAllocator::SimpleBestFitAllocator(size_t size, uint32_t flags)
+    : mFlags(flags)
 {
     size_t pagesize = getpagesize();
     mHeapSize = ((size + pagesize-1) & ~(pagesize-1));
 
+    memset(mBins, 0, sizeof(mBins));
     chunk_t* node = new chunk_t(0, mHeapSize / kMemoryAlign);
     mList.insertHead(node);
+    insertFree(node);
 }
 
 SimpleBestFitAllocator::~SimpleBestFitAllocator()
@@ -307,14 +331,44 @@ status_t SimpleBestFitAllocator::deallocate(size_t offset)
     return NAME_NOT_FOUND;
 }
 
-ssize_t SimpleBestFitAllocator::alloc(size_t size, uint32_t flags)
+size_t SimpleBestFitAllocator::binFor(size_t size)
 {
-    if (size == 0) {
-        return 0;
+    size_t bin = 0;
+    while ((size >>= 1) && bin < NUM_BINS-1) {
+        bin++;
     }
-    size = (size + kMemoryAlign-1) / kMemoryAlign;
+    return bin;
+}
+
+void SimpleBestFitAllocator::insertFree(chunk_t* chunk)
+{
+    chunk_t*& head = mBins[binFor(chunk->size)];
+    chunk->freePrev = 0;
+    chunk->freeNext = head;
+    if (head) {
+        head->freePrev = chunk;
+    }
+    head = chunk;
+}
+
+void SimpleBestFitAllocator::removeFree(chunk_t* chunk)
+{
+    if (chunk->freePrev) {
+        chunk->freePrev->freeNext = chunk->freeNext;
+    } else {
+        mBins[binFor(chunk->size)] = chunk->freeNext;
+    }
+    if (chunk->freeNext) {
+        chunk->freeNext->freePrev = chunk->freePrev;
+    }
+    chunk->freePrev = chunk->freeNext = 0;
+}
+
+SimpleBestFitAllocator::chunk_t* SimpleBestFitAllocator::findBestFit(
+        size_t size, uint32_t flags) const
+{
     chunk_t* free_chunk = 0;
-    chunk_t* cur = mList.head();
+    chunk_t* cur = const_cast<chunk_t*>(mList.head());
 
     size_t pagesize = getpagesize();
     while (cur) {
@@ -333,8 +387,47 @@ ssize_t SimpleBestFitAllocator::alloc(size_t size, uint32_t flags)
         }
         cur = cur->next;
     }
+    return free_chunk;
+}
 
+SimpleBestFitAllocator::chunk_t* SimpleBestFitAllocator::findSegregatedFit(
+        size_t size) const
+{
+    // chunks in the size's own class may be too small, look for the
+    // first one that fits; any chunk of a larger class fits.
+    size_t bin = binFor(size);
+    for (chunk_t* cur = mBins[bin] ; cur ; cur = cur->freeNext) {
+        if (cur->size >= size) {
+            return cur;
+        }
+    }
+    for (bin++ ; bin < NUM_BINS ; bin++) {
+        if (mBins[bin]) {
+            return mBins[bin];
+        }
+    }
+    return 0;
+}
+
+ssize_t SimpleBestFitAllocator::alloc(size_t size, uint32_t flags)
+{
+    if (size == 0) {
+        return 0;
+    }
+    size = (size + kMemoryAlign-1) / kMemoryAlign;
+
+    // the free lists don't know about alignment, page aligned requests
+    // always search the whole heap
+    chunk_t* free_chunk;
+    if ((mFlags & MemoryDealer::SEGREGATED_FIT) && !(flags & PAGE_ALIGNED)) {
+        free_chunk = findSegregatedFit(size);
+    } else {
+        free_chunk = findBestFit(size, flags);
+    }
+
+    size_t pagesize = getpagesize();
     if (free_chunk) {
+        removeFree(free_chunk);
         const size_t free_size = free_chunk->size;
         free_chunk->free = 0;
         free_chunk->size = size;
@@ -346,6 +439,7 @@ ssize_t SimpleBestFitAllocator::alloc(size_t size, uint32_t flags)
                 chunk_t* split = new chunk_t(free_chunk->start, extra);
                 free_chunk->start += extra;
                 mList.insertBefore(free_chunk, split);
+                insertFree(split);
             }
 
             ALOGE_IF((flags&PAGE_ALIGNED) && 
@@ -357,8 +451,11 @@ ssize_t SimpleBestFitAllocator::alloc(size_t size, uint32_t flags)
                 chunk_t* split = new chunk_t(
                         free_chunk->start + free_chunk->size, tail_free);
                 mList.insertAfter(free_chunk, split);
+                insertFree(split);
             }
         }
+        const uint32_t start = free_chunk->start;
+        mBusy.add(hash_type(start), busy_t(start, free_chunk));
         return (free_chunk->start)*kMemoryAlign;
     }
     return NO_MEMORY;
@@ -366,43 +463,49 @@ ssize_t SimpleBestFitAllocator::alloc(size_t size, uint32_t flags)
 
 SimpleBestFitAllocator::chunk_t* SimpleBestFitAllocator::dealloc(size_t start)
 {
-    start = start / kMemoryAlign;
-    chunk_t* cur = mList.head();
-    while (cur) {
-        if (cur->start == start) {
-            LOG_FATAL_IF(cur->free,
-                "block at offset 0x%08lX of size 0x%08lX already freed",
-                cur->start*kMemoryAlign, cur->size*kMemoryAlign);
-
-            // merge freed blocks together
-            chunk_t* freed = cur;
-            cur->free = 1;
-            do {
-                chunk_t* const p = cur->prev;
-                chunk_t* const n = cur->next;
-                if (p && (p->free || !cur->size)) {
-                    freed = p;
-                    p->size += cur->size;
-                    mList.remove(cur);
-                    delete cur;
-                }
-                cur = n;
-            } while (cur && cur->free);
-
-            #ifndef NDEBUG
-                if (!freed->free) {
-                    dump_l("dealloc (!freed->free)");
-                }
-            #endif
-            LOG_FATAL_IF(!freed->free,
-                "freed block at offset 0x%08lX of size 0x%08lX is not free!",
-                freed->start * kMemoryAlign, freed->size * kMemoryAlign);
-
-            return freed;
-        }
-        cur = cur->next;
+    const uint32_t key = start / kMemoryAlign;
+    const ssize_t index = mBusy.find(-1, hash_type(key), key);
+    if (index < 0) {
+        return 0;
     }
-    return 0;
+    chunk_t* cur = mBusy.entryAt(index).value;
+    mBusy.removeAt(index);
+
+    LOG_FATAL_IF(cur->free,
+        "block at offset 0x%08lX of size 0x%08lX already freed",
+        cur->start*kMemoryAlign, cur->size*kMemoryAlign);
+
+    // merge freed blocks together; free blocks are never adjacent, so
+    // only the immediate neighbours need to be looked at
+    chunk_t* freed = cur;
+    cur->free = 1;
+    chunk_t* const p = cur->prev;
+    if (p && p->free) {
+        removeFree(p);
+        p->size += cur->size;
+        mList.remove(cur);
+        delete cur;
+        freed = p;
+    }
+    chunk_t* const n = freed->next;
+    if (n && n->free) {
+        removeFree(n);
+        freed->size += n->size;
+        mList.remove(n);
+        delete n;
+    }
+    insertFree(freed);
+
+    #ifndef NDEBUG
+        if (!freed->free) {
+            dump_l("dealloc (!freed->free)");
+        }
+    #endif
+    LOG_FATAL_IF(!freed->free,
+        "freed block at offset 0x%08lX of size 0x%08lX is not free!",
+        freed->start * kMemoryAlign, freed->size * kMemoryAlign);
+
+    return freed;
 }
 
 void SimpleBestFitAllocator::dump(const char* what) const
@@ -429,6 +532,9 @@ void SimpleBestFitAllocator::dump_l(String8& result,
         const char* what) const
 {
     size_t size = 0;
+    size_t freeSize = 0;
+    size_t largestFree = 0;
+    size_t freeChunks = 0;
     int32_t i = 0;
     chunk_t const* cur = mList.head();
     
@@ -453,8 +559,15 @@ void SimpleBestFitAllocator::dump_l(String8& result,
         
         result.append(buffer);
 
-        if (!cur->free)
+        if (!cur->free) {
             size += cur->size*kMemoryAlign;
+        } else {
+            const size_t chunkSize = cur->size*kMemoryAlign;
+            freeSize += chunkSize;
+            if (chunkSize > largestFree)
+                largestFree = chunkSize;
+            freeChunks++;
+        }
 
         i++;
         cur = cur->next;
@@ -462,6 +575,19 @@ void SimpleBestFitAllocator::dump_l(String8& result,
     snprintf(buffer, SIZE,
             "  size allocated: %u (%u KB)\n", int(size), int(size/1024));
     result.append(buffer);
+
+    // fragmentation is the part of the free memory that can't be
+    // handed out in a single allocation
+    const unsigned int fragmentation = freeSize ?
+            (unsigned int)(100 - (largestFree * 100) / freeSize) : 0;
+    snprintf(buffer, SIZE,
+            "  size free: %u (%u KB) in %u chunks, largest: %u (%u KB), "
+            "fragmentation: %u%%, %s\n",
+            int(freeSize), int(freeSize/1024), int(freeChunks),
+            int(largestFree), int(largestFree/1024), fragmentation,
+            (mFlags & MemoryDealer::SEGREGATED_FIT) ?
+                    "segregated fit" : "best fit");
+    result.append(buffer);
 }
 
 
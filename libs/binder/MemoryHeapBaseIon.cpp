@@ -25,8 +25,10 @@
  * Initial version
  */
 
+#include <errno.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/types.h>
@@ -49,7 +51,10 @@ MemoryHeapBaseIon::MemoryHeapBaseIon(size_t size, uint32_t flags, char const *na
         ALOGE("MemoryHeapBaseIon : ION client creation failed");
     }
     void* base = NULL;
-    int fd = ion_alloc(mIonClient, size, 0, ION_HEAP_EXYNOS_MASK);
+    unsigned int ionFlags = ION_HEAP_EXYNOS_MASK;
+    if (flags & NO_CACHING)
+        ionFlags |= ION_EXYNOS_NONCACHE_MASK;
+    int fd = ion_alloc(mIonClient, size, 0, ionFlags);
 
     if (fd < 0) {
         ALOGE("MemoryHeapBaseIon : ION memory allocation failed");
@@ -93,4 +98,30 @@ MemoryHeapBaseIon::~MemoryHeapBaseIon()
     }
 }
 
+status_t MemoryHeapBaseIon::flushCache(size_t offset, size_t size) const
+{
+    return syncCache(offset, size, IMSYNC_DEV_TO_READ | IMSYNC_SYNC_FOR_DEV);
+}
+
+status_t MemoryHeapBaseIon::invalidateCache(size_t offset, size_t size) const
+{
+    return syncCache(offset, size, IMSYNC_DEV_TO_WRITE | IMSYNC_SYNC_FOR_CPU);
+}
+
+status_t MemoryHeapBaseIon::syncCache(size_t offset, size_t size, long flags) const
+{
+    if (offset > getSize() || size > getSize() - offset)
+        return BAD_VALUE;
+    if (getFlags() & NO_CACHING)
+        return NO_ERROR;
+    if (mIonClient < 0 || getHeapID() < 0)
+        return NO_INIT;
+    if (ion_msync(mIonClient, getHeapID(), flags, size, offset) < 0) {
+        status_t err = -errno;
+        ALOGE("MemoryHeapBaseIon : cache sync failed (%s)", strerror(-err));
+        return err;
+    }
+    return NO_ERROR;
+}
+
 };
@@ -31,12 +31,15 @@
 #include <utils/misc.h>
 #include <utils/Flattenable.h>
 #include <cutils/ashmem.h>
+#include <cutils/atomic.h>
 
 #include <private/binder/binder_module.h>
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <sys/mman.h>
 
 #ifndef INT32_MAX
@@ -53,6 +56,10 @@
 // Note: must be kept in sync with android/os/StrictMode.java's PENALTY_GATHER
 #define STRICT_MODE_PENALTY_GATHER 0x100
 
+// Stored where the length of the interface name would be, which is never
+// negative but for a NULL string, when the RPC header holds a token.
+#define INTERFACE_TOKEN_MARKER -2
+
 // Note: must be kept in sync with android/os/Parcel.java's EX_HAS_REPLY_HEADER
 #define EX_HAS_REPLY_HEADER -128
 
@@ -283,6 +290,97 @@ status_t unflatten_binder(const sp<ProcessState>& proc,
 
 // ---------------------------------------------------------------------------
 
+// Heap data buffers released by the parcels of a thread, handed out again
+// to the next parcels of that thread needing one. This saves a malloc and
+// free per transaction for the reply parcels and the buffers IPCThreadState
+// goes through.
+struct DataBufferPool
+{
+    enum {
+        MAX_BUFFERS     = 4,
+        MAX_BUFFER_SIZE = 8 * 1024
+    };
+
+    size_t count;
+    void* buffers[MAX_BUFFERS];
+    size_t capacities[MAX_BUFFERS];
+};
+
+static pthread_key_t gDataBufferPoolKey;
+static pthread_once_t gDataBufferPoolOnce = PTHREAD_ONCE_INIT;
+static bool gDataBufferPoolKeyValid = false;
+
+static void destroyDataBufferPool(void* p)
+{
+    DataBufferPool* pool = static_cast<DataBufferPool*>(p);
+    for (size_t i=0 ; i<pool->count ; i++) {
+        free(pool->buffers[i]);
+    }
+    free(pool);
+}
+
+static void createDataBufferPoolKey()
+{
+    gDataBufferPoolKeyValid =
+            pthread_key_create(&gDataBufferPoolKey, destroyDataBufferPool) == 0;
+}
+
+static DataBufferPool* getDataBufferPool()
+{
+    pthread_once(&gDataBufferPoolOnce, createDataBufferPoolKey);
+    if (!gDataBufferPoolKeyValid) {
+        return NULL;
+    }
+    DataBufferPool* pool =
+            static_cast<DataBufferPool*>(pthread_getspecific(gDataBufferPoolKey));
+    if (pool == NULL) {
+        pool = static_cast<DataBufferPool*>(calloc(1, sizeof(DataBufferPool)));
+        if (pool && pthread_setspecific(gDataBufferPoolKey, pool) != 0) {
+            free(pool);
+            pool = NULL;
+        }
+    }
+    return pool;
+}
+
+static uint8_t* takePooledDataBuffer(size_t desired, size_t* outCapacity)
+{
+    if (desired > DataBufferPool::MAX_BUFFER_SIZE) {
+        return NULL;
+    }
+    DataBufferPool* pool = getDataBufferPool();
+    if (pool == NULL) {
+        return NULL;
+    }
+    for (size_t i=0 ; i<pool->count ; i++) {
+        if (pool->capacities[i] >= desired) {
+            uint8_t* data = static_cast<uint8_t*>(pool->buffers[i]);
+            *outCapacity = pool->capacities[i];
+            pool->count--;
+            pool->buffers[i] = pool->buffers[pool->count];
+            pool->capacities[i] = pool->capacities[pool->count];
+            return data;
+        }
+    }
+    return NULL;
+}
+
+static void givePooledDataBuffer(void* data, size_t capacity)
+{
+    if (capacity <= DataBufferPool::MAX_BUFFER_SIZE) {
+        DataBufferPool* pool = getDataBufferPool();
+        if (pool && pool->count < DataBufferPool::MAX_BUFFERS) {
+            pool->buffers[pool->count] = data;
+            pool->capacities[pool->count] = capacity;
+            pool->count++;
+            return;
+        }
+    }
+    free(data);
+}
+
+// ---------------------------------------------------------------------------
+
 Parcel::Parcel()
 {
     initState();
@@ -410,13 +508,13 @@ status_t Parcel::appendFrom(const Parcel *parcel, size_t offset, size_t len)
         // grow objects
         if (mObjectsCapacity < mObjectsSize + numObjects) {
             int newSize = ((mObjectsSize + numObjects)*3)/2;
-            size_t *objects =
-                (size_t*)realloc(mObjects, newSize*sizeof(size_t));
+            size_t capacity;
+            size_t *objects = reallocObjects(newSize, &capacity);
             if (objects == (size_t*)0) {
                 return NO_MEMORY;
             }
             mObjects = objects;
-            mObjectsCapacity = newSize;
+            mObjectsCapacity = capacity;
         }
         
         // append and acquire objects
@@ -478,6 +576,49 @@ status_t Parcel::writeInterfaceToken(const String16& interface)
     return writeString16(interface);
 }
 
+status_t Parcel::writeInterfaceToken(const String16& interface, IBinder* target)
+{
+    BpBinder* proxy = target != NULL ? target->remoteBinder() : NULL;
+    const int32_t token = proxy != NULL ? proxy->interfaceToken(interface) : 0;
+    if (token <= 0) {
+        return writeInterfaceToken(interface);
+    }
+    writeInt32(IPCThreadState::self()->getStrictModePolicy() |
+               STRICT_MODE_PENALTY_GATHER);
+    writeInt32(INTERFACE_TOKEN_MARKER);
+    return writeInt32(token);
+}
+
+// The interfaces tokens were handed out for, token - 1 being the index.
+// Entries are only ever appended, so looking a token up needs no lock.
+static const int32_t kMaxInterfaceTokens = 64;
+static Mutex gInterfaceTokenLock;
+static String16* gInterfaceTokens[kMaxInterfaceTokens];
+static volatile int32_t gInterfaceTokenCount = 0;
+
+int32_t Parcel::registerInterfaceToken(const String16& interface)
+{
+    Mutex::Autolock _l(gInterfaceTokenLock);
+    const int32_t count = gInterfaceTokenCount;
+    for (int32_t i = 0; i < count; i++) {
+        if (*gInterfaceTokens[i] == interface) {
+            return i + 1;
+        }
+    }
+    if (count == kMaxInterfaceTokens) {
+        return 0;
+    }
+    gInterfaceTokens[count] = new String16(interface);
+    android_atomic_release_store(count + 1, &gInterfaceTokenCount);
+    return count + 1;
+}
+
+static bool isInterfaceToken(int32_t token, const String16& interface)
+{
+    return token > 0 && token <= android_atomic_acquire_load(&gInterfaceTokenCount) &&
+            *gInterfaceTokens[token - 1] == interface;
+}
+
 bool Parcel::checkInterface(IBinder* binder) const
 {
     return enforceInterface(binder->getInterfaceDescriptor());
@@ -500,12 +641,27 @@ bool Parcel::enforceInterface(const String16& interface,
     } else {
       threadState->setStrictModePolicy(strictPolicy);
     }
-    const String16 str(readString16());
-    if (str == interface) {
+    // callers that negotiated a token send it instead of the name
+    if (dataAvail() >= 2 * sizeof(int32_t) &&
+            *reinterpret_cast<const int32_t*>(mData + mDataPos) == INTERFACE_TOKEN_MARKER) {
+        readInt32();
+        const int32_t token = readInt32();
+        if (isInterfaceToken(token, interface)) {
+            return true;
+        }
+        ALOGW("**** enforceInterface() expected '%s' but read token %d\n",
+                String8(interface).string(), token);
+        return false;
+    }
+    // compare in place, this is done for every incoming transaction
+    size_t len;
+    const char16_t* str = readString16Inplace(&len);
+    if (len == interface.size() &&
+            strzcmp16(str, len, interface.string(), len) == 0) {
         return true;
     } else {
         ALOGW("**** enforceInterface() expected '%s' but read '%s'\n",
-                String8(interface).string(), String8(str).string());
+                String8(interface).string(), String8(str, len).string());
         return false;
     }
 }
@@ -849,10 +1005,11 @@ restart_write:
     }
     if (!enoughObjects) {
         size_t newSize = ((mObjectsSize+2)*3)/2;
-        size_t* objects = (size_t*)realloc(mObjects, newSize*sizeof(size_t));
+        size_t capacity;
+        size_t* objects = reallocObjects(newSize, &capacity);
         if (objects == NULL) return NO_MEMORY;
         mObjects = objects;
-        mObjectsCapacity = newSize;
+        mObjectsCapacity = capacity;
     }
     
     goto restart_write;
@@ -1123,8 +1280,13 @@ status_t Parcel::readBlob(size_t len, ReadableBlob* outBlob) const
     int fd = readFileDescriptor();
     if (fd == int(BAD_TYPE)) return BAD_VALUE;
 
+    // the region must hold the whole blob, touching the mapping past its
+    // end would fault
+    int size = ashmem_get_size_region(fd);
+    if (size < 0 || size_t(size) < len) return BAD_VALUE;
+
     void* ptr = ::mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
-    if (!ptr) return NO_MEMORY;
+    if (ptr == MAP_FAILED) return NO_MEMORY;
 
     outBlob->init(true /*mapped*/, ptr, len);
     return NO_ERROR;
@@ -1345,8 +1507,85 @@ void Parcel::freeDataNoInit()
         mOwner(this, mData, mDataSize, mObjects, mObjectsSize, mOwnerCookie);
     } else {
         releaseObjects();
-        if (mData) free(mData);
-        if (mObjects) free(mObjects);
+        freeDataBuffer();
+        freeObjectsBuffer();
+    }
+}
+
+uint8_t* Parcel::allocData(size_t desired, size_t* outCapacity)
+{
+    if (desired <= INLINE_DATA_SIZE) {
+        *outCapacity = INLINE_DATA_SIZE;
+        return reinterpret_cast<uint8_t*>(mInlineData);
+    }
+    uint8_t* data = takePooledDataBuffer(desired, outCapacity);
+    if (data == NULL) {
+        data = (uint8_t*)malloc(desired);
+        *outCapacity = desired;
+    }
+    return data;
+}
+
+uint8_t* Parcel::reallocData(size_t desired, size_t* outCapacity)
+{
+    // must only be called when we own mData
+    if (mData == NULL || mData == reinterpret_cast<uint8_t*>(mInlineData)) {
+        uint8_t* data = allocData(desired, outCapacity);
+        if (data && mData && data != mData) {
+            memcpy(data, mData, mDataSize < desired ? mDataSize : desired);
+        }
+        return data;
+    }
+    if (desired == 0) {
+        // realloc() would free the buffer
+        *outCapacity = mDataCapacity;
+        return mData;
+    }
+    uint8_t* data = (uint8_t*)realloc(mData, desired);
+    *outCapacity = desired;
+    return data;
+}
+
+void Parcel::freeDataBuffer()
+{
+    if (mData && mData != reinterpret_cast<uint8_t*>(mInlineData)) {
+        givePooledDataBuffer(mData, mDataCapacity);
+    }
+}
+
+size_t* Parcel::allocObjects(size_t count, size_t* outCapacity)
+{
+    if (count <= INLINE_OBJECTS) {
+        *outCapacity = INLINE_OBJECTS;
+        return mInlineObjects;
+    }
+    *outCapacity = count;
+    return (size_t*)malloc(count*sizeof(size_t));
+}
+
+size_t* Parcel::reallocObjects(size_t count, size_t* outCapacity)
+{
+    // must only be called when we own mObjects
+    if (mObjects == NULL || mObjects == mInlineObjects) {
+        size_t* objects = allocObjects(count, outCapacity);
+        if (objects && mObjects && objects != mObjects) {
+            memcpy(objects, mObjects,
+                    (mObjectsSize < count ? mObjectsSize : count)*sizeof(size_t));
+        }
+        return objects;
+    }
+    if (count <= mObjectsCapacity) {
+        *outCapacity = mObjectsCapacity;
+        return mObjects;
+    }
+    *outCapacity = count;
+    return (size_t*)realloc(mObjects, count*sizeof(size_t));
+}
+
+void Parcel::freeObjectsBuffer()
+{
+    if (mObjects && mObjects != mInlineObjects) {
+        free(mObjects);
     }
 }
 
@@ -1365,7 +1604,8 @@ status_t Parcel::restartWrite(size_t desired)
         return continueWrite(desired);
     }
     
-    uint8_t* data = (uint8_t*)realloc(mData, desired);
+    size_t capacity;
+    uint8_t* data = reallocData(desired, &capacity);
     if (!data && desired > mDataCapacity) {
         mError = NO_MEMORY;
         return NO_MEMORY;
@@ -1375,14 +1615,14 @@ status_t Parcel::restartWrite(size_t desired)
     
     if (data) {
         mData = data;
-        mDataCapacity = desired;
+        mDataCapacity = capacity;
     }
     
     mDataSize = mDataPos = 0;
     ALOGV("restartWrite Setting data size of %p to %d\n", this, mDataSize);
     ALOGV("restartWrite Setting data pos of %p to %d\n", this, mDataPos);
         
-    free(mObjects);
+    freeObjectsBuffer();
     mObjects = NULL;
     mObjectsSize = mObjectsCapacity = 0;
     mNextObjectHint = 0;
@@ -1419,17 +1659,21 @@ status_t Parcel::continueWrite(size_t desired)
 
         // If there is a different owner, we need to take
         // posession.
-        uint8_t* data = (uint8_t*)malloc(desired);
+        size_t dataCapacity;
+        uint8_t* data = allocData(desired, &dataCapacity);
         if (!data) {
             mError = NO_MEMORY;
             return NO_MEMORY;
         }
         size_t* objects = NULL;
+        size_t objectsCapacity = 0;
         
         if (objectsSize) {
-            objects = (size_t*)malloc(objectsSize*sizeof(size_t));
+            objects = allocObjects(objectsSize, &objectsCapacity);
             if (!objects) {
-                free(data);
+                if (data != reinterpret_cast<uint8_t*>(mInlineData)) {
+                    givePooledDataBuffer(data, dataCapacity);
+                }
 
                 mError = NO_MEMORY;
                 return NO_MEMORY;
@@ -1457,8 +1701,9 @@ status_t Parcel::continueWrite(size_t desired)
         mObjects = objects;
         mDataSize = (mDataSize < desired) ? mDataSize : desired;
         ALOGV("continueWrite Setting data size of %p to %d\n", this, mDataSize);
-        mDataCapacity = desired;
-        mObjectsSize = mObjectsCapacity = objectsSize;
+        mDataCapacity = dataCapacity;
+        mObjectsSize = objectsSize;
+        mObjectsCapacity = objectsCapacity;
         mNextObjectHint = 0;
 
     } else if (mData) {
@@ -1474,21 +1719,17 @@ status_t Parcel::continueWrite(size_t desired)
                 }
                 release_object(proc, *flat, this);
             }
-            size_t* objects =
-                (size_t*)realloc(mObjects, objectsSize*sizeof(size_t));
-            if (objects) {
-                mObjects = objects;
-            }
             mObjectsSize = objectsSize;
             mNextObjectHint = 0;
         }
 
-        // We own the data, so we can just do a realloc().
+        // We own the data, so we can just grow it in place.
         if (desired > mDataCapacity) {
-            uint8_t* data = (uint8_t*)realloc(mData, desired);
+            size_t capacity;
+            uint8_t* data = reallocData(desired, &capacity);
             if (data) {
                 mData = data;
-                mDataCapacity = desired;
+                mDataCapacity = capacity;
             } else if (desired > mDataCapacity) {
                 mError = NO_MEMORY;
                 return NO_MEMORY;
@@ -1506,7 +1747,8 @@ status_t Parcel::continueWrite(size_t desired)
         
     } else {
         // This is the first data.  Easy!
-        uint8_t* data = (uint8_t*)malloc(desired);
+        size_t capacity;
+        uint8_t* data = allocData(desired, &capacity);
         if (!data) {
             mError = NO_MEMORY;
             return NO_MEMORY;
@@ -1521,7 +1763,7 @@ status_t Parcel::continueWrite(size_t desired)
         mDataSize = mDataPos = 0;
         ALOGV("continueWrite Setting data size of %p to %d\n", this, mDataSize);
         ALOGV("continueWrite Setting data pos of %p to %d\n", this, mDataPos);
-        mDataCapacity = desired;
+        mDataCapacity = capacity;
     }
 
     return NO_ERROR;
@@ -29,31 +29,43 @@ namespace android {
 
 ANDROID_SINGLETON_STATIC_INSTANCE(PermissionCache) ;
 
+// how long a denial is cached
+static const nsecs_t DENIAL_TTL = 10000000000LL;    // 10 s
+
 // ----------------------------------------------------------------------------
 
-PermissionCache::PermissionCache() {
+PermissionCache::PermissionCache()
+    : mHits(0), mMisses(0), mExpired(0) {
 }
 
 status_t PermissionCache::check(bool* granted,
         const String16& permission, uid_t uid) const {
-    Mutex::Autolock _l(mLock);
+    ScalableRWLock::AutoRLock _l(mLock);
     Entry e;
     e.name = permission;
     e.uid  = uid;
     ssize_t index = mCache.indexOf(e);
     if (index >= 0) {
-        *granted = mCache.itemAt(index).granted;
-        return NO_ERROR;
+        const Entry& cached(mCache.itemAt(index));
+        if (cached.expires == 0 ||
+                systemTime(SYSTEM_TIME_MONOTONIC) < cached.expires) {
+            *granted = cached.granted;
+            android_atomic_inc(&mHits);
+            return NO_ERROR;
+        }
+        // cache() will replace the entry
+        android_atomic_inc(&mExpired);
     }
+    android_atomic_inc(&mMisses);
     return NAME_NOT_FOUND;
 }
 
 void PermissionCache::cache(const String16& permission,
         uid_t uid, bool granted) {
-    Mutex::Autolock _l(mLock);
+    ScalableRWLock::AutoWLock _l(mLock);
     Entry e;
     ssize_t index = mPermissionNamesPool.indexOf(permission);
-    if (index > 0) {
+    if (index >= 0) {
         e.name = mPermissionNamesPool.itemAt(index);
     } else {
         mPermissionNamesPool.add(permission);
@@ -63,15 +75,47 @@ void PermissionCache::cache(const String16& permission,
     // permission checks
     e.uid  = uid;
     e.granted = granted;
-    index = mCache.indexOf(e);
-    if (index < 0) {
-        mCache.add(e);
-    }
+    e.expires = granted ? 0 :
+            systemTime(SYSTEM_TIME_MONOTONIC) + DENIAL_TTL;
+    // replaces an expired entry
+    mCache.add(e);
 }
 
 void PermissionCache::purge() {
-    Mutex::Autolock _l(mLock);
-    mCache.clear();
+    PermissionCache& pc(PermissionCache::getInstance());
+    ScalableRWLock::AutoWLock _l(pc.mLock);
+    pc.mCache.clear();
+}
+
+void PermissionCache::purge(uid_t uid) {
+    PermissionCache& pc(PermissionCache::getInstance());
+    ScalableRWLock::AutoWLock _l(pc.mLock);
+    // entries are sorted by uid first
+    size_t i = 0;
+    while (i < pc.mCache.size() && pc.mCache[i].uid < uid) {
+        i++;
+    }
+    size_t n = 0;
+    while (i + n < pc.mCache.size() && pc.mCache[i + n].uid == uid) {
+        n++;
+    }
+    if (n) {
+        pc.mCache.removeItemsAt(i, n);
+    }
+}
+
+void PermissionCache::dump(String8& result) {
+    PermissionCache& pc(PermissionCache::getInstance());
+    ScalableRWLock::AutoRLock _l(pc.mLock);
+    size_t denied = 0;
+    for (size_t i=0 ; i<pc.mCache.size() ; i++) {
+        if (!pc.mCache[i].granted) {
+            denied++;
+        }
+    }
+    result.appendFormat("Permission cache: %u entries (%u denied), "
+            "%u hits, %u misses (%u expired denials)\n",
+            pc.mCache.size(), denied, pc.mHits, pc.mMisses, pc.mExpired);
 }
 
 bool PermissionCache::checkCallingPermission(const String16& permission) {
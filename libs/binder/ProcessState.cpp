@@ -42,6 +42,8 @@
 #include <sys/stat.h>
 
 #define BINDER_VM_SIZE ((1*1024*1024) - (4096 *2))
+#define MAX_BINDER_VM_SIZE (4*1024*1024)
+#define DEFAULT_MAX_BINDER_THREADS 15
 
 
 // ---------------------------------------------------------------------------
@@ -64,6 +66,7 @@ public:
 protected:
     virtual bool threadLoop()
     {
+        androidConfigureThread(0, "binder");
         IPCThreadState::self()->joinThreadPool(mIsMain);
         return false;
     }
@@ -77,7 +80,26 @@ sp<ProcessState> ProcessState::self()
     if (gProcess != NULL) {
         return gProcess;
     }
-    gProcess = new ProcessState;
+    gProcess = new ProcessState(BINDER_VM_SIZE);
+    return gProcess;
+}
+
+sp<ProcessState> ProcessState::initWithVMSize(size_t vmSize)
+{
+    Mutex::Autolock _l(gProcessMutex);
+    if (gProcess != NULL) {
+        ALOGW_IF(gProcess->mVMSize != vmSize,
+                "Binder already mapped %u bytes, can't map %u",
+                gProcess->mVMSize, vmSize);
+        return gProcess;
+    }
+    const size_t pageSize = getpagesize();
+    vmSize = (vmSize + pageSize - 1) & ~(pageSize - 1);
+    if (vmSize == 0 || vmSize > MAX_BINDER_VM_SIZE) {
+        ALOGW("Invalid binder mapping size %u, using %u", vmSize, BINDER_VM_SIZE);
+        vmSize = BINDER_VM_SIZE;
+    }
+    gProcess = new ProcessState(vmSize);
     return gProcess;
 }
 
@@ -296,14 +318,121 @@ void ProcessState::spawnPooledThread(bool isMain)
 }
 
 status_t ProcessState::setThreadPoolMaxThreadCount(size_t maxThreads) {
+    AutoMutex _l(mLock);
+    mMaxThreads = maxThreads;
+    // the driver counts the threads it ever asked for against this limit,
+    // including the ones that left the pool since
+    size_t driverMaxThreads = maxThreads + mReapedThreads;
     status_t result = NO_ERROR;
-    if (ioctl(mDriverFD, BINDER_SET_MAX_THREADS, &maxThreads) == -1) {
+    if (ioctl(mDriverFD, BINDER_SET_MAX_THREADS, &driverMaxThreads) == -1) {
         result = -errno;
         ALOGE("Binder ioctl to set max threads failed: %s", strerror(-result));
     }
     return result;
 }
 
+void ProcessState::setThreadPoolMinThreadCount(size_t minThreads) {
+    AutoMutex _l(mLock);
+    mMinThreads = minThreads;
+}
+
+void ProcessState::setThreadPoolIdleTimeout(nsecs_t timeout) {
+    AutoMutex _l(mLock);
+    mIdleTimeout = timeout;
+}
+
+nsecs_t ProcessState::getThreadPoolIdleTimeout() const {
+    AutoMutex _l(mLock);
+    return mIdleTimeout;
+}
+
+void ProcessState::pooledThreadEntered() {
+    AutoMutex _l(mLock);
+    mPooledThreads++;
+}
+
+void ProcessState::pooledThreadExited(bool reaped) {
+    AutoMutex _l(mLock);
+    if (!reaped) {
+        // reaped threads were already accounted for
+        mPooledThreads--;
+    }
+}
+
+bool ProcessState::reapIdlePooledThread(nsecs_t idleTime) {
+    AutoMutex _l(mLock);
+    if (mIdleTimeout <= 0 || idleTime < mIdleTimeout) {
+        return false;
+    }
+    if (mPooledThreads <= mMinThreads || mPooledThreads <= 1) {
+        return false;
+    }
+    mPooledThreads--;
+    mReapedThreads++;
+
+    // let the driver spawn a thread in place of this one when needed
+    size_t driverMaxThreads = mMaxThreads + mReapedThreads;
+    if (ioctl(mDriverFD, BINDER_SET_MAX_THREADS, &driverMaxThreads) == -1) {
+        ALOGE("Binder ioctl to set max threads failed: %s", strerror(errno));
+    }
+    return true;
+}
+
+void ProcessState::dumpThreadPool(String8& result) const {
+    AutoMutex _l(mLock);
+    result.appendFormat("Binder thread pool (pid %d): %u threads, %d busy "
+            "(max %d busy), min=%u, max=%u spawned, idle timeout=%lld ms, "
+            "%u reaped\n",
+            getpid(), mPooledThreads, android_atomic_acquire_load(&mBusyThreads),
+            mMaxBusyThreads, mMinThreads, mMaxThreads,
+            ns2ms(mIdleTimeout), mReapedThreads);
+}
+
+size_t ProcessState::getVMSize() const {
+    return mVMSize;
+}
+
+static inline size_t transactionBufferSize(size_t dataSize, size_t offsetsSize) {
+    // the driver keeps both parts word-aligned
+    const size_t align = sizeof(void*) - 1;
+    return ((dataSize + align) & ~align) + ((offsetsSize + align) & ~align);
+}
+
+void ProcessState::transactionBufferReceived(size_t dataSize, size_t offsetsSize) {
+    const int32_t size = transactionBufferSize(dataSize, offsetsSize);
+    const int32_t used = android_atomic_add(size, &mBufferBytes) + size;
+    android_atomic_inc(&mBufferCount);
+    int32_t max = android_atomic_acquire_load(&mMaxBufferBytes);
+    while (used > max) {
+        if (android_atomic_release_cas(max, used, &mMaxBufferBytes) == 0) {
+            // once, when the high-water mark first goes past 3/4
+            const int32_t limit = mVMSize / 4 * 3;
+            ALOGW_IF(max <= limit && used > limit,
+                    "Binder transaction buffer is %d%% full (%d of %u bytes "
+                    "in %d buffers)", int32_t(int64_t(used) * 100 / mVMSize),
+                    used, mVMSize, android_atomic_acquire_load(&mBufferCount));
+            break;
+        }
+        max = android_atomic_acquire_load(&mMaxBufferBytes);
+    }
+}
+
+void ProcessState::transactionBufferFreed(size_t dataSize, size_t offsetsSize) {
+    android_atomic_add(-int32_t(transactionBufferSize(dataSize, offsetsSize)),
+            &mBufferBytes);
+    android_atomic_dec(&mBufferCount);
+}
+
+void ProcessState::dumpTransactionBuffer(String8& result) const {
+    const int32_t used = android_atomic_acquire_load(&mBufferBytes);
+    const int32_t max = android_atomic_acquire_load(&mMaxBufferBytes);
+    result.appendFormat("Binder transaction buffer (pid %d): %d of %u bytes "
+            "used (%d%%) in %d buffers, max %d bytes (%d%%)\n",
+            getpid(), used, mVMSize, int32_t(int64_t(used) * 100 / mVMSize),
+            android_atomic_acquire_load(&mBufferCount),
+            max, int32_t(int64_t(max) * 100 / mVMSize));
+}
+
 static int open_driver()
 {
     int fd = open("/dev/binder", O_RDWR);
@@ -321,7 +450,7 @@ static int open_driver()
             close(fd);
             fd = -1;
         }
-        size_t maxThreads = 15;
+        size_t maxThreads = DEFAULT_MAX_BINDER_THREADS;
         result = ioctl(fd, BINDER_SET_MAX_THREADS, &maxThreads);
         if (result == -1) {
             ALOGE("Binder ioctl to set max threads failed: %s", strerror(errno));
@@ -332,14 +461,25 @@ static int open_driver()
     return fd;
 }
 
-ProcessState::ProcessState()
+ProcessState::ProcessState(size_t vmSize)
     : mDriverFD(open_driver())
+    , mVMSize(vmSize)
     , mVMStart(MAP_FAILED)
+    , mBufferBytes(0)
+    , mMaxBufferBytes(0)
+    , mBufferCount(0)
     , mManagesContexts(false)
     , mBinderContextCheckFunc(NULL)
     , mBinderContextUserData(NULL)
     , mThreadPoolStarted(false)
     , mThreadPoolSeq(1)
+    , mMaxThreads(DEFAULT_MAX_BINDER_THREADS)
+    , mMinThreads(0)
+    , mIdleTimeout(0)
+    , mPooledThreads(0)
+    , mReapedThreads(0)
+    , mBusyThreads(0)
+    , mMaxBusyThreads(0)
 {
     if (mDriverFD >= 0) {
         // XXX Ideally, there should be a specific define for whether we
@@ -347,7 +487,7 @@ ProcessState::ProcessState()
         // availabla).
 #if !defined(HAVE_WIN32_IPC)
         // mmap the binder, providing a chunk of virtual address space to receive transactions.
-        mVMStart = mmap(0, BINDER_VM_SIZE, PROT_READ, MAP_PRIVATE | MAP_NORESERVE, mDriverFD, 0);
+        mVMStart = mmap(0, mVMSize, PROT_READ, MAP_PRIVATE | MAP_NORESERVE, mDriverFD, 0);
         if (mVMStart == MAP_FAILED) {
             // *sigh*
             ALOGE("Using /dev/binder failed: unable to mmap transaction memory.\n");
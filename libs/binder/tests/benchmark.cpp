@@ -0,0 +1,691 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "BinderBenchmark"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <binder/Binder.h>
+#include <binder/IPCThreadState.h>
+#include <binder/IServiceManager.h>
+#include <binder/Parcel.h>
+#include <binder/ProcessState.h>
+
+#include <cutils/atomic.h>
+
+#include <utils/Condition.h>
+#include <utils/Log.h>
+#include <utils/Mutex.h>
+#include <utils/String16.h>
+#include <utils/String8.h>
+#include <utils/Thread.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+using namespace android;
+
+// ---------------------------------------------------------------------------
+
+/*
+ * Measures binder IPC and the Parcel operations under it:
+ *
+ *   parcel   writing and reading primitives, strings, byte arrays, binders
+ *            and file descriptors, without IPC
+ *   sync     synchronous calls to a server process, with each payload size,
+ *            echoed back or not, from one or more client threads
+ *   oneway   one-way calls, until the server has received all of them
+ *   objects  synchronous calls carrying strong binders, weak binders or
+ *            file descriptors
+ *   death    time from killing a server to the delivery of its obituary
+ *
+ * Each server runs in its own process, re-executed from this binary so it
+ * gets its own binder state, with a thread pool of each requested size.
+ * It registers with the service manager, so this must run as root.
+ *
+ * Results are printed to stdout as CSV with a header line; everything else
+ * goes to stderr.
+ */
+
+enum {
+    CALL = IBinder::FIRST_CALL_TRANSACTION, // payload in, empty reply
+    ECHO,                                   // payload in, same payload back
+    ONEWAY,                                 // payload in, one-way
+    COUNT,                                  // one-way calls received so far
+    OBJECTS                                 // reads the objects sent
+};
+
+enum ObjectKind {
+    STRONG_BINDER,
+    WEAK_BINDER,
+    FILE_DESCRIPTOR
+};
+
+static const char* const kObjectKindNames[] = { "strong", "weak", "fd" };
+
+struct Options {
+    int iterations;
+    int deathIterations;
+    Vector<int> sizes;
+    Vector<int> serverThreads;
+    Vector<int> clientThreads;
+    Vector<int> objectCounts;
+    const char* benchmarks;     // comma-separated, NULL for all
+};
+
+static int compareNsecs(const nsecs_t* lhs, const nsecs_t* rhs)
+{
+    return (*lhs > *rhs) - (*lhs < *rhs);
+}
+
+// returns the percentile (0-100) of sorted samples, in microseconds
+static double percentile(const Vector<nsecs_t>& samples, int p)
+{
+    if (samples.isEmpty()) {
+        return 0;
+    }
+    size_t i = (samples.size() * p) / 100;
+    if (i >= samples.size()) {
+        i = samples.size() - 1;
+    }
+    return samples[i] / 1000.0;
+}
+
+static void printHeader()
+{
+    printf("benchmark,mode,payload_bytes,server_threads,client_threads,"
+            "objects,iterations,total_ms,ops_per_sec,p50_us,p90_us,p99_us,"
+            "max_us\n");
+    fflush(stdout);
+}
+
+// "samples" are the times of single operations, "total" the wall time the
+// operations took together
+static void report(const char* benchmark, const char* mode, int payload,
+        int serverThreads, int clientThreads, int objects,
+        Vector<nsecs_t>& samples, nsecs_t total)
+{
+    samples.sort(compareNsecs);
+    const size_t n = samples.size();
+    printf("%s,%s,%d,%d,%d,%d,%u,%.3f,%.1f,%.2f,%.2f,%.2f,%.2f\n",
+            benchmark, mode, payload, serverThreads, clientThreads, objects,
+            n, total / 1e6, total > 0 ? n * 1e9 / total : 0.0,
+            percentile(samples, 50), percentile(samples, 90),
+            percentile(samples, 99), n ? samples[n - 1] / 1000.0 : 0.0);
+    fflush(stdout);
+}
+
+static bool isSelected(const Options& options, const char* benchmark)
+{
+    if (options.benchmarks == NULL) {
+        return true;
+    }
+    const size_t length = strlen(benchmark);
+    for (const char* s = options.benchmarks ; *s ; ) {
+        const char* end = strchr(s, ',');
+        const size_t n = end ? size_t(end - s) : strlen(s);
+        if (n == length && !strncmp(s, benchmark, n)) {
+            return true;
+        }
+        s += end ? n + 1 : n;
+    }
+    return false;
+}
+
+// ---------------------------------------------------------------------------
+// The server side
+
+class BenchmarkService : public BBinder
+{
+public:
+    BenchmarkService() : mOnewayCalls(0) { }
+
+protected:
+    virtual status_t onTransact(uint32_t code, const Parcel& data,
+            Parcel* reply, uint32_t flags) {
+        switch (code) {
+            case CALL:
+                return NO_ERROR;
+            case ECHO:
+                return reply->write(data.data(), data.dataSize());
+            case ONEWAY:
+                android_atomic_inc(&mOnewayCalls);
+                return NO_ERROR;
+            case COUNT:
+                return reply->writeInt32(android_atomic_acquire_load(&mOnewayCalls));
+            case OBJECTS: {
+                const int32_t kind = data.readInt32();
+                const int32_t count = data.readInt32();
+                for (int32_t i=0 ; i<count ; i++) {
+                    if (kind == STRONG_BINDER) {
+                        data.readStrongBinder();
+                    } else if (kind == WEAK_BINDER) {
+                        data.readWeakBinder();
+                    } else {
+                        data.readFileDescriptor();
+                    }
+                }
+                return NO_ERROR;
+            }
+        }
+        return BBinder::onTransact(code, data, reply, flags);
+    }
+
+private:
+    volatile int32_t mOnewayCalls;
+};
+
+static int runServer(const char* name, int threads)
+{
+    sp<ProcessState> ps(ProcessState::self());
+    if (defaultServiceManager()->addService(String16(name),
+            new BenchmarkService()) != NO_ERROR) {
+        fprintf(stderr, "can't register %s (not running as root?)\n", name);
+        return 1;
+    }
+    // the main thread, the pool's first thread and those the driver spawns
+    if (threads > 1) {
+        ps->setThreadPoolMaxThreadCount(threads - 2);
+        ps->startThreadPool();
+    } else {
+        ps->setThreadPoolMaxThreadCount(0);
+    }
+    IPCThreadState::self()->joinThreadPool();
+    return 0;
+}
+
+struct Server {
+    pid_t pid;
+    sp<IBinder> binder;
+};
+
+// starts a server process and waits for its service to show up
+static bool startServer(int threads, Server* server)
+{
+    static int sSequence = 0;
+    char name[64];
+    char threadCount[16];
+    snprintf(name, sizeof(name), "binder.benchmark.%d.%d", getpid(), sSequence++);
+    snprintf(threadCount, sizeof(threadCount), "%d", threads);
+
+    server->pid = fork();
+    if (server->pid < 0) {
+        fprintf(stderr, "fork failed: %s\n", strerror(errno));
+        return false;
+    }
+    if (server->pid == 0) {
+        // /dev/binder is close-on-exec, so the server starts afresh
+        execl("/proc/self/exe", "binder-benchmark-server", "--server", name,
+                threadCount, (char*) NULL);
+        _exit(1);
+    }
+    server->binder = defaultServiceManager()->getService(String16(name));
+    if (server->binder == NULL) {
+        fprintf(stderr, "server %s didn't start\n", name);
+        kill(server->pid, SIGKILL);
+        waitpid(server->pid, NULL, 0);
+        return false;
+    }
+    return true;
+}
+
+static void stopServer(Server* server)
+{
+    server->binder.clear();
+    kill(server->pid, SIGKILL);
+    waitpid(server->pid, NULL, 0);
+}
+
+// ---------------------------------------------------------------------------
+// Parcel operations
+
+static const size_t kParcelBatch = 64;
+
+// times kParcelBatch writes of one item into a parcel, and reading them back
+template <typename OP>
+static void benchmarkParcelOp(const char* mode, int payload, int iterations,
+        OP& op)
+{
+    Vector<nsecs_t> writes, reads;
+    nsecs_t writeTotal = 0, readTotal = 0;
+    Parcel parcel;
+    for (int i=0 ; i<iterations ; i++) {
+        parcel.freeData();
+        nsecs_t start = systemTime();
+        for (size_t j=0 ; j<kParcelBatch ; j++) {
+            op.write(parcel);
+        }
+        nsecs_t t = systemTime() - start;
+        writes.add(t / kParcelBatch);
+        writeTotal += t;
+
+        parcel.setDataPosition(0);
+        start = systemTime();
+        for (size_t j=0 ; j<kParcelBatch ; j++) {
+            op.read(parcel);
+        }
+        t = systemTime() - start;
+        reads.add(t / kParcelBatch);
+        readTotal += t;
+    }
+    String8 name;
+    name.appendFormat("%s_write", mode);
+    report("parcel", name.string(), payload, 0, 1, 0, writes, writeTotal);
+    name.clear();
+    name.appendFormat("%s_read", mode);
+    report("parcel", name.string(), payload, 0, 1, 0, reads, readTotal);
+}
+
+struct Int32Op {
+    void write(Parcel& p) { p.writeInt32(42); }
+    void read(const Parcel& p) { p.readInt32(); }
+};
+
+struct String16Op {
+    String16 value;
+    String16Op() : value("android.benchmark.IBinderBenchmark") { }
+    void write(Parcel& p) { p.writeString16(value); }
+    void read(const Parcel& p) { p.readString16(); }
+};
+
+struct BytesOp {
+    size_t size;
+    void* buffer;
+    BytesOp(size_t size) : size(size), buffer(calloc(1, size ? size : 1)) { }
+    ~BytesOp() { free(buffer); }
+    void write(Parcel& p) { p.write(buffer, size); }
+    void read(const Parcel& p) { p.read(buffer, size); }
+};
+
+struct StrongBinderOp {
+    sp<IBinder> binder;
+    StrongBinderOp() : binder(new BBinder()) { }
+    void write(Parcel& p) { p.writeStrongBinder(binder); }
+    void read(const Parcel& p) { p.readStrongBinder(); }
+};
+
+struct WeakBinderOp {
+    sp<IBinder> binder;
+    WeakBinderOp() : binder(new BBinder()) { }
+    void write(Parcel& p) { p.writeWeakBinder(binder); }
+    void read(const Parcel& p) { p.readWeakBinder(); }
+};
+
+struct FileDescriptorOp {
+    int fd;
+    FileDescriptorOp() : fd(open("/dev/null", O_RDONLY)) { }
+    ~FileDescriptorOp() { close(fd); }
+    void write(Parcel& p) { p.writeFileDescriptor(fd); }
+    void read(const Parcel& p) { p.readFileDescriptor(); }
+};
+
+static void benchmarkParcel(const Options& options)
+{
+    fprintf(stderr, "parcel operations\n");
+    Int32Op int32Op;
+    benchmarkParcelOp("int32", 4, options.iterations, int32Op);
+    String16Op string16Op;
+    benchmarkParcelOp("string16", string16Op.value.size() * 2,
+            options.iterations, string16Op);
+    for (size_t i=0 ; i<options.sizes.size() ; i++) {
+        BytesOp bytesOp(options.sizes[i]);
+        benchmarkParcelOp("bytes", options.sizes[i],
+                // keep the biggest parcels reasonably quick
+                options.sizes[i] > 4096 ? options.iterations / 10 + 1 :
+                        options.iterations, bytesOp);
+    }
+    StrongBinderOp strongOp;
+    benchmarkParcelOp("strong_binder", 0, options.iterations, strongOp);
+    WeakBinderOp weakOp;
+    benchmarkParcelOp("weak_binder", 0, options.iterations, weakOp);
+    FileDescriptorOp fdOp;
+    benchmarkParcelOp("fd", 0, options.iterations, fdOp);
+}
+
+// ---------------------------------------------------------------------------
+// Calls to a server
+
+class CallerThread : public Thread
+{
+public:
+    CallerThread(const sp<IBinder>& service, uint32_t code, size_t payload,
+            int calls)
+        : Thread(false), mService(service), mCode(code), mPayload(payload),
+          mCalls(calls), mResult(NO_ERROR) { }
+
+    Vector<nsecs_t> latencies;
+
+    status_t getResult() const { return mResult; }
+
+private:
+    virtual bool threadLoop() {
+        void* buffer = calloc(1, mPayload ? mPayload : 1);
+        latencies.setCapacity(mCalls);
+        for (int i=0 ; i<mCalls ; i++) {
+            Parcel data, reply;
+            data.write(buffer, mPayload);
+            const nsecs_t start = systemTime();
+            mResult = mService->transact(mCode, data, &reply);
+            latencies.add(systemTime() - start);
+            if (mResult != NO_ERROR) {
+                break;
+            }
+        }
+        free(buffer);
+        return false;
+    }
+
+    sp<IBinder> mService;
+    uint32_t mCode;
+    size_t mPayload;
+    int mCalls;
+    status_t mResult;
+};
+
+static bool benchmarkSync(const Options& options, const Server& server,
+        int serverThreads)
+{
+    fprintf(stderr, "synchronous calls, %d server threads\n", serverThreads);
+    static const uint32_t codes[] = { CALL, ECHO };
+    static const char* const modes[] = { "call", "echo" };
+    for (size_t c=0 ; c<options.clientThreads.size() ; c++) {
+        const int clients = options.clientThreads[c];
+        for (size_t s=0 ; s<options.sizes.size() ; s++) {
+            for (size_t m=0 ; m<2 ; m++) {
+                Vector< sp<CallerThread> > threads;
+                const nsecs_t start = systemTime();
+                for (int i=0 ; i<clients ; i++) {
+                    sp<CallerThread> t(new CallerThread(server.binder, codes[m],
+                            options.sizes[s], options.iterations / clients + 1));
+                    t->run("CallerThread");
+                    threads.add(t);
+                }
+                Vector<nsecs_t> latencies;
+                bool ok = true;
+                for (int i=0 ; i<clients ; i++) {
+                    threads[i]->join();
+                    latencies.appendVector(threads[i]->latencies);
+                    ok = ok && threads[i]->getResult() == NO_ERROR;
+                }
+                const nsecs_t total = systemTime() - start;
+                if (!ok) {
+                    fprintf(stderr, "%s of %d bytes failed\n", modes[m],
+                            options.sizes[s]);
+                    return false;
+                }
+                report("sync", modes[m], options.sizes[s], serverThreads,
+                        clients, 0, latencies, total);
+            }
+        }
+    }
+    return true;
+}
+
+static bool benchmarkOneway(const Options& options, const Server& server,
+        int serverThreads)
+{
+    fprintf(stderr, "one-way calls, %d server threads\n", serverThreads);
+    int32_t received = 0;
+    for (size_t s=0 ; s<options.sizes.size() ; s++) {
+        const size_t payload = options.sizes[s];
+        void* buffer = calloc(1, payload ? payload : 1);
+        Vector<nsecs_t> latencies;
+        latencies.setCapacity(options.iterations);
+        const nsecs_t start = systemTime();
+        status_t err = NO_ERROR;
+        for (int i=0 ; i<options.iterations && err == NO_ERROR ; i++) {
+            Parcel data;
+            data.write(buffer, payload);
+            const nsecs_t before = systemTime();
+            err = server.binder->transact(ONEWAY, data, NULL,
+                    IBinder::FLAG_ONEWAY);
+            latencies.add(systemTime() - before);
+        }
+        free(buffer);
+        // the time until the server has seen the last one-way call is what
+        // bounds the throughput
+        const int32_t expected = received + latencies.size();
+        while (err == NO_ERROR && received < expected) {
+            Parcel data, reply;
+            err = server.binder->transact(COUNT, data, &reply);
+            received = reply.readInt32();
+        }
+        const nsecs_t total = systemTime() - start;
+        if (err != NO_ERROR) {
+            fprintf(stderr, "one-way calls of %u bytes failed: %d\n",
+                    payload, err);
+            return false;
+        }
+        report("oneway", "send", payload, serverThreads, 1, 0, latencies, total);
+    }
+    return true;
+}
+
+static bool benchmarkObjects(const Options& options, const Server& server,
+        int serverThreads)
+{
+    fprintf(stderr, "objects, %d server threads\n", serverThreads);
+    sp<IBinder> local(new BBinder());
+    const int fd = open("/dev/null", O_RDONLY);
+    for (int kind=STRONG_BINDER ; kind<=FILE_DESCRIPTOR ; kind++) {
+        for (size_t o=0 ; o<options.objectCounts.size() ; o++) {
+            const int count = options.objectCounts[o];
+            Vector<nsecs_t> latencies;
+            latencies.setCapacity(options.iterations);
+            const nsecs_t start = systemTime();
+            for (int i=0 ; i<options.iterations ; i++) {
+                Parcel data, reply;
+                const nsecs_t before = systemTime();
+                data.writeInt32(kind);
+                data.writeInt32(count);
+                for (int j=0 ; j<count ; j++) {
+                    if (kind == STRONG_BINDER) {
+                        data.writeStrongBinder(local);
+                    } else if (kind == WEAK_BINDER) {
+                        data.writeWeakBinder(local);
+                    } else {
+                        data.writeFileDescriptor(fd);
+                    }
+                }
+                const status_t err = server.binder->transact(OBJECTS, data, &reply);
+                latencies.add(systemTime() - before);
+                if (err != NO_ERROR) {
+                    fprintf(stderr, "sending %d %s objects failed: %d\n", count,
+                            kObjectKindNames[kind], err);
+                    close(fd);
+                    return false;
+                }
+            }
+            report("objects", kObjectKindNames[kind], 0, serverThreads, 1,
+                    count, latencies, systemTime() - start);
+        }
+    }
+    close(fd);
+    return true;
+}
+
+class DeathWaiter : public IBinder::DeathRecipient
+{
+public:
+    DeathWaiter() : mDiedAt(0) { }
+
+    // returns when the obituary arrived, or 0 if it didn't in time
+    nsecs_t wait(nsecs_t timeout) {
+        Mutex::Autolock _l(mLock);
+        const nsecs_t end = systemTime() + timeout;
+        while (!mDiedAt) {
+            const nsecs_t remaining = end - systemTime();
+            if (remaining <= 0) {
+                break;
+            }
+            mCondition.waitRelative(mLock, remaining);
+        }
+        return mDiedAt;
+    }
+
+private:
+    virtual void binderDied(const wp<IBinder>& who) {
+        Mutex::Autolock _l(mLock);
+        mDiedAt = systemTime();
+        mCondition.signal();
+    }
+
+    Mutex mLock;
+    Condition mCondition;
+    nsecs_t mDiedAt;
+};
+
+static bool benchmarkDeath(const Options& options)
+{
+    fprintf(stderr, "death notifications\n");
+    Vector<nsecs_t> latencies;
+    nsecs_t total = 0;
+    for (int i=0 ; i<options.deathIterations ; i++) {
+        Server server;
+        if (!startServer(1, &server)) {
+            return false;
+        }
+        sp<DeathWaiter> waiter(new DeathWaiter());
+        server.binder->linkToDeath(waiter);
+        const nsecs_t start = systemTime();
+        kill(server.pid, SIGKILL);
+        const nsecs_t diedAt = waiter->wait(s2ns(5));
+        waitpid(server.pid, NULL, 0);
+        if (!diedAt) {
+            fprintf(stderr, "no obituary after 5 seconds\n");
+            return false;
+        }
+        latencies.add(diedAt - start);
+        total += diedAt - start;
+    }
+    report("death", "obituary", 0, 1, 1, 0, latencies, total);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+
+static bool parseList(const char* arg, Vector<int>* out)
+{
+    out->clear();
+    for (const char* s = arg ; *s ; ) {
+        char* end;
+        const long value = strtol(s, &end, 10);
+        if (end == s || value < 0 || (*end && *end != ',')) {
+            return false;
+        }
+        out->add(int(value));
+        s = *end ? end + 1 : end;
+    }
+    return !out->isEmpty();
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+            "usage: %s [-b benchmarks] [-n iterations] [-s sizes] [-t threads]\n"
+            "       [-c clients] [-o objects] [-d deaths]\n"
+            "  -b  comma-separated list of parcel, sync, oneway, objects and\n"
+            "      death, all of them by default\n"
+            "  -n  operations per measurement (default 2000)\n"
+            "  -s  payload sizes in bytes (default 0,64,1024,16384)\n"
+            "  -t  server thread pool sizes (default 1,4)\n"
+            "  -c  numbers of client threads making synchronous calls "
+            "(default 1,4)\n"
+            "  -o  numbers of objects per call (default 1,16)\n"
+            "  -d  servers killed to time death notifications (default 10)\n"
+            "Must run as root, to register the servers.\n", name);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc == 4 && !strcmp(argv[1], "--server")) {
+        return runServer(argv[2], atoi(argv[3]));
+    }
+
+    Options options;
+    options.iterations = 2000;
+    options.deathIterations = 10;
+    options.benchmarks = NULL;
+    parseList("0,64,1024,16384", &options.sizes);
+    parseList("1,4", &options.serverThreads);
+    parseList("1,4", &options.clientThreads);
+    parseList("1,16", &options.objectCounts);
+
+    int c;
+    bool ok = true;
+    while ((c = getopt(argc, argv, "b:n:s:t:c:o:d:")) != -1) {
+        switch (c) {
+            case 'b': options.benchmarks = optarg; break;
+            case 'n': options.iterations = atoi(optarg); break;
+            case 's': ok = ok && parseList(optarg, &options.sizes); break;
+            case 't': ok = ok && parseList(optarg, &options.serverThreads); break;
+            case 'c': ok = ok && parseList(optarg, &options.clientThreads); break;
+            case 'o': ok = ok && parseList(optarg, &options.objectCounts); break;
+            case 'd': options.deathIterations = atoi(optarg); break;
+            default: ok = false; break;
+        }
+    }
+    if (!ok || options.iterations < 1 || options.deathIterations < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    for (size_t i=0 ; i<options.serverThreads.size() ; i++) {
+        if (options.serverThreads[i] < 1) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    for (size_t i=0 ; i<options.clientThreads.size() ; i++) {
+        if (options.clientThreads[i] < 1) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // obituaries are delivered on the pool's threads
+    ProcessState::self()->startThreadPool();
+
+    printHeader();
+    if (isSelected(options, "parcel")) {
+        benchmarkParcel(options);
+    }
+    int result = 0;
+    const bool remote = isSelected(options, "sync") ||
+            isSelected(options, "oneway") || isSelected(options, "objects");
+    for (size_t t=0 ; remote && t<options.serverThreads.size() ; t++) {
+        const int threads = options.serverThreads[t];
+        Server server;
+        if (!startServer(threads, &server)) {
+            return 1;
+        }
+        if ((isSelected(options, "sync") && !benchmarkSync(options, server, threads)) ||
+                (isSelected(options, "oneway") && !benchmarkOneway(options, server, threads)) ||
+                (isSelected(options, "objects") && !benchmarkObjects(options, server, threads))) {
+            result = 1;
+        }
+        stopServer(&server);
+    }
+    if (isSelected(options, "death") && !benchmarkDeath(options)) {
+        result = 1;
+    }
+    return result;
+}
@@ -4,6 +4,9 @@ include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES :=     \
         CentralTendencyStatistics.cpp \
+        LogHistogram.cpp \
+        QuantileEstimator.cpp \
+        ThreadCpuSampler.cpp \
         ThreadCpuUsage.cpp
 
 LOCAL_MODULE := libcpustats
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <cpustats/LogHistogram.h>
+
+unsigned LogHistogram::bucketOf(uint64_t x)
+{
+    if (x < SUB_BUCKETS) {
+        return (unsigned) x;
+    }
+    // x is in [2^e, 2^(e+1)); the SUB_BUCKET_BITS after the top bit pick
+    // the linear bucket within that range
+    unsigned e = 63 - __builtin_clzll(x);
+    unsigned sub = (unsigned) (x >> (e - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    return (e - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+uint64_t LogHistogram::bucketLowerBound(unsigned bucket)
+{
+    if (bucket < SUB_BUCKETS) {
+        return bucket;
+    }
+    unsigned e = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    uint64_t sub = bucket % SUB_BUCKETS;
+    return (SUB_BUCKETS + sub) << (e - SUB_BUCKET_BITS);
+}
+
+void LogHistogram::reset()
+{
+    mN = 0;
+    mSum = 0;
+    mMinimum = ~(uint64_t) 0;
+    mMaximum = 0;
+    memset(mCounts, 0, sizeof(mCounts));
+}
+
+void LogHistogram::sample(uint64_t x)
+{
+    if (x < mMinimum)
+        mMinimum = x;
+    if (x > mMaximum)
+        mMaximum = x;
+    ++mN;
+    mSum += x;
+    ++mCounts[bucketOf(x)];
+}
+
+void LogHistogram::merge(const LogHistogram& other)
+{
+    if (other.mN == 0) {
+        return;
+    }
+    if (other.mMinimum < mMinimum)
+        mMinimum = other.mMinimum;
+    if (other.mMaximum > mMaximum)
+        mMaximum = other.mMaximum;
+    mN += other.mN;
+    mSum += other.mSum;
+    for (unsigned i = 0; i < NUM_BUCKETS; ++i) {
+        mCounts[i] += other.mCounts[i];
+    }
+}
+
+uint64_t LogHistogram::percentile(double p) const
+{
+    if (mN == 0) {
+        return 0;
+    }
+    if (p <= 0) {
+        return mMinimum;
+    }
+    if (p >= 100) {
+        return mMaximum;
+    }
+    // rank of the sample we're looking for, 1-based
+    uint64_t rank = (uint64_t) (p * mN / 100 + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < NUM_BUCKETS; ++i) {
+        seen += mCounts[i];
+        if (seen >= rank) {
+            // report the middle of the bucket, within the observed range
+            uint64_t lo = bucketLowerBound(i);
+            uint64_t width = 1;
+            if (i >= SUB_BUCKETS) {
+                width <<= i / SUB_BUCKETS - 1;
+            }
+            uint64_t v = lo + width / 2;
+            if (v < mMinimum)
+                v = mMinimum;
+            if (v > mMaximum)
+                v = mMaximum;
+            return v;
+        }
+    }
+    return mMaximum;
+}
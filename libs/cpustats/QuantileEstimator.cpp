@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include <cpustats/QuantileEstimator.h>
+
+static int compareDoubles(const void* a, const void* b)
+{
+    double x = *(const double*) a;
+    double y = *(const double*) b;
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+QuantileEstimator::QuantileEstimator(double p) :
+        mP(p < 0 ? 0 : (p > 1 ? 1 : p))
+{
+    reset();
+}
+
+void QuantileEstimator::reset()
+{
+    mN = 0;
+    mIncrement[0] = 0;
+    mIncrement[1] = mP / 2;
+    mIncrement[2] = mP;
+    mIncrement[3] = (1 + mP) / 2;
+    mIncrement[4] = 1;
+    for (int i = 0; i < 5; ++i) {
+        mHeight[i] = 0;
+        mPosition[i] = i + 1;
+        mDesired[i] = 1 + 4 * mIncrement[i];
+    }
+}
+
+void QuantileEstimator::sample(double x)
+{
+    if (mN < 5) {
+        mHeight[mN++] = x;
+        if (mN == 5) {
+            qsort(mHeight, 5, sizeof(mHeight[0]), compareDoubles);
+        }
+        return;
+    }
+    ++mN;
+
+    // find the cell containing x, extending the extreme markers if needed
+    int k;
+    if (x < mHeight[0]) {
+        mHeight[0] = x;
+        k = 0;
+    } else if (x >= mHeight[4]) {
+        mHeight[4] = x;
+        k = 3;
+    } else {
+        for (k = 0; k < 3 && x >= mHeight[k + 1]; ++k)
+            ;
+    }
+    for (int i = k + 1; i < 5; ++i) {
+        ++mPosition[i];
+    }
+    for (int i = 0; i < 5; ++i) {
+        mDesired[i] += mIncrement[i];
+    }
+
+    // move the middle markers toward their desired positions
+    for (int i = 1; i < 4; ++i) {
+        double delta = mDesired[i] - mPosition[i];
+        if ((delta >= 1 && mPosition[i + 1] - mPosition[i] > 1) ||
+                (delta <= -1 && mPosition[i - 1] - mPosition[i] < -1)) {
+            int d = delta > 0 ? 1 : -1;
+            double h = parabolic(i, d);
+            if (!(mHeight[i - 1] < h && h < mHeight[i + 1])) {
+                h = linear(i, d);
+            }
+            mHeight[i] = h;
+            mPosition[i] += d;
+        }
+    }
+}
+
+double QuantileEstimator::parabolic(int i, int d) const
+{
+    double nm = mPosition[i - 1], n = mPosition[i], np = mPosition[i + 1];
+    return mHeight[i] + d / (np - nm) *
+            ((n - nm + d) * (mHeight[i + 1] - mHeight[i]) / (np - n) +
+             (np - n - d) * (mHeight[i] - mHeight[i - 1]) / (n - nm));
+}
+
+double QuantileEstimator::linear(int i, int d) const
+{
+    return mHeight[i] + d * (mHeight[i + d] - mHeight[i]) /
+            (mPosition[i + d] - mPosition[i]);
+}
+
+double QuantileEstimator::value() const
+{
+    if (mN == 0) {
+        return NAN;
+    }
+    if (mN >= 5) {
+        return mHeight[2];
+    }
+    // not enough samples for the markers yet: use the nearest rank
+    double sorted[5];
+    for (unsigned i = 0; i < mN; ++i) {
+        sorted[i] = mHeight[i];
+    }
+    qsort(sorted, mN, sizeof(sorted[0]), compareDoubles);
+    return sorted[(unsigned) (mP * (mN - 1) + 0.5)];
+}
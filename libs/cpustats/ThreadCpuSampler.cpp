@@ -0,0 +1,357 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ThreadCpuSampler"
+//#define LOG_NDEBUG 0
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <utils/Log.h>
+
+#include <cpustats/ThreadCpuSampler.h>
+
+namespace android {
+
+// threads matching a prefix are looked for every this many periods
+static const uint32_t SCAN_TICKS = 10;
+
+static int64_t monotonicNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+ThreadCpuSampler::ThreadCpuSampler(uint32_t periodMs) :
+    mPeriodMs(periodMs > 0 ? periodMs : 1),
+    mRunning(false),
+    mStartNs(monotonicNs()),
+    mTicks(0)
+{
+    pthread_mutex_init(&mLock, NULL);
+    pthread_cond_init(&mCond, NULL);
+}
+
+ThreadCpuSampler::~ThreadCpuSampler()
+{
+    stop();
+    pthread_cond_destroy(&mCond);
+    pthread_mutex_destroy(&mLock);
+}
+
+/*static*/
+void ThreadCpuSampler::resetRecord(Record& r)
+{
+    r.totalNs = 0;
+    memset(r.cpuNs, 0, sizeof(r.cpuNs));
+    r.kHzNs.clear();
+    memset(r.histogram, 0, sizeof(r.histogram));
+    r.samples = 0;
+    r.maxPercent = 0;
+}
+
+ssize_t ThreadCpuSampler::indexOfLocked(pid_t tid) const
+{
+    for (size_t i = 0; i < mRecords.size(); i++) {
+        if (mRecords[i].tid == tid) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void ThreadCpuSampler::addThreadLocked(pid_t tid, const char* name)
+{
+    if (indexOfLocked(tid) >= 0) {
+        return;
+    }
+    Record r;
+    r.tid = tid;
+    r.name = name;
+    r.exited = false;
+    r.primed = false;
+    r.lastNs = 0;
+    resetRecord(r);
+    mRecords.add(r);
+}
+
+void ThreadCpuSampler::addThread(pid_t tid, const char* name)
+{
+    pthread_mutex_lock(&mLock);
+    addThreadLocked(tid, name);
+    pthread_mutex_unlock(&mLock);
+}
+
+void ThreadCpuSampler::addThreadsNamed(const char* prefix)
+{
+    pthread_mutex_lock(&mLock);
+    mPrefixes.add(String8(prefix));
+    scanThreadsLocked();
+    pthread_mutex_unlock(&mLock);
+}
+
+void ThreadCpuSampler::removeThread(pid_t tid)
+{
+    pthread_mutex_lock(&mLock);
+    ssize_t i = indexOfLocked(tid);
+    if (i >= 0) {
+        mRecords.removeAt(i);
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+bool ThreadCpuSampler::start()
+{
+    pthread_mutex_lock(&mLock);
+    bool ok = mRunning;
+    if (!mRunning) {
+        mRunning = true;
+        if (pthread_create(&mThread, NULL, threadLoop, this) == 0) {
+            ok = true;
+        } else {
+            ALOGE("can't create sampling thread: %s", strerror(errno));
+            mRunning = false;
+        }
+    }
+    pthread_mutex_unlock(&mLock);
+    return ok;
+}
+
+void ThreadCpuSampler::stop()
+{
+    pthread_mutex_lock(&mLock);
+    bool wasRunning = mRunning;
+    mRunning = false;
+    pthread_cond_signal(&mCond);
+    pthread_mutex_unlock(&mLock);
+    if (wasRunning) {
+        pthread_join(mThread, NULL);
+    }
+}
+
+void ThreadCpuSampler::reset()
+{
+    pthread_mutex_lock(&mLock);
+    for (size_t i = 0; i < mRecords.size(); i++) {
+        resetRecord(mRecords.editItemAt(i));
+    }
+    mStartNs = monotonicNs();
+    pthread_mutex_unlock(&mLock);
+}
+
+/*static*/
+void* ThreadCpuSampler::threadLoop(void* arg)
+{
+    ThreadCpuSampler* self = static_cast<ThreadCpuSampler*>(arg);
+    int64_t last = monotonicNs();
+    pthread_mutex_lock(&self->mLock);
+    while (self->mRunning) {
+        const int64_t deadline = last + self->mPeriodMs * 1000000LL;
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        int64_t wait = deadline - monotonicNs();
+        if (wait > 0) {
+            int64_t abs = ts.tv_sec * 1000000000LL + ts.tv_nsec + wait;
+            ts.tv_sec = abs / 1000000000LL;
+            ts.tv_nsec = abs % 1000000000LL;
+            pthread_cond_timedwait(&self->mCond, &self->mLock, &ts);
+            continue;
+        }
+        const int64_t now = monotonicNs();
+        self->sampleLocked(now - last);
+        last = now;
+    }
+    pthread_mutex_unlock(&self->mLock);
+    return NULL;
+}
+
+void ThreadCpuSampler::scanThreadsLocked()
+{
+    DIR* d = opendir("/proc/self/task");
+    if (d == NULL) {
+        ALOGW("can't open /proc/self/task: %s", strerror(errno));
+        return;
+    }
+    struct dirent* de;
+    while ((de = readdir(d)) != NULL) {
+        pid_t tid = atoi(de->d_name);
+        if (tid <= 0 || indexOfLocked(tid) >= 0) {
+            continue;
+        }
+        char path[64];
+        char comm[32];
+        snprintf(path, sizeof(path), "/proc/self/task/%d/comm", tid);
+        FILE* f = fopen(path, "r");
+        if (f == NULL) {
+            continue;
+        }
+        if (fgets(comm, sizeof(comm), f) != NULL) {
+            comm[strcspn(comm, "\n")] = '\0';
+            for (size_t i = 0; i < mPrefixes.size(); i++) {
+                if (!strncmp(comm, mPrefixes[i].string(), mPrefixes[i].length())) {
+                    addThreadLocked(tid, comm);
+                    break;
+                }
+            }
+        }
+        fclose(f);
+    }
+    closedir(d);
+}
+
+/*static*/
+bool ThreadCpuSampler::readThread(pid_t tid, uint64_t* ns, int* cpu)
+{
+    char path[64];
+    char buf[512];
+
+    // the CPU last run on is field 39 of stat, after the parenthesized name
+    snprintf(path, sizeof(path), "/proc/self/task/%d/stat", tid);
+    FILE* f = fopen(path, "r");
+    if (f == NULL) {
+        return false;
+    }
+    char* line = fgets(buf, sizeof(buf), f);
+    fclose(f);
+    const char* p = line ? strrchr(line, ')') : NULL;
+    if (p == NULL) {
+        return false;
+    }
+    unsigned long utime = 0, stime = 0;
+    *cpu = -1;
+    // p + 2 is field 3
+    p += 2;
+    for (int field = 3; *p && field <= 39; field++) {
+        if (field == 14) utime = strtoul(p, NULL, 10);
+        else if (field == 15) stime = strtoul(p, NULL, 10);
+        else if (field == 39) *cpu = atoi(p);
+        p = strchr(p, ' ');
+        if (p == NULL) break;
+        p++;
+    }
+
+    // schedstat has the time on CPU in ns, when the kernel keeps it
+    snprintf(path, sizeof(path), "/proc/self/task/%d/schedstat", tid);
+    f = fopen(path, "r");
+    unsigned long long runNs;
+    if (f != NULL && fscanf(f, "%llu", &runNs) == 1) {
+        *ns = runNs;
+    } else {
+        *ns = (uint64_t) (utime + stime) * (1000000000LL / sysconf(_SC_CLK_TCK));
+    }
+    if (f != NULL) {
+        fclose(f);
+    }
+    return true;
+}
+
+void ThreadCpuSampler::sampleLocked(int64_t periodNs)
+{
+    if (!mPrefixes.isEmpty() && (mTicks++ % SCAN_TICKS) == 0) {
+        scanThreadsLocked();
+    }
+    for (size_t i = 0; i < mRecords.size(); i++) {
+        Record& r(mRecords.editItemAt(i));
+        if (r.exited) {
+            continue;
+        }
+        uint64_t ns;
+        int cpu;
+        if (!readThread(r.tid, &ns, &cpu)) {
+            r.exited = true;
+            continue;
+        }
+        if (r.primed && ns >= r.lastNs) {
+            const uint64_t delta = ns - r.lastNs;
+            r.totalNs += delta;
+            uint32_t percent = periodNs > 0 ? uint32_t(delta * 100 / periodNs) : 0;
+            if (percent >= HISTOGRAM_BINS) {
+                percent = HISTOGRAM_BINS - 1;
+            }
+            r.histogram[percent]++;
+            r.samples++;
+            if (percent > r.maxPercent) {
+                r.maxPercent = percent;
+            }
+            if (delta && cpu >= 0 && cpu < MAX_CPU) {
+                r.cpuNs[cpu] += delta;
+                const uint32_t kHz = mCpuUsage.getCpukHz(cpu);
+                ssize_t j = r.kHzNs.indexOfKey(kHz);
+                if (j >= 0) {
+                    r.kHzNs.editValueAt(j) += delta;
+                } else {
+                    r.kHzNs.add(kHz, delta);
+                }
+            }
+        }
+        r.lastNs = ns;
+        r.primed = true;
+    }
+}
+
+/*static*/
+uint32_t ThreadCpuSampler::percentile(const Record& r, int p)
+{
+    const uint64_t rank = ((uint64_t) r.samples * p + 99) / 100;
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BINS; i++) {
+        seen += r.histogram[i];
+        if (seen >= rank && seen > 0) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+void ThreadCpuSampler::dump(String8& result) const
+{
+    pthread_mutex_lock(&mLock);
+    const double elapsed = (monotonicNs() - mStartNs) / 1e9;
+    result.appendFormat("Thread CPU usage (every %u ms, for %.1f s, %s):\n",
+            mPeriodMs, elapsed, mRunning ? "running" : "stopped");
+    result.append("   tid name            cpu ms   avg%  p50%  p90%  p99%  max%\n");
+    for (size_t i = 0; i < mRecords.size(); i++) {
+        const Record& r(mRecords[i]);
+        result.appendFormat("%6d %-15s %8.1f %6.1f %5u %5u %5u %5u%s\n",
+                r.tid, r.name.string(), r.totalNs / 1e6,
+                elapsed > 0 ? r.totalNs / 1e7 / elapsed : 0.0,
+                percentile(r, 50), percentile(r, 90), percentile(r, 99), r.maxPercent,
+                r.exited ? " (exited)" : "");
+        if (r.totalNs == 0) {
+            continue;
+        }
+        result.append("         by cpu:");
+        for (int cpu = 0; cpu < MAX_CPU; cpu++) {
+            if (r.cpuNs[cpu]) {
+                result.appendFormat(" cpu%d=%.1fms", cpu, r.cpuNs[cpu] / 1e6);
+            }
+        }
+        result.append("\n         by kHz:");
+        for (size_t j = 0; j < r.kHzNs.size(); j++) {
+            result.appendFormat(" %u=%.1fms", r.kHzNs.keyAt(j), r.kHzNs.valueAt(j) / 1e6);
+        }
+        result.append("\n");
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+}   // namespace android
@@ -7,19 +7,23 @@ LOCAL_SRC_FILES:= \
 	ConsumerBase.cpp \
 	DisplayEventReceiver.cpp \
 	IDisplayEventConnection.cpp \
+	IScreenCaptureListener.cpp \
 	ISensorEventConnection.cpp \
 	ISensorServer.cpp \
 	ISurfaceTexture.cpp \
 	Sensor.cpp \
 	SensorEventQueue.cpp \
+	SensorEventRing.cpp \
 	SensorManager.cpp \
 	SurfaceTexture.cpp \
 	SurfaceTextureClient.cpp \
 	ISurfaceComposer.cpp \
 	ISurface.cpp \
 	ISurfaceComposerClient.cpp \
+	ITransactionCompletedListener.cpp \
 	IGraphicBufferAlloc.cpp \
 	LayerState.cpp \
+	LayerStateChannel.cpp \
 	Surface.cpp \
 	SurfaceComposerClient.cpp \
 	DummyConsumer.cpp \
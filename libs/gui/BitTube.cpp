@@ -15,8 +15,11 @@
  */
 
 #include <stdint.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
 
 #include <fcntl.h>
 #include <unistd.h>
@@ -34,6 +37,65 @@ namespace android {
 // we really need.  So we make it smaller.
 static const size_t SOCKET_BUFFER_SIZE = 4 * 1024;
 
+#if defined(__NR_sendmmsg) && defined(__NR_recvmmsg)
+#define HAVE_MMSG 1
+
+// Objects moved per sendmmsg/recvmmsg call
+static const size_t MAX_BATCH = 32;
+
+// the kernel's struct mmsghdr, which the C library doesn't always declare
+struct bittube_mmsghdr {
+    struct msghdr msg_hdr;
+    unsigned int msg_len;
+};
+
+// set when the kernel predates sendmmsg or recvmmsg
+static bool sNoMmsg = false;
+
+/*
+ * Moves up to count objects of objSize bytes, one message each, with as
+ * few system calls as possible. Returns how many were moved, which can be
+ * fewer when the socket is full or empty, or a negative error if none was.
+ */
+static ssize_t transferBatched(int fd, bool send, char* objects, size_t count,
+        size_t objSize)
+{
+    size_t done = 0;
+    while (done < count) {
+        bittube_mmsghdr msgs[MAX_BATCH];
+        struct iovec iovs[MAX_BATCH];
+        const size_t n = count - done < MAX_BATCH ? count - done : MAX_BATCH;
+        memset(msgs, 0, n * sizeof(msgs[0]));
+        for (size_t i=0 ; i<n ; i++) {
+            iovs[i].iov_base = objects + (done + i) * objSize;
+            iovs[i].iov_len = objSize;
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int result, err;
+        do {
+            result = send ?
+                    syscall(__NR_sendmmsg, fd, msgs, n, MSG_DONTWAIT | MSG_NOSIGNAL) :
+                    syscall(__NR_recvmmsg, fd, msgs, n, MSG_DONTWAIT, NULL);
+            err = result < 0 ? errno : 0;
+        } while (err == EINTR);
+        if (err == EAGAIN || err == EWOULDBLOCK) {
+            // no more space, or no more messages: like write() and read(),
+            // an error only if nothing was transferred at all
+            return done ? ssize_t(done) : -err;
+        }
+        if (err) {
+            return done ? ssize_t(done) : -err;
+        }
+        done += result;
+        if (size_t(result) < n) {
+            break;
+        }
+    }
+    return done;
+}
+#endif
+
 
 BitTube::BitTube()
     : mSendFd(-1), mReceiveFd(-1)
@@ -134,6 +196,17 @@ status_t BitTube::writeToParcel(Parcel* reply) const
 ssize_t BitTube::sendObjects(const sp<BitTube>& tube,
         void const* events, size_t count, size_t objSize)
 {
+#ifdef HAVE_MMSG
+    if (count > 1 && !sNoMmsg) {
+        ssize_t n = transferBatched(tube->mSendFd, true,
+                const_cast<char*>(reinterpret_cast<const char*>(events)),
+                count, objSize);
+        if (n != -ENOSYS) {
+            return n;
+        }
+        sNoMmsg = true;
+    }
+#endif
     ssize_t numObjects = 0;
     for (size_t i=0 ; i<count ; i++) {
         const char* vaddr = reinterpret_cast<const char*>(events) + objSize * i;
@@ -153,6 +226,16 @@ ssize_t BitTube::sendObjects(const sp<BitTube>& tube,
 ssize_t BitTube::recvObjects(const sp<BitTube>& tube,
         void* events, size_t count, size_t objSize)
 {
+#ifdef HAVE_MMSG
+    if (count > 1 && !sNoMmsg) {
+        ssize_t n = transferBatched(tube->mReceiveFd, false,
+                reinterpret_cast<char*>(events), count, objSize);
+        if (n != -ENOSYS) {
+            return n;
+        }
+        sNoMmsg = true;
+    }
+#endif
     ssize_t numObjects = 0;
     for (size_t i=0 ; i<count ; i++) {
         char* vaddr = reinterpret_cast<char*>(events) + objSize * i;
@@ -31,7 +31,8 @@ namespace android {
 
 BufferItemConsumer::BufferItemConsumer(uint32_t consumerUsage,
         int bufferCount, bool synchronousMode) :
-    ConsumerBase(new BufferQueue(true) )
+    ConsumerBase(new BufferQueue(true) ),
+    mFramesPending(false)
 {
     mBufferQueue->setConsumerUsageBits(consumerUsage);
     mBufferQueue->setSynchronousMode(synchronousMode);
@@ -56,7 +57,9 @@ status_t BufferItemConsumer::acquireBuffer(BufferItem *item, bool waitForFence)
 
     err = acquireBufferLocked(item);
     if (err != OK) {
-        if (err != NO_BUFFER_AVAILABLE) {
+        if (err == NO_BUFFER_AVAILABLE) {
+            mFramesPending = false;
+        } else {
             BI_LOGE("Error acquiring buffer: %s (%d)", strerror(err), err);
         }
         return err;
@@ -76,6 +79,44 @@ status_t BufferItemConsumer::acquireBuffer(BufferItem *item, bool waitForFence)
     return OK;
 }
 
+status_t BufferItemConsumer::acquireBuffers(size_t max,
+        Vector<BufferItem>& items, bool waitForFence) {
+    status_t err;
+
+    items.clear();
+    if (!max) return BAD_VALUE;
+
+    Mutex::Autolock _l(mMutex);
+
+    err = acquireBuffersLocked(max, &items);
+    if (err == NO_BUFFER_AVAILABLE) {
+        mFramesPending = false;
+    }
+    if (items.isEmpty()) {
+        if (err != NO_BUFFER_AVAILABLE) {
+            BI_LOGE("Error acquiring buffers: %s (%d)", strerror(-err), err);
+        }
+        return err;
+    }
+
+    for (size_t i = 0; i < items.size(); i++) {
+        BufferItem& item(items.editItemAt(i));
+        if (waitForFence && item.mFence.get()) {
+            err = item.mFence->waitForever(1000,
+                    "BufferItemConsumer::acquireBuffers");
+            if (err != OK) {
+                // the buffers stay acquired, the caller must release them
+                BI_LOGE("Failed to wait for fence of acquired buffer: %s (%d)",
+                        strerror(-err), err);
+                return err;
+            }
+        }
+        item.mGraphicBuffer = mSlots[item.mBuf].mGraphicBuffer;
+    }
+
+    return OK;
+}
+
 status_t BufferItemConsumer::releaseBuffer(const BufferItem &item,
         const sp<Fence>& releaseFence) {
     status_t err;
@@ -93,4 +134,28 @@ status_t BufferItemConsumer::releaseBuffer(const BufferItem &item,
     return err;
 }
 
+void BufferItemConsumer::setFramesAvailableListener(
+        const sp<FramesAvailableListener>& listener) {
+    Mutex::Autolock _l(mMutex);
+    mFramesAvailableListener = listener;
+}
+
+void BufferItemConsumer::onFrameAvailable() {
+    ConsumerBase::onFrameAvailable();
+
+    sp<FramesAvailableListener> listener;
+    { // scope for the lock
+        Mutex::Autolock _l(mMutex);
+        if (mFramesPending) {
+            return;
+        }
+        mFramesPending = true;
+        listener = mFramesAvailableListener;
+    }
+
+    if (listener != NULL) {
+        listener->onFramesAvailable();
+    }
+}
+
 } // namespace android
@@ -28,7 +28,13 @@
 #include <gui/ISurfaceComposer.h>
 #include <private/gui/ComposerService.h>
 
+#include <cutils/atomic.h>
+
+#include <ui/PixelFormat.h>
+
 #include <utils/Log.h>
+#include <utils/Profiler.h>
+#include <utils/ProtoOutput.h>
 #include <gui/SurfaceTexture.h>
 #include <utils/Trace.h>
 
@@ -136,17 +142,26 @@ BufferQueue::BufferQueue(bool allowSynchronousMode,
     mDefaultMaxBufferCount(2),
     mOverrideMaxBufferCount(0),
     mSynchronousMode(false),
+    mQueueMode(ISurfaceTexture::QUEUE_MODE_DEFAULT),
+    mQueueDepth(1),
     mAllowSynchronousMode(allowSynchronousMode),
     mConnectedApi(NO_CONNECTED_API),
     mAbandoned(false),
+    mMutex(Mutex::PRIO_INHERIT | Mutex::ADAPTIVE | Mutex::TRACK_CONTENTION,
+            "BufferQueue::mMutex"),
     mFrameCounter(0),
+    mDequeueBlockedTime(0),
     mBufferHasBeenQueued(false),
+    mReleaseAllOnDequeue(false),
     mDefaultBufferFormat(PIXEL_FORMAT_RGBA_8888),
     mConsumerUsageBits(0),
-    mTransformHint(0)
+    mTransformHint(0),
+    mQueuedCount(0),
+    mAcquiredCount(0)
 {
     // Choose a name using the PID and a process-unique ID.
     mConsumerName = String8::format("unnamed-%d-%d", getpid(), createProcessUniqueId());
+    memset(mDroppedFrames, 0, sizeof(mDroppedFrames));
 
     ST_LOGV("BufferQueue");
     if (allocator == NULL) {
@@ -177,9 +192,17 @@ status_t BufferQueue::setDefaultMaxBufferCountLocked(int count) {
     return OK;
 }
 
+sp<Fence> BufferQueue::getQueuedBufferFence() const {
+    Mutex::Autolock lock(mMutex);
+    if (mQueue.empty()) {
+        return NULL;
+    }
+    return mSlots[*mQueue.begin()].mFence;
+}
+
 bool BufferQueue::isSynchronousMode() const {
     Mutex::Autolock lock(mMutex);
-    return mSynchronousMode;
+    return getQueueModeLocked() == ISurfaceTexture::QUEUE_MODE_FIFO;
 }
 
 void BufferQueue::setConsumerName(const String8& name) {
@@ -334,6 +357,7 @@ status_t BufferQueue::requestBuffer(int slot, sp<GraphicBuffer>* buf) {
 status_t BufferQueue::dequeueBuffer(int *outBuf, sp<Fence>& outFence,
         uint32_t w, uint32_t h, uint32_t format, uint32_t usage) {
     ATRACE_CALL();
+    PROFILE_SCOPE("bufferqueue", "dequeueBuffer");
     ST_LOGV("dequeueBuffer: w=%d h=%d fmt=%#x usage=%#x", w, h, format, usage);
 
     if ((w && !h) || (!w && h)) {
@@ -342,6 +366,7 @@ status_t BufferQueue::dequeueBuffer(int *outBuf, sp<Fence>& outFence,
     }
 
     status_t returnFlags(OK);
+    bool needsAllocation = false;
     EGLDisplay dpy = EGL_NO_DISPLAY;
     EGLSyncKHR eglFence = EGL_NO_SYNC_KHR;
 
@@ -366,14 +391,19 @@ status_t BufferQueue::dequeueBuffer(int *outBuf, sp<Fence>& outFence,
             const int maxBufferCount = getMaxBufferCountLocked();
 
             // Free up any buffers that are in slots beyond the max buffer
-            // count.
+            // count. When the consumer lowers the default count, some of
+            // them may still be acquired, they're freed once released.
             for (int i = maxBufferCount; i < NUM_BUFFER_SLOTS; i++) {
-                assert(mSlots[i].mBufferState == BufferSlot::FREE);
-                if (mSlots[i].mGraphicBuffer != NULL) {
+                if (mSlots[i].mBufferState == BufferSlot::FREE &&
+                        mSlots[i].mGraphicBuffer != NULL) {
                     freeBufferLocked(i);
                     returnFlags |= ISurfaceTexture::RELEASE_ALL_BUFFERS;
                 }
             }
+            if (mReleaseAllOnDequeue) {
+                mReleaseAllOnDequeue = false;
+                returnFlags |= ISurfaceTexture::RELEASE_ALL_BUFFERS;
+            }
 
             // look for a free buffer to give to the client
             found = INVALID_BUFFER_SLOT;
@@ -425,8 +455,24 @@ status_t BufferQueue::dequeueBuffer(int *outBuf, sp<Fence>& outFence,
             // If no buffer is found, wait for a buffer to be released or for
             // the max buffer count to change.
             tryAgain = found == INVALID_BUFFER_SLOT;
+            if (tryAgain && (mQueueMode == ISurfaceTexture::QUEUE_MODE_MAILBOX ||
+                    mQueueMode == ISurfaceTexture::QUEUE_MODE_DROP_OLDEST)) {
+                // These modes never block, take back the oldest frame the
+                // consumer hasn't acquired yet instead.
+                if (mQueue.isEmpty()) {
+                    ST_LOGE("dequeueBuffer: no free or queued buffer to "
+                            "dequeue (queue mode %d)", mQueueMode);
+                    return -EBUSY;
+                }
+                found = mQueue[0];
+                dropQueuedBufferLocked(0);
+                tryAgain = false;
+            }
             if (tryAgain) {
+                const nsecs_t blockedSince = systemTime(SYSTEM_TIME_MONOTONIC);
                 mDequeueCondition.wait(mMutex);
+                mDequeueBlockedTime += systemTime(SYSTEM_TIME_MONOTONIC) -
+                        blockedSince;
             }
         }
 
@@ -451,7 +497,7 @@ status_t BufferQueue::dequeueBuffer(int *outBuf, sp<Fence>& outFence,
 
         // buffer is now in DEQUEUED (but can also be current at the same time,
         // if we're in synchronous mode)
-        mSlots[buf].mBufferState = BufferSlot::DEQUEUED;
+        setBufferStateLocked(buf, BufferSlot::DEQUEUED);
 
         const sp<GraphicBuffer>& buffer(mSlots[buf].mGraphicBuffer);
 #ifdef QCOM_BSP
@@ -487,7 +533,13 @@ status_t BufferQueue::dequeueBuffer(int *outBuf, sp<Fence>& outFence,
             mSlots[buf].mEglDisplay = EGL_NO_DISPLAY;
 
             returnFlags |= ISurfaceTexture::BUFFER_NEEDS_REALLOCATION;
+            needsAllocation = true;
+        } else if (mSlots[buf].mPreallocated) {
+            // the buffer was allocated by allocateBuffers(), the client
+            // doesn't have it yet and must call requestBuffer.
+            returnFlags |= ISurfaceTexture::BUFFER_NEEDS_REALLOCATION;
         }
+        mSlots[buf].mPreallocated = false;
 
         dpy = mSlots[buf].mEglDisplay;
         eglFence = mSlots[buf].mEglFence;
@@ -496,7 +548,7 @@ status_t BufferQueue::dequeueBuffer(int *outBuf, sp<Fence>& outFence,
         mSlots[buf].mFence.clear();
     }  // end lock scope
 
-    if (returnFlags & ISurfaceTexture::BUFFER_NEEDS_REALLOCATION) {
+    if (needsAllocation) {
         status_t error;
         sp<GraphicBuffer> graphicBuffer(
                 mGraphicBufferAlloc->createGraphicBuffer(
@@ -539,6 +591,109 @@ status_t BufferQueue::dequeueBuffer(int *outBuf, sp<Fence>& outFence,
     return returnFlags;
 }
 
+void BufferQueue::allocateBuffers(uint32_t w, uint32_t h, uint32_t format,
+        uint32_t usage, int count) {
+    ATRACE_CALL();
+    ST_LOGV("allocateBuffers: w=%d h=%d fmt=%#x usage=%#x count=%d",
+            w, h, format, usage, count);
+
+    if ((w && !h) || (!w && h)) {
+        ST_LOGE("allocateBuffers: invalid size: w=%u, h=%u", w, h);
+        return;
+    }
+
+    // pick the free slots that would need a (re)allocation if they were
+    // dequeued with this geometry. Their buffers are remembered by id, an
+    // address could be reused by a buffer allocated meanwhile.
+    int slots[NUM_BUFFER_SLOTS];
+    uint64_t previous[NUM_BUFFER_SLOTS];
+    int numSlots = 0;
+    { // Scope for the lock
+        Mutex::Autolock lock(mMutex);
+
+        if (mAbandoned) {
+            ST_LOGE("allocateBuffers: SurfaceTexture has been abandoned!");
+            return;
+        }
+
+        if (!w && !h) {
+            w = mDefaultWidth;
+            h = mDefaultHeight;
+        }
+        if (format == 0) {
+            format = mDefaultBufferFormat;
+        }
+        usage |= mConsumerUsageBits;
+
+        const int maxBufferCount = getMaxBufferCountLocked();
+        for (int i = 0; i < maxBufferCount && numSlots < count; i++) {
+            if (mSlots[i].mBufferState != BufferSlot::FREE) {
+                continue;
+            }
+            const sp<GraphicBuffer>& buffer(mSlots[i].mGraphicBuffer);
+            if ((buffer == NULL) ||
+                (uint32_t(buffer->width)  != w) ||
+                (uint32_t(buffer->height) != h) ||
+                (uint32_t(buffer->format) != format) ||
+                ((uint32_t(buffer->usage) & usage) != usage))
+            {
+                slots[numSlots] = i;
+                previous[numSlots] = buffer != NULL ? buffer->getId() : 0;
+                numSlots++;
+            }
+        }
+    } // end lock scope
+
+    if (numSlots == 0) {
+        return;
+    }
+
+    // allocate without holding the lock, the producer may keep dequeueing
+    // and queueing meanwhile. A single call takes care of all the slots.
+    Vector< sp<GraphicBuffer> > buffers;
+    status_t error = mGraphicBufferAlloc->createGraphicBuffers(
+            w, h, format, usage, numSlots, &buffers);
+    if (error != NO_ERROR) {
+        ST_LOGE("allocateBuffers: SurfaceComposer::createGraphicBuffers "
+                "failed (%d of %d allocated)", int(buffers.size()), numSlots);
+    }
+
+    sp<ConsumerListener> listener;
+    { // Scope for the lock
+        Mutex::Autolock lock(mMutex);
+
+        if (mAbandoned) {
+            ST_LOGE("allocateBuffers: SurfaceTexture has been abandoned!");
+            return;
+        }
+
+        bool released = false;
+        for (size_t i = 0; i < buffers.size(); i++) {
+            // only use the buffer if nobody touched the slot in the meantime
+            const int slot = slots[i];
+            const sp<GraphicBuffer>& buffer(mSlots[slot].mGraphicBuffer);
+            if (mSlots[slot].mBufferState != BufferSlot::FREE ||
+                    (buffer != NULL ? buffer->getId() : 0) != previous[i]) {
+                continue;
+            }
+            if (buffer != NULL) {
+                released = true;
+            }
+            freeBufferLocked(slot);
+            mSlots[slot].mGraphicBuffer = buffers[i];
+            mSlots[slot].mPreallocated = true;
+        }
+        if (released) {
+            listener = mConsumerListener;
+        }
+    } // end lock scope
+
+    // call back without lock held
+    if (listener != NULL) {
+        listener->onBuffersReleased();
+    }
+}
+
 #ifdef QCOM_BSP
 status_t BufferQueue::updateBuffersGeometry(int w, int h, int f) {
     ST_LOGV("updateBuffersGeometry: w=%d h=%d f=%d", w, h, f);
@@ -580,18 +735,87 @@ status_t BufferQueue::setSynchronousMode(bool enabled) {
     return err;
 }
 
+status_t BufferQueue::setQueueMode(int mode, int depth) {
+    ATRACE_CALL();
+    ST_LOGV("setQueueMode: mode=%d depth=%d", mode, depth);
+    Mutex::Autolock lock(mMutex);
+
+    if (mAbandoned) {
+        ST_LOGE("setQueueMode: SurfaceTexture has been abandoned!");
+        return NO_INIT;
+    }
+
+    switch (mode) {
+        case ISurfaceTexture::QUEUE_MODE_DEFAULT:
+        case ISurfaceTexture::QUEUE_MODE_MAILBOX:
+            break;
+        case ISurfaceTexture::QUEUE_MODE_FIFO:
+            if (!mAllowSynchronousMode) {
+                ST_LOGE("setQueueMode: FIFO mode is not allowed");
+                return INVALID_OPERATION;
+            }
+            break;
+        case ISurfaceTexture::QUEUE_MODE_DROP_OLDEST:
+            if (depth < 1 || depth >= NUM_BUFFER_SLOTS) {
+                ST_LOGE("setQueueMode: invalid depth %d", depth);
+                return BAD_VALUE;
+            }
+            break;
+        default:
+            ST_LOGE("setQueueMode: unknown mode %d", mode);
+            return BAD_VALUE;
+    }
+
+    const int oldMode = getQueueModeLocked();
+    int newMode = mode;
+    if (newMode == ISurfaceTexture::QUEUE_MODE_DEFAULT) {
+        newMode = mSynchronousMode ? ISurfaceTexture::QUEUE_MODE_FIFO :
+                ISurfaceTexture::QUEUE_MODE_MAILBOX;
+    }
+
+    if (oldMode == ISurfaceTexture::QUEUE_MODE_FIFO &&
+            newMode != ISurfaceTexture::QUEUE_MODE_FIFO) {
+        // leaving FIFO mode, frames already queued are not dropped
+        status_t err = drainQueueLocked();
+        if (err != NO_ERROR)
+            return err;
+    }
+
+    // the new mode may keep fewer queued frames than the old one, drop the
+    // oldest ones
+    size_t maxQueued = NUM_BUFFER_SLOTS;
+    if (newMode == ISurfaceTexture::QUEUE_MODE_MAILBOX) {
+        maxQueued = 1;
+    } else if (newMode == ISurfaceTexture::QUEUE_MODE_DROP_OLDEST) {
+        maxQueued = depth;
+    }
+
+    mQueueMode = mode;
+    if (mode == ISurfaceTexture::QUEUE_MODE_DROP_OLDEST) {
+        mQueueDepth = depth;
+    }
+    while (mQueue.size() > maxQueued) {
+        dropQueuedBufferLocked(0);
+    }
+    mDequeueCondition.broadcast();
+    return OK;
+}
+
 status_t BufferQueue::queueBuffer(int buf,
         const QueueBufferInput& input, QueueBufferOutput* output) {
     ATRACE_CALL();
+    PROFILE_SCOPE("bufferqueue", "queueBuffer");
     ATRACE_BUFFER_INDEX(buf);
 
     Rect crop;
     uint32_t transform;
     int scalingMode;
     int64_t timestamp;
+    bool isAutoTimestamp;
     sp<Fence> fence;
 
-    input.deflate(&timestamp, &crop, &scalingMode, &transform, &fence);
+    input.deflate(&timestamp, &isAutoTimestamp, &crop, &scalingMode,
+            &transform, &fence);
 
     ST_LOGV("queueBuffer: slot=%d time=%#llx crop=[%d,%d,%d,%d] tr=%#x "
             "scale=%s",
@@ -655,13 +879,22 @@ status_t BufferQueue::queueBuffer(int buf,
             return -EINVAL;
         }
 
-        if (mSynchronousMode) {
+        const int queueMode = getQueueModeLocked();
+        if (queueMode == ISurfaceTexture::QUEUE_MODE_FIFO) {
             // In synchronous mode we queue all buffers in a FIFO.
             mQueue.push_back(buf);
 
             // Synchronous mode always signals that an additional frame should
             // be consumed.
             listener = mConsumerListener;
+        } else if (queueMode == ISurfaceTexture::QUEUE_MODE_DROP_OLDEST) {
+            // Keep up to mQueueDepth buffers, making room by dropping the
+            // oldest ones.
+            while (mQueue.size() >= size_t(mQueueDepth)) {
+                dropQueuedBufferLocked(0);
+            }
+            mQueue.push_back(buf);
+            listener = mConsumerListener;
         } else {
             // In asynchronous mode we only keep the most recent buffer.
             if (mQueue.empty()) {
@@ -674,15 +907,17 @@ status_t BufferQueue::queueBuffer(int buf,
             } else {
                 Fifo::iterator front(mQueue.begin());
                 // buffer currently queued is freed
-                mSlots[*front].mBufferState = BufferSlot::FREE;
+                setBufferStateLocked(*front, BufferSlot::FREE);
                 // reset the frame number of the freed buffer
                 mSlots[*front].mFrameNumber = 0;
+                mDroppedFrames[queueMode]++;
                 // and we record the new buffer index in the queued list
                 *front = buf;
             }
         }
 
         mSlots[buf].mTimestamp = timestamp;
+        mSlots[buf].mIsAutoTimestamp = isAutoTimestamp;
         mSlots[buf].mCrop = crop;
         mSlots[buf].mTransform = transform;
         mSlots[buf].mFence = fence;
@@ -698,7 +933,7 @@ status_t BufferQueue::queueBuffer(int buf,
                 break;
         }
 
-        mSlots[buf].mBufferState = BufferSlot::QUEUED;
+        setBufferStateLocked(buf, BufferSlot::QUEUED);
         mSlots[buf].mScalingMode = scalingMode;
         mFrameCounter++;
         mSlots[buf].mFrameNumber = mFrameCounter;
@@ -739,7 +974,7 @@ void BufferQueue::cancelBuffer(int buf, sp<Fence> fence) {
                 buf, mSlots[buf].mBufferState);
         return;
     }
-    mSlots[buf].mBufferState = BufferSlot::FREE;
+    setBufferStateLocked(buf, BufferSlot::FREE);
     mSlots[buf].mFrameNumber = 0;
     mSlots[buf].mFence = fence;
     mDequeueCondition.broadcast();
@@ -865,6 +1100,18 @@ void BufferQueue::dump(String8& result, const char* prefix,
             fifoSize, fifo.string());
     result.append(buffer);
 
+    static const char* const queueModeNames[] = {
+            "default", "fifo", "mailbox", "drop-oldest" };
+    snprintf(buffer, SIZE,
+            "%s queue-mode=%s (%s), depth=%d, dropped: fifo=%u mailbox=%u "
+            "drop-oldest=%u\n",
+            prefix, queueModeNames[mQueueMode],
+            queueModeNames[getQueueModeLocked()], mQueueDepth,
+            mDroppedFrames[ISurfaceTexture::QUEUE_MODE_FIFO],
+            mDroppedFrames[ISurfaceTexture::QUEUE_MODE_MAILBOX],
+            mDroppedFrames[ISurfaceTexture::QUEUE_MODE_DROP_OLDEST]);
+    result.append(buffer);
+
 
     struct {
         const char * operator()(int state) const {
@@ -904,15 +1151,83 @@ void BufferQueue::dump(String8& result, const char* prefix,
     }
 }
 
+void BufferQueue::dumpProto(ProtoOutput& proto) const
+{
+    Mutex::Autolock _l(mMutex);
+
+    const int maxBufferCount = getMaxBufferCountLocked();
+    proto.writeInt32(1, maxBufferCount);
+    proto.writeBool(2, mSynchronousMode);
+    proto.writeUInt32(3, mDefaultWidth);
+    proto.writeUInt32(4, mDefaultHeight);
+    proto.writeUInt32(5, mDefaultBufferFormat);
+    proto.writeUInt32(6, mTransformHint);
+    proto.writeInt32(7, getQueueModeLocked());
+    proto.writeInt32(8, mQueueDepth);
+    for (Fifo::const_iterator i(mQueue.begin()) ; i != mQueue.end() ; ++i) {
+        proto.writeInt32(9, *i);
+    }
+
+    for (int i=0 ; i<maxBufferCount ; i++) {
+        const BufferSlot& slot(mSlots[i]);
+        const size_t token = proto.beginMessage(10);
+        proto.writeInt32(1, slot.mBufferState);
+        proto.writeUInt64(2, slot.mFrameNumber);
+        proto.writeInt64(3, slot.mTimestamp);
+        const size_t crop = proto.beginMessage(4);
+        proto.writeInt32(1, slot.mCrop.left);
+        proto.writeInt32(2, slot.mCrop.top);
+        proto.writeInt32(3, slot.mCrop.right);
+        proto.writeInt32(4, slot.mCrop.bottom);
+        proto.endMessage(crop);
+        proto.writeUInt32(5, slot.mTransform);
+        proto.writeUInt32(6, slot.mScalingMode);
+        const sp<GraphicBuffer>& buf(slot.mGraphicBuffer);
+        if (buf != NULL) {
+            const size_t buffer = proto.beginMessage(7);
+            proto.writeUInt32(1, buf->width);
+            proto.writeUInt32(2, buf->height);
+            proto.writeUInt32(3, buf->stride);
+            proto.writeInt32(4, buf->format);
+            proto.endMessage(buffer);
+        }
+        proto.endMessage(token);
+    }
+
+    for (int mode=0 ; mode<=ISurfaceTexture::QUEUE_MODE_DROP_OLDEST ; mode++) {
+        proto.writeUInt32(11, mDroppedFrames[mode]);
+    }
+}
+
+void BufferQueue::setBufferStateLocked(int slot,
+        BufferSlot::BufferState state) {
+    const BufferSlot::BufferState old = mSlots[slot].mBufferState;
+    if (old == state) {
+        return;
+    }
+    if (old == BufferSlot::QUEUED) {
+        android_atomic_dec(&mQueuedCount);
+    } else if (old == BufferSlot::ACQUIRED) {
+        android_atomic_dec(&mAcquiredCount);
+    }
+    if (state == BufferSlot::QUEUED) {
+        android_atomic_inc(&mQueuedCount);
+    } else if (state == BufferSlot::ACQUIRED) {
+        android_atomic_inc(&mAcquiredCount);
+    }
+    mSlots[slot].mBufferState = state;
+}
+
 void BufferQueue::freeBufferLocked(int slot) {
     ST_LOGV("freeBufferLocked: slot=%d", slot);
     mSlots[slot].mGraphicBuffer = 0;
     if (mSlots[slot].mBufferState == BufferSlot::ACQUIRED) {
         mSlots[slot].mNeedsCleanupOnRelease = true;
     }
-    mSlots[slot].mBufferState = BufferSlot::FREE;
+    setBufferStateLocked(slot, BufferSlot::FREE);
     mSlots[slot].mFrameNumber = 0;
     mSlots[slot].mAcquireCalled = false;
+    mSlots[slot].mPreallocated = false;
 
     // destroy fence as BufferQueue now takes ownership
     if (mSlots[slot].mEglFence != EGL_NO_SYNC_KHR) {
@@ -932,20 +1247,57 @@ void BufferQueue::freeAllBuffersLocked() {
     }
 }
 
-status_t BufferQueue::acquireBuffer(BufferItem *buffer) {
+status_t BufferQueue::acquireBuffer(BufferItem *buffer, nsecs_t presentWhen) {
     ATRACE_CALL();
+    PROFILE_SCOPE("bufferqueue", "acquireBuffer");
+
+    // Fast path: consumers commonly poll for a new frame that isn't there.
+    // Answer that without taking mMutex, so that the consumer doesn't
+    // contend with (and possibly wait behind a low priority) producer.
+    // A buffer queued concurrently is not lost, queueBuffer notifies the
+    // consumer after publishing it. mMaxAcquiredBufferCount can only change
+    // while no producer is connected, i.e. while nothing can be queued.
+    if (android_atomic_acquire_load(&mQueuedCount) == 0 &&
+            android_atomic_acquire_load(&mAcquiredCount) <
+                    mMaxAcquiredBufferCount+1) {
+        return NO_BUFFER_AVAILABLE;
+    }
+
     Mutex::Autolock _l(mMutex);
+    return acquireBufferLocked(buffer, presentWhen);
+}
+
+status_t BufferQueue::acquireBuffers(size_t max, Vector<BufferItem>* items) {
+    ATRACE_CALL();
+    PROFILE_SCOPE("bufferqueue", "acquireBuffers");
 
+    Mutex::Autolock _l(mMutex);
+    const size_t first = items->size();
+    for (size_t i=0 ; i<max ; i++) {
+        // stop quietly once some were acquired, acquireBufferLocked would
+        // log running into the limit as an error
+        if (i && (mQueue.empty() ||
+                mAcquiredCount >= mMaxAcquiredBufferCount+1)) {
+            return mQueue.empty() ? status_t(NO_BUFFER_AVAILABLE) :
+                    INVALID_OPERATION;
+        }
+        items->add();
+        status_t err = acquireBufferLocked(&items->editItemAt(first + i), 0);
+        if (err != OK) {
+            items->removeAt(first + i);
+            return err;
+        }
+    }
+    return OK;
+}
+
+status_t BufferQueue::acquireBufferLocked(BufferItem *buffer,
+        nsecs_t presentWhen) {
     // Check that the consumer doesn't currently have the maximum number of
     // buffers acquired.  We allow the max buffer count to be exceeded by one
     // buffer, so that the consumer can successfully set up the newly acquired
     // buffer before releasing the old one.
-    int numAcquiredBuffers = 0;
-    for (int i = 0; i < NUM_BUFFER_SLOTS; i++) {
-        if (mSlots[i].mBufferState == BufferSlot::ACQUIRED) {
-            numAcquiredBuffers++;
-        }
-    }
+    int numAcquiredBuffers = mAcquiredCount;
     if (numAcquiredBuffers >= mMaxAcquiredBufferCount+1) {
         ST_LOGE("acquireBuffer: max acquired buffer count reached: %d (max=%d)",
                 numAcquiredBuffers, mMaxAcquiredBufferCount);
@@ -955,6 +1307,30 @@ status_t BufferQueue::acquireBuffer(BufferItem *buffer) {
     // check if queue is empty
     // In asynchronous mode the list is guaranteed to be one buffer
     // deep, while in synchronous mode we use the oldest buffer.
+    if (!mQueue.empty() && presentWhen != 0) {
+        const nsecs_t MAX_REASONABLE_NSEC = 1000000000LL; // 1 second
+
+        // a buffer is late if the next one is due by presentWhen already
+        while (mQueue.size() > 1 && !mSlots[mQueue[0]].mIsAutoTimestamp) {
+            const BufferSlot& next(mSlots[mQueue[1]]);
+            if (next.mIsAutoTimestamp ||
+                    next.mTimestamp > presentWhen ||
+                    next.mTimestamp < presentWhen - MAX_REASONABLE_NSEC) {
+                break;
+            }
+            ST_LOGV("acquireBuffer: dropping late buffer (slot %d)", mQueue[0]);
+            dropQueuedBufferLocked(0);
+        }
+
+        // and it's held while it's due after presentWhen
+        const BufferSlot& front(mSlots[mQueue[0]]);
+        if (!front.mIsAutoTimestamp &&
+                front.mTimestamp > presentWhen &&
+                front.mTimestamp < presentWhen + MAX_REASONABLE_NSEC) {
+            return PRESENT_LATER;
+        }
+    }
+
     if (!mQueue.empty()) {
         Fifo::iterator front(mQueue.begin());
         int buf = *front;
@@ -971,12 +1347,13 @@ status_t BufferQueue::acquireBuffer(BufferItem *buffer) {
         buffer->mScalingMode = mSlots[buf].mScalingMode;
         buffer->mFrameNumber = mSlots[buf].mFrameNumber;
         buffer->mTimestamp = mSlots[buf].mTimestamp;
+        buffer->mIsAutoTimestamp = mSlots[buf].mIsAutoTimestamp;
         buffer->mBuf = buf;
         buffer->mFence = mSlots[buf].mFence;
 
         mSlots[buf].mAcquireCalled = true;
         mSlots[buf].mNeedsCleanupOnRelease = false;
-        mSlots[buf].mBufferState = BufferSlot::ACQUIRED;
+        setBufferStateLocked(buf, BufferSlot::ACQUIRED);
         mSlots[buf].mFence.clear();
 
         mQueue.erase(front);
@@ -993,10 +1370,42 @@ status_t BufferQueue::acquireBuffer(BufferItem *buffer) {
 status_t BufferQueue::releaseBuffer(int buf, EGLDisplay display,
         EGLSyncKHR eglFence, const sp<Fence>& fence) {
     ATRACE_CALL();
+    PROFILE_SCOPE("bufferqueue", "releaseBuffer");
     ATRACE_BUFFER_INDEX(buf);
 
     Mutex::Autolock _l(mMutex);
+    status_t err = releaseBufferLocked(buf, display, eglFence, fence);
+    if (err == OK) {
+        mDequeueCondition.broadcast();
+    }
+    return err;
+}
 
+status_t BufferQueue::releaseBuffers(ReleaseItem* items, size_t count) {
+    ATRACE_CALL();
+    PROFILE_SCOPE("bufferqueue", "releaseBuffers");
+
+    Mutex::Autolock _l(mMutex);
+    status_t err = OK;
+    bool released = false;
+    for (size_t i=0 ; i<count ; i++) {
+        ReleaseItem& item(items[i]);
+        item.mResult = releaseBufferLocked(item.mBuf, item.mEglDisplay,
+                item.mEglFence, item.mFence);
+        if (item.mResult == OK) {
+            released = true;
+        } else if (err == OK) {
+            err = item.mResult;
+        }
+    }
+    if (released) {
+        mDequeueCondition.broadcast();
+    }
+    return err;
+}
+
+status_t BufferQueue::releaseBufferLocked(int buf, EGLDisplay display,
+        EGLSyncKHR eglFence, const sp<Fence>& fence) {
     if (buf == INVALID_BUFFER_SLOT) {
         return -EINVAL;
     }
@@ -1007,7 +1416,7 @@ status_t BufferQueue::releaseBuffer(int buf, EGLDisplay display,
 
     // The buffer can now only be released if its in the acquired state
     if (mSlots[buf].mBufferState == BufferSlot::ACQUIRED) {
-        mSlots[buf].mBufferState = BufferSlot::FREE;
+        setBufferStateLocked(buf, BufferSlot::FREE);
     } else if (mSlots[buf].mNeedsCleanupOnRelease) {
         ST_LOGV("releasing a stale buf %d its state was %d", buf, mSlots[buf].mBufferState);
         mSlots[buf].mNeedsCleanupOnRelease = false;
@@ -1017,7 +1426,6 @@ status_t BufferQueue::releaseBuffer(int buf, EGLDisplay display,
         return -EINVAL;
     }
 
-    mDequeueCondition.broadcast();
     return OK;
 }
 
@@ -1052,6 +1460,38 @@ status_t BufferQueue::consumerDisconnect() {
     return OK;
 }
 
+size_t BufferQueue::freeIdleBuffers() {
+    ATRACE_CALL();
+    sp<ConsumerListener> listener;
+    size_t freed = 0;
+    { // scope for the lock
+        Mutex::Autolock lock(mMutex);
+        if (mAbandoned) {
+            return 0;
+        }
+        for (int i = 0; i < NUM_BUFFER_SLOTS; i++) {
+            const sp<GraphicBuffer>& buf(mSlots[i].mGraphicBuffer);
+            if (buf == NULL || mSlots[i].mBufferState != BufferSlot::FREE) {
+                continue;
+            }
+            const PixelFormatDescriptor* desc(
+                    getPixelFormatDescriptor(buf->getPixelFormat()));
+            if (desc != NULL) {
+                freed += size_t(buf->getStride()) * buf->getHeight() *
+                        desc->bitsPerPixel / 8;
+            }
+            freeBufferLocked(i);
+            mReleaseAllOnDequeue = true;
+            listener = mConsumerListener;
+        }
+    }
+    if (listener != NULL) {
+        ST_LOGV("freeIdleBuffers: freed %u bytes", freed);
+        listener->onBuffersReleased();
+    }
+    return freed;
+}
+
 status_t BufferQueue::getReleasedBuffers(uint32_t* slotMask) {
     ST_LOGV("getReleasedBuffers");
     Mutex::Autolock lock(mMutex);
@@ -1094,6 +1534,11 @@ status_t BufferQueue::setDefaultMaxBufferCount(int bufferCount) {
     return setDefaultMaxBufferCountLocked(bufferCount);
 }
 
+nsecs_t BufferQueue::getDequeueBlockedTime() const {
+    Mutex::Autolock lock(mMutex);
+    return mDequeueBlockedTime;
+}
+
 status_t BufferQueue::setMaxAcquiredBufferCount(int maxAcquiredBuffers) {
     ATRACE_CALL();
     Mutex::Autolock lock(mMutex);
@@ -1124,7 +1569,8 @@ void BufferQueue::freeAllBuffersExceptHeadLocked() {
 }
 
 status_t BufferQueue::drainQueueLocked() {
-    while (mSynchronousMode && !mQueue.isEmpty()) {
+    while (getQueueModeLocked() == ISurfaceTexture::QUEUE_MODE_FIFO &&
+            !mQueue.isEmpty()) {
         mDequeueCondition.wait(mMutex);
         if (mAbandoned) {
             ST_LOGE("drainQueueLocked: BufferQueue has been abandoned!");
@@ -1141,9 +1587,13 @@ status_t BufferQueue::drainQueueLocked() {
 status_t BufferQueue::drainQueueAndFreeBuffersLocked() {
     status_t err = drainQueueLocked();
     if (err == NO_ERROR) {
-        if (mSynchronousMode) {
+        if (getQueueModeLocked() == ISurfaceTexture::QUEUE_MODE_FIFO) {
             freeAllBuffersLocked();
         } else {
+            // only the most recent frame survives
+            while (mQueue.size() > 1) {
+                dropQueuedBufferLocked(0);
+            }
             freeAllBuffersExceptHeadLocked();
         }
     }
@@ -1155,8 +1605,24 @@ int BufferQueue::getMinMaxBufferCountLocked() const {
 }
 
 int BufferQueue::getMinUndequeuedBufferCountLocked() const {
-    return mSynchronousMode ? mMaxAcquiredBufferCount :
-            mMaxAcquiredBufferCount + 1;
+    return getQueueModeLocked() == ISurfaceTexture::QUEUE_MODE_FIFO ?
+            mMaxAcquiredBufferCount : mMaxAcquiredBufferCount + 1;
+}
+
+int BufferQueue::getQueueModeLocked() const {
+    if (mQueueMode != ISurfaceTexture::QUEUE_MODE_DEFAULT) {
+        return mQueueMode;
+    }
+    return mSynchronousMode ? ISurfaceTexture::QUEUE_MODE_FIFO :
+            ISurfaceTexture::QUEUE_MODE_MAILBOX;
+}
+
+void BufferQueue::dropQueuedBufferLocked(size_t index) {
+    const int buf = mQueue[index];
+    setBufferStateLocked(buf, BufferSlot::FREE);
+    mSlots[buf].mFrameNumber = 0;
+    mQueue.removeAt(index);
+    mDroppedFrames[getQueueModeLocked()]++;
 }
 
 int BufferQueue::getMaxBufferCountLocked() const {
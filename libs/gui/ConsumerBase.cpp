@@ -85,6 +85,7 @@ void ConsumerBase::freeBufferLocked(int slotIndex) {
     CB_LOGV("freeBufferLocked: slotIndex=%d", slotIndex);
     mSlots[slotIndex].mGraphicBuffer = 0;
     mSlots[slotIndex].mFence = 0;
+    mSlots[slotIndex].mPendingFences.clear();
 }
 
 // Used for refactoring, should not be in final interface
@@ -175,8 +176,9 @@ void ConsumerBase::dumpLocked(String8& result, const char* prefix,
     }
 }
 
-status_t ConsumerBase::acquireBufferLocked(BufferQueue::BufferItem *item) {
-    status_t err = mBufferQueue->acquireBuffer(item);
+status_t ConsumerBase::acquireBufferLocked(BufferQueue::BufferItem *item,
+        nsecs_t presentWhen) {
+    status_t err = mBufferQueue->acquireBuffer(item, presentWhen);
     if (err != NO_ERROR) {
         return err;
     }
@@ -186,12 +188,31 @@ status_t ConsumerBase::acquireBufferLocked(BufferQueue::BufferItem *item) {
     }
 
     mSlots[item->mBuf].mFence = item->mFence;
+    mSlots[item->mBuf].mPendingFences.clear();
 
     CB_LOGV("acquireBufferLocked: -> slot=%d", item->mBuf);
 
     return OK;
 }
 
+status_t ConsumerBase::acquireBuffersLocked(size_t max,
+        Vector<BufferQueue::BufferItem>* items) {
+    const size_t first = items->size();
+    status_t err = mBufferQueue->acquireBuffers(max, items);
+    for (size_t i=first ; i<items->size() ; i++) {
+        const BufferQueue::BufferItem& item(items->itemAt(i));
+        if (item.mGraphicBuffer != NULL) {
+            mSlots[item.mBuf].mGraphicBuffer = item.mGraphicBuffer;
+        }
+        mSlots[item.mBuf].mFence = item.mFence;
+        mSlots[item.mBuf].mPendingFences.clear();
+    }
+
+    CB_LOGV("acquireBuffersLocked: -> %d buffers", items->size() - first);
+
+    return err;
+}
+
 status_t ConsumerBase::addReleaseFence(int slot, const sp<Fence>& fence) {
     Mutex::Autolock lock(mMutex);
     return addReleaseFenceLocked(slot, fence);
@@ -200,36 +221,69 @@ status_t ConsumerBase::addReleaseFence(int slot, const sp<Fence>& fence) {
 status_t ConsumerBase::addReleaseFenceLocked(int slot, const sp<Fence>& fence) {
     CB_LOGV("addReleaseFenceLocked: slot=%d", slot);
 
-    if (!mSlots[slot].mFence.get()) {
-        mSlots[slot].mFence = fence;
-    } else {
-        sp<Fence> mergedFence = Fence::merge(
-                String8::format("%.28s:%d", mName.string(), slot),
-                mSlots[slot].mFence, fence);
-        if (!mergedFence.get()) {
+    Slot& s(mSlots[slot]);
+    if (!s.mFence.get()) {
+        s.mFence = fence;
+    } else if (fence != s.mFence &&
+            (s.mPendingFences.isEmpty() || fence != s.mPendingFences.top())) {
+        // the merge is deferred until the buffer is released
+        s.mPendingFences.push(fence);
+    }
+
+    return OK;
+}
+
+sp<Fence> ConsumerBase::getReleaseFenceLocked(int slot) {
+    Slot& s(mSlots[slot]);
+    sp<Fence> fence(s.mFence);
+    if (!s.mPendingFences.isEmpty()) {
+        Vector< sp<Fence> > fences;
+        fences.setCapacity(s.mPendingFences.size() + 1);
+        fences.push(s.mFence);
+        fences.appendVector(s.mPendingFences);
+        fence = Fence::merge(
+                String8::format("%.28s:%d", mName.string(), slot), fences);
+        if (fence == Fence::NO_FENCE) {
             CB_LOGE("failed to merge release fences");
             // synchronization is broken, the best we can do is hope fences
-            // signal in order so the new fence will act like a union
-            mSlots[slot].mFence = fence;
-            return BAD_VALUE;
+            // signal in order so the last fence will act like a union
+            fence = s.mPendingFences.top();
         }
-        mSlots[slot].mFence = mergedFence;
+        s.mPendingFences.clear();
     }
-
-    return OK;
+    s.mFence.clear();
+    return fence;
 }
 
 status_t ConsumerBase::releaseBufferLocked(int slot, EGLDisplay display,
        EGLSyncKHR eglFence) {
     CB_LOGV("releaseBufferLocked: slot=%d", slot);
     status_t err = mBufferQueue->releaseBuffer(slot, display, eglFence,
-            mSlots[slot].mFence);
+            getReleaseFenceLocked(slot));
     if (err == BufferQueue::STALE_BUFFER_SLOT) {
         freeBufferLocked(slot);
     }
 
-    mSlots[slot].mFence.clear();
+    return err;
+}
 
+status_t ConsumerBase::releaseBuffersLocked(const int* slots, size_t count) {
+    CB_LOGV("releaseBuffersLocked: count=%d", count);
+    Vector<BufferQueue::ReleaseItem> items;
+    items.insertAt(0, count);
+    for (size_t i=0 ; i<count ; i++) {
+        BufferQueue::ReleaseItem& item(items.editItemAt(i));
+        item.mBuf = slots[i];
+        item.mEglDisplay = EGL_NO_DISPLAY;
+        item.mEglFence = EGL_NO_SYNC_KHR;
+        item.mFence = getReleaseFenceLocked(slots[i]);
+    }
+    status_t err = mBufferQueue->releaseBuffers(items.editArray(), count);
+    for (size_t i=0 ; i<count ; i++) {
+        if (items[i].mResult == BufferQueue::STALE_BUFFER_SLOT) {
+            freeBufferLocked(slots[i]);
+        }
+    }
     return err;
 }
 
@@ -21,6 +21,10 @@
 
 #include <gui/CpuConsumer.h>
 
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
 #define CC_LOGV(x, ...) ALOGV("[%s] "x, mName.string(), ##__VA_ARGS__)
 #define CC_LOGD(x, ...) ALOGD("[%s] "x, mName.string(), ##__VA_ARGS__)
 #define CC_LOGI(x, ...) ALOGI("[%s] "x, mName.string(), ##__VA_ARGS__)
@@ -29,22 +33,49 @@
 
 namespace android {
 
-CpuConsumer::CpuConsumer(uint32_t maxLockedBuffers) :
+// Fills in the chroma plane description of a locked buffer from its luma
+// plane, using the layouts documented in system/graphics.h.
+static void setChromaPlanes(CpuConsumer::LockedBuffer* b) {
+    const uint32_t ySize = b->stride * b->height;
+    switch (b->format) {
+        case HAL_PIXEL_FORMAT_YV12:
+            // Cr then Cb planes at half resolution, with 16 byte aligned
+            // rows
+            b->chromaStride = ((b->stride / 2) + 15) & ~15;
+            b->chromaStep = 1;
+            b->dataCr = b->data + ySize;
+            b->dataCb = b->dataCr + b->chromaStride * (b->height / 2);
+            break;
+        case HAL_PIXEL_FORMAT_YCrCb_420_SP:
+            // interleaved CrCb plane at half resolution
+            b->chromaStride = b->stride;
+            b->chromaStep = 2;
+            b->dataCr = b->data + ySize;
+            b->dataCb = b->dataCr + 1;
+            break;
+        default:
+            b->chromaStride = 0;
+            b->chromaStep = 0;
+            b->dataCb = NULL;
+            b->dataCr = NULL;
+            break;
+    }
+}
+
+CpuConsumer::CpuConsumer(uint32_t maxLockedBuffers, bool cacheMappings) :
     ConsumerBase(new BufferQueue(true) ),
     mMaxLockedBuffers(maxLockedBuffers),
+    mCacheMappings(cacheMappings),
     mCurrentLockedBuffers(0)
 {
-
-    for (int i = 0; i < BufferQueue::NUM_BUFFER_SLOTS; i++) {
-        mBufferPointers[i] = NULL;
-    }
-
     mBufferQueue->setSynchronousMode(true);
     mBufferQueue->setConsumerUsageBits(GRALLOC_USAGE_SW_READ_OFTEN);
     mBufferQueue->setMaxAcquiredBufferCount(maxLockedBuffers);
 }
 
 CpuConsumer::~CpuConsumer() {
+    // Let freeBufferLocked unmap the buffers, ~ConsumerBase can't call it.
+    abandon();
 }
 
 void CpuConsumer::setName(const String8& name) {
@@ -57,22 +88,44 @@ status_t CpuConsumer::lockNextBuffer(LockedBuffer *nativeBuffer) {
     status_t err;
 
     if (!nativeBuffer) return BAD_VALUE;
-    if (mCurrentLockedBuffers == mMaxLockedBuffers) {
-        return INVALID_OPERATION;
-    }
 
     BufferQueue::BufferItem b;
+    sp<GraphicBuffer> graphicBuffer;
+    void *bufferPointer;
 
-    Mutex::Autolock _l(mMutex);
+    { // Scope for the lock
+        Mutex::Autolock _l(mMutex);
 
-    err = acquireBufferLocked(&b);
-    if (err != OK) {
-        if (err == BufferQueue::NO_BUFFER_AVAILABLE) {
-            return BAD_VALUE;
-        } else {
-            CC_LOGE("Error acquiring buffer: %s (%d)", strerror(err), err);
-            return err;
+        if (mCurrentLockedBuffers == mMaxLockedBuffers) {
+            return INVALID_OPERATION;
+        }
+
+        err = acquireBufferLocked(&b);
+        if (err != OK) {
+            if (err == BufferQueue::NO_BUFFER_AVAILABLE) {
+                return BAD_VALUE;
+            } else {
+                CC_LOGE("Error acquiring buffer: %s (%d)", strerror(err), err);
+                return err;
+            }
         }
+
+        LockedSlot& slot(mLockedSlots[b.mBuf]);
+        graphicBuffer = mSlots[b.mBuf].mGraphicBuffer;
+        if (slot.mGraphicBuffer != graphicBuffer) {
+            // The slot has a new buffer, drop the mapping of the old one.
+            if (slot.mBufferPointer != NULL) {
+                slot.mGraphicBuffer->unlock();
+                slot.mBufferPointer = NULL;
+            }
+            slot.mGraphicBuffer = graphicBuffer;
+        }
+        bufferPointer = slot.mBufferPointer;
+
+        // Reserve the slot so that other threads can go on while this one
+        // waits for the fence and maps the buffer.
+        slot.mLocked = true;
+        mCurrentLockedBuffers++;
     }
 
     int buf = b.mBuf;
@@ -82,26 +135,51 @@ status_t CpuConsumer::lockNextBuffer(LockedBuffer *nativeBuffer) {
         if (err != OK) {
             CC_LOGE("Failed to wait for fence of acquired buffer: %s (%d)",
                     strerror(-err), err);
+            Mutex::Autolock _l(mMutex);
+            cancelLockLocked(buf, graphicBuffer);
             return err;
         }
     }
 
-    err = mSlots[buf].mGraphicBuffer->lock(
-        GraphicBuffer::USAGE_SW_READ_OFTEN,
-        b.mCrop,
-        &mBufferPointers[buf]);
+    bool mappedHere = false;
+    if (bufferPointer == NULL) {
+        // A cached mapping is reused for any crop, so it covers the whole
+        // buffer.
+        const Rect bounds(graphicBuffer->getWidth(), graphicBuffer->getHeight());
+        err = graphicBuffer->lock(
+            GraphicBuffer::USAGE_SW_READ_OFTEN,
+            mCacheMappings ? bounds : b.mCrop,
+            &bufferPointer);
+
+        if (bufferPointer != NULL && err != OK) {
+            CC_LOGE("Unable to lock buffer for CPU reading: %s (%d)",
+                    strerror(-err), err);
+            Mutex::Autolock _l(mMutex);
+            cancelLockLocked(buf, graphicBuffer);
+            return err;
+        }
+        mappedHere = true;
+    }
 
-    if (mBufferPointers[buf] != NULL && err != OK) {
-        CC_LOGE("Unable to lock buffer for CPU reading: %s (%d)", strerror(-err),
-                err);
-        return err;
+    { // Scope for the lock
+        Mutex::Autolock _l(mMutex);
+        LockedSlot& slot(mLockedSlots[buf]);
+        if (!slot.mLocked || slot.mGraphicBuffer != graphicBuffer) {
+            // freeBufferLocked ran meanwhile, the buffer is no longer ours.
+            CC_LOGW("Buffer %d freed while being locked", buf);
+            if (mappedHere) {
+                graphicBuffer->unlock();
+            }
+            return BAD_VALUE;
+        }
+        slot.mBufferPointer = bufferPointer;
     }
 
-    nativeBuffer->data   = reinterpret_cast<uint8_t*>(mBufferPointers[buf]);
-    nativeBuffer->width  = mSlots[buf].mGraphicBuffer->getWidth();
-    nativeBuffer->height = mSlots[buf].mGraphicBuffer->getHeight();
-    nativeBuffer->format = mSlots[buf].mGraphicBuffer->getPixelFormat();
-    nativeBuffer->stride = mSlots[buf].mGraphicBuffer->getStride();
+    nativeBuffer->data   = reinterpret_cast<uint8_t*>(bufferPointer);
+    nativeBuffer->width  = graphicBuffer->getWidth();
+    nativeBuffer->height = graphicBuffer->getHeight();
+    nativeBuffer->format = graphicBuffer->getPixelFormat();
+    nativeBuffer->stride = graphicBuffer->getStride();
 
     nativeBuffer->crop        = b.mCrop;
     nativeBuffer->transform   = b.mTransform;
@@ -109,11 +187,111 @@ status_t CpuConsumer::lockNextBuffer(LockedBuffer *nativeBuffer) {
     nativeBuffer->timestamp   = b.mTimestamp;
     nativeBuffer->frameNumber = b.mFrameNumber;
 
-    mCurrentLockedBuffers++;
+    setChromaPlanes(nativeBuffer);
+
+    return OK;
+}
+
+// The conversion uses 6 bit fixed point BT.601 video range coefficients:
+//   R = 1.164 (Y - 16) + 1.596 (Cr - 128)
+//   G = 1.164 (Y - 16) - 0.813 (Cr - 128) - 0.391 (Cb - 128)
+//   B = 1.164 (Y - 16) + 2.018 (Cb - 128)
+// The scalar and NEON versions give identical results.
 
+static inline uint8_t clampToByte(int v) {
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+static inline void yuvToRgba(int y, int cb, int cr, uint8_t* dst) {
+    const int luma = (y - 16) * 74;
+    const int u = cb - 128;
+    const int v = cr - 128;
+    dst[0] = clampToByte((luma + 102 * v) >> 6);
+    dst[1] = clampToByte((luma - 52 * v - 25 * u) >> 6);
+    dst[2] = clampToByte((luma + 129 * u) >> 6);
+    dst[3] = 0xff;
+}
+
+#if defined(__ARM_NEON__)
+// Converts 16 pixels, cb and cr hold the 8 chroma samples covering them.
+static inline void yuvToRgba16(const uint8_t* y, uint8x8_t cb, uint8x8_t cr,
+        uint8_t* dst) {
+    const uint8x16_t luma = vld1q_u8(y);
+    // each chroma sample covers two pixels of the row
+    const uint8x8x2_t cb2 = vzip_u8(cb, cb);
+    const uint8x8x2_t cr2 = vzip_u8(cr, cr);
+    const int16x8_t k16 = vdupq_n_s16(16);
+    const int16x8_t k128 = vdupq_n_s16(128);
+    for (int half = 0; half < 2; half++) {
+        const uint8x8_t y8 = half ? vget_high_u8(luma) : vget_low_u8(luma);
+        const int16x8_t yy = vmulq_n_s16(vsubq_s16(
+                vreinterpretq_s16_u16(vmovl_u8(y8)), k16), 74);
+        const int16x8_t u = vsubq_s16(
+                vreinterpretq_s16_u16(vmovl_u8(cb2.val[half])), k128);
+        const int16x8_t v = vsubq_s16(
+                vreinterpretq_s16_u16(vmovl_u8(cr2.val[half])), k128);
+        uint8x8x4_t rgba;
+        rgba.val[0] = vqshrun_n_s16(vqaddq_s16(yy, vmulq_n_s16(v, 102)), 6);
+        rgba.val[1] = vqshrun_n_s16(vqsubq_s16(vqsubq_s16(yy,
+                vmulq_n_s16(v, 52)), vmulq_n_s16(u, 25)), 6);
+        rgba.val[2] = vqshrun_n_s16(vqaddq_s16(yy, vmulq_n_s16(u, 129)), 6);
+        rgba.val[3] = vdup_n_u8(0xff);
+        vst4_u8(dst + half * 32, rgba);
+    }
+}
+#endif
+
+status_t CpuConsumer::convertToRgba8888(const LockedBuffer& buffer,
+        uint8_t* dst, uint32_t dstStride) {
+    if (buffer.data == NULL || buffer.dataCb == NULL ||
+            buffer.dataCr == NULL || dst == NULL) {
+        return BAD_VALUE;
+    }
+
+    const uint32_t w = buffer.width;
+    const uint32_t step = buffer.chromaStep;
+    for (uint32_t row = 0; row < buffer.height; row++) {
+        const uint8_t* y = buffer.data + row * buffer.stride;
+        const uint8_t* cb = buffer.dataCb + (row / 2) * buffer.chromaStride;
+        const uint8_t* cr = buffer.dataCr + (row / 2) * buffer.chromaStride;
+        uint8_t* out = dst + row * dstStride * 4;
+        uint32_t x = 0;
+#if defined(__ARM_NEON__)
+        if (step == 1) {
+            for (; x + 16 <= w; x += 16) {
+                yuvToRgba16(y + x, vld1_u8(cb + x / 2), vld1_u8(cr + x / 2),
+                        out + x * 4);
+            }
+        } else if (step == 2 && (cr == cb + 1 || cb == cr + 1)) {
+            const bool cbFirst = cb < cr;
+            const uint8_t* c = cbFirst ? cb : cr;
+            for (; x + 16 <= w; x += 16) {
+                const uint8x8x2_t c2 = vld2_u8(c + x);
+                yuvToRgba16(y + x, c2.val[cbFirst ? 0 : 1],
+                        c2.val[cbFirst ? 1 : 0], out + x * 4);
+            }
+        }
+#endif
+        for (; x < w; x++) {
+            const uint32_t c = (x / 2) * step;
+            yuvToRgba(y[x], cb[c], cr[c], out + x * 4);
+        }
+    }
     return OK;
 }
 
+void CpuConsumer::cancelLockLocked(int slotIndex,
+        const sp<GraphicBuffer>& buffer) {
+    LockedSlot& slot(mLockedSlots[slotIndex]);
+    if (!slot.mLocked || slot.mGraphicBuffer != buffer) {
+        // already cleaned up by freeBufferLocked
+        return;
+    }
+    slot.mLocked = false;
+    releaseBufferLocked(slotIndex, EGL_NO_DISPLAY, EGL_NO_SYNC_KHR);
+    mCurrentLockedBuffers--;
+}
+
 status_t CpuConsumer::unlockBuffer(const LockedBuffer &nativeBuffer) {
     Mutex::Autolock _l(mMutex);
     int slotIndex = 0;
@@ -121,19 +299,25 @@ status_t CpuConsumer::unlockBuffer(const LockedBuffer &nativeBuffer) {
 
     void *bufPtr = reinterpret_cast<void *>(nativeBuffer.data);
     for (; slotIndex < BufferQueue::NUM_BUFFER_SLOTS; slotIndex++) {
-        if (bufPtr == mBufferPointers[slotIndex]) break;
+        const LockedSlot& slot(mLockedSlots[slotIndex]);
+        if (slot.mLocked && bufPtr == slot.mBufferPointer) break;
     }
     if (slotIndex == BufferQueue::NUM_BUFFER_SLOTS) {
         CC_LOGE("%s: Can't find buffer to free", __FUNCTION__);
         return BAD_VALUE;
     }
 
-    mBufferPointers[slotIndex] = NULL;
-    err = mSlots[slotIndex].mGraphicBuffer->unlock();
-    if (err != OK) {
-        CC_LOGE("%s: Unable to unlock graphic buffer %d", __FUNCTION__, slotIndex);
-        return err;
+    LockedSlot& slot(mLockedSlots[slotIndex]);
+    if (!mCacheMappings) {
+        slot.mBufferPointer = NULL;
+        err = slot.mGraphicBuffer->unlock();
+        if (err != OK) {
+            CC_LOGE("%s: Unable to unlock graphic buffer %d", __FUNCTION__,
+                    slotIndex);
+            return err;
+        }
     }
+    slot.mLocked = false;
     releaseBufferLocked(slotIndex, EGL_NO_DISPLAY, EGL_NO_SYNC_KHR);
 
     mCurrentLockedBuffers--;
@@ -142,17 +326,22 @@ status_t CpuConsumer::unlockBuffer(const LockedBuffer &nativeBuffer) {
 }
 
 void CpuConsumer::freeBufferLocked(int slotIndex) {
-    if (mBufferPointers[slotIndex] != NULL) {
-        status_t err;
+    LockedSlot& slot(mLockedSlots[slotIndex]);
+    if (slot.mLocked) {
         CC_LOGW("Buffer %d freed while locked by consumer", slotIndex);
-        mBufferPointers[slotIndex] = NULL;
-        err = mSlots[slotIndex].mGraphicBuffer->unlock();
+        slot.mLocked = false;
+        mCurrentLockedBuffers--;
+    }
+    if (slot.mBufferPointer != NULL) {
+        status_t err;
+        slot.mBufferPointer = NULL;
+        err = slot.mGraphicBuffer->unlock();
         if (err != OK) {
             CC_LOGE("%s: Unable to unlock graphic buffer %d", __FUNCTION__,
                     slotIndex);
         }
-        mCurrentLockedBuffers--;
     }
+    slot.mGraphicBuffer.clear();
     ConsumerBase::freeBufferLocked(slotIndex);
 }
 
@@ -14,9 +14,13 @@
  * limitations under the License.
  */
 
+#define LOG_TAG "DisplayEventReceiver"
+
 #include <string.h>
 
 #include <utils/Errors.h>
+#include <utils/Log.h>
+#include <utils/Looper.h>
 
 #include <gui/BitTube.h>
 #include <gui/DisplayEventReceiver.h>
@@ -41,7 +45,38 @@ DisplayEventReceiver::DisplayEventReceiver() {
     }
 }
 
+// Reads the events when the data channel is readable, on the looper's
+// thread. It doesn't need the receiver for that.
+class DisplayEventLooperCallback : public LooperCallback {
+public:
+    DisplayEventLooperCallback(const sp<BitTube>& dataChannel,
+            const sp<DisplayEventReceiver::EventListener>& listener)
+        : mDataChannel(dataChannel), mListener(listener) {
+    }
+
+    virtual int handleEvent(int fd, int events, void* data) {
+        if (events & (ALOOPER_EVENT_HANGUP | ALOOPER_EVENT_ERROR)) {
+            ALOGE("DisplayEventReceiver: connection broken (events=%#x)",
+                    events);
+            mListener->onDisplayEvents(NULL, 0);
+            return 0;
+        }
+        DisplayEventReceiver::Event buffer[8];
+        ssize_t n;
+        while ((n = DisplayEventReceiver::getEventsWithLatestVsync(
+                mDataChannel, buffer, 8)) > 0) {
+            mListener->onDisplayEvents(buffer, n);
+        }
+        return 1;
+    }
+
+private:
+    const sp<BitTube> mDataChannel;
+    const sp<DisplayEventReceiver::EventListener> mListener;
+};
+
 DisplayEventReceiver::~DisplayEventReceiver() {
+    detachLooper();
 }
 
 status_t DisplayEventReceiver::initCheck() const {
@@ -77,6 +112,33 @@ status_t DisplayEventReceiver::requestNextVsync() {
 }
 
 
+status_t DisplayEventReceiver::attachLooper(const sp<Looper>& looper,
+        const sp<EventListener>& listener) {
+    if (mDataChannel == NULL)
+        return NO_INIT;
+    if (looper == NULL || listener == NULL)
+        return BAD_VALUE;
+    if (mLooper != NULL)
+        return INVALID_OPERATION;
+
+    sp<LooperCallback> callback(
+            new DisplayEventLooperCallback(mDataChannel, listener));
+    if (looper->addFd(getFd(), 0, ALOOPER_EVENT_INPUT, callback, NULL) != 1)
+        return BAD_VALUE;
+    mLooper = looper;
+    mLooperCallback = callback;
+    return NO_ERROR;
+}
+
+status_t DisplayEventReceiver::detachLooper() {
+    if (mLooper != NULL) {
+        mLooper->removeFd(getFd());
+        mLooper.clear();
+        mLooperCallback.clear();
+    }
+    return NO_ERROR;
+}
+
 ssize_t DisplayEventReceiver::getEvents(DisplayEventReceiver::Event* events,
         size_t count) {
     return DisplayEventReceiver::getEvents(mDataChannel, events, count);
@@ -88,6 +150,54 @@ ssize_t DisplayEventReceiver::getEvents(const sp<BitTube>& dataChannel,
     return BitTube::recvObjects(dataChannel, events, count);
 }
 
+ssize_t DisplayEventReceiver::getEventsWithLatestVsync(
+        DisplayEventReceiver::Event* events, size_t count) {
+    return DisplayEventReceiver::getEventsWithLatestVsync(mDataChannel,
+            events, count);
+}
+
+ssize_t DisplayEventReceiver::getEventsWithLatestVsync(
+        const sp<BitTube>& dataChannel, Event* events, size_t count)
+{
+    Event batch[16];
+    size_t numEvents = 0;   // not counting the vsync
+    bool haveVsync = false;
+    Event vsync;
+    for (;;) {
+        // every event read takes at most one more slot
+        size_t room = count - numEvents - (haveVsync ? 1 : 0);
+        if (room > 16) {
+            room = 16;
+        }
+        if (room == 0) {
+            break;
+        }
+        ssize_t n = BitTube::recvObjects(dataChannel, batch, room);
+        if (n < 0) {
+            if (numEvents == 0 && !haveVsync) {
+                return n;
+            }
+            break;
+        }
+        for (ssize_t i=0 ; i<n ; i++) {
+            if (batch[i].header.type == DISPLAY_EVENT_VSYNC) {
+                vsync = batch[i];
+                haveVsync = true;
+            } else {
+                events[numEvents++] = batch[i];
+            }
+        }
+        if (size_t(n) < room) {
+            // drained
+            break;
+        }
+    }
+    if (haveVsync) {
+        events[numEvents++] = vsync;
+    }
+    return numEvents;
+}
+
 ssize_t DisplayEventReceiver::sendEvents(const sp<BitTube>& dataChannel,
         Event const* events, size_t count)
 {
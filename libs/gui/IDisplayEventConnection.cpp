@@ -21,6 +21,7 @@
 #include <utils/RefBase.h>
 #include <utils/Timers.h>
 
+#include <binder/BpBinder.h>
 #include <binder/Parcel.h>
 #include <binder/IInterface.h>
 
@@ -42,6 +43,11 @@ public:
     BpDisplayEventConnection(const sp<IBinder>& impl)
         : BpInterface<IDisplayEventConnection>(impl)
     {
+        // the vsync requests are small and frequent, shorten their header
+        BpBinder* proxy = impl->remoteBinder();
+        if (proxy != NULL) {
+            proxy->negotiateInterfaceToken(IDisplayEventConnection::descriptor);
+        }
     }
 
     virtual sp<BitTube> getDataChannel() const
@@ -54,14 +60,14 @@ public:
 
     virtual void setVsyncRate(uint32_t count) {
         Parcel data, reply;
-        data.writeInterfaceToken(IDisplayEventConnection::getInterfaceDescriptor());
+        data.writeInterfaceToken(IDisplayEventConnection::getInterfaceDescriptor(), remote());
         data.writeInt32(count);
         remote()->transact(SET_VSYNC_RATE, data, &reply);
     }
 
     virtual void requestNextVsync() {
         Parcel data, reply;
-        data.writeInterfaceToken(IDisplayEventConnection::getInterfaceDescriptor());
+        data.writeInterfaceToken(IDisplayEventConnection::getInterfaceDescriptor(), remote());
         remote()->transact(REQUEST_NEXT_VSYNC, data, &reply, IBinder::FLAG_ONEWAY);
     }
 };
@@ -35,6 +35,7 @@ enum {
 #ifdef QCOM_BSP
     SET_GRAPHIC_BUFFER_SIZE,
 #endif
+    CREATE_GRAPHIC_BUFFERS,
 };
 
 class BpGraphicBufferAlloc : public BpInterface<IGraphicBufferAlloc>
@@ -67,6 +68,35 @@ public:
         return graphicBuffer;
     }
 
+    virtual status_t createGraphicBuffers(uint32_t w, uint32_t h,
+            PixelFormat format, uint32_t usage, size_t count,
+            Vector< sp<GraphicBuffer> >* outBuffers) {
+        Parcel data, reply;
+        data.writeInterfaceToken(IGraphicBufferAlloc::getInterfaceDescriptor());
+        data.writeInt32(w);
+        data.writeInt32(h);
+        data.writeInt32(format);
+        data.writeInt32(usage);
+        data.writeInt32(count);
+        status_t result = remote()->transact(CREATE_GRAPHIC_BUFFERS,
+                data, &reply);
+        if (result != NO_ERROR) {
+            return result;
+        }
+        result = reply.readInt32();
+        size_t n = reply.readInt32();
+        for (size_t i = 0; i < n; i++) {
+            sp<GraphicBuffer> graphicBuffer(new GraphicBuffer());
+            status_t err = reply.read(*graphicBuffer);
+            if (err != NO_ERROR) {
+                return err;
+            }
+            outBuffers->add(graphicBuffer);
+        }
+        // the BufferReference that follows dies with the parcel.
+        return result;
+    }
+
 #ifdef QCOM_BSP
     virtual void setGraphicBufferSize(int size) {
         Parcel data, reply;
@@ -87,6 +117,10 @@ status_t BnGraphicBufferAlloc::onTransact(
 {
     // codes that don't require permission check
 
+    // upper bound of a CREATE_GRAPHIC_BUFFERS request, a BufferQueue never
+    // needs more than its number of slots.
+    static const size_t MAX_BUFFERS_PER_CALL = 32;
+
     /* BufferReference just keeps a strong reference to a
      * GraphicBuffer until it is destroyed (that is, until
      * no local or remote process have a reference to it).
@@ -97,6 +131,16 @@ status_t BnGraphicBufferAlloc::onTransact(
         BufferReference(const sp<GraphicBuffer>& buffer) : buffer(buffer) { }
     };
 
+    /* Same as BufferReference, for all the buffers of a
+     * CREATE_GRAPHIC_BUFFERS reply.
+     */
+    class BuffersReference : public BBinder {
+        Vector< sp<GraphicBuffer> > buffers;
+    public:
+        BuffersReference(const Vector< sp<GraphicBuffer> >& buffers)
+            : buffers(buffers) { }
+    };
+
 
     switch(code) {
         case CREATE_GRAPHIC_BUFFER: {
@@ -121,6 +165,29 @@ status_t BnGraphicBufferAlloc::onTransact(
             }
             return NO_ERROR;
         } break;
+        case CREATE_GRAPHIC_BUFFERS: {
+            CHECK_INTERFACE(IGraphicBufferAlloc, data, reply);
+            uint32_t w = data.readInt32();
+            uint32_t h = data.readInt32();
+            PixelFormat format = data.readInt32();
+            uint32_t usage = data.readInt32();
+            size_t count = data.readInt32();
+            Vector< sp<GraphicBuffer> > buffers;
+            status_t error = BAD_VALUE;
+            if (count <= MAX_BUFFERS_PER_CALL) {
+                error = createGraphicBuffers(w, h, format, usage,
+                        count, &buffers);
+            }
+            reply->writeInt32(error);
+            reply->writeInt32(buffers.size());
+            for (size_t i = 0; i < buffers.size(); i++) {
+                reply->write(*buffers[i]);
+            }
+            // see CREATE_GRAPHIC_BUFFER, a single reference keeps all the
+            // buffers alive.
+            reply->writeStrongBinder( new BuffersReference(buffers) );
+            return NO_ERROR;
+        } break;
 #ifdef QCOM_BSP
         case SET_GRAPHIC_BUFFER_SIZE: {
             CHECK_INTERFACE(IGraphicBufferAlloc, data, reply);
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/Errors.h>
+#include <utils/RefBase.h>
+
+#include <binder/Parcel.h>
+#include <binder/IInterface.h>
+
+#include <ui/Fence.h>
+#include <ui/GraphicBuffer.h>
+
+#include <gui/IScreenCaptureListener.h>
+
+namespace android {
+// ----------------------------------------------------------------------------
+
+enum {
+    ON_SCREEN_CAPTURED = IBinder::FIRST_CALL_TRANSACTION,
+};
+
+class BpScreenCaptureListener : public BpInterface<IScreenCaptureListener>
+{
+    /* BufferReference just keeps a strong reference to a
+     * GraphicBuffer until the other side has imported it,
+     * see BnGraphicBufferAlloc.
+     */
+    class BufferReference : public BBinder {
+        sp<GraphicBuffer> buffer;
+    public:
+        BufferReference(const sp<GraphicBuffer>& buffer) : buffer(buffer) { }
+    };
+
+public:
+    BpScreenCaptureListener(const sp<IBinder>& impl)
+        : BpInterface<IScreenCaptureListener>(impl)
+    {
+    }
+
+    virtual void onScreenCaptured(status_t result,
+            const sp<GraphicBuffer>& buffer, const sp<Fence>& fence) {
+        Parcel data, reply;
+        data.writeInterfaceToken(IScreenCaptureListener::getInterfaceDescriptor());
+        data.writeInt32(result);
+        data.writeInt32(buffer != 0);
+        if (buffer != 0) {
+            data.write(*buffer);
+            data.writeStrongBinder(new BufferReference(buffer));
+        }
+        bool hasFence = fence.get() && fence->isValid();
+        data.writeInt32(hasFence);
+        if (hasFence) {
+            data.write(*fence.get());
+        }
+        remote()->transact(ON_SCREEN_CAPTURED, data, &reply,
+                IBinder::FLAG_ONEWAY);
+    }
+};
+
+IMPLEMENT_META_INTERFACE(ScreenCaptureListener, "android.gui.ScreenCaptureListener");
+
+// ----------------------------------------------------------------------------
+
+status_t BnScreenCaptureListener::onTransact(
+    uint32_t code, const Parcel& data, Parcel* reply, uint32_t flags)
+{
+    switch(code) {
+        case ON_SCREEN_CAPTURED: {
+            CHECK_INTERFACE(IScreenCaptureListener, data, reply);
+            status_t result = data.readInt32();
+            sp<GraphicBuffer> buffer;
+            if (data.readInt32()) {
+                buffer = new GraphicBuffer();
+                data.read(*buffer);
+                // the BufferReference can go once the buffer is imported
+                data.readStrongBinder();
+            }
+            sp<Fence> fence(Fence::NO_FENCE);
+            if (data.readInt32()) {
+                fence = new Fence();
+                data.read(*fence.get());
+            }
+            onScreenCaptured(result, buffer, fence);
+            return NO_ERROR;
+        } break;
+    }
+    return BBinder::onTransact(code, data, reply, flags);
+}
+
+// ----------------------------------------------------------------------------
+}; // namespace android
@@ -21,8 +21,10 @@
 #include <utils/RefBase.h>
 #include <utils/Timers.h>
 
+#include <binder/BpBinder.h>
 #include <binder/Parcel.h>
 #include <binder/IInterface.h>
+#include <binder/IMemory.h>
 
 #include <gui/ISensorEventConnection.h>
 #include <gui/BitTube.h>
@@ -33,7 +35,11 @@ namespace android {
 enum {
     GET_SENSOR_CHANNEL = IBinder::FIRST_CALL_TRANSACTION,
     ENABLE_DISABLE,
-    SET_EVENT_RATE
+    SET_EVENT_RATE,
+    GET_SENSOR_EVENT_RING,
+    BATCH,
+    FLUSH,
+    SET_WAKE_UP
 };
 
 class BpSensorEventConnection : public BpInterface<ISensorEventConnection>
@@ -42,6 +48,11 @@ public:
     BpSensorEventConnection(const sp<IBinder>& impl)
         : BpInterface<ISensorEventConnection>(impl)
     {
+        // the rate changes are small and frequent, shorten their header
+        BpBinder* proxy = impl->remoteBinder();
+        if (proxy != NULL) {
+            proxy->negotiateInterfaceToken(ISensorEventConnection::descriptor);
+        }
     }
 
     virtual sp<BitTube> getSensorChannel() const
@@ -55,7 +66,7 @@ public:
     virtual status_t enableDisable(int handle, bool enabled)
     {
         Parcel data, reply;
-        data.writeInterfaceToken(ISensorEventConnection::getInterfaceDescriptor());
+        data.writeInterfaceToken(ISensorEventConnection::getInterfaceDescriptor(), remote());
         data.writeInt32(handle);
         data.writeInt32(enabled);
         remote()->transact(ENABLE_DISABLE, data, &reply);
@@ -65,12 +76,53 @@ public:
     virtual status_t setEventRate(int handle, nsecs_t ns)
     {
         Parcel data, reply;
-        data.writeInterfaceToken(ISensorEventConnection::getInterfaceDescriptor());
+        data.writeInterfaceToken(ISensorEventConnection::getInterfaceDescriptor(), remote());
         data.writeInt32(handle);
         data.writeInt64(ns);
         remote()->transact(SET_EVENT_RATE, data, &reply);
         return reply.readInt32();
     }
+
+    virtual sp<IMemoryHeap> getSensorEventRing()
+    {
+        Parcel data, reply;
+        data.writeInterfaceToken(ISensorEventConnection::getInterfaceDescriptor());
+        status_t result = remote()->transact(GET_SENSOR_EVENT_RING, data, &reply);
+        if (result != NO_ERROR) {
+            return NULL;
+        }
+        return interface_cast<IMemoryHeap>(reply.readStrongBinder());
+    }
+
+    virtual status_t batch(int handle, nsecs_t period,
+            nsecs_t maxReportLatency)
+    {
+        Parcel data, reply;
+        data.writeInterfaceToken(ISensorEventConnection::getInterfaceDescriptor());
+        data.writeInt32(handle);
+        data.writeInt64(period);
+        data.writeInt64(maxReportLatency);
+        remote()->transact(BATCH, data, &reply);
+        return reply.readInt32();
+    }
+
+    virtual status_t flush(int handle)
+    {
+        Parcel data, reply;
+        data.writeInterfaceToken(ISensorEventConnection::getInterfaceDescriptor());
+        data.writeInt32(handle);
+        remote()->transact(FLUSH, data, &reply);
+        return reply.readInt32();
+    }
+
+    virtual status_t setWakeUp(bool wakeUp)
+    {
+        Parcel data, reply;
+        data.writeInterfaceToken(ISensorEventConnection::getInterfaceDescriptor());
+        data.writeInt32(wakeUp);
+        remote()->transact(SET_WAKE_UP, data, &reply);
+        return reply.readInt32();
+    }
 };
 
 IMPLEMENT_META_INTERFACE(SensorEventConnection, "android.gui.SensorEventConnection");
@@ -103,6 +155,35 @@ status_t BnSensorEventConnection::onTransact(
             reply->writeInt32(result);
             return NO_ERROR;
         } break;
+        case GET_SENSOR_EVENT_RING: {
+            CHECK_INTERFACE(ISensorEventConnection, data, reply);
+            sp<IMemoryHeap> heap(getSensorEventRing());
+            reply->writeStrongBinder(heap != NULL ? heap->asBinder() : NULL);
+            return NO_ERROR;
+        } break;
+        case BATCH: {
+            CHECK_INTERFACE(ISensorEventConnection, data, reply);
+            int handle = data.readInt32();
+            nsecs_t period = data.readInt64();
+            nsecs_t maxReportLatency = data.readInt64();
+            status_t result = batch(handle, period, maxReportLatency);
+            reply->writeInt32(result);
+            return NO_ERROR;
+        } break;
+        case FLUSH: {
+            CHECK_INTERFACE(ISensorEventConnection, data, reply);
+            int handle = data.readInt32();
+            status_t result = flush(handle);
+            reply->writeInt32(result);
+            return NO_ERROR;
+        } break;
+        case SET_WAKE_UP: {
+            CHECK_INTERFACE(ISensorEventConnection, data, reply);
+            int wakeUp = data.readInt32();
+            status_t result = setWakeUp(wakeUp);
+            reply->writeInt32(result);
+            return NO_ERROR;
+        } break;
     }
     return BBinder::onTransact(code, data, reply, flags);
 }
@@ -50,13 +50,17 @@ public:
         Parcel data, reply;
         data.writeInterfaceToken(ISensorServer::getInterfaceDescriptor());
         remote()->transact(GET_SENSOR_LIST, data, &reply);
-        Sensor s;
         Vector<Sensor> v;
         int32_t n = reply.readInt32();
-        v.setCapacity(n);
-        while (n--) {
-            reply.read(s);
-            v.add(s);
+        if (n > 0) {
+            // unflatten in place rather than copying each sensor
+            v.insertAt(0, n);
+            for (int32_t i=0 ; i<n ; i++) {
+                if (reply.read(v.editItemAt(i)) != NO_ERROR) {
+                    v.removeItemsAt(i, n - i);
+                    break;
+                }
+            }
         }
         return v;
     }
@@ -27,12 +27,15 @@
 
 #include <gui/BitTube.h>
 #include <gui/IDisplayEventConnection.h>
+#include <gui/IScreenCaptureListener.h>
 #include <gui/ISurfaceComposer.h>
 #include <gui/ISurfaceTexture.h>
+#include <gui/ITransactionCompletedListener.h>
 
 #include <private/gui/LayerState.h>
 
 #include <ui/DisplayInfo.h>
+#include <ui/GraphicBuffer.h>
 
 #include <utils/Log.h>
 
@@ -42,6 +45,107 @@ namespace android {
 
 class IDisplayEventConnection;
 
+/*
+ * The layer states are sent as a table of the clients they belong to,
+ * followed by a single block of compact layer states (see
+ * layer_state_t::writeCompact()) that is built in place in the parcel
+ * and parsed straight out of it, without a flattened Region or a
+ * strong binder per state.
+ */
+static void writeTransactionState(Parcel& data,
+        const Vector<ComposerState>& state,
+        const Vector<DisplayState>& displays)
+{
+    {
+        // states are sorted by client, so a client's states are together
+        const size_t count = state.size();
+        size_t clientCount = 0;
+        size_t size = 0;
+        for (size_t i=0 ; i<count ; i++) {
+            if (i == 0 || state[i].client != state[i-1].client) {
+                clientCount++;
+            }
+            size += sizeof(uint32_t) + state[i].state.getCompactSize();
+        }
+        data.writeInt32(clientCount);
+        for (size_t i=0 ; i<count ; i++) {
+            if (i == 0 || state[i].client != state[i-1].client) {
+                data.writeStrongBinder(state[i].client->asBinder());
+            }
+        }
+        data.writeInt32(count);
+        data.writeInt32(size);
+        uint32_t* cursor = reinterpret_cast<uint32_t*>(data.writeInplace(size));
+        if (cursor) {
+            uint32_t client = 0;
+            for (size_t i=0 ; i<count ; i++) {
+                if (i > 0 && state[i].client != state[i-1].client) {
+                    client++;
+                }
+                *cursor++ = client;
+                state[i].state.writeCompact(cursor);
+            }
+        }
+    }
+    {
+        Vector<DisplayState>::const_iterator b(displays.begin());
+        Vector<DisplayState>::const_iterator e(displays.end());
+        data.writeInt32(displays.size());
+        for ( ; b != e ; ++b ) {
+            b->write(data);
+        }
+    }
+}
+
+static status_t readTransactionState(const Parcel& data,
+        Vector<ComposerState>* state,
+        Vector<DisplayState>* displays)
+{
+    {
+        const size_t clientCount = data.readInt32();
+        if (clientCount > data.dataAvail()) {
+            return BAD_VALUE;
+        }
+        Vector< sp<ISurfaceComposerClient> > clients;
+        clients.setCapacity(clientCount);
+        for (size_t i=0 ; i<clientCount ; i++) {
+            clients.add(interface_cast<ISurfaceComposerClient>(
+                    data.readStrongBinder()));
+        }
+        const size_t count = data.readInt32();
+        const size_t size = data.readInt32();
+        uint32_t const* cursor =
+                reinterpret_cast<uint32_t const*>(data.readInplace(size));
+        if (cursor == NULL || count > size / (3 * sizeof(uint32_t))) {
+            return BAD_VALUE;
+        }
+        uint32_t const* const end = cursor + size / sizeof(uint32_t);
+        if (count) {
+            // allocated once, the states are parsed in place
+            state->insertAt(0, count);
+        }
+        for (size_t i=0 ; i<count ; i++) {
+            ComposerState& s(state->editItemAt(i));
+            if (cursor == end || *cursor >= clientCount) {
+                return BAD_VALUE;
+            }
+            s.client = clients[*cursor++];
+            status_t err = s.state.readCompact(cursor, end);
+            if (err != NO_ERROR) {
+                return err;
+            }
+        }
+    }
+    size_t count = data.readInt32();
+    DisplayState d;
+    displays->setCapacity(count);
+    for (size_t i=0 ; i<count ; i++) {
+        d.read(data);
+        displays->add(d);
+    }
+    return NO_ERROR;
+}
+
 class BpSurfaceComposer : public BpInterface<ISurfaceComposer>
 {
 public:
@@ -75,26 +179,30 @@ public:
     {
         Parcel data, reply;
         data.writeInterfaceToken(ISurfaceComposer::getInterfaceDescriptor());
-        {
-            Vector<ComposerState>::const_iterator b(state.begin());
-            Vector<ComposerState>::const_iterator e(state.end());
-            data.writeInt32(state.size());
-            for ( ; b != e ; ++b ) {
-                b->write(data);
-            }
-        }
-        {
-            Vector<DisplayState>::const_iterator b(displays.begin());
-            Vector<DisplayState>::const_iterator e(displays.end());
-            data.writeInt32(displays.size());
-            for ( ; b != e ; ++b ) {
-                b->write(data);
-            }
-        }
+        writeTransactionState(data, state, displays);
         data.writeInt32(flags);
         remote()->transact(BnSurfaceComposer::SET_TRANSACTION_STATE, data, &reply);
     }
 
+    virtual void setTransactionStateAsync(
+            const Vector<ComposerState>& state,
+            const Vector<DisplayState>& displays,
+            uint32_t flags,
+            const Vector< sp<ITransactionCompletedListener> >& listeners)
+    {
+        Parcel data, reply;
+        data.writeInterfaceToken(ISurfaceComposer::getInterfaceDescriptor());
+        writeTransactionState(data, state, displays);
+        data.writeInt32(flags);
+        data.writeInt32(listeners.size());
+        for (size_t i=0 ; i<listeners.size() ; i++) {
+            data.writeStrongBinder(listeners[i]->asBinder());
+        }
+        // not one-way, so it stays ordered with the other transactions
+        remote()->transact(BnSurfaceComposer::SET_TRANSACTION_STATE_ASYNC,
+                data, &reply);
+    }
+
     virtual void bootFinished()
     {
         Parcel data, reply;
@@ -123,6 +231,61 @@ public:
         return reply.readInt32();
     }
 
+    virtual status_t captureScreenToBuffer(
+            const sp<IBinder>& display, sp<GraphicBuffer>* outBuffer,
+            uint32_t reqWidth, uint32_t reqHeight,
+            uint32_t minLayerZ, uint32_t maxLayerZ)
+    {
+        Parcel data, reply;
+        data.writeInterfaceToken(ISurfaceComposer::getInterfaceDescriptor());
+        data.writeStrongBinder(display);
+        data.writeInt32(reqWidth);
+        data.writeInt32(reqHeight);
+        data.writeInt32(minLayerZ);
+        data.writeInt32(maxLayerZ);
+        status_t result = remote()->transact(
+                BnSurfaceComposer::CAPTURE_SCREEN_TO_BUFFER, data, &reply);
+        if (result != NO_ERROR) {
+            return result;
+        }
+        result = reply.readInt32();
+        if (result == NO_ERROR) {
+            sp<GraphicBuffer> buffer(new GraphicBuffer());
+            result = reply.read(*buffer);
+            if (result == NO_ERROR) {
+                *outBuffer = buffer;
+            }
+        }
+        return result;
+    }
+
+    virtual status_t captureScreenAsync(const sp<IBinder>& display,
+            const sp<IScreenCaptureListener>& listener,
+            const Rect& sourceCrop,
+            uint32_t reqWidth, uint32_t reqHeight, PixelFormat format,
+            uint32_t minLayerZ, uint32_t maxLayerZ)
+    {
+        Parcel data, reply;
+        data.writeInterfaceToken(ISurfaceComposer::getInterfaceDescriptor());
+        data.writeStrongBinder(display);
+        data.writeStrongBinder(listener != 0 ? listener->asBinder() : NULL);
+        data.writeInt32(sourceCrop.left);
+        data.writeInt32(sourceCrop.top);
+        data.writeInt32(sourceCrop.right);
+        data.writeInt32(sourceCrop.bottom);
+        data.writeInt32(reqWidth);
+        data.writeInt32(reqHeight);
+        data.writeInt32(format);
+        data.writeInt32(minLayerZ);
+        data.writeInt32(maxLayerZ);
+        status_t result = remote()->transact(
+                BnSurfaceComposer::CAPTURE_SCREEN_ASYNC, data, &reply);
+        if (result != NO_ERROR) {
+            return result;
+        }
+        return reply.readInt32();
+    }
+
     virtual bool authenticateSurfaceTexture(
             const sp<ISurfaceTexture>& surfaceTexture) const
     {
@@ -223,6 +386,36 @@ public:
         memcpy(info, reply.readInplace(sizeof(DisplayInfo)), sizeof(DisplayInfo));
         return reply.readInt32();
     }
+
+    virtual status_t getGraphicMemoryUsage(Vector<GraphicMemoryUsage>* usage)
+    {
+        Parcel data, reply;
+        data.writeInterfaceToken(ISurfaceComposer::getInterfaceDescriptor());
+        status_t err = remote()->transact(
+                BnSurfaceComposer::GET_GRAPHIC_MEMORY_USAGE, data, &reply);
+        if (err == NO_ERROR) {
+            err = reply.readInt32();
+        }
+        usage->clear();
+        if (err != NO_ERROR) {
+            return err;
+        }
+        const size_t count = reply.readInt32();
+        if (count > reply.dataAvail()) {
+            return BAD_VALUE;
+        }
+        usage->setCapacity(count);
+        for (size_t i=0 ; i<count ; i++) {
+            GraphicMemoryUsage u;
+            u.pid = reply.readInt32();
+            u.name = reply.readString8();
+            u.usage = reply.readInt32();
+            u.count = reply.readInt32();
+            u.bytes = reply.readInt64();
+            usage->add(u);
+        }
+        return NO_ERROR;
+    }
 };
 
 IMPLEMENT_META_INTERFACE(SurfaceComposer, "android.ui.ISurfaceComposer");
@@ -232,6 +425,16 @@ IMPLEMENT_META_INTERFACE(SurfaceComposer, "android.ui.ISurfaceComposer");
 status_t BnSurfaceComposer::onTransact(
     uint32_t code, const Parcel& data, Parcel* reply, uint32_t flags)
 {
+    /* BufferReference just keeps a strong reference to a
+     * GraphicBuffer until it is destroyed (that is, until
+     * no local or remote process have a reference to it).
+     */
+    class BufferReference : public BBinder {
+        sp<GraphicBuffer> buffer;
+    public:
+        BufferReference(const sp<GraphicBuffer>& buffer) : buffer(buffer) { }
+    };
+
     switch(code) {
         case CREATE_CONNECTION: {
             CHECK_INTERFACE(ISurfaceComposer, data, reply);
@@ -245,25 +448,39 @@ status_t BnSurfaceComposer::onTransact(
         } break;
         case SET_TRANSACTION_STATE: {
             CHECK_INTERFACE(ISurfaceComposer, data, reply);
-            size_t count = data.readInt32();
-            ComposerState s;
             Vector<ComposerState> state;
-            state.setCapacity(count);
-            for (size_t i=0 ; i<count ; i++) {
-                s.read(data);
-                state.add(s);
-            }
-            count = data.readInt32();
-            DisplayState d;
             Vector<DisplayState> displays;
-            displays.setCapacity(count);
-            for (size_t i=0 ; i<count ; i++) {
-                d.read(data);
-                displays.add(d);
+            status_t err = readTransactionState(data, &state, &displays);
+            if (err != NO_ERROR) {
+                ALOGE("setTransactionState: malformed transaction (%d)", err);
+                return err;
             }
             uint32_t flags = data.readInt32();
             setTransactionState(state, displays, flags);
         } break;
+        case SET_TRANSACTION_STATE_ASYNC: {
+            CHECK_INTERFACE(ISurfaceComposer, data, reply);
+            Vector<ComposerState> state;
+            Vector<DisplayState> displays;
+            status_t err = readTransactionState(data, &state, &displays);
+            if (err != NO_ERROR) {
+                ALOGE("setTransactionState: malformed transaction (%d)", err);
+                return err;
+            }
+            uint32_t flags = data.readInt32();
+            size_t count = data.readInt32();
+            Vector< sp<ITransactionCompletedListener> > listeners;
+            listeners.setCapacity(count);
+            for (size_t i=0 ; i<count ; i++) {
+                sp<ITransactionCompletedListener> listener =
+                        interface_cast<ITransactionCompletedListener>(
+                                data.readStrongBinder());
+                if (listener != NULL) {
+                    listeners.add(listener);
+                }
+            }
+            setTransactionStateAsync(state, displays, flags, listeners);
+        } break;
         case BOOT_FINISHED: {
             CHECK_INTERFACE(ISurfaceComposer, data, reply);
             bootFinished();
@@ -286,6 +503,47 @@ status_t BnSurfaceComposer::onTransact(
             reply->writeInt32(f);
             reply->writeInt32(res);
         } break;
+        case CAPTURE_SCREEN_TO_BUFFER: {
+            CHECK_INTERFACE(ISurfaceComposer, data, reply);
+            sp<IBinder> display = data.readStrongBinder();
+            uint32_t reqWidth = data.readInt32();
+            uint32_t reqHeight = data.readInt32();
+            uint32_t minLayerZ = data.readInt32();
+            uint32_t maxLayerZ = data.readInt32();
+            sp<GraphicBuffer> buffer;
+            status_t res = captureScreenToBuffer(display, &buffer,
+                    reqWidth, reqHeight, minLayerZ, maxLayerZ);
+            if (res == NO_ERROR && buffer == 0) {
+                res = NO_MEMORY;
+            }
+            reply->writeInt32(res);
+            if (res == NO_ERROR) {
+                reply->write(*buffer);
+                // keeps the buffer alive until the client has imported it,
+                // see BnGraphicBufferAlloc.
+                reply->writeStrongBinder(new BufferReference(buffer));
+            }
+        } break;
+        case CAPTURE_SCREEN_ASYNC: {
+            CHECK_INTERFACE(ISurfaceComposer, data, reply);
+            sp<IBinder> display = data.readStrongBinder();
+            sp<IScreenCaptureListener> listener =
+                    interface_cast<IScreenCaptureListener>(
+                            data.readStrongBinder());
+            Rect sourceCrop;
+            sourceCrop.left = data.readInt32();
+            sourceCrop.top = data.readInt32();
+            sourceCrop.right = data.readInt32();
+            sourceCrop.bottom = data.readInt32();
+            uint32_t reqWidth = data.readInt32();
+            uint32_t reqHeight = data.readInt32();
+            PixelFormat format = data.readInt32();
+            uint32_t minLayerZ = data.readInt32();
+            uint32_t maxLayerZ = data.readInt32();
+            status_t res = captureScreenAsync(display, listener, sourceCrop,
+                    reqWidth, reqHeight, format, minLayerZ, maxLayerZ);
+            reply->writeInt32(res);
+        } break;
         case AUTHENTICATE_SURFACE: {
             CHECK_INTERFACE(ISurfaceComposer, data, reply);
             sp<ISurfaceTexture> surfaceTexture =
@@ -332,6 +590,23 @@ status_t BnSurfaceComposer::onTransact(
             memcpy(reply->writeInplace(sizeof(DisplayInfo)), &info, sizeof(DisplayInfo));
             reply->writeInt32(result);
         } break;
+        case GET_GRAPHIC_MEMORY_USAGE: {
+            CHECK_INTERFACE(ISurfaceComposer, data, reply);
+            Vector<GraphicMemoryUsage> usage;
+            status_t result = getGraphicMemoryUsage(&usage);
+            reply->writeInt32(result);
+            if (result == NO_ERROR) {
+                reply->writeInt32(usage.size());
+                for (size_t i=0 ; i<usage.size() ; i++) {
+                    const GraphicMemoryUsage& u(usage[i]);
+                    reply->writeInt32(u.pid);
+                    reply->writeString8(u.name);
+                    reply->writeInt32(u.usage);
+                    reply->writeInt32(u.count);
+                    reply->writeInt64(u.bytes);
+                }
+            }
+        } break;
         default:
             return BBinder::onTransact(code, data, reply, flags);
     }
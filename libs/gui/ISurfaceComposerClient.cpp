@@ -39,7 +39,9 @@ namespace android {
 
 enum {
     CREATE_SURFACE = IBinder::FIRST_CALL_TRANSACTION,
-    DESTROY_SURFACE
+    DESTROY_SURFACE,
+    GET_STATE_CHANNEL,
+    SIGNAL_STATE_CHANNEL
 };
 
 class BpSurfaceComposerClient : public BpInterface<ISurfaceComposerClient>
@@ -77,6 +79,22 @@ public:
         remote()->transact(DESTROY_SURFACE, data, &reply);
         return reply.readInt32();
     }
+
+    virtual sp<IMemoryHeap> getStateChannel()
+    {
+        Parcel data, reply;
+        data.writeInterfaceToken(ISurfaceComposerClient::getInterfaceDescriptor());
+        remote()->transact(GET_STATE_CHANNEL, data, &reply);
+        return interface_cast<IMemoryHeap>(reply.readStrongBinder());
+    }
+
+    virtual void signalStateChannel()
+    {
+        Parcel data, reply;
+        data.writeInterfaceToken(ISurfaceComposerClient::getInterfaceDescriptor());
+        remote()->transact(SIGNAL_STATE_CHANNEL, data, &reply,
+                IBinder::FLAG_ONEWAY);
+    }
 };
 
 IMPLEMENT_META_INTERFACE(SurfaceComposerClient, "android.ui.ISurfaceComposerClient");
@@ -106,6 +124,17 @@ status_t BnSurfaceComposerClient::onTransact(
             reply->writeInt32( destroySurface( data.readInt32() ) );
             return NO_ERROR;
         } break;
+        case GET_STATE_CHANNEL: {
+            CHECK_INTERFACE(ISurfaceComposerClient, data, reply);
+            sp<IMemoryHeap> heap(getStateChannel());
+            reply->writeStrongBinder(heap != NULL ? heap->asBinder() : sp<IBinder>());
+            return NO_ERROR;
+        } break;
+        case SIGNAL_STATE_CHANNEL: {
+            CHECK_INTERFACE(ISurfaceComposerClient, data, reply);
+            signalStateChannel();
+            return NO_ERROR;
+        } break;
         default:
             return BBinder::onTransact(code, data, reply, flags);
     }
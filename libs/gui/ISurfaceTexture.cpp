@@ -44,6 +44,9 @@ enum {
 #endif
     CONNECT,
     DISCONNECT,
+    ALLOCATE_BUFFERS,
+    SET_QUEUE_MODE,
+    QUEUE_AND_DEQUEUE_BUFFER,
 };
 
 
@@ -123,6 +126,37 @@ public:
         return result;
     }
 
+    virtual status_t queueAndDequeueBuffer(int buf,
+            const QueueBufferInput& input, QueueBufferOutput* output,
+            int* outBuf, sp<Fence>& fence, uint32_t w, uint32_t h,
+            uint32_t format, uint32_t usage, status_t* outDequeueResult) {
+        Parcel data, reply;
+        data.writeInterfaceToken(ISurfaceTexture::getInterfaceDescriptor());
+        data.writeInt32(buf);
+        data.write(input);
+        data.writeInt32(w);
+        data.writeInt32(h);
+        data.writeInt32(format);
+        data.writeInt32(usage);
+        *outDequeueResult = NO_INIT;
+        status_t result = remote()->transact(QUEUE_AND_DEQUEUE_BUFFER,
+                data, &reply);
+        if (result != NO_ERROR) {
+            return result;
+        }
+        memcpy(output, reply.readInplace(sizeof(*output)), sizeof(*output));
+        result = reply.readInt32();
+        *outBuf = reply.readInt32();
+        fence.clear();
+        bool hasFence = reply.readInt32();
+        if (hasFence) {
+            fence = new Fence();
+            reply.read(*fence.get());
+        }
+        *outDequeueResult = reply.readInt32();
+        return result;
+    }
+
     virtual void cancelBuffer(int buf, sp<Fence> fence) {
         Parcel data, reply;
         bool hasFence = fence.get() && fence->isValid();
@@ -213,6 +247,32 @@ public:
         result = reply.readInt32();
         return result;
     }
+
+    virtual void allocateBuffers(uint32_t w, uint32_t h, uint32_t format,
+            uint32_t usage, int count) {
+        Parcel data, reply;
+        data.writeInterfaceToken(ISurfaceTexture::getInterfaceDescriptor());
+        data.writeInt32(w);
+        data.writeInt32(h);
+        data.writeInt32(format);
+        data.writeInt32(usage);
+        data.writeInt32(count);
+        remote()->transact(ALLOCATE_BUFFERS, data, &reply,
+                IBinder::FLAG_ONEWAY);
+    }
+
+    virtual status_t setQueueMode(int mode, int depth) {
+        Parcel data, reply;
+        data.writeInterfaceToken(ISurfaceTexture::getInterfaceDescriptor());
+        data.writeInt32(mode);
+        data.writeInt32(depth);
+        status_t result = remote()->transact(SET_QUEUE_MODE, data, &reply);
+        if (result != NO_ERROR) {
+            return result;
+        }
+        result = reply.readInt32();
+        return result;
+    }
 };
 
 IMPLEMENT_META_INTERFACE(SurfaceTexture, "android.gui.SurfaceTexture");
@@ -271,6 +331,32 @@ status_t BnSurfaceTexture::onTransact(
             reply->writeInt32(result);
             return NO_ERROR;
         } break;
+        case QUEUE_AND_DEQUEUE_BUFFER: {
+            CHECK_INTERFACE(ISurfaceTexture, data, reply);
+            int buf = data.readInt32();
+            QueueBufferInput input(data);
+            uint32_t w      = data.readInt32();
+            uint32_t h      = data.readInt32();
+            uint32_t format = data.readInt32();
+            uint32_t usage  = data.readInt32();
+            QueueBufferOutput* const output =
+                    reinterpret_cast<QueueBufferOutput *>(
+                            reply->writeInplace(sizeof(QueueBufferOutput)));
+            int nextBuf = -1;
+            sp<Fence> fence;
+            status_t dequeueResult = NO_INIT;
+            status_t result = queueAndDequeueBuffer(buf, input, output,
+                    &nextBuf, fence, w, h, format, usage, &dequeueResult);
+            bool hasFence = fence.get() && fence->isValid();
+            reply->writeInt32(result);
+            reply->writeInt32(nextBuf);
+            reply->writeInt32(hasFence);
+            if (hasFence) {
+                reply->write(*fence.get());
+            }
+            reply->writeInt32(dequeueResult);
+            return NO_ERROR;
+        } break;
         case CANCEL_BUFFER: {
             CHECK_INTERFACE(ISurfaceTexture, data, reply);
             int buf = data.readInt32();
@@ -334,12 +420,45 @@ status_t BnSurfaceTexture::onTransact(
             reply->writeInt32(res);
             return NO_ERROR;
         } break;
+        case ALLOCATE_BUFFERS: {
+            CHECK_INTERFACE(ISurfaceTexture, data, reply);
+            uint32_t w = data.readInt32();
+            uint32_t h = data.readInt32();
+            uint32_t format = data.readInt32();
+            uint32_t usage = data.readInt32();
+            int count = data.readInt32();
+            allocateBuffers(w, h, format, usage, count);
+            return NO_ERROR;
+        } break;
+        case SET_QUEUE_MODE: {
+            CHECK_INTERFACE(ISurfaceTexture, data, reply);
+            int mode = data.readInt32();
+            int depth = data.readInt32();
+            status_t res = setQueueMode(mode, depth);
+            reply->writeInt32(res);
+            return NO_ERROR;
+        } break;
     }
     return BBinder::onTransact(code, data, reply, flags);
 }
 
 // ----------------------------------------------------------------------------
 
+status_t ISurfaceTexture::queueAndDequeueBuffer(int slot,
+        const QueueBufferInput& input, QueueBufferOutput* output,
+        int* outSlot, sp<Fence>& fence, uint32_t w, uint32_t h,
+        uint32_t format, uint32_t usage, status_t* outDequeueResult)
+{
+    *outDequeueResult = NO_INIT;
+    status_t result = queueBuffer(slot, input, output);
+    if (result == NO_ERROR) {
+        *outDequeueResult = dequeueBuffer(outSlot, fence, w, h, format, usage);
+    }
+    return result;
+}
+
+// ----------------------------------------------------------------------------
+
 static bool isValid(const sp<Fence>& fence) {
     return fence.get() && fence->isValid();
 }
@@ -351,6 +470,7 @@ ISurfaceTexture::QueueBufferInput::QueueBufferInput(const Parcel& parcel) {
 size_t ISurfaceTexture::QueueBufferInput::getFlattenedSize() const
 {
     return sizeof(timestamp)
+         + sizeof(isAutoTimestamp)
          + sizeof(crop)
          + sizeof(scalingMode)
          + sizeof(transform)
@@ -370,6 +490,8 @@ status_t ISurfaceTexture::QueueBufferInput::flatten(void* buffer, size_t size,
     bool haveFence = isValid(fence);
     char* p = (char*)buffer;
     memcpy(p, &timestamp,   sizeof(timestamp));   p += sizeof(timestamp);
+    memcpy(p, &isAutoTimestamp, sizeof(isAutoTimestamp));
+    p += sizeof(isAutoTimestamp);
     memcpy(p, &crop,        sizeof(crop));        p += sizeof(crop);
     memcpy(p, &scalingMode, sizeof(scalingMode)); p += sizeof(scalingMode);
     memcpy(p, &transform,   sizeof(transform));   p += sizeof(transform);
@@ -387,6 +509,8 @@ status_t ISurfaceTexture::QueueBufferInput::unflatten(void const* buffer,
     bool haveFence;
     const char* p = (const char*)buffer;
     memcpy(&timestamp,   p, sizeof(timestamp));   p += sizeof(timestamp);
+    memcpy(&isAutoTimestamp, p, sizeof(isAutoTimestamp));
+    p += sizeof(isAutoTimestamp);
     memcpy(&crop,        p, sizeof(crop));        p += sizeof(crop);
     memcpy(&scalingMode, p, sizeof(scalingMode)); p += sizeof(scalingMode);
     memcpy(&transform,   p, sizeof(transform));   p += sizeof(transform);
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/Errors.h>
+#include <utils/RefBase.h>
+
+#include <binder/Parcel.h>
+#include <binder/IInterface.h>
+
+#include <ui/Fence.h>
+
+#include <gui/ITransactionCompletedListener.h>
+
+namespace android {
+// ----------------------------------------------------------------------------
+
+enum {
+    ON_TRANSACTION_COMPLETED = IBinder::FIRST_CALL_TRANSACTION,
+};
+
+class BpTransactionCompletedListener :
+        public BpInterface<ITransactionCompletedListener>
+{
+public:
+    BpTransactionCompletedListener(const sp<IBinder>& impl)
+        : BpInterface<ITransactionCompletedListener>(impl)
+    {
+    }
+
+    virtual void onTransactionCompleted(const sp<Fence>& fence) {
+        Parcel data, reply;
+        data.writeInterfaceToken(
+                ITransactionCompletedListener::getInterfaceDescriptor());
+        bool hasFence = fence.get() && fence->isValid();
+        data.writeInt32(hasFence);
+        if (hasFence) {
+            data.write(*fence.get());
+        }
+        remote()->transact(ON_TRANSACTION_COMPLETED, data, &reply,
+                IBinder::FLAG_ONEWAY);
+    }
+};
+
+IMPLEMENT_META_INTERFACE(TransactionCompletedListener,
+        "android.gui.TransactionCompletedListener");
+
+// ----------------------------------------------------------------------------
+
+status_t BnTransactionCompletedListener::onTransact(
+    uint32_t code, const Parcel& data, Parcel* reply, uint32_t flags)
+{
+    switch(code) {
+        case ON_TRANSACTION_COMPLETED: {
+            CHECK_INTERFACE(ITransactionCompletedListener, data, reply);
+            sp<Fence> fence(Fence::NO_FENCE);
+            if (data.readInt32()) {
+                fence = new Fence();
+                data.read(*fence.get());
+            }
+            onTransactionCompleted(fence);
+            return NO_ERROR;
+        } break;
+    }
+    return BBinder::onTransact(code, data, reply, flags);
+}
+
+// ----------------------------------------------------------------------------
+}; // namespace android
@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <string.h>
+
 #include <utils/Errors.h>
 #include <binder/Parcel.h>
 #include <gui/ISurfaceComposerClient.h>
@@ -50,6 +52,157 @@ status_t layer_state_t::read(const Parcel& input)
     return NO_ERROR;
 }
 
+// ---------------------------------------------------------------------------
+
+static inline void putFloat(uint32_t*& cursor, float v) {
+    memcpy(cursor++, &v, sizeof(uint32_t));
+}
+
+static inline float getFloat(uint32_t const*& cursor) {
+    float v;
+    memcpy(&v, cursor++, sizeof(uint32_t));
+    return v;
+}
+
+// number of words taken by the fixed-size fields selected by 'what',
+// including the length of the transparent region but not its rects
+static size_t getCompactWords(uint32_t what) {
+    size_t words = 0;
+    if (what & layer_state_t::ePositionChanged)             words += 2;
+    if (what & layer_state_t::eLayerChanged)                words += 1;
+    if (what & layer_state_t::eSizeChanged)                 words += 2;
+    if (what & layer_state_t::eAlphaChanged)                words += 1;
+    if (what & layer_state_t::eMatrixChanged)               words += 4;
+    if (what & layer_state_t::eVisibilityChanged)           words += 1;
+    if (what & layer_state_t::eLayerStackChanged)           words += 1;
+    if (what & layer_state_t::eCropChanged)                 words += 4;
+    if (what & layer_state_t::eFrameRateChanged)            words += 1;
+    if (what & layer_state_t::eTransparentRegionChanged)    words += 1;
+    return words;
+}
+
+size_t layer_state_t::getCompactSize() const
+{
+    size_t size = (2 + getCompactWords(what)) * sizeof(uint32_t);
+    if (what & eTransparentRegionChanged) {
+        size += transparentRegion.getSize();
+    }
+    return size;
+}
+
+void layer_state_t::writeCompact(uint32_t*& cursor) const
+{
+    *cursor++ = surface;
+    *cursor++ = what;
+    if (what & ePositionChanged) {
+        putFloat(cursor, x);
+        putFloat(cursor, y);
+    }
+    if (what & eLayerChanged) {
+        *cursor++ = z;
+    }
+    if (what & eSizeChanged) {
+        *cursor++ = w;
+        *cursor++ = h;
+    }
+    if (what & eAlphaChanged) {
+        putFloat(cursor, alpha);
+    }
+    if (what & eMatrixChanged) {
+        putFloat(cursor, matrix.dsdx);
+        putFloat(cursor, matrix.dtdx);
+        putFloat(cursor, matrix.dsdy);
+        putFloat(cursor, matrix.dtdy);
+    }
+    if (what & eVisibilityChanged) {
+        *cursor++ = flags | (uint32_t(mask) << 8);
+    }
+    if (what & eLayerStackChanged) {
+        *cursor++ = layerStack;
+    }
+    if (what & eCropChanged) {
+        *cursor++ = crop.left;
+        *cursor++ = crop.top;
+        *cursor++ = crop.right;
+        *cursor++ = crop.bottom;
+    }
+    if (what & eFrameRateChanged) {
+        putFloat(cursor, frameRate);
+    }
+    // NOTE: the region is last, it's the only variable-size field
+    if (what & eTransparentRegionChanged) {
+        const size_t size = transparentRegion.getSize();
+        *cursor++ = size;
+        transparentRegion.flatten(cursor);
+        cursor += size / sizeof(uint32_t);
+    }
+}
+
+status_t layer_state_t::readCompact(uint32_t const*& cursor,
+        uint32_t const* end)
+{
+    if (end - cursor < 2) {
+        return BAD_VALUE;
+    }
+    surface = *cursor++;
+    what = *cursor++;
+    if (size_t(end - cursor) < getCompactWords(what)) {
+        return BAD_VALUE;
+    }
+    if (what & ePositionChanged) {
+        x = getFloat(cursor);
+        y = getFloat(cursor);
+    }
+    if (what & eLayerChanged) {
+        z = *cursor++;
+    }
+    if (what & eSizeChanged) {
+        w = *cursor++;
+        h = *cursor++;
+    }
+    if (what & eAlphaChanged) {
+        alpha = getFloat(cursor);
+    }
+    if (what & eMatrixChanged) {
+        matrix.dsdx = getFloat(cursor);
+        matrix.dtdx = getFloat(cursor);
+        matrix.dsdy = getFloat(cursor);
+        matrix.dtdy = getFloat(cursor);
+    }
+    if (what & eVisibilityChanged) {
+        const uint32_t v = *cursor++;
+        flags = uint8_t(v);
+        mask = uint8_t(v >> 8);
+    }
+    if (what & eLayerStackChanged) {
+        layerStack = *cursor++;
+    }
+    if (what & eCropChanged) {
+        crop.left   = *cursor++;
+        crop.top    = *cursor++;
+        crop.right  = *cursor++;
+        crop.bottom = *cursor++;
+    }
+    if (what & eFrameRateChanged) {
+        frameRate = getFloat(cursor);
+    }
+    if (what & eTransparentRegionChanged) {
+        const size_t size = *cursor++;
+        if ((size % sizeof(Rect)) ||
+                size > size_t(end - cursor) * sizeof(uint32_t)) {
+            return BAD_VALUE;
+        }
+        status_t err = transparentRegion.unflatten(cursor, size);
+        if (err != NO_ERROR) {
+            return err;
+        }
+        cursor += size / sizeof(uint32_t);
+    }
+    return NO_ERROR;
+}
+
+// ---------------------------------------------------------------------------
+
 status_t ComposerState::write(Parcel& output) const {
     output.writeStrongBinder(client->asBinder());
     return state.write(output);
@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "LayerStateChannel"
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+
+#include <cutils/atomic.h>
+#include <utils/Log.h>
+
+#include <binder/MemoryHeapBase.h>
+
+#include <private/gui/LayerStateChannel.h>
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+LayerStateChannel::LayerStateChannel(size_t size)
+    : mControl(NULL), mCapacity(0), mIndex(0), mPending(0),
+      mInitCheck(NO_INIT)
+{
+    size_t capacity = 1;
+    while (capacity * sizeof(uint32_t) < size) {
+        capacity <<= 1;
+    }
+    mHeap = new MemoryHeapBase(sizeof(Control) + capacity * sizeof(uint32_t),
+            0, "LayerStateChannel");
+    if (mHeap->getHeapID() < 0) {
+        ALOGE("LayerStateChannel: can't allocate %u bytes", size);
+        mInitCheck = NO_MEMORY;
+        return;
+    }
+    mControl = static_cast<Control*>(mHeap->getBase());
+    mControl->writeIndex = 0;
+    mControl->readIndex = 0;
+    mControl->signaled = 0;
+    mControl->capacity = capacity;
+    mCapacity = capacity;
+    mInitCheck = NO_ERROR;
+}
+
+LayerStateChannel::LayerStateChannel(const sp<IMemoryHeap>& heap)
+    : mHeap(heap), mControl(NULL), mCapacity(0), mIndex(0), mPending(0),
+      mInitCheck(BAD_VALUE)
+{
+    if (heap == NULL) {
+        return;
+    }
+    void* base = heap->getBase();
+    const size_t size = heap->getSize();
+    if (base == MAP_FAILED || size < sizeof(Control)) {
+        ALOGE("LayerStateChannel: can't map the channel");
+        return;
+    }
+    mControl = static_cast<Control*>(base);
+    const uint32_t capacity = mControl->capacity;
+    if (capacity < 2 || (capacity & (capacity - 1)) ||
+            capacity > (size - sizeof(Control)) / sizeof(uint32_t)) {
+        ALOGE("LayerStateChannel: bad capacity %u for %u bytes",
+                capacity, size);
+        mControl = NULL;
+        return;
+    }
+    mCapacity = capacity;
+    mIndex = uint32_t(android_atomic_acquire_load(&mControl->writeIndex));
+    mInitCheck = NO_ERROR;
+}
+
+LayerStateChannel::~LayerStateChannel()
+{
+}
+
+status_t LayerStateChannel::initCheck() const
+{
+    return mInitCheck;
+}
+
+uint32_t* LayerStateChannel::words() const
+{
+    return reinterpret_cast<uint32_t*>(mControl + 1);
+}
+
+// ---------------------------------------------------------------------------
+
+uint32_t* LayerStateChannel::beginWrite(size_t count)
+{
+    if (mInitCheck != NO_ERROR || count + 1 > mCapacity) {
+        return NULL;
+    }
+
+    const uint32_t readIndex =
+            uint32_t(android_atomic_acquire_load(&mControl->readIndex));
+    uint32_t used = mIndex - readIndex;
+    if (used > mCapacity) {
+        // the consumer's index makes no sense, don't overwrite anything
+        return NULL;
+    }
+    const uint32_t offset = mIndex & (mCapacity - 1);
+    const uint32_t contiguous = mCapacity - offset;
+    const uint32_t need = count + 1;
+    if (contiguous < need) {
+        // the transaction must start at the beginning of the ring. The
+        // end of the ring is skipped right away, even if the transaction
+        // doesn't fit yet, so that an empty ring always has room for it.
+        if (used + contiguous > mCapacity) {
+            return NULL;
+        }
+        words()[offset] = WRAP;
+        mIndex += contiguous;
+        used += contiguous;
+        android_atomic_release_store(int32_t(mIndex), &mControl->writeIndex);
+    }
+    if (used + need > mCapacity) {
+        return NULL;
+    }
+    uint32_t* const header = words() + (mIndex & (mCapacity - 1));
+    *header = count;
+    mPending = need;
+    return header + 1;
+}
+
+void LayerStateChannel::endWrite(bool* wake)
+{
+    *wake = false;
+    if (mInitCheck != NO_ERROR || mPending == 0) {
+        return;
+    }
+    mIndex += mPending;
+    mPending = 0;
+    android_atomic_release_store(int32_t(mIndex), &mControl->writeIndex);
+
+    // the new write index must be visible before we look at the doorbell,
+    // or a consumer clearing it could miss both
+    android_memory_barrier();
+    if (android_atomic_cmpxchg(0, 1, &mControl->signaled) == 0) {
+        *wake = true;
+    }
+}
+
+bool LayerStateChannel::isEmpty() const
+{
+    if (mInitCheck != NO_ERROR) {
+        return true;
+    }
+    return uint32_t(android_atomic_acquire_load(&mControl->readIndex)) ==
+            mIndex;
+}
+
+// ---------------------------------------------------------------------------
+
+void LayerStateChannel::clearSignaled()
+{
+    if (mInitCheck != NO_ERROR) {
+        return;
+    }
+    android_atomic_release_store(0, &mControl->signaled);
+    // pairs with the barrier in endWrite()
+    android_memory_barrier();
+}
+
+uint32_t const* LayerStateChannel::read(size_t* count)
+{
+    *count = 0;
+    if (mInitCheck != NO_ERROR) {
+        return NULL;
+    }
+
+    const uint32_t writeIndex =
+            uint32_t(android_atomic_acquire_load(&mControl->writeIndex));
+    while (writeIndex != mIndex) {
+        const uint32_t avail = writeIndex - mIndex;
+        const uint32_t offset = mIndex & (mCapacity - 1);
+        const uint32_t contiguous = mCapacity - offset;
+        const uint32_t header = words()[offset];
+        if (avail > mCapacity) {
+            break;
+        }
+        if (header == WRAP) {
+            if (contiguous > avail) {
+                break;
+            }
+            mIndex += contiguous;
+            continue;
+        }
+        if (header >= contiguous || header >= avail) {
+            break;
+        }
+        if (mBuffer.size() < header) {
+            mBuffer.insertAt(uint32_t(0), mBuffer.size(),
+                    header - mBuffer.size());
+        }
+        memcpy(mBuffer.editArray(), words() + offset + 1,
+                header * sizeof(uint32_t));
+        mIndex += header + 1;
+        android_atomic_release_store(int32_t(mIndex), &mControl->readIndex);
+        *count = header;
+        return mBuffer.array();
+    }
+
+    if (writeIndex != mIndex) {
+        // can't happen with a well-behaved producer, resynchronize
+        ALOGE("LayerStateChannel: bad transaction, dropping %u words",
+                writeIndex - mIndex);
+        mIndex = writeIndex;
+    }
+    android_atomic_release_store(int32_t(mIndex), &mControl->readIndex);
+    return NULL;
+}
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
@@ -15,6 +15,7 @@
  */
 
 #include <stdint.h>
+#include <string.h>
 #include <sys/types.h>
 
 #include <utils/Errors.h>
@@ -98,85 +99,73 @@ int32_t Sensor::getVersion() const {
     return mVersion;
 }
 
+/*
+ * The flattened form is a FlatSensor followed by the name and the vendor,
+ * without terminators, padded to 4 bytes. All the numbers can be read with
+ * a single copy, and only the strings need to be allocated.
+ */
+struct FlatSensor {
+    int32_t version;
+    int32_t handle;
+    int32_t type;
+    float   minValue;
+    float   maxValue;
+    float   resolution;
+    float   power;
+    int32_t minDelay;
+    uint32_t nameLength;
+    uint32_t vendorLength;
+};
+
 size_t Sensor::getSize() const
 {
-    return  sizeof(int32_t) + ((mName.length() + 3) & ~3) +
-            sizeof(int32_t) + ((mVendor.length() + 3) & ~3) +
-            sizeof(int32_t) * 3 +
-            sizeof(float) * 4 +
-            sizeof(int32_t);
-}
-
-static inline
-size_t write(void* buffer, size_t offset, const String8& value) {
-    memcpy(static_cast<char*>(buffer) + offset, value.string(), value.length());
-    return (value.length() + 3) & ~3;
-}
-
-static inline
-size_t write(void* buffer, size_t offset, float value) {
-    *reinterpret_cast<float*>(static_cast<char*>(buffer) + offset) = value;
-    return sizeof(float);
-}
-
-static inline
-size_t write(void* buffer, size_t offset, int32_t value) {
-    *reinterpret_cast<int32_t*>(static_cast<char*>(buffer) + offset) = value;
-    return sizeof(int32_t);
+    return sizeof(FlatSensor) + ((mName.length() + mVendor.length() + 3) & ~3);
 }
 
 status_t Sensor::flatten(void* buffer) const
 {
-    size_t offset = 0;
-    offset += write(buffer, offset, int32_t(mName.length()));
-    offset += write(buffer, offset, mName);
-    offset += write(buffer, offset, int32_t(mVendor.length()));
-    offset += write(buffer, offset, mVendor);
-    offset += write(buffer, offset, mVersion);
-    offset += write(buffer, offset, mHandle);
-    offset += write(buffer, offset, mType);
-    offset += write(buffer, offset, mMinValue);
-    offset += write(buffer, offset, mMaxValue);
-    offset += write(buffer, offset, mResolution);
-    offset += write(buffer, offset, mPower);
-    offset += write(buffer, offset, mMinDelay);
+    FlatSensor* flat = static_cast<FlatSensor*>(buffer);
+    flat->version = mVersion;
+    flat->handle = mHandle;
+    flat->type = mType;
+    flat->minValue = mMinValue;
+    flat->maxValue = mMaxValue;
+    flat->resolution = mResolution;
+    flat->power = mPower;
+    flat->minDelay = mMinDelay;
+    flat->nameLength = mName.length();
+    flat->vendorLength = mVendor.length();
+    char* strings = reinterpret_cast<char*>(flat + 1);
+    memcpy(strings, mName.string(), mName.length());
+    memcpy(strings + mName.length(), mVendor.string(), mVendor.length());
+    // don't leak whatever was in the padding
+    const size_t end = mName.length() + mVendor.length();
+    memset(strings + end, 0, ((end + 3) & ~3) - end);
     return NO_ERROR;
 }
 
-static inline
-size_t read(void const* buffer, size_t offset, String8* value, int32_t len) {
-    value->setTo(static_cast<char const*>(buffer) + offset, len);
-    return (len + 3) & ~3;
-}
-
-static inline
-size_t read(void const* buffer, size_t offset, float* value) {
-    *value = *reinterpret_cast<float const*>(static_cast<char const*>(buffer) + offset);
-    return sizeof(float);
-}
-
-static inline
-size_t read(void const* buffer, size_t offset, int32_t* value) {
-    *value = *reinterpret_cast<int32_t const*>(static_cast<char const*>(buffer) + offset);
-    return sizeof(int32_t);
-}
-
 status_t Sensor::unflatten(void const* buffer, size_t size)
 {
-    int32_t len;
-    size_t offset = 0;
-    offset += read(buffer, offset, &len);
-    offset += read(buffer, offset, &mName, len);
-    offset += read(buffer, offset, &len);
-    offset += read(buffer, offset, &mVendor, len);
-    offset += read(buffer, offset, &mVersion);
-    offset += read(buffer, offset, &mHandle);
-    offset += read(buffer, offset, &mType);
-    offset += read(buffer, offset, &mMinValue);
-    offset += read(buffer, offset, &mMaxValue);
-    offset += read(buffer, offset, &mResolution);
-    offset += read(buffer, offset, &mPower);
-    offset += read(buffer, offset, &mMinDelay);
+    if (size < sizeof(FlatSensor)) {
+        return NO_MEMORY;
+    }
+    FlatSensor flat;
+    memcpy(&flat, buffer, sizeof(flat));
+    if (flat.nameLength > size - sizeof(FlatSensor) ||
+            flat.vendorLength > size - sizeof(FlatSensor) - flat.nameLength) {
+        return NO_MEMORY;
+    }
+    char const* strings = static_cast<char const*>(buffer) + sizeof(FlatSensor);
+    mName.setTo(strings, flat.nameLength);
+    mVendor.setTo(strings + flat.nameLength, flat.vendorLength);
+    mVersion = flat.version;
+    mHandle = flat.handle;
+    mType = flat.type;
+    mMinValue = flat.minValue;
+    mMaxValue = flat.maxValue;
+    mResolution = flat.resolution;
+    mPower = flat.power;
+    mMinDelay = flat.minDelay;
     return NO_ERROR;
 }
 
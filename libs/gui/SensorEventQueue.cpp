@@ -26,6 +26,7 @@
 #include <gui/Sensor.h>
 #include <gui/BitTube.h>
 #include <gui/SensorEventQueue.h>
+#include <gui/SensorEventRing.h>
 #include <gui/ISensorEventConnection.h>
 
 #include <android/sensor.h>
@@ -39,13 +40,58 @@ SensorEventQueue::SensorEventQueue(const sp<ISensorEventConnection>& connection)
 {
 }
 
+// Reads the queue's events when its fd is readable, on the looper's thread.
+class SensorEventQueue::LooperEventCallback : public LooperCallback {
+public:
+    LooperEventCallback(const wp<SensorEventQueue>& queue,
+            const sp<EventListener>& listener)
+        : mQueue(queue), mListener(listener) {
+    }
+
+    virtual int handleEvent(int fd, int events, void* data) {
+        sp<SensorEventQueue> queue(mQueue.promote());
+        if (queue == NULL) {
+            return 0;
+        }
+        if (events & (ALOOPER_EVENT_HANGUP | ALOOPER_EVENT_ERROR)) {
+            ALOGE("SensorEventQueue: connection broken (events=%#x)", events);
+            queue->onDetached(this);
+            mListener->onSensorEvents(queue, NULL, 0);
+            return 0;
+        }
+        // until empty, which also asks the service to ring again when
+        // events come through the shared ring
+        ASensorEvent buffer[16];
+        ssize_t n;
+        while ((n = queue->read(buffer, 16)) > 0) {
+            mListener->onSensorEvents(queue, buffer, n);
+        }
+        return 1;
+    }
+
+private:
+    const wp<SensorEventQueue> mQueue;
+    const sp<EventListener> mListener;
+};
+
 SensorEventQueue::~SensorEventQueue()
 {
+    detachLooper();
 }
 
 void SensorEventQueue::onFirstRef()
 {
     mSensorChannel = mSensorEventConnection->getSensorChannel();
+
+    // ask for the shared ring before any sensor is enabled, so that no
+    // event is left behind in the BitTube
+    sp<IMemoryHeap> heap(mSensorEventConnection->getSensorEventRing());
+    if (heap != NULL) {
+        sp<SensorEventRing> ring(new SensorEventRing(heap));
+        if (ring->initCheck() == NO_ERROR) {
+            mSensorEventRing = ring;
+        }
+    }
 }
 
 int SensorEventQueue::getFd() const
@@ -61,7 +107,22 @@ ssize_t SensorEventQueue::write(const sp<BitTube>& tube,
 
 ssize_t SensorEventQueue::read(ASensorEvent* events, size_t numEvents)
 {
-    return BitTube::recvObjects(mSensorChannel, events, numEvents);
+    if (mSensorEventRing == NULL) {
+        return BitTube::recvObjects(mSensorChannel, events, numEvents);
+    }
+
+    size_t count = mSensorEventRing->read(events, numEvents);
+    if (count == 0) {
+        // the ring is empty and the caller is going back to sleep on the
+        // fd: throw away the doorbells already rung, ask for a new one,
+        // then pick up what was written before the service saw the request
+        ASensorEvent doorbell;
+        while (mSensorChannel->read(&doorbell, sizeof(doorbell)) > 0) {
+        }
+        mSensorEventRing->setWaiting();
+        count = mSensorEventRing->read(events, numEvents);
+    }
+    return count;
 }
 
 sp<Looper> SensorEventQueue::getLooper() const
@@ -74,8 +135,54 @@ sp<Looper> SensorEventQueue::getLooper() const
     return mLooper;
 }
 
+status_t SensorEventQueue::attachLooper(const sp<Looper>& looper,
+        const sp<EventListener>& listener)
+{
+    if (looper == NULL || listener == NULL) {
+        return BAD_VALUE;
+    }
+    Mutex::Autolock _l(mLock);
+    if (mAttachedLooper != NULL) {
+        return INVALID_OPERATION;
+    }
+    sp<LooperCallback> callback(new LooperEventCallback(this, listener));
+    if (looper->addFd(getFd(), 0, ALOOPER_EVENT_INPUT, callback, NULL) != 1) {
+        return BAD_VALUE;
+    }
+    mAttachedLooper = looper;
+    mAttachedCallback = callback;
+    return NO_ERROR;
+}
+
+status_t SensorEventQueue::detachLooper()
+{
+    Mutex::Autolock _l(mLock);
+    if (mAttachedLooper == NULL) {
+        return NO_ERROR;
+    }
+    mAttachedLooper->removeFd(getFd());
+    mAttachedLooper.clear();
+    mAttachedCallback.clear();
+    return NO_ERROR;
+}
+
+void SensorEventQueue::onDetached(const sp<LooperCallback>& callback)
+{
+    Mutex::Autolock _l(mLock);
+    if (mAttachedCallback == callback) {
+        mAttachedLooper.clear();
+        mAttachedCallback.clear();
+    }
+}
+
 status_t SensorEventQueue::waitForEvent() const
 {
+    {
+        Mutex::Autolock _l(mLock);
+        if (mAttachedLooper != NULL) {
+            return INVALID_OPERATION;
+        }
+    }
     const int fd = getFd();
     sp<Looper> looper(getLooper());
 
@@ -101,6 +208,12 @@ status_t SensorEventQueue::waitForEvent() const
 
 status_t SensorEventQueue::wake() const
 {
+    {
+        Mutex::Autolock _l(mLock);
+        if (mAttachedLooper != NULL) {
+            return INVALID_OPERATION;
+        }
+    }
     sp<Looper> looper(getLooper());
     looper->wake();
     return NO_ERROR;
@@ -122,6 +235,16 @@ status_t SensorEventQueue::enableSensor(int32_t handle, int32_t us) const {
     return err;
 }
 
+status_t SensorEventQueue::enableSensor(int32_t handle, int32_t us,
+        int64_t maxReportLatencyUs) const {
+    status_t err = mSensorEventConnection->enableDisable(handle, true);
+    if (err == NO_ERROR) {
+        mSensorEventConnection->batch(handle, us2ns(us),
+                us2ns(maxReportLatencyUs));
+    }
+    return err;
+}
+
 status_t SensorEventQueue::disableSensor(int32_t handle) const {
     return mSensorEventConnection->enableDisable(handle, false);
 }
@@ -130,6 +253,20 @@ status_t SensorEventQueue::setEventRate(Sensor const* sensor, nsecs_t ns) const
     return mSensorEventConnection->setEventRate(sensor->getHandle(), ns);
 }
 
+status_t SensorEventQueue::batch(Sensor const* sensor, nsecs_t ns,
+        nsecs_t maxReportLatency) const {
+    return mSensorEventConnection->batch(sensor->getHandle(), ns,
+            maxReportLatency);
+}
+
+status_t SensorEventQueue::flush(Sensor const* sensor) const {
+    return mSensorEventConnection->flush(sensor->getHandle());
+}
+
+status_t SensorEventQueue::setWakeUp(bool wakeUp) const {
+    return mSensorEventConnection->setWakeUp(wakeUp);
+}
+
 // ----------------------------------------------------------------------------
 }; // namespace android
 
@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#define LOG_TAG "Sensors"
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+
+#include <cutils/atomic.h>
+#include <utils/Log.h>
+
+#include <binder/MemoryHeapBase.h>
+
+#include <gui/SensorEventRing.h>
+
+#include <android/sensor.h>
+
+// ----------------------------------------------------------------------------
+namespace android {
+// ----------------------------------------------------------------------------
+
+SensorEventRing::SensorEventRing(size_t capacity)
+    : mControl(NULL), mCapacity(0), mIndex(0), mDropped(0),
+      mInitCheck(NO_INIT)
+{
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    mHeap = new MemoryHeapBase(sizeof(Control) + size * sizeof(ASensorEvent),
+            0, "SensorEventRing");
+    if (mHeap->getHeapID() < 0) {
+        ALOGE("SensorEventRing: can't allocate %u events", size);
+        mInitCheck = NO_MEMORY;
+        return;
+    }
+    mControl = static_cast<Control*>(mHeap->getBase());
+    mControl->writeIndex = 0;
+    mControl->readIndex = 0;
+    mControl->waiting = 0;
+    mControl->capacity = size;
+    mCapacity = size;
+    mInitCheck = NO_ERROR;
+}
+
+SensorEventRing::SensorEventRing(const sp<IMemoryHeap>& heap)
+    : mHeap(heap), mControl(NULL), mCapacity(0), mIndex(0), mDropped(0),
+      mInitCheck(BAD_VALUE)
+{
+    if (heap == NULL) {
+        return;
+    }
+    void* base = heap->getBase();
+    const size_t size = heap->getSize();
+    if (base == MAP_FAILED || size < sizeof(Control)) {
+        ALOGE("SensorEventRing: can't map the ring");
+        return;
+    }
+    mControl = static_cast<Control*>(base);
+    const uint32_t capacity = mControl->capacity;
+    if (capacity == 0 || (capacity & (capacity - 1)) ||
+            capacity > (size - sizeof(Control)) / sizeof(ASensorEvent)) {
+        ALOGE("SensorEventRing: bad capacity %u for %u bytes",
+                capacity, size);
+        mControl = NULL;
+        return;
+    }
+    mCapacity = capacity;
+    mIndex = uint32_t(android_atomic_acquire_load(&mControl->readIndex));
+    mInitCheck = NO_ERROR;
+}
+
+SensorEventRing::~SensorEventRing()
+{
+}
+
+status_t SensorEventRing::initCheck() const
+{
+    return mInitCheck;
+}
+
+ASensorEvent* SensorEventRing::events() const
+{
+    return reinterpret_cast<ASensorEvent*>(mControl + 1);
+}
+
+size_t SensorEventRing::write(ASensorEvent const* buffer, size_t count,
+        bool* wake)
+{
+    *wake = false;
+    if (mInitCheck != NO_ERROR) {
+        return 0;
+    }
+
+    const uint32_t readIndex =
+            uint32_t(android_atomic_acquire_load(&mControl->readIndex));
+    uint32_t used = mIndex - readIndex;
+    if (used > mCapacity) {
+        // the consumer's index makes no sense, don't overwrite anything
+        used = mCapacity;
+    }
+    const size_t n = count < mCapacity - used ? count : mCapacity - used;
+    const size_t offset = mIndex & (mCapacity - 1);
+    const size_t first = n < mCapacity - offset ? n : mCapacity - offset;
+    memcpy(events() + offset, buffer, first * sizeof(ASensorEvent));
+    memcpy(events(), buffer + first, (n - first) * sizeof(ASensorEvent));
+    mIndex += n;
+    mDropped += count - n;
+    android_atomic_release_store(int32_t(mIndex), &mControl->writeIndex);
+
+    // the new write index must be visible before we look at the request,
+    // or a consumer going to sleep could miss both
+    android_memory_barrier();
+    if (android_atomic_cmpxchg(1, 0, &mControl->waiting) == 0) {
+        *wake = true;
+    }
+    return n;
+}
+
+size_t SensorEventRing::getUnreadCount() const
+{
+    if (mInitCheck != NO_ERROR) {
+        return 0;
+    }
+    const uint32_t readIndex =
+            uint32_t(android_atomic_acquire_load(&mControl->readIndex));
+    const uint32_t used = mIndex - readIndex;
+    return used > mCapacity ? mCapacity : used;
+}
+
+size_t SensorEventRing::read(ASensorEvent* buffer, size_t count)
+{
+    if (mInitCheck != NO_ERROR) {
+        return 0;
+    }
+
+    const uint32_t writeIndex =
+            uint32_t(android_atomic_acquire_load(&mControl->writeIndex));
+    uint32_t avail = writeIndex - mIndex;
+    if (avail > mCapacity) {
+        // can't happen with a well-behaved producer, resynchronize
+        mIndex = writeIndex;
+        avail = 0;
+    }
+    const size_t n = count < avail ? count : avail;
+    const size_t offset = mIndex & (mCapacity - 1);
+    const size_t first = n < mCapacity - offset ? n : mCapacity - offset;
+    memcpy(buffer, events() + offset, first * sizeof(ASensorEvent));
+    memcpy(buffer + first, events(), (n - first) * sizeof(ASensorEvent));
+    mIndex += n;
+    android_atomic_release_store(int32_t(mIndex), &mControl->readIndex);
+    return n;
+}
+
+void SensorEventRing::setWaiting()
+{
+    if (mInitCheck != NO_ERROR) {
+        return;
+    }
+    android_atomic_release_store(1, &mControl->waiting);
+    // pairs with the barrier in write()
+    android_memory_barrier();
+}
+
+// ----------------------------------------------------------------------------
+}; // namespace android
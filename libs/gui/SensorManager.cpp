@@ -38,8 +38,60 @@ namespace android {
 
 ANDROID_SINGLETON_STATIC_INSTANCE(SensorManager)
 
+/*
+ * The sensor list of an instance of sensorservice, which never changes.
+ * It's fetched once per process and shared by the SensorManagers talking
+ * to that instance.
+ */
+class SharedSensorList : public LightRefBase<SharedSensorList>
+{
+public:
+    SharedSensorList(const sp<ISensorServer>& server)
+        : mServer(server->asBinder()), mSensors(server->getSensorList()) {
+        const size_t count = mSensors.size();
+        mList = (Sensor const**)malloc(count * sizeof(Sensor*));
+        for (size_t i=0 ; i<count ; i++) {
+            mList[i] = mSensors.array() + i;
+        }
+    }
+    ~SharedSensorList() {
+        free(mList);
+    }
+
+    const sp<IBinder>& getServer() const { return mServer; }
+    Sensor const* const* getList() const { return mList; }
+    size_t size() const { return mSensors.size(); }
+
+    // returns the list of server, fetching it if needed
+    static sp<SharedSensorList> get(const sp<ISensorServer>& server) {
+        Mutex::Autolock _l(sLock);
+        if (sList == NULL || sList->getServer() != server->asBinder()) {
+            sList = new SharedSensorList(server);
+        }
+        return sList;
+    }
+
+    // forgets the list of a server that died
+    static void invalidate(const wp<IBinder>& server) {
+        Mutex::Autolock _l(sLock);
+        if (sList != NULL && sList->getServer() == server) {
+            sList.clear();
+        }
+    }
+
+private:
+    const sp<IBinder> mServer;
+    const Vector<Sensor> mSensors;
+    Sensor const** mList;
+
+    static Mutex sLock;
+    static sp<SharedSensorList> sList;
+};
+
+Mutex SharedSensorList::sLock;
+sp<SharedSensorList> SharedSensorList::sList;
+
 SensorManager::SensorManager()
-    : mSensorList(0)
 {
     // okay we're not locked here, but it's not needed during construction
     assertStateLocked();
@@ -47,16 +99,13 @@ SensorManager::SensorManager()
 
 SensorManager::~SensorManager()
 {
-    free(mSensorList);
 }
 
 void SensorManager::sensorManagerDied()
 {
     Mutex::Autolock _l(mLock);
     mSensorServer.clear();
-    free(mSensorList);
-    mSensorList = NULL;
-    mSensors.clear();
+    mSensorList.clear();
 }
 
 status_t SensorManager::assertStateLocked() const {
@@ -79,6 +128,7 @@ status_t SensorManager::assertStateLocked() const {
             SensorManager& mSensorManger;
             virtual void binderDied(const wp<IBinder>& who) {
                 ALOGW("sensorservice died [%p]", who.unsafe_get());
+                SharedSensorList::invalidate(who);
                 mSensorManger.sensorManagerDied();
             }
         public:
@@ -88,19 +138,12 @@ status_t SensorManager::assertStateLocked() const {
         mDeathObserver = new DeathObserver(*const_cast<SensorManager *>(this));
         mSensorServer->asBinder()->linkToDeath(mDeathObserver);
 
-        mSensors = mSensorServer->getSensorList();
-        size_t count = mSensors.size();
-        mSensorList = (Sensor const**)malloc(count * sizeof(Sensor*));
-        for (size_t i=0 ; i<count ; i++) {
-            mSensorList[i] = mSensors.array() + i;
-        }
+        mSensorList = SharedSensorList::get(mSensorServer);
     }
 
     return NO_ERROR;
 }
 
-
-
 ssize_t SensorManager::getSensorList(Sensor const* const** list) const
 {
     Mutex::Autolock _l(mLock);
@@ -108,8 +151,8 @@ ssize_t SensorManager::getSensorList(Sensor const* const** list) const
     if (err < 0) {
         return ssize_t(err);
     }
-    *list = mSensorList;
-    return mSensors.size();
+    *list = mSensorList->getList();
+    return mSensorList->size();
 }
 
 Sensor const* SensorManager::getDefaultSensor(int type)
@@ -119,9 +162,10 @@ Sensor const* SensorManager::getDefaultSensor(int type)
         // For now we just return the first sensor of that type we find.
         // in the future it will make sense to let the SensorService make
         // that decision.
-        for (size_t i=0 ; i<mSensors.size() ; i++) {
-            if (mSensorList[i]->getType() == type)
-                return mSensorList[i];
+        Sensor const* const* list = mSensorList->getList();
+        for (size_t i=0 ; i<mSensorList->size() ; i++) {
+            if (list[i]->getType() == type)
+                return list[i];
         }
     }
     return NULL;
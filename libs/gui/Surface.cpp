@@ -40,6 +40,8 @@
 #include <gui/SurfaceComposerClient.h>
 #include <gui/SurfaceTextureClient.h>
 
+#include <private/gui/LayerState.h>
+
 namespace android {
 
 // ============================================================================
@@ -92,47 +94,114 @@ bool SurfaceControl::isSameSurface(
     return lhs->mSurface->asBinder() == rhs->mSurface->asBinder();
 }
 
+SurfaceControl::CachedState::CachedState()
+    : cached(0), layerStack(0), layer(0), x(0), y(0), w(0), h(0),
+      alpha(0), frameRate(0), flags(0), flagsMask(0)
+{
+    matrix[0] = matrix[1] = matrix[2] = matrix[3] = 0;
+}
+
 status_t SurfaceControl::setLayerStack(int32_t layerStack) {
     status_t err = validate();
     if (err < 0) return err;
+    Mutex::Autolock _l(mLock);
+    CachedState& cs(mCachedState);
+    if ((cs.cached & CachedState::eLayerStack) && cs.layerStack == layerStack)
+        return NO_ERROR;
+    const sp<SurfaceComposerClient>& client(mClient);
+    err = client->setLayerStack(mToken, layerStack);
+    if (err == NO_ERROR) {
+        cs.layerStack = layerStack;
+        cs.cached |= CachedState::eLayerStack;
+    }
+    return err;
+}
+status_t SurfaceControl::setFrameRate(float frameRate) {
+    status_t err = validate();
+    if (err < 0) return err;
+    Mutex::Autolock _l(mLock);
+    CachedState& cs(mCachedState);
+    if ((cs.cached & CachedState::eFrameRate) && cs.frameRate == frameRate)
+        return NO_ERROR;
     const sp<SurfaceComposerClient>& client(mClient);
-    return client->setLayerStack(mToken, layerStack);
+    err = client->setFrameRate(mToken, frameRate);
+    if (err == NO_ERROR) {
+        cs.frameRate = frameRate;
+        cs.cached |= CachedState::eFrameRate;
+    }
+    return err;
 }
 status_t SurfaceControl::setLayer(int32_t layer) {
     status_t err = validate();
     if (err < 0) return err;
+    Mutex::Autolock _l(mLock);
+    CachedState& cs(mCachedState);
+    if ((cs.cached & CachedState::eLayer) && cs.layer == layer)
+        return NO_ERROR;
     const sp<SurfaceComposerClient>& client(mClient);
-    return client->setLayer(mToken, layer);
+    err = client->setLayer(mToken, layer);
+    if (err == NO_ERROR) {
+        cs.layer = layer;
+        cs.cached |= CachedState::eLayer;
+    }
+    return err;
 }
 status_t SurfaceControl::setPosition(int32_t x, int32_t y) {
     status_t err = validate();
     if (err < 0) return err;
+    Mutex::Autolock _l(mLock);
+    CachedState& cs(mCachedState);
+    if ((cs.cached & CachedState::ePosition) && cs.x == x && cs.y == y)
+        return NO_ERROR;
     const sp<SurfaceComposerClient>& client(mClient);
-    return client->setPosition(mToken, x, y);
+    err = client->setPosition(mToken, x, y);
+    if (err == NO_ERROR) {
+        cs.x = x;
+        cs.y = y;
+        cs.cached |= CachedState::ePosition;
+    }
+    return err;
 }
 status_t SurfaceControl::setSize(uint32_t w, uint32_t h) {
     status_t err = validate();
     if (err < 0) return err;
+    Mutex::Autolock _l(mLock);
+    CachedState& cs(mCachedState);
+    if ((cs.cached & CachedState::eSize) && cs.w == w && cs.h == h)
+        return NO_ERROR;
     const sp<SurfaceComposerClient>& client(mClient);
-    return client->setSize(mToken, w, h);
+    err = client->setSize(mToken, w, h);
+    if (err == NO_ERROR) {
+        cs.w = w;
+        cs.h = h;
+        cs.cached |= CachedState::eSize;
+    }
+    return err;
 }
 status_t SurfaceControl::hide() {
-    status_t err = validate();
-    if (err < 0) return err;
-    const sp<SurfaceComposerClient>& client(mClient);
-    return client->hide(mToken);
+    return setFlagsCached(layer_state_t::eLayerHidden,
+            layer_state_t::eLayerHidden);
 }
 status_t SurfaceControl::show() {
-    status_t err = validate();
-    if (err < 0) return err;
-    const sp<SurfaceComposerClient>& client(mClient);
-    return client->show(mToken);
+    return setFlagsCached(0, layer_state_t::eLayerHidden);
 }
 status_t SurfaceControl::setFlags(uint32_t flags, uint32_t mask) {
+    return setFlagsCached(flags, mask);
+}
+status_t SurfaceControl::setFlagsCached(uint32_t flags, uint32_t mask) {
     status_t err = validate();
     if (err < 0) return err;
+    Mutex::Autolock _l(mLock);
+    CachedState& cs(mCachedState);
+    if ((cs.flagsMask & mask) == mask && (cs.flags & mask) == (flags & mask))
+        return NO_ERROR;
     const sp<SurfaceComposerClient>& client(mClient);
-    return client->setFlags(mToken, flags, mask);
+    err = client->setFlags(mToken, flags, mask);
+    if (err == NO_ERROR) {
+        cs.flags = (cs.flags & ~mask) | (flags & mask);
+        cs.flagsMask |= mask;
+    }
+    return err;
 }
 status_t SurfaceControl::setTransparentRegionHint(const Region& transparent) {
     status_t err = validate();
@@ -143,20 +212,52 @@ status_t SurfaceControl::setTransparentRegionHint(const Region& transparent) {
 status_t SurfaceControl::setAlpha(float alpha) {
     status_t err = validate();
     if (err < 0) return err;
+    Mutex::Autolock _l(mLock);
+    CachedState& cs(mCachedState);
+    if ((cs.cached & CachedState::eAlpha) && cs.alpha == alpha)
+        return NO_ERROR;
     const sp<SurfaceComposerClient>& client(mClient);
-    return client->setAlpha(mToken, alpha);
+    err = client->setAlpha(mToken, alpha);
+    if (err == NO_ERROR) {
+        cs.alpha = alpha;
+        cs.cached |= CachedState::eAlpha;
+    }
+    return err;
 }
 status_t SurfaceControl::setMatrix(float dsdx, float dtdx, float dsdy, float dtdy) {
     status_t err = validate();
     if (err < 0) return err;
+    Mutex::Autolock _l(mLock);
+    CachedState& cs(mCachedState);
+    if ((cs.cached & CachedState::eMatrix) &&
+            cs.matrix[0] == dsdx && cs.matrix[1] == dtdx &&
+            cs.matrix[2] == dsdy && cs.matrix[3] == dtdy)
+        return NO_ERROR;
     const sp<SurfaceComposerClient>& client(mClient);
-    return client->setMatrix(mToken, dsdx, dtdx, dsdy, dtdy);
+    err = client->setMatrix(mToken, dsdx, dtdx, dsdy, dtdy);
+    if (err == NO_ERROR) {
+        cs.matrix[0] = dsdx;
+        cs.matrix[1] = dtdx;
+        cs.matrix[2] = dsdy;
+        cs.matrix[3] = dtdy;
+        cs.cached |= CachedState::eMatrix;
+    }
+    return err;
 }
 status_t SurfaceControl::setCrop(const Rect& crop) {
     status_t err = validate();
     if (err < 0) return err;
+    Mutex::Autolock _l(mLock);
+    CachedState& cs(mCachedState);
+    if ((cs.cached & CachedState::eCrop) && cs.crop == crop)
+        return NO_ERROR;
     const sp<SurfaceComposerClient>& client(mClient);
-    return client->setCrop(mToken, crop);
+    err = client->setCrop(mToken, crop);
+    if (err == NO_ERROR) {
+        cs.crop = crop;
+        cs.cached |= CachedState::eCrop;
+    }
+    return err;
 }
 
 status_t SurfaceControl::validate() const
@@ -16,10 +16,12 @@
 
 #define LOG_TAG "SurfaceComposerClient"
 
+#include <pthread.h>
 #include <stdint.h>
 #include <sys/types.h>
 
 #include <utils/Errors.h>
+#include <utils/KeyedVector.h>
 #include <utils/Log.h>
 #include <utils/Singleton.h>
 #include <utils/SortedVector.h>
@@ -35,9 +37,11 @@
 #include <gui/ISurfaceComposer.h>
 #include <gui/ISurfaceComposerClient.h>
 #include <gui/SurfaceComposerClient.h>
+#include <gui/ITransactionCompletedListener.h>
 
 #include <private/gui/ComposerService.h>
 #include <private/gui/LayerState.h>
+#include <private/gui/LayerStateChannel.h>
 
 namespace android {
 // ---------------------------------------------------------------------------
@@ -114,17 +118,38 @@ class Composer : public Singleton<Composer>
     mutable Mutex               mLock;
     SortedVector<ComposerState> mComposerStates;
     SortedVector<DisplayState > mDisplayStates;
+    Vector< sp<ITransactionCompletedListener> > mCompletionListeners;
     uint32_t                    mForceSynchronous;
+    // the depth of the calling thread's open transactions, a thread never
+    // waits for another one's outer transaction to close
+    pthread_key_t               mTransactionNestKey;
     bool                        mAnimation;
+    DefaultKeyedVector< sp<ISurfaceComposerClient>,
+            sp<LayerStateChannel> > mStateChannels;
 
     Composer() : Singleton<Composer>(),
         mForceSynchronous(0),
         mAnimation(false)
-    { }
+    {
+        pthread_key_create(&mTransactionNestKey, NULL);
+    }
+
+    uintptr_t getTransactionNestCount() const {
+        return uintptr_t(pthread_getspecific(mTransactionNestKey));
+    }
+    void setTransactionNestCount(uintptr_t count) {
+        pthread_setspecific(mTransactionNestKey,
+                reinterpret_cast<const void*>(count));
+    }
 
+    void openGlobalTransactionImpl();
     void closeGlobalTransactionImpl(bool synchronous);
+    void closeGlobalTransactionAsyncImpl(
+            const sp<ITransactionCompletedListener>& listener);
     void setAnimationTransactionImpl();
 
+    sp<ISurfaceComposerClient> writeStateChannelLocked();
+
     layer_state_t* getLayerStateLocked(
             const sp<SurfaceComposerClient>& client, SurfaceID id);
 
@@ -154,6 +179,11 @@ public:
             const Rect& crop);
     status_t setLayerStack(const sp<SurfaceComposerClient>& client,
             SurfaceID id, uint32_t layerStack);
+    status_t setFrameRate(const sp<SurfaceComposerClient>& client,
+            SurfaceID id, float frameRate);
+
+    void setStateChannel(const sp<ISurfaceComposerClient>& client,
+            const sp<LayerStateChannel>& channel);
 
     void setDisplaySurface(const sp<IBinder>& token, const sp<ISurfaceTexture>& surface);
     void setDisplayLayerStack(const sp<IBinder>& token, uint32_t layerStack);
@@ -166,9 +196,18 @@ public:
         Composer::getInstance().setAnimationTransactionImpl();
     }
 
+    static void openGlobalTransaction() {
+        Composer::getInstance().openGlobalTransactionImpl();
+    }
+
     static void closeGlobalTransaction(bool synchronous) {
         Composer::getInstance().closeGlobalTransactionImpl(synchronous);
     }
+
+    static void closeGlobalTransactionAsync(
+            const sp<ITransactionCompletedListener>& listener) {
+        Composer::getInstance().closeGlobalTransactionAsyncImpl(listener);
+    }
 };
 
 ANDROID_SINGLETON_STATIC_INSTANCE(Composer);
@@ -184,22 +223,62 @@ sp<IBinder> Composer::getBuiltInDisplay(int32_t id) {
     return ComposerService::getComposerService()->getBuiltInDisplay(id);
 }
 
+void Composer::openGlobalTransactionImpl() {
+    setTransactionNestCount(getTransactionNestCount() + 1);
+}
+
 void Composer::closeGlobalTransactionImpl(bool synchronous) {
     sp<ISurfaceComposer> sm(ComposerService::getComposerService());
 
     Vector<ComposerState> transaction;
     Vector<DisplayState> displayTransaction;
+    Vector< sp<ITransactionCompletedListener> > listeners;
     uint32_t flags = 0;
 
     { // scope for the lock
         Mutex::Autolock _l(mLock);
+        if (synchronous) {
+            // remembered until the outermost transaction is closed
+            mForceSynchronous = true;
+        }
+        const uintptr_t nestCount = getTransactionNestCount();
+        if (nestCount > 1) {
+            // nested transaction, everything is sent at once when this
+            // thread closes its outermost one
+            setTransactionNestCount(nestCount - 1);
+            return;
+        }
+        setTransactionNestCount(0);
+
+        if (mComposerStates.isEmpty() && mDisplayStates.isEmpty() &&
+                mCompletionListeners.isEmpty() && !mForceSynchronous) {
+            // nothing changed, save the IPC
+            mAnimation = false;
+            return;
+        }
+
+        if (!mForceSynchronous && mDisplayStates.isEmpty() &&
+                mCompletionListeners.isEmpty()) {
+            sp<ISurfaceComposerClient> doorbell(writeStateChannelLocked());
+            if (mComposerStates.isEmpty()) {
+                mAnimation = false;
+                if (doorbell != NULL) {
+                    doorbell->signalStateChannel();
+                }
+                return;
+            }
+        }
+
         transaction = mComposerStates;
         mComposerStates.clear();
 
         displayTransaction = mDisplayStates;
         mDisplayStates.clear();
 
-        if (synchronous || mForceSynchronous) {
+        listeners = mCompletionListeners;
+        mCompletionListeners.clear();
+
+        if (mForceSynchronous) {
             flags |= ISurfaceComposer::eSynchronous;
         }
         if (mAnimation) {
@@ -210,7 +289,69 @@ void Composer::closeGlobalTransactionImpl(bool synchronous) {
         mAnimation = false;
     }
 
-   sm->setTransactionState(transaction, displayTransaction, flags);
+    if (!listeners.isEmpty()) {
+        // the listeners replace waiting for the transaction
+        sm->setTransactionStateAsync(transaction, displayTransaction, flags,
+                listeners);
+    } else {
+        sm->setTransactionState(transaction, displayTransaction, flags);
+    }
+}
+
+void Composer::closeGlobalTransactionAsyncImpl(
+        const sp<ITransactionCompletedListener>& listener) {
+    if (listener != NULL) {
+        Mutex::Autolock _l(mLock);
+        mCompletionListeners.add(listener);
+    }
+    closeGlobalTransactionImpl(false);
+}
+
+sp<ISurfaceComposerClient> Composer::writeStateChannelLocked() {
+    // the states are sorted by client, they must all belong to one that
+    // has a channel. Animation frames are paced by SurfaceFlinger, so they
+    // only take the channel once it has caught up with the previous ones.
+    sp<ISurfaceComposerClient> doorbell;
+    const size_t count = mComposerStates.size();
+    if (count == 0 || mComposerStates[0].client !=
+            mComposerStates[count - 1].client) {
+        return doorbell;
+    }
+    const sp<ISurfaceComposerClient>& client(mComposerStates[0].client);
+    sp<LayerStateChannel> channel(mStateChannels.valueFor(client));
+    if (channel == NULL || (mAnimation && !channel->isEmpty())) {
+        return doorbell;
+    }
+
+    size_t size = 0;
+    for (size_t i=0 ; i<count ; i++) {
+        size += mComposerStates[i].state.getCompactSize();
+    }
+    uint32_t* cursor = channel->beginWrite(size / sizeof(uint32_t));
+    if (cursor == NULL) {
+        // full, the binder transaction applies what's in the ring first
+        return doorbell;
+    }
+    for (size_t i=0 ; i<count ; i++) {
+        mComposerStates[i].state.writeCompact(cursor);
+    }
+    bool wake;
+    channel->endWrite(&wake);
+    if (wake) {
+        doorbell = client;
+    }
+    mComposerStates.clear();
+    return doorbell;
+}
+
+void Composer::setStateChannel(const sp<ISurfaceComposerClient>& client,
+        const sp<LayerStateChannel>& channel) {
+    Mutex::Autolock _l(mLock);
+    if (channel != NULL) {
+        mStateChannels.add(client, channel);
+    } else {
+        mStateChannels.removeItem(client);
+    }
 }
 
 void Composer::setAnimationTransactionImpl() {
@@ -322,6 +463,17 @@ status_t Composer::setLayerStack(const sp<SurfaceComposerClient>& client,
     return NO_ERROR;
 }
 
+status_t Composer::setFrameRate(const sp<SurfaceComposerClient>& client,
+        SurfaceID id, float frameRate) {
+    Mutex::Autolock _l(mLock);
+    layer_state_t* s = getLayerStateLocked(client, id);
+    if (!s)
+        return BAD_INDEX;
+    s->what |= layer_state_t::eFrameRateChanged;
+    s->frameRate = frameRate;
+    return NO_ERROR;
+}
+
 status_t Composer::setMatrix(const sp<SurfaceComposerClient>& client,
         SurfaceID id, float dsdx, float dtdx,
         float dsdy, float dtdy) {
@@ -446,10 +598,29 @@ void SurfaceComposerClient::dispose() {
     if (mClient != 0) {
         client = mClient; // hold ref while lock is held
         mClient.clear();
+        mComposer.setStateChannel(client, NULL);
     }
     mStatus = NO_INIT;
 }
 
+status_t SurfaceComposerClient::enableStateChannel() {
+    sp<ISurfaceComposerClient> client;
+    {
+        Mutex::Autolock _l(mLock);
+        if (mStatus != NO_ERROR) {
+            return mStatus;
+        }
+        client = mClient;
+    }
+    sp<LayerStateChannel> channel(
+            new LayerStateChannel(client->getStateChannel()));
+    status_t err = channel->initCheck();
+    if (err == NO_ERROR) {
+        mComposer.setStateChannel(client, channel);
+    }
+    return err;
+}
+
 /* Create ICS/MR0-compatible constructors */
 extern "C" sp<SurfaceControl> _ZN7android21SurfaceComposerClient13createSurfaceERKNS_7String8Ejjij(
         const String8& name,
@@ -516,13 +687,18 @@ inline Composer& SurfaceComposerClient::getComposer() {
 // ----------------------------------------------------------------------------
 
 void SurfaceComposerClient::openGlobalTransaction() {
-    // Currently a no-op
+    Composer::openGlobalTransaction();
 }
 
 void SurfaceComposerClient::closeGlobalTransaction(bool synchronous) {
     Composer::closeGlobalTransaction(synchronous);
 }
 
+void SurfaceComposerClient::closeGlobalTransactionAsync(
+        const sp<ITransactionCompletedListener>& listener) {
+    Composer::closeGlobalTransactionAsync(listener);
+}
+
 void SurfaceComposerClient::setAnimationTransaction() {
     Composer::setAnimationTransaction();
 }
@@ -575,6 +751,13 @@ status_t SurfaceComposerClient::setLayerStack(SurfaceID id, uint32_t layerStack)
     return getComposer().setLayerStack(this, id, layerStack);
 }
 
+status_t SurfaceComposerClient::setFrameRate(SurfaceID id, float frameRate) {
+    if (frameRate < 0) {
+        return BAD_VALUE;
+    }
+    return getComposer().setFrameRate(this, id, frameRate);
+}
+
 status_t SurfaceComposerClient::setMatrix(SurfaceID id, float dsdx, float dtdx,
         float dsdy, float dtdy) {
     return getComposer().setMatrix(this, id, dsdx, dtdx, dsdy, dtdy);
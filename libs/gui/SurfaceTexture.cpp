@@ -43,7 +43,8 @@
 // EGL_ANDROID_native_fence_sync extension to create Android native fences to
 // signal when all GLES reads for a given buffer have completed.  It is not
 // compatible with using the EGL_KHR_fence_sync extension for the same
-// purpose.
+// purpose.  Without it, the extension is still used if the EGLDisplay
+// reports it.
 #ifdef USE_NATIVE_FENCE_SYNC
 #ifdef USE_FENCE_SYNC
 #error "USE_NATIVE_FENCE_SYNC and USE_FENCE_SYNC are incompatible"
@@ -56,13 +57,18 @@ static const bool useNativeFenceSync = false;
 // This compile option makes SurfaceTexture use the EGL_ANDROID_sync_wait
 // extension to insert server-side waits into the GLES command stream.  This
 // feature requires the EGL_ANDROID_native_fence_sync and
-// EGL_ANDROID_wait_sync extensions.
+// EGL_ANDROID_wait_sync extensions.  Without it, server-side waits are still
+// used if the EGLDisplay reports both extensions.
 #ifdef USE_WAIT_SYNC
 static const bool useWaitSync = true;
 #else
 static const bool useWaitSync = false;
 #endif
 
+// A cached EGLImage that wasn't needed for this many acquired buffers is
+// destroyed, its buffer is unlikely to come back.
+static const uint32_t MAX_IMAGE_CACHE_AGE = 120;
+
 // Macros for including the SurfaceTexture name in log messages
 #define ST_LOGV(x, ...) ALOGV("[%s] "x, mName.string(), ##__VA_ARGS__)
 #define ST_LOGD(x, ...) ALOGD("[%s] "x, mName.string(), ##__VA_ARGS__)
@@ -72,6 +78,20 @@ static const bool useWaitSync = false;
 
 namespace android {
 
+static bool hasEglExtension(EGLDisplay dpy, const char* name) {
+    const char* exts = eglQueryString(dpy, EGL_EXTENSIONS);
+    if (exts == NULL) {
+        return false;
+    }
+    const size_t len = strlen(name);
+    for (const char* p = strstr(exts, name); p; p = strstr(p + len, name)) {
+        if ((p == exts || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0')) {
+            return true;
+        }
+    }
+    return false;
+}
+
 // Transform matrices
 static float mtxIdentity[16] = {
     1, 0, 0, 0,
@@ -125,11 +145,22 @@ SurfaceTexture::SurfaceTexture(GLuint tex, bool allowSynchronousMode,
 #else
     mUseFenceSync(false),
 #endif
+    mNativeFenceSync(useNativeFenceSync),
+    mWaitSync(useWaitSync),
+    mCpuFenceWaits(0),
+    mCpuFenceWaitTime(0),
     mTexTarget(texTarget),
     mEglDisplay(EGL_NO_DISPLAY),
     mEglContext(EGL_NO_CONTEXT),
+    mImageCacheSize(0),
+    mImageCacheClock(0),
+    mImageCacheHits(0),
+    mImageCacheMisses(0),
+    mImageCacheEvictions(0),
     mCurrentTexture(BufferQueue::INVALID_BUFFER_SLOT),
-    mAttached(true)
+    mAttached(true),
+    mLazyBinding(false),
+    mCurrentTextureBound(false)
 {
     ST_LOGV("SurfaceTexture");
 
@@ -144,6 +175,12 @@ status_t SurfaceTexture::setDefaultMaxBufferCount(int bufferCount) {
     return mBufferQueue->setDefaultMaxBufferCount(bufferCount);
 }
 
+void SurfaceTexture::setImageCacheSize(size_t size) {
+    Mutex::Autolock lock(mMutex);
+    mImageCacheSize = size;
+    trimImageCacheLocked(size);
+}
+
 
 status_t SurfaceTexture::setDefaultBufferSize(uint32_t w, uint32_t h)
 {
@@ -157,31 +194,47 @@ status_t SurfaceTexture::updateTexImage() {
     return SurfaceTexture::updateTexImage(NULL, false);
 }
 
-status_t SurfaceTexture::acquireBufferLocked(BufferQueue::BufferItem *item) {
-    status_t err = ConsumerBase::acquireBufferLocked(item);
+status_t SurfaceTexture::acquireBufferLocked(BufferQueue::BufferItem *item,
+        nsecs_t presentWhen) {
+    status_t err = ConsumerBase::acquireBufferLocked(item, presentWhen);
     if (err != NO_ERROR) {
         return err;
     }
 
     int slot = item->mBuf;
     if (item->mGraphicBuffer != NULL) {
-        if (mEglSlots[slot].mEglImage != EGL_NO_IMAGE_KHR) {
-            eglDestroyImageKHR(mEglDisplay, mEglSlots[slot].mEglImage);
-            mEglSlots[slot].mEglImage = EGL_NO_IMAGE_KHR;
+        // The slot has a new buffer.  Keep the image of the old one unless
+        // it is the same buffer, whose geometry was changed in place.
+        releaseImageLocked(slot,
+                mEglSlots[slot].mImageBuffer != item->mGraphicBuffer);
+        EGLImageKHR image = takeCachedImageLocked(item->mGraphicBuffer);
+        if (image != EGL_NO_IMAGE_KHR) {
+            mEglSlots[slot].mEglImage = image;
+            mEglSlots[slot].mImageBuffer = item->mGraphicBuffer;
         }
     }
+    mImageCacheClock++;
+    trimImageCacheLocked(mImageCacheSize);
 
     // Update the GL texture object. We may have to do this even when
     // item.mGraphicBuffer == NULL, if we destroyed the EGLImage when
     // detaching from a context but the buffer has not been re-allocated.
+    // With lazy binding, it is done when the buffer is bound, if ever.
+    if (mLazyBinding) {
+        return NO_ERROR;
+    }
+    return createImageLocked(slot);
+}
+
+status_t SurfaceTexture::createImageLocked(int slot) {
     if (mEglSlots[slot].mEglImage == EGL_NO_IMAGE_KHR) {
         EGLImageKHR image = createImage(mEglDisplay, mSlots[slot].mGraphicBuffer);
         if (image == EGL_NO_IMAGE_KHR) {
             return UNKNOWN_ERROR;
         }
         mEglSlots[slot].mEglImage = image;
+        mEglSlots[slot].mImageBuffer = mSlots[slot].mGraphicBuffer;
     }
-
     return NO_ERROR;
 }
 
@@ -195,7 +248,8 @@ status_t SurfaceTexture::releaseBufferLocked(int buf, EGLDisplay display,
     return err;
 }
 
-status_t SurfaceTexture::updateTexImage(BufferRejecter* rejecter, bool skipSync) {
+status_t SurfaceTexture::updateTexImage(BufferRejecter* rejecter, bool skipSync,
+        nsecs_t presentWhen) {
     ATRACE_CALL();
     ST_LOGV("updateTexImage");
     Mutex::Autolock lock(mMutex);
@@ -228,6 +282,9 @@ status_t SurfaceTexture::updateTexImage(BufferRejecter* rejecter, bool skipSync)
         return INVALID_OPERATION;
     }
 
+    if (mEglDisplay != dpy) {
+        probeFenceSyncLocked(dpy);
+    }
     mEglDisplay = dpy;
     mEglContext = ctx;
 
@@ -235,7 +292,7 @@ status_t SurfaceTexture::updateTexImage(BufferRejecter* rejecter, bool skipSync)
 
     // In asynchronous mode the list is guaranteed to be one buffer
     // deep, while in synchronous mode we use the oldest buffer.
-    err = acquireBufferLocked(&item);
+    err = acquireBufferLocked(&item, presentWhen);
     if (err == NO_ERROR) {
         int buf = item.mBuf;
 
@@ -244,26 +301,31 @@ status_t SurfaceTexture::updateTexImage(BufferRejecter* rejecter, bool skipSync)
         // reject buffers which have the wrong size
         if (rejecter && rejecter->reject(mSlots[buf].mGraphicBuffer, item)) {
             releaseBufferLocked(buf, dpy, EGL_NO_SYNC_KHR);
-            glBindTexture(mTexTarget, mTexName);
+            if (!mLazyBinding) {
+                glBindTexture(mTexTarget, mTexName);
+            }
             return NO_ERROR;
         }
 
-        GLint error;
-        while ((error = glGetError()) != GL_NO_ERROR) {
-            ST_LOGW("updateTexImage: clearing GL error: %#04x", error);
-        }
+        if (!mLazyBinding) {
+            GLint error;
+            while ((error = glGetError()) != GL_NO_ERROR) {
+                ST_LOGW("updateTexImage: clearing GL error: %#04x", error);
+            }
 
-        EGLImageKHR image = mEglSlots[buf].mEglImage;
-        glBindTexture(mTexTarget, mTexName);
-        glEGLImageTargetTexture2DOES(mTexTarget, (GLeglImageOES)image);
+            EGLImageKHR image = mEglSlots[buf].mEglImage;
+            glBindTexture(mTexTarget, mTexName);
+            glEGLImageTargetTexture2DOES(mTexTarget, (GLeglImageOES)image);
 
-        while ((error = glGetError()) != GL_NO_ERROR) {
-            ST_LOGE("updateTexImage: error binding external texture image %p "
-                    "(slot %d): %#04x", image, buf, error);
-            err = UNKNOWN_ERROR;
+            while ((error = glGetError()) != GL_NO_ERROR) {
+                ST_LOGE("updateTexImage: error binding external texture image %p "
+                        "(slot %d): %#04x", image, buf, error);
+                err = UNKNOWN_ERROR;
+            }
         }
 
-        if (err == NO_ERROR) {
+        // GL may still be reading the old buffer, unless it was never bound
+        if (err == NO_ERROR && (!mLazyBinding || mCurrentTextureBound)) {
             err = syncForReleaseLocked(dpy);
         }
 
@@ -292,6 +354,7 @@ status_t SurfaceTexture::updateTexImage(BufferRejecter* rejecter, bool skipSync)
 
         // Update the SurfaceTexture state.
         mCurrentTexture = buf;
+        mCurrentTextureBound = !mLazyBinding;
         mCurrentTextureBuf = mSlots[buf].mGraphicBuffer;
         mCurrentCrop = item.mCrop;
         mCurrentTransform = item.mTransform;
@@ -315,10 +378,71 @@ status_t SurfaceTexture::updateTexImage(BufferRejecter* rejecter, bool skipSync)
             return err;
         }
         // We always bind the texture even if we don't update its contents.
-        glBindTexture(mTexTarget, mTexName);
-        return OK;
+        if (!mLazyBinding) {
+            glBindTexture(mTexTarget, mTexName);
+        }
+        return err == BufferQueue::PRESENT_LATER ? err : OK;
+    }
+
+    return err;
+}
+
+void SurfaceTexture::setLazyBinding(bool enabled) {
+    Mutex::Autolock lock(mMutex);
+    mLazyBinding = enabled;
+}
+
+status_t SurfaceTexture::bindTextureImage() {
+    Mutex::Autolock lock(mMutex);
+
+    if (mAbandoned) {
+        ST_LOGE("bindTextureImage: SurfaceTexture is abandoned!");
+        return NO_INIT;
+    }
+    if (!mAttached) {
+        ST_LOGE("bindTextureImage: SurfaceTexture is not attached to an OpenGL "
+                "ES context");
+        return INVALID_OPERATION;
+    }
+    if (mCurrentTextureBound || mCurrentTextureBuf == NULL) {
+        return NO_ERROR;
+    }
+
+    // the current buffer may have left its slot since it was latched
+    EGLImageKHR image;
+    const bool inSlot = mCurrentTexture != BufferQueue::INVALID_BUFFER_SLOT;
+    if (inSlot) {
+        status_t err = createImageLocked(mCurrentTexture);
+        if (err != NO_ERROR) {
+            return err;
+        }
+        image = mEglSlots[mCurrentTexture].mEglImage;
+    } else {
+        image = createImage(mEglDisplay, mCurrentTextureBuf);
+        if (image == EGL_NO_IMAGE_KHR) {
+            return UNKNOWN_ERROR;
+        }
+    }
+
+    GLint error;
+    while ((error = glGetError()) != GL_NO_ERROR) {
+        ST_LOGW("bindTextureImage: clearing GL error: %#04x", error);
     }
 
+    glBindTexture(mTexTarget, mTexName);
+    glEGLImageTargetTexture2DOES(mTexTarget, (GLeglImageOES)image);
+
+    status_t err = NO_ERROR;
+    while ((error = glGetError()) != GL_NO_ERROR) {
+        ST_LOGE("bindTextureImage: error binding external texture image %p "
+                "(slot %d): %#04x", image, mCurrentTexture, error);
+        err = UNKNOWN_ERROR;
+    }
+    if (!inSlot) {
+        eglDestroyImageKHR(mEglDisplay, image);
+    }
+
+    mCurrentTextureBound = (err == NO_ERROR);
     return err;
 }
 
@@ -376,12 +500,9 @@ status_t SurfaceTexture::detachFromContext() {
     // SurfaceTexture gets attached to a new OpenGL ES context (and thus gets a
     // new EGLDisplay).
     for (int i =0; i < BufferQueue::NUM_BUFFER_SLOTS; i++) {
-        EGLImageKHR img = mEglSlots[i].mEglImage;
-        if (img != EGL_NO_IMAGE_KHR) {
-            eglDestroyImageKHR(mEglDisplay, img);
-            mEglSlots[i].mEglImage = EGL_NO_IMAGE_KHR;
-        }
+        releaseImageLocked(i, false);
     }
+    trimImageCacheLocked(0);
 
     mEglDisplay = EGL_NO_DISPLAY;
     mEglContext = EGL_NO_CONTEXT;
@@ -453,8 +574,10 @@ status_t SurfaceTexture::attachToContext(GLuint tex) {
         if (err != OK) {
             return err;
         }
+        mCurrentTextureBound = true;
     }
 
+    probeFenceSyncLocked(dpy);
     mEglDisplay = dpy;
     mEglContext = ctx;
     mTexName = tex;
@@ -467,7 +590,7 @@ status_t SurfaceTexture::syncForReleaseLocked(EGLDisplay dpy) {
     ST_LOGV("syncForReleaseLocked");
 
     if (mCurrentTexture != BufferQueue::INVALID_BUFFER_SLOT) {
-        if (useNativeFenceSync) {
+        if (mNativeFenceSync) {
             EGLSyncKHR sync = eglCreateSyncKHR(dpy,
                     EGL_SYNC_NATIVE_FENCE_ANDROID, NULL);
             if (sync == EGL_NO_SYNC_KHR) {
@@ -497,7 +620,13 @@ status_t SurfaceTexture::syncForReleaseLocked(EGLDisplay dpy) {
                 // wait on that before replacing it with another fence to
                 // ensure that all outstanding buffer accesses have completed
                 // before the producer accesses it.
-                EGLint result = eglClientWaitSyncKHR(dpy, fence, 0, 1000000000);
+                EGLint result = eglClientWaitSyncKHR(dpy, fence, 0, 0);
+                if (result == EGL_TIMEOUT_EXPIRED_KHR) {
+                    const nsecs_t start = systemTime();
+                    result = eglClientWaitSyncKHR(dpy, fence, 0, 1000000000);
+                    mCpuFenceWaits++;
+                    mCpuFenceWaitTime += systemTime() - start;
+                }
                 if (result == EGL_FALSE) {
                     ST_LOGE("syncForReleaseLocked: error waiting for previous "
                             "fence: %#x", eglGetError());
@@ -749,6 +878,14 @@ sp<Fence> SurfaceTexture::getCurrentFence() const {
     return mCurrentFence;
 }
 
+sp<Fence> SurfaceTexture::getQueuedBufferFence() const {
+    Mutex::Autolock lock(mMutex);
+    if (mAbandoned) {
+        return NULL;
+    }
+    return mBufferQueue->getQueuedBufferFence();
+}
+
 status_t SurfaceTexture::doGLFenceWait() const {
     Mutex::Autolock lock(mMutex);
     return doGLFenceWaitLocked();
@@ -770,7 +907,7 @@ status_t SurfaceTexture::doGLFenceWaitLocked() const {
     }
 
     if (mCurrentFence != NULL) {
-        if (useWaitSync) {
+        if (mWaitSync) {
             // Create an EGLSyncKHR from the current fence.
             int fenceFd = mCurrentFence->dup();
             if (fenceFd == -1) {
@@ -801,9 +938,12 @@ status_t SurfaceTexture::doGLFenceWaitLocked() const {
                         eglErr);
                 return UNKNOWN_ERROR;
             }
-        } else {
+        } else if (mCurrentFence->wait(0) != NO_ERROR) {
+            const nsecs_t start = systemTime();
             status_t err = mCurrentFence->waitForever(1000,
                     "SurfaceTexture::doGLFenceWaitLocked");
+            mCpuFenceWaits++;
+            mCpuFenceWaitTime += systemTime() - start;
             if (err != NO_ERROR) {
                 ST_LOGE("doGLFenceWait: error waiting for fence: %d", err);
                 return err;
@@ -824,19 +964,74 @@ void SurfaceTexture::freeBufferLocked(int slotIndex) {
     if (slotIndex == mCurrentTexture) {
         mCurrentTexture = BufferQueue::INVALID_BUFFER_SLOT;
     }
-    EGLImageKHR img = mEglSlots[slotIndex].mEglImage;
+    releaseImageLocked(slotIndex, true);
+    ConsumerBase::freeBufferLocked(slotIndex);
+}
+
+void SurfaceTexture::releaseImageLocked(int slot, bool canCache) {
+    EGLImageKHR img = mEglSlots[slot].mEglImage;
     if (img != EGL_NO_IMAGE_KHR) {
-        ST_LOGV("destroying EGLImage dpy=%p img=%p", mEglDisplay, img);
+        if (canCache && mImageCacheSize > 0 &&
+                mEglSlots[slot].mImageBuffer != NULL) {
+            CachedImage entry;
+            entry.mGraphicBuffer = mEglSlots[slot].mImageBuffer;
+            entry.mEglImage = img;
+            entry.mLastUsed = mImageCacheClock;
+            mImageCache.push(entry);
+            trimImageCacheLocked(mImageCacheSize);
+        } else {
+            ST_LOGV("destroying EGLImage dpy=%p img=%p", mEglDisplay, img);
+            eglDestroyImageKHR(mEglDisplay, img);
+        }
+    }
+    mEglSlots[slot].mEglImage = EGL_NO_IMAGE_KHR;
+    mEglSlots[slot].mImageBuffer.clear();
+}
+
+EGLImageKHR SurfaceTexture::takeCachedImageLocked(
+        const sp<GraphicBuffer>& graphicBuffer) {
+    if (mImageCacheSize == 0) {
+        return EGL_NO_IMAGE_KHR;
+    }
+    const size_t count = mImageCache.size();
+    for (size_t i=0 ; i<count ; i++) {
+        if (mImageCache[i].mGraphicBuffer == graphicBuffer) {
+            EGLImageKHR image = mImageCache[i].mEglImage;
+            mImageCache.removeAt(i);
+            mImageCacheHits++;
+            return image;
+        }
+    }
+    mImageCacheMisses++;
+    return EGL_NO_IMAGE_KHR;
+}
+
+void SurfaceTexture::trimImageCacheLocked(size_t maxSize) {
+    // entries are in the order they were cached, the oldest is first
+    while (!mImageCache.isEmpty() && (mImageCache.size() > maxSize ||
+            mImageCacheClock - mImageCache[0].mLastUsed > MAX_IMAGE_CACHE_AGE)) {
+        EGLImageKHR img = mImageCache[0].mEglImage;
+        ST_LOGV("evicting cached EGLImage dpy=%p img=%p", mEglDisplay, img);
         eglDestroyImageKHR(mEglDisplay, img);
+        mImageCache.removeAt(0);
+        mImageCacheEvictions++;
     }
-    mEglSlots[slotIndex].mEglImage = EGL_NO_IMAGE_KHR;
-    ConsumerBase::freeBufferLocked(slotIndex);
+}
+
+void SurfaceTexture::probeFenceSyncLocked(EGLDisplay dpy) {
+    mNativeFenceSync = useNativeFenceSync ||
+            hasEglExtension(dpy, "EGL_ANDROID_native_fence_sync");
+    mWaitSync = useWaitSync || (mNativeFenceSync &&
+            hasEglExtension(dpy, "EGL_ANDROID_wait_sync"));
+    ST_LOGV("probeFenceSyncLocked: native fence sync=%d, wait sync=%d",
+            mNativeFenceSync, mWaitSync);
 }
 
 void SurfaceTexture::abandonLocked() {
     ST_LOGV("abandonLocked");
     mCurrentTextureBuf.clear();
     ConsumerBase::abandonLocked();
+    trimImageCacheLocked(0);
 }
 
 void SurfaceTexture::setName(const String8& name) {
@@ -879,6 +1074,20 @@ void SurfaceTexture::dumpLocked(String8& result, const char* prefix,
        mCurrentTransform);
     result.append(buffer);
 
+    snprintf(buffer, size,
+            "%snative-fence-sync=%d wait-sync=%d cpu-fence-waits=%u (%.3f ms)\n",
+            prefix, mNativeFenceSync, mWaitSync, mCpuFenceWaits,
+            mCpuFenceWaitTime / 1e6);
+    result.append(buffer);
+
+    if (mImageCacheSize > 0) {
+        snprintf(buffer, size,
+                "%smImageCache=%d/%d hits=%u misses=%u evictions=%u\n",
+                prefix, mImageCache.size(), mImageCacheSize, mImageCacheHits,
+                mImageCacheMisses, mImageCacheEvictions);
+        result.append(buffer);
+    }
+
     ConsumerBase::dumpLocked(result, prefix, buffer, size);
 }
 
@@ -53,7 +53,34 @@ SurfaceTextureClient::SurfaceTextureClient() {
     SurfaceTextureClient::init();
 }
 
+// Dequeues buffers ahead of time for a SurfaceTextureClient, see
+// setDequeueAhead().
+class SurfaceTextureClient::DequeueAheadThread : public Thread {
+public:
+    DequeueAheadThread(SurfaceTextureClient* client)
+        : Thread(false), mClient(client) {
+    }
+    bool exiting() const {
+        return exitPending();
+    }
+private:
+    virtual bool threadLoop() {
+        return mClient->dequeueAhead();
+    }
+    SurfaceTextureClient* const mClient;
+};
+
 SurfaceTextureClient::~SurfaceTextureClient() {
+    if (mDequeueAheadThread != NULL) {
+        {
+            Mutex::Autolock lock(mMutex);
+            mDequeueAheadThread->requestExit();
+            mDequeueAheadCondition.broadcast();
+        }
+        mDequeueAheadThread->requestExitAndWait();
+        Mutex::Autolock lock(mMutex);
+        cancelPrefetchedBufferLocked();
+    }
     if (mConnectedToCpu) {
         SurfaceTextureClient::disconnect(NATIVE_WINDOW_API_CPU);
     }
@@ -94,6 +121,15 @@ void SurfaceTextureClient::init() {
     mTransformHint = 0;
     mConsumerRunningBehind = false;
     mConnectedToCpu = false;
+    mSwapIntervalZero = false;
+    mPrefetchedSlot = -1;
+    mPrefetchedResult = NO_INIT;
+    mPrefetchedWidth = 0;
+    mPrefetchedHeight = 0;
+    mPrefetchedFormat = 0;
+    mPrefetchedUsage = 0;
+    mDequeueAhead = false;
+    mDequeueAheadPending = false;
 }
 
 void SurfaceTextureClient::setISurfaceTexture(
@@ -106,6 +142,63 @@ sp<ISurfaceTexture> SurfaceTextureClient::getISurfaceTexture() const {
     return mSurfaceTexture;
 }
 
+status_t SurfaceTextureClient::setDequeueAhead(bool enabled) {
+    Mutex::Autolock lock(mMutex);
+    if (enabled && mDequeueAheadThread == NULL) {
+        sp<DequeueAheadThread> thread(new DequeueAheadThread(this));
+        status_t err = thread->run("DequeueAhead", PRIORITY_URGENT_DISPLAY);
+        if (err != NO_ERROR) {
+            ALOGE("setDequeueAhead: can't start thread: %d", err);
+            return err;
+        }
+        mDequeueAheadThread = thread;
+    }
+    mDequeueAhead = enabled;
+    if (!enabled && !mSwapIntervalZero) {
+        cancelPrefetchedBufferLocked();
+    }
+    return NO_ERROR;
+}
+
+bool SurfaceTextureClient::dequeueAhead() {
+    Mutex::Autolock lock(mMutex);
+    while (!mDequeueAheadPending) {
+        if (mDequeueAheadThread->exiting()) {
+            return false;
+        }
+        mDequeueAheadCondition.wait(mMutex);
+    }
+
+    // dequeueBuffer waits for the consumer, let the client go on meanwhile;
+    // it waits for this to complete before it uses mPrefetched*
+    int buf = -1;
+    sp<Fence> fence;
+    const sp<ISurfaceTexture> surfaceTexture(mSurfaceTexture);
+    mMutex.unlock();
+    status_t result = surfaceTexture->dequeueBuffer(&buf, fence,
+            mPrefetchedWidth, mPrefetchedHeight,
+            mPrefetchedFormat, mPrefetchedUsage);
+    mMutex.lock();
+
+    if (result >= 0) {
+        mPrefetchedSlot = buf;
+        mPrefetchedFence = fence;
+        mPrefetchedResult = result;
+    } else {
+        ALOGV("dequeueAhead: ISurfaceTexture::dequeueBuffer failed: %d",
+                result);
+    }
+    mDequeueAheadPending = false;
+    mDequeueAheadCondition.broadcast();
+    return true;
+}
+
+void SurfaceTextureClient::waitForDequeueAheadLocked() {
+    while (mDequeueAheadPending) {
+        mDequeueAheadCondition.wait(mMutex);
+    }
+}
+
 int SurfaceTextureClient::hook_setSwapInterval(ANativeWindow* window, int interval) {
     SurfaceTextureClient* c = getSelf(window);
     return c->setSwapInterval(interval);
@@ -191,7 +284,16 @@ int SurfaceTextureClient::setSwapInterval(int interval) {
     if (interval > maxSwapInterval)
         interval = maxSwapInterval;
 
+    Mutex::Autolock lock(mMutex);
     status_t res = mSurfaceTexture->setSynchronousMode(interval ? true : false);
+    if (res == NO_ERROR) {
+        mSwapIntervalZero = (interval == 0);
+    }
+    if (!mSwapIntervalZero) {
+        // dequeueBuffer may block from now on, don't hold a buffer the
+        // consumer could need
+        cancelPrefetchedBufferLocked();
+    }
 
     return res;
 }
@@ -205,8 +307,25 @@ int SurfaceTextureClient::dequeueBuffer(android_native_buffer_t** buffer,
     int reqW = mReqWidth ? mReqWidth : mUserWidth;
     int reqH = mReqHeight ? mReqHeight : mUserHeight;
     sp<Fence> fence;
-    status_t result = mSurfaceTexture->dequeueBuffer(&buf, fence, reqW, reqH,
-            mReqFormat, mReqUsage);
+    status_t result;
+    waitForDequeueAheadLocked();
+    if (mPrefetchedSlot >= 0 &&
+            mPrefetchedWidth == uint32_t(reqW) &&
+            mPrefetchedHeight == uint32_t(reqH) &&
+            mPrefetchedFormat == mReqFormat &&
+            mPrefetchedUsage == mReqUsage) {
+        // the buffer was dequeued along with the last queued one, or
+        // right after it was queued
+        buf = mPrefetchedSlot;
+        fence = mPrefetchedFence;
+        result = mPrefetchedResult;
+        mPrefetchedSlot = -1;
+        mPrefetchedFence.clear();
+    } else {
+        cancelPrefetchedBufferLocked();
+        result = mSurfaceTexture->dequeueBuffer(&buf, fence, reqW, reqH,
+                mReqFormat, mReqUsage);
+    }
     if (result < 0) {
         ALOGV("dequeueBuffer: ISurfaceTexture::dequeueBuffer(%d, %d, %d, %d)"
              "failed: %d", mReqWidth, mReqHeight, mReqFormat, mReqUsage,
@@ -225,6 +344,8 @@ int SurfaceTextureClient::dequeueBuffer(android_native_buffer_t** buffer,
                     result);
             return result;
         }
+        // nothing is known about the content of a new buffer
+        mSlots[buf].dirtyRegion.set(Rect(gbuf->width, gbuf->height));
     }
 
     if (fence.get()) {
@@ -281,7 +402,8 @@ int SurfaceTextureClient::queueBuffer(android_native_buffer_t* buffer, int fence
     ALOGV("SurfaceTextureClient::queueBuffer");
     Mutex::Autolock lock(mMutex);
     int64_t timestamp;
-    if (mTimestamp == NATIVE_WINDOW_TIMESTAMP_AUTO) {
+    const bool isAutoTimestamp = mTimestamp == NATIVE_WINDOW_TIMESTAMP_AUTO;
+    if (isAutoTimestamp) {
         timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
         ALOGV("SurfaceTextureClient::queueBuffer making up timestamp: %.2f ms",
              timestamp / 1000000.f);
@@ -300,9 +422,44 @@ int SurfaceTextureClient::queueBuffer(android_native_buffer_t* buffer, int fence
 
     sp<Fence> fence(fenceFd >= 0 ? new Fence(fenceFd) : NULL);
     ISurfaceTexture::QueueBufferOutput output;
+    // a buffer queued without dequeuing one since the last queueBuffer
+    waitForDequeueAheadLocked();
     ISurfaceTexture::QueueBufferInput input(timestamp, crop, mScalingMode,
-            mTransform, fence);
-    status_t err = mSurfaceTexture->queueBuffer(i, input, &output);
+            mTransform, fence, isAutoTimestamp);
+    status_t err;
+    if (mSwapIntervalZero && mPrefetchedSlot < 0) {
+        // dequeueBuffer doesn't wait in asynchronous mode, so get the next
+        // buffer in the same transaction
+        uint32_t reqW = mReqWidth ? mReqWidth : mUserWidth;
+        uint32_t reqH = mReqHeight ? mReqHeight : mUserHeight;
+        int nextSlot = -1;
+        sp<Fence> nextFence;
+        status_t dequeueResult = NO_INIT;
+        err = mSurfaceTexture->queueAndDequeueBuffer(i, input, &output,
+                &nextSlot, nextFence, reqW, reqH, mReqFormat, mReqUsage,
+                &dequeueResult);
+        if (err == OK && dequeueResult >= 0) {
+            mPrefetchedSlot = nextSlot;
+            mPrefetchedFence = nextFence;
+            mPrefetchedResult = dequeueResult;
+            mPrefetchedWidth = reqW;
+            mPrefetchedHeight = reqH;
+            mPrefetchedFormat = mReqFormat;
+            mPrefetchedUsage = mReqUsage;
+        }
+    } else {
+        err = mSurfaceTexture->queueBuffer(i, input, &output);
+        if (err == OK && mDequeueAhead && !mSwapIntervalZero &&
+                mPrefetchedSlot < 0 && !mDequeueAheadPending) {
+            // mPrefetched* don't change until the thread is done with them
+            mPrefetchedWidth = mReqWidth ? mReqWidth : mUserWidth;
+            mPrefetchedHeight = mReqHeight ? mReqHeight : mUserHeight;
+            mPrefetchedFormat = mReqFormat;
+            mPrefetchedUsage = mReqUsage;
+            mDequeueAheadPending = true;
+            mDequeueAheadCondition.broadcast();
+        }
+    }
     if (err != OK)  {
         ALOGE("queueBuffer: error queuing buffer to SurfaceTexture, %d", err);
     }
@@ -550,6 +707,7 @@ int SurfaceTextureClient::disconnect(int api) {
     ATRACE_CALL();
     ALOGV("SurfaceTextureClient::disconnect");
     Mutex::Autolock lock(mMutex);
+    cancelPrefetchedBufferLocked();
     freeAllBuffers();
     int err = mSurfaceTexture->disconnect(api);
     if (!err) {
@@ -603,6 +761,8 @@ int SurfaceTextureClient::setBufferCount(int bufferCount)
     ALOGV("SurfaceTextureClient::setBufferCount");
     Mutex::Autolock lock(mMutex);
 
+    // the server refuses to change the buffer count while we own a buffer
+    cancelPrefetchedBufferLocked();
     status_t err = mSurfaceTexture->setBufferCount(bufferCount);
     ALOGE_IF(err, "ISurfaceTexture::setBufferCount(%d) returned %s",
             bufferCount, strerror(-err));
@@ -731,6 +891,15 @@ int SurfaceTextureClient::setBuffersTimestamp(int64_t timestamp)
     return NO_ERROR;
 }
 
+void SurfaceTextureClient::cancelPrefetchedBufferLocked() {
+    waitForDequeueAheadLocked();
+    if (mPrefetchedSlot >= 0) {
+        mSurfaceTexture->cancelBuffer(mPrefetchedSlot, mPrefetchedFence);
+        mPrefetchedSlot = -1;
+        mPrefetchedFence.clear();
+    }
+}
+
 void SurfaceTextureClient::freeAllBuffers() {
     for (int i = 0; i < NUM_BUFFER_SLOTS; i++) {
         mSlots[i].buffer = 0;
@@ -740,6 +909,32 @@ void SurfaceTextureClient::freeAllBuffers() {
 // ----------------------------------------------------------------------
 // the lock/unlock APIs must be used from the same thread
 
+static inline void copySpan(uint8_t* d, uint8_t const* s,
+        size_t size, size_t bpp)
+{
+    // short spans, like the edges of a blinking caret, are
+    // cheaper to copy inline than through a memcpy() call.
+    if (size <= 64) {
+        if (bpp == 4) {
+            uint32_t* d32 = reinterpret_cast<uint32_t*>(d);
+            uint32_t const* s32 = reinterpret_cast<uint32_t const*>(s);
+            for (size_t n = size >> 2 ; n > 0 ; n--) {
+                *d32++ = *s32++;
+            }
+            return;
+        }
+        if (bpp == 2) {
+            uint16_t* d16 = reinterpret_cast<uint16_t*>(d);
+            uint16_t const* s16 = reinterpret_cast<uint16_t const*>(s);
+            for (size_t n = size >> 1 ; n > 0 ; n--) {
+                *d16++ = *s16++;
+            }
+            return;
+        }
+    }
+    memcpy(d, s, size);
+}
+
 static status_t copyBlt(
         const sp<GraphicBuffer>& dst,
         const sp<GraphicBuffer>& src,
@@ -758,24 +953,45 @@ static status_t copyBlt(
 
     Region::const_iterator head(reg.begin());
     Region::const_iterator tail(reg.end());
-    if (head != tail && src_bits && dst_bits) {
-        const size_t bpp = bytesPerPixel(src->format);
+    const PixelFormatDescriptor* desc = getPixelFormatDescriptor(src->format);
+    if (head != tail && src_bits && dst_bits && desc) {
+        const size_t bpp = desc->bytesPerPixel;
         const size_t dbpr = dst->stride * bpp;
         const size_t sbpr = src->stride * bpp;
 
         while (head != tail) {
-            const Rect& r(*head++);
-            ssize_t h = r.height();
+            // the rectangles of a region come in bands sharing the same
+            // top and bottom; walk each band row by row so that every
+            // row of both buffers is only touched once.
+            Region::const_iterator band(head);
+            const Rect& first(*head++);
+            while (head != tail && head->top == first.top) {
+                head++;
+            }
+            ssize_t h = first.height();
             if (h <= 0) continue;
-            size_t size = r.width() * bpp;
-            uint8_t const * s = src_bits + (r.left + src->stride * r.top) * bpp;
-            uint8_t       * d = dst_bits + (r.left + dst->stride * r.top) * bpp;
-            if (dbpr==sbpr && size==sbpr) {
-                size *= h;
-                h = 1;
+            uint8_t const * s = src_bits + src->stride * first.top * bpp;
+            uint8_t       * d = dst_bits + dst->stride * first.top * bpp;
+            if (head - band == 1) {
+                size_t size = first.width() * bpp;
+                s += first.left * bpp;
+                d += first.left * bpp;
+                if (dbpr==sbpr && size==sbpr) {
+                    size *= h;
+                    h = 1;
+                }
+                do {
+                    copySpan(d, s, size, bpp);
+                    d += dbpr;
+                    s += sbpr;
+                } while (--h > 0);
+                continue;
             }
             do {
-                memcpy(d, s, size);
+                for (Region::const_iterator r(band) ; r != head ; r++) {
+                    copySpan(d + r->left * bpp, s + r->left * bpp,
+                            r->width() * bpp, bpp);
+                }
                 d += dbpr;
                 s += sbpr;
             } while (--h > 0);
@@ -842,46 +1058,44 @@ status_t SurfaceTextureClient::lock(
                 backBuffer->height == frontBuffer->height &&
                 backBuffer->format == frontBuffer->format);
 
+        Region copyback;
         if (canCopyBack) {
-            // copy the area that is invalid and not repainted this round
-            const Region copyback(mDirtyRegion.subtract(newDirtyRegion));
-            if (!copyback.isEmpty())
-                copyBlt(backBuffer, frontBuffer, copyback);
+            // copy the area this buffer missed since it was last posted
+            // and that isn't repainted this round
+            copyback.set(bounds);
+            { // scope for the lock
+                Mutex::Autolock lock(mMutex);
+                int backBufferSlot(getSlotFromBufferLocked(backBuffer.get()));
+                if (backBufferSlot >= 0) {
+                    copyback = mSlots[backBufferSlot].dirtyRegion;
+                }
+            }
+            copyback.subtractSelf(newDirtyRegion);
         } else {
             // if we can't copy-back anything, modify the user's dirty
             // region to make sure they redraw the whole buffer
             newDirtyRegion.set(bounds);
-            mDirtyRegion.clear();
-            Mutex::Autolock lock(mMutex);
-            for (size_t i=0 ; i<NUM_BUFFER_SLOTS ; i++) {
-                mSlots[i].dirtyRegion.clear();
-            }
         }
 
-
-        { // scope for the lock
-            Mutex::Autolock lock(mMutex);
-            int backBufferSlot(getSlotFromBufferLocked(backBuffer.get()));
-            if (backBufferSlot >= 0) {
-                Region& dirtyRegion(mSlots[backBufferSlot].dirtyRegion);
-                mDirtyRegion.subtract(dirtyRegion);
-                dirtyRegion = newDirtyRegion;
-            }
-        }
-
-        mDirtyRegion.orSelf(newDirtyRegion);
+        mDirtyRegion = newDirtyRegion;
         if (inOutDirtyBounds) {
             *inOutDirtyBounds = newDirtyRegion.getBounds();
         }
 
+        // lock the back buffer once for both the copy-back and the client,
+        // copyBlt's own lock of it is then served by the mapper
         void* vaddr;
         status_t res = backBuffer->lock(
                 GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN,
-                newDirtyRegion.bounds(), &vaddr);
+                newDirtyRegion.merge(copyback).bounds(), &vaddr);
 
         ALOGW_IF(res, "failed locking buffer (handle = %p)",
                 backBuffer->handle);
 
+        if (res == 0 && !copyback.isEmpty()) {
+            copyBlt(backBuffer, frontBuffer, copyback);
+        }
+
         if (res != 0) {
             err = INVALID_OPERATION;
         } else {
@@ -903,13 +1117,30 @@ status_t SurfaceTextureClient::unlockAndPost()
         return INVALID_OPERATION;
     }
 
-    status_t err = mLockedBuffer->unlock();
+    // the consumer waits for gralloc's cache maintenance, not us
+    int fenceFd = -1;
+    status_t err = mLockedBuffer->unlockAsync(&fenceFd);
     ALOGE_IF(err, "failed unlocking buffer (%p)", mLockedBuffer->handle);
 
-    err = queueBuffer(mLockedBuffer.get(), -1);
+    err = queueBuffer(mLockedBuffer.get(), fenceFd);
     ALOGE_IF(err, "queueBuffer (handle=%p) failed (%s)",
             mLockedBuffer->handle, strerror(-err));
 
+    { // scope for the lock
+        // the posted buffer is now the front buffer, every other buffer
+        // is missing what was just drawn
+        Mutex::Autolock lock(mMutex);
+        int postedSlot(getSlotFromBufferLocked(mLockedBuffer.get()));
+        for (int i=0 ; i<NUM_BUFFER_SLOTS ; i++) {
+            if (i == postedSlot) {
+                mSlots[i].dirtyRegion.clear();
+            } else if (mSlots[i].buffer != 0) {
+                mSlots[i].dirtyRegion.orSelf(mDirtyRegion);
+            }
+        }
+    }
+    mDirtyRegion.clear();
+
     mPostedBuffer = mLockedBuffer;
     mLockedBuffer = 0;
     return err;
@@ -7,8 +7,14 @@ LOCAL_MODULE := libgui_test
 LOCAL_MODULE_TAGS := tests
 
 LOCAL_SRC_FILES := \
+    BitTube_test.cpp \
     BufferQueue_test.cpp \
     CpuConsumer_test.cpp \
+    DisplayEventReceiver_test.cpp \
+    LayerStateChannel_test.cpp \
+    LayerState_test.cpp \
+    SensorEventRing_test.cpp \
+    Sensor_test.cpp \
     SurfaceTextureClient_test.cpp \
     SurfaceTexture_test.cpp \
     Surface_test.cpp \
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "BitTube_test"
+//#define LOG_NDEBUG 0
+
+#include <gtest/gtest.h>
+
+#include <gui/BitTube.h>
+#include <gui/DisplayEventReceiver.h>
+
+namespace android {
+
+typedef DisplayEventReceiver::Event Event;
+
+static Event makeEvent(uint32_t type, uint32_t count) {
+    Event e;
+    memset(&e, 0, sizeof(e));
+    e.header.type = type;
+    e.header.timestamp = count;
+    e.vsync.count = count;
+    return e;
+}
+
+// the socket buffer is small, this many events always fit
+static const size_t kFewEvents = 8;
+
+TEST(BitTubeTest, ObjectsArriveInOrder) {
+    sp<BitTube> tube(new BitTube());
+    ASSERT_EQ(NO_ERROR, tube->initCheck());
+
+    Event in[kFewEvents], out[64];
+    for (size_t i = 0; i < kFewEvents; i++) {
+        in[i] = makeEvent(DisplayEventReceiver::DISPLAY_EVENT_VSYNC, i);
+    }
+    ASSERT_EQ(ssize_t(kFewEvents), BitTube::sendObjects(tube, in, kFewEvents));
+    ASSERT_EQ(ssize_t(kFewEvents), BitTube::recvObjects(tube, out, 64));
+    for (size_t i = 0; i < kFewEvents; i++) {
+        EXPECT_EQ(i, out[i].vsync.count);
+    }
+    EXPECT_EQ(-EAGAIN, BitTube::recvObjects(tube, out, 64));
+    EXPECT_EQ(-EAGAIN, BitTube::recvObjects(tube, out, 1));
+}
+
+TEST(BitTubeTest, SendStopsWhenTheSocketIsFull) {
+    sp<BitTube> tube(new BitTube());
+    ASSERT_EQ(NO_ERROR, tube->initCheck());
+
+    Event in[1024], out[1024];
+    for (size_t i = 0; i < 1024; i++) {
+        in[i] = makeEvent(DisplayEventReceiver::DISPLAY_EVENT_VSYNC, i);
+    }
+    ssize_t sent = BitTube::sendObjects(tube, in, 1024);
+    ASSERT_GT(sent, 0);
+    ASSERT_LT(sent, 1024);
+    // full, the same as writing a single object
+    EXPECT_EQ(-EAGAIN, BitTube::sendObjects(tube, in, 2));
+    EXPECT_EQ(-EAGAIN, BitTube::sendObjects(tube, in, 1));
+    EXPECT_EQ(sent, BitTube::recvObjects(tube, out, 1024));
+    EXPECT_EQ(uint32_t(sent - 1), out[sent - 1].vsync.count);
+}
+
+TEST(BitTubeTest, PendingVsyncsCollapseIntoTheLatest) {
+    sp<BitTube> tube(new BitTube());
+    ASSERT_EQ(NO_ERROR, tube->initCheck());
+
+    Event in[kFewEvents];
+    for (size_t i = 0; i < kFewEvents; i++) {
+        in[i] = makeEvent(DisplayEventReceiver::DISPLAY_EVENT_VSYNC, i);
+    }
+    in[3] = makeEvent(DisplayEventReceiver::DISPLAY_EVENT_HOTPLUG, 3);
+    in[5] = makeEvent(DisplayEventReceiver::DISPLAY_EVENT_HOTPLUG, 5);
+    ASSERT_EQ(ssize_t(kFewEvents),
+            DisplayEventReceiver::sendEvents(tube, in, kFewEvents));
+
+    // smaller than the backlog, so that it takes several reads
+    Event out[4];
+    ASSERT_EQ(3, DisplayEventReceiver::getEventsWithLatestVsync(tube, out, 4));
+    EXPECT_EQ(uint32_t(DisplayEventReceiver::DISPLAY_EVENT_HOTPLUG), out[0].header.type);
+    EXPECT_EQ(3, out[0].header.timestamp);
+    EXPECT_EQ(uint32_t(DisplayEventReceiver::DISPLAY_EVENT_HOTPLUG), out[1].header.type);
+    EXPECT_EQ(5, out[1].header.timestamp);
+    EXPECT_EQ(uint32_t(DisplayEventReceiver::DISPLAY_EVENT_VSYNC), out[2].header.type);
+    EXPECT_EQ(kFewEvents - 1, out[2].vsync.count);
+    EXPECT_EQ(-EAGAIN, DisplayEventReceiver::getEventsWithLatestVsync(tube, out, 4));
+}
+
+TEST(BitTubeTest, CollapsingStopsWhenTheOutputIsFull) {
+    sp<BitTube> tube(new BitTube());
+    ASSERT_EQ(NO_ERROR, tube->initCheck());
+
+    Event in[4];
+    in[0] = makeEvent(DisplayEventReceiver::DISPLAY_EVENT_VSYNC, 0);
+    in[1] = makeEvent(DisplayEventReceiver::DISPLAY_EVENT_HOTPLUG, 1);
+    in[2] = makeEvent(DisplayEventReceiver::DISPLAY_EVENT_HOTPLUG, 2);
+    in[3] = makeEvent(DisplayEventReceiver::DISPLAY_EVENT_VSYNC, 3);
+    ASSERT_EQ(4, DisplayEventReceiver::sendEvents(tube, in, 4));
+
+    Event out[2];
+    ASSERT_EQ(2, DisplayEventReceiver::getEventsWithLatestVsync(tube, out, 2));
+    EXPECT_EQ(1, out[0].header.timestamp);
+    EXPECT_EQ(0U, out[1].vsync.count);
+    ASSERT_EQ(2, DisplayEventReceiver::getEventsWithLatestVsync(tube, out, 2));
+    EXPECT_EQ(2, out[0].header.timestamp);
+    EXPECT_EQ(3U, out[1].vsync.count);
+}
+
+} // namespace android
@@ -93,6 +93,154 @@ TEST_F(BufferQueueTest, AcquireBuffer_ExceedsMaxAcquireCount_Fails) {
     ASSERT_EQ(INVALID_OPERATION, mBQ->acquireBuffer(&item));
 }
 
+TEST_F(BufferQueueTest, AcquireBuffer_NothingQueued_ReturnsNoBufferAvailable) {
+    sp<DummyConsumer> dc(new DummyConsumer);
+    mBQ->consumerConnect(dc);
+    ISurfaceTexture::QueueBufferOutput qbo;
+    mBQ->connect(NATIVE_WINDOW_API_CPU, &qbo);
+    mBQ->setBufferCount(4);
+
+    int slot;
+    sp<Fence> fence;
+    sp<GraphicBuffer> buf;
+    ISurfaceTexture::QueueBufferInput qbi(0, Rect(0, 0, 1, 1),
+            NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, fence);
+    BufferQueue::BufferItem item;
+
+    ASSERT_EQ(int(BufferQueue::NO_BUFFER_AVAILABLE), mBQ->acquireBuffer(&item));
+
+    ASSERT_EQ(ISurfaceTexture::BUFFER_NEEDS_REALLOCATION,
+            mBQ->dequeueBuffer(&slot, fence, 1, 1, 0,
+                GRALLOC_USAGE_SW_READ_OFTEN));
+    ASSERT_EQ(OK, mBQ->requestBuffer(slot, &buf));
+
+    // A dequeued buffer isn't available to the consumer.
+    ASSERT_EQ(int(BufferQueue::NO_BUFFER_AVAILABLE), mBQ->acquireBuffer(&item));
+
+    ASSERT_EQ(OK, mBQ->queueBuffer(slot, qbi, &qbo));
+    ASSERT_EQ(OK, mBQ->acquireBuffer(&item));
+    ASSERT_EQ(slot, item.mBuf);
+    ASSERT_EQ(int(BufferQueue::NO_BUFFER_AVAILABLE), mBQ->acquireBuffer(&item));
+
+    ASSERT_EQ(OK, mBQ->releaseBuffer(item.mBuf, EGL_NO_DISPLAY,
+            EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+    ASSERT_EQ(int(BufferQueue::NO_BUFFER_AVAILABLE), mBQ->acquireBuffer(&item));
+}
+
+TEST_F(BufferQueueTest, AcquireBuffer_MaxAcquiredNothingQueued_Fails) {
+    sp<DummyConsumer> dc(new DummyConsumer);
+    mBQ->consumerConnect(dc);
+    ISurfaceTexture::QueueBufferOutput qbo;
+    mBQ->connect(NATIVE_WINDOW_API_CPU, &qbo);
+    mBQ->setBufferCount(4);
+
+    int slot;
+    sp<Fence> fence;
+    sp<GraphicBuffer> buf;
+    ISurfaceTexture::QueueBufferInput qbi(0, Rect(0, 0, 1, 1),
+            NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, fence);
+    BufferQueue::BufferItem item;
+
+    for (int i = 0; i < 2; i++) {
+        ASSERT_EQ(ISurfaceTexture::BUFFER_NEEDS_REALLOCATION,
+                mBQ->dequeueBuffer(&slot, fence, 1, 1, 0,
+                    GRALLOC_USAGE_SW_READ_OFTEN));
+        ASSERT_EQ(OK, mBQ->requestBuffer(slot, &buf));
+        ASSERT_EQ(OK, mBQ->queueBuffer(slot, qbi, &qbo));
+        ASSERT_EQ(OK, mBQ->acquireBuffer(&item));
+    }
+
+    // The max acquired check takes precedence over the empty queue.
+    ASSERT_EQ(INVALID_OPERATION, mBQ->acquireBuffer(&item));
+}
+
+TEST_F(BufferQueueTest, AllocateBuffers_DequeueUsesPreallocatedBuffer) {
+    sp<DummyConsumer> dc(new DummyConsumer);
+    mBQ->consumerConnect(dc);
+    ISurfaceTexture::QueueBufferOutput qbo;
+    mBQ->connect(NATIVE_WINDOW_API_CPU, &qbo);
+    mBQ->setBufferCount(4);
+
+    mBQ->allocateBuffers(2, 2, HAL_PIXEL_FORMAT_RGBA_8888,
+            GRALLOC_USAGE_SW_READ_OFTEN, 2);
+
+    int slot;
+    sp<Fence> fence;
+    sp<GraphicBuffer> buf;
+
+    // The producer hasn't seen the buffer yet so it must still request it.
+    ASSERT_EQ(ISurfaceTexture::BUFFER_NEEDS_REALLOCATION,
+            mBQ->dequeueBuffer(&slot, fence, 2, 2, HAL_PIXEL_FORMAT_RGBA_8888,
+                GRALLOC_USAGE_SW_READ_OFTEN));
+    ASSERT_EQ(OK, mBQ->requestBuffer(slot, &buf));
+    ASSERT_TRUE(buf != NULL);
+    EXPECT_EQ(2U, buf->getWidth());
+    EXPECT_EQ(2U, buf->getHeight());
+    mBQ->cancelBuffer(slot, Fence::NO_FENCE);
+
+    // Once requested, it's a plain hit.
+    int slot2;
+    ASSERT_EQ(OK, mBQ->dequeueBuffer(&slot2, fence, 2, 2,
+            HAL_PIXEL_FORMAT_RGBA_8888, GRALLOC_USAGE_SW_READ_OFTEN));
+    ASSERT_EQ(slot, slot2);
+}
+
+// A consumer polling acquireBuffer while a producer queues must still see
+// every frame; the empty-queue check it mostly hits runs without the lock.
+TEST_F(BufferQueueTest, AcquireBuffer_PolledWhileQueueing_GetsEveryFrame) {
+    sp<DummyConsumer> dc(new DummyConsumer);
+    mBQ->consumerConnect(dc);
+    ISurfaceTexture::QueueBufferOutput qbo;
+    mBQ->connect(NATIVE_WINDOW_API_CPU, &qbo);
+    // Synchronous mode so that every queued frame reaches the consumer.
+    mBQ->setSynchronousMode(true);
+    mBQ->setBufferCount(4);
+
+    struct ProducerThread : public Thread {
+        ProducerThread(const sp<BufferQueue>& bq, int frames) :
+                mBQ(bq), mFrames(frames) {}
+        virtual bool threadLoop() {
+            int slot;
+            sp<Fence> fence;
+            sp<GraphicBuffer> buf;
+            ISurfaceTexture::QueueBufferOutput qbo;
+            ISurfaceTexture::QueueBufferInput qbi(0, Rect(0, 0, 1, 1),
+                    NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, fence);
+            for (int i = 0; i < mFrames; i++) {
+                if (mBQ->dequeueBuffer(&slot, fence, 1, 1, 0,
+                        GRALLOC_USAGE_SW_READ_OFTEN) < 0) {
+                    break;
+                }
+                mBQ->requestBuffer(slot, &buf);
+                mBQ->queueBuffer(slot, qbi, &qbo);
+            }
+            return false;
+        }
+        sp<BufferQueue> mBQ;
+        int mFrames;
+    };
+
+    const int frames = 100;
+    sp<ProducerThread> pt(new ProducerThread(mBQ, frames));
+    nsecs_t start = systemTime();
+    pt->run("BufferQueueTest::ProducerThread");
+
+    int acquired = 0;
+    BufferQueue::BufferItem item;
+    while (acquired < frames && systemTime() - start < s2ns(10)) {
+        if (mBQ->acquireBuffer(&item) == OK) {
+            acquired++;
+            ASSERT_EQ(OK, mBQ->releaseBuffer(item.mBuf, EGL_NO_DISPLAY,
+                    EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+        }
+    }
+    pt->requestExitAndWait();
+
+    // synchronous mode: nothing queued may be dropped
+    ASSERT_EQ(frames, acquired);
+    ASSERT_EQ(BufferQueue::NO_BUFFER_AVAILABLE, mBQ->acquireBuffer(&item));
+}
+
 TEST_F(BufferQueueTest, SetMaxAcquiredBufferCountWithIllegalValues_ReturnsError) {
     sp<DummyConsumer> dc(new DummyConsumer);
     mBQ->consumerConnect(dc);
@@ -114,4 +262,325 @@ TEST_F(BufferQueueTest, SetMaxAcquiredBufferCountWithLegalValues_Succeeds) {
             BufferQueue::MAX_MAX_ACQUIRED_BUFFERS));
 }
 
+TEST_F(BufferQueueTest, SetQueueModeWithIllegalValues_ReturnsError) {
+    ASSERT_EQ(BAD_VALUE, mBQ->setQueueMode(-1, 0));
+    ASSERT_EQ(BAD_VALUE, mBQ->setQueueMode(
+            ISurfaceTexture::QUEUE_MODE_DROP_OLDEST + 1, 0));
+    ASSERT_EQ(BAD_VALUE, mBQ->setQueueMode(
+            ISurfaceTexture::QUEUE_MODE_DROP_OLDEST, 0));
+    ASSERT_EQ(BAD_VALUE, mBQ->setQueueMode(
+            ISurfaceTexture::QUEUE_MODE_DROP_OLDEST,
+            BufferQueue::NUM_BUFFER_SLOTS));
+}
+
+TEST_F(BufferQueueTest, QueueModeDropOldest_KeepsNewestFrames) {
+    sp<DummyConsumer> dc(new DummyConsumer);
+    mBQ->consumerConnect(dc);
+    ISurfaceTexture::QueueBufferOutput qbo;
+    mBQ->connect(NATIVE_WINDOW_API_CPU, &qbo);
+    mBQ->setBufferCount(4);
+    ASSERT_EQ(OK, mBQ->setQueueMode(ISurfaceTexture::QUEUE_MODE_DROP_OLDEST, 2));
+
+    int slot;
+    sp<Fence> fence;
+    sp<GraphicBuffer> buf;
+    ISurfaceTexture::QueueBufferInput qbi(0, Rect(0, 0, 1, 1),
+            NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, fence);
+    BufferQueue::BufferItem item;
+
+    for (int i = 0; i < 3; i++) {
+        ASSERT_LE(0, mBQ->dequeueBuffer(&slot, fence, 1, 1, 0,
+                GRALLOC_USAGE_SW_READ_OFTEN));
+        ASSERT_EQ(OK, mBQ->requestBuffer(slot, &buf));
+        ASSERT_EQ(OK, mBQ->queueBuffer(slot, qbi, &qbo));
+    }
+
+    // The first frame made room for the third one.
+    ASSERT_EQ(OK, mBQ->acquireBuffer(&item));
+    EXPECT_EQ(2U, item.mFrameNumber);
+    ASSERT_EQ(OK, mBQ->releaseBuffer(item.mBuf, EGL_NO_DISPLAY,
+            EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+    ASSERT_EQ(OK, mBQ->acquireBuffer(&item));
+    EXPECT_EQ(3U, item.mFrameNumber);
+    ASSERT_EQ(int(BufferQueue::NO_BUFFER_AVAILABLE), mBQ->acquireBuffer(&item));
+}
+
+TEST_F(BufferQueueTest, QueueModeMailbox_DequeueTakesBackPendingFrame) {
+    sp<DummyConsumer> dc(new DummyConsumer);
+    mBQ->consumerConnect(dc);
+    ISurfaceTexture::QueueBufferOutput qbo;
+    mBQ->connect(NATIVE_WINDOW_API_CPU, &qbo);
+    mBQ->setBufferCount(3);
+    ASSERT_EQ(OK, mBQ->setQueueMode(ISurfaceTexture::QUEUE_MODE_MAILBOX, 0));
+
+    int slot;
+    sp<Fence> fence;
+    sp<GraphicBuffer> buf;
+    ISurfaceTexture::QueueBufferInput qbi(0, Rect(0, 0, 1, 1),
+            NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, fence);
+    BufferQueue::BufferItem item;
+
+    // The consumer holds on to two frames and a third one is pending, so no
+    // slot is free.
+    for (int i = 0; i < 3; i++) {
+        ASSERT_LE(0, mBQ->dequeueBuffer(&slot, fence, 1, 1, 0,
+                GRALLOC_USAGE_SW_READ_OFTEN));
+        ASSERT_EQ(OK, mBQ->requestBuffer(slot, &buf));
+        ASSERT_EQ(OK, mBQ->queueBuffer(slot, qbi, &qbo));
+        if (i < 2) {
+            ASSERT_EQ(OK, mBQ->acquireBuffer(&item));
+        }
+    }
+
+    // Rather than block, dequeueBuffer drops the pending frame.
+    int pending = slot;
+    ASSERT_LE(0, mBQ->dequeueBuffer(&slot, fence, 1, 1, 0,
+            GRALLOC_USAGE_SW_READ_OFTEN));
+    EXPECT_EQ(pending, slot);
+    ASSERT_EQ(OK, mBQ->releaseBuffer(item.mBuf, EGL_NO_DISPLAY,
+            EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+    ASSERT_EQ(int(BufferQueue::NO_BUFFER_AVAILABLE), mBQ->acquireBuffer(&item));
+
+    String8 result;
+    mBQ->dump(result);
+    EXPECT_TRUE(strstr(result.string(), "mailbox=1") != NULL);
+}
+
+TEST_F(BufferQueueTest, QueueAndDequeueBuffer_ReturnsNextSlot) {
+    sp<DummyConsumer> dc(new DummyConsumer);
+    mBQ->consumerConnect(dc);
+    ISurfaceTexture::QueueBufferOutput qbo;
+    mBQ->connect(NATIVE_WINDOW_API_CPU, &qbo);
+    mBQ->setBufferCount(3);
+
+    int slot;
+    int nextSlot = -1;
+    status_t dequeueResult;
+    sp<Fence> fence;
+    sp<GraphicBuffer> buf;
+    ISurfaceTexture::QueueBufferInput qbi(0, Rect(0, 0, 1, 1),
+            NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, fence);
+    BufferQueue::BufferItem item;
+
+    ASSERT_EQ(ISurfaceTexture::BUFFER_NEEDS_REALLOCATION,
+            mBQ->dequeueBuffer(&slot, fence, 1, 1, 0,
+                GRALLOC_USAGE_SW_READ_OFTEN));
+    ASSERT_EQ(OK, mBQ->requestBuffer(slot, &buf));
+    ASSERT_EQ(OK, mBQ->queueAndDequeueBuffer(slot, qbi, &qbo, &nextSlot,
+            fence, 1, 1, 0, GRALLOC_USAGE_SW_READ_OFTEN, &dequeueResult));
+    ASSERT_LE(0, dequeueResult);
+    EXPECT_NE(slot, nextSlot);
+
+    // The first buffer was queued, the second one is owned by the producer.
+    ASSERT_EQ(OK, mBQ->acquireBuffer(&item));
+    EXPECT_EQ(slot, item.mBuf);
+    ASSERT_EQ(OK, mBQ->requestBuffer(nextSlot, &buf));
+    ASSERT_EQ(OK, mBQ->queueBuffer(nextSlot, qbi, &qbo));
+
+    // Nothing is dequeued when the queue fails.
+    nextSlot = -1;
+    ASSERT_EQ(-EINVAL, mBQ->queueAndDequeueBuffer(-1, qbi, &qbo, &nextSlot,
+            fence, 1, 1, 0, GRALLOC_USAGE_SW_READ_OFTEN, &dequeueResult));
+    EXPECT_EQ(NO_INIT, dequeueResult);
+    EXPECT_EQ(-1, nextSlot);
+}
+
+TEST_F(BufferQueueTest, GetQueuedBufferFence_ReturnsHeadFence) {
+    sp<DummyConsumer> dc(new DummyConsumer);
+    mBQ->consumerConnect(dc);
+    ISurfaceTexture::QueueBufferOutput qbo;
+    mBQ->connect(NATIVE_WINDOW_API_CPU, &qbo);
+    mBQ->setBufferCount(3);
+
+    int slot;
+    sp<Fence> fence;
+    sp<GraphicBuffer> buf;
+    sp<Fence> queuedFence(new Fence());
+    ISurfaceTexture::QueueBufferInput qbi(0, Rect(0, 0, 1, 1),
+            NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, queuedFence);
+    BufferQueue::BufferItem item;
+
+    EXPECT_TRUE(mBQ->getQueuedBufferFence() == NULL);
+
+    ASSERT_EQ(ISurfaceTexture::BUFFER_NEEDS_REALLOCATION,
+            mBQ->dequeueBuffer(&slot, fence, 1, 1, 0,
+                GRALLOC_USAGE_SW_READ_OFTEN));
+    ASSERT_EQ(OK, mBQ->requestBuffer(slot, &buf));
+    ASSERT_EQ(OK, mBQ->queueBuffer(slot, qbi, &qbo));
+    EXPECT_TRUE(mBQ->getQueuedBufferFence() == queuedFence);
+
+    // Once acquired, nothing is left in the queue.
+    ASSERT_EQ(OK, mBQ->acquireBuffer(&item));
+    EXPECT_TRUE(item.mFence == queuedFence);
+    EXPECT_TRUE(mBQ->getQueuedBufferFence() == NULL);
+}
+
+TEST_F(BufferQueueTest, AcquireBuffer_PresentTime_HoldsAndDropsBuffers) {
+    sp<DummyConsumer> dc(new DummyConsumer);
+    mBQ->consumerConnect(dc);
+    ISurfaceTexture::QueueBufferOutput qbo;
+    mBQ->connect(NATIVE_WINDOW_API_CPU, &qbo);
+    mBQ->setSynchronousMode(true);
+    mBQ->setBufferCount(4);
+
+    const nsecs_t now = systemTime();
+    const nsecs_t ms = 1000000;
+    int slots[3];
+    sp<Fence> fence;
+    sp<GraphicBuffer> buf;
+    BufferQueue::BufferItem item;
+
+    // three frames due 10ms apart
+    for (int i = 0; i < 3; i++) {
+        ISurfaceTexture::QueueBufferInput qbi(now + i*10*ms,
+                Rect(0, 0, 1, 1), NATIVE_WINDOW_SCALING_MODE_FREEZE, 0,
+                fence, false);
+        ASSERT_EQ(ISurfaceTexture::BUFFER_NEEDS_REALLOCATION,
+                mBQ->dequeueBuffer(&slots[i], fence, 1, 1, 0,
+                    GRALLOC_USAGE_SW_READ_OFTEN));
+        ASSERT_EQ(OK, mBQ->requestBuffer(slots[i], &buf));
+        ASSERT_EQ(OK, mBQ->queueBuffer(slots[i], qbi, &qbo));
+    }
+
+    // nothing is due yet
+    EXPECT_EQ(BufferQueue::PRESENT_LATER, mBQ->acquireBuffer(&item, now - ms));
+
+    // by the time the second one is due the first one is late
+    ASSERT_EQ(OK, mBQ->acquireBuffer(&item, now + 15*ms));
+    EXPECT_EQ(slots[1], item.mBuf);
+    EXPECT_FALSE(item.mIsAutoTimestamp);
+    ASSERT_EQ(OK, mBQ->releaseBuffer(item.mBuf, EGL_NO_DISPLAY,
+            EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+
+    // without a present time, the next one is acquired right away
+    ASSERT_EQ(OK, mBQ->acquireBuffer(&item));
+    EXPECT_EQ(slots[2], item.mBuf);
+}
+
+TEST_F(BufferQueueTest, ReleaseBuffers_ReleasesEachSlotAndReportsErrors) {
+    sp<DummyConsumer> dc(new DummyConsumer);
+    mBQ->consumerConnect(dc);
+    ISurfaceTexture::QueueBufferOutput qbo;
+    mBQ->connect(NATIVE_WINDOW_API_CPU, &qbo);
+    mBQ->setBufferCount(4);
+
+    int slot;
+    sp<Fence> fence;
+    sp<GraphicBuffer> buf;
+    ISurfaceTexture::QueueBufferInput qbi(0, Rect(0, 0, 1, 1),
+            NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, fence);
+    BufferQueue::BufferItem item;
+    BufferQueue::ReleaseItem items[3];
+
+    for (int i = 0; i < 2; i++) {
+        ASSERT_EQ(ISurfaceTexture::BUFFER_NEEDS_REALLOCATION,
+                mBQ->dequeueBuffer(&slot, fence, 1, 1, 0,
+                    GRALLOC_USAGE_SW_READ_OFTEN));
+        ASSERT_EQ(OK, mBQ->requestBuffer(slot, &buf));
+        ASSERT_EQ(OK, mBQ->queueBuffer(slot, qbi, &qbo));
+        ASSERT_EQ(OK, mBQ->acquireBuffer(&item));
+        items[i].mBuf = item.mBuf;
+        items[i].mFence = Fence::NO_FENCE;
+    }
+
+    // Releasing the same slot twice fails for the second one only.
+    items[2].mBuf = items[0].mBuf;
+    items[2].mFence = Fence::NO_FENCE;
+    ASSERT_EQ(-EINVAL, mBQ->releaseBuffers(items, 3));
+    EXPECT_EQ(OK, items[0].mResult);
+    EXPECT_EQ(OK, items[1].mResult);
+    EXPECT_EQ(-EINVAL, items[2].mResult);
+
+    // Both buffers are back, so two more can be acquired.
+    for (int i = 0; i < 2; i++) {
+        ASSERT_LE(0, mBQ->dequeueBuffer(&slot, fence, 1, 1, 0,
+                GRALLOC_USAGE_SW_READ_OFTEN));
+        ASSERT_EQ(OK, mBQ->requestBuffer(slot, &buf));
+        ASSERT_EQ(OK, mBQ->queueBuffer(slot, qbi, &qbo));
+        ASSERT_EQ(OK, mBQ->acquireBuffer(&item));
+    }
+}
+
+TEST_F(BufferQueueTest, AcquireBuffers_AcquiresQueuedBuffersInOrder) {
+    sp<DummyConsumer> dc(new DummyConsumer);
+    mBQ->consumerConnect(dc);
+    ASSERT_EQ(OK, mBQ->setMaxAcquiredBufferCount(2));
+    ISurfaceTexture::QueueBufferOutput qbo;
+    mBQ->connect(NATIVE_WINDOW_API_CPU, &qbo);
+    mBQ->setSynchronousMode(true);
+    mBQ->setBufferCount(5);
+
+    int slot;
+    sp<Fence> fence;
+    sp<GraphicBuffer> buf;
+    ISurfaceTexture::QueueBufferInput qbi(0, Rect(0, 0, 1, 1),
+            NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, fence);
+    Vector<BufferQueue::BufferItem> items;
+
+    ASSERT_EQ(int(BufferQueue::NO_BUFFER_AVAILABLE),
+            mBQ->acquireBuffers(4, &items));
+    EXPECT_EQ(0U, items.size());
+
+    for (int i = 0; i < 4; i++) {
+        ASSERT_EQ(ISurfaceTexture::BUFFER_NEEDS_REALLOCATION,
+                mBQ->dequeueBuffer(&slot, fence, 1, 1, 0,
+                    GRALLOC_USAGE_SW_READ_OFTEN));
+        ASSERT_EQ(OK, mBQ->requestBuffer(slot, &buf));
+        ASSERT_EQ(OK, mBQ->queueBuffer(slot, qbi, &qbo));
+    }
+
+    // One buffer over the maximum can be acquired, the fourth stays queued.
+    ASSERT_EQ(INVALID_OPERATION, mBQ->acquireBuffers(4, &items));
+    ASSERT_EQ(3U, items.size());
+    for (size_t i = 0; i < items.size(); i++) {
+        EXPECT_EQ(uint64_t(i + 1), items[i].mFrameNumber);
+    }
+
+    ASSERT_EQ(OK, mBQ->releaseBuffer(items[0].mBuf, EGL_NO_DISPLAY,
+            EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+    ASSERT_EQ(int(BufferQueue::NO_BUFFER_AVAILABLE),
+            mBQ->acquireBuffers(4, &items));
+    ASSERT_EQ(4U, items.size());
+    EXPECT_EQ(4U, items[3].mFrameNumber);
+}
+
+TEST_F(BufferQueueTest, SetDefaultMaxBufferCount_LoweredWhileAcquired_KeepsAcquiredBuffer) {
+    sp<DummyConsumer> dc(new DummyConsumer);
+    mBQ->consumerConnect(dc);
+    mBQ->setDefaultMaxBufferCount(3);
+    ISurfaceTexture::QueueBufferOutput qbo;
+    mBQ->connect(NATIVE_WINDOW_API_CPU, &qbo);
+    mBQ->setSynchronousMode(true);
+
+    int slot;
+    sp<Fence> fence;
+    sp<GraphicBuffer> buf;
+    ISurfaceTexture::QueueBufferInput qbi(0, Rect(0, 0, 1, 1),
+            NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, fence);
+    BufferQueue::BufferItem items[3];
+
+    for (int i = 0; i < 3; i++) {
+        ASSERT_EQ(ISurfaceTexture::BUFFER_NEEDS_REALLOCATION,
+                mBQ->dequeueBuffer(&slot, fence, 1, 1, 0,
+                    GRALLOC_USAGE_SW_READ_OFTEN));
+        ASSERT_EQ(i, slot);
+        ASSERT_EQ(OK, mBQ->requestBuffer(slot, &buf));
+        ASSERT_EQ(OK, mBQ->queueBuffer(slot, qbi, &qbo));
+        if (i == 2) {
+            ASSERT_EQ(OK, mBQ->releaseBuffer(items[0].mBuf, EGL_NO_DISPLAY,
+                    EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+        }
+        ASSERT_EQ(OK, mBQ->acquireBuffer(&items[i]));
+    }
+
+    // The last slot is acquired when the count goes back to 2, it's kept
+    // until the consumer releases it.
+    ASSERT_EQ(OK, mBQ->setDefaultMaxBufferCount(2));
+    ASSERT_LE(0, mBQ->dequeueBuffer(&slot, fence, 1, 1, 0,
+            GRALLOC_USAGE_SW_READ_OFTEN));
+    EXPECT_EQ(0, slot);
+    EXPECT_EQ(OK, mBQ->releaseBuffer(items[2].mBuf, EGL_NO_DISPLAY,
+            EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+}
+
 } // namespace android
@@ -32,6 +32,7 @@
 #include <utils/Thread.h>
 #include <utils/Mutex.h>
 #include <utils/Condition.h>
+#include <utils/SortedVector.h>
 
 #include <ui/FramebufferNativeWindow.h>
 
@@ -493,6 +494,219 @@ TEST_P(CpuConsumerTest, DISABLED_FromCpuLockMax) {
 
 }
 
+// This test is disabled because the HAL_PIXEL_FORMAT_RAW_SENSOR format is not
+// supported on all devices.
+TEST_P(CpuConsumerTest, DISABLED_FromCpuCachedMappings) {
+    status_t err;
+    CpuConsumerTestParams params = GetParam();
+
+    // Set up, with a consumer that keeps its buffers mapped
+
+    mANW.clear();
+    mSTC.clear();
+    mCC = new CpuConsumer(params.maxLockedBuffers, true);
+    mSTC = new SurfaceTextureClient(mCC->getProducerInterface());
+    mANW = mSTC;
+
+    const int maxBufferSlack = 1;
+    ASSERT_NO_FATAL_FAILURE(configureANW(mANW, params, maxBufferSlack));
+
+    int minUndequeuedBuffers;
+    err = mANW->query(mANW.get(), NATIVE_WINDOW_MIN_UNDEQUEUED_BUFFERS,
+            &minUndequeuedBuffers);
+    ASSERT_NO_ERROR(err, "query error: ");
+    const int bufferCount = maxBufferSlack + 1 + minUndequeuedBuffers;
+
+    // Produce and consume enough frames for every buffer to come back, the
+    // contents must be right when a cached mapping is reused.
+
+    SortedVector<uint8_t*> mappings;
+    for (int i = 0; i < 3 * bufferCount; i++) {
+        const int64_t time = i + 1;
+        uint32_t stride;
+        ASSERT_NO_FATAL_FAILURE(produceOneFrame(mANW, params, time,
+                        &stride));
+
+        CpuConsumer::LockedBuffer b;
+        err = mCC->lockNextBuffer(&b);
+        ASSERT_NO_ERROR(err, "getNextBuffer error: ");
+        ASSERT_TRUE(b.data != NULL);
+        EXPECT_EQ(time, b.timestamp);
+        checkBayerRawBuffer(b);
+
+        mappings.add(b.data);
+
+        err = mCC->unlockBuffer(b);
+        ASSERT_NO_ERROR(err, "Could not unlock buffer: ");
+    }
+
+    // Each buffer was mapped once.
+    EXPECT_LE(int(mappings.size()), bufferCount);
+}
+
+class LockerThread : public Thread {
+public:
+    LockerThread(const sp<CpuConsumer>& cc, Mutex* mutex, Condition* cond,
+            int* lockedCount, int total) :
+        Thread(false),
+        mResult(NO_INIT),
+        mCC(cc), mMutex(mutex), mCond(cond), mLockedCount(lockedCount),
+        mTotal(total) {
+    }
+
+    status_t mResult;
+    CpuConsumer::LockedBuffer mBuffer;
+
+private:
+    virtual bool threadLoop() {
+        mResult = mCC->lockNextBuffer(&mBuffer);
+        // Hold on to the buffer until every thread has locked one.
+        Mutex::Autolock lock(*mMutex);
+        (*mLockedCount)++;
+        mCond->broadcast();
+        while (*mLockedCount < mTotal) {
+            mCond->wait(*mMutex);
+        }
+        return false;
+    }
+
+    sp<CpuConsumer> mCC;
+    Mutex* mMutex;
+    Condition* mCond;
+    int* mLockedCount;
+    int mTotal;
+};
+
+// This test is disabled because the HAL_PIXEL_FORMAT_RAW_SENSOR format is not
+// supported on all devices.
+TEST_P(CpuConsumerTest, DISABLED_FromCpuLockMaxConcurrently) {
+    status_t err;
+    CpuConsumerTestParams params = GetParam();
+
+    // Set up
+
+    ASSERT_NO_FATAL_FAILURE(configureANW(mANW, params, params.maxLockedBuffers));
+
+    // Produce
+
+    const int64_t time = 1234L;
+    uint32_t stride;
+
+    for (int i = 0; i < params.maxLockedBuffers; i++) {
+        ASSERT_NO_FATAL_FAILURE(produceOneFrame(mANW, params, time,
+                        &stride));
+    }
+
+    // Consume, one thread per buffer
+
+    Mutex mutex;
+    Condition cond;
+    int lockedCount = 0;
+    Vector< sp<LockerThread> > threads;
+    for (int i = 0; i < params.maxLockedBuffers; i++) {
+        sp<LockerThread> t(new LockerThread(mCC, &mutex, &cond, &lockedCount,
+                params.maxLockedBuffers));
+        threads.add(t);
+        t->run("LockerThread");
+    }
+    for (int i = 0; i < params.maxLockedBuffers; i++) {
+        threads[i]->join();
+    }
+
+    for (int i = 0; i < params.maxLockedBuffers; i++) {
+        const CpuConsumer::LockedBuffer& b(threads[i]->mBuffer);
+        ASSERT_NO_ERROR(threads[i]->mResult, "getNextBuffer error: ");
+        ASSERT_TRUE(b.data != NULL);
+        EXPECT_EQ(time, b.timestamp);
+        checkBayerRawBuffer(b);
+
+        // Every thread got a different frame.
+        for (int j = 0; j < i; j++) {
+            EXPECT_NE(threads[j]->mBuffer.frameNumber, b.frameNumber);
+        }
+    }
+
+    for (int i = 0; i < params.maxLockedBuffers; i++) {
+        err = mCC->unlockBuffer(threads[i]->mBuffer);
+        ASSERT_NO_ERROR(err, "Could not unlock buffer: ");
+    }
+}
+
+// Fills a YV12 or YCrCb_420_SP locked buffer description with one color.
+static void makeYuv420Buffer(CpuConsumer::LockedBuffer* b, Vector<uint8_t>* mem,
+        PixelFormat format, uint32_t w, uint32_t h,
+        uint8_t y, uint8_t cb, uint8_t cr) {
+    b->width = w;
+    b->height = h;
+    b->format = format;
+    b->stride = (w + 15) & ~15;
+    const uint32_t cstride = format == HAL_PIXEL_FORMAT_YV12 ?
+            ((b->stride / 2) + 15) & ~15 : b->stride;
+    mem->clear();
+    mem->insertAt(uint8_t(0), 0, b->stride * h + cstride * h);
+    b->data = mem->editArray();
+    memset(b->data, y, b->stride * h);
+    b->dataCr = b->data + b->stride * h;
+    b->chromaStride = cstride;
+    if (format == HAL_PIXEL_FORMAT_YV12) {
+        b->chromaStep = 1;
+        b->dataCb = b->dataCr + cstride * (h / 2);
+    } else {
+        b->chromaStep = 2;
+        b->dataCb = b->dataCr + 1;
+    }
+    for (uint32_t row = 0; row < h / 2; row++) {
+        for (uint32_t x = 0; x < w / 2; x++) {
+            b->dataCb[row * cstride + x * b->chromaStep] = cb;
+            b->dataCr[row * cstride + x * b->chromaStep] = cr;
+        }
+    }
+}
+
+TEST(CpuConsumerConversionTest, Yuv420ToRgba8888) {
+    struct {
+        uint8_t y, cb, cr;
+        uint8_t r, g, b;
+    } colors[] = {
+        {  16, 128, 128,   0,   0,   0 },
+        { 235, 128, 128, 255, 255, 255 },
+        {  81,  90, 240, 255,   0,   0 },
+        { 145,  54,  34,   0, 255,   0 },
+        {  41, 240, 110,   0,   0, 255 },
+    };
+    const PixelFormat formats[] = {
+        HAL_PIXEL_FORMAT_YV12, HAL_PIXEL_FORMAT_YCrCb_420_SP
+    };
+
+    // odd number of 16 pixel blocks plus a remainder, so that both the
+    // vector and the scalar code run
+    const uint32_t w = 50, h = 4;
+    Vector<uint8_t> mem;
+    Vector<uint8_t> rgba;
+    rgba.insertAt(uint8_t(0), 0, w * h * 4);
+
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        for (size_t i = 0; i < sizeof(colors) / sizeof(colors[0]); i++) {
+            CpuConsumer::LockedBuffer b;
+            makeYuv420Buffer(&b, &mem, formats[f], w, h,
+                    colors[i].y, colors[i].cb, colors[i].cr);
+            ASSERT_EQ(OK, CpuConsumer::convertToRgba8888(b, rgba.editArray(), w));
+            for (uint32_t p = 0; p < w * h; p++) {
+                const uint8_t* px = rgba.array() + p * 4;
+                ASSERT_NEAR(colors[i].r, px[0], 4) << "pixel " << p;
+                ASSERT_NEAR(colors[i].g, px[1], 4) << "pixel " << p;
+                ASSERT_NEAR(colors[i].b, px[2], 4) << "pixel " << p;
+                ASSERT_EQ(0xff, px[3]) << "pixel " << p;
+            }
+        }
+    }
+
+    CpuConsumer::LockedBuffer b;
+    makeYuv420Buffer(&b, &mem, HAL_PIXEL_FORMAT_YV12, w, h, 16, 128, 128);
+    b.dataCb = b.dataCr = NULL;
+    EXPECT_EQ(BAD_VALUE, CpuConsumer::convertToRgba8888(b, rgba.editArray(), w));
+}
+
 CpuConsumerTestParams rawTestSets[] = {
     { 512,   512, 1, HAL_PIXEL_FORMAT_RAW_SENSOR},
     { 512,   512, 3, HAL_PIXEL_FORMAT_RAW_SENSOR},
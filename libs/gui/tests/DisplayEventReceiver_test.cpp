@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2013 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "DisplayEventReceiver_test"
+//#define LOG_NDEBUG 0
+
+#include <gtest/gtest.h>
+
+#include <gui/DisplayEventReceiver.h>
+#include <utils/Looper.h>
+
+namespace android {
+
+class VsyncCounter : public DisplayEventReceiver::EventListener {
+public:
+    VsyncCounter() : mVsyncs(0), mBroken(false) { }
+
+    virtual void onDisplayEvents(DisplayEventReceiver::Event const* events,
+            size_t count) {
+        if (count == 0) {
+            mBroken = true;
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (events[i].header.type ==
+                    DisplayEventReceiver::DISPLAY_EVENT_VSYNC) {
+                mVsyncs++;
+            }
+        }
+    }
+
+    int mVsyncs;
+    bool mBroken;
+};
+
+TEST(DisplayEventReceiverTest, TwoReceiversShareOneLooper) {
+    DisplayEventReceiver first, second;
+    ASSERT_EQ(NO_ERROR, first.initCheck());
+    ASSERT_EQ(NO_ERROR, second.initCheck());
+
+    sp<Looper> looper(new Looper(false));
+    sp<VsyncCounter> firstCounter(new VsyncCounter);
+    sp<VsyncCounter> secondCounter(new VsyncCounter);
+    ASSERT_EQ(NO_ERROR, first.attachLooper(looper, firstCounter));
+    ASSERT_EQ(NO_ERROR, second.attachLooper(looper, secondCounter));
+    EXPECT_EQ(INVALID_OPERATION, first.attachLooper(looper, firstCounter));
+
+    ASSERT_EQ(NO_ERROR, first.setVsyncRate(1));
+    ASSERT_EQ(NO_ERROR, second.setVsyncRate(1));
+    for (int i = 0; i < 100; i++) {
+        if (firstCounter->mVsyncs && secondCounter->mVsyncs) {
+            break;
+        }
+        looper->pollOnce(100);
+    }
+    EXPECT_LT(0, firstCounter->mVsyncs);
+    EXPECT_LT(0, secondCounter->mVsyncs);
+    EXPECT_FALSE(firstCounter->mBroken);
+
+    // nothing is delivered once detached
+    ASSERT_EQ(NO_ERROR, first.detachLooper());
+    const int vsyncs = firstCounter->mVsyncs;
+    for (int i = 0; i < 5; i++) {
+        looper->pollOnce(100);
+    }
+    EXPECT_EQ(vsyncs, firstCounter->mVsyncs);
+    EXPECT_LT(1, secondCounter->mVsyncs);
+}
+
+} // namespace android
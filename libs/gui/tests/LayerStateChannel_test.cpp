@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "LayerStateChannel_test"
+//#define LOG_NDEBUG 0
+
+#include <gtest/gtest.h>
+
+#include <private/gui/LayerStateChannel.h>
+
+namespace android {
+
+static bool writeWords(const sp<LayerStateChannel>& channel,
+        size_t count, uint32_t first, bool* wake) {
+    uint32_t* words = channel->beginWrite(count);
+    if (words == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        words[i] = first + i;
+    }
+    channel->endWrite(wake);
+    return true;
+}
+
+TEST(LayerStateChannelTest, DoorbellIsRungOncePerDrain) {
+    sp<LayerStateChannel> server(new LayerStateChannel(256));
+    ASSERT_EQ(NO_ERROR, server->initCheck());
+    sp<LayerStateChannel> client(new LayerStateChannel(server->getHeap()));
+    ASSERT_EQ(NO_ERROR, client->initCheck());
+
+    bool wake;
+    ASSERT_TRUE(writeWords(client, 3, 10, &wake));
+    EXPECT_TRUE(wake);
+    ASSERT_TRUE(writeWords(client, 2, 20, &wake));
+    EXPECT_FALSE(wake);
+    EXPECT_FALSE(client->isEmpty());
+
+    server->clearSignaled();
+    size_t count;
+    uint32_t const* words = server->read(&count);
+    ASSERT_TRUE(words != NULL);
+    ASSERT_EQ(3U, count);
+    EXPECT_EQ(12U, words[2]);
+    words = server->read(&count);
+    ASSERT_TRUE(words != NULL);
+    ASSERT_EQ(2U, count);
+    EXPECT_EQ(20U, words[0]);
+    EXPECT_TRUE(server->read(&count) == NULL);
+    EXPECT_TRUE(client->isEmpty());
+
+    ASSERT_TRUE(writeWords(client, 1, 30, &wake));
+    EXPECT_TRUE(wake);
+}
+
+TEST(LayerStateChannelTest, TransactionsDontWrapAround) {
+    // 64 words
+    sp<LayerStateChannel> server(new LayerStateChannel(256));
+    sp<LayerStateChannel> client(new LayerStateChannel(server->getHeap()));
+    ASSERT_EQ(NO_ERROR, client->initCheck());
+
+    bool wake;
+    size_t count;
+    for (uint32_t i = 0; i < 10; i++) {
+        ASSERT_TRUE(writeWords(client, 20, i * 100, &wake));
+        uint32_t const* words = server->read(&count);
+        ASSERT_TRUE(words != NULL);
+        ASSERT_EQ(20U, count);
+        for (size_t j = 0; j < count; j++) {
+            ASSERT_EQ(i * 100 + j, words[j]);
+        }
+    }
+
+    // a full ring refuses the transaction instead of overwriting
+    ASSERT_TRUE(writeWords(client, 40, 0, &wake));
+    EXPECT_FALSE(writeWords(client, 40, 0, &wake));
+    EXPECT_FALSE(writeWords(client, 64, 0, &wake));
+}
+
+} // namespace android
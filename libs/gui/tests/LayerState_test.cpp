@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "LayerState_test"
+//#define LOG_NDEBUG 0
+
+#include <gtest/gtest.h>
+
+#include <private/gui/LayerState.h>
+
+namespace android {
+
+TEST(LayerStateTest, CompactStateRoundTrips) {
+    layer_state_t s;
+    s.surface = 7;
+    s.what = layer_state_t::ePositionChanged |
+            layer_state_t::eAlphaChanged |
+            layer_state_t::eVisibilityChanged |
+            layer_state_t::eCropChanged |
+            layer_state_t::eTransparentRegionChanged;
+    s.x = 12.5f;
+    s.y = -3.0f;
+    s.alpha = 0.25f;
+    s.flags = layer_state_t::eLayerHidden;
+    s.mask = layer_state_t::eLayerHidden;
+    s.crop = Rect(1, 2, 30, 40);
+    s.transparentRegion.orSelf(Rect(0, 0, 10, 10));
+    s.transparentRegion.orSelf(Rect(20, 20, 30, 30));
+
+    // fields that aren't selected by 'what' aren't sent
+    s.z = 99;
+
+    const size_t size = s.getCompactSize();
+    ASSERT_EQ(0U, size % sizeof(uint32_t));
+    uint32_t buffer[64];
+    ASSERT_GE(sizeof(buffer), size);
+    uint32_t const* const end = buffer + size / sizeof(uint32_t);
+
+    uint32_t* out = buffer;
+    s.writeCompact(out);
+    EXPECT_EQ(end, out);
+
+    layer_state_t r;
+    uint32_t const* in = buffer;
+    ASSERT_EQ(NO_ERROR, r.readCompact(in, end));
+    EXPECT_EQ(end, in);
+
+    EXPECT_EQ(s.surface, r.surface);
+    EXPECT_EQ(s.what, r.what);
+    EXPECT_EQ(s.x, r.x);
+    EXPECT_EQ(s.y, r.y);
+    EXPECT_EQ(s.alpha, r.alpha);
+    EXPECT_EQ(s.flags, r.flags);
+    EXPECT_EQ(s.mask, r.mask);
+    EXPECT_TRUE(s.crop == r.crop);
+    EXPECT_TRUE(s.transparentRegion.subtract(r.transparentRegion).isEmpty());
+    EXPECT_TRUE(r.transparentRegion.subtract(s.transparentRegion).isEmpty());
+    EXPECT_EQ(0U, r.z);
+}
+
+TEST(LayerStateTest, TruncatedCompactStateIsRejected) {
+    layer_state_t s;
+    s.surface = 3;
+    s.what = layer_state_t::eMatrixChanged | layer_state_t::eSizeChanged;
+
+    uint32_t buffer[64];
+    ASSERT_GE(sizeof(buffer), s.getCompactSize());
+    uint32_t* out = buffer;
+    s.writeCompact(out);
+
+    layer_state_t r;
+    uint32_t const* in = buffer;
+    EXPECT_EQ(BAD_VALUE, r.readCompact(in, out - 1));
+}
+
+} // namespace android
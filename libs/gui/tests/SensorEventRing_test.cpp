@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#define LOG_TAG "SensorEventRing_test"
+//#define LOG_NDEBUG 0
+
+#include <gtest/gtest.h>
+
+#include <gui/SensorEventRing.h>
+
+#include <android/sensor.h>
+
+namespace android {
+
+static void fillEvents(ASensorEvent* events, size_t count, int64_t first) {
+    memset(events, 0, count * sizeof(ASensorEvent));
+    for (size_t i = 0; i < count; i++) {
+        events[i].timestamp = first + i;
+    }
+}
+
+TEST(SensorEventRingTest, CapacityIsRoundedUpToPowerOfTwo) {
+    sp<SensorEventRing> ring(new SensorEventRing(100));
+    ASSERT_EQ(NO_ERROR, ring->initCheck());
+    EXPECT_EQ(128U, ring->getCapacity());
+
+    sp<SensorEventRing> client(new SensorEventRing(ring->getHeap()));
+    ASSERT_EQ(NO_ERROR, client->initCheck());
+    EXPECT_EQ(128U, client->getCapacity());
+}
+
+TEST(SensorEventRingTest, EventsWrapAroundInOrder) {
+    sp<SensorEventRing> ring(new SensorEventRing(8));
+    sp<SensorEventRing> client(new SensorEventRing(ring->getHeap()));
+    ASSERT_EQ(NO_ERROR, client->initCheck());
+
+    ASensorEvent in[6], out[8];
+    bool wake;
+    int64_t next = 0;
+    for (int pass = 0; pass < 4; pass++) {
+        fillEvents(in, 6, next);
+        ASSERT_EQ(6U, ring->write(in, 6, &wake));
+        EXPECT_FALSE(wake);
+        ASSERT_EQ(6U, client->read(out, 8));
+        for (size_t i = 0; i < 6; i++) {
+            EXPECT_EQ(next + int64_t(i), out[i].timestamp);
+        }
+        next += 6;
+    }
+    EXPECT_EQ(0U, client->read(out, 8));
+    EXPECT_EQ(0U, ring->getDroppedCount());
+}
+
+TEST(SensorEventRingTest, FullRingDropsNewEvents) {
+    sp<SensorEventRing> ring(new SensorEventRing(4));
+    sp<SensorEventRing> client(new SensorEventRing(ring->getHeap()));
+    ASSERT_EQ(NO_ERROR, client->initCheck());
+
+    ASensorEvent in[6], out[6];
+    bool wake;
+    fillEvents(in, 6, 0);
+    ASSERT_EQ(4U, ring->write(in, 6, &wake));
+    EXPECT_EQ(2U, ring->getDroppedCount());
+    ASSERT_EQ(4U, client->read(out, 6));
+    EXPECT_EQ(3, out[3].timestamp);
+}
+
+TEST(SensorEventRingTest, UnreadCountFollowsTheConsumer) {
+    sp<SensorEventRing> ring(new SensorEventRing(8));
+    sp<SensorEventRing> client(new SensorEventRing(ring->getHeap()));
+    ASSERT_EQ(NO_ERROR, client->initCheck());
+
+    ASensorEvent in[5], out[3];
+    bool wake;
+    EXPECT_EQ(0U, ring->getUnreadCount());
+    fillEvents(in, 5, 0);
+    ASSERT_EQ(5U, ring->write(in, 5, &wake));
+    EXPECT_EQ(5U, ring->getUnreadCount());
+    ASSERT_EQ(3U, client->read(out, 3));
+    EXPECT_EQ(2U, ring->getUnreadCount());
+}
+
+TEST(SensorEventRingTest, WaitingClientIsWokenOnce) {
+    sp<SensorEventRing> ring(new SensorEventRing(4));
+    sp<SensorEventRing> client(new SensorEventRing(ring->getHeap()));
+    ASSERT_EQ(NO_ERROR, client->initCheck());
+
+    ASensorEvent in[1], out[4];
+    bool wake;
+    fillEvents(in, 1, 0);
+    client->setWaiting();
+    ASSERT_EQ(1U, ring->write(in, 1, &wake));
+    EXPECT_TRUE(wake);
+    ASSERT_EQ(1U, ring->write(in, 1, &wake));
+    EXPECT_FALSE(wake);
+    EXPECT_EQ(2U, client->read(out, 4));
+}
+
+} // namespace android
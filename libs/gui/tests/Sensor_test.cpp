@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "Sensor_test"
+//#define LOG_NDEBUG 0
+
+#include <gtest/gtest.h>
+
+#include <hardware/sensors.h>
+
+#include <gui/Sensor.h>
+
+namespace android {
+
+static sensor_t makeHwSensor(const char* name, const char* vendor) {
+    sensor_t hw;
+    memset(&hw, 0, sizeof(hw));
+    hw.name = name;
+    hw.vendor = vendor;
+    hw.version = 3;
+    hw.handle = 42;
+    hw.type = Sensor::TYPE_GYROSCOPE;
+    hw.maxRange = 34.9f;
+    hw.resolution = 0.001f;
+    hw.power = 6.1f;
+    hw.minDelay = 5000;
+    return hw;
+}
+
+TEST(SensorTest, FlattenedSensorsReadBackTheSame) {
+    sensor_t hw(makeHwSensor("Gyroscope", "ACME"));
+    Sensor in(&hw);
+    uint8_t buffer[256];
+    ASSERT_LE(in.getSize(), sizeof(buffer));
+    ASSERT_EQ(0U, in.getSize() % 4);
+    ASSERT_EQ(NO_ERROR, in.flatten(buffer));
+
+    Sensor out;
+    ASSERT_EQ(NO_ERROR, out.unflatten(buffer, in.getSize()));
+    EXPECT_STREQ("Gyroscope", out.getName().string());
+    EXPECT_STREQ("ACME", out.getVendor().string());
+    EXPECT_EQ(3, out.getVersion());
+    EXPECT_EQ(42, out.getHandle());
+    EXPECT_EQ(Sensor::TYPE_GYROSCOPE, out.getType());
+    EXPECT_EQ(34.9f, out.getMaxValue());
+    EXPECT_EQ(0.001f, out.getResolution());
+    EXPECT_EQ(6.1f, out.getPowerUsage());
+    EXPECT_EQ(5000, out.getMinDelay());
+}
+
+TEST(SensorTest, TruncatedSensorsAreRejected) {
+    sensor_t hw(makeHwSensor("Light", "ACME"));
+    Sensor in(&hw);
+    uint8_t buffer[256];
+    ASSERT_EQ(NO_ERROR, in.flatten(buffer));
+
+    Sensor out;
+    // the strings are 9 bytes, padded to 12
+    EXPECT_EQ(NO_MEMORY, out.unflatten(buffer, in.getSize() - 4));
+    EXPECT_EQ(NO_MEMORY, out.unflatten(buffer, 8));
+    EXPECT_EQ(NO_ERROR, out.unflatten(buffer, in.getSize() - 3));
+    EXPECT_STREQ("ACME", out.getVendor().string());
+}
+
+} // namespace android
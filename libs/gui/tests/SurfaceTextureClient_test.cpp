@@ -393,6 +393,24 @@ TEST_F(SurfaceTextureClientTest, SurfaceTextureSyncModeDQQR) {
     EXPECT_EQ(mST->getCurrentBuffer().get(), buf[2]);
 }
 
+TEST_F(SurfaceTextureClientTest, SurfaceTextureSyncModeDequeueAhead) {
+    android_native_buffer_t* buf;
+    ASSERT_EQ(OK, mST->setSynchronousMode(true));
+    ASSERT_EQ(OK, native_window_set_buffer_count(mANW.get(), 3));
+    ASSERT_EQ(OK, mSTC->setDequeueAhead(true));
+
+    for (int i = 0; i < 10; i++) {
+        ASSERT_EQ(OK, native_window_dequeue_buffer_and_wait(mANW.get(), &buf));
+        ASSERT_EQ(OK, mANW->queueBuffer(mANW.get(), buf, -1));
+        EXPECT_EQ(OK, mST->updateTexImage());
+        EXPECT_EQ(mST->getCurrentBuffer().get(), buf);
+    }
+
+    // nothing is left dequeued, or the count couldn't change
+    ASSERT_EQ(OK, mSTC->setDequeueAhead(false));
+    EXPECT_EQ(OK, native_window_set_buffer_count(mANW.get(), 4));
+}
+
 // XXX: We currently have no hardware that properly handles dequeuing the
 // buffer that is currently bound to the texture.
 TEST_F(SurfaceTextureClientTest, DISABLED_SurfaceTextureSyncModeDequeueCurrent) {
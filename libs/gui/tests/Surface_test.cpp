@@ -17,10 +17,14 @@
 #include <gtest/gtest.h>
 
 #include <binder/IMemory.h>
+#include <gui/IScreenCaptureListener.h>
 #include <gui/ISurfaceComposer.h>
+#include <gui/ITransactionCompletedListener.h>
 #include <gui/Surface.h>
 #include <gui/SurfaceComposerClient.h>
+#include <ui/GraphicBuffer.h>
 #include <utils/String8.h>
+#include <utils/threads.h>
 
 #include <private/gui/ComposerService.h>
 
@@ -123,6 +127,101 @@ TEST_F(SurfaceTest, ScreenshotsOfProtectedBuffersSucceed) {
     ASSERT_TRUE(heap != NULL);
 }
 
+TEST_F(SurfaceTest, ScreenshotToBufferHasRequestedSize) {
+    sp<GraphicBuffer> buffer;
+    sp<ISurfaceComposer> sf(ComposerService::getComposerService());
+    sp<IBinder> display(sf->getBuiltInDisplay(ISurfaceComposer::eDisplayIdMain));
+    ASSERT_EQ(NO_ERROR, sf->captureScreenToBuffer(display, &buffer, 64, 64,
+            0, 0x7fffffff));
+    ASSERT_TRUE(buffer != NULL);
+    EXPECT_EQ(64U, buffer->getWidth());
+    EXPECT_EQ(64U, buffer->getHeight());
+    EXPECT_EQ(PIXEL_FORMAT_RGBA_8888, buffer->getPixelFormat());
+}
+
+class CaptureListener : public BnScreenCaptureListener {
+public:
+    CaptureListener() : mCaptured(false), mResult(NO_INIT) {}
+
+    virtual void onScreenCaptured(status_t result,
+            const sp<GraphicBuffer>& buffer, const sp<Fence>& fence) {
+        Mutex::Autolock lock(mMutex);
+        mResult = result;
+        mBuffer = buffer;
+        mFence = fence;
+        mCaptured = true;
+        mCondition.signal();
+    }
+
+    status_t waitForCapture(nsecs_t timeout) {
+        Mutex::Autolock lock(mMutex);
+        while (!mCaptured) {
+            if (mCondition.waitRelative(mMutex, timeout) == TIMED_OUT) {
+                return TIMED_OUT;
+            }
+        }
+        return mResult;
+    }
+
+    Mutex mMutex;
+    Condition mCondition;
+    bool mCaptured;
+    status_t mResult;
+    sp<GraphicBuffer> mBuffer;
+    sp<Fence> mFence;
+};
+
+TEST_F(SurfaceTest, AsyncScreenshotOfCropHasRequestedSize) {
+    sp<ISurfaceComposer> sf(ComposerService::getComposerService());
+    sp<IBinder> display(sf->getBuiltInDisplay(ISurfaceComposer::eDisplayIdMain));
+    sp<CaptureListener> listener(new CaptureListener);
+    ASSERT_EQ(NO_ERROR, sf->captureScreenAsync(display, listener,
+            Rect(0, 0, 64, 64), 32, 32, PIXEL_FORMAT_RGBA_8888, 0, 0x7fffffff));
+    ASSERT_EQ(NO_ERROR, listener->waitForCapture(ms2ns(1000)));
+    ASSERT_TRUE(listener->mBuffer != NULL);
+    EXPECT_EQ(32U, listener->mBuffer->getWidth());
+    EXPECT_EQ(32U, listener->mBuffer->getHeight());
+    ASSERT_TRUE(listener->mFence != NULL);
+    EXPECT_EQ(NO_ERROR, listener->mFence->wait(1000));
+}
+
+class TransactionListener : public BnTransactionCompletedListener {
+public:
+    TransactionListener() : mCompleted(false) {}
+
+    virtual void onTransactionCompleted(const sp<Fence>& fence) {
+        Mutex::Autolock lock(mMutex);
+        mFence = fence;
+        mCompleted = true;
+        mCondition.signal();
+    }
+
+    status_t waitForCompletion(nsecs_t timeout) {
+        Mutex::Autolock lock(mMutex);
+        while (!mCompleted) {
+            if (mCondition.waitRelative(mMutex, timeout) == TIMED_OUT) {
+                return TIMED_OUT;
+            }
+        }
+        return NO_ERROR;
+    }
+
+    Mutex mMutex;
+    Condition mCondition;
+    bool mCompleted;
+    sp<Fence> mFence;
+};
+
+TEST_F(SurfaceTest, AsyncTransactionCompletes) {
+    sp<TransactionListener> listener(new TransactionListener);
+    SurfaceComposerClient::openGlobalTransaction();
+    ASSERT_EQ(NO_ERROR, mSurfaceControl->setPosition(16, 16));
+    SurfaceComposerClient::closeGlobalTransactionAsync(listener);
+    ASSERT_EQ(NO_ERROR, listener->waitForCompletion(ms2ns(1000)));
+    ASSERT_TRUE(listener->mFence != NULL);
+    EXPECT_EQ(NO_ERROR, listener->mFence->wait(1000));
+}
+
 TEST_F(SurfaceTest, ConcreteTypeIsSurface) {
     sp<ANativeWindow> anw(mSurface);
     int result = -123;
@@ -131,4 +230,30 @@ TEST_F(SurfaceTest, ConcreteTypeIsSurface) {
     EXPECT_EQ(NATIVE_WINDOW_SURFACE, result);
 }
 
+TEST_F(SurfaceTest, GraphicMemoryUsageIncludesTheLayersBuffers) {
+    sp<ANativeWindow> anw(mSurface);
+    ASSERT_EQ(NO_ERROR, native_window_api_connect(anw.get(),
+            NATIVE_WINDOW_API_CPU));
+    ANativeWindowBuffer* buf = 0;
+    ASSERT_EQ(NO_ERROR, native_window_dequeue_buffer_and_wait(anw.get(), &buf));
+    ASSERT_EQ(NO_ERROR, anw->queueBuffer(anw.get(), buf, -1));
+
+    sp<ISurfaceComposer> sf(ComposerService::getComposerService());
+    Vector<GraphicMemoryUsage> usage;
+    ASSERT_EQ(NO_ERROR, sf->getGraphicMemoryUsage(&usage));
+    const GraphicMemoryUsage* layer = NULL;
+    for (size_t i = 0; i < usage.size(); i++) {
+        if (usage[i].name == String8("Test Surface")) {
+            layer = &usage[i];
+        }
+    }
+    ASSERT_TRUE(layer != NULL);
+    EXPECT_EQ(getpid(), layer->pid);
+    EXPECT_LE(1U, layer->count);
+    EXPECT_LE(uint64_t(32 * 32 * 4), layer->bytes);
+
+    ASSERT_EQ(NO_ERROR, native_window_api_disconnect(anw.get(),
+            NATIVE_WINDOW_API_CPU));
+}
+
 }
@@ -0,0 +1,19 @@
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	throughput.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libEGL \
+	libGLESv2 \
+	libcutils \
+	libgui \
+	libui \
+	libutils
+
+LOCAL_MODULE:= test-gui-throughput
+
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
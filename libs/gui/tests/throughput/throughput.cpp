@@ -0,0 +1,434 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "GuiThroughput"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+
+#include <gui/BufferItemConsumer.h>
+#include <gui/CpuConsumer.h>
+#include <gui/SurfaceTexture.h>
+#include <gui/SurfaceTextureClient.h>
+
+#include <ui/GraphicBuffer.h>
+
+#include <utils/Log.h>
+#include <utils/Thread.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+using namespace android;
+
+// ---------------------------------------------------------------------------
+
+/*
+ * Measures the producer -> BufferQueue -> consumer path end to end: a
+ * SurfaceTextureClient producer queues frames as fast as it can to a
+ * CpuConsumer, a BufferItemConsumer or a SurfaceTexture consuming them on
+ * its own thread. Reports the frame rates, the time spent blocked in
+ * dequeueBuffer and the latency from queueBuffer to the consumer's acquire.
+ *
+ * The "poll" consumer is a BufferItemConsumer that calls acquireBuffer in a
+ * loop instead of waiting for onFrameAvailable, so most of its calls find
+ * the queue empty while the producer is queueing.
+ */
+
+struct Options {
+    const char* consumer;   // "cpu", "item", "poll", "texture" or NULL for all
+    int bufferCount;
+    uint32_t width;
+    uint32_t height;
+    bool async;
+    bool fill;              // lock and write each frame with the CPU
+    int frames;
+};
+
+static int compareNsecs(const nsecs_t* lhs, const nsecs_t* rhs)
+{
+    return (*lhs > *rhs) - (*lhs < *rhs);
+}
+
+// returns the percentile (0-100) of sorted samples, in microseconds
+static double percentile(const Vector<nsecs_t>& samples, int p)
+{
+    if (samples.isEmpty()) {
+        return 0;
+    }
+    size_t i = (samples.size() * p) / 100;
+    if (i >= samples.size()) {
+        i = samples.size() - 1;
+    }
+    return samples[i] / 1000.0;
+}
+
+// ---------------------------------------------------------------------------
+
+class Consumer : public Thread, public ConsumerBase::FrameAvailableListener
+{
+public:
+    Consumer() : Thread(false), polls(0), mPending(0), mDone(false) { }
+
+    virtual const char* getName() const = 0;
+    virtual sp<ISurfaceTexture> getProducerInterface() const = 0;
+    virtual void setListener() = 0;
+
+    // called by the producer once it has queued its last frame
+    void finish() {
+        Mutex::Autolock _l(mLock);
+        mDone = true;
+        mCondition.signal();
+    }
+
+    Vector<nsecs_t> latencies;
+    int polls;              // acquires attempted by a polling consumer
+
+protected:
+    // acquires and releases the next frame, returns false if there was none
+    virtual bool consume(nsecs_t* outTimestamp) = 0;
+
+    bool isFinished() {
+        Mutex::Autolock _l(mLock);
+        return mDone;
+    }
+
+private:
+    virtual void onFrameAvailable() {
+        Mutex::Autolock _l(mLock);
+        mPending++;
+        mCondition.signal();
+    }
+
+    virtual bool threadLoop() {
+        for (;;) {
+            {
+                Mutex::Autolock _l(mLock);
+                while (!mPending && !mDone) {
+                    mCondition.wait(mLock);
+                }
+                if (!mPending) {
+                    return false;
+                }
+                mPending--;
+            }
+            // in async mode a frame may have been replaced by the next one
+            nsecs_t timestamp;
+            if (consume(&timestamp)) {
+                latencies.add(systemTime() - timestamp);
+            }
+        }
+    }
+
+    Mutex mLock;
+    Condition mCondition;
+    int mPending;
+    bool mDone;
+};
+
+class CpuConsumerThread : public Consumer
+{
+public:
+    CpuConsumerThread() : mConsumer(new CpuConsumer(1)) { }
+    virtual const char* getName() const { return "cpu"; }
+    virtual sp<ISurfaceTexture> getProducerInterface() const {
+        return mConsumer->getProducerInterface();
+    }
+    virtual void setListener() { mConsumer->setFrameAvailableListener(this); }
+protected:
+    virtual bool consume(nsecs_t* outTimestamp) {
+        CpuConsumer::LockedBuffer b;
+        if (mConsumer->lockNextBuffer(&b) != NO_ERROR) {
+            return false;
+        }
+        *outTimestamp = b.timestamp;
+        mConsumer->unlockBuffer(b);
+        return true;
+    }
+private:
+    sp<CpuConsumer> mConsumer;
+};
+
+class BufferItemConsumerThread : public Consumer
+{
+public:
+    BufferItemConsumerThread(bool async)
+        : mConsumer(new BufferItemConsumer(GRALLOC_USAGE_HW_TEXTURE, 1, !async)) { }
+    virtual const char* getName() const { return "item"; }
+    virtual sp<ISurfaceTexture> getProducerInterface() const {
+        return mConsumer->getProducerInterface();
+    }
+    virtual void setListener() { mConsumer->setFrameAvailableListener(this); }
+protected:
+    virtual bool consume(nsecs_t* outTimestamp) {
+        BufferItemConsumer::BufferItem item;
+        if (mConsumer->acquireBuffer(&item) != NO_ERROR) {
+            return false;
+        }
+        *outTimestamp = item.mTimestamp;
+        mConsumer->releaseBuffer(item);
+        return true;
+    }
+private:
+    sp<BufferItemConsumer> mConsumer;
+};
+
+// Never waits: acquires until a poll comes back empty after the producer
+// has queued its last frame.
+class PollingConsumerThread : public BufferItemConsumerThread
+{
+public:
+    PollingConsumerThread(bool async) : BufferItemConsumerThread(async) { }
+    virtual const char* getName() const { return "poll"; }
+    virtual void setListener() { }
+private:
+    virtual bool threadLoop() {
+        for (;;) {
+            // read before polling, so an empty poll after it means drained
+            const bool done = isFinished();
+            nsecs_t timestamp;
+            polls++;
+            if (consume(&timestamp)) {
+                latencies.add(systemTime() - timestamp);
+            } else if (done) {
+                return false;
+            }
+        }
+    }
+};
+
+// updateTexImage() needs a GL context, made current on the consumer thread.
+// Buffers are released with the fence of the GL commands that read them.
+class SurfaceTextureThread : public Consumer
+{
+public:
+    SurfaceTextureThread()
+        : mSurfaceTexture(new SurfaceTexture(TEX_ID)),
+          mDisplay(EGL_NO_DISPLAY), mSurface(EGL_NO_SURFACE),
+          mContext(EGL_NO_CONTEXT) { }
+    virtual ~SurfaceTextureThread() {
+        if (mDisplay != EGL_NO_DISPLAY) {
+            eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            eglDestroyContext(mDisplay, mContext);
+            eglDestroySurface(mDisplay, mSurface);
+            eglTerminate(mDisplay);
+        }
+    }
+    virtual const char* getName() const { return "texture"; }
+    virtual sp<ISurfaceTexture> getProducerInterface() const {
+        return mSurfaceTexture->getBufferQueue();
+    }
+    virtual void setListener() { mSurfaceTexture->setFrameAvailableListener(this); }
+protected:
+    virtual status_t readyToRun() {
+        static const EGLint configAttribs[] = {
+                EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+                EGL_NONE };
+        static const EGLint surfaceAttribs[] = {
+                EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+        static const EGLint contextAttribs[] = {
+                EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+        EGLConfig config;
+        EGLint numConfigs;
+        mDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        if (!eglInitialize(mDisplay, NULL, NULL) ||
+                !eglChooseConfig(mDisplay, configAttribs, &config, 1, &numConfigs) ||
+                numConfigs < 1) {
+            fprintf(stderr, "can't initialize EGL (%#x)\n", eglGetError());
+            return UNKNOWN_ERROR;
+        }
+        mSurface = eglCreatePbufferSurface(mDisplay, config, surfaceAttribs);
+        mContext = eglCreateContext(mDisplay, config, EGL_NO_CONTEXT, contextAttribs);
+        if (!eglMakeCurrent(mDisplay, mSurface, mSurface, mContext)) {
+            fprintf(stderr, "can't make the GL context current (%#x)\n",
+                    eglGetError());
+            return UNKNOWN_ERROR;
+        }
+        return NO_ERROR;
+    }
+    virtual bool consume(nsecs_t* outTimestamp) {
+        if (mSurfaceTexture->updateTexImage() != NO_ERROR) {
+            return false;
+        }
+        *outTimestamp = mSurfaceTexture->getTimestamp();
+        return true;
+    }
+private:
+    enum { TEX_ID = 123 };
+    sp<SurfaceTexture> mSurfaceTexture;
+    EGLDisplay mDisplay;
+    EGLSurface mSurface;
+    EGLContext mContext;
+};
+
+// ---------------------------------------------------------------------------
+
+static sp<Consumer> createConsumer(const char* name, const Options& options)
+{
+    if (!strcmp(name, "cpu")) {
+        return new CpuConsumerThread();
+    } else if (!strcmp(name, "item")) {
+        return new BufferItemConsumerThread(options.async);
+    } else if (!strcmp(name, "poll")) {
+        return new PollingConsumerThread(options.async);
+    } else if (!strcmp(name, "texture")) {
+        return new SurfaceTextureThread();
+    }
+    return NULL;
+}
+
+static int run(const char* name, const Options& options)
+{
+    sp<Consumer> consumer(createConsumer(name, options));
+    if (consumer == NULL) {
+        fprintf(stderr, "unknown consumer: %s\n", name);
+        return 1;
+    }
+    consumer->setListener();
+
+    sp<SurfaceTextureClient> stc(new SurfaceTextureClient(
+            consumer->getProducerInterface()));
+    ANativeWindow* anw = stc.get();
+    if (native_window_api_connect(anw, NATIVE_WINDOW_API_CPU) != NO_ERROR) {
+        fprintf(stderr, "%s: can't connect to the queue\n", name);
+        return 1;
+    }
+    native_window_set_buffers_dimensions(anw, options.width, options.height);
+    native_window_set_buffers_format(anw, HAL_PIXEL_FORMAT_RGBA_8888);
+    native_window_set_usage(anw, options.fill ? GRALLOC_USAGE_SW_WRITE_OFTEN : 0);
+    if (native_window_set_buffer_count(anw, options.bufferCount) != NO_ERROR) {
+        fprintf(stderr, "%s: can't use %d buffers\n", name, options.bufferCount);
+        return 1;
+    }
+    anw->setSwapInterval(anw, options.async ? 0 : 1);
+
+    if (consumer->run(consumer->getName()) != NO_ERROR) {
+        return 1;
+    }
+
+    Vector<nsecs_t> dequeueTimes;
+    dequeueTimes.setCapacity(options.frames);
+    const nsecs_t start = systemTime();
+    int queued = 0;
+    for ( ; queued < options.frames ; queued++) {
+        const nsecs_t before = systemTime();
+        ANativeWindowBuffer* anb;
+        if (native_window_dequeue_buffer_and_wait(anw, &anb) != NO_ERROR) {
+            break;
+        }
+        dequeueTimes.add(systemTime() - before);
+        if (options.fill) {
+            sp<GraphicBuffer> buffer(new GraphicBuffer(anb, false));
+            uint8_t* bits;
+            if (buffer->lock(GRALLOC_USAGE_SW_WRITE_OFTEN,
+                    reinterpret_cast<void**>(&bits)) != NO_ERROR) {
+                anw->cancelBuffer(anw, anb, -1);
+                break;
+            }
+            const size_t bpr = buffer->getStride() * 4;
+            for (uint32_t y=0 ; y<buffer->getHeight() ; y++) {
+                memset(bits + y * bpr, queued, buffer->getWidth() * 4);
+            }
+            buffer->unlock();
+        }
+        if (anw->queueBuffer(anw, anb, -1) != NO_ERROR) {
+            break;
+        }
+    }
+    const nsecs_t produced = systemTime() - start;
+    consumer->finish();
+    consumer->join();
+    const nsecs_t consumed = systemTime() - start;
+    native_window_api_disconnect(anw, NATIVE_WINDOW_API_CPU);
+
+    dequeueTimes.sort(compareNsecs);
+    consumer->latencies.sort(compareNsecs);
+    const size_t acquired = consumer->latencies.size();
+    printf("%-8s %d buffers %4ux%-4u %-5s: %7.1f fps queued, %7.1f fps acquired "
+            "(%d/%d frames)\n",
+            name, options.bufferCount, options.width, options.height,
+            options.async ? "async" : "sync",
+            queued * 1e9 / produced, acquired * 1e9 / consumed,
+            int(acquired), queued);
+    printf("%44s dequeue p50/p90/p99 %8.1f %8.1f %8.1f us\n", "",
+            percentile(dequeueTimes, 50), percentile(dequeueTimes, 90),
+            percentile(dequeueTimes, 99));
+    printf("%44s latency p50/p90/p99 %8.1f %8.1f %8.1f us\n", "",
+            percentile(consumer->latencies, 50),
+            percentile(consumer->latencies, 90),
+            percentile(consumer->latencies, 99));
+    if (consumer->polls) {
+        printf("%44s %d acquires attempted, %.1f per frame\n", "",
+                consumer->polls, acquired ? double(consumer->polls) / acquired : 0.0);
+    }
+    return queued == options.frames ? 0 : 1;
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+            "usage: %s [-c cpu|item|poll|texture] [-b buffers] [-w width]\n"
+            "       [-h height] [-n frames] [-a] [-f]\n"
+            "  -c  consumer to test, all of them by default\n"
+            "  -a  asynchronous mode (swap interval 0)\n"
+            "  -f  lock and fill each frame with the CPU\n", name);
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    options.consumer = NULL;
+    options.bufferCount = 3;
+    options.width = 720;
+    options.height = 1280;
+    options.async = false;
+    options.fill = false;
+    options.frames = 1000;
+
+    int c;
+    while ((c = getopt(argc, argv, "c:b:w:h:n:af")) != -1) {
+        switch (c) {
+            case 'c': options.consumer = optarg; break;
+            case 'b': options.bufferCount = atoi(optarg); break;
+            case 'w': options.width = atoi(optarg); break;
+            case 'h': options.height = atoi(optarg); break;
+            case 'n': options.frames = atoi(optarg); break;
+            case 'a': options.async = true; break;
+            case 'f': options.fill = true; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (options.bufferCount < 1 || options.frames < 1 ||
+            !options.width || !options.height) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (options.consumer) {
+        return run(options.consumer, options);
+    }
+    static const char* const consumers[] = { "cpu", "item", "poll", "texture" };
+    int result = 0;
+    for (size_t i=0 ; i<sizeof(consumers)/sizeof(*consumers) ; i++) {
+        result |= run(consumers[i], options);
+    }
+    return result;
+}
@@ -27,6 +27,8 @@
 namespace android {
 
 const sp<Fence> Fence::NO_FENCE = sp<Fence>();
+const nsecs_t Fence::SIGNAL_TIME_PENDING;
+const nsecs_t Fence::SIGNAL_TIME_INVALID;
 
 Fence::Fence() :
     mFenceFd(-1) {
@@ -65,9 +67,23 @@ status_t Fence::waitForever(unsigned int warningTimeout, const char* logname) {
     return err < 0 ? -errno : status_t(NO_ERROR);
 }
 
+bool Fence::isPending(const sp<Fence>& fence) {
+    if (fence == NULL || fence->mFenceFd == -1) {
+        return false;
+    }
+    // errors other than a timeout are left for the merge to report
+    return sync_wait(fence->mFenceFd, 0) < 0;
+}
+
 sp<Fence> Fence::merge(const String8& name, const sp<Fence>& f1,
         const sp<Fence>& f2) {
     ATRACE_CALL();
+    if (f1 == f2 || !isPending(f2)) {
+        return f1 != NULL ? f1 : f2;
+    }
+    if (!isPending(f1)) {
+        return f2;
+    }
     int result = sync_merge(name.string(), f1->mFenceFd, f2->mFenceFd);
     if (result == -1) {
         status_t err = -errno;
@@ -79,6 +95,76 @@ sp<Fence> Fence::merge(const String8& name, const sp<Fence>& f1,
     return sp<Fence>(new Fence(result));
 }
 
+sp<Fence> Fence::merge(const String8& name,
+        const Vector< sp<Fence> >& fences) {
+    ATRACE_CALL();
+    Vector< sp<Fence> > pending;
+    pending.setCapacity(fences.size());
+    for (size_t i=0 ; i<fences.size() ; i++) {
+        const sp<Fence>& fence(fences[i]);
+        if (isPending(fence) &&
+                (pending.isEmpty() || pending.top() != fence)) {
+            pending.push(fence);
+        }
+    }
+    if (pending.isEmpty()) {
+        // everything has signaled already
+        return new Fence();
+    }
+
+    // merge pairs of fences until a single one is left
+    while (pending.size() > 1) {
+        const size_t count = pending.size();
+        for (size_t i=0 ; i<count/2 ; i++) {
+            const sp<Fence>& f1(pending[2*i]);
+            const sp<Fence>& f2(pending[2*i+1]);
+            int result = sync_merge(name.string(), f1->mFenceFd, f2->mFenceFd);
+            if (result == -1) {
+                status_t err = -errno;
+                ALOGE("merge: sync_merge(\"%s\", %d, %d) returned an error: "
+                        "%s (%d)", name.string(), f1->mFenceFd, f2->mFenceFd,
+                        strerror(-err), err);
+                return NO_FENCE;
+            }
+            pending.editItemAt(i) = new Fence(result);
+        }
+        if (count & 1) {
+            pending.editItemAt(count/2) = pending[count-1];
+        }
+        pending.removeItemsAt((count+1)/2, count/2);
+    }
+    return pending[0];
+}
+
+nsecs_t Fence::getSignalTime() const {
+    if (mFenceFd == -1) {
+        return SIGNAL_TIME_INVALID;
+    }
+
+    struct sync_fence_info_data* finfo = sync_fence_info(mFenceFd);
+    if (finfo == NULL) {
+        ALOGE("getSignalTime: sync_fence_info returned NULL for fd %d",
+                mFenceFd);
+        return SIGNAL_TIME_INVALID;
+    }
+    if (finfo->status != 1) {
+        const int status = finfo->status;
+        sync_fence_info_free(finfo);
+        return status == 0 ? SIGNAL_TIME_PENDING : SIGNAL_TIME_INVALID;
+    }
+
+    uint64_t timestamp = 0;
+    struct sync_pt_info* pinfo = NULL;
+    while ((pinfo = sync_pt_info(finfo, pinfo)) != NULL) {
+        if (pinfo->timestamp_ns > timestamp) {
+            timestamp = pinfo->timestamp_ns;
+        }
+    }
+    sync_fence_info_free(finfo);
+
+    return nsecs_t(timestamp);
+}
+
 int Fence::dup() const {
     if (mFenceFd == -1) {
         return -1;
@@ -24,6 +24,7 @@
 
 #include <cutils/log.h>
 #include <cutils/atomic.h>
+#include <cutils/properties.h>
 #include <utils/threads.h>
 #include <utils/RefBase.h>
 
@@ -67,13 +68,27 @@ private:
  * In fact this is an implementation of ANativeWindow on top of
  * the framebuffer.
  * 
- * Currently it is pretty simple, it manages only two buffers (the front and 
- * back buffer).
+ * It manages two or three buffers (the front and back buffers), as many as
+ * the framebuffer HAL has room for unless the debug.sf.fb_buffers property
+ * says otherwise: "2" or "3" force that many buffers and "auto" starts
+ * with two and adds the third one when posting keeps stalling.
  * 
  */
 
+// a post taking longer than this stalled the composition
+static const nsecs_t POST_STALL_THRESHOLD = ms2ns(4);
+
+// how many of the last STALL_WINDOW frames must have stalled before
+// another buffer is added
+static const uint32_t STALL_WINDOW = 32;
+static const uint32_t STALL_COUNT_FOR_NEW_BUFFER = 4;
+
 FramebufferNativeWindow::FramebufferNativeWindow() 
-    : BASE(), fbDev(0), grDev(0), mUpdateOnDemand(false)
+    : BASE(), fbDev(0), grDev(0), mNumBuffers(0), mNumFreeBuffers(0),
+      mBufferHead(0), mCurrentBufferIndex(0), mUpdateOnDemand(false),
+      mMaxBuffers(0), mRecentFrames(0), mRecentStalls(0),
+      mFrames(0), mDequeueStalls(0), mDequeueWaitTime(0),
+      mMaxDequeueWaitTime(0), mPostTime(0), mMaxPostTime(0)
 {
     hw_module_t const* module;
 
@@ -100,9 +115,25 @@ FramebufferNativeWindow::FramebufferNativeWindow()
         // initialize the buffer FIFO
         if(fbDev->numFramebuffers >= MIN_NUM_FRAME_BUFFERS &&
            fbDev->numFramebuffers <= MAX_NUM_FRAME_BUFFERS){
-            mNumBuffers = fbDev->numFramebuffers;
+            mMaxBuffers = fbDev->numFramebuffers;
         } else {
+            mMaxBuffers = MIN_NUM_FRAME_BUFFERS;
+        }
+        mNumBuffers = mMaxBuffers;
+
+        char property[PROPERTY_VALUE_MAX];
+        property_get("debug.sf.fb_buffers", property, "");
+        if (!strcmp(property, "auto")) {
             mNumBuffers = MIN_NUM_FRAME_BUFFERS;
+        } else if (property[0]) {
+            int count = atoi(property);
+            if (count >= MIN_NUM_FRAME_BUFFERS && count <= mMaxBuffers) {
+                mNumBuffers = count;
+                mMaxBuffers = count;
+            } else {
+                ALOGW("debug.sf.fb_buffers=%s ignored, the framebuffer has "
+                        "room for %d buffers", property, mMaxBuffers);
+            }
         }
         mNumFreeBuffers = mNumBuffers;
         mBufferHead = mNumBuffers-1;
@@ -139,6 +170,7 @@ FramebufferNativeWindow::FramebufferNativeWindow()
                         mNumBuffers = i;
                         mNumFreeBuffers = i;
                         mBufferHead = mNumBuffers-1;
+                        mMaxBuffers = i;
                         break;
                 }
         }
@@ -166,6 +198,29 @@ FramebufferNativeWindow::FramebufferNativeWindow()
     ANativeWindow::queueBuffer_DEPRECATED = queueBuffer_DEPRECATED;
 }
 
+bool FramebufferNativeWindow::addBufferLocked()
+{
+    const int i = mNumBuffers;
+    sp<NativeBuffer> buffer(new NativeBuffer(
+            fbDev->width, fbDev->height, fbDev->format, GRALLOC_USAGE_HW_FB));
+    int err = grDev->alloc(grDev,
+            fbDev->width, fbDev->height, fbDev->format,
+            GRALLOC_USAGE_HW_FB, &buffer->handle, &buffer->stride);
+    if (err) {
+        ALOGW("fb buffer %d allocation failed w=%d, h=%d, err=%s",
+                i, fbDev->width, fbDev->height, strerror(-err));
+        mMaxBuffers = mNumBuffers;
+        return false;
+    }
+
+    // every buffer is free, so the new one can go at the end of the FIFO
+    buffers[i] = buffer;
+    mNumBuffers++;
+    mNumFreeBuffers++;
+    ALOGI("posting stalls, now using %d framebuffers", mNumBuffers);
+    return true;
+}
+
 FramebufferNativeWindow::~FramebufferNativeWindow() 
 {
     if (grDev) {
@@ -206,6 +261,17 @@ int FramebufferNativeWindow::setSwapInterval(
 }
 
 void FramebufferNativeWindow::dump(String8& result) {
+    {
+        Mutex::Autolock _l(mutex);
+        result.appendFormat("  FramebufferNativeWindow: buffers=%d (max %d), "
+                "frames=%u\n", mNumBuffers, mMaxBuffers, mFrames);
+        result.appendFormat("    dequeue: stalls=%u, waited=%.3f ms "
+                "(max %.3f ms)\n", mDequeueStalls, mDequeueWaitTime / 1e6,
+                mMaxDequeueWaitTime / 1e6);
+        result.appendFormat("    post: avg=%.3f ms, max=%.3f ms\n",
+                mFrames ? mPostTime / 1e6 / mFrames : 0.0,
+                mMaxPostTime / 1e6);
+    }
     if (fbDev->common.version >= 1 && fbDev->dump) {
         const size_t SIZE = 4096;
         char buffer[SIZE];
@@ -250,8 +316,17 @@ int FramebufferNativeWindow::dequeueBuffer(ANativeWindow* window,
         self->mBufferHead = 0;
 
     // wait for a free non-front buffer
-    while (self->mNumFreeBuffers < 2) {
-        self->mCondition.wait(self->mutex);
+    if (self->mNumFreeBuffers < 2) {
+        const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        while (self->mNumFreeBuffers < 2) {
+            self->mCondition.wait(self->mutex);
+        }
+        const nsecs_t waited = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+        self->mDequeueStalls++;
+        self->mDequeueWaitTime += waited;
+        if (waited > self->mMaxDequeueWaitTime) {
+            self->mMaxDequeueWaitTime = waited;
+        }
     }
     ALOG_ASSERT(self->buffers[index] != self->front);
 
@@ -289,9 +364,34 @@ int FramebufferNativeWindow::queueBuffer(ANativeWindow* window,
     fence->wait(Fence::TIMEOUT_NEVER);
 
     const int index = self->mCurrentBufferIndex;
+    const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
     int res = fb->post(fb, handle);
+    const nsecs_t duration = systemTime(SYSTEM_TIME_MONOTONIC) - start;
     self->front = static_cast<NativeBuffer*>(buffer);
     self->mNumFreeBuffers++;
+
+    self->mFrames++;
+    self->mPostTime += duration;
+    if (duration > self->mMaxPostTime) {
+        self->mMaxPostTime = duration;
+    }
+    if (self->mNumBuffers < self->mMaxBuffers) {
+        // the HAL waits in post() for the flip of the previous frame when it
+        // has no spare buffer, see if another one would help
+        if (duration > POST_STALL_THRESHOLD) {
+            self->mRecentStalls++;
+        }
+        if (++self->mRecentFrames >= STALL_WINDOW) {
+            self->mRecentFrames = 0;
+            self->mRecentStalls = 0;
+        }
+        if (self->mRecentStalls >= STALL_COUNT_FOR_NEW_BUFFER &&
+                self->mNumFreeBuffers == self->mNumBuffers) {
+            self->addBufferLocked();
+            self->mRecentFrames = 0;
+            self->mRecentStalls = 0;
+        }
+    }
     self->mCondition.broadcast();
 #ifdef SAMSUNG_HDMI_SUPPORT
 #if defined(SAMSUNG_EXYNOS4210) || defined(SAMSUNG_EXYNOS4x12)
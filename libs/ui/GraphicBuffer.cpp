@@ -18,10 +18,18 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 
+#include <unistd.h>
+
+#include <cutils/atomic.h>
+
 #include <utils/Errors.h>
+#include <utils/KeyedVector.h>
 #include <utils/Log.h>
+#include <utils/Mutex.h>
 
 #include <ui/GraphicBuffer.h>
 #include <ui/GraphicBufferAllocator.h>
@@ -30,13 +38,102 @@
 
 namespace android {
 
+// ===========================================================================
+// Import cache
+// ===========================================================================
+
+/*
+ * The handles this process registered with gralloc, by buffer id, so a
+ * buffer received again shares the registration instead of making a new
+ * one. The GraphicBuffers using a handle hold a reference each; the last
+ * one to go unregisters it.
+ */
+struct ImportedHandle {
+    native_handle_t* handle;
+    int32_t refs;
+};
+
+static Mutex gImportLock;
+static KeyedVector<uint64_t, ImportedHandle*> gImports;
+static int32_t gNextId;
+
+static uint64_t newBufferId()
+{
+    // a pid reused after a crash can repeat ids, and a peer can send any id;
+    // importHandle() compares the handles and their files too, so that only
+    // costs a cache miss
+    return (uint64_t(getpid()) << 32) | uint32_t(android_atomic_inc(&gNextId) + 1);
+}
+
+static bool sameHandle(const native_handle_t* h, size_t numFds, size_t numInts,
+        int const* ints)
+{
+    return size_t(h->numFds) == numFds && size_t(h->numInts) == numInts &&
+            !memcmp(h->data + numFds, ints, numInts*sizeof(int));
+}
+
+#ifndef KCMP_FILE
+#define KCMP_FILE 0
+#endif
+
+// whether two fds refer to the same memory: a fd received again through
+// binder shares the open file of the first one, which kcmp() can tell. Without
+// it the inode has to do, but only a regular file (ashmem) has one per buffer,
+// the fds of a device node or a dma-buf all share theirs.
+static bool sameFile(int a, int b)
+{
+#ifdef SYS_kcmp
+    const pid_t pid = getpid();
+    const int r = syscall(SYS_kcmp, pid, pid, KCMP_FILE, a, b);
+    if (r >= 0) {
+        return r == 0;
+    }
+#endif
+    struct stat sa, sb;
+    if (fstat(a, &sa) || fstat(b, &sb)) {
+        return false;
+    }
+    return S_ISREG(sa.st_mode) &&
+            sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+// the ids and the ints come from the sender, only the fds tell whether this
+// really is the memory already imported
+static bool sameFiles(const native_handle_t* h, int const* fds, size_t numFds)
+{
+    for (size_t i=0 ; i<numFds ; i++) {
+        if (!sameFile(h->data[i], fds[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void releaseImport(GraphicBufferMapper& mapper, uint64_t id)
+{
+    Mutex::Autolock _l(gImportLock);
+    ssize_t index = gImports.indexOfKey(id);
+    if (index < 0) {
+        ALOGE("releasing buffer %llx, which isn't imported", id);
+        return;
+    }
+    ImportedHandle* imported = gImports.valueAt(index);
+    if (--imported->refs == 0) {
+        mapper.unregisterBuffer(imported->handle);
+        native_handle_close(imported->handle);
+        native_handle_delete(imported->handle);
+        gImports.removeItemsAt(index);
+        delete imported;
+    }
+}
+
 // ===========================================================================
 // Buffer and implementation of ANativeWindowBuffer
 // ===========================================================================
 
 GraphicBuffer::GraphicBuffer()
     : BASE(), mOwner(ownData), mBufferMapper(GraphicBufferMapper::get()),
-      mInitCheck(NO_ERROR), mIndex(-1)
+      mInitCheck(NO_ERROR), mIndex(-1), mId(0)
 {
     width  = 
     height = 
@@ -49,7 +146,7 @@ GraphicBuffer::GraphicBuffer()
 GraphicBuffer::GraphicBuffer(uint32_t w, uint32_t h, 
         PixelFormat reqFormat, uint32_t reqUsage)
     : BASE(), mOwner(ownData), mBufferMapper(GraphicBufferMapper::get()),
-      mInitCheck(NO_ERROR), mIndex(-1)
+      mInitCheck(NO_ERROR), mIndex(-1), mId(0)
 {
     width  = 
     height = 
@@ -64,7 +161,7 @@ GraphicBuffer::GraphicBuffer(uint32_t w, uint32_t h,
 GraphicBuffer::GraphicBuffer(uint32_t w, uint32_t h,
         PixelFormat reqFormat, uint32_t reqUsage, uint32_t bufferSize)
     : BASE(), mOwner(ownData), mBufferMapper(GraphicBufferMapper::get()),
-      mInitCheck(NO_ERROR), mIndex(-1)
+      mInitCheck(NO_ERROR), mIndex(-1), mId(0)
 {
     width  =
     height =
@@ -81,7 +178,7 @@ GraphicBuffer::GraphicBuffer(uint32_t w, uint32_t h,
         uint32_t inStride, native_handle_t* inHandle, bool keepOwnership)
     : BASE(), mOwner(keepOwnership ? ownHandle : ownNone),
       mBufferMapper(GraphicBufferMapper::get()),
-      mInitCheck(NO_ERROR), mIndex(-1)
+      mInitCheck(NO_ERROR), mIndex(-1), mId(0)
 {
     width  = w;
     height = h;
@@ -94,7 +191,7 @@ GraphicBuffer::GraphicBuffer(uint32_t w, uint32_t h,
 GraphicBuffer::GraphicBuffer(ANativeWindowBuffer* buffer, bool keepOwnership)
     : BASE(), mOwner(keepOwnership ? ownHandle : ownNone),
       mBufferMapper(GraphicBufferMapper::get()),
-      mInitCheck(NO_ERROR), mIndex(-1), mWrappedBuffer(buffer)
+      mInitCheck(NO_ERROR), mIndex(-1), mId(0), mWrappedBuffer(buffer)
 {
     width  = buffer->width;
     height = buffer->height;
@@ -120,6 +217,8 @@ void GraphicBuffer::free_handle()
     } else if (mOwner == ownData) {
         GraphicBufferAllocator& allocator(GraphicBufferAllocator::get());
         allocator.free(handle);
+    } else if (mOwner == ownImport) {
+        releaseImport(mBufferMapper, mId);
     }
     mWrappedBuffer = 0;
 }
@@ -156,6 +255,25 @@ status_t GraphicBuffer::reallocate(uint32_t w, uint32_t h, PixelFormat f,
     return initSize(w, h, f, reqUsage);
 }
 
+status_t GraphicBuffer::allocOwned(uint32_t w, uint32_t h, PixelFormat f,
+        uint32_t reqUsage, int32_t owner)
+{
+    if (mOwner != ownData || handle)
+        return INVALID_OPERATION;
+
+    GraphicBufferAllocator& allocator = GraphicBufferAllocator::get();
+    status_t err = allocator.allocOwned(w, h, f, reqUsage, owner,
+            &handle, &stride);
+    if (err == NO_ERROR) {
+        this->width  = w;
+        this->height = h;
+        this->format = f;
+        this->usage  = reqUsage;
+        mId = newBufferId();
+    }
+    return err;
+}
+
 status_t GraphicBuffer::initSize(uint32_t w, uint32_t h, PixelFormat format,
         uint32_t reqUsage)
 {
@@ -166,6 +284,7 @@ status_t GraphicBuffer::initSize(uint32_t w, uint32_t h, PixelFormat format,
         this->height = h;
         this->format = format;
         this->usage  = reqUsage;
+        mId = newBufferId();
     }
     return err;
 }
@@ -182,6 +301,7 @@ status_t GraphicBuffer::initSize(uint32_t w, uint32_t h, PixelFormat format,
         this->height = h;
         this->format = format;
         this->usage  = reqUsage;
+        mId = newBufferId();
     }
     return err;
 }
@@ -213,6 +333,12 @@ status_t GraphicBuffer::unlock()
     return res;
 }
 
+status_t GraphicBuffer::unlockAsync(int* fenceFd)
+{
+    status_t res = getBufferMapper().unlockAsync(handle, fenceFd);
+    return res;
+}
+
 #ifdef QCOM_BSP
 status_t GraphicBuffer::perform(buffer_handle_t hnd, int operation,
                                 uint32_t w, uint32_t h, PixelFormat format)
@@ -223,8 +349,13 @@ status_t GraphicBuffer::perform(buffer_handle_t hnd, int operation,
 }
 #endif
 
+/*
+ * The flattened form is a header of 8 ints, the ints of the handle and the
+ * buffer id as 2 ints. Readers that predate the id ignore the trailing ints,
+ * and a missing id reads as 0, which is never cached.
+ */
 size_t GraphicBuffer::getFlattenedSize() const {
-    return (8 + (handle ? handle->numInts : 0))*sizeof(int);
+    return (10 + (handle ? handle->numInts : 0))*sizeof(int);
 }
 
 size_t GraphicBuffer::getFdCount() const {
@@ -250,13 +381,17 @@ status_t GraphicBuffer::flatten(void* buffer, size_t size,
     buf[6] = 0;
     buf[7] = 0;
 
+    size_t numInts = 0;
     if (handle) {
         buf[6] = handle->numFds;
         buf[7] = handle->numInts;
         native_handle_t const* const h = handle;
         memcpy(fds,     h->data,             h->numFds*sizeof(int));
         memcpy(&buf[8], h->data + h->numFds, h->numInts*sizeof(int));
+        numInts = h->numInts;
     }
+    buf[8 + numInts] = int(uint32_t(mId));
+    buf[9 + numInts] = int(uint32_t(mId >> 32));
 
     return NO_ERROR;
 }
@@ -283,32 +418,72 @@ status_t GraphicBuffer::unflatten(void const* buffer, size_t size,
         free_handle();
     }
 
+    uint64_t id = 0;
+    if (size >= sizeNeeded + 2*sizeof(int)) {
+        id = uint32_t(buf[8 + numInts]) | (uint64_t(uint32_t(buf[9 + numInts])) << 32);
+    }
+    mId = id;
+
     if (numFds || numInts) {
         width  = buf[1];
         height = buf[2];
         stride = buf[3];
         format = buf[4];
         usage  = buf[5];
-        native_handle* h = native_handle_create(numFds, numInts);
-        memcpy(h->data,          fds,     numFds*sizeof(int));
-        memcpy(h->data + numFds, &buf[8], numInts*sizeof(int));
-        handle = h;
-    } else {
-        width = height = stride = format = usage = 0;
-        handle = NULL;
+        return importHandle(id, &buf[8], fds, numFds, numInts);
     }
 
+    width = height = stride = format = usage = 0;
+    handle = NULL;
     mOwner = ownHandle;
+    return NO_ERROR;
+}
 
-    if (handle != 0) {
-        status_t err = mBufferMapper.registerBuffer(handle);
-        if (err != NO_ERROR) {
-            ALOGE("unflatten: registerBuffer failed: %s (%d)",
-                    strerror(-err), err);
-            return err;
+status_t GraphicBuffer::importHandle(uint64_t id, int const* ints, int fds[],
+        size_t numFds, size_t numInts)
+{
+    Mutex::Autolock _l(gImportLock);
+    ssize_t index = id ? gImports.indexOfKey(id) : NAME_NOT_FOUND;
+    if (index >= 0) {
+        ImportedHandle* imported = gImports.valueAt(index);
+        if (sameHandle(imported->handle, numFds, numInts, ints) &&
+                sameFiles(imported->handle, fds, numFds)) {
+            // the fds are duplicates of the ones already imported
+            for (size_t i=0 ; i<numFds ; i++) {
+                close(fds[i]);
+            }
+            imported->refs++;
+            handle = imported->handle;
+            mOwner = ownImport;
+            return NO_ERROR;
         }
+        // not the buffer we know by that id, don't cache this one
+        id = 0;
     }
 
+    native_handle* h = native_handle_create(numFds, numInts);
+    memcpy(h->data,          fds,  numFds*sizeof(int));
+    memcpy(h->data + numFds, ints, numInts*sizeof(int));
+    handle = h;
+    mOwner = ownHandle;
+
+    status_t err = mBufferMapper.registerBuffer(handle);
+    if (err != NO_ERROR) {
+        ALOGE("unflatten: registerBuffer failed: %s (%d)",
+                strerror(-err), err);
+        return err;
+    }
+
+    if (id) {
+        ImportedHandle* imported = new ImportedHandle;
+        imported->handle = h;
+        imported->refs = 1;
+        if (gImports.add(id, imported) >= 0) {
+            mOwner = ownImport;
+        } else {
+            delete imported;
+        }
+    }
     return NO_ERROR;
 }
 
@@ -34,6 +34,13 @@ ANDROID_SINGLETON_STATIC_INSTANCE( GraphicBufferAllocator )
 Mutex GraphicBufferAllocator::sLock;
 KeyedVector<buffer_handle_t,
     GraphicBufferAllocator::alloc_rec_t> GraphicBufferAllocator::sAllocList;
+KeyedVector<int32_t,
+    GraphicBufferAllocator::owner_usage_t> GraphicBufferAllocator::sOwners;
+Vector<GraphicBufferAllocator::pooled_buffer_t> GraphicBufferAllocator::sPool;
+size_t GraphicBufferAllocator::sPoolSize = 0;
+size_t GraphicBufferAllocator::sPoolMaxSize = 0;
+uint32_t GraphicBufferAllocator::sPoolHits = 0;
+uint32_t GraphicBufferAllocator::sPoolMisses = 0;
 
 GraphicBufferAllocator::GraphicBufferAllocator()
     : mAllocDev(0)
@@ -77,6 +84,13 @@ void GraphicBufferAllocator::dump(String8& result) const
     }
     snprintf(buffer, SIZE, "Total allocated (estimate): %.2f KB\n", total/1024.0f);
     result.append(buffer);
+    if (sPoolMaxSize) {
+        snprintf(buffer, SIZE, "Recycling pool: %u buffers, %.2f KB "
+                "(max %.2f KB), hits=%u, misses=%u\n",
+                sPool.size(), sPoolSize/1024.0f, sPoolMaxSize/1024.0f,
+                sPoolHits, sPoolMisses);
+        result.append(buffer);
+    }
     if (mAllocDev->common.version >= 1 && mAllocDev->dump) {
         mAllocDev->dump(mAllocDev, buffer, SIZE);
         result.append(buffer);
@@ -236,6 +250,10 @@ status_t GraphicBufferAllocator::alloc(uint32_t w, uint32_t h,
 
     if (err != NO_ERROR) {
         ALOGW("WOW! gralloc alloc failed, waiting for pending frees!");
+        {
+            Mutex::Autolock _l(sLock);
+            trimPoolLocked(0);
+        }
         BufferLiberatorThread::waitForLiberation();
 #ifdef QCOM_BSP
         err = mAllocDev->allocSize(mAllocDev, w, h,
@@ -269,6 +287,7 @@ status_t GraphicBufferAllocator::alloc(uint32_t w, uint32_t h,
         rec.format = format;
         rec.usage = usage;
         rec.size = h * stride[0] * bpp;
+        rec.owner = 0;
         list.add(*handle, rec);
     }
 
@@ -276,11 +295,159 @@ status_t GraphicBufferAllocator::alloc(uint32_t w, uint32_t h,
 }
 
 
+status_t GraphicBufferAllocator::allocOwned(uint32_t w, uint32_t h,
+        PixelFormat format, int usage, int32_t owner,
+        buffer_handle_t* handle, int32_t* stride)
+{
+    if (!w || !h)
+        w = h = 1;
+
+    if (owner && sPoolMaxSize) {
+        Mutex::Autolock _l(sLock);
+        if (takeFromPoolLocked(w, h, format, usage, owner, handle, stride)) {
+            setOwnerLocked(sAllocList.editValueFor(*handle), owner);
+            return NO_ERROR;
+        }
+    }
+
+    status_t err = alloc(w, h, format, usage, handle, stride);
+    if (err == NO_ERROR && owner) {
+        setOwner(*handle, owner);
+    }
+    return err;
+}
+
 status_t GraphicBufferAllocator::free(buffer_handle_t handle)
 {
+    {
+        Mutex::Autolock _l(sLock);
+        ssize_t index = sAllocList.indexOfKey(handle);
+        int32_t owner = 0;
+        if (index >= 0) {
+            owner = sAllocList.valueAt(index).owner;
+            setOwnerLocked(sAllocList.editValueAt(index), 0);
+        }
+        if (sPoolMaxSize && owner) {
+            // only buffers of a known size can be accounted for
+            if (index >= 0) {
+                const alloc_rec_t& rec(sAllocList.valueAt(index));
+                if (rec.size && rec.size <= sPoolMaxSize) {
+                    pooled_buffer_t pooled;
+                    pooled.handle = handle;
+                    pooled.owner = owner;
+                    sPool.push_back(pooled);
+                    sPoolSize += rec.size;
+                    trimPoolLocked(sPoolMaxSize);
+                    return NO_ERROR;
+                }
+            }
+        }
+    }
     BufferLiberatorThread::queueCaptiveBuffer(handle);
     return NO_ERROR;
 }
 
+void GraphicBufferAllocator::setRecyclingPoolSize(size_t maxBytes)
+{
+    Mutex::Autolock _l(sLock);
+    sPoolMaxSize = maxBytes;
+    trimPoolLocked(maxBytes);
+}
+
+void GraphicBufferAllocator::setOwner(buffer_handle_t handle, int32_t owner)
+{
+    Mutex::Autolock _l(sLock);
+    ssize_t index = sAllocList.indexOfKey(handle);
+    if (index >= 0) {
+        setOwnerLocked(sAllocList.editValueAt(index), owner);
+    }
+}
+
+void GraphicBufferAllocator::releaseOwner(int32_t owner)
+{
+    Mutex::Autolock _l(sLock);
+    for (size_t i = 0; i < sPool.size(); ) {
+        if (sPool[i].owner == owner) {
+            buffer_handle_t handle = sPool[i].handle;
+            sPoolSize -= sAllocList.valueFor(handle).size;
+            sPool.removeAt(i);
+            BufferLiberatorThread::queueCaptiveBuffer(handle);
+        } else {
+            i++;
+        }
+    }
+}
+
+void GraphicBufferAllocator::setOwnerLocked(alloc_rec_t& rec, int32_t owner)
+{
+    if (rec.owner == owner) {
+        return;
+    }
+    if (rec.owner) {
+        ssize_t index = sOwners.indexOfKey(rec.owner);
+        owner_usage_t& u(sOwners.editValueAt(index));
+        u.count--;
+        u.size -= rec.size;
+        if (!u.count) {
+            sOwners.removeItemsAt(index);
+        }
+    }
+    rec.owner = owner;
+    if (owner) {
+        ssize_t index = sOwners.indexOfKey(owner);
+        if (index < 0) {
+            owner_usage_t u;
+            u.usage = 0;
+            u.count = 0;
+            u.size = 0;
+            index = sOwners.add(owner, u);
+        }
+        owner_usage_t& u(sOwners.editValueAt(index));
+        u.usage |= rec.usage;
+        u.count++;
+        u.size += rec.size;
+    }
+}
+
+void GraphicBufferAllocator::getOwnerUsage(
+        KeyedVector<int32_t, owner_usage_t>* usage) const
+{
+    Mutex::Autolock _l(sLock);
+    *usage = sOwners;
+}
+
+bool GraphicBufferAllocator::takeFromPoolLocked(uint32_t w, uint32_t h,
+        PixelFormat format, int usage, int32_t owner,
+        buffer_handle_t* handle, int32_t* stride)
+{
+    for (ssize_t i = ssize_t(sPool.size()) - 1; i >= 0; i--) {
+        if (sPool[i].owner != owner) {
+            continue;
+        }
+        const alloc_rec_t& rec(sAllocList.valueFor(sPool[i].handle));
+        if (rec.w == w && rec.h == h && rec.format == format &&
+                rec.usage == uint32_t(usage)) {
+            *handle = sPool[i].handle;
+            *stride = rec.s;
+            sPoolSize -= rec.size;
+            sPool.removeAt(i);
+            sPoolHits++;
+            return true;
+        }
+    }
+    sPoolMisses++;
+    return false;
+}
+
+void GraphicBufferAllocator::trimPoolLocked(size_t maxSize)
+{
+    while (sPoolSize > maxSize && !sPool.isEmpty()) {
+        buffer_handle_t handle = sPool[0].handle;
+        sPoolSize -= sAllocList.valueFor(handle).size;
+        sPool.removeAt(0);
+        BufferLiberatorThread::queueCaptiveBuffer(handle);
+    }
+}
+
 // ---------------------------------------------------------------------------
 }; // namespace android
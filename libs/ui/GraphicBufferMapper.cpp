@@ -63,6 +63,16 @@ status_t GraphicBufferMapper::unregisterBuffer(buffer_handle_t handle)
     ATRACE_CALL();
     status_t err;
 
+    {
+        Mutex::Autolock _l(mLock);
+        ssize_t index = mMappings.indexOfKey(handle);
+        if (index >= 0) {
+            ALOGW("unregisterBuffer(%p) while locked %u time(s)",
+                    handle, mMappings.valueAt(index).count);
+            mMappings.removeItemsAt(index);
+        }
+    }
+
     err = mAllocMod->unregisterBuffer(mAllocMod, handle);
 
     ALOGW_IF(err, "unregisterBuffer(%p) failed %d (%s)",
@@ -76,11 +86,52 @@ status_t GraphicBufferMapper::lock(buffer_handle_t handle,
     ATRACE_CALL();
     status_t err;
 
+    {
+        // only readers share a mapping, the writers are left to gralloc
+        // to arbitrate
+        Mutex::Autolock _l(mLock);
+        ssize_t index = mMappings.indexOfKey(handle);
+        if (index >= 0 && !(usage & GRALLOC_USAGE_SW_WRITE_MASK)) {
+            Mapping& mapping(mMappings.editValueAt(index));
+            Rect unused;
+            if (!(mapping.usage & GRALLOC_USAGE_SW_WRITE_MASK) &&
+                    (usage & ~mapping.usage) == 0 &&
+                    (bounds.isEmpty() || (mapping.bounds.intersect(bounds,
+                            &unused) && unused == bounds))) {
+                mapping.count++;
+                *vaddr = mapping.vaddr;
+                return NO_ERROR;
+            }
+        }
+    }
+
+    // gralloc may block, the other buffers can be locked meanwhile
     err = mAllocMod->lock(mAllocMod, handle, usage,
             bounds.left, bounds.top, bounds.width(), bounds.height(),
             vaddr);
 
     ALOGW_IF(err, "lock(...) failed %d (%s)", err, strerror(-err));
+    if (err == NO_ERROR) {
+        Mutex::Autolock _l(mLock);
+        ssize_t index = mMappings.indexOfKey(handle);
+        if (index >= 0) {
+            // a nested lock the active mapping doesn't cover, it's up to
+            // gralloc to deal with it. Once a writer is in, no more readers
+            // share the mapping.
+            Mapping& mapping(mMappings.editValueAt(index));
+            mapping.usage |= usage & GRALLOC_USAGE_SW_WRITE_MASK;
+            mapping.count++;
+            mapping.grallocLocks++;
+        } else {
+            Mapping mapping;
+            mapping.usage = usage;
+            mapping.bounds = bounds;
+            mapping.vaddr = *vaddr;
+            mapping.count = 1;
+            mapping.grallocLocks = 1;
+            mMappings.add(handle, mapping);
+        }
+    }
     return err;
 }
 
@@ -89,12 +140,38 @@ status_t GraphicBufferMapper::unlock(buffer_handle_t handle)
     ATRACE_CALL();
     status_t err;
 
+    {
+        Mutex::Autolock _l(mLock);
+        ssize_t index = mMappings.indexOfKey(handle);
+        if (index >= 0) {
+            Mapping& mapping(mMappings.editValueAt(index));
+            if (mapping.grallocLocks > 1) {
+                mapping.grallocLocks--;
+                mapping.count--;
+            } else if (mapping.count > 1) {
+                mapping.count--;
+                return NO_ERROR;
+            } else {
+                mMappings.removeItemsAt(index);
+            }
+        }
+    }
+
     err = mAllocMod->unlock(mAllocMod, handle);
 
     ALOGW_IF(err, "unlock(...) failed %d (%s)", err, strerror(-err));
     return err;
 }
 
+status_t GraphicBufferMapper::unlockAsync(buffer_handle_t handle, int* fenceFd)
+{
+    ATRACE_CALL();
+    // this version of the gralloc HAL can only unlock synchronously, the
+    // contents are coherent once unlock returns
+    *fenceFd = -1;
+    return unlock(handle);
+}
+
 #ifdef EXYNOS4_ENHANCEMENTS
 status_t GraphicBufferMapper::getphys(buffer_handle_t handle, void** paddr)
 {
@@ -21,45 +21,41 @@
 namespace android {
 // ----------------------------------------------------------------------------
 
-static const int COMPONENT_YUV = 0xFF;
-
-struct Info {
-    size_t      size;
-    size_t      bitsPerPixel;
-    struct {
-        uint8_t     ah;
-        uint8_t     al;
-        uint8_t     rh;
-        uint8_t     rl;
-        uint8_t     gh;
-        uint8_t     gl;
-        uint8_t     bh;
-        uint8_t     bl;
-    };
-    uint8_t     components;
+static const int COMPONENT_YUV = PixelFormatInfo::OTHER;
+
+#define RGB_(bpp, bits, ah,al, rh,rl, gh,gl, bh,bl, components) \
+        { (bpp), (bits), PixelFormatInfo::components, 1,        \
+          { {ah,al}, {rh,rl}, {gh,gl}, {bh,bl} } }
+#define YUV_(bits, planes)                                      \
+        { 1, (bits), COMPONENT_YUV, (planes),                   \
+          { {0,0}, {8,0}, {8,0}, {8,0} } }
+#define NONE_ { 0, 0, 0, 0, { {0,0}, {0,0}, {0,0}, {0,0} } }
+
+const PixelFormatDescriptor gPixelFormatDescriptors[NUM_PIXEL_FORMAT_DESCRIPTORS] = {
+        NONE_,
+        RGB_(4, 32,  32,24,   8, 0,  16, 8,  24,16, RGBA),
+        RGB_(4, 24,   0, 0,   8, 0,  16, 8,  24,16, RGB ),
+        RGB_(3, 24,   0, 0,   8, 0,  16, 8,  24,16, RGB ),
+        RGB_(2, 16,   0, 0,  16,11,  11, 5,   5, 0, RGB ),
+        RGB_(4, 32,  32,24,  24,16,  16, 8,   8, 0, RGBA),
+        RGB_(2, 16,   1, 0,  16,11,  11, 6,   6, 1, RGBA),
+        RGB_(2, 16,   4, 0,  16,12,  12, 8,   8, 4, RGBA),
+        RGB_(1,  8,   8, 0,   0, 0,   0, 0,   0, 0, ALPHA),
+        RGB_(1,  8,   0, 0,   8, 0,   8, 0,   8, 0, L   ),
+        RGB_(2, 16,  16, 8,   8, 0,   8, 0,   8, 0, LA  ),
+        RGB_(1,  8,   0, 0,   8, 5,   5, 2,   2, 0, RGB ),
+        NONE_, NONE_, NONE_, NONE_,
+        YUV_(16, 2),    // HAL_PIXEL_FORMAT_YCbCr_422_SP
+        YUV_(12, 2),    // HAL_PIXEL_FORMAT_YCrCb_420_SP
+        NONE_, NONE_,
+        YUV_(16, 1),    // HAL_PIXEL_FORMAT_YCbCr_422_I
 };
 
-static Info const sPixelFormatInfos[] = {
-        { 0,  0, { 0, 0,   0, 0,   0, 0,   0, 0 }, 0 },
-        { 4, 32, {32,24,   8, 0,  16, 8,  24,16 }, PixelFormatInfo::RGBA },
-        { 4, 24, { 0, 0,   8, 0,  16, 8,  24,16 }, PixelFormatInfo::RGB  },
-        { 3, 24, { 0, 0,   8, 0,  16, 8,  24,16 }, PixelFormatInfo::RGB  },
-        { 2, 16, { 0, 0,  16,11,  11, 5,   5, 0 }, PixelFormatInfo::RGB  },
-        { 4, 32, {32,24,  24,16,  16, 8,   8, 0 }, PixelFormatInfo::RGBA },
-        { 2, 16, { 1, 0,  16,11,  11, 6,   6, 1 }, PixelFormatInfo::RGBA },
-        { 2, 16, { 4, 0,  16,12,  12, 8,   8, 4 }, PixelFormatInfo::RGBA },
-        { 1,  8, { 8, 0,   0, 0,   0, 0,   0, 0 }, PixelFormatInfo::ALPHA},
-        { 1,  8, { 0, 0,   8, 0,   8, 0,   8, 0 }, PixelFormatInfo::L    },
-        { 2, 16, {16, 8,   8, 0,   8, 0,   8, 0 }, PixelFormatInfo::LA   },
-        { 1,  8, { 0, 0,   8, 5,   5, 2,   2, 0 }, PixelFormatInfo::RGB  },
-};
+const PixelFormatDescriptor gPixelFormatDescriptorYV12 = YUV_(12, 3);
 
-static const Info* gGetPixelFormatTable(size_t* numEntries) {
-    if (numEntries) {
-        *numEntries = sizeof(sPixelFormatInfos)/sizeof(Info);
-    }
-    return sPixelFormatInfos;
-}
+#undef RGB_
+#undef YUV_
+#undef NONE_
 
 // ----------------------------------------------------------------------------
 
@@ -75,18 +71,21 @@ size_t PixelFormatInfo::getScanlineSize(unsigned int width) const
     return size;
 }
 
+static status_t formatError(PixelFormat format)
+{
+    return (format <= 0) ? status_t(BAD_VALUE) : status_t(BAD_INDEX);
+}
+
 ssize_t bytesPerPixel(PixelFormat format)
 {
-    PixelFormatInfo info;
-    status_t err = getPixelFormatInfo(format, &info);
-    return (err < 0) ? err : info.bytesPerPixel;
+    const PixelFormatDescriptor* d = getPixelFormatDescriptor(format);
+    return (d == NULL) ? formatError(format) : d->bytesPerPixel;
 }
 
 ssize_t bitsPerPixel(PixelFormat format)
 {
-    PixelFormatInfo info;
-    status_t err = getPixelFormatInfo(format, &info);
-    return (err < 0) ? err : info.bitsPerPixel;
+    const PixelFormatDescriptor* d = getPixelFormatDescriptor(format);
+    return (d == NULL) ? formatError(format) : d->bitsPerPixel;
 }
 
 status_t getPixelFormatInfo(PixelFormat format, PixelFormatInfo* info)
@@ -97,45 +96,18 @@ status_t getPixelFormatInfo(PixelFormat format, PixelFormatInfo* info)
     if (info->version != sizeof(PixelFormatInfo))
         return INVALID_OPERATION;
 
-    // YUV format from the HAL are handled here
-    switch (format) {
-    case HAL_PIXEL_FORMAT_YCbCr_422_SP:
-    case HAL_PIXEL_FORMAT_YCbCr_422_I:
-        info->bitsPerPixel = 16;
-        goto done;
-    case HAL_PIXEL_FORMAT_YCrCb_420_SP:
-    case HAL_PIXEL_FORMAT_YV12:
-        info->bitsPerPixel = 12;
-     done:
-        info->format = format;
-        info->components = COMPONENT_YUV;
-        info->bytesPerPixel = 1;
-        info->h_alpha = 0;
-        info->l_alpha = 0;
-        info->h_red = info->h_green = info->h_blue = 8;
-        info->l_red = info->l_green = info->l_blue = 0;
-        return NO_ERROR;
-    }
-
-    size_t numEntries;
-    const Info *i = gGetPixelFormatTable(&numEntries) + format;
-    bool valid = uint32_t(format) < numEntries;
-    if (!valid) {
+    const PixelFormatDescriptor* d = getPixelFormatDescriptor(format);
+    if (d == NULL) {
         return BAD_INDEX;
     }
 
     info->format = format;
-    info->bytesPerPixel = i->size;
-    info->bitsPerPixel  = i->bitsPerPixel;
-    info->h_alpha       = i->ah;
-    info->l_alpha       = i->al;
-    info->h_red         = i->rh;
-    info->l_red         = i->rl;
-    info->h_green       = i->gh;
-    info->l_green       = i->gl;
-    info->h_blue        = i->bh;
-    info->l_blue        = i->bl;
-    info->components    = i->components;
+    info->bytesPerPixel = d->bytesPerPixel;
+    info->bitsPerPixel  = d->bitsPerPixel;
+    for (size_t ci = 0; ci < 4; ci++) {
+        info->cinfo[ci] = d->cinfo[ci];
+    }
+    info->components    = d->components;
 
     return NO_ERROR;
 }
@@ -18,9 +18,16 @@
 
 #include <limits.h>
 
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <utils/CallStack.h>
+#include <utils/Debug.h>
 #include <utils/Log.h>
 #include <utils/String8.h>
-#include <utils/CallStack.h>
 
 #include <ui/Rect.h>
 #include <ui/Region.h>
@@ -49,20 +56,25 @@ enum {
 
 // ----------------------------------------------------------------------------
 
-Region::Region() {
-    mStorage.add(Rect(0,0));
+Region::Region()
+    : mInlineCount(1)
+{
+    mInline[0] = Rect(0,0);
 }
 
 Region::Region(const Region& rhs)
-    : mStorage(rhs.mStorage)
+    : mStorage(rhs.mStorage), mInlineCount(rhs.mInlineCount)
 {
+    memcpy(mInline, rhs.mInline, mInlineCount * sizeof(Rect));
 #if VALIDATE_REGIONS
     validate(rhs, "rhs copy-ctor");
 #endif
 }
 
-Region::Region(const Rect& rhs) {
-    mStorage.add(rhs);
+Region::Region(const Rect& rhs)
+    : mInlineCount(1)
+{
+    mInline[0] = rhs;
 }
 
 Region::~Region()
@@ -75,43 +87,86 @@ Region& Region::operator = (const Region& rhs)
     validate(*this, "this->operator=");
     validate(rhs, "rhs.operator=");
 #endif
-    mStorage = rhs.mStorage;
+    if (this != &rhs) {
+        mStorage = rhs.mStorage;
+        mInlineCount = rhs.mInlineCount;
+        memcpy(mInline, rhs.mInline, mInlineCount * sizeof(Rect));
+    }
     return *this;
 }
 
 Region& Region::makeBoundsSelf()
 {
-    if (mStorage.size() >= 2) {
-        const Rect bounds(getBounds());
-        mStorage.clear();
-        mStorage.add(bounds);
+    if (storageSize() >= 2) {
+        set(getBounds());
     }
     return *this;
 }
 
 void Region::clear()
 {
-    mStorage.clear();
-    mStorage.add(Rect(0,0));
+    set(Rect(0,0));
 }
 
 void Region::set(const Rect& r)
 {
     mStorage.clear();
-    mStorage.add(r);
+    mInlineCount = 1;
+    mInline[0] = r;
 }
 
 void Region::set(uint32_t w, uint32_t h)
 {
-    mStorage.clear();
-    mStorage.add(Rect(w,h));
+    set(Rect(w,h));
 }
 
 // ----------------------------------------------------------------------------
 
+Rect* Region::editStorageArray()
+{
+    return mInlineCount ? mInline : mStorage.editArray();
+}
+
+void Region::setStorage(Rect const* rects, size_t count)
+{
+    if (count <= INLINE_CAPACITY) {
+        mStorage.clear();
+        memcpy(mInline, rects, count * sizeof(Rect));
+        mInlineCount = count;
+    } else {
+        mStorage.clear();
+        mStorage.appendArray(rects, count);
+        mInlineCount = 0;
+    }
+}
+
+void Region::setStorage(const Vector<Rect>& storage)
+{
+    if (storage.size() <= INLINE_CAPACITY) {
+        setStorage(storage.array(), storage.size());
+    } else {
+        // this doesn't copy the rects
+        mStorage = storage;
+        mInlineCount = 0;
+    }
+}
+
 void Region::addRectUnchecked(int l, int t, int r, int b)
 {
     Rect rect(l,t,r,b);
+    if (mInlineCount) {
+        if (mInlineCount < INLINE_CAPACITY) {
+            // insert before the bounds
+            mInline[mInlineCount] = mInline[mInlineCount - 1];
+            mInline[mInlineCount - 1] = rect;
+            mInlineCount++;
+            return;
+        }
+        // we need to move to the heap
+        mStorage.clear();
+        mStorage.appendArray(mInline, mInlineCount);
+        mInlineCount = 0;
+    }
     size_t where = mStorage.size() - 1;
     mStorage.insertAt(rect, where, 1);
 }
@@ -254,15 +309,17 @@ const Region Region::operation(const Region& rhs, int dx, int dy, int op) const
 class Region::rasterizer : public region_operator<Rect>::region_rasterizer 
 {
     Rect bounds;
-    Vector<Rect>& storage;
+    Region& region;
+    // the destination region is only updated when we're done, because
+    // it may be one of the operands
+    Vector<Rect> storage;
     Rect* head;
     Rect* tail;
     Vector<Rect> span;
     Rect* cur;
 public:
     rasterizer(Region& reg) 
-        : bounds(INT_MAX, 0, INT_MIN, 0), storage(reg.mStorage), head(), tail(), cur() {
-        storage.clear();
+        : bounds(INT_MAX, 0, INT_MIN, 0), region(reg), head(), tail(), cur() {
     }
 
     ~rasterizer() {
@@ -280,6 +337,7 @@ public:
             bounds.right = 0;
         }
         storage.add(bounds);
+        region.setStorage(storage);
     }
     
     virtual void operator()(const Rect& rect) {
@@ -392,9 +450,9 @@ bool Region::validate(const Region& reg, const char* name, bool silent)
                 reg.getBounds().left, reg.getBounds().top, 
                 reg.getBounds().right, reg.getBounds().bottom);
     }
-    if (reg.mStorage.size() == 2) {
+    if (reg.storageSize() == 2) {
         result = false;
-        ALOGE_IF(!silent, "%s: mStorage size is 2, which is never valid", name);
+        ALOGE_IF(!silent, "%s: storage size is 2, which is never valid", name);
     }
     if (result == false && !silent) {
         reg.dump(name);
@@ -405,6 +463,116 @@ bool Region::validate(const Region& reg, const char* name, bool silent)
     return result;
 }
 
+static inline bool contains(const Rect& outer, const Rect& inner) {
+    return (outer.left <= inner.left) && (outer.top <= inner.top) &&
+           (outer.right >= inner.right) && (outer.bottom >= inner.bottom);
+}
+
+bool Region::boolean_operation_fast(int op, Region& dst,
+        const Region& lhs, Rect const* rhs, size_t rhsCount,
+        const Rect& rhsBounds, int dx, int dy)
+{
+    // NOTE: dst can be the same object as rhs (e.g.: r.orSelf(r)), so
+    // rhs must not be accessed after dst has been modified.
+
+    const Rect lb(lhs.getBounds());
+    Rect rb(rhsBounds);
+    rb.offsetBy(dx, dy);
+    const bool lhsEmpty = lb.isEmpty();
+    const bool rhsEmpty = rb.isEmpty();
+    const bool rhsIsRect = (rhsCount == 1);
+    Rect overlap;
+    const bool overlaps = !lhsEmpty && !rhsEmpty && lb.intersect(rb, &overlap);
+
+    switch (op) {
+        case op_and:
+            if (!overlaps) {
+                dst.clear();
+                return true;
+            }
+            if (lhs.isRect() && rhsIsRect) {
+                // the intersection of two rects is their bounds' intersection
+                dst.set(overlap);
+                return true;
+            }
+            if (rhsIsRect && contains(rb, lb)) {
+                dst = lhs;
+                return true;
+            }
+            break;
+
+        case op_nand:
+            if (lhsEmpty) {
+                dst.clear();
+                return true;
+            }
+            if (!overlaps) {
+                dst = lhs;
+                return true;
+            }
+            if (rhsIsRect && contains(rb, lb)) {
+                dst.clear();
+                return true;
+            }
+            break;
+
+        case op_or:
+        case op_xor: {
+            if (rhsEmpty) {
+                dst = lhs;
+                return true;
+            }
+            if (op == op_or) {
+                if (rhsIsRect && (lhsEmpty || contains(rb, lb))) {
+                    dst.set(rb);
+                    return true;
+                }
+                if (lhs.isRect() && contains(lb, rb)) {
+                    dst = lhs;
+                    return true;
+                }
+            }
+            if (!lhsEmpty && lb.bottom >= rb.top && rb.bottom >= lb.top) {
+                // the bounds overlap or touch vertically, spans may need
+                // to be merged or split.
+                break;
+            }
+            // the result is just the rects of lhs and rhs, sorted in Y.
+            size_t lhsCount;
+            Rect const* lhsRects = lhs.getArray(&lhsCount);
+            if (lhsEmpty) {
+                lhsCount = 0;
+            }
+            const bool lhsFirst = lb.top < rb.top;
+            Vector<Rect> storage;
+            storage.setCapacity(lhsCount + rhsCount + 1);
+            if (lhsFirst) {
+                storage.appendArray(lhsRects, lhsCount);
+            }
+            for (size_t i=0 ; i<rhsCount ; i++) {
+                Rect r(rhs[i]);
+                storage.add(r.offsetBy(dx, dy));
+            }
+            if (!lhsFirst) {
+                storage.appendArray(lhsRects, lhsCount);
+            }
+            if (storage.size() > 1) {
+                Rect bounds(rb);
+                if (!lhsEmpty) {
+                    bounds.left   = lb.left   < rb.left   ? lb.left   : rb.left;
+                    bounds.top    = lb.top    < rb.top    ? lb.top    : rb.top;
+                    bounds.right  = lb.right  > rb.right  ? lb.right  : rb.right;
+                    bounds.bottom = lb.bottom > rb.bottom ? lb.bottom : rb.bottom;
+                }
+                storage.add(bounds);
+            }
+            dst.setStorage(storage);
+            return true;
+        }
+    }
+    return false;
+}
+
 void Region::boolean_operation(int op, Region& dst,
         const Region& lhs,
         const Region& rhs, int dx, int dy)
@@ -421,6 +589,16 @@ void Region::boolean_operation(int op, Region& dst,
     size_t rhs_count;
     Rect const * const rhs_rects = rhs.getArray(&rhs_count);
 
+#if !VALIDATE_WITH_CORECG
+    if (boolean_operation_fast(op, dst, lhs,
+            rhs_rects, rhs_count, rhs.getBounds(), dx, dy)) {
+#if VALIDATE_REGIONS
+        validate(dst, "boolean_operation (fast): dst");
+#endif
+        return;
+    }
+#endif
+
     region_operator<Rect>::region lhs_region(lhs_rects, lhs_count);
     region_operator<Rect>::region rhs_region(rhs_rects, rhs_count, dx, dy);
     region_operator<Rect> operation(op, lhs_region, rhs_region);
@@ -528,6 +706,10 @@ void Region::boolean_operation(int op, Region& dst,
 #if VALIDATE_WITH_CORECG || VALIDATE_REGIONS
     boolean_operation(op, dst, lhs, Region(rhs), dx, dy);
 #else
+    if (boolean_operation_fast(op, dst, lhs, &rhs, 1, rhs, dx, dy)) {
+        return;
+    }
+
     size_t lhs_count;
     Rect const * const lhs_rects = lhs.getArray(&lhs_count);
 
@@ -554,19 +736,43 @@ void Region::boolean_operation(int op, Region& dst,
     boolean_operation(op, dst, lhs, rhs, 0, 0);
 }
 
+// A Rect is 4 int32_t, offsetting it is adding {dx, dy, dx, dy} to them;
+// with NEON or SSE2, 2 rects are done at a time.
+static void translateRects(Rect* rects, size_t count, int dx, int dy)
+{
+    COMPILE_TIME_ASSERT_FUNCTION_SCOPE(sizeof(Rect) == 4 * sizeof(int32_t));
+    int32_t* p = reinterpret_cast<int32_t*>(rects);
+#if defined(__ARM_NEON__)
+    const int32_t d[4] = { dx, dy, dx, dy };
+    const int32x4_t offset = vld1q_s32(d);
+    for (; count >= 2; count -= 2, p += 8) {
+        vst1q_s32(p,     vaddq_s32(vld1q_s32(p),     offset));
+        vst1q_s32(p + 4, vaddq_s32(vld1q_s32(p + 4), offset));
+    }
+#elif defined(__SSE2__)
+    const __m128i offset = _mm_setr_epi32(dx, dy, dx, dy);
+    for (; count >= 2; count -= 2, p += 8) {
+        __m128i* v = reinterpret_cast<__m128i*>(p);
+        _mm_storeu_si128(v,     _mm_add_epi32(_mm_loadu_si128(v),     offset));
+        _mm_storeu_si128(v + 1, _mm_add_epi32(_mm_loadu_si128(v + 1), offset));
+    }
+#endif
+    for (; count > 0; count--, p += 4) {
+        p[0] += dx;
+        p[1] += dy;
+        p[2] += dx;
+        p[3] += dy;
+    }
+}
+
 void Region::translate(Region& reg, int dx, int dy)
 {
     if ((dx || dy) && !reg.isEmpty()) {
 #if VALIDATE_REGIONS
         validate(reg, "translate (before)");
 #endif
-        size_t count = reg.mStorage.size();
-        Rect* rects = reg.mStorage.editArray();
-        while (count) {
-            rects->translate(dx, dy);
-            rects++;
-            count--;
-        }
+        // this is where a shared storage gets copied
+        translateRects(reg.editStorageArray(), reg.storageSize(), dx, dy);
 #if VALIDATE_REGIONS
         validate(reg, "translate (after)");
 #endif
@@ -582,7 +788,7 @@ void Region::translate(Region& dst, const Region& reg, int dx, int dy)
 // ----------------------------------------------------------------------------
 
 size_t Region::getSize() const {
-    return mStorage.size() * sizeof(Rect);
+    return storageSize() * sizeof(Rect);
 }
 
 status_t Region::flatten(void* buffer) const {
@@ -590,22 +796,27 @@ status_t Region::flatten(void* buffer) const {
     validate(*this, "Region::flatten");
 #endif
     Rect* rects = reinterpret_cast<Rect*>(buffer);
-    memcpy(rects, mStorage.array(), mStorage.size() * sizeof(Rect));
+    memcpy(rects, storageArray(), storageSize() * sizeof(Rect));
     return NO_ERROR;
 }
 
 status_t Region::unflatten(void const* buffer, size_t size) {
+    // the rects are copied once, straight out of the parcel; a large
+    // region then shares its storage with the copies made of it until
+    // one of them is modified.
     Region result;
     if (size >= sizeof(Rect)) {
         Rect const* rects = reinterpret_cast<Rect const*>(buffer);
         size_t count = size / sizeof(Rect);
-        if (count > 0) {
+        if (count > INLINE_CAPACITY) {
             result.mStorage.clear();
-            ssize_t err = result.mStorage.insertAt(0, count);
+            ssize_t err = result.mStorage.appendArray(rects, count);
             if (err < 0) {
                 return status_t(err);
             }
-            memcpy(result.mStorage.editArray(), rects, count*sizeof(Rect));
+            result.mInlineCount = 0;
+        } else if (count > 0) {
+            result.setStorage(rects, count);
         }
     }
 #if VALIDATE_REGIONS
@@ -616,19 +827,20 @@ status_t Region::unflatten(void const* buffer, size_t size) {
         ALOGE("Region::unflatten() failed, invalid region");
         return BAD_VALUE;
     }
-    mStorage = result.mStorage;
+    // doesn't copy a large region's rects
+    *this = result;
     return NO_ERROR;
 }
 
 // ----------------------------------------------------------------------------
 
 Region::const_iterator Region::begin() const {
-    return mStorage.array();
+    return storageArray();
 }
 
 Region::const_iterator Region::end() const {
-    size_t numRects = isRect() ? 1 : mStorage.size() - 1;
-    return mStorage.array() + numRects;
+    size_t numRects = isRect() ? 1 : storageSize() - 1;
+    return storageArray() + numRects;
 }
 
 Rect const* Region::getArray(size_t* count) const {
@@ -639,14 +851,25 @@ Rect const* Region::getArray(size_t* count) const {
 }
 
 SharedBuffer const* Region::getSharedBuffer(size_t* count) const {
-    // We can get to the SharedBuffer of a Vector<Rect> because Rect has
-    // a trivial destructor.
-    SharedBuffer const* sb = SharedBuffer::bufferFromData(mStorage.array());
+    size_t numRects = isRect() ? 1 : storageSize() - 1;
+    SharedBuffer const* sb;
+    if (mInlineCount) {
+        // the rects are stored inline, we need to make a copy
+        SharedBuffer* buffer = SharedBuffer::alloc(storageSize() * sizeof(Rect));
+        if (buffer == 0) {
+            return 0;
+        }
+        memcpy(buffer->data(), mInline, storageSize() * sizeof(Rect));
+        sb = buffer;
+    } else {
+        // We can get to the SharedBuffer of a Vector<Rect> because Rect has
+        // a trivial destructor.
+        sb = SharedBuffer::bufferFromData(mStorage.array());
+        sb->acquire();
+    }
     if (count) {
-        size_t numRects = isRect() ? 1 : mStorage.size() - 1;
         count[0] = numRects;
     }
-    sb->acquire();
     return sb;
 }
 
@@ -18,11 +18,107 @@
 
 #include <stdio.h>
 #include <utils/Debug.h>
+#include <utils/Timers.h>
 #include <ui/Rect.h>
 #include <ui/Region.h>
 
 using namespace android;
 
+// ---------------------------------------------------------------------------
+
+static const size_t kIterations = 200000;
+
+template <typename OP>
+static void benchmark(const char* name, OP op)
+{
+    // warm-up
+    for (size_t i=0 ; i<kIterations/10 ; i++) {
+        op(i);
+    }
+    const nsecs_t start = systemTime();
+    for (size_t i=0 ; i<kIterations ; i++) {
+        op(i);
+    }
+    const nsecs_t duration = systemTime() - start;
+    printf("%-32s: %10.0f ops/s (%6.1f ns/op)\n", name,
+            kIterations * 1e9 / duration, double(duration) / kIterations);
+}
+
+// a region looking like what SurfaceFlinger deals with: a status bar,
+// a navigation bar and a window in between, with a hole in it.
+static Region makeScreen(int dx)
+{
+    Region r(Rect(0, 0, 720, 50));
+    r.orSelf(Rect(0, 1184, 720, 1280));
+    r.orSelf(Rect(dx, 100, 600 + dx, 1000));
+    r.subtractSelf(Rect(200 + dx, 400, 300 + dx, 500));
+    return r;
+}
+
+struct RectAndRect {
+    void operator()(size_t i) const {
+        Region r(Rect(0, 0, 720, 1280));
+        r.andSelf(Rect(i & 0xff, 0, 400, 1280));
+    }
+};
+
+struct RectMinusRect {
+    void operator()(size_t i) const {
+        Region r(Rect(0, 0, 720, 1280));
+        r.subtractSelf(Rect(i & 0xff, 50, 400, 1184));
+    }
+};
+
+struct RegionOrDisjointRect {
+    const Region screen;
+    RegionOrDisjointRect() : screen(makeScreen(0)) { }
+    void operator()(size_t i) const {
+        Region r(screen);
+        r.orSelf(Rect(0, 1300, 720, 1400 + (i & 0xff)));
+    }
+};
+
+struct RegionAndDisjointRegion {
+    const Region screen;
+    const Region other;
+    RegionAndDisjointRegion()
+        : screen(makeScreen(0)), other(Rect(800, 0, 1000, 1280)) { }
+    void operator()(size_t i) const {
+        Region r(screen.intersect(other));
+    }
+};
+
+struct RegionOrRegion {
+    const Region a;
+    const Region b;
+    RegionOrRegion() : a(makeScreen(0)), b(makeScreen(60)) { }
+    void operator()(size_t i) const {
+        Region r(a.merge(b));
+    }
+};
+
+struct RegionMinusRegion {
+    const Region a;
+    const Region b;
+    RegionMinusRegion() : a(makeScreen(0)), b(makeScreen(60)) { }
+    void operator()(size_t i) const {
+        Region r(a.subtract(b));
+    }
+};
+
+static void runBenchmarks()
+{
+    printf("Region benchmarks (%u iterations)\n", kIterations);
+    benchmark("rect & rect", RectAndRect());
+    benchmark("rect - rect", RectMinusRect());
+    benchmark("region | disjoint rect", RegionOrDisjointRect());
+    benchmark("region & disjoint region", RegionAndDisjointRegion());
+    benchmark("region | region", RegionOrRegion());
+    benchmark("region - region", RegionMinusRegion());
+}
+
+// ---------------------------------------------------------------------------
+
 int main()
 {
     Region empty;
@@ -63,7 +159,9 @@ int main()
     reg0.dump("reg0");
     reg1.dump("reg1");
     reg2.dump("reg2");
-    
+
+    runBenchmarks();
+
     return 0;
 }
 
@@ -25,10 +25,14 @@ commonSources:= \
 	Debug.cpp \
 	FileMap.cpp \
 	Flattenable.cpp \
+	LinearHashtable.cpp \
 	LinearTransform.cpp \
 	Log.cpp \
+	Profiler.cpp \
 	PropertyMap.cpp \
+	ProtoOutput.cpp \
 	RefBase.cpp \
+	ScalableRWLock.cpp \
 	SharedBuffer.cpp \
 	Static.cpp \
 	StopWatch.cpp \
@@ -37,6 +41,7 @@ commonSources:= \
 	StringArray.cpp \
 	SystemClock.cpp \
 	TextOutput.cpp \
+	ThreadPool.cpp \
 	Threads.cpp \
 	Timers.cpp \
 	Tokenizer.cpp \
@@ -39,20 +39,17 @@ BlobCache::BlobCache(size_t maxKeySize, size_t maxValueSize, size_t maxTotalSize
         mMaxKeySize(maxKeySize),
         mMaxValueSize(maxValueSize),
         mMaxTotalSize(maxTotalSize),
-        mTotalSize(0) {
-    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
-#ifdef _WIN32
-    srand(now);
-#else
-    mRandState[0] = (now >> 0) & 0xFFFF;
-    mRandState[1] = (now >> 16) & 0xFFFF;
-    mRandState[2] = (now >> 32) & 0xFFFF;
-#endif
-    ALOGV("initializing random seed using %lld", now);
+        mTotalSize(0),
+        mUseCount(0) {
 }
 
 void BlobCache::set(const void* key, size_t keySize, const void* value,
         size_t valueSize) {
+    setImpl(key, keySize, value, valueSize, true);
+}
+
+void BlobCache::setImpl(const void* key, size_t keySize, const void* value,
+        size_t valueSize, bool copyData) {
     if (mMaxKeySize < keySize) {
         ALOGV("set: not caching because the key is too large: %d (limit: %d)",
                 keySize, mMaxKeySize);
@@ -77,15 +74,13 @@ void BlobCache::set(const void* key, size_t keySize, const void* value,
         return;
     }
 
-    sp<Blob> dummyKey(new Blob(key, keySize, false));
-    CacheEntry dummyEntry(dummyKey, NULL);
+    const BlobKey lookupKey(key, keySize);
+    const hash_t hash = lookupKey.hash();
 
     while (true) {
-        ssize_t index = mCacheEntries.indexOf(dummyEntry);
+        ssize_t index = mCacheEntries.find(-1, hash, lookupKey);
         if (index < 0) {
             // Create a new cache entry.
-            sp<Blob> keyBlob(new Blob(key, keySize, true));
-            sp<Blob> valueBlob(new Blob(value, valueSize, true));
             size_t newTotalSize = mTotalSize + keySize + valueSize;
             if (mMaxTotalSize < newTotalSize) {
                 if (isCleanable()) {
@@ -100,14 +95,15 @@ void BlobCache::set(const void* key, size_t keySize, const void* value,
                     break;
                 }
             }
-            mCacheEntries.add(CacheEntry(keyBlob, valueBlob));
+            sp<Blob> keyBlob(new Blob(key, keySize, copyData));
+            sp<Blob> valueBlob(new Blob(value, valueSize, copyData));
+            mCacheEntries.add(hash, CacheEntry(keyBlob, valueBlob, mUseCount++));
             mTotalSize = newTotalSize;
             ALOGV("set: created new cache entry with %d byte key and %d byte value",
                     keySize, valueSize);
         } else {
             // Update the existing cache entry.
-            sp<Blob> valueBlob(new Blob(value, valueSize, true));
-            sp<Blob> oldValueBlob(mCacheEntries[index].getValue());
+            sp<Blob> oldValueBlob(mCacheEntries.entryAt(index).getValue());
             size_t newTotalSize = mTotalSize + valueSize - oldValueBlob->getSize();
             if (mMaxTotalSize < newTotalSize) {
                 if (isCleanable()) {
@@ -121,7 +117,10 @@ void BlobCache::set(const void* key, size_t keySize, const void* value,
                     break;
                 }
             }
-            mCacheEntries.editItemAt(index).setValue(valueBlob);
+            sp<Blob> valueBlob(new Blob(value, valueSize, copyData));
+            CacheEntry& entry(mCacheEntries.editEntryAt(index));
+            entry.setValue(valueBlob);
+            entry.setLastUse(mUseCount++);
             mTotalSize = newTotalSize;
             ALOGV("set: updated existing cache entry with %d byte key and %d byte "
                     "value", keySize, valueSize);
@@ -137,9 +136,8 @@ size_t BlobCache::get(const void* key, size_t keySize, void* value,
                 keySize, mMaxKeySize);
         return 0;
     }
-    sp<Blob> dummyKey(new Blob(key, keySize, false));
-    CacheEntry dummyEntry(dummyKey, NULL);
-    ssize_t index = mCacheEntries.indexOf(dummyEntry);
+    const BlobKey lookupKey(key, keySize);
+    ssize_t index = mCacheEntries.find(-1, lookupKey.hash(), lookupKey);
     if (index < 0) {
         ALOGV("get: no cache entry found for key of size %d", keySize);
         return 0;
@@ -147,7 +145,9 @@ size_t BlobCache::get(const void* key, size_t keySize, void* value,
 
     // The key was found. Return the value if the caller's buffer is large
     // enough.
-    sp<Blob> valueBlob(mCacheEntries[index].getValue());
+    CacheEntry& entry(mCacheEntries.editEntryAt(index));
+    entry.setLastUse(mUseCount++);
+    sp<Blob> valueBlob(entry.getValue());
     size_t valueBlobSize = valueBlob->getSize();
     if (valueBlobSize <= valueSize) {
         ALOGV("get: copying %d bytes to caller's buffer", valueBlobSize);
@@ -165,9 +165,9 @@ static inline size_t align4(size_t size) {
 
 size_t BlobCache::getFlattenedSize() const {
     size_t size = sizeof(Header);
-    for (size_t i = 0; i < mCacheEntries.size(); i++) {
-        const CacheEntry& e(mCacheEntries[i]);
-        sp<Blob> keyBlob = e.getKey();
+    for (ssize_t i = mCacheEntries.next(-1); i >= 0; i = mCacheEntries.next(i)) {
+        const CacheEntry& e(mCacheEntries.entryAt(i));
+        sp<Blob> keyBlob = e.getKeyBlob();
         sp<Blob> valueBlob = e.getValue();
         size = align4(size);
         size += sizeof(EntryHeader) + keyBlob->getSize() +
@@ -198,12 +198,14 @@ status_t BlobCache::flatten(void* buffer, size_t size, int fds[], size_t count)
     header->mDeviceVersion = blobCacheDeviceVersion;
     header->mNumEntries = mCacheEntries.size();
 
-    // Write cache entries
+    // Write cache entries, least recently used first, so that unflattening
+    // them in order restores their relative ages.
     uint8_t* byteBuffer = reinterpret_cast<uint8_t*>(buffer);
     off_t byteOffset = align4(sizeof(Header));
-    for (size_t i = 0; i < mCacheEntries.size(); i++) {
-        const CacheEntry& e(mCacheEntries[i]);
-        sp<Blob> keyBlob = e.getKey();
+    Vector<size_t> entries(getEntriesByAge());
+    for (size_t i = 0; i < entries.size(); i++) {
+        const CacheEntry& e(mCacheEntries.entryAt(entries[i]));
+        sp<Blob> keyBlob = e.getKeyBlob();
         sp<Blob> valueBlob = e.getValue();
         size_t keySize = keyBlob->getSize();
         size_t valueSize = valueBlob->getSize();
@@ -230,13 +232,25 @@ status_t BlobCache::flatten(void* buffer, size_t size, int fds[], size_t count)
 
 status_t BlobCache::unflatten(void const* buffer, size_t size, int fds[],
         size_t count) {
-    // All errors should result in the BlobCache being in an empty state.
-    mCacheEntries.clear();
-
     if (count != 0) {
+        // All errors should result in the BlobCache being in an empty state.
+        mCacheEntries.clear();
+        mTotalSize = 0;
         ALOGE("unflatten: nonzero fd count: %zu", count);
         return BAD_VALUE;
     }
+    return unflattenImpl(buffer, size, true);
+}
+
+status_t BlobCache::unflattenInPlace(void const* buffer, size_t size) {
+    return unflattenImpl(buffer, size, false);
+}
+
+status_t BlobCache::unflattenImpl(void const* buffer, size_t size,
+        bool copyData) {
+    // All errors should result in the BlobCache being in an empty state.
+    mCacheEntries.clear();
+    mTotalSize = 0;
 
     // Read the cache header
     if (size < sizeof(Header)) {
@@ -261,6 +275,7 @@ status_t BlobCache::unflatten(void const* buffer, size_t size, int fds[],
     for (size_t i = 0; i < numEntries; i++) {
         if (byteOffset + sizeof(EntryHeader) > size) {
             mCacheEntries.clear();
+            mTotalSize = 0;
             ALOGE("unflatten: not enough room for cache entry headers");
             return BAD_VALUE;
         }
@@ -273,12 +288,13 @@ status_t BlobCache::unflatten(void const* buffer, size_t size, int fds[],
 
         if (byteOffset + entrySize > size) {
             mCacheEntries.clear();
+            mTotalSize = 0;
             ALOGE("unflatten: not enough room for cache entry headers");
             return BAD_VALUE;
         }
 
         const uint8_t* data = eheader->mData;
-        set(data, keySize, data + keySize, valueSize);
+        setImpl(data, keySize, data + keySize, valueSize, copyData);
 
         byteOffset += align4(entrySize);
     }
@@ -286,22 +302,47 @@ status_t BlobCache::unflatten(void const* buffer, size_t size, int fds[],
     return OK;
 }
 
-long int BlobCache::blob_random() {
-#ifdef _WIN32
-    return rand();
-#else
-    return nrand48(mRandState);
-#endif
+struct EntryAge {
+    uint32_t age;
+    size_t index;
+};
+
+static int compareEntryAges(const EntryAge* lhs, const EntryAge* rhs) {
+    // oldest first
+    if (lhs->age != rhs->age) {
+        return lhs->age > rhs->age ? -1 : 1;
+    }
+    return 0;
+}
+
+Vector<size_t> BlobCache::getEntriesByAge() const {
+    Vector<EntryAge> ages;
+    ages.setCapacity(mCacheEntries.size());
+    for (ssize_t i = mCacheEntries.next(-1); i >= 0; i = mCacheEntries.next(i)) {
+        EntryAge entryAge;
+        entryAge.age = mUseCount - mCacheEntries.entryAt(i).getLastUse();
+        entryAge.index = i;
+        ages.add(entryAge);
+    }
+    ages.sort(compareEntryAges);
+
+    Vector<size_t> indices;
+    indices.setCapacity(ages.size());
+    for (size_t i = 0; i < ages.size(); i++) {
+        indices.add(ages[i].index);
+    }
+    return indices;
 }
 
 void BlobCache::clean() {
-    // Remove a random cache entry until the total cache size gets below half
-    // the maximum total cache size.
-    while (mTotalSize > mMaxTotalSize / 2) {
-        size_t i = size_t(blob_random() % (mCacheEntries.size()));
-        const CacheEntry& entry(mCacheEntries[i]);
-        mTotalSize -= entry.getKey()->getSize() + entry.getValue()->getSize();
-        mCacheEntries.removeAt(i);
+    // Remove the least recently used cache entries until the total cache size
+    // gets below half the maximum total cache size.  Removing an entry doesn't
+    // move the others, so the indices stay valid.
+    Vector<size_t> entries(getEntriesByAge());
+    for (size_t i = 0; i < entries.size() && mTotalSize > mMaxTotalSize / 2; i++) {
+        const CacheEntry& entry(mCacheEntries.entryAt(entries[i]));
+        mTotalSize -= entry.getKeyBlob()->getSize() + entry.getValue()->getSize();
+        mCacheEntries.removeAt(entries[i]);
     }
 }
 
@@ -324,14 +365,6 @@ BlobCache::Blob::~Blob() {
     }
 }
 
-bool BlobCache::Blob::operator<(const Blob& rhs) const {
-    if (mSize == rhs.mSize) {
-        return memcmp(mData, rhs.mData, mSize) < 0;
-    } else {
-        return mSize < rhs.mSize;
-    }
-}
-
 const void* BlobCache::Blob::getData() const {
     return mData;
 }
@@ -340,30 +373,58 @@ size_t BlobCache::Blob::getSize() const {
     return mSize;
 }
 
-BlobCache::CacheEntry::CacheEntry() {
+BlobCache::BlobKey::BlobKey(const void* data, size_t size):
+        mData(data),
+        mSize(size) {
+}
+
+bool BlobCache::BlobKey::operator==(const BlobKey& rhs) const {
+    return mSize == rhs.mSize && memcmp(mData, rhs.mData, mSize) == 0;
+}
+
+bool BlobCache::BlobKey::operator!=(const BlobKey& rhs) const {
+    return !(*this == rhs);
+}
+
+hash_t BlobCache::BlobKey::hash() const {
+    // FNV-1a
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(mData);
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < mSize; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+BlobCache::CacheEntry::CacheEntry():
+        mLastUse(0) {
 }
 
-BlobCache::CacheEntry::CacheEntry(const sp<Blob>& key, const sp<Blob>& value):
+BlobCache::CacheEntry::CacheEntry(const sp<Blob>& key, const sp<Blob>& value,
+        uint32_t lastUse):
         mKey(key),
-        mValue(value) {
+        mValue(value),
+        mLastUse(lastUse) {
 }
 
 BlobCache::CacheEntry::CacheEntry(const CacheEntry& ce):
         mKey(ce.mKey),
-        mValue(ce.mValue) {
-}
-
-bool BlobCache::CacheEntry::operator<(const CacheEntry& rhs) const {
-    return *mKey < *rhs.mKey;
+        mValue(ce.mValue),
+        mLastUse(ce.mLastUse) {
 }
 
 const BlobCache::CacheEntry& BlobCache::CacheEntry::operator=(const CacheEntry& rhs) {
     mKey = rhs.mKey;
     mValue = rhs.mValue;
+    mLastUse = rhs.mLastUse;
     return *this;
 }
 
-sp<BlobCache::Blob> BlobCache::CacheEntry::getKey() const {
+BlobCache::BlobKey BlobCache::CacheEntry::getKey() const {
+    return BlobKey(mKey->getData(), mKey->getSize());
+}
+
+sp<BlobCache::Blob> BlobCache::CacheEntry::getKeyBlob() const {
     return mKey;
 }
 
@@ -371,8 +432,16 @@ sp<BlobCache::Blob> BlobCache::CacheEntry::getValue() const {
     return mValue;
 }
 
+uint32_t BlobCache::CacheEntry::getLastUse() const {
+    return mLastUse;
+}
+
 void BlobCache::CacheEntry::setValue(const sp<Blob>& value) {
     mValue = value;
 }
 
+void BlobCache::CacheEntry::setLastUse(uint32_t lastUse) {
+    mLastUse = lastUse;
+}
+
 } // namespace android
@@ -21,6 +21,8 @@
 #include <utils/Log.h>
 #include <utils/Errors.h>
 #include <utils/CallStack.h>
+#include <utils/KeyedVector.h>
+#include <utils/Mutex.h>
 #include <corkscrew/backtrace.h>
 
 /*****************************************************************************/
@@ -96,6 +98,51 @@ void CallStack::update(int32_t ignoreDepth, int32_t maxDepth) {
     mCount = count > 0 ? count : 0;
 }
 
+uint32_t CallStack::hash() const {
+    // FNV-1a over the frame addresses, the rest of the frames depends on
+    // where the stack was when they were captured
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < mCount; i++) {
+        uintptr_t pc = mStack[i].absolute_pc;
+        for (size_t j = 0; j < sizeof(pc); j++) {
+            hash = (hash ^ uint8_t(pc >> (j * 8))) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+bool CallStack::sameFrames(const CallStack& rhs) const {
+    if (mCount != rhs.mCount)
+        return false;
+    for (size_t i = 0; i < mCount; i++) {
+        if (mStack[i].absolute_pc != rhs.mStack[i].absolute_pc)
+            return false;
+    }
+    return true;
+}
+
+static Mutex sInternLock;
+static KeyedVector<uint32_t, const CallStack*> sInterned;
+
+const CallStack* CallStack::intern() const {
+    Mutex::Autolock _l(sInternLock);
+    // stacks whose hashes collide take the next free key
+    uint32_t key = hash();
+    for (;;) {
+        ssize_t index = sInterned.indexOfKey(key);
+        if (index < 0) {
+            const CallStack* stack = new CallStack(*this);
+            sInterned.add(key, stack);
+            return stack;
+        }
+        const CallStack* stack = sInterned.valueAt(index);
+        if (sameFrames(*stack)) {
+            return stack;
+        }
+        key++;
+    }
+}
+
 void CallStack::dump(const char* prefix) const {
     backtrace_symbol_t symbols[mCount];
 
@@ -22,6 +22,7 @@
 
 #include <utils/FileMap.h>
 #include <utils/Log.h>
+#include <utils/threads.h>
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -39,13 +40,15 @@ using namespace android;
 
 /*static*/ long FileMap::mPageSize = -1;
 
+static Mutex gDefaultCreateOptionsLock;
+static FileMap::CreateOptions gDefaultCreateOptions;
 
 /*
  * Constructor.  Create an empty object.
  */
 FileMap::FileMap(void)
     : mRefCount(1), mFileName(NULL), mBasePtr(NULL), mBaseLength(0),
-      mDataPtr(NULL), mDataLength(0)
+      mDataPtr(NULL), mDataLength(0), mPopulated(false)
 {
 }
 
@@ -80,6 +83,31 @@ FileMap::~FileMap(void)
 }
 
 
+/*
+ * Set the options used by create() when the caller doesn't pass any.
+ */
+/*static*/ void FileMap::setDefaultCreateOptions(const CreateOptions& options)
+{
+    Mutex::Autolock _l(gDefaultCreateOptionsLock);
+    gDefaultCreateOptions = options;
+}
+
+/*static*/ FileMap::CreateOptions FileMap::getDefaultCreateOptions()
+{
+    Mutex::Autolock _l(gDefaultCreateOptionsLock);
+    return gDefaultCreateOptions;
+}
+
+/*
+ * Create a new mapping on an open file, with the default options.
+ */
+bool FileMap::create(const char* origFileName, int fd, off64_t offset, size_t length,
+        bool readOnly)
+{
+    return create(origFileName, fd, offset, length, readOnly,
+            getDefaultCreateOptions());
+}
+
 /*
  * Create a new mapping on an open file.
  *
@@ -89,7 +117,7 @@ FileMap::~FileMap(void)
  * Returns "false" on failure.
  */
 bool FileMap::create(const char* origFileName, int fd, off64_t offset, size_t length,
-        bool readOnly)
+        bool readOnly, const CreateOptions& options)
 {
 #ifdef HAVE_WIN32_FILEMAP
     int     adjust;
@@ -165,6 +193,12 @@ try_again:
     prot = PROT_READ;
     if (!readOnly)
         prot |= PROT_WRITE;
+#ifdef MAP_POPULATE
+    if (options.populate && adjLength <= kMaxPopulateLength) {
+        flags |= MAP_POPULATE;
+        mPopulated = true;
+    }
+#endif
 
     ptr = mmap(NULL, adjLength, prot, flags, fd, adjOffset);
     if (ptr == MAP_FAILED) {
@@ -193,6 +227,18 @@ try_again:
     ALOGV("MAP: base %p/%d data %p/%d\n",
         mBasePtr, (int) mBaseLength, mDataPtr, (int) mDataLength);
 
+    /*
+     * The hints are only worth a warning if they fail, the map itself is
+     * fine.
+     */
+    if (options.advice != NORMAL)
+        advise(options.advice);
+
+    if (options.populate && !mPopulated)
+        readAhead(0, mDataLength);
+    else if (options.readAheadLength > 0 && !mPopulated)
+        readAhead(0, options.readAheadLength);
+
     return true;
 }
 
@@ -223,3 +269,74 @@ int FileMap::advise(MapAdvice advice)
 	return -1;
 #endif // HAVE_MADVISE
 }
+
+/*
+ * Start paging in part of the map.
+ *
+ * MADV_WILLNEED on a file mapping kicks off the same asynchronous page
+ * cache read as readahead() on the file, and doesn't need the fd, which
+ * we don't own and may have been closed by now.
+ */
+int FileMap::readAhead(size_t offset, size_t length)
+{
+#if HAVE_MADVISE
+    if (offset >= mDataLength)
+        return 0;
+    if (length > mDataLength - offset)
+        length = mDataLength - offset;
+
+    /* madvise() needs a page aligned start, mBasePtr is */
+    size_t start = (char*) mDataPtr - (char*) mBasePtr + offset;
+    size_t adjust = start % mPageSize;
+    start -= adjust;
+    length += adjust;
+
+    int cc = madvise((char*) mBasePtr + start, length, MADV_WILLNEED);
+    if (cc != 0)
+        ALOGW("madvise(WILLNEED) failed: %s\n", strerror(errno));
+    return cc;
+#else
+    return -1;
+#endif // HAVE_MADVISE
+}
+
+/*
+ * Count the resident pages of the map.
+ */
+int FileMap::getPageStats(PageStats* outStats) const
+{
+#ifdef HAVE_POSIX_FILEMAP
+    const size_t pageCount = (mBaseLength + mPageSize - 1) / mPageSize;
+
+    outStats->totalPages = pageCount;
+    outStats->residentPages = 0;
+    outStats->populated = mPopulated;
+
+    /* check a chunk at a time, so huge maps don't need a huge vector */
+    const size_t kChunkPages = 256;
+    unsigned char vec[kChunkPages];
+    for (size_t page = 0; page < pageCount; page += kChunkPages) {
+        size_t count = pageCount - page;
+        if (count > kChunkPages)
+            count = kChunkPages;
+#ifdef __APPLE__
+        int cc = mincore((char*) mBasePtr + page * mPageSize,
+                count * mPageSize, (char*) vec);
+#else
+        int cc = mincore((char*) mBasePtr + page * mPageSize,
+                count * mPageSize, vec);
+#endif
+        if (cc != 0) {
+            ALOGW("mincore failed: %s\n", strerror(errno));
+            return -1;
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (vec[i] & 1)
+                outStats->residentPages++;
+        }
+    }
+    return 0;
+#else
+    return -1;
+#endif // HAVE_POSIX_FILEMAP
+}
@@ -0,0 +1,285 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "LinearHashtable"
+
+#include <math.h>
+
+#include <utils/Log.h>
+#include <utils/LinearHashtable.h>
+
+namespace android {
+
+static const size_t MIN_BUCKET_COUNT = 4;
+
+LinearHashtableImpl::LinearHashtableImpl(size_t entrySize, bool hasTrivialDestructor,
+        size_t minimumInitialCapacity, float loadFactor) :
+        mBucketSize(entrySize + sizeof(Bucket)), mHasTrivialDestructor(hasTrivialDestructor),
+        mLoadFactor(loadFactor), mSize(0),
+        mFilledBuckets(0), mBuckets(NULL) {
+    determineCapacity(minimumInitialCapacity, mLoadFactor, &mBucketCount, &mCapacity);
+}
+
+LinearHashtableImpl::LinearHashtableImpl(const LinearHashtableImpl& other) :
+        mBucketSize(other.mBucketSize), mHasTrivialDestructor(other.mHasTrivialDestructor),
+        mCapacity(other.mCapacity), mLoadFactor(other.mLoadFactor),
+        mSize(other.mSize), mFilledBuckets(other.mFilledBuckets),
+        mBucketCount(other.mBucketCount), mBuckets(other.mBuckets) {
+    if (mBuckets) {
+        SharedBuffer::bufferFromData(mBuckets)->acquire();
+    }
+}
+
+void LinearHashtableImpl::dispose() {
+    if (mBuckets) {
+        releaseBuckets(mBuckets, mBucketCount);
+    }
+}
+
+void LinearHashtableImpl::clone() {
+    if (mBuckets) {
+        void* newBuckets = allocateBuckets(mBucketCount);
+        for (size_t i = 0; i < mBucketCount; i++) {
+            const Bucket& fromBucket = bucketAt(mBuckets, i);
+            Bucket& toBucket = bucketAt(newBuckets, i);
+            toBucket.cookie = fromBucket.cookie;
+            if (fromBucket.cookie & Bucket::PRESENT) {
+                initializeBucketEntry(toBucket, fromBucket.entry);
+            }
+        }
+        releaseBuckets(mBuckets, mBucketCount);
+        mBuckets = newBuckets;
+    }
+}
+
+void LinearHashtableImpl::setTo(const LinearHashtableImpl& other) {
+    if (mBuckets) {
+        releaseBuckets(mBuckets, mBucketCount);
+    }
+
+    mCapacity = other.mCapacity;
+    mLoadFactor = other.mLoadFactor;
+    mSize = other.mSize;
+    mFilledBuckets = other.mFilledBuckets;
+    mBucketCount = other.mBucketCount;
+    mBuckets = other.mBuckets;
+
+    if (mBuckets) {
+        SharedBuffer::bufferFromData(mBuckets)->acquire();
+    }
+}
+
+void LinearHashtableImpl::clear() {
+    if (mBuckets) {
+        if (mFilledBuckets) {
+            SharedBuffer* sb = SharedBuffer::bufferFromData(mBuckets);
+            if (sb->onlyOwner()) {
+                destroyBuckets(mBuckets, mBucketCount);
+                for (size_t i = 0; i < mBucketCount; i++) {
+                    Bucket& bucket = bucketAt(mBuckets, i);
+                    bucket.cookie = Bucket::EMPTY;
+                }
+            } else {
+                releaseBuckets(mBuckets, mBucketCount);
+                mBuckets = NULL;
+            }
+            mFilledBuckets = 0;
+        }
+        mSize = 0;
+    }
+}
+
+ssize_t LinearHashtableImpl::next(ssize_t index) const {
+    if (mSize) {
+        while (size_t(++index) < mBucketCount) {
+            const Bucket& bucket = bucketAt(mBuckets, index);
+            if (bucket.cookie & Bucket::PRESENT) {
+                return index;
+            }
+        }
+    }
+    return -1;
+}
+
+ssize_t LinearHashtableImpl::find(ssize_t index, hash_t hash,
+        const void* __restrict__ key) const {
+    if (!mSize) {
+        return -1;
+    }
+
+    const uint32_t cookie = Bucket::PRESENT | mixHash(hash);
+    const size_t mask = mBucketCount - 1;
+    // The load factor guarantees an EMPTY bucket, which ends the search.
+    size_t i = (index < 0) ? (cookie & mask) : ((size_t(index) + 1) & mask);
+    for (;;) {
+        const Bucket& bucket = bucketAt(mBuckets, i);
+        if (bucket.cookie == cookie && compareBucketKey(bucket, key)) {
+            return i;
+        }
+        if (bucket.cookie == Bucket::EMPTY) {
+            return -1;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+size_t LinearHashtableImpl::add(hash_t hash, const void* entry) {
+    if (!mBuckets) {
+        mBuckets = allocateBuckets(mBucketCount);
+    } else {
+        edit();
+    }
+
+    hash = mixHash(hash);
+    for (;;) {
+        const size_t mask = mBucketCount - 1;
+        size_t index = hash & mask;
+        while (bucketAt(mBuckets, index).cookie & Bucket::PRESENT) {
+            index = (index + 1) & mask;
+        }
+
+        Bucket& bucket = bucketAt(mBuckets, index);
+        if (bucket.cookie == Bucket::EMPTY) {
+            if (mFilledBuckets >= mCapacity) {
+                if (mSize <= mCapacity / 2) {
+                    // mostly tombstones, clean them up without growing
+                    resize(mBucketCount);
+                } else {
+                    rehash(mCapacity * 2, mLoadFactor);
+                }
+                continue;
+            }
+            mFilledBuckets += 1;
+        }
+
+        bucket.cookie = Bucket::PRESENT | hash;
+        mSize += 1;
+        initializeBucketEntry(bucket, entry);
+        return index;
+    }
+}
+
+void LinearHashtableImpl::removeAt(size_t index) {
+    edit();
+
+    Bucket& bucket = bucketAt(mBuckets, index);
+    if (bucketAt(mBuckets, (index + 1) & (mBucketCount - 1)).cookie == Bucket::EMPTY) {
+        // no probe goes past this bucket, so it doesn't need a tombstone
+        bucket.cookie = Bucket::EMPTY;
+        mFilledBuckets -= 1;
+    } else {
+        bucket.cookie = Bucket::DELETED;
+    }
+    mSize -= 1;
+    if (!mHasTrivialDestructor) {
+        destroyBucketEntry(bucket);
+    }
+}
+
+void LinearHashtableImpl::rehash(size_t minimumCapacity, float loadFactor) {
+    if (minimumCapacity < mSize) {
+        minimumCapacity = mSize;
+    }
+    size_t newBucketCount, newCapacity;
+    determineCapacity(minimumCapacity, loadFactor, &newBucketCount, &newCapacity);
+
+    if (newBucketCount != mBucketCount || newCapacity != mCapacity) {
+        if (mBuckets) {
+            if (mSize) {
+                resize(newBucketCount);
+            } else {
+                releaseBuckets(mBuckets, mBucketCount);
+                mBuckets = NULL;
+                mFilledBuckets = 0;
+            }
+        }
+        mBucketCount = newBucketCount;
+        mCapacity = newCapacity;
+    }
+    mLoadFactor = loadFactor;
+}
+
+void LinearHashtableImpl::resize(size_t newBucketCount) {
+    void* newBuckets = allocateBuckets(newBucketCount);
+    const size_t mask = newBucketCount - 1;
+    for (size_t i = 0; i < mBucketCount; i++) {
+        const Bucket& fromBucket = bucketAt(mBuckets, i);
+        if (fromBucket.cookie & Bucket::PRESENT) {
+            size_t index = fromBucket.cookie & mask;
+            while (bucketAt(newBuckets, index).cookie != Bucket::EMPTY) {
+                index = (index + 1) & mask;
+            }
+            Bucket& toBucket = bucketAt(newBuckets, index);
+            toBucket.cookie = fromBucket.cookie;
+            initializeBucketEntry(toBucket, fromBucket.entry);
+        }
+    }
+    releaseBuckets(mBuckets, mBucketCount);
+    mBuckets = newBuckets;
+    mBucketCount = newBucketCount;
+    mFilledBuckets = mSize;
+}
+
+void* LinearHashtableImpl::allocateBuckets(size_t count) const {
+    size_t bytes = count * mBucketSize;
+    SharedBuffer* sb = SharedBuffer::alloc(bytes);
+    LOG_ALWAYS_FATAL_IF(!sb, "Could not allocate %u bytes for hashtable with %u buckets.",
+            uint32_t(bytes), uint32_t(count));
+    void* buckets = sb->data();
+    for (size_t i = 0; i < count; i++) {
+        Bucket& bucket = bucketAt(buckets, i);
+        bucket.cookie = Bucket::EMPTY;
+    }
+    return buckets;
+}
+
+void LinearHashtableImpl::releaseBuckets(void* __restrict__ buckets, size_t count) const {
+    SharedBuffer* sb = SharedBuffer::bufferFromData(buckets);
+    if (sb->release(SharedBuffer::eKeepStorage) == 1) {
+        destroyBuckets(buckets, count);
+        SharedBuffer::dealloc(sb);
+    }
+}
+
+void LinearHashtableImpl::destroyBuckets(void* __restrict__ buckets, size_t count) const {
+    if (!mHasTrivialDestructor) {
+        for (size_t i = 0; i < count; i++) {
+            Bucket& bucket = bucketAt(buckets, i);
+            if (bucket.cookie & Bucket::PRESENT) {
+                destroyBucketEntry(bucket);
+            }
+        }
+    }
+}
+
+void LinearHashtableImpl::determineCapacity(size_t minimumCapacity, float loadFactor,
+        size_t* __restrict__ outBucketCount, size_t* __restrict__ outCapacity) {
+    LOG_ALWAYS_FATAL_IF(loadFactor <= 0.0f || loadFactor > 1.0f,
+            "Invalid load factor %0.3f.  Must be in the range (0, 1].", loadFactor);
+
+    // one bucket is always left EMPTY to end the probes
+    size_t count = MIN_BUCKET_COUNT;
+    while (size_t(ceilf((count - 1) * loadFactor)) < minimumCapacity) {
+        LOG_ALWAYS_FATAL_IF(count > (SIZE_MAX >> 1), "Could not determine required "
+                "number of buckets for hashtable with minimum capacity %u and load "
+                "factor %0.3f.", uint32_t(minimumCapacity), loadFactor);
+        count <<= 1;
+    }
+    *outBucketCount = count;
+    *outCapacity = ceilf((count - 1) * loadFactor);
+}
+
+}; // namespace android
@@ -25,11 +25,17 @@ namespace android {
 
 template<class T> static inline T ABS(T x) { return (x < 0) ? -x : x; }
 
+// Returns log2(D) if D is a power of two, -1 otherwise.
+static inline int divisor_shift(uint32_t D) {
+    return (D & (D - 1)) ? -1 : __builtin_ctz(D);
+}
+
 // Static math methods involving linear transformations
 static bool scale_u64_to_u64(
         uint64_t val,
         uint32_t N,
         uint32_t D,
+        int      D_shift,
         uint64_t* res,
         bool round_up_not_down) {
     uint64_t tmp1, tmp2;
@@ -38,6 +44,24 @@ static bool scale_u64_to_u64(
     assert(res);
     assert(D);
 
+    // The deltas between nearby timestamps are below 2^32, then M = val * N
+    // fits in 64 bits and one division (or a shift) does.
+    if (!(val >> 32)) {
+        const uint64_t M = val * N;
+        uint64_t rem;
+        if (D_shift >= 0) {
+            *res = M >> D_shift;
+            rem = M & ((uint64_t(1) << D_shift) - 1);
+        } else {
+            *res = M / D;
+            rem = M - *res * D;
+        }
+        // M / D < 2^64, so this can't wrap
+        if (rem && round_up_not_down)
+            ++(*res);
+        return true;
+    }
+
     // Let U32(X) denote a uint32_t containing the upper 32 bits of a 64 bit
     // integer X.
     // Let L32(X) denote a uint32_t containing the lower 32 bits of a 64 bit
@@ -115,6 +139,7 @@ static bool linear_transform_s64_to_s64(
         int32_t  N,
         uint32_t D,
         bool     invert_frac,
+        int      divisor_shift,
         int64_t  basis2,
         int64_t* out) {
     uint64_t scaled, res;
@@ -140,6 +165,7 @@ static bool linear_transform_s64_to_s64(
     if (!scale_u64_to_u64(abs_val,
                           invert_frac ? D : ABS(N),
                           invert_frac ? ABS(N) : D,
+                          divisor_shift,
                           &scaled,
                           is_neg))
         return false; // overflow/undeflow
@@ -193,6 +219,7 @@ bool LinearTransform::doForwardTransform(int64_t a_in, int64_t* b_out) const {
                                        a_to_b_numer,
                                        a_to_b_denom,
                                        false,
+                                       divisor_shift(a_to_b_denom),
                                        b_zero,
                                        b_out);
 }
@@ -206,10 +233,53 @@ bool LinearTransform::doReverseTransform(int64_t b_in, int64_t* a_out) const {
                                        a_to_b_numer,
                                        a_to_b_denom,
                                        true,
+                                       divisor_shift(ABS(a_to_b_numer)),
                                        a_zero,
                                        a_out);
 }
 
+size_t LinearTransform::doForwardTransform(const int64_t* a_in, int64_t* b_out,
+                                           size_t count) const {
+    if (0 == a_to_b_denom || !a_in)
+        return 0;
+
+    const int shift = divisor_shift(a_to_b_denom);
+    size_t i;
+    for (i = 0; i < count; ++i) {
+        if (!linear_transform_s64_to_s64(a_in[i],
+                                         a_zero,
+                                         a_to_b_numer,
+                                         a_to_b_denom,
+                                         false,
+                                         shift,
+                                         b_zero,
+                                         &b_out[i]))
+            break;
+    }
+    return i;
+}
+
+size_t LinearTransform::doReverseTransform(const int64_t* b_in, int64_t* a_out,
+                                           size_t count) const {
+    if (0 == a_to_b_numer || !b_in)
+        return 0;
+
+    const int shift = divisor_shift(ABS(a_to_b_numer));
+    size_t i;
+    for (i = 0; i < count; ++i) {
+        if (!linear_transform_s64_to_s64(b_in[i],
+                                         b_zero,
+                                         a_to_b_numer,
+                                         a_to_b_denom,
+                                         true,
+                                         shift,
+                                         a_zero,
+                                         &a_out[i]))
+            break;
+    }
+    return i;
+}
+
 template <class T> void LinearTransform::reduce(T* N, T* D) {
     T a, b;
     if (!N || !D || !(*D)) {
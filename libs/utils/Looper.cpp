@@ -20,6 +20,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <sys/eventfd.h>
 
 
 namespace android {
@@ -61,45 +62,45 @@ int SimpleLooperCallback::handleEvent(int fd, int events, void* data) {
 static const int EPOLL_SIZE_HINT = 8;
 
 // Maximum number of file descriptors for which to retrieve poll events each iteration.
-static const int EPOLL_MAX_EVENTS = 16;
+// Busy loopers (input, sensors) often have many ready fds at once; dispatching them
+// from a single epoll_wait() saves a system call and a lock round trip per batch.
+static const int EPOLL_MAX_EVENTS = 64;
+
+// The epoll data of a registered fd: its request sequence number, and the fd.
+static inline uint64_t makeEpollData(uint32_t seq, int fd) {
+    return (uint64_t(seq) << 32) | uint32_t(fd);
+}
 
 static pthread_once_t gTLSOnce = PTHREAD_ONCE_INIT;
 static pthread_key_t gTLSKey = 0;
 
 Looper::Looper(bool allowNonCallbacks) :
-        mAllowNonCallbacks(allowNonCallbacks), mSendingMessage(false),
-        mResponseIndex(0), mNextMessageUptime(LLONG_MAX) {
-    int wakeFds[2];
-    int result = pipe(wakeFds);
-    LOG_ALWAYS_FATAL_IF(result != 0, "Could not create wake pipe.  errno=%d", errno);
-
-    mWakeReadPipeFd = wakeFds[0];
-    mWakeWritePipeFd = wakeFds[1];
-
-    result = fcntl(mWakeReadPipeFd, F_SETFL, O_NONBLOCK);
-    LOG_ALWAYS_FATAL_IF(result != 0, "Could not make wake read pipe non-blocking.  errno=%d",
-            errno);
-
-    result = fcntl(mWakeWritePipeFd, F_SETFL, O_NONBLOCK);
-    LOG_ALWAYS_FATAL_IF(result != 0, "Could not make wake write pipe non-blocking.  errno=%d",
+        mAllowNonCallbacks(allowNonCallbacks), mNextMessageSequence(0),
+        mSendingMessage(false), mNextRequestSeq(1), mResponseIndex(0),
+        mNextMessageUptime(LLONG_MAX) {
+    // An eventfd is a single counter, so any number of wakes is drained by one read.
+    mWakeEventFd = eventfd(0, 0);
+    LOG_ALWAYS_FATAL_IF(mWakeEventFd < 0, "Could not create wake eventfd.  errno=%d", errno);
+
+    int result = fcntl(mWakeEventFd, F_SETFL, O_NONBLOCK);
+    LOG_ALWAYS_FATAL_IF(result != 0, "Could not make wake eventfd non-blocking.  errno=%d",
             errno);
 
-    // Allocate the epoll instance and register the wake pipe.
+    // Allocate the epoll instance and register the wake eventfd.
     mEpollFd = epoll_create(EPOLL_SIZE_HINT);
     LOG_ALWAYS_FATAL_IF(mEpollFd < 0, "Could not create epoll instance.  errno=%d", errno);
 
     struct epoll_event eventItem;
     memset(& eventItem, 0, sizeof(epoll_event)); // zero out unused members of data field union
     eventItem.events = EPOLLIN;
-    eventItem.data.fd = mWakeReadPipeFd;
-    result = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mWakeReadPipeFd, & eventItem);
-    LOG_ALWAYS_FATAL_IF(result != 0, "Could not add wake read pipe to epoll instance.  errno=%d",
+    eventItem.data.u64 = makeEpollData(0, mWakeEventFd);
+    result = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mWakeEventFd, & eventItem);
+    LOG_ALWAYS_FATAL_IF(result != 0, "Could not add wake eventfd to epoll instance.  errno=%d",
             errno);
 }
 
 Looper::~Looper() {
-    close(mWakeReadPipeFd);
-    close(mWakeWritePipeFd);
+    close(mWakeEventFd);
     close(mEpollFd);
 }
 
@@ -245,23 +246,23 @@ int Looper::pollInner(int timeoutMillis) {
 #endif
 
     for (int i = 0; i < eventCount; i++) {
-        int fd = eventItems[i].data.fd;
+        int fd = int(uint32_t(eventItems[i].data.u64));
+        uint32_t seq = uint32_t(eventItems[i].data.u64 >> 32);
         uint32_t epollEvents = eventItems[i].events;
-        if (fd == mWakeReadPipeFd) {
+        if (fd == mWakeEventFd) {
             if (epollEvents & EPOLLIN) {
                 awoken();
             } else {
-                ALOGW("Ignoring unexpected epoll events 0x%x on wake read pipe.", epollEvents);
+                ALOGW("Ignoring unexpected epoll events 0x%x on wake eventfd.", epollEvents);
             }
         } else {
-            ssize_t requestIndex = mRequests.indexOfKey(fd);
-            if (requestIndex >= 0) {
+            if (size_t(fd) < mRequests.size() && mRequests[fd].seq == seq) {
                 int events = 0;
                 if (epollEvents & EPOLLIN) events |= ALOOPER_EVENT_INPUT;
                 if (epollEvents & EPOLLOUT) events |= ALOOPER_EVENT_OUTPUT;
                 if (epollEvents & EPOLLERR) events |= ALOOPER_EVENT_ERROR;
                 if (epollEvents & EPOLLHUP) events |= ALOOPER_EVENT_HANGUP;
-                pushResponse(events, mRequests.valueAt(requestIndex));
+                pushResponse(events, mRequests[fd]);
             } else {
                 ALOGW("Ignoring unexpected epoll events 0x%x on fd %d that is "
                         "no longer registered.", epollEvents, fd);
@@ -283,7 +284,7 @@ Done: ;
             { // obtain handler
                 sp<MessageHandler> handler = messageEnvelope.handler;
                 Message message = messageEnvelope.message;
-                mMessageEnvelopes.removeAt(0);
+                popMessageEnvelopeLocked();
                 mSendingMessage = true;
                 mLock.unlock();
 
@@ -362,12 +363,13 @@ void Looper::wake() {
     ALOGD("%p ~ wake", this);
 #endif
 
+    uint64_t inc = 1;
     ssize_t nWrite;
     do {
-        nWrite = write(mWakeWritePipeFd, "W", 1);
+        nWrite = write(mWakeEventFd, &inc, sizeof(uint64_t));
     } while (nWrite == -1 && errno == EINTR);
 
-    if (nWrite != 1) {
+    if (nWrite != sizeof(uint64_t)) {
         if (errno != EAGAIN) {
             ALOGW("Could not write wake signal, errno=%d", errno);
         }
@@ -379,11 +381,64 @@ void Looper::awoken() {
     ALOGD("%p ~ awoken", this);
 #endif
 
-    char buffer[16];
+    uint64_t counter;
     ssize_t nRead;
     do {
-        nRead = read(mWakeReadPipeFd, buffer, sizeof(buffer));
-    } while ((nRead == -1 && errno == EINTR) || nRead == sizeof(buffer));
+        nRead = read(mWakeEventFd, &counter, sizeof(uint64_t));
+    } while (nRead == -1 && errno == EINTR);
+}
+
+size_t Looper::pushMessageEnvelopeLocked(const MessageEnvelope& messageEnvelope) {
+    // Sift the new envelope up from the end of the heap.
+    size_t i = mMessageEnvelopes.add(messageEnvelope);
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!messageEnvelope.isBefore(mMessageEnvelopes.itemAt(parent))) {
+            break;
+        }
+        mMessageEnvelopes.editItemAt(i) = mMessageEnvelopes.itemAt(parent);
+        i = parent;
+    }
+    mMessageEnvelopes.editItemAt(i) = messageEnvelope;
+    return i;
+}
+
+void Looper::popMessageEnvelopeLocked() {
+    size_t last = mMessageEnvelopes.size() - 1;
+    if (last != 0) {
+        mMessageEnvelopes.editItemAt(0) = mMessageEnvelopes.itemAt(last);
+    }
+    mMessageEnvelopes.removeAt(last);
+    if (last > 1) {
+        siftDownMessageEnvelopeLocked(0);
+    }
+}
+
+void Looper::siftDownMessageEnvelopeLocked(size_t index) {
+    const size_t count = mMessageEnvelopes.size();
+    MessageEnvelope messageEnvelope(mMessageEnvelopes.itemAt(index));
+    for (;;) {
+        size_t child = index * 2 + 1;
+        if (child >= count) {
+            break;
+        }
+        if (child + 1 < count && mMessageEnvelopes.itemAt(child + 1).isBefore(
+                mMessageEnvelopes.itemAt(child))) {
+            child += 1;
+        }
+        if (!mMessageEnvelopes.itemAt(child).isBefore(messageEnvelope)) {
+            break;
+        }
+        mMessageEnvelopes.editItemAt(index) = mMessageEnvelopes.itemAt(child);
+        index = child;
+    }
+    mMessageEnvelopes.editItemAt(index) = messageEnvelope;
+}
+
+void Looper::rebuildMessageEnvelopesLocked() {
+    for (size_t i = mMessageEnvelopes.size() / 2; i != 0; ) {
+        siftDownMessageEnvelopeLocked(--i);
+    }
 }
 
 void Looper::pushResponse(int events, const Request& request) {
@@ -421,36 +476,50 @@ int Looper::addFd(int fd, int ident, int events, const sp<LooperCallback>& callb
     if (events & ALOOPER_EVENT_INPUT) epollEvents |= EPOLLIN;
     if (events & ALOOPER_EVENT_OUTPUT) epollEvents |= EPOLLOUT;
 
+    if (fd < 0) {
+        ALOGE("Invalid attempt to add fd %d.", fd);
+        return -1;
+    }
+
     { // acquire lock
         AutoMutex _l(mLock);
 
-        Request request;
-        request.fd = fd;
-        request.ident = ident;
-        request.callback = callback;
-        request.data = data;
-
         struct epoll_event eventItem;
         memset(& eventItem, 0, sizeof(epoll_event)); // zero out unused members of data field union
         eventItem.events = epollEvents;
-        eventItem.data.fd = fd;
 
-        ssize_t requestIndex = mRequests.indexOfKey(fd);
-        if (requestIndex < 0) {
+        uint32_t seq;
+        if (size_t(fd) >= mRequests.size() || !mRequests[fd].seq) {
+            seq = mNextRequestSeq++;
+            if (!seq) {
+                seq = mNextRequestSeq++; // 0 marks the unused entries
+            }
+            eventItem.data.u64 = makeEpollData(seq, fd);
             int epollResult = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, & eventItem);
             if (epollResult < 0) {
                 ALOGE("Error adding epoll events for fd %d, errno=%d", fd, errno);
                 return -1;
             }
-            mRequests.add(fd, request);
+            if (size_t(fd) >= mRequests.size()) {
+                mRequests.insertAt(mRequests.size(), fd + 1 - mRequests.size());
+            }
         } else {
+            // events already polled for the fd go to the new request
+            seq = mRequests[fd].seq;
+            eventItem.data.u64 = makeEpollData(seq, fd);
             int epollResult = epoll_ctl(mEpollFd, EPOLL_CTL_MOD, fd, & eventItem);
             if (epollResult < 0) {
                 ALOGE("Error modifying epoll events for fd %d, errno=%d", fd, errno);
                 return -1;
             }
-            mRequests.replaceValueAt(requestIndex, request);
         }
+
+        Request& request(mRequests.editItemAt(fd));
+        request.fd = fd;
+        request.ident = ident;
+        request.seq = seq;
+        request.callback = callback;
+        request.data = data;
     } // release lock
     return 1;
 }
@@ -462,8 +531,7 @@ int Looper::removeFd(int fd) {
 
     { // acquire lock
         AutoMutex _l(mLock);
-        ssize_t requestIndex = mRequests.indexOfKey(fd);
-        if (requestIndex < 0) {
+        if (fd < 0 || size_t(fd) >= mRequests.size() || !mRequests[fd].seq) {
             return 0;
         }
 
@@ -473,7 +541,7 @@ int Looper::removeFd(int fd) {
             return -1;
         }
 
-        mRequests.removeItemsAt(requestIndex);
+        mRequests.editItemAt(fd) = Request();
     } // release lock
     return 1;
 }
@@ -500,13 +568,8 @@ void Looper::sendMessageAtTime(nsecs_t uptime, const sp<MessageHandler>& handler
     { // acquire lock
         AutoMutex _l(mLock);
 
-        size_t messageCount = mMessageEnvelopes.size();
-        while (i < messageCount && uptime >= mMessageEnvelopes.itemAt(i).uptime) {
-            i += 1;
-        }
-
-        MessageEnvelope messageEnvelope(uptime, handler, message);
-        mMessageEnvelopes.insertAt(messageEnvelope, i, 1);
+        MessageEnvelope messageEnvelope(uptime, handler, message, mNextMessageSequence++);
+        i = pushMessageEnvelopeLocked(messageEnvelope);
 
         // Optimization: If the Looper is currently sending a message, then we can skip
         // the call to wake() because the next thing the Looper will do after processing
@@ -531,12 +594,22 @@ void Looper::removeMessages(const sp<MessageHandler>& handler) {
     { // acquire lock
         AutoMutex _l(mLock);
 
-        for (size_t i = mMessageEnvelopes.size(); i != 0; ) {
-            const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(--i);
-            if (messageEnvelope.handler == handler) {
-                mMessageEnvelopes.removeAt(i);
+        // Compact the remaining envelopes, then restore the heap order.
+        size_t count = mMessageEnvelopes.size();
+        size_t kept = 0;
+        for (size_t i = 0; i < count; i++) {
+            const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(i);
+            if (messageEnvelope.handler != handler) {
+                if (kept != i) {
+                    mMessageEnvelopes.editItemAt(kept) = messageEnvelope;
+                }
+                kept += 1;
             }
         }
+        if (kept != count) {
+            mMessageEnvelopes.removeItemsAt(kept, count - kept);
+            rebuildMessageEnvelopesLocked();
+        }
     } // release lock
 }
 
@@ -548,13 +621,23 @@ void Looper::removeMessages(const sp<MessageHandler>& handler, int what) {
     { // acquire lock
         AutoMutex _l(mLock);
 
-        for (size_t i = mMessageEnvelopes.size(); i != 0; ) {
-            const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(--i);
-            if (messageEnvelope.handler == handler
-                    && messageEnvelope.message.what == what) {
-                mMessageEnvelopes.removeAt(i);
+        // Compact the remaining envelopes, then restore the heap order.
+        size_t count = mMessageEnvelopes.size();
+        size_t kept = 0;
+        for (size_t i = 0; i < count; i++) {
+            const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(i);
+            if (messageEnvelope.handler != handler
+                    || messageEnvelope.message.what != what) {
+                if (kept != i) {
+                    mMessageEnvelopes.editItemAt(kept) = messageEnvelope;
+                }
+                kept += 1;
             }
         }
+        if (kept != count) {
+            mMessageEnvelopes.removeItemsAt(kept, count - kept);
+            rebuildMessageEnvelopesLocked();
+        }
     } // release lock
 }
 
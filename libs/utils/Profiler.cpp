@@ -0,0 +1,322 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "Profiler"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(HAVE_PTHREADS)
+# include <pthread.h>
+#endif
+
+#include <cutils/atomic.h>
+#include <cutils/properties.h>
+
+#include <utils/Log.h>
+#include <utils/Profiler.h>
+
+// ---------------------------------------------------------------------------
+
+namespace android {
+
+#if defined(HAVE_PTHREADS)
+
+namespace {
+
+struct PointStats {
+    uint32_t count;
+    nsecs_t total;
+    // total minus the time spent in nested scopes
+    nsecs_t self;
+    nsecs_t max;
+    uint32_t histogram[Profiler::HISTOGRAM_BUCKETS];
+};
+
+// only ever written by its thread
+struct ThreadStats {
+    ThreadStats* next;
+    // the innermost scope being timed on this thread
+    ProfileScope* current;
+    PointStats points[Profiler::MAX_POINTS];
+};
+
+/*
+ * Everything here has static initializers only, because points register
+ * themselves from static constructors in any order.
+ */
+pthread_mutex_t gLock = PTHREAD_MUTEX_INITIALIZER;
+ProfilePoint* gPoints[Profiler::MAX_POINTS];
+int32_t gPointCount;
+bool gTagsInitialized;
+char gTags[PROPERTY_VALUE_MAX];
+// live threads, and what the threads that exited left behind
+ThreadStats* gThreads;
+ThreadStats gRetired;
+pthread_key_t gKey;
+pthread_once_t gKeyOnce = PTHREAD_ONCE_INIT;
+
+bool isTagEnabledLocked(const char* tag) {
+    if (!gTagsInitialized) {
+        property_get("debug.profile.tags", gTags, "");
+        gTagsInitialized = true;
+    }
+    if (!strcmp(gTags, "all")) {
+        return true;
+    }
+    const size_t length = strlen(tag);
+    for (const char* s = gTags ; *s ; ) {
+        const char* end = strchr(s, ',');
+        const size_t n = end ? size_t(end - s) : strlen(s);
+        if (n == length && !strncmp(s, tag, n)) {
+            return true;
+        }
+        s += end ? n + 1 : n;
+    }
+    return false;
+}
+
+void addStats(PointStats& to, const PointStats& from) {
+    to.count += from.count;
+    to.total += from.total;
+    to.self += from.self;
+    if (from.max > to.max) {
+        to.max = from.max;
+    }
+    for (size_t i=0 ; i<Profiler::HISTOGRAM_BUCKETS ; i++) {
+        to.histogram[i] += from.histogram[i];
+    }
+}
+
+void retireThread(void* stats) {
+    ThreadStats* const t = static_cast<ThreadStats*>(stats);
+    pthread_mutex_lock(&gLock);
+    for (ThreadStats** p = &gThreads ; *p ; p = &(*p)->next) {
+        if (*p == t) {
+            *p = t->next;
+            break;
+        }
+    }
+    for (size_t i=0 ; i<Profiler::MAX_POINTS ; i++) {
+        addStats(gRetired.points[i], t->points[i]);
+    }
+    pthread_mutex_unlock(&gLock);
+    free(t);
+}
+
+void createKey() {
+    pthread_key_create(&gKey, retireThread);
+}
+
+ThreadStats* getThreadStats() {
+    pthread_once(&gKeyOnce, createKey);
+    ThreadStats* t = static_cast<ThreadStats*>(pthread_getspecific(gKey));
+    if (t == NULL) {
+        t = static_cast<ThreadStats*>(calloc(1, sizeof(ThreadStats)));
+        if (t == NULL) {
+            return NULL;
+        }
+        pthread_mutex_lock(&gLock);
+        t->next = gThreads;
+        gThreads = t;
+        pthread_mutex_unlock(&gLock);
+        pthread_setspecific(gKey, t);
+    }
+    return t;
+}
+
+size_t bucketFor(nsecs_t duration) {
+    nsecs_t us = ns2us(duration);
+    size_t bucket = 0;
+    while (us >= 2 && bucket < Profiler::HISTOGRAM_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+void dumpPoint(String8& result, const PointStats* sums, bool* dumped,
+        int32_t id, int depth) {
+    dumped[id] = true;
+    const ProfilePoint* point = gPoints[id];
+    const PointStats& s(sums[id]);
+    String8 name;
+    name.appendFormat("%*s%s", depth * 2, "", point->getName());
+    result.appendFormat("  %-40s %8u %10.2f %10.2f %8.1f %8.1f ",
+            name.string(), s.count, s.total / 1e6, s.self / 1e6,
+            s.count ? s.total / 1e3 / s.count : 0.0, s.max / 1e3);
+    size_t last = Profiler::HISTOGRAM_BUCKETS;
+    while (last > 0 && !s.histogram[last - 1]) {
+        last--;
+    }
+    for (size_t i=0 ; i<last ; i++) {
+        result.appendFormat(" %u", s.histogram[i]);
+    }
+    result.append("\n");
+    for (int32_t i=0 ; i<gPointCount ; i++) {
+        if (!dumped[i] && gPoints[i]->getParent() == id && sums[i].count) {
+            dumpPoint(result, sums, dumped, i, depth + 1);
+        }
+    }
+}
+
+} // anonymous namespace
+
+// ---------------------------------------------------------------------------
+
+ProfilePoint::ProfilePoint(const char* tag, const char* name)
+    : mTag(tag), mName(name), mId(-1), mParent(-1), mEnabled(0)
+{
+    pthread_mutex_lock(&gLock);
+    if (gPointCount < Profiler::MAX_POINTS) {
+        mId = gPointCount;
+        gPoints[gPointCount++] = this;
+        mEnabled = isTagEnabledLocked(tag);
+    } else {
+        ALOGW("too many profile points, %s/%s is never timed", tag, name);
+    }
+    pthread_mutex_unlock(&gLock);
+}
+
+void ProfileScope::enter()
+{
+    ThreadStats* t = getThreadStats();
+    if (t == NULL) {
+        return;
+    }
+    mOuter = t->current;
+    mChildTime = 0;
+    t->current = this;
+    mStart = systemTime();
+}
+
+void ProfileScope::exit()
+{
+    const nsecs_t duration = systemTime() - mStart;
+    ThreadStats* t = static_cast<ThreadStats*>(pthread_getspecific(gKey));
+    t->current = mOuter;
+    if (mOuter) {
+        mOuter->mChildTime += duration;
+        if (mPoint.mParent < 0) {
+            android_atomic_release_cas(-1, mOuter->mPoint.mId, &mPoint.mParent);
+        }
+    }
+    PointStats& s(t->points[mPoint.mId]);
+    s.count++;
+    s.total += duration;
+    s.self += duration - mChildTime;
+    if (duration > s.max) {
+        s.max = duration;
+    }
+    s.histogram[bucketFor(duration)]++;
+}
+
+void Profiler::setEnabledTags(const char* tags)
+{
+    pthread_mutex_lock(&gLock);
+    strncpy(gTags, tags, sizeof(gTags) - 1);
+    gTags[sizeof(gTags) - 1] = '\0';
+    gTagsInitialized = true;
+    for (int32_t i=0 ; i<gPointCount ; i++) {
+        android_atomic_release_store(isTagEnabledLocked(gPoints[i]->mTag),
+                &gPoints[i]->mEnabled);
+    }
+    pthread_mutex_unlock(&gLock);
+}
+
+void Profiler::clear()
+{
+    pthread_mutex_lock(&gLock);
+    for (ThreadStats* t = gThreads ; t ; t = t->next) {
+        memset(t->points, 0, sizeof(t->points));
+    }
+    memset(gRetired.points, 0, sizeof(gRetired.points));
+    pthread_mutex_unlock(&gLock);
+}
+
+void Profiler::dump(String8& result)
+{
+    PointStats* sums = static_cast<PointStats*>(
+            calloc(MAX_POINTS, sizeof(PointStats)));
+    if (sums == NULL) {
+        return;
+    }
+    bool dumped[MAX_POINTS];
+    memset(dumped, 0, sizeof(dumped));
+
+    pthread_mutex_lock(&gLock);
+    if (!gTagsInitialized) {
+        isTagEnabledLocked("");
+    }
+    for (int32_t i=0 ; i<gPointCount ; i++) {
+        addStats(sums[i], gRetired.points[i]);
+        for (ThreadStats* t = gThreads ; t ; t = t->next) {
+            addStats(sums[i], t->points[i]);
+        }
+    }
+    result.appendFormat("Profile (tags: %s):\n", gTags[0] ? gTags : "none");
+    result.appendFormat("  %-40s %8s %10s %10s %8s %8s  %s\n",
+            "scope", "count", "total ms", "self ms", "avg us", "max us",
+            "histogram (<2us, <4us, ...)");
+    // the top-level scopes with their nested ones, then those whose outer
+    // scope wasn't shown, if any
+    for (int32_t i=0 ; i<gPointCount ; i++) {
+        if (!dumped[i] && gPoints[i]->getParent() < 0 && sums[i].count) {
+            dumpPoint(result, sums, dumped, i, 0);
+        }
+    }
+    for (int32_t i=0 ; i<gPointCount ; i++) {
+        if (!dumped[i] && sums[i].count) {
+            dumpPoint(result, sums, dumped, i, 0);
+        }
+    }
+    pthread_mutex_unlock(&gLock);
+    free(sums);
+}
+
+#else // !HAVE_PTHREADS
+
+ProfilePoint::ProfilePoint(const char* tag, const char* name)
+    : mTag(tag), mName(name), mId(-1), mParent(-1), mEnabled(0)
+{
+}
+
+void ProfileScope::enter()
+{
+}
+
+void ProfileScope::exit()
+{
+}
+
+void Profiler::setEnabledTags(const char* tags)
+{
+}
+
+void Profiler::clear()
+{
+}
+
+void Profiler::dump(String8& result)
+{
+    result.append("Profile: not supported\n");
+}
+
+#endif // HAVE_PTHREADS
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
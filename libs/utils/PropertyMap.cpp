@@ -18,9 +18,11 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #include <utils/PropertyMap.h>
 #include <utils/Log.h>
+#include <utils/Mutex.h>
 
 // Enables debug output for the parser.
 #define DEBUG_PARSER 0
@@ -34,6 +36,61 @@ namespace android {
 static const char* WHITESPACE = " \t\r";
 static const char* WHITESPACE_OR_PROPERTY_DELIMITER = " \t\r=";
 
+// Number of parsed files load() keeps.
+static const size_t MAX_CACHED_MAPS = 32;
+
+
+// --- PropertyMap cache ---
+
+// The same configuration files are loaded whenever a device is plugged in,
+// copies of a cached map share the strings of its keys and values.
+struct CachedPropertyMap {
+    time_t mtime;
+    off_t size;
+    uint32_t lastUsed;
+    PropertyMap map;
+};
+
+static Mutex gCacheLock;
+static KeyedVector<String8, CachedPropertyMap> gCache;
+static uint32_t gCacheGeneration;
+
+static PropertyMap* findCachedMap(const String8& filename, const struct stat& st) {
+    AutoMutex _l(gCacheLock);
+    ssize_t index = gCache.indexOfKey(filename);
+    if (index < 0) {
+        return NULL;
+    }
+    CachedPropertyMap& cached = gCache.editValueAt(index);
+    if (cached.mtime != st.st_mtime || cached.size != st.st_size) {
+        gCache.removeItemsAt(index);
+        return NULL;
+    }
+    cached.lastUsed = ++gCacheGeneration;
+    return new PropertyMap(cached.map);
+}
+
+static void cacheMap(const String8& filename, const struct stat& st,
+        const PropertyMap& map) {
+    AutoMutex _l(gCacheLock);
+    if (gCache.size() >= MAX_CACHED_MAPS && gCache.indexOfKey(filename) < 0) {
+        size_t oldest = 0;
+        for (size_t i = 1; i < gCache.size(); i++) {
+            if (gCache.valueAt(i).lastUsed < gCache.valueAt(oldest).lastUsed) {
+                oldest = i;
+            }
+        }
+        gCache.removeItemsAt(oldest);
+    }
+
+    CachedPropertyMap cached;
+    cached.mtime = st.st_mtime;
+    cached.size = st.st_size;
+    cached.lastUsed = ++gCacheGeneration;
+    cached.map = map;
+    gCache.add(filename, cached);
+}
+
 
 // --- PropertyMap ---
 
@@ -115,9 +172,25 @@ void PropertyMap::addAll(const PropertyMap* map) {
     }
 }
 
+void PropertyMap::clearCache() {
+    AutoMutex _l(gCacheLock);
+    gCache.clear();
+}
+
 status_t PropertyMap::load(const String8& filename, PropertyMap** outMap) {
     *outMap = NULL;
 
+    // files in sysfs change without their modification time changing,
+    // maps are only cached if the file could be mapped
+    struct stat st;
+    bool cacheable = !stat(filename.string(), &st) && S_ISREG(st.st_mode);
+    if (cacheable) {
+        *outMap = findCachedMap(filename, st);
+        if (*outMap) {
+            return NO_ERROR;
+        }
+    }
+
     Tokenizer* tokenizer;
     status_t status = Tokenizer::open(filename, &tokenizer);
     if (status) {
@@ -142,6 +215,9 @@ status_t PropertyMap::load(const String8& filename, PropertyMap** outMap) {
             if (status) {
                 delete map;
             } else {
+                if (cacheable && tokenizer->isMapped()) {
+                    cacheMap(filename, st, *map);
+                }
                 *outMap = map;
             }
         }
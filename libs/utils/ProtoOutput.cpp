@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <utils/ProtoOutput.h>
+
+namespace android {
+
+// a nested message's length is written as a varint of up to this many
+// bytes, which is as much as a uint32_t needs
+static const size_t MAX_LENGTH_SIZE = 5;
+
+ProtoOutput::ProtoOutput() {
+}
+
+void ProtoOutput::writeTag(uint32_t field, uint32_t wireType) {
+    writeVarint((uint64_t(field) << 3) | wireType);
+}
+
+void ProtoOutput::writeVarint(uint64_t value) {
+    uint8_t bytes[10];
+    size_t n = 0;
+    while (value >= 0x80) {
+        bytes[n++] = uint8_t(value) | 0x80;
+        value >>= 7;
+    }
+    bytes[n++] = uint8_t(value);
+    writeRaw(bytes, n);
+}
+
+void ProtoOutput::writeRaw(const void* data, size_t size) {
+    mBuffer.appendArray(static_cast<const uint8_t*>(data), size);
+}
+
+void ProtoOutput::writeInt32(uint32_t field, int32_t value) {
+    // negative values are sign extended, as protobuf does for int32
+    writeTag(field, WIRE_VARINT);
+    writeVarint(uint64_t(int64_t(value)));
+}
+
+void ProtoOutput::writeInt64(uint32_t field, int64_t value) {
+    writeTag(field, WIRE_VARINT);
+    writeVarint(uint64_t(value));
+}
+
+void ProtoOutput::writeUInt32(uint32_t field, uint32_t value) {
+    writeTag(field, WIRE_VARINT);
+    writeVarint(value);
+}
+
+void ProtoOutput::writeUInt64(uint32_t field, uint64_t value) {
+    writeTag(field, WIRE_VARINT);
+    writeVarint(value);
+}
+
+void ProtoOutput::writeBool(uint32_t field, bool value) {
+    writeTag(field, WIRE_VARINT);
+    writeVarint(value ? 1 : 0);
+}
+
+void ProtoOutput::writeFloat(uint32_t field, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint8_t bytes[4];
+    for (size_t i=0 ; i<sizeof(bytes) ; i++) {
+        bytes[i] = uint8_t(bits >> (i * 8));
+    }
+    writeTag(field, WIRE_FIXED32);
+    writeRaw(bytes, sizeof(bytes));
+}
+
+void ProtoOutput::writeDouble(uint32_t field, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint8_t bytes[8];
+    for (size_t i=0 ; i<sizeof(bytes) ; i++) {
+        bytes[i] = uint8_t(bits >> (i * 8));
+    }
+    writeTag(field, WIRE_FIXED64);
+    writeRaw(bytes, sizeof(bytes));
+}
+
+void ProtoOutput::writeString(uint32_t field, const char* value) {
+    writeBytes(field, value, value ? strlen(value) : 0);
+}
+
+void ProtoOutput::writeString(uint32_t field, const String8& value) {
+    writeBytes(field, value.string(), value.length());
+}
+
+void ProtoOutput::writeBytes(uint32_t field, const void* data, size_t size) {
+    writeTag(field, WIRE_LENGTH_DELIMITED);
+    writeVarint(size);
+    writeRaw(data, size);
+}
+
+size_t ProtoOutput::beginMessage(uint32_t field) {
+    writeTag(field, WIRE_LENGTH_DELIMITED);
+    // room for the length, trimmed to its actual size by endMessage()
+    const size_t token = mBuffer.size();
+    mBuffer.insertAt(uint8_t(0), token, MAX_LENGTH_SIZE);
+    return token;
+}
+
+void ProtoOutput::endMessage(size_t token) {
+    const size_t start = token + MAX_LENGTH_SIZE;
+    size_t length = mBuffer.size() - start;
+    uint8_t* p = mBuffer.editArray() + token;
+    size_t n = 0;
+    while (length >= 0x80) {
+        p[n++] = uint8_t(length) | 0x80;
+        length >>= 7;
+    }
+    p[n++] = uint8_t(length);
+    if (n < MAX_LENGTH_SIZE) {
+        mBuffer.removeItemsAt(token + n, MAX_LENGTH_SIZE - n);
+    }
+}
+
+} // namespace android
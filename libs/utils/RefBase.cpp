@@ -21,12 +21,13 @@
 #include <utils/Atomic.h>
 #include <utils/CallStack.h>
 #include <utils/Log.h>
+#include <utils/String8.h>
 #include <utils/threads.h>
 #include <utils/TextOutput.h>
+#include <utils/Vector.h>
 
 #include <stdlib.h>
 #include <stdio.h>
-#include <typeinfo>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -47,6 +48,136 @@ namespace android {
 
 #define INITIAL_STRONG_VALUE (1<<28)
 
+// ---------------------------------------------------------------------------
+// Sampled tracking of strong references, see RefBase::sampleReferences()
+
+namespace {
+
+struct sampled_ref
+{
+    sampled_ref* next;
+    const void* id;
+    const CallStack* stack;
+};
+
+struct sampled_object
+{
+    sampled_object* next;
+    sampled_object* prev;
+    const void* base;
+    const char* type;
+    const volatile int32_t* strong;
+    sampled_ref* refs;
+    // releases of references we didn't see being taken, a sp<> that was
+    // moved with memcpy() (see trait_trivial_move) isn't found again
+    uint32_t unmatched;
+};
+
+struct sampled_class
+{
+    String8 name;
+    uint32_t period;
+    uint32_t count;
+};
+
+} // namespace
+
+// the classes sampled and the live objects sampled, not touched at all
+// as long as sSampledClassCount is 0
+static Mutex sSamplingLock;
+static volatile int32_t sSampledClassCount = 0;
+static Vector<sampled_class> sSampledClasses;
+static sampled_object* sSampledObjects = NULL;
+
+static sampled_object* sampleObject(const RefBase* base, const char* type,
+        const volatile int32_t* strong)
+{
+    Mutex::Autolock _l(sSamplingLock);
+    for (size_t i=0 ; i<sSampledClasses.size() ; i++) {
+        sampled_class& c(sSampledClasses.editItemAt(i));
+        if (c.name != type) {
+            continue;
+        }
+        if (c.count++ % c.period) {
+            return NULL;
+        }
+        sampled_object* object = new sampled_object;
+        object->prev = NULL;
+        object->next = sSampledObjects;
+        object->base = base;
+        object->type = type;
+        object->strong = strong;
+        object->refs = NULL;
+        object->unmatched = 0;
+        if (sSampledObjects) {
+            sSampledObjects->prev = object;
+        }
+        sSampledObjects = object;
+        return object;
+    }
+    return NULL;
+}
+
+static void addSampledRef(sampled_object* object, const void* id)
+{
+    // identical stacks, a sp<> member copied from the same place over
+    // and over, are kept once
+    CallStack stack;
+    stack.update(2);
+    const CallStack* interned = stack.intern();
+
+    Mutex::Autolock _l(sSamplingLock);
+    sampled_ref* ref = new sampled_ref;
+    ref->next = object->refs;
+    ref->id = id;
+    ref->stack = interned;
+    object->refs = ref;
+}
+
+static void removeSampledRef(sampled_object* object, const void* id)
+{
+    Mutex::Autolock _l(sSamplingLock);
+    for (sampled_ref** ref = &object->refs ; *ref ; ref = &(*ref)->next) {
+        if ((*ref)->id == id) {
+            sampled_ref* const found = *ref;
+            *ref = found->next;
+            delete found;
+            return;
+        }
+    }
+    object->unmatched++;
+}
+
+static void renameSampledRef(sampled_object* object,
+        const void* old_id, const void* new_id)
+{
+    Mutex::Autolock _l(sSamplingLock);
+    for (sampled_ref* ref = object->refs ; ref ; ref = ref->next) {
+        if (ref->id == old_id) {
+            ref->id = new_id;
+        }
+    }
+}
+
+static void releaseSampledObject(sampled_object* object)
+{
+    Mutex::Autolock _l(sSamplingLock);
+    if (object->prev) {
+        object->prev->next = object->next;
+    } else {
+        sSampledObjects = object->next;
+    }
+    if (object->next) {
+        object->next->prev = object->prev;
+    }
+    while (object->refs) {
+        sampled_ref* const ref = object->refs;
+        object->refs = ref->next;
+        delete ref;
+    }
+    delete object;
+}
+
 // ---------------------------------------------------------------------------
 
 class RefBase::weakref_impl : public RefBase::weakref_type
@@ -64,18 +195,53 @@ public:
         , mWeak(0)
         , mBase(base)
         , mFlags(0)
+        , mSampled(NULL)
+    {
+    }
+
+    ~weakref_impl()
     {
+        if (mSampled) {
+            releaseSampledObject(mSampled);
+        }
+    }
+
+    // whether the object is sampled is decided once it is fully
+    // constructed, so that its class is known
+    void onFirstStrongRef(const void* id) {
+        if (android_atomic_acquire_load(&sSampledClassCount)) {
+            const char* type = mBase->getSampledTypeName();
+            mSampled = type ? sampleObject(mBase, type, &mStrong) : NULL;
+            if (mSampled) {
+                addSampledRef(mSampled, id);
+            }
+        }
     }
 
-    void addStrongRef(const void* /*id*/) { }
-    void removeStrongRef(const void* /*id*/) { }
-    void renameStrongRefId(const void* /*old_id*/, const void* /*new_id*/) { }
+    void addStrongRef(const void* id) {
+        if (mSampled) {
+            addSampledRef(mSampled, id);
+        }
+    }
+    void removeStrongRef(const void* id) {
+        if (mSampled) {
+            removeSampledRef(mSampled, id);
+        }
+    }
+    void renameStrongRefId(const void* old_id, const void* new_id) {
+        if (mSampled) {
+            renameSampledRef(mSampled, old_id, new_id);
+        }
+    }
     void addWeakRef(const void* /*id*/) { }
     void removeWeakRef(const void* /*id*/) { }
     void renameWeakRefId(const void* /*old_id*/, const void* /*new_id*/) { }
     void printRefs() const { }
     void trackMe(bool, bool) { }
 
+private:
+    sampled_object* mSampled;
+
 #else
 
     weakref_impl(RefBase* base)
@@ -136,6 +302,8 @@ public:
         }
     }
 
+    void onFirstStrongRef(const void* /*id*/) { }
+
     void addStrongRef(const void* id) {
         //ALOGD_IF(mTrackEnabled,
         //        "addStrongRef: RefBase=%p, id=%p", mBase, id);
@@ -341,6 +509,7 @@ void RefBase::incStrong(const void* id) const
     }
 
     android_atomic_add(-INITIAL_STRONG_VALUE, &refs->mStrong);
+    refs->onFirstStrongRef(id);
     refs->mBase->onFirstRef();
 }
 
@@ -378,6 +547,7 @@ void RefBase::forceIncStrong(const void* id) const
     switch (c) {
     case INITIAL_STRONG_VALUE:
         android_atomic_add(-INITIAL_STRONG_VALUE, &refs->mStrong);
+        refs->onFirstStrongRef(id);
         // fall through...
     case 0:
         refs->mBase->onFirstRef();
@@ -492,6 +662,7 @@ bool RefBase::weakref_type::attemptIncStrong(const void* id)
 
     if (curCount == INITIAL_STRONG_VALUE) {
         android_atomic_add(-INITIAL_STRONG_VALUE, &impl->mStrong);
+        impl->onFirstStrongRef(id);
         impl->mBase->onFirstRef();
     }
     
@@ -593,8 +764,56 @@ void RefBase::onLastWeakRef(const void* /*id*/)
 {
 }
 
+const char* RefBase::getSampledTypeName() const
+{
+    return NULL;
+}
+
 // ---------------------------------------------------------------------------
 
+void RefBase::sampleReferences(const char* typeName, uint32_t period)
+{
+    Mutex::Autolock _l(sSamplingLock);
+    for (size_t i=0 ; i<sSampledClasses.size() ; i++) {
+        if (sSampledClasses[i].name == typeName) {
+            sSampledClasses.removeAt(i);
+            break;
+        }
+    }
+    if (period) {
+        sampled_class c;
+        c.name = typeName;
+        c.period = period;
+        c.count = 0;
+        sSampledClasses.add(c);
+    }
+    android_atomic_release_store(int32_t(sSampledClasses.size()),
+            &sSampledClassCount);
+}
+
+void RefBase::dumpSampledReferences(String8* out)
+{
+    Mutex::Autolock _l(sSamplingLock);
+    char buf[128];
+    for (const sampled_object* object = sSampledObjects ; object ;
+            object = object->next) {
+        const int32_t strong = *object->strong;
+        if (strong <= 0) {
+            // only weakly referenced, or being destroyed
+            continue;
+        }
+        snprintf(buf, sizeof(buf), "%s %p: %d strong references "
+                "(%u released untracked):\n",
+                object->type, object->base, strong, object->unmatched);
+        out->append(buf);
+        for (const sampled_ref* ref = object->refs ; ref ; ref = ref->next) {
+            snprintf(buf, sizeof(buf), "\tID %p:\n", ref->id);
+            out->append(buf);
+            out->append(ref->stack->toString("\t\t"));
+        }
+    }
+}
+
 void RefBase::moveReferences(void* dst, void const* src, size_t n,
         const ReferenceConverterBase& caster)
 {
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ScalableRWLock"
+
+#include <utils/ScalableRWLock.h>
+
+namespace android {
+
+#if defined(HAVE_PTHREADS)
+
+/*
+ * The readers' fast paths are inline: they bump their slot, issue a full
+ * barrier and check mWriter. A writer stores mWriter, issues a full barrier
+ * and then reads the slots, so either the writer sees the reader's count or
+ * the reader sees the writer and backs off. Everything that waits does so
+ * on mCondition under mLock, and readers that back off or leave while a
+ * writer is around broadcast under mLock, so no wakeup is lost.
+ */
+
+bool ScalableRWLock::drainedLocked() const {
+    for (size_t i=0 ; i<SLOT_COUNT ; i++) {
+        if (android_atomic_acquire_load(&mSlots[i].readers) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ScalableRWLock::wakeWriter() {
+    Mutex::Autolock _l(mLock);
+    mCondition.broadcast();
+}
+
+void ScalableRWLock::readLockSlow(Slot* slot) {
+    do {
+        android_atomic_dec(&slot->readers);
+        {
+            Mutex::Autolock _l(mLock);
+            // the writer may be waiting on our slot
+            mCondition.broadcast();
+            while (android_atomic_acquire_load(&mWriter) != WRITER_NONE) {
+                mCondition.wait(mLock);
+            }
+        }
+        android_atomic_inc(&slot->readers);
+        android_memory_barrier();
+    } while (android_atomic_acquire_load(&mWriter) != WRITER_NONE);
+}
+
+status_t ScalableRWLock::writeLock() {
+    Mutex::Autolock _l(mLock);
+    while (android_atomic_acquire_load(&mWriter) != WRITER_NONE) {
+        mCondition.wait(mLock);
+    }
+    android_atomic_release_store(WRITER_PENDING, &mWriter);
+    android_memory_barrier();
+    while (!drainedLocked()) {
+        mCondition.wait(mLock);
+    }
+    android_atomic_release_store(WRITER_HELD, &mWriter);
+    return NO_ERROR;
+}
+
+status_t ScalableRWLock::tryWriteLock() {
+    Mutex::Autolock _l(mLock);
+    if (android_atomic_acquire_load(&mWriter) != WRITER_NONE) {
+        return -EBUSY;
+    }
+    android_atomic_release_store(WRITER_PENDING, &mWriter);
+    android_memory_barrier();
+    if (!drainedLocked()) {
+        // let the readers we held up through
+        android_atomic_release_store(WRITER_NONE, &mWriter);
+        mCondition.broadcast();
+        return -EBUSY;
+    }
+    android_atomic_release_store(WRITER_HELD, &mWriter);
+    return NO_ERROR;
+}
+
+void ScalableRWLock::writeUnlock() {
+    Mutex::Autolock _l(mLock);
+    android_atomic_release_store(WRITER_NONE, &mWriter);
+    mCondition.broadcast();
+}
+
+#endif // HAVE_PTHREADS
+
+}; // namespace android
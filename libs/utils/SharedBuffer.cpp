@@ -14,9 +14,17 @@
  * limitations under the License.
  */
 
+#define LOG_TAG "SharedBuffer"
+
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(HAVE_PTHREADS)
+# include <pthread.h>
+#endif
+
+#include <cutils/properties.h>
+
 #include <utils/SharedBuffer.h>
 #include <utils/Atomic.h>
 
@@ -24,9 +32,281 @@
 
 namespace android {
 
-SharedBuffer* SharedBuffer::alloc(size_t size)
+#if defined(HAVE_PTHREADS)
+
+/*
+ * Small buffers are rounded up to one of a few size classes. When they are
+ * freed, they go on free lists of the thread that frees them instead of
+ * back to malloc(), which would take its lock. A thread reserves room in a
+ * process-wide budget before it caches anything. Every TRIM_INTERVAL frees,
+ * it gives malloc() back the buffers that each list didn't need since the
+ * previous trim. Setting debug.sharedbuffer.cache to 0 turns the cache off.
+ */
+struct SharedBufferCache {
+    enum {
+        CLASS_COUNT = 5,            // 16, 32, 64, 128 and 256 bytes of data
+        MIN_CLASS_SHIFT = 4,
+        MAX_PER_CLASS = 32,
+        TRIM_INTERVAL = 4096,
+        BUDGET_CHUNK = 4096,
+        MAX_CACHED_BYTES = 256 * 1024
+    };
+
+    struct Node {
+        Node* next;
+    };
+
+    Node* heads[CLASS_COUNT];
+    uint32_t counts[CLASS_COUNT];
+    // fewest buffers each list held since the last trim
+    uint32_t lowWater[CLASS_COUNT];
+    size_t cachedBytes;
+    // our share of sReservedBytes, at least cachedBytes
+    size_t reservedBytes;
+    uint32_t frees;
+    // not yet folded into the process-wide counters
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t trimmed;
+
+    static pthread_key_t sKey;
+    static pthread_once_t sOnce;
+    static bool sEnabled;
+    static volatile int32_t sReservedBytes;
+    static volatile int32_t sHits;
+    static volatile int32_t sMisses;
+    static volatile int32_t sTrimmed;
+
+    static void init();
+    static void destroy(void* cache);
+    static SharedBufferCache* get(bool create);
+
+    // -1 if buffers of that size aren't cached
+    static inline int classFor(size_t size) {
+        if (size > (size_t(1) << (CLASS_COUNT - 1 + MIN_CLASS_SHIFT))) {
+            return -1;
+        }
+        int c = 0;
+        while ((size_t(1) << (c + MIN_CLASS_SHIFT)) < size) {
+            c++;
+        }
+        return c;
+    }
+    static inline size_t classDataSize(int c) {
+        return size_t(1) << (c + MIN_CLASS_SHIFT);
+    }
+    static inline size_t classSize(int c) {
+        return sizeof(SharedBuffer) + classDataSize(c);
+    }
+
+    SharedBuffer* pop(int c);
+    bool push(SharedBuffer* sb, int c);
+    bool reserve(size_t bytes);
+    void trim(bool all);
+    void flushStats();
+};
+
+pthread_key_t SharedBufferCache::sKey;
+pthread_once_t SharedBufferCache::sOnce = PTHREAD_ONCE_INIT;
+bool SharedBufferCache::sEnabled = false;
+volatile int32_t SharedBufferCache::sReservedBytes = 0;
+volatile int32_t SharedBufferCache::sHits = 0;
+volatile int32_t SharedBufferCache::sMisses = 0;
+volatile int32_t SharedBufferCache::sTrimmed = 0;
+
+void SharedBufferCache::init() {
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.sharedbuffer.cache", value, "1");
+    if (atoi(value) == 0) {
+        return;
+    }
+    sEnabled = pthread_key_create(&sKey, destroy) == 0;
+}
+
+void SharedBufferCache::destroy(void* cache) {
+    SharedBufferCache* self = static_cast<SharedBufferCache*>(cache);
+    // buffers freed by later TLS destructors go straight to free()
+    self->trim(true);
+    free(self);
+}
+
+SharedBufferCache* SharedBufferCache::get(bool create) {
+    pthread_once(&sOnce, init);
+    if (!sEnabled) {
+        return NULL;
+    }
+    SharedBufferCache* cache =
+            static_cast<SharedBufferCache*>(pthread_getspecific(sKey));
+    if (cache == NULL && create) {
+        cache = static_cast<SharedBufferCache*>(
+                calloc(1, sizeof(SharedBufferCache)));
+        if (cache != NULL) {
+            pthread_setspecific(sKey, cache);
+        }
+    }
+    return cache;
+}
+
+SharedBuffer* SharedBufferCache::pop(int c) {
+    Node* node = heads[c];
+    if (node == NULL) {
+        misses++;
+        return NULL;
+    }
+    heads[c] = node->next;
+    if (--counts[c] < lowWater[c]) {
+        lowWater[c] = counts[c];
+    }
+    cachedBytes -= classSize(c);
+    hits++;
+    return reinterpret_cast<SharedBuffer*>(node);
+}
+
+bool SharedBufferCache::push(SharedBuffer* sb, int c) {
+    const size_t size = classSize(c);
+    if (counts[c] >= MAX_PER_CLASS ||
+            (cachedBytes + size > reservedBytes && !reserve(BUDGET_CHUNK))) {
+        return false;
+    }
+    Node* node = reinterpret_cast<Node*>(sb);
+    node->next = heads[c];
+    heads[c] = node;
+    counts[c]++;
+    cachedBytes += size;
+    if (++frees >= TRIM_INTERVAL) {
+        trim(false);
+    }
+    return true;
+}
+
+bool SharedBufferCache::reserve(size_t bytes) {
+    int32_t reserved;
+    do {
+        reserved = android_atomic_acquire_load(&sReservedBytes);
+        if (size_t(reserved) + bytes > MAX_CACHED_BYTES) {
+            return false;
+        }
+    } while (android_atomic_release_cas(reserved, reserved + int32_t(bytes),
+            &sReservedBytes) != 0);
+    reservedBytes += bytes;
+    return true;
+}
+
+void SharedBufferCache::trim(bool all) {
+    for (int c=0 ; c<CLASS_COUNT ; c++) {
+        uint32_t n = all ? counts[c] : lowWater[c];
+        while (n--) {
+            Node* node = heads[c];
+            heads[c] = node->next;
+            free(node);
+            counts[c]--;
+            cachedBytes -= classSize(c);
+            trimmed++;
+        }
+        lowWater[c] = counts[c];
+    }
+    // give back the budget we no longer use
+    const size_t keep = (cachedBytes + BUDGET_CHUNK - 1) & ~size_t(BUDGET_CHUNK - 1);
+    if (reservedBytes > keep) {
+        android_atomic_add(-int32_t(reservedBytes - keep), &sReservedBytes);
+        reservedBytes = keep;
+    }
+    frees = 0;
+    flushStats();
+}
+
+void SharedBufferCache::flushStats() {
+    if (hits) {
+        android_atomic_add(int32_t(hits), &sHits);
+        hits = 0;
+    }
+    if (misses) {
+        android_atomic_add(int32_t(misses), &sMisses);
+        misses = 0;
+    }
+    if (trimmed) {
+        android_atomic_add(int32_t(trimmed), &sTrimmed);
+        trimmed = 0;
+    }
+}
+
+SharedBuffer* SharedBuffer::allocStorage(size_t size)
 {
+    const int c = SharedBufferCache::classFor(size);
+    SharedBufferCache* cache = c >= 0 ? SharedBufferCache::get(true) : NULL;
+    if (cache != NULL) {
+        SharedBuffer* sb = cache->pop(c);
+        if (sb == NULL) {
+            sb = static_cast<SharedBuffer *>(
+                    malloc(SharedBufferCache::classSize(c)));
+        }
+        if (sb) {
+            sb->mReserved[0] = c + 1;
+        }
+        return sb;
+    }
     SharedBuffer* sb = static_cast<SharedBuffer *>(malloc(sizeof(SharedBuffer) + size));
+    if (sb) {
+        sb->mReserved[0] = 0;
+    }
+    return sb;
+}
+
+void SharedBuffer::freeStorage(const SharedBuffer* sb)
+{
+    SharedBuffer* buf = const_cast<SharedBuffer*>(sb);
+    if (buf->mReserved[0]) {
+        SharedBufferCache* cache = SharedBufferCache::get(false);
+        if (cache != NULL && cache->push(buf, buf->mReserved[0] - 1)) {
+            return;
+        }
+    }
+    free(buf);
+}
+
+void SharedBuffer::getCacheStats(CacheStats* stats)
+{
+    // our own counters are current at least
+    SharedBufferCache* cache = SharedBufferCache::get(false);
+    if (cache != NULL) {
+        cache->flushStats();
+    }
+    stats->hits = android_atomic_acquire_load(&SharedBufferCache::sHits);
+    stats->misses = android_atomic_acquire_load(&SharedBufferCache::sMisses);
+    stats->trimmed = android_atomic_acquire_load(&SharedBufferCache::sTrimmed);
+    stats->cachedBytes = android_atomic_acquire_load(&SharedBufferCache::sReservedBytes);
+    stats->maxCachedBytes = SharedBufferCache::sEnabled ?
+            SharedBufferCache::MAX_CACHED_BYTES : 0;
+}
+
+#else
+
+SharedBuffer* SharedBuffer::allocStorage(size_t size)
+{
+    SharedBuffer* sb = static_cast<SharedBuffer *>(malloc(sizeof(SharedBuffer) + size));
+    if (sb) {
+        sb->mReserved[0] = 0;
+    }
+    return sb;
+}
+
+void SharedBuffer::freeStorage(const SharedBuffer* sb)
+{
+    free(const_cast<SharedBuffer*>(sb));
+}
+
+void SharedBuffer::getCacheStats(CacheStats* stats)
+{
+    memset(stats, 0, sizeof(CacheStats));
+}
+
+#endif // HAVE_PTHREADS
+
+// ---------------------------------------------------------------------------
+
+SharedBuffer* SharedBuffer::alloc(size_t size)
+{
+    SharedBuffer* sb = allocStorage(size);
     if (sb) {
         sb->mRefs = 1;
         sb->mSize = size;
@@ -38,7 +318,7 @@ SharedBuffer* SharedBuffer::alloc(size_t size)
 ssize_t SharedBuffer::dealloc(const SharedBuffer* released)
 {
     if (released->mRefs != 0) return -1; // XXX: invalid operation
-    free(const_cast<SharedBuffer*>(released));
+    freeStorage(released);
     return 0;
 }
 
@@ -60,10 +340,22 @@ SharedBuffer* SharedBuffer::editResize(size_t newSize) const
     if (onlyOwner()) {
         SharedBuffer* buf = const_cast<SharedBuffer*>(this);
         if (buf->mSize == newSize) return buf;
-        buf = (SharedBuffer*)realloc(buf, sizeof(SharedBuffer) + newSize);
-        if (buf != NULL) {
-            buf->mSize = newSize;
-            return buf;
+#if defined(HAVE_PTHREADS)
+        if (buf->mReserved[0]) {
+            // a cached buffer has room for its whole size class
+            const int c = buf->mReserved[0] - 1;
+            if (newSize <= SharedBufferCache::classDataSize(c)) {
+                buf->mSize = newSize;
+                return buf;
+            }
+        } else
+#endif
+        {
+            buf = (SharedBuffer*)realloc(buf, sizeof(SharedBuffer) + newSize);
+            if (buf != NULL) {
+                buf->mSize = newSize;
+                return buf;
+            }
         }
     }
     SharedBuffer* sb = alloc(newSize);
@@ -103,7 +395,7 @@ int32_t SharedBuffer::release(uint32_t flags) const
     if (onlyOwner() || ((prev = android_atomic_dec(&mRefs)) == 1)) {
         mRefs = 0;
         if ((flags & eKeepStorage) == 0) {
-            free(const_cast<SharedBuffer*>(this));
+            freeStorage(this);
         }
     }
     return prev;
@@ -18,6 +18,7 @@
 
 #include <utils/Debug.h>
 #include <utils/Log.h>
+#include <utils/SortedVector.h>
 #include <utils/Unicode.h>
 #include <utils/String8.h>
 #include <utils/TextOutput.h>
@@ -35,6 +36,9 @@ namespace android {
 static SharedBuffer* gEmptyStringBuf = NULL;
 static char16_t* gEmptyString = NULL;
 
+static Mutex gInternLock;
+static SortedVector<String16>* gInternTable = NULL;
+
 static inline char16_t* getEmptyString()
 {
     gEmptyStringBuf->acquire();
@@ -52,6 +56,9 @@ void initialize_string16()
 
 void terminate_string16()
 {
+    delete gInternTable;
+    gInternTable = NULL;
+
     SharedBuffer::bufferFromData(gEmptyString)->release();
     gEmptyStringBuf = NULL;
     gEmptyString = NULL;
@@ -63,30 +70,27 @@ static char16_t* allocFromUTF8(const char* u8str, size_t u8len)
 {
     if (u8len == 0) return getEmptyString();
 
-    const uint8_t* u8cur = (const uint8_t*) u8str;
+    // UTF-8 never takes more UTF-16 code units than it has bytes, so convert
+    // into a buffer that large and give back what's left, rather than
+    // walking the string twice.
+    SharedBuffer* buf = SharedBuffer::alloc(sizeof(char16_t)*(u8len+1));
+    if (!buf) {
+        return getEmptyString();
+    }
 
-    const ssize_t u16len = utf8_to_utf16_length(u8cur, u8len);
+    const ssize_t u16len = utf8_to_utf16_and_length(
+            (const uint8_t*) u8str, u8len, (char16_t*)buf->data());
     if (u16len < 0) {
+        buf->release();
         return getEmptyString();
     }
 
-    const uint8_t* const u8end = u8cur + u8len;
-
-    SharedBuffer* buf = SharedBuffer::alloc(sizeof(char16_t)*(u16len+1));
-    if (buf) {
-        u8cur = (const uint8_t*) u8str;
-        char16_t* u16str = (char16_t*)buf->data();
-
-        utf8_to_utf16(u8cur, u8len, u16str);
-
-        //printf("Created UTF-16 string from UTF-8 \"%s\":", in);
-        //printHexData(1, str, buf->size(), 16, 1);
-        //printf("\n");
-        
-        return u16str;
+    SharedBuffer* sb = buf->editResize(sizeof(char16_t)*(u16len+1));
+    if (!sb) {
+        buf->release();
+        return getEmptyString();
     }
-
-    return getEmptyString();
+    return (char16_t*)sb->data();
 }
 
 // ---------------------------------------------------------------------------
@@ -158,6 +162,80 @@ String16::~String16()
     SharedBuffer::bufferFromData(mString)->release();
 }
 
+// Returns the interned string equal to "str", adding "share" (or a copy of
+// "str" if it's NULL) to the table if there's none yet.
+static String16 internLocked(const char16_t* str, size_t len, const String16* share)
+{
+    if (gInternTable == NULL) {
+        gInternTable = new SortedVector<String16>();
+    }
+    // binary search on the characters, so that a hit doesn't allocate
+    ssize_t l = 0;
+    ssize_t h = gInternTable->size() - 1;
+    while (l <= h) {
+        const ssize_t mid = l + (h - l) / 2;
+        const String16& item(gInternTable->itemAt(mid));
+        const int c = strzcmp16(item.string(), item.size(), str, len);
+        if (c == 0) {
+            return item;
+        } else if (c < 0) {
+            l = mid + 1;
+        } else {
+            h = mid - 1;
+        }
+    }
+    const String16 interned(share ? *share : String16(str, len));
+    gInternTable->add(interned);
+    return interned;
+}
+
+String16 String16::intern(const char16_t* str, size_t len)
+{
+    if (str == NULL || len == 0) {
+        return String16();
+    }
+    Mutex::Autolock _l(gInternLock);
+    return internLocked(str, len, NULL);
+}
+
+String16 String16::intern(const String16& str)
+{
+    if (str.size() == 0) {
+        return String16();
+    }
+    Mutex::Autolock _l(gInternLock);
+    return internLocked(str.string(), str.size(), &str);
+}
+
+hash_t String16::hash(const char16_t* str, size_t len)
+{
+    // MurmurHash3, two characters at a time
+    uint32_t h = len;
+    size_t i = 0;
+    for (; i + 2 <= len; i += 2) {
+        uint32_t k = str[i] | ((uint32_t) str[i + 1] << 16);
+        k *= 0xcc9e2d51;
+        k = (k << 15) | (k >> 17);
+        k *= 0x1b873593;
+        h ^= k;
+        h = (h << 13) | (h >> 19);
+        h = h * 5 + 0xe6546b64;
+    }
+    if (i < len) {
+        uint32_t k = str[i];
+        k *= 0xcc9e2d51;
+        k = (k << 15) | (k >> 17);
+        k *= 0x1b873593;
+        h ^= k;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return hash_t(h);
+}
+
 void String16::setTo(const String16& other)
 {
     SharedBuffer::bufferFromData(other.mString)->acquire();
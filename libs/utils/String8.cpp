@@ -19,6 +19,7 @@
 #include <utils/Log.h>
 #include <utils/Unicode.h>
 #include <utils/SharedBuffer.h>
+#include <utils/SortedVector.h>
 #include <utils/String16.h>
 #include <utils/TextOutput.h>
 #include <utils/threads.h>
@@ -43,6 +44,9 @@ namespace android {
 static SharedBuffer* gEmptyStringBuf = NULL;
 static char* gEmptyString = NULL;
 
+static Mutex gInternLock;
+static SortedVector<String8>* gInternTable = NULL;
+
 extern int gDarwinCantLoadAllObjects;
 int gDarwinIsReallyAnnoying;
 
@@ -69,6 +73,9 @@ void initialize_string8()
 
 void terminate_string8()
 {
+    delete gInternTable;
+    gInternTable = NULL;
+
     SharedBuffer::bufferFromData(gEmptyString)->release();
     gEmptyStringBuf = NULL;
     gEmptyString = NULL;
@@ -76,6 +83,9 @@ void terminate_string8()
 
 // ---------------------------------------------------------------------------
 
+// strings up to this long (in UTF-16 code units) are converted in one pass
+static const size_t MAX_SINGLE_PASS_UTF16_LENGTH = 1024;
+
 static char* allocFromUTF8(const char* in, size_t len)
 {
     if (len > 0) {
@@ -97,6 +107,24 @@ static char* allocFromUTF16(const char16_t* in, size_t len)
 {
     if (len == 0) return getEmptyString();
 
+    if (len <= MAX_SINGLE_PASS_UTF16_LENGTH) {
+        // convert into a worst case sized buffer and give back what's
+        // left, rather than walking the string twice
+        SharedBuffer* buf = SharedBuffer::alloc(len*3+1);
+        ALOG_ASSERT(buf, "Unable to allocate shared buffer");
+        if (!buf) {
+            return getEmptyString();
+        }
+        const size_t bytes = utf16_to_utf8_and_length(in, len,
+                (char*)buf->data());
+        SharedBuffer* sb = buf->editResize(bytes+1);
+        if (!sb) {
+            buf->release();
+            return getEmptyString();
+        }
+        return (char*)sb->data();
+    }
+
     const ssize_t bytes = utf16_to_utf8_length(in, len);
     if (bytes < 0) {
         return getEmptyString();
@@ -213,6 +241,51 @@ String8 String8::formatV(const char* fmt, va_list args)
     return result;
 }
 
+// Returns the interned string equal to "str", adding "share" (or a copy of
+// "str" if it's NULL) to the table if there's none yet.
+static String8 internLocked(const char* str, const String8* share)
+{
+    if (gInternTable == NULL) {
+        gInternTable = new SortedVector<String8>();
+    }
+    // binary search on the characters, so that a hit doesn't allocate
+    ssize_t l = 0;
+    ssize_t h = gInternTable->size() - 1;
+    while (l <= h) {
+        const ssize_t mid = l + (h - l) / 2;
+        const String8& item(gInternTable->itemAt(mid));
+        const int c = strcmp(item.string(), str);
+        if (c == 0) {
+            return item;
+        } else if (c < 0) {
+            l = mid + 1;
+        } else {
+            h = mid - 1;
+        }
+    }
+    const String8 interned(share ? *share : String8(str));
+    gInternTable->add(interned);
+    return interned;
+}
+
+String8 String8::intern(const char* str)
+{
+    if (str == NULL || *str == '\0') {
+        return String8();
+    }
+    Mutex::Autolock _l(gInternLock);
+    return internLocked(str, NULL);
+}
+
+String8 String8::intern(const String8& str)
+{
+    if (str.isEmpty()) {
+        return String8();
+    }
+    Mutex::Autolock _l(gInternLock);
+    return internLocked(str.string(), &str);
+}
+
 void String8::clear() {
     SharedBuffer::bufferFromData(mString)->release();
     mString = getEmptyString();
@@ -311,16 +384,27 @@ status_t String8::appendFormat(const char* fmt, ...)
 
 status_t String8::appendFormatV(const char* fmt, va_list args)
 {
+    // Most formatted strings are short, format into the stack first so
+    // that only the long ones need a second pass.
+    char local[256];
+    va_list tmp;
+    va_copy(tmp, args);
+    int n = vsnprintf(local, sizeof(local), fmt, tmp);
+    va_end(tmp);
+    if (n <= 0) {
+        return (n < 0) ? UNKNOWN_ERROR : NO_ERROR;
+    }
+    if (size_t(n) < sizeof(local)) {
+        return real_append(local, n);
+    }
+
     int result = NO_ERROR;
-    int n = vsnprintf(NULL, 0, fmt, args);
-    if (n != 0) {
-        size_t oldLength = length();
-        char* buf = lockBuffer(oldLength + n);
-        if (buf) {
-            vsnprintf(buf + oldLength, n + 1, fmt, args);
-        } else {
-            result = NO_MEMORY;
-        }
+    size_t oldLength = length();
+    char* buf = lockBuffer(oldLength + n);
+    if (buf) {
+        vsnprintf(buf + oldLength, n + 1, fmt, args);
+    } else {
+        result = NO_MEMORY;
     }
     return result;
 }
@@ -28,9 +28,13 @@
 
 #include <sys/time.h>
 #include <limits.h>
+#include <stdlib.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <string.h>
+#include <time.h>
+
+#include <cutils/properties.h>
 
 #include <utils/SystemClock.h>
 #include <utils/Timers.h>
@@ -146,6 +150,45 @@ static inline void checkTimeStamps(int64_t timestamp,
 #endif
 }
 
+#ifdef HAVE_ANDROID_OS
+/*
+ * b/7100774
+ * clock_gettime(CLOCK_BOOTTIME) appears to have clock skews on some kernels
+ * and can sometimes return backwards values, so it's only used when the
+ * device says its kernel is fine with ro.utils.clock_boottime=1. It is
+ * served from the vDSO where there is one, while the alarm driver costs an
+ * ioctl per call.
+ *
+ * The method, and the alarm driver's fd, are picked once per process: when
+ * neither clock works we don't try to open /dev/alarm on every call.
+ */
+#define METHOD_UNKNOWN          -1
+
+static volatile int32_t gElapsedRealtimeMethod = METHOD_UNKNOWN;
+static volatile int32_t gAlarmFd = -1;
+
+static int selectElapsedRealtimeMethod()
+{
+    char value[PROPERTY_VALUE_MAX];
+    property_get("ro.utils.clock_boottime", value, "0");
+    struct timespec ts;
+    if (atoi(value) && clock_gettime(CLOCK_BOOTTIME, &ts) == 0) {
+        return METHOD_CLOCK_GETTIME;
+    }
+
+    int fd = open("/dev/alarm", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        ALOGW("Unable to open alarm driver: %s\n", strerror(errno));
+        return METHOD_SYSTEMTIME;
+    }
+    if (android_atomic_cmpxchg(-1, fd, &gAlarmFd)) {
+        // another thread got there first
+        close(fd);
+    }
+    return METHOD_IOCTL;
+}
+#endif
+
 /*
  * native public static long elapsedRealtimeNano();
  */
@@ -153,43 +196,34 @@ int64_t elapsedRealtimeNano()
 {
 #ifdef HAVE_ANDROID_OS
     struct timespec ts;
-    int result;
     int64_t timestamp;
     static volatile int64_t prevTimestamp;
     static volatile int prevMethod;
 
-#if 0
-    /*
-     * b/7100774
-     * clock_gettime appears to have clock skews and can sometimes return
-     * backwards values. Disable its use until we find out what's wrong.
-     */
-    result = clock_gettime(CLOCK_BOOTTIME, &ts);
-    if (result == 0) {
-        timestamp = seconds_to_nanoseconds(ts.tv_sec) + ts.tv_nsec;
-        checkTimeStamps(timestamp, &prevTimestamp, &prevMethod,
-                        METHOD_CLOCK_GETTIME);
-        return timestamp;
+    int method = android_atomic_acquire_load(&gElapsedRealtimeMethod);
+    if (method == METHOD_UNKNOWN) {
+        method = selectElapsedRealtimeMethod();
+        android_atomic_release_store(method, &gElapsedRealtimeMethod);
     }
-#endif
-
-    // CLOCK_BOOTTIME doesn't exist, fallback to /dev/alarm
-    static int s_fd = -1;
 
-    if (s_fd == -1) {
-        int fd = open("/dev/alarm", O_RDONLY);
-        if (android_atomic_cmpxchg(-1, fd, &s_fd)) {
-            close(fd);
+    switch (method) {
+    case METHOD_CLOCK_GETTIME:
+        if (clock_gettime(CLOCK_BOOTTIME, &ts) == 0) {
+            timestamp = seconds_to_nanoseconds(ts.tv_sec) + ts.tv_nsec;
+            checkTimeStamps(timestamp, &prevTimestamp, &prevMethod,
+                            METHOD_CLOCK_GETTIME);
+            return timestamp;
         }
-    }
-
-    result = ioctl(s_fd,
-            ANDROID_ALARM_GET_TIME(ANDROID_ALARM_ELAPSED_REALTIME), &ts);
-
-    if (result == 0) {
-        timestamp = seconds_to_nanoseconds(ts.tv_sec) + ts.tv_nsec;
-        checkTimeStamps(timestamp, &prevTimestamp, &prevMethod, METHOD_IOCTL);
-        return timestamp;
+        break;
+    case METHOD_IOCTL:
+        if (ioctl(gAlarmFd,
+                ANDROID_ALARM_GET_TIME(ANDROID_ALARM_ELAPSED_REALTIME), &ts) == 0) {
+            timestamp = seconds_to_nanoseconds(ts.tv_sec) + ts.tv_nsec;
+            checkTimeStamps(timestamp, &prevTimestamp, &prevMethod,
+                            METHOD_IOCTL);
+            return timestamp;
+        }
+        break;
     }
 
     // XXX: there was an error, probably because the driver didn't
@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "ThreadPool"
+
+#include <utils/Log.h>
+#include <utils/ThreadPool.h>
+
+namespace android {
+
+// --- ThreadPool::Task ---
+
+ThreadPool::Task::Task() :
+        mCompleted(false), mPendingDependencies(1),
+        mPool(NULL), mPriority(PRIORITY_NORMAL) {
+}
+
+ThreadPool::Task::~Task() {
+}
+
+void ThreadPool::Task::addDependency(const sp<Task>& other) {
+    LOG_ALWAYS_FATAL_IF(mPool, "Task dependencies must be added before scheduling it");
+
+    AutoMutex _l(other->mLock);
+    if (!other->mCompleted) {
+        android_atomic_inc(&mPendingDependencies);
+        other->mDependents.push(this);
+    }
+}
+
+void ThreadPool::Task::wait() const {
+    AutoMutex _l(mLock);
+    while (!mCompleted) {
+        mCompletedCondition.wait(mLock);
+    }
+}
+
+bool ThreadPool::Task::isCompleted() const {
+    AutoMutex _l(mLock);
+    return mCompleted;
+}
+
+// --- ThreadPool ---
+
+ThreadPool::ThreadPool(size_t threadCount, bool canCallJava) :
+        mNextWorker(0), mQueuedTasks(0), mScheduledTasks(0), mExiting(false) {
+    int result = pthread_key_create(&mTLSKey, NULL);
+    LOG_ALWAYS_FATAL_IF(result != 0, "Could not allocate TLS key.");
+
+    if (threadCount < 1) {
+        threadCount = 1;
+    }
+
+    // all the workers must exist before any of them starts stealing
+    for (size_t i = 0; i < threadCount; i++) {
+        mWorkers.push(new Worker(this, i, canCallJava));
+    }
+    for (size_t i = 0; i < threadCount; i++) {
+        status_t status = mWorkers[i]->run("ThreadPool");
+        LOG_ALWAYS_FATAL_IF(status, "Could not start thread pool thread: %d", status);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    wait();
+
+    { // acquire lock
+        AutoMutex _l(mLock);
+        mExiting = true;
+        mWorkAvailableCondition.broadcast();
+    } // release lock
+
+    size_t count = mWorkers.size();
+    for (size_t i = 0; i < count; i++) {
+        mWorkers[i]->join();
+    }
+    mWorkers.clear();
+    pthread_key_delete(mTLSKey);
+}
+
+status_t ThreadPool::schedule(const sp<Task>& task, Priority priority) {
+    { // acquire lock
+        AutoMutex _l(task->mLock);
+        if (task->mPool) {
+            return INVALID_OPERATION;
+        }
+        task->mPool = this;
+        task->mPriority = priority;
+    } // release lock
+
+    android_atomic_inc(&mScheduledTasks);
+    if (android_atomic_dec(&task->mPendingDependencies) == 1) {
+        enqueue(task);
+    }
+    return OK;
+}
+
+void ThreadPool::wait() {
+    AutoMutex _l(mLock);
+    while (android_atomic_acquire_load(&mScheduledTasks)) {
+        mIdleCondition.wait(mLock);
+    }
+}
+
+void ThreadPool::enqueue(const sp<Task>& task) {
+    // keep the work fanned out by a task on its thread, spread the rest
+    Worker* worker = static_cast<Worker*>(pthread_getspecific(mTLSKey));
+    if (!worker) {
+        uint32_t next = uint32_t(android_atomic_inc(&mNextWorker));
+        worker = mWorkers[next % mWorkers.size()].get();
+    }
+
+    { // acquire lock
+        AutoMutex _l(worker->mLock);
+        worker->mTasks[task->mPriority].push(task);
+        android_atomic_inc(&mQueuedTasks);
+    } // release lock
+
+    AutoMutex _l(mLock);
+    mWorkAvailableCondition.signal();
+}
+
+sp<ThreadPool::Task> ThreadPool::takeTask(size_t workerIndex) {
+    const size_t count = mWorkers.size();
+    for (size_t p = 0; p < PRIORITY_COUNT; p++) {
+        if (!android_atomic_acquire_load(&mQueuedTasks)) {
+            break;
+        }
+
+        // our own deque first, newest task first
+        Worker* worker = mWorkers[workerIndex].get();
+        { // acquire lock
+            AutoMutex _l(worker->mLock);
+            Vector<sp<Task> >& tasks(worker->mTasks[p]);
+            if (!tasks.isEmpty()) {
+                sp<Task> task(tasks.top());
+                tasks.pop();
+                android_atomic_dec(&mQueuedTasks);
+                return task;
+            }
+        } // release lock
+
+        // then steal the oldest task of another deque
+        for (size_t i = 1; i < count; i++) {
+            worker = mWorkers[(workerIndex + i) % count].get();
+            AutoMutex _l(worker->mLock);
+            Vector<sp<Task> >& tasks(worker->mTasks[p]);
+            if (!tasks.isEmpty()) {
+                sp<Task> task(tasks[0]);
+                tasks.removeAt(0);
+                android_atomic_dec(&mQueuedTasks);
+                return task;
+            }
+        }
+    }
+    return NULL;
+}
+
+void ThreadPool::completeTask(const sp<Task>& task) {
+    task->onCompleted();
+
+    Vector<sp<Task> > dependents;
+    { // acquire lock
+        AutoMutex _l(task->mLock);
+        task->mCompleted = true;
+        dependents = task->mDependents;
+        task->mDependents.clear();
+        task->mCompletedCondition.broadcast();
+    } // release lock
+
+    size_t count = dependents.size();
+    for (size_t i = 0; i < count; i++) {
+        const sp<Task>& dependent(dependents[i]);
+        if (android_atomic_dec(&dependent->mPendingDependencies) == 1) {
+            dependent->mPool->enqueue(dependent);
+        }
+    }
+
+    if (android_atomic_dec(&mScheduledTasks) == 1) {
+        AutoMutex _l(mLock);
+        mIdleCondition.broadcast();
+    }
+}
+
+bool ThreadPool::threadLoop(size_t workerIndex) {
+    sp<Task> task(takeTask(workerIndex));
+    if (task != NULL) {
+        task->run();
+        completeTask(task);
+        return true;
+    }
+
+    AutoMutex _l(mLock);
+    while (!android_atomic_acquire_load(&mQueuedTasks)) {
+        if (mExiting) {
+            return false;
+        }
+        mWorkAvailableCondition.wait(mLock);
+    }
+    return true;
+}
+
+// --- ThreadPool::Worker ---
+
+ThreadPool::Worker::Worker(ThreadPool* pool, size_t index, bool canCallJava) :
+        Thread(canCallJava), mPool(pool), mIndex(index) {
+}
+
+ThreadPool::Worker::~Worker() {
+}
+
+status_t ThreadPool::Worker::readyToRun() {
+    pthread_setspecific(mPool->mTLSKey, this);
+    return OK;
+}
+
+bool ThreadPool::Worker::threadLoop() {
+    return mPool->threadLoop(mIndex);
+}
+
+};  // namespace android
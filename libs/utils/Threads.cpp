@@ -18,7 +18,9 @@
 #define LOG_TAG "libutils.threads"
 
 #include <utils/threads.h>
+#include <utils/KeyedVector.h>
 #include <utils/Log.h>
+#include <utils/String8.h>
 
 #include <cutils/sched_policy.h>
 #include <cutils/properties.h>
@@ -26,6 +28,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <memory.h>
+#include <string.h>
 #include <errno.h>
 #include <assert.h>
 #include <unistd.h>
@@ -36,6 +39,7 @@
 # include <sys/resource.h>
 #ifdef HAVE_ANDROID_OS
 # include <bionic_pthread.h>
+# include <sys/syscall.h>
 #endif
 #elif defined(HAVE_WIN32_THREADS)
 # include <windows.h>
@@ -371,6 +375,126 @@ int androidGetThreadPriority(pid_t tid) {
 #endif
 }
 
+void androidInitThreadAttributes(android_thread_attrs_t* attrs)
+{
+    attrs->cpuMask = 0;
+    attrs->schedPolicy = -1;
+    attrs->rtPriority = 0;
+    attrs->schedGroup = -1;
+}
+
+int androidGetThreadAttributes(const char* name, android_thread_attrs_t* attrs)
+{
+    char key[PROPERTY_KEY_MAX];
+    char value[PROPERTY_VALUE_MAX];
+    snprintf(key, sizeof(key), "sys.sched.%s", name);
+    if (property_get(key, value, "") <= 0) {
+        return NAME_NOT_FOUND;
+    }
+
+    android_thread_attrs_t parsed = *attrs;
+    char* state;
+    for (char* token = strtok_r(value, ",", &state); token;
+            token = strtok_r(NULL, ",", &state)) {
+        char* arg = strchr(token, '=');
+        if (!arg) {
+            goto error;
+        }
+        *arg++ = 0;
+        if (!strcmp(token, "cpus")) {
+            char* end;
+            parsed.cpuMask = strtoul(arg, &end, 0);
+            if (*end) {
+                goto error;
+            }
+        } else if (!strcmp(token, "policy")) {
+            if (!strcmp(arg, "other")) {
+                parsed.schedPolicy = SCHED_OTHER;
+            } else if (!strcmp(arg, "fifo")) {
+                parsed.schedPolicy = SCHED_FIFO;
+            } else if (!strcmp(arg, "rr")) {
+                parsed.schedPolicy = SCHED_RR;
+            } else {
+                goto error;
+            }
+        } else if (!strcmp(token, "priority")) {
+            char* end;
+            parsed.rtPriority = strtol(arg, &end, 10);
+            if (*end) {
+                goto error;
+            }
+        } else if (!strcmp(token, "group")) {
+            if (!strcmp(arg, "fg")) {
+                parsed.schedGroup = SP_FOREGROUND;
+            } else if (!strcmp(arg, "bg")) {
+                parsed.schedGroup = SP_BACKGROUND;
+            } else {
+                goto error;
+            }
+        } else {
+            goto error;
+        }
+    }
+    *attrs = parsed;
+    return NO_ERROR;
+
+error:
+    ALOGE("invalid scheduling attributes in %s", key);
+    return BAD_VALUE;
+}
+
+int androidSetThreadAttributes(pid_t tid, const android_thread_attrs_t* attrs)
+{
+    int rc = 0;
+    int lasterr = 0;
+    if (tid == 0) {
+        tid = androidGetTid();
+    }
+
+    if (attrs->cpuMask) {
+        // the kernel takes a mask of unsigned longs
+        unsigned long mask = attrs->cpuMask;
+        if (syscall(__NR_sched_setaffinity, tid, sizeof(mask), &mask) < 0) {
+            rc = -1;
+            lasterr = errno;
+        }
+    }
+
+    if (attrs->schedGroup >= 0) {
+        if (set_sched_policy(tid, SchedPolicy(attrs->schedGroup)) < 0) {
+            rc = -1;
+            lasterr = errno;
+        }
+    }
+
+    if (attrs->schedPolicy >= 0) {
+        struct sched_param param;
+        param.sched_priority = attrs->schedPolicy == SCHED_OTHER ? 0 : attrs->rtPriority;
+        if (sched_setscheduler(tid, attrs->schedPolicy, &param) < 0) {
+            rc = -1;
+            lasterr = errno;
+        }
+    }
+
+    errno = lasterr;
+    return rc;
+}
+
+int androidConfigureThread(pid_t tid, const char* name)
+{
+    android_thread_attrs_t attrs;
+    androidInitThreadAttributes(&attrs);
+    if (androidGetThreadAttributes(name, &attrs) != NO_ERROR) {
+        return 0;
+    }
+    int rc = androidSetThreadAttributes(tid, &attrs);
+    if (rc) {
+        ALOGW("could not set all the scheduling attributes of %s (%s)",
+                name, strerror(errno));
+    }
+    return rc;
+}
+
 #endif
 
 namespace android {
@@ -382,7 +506,200 @@ namespace android {
  */
 
 #if defined(HAVE_PTHREADS)
-// implemented as inlines in threads.h
+// implemented as inlines in threads.h, but for the types other than
+// PRIVATE and SHARED
+
+struct Mutex::Extra {
+    Extra* next;
+    const char* name;
+    // trylock() attempts before sleeping in lock(), 0 if not ADAPTIVE
+    int spinCount;
+    bool track;
+    // tid of the thread holding the mutex, 0 if none (when tracking)
+    volatile pid_t owner;
+    // protected by statsLock
+    pthread_mutex_t statsLock;
+    uint32_t contentions;
+    nsecs_t waitTime;
+    nsecs_t maxWaitTime;
+    pid_t maxWaitOwner;
+
+    // the TRACK_CONTENTION mutexes, only with debug.mutex.track_contention
+    static pthread_mutex_t sTrackedLock;
+    static Extra* sTracked;
+};
+
+pthread_mutex_t Mutex::Extra::sTrackedLock = PTHREAD_MUTEX_INITIALIZER;
+Mutex::Extra* Mutex::Extra::sTracked = NULL;
+
+static bool isContentionTrackingEnabled() {
+    static volatile int32_t sEnabled = -1;
+    if (sEnabled < 0) {
+        char value[PROPERTY_VALUE_MAX];
+        property_get("debug.mutex.track_contention", value, "0");
+        sEnabled = atoi(value) ? 1 : 0;
+    }
+    return sEnabled;
+}
+
+void Mutex::init(int type, const char* name) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    if (type & SHARED) {
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    }
+#if defined(PTHREAD_PRIO_INHERIT)
+    if (type & PRIO_INHERIT) {
+        pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+    }
+#endif
+    pthread_mutex_init(&mMutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    // spinning only helps when the holder can run meanwhile
+    const int spinCount = ((type & ADAPTIVE) && sysconf(_SC_NPROCESSORS_CONF) > 1) ?
+            100 : 0;
+    const bool track = (type & TRACK_CONTENTION) && name &&
+            isContentionTrackingEnabled();
+    if (!spinCount && !track) {
+        return;
+    }
+
+    Extra* e = new Extra;
+    e->next = NULL;
+    e->name = name;
+    e->spinCount = spinCount;
+    e->track = track;
+    e->owner = 0;
+    pthread_mutex_init(&e->statsLock, NULL);
+    e->contentions = 0;
+    e->waitTime = 0;
+    e->maxWaitTime = 0;
+    e->maxWaitOwner = 0;
+    if (track) {
+        pthread_mutex_lock(&Extra::sTrackedLock);
+        e->next = Extra::sTracked;
+        Extra::sTracked = e;
+        pthread_mutex_unlock(&Extra::sTrackedLock);
+    }
+    mExtra = e;
+}
+
+void Mutex::fini() {
+    Extra* e = mExtra;
+    if (e->track) {
+        pthread_mutex_lock(&Extra::sTrackedLock);
+        Extra** p = &Extra::sTracked;
+        while (*p != e) {
+            p = &(*p)->next;
+        }
+        *p = e->next;
+        pthread_mutex_unlock(&Extra::sTrackedLock);
+    }
+    pthread_mutex_destroy(&e->statsLock);
+    delete e;
+    mExtra = NULL;
+}
+
+void Mutex::setOwner() {
+    if (mExtra->track) {
+        mExtra->owner = androidGetTid();
+    }
+}
+
+status_t Mutex::lockSlow() {
+    Extra* const e = mExtra;
+    for (int i=0 ; i<e->spinCount ; i++) {
+        if (pthread_mutex_trylock(&mMutex) == 0) {
+            setOwner();
+            return NO_ERROR;
+        }
+    }
+    if (!e->track) {
+        return -pthread_mutex_lock(&mMutex);
+    }
+    if (pthread_mutex_trylock(&mMutex) == 0) {
+        setOwner();
+        return NO_ERROR;
+    }
+
+    // contended
+    const pid_t holder = e->owner;
+    const nsecs_t start = systemTime();
+    int err = pthread_mutex_lock(&mMutex);
+    const nsecs_t waitTime = systemTime() - start;
+    setOwner();
+    pthread_mutex_lock(&e->statsLock);
+    e->contentions++;
+    e->waitTime += waitTime;
+    if (waitTime > e->maxWaitTime) {
+        e->maxWaitTime = waitTime;
+        e->maxWaitOwner = holder;
+    }
+    pthread_mutex_unlock(&e->statsLock);
+    return -err;
+}
+
+void Mutex::unlockSlow() {
+    mExtra->owner = 0;
+}
+
+status_t Mutex::tryLockSlow() {
+    int err = pthread_mutex_trylock(&mMutex);
+    if (err == 0) {
+        setOwner();
+    }
+    return -err;
+}
+
+// the TRACK_CONTENTION mutexes of a name
+struct MutexContention {
+    uint32_t count;
+    uint32_t contentions;
+    nsecs_t waitTime;
+    nsecs_t maxWaitTime;
+    pid_t maxWaitOwner;
+};
+
+void Mutex::dumpContention(String8& result) {
+    typedef MutexContention Summary;
+    KeyedVector<String8, Summary> summaries;
+    pthread_mutex_lock(&Extra::sTrackedLock);
+    for (Extra* e = Extra::sTracked ; e ; e = e->next) {
+        const String8 name(e->name);
+        ssize_t index = summaries.indexOfKey(name);
+        if (index < 0) {
+            Summary summary;
+            memset(&summary, 0, sizeof(summary));
+            index = summaries.add(name, summary);
+        }
+        Summary& summary(summaries.editValueAt(index));
+        pthread_mutex_lock(&e->statsLock);
+        summary.count++;
+        summary.contentions += e->contentions;
+        summary.waitTime += e->waitTime;
+        if (e->maxWaitTime > summary.maxWaitTime) {
+            summary.maxWaitTime = e->maxWaitTime;
+            summary.maxWaitOwner = e->maxWaitOwner;
+        }
+        pthread_mutex_unlock(&e->statsLock);
+    }
+    pthread_mutex_unlock(&Extra::sTrackedLock);
+
+    if (summaries.isEmpty()) {
+        return;
+    }
+    result.append("Mutex contention:\n");
+    for (size_t i=0 ; i<summaries.size() ; i++) {
+        const Summary& summary(summaries.valueAt(i));
+        result.appendFormat("  %s (x%u): %u contended, waited %.3f ms, "
+                "max %.3f ms held by tid %d\n",
+                summaries.keyAt(i).string(), summary.count,
+                summary.contentions, summary.waitTime / 1e6,
+                summary.maxWaitTime / 1e6, summary.maxWaitOwner);
+    }
+}
+
 #elif defined(HAVE_WIN32_THREADS)
 
 Mutex::Mutex()
@@ -445,6 +762,11 @@ status_t Mutex::tryLock()
     return (dwWaitResult == WAIT_OBJECT_0) ? 0 : -1;
 }
 
+void Mutex::dumpContention(String8& result)
+{
+    // contention isn't tracked here
+}
+
 #else
 #error "Somebody forgot to implement threads for this platform."
 #endif
@@ -886,6 +1208,15 @@ pid_t Thread::getTid() const
     }
     return tid;
 }
+
+status_t Thread::configureScheduling(const char* name)
+{
+    pid_t tid = getTid();
+    if (tid < 0) {
+        return INVALID_OPERATION;
+    }
+    return androidConfigureThread(tid, name) ? -errno : NO_ERROR;
+}
 #endif
 
 bool Thread::exitPending() const
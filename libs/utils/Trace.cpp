@@ -16,6 +16,8 @@
 
 #define LOG_TAG "Trace"
 
+#include <pthread.h>
+
 #include <cutils/properties.h>
 #include <utils/Log.h>
 #include <utils/Trace.h>
@@ -26,6 +28,7 @@ namespace android {
 volatile int32_t Tracer::sIsReady = 0;
 int Tracer::sTraceFD = -1;
 uint64_t Tracer::sEnabledTags = ATRACE_TAG_NOT_READY;
+int Tracer::sPid = 0;
 Mutex Tracer::sMutex;
 
 void Tracer::changeCallback() {
@@ -35,12 +38,19 @@ void Tracer::changeCallback() {
     }
 }
 
+void Tracer::atForkChild() {
+    sPid = getpid();
+}
+
 void Tracer::init() {
     Mutex::Autolock lock(sMutex);
 
     if (!sIsReady) {
         add_sysprop_change_callback(changeCallback, 0);
 
+        sPid = getpid();
+        pthread_atfork(NULL, NULL, atForkChild);
+
         const char* const traceFileName =
                 "/sys/kernel/debug/tracing/trace_marker";
         sTraceFD = open(traceFileName, O_WRONLY);
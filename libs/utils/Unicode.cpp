@@ -17,6 +17,13 @@
 #include <utils/Unicode.h>
 
 #include <stddef.h>
+#include <string.h>
+
+#if defined(__ARM_NEON__)
+# include <arm_neon.h>
+#elif defined(__SSE2__)
+# include <emmintrin.h>
+#endif
 
 #ifdef HAVE_WINSOCK
 # undef  nhtol
@@ -68,6 +75,194 @@ static const char32_t kFirstByteMark[] = {
     0x00000000, 0x00000000, 0x000000C0, 0x000000E0, 0x000000F0
 };
 
+// --------------------------------------------------------------------------
+// ASCII fast paths
+// --------------------------------------------------------------------------
+
+// Most strings converted here are entirely or mostly ASCII, so runs of ASCII
+// characters are handled 16 at a time (with NEON or SSE2 when available, a
+// few machine words at a time otherwise) before falling back to decoding
+// one code point at a time.
+
+#if defined(__ARM_NEON__)
+static inline bool utf8_neon_is_ascii(uint8x16_t v)
+{
+    const uint8x8_t m = vorr_u8(vget_low_u8(v), vget_high_u8(v));
+    return (vget_lane_u64(vreinterpret_u64_u8(m), 0) & 0x8080808080808080ULL) == 0;
+}
+
+static inline bool utf16_neon_is_ascii(uint16x8_t a, uint16x8_t b)
+{
+    const uint16x8_t o = vorrq_u16(a, b);
+    const uint16x4_t m = vorr_u16(vget_low_u16(o), vget_high_u16(o));
+    return (vget_lane_u64(vreinterpret_u64_u16(m), 0) & 0xFF80FF80FF80FF80ULL) == 0;
+}
+#elif defined(__SSE2__)
+static inline bool utf16_sse2_is_ascii(__m128i a, __m128i b)
+{
+    const __m128i high = _mm_and_si128(_mm_or_si128(a, b), _mm_set1_epi16((short)0xFF80));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(high, _mm_setzero_si128())) == 0xFFFF;
+}
+#else
+static inline uint32_t load_u32(const void* p)
+{
+    uint32_t w;
+    memcpy(&w, p, sizeof(w));
+    return w;
+}
+#endif
+
+/**
+ * Returns the number of leading ASCII bytes in "src", at most "len".
+ */
+static inline size_t utf8_ascii_length(const uint8_t* src, size_t len)
+{
+    size_t i = 0;
+#if defined(__ARM_NEON__)
+    for (; i + 16 <= len; i += 16) {
+        if (!utf8_neon_is_ascii(vld1q_u8(src + i))) break;
+    }
+#elif defined(__SSE2__)
+    for (; i + 16 <= len; i += 16) {
+        if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(src + i)))) break;
+    }
+#else
+    for (; i + 8 <= len; i += 8) {
+        if ((load_u32(src + i) | load_u32(src + i + 4)) & 0x80808080) break;
+    }
+#endif
+    while (i < len && src[i] < 0x80) {
+        i++;
+    }
+    return i;
+}
+
+/**
+ * Widens the leading ASCII bytes of "src" into "dst" and returns how many
+ * there were, at most "len".
+ */
+static inline size_t utf8_ascii_to_utf16(const uint8_t* src, size_t len, char16_t* dst)
+{
+    size_t i = 0;
+#if defined(__ARM_NEON__)
+    for (; i + 16 <= len; i += 16) {
+        const uint8x16_t v = vld1q_u8(src + i);
+        if (!utf8_neon_is_ascii(v)) break;
+        vst1q_u16(dst + i, vmovl_u8(vget_low_u8(v)));
+        vst1q_u16(dst + i + 8, vmovl_u8(vget_high_u8(v)));
+    }
+#elif defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= len; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        if (_mm_movemask_epi8(v)) break;
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi8(v, zero));
+        _mm_storeu_si128((__m128i*)(dst + i + 8), _mm_unpackhi_epi8(v, zero));
+    }
+#else
+    for (; i + 8 <= len; i += 8) {
+        if ((load_u32(src + i) | load_u32(src + i + 4)) & 0x80808080) break;
+        for (size_t j = i; j < i + 8; j++) {
+            dst[j] = src[j];
+        }
+    }
+#endif
+    while (i < len && src[i] < 0x80) {
+        dst[i] = src[i];
+        i++;
+    }
+    return i;
+}
+
+/**
+ * Returns the number of leading ASCII code units in "src", at most "len".
+ */
+static inline size_t utf16_ascii_length(const char16_t* src, size_t len)
+{
+    size_t i = 0;
+#if defined(__ARM_NEON__)
+    for (; i + 16 <= len; i += 16) {
+        if (!utf16_neon_is_ascii(vld1q_u16(src + i), vld1q_u16(src + i + 8))) break;
+    }
+#elif defined(__SSE2__)
+    for (; i + 16 <= len; i += 16) {
+        if (!utf16_sse2_is_ascii(_mm_loadu_si128((const __m128i*)(src + i)),
+                _mm_loadu_si128((const __m128i*)(src + i + 8)))) break;
+    }
+#else
+    for (; i + 4 <= len; i += 4) {
+        if ((load_u32(src + i) | load_u32(src + i + 2)) & 0xFF80FF80) break;
+    }
+#endif
+    while (i < len && src[i] < 0x80) {
+        i++;
+    }
+    return i;
+}
+
+/**
+ * Narrows the leading ASCII code units of "src" into "dst" and returns how
+ * many there were, at most "len".
+ */
+static inline size_t utf16_ascii_to_utf8(const char16_t* src, size_t len, char* dst)
+{
+    size_t i = 0;
+#if defined(__ARM_NEON__)
+    for (; i + 16 <= len; i += 16) {
+        const uint16x8_t a = vld1q_u16(src + i);
+        const uint16x8_t b = vld1q_u16(src + i + 8);
+        if (!utf16_neon_is_ascii(a, b)) break;
+        vst1q_u8((uint8_t*)dst + i, vcombine_u8(vmovn_u16(a), vmovn_u16(b)));
+    }
+#elif defined(__SSE2__)
+    for (; i + 16 <= len; i += 16) {
+        const __m128i a = _mm_loadu_si128((const __m128i*)(src + i));
+        const __m128i b = _mm_loadu_si128((const __m128i*)(src + i + 8));
+        if (!utf16_sse2_is_ascii(a, b)) break;
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(a, b));
+    }
+#else
+    for (; i + 4 <= len; i += 4) {
+        if ((load_u32(src + i) | load_u32(src + i + 2)) & 0xFF80FF80) break;
+        for (size_t j = i; j < i + 4; j++) {
+            dst[j] = (char) src[j];
+        }
+    }
+#endif
+    while (i < len && src[i] < 0x80) {
+        dst[i] = (char) src[i];
+        i++;
+    }
+    return i;
+}
+
+/**
+ * Returns a pointer to the first NUL or non-ASCII byte in "src".
+ */
+static inline const char* utf8_skip_ascii(const char* src)
+{
+    const uint8_t* cur = (const uint8_t*) src;
+    while (((uintptr_t) cur & (sizeof(uint32_t) - 1)) != 0) {
+        if (*cur == 0 || *cur >= 0x80) {
+            return (const char*) cur;
+        }
+        cur++;
+    }
+    // The string's end isn't known, but an aligned word never straddles a
+    // page, so reading the whole word holding the NUL is safe.
+    for (;;) {
+        uint32_t w;
+        memcpy(&w, cur, sizeof(w));
+        // true unless every byte is in [0x01, 0x7F]
+        if (((w - 0x01010101) | w) & 0x80808080) break;
+        cur += sizeof(w);
+    }
+    while (*cur != 0 && *cur < 0x80) {
+        cur++;
+    }
+    return (const char*) cur;
+}
+
 // --------------------------------------------------------------------------
 // UTF-32
 // --------------------------------------------------------------------------
@@ -209,11 +404,121 @@ void utf32_to_utf8(const char32_t* src, size_t src_len, char* dst)
 // UTF-16
 // --------------------------------------------------------------------------
 
+// The comparisons below check 8 code units at a time (with NEON or SSE2 when
+// available, a machine word at a time otherwise) for the first difference,
+// and then let the scalar loop find it and compute the result.
+
+#if defined(__ARM_NEON__)
+static inline bool utf16_neon_all_set(uint16x8_t v)
+{
+    const uint16x4_t m = vand_u16(vget_low_u16(v), vget_high_u16(v));
+    return vget_lane_u64(vreinterpret_u64_u16(m), 0) == ~0ULL;
+}
+#endif
+
+/**
+ * Returns whether the 8 code units at "s1" match those at "s2" and contain
+ * no NUL.
+ */
+static inline bool utf16_block_equal_nonzero(const char16_t* s1, const char16_t* s2)
+{
+#if defined(__ARM_NEON__)
+    const uint16x8_t a = vld1q_u16(s1);
+    const uint16x8_t b = vld1q_u16(s2);
+    return utf16_neon_all_set(vbicq_u16(vceqq_u16(a, b), vceqq_u16(a, vdupq_n_u16(0))));
+#elif defined(__SSE2__)
+    const __m128i a = _mm_loadu_si128((const __m128i*) s1);
+    const __m128i b = _mm_loadu_si128((const __m128i*) s2);
+    const __m128i ok = _mm_andnot_si128(_mm_cmpeq_epi16(a, _mm_setzero_si128()),
+            _mm_cmpeq_epi16(a, b));
+    return _mm_movemask_epi8(ok) == 0xFFFF;
+#else
+    for (size_t i = 0; i < 8; i += 2) {
+        const uint32_t w = load_u32(s1 + i);
+        if (w != load_u32(s2 + i) || (w & 0xFFFF) == 0 || (w >> 16) == 0) {
+            return false;
+        }
+    }
+    return true;
+#endif
+}
+
+/**
+ * Returns whether reading 8 code units at "s" stays within its page, so
+ * that it can't fault when the string ends before them.
+ */
+static inline bool utf16_block_in_page(const char16_t* s)
+{
+    // the smallest page size we run with
+    const uintptr_t kPageSize = 4096;
+    return ((uintptr_t) s & (kPageSize - 1)) <= kPageSize - 8 * sizeof(char16_t);
+}
+
+/**
+ * Returns the number of leading code units that are equal in "s1" and
+ * "s2", at most "len".  Both must have at least "len" code units.
+ */
+static inline size_t utf16_equal_length(const char16_t* s1, const char16_t* s2, size_t len)
+{
+    size_t i = 0;
+#if defined(__ARM_NEON__)
+    for (; i + 8 <= len; i += 8) {
+        if (!utf16_neon_all_set(vceqq_u16(vld1q_u16(s1 + i), vld1q_u16(s2 + i)))) break;
+    }
+#elif defined(__SSE2__)
+    for (; i + 8 <= len; i += 8) {
+        const __m128i eq = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i*)(s1 + i)),
+                _mm_loadu_si128((const __m128i*)(s2 + i)));
+        if (_mm_movemask_epi8(eq) != 0xFFFF) break;
+    }
+#else
+    for (; i + 4 <= len; i += 4) {
+        if (load_u32(s1 + i) != load_u32(s2 + i) ||
+                load_u32(s1 + i + 2) != load_u32(s2 + i + 2)) break;
+    }
+#endif
+    while (i < len && s1[i] == s2[i]) {
+        i++;
+    }
+    return i;
+}
+
+/**
+ * Same as utf16_equal_length(), with "s2N" in network byte order.
+ */
+static inline size_t utf16_equal_length_h_n(const char16_t* s1H, const char16_t* s2N, size_t len)
+{
+    size_t i = 0;
+#if defined(HAVE_LITTLE_ENDIAN) && defined(__ARM_NEON__)
+    for (; i + 8 <= len; i += 8) {
+        const uint16x8_t b = vreinterpretq_u16_u8(vrev16q_u8(vld1q_u8((const uint8_t*)(s2N + i))));
+        if (!utf16_neon_all_set(vceqq_u16(vld1q_u16(s1H + i), b))) break;
+    }
+#elif defined(HAVE_LITTLE_ENDIAN) && defined(__SSE2__)
+    for (; i + 8 <= len; i += 8) {
+        const __m128i n = _mm_loadu_si128((const __m128i*)(s2N + i));
+        const __m128i b = _mm_or_si128(_mm_slli_epi16(n, 8), _mm_srli_epi16(n, 8));
+        const __m128i eq = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i*)(s1H + i)), b);
+        if (_mm_movemask_epi8(eq) != 0xFFFF) break;
+    }
+#endif
+    while (i < len && s1H[i] == ntohs(s2N[i])) {
+        i++;
+    }
+    return i;
+}
+
 int strcmp16(const char16_t *s1, const char16_t *s2)
 {
   char16_t ch;
   int d = 0;
 
+  while ( utf16_block_in_page(s1) && utf16_block_in_page(s2) &&
+          utf16_block_equal_nonzero(s1, s2) ) {
+    s1 += 8;
+    s2 += 8;
+  }
+
   while ( 1 ) {
     d = (int)(ch = *s1++) - (int)*s2++;
     if ( d || !ch )
@@ -228,6 +533,13 @@ int strncmp16(const char16_t *s1, const char16_t *s2, size_t n)
   char16_t ch;
   int d = 0;
 
+  while ( n >= 8 && utf16_block_in_page(s1) && utf16_block_in_page(s2) &&
+          utf16_block_equal_nonzero(s1, s2) ) {
+    s1 += 8;
+    s2 += 8;
+    n -= 8;
+  }
+
   while ( n-- ) {
     d = (int)(ch = *s1++) - (int)*s2++;
     if ( d || !ch )
@@ -292,15 +604,13 @@ size_t strnlen16(const char16_t *s, size_t maxlen)
 
 int strzcmp16(const char16_t *s1, size_t n1, const char16_t *s2, size_t n2)
 {
-    const char16_t* e1 = s1+n1;
-    const char16_t* e2 = s2+n2;
-
-    while (s1 < e1 && s2 < e2) {
-        const int d = (int)*s1++ - (int)*s2++;
-        if (d) {
-            return d;
-        }
+    const size_t n = n1 < n2 ? n1 : n2;
+    const size_t i = utf16_equal_length(s1, s2, n);
+    if (i < n) {
+        return (int)s1[i] - (int)s2[i];
     }
+    s1 += n;
+    s2 += n;
 
     return n1 < n2
         ? (0 - (int)*s2)
@@ -311,17 +621,13 @@ int strzcmp16(const char16_t *s1, size_t n1, const char16_t *s2, size_t n2)
 
 int strzcmp16_h_n(const char16_t *s1H, size_t n1, const char16_t *s2N, size_t n2)
 {
-    const char16_t* e1 = s1H+n1;
-    const char16_t* e2 = s2N+n2;
-
-    while (s1H < e1 && s2N < e2) {
-        const char16_t c2 = ntohs(*s2N);
-        const int d = (int)*s1H++ - (int)c2;
-        s2N++;
-        if (d) {
-            return d;
-        }
+    const size_t n = n1 < n2 ? n1 : n2;
+    const size_t i = utf16_equal_length_h_n(s1H, s2N, n);
+    if (i < n) {
+        return (int)s1H[i] - (int)ntohs(s2N[i]);
     }
+    s1H += n;
+    s2N += n;
 
     return n1 < n2
         ? (0 - (int)ntohs(*s2N))
@@ -340,6 +646,12 @@ void utf16_to_utf8(const char16_t* src, size_t src_len, char* dst)
     const char16_t* const end_utf16 = src + src_len;
     char *cur = dst;
     while (cur_utf16 < end_utf16) {
+        if (*cur_utf16 < 0x80) {
+            const size_t n = utf16_ascii_to_utf8(cur_utf16, end_utf16 - cur_utf16, cur);
+            cur_utf16 += n;
+            cur += n;
+            continue;
+        }
         char32_t utf32;
         // surrogate pairs
         if ((*cur_utf16 & 0xFC00) == 0xD800) {
@@ -367,7 +679,9 @@ ssize_t utf8_length(const char *src)
     while (*cur != '\0') {
         const char first_char = *cur++;
         if ((first_char & 0x80) == 0) { // ASCII
-            ret += 1;
+            const char* next = utf8_skip_ascii(cur);
+            ret += 1 + (next - cur);
+            cur = next;
             continue;
         }
         // (UTF-8's character must not be like 10xxxxxx,
@@ -393,7 +707,7 @@ ssize_t utf8_length(const char *src)
             return -1;
         }
         to_ignore_mask |= mask;
-        utf32 |= ((~to_ignore_mask) & first_char) << (6 * (num_to_read - 1));
+        utf32 |= ((~to_ignore_mask) & (uint8_t) first_char) << (6 * (num_to_read - 1));
         if (utf32 > kUnicodeMaxCodepoint) {
             return -1;
         }
@@ -412,7 +726,11 @@ ssize_t utf16_to_utf8_length(const char16_t *src, size_t src_len)
     size_t ret = 0;
     const char16_t* const end = src + src_len;
     while (src < end) {
-        if ((*src & 0xFC00) == 0xD800 && (src + 1) < end
+        if (*src < 0x80) {
+            const size_t n = utf16_ascii_length(src, end - src);
+            ret += n;
+            src += n;
+        } else if ((*src & 0xFC00) == 0xD800 && (src + 1) < end
                 && (*++src & 0xFC00) == 0xDC00) {
             // surrogate pairs are always 4 bytes.
             ret += 4;
@@ -424,6 +742,43 @@ ssize_t utf16_to_utf8_length(const char16_t *src, size_t src_len)
     return ret;
 }
 
+size_t utf16_to_utf8_and_length(const char16_t* src, size_t src_len, char* dst)
+{
+    if (src == NULL || src_len == 0 || dst == NULL) {
+        if (dst != NULL) {
+            *dst = '\0';
+        }
+        return 0;
+    }
+
+    const char16_t* cur_utf16 = src;
+    const char16_t* const end_utf16 = src + src_len;
+    char* cur = dst;
+    while (cur_utf16 < end_utf16) {
+        if (*cur_utf16 < 0x80) {
+            const size_t n = utf16_ascii_to_utf8(cur_utf16, end_utf16 - cur_utf16, cur);
+            cur_utf16 += n;
+            cur += n;
+            continue;
+        }
+        char32_t utf32;
+        // same handling of unpaired surrogates as utf16_to_utf8_length
+        if ((*cur_utf16 & 0xFC00) == 0xD800 && (cur_utf16 + 1) < end_utf16
+                && (*++cur_utf16 & 0xFC00) == 0xDC00) {
+            utf32 = (cur_utf16[-1] - 0xD800) << 10;
+            utf32 |= *cur_utf16++ - 0xDC00;
+            utf32 += 0x10000;
+        } else {
+            utf32 = (char32_t) *cur_utf16++;
+        }
+        const size_t len = utf32_codepoint_utf8_length(utf32);
+        utf32_codepoint_to_utf8((uint8_t*)cur, utf32, len);
+        cur += len;
+    }
+    *cur = '\0';
+    return cur - dst;
+}
+
 /**
  * Returns 1-4 based on the number of leading bits.
  *
@@ -524,8 +879,18 @@ ssize_t utf8_to_utf16_length(const uint8_t* u8str, size_t u8len)
     /* Validate that the UTF-8 is the correct len */
     size_t u16measuredLen = 0;
     while (u8cur < u8end) {
+        if (*u8cur < 0x80) {
+            const size_t n = utf8_ascii_length(u8cur, u8end - u8cur);
+            u16measuredLen += n;
+            u8cur += n;
+            continue;
+        }
         u16measuredLen++;
         int u8charLen = utf8_codepoint_len(*u8cur);
+        if (u8charLen > u8end - u8cur) {
+            // truncated, don't read past the end
+            return -1;
+        }
         uint32_t codepoint = utf8_to_utf32_codepoint(u8cur, u8charLen);
         if (codepoint > 0xFFFF) u16measuredLen++; // this will be a surrogate pair in utf16
         u8cur += u8charLen;
@@ -549,6 +914,12 @@ char16_t* utf8_to_utf16_no_null_terminator(const uint8_t* u8str, size_t u8len, c
     char16_t* u16cur = u16str;
 
     while (u8cur < u8end) {
+        if (*u8cur < 0x80) {
+            const size_t n = utf8_ascii_to_utf16(u8cur, u8end - u8cur, u16cur);
+            u8cur += n;
+            u16cur += n;
+            continue;
+        }
         size_t u8len = utf8_codepoint_len(*u8cur);
         uint32_t codepoint = utf8_to_utf32_codepoint(u8cur, u8len);
 
@@ -573,4 +944,36 @@ void utf8_to_utf16(const uint8_t* u8str, size_t u8len, char16_t* u16str) {
     *end = 0;
 }
 
+ssize_t utf8_to_utf16_and_length(const uint8_t* u8str, size_t u8len, char16_t* u16str)
+{
+    const uint8_t* const u8end = u8str + u8len;
+    const uint8_t* u8cur = u8str;
+    char16_t* u16cur = u16str;
+
+    while (u8cur < u8end) {
+        if (*u8cur < 0x80) {
+            const size_t n = utf8_ascii_to_utf16(u8cur, u8end - u8cur, u16cur);
+            u8cur += n;
+            u16cur += n;
+            continue;
+        }
+        const size_t len = utf8_codepoint_len(*u8cur);
+        if (len > size_t(u8end - u8cur)) {
+            // the last code point is truncated
+            return -1;
+        }
+        uint32_t codepoint = utf8_to_utf32_codepoint(u8cur, len);
+        if (codepoint <= 0xFFFF) {
+            *u16cur++ = (char16_t) codepoint;
+        } else {
+            codepoint = codepoint - 0x10000;
+            *u16cur++ = (char16_t) ((codepoint >> 10) + 0xD800);
+            *u16cur++ = (char16_t) ((codepoint & 0x3FF) + 0xDC00);
+        }
+        u8cur += len;
+    }
+    *u16cur = 0;
+    return u16cur - u16str;
+}
+
 }
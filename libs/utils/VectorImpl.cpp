@@ -35,10 +35,20 @@ namespace android {
 
 const size_t kMinVectorCapacity = 4;
 
+// vectors smaller than this (in bytes) double their capacity when they
+// grow, larger ones grow by half to bound the unused space
+const size_t kVectorDoublingLimit = 4096;
+
 static inline size_t max(size_t a, size_t b) {
     return a>b ? a : b;
 }
 
+static inline size_t grow_capacity(size_t new_size, size_t item_size) {
+    const size_t capacity = (new_size*item_size < kVectorDoublingLimit) ?
+            new_size*2 : ((new_size*3)+1)/2;
+    return max(kMinVectorCapacity, capacity);
+}
+
 // ----------------------------------------------------------------------------
 
 VectorImpl::VectorImpl(size_t itemSize, uint32_t flags)
@@ -331,6 +341,15 @@ ssize_t VectorImpl::setCapacity(size_t new_capacity)
         // we can't reduce the capacity
         return current_capacity;
     } 
+    if (_can_relocate_in_place()) {
+        SharedBuffer* sb = SharedBuffer::bufferFromData(mStorage)
+                ->editResize(new_capacity * mItemSize);
+        if (sb == 0) {
+            return NO_MEMORY;
+        }
+        mStorage = sb->data();
+        return new_capacity;
+    }
     SharedBuffer* sb = SharedBuffer::alloc(new_capacity * mItemSize);
     if (sb) {
         void* array = sb->data();
@@ -365,31 +384,43 @@ void* VectorImpl::_grow(size_t where, size_t amount)
 
     const size_t new_size = mCount + amount;
     if (capacity() < new_size) {
-        const size_t new_capacity = max(kMinVectorCapacity, ((new_size*3)+1)/2);
+        const size_t new_capacity = grow_capacity(new_size, mItemSize);
 //        ALOGV("grow vector %p, new_capacity=%d", this, (int)new_capacity);
         if ((mStorage) &&
-            (mCount==where) &&
-            (mFlags & HAS_TRIVIAL_COPY) &&
-            (mFlags & HAS_TRIVIAL_DTOR))
+            (((mCount==where) &&
+              (mFlags & HAS_TRIVIAL_COPY) &&
+              (mFlags & HAS_TRIVIAL_DTOR)) ||
+             _can_relocate_in_place()))
         {
+            // realloc the storage and open the gap in it, rather than
+            // copying (and destroying) every item
             const SharedBuffer* cur_sb = SharedBuffer::bufferFromData(mStorage);
             SharedBuffer* sb = cur_sb->editResize(new_capacity * mItemSize);
+            if (sb == 0) {
+                return 0;
+            }
             mStorage = sb->data();
+            if (where != mCount) {
+                const void* from = reinterpret_cast<const uint8_t *>(mStorage) + where*mItemSize;
+                void* to = reinterpret_cast<uint8_t *>(mStorage) + (where+amount)*mItemSize;
+                _do_move_forward(to, from, mCount - where);
+            }
         } else {
             SharedBuffer* sb = SharedBuffer::alloc(new_capacity * mItemSize);
-            if (sb) {
-                void* array = sb->data();
-                if (where != 0) {
-                    _do_copy(array, mStorage, where);
-                }
-                if (where != mCount) {
-                    const void* from = reinterpret_cast<const uint8_t *>(mStorage) + where*mItemSize;
-                    void* dest = reinterpret_cast<uint8_t *>(array) + (where+amount)*mItemSize;
-                    _do_copy(dest, from, mCount-where);
-                }
-                release_storage();
-                mStorage = const_cast<void*>(array);
+            if (sb == 0) {
+                return 0;
+            }
+            void* array = sb->data();
+            if (where != 0) {
+                _do_copy(array, mStorage, where);
+            }
+            if (where != mCount) {
+                const void* from = reinterpret_cast<const uint8_t *>(mStorage) + where*mItemSize;
+                void* dest = reinterpret_cast<uint8_t *>(array) + (where+amount)*mItemSize;
+                _do_copy(dest, from, mCount-where);
             }
+            release_storage();
+            mStorage = const_cast<void*>(array);
         }
     } else {
         void* array = editArrayImpl();
@@ -420,7 +451,20 @@ void VectorImpl::_shrink(size_t where, size_t amount)
     if (new_size*3 < capacity()) {
         const size_t new_capacity = max(kMinVectorCapacity, new_size*2);
 //        ALOGV("shrink vector %p, new_capacity=%d", this, (int)new_capacity);
-        if ((where == new_size) &&
+        if (_can_relocate_in_place()) {
+            // close the gap in place, then give back the unused storage
+            void* to = reinterpret_cast<uint8_t *>(mStorage) + where*mItemSize;
+            _do_destroy(to, amount);
+            if (where != new_size) {
+                const void* from = reinterpret_cast<uint8_t *>(mStorage) + (where+amount)*mItemSize;
+                _do_move_backward(to, from, new_size - where);
+            }
+            SharedBuffer* sb = SharedBuffer::bufferFromData(mStorage)
+                    ->editResize(new_capacity * mItemSize);
+            if (sb) {
+                mStorage = sb->data();
+            }
+        } else if ((where == new_size) &&
             (mFlags & HAS_TRIVIAL_COPY) &&
             (mFlags & HAS_TRIVIAL_DTOR))
         {
@@ -487,11 +531,32 @@ void VectorImpl::_do_splat(void* dest, const void* item, size_t num) const {
 }
 
 void VectorImpl::_do_move_forward(void* dest, const void* from, size_t num) const {
-    do_move_forward(dest, from, num);
+    if (_is_relocatable()) {
+        memmove(dest, from, num*itemSize());
+    } else {
+        do_move_forward(dest, from, num);
+    }
 }
 
 void VectorImpl::_do_move_backward(void* dest, const void* from, size_t num) const {
-    do_move_backward(dest, from, num);
+    if (_is_relocatable()) {
+        memmove(dest, from, num*itemSize());
+    } else {
+        do_move_backward(dest, from, num);
+    }
+}
+
+bool VectorImpl::_is_relocatable() const {
+    // moving an item with a trivial copy and destructor is a memcpy too
+    return (mFlags & HAS_TRIVIAL_MOVE) ||
+            ((mFlags & HAS_TRIVIAL_COPY) && (mFlags & HAS_TRIVIAL_DTOR));
+}
+
+bool VectorImpl::_can_relocate_in_place() const {
+    // items in a shared storage must be copied, the other owners still
+    // reference them
+    return mStorage && _is_relocatable() &&
+            SharedBuffer::bufferFromData(mStorage)->onlyOwner();
 }
 
 void VectorImpl::reservedVectorImpl1() { }
@@ -21,8 +21,11 @@
 //#define LOG_NDEBUG 0
 #include <utils/Log.h>
 #include <utils/ZipFileRO.h>
+#include <utils/ThreadPool.h>
+#include <utils/String8.h>
 #include <utils/misc.h>
 #include <utils/threads.h>
+#include <cutils/atomic.h>
 
 #include <zlib.h>
 
@@ -31,6 +34,7 @@
 #include <errno.h>
 #include <assert.h>
 #include <unistd.h>
+#include <sys/stat.h>
 
 #if HAVE_PRINTF_ZD
 #  define ZD "%zd"
@@ -102,8 +106,35 @@ using namespace android;
  */
 #define kZipEntryAdj        10000
 
+/*
+ * An index file is this header followed by the hash table, in the byte
+ * order of the device that wrote it.  Bump kIndexVersion whenever HashEntry
+ * or computeHash() change.
+ */
+#define kIndexMagic         0x7864697a      // "zidx"
+#define kIndexVersion       1
+
+namespace {
+
+struct IndexHeader {
+    uint32_t    magic;
+    uint32_t    version;
+    /* the archive the index was written for */
+    uint64_t    archiveLength;
+    int64_t     archiveModified;
+    uint32_t    dirOffset;
+    uint32_t    dirSize;
+    uint32_t    numEntries;
+    uint32_t    hashTableSize;
+};
+
+} // anonymous namespace
+
 ZipFileRO::~ZipFileRO() {
-    free(mHashTable);
+    if (mIndexMap)
+        mIndexMap->release();
+    else
+        free(mHashTable);
     if (mDirectoryMap)
         mDirectoryMap->release();
     if (mFd >= 0)
@@ -119,7 +150,9 @@ ZipFileRO::~ZipFileRO() {
 int ZipFileRO::entryToIndex(const ZipEntryRO entry) const
 {
     long ent = ((intptr_t) entry) - kZipEntryAdj;
-    if (ent < 0 || ent >= mHashTableSize || mHashTable[ent].name == NULL) {
+    if (ent < 0 || ent >= mHashTableSize ||
+            mHashTable[ent].nameOffset < kCDELen ||
+            entryName(mHashTable[ent]) == NULL) {
         ALOGW("Invalid ZipEntryRO %p (%ld)\n", entry, ent);
         return -1;
     }
@@ -131,7 +164,7 @@ int ZipFileRO::entryToIndex(const ZipEntryRO entry) const
  * Open the specified file read-only.  We memory-map the entire thing and
  * close the file before returning.
  */
-status_t ZipFileRO::open(const char* zipFileName)
+status_t ZipFileRO::open(const char* zipFileName, const char* indexFileName)
 {
     int fd = -1;
 
@@ -162,14 +195,15 @@ status_t ZipFileRO::open(const char* zipFileName)
     /*
      * Find the Central Directory and store its size and number of entries.
      */
-    if (!mapCentralDirectory()) {
+    if (!mapCentralDirectory(indexFileName)) {
         goto bail;
     }
 
     /*
-     * Verify Central Directory and create data structures for fast access.
+     * Verify Central Directory and create data structures for fast access,
+     * unless we have them already.
      */
-    if (!parseZipArchive()) {
+    if (mIndexMap == NULL && !parseZipArchive()) {
         goto bail;
     }
 
@@ -186,7 +220,7 @@ bail:
  * Parse the Zip archive, verifying its contents and initializing internal
  * data structures.
  */
-bool ZipFileRO::mapCentralDirectory(void)
+bool ZipFileRO::mapCentralDirectory(const char* indexFileName)
 {
     ssize_t readAmount = kMaxEOCDSearch;
     if (readAmount > (ssize_t) mFileLength)
@@ -308,7 +342,18 @@ bool ZipFileRO::mapCentralDirectory(void)
         return false;
     }
 
-    if (!mDirectoryMap->create(mFileName, mFd, dirOffset, dirSize, true)) {
+    /*
+     * parseZipArchive() is about to walk the whole directory, so fault it
+     * in at once rather than a page at a time.  With an index we only touch
+     * the entries that are looked up.
+     */
+    if (indexFileName != NULL) {
+        mapIndex(indexFileName, dirOffset, dirSize, numEntries);
+    }
+    FileMap::CreateOptions options(FileMap::getDefaultCreateOptions());
+    options.populate = (mIndexMap == NULL);
+    if (!mDirectoryMap->create(mFileName, mFd, dirOffset, dirSize, true,
+            options)) {
         ALOGW("Unable to map '%s' (" ZD " to " ZD "): %s\n", mFileName,
                 (ZD_TYPE) dirOffset, (ZD_TYPE) (dirOffset + dirSize), strerror(errno));
         return false;
@@ -321,6 +366,145 @@ bool ZipFileRO::mapCentralDirectory(void)
 }
 
 
+/*
+ * Map the hash table saved by writeIndex(), after checking that it was
+ * written for this archive.
+ */
+bool ZipFileRO::mapIndex(const char* indexFileName, off64_t dirOffset,
+    size_t dirSize, int numEntries)
+{
+    struct stat zipStat;
+    if (fstat(mFd, &zipStat) != 0) {
+        ALOGW("fstat of '%s' failed: %s\n", mFileName, strerror(errno));
+        return false;
+    }
+
+    int fd = TEMP_FAILURE_RETRY(::open(indexFileName, O_RDONLY | O_BINARY));
+    if (fd < 0) {
+        ALOGV("No zip index '%s': %s\n", indexFileName, strerror(errno));
+        return false;
+    }
+
+    bool result = false;
+    IndexHeader header;
+    FileMap* map = NULL;
+    size_t tableLength;
+    off64_t indexLength = lseek64(fd, 0, SEEK_END);
+    if (indexLength < (off64_t) sizeof(header) ||
+            lseek64(fd, 0, SEEK_SET) != 0 ||
+            TEMP_FAILURE_RETRY(read(fd, &header, sizeof(header))) !=
+                    (ssize_t) sizeof(header)) {
+        ALOGW("Unable to read zip index '%s'\n", indexFileName);
+        goto bail;
+    }
+
+    /*
+     * The table size must be a power of 2 with room to spare, so that
+     * lookups always find an empty slot.
+     */
+    tableLength = (size_t) header.hashTableSize * sizeof(HashEntry);
+    if (header.magic != kIndexMagic || header.version != kIndexVersion ||
+            header.hashTableSize <= header.numEntries ||
+            (header.hashTableSize & (header.hashTableSize - 1)) != 0 ||
+            tableLength / sizeof(HashEntry) != header.hashTableSize ||
+            (off64_t) (sizeof(header) + tableLength) != indexLength) {
+        ALOGW("Ignoring bad zip index '%s'\n", indexFileName);
+        goto bail;
+    }
+    if (header.archiveLength != (uint64_t) mFileLength ||
+            header.archiveModified != (int64_t) zipStat.st_mtime ||
+            header.dirOffset != dirOffset || header.dirSize != dirSize ||
+            header.numEntries != (uint32_t) numEntries) {
+        ALOGD("Ignoring stale zip index '%s'\n", indexFileName);
+        goto bail;
+    }
+
+    map = new FileMap();
+    if (!map->create(indexFileName, fd, 0, indexLength, true)) {
+        ALOGW("Unable to map zip index '%s': %s\n", indexFileName,
+            strerror(errno));
+        map->release();
+        goto bail;
+    }
+
+    mIndexMap = map;
+    mHashTableSize = header.hashTableSize;
+    mHashTable = (HashEntry*) ((char*) map->getDataPtr() + sizeof(header));
+    ALOGV("+++ mapped zip index '%s'\n", indexFileName);
+    result = true;
+
+bail:
+    TEMP_FAILURE_RETRY(close(fd));
+    return result;
+}
+
+/*
+ * Write the whole buffer, retrying short writes.
+ */
+static bool writeFully(int fd, const void* buf, size_t len)
+{
+    const char* ptr = (const char*) buf;
+    while (len > 0) {
+        ssize_t actual = TEMP_FAILURE_RETRY(write(fd, ptr, len));
+        if (actual <= 0)
+            return false;
+        ptr += actual;
+        len -= actual;
+    }
+    return true;
+}
+
+status_t ZipFileRO::writeIndex(const char* indexFileName) const
+{
+    if (mHashTableSize <= 0 || mDirectoryMap == NULL) {
+        return INVALID_OPERATION;
+    }
+
+    struct stat zipStat;
+    if (fstat(mFd, &zipStat) != 0) {
+        ALOGW("fstat of '%s' failed: %s\n", mFileName, strerror(errno));
+        return UNKNOWN_ERROR;
+    }
+
+    IndexHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = kIndexMagic;
+    header.version = kIndexVersion;
+    header.archiveLength = mFileLength;
+    header.archiveModified = zipStat.st_mtime;
+    header.dirOffset = mDirectoryOffset;
+    header.dirSize = mDirectoryMap->getDataLength();
+    header.numEntries = mNumEntries;
+    header.hashTableSize = mHashTableSize;
+
+    /*
+     * Write a temporary file and rename it over the index, so readers see
+     * either the old index or the complete new one.
+     */
+    String8 tmpName(indexFileName);
+    tmpName.append(".tmp");
+    int fd = TEMP_FAILURE_RETRY(::open(tmpName.string(),
+            O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644));
+    if (fd < 0) {
+        ALOGW("Unable to create zip index '%s': %s\n", tmpName.string(),
+            strerror(errno));
+        return UNKNOWN_ERROR;
+    }
+
+    bool ok = writeFully(fd, &header, sizeof(header)) &&
+            writeFully(fd, mHashTable, mHashTableSize * sizeof(HashEntry));
+    if (TEMP_FAILURE_RETRY(close(fd)) != 0)
+        ok = false;
+    if (!ok || rename(tmpName.string(), indexFileName) != 0) {
+        ALOGW("Unable to write zip index '%s': %s\n", indexFileName,
+            strerror(errno));
+        unlink(tmpName.string());
+        return UNKNOWN_ERROR;
+    }
+
+    return OK;
+}
+
 /*
  * Round up to the next highest power of 2.
  *
@@ -382,7 +566,7 @@ bool ZipFileRO::parseZipArchive(void)
 
         /* add the CDE filename to the hash table */
         hash = computeHash((const char*)ptr + kCDELen, fileNameLen);
-        addToHash((const char*)ptr + kCDELen, fileNameLen, hash);
+        addToHash(ptr + kCDELen - cdPtr, fileNameLen, hash);
 
         ptr += kCDELen + fileNameLen + extraLen + commentLen;
         if ((size_t)(ptr - cdPtr) > cdLength) {
@@ -414,17 +598,17 @@ bail:
 /*
  * Add a new entry to the hash table.
  */
-void ZipFileRO::addToHash(const char* str, int strLen, unsigned int hash)
+void ZipFileRO::addToHash(uint32_t nameOffset, int strLen, unsigned int hash)
 {
     int ent = hash & (mHashTableSize-1);
 
     /*
      * We over-allocate the table, so we're guaranteed to find an empty slot.
      */
-    while (mHashTable[ent].name != NULL)
+    while (mHashTable[ent].nameOffset != 0)
         ent = (ent + 1) & (mHashTableSize-1);
 
-    mHashTable[ent].name = str;
+    mHashTable[ent].nameOffset = nameOffset;
     mHashTable[ent].nameLen = strLen;
 }
 
@@ -447,12 +631,16 @@ ZipEntryRO ZipFileRO::findEntryByName(const char* fileName) const
     unsigned int hash = computeHash(fileName, nameLen);
     int ent = hash & (mHashTableSize-1);
 
-    while (mHashTable[ent].name != NULL) {
-        if (mHashTable[ent].nameLen == nameLen &&
-            memcmp(mHashTable[ent].name, fileName, nameLen) == 0)
-        {
-            /* match */
-            return (ZipEntryRO)(long)(ent + kZipEntryAdj);
+    /* a corrupt index file may not have an empty slot to stop at */
+    int probes = mHashTableSize;
+
+    while (mHashTable[ent].nameOffset != 0 && probes-- > 0) {
+        if (mHashTable[ent].nameLen == nameLen) {
+            const char* name = entryName(mHashTable[ent]);
+            if (name != NULL && memcmp(name, fileName, nameLen) == 0) {
+                /* match */
+                return (ZipEntryRO)(long)(ent + kZipEntryAdj);
+            }
         }
 
         ent = (ent + 1) & (mHashTableSize-1);
@@ -476,7 +664,7 @@ ZipEntryRO ZipFileRO::findEntryByIndex(int idx) const
     }
 
     for (int ent = 0; ent < mHashTableSize; ent++) {
-        if (mHashTable[ent].name != NULL) {
+        if (mHashTable[ent].nameOffset != 0) {
             if (idx-- == 0)
                 return (ZipEntryRO) (intptr_t)(ent + kZipEntryAdj);
         }
@@ -507,7 +695,7 @@ bool ZipFileRO::getEntryInfo(ZipEntryRO entry, int* pMethod, size_t* pUncompLen,
      * pointer.  The filename is the first entry past the fixed-size data,
      * so we can just subtract back from that.
      */
-    const unsigned char* ptr = (const unsigned char*) hashEntry.name;
+    const unsigned char* ptr = (const unsigned char*) entryName(hashEntry);
     off64_t cdOffset = mDirectoryOffset;
 
     ptr -= kCDELen;
@@ -649,7 +837,7 @@ int ZipFileRO::getEntryFileName(ZipEntryRO entry, char* buffer, int bufLen)
     if (bufLen < nameLen+1)
         return nameLen+1;
 
-    memcpy(buffer, mHashTable[ent].name, nameLen);
+    memcpy(buffer, entryName(mHashTable[ent]), nameLen);
     buffer[nameLen] = '\0';
     return 0;
 }
@@ -795,6 +983,78 @@ bail:
     return result;
 }
 
+/*
+ * Uncompresses one entry of a batch on a thread of the pool.
+ */
+class UncompressEntryTask : public ThreadPool::Task {
+public:
+    UncompressEntryTask(const ZipFileRO* zip, ZipEntryRO entry, void* buffer,
+            volatile int32_t* failures)
+        : mZip(zip), mEntry(entry), mBuffer(buffer), mFailures(failures)
+        {}
+
+    virtual void run() {
+        if (!mZip->uncompressEntry(mEntry, mBuffer))
+            android_atomic_inc(mFailures);
+    }
+
+private:
+    const ZipFileRO* const mZip;
+    const ZipEntryRO mEntry;
+    void* const mBuffer;
+    volatile int32_t* const mFailures;
+};
+
+/*
+ * Uncompress several entries in parallel.
+ *
+ * Every entry gets its own mapping and inflater state in uncompressEntry(),
+ * and the shared file descriptor is only used under mFdLock, so the
+ * entries don't need any more locking than that.
+ */
+bool ZipFileRO::uncompressEntries(const ZipEntryRO* entries,
+    void* const* buffers, size_t count, ThreadPool* pool) const
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threadCount = cpus > 1 ? (size_t) cpus : 1;
+    if (threadCount > count)
+        threadCount = count;
+
+    if (pool == NULL && threadCount <= 1) {
+        /* not worth starting any thread */
+        bool result = true;
+        for (size_t i = 0; i < count; i++) {
+            if (!uncompressEntry(entries[i], buffers[i]))
+                result = false;
+        }
+        return result;
+    }
+
+    ThreadPool* localPool = NULL;
+    if (pool == NULL) {
+        localPool = new ThreadPool(threadCount, false);
+        pool = localPool;
+    }
+
+    volatile int32_t failures = 0;
+    Vector<sp<ThreadPool::Task> > tasks;
+    tasks.setCapacity(count);
+    for (size_t i = 0; i < count; i++) {
+        sp<ThreadPool::Task> task(new UncompressEntryTask(this,
+                entries[i], buffers[i], &failures));
+        pool->schedule(task);
+        tasks.add(task);
+    }
+
+    /* the pool might be running other work too, only wait for ours */
+    for (size_t i = 0; i < count; i++)
+        tasks[i]->wait();
+
+    delete localPool;
+
+    return android_atomic_acquire_load(&failures) == 0;
+}
+
 /*
  * Uncompress "deflate" data from one buffer to another.
  */
@@ -951,3 +1211,140 @@ z_bail:
 bail:
     return result;
 }
+
+/*
+ * ===========================================================================
+ *      ZipEntryReader
+ * ===========================================================================
+ */
+
+ZipEntryReader::ZipEntryReader()
+    : mMap(NULL), mZStream(NULL), mMethod(-1),
+      mCompLen(0), mUncompLen(0), mOffset(0), mFailed(false)
+{
+}
+
+ZipEntryReader::~ZipEntryReader()
+{
+    close();
+}
+
+bool ZipEntryReader::open(const ZipFileRO& zip, ZipEntryRO entry)
+{
+    const size_t kSequentialMin = 32768;
+    int method;
+    size_t uncompLen, compLen;
+
+    close();
+
+    if (!zip.getEntryInfo(entry, &method, &uncompLen, &compLen, NULL, NULL,
+            NULL))
+        return false;
+
+    if (method == ZipFileRO::kCompressStored) {
+        if (compLen < uncompLen) {
+            ALOGW("Stored entry is short (" ZD " of " ZD ")\n",
+                (ZD_TYPE) compLen, (ZD_TYPE) uncompLen);
+            return false;
+        }
+    } else if (method != ZipFileRO::kCompressDeflated) {
+        ALOGW("Unsupported compression method %d\n", method);
+        return false;
+    }
+
+    FileMap* map = zip.createEntryFileMap(entry);
+    if (map == NULL)
+        return false;
+
+    if (method == ZipFileRO::kCompressDeflated) {
+        z_stream* zstream = new z_stream;
+        memset(zstream, 0, sizeof(*zstream));
+        zstream->zalloc = Z_NULL;
+        zstream->zfree = Z_NULL;
+        zstream->opaque = Z_NULL;
+        zstream->next_in = (Bytef*) map->getDataPtr();
+        zstream->avail_in = compLen;
+        zstream->data_type = Z_UNKNOWN;
+
+        /* no zlib header, see inflateBuffer() */
+        int zerr = inflateInit2(zstream, -MAX_WBITS);
+        if (zerr != Z_OK) {
+            ALOGE("Call to inflateInit2 failed (zerr=%d)\n", zerr);
+            delete zstream;
+            map->release();
+            return false;
+        }
+        mZStream = zstream;
+    }
+
+    /*
+     * The whole entry is going to be read in order, and the mapping is
+     * ours alone, so there's no need to turn the hint back off the way
+     * uncompressEntry() does.
+     */
+    if (compLen > kSequentialMin)
+        map->advise(FileMap::SEQUENTIAL);
+
+    mMap = map;
+    mMethod = method;
+    mCompLen = compLen;
+    mUncompLen = uncompLen;
+    mOffset = 0;
+    mFailed = false;
+    return true;
+}
+
+ssize_t ZipEntryReader::read(void* buffer, size_t len)
+{
+    if (mMap == NULL || mFailed)
+        return -1;
+
+    if (len > mUncompLen - mOffset)
+        len = mUncompLen - mOffset;
+    if (len == 0)
+        return 0;
+
+    if (mMethod == ZipFileRO::kCompressStored) {
+        memcpy(buffer, (const unsigned char*) mMap->getDataPtr() + mOffset,
+            len);
+    } else {
+        z_stream* zstream = (z_stream*) mZStream;
+        zstream->next_out = (Bytef*) buffer;
+        zstream->avail_out = len;
+
+        /*
+         * All the input is available, so inflate() only stops short of
+         * filling the buffer if the data ends early or is corrupt.
+         */
+        int zerr = inflate(zstream, Z_NO_FLUSH);
+        if ((zerr != Z_OK && zerr != Z_STREAM_END) || zstream->avail_out != 0) {
+            ALOGW("Zip inflate failed, zerr=%d (aIn=%u aOut=%u at " ZD " of "
+                ZD ")\n", zerr, zstream->avail_in, zstream->avail_out,
+                (ZD_TYPE) mOffset, (ZD_TYPE) mUncompLen);
+            mFailed = true;
+            return -1;
+        }
+    }
+
+    mOffset += len;
+    return len;
+}
+
+void ZipEntryReader::close()
+{
+    if (mZStream != NULL) {
+        z_stream* zstream = (z_stream*) mZStream;
+        inflateEnd(zstream);
+        delete zstream;
+        mZStream = NULL;
+    }
+    if (mMap != NULL) {
+        mMap->release();
+        mMap = NULL;
+    }
+    mMethod = -1;
+    mCompLen = 0;
+    mUncompLen = 0;
+    mOffset = 0;
+    mFailed = false;
+}
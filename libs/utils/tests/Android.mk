@@ -6,8 +6,19 @@ include $(CLEAR_VARS)
 test_src_files := \
 	BasicHashtable_test.cpp \
 	BlobCache_test.cpp \
+	LinearTransform_test.cpp \
 	Looper_test.cpp \
+	LruCache_test.cpp \
+	Mutex_test.cpp \
+	Profiler_test.cpp \
+	PropertyMap_test.cpp \
+	ProtoOutput_test.cpp \
+	RefBase_test.cpp \
+	ScalableRWLock_test.cpp \
+	SharedBuffer_test.cpp \
 	String8_test.cpp \
+	SystemClock_test.cpp \
+	ThreadPool_test.cpp \
 	Unicode_test.cpp \
 	Vector_test.cpp \
 	ZipFileRO_test.cpp
@@ -43,3 +54,12 @@ $(foreach file,$(test_src_files), \
     $(eval LOCAL_MODULE_TAGS := $(module_tags)) \
     $(eval include $(BUILD_EXECUTABLE)) \
 )
+
+# Include subdirectory makefiles
+# ============================================================
+
+# If we're building with ONE_SHOT_MAKEFILE (mm, mmm), then what the framework
+# team really wants is to build the stuff defined by this makefile.
+ifeq (,$(ONE_SHOT_MAKEFILE))
+include $(call first-makefiles-under,$(LOCAL_PATH))
+endif
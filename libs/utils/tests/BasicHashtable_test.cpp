@@ -17,6 +17,7 @@
 #define LOG_TAG "BasicHashtable_test"
 
 #include <utils/BasicHashtable.h>
+#include <utils/LinearHashtable.h>
 #include <cutils/log.h>
 #include <gtest/gtest.h>
 #include <unistd.h>
@@ -83,6 +84,9 @@ ssize_t ComplexValue::instanceCount = 0;
 typedef key_value_pair_t<ComplexKey, ComplexValue> ComplexEntry;
 typedef BasicHashtable<ComplexKey, ComplexEntry> ComplexHashtable;
 
+typedef LinearHashtable<SimpleKey, SimpleEntry> SimpleLinearHashtable;
+typedef LinearHashtable<ComplexKey, ComplexEntry> ComplexLinearHashtable;
+
 class BasicHashtableTest : public testing::Test {
 protected:
     virtual void SetUp() {
@@ -116,6 +120,19 @@ public:
     static const void* getBuckets(const BasicHashtable<TKey, TEntry>& h) {
         return h.mBuckets;
     }
+
+    template <typename TKey, typename TEntry>
+    static const void* getBuckets(const LinearHashtable<TKey, TEntry>& h) {
+        return h.mBuckets;
+    }
+
+    template <typename TKey, typename TEntry>
+    static void cookieAt(const LinearHashtable<TKey, TEntry>& h, size_t index,
+            bool* present, bool* deleted) {
+        uint32_t cookie = h.cookieAt(index);
+        *present = cookie & LinearHashtable<TKey, TEntry>::Bucket::PRESENT;
+        *deleted = cookie & LinearHashtable<TKey, TEntry>::Bucket::DELETED;
+    }
 };
 
 template <typename TKey, typename TValue>
@@ -141,6 +158,29 @@ static bool remove(BasicHashtable<TKey, key_value_pair_t<TKey, TValue> >& h,
     return false;
 }
 
+template <typename TKey, typename TValue>
+static size_t add(LinearHashtable<TKey, key_value_pair_t<TKey, TValue> >& h,
+        const TKey& key, const TValue& value) {
+    return h.add(hash_type(key), key_value_pair_t<TKey, TValue>(key, value));
+}
+
+template <typename TKey, typename TValue>
+static ssize_t find(LinearHashtable<TKey, key_value_pair_t<TKey, TValue> >& h,
+        ssize_t index, const TKey& key) {
+    return h.find(index, hash_type(key), key);
+}
+
+template <typename TKey, typename TValue>
+static bool remove(LinearHashtable<TKey, key_value_pair_t<TKey, TValue> >& h,
+        const TKey& key) {
+    ssize_t index = find(h, -1, key);
+    if (index >= 0) {
+        h.removeAt(index);
+        return true;
+    }
+    return false;
+}
+
 template <typename TEntry>
 static void getKeyValue(const TEntry& entry, int* key, int* value);
 
@@ -344,6 +384,19 @@ TEST_F(BasicHashtableTest, Clear_AfterElementsAdded_DestroysThem) {
     EXPECT_EQ(0.75f, h.loadFactor());
 }
 
+TEST_F(BasicHashtableTest, Clear_WhenEntriesBeyondSize_ForgetsThem) {
+    ComplexHashtable h;
+    // with 5 buckets, these land in buckets 3 and 4, past the size
+    add(h, ComplexKey(3), ComplexValue(0));
+    add(h, ComplexKey(4), ComplexValue(0));
+    ASSERT_NO_FATAL_FAILURE(assertInstanceCount(2, 2));
+
+    h.clear();
+    ASSERT_NO_FATAL_FAILURE(assertInstanceCount(0, 0));
+    EXPECT_EQ(-1, h.next(-1));
+    EXPECT_EQ(-1, find(h, -1, ComplexKey(3)));
+}
+
 TEST_F(BasicHashtableTest, Remove_AfterElementsAdded_DestroysThem) {
     ComplexHashtable h;
     add(h, ComplexKey(0), ComplexValue(0));
@@ -574,4 +627,303 @@ TEST_F(BasicHashtableTest, CopyOnWrite) {
     EXPECT_EQ(2U, h3.size());
 }
 
+TEST_F(BasicHashtableTest, Linear_DefaultConstructor_WithDefaultProperties) {
+    SimpleLinearHashtable h;
+
+    EXPECT_EQ(0U, h.size());
+    EXPECT_EQ(2U, h.capacity());
+    EXPECT_EQ(4U, h.bucketCount());
+    EXPECT_EQ(0.5f, h.loadFactor());
+}
+
+TEST_F(BasicHashtableTest, Linear_Constructor_RoundsBucketCountToPowerOfTwo) {
+    SimpleLinearHashtable h(100, 0.5f);
+
+    EXPECT_EQ(0U, h.size());
+    EXPECT_LE(100U, h.capacity());
+    EXPECT_EQ(256U, h.bucketCount());
+    EXPECT_EQ(0.5f, h.loadFactor());
+}
+
+TEST_F(BasicHashtableTest, Linear_FindAddFindRemoveFind_MultipleEntryWithUniqueKey) {
+    const int N = 11;
+
+    ComplexLinearHashtable h;
+    for (int i = 0; i < N; i++) {
+        ASSERT_EQ(-1, find(h, -1, ComplexKey(i)));
+        add(h, ComplexKey(i), ComplexValue(i));
+        ASSERT_NO_FATAL_FAILURE(assertInstanceCount(i + 1, i + 1));
+        ASSERT_GE(find(h, -1, ComplexKey(i)), 0);
+    }
+    EXPECT_EQ(size_t(N), h.size());
+    for (int i = 0; i < N; i++) {
+        ssize_t index = find(h, -1, ComplexKey(i));
+        ASSERT_GE(index, 0);
+        ASSERT_EQ(i, h.entryAt(index).value.v);
+    }
+    for (int i = N - 1; i >= 0; i--) {
+        ASSERT_TRUE(remove(h, ComplexKey(i))) << "i = " << i;
+        ASSERT_NO_FATAL_FAILURE(assertInstanceCount(i, i));
+        ASSERT_EQ(-1, find(h, -1, ComplexKey(i)));
+    }
+    EXPECT_EQ(0U, h.size());
+}
+
+TEST_F(BasicHashtableTest, Linear_FindAddFindRemoveFind_MultipleEntryWithDuplicateKey) {
+    const int N = 11;
+    const int K = 1;
+
+    SimpleLinearHashtable h;
+    for (int i = 0; i < N; i++) {
+        add(h, K, i);
+    }
+    EXPECT_EQ(size_t(N), h.size());
+
+    bool seen[N];
+    memset(seen, 0, sizeof(seen));
+    ssize_t index = -1;
+    for (int i = 0; i < N; i++) {
+        index = find(h, index, K);
+        ASSERT_GE(index, 0);
+        ASSERT_EQ(K, h.entryAt(index).key);
+        ASSERT_FALSE(seen[h.entryAt(index).value]);
+        seen[h.entryAt(index).value] = true;
+    }
+    ASSERT_EQ(-1, find(h, index, K));
+
+    for (int i = N; i > 0; i--) {
+        ASSERT_TRUE(remove(h, K));
+        EXPECT_EQ(size_t(i - 1), h.size());
+    }
+    ASSERT_FALSE(remove(h, K));
+}
+
+TEST_F(BasicHashtableTest, Linear_Clear_AfterElementsAdded_DestroysThem) {
+    ComplexLinearHashtable h;
+    add(h, ComplexKey(0), ComplexValue(0));
+    add(h, ComplexKey(1), ComplexValue(0));
+    ASSERT_NO_FATAL_FAILURE(assertInstanceCount(2, 2));
+
+    h.clear();
+    ASSERT_NO_FATAL_FAILURE(assertInstanceCount(0, 0));
+    EXPECT_EQ(0U, h.size());
+    EXPECT_EQ(-1, h.next(-1));
+    EXPECT_EQ(-1, find(h, -1, ComplexKey(0)));
+
+    add(h, ComplexKey(2), ComplexValue(2));
+    ASSERT_NO_FATAL_FAILURE(assertInstanceCount(1, 1));
+    EXPECT_GE(find(h, -1, ComplexKey(2)), 0);
+}
+
+TEST_F(BasicHashtableTest, Linear_Destructor_AfterElementsAdded_DestroysThem) {
+    {
+        ComplexLinearHashtable h;
+        for (int i = 0; i < 20; i++) {
+            add(h, ComplexKey(i), ComplexValue(i));
+        }
+        ASSERT_NO_FATAL_FAILURE(assertInstanceCount(20, 20));
+    } // h is destroyed here
+
+    ASSERT_NO_FATAL_FAILURE(assertInstanceCount(0, 0));
+}
+
+TEST_F(BasicHashtableTest, Linear_Next_WhileRemoving_VisitsAllEntries) {
+    const int N = 88;
+
+    SimpleLinearHashtable h;
+    for (int i = 0; i < N; i++) {
+        add(h, i, i * 10);
+    }
+
+    bool set[N];
+    memset(set, 0, sizeof(bool) * N);
+    int count = 0;
+    for (ssize_t index = -1; (index = h.next(index)) != -1; ) {
+        const SimpleEntry& entry = h.entryAt(index);
+        ASSERT_GE(entry.key, 0);
+        ASSERT_LT(entry.key, N);
+        ASSERT_FALSE(set[entry.key]);
+        ASSERT_EQ(entry.key * 10, entry.value);
+        set[entry.key] = true;
+        count += 1;
+        h.removeAt(index);
+    }
+    ASSERT_EQ(N, count);
+    EXPECT_EQ(0U, h.size());
+}
+
+TEST_F(BasicHashtableTest, Linear_Add_RehashesOnDemand) {
+    SimpleLinearHashtable h;
+    size_t initialCapacity = h.capacity();
+    size_t initialBucketCount = h.bucketCount();
+
+    for (size_t i = 0; i < initialCapacity; i++) {
+        add(h, int(i), 0);
+    }
+
+    EXPECT_EQ(initialCapacity, h.size());
+    EXPECT_EQ(initialCapacity, h.capacity());
+    EXPECT_EQ(initialBucketCount, h.bucketCount());
+
+    add(h, -1, -1);
+
+    EXPECT_EQ(initialCapacity + 1, h.size());
+    EXPECT_GT(h.capacity(), initialCapacity);
+    EXPECT_GT(h.bucketCount(), initialBucketCount);
+    EXPECT_GT(h.bucketCount(), h.capacity());
+}
+
+TEST_F(BasicHashtableTest, Linear_Remove_WhenFollowedByEntry_LeavesTombstone) {
+    // 3 of the 4 buckets are filled, so some entry is followed by another
+    SimpleLinearHashtable h(3, 1.0f);
+    ASSERT_EQ(4U, h.bucketCount());
+    for (int i = 0; i < 3; i++) {
+        add(h, i, i);
+    }
+
+    bool present, deleted;
+    ssize_t index = -1;
+    for (size_t i = 0; i < h.bucketCount() && index < 0; i++) {
+        BasicHashtableTest::cookieAt(h, i, &present, &deleted);
+        if (present) {
+            BasicHashtableTest::cookieAt(h, (i + 1) % h.bucketCount(), &present, &deleted);
+            if (present) {
+                index = i;
+            }
+        }
+    }
+    ASSERT_GE(index, 0);
+
+    int key = h.entryAt(index).key;
+    h.removeAt(index);
+    BasicHashtableTest::cookieAt(h, index, &present, &deleted);
+    EXPECT_FALSE(present);
+    EXPECT_TRUE(deleted);
+
+    // the entries following the tombstone can still be found
+    for (int i = 0; i < 3; i++) {
+        if (i != key) {
+            ssize_t found = find(h, -1, i);
+            ASSERT_GE(found, 0);
+            EXPECT_EQ(i, h.entryAt(found).value);
+        }
+    }
+    EXPECT_EQ(-1, find(h, -1, key));
+}
+
+TEST_F(BasicHashtableTest, Linear_AddRemove_PurgesTombstonesWithoutGrowing) {
+    SimpleLinearHashtable h;
+    const size_t bucketCount = h.bucketCount();
+    add(h, -1, -1);
+
+    for (int i = 0; i < 1000; i++) {
+        add(h, i, i);
+        ASSERT_TRUE(remove(h, i));
+        ASSERT_EQ(1U, h.size());
+    }
+
+    EXPECT_EQ(bucketCount, h.bucketCount());
+    ssize_t index = find(h, -1, -1);
+    ASSERT_GE(index, 0);
+    EXPECT_EQ(-1, h.entryAt(index).value);
+}
+
+TEST_F(BasicHashtableTest, Linear_Rehash_WhenCapacityAndBucketCountUnchanged_DoesNothing) {
+    ComplexLinearHashtable h;
+    add(h, ComplexKey(0), ComplexValue(0));
+    const void* oldBuckets = getBuckets(h);
+    ASSERT_NE((void*)NULL, oldBuckets);
+
+    h.rehash(h.capacity(), h.loadFactor());
+
+    ASSERT_EQ(oldBuckets, getBuckets(h));
+    ASSERT_NO_FATAL_FAILURE(assertInstanceCount(1, 1));
+}
+
+TEST_F(BasicHashtableTest, Linear_Rehash_WhenEmptyAndHasBuckets_ReleasesBuckets) {
+    ComplexLinearHashtable h;
+    add(h, ComplexKey(0), ComplexValue(0));
+    ASSERT_TRUE(remove(h, ComplexKey(0)));
+    ASSERT_NE((void*)NULL, getBuckets(h));
+
+    h.rehash(10, 1.0f);
+
+    EXPECT_EQ((void*)NULL, getBuckets(h));
+    EXPECT_EQ(16U, h.bucketCount());
+    EXPECT_EQ(15U, h.capacity());
+    EXPECT_EQ(1.0f, h.loadFactor());
+}
+
+TEST_F(BasicHashtableTest, Linear_CopyOnWrite) {
+    ComplexLinearHashtable h1;
+    add(h1, ComplexKey(0), ComplexValue(0));
+    add(h1, ComplexKey(1), ComplexValue(1));
+    const void* originalBuckets = getBuckets(h1);
+    ssize_t index0 = find(h1, -1, ComplexKey(0));
+    EXPECT_GE(index0, 0);
+
+    // copy constructor acquires shared reference
+    ComplexLinearHashtable h2(h1);
+    ASSERT_NO_FATAL_FAILURE(assertInstanceCount(2, 2));
+    ASSERT_EQ(originalBuckets, getBuckets(h2));
+    EXPECT_EQ(index0, find(h2, -1, ComplexKey(0)));
+
+    // editEntryAt copies shared contents
+    h1.editEntryAt(index0).value.v = 42;
+    ASSERT_NO_FATAL_FAILURE(assertInstanceCount(4, 4));
+    ASSERT_NE(originalBuckets, getBuckets(h1));
+    EXPECT_EQ(42, h1.entryAt(index0).value.v);
+    EXPECT_EQ(0, h2.entryAt(index0).value.v);
+
+    // operator= acquires shared reference, destroys unshared contents
+    h1 = h2;
+    ASSERT_NO_FATAL_FAILURE(assertInstanceCount(2, 2));
+    ASSERT_EQ(originalBuckets, getBuckets(h1));
+
+    // remove copies shared contents
+    h1.removeAt(index0);
+    ASSERT_NO_FATAL_FAILURE(assertInstanceCount(3, 3));
+    ASSERT_NE(originalBuckets, getBuckets(h1));
+    EXPECT_EQ(1U, h1.size());
+    EXPECT_EQ(2U, h2.size());
+
+    // clear releases reference to shared contents
+    h1 = h2;
+    h1.clear();
+    ASSERT_NO_FATAL_FAILURE(assertInstanceCount(2, 2));
+    EXPECT_EQ(0U, h1.size());
+    EXPECT_EQ(2U, h2.size());
+    EXPECT_EQ(index0, find(h2, -1, ComplexKey(0)));
+}
+
+// scattered keys, like those of pointers or strings; even keys are added
+// so that odd keys miss
+template <typename THashtable>
+static void checkScatteredKeys(THashtable& h, int count) {
+    uint32_t seed = 1;
+    for (int i = 0; i < count; i++) {
+        seed = seed * 1103515245 + 12345;
+        add(h, int(seed & ~1), i);
+    }
+    ASSERT_EQ(size_t(count), h.size());
+    seed = 1;
+    for (int i = 0; i < count; i++) {
+        seed = seed * 1103515245 + 12345;
+        ssize_t index = find(h, -1, int(seed & ~1));
+        ASSERT_GE(index, 0) << "entry " << i;
+        EXPECT_EQ(i, h.entryAt(index).value);
+        EXPECT_EQ(-1, find(h, -1, int(seed | 1))) << "entry " << i;
+    }
+}
+
+TEST_F(BasicHashtableTest, Find_WithScatteredKeys_FindsAddedKeysOnly) {
+    SimpleHashtable h;
+    checkScatteredKeys(h, 2000);
+}
+
+TEST_F(BasicHashtableTest, Linear_Find_WithScatteredKeys_FindsAddedKeysOnly) {
+    SimpleLinearHashtable h;
+    checkScatteredKeys(h, 2000);
+}
+
 } // namespace android
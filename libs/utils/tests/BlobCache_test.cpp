@@ -258,6 +258,31 @@ TEST_F(BlobCacheTest, ExceedingTotalLimitHalvesCacheSize) {
     ASSERT_EQ(maxEntries/2 + 1, numCached);
 }
 
+TEST_F(BlobCacheTest, ExceedingTotalLimitEvictsLeastRecentlyUsed) {
+    // Fill up the entire cache with 1 char key/value pairs.
+    const int maxEntries = MAX_TOTAL_SIZE / 2;
+    for (int i = 0; i < maxEntries; i++) {
+        uint8_t k = i;
+        mBC->set(&k, 1, "x", 1);
+    }
+    // Use the first half of the entries again.
+    for (int i = 0; i < maxEntries/2; i++) {
+        uint8_t k = i;
+        ASSERT_EQ(size_t(1), mBC->get(&k, 1, NULL, 0));
+    }
+    // Insert one more entry, causing a cache overflow.
+    {
+        uint8_t k = maxEntries;
+        mBC->set(&k, 1, "x", 1);
+    }
+    // The entries that weren't used again should be gone.
+    for (int i = 0; i < maxEntries+1; i++) {
+        uint8_t k = i;
+        bool recent = i < maxEntries/2 || i == maxEntries;
+        ASSERT_EQ(size_t(recent ? 1 : 0), mBC->get(&k, 1, NULL, 0));
+    }
+}
+
 class BlobCacheFlattenTest : public BlobCacheTest {
 protected:
     virtual void SetUp() {
@@ -418,4 +443,57 @@ TEST_F(BlobCacheFlattenTest, UnflattenCatchesBufferTooSmall) {
     ASSERT_EQ(size_t(0), mBC2->get("abcd", 4, buf, 4));
 }
 
+
+TEST_F(BlobCacheFlattenTest, FlattenPreservesLeastRecentlyUsedOrder) {
+    // Fill up the entire cache with 1 char key/value pairs.
+    const int maxEntries = MAX_TOTAL_SIZE / 2;
+    for (int i = 0; i < maxEntries; i++) {
+        uint8_t k = i;
+        mBC->set(&k, 1, "x", 1);
+    }
+    // Make the first entry the most recently used one.
+    {
+        uint8_t k = 0;
+        ASSERT_EQ(size_t(1), mBC->get(&k, 1, NULL, 0));
+    }
+
+    roundTrip();
+
+    // Overflowing the deserialized cache should evict the oldest entries.
+    {
+        uint8_t k = maxEntries;
+        mBC2->set(&k, 1, "x", 1);
+    }
+    for (int i = 0; i < maxEntries+1; i++) {
+        uint8_t k = i;
+        bool recent = i == 0 || i > maxEntries/2;
+        ASSERT_EQ(size_t(recent ? 1 : 0), mBC2->get(&k, 1, NULL, 0));
+    }
+}
+
+TEST_F(BlobCacheFlattenTest, UnflattenInPlaceUsesBuffer) {
+    char buf[4] = { 0xee, 0xee, 0xee, 0xee };
+    mBC->set("abcd", 4, "efgh", 4);
+
+    size_t size = mBC->getFlattenedSize();
+    uint8_t* flat = new uint8_t[size];
+    ASSERT_EQ(OK, mBC->flatten(flat, size, NULL, 0));
+    ASSERT_EQ(OK, mBC2->unflattenInPlace(flat, size));
+
+    ASSERT_EQ(size_t(4), mBC2->get("abcd", 4, buf, 4));
+    ASSERT_EQ('e', buf[0]);
+    ASSERT_EQ('h', buf[3]);
+
+    // The value is read from the buffer when it is retrieved
+    flat[size-1] = 'z';
+    ASSERT_EQ(size_t(4), mBC2->get("abcd", 4, buf, 4));
+    ASSERT_EQ('z', buf[3]);
+
+    // A new value is copied into the cache
+    mBC2->set("abcd", 4, "ijkl", 4);
+    mBC2->set("mn", 2, "op", 2);
+    mBC2.clear();
+    delete[] flat;
+}
+
 } // namespace android
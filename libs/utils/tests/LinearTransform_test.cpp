@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "LinearTransform_test"
+
+#include <utils/LinearTransform.h>
+#include <gtest/gtest.h>
+
+namespace android {
+
+class LinearTransformTest : public testing::Test {
+};
+
+static LinearTransform makeTransform(int64_t a_zero, int64_t b_zero,
+        int32_t numer, uint32_t denom) {
+    LinearTransform t;
+    t.a_zero = a_zero;
+    t.b_zero = b_zero;
+    t.a_to_b_numer = numer;
+    t.a_to_b_denom = denom;
+    return t;
+}
+
+TEST_F(LinearTransformTest, SmallDeltasRoundTowardsMinusInfinity) {
+    // 48kHz frames to microseconds
+    LinearTransform t(makeTransform(1000, 5000000, 1000000, 48000));
+    int64_t out;
+    ASSERT_TRUE(t.doForwardTransform(1000 + 48000, &out));
+    EXPECT_EQ(5000000 + 1000000, out);
+    ASSERT_TRUE(t.doForwardTransform(1000 + 1, &out));
+    EXPECT_EQ(5000000 + 20, out);
+    ASSERT_TRUE(t.doForwardTransform(1000 - 1, &out));
+    EXPECT_EQ(5000000 - 21, out);
+
+    ASSERT_TRUE(t.doReverseTransform(5000000 + 21, &out));
+    EXPECT_EQ(1000 + 1, out);
+    ASSERT_TRUE(t.doReverseTransform(5000000 - 21, &out));
+    EXPECT_EQ(1000 - 2, out);
+}
+
+TEST_F(LinearTransformTest, PowerOfTwoDivisorsMatchOtherDivisors) {
+    // 3/4 is 9/12 too, which can't be done with a shift
+    LinearTransform shifted(makeTransform(0, 0, 3, 4));
+    LinearTransform divided(makeTransform(0, 0, 9, 12));
+    LinearTransform negative(makeTransform(0, 0, -3, 4));
+    for (int64_t a = -100; a <= 100; a++) {
+        int64_t s, d, n;
+        ASSERT_TRUE(shifted.doForwardTransform(a, &s));
+        ASSERT_TRUE(divided.doForwardTransform(a, &d));
+        ASSERT_TRUE(negative.doForwardTransform(-a, &n));
+        EXPECT_EQ(d, s);
+        EXPECT_EQ(s, n);
+    }
+}
+
+TEST_F(LinearTransformTest, LargeDeltasAndOverflows) {
+    LinearTransform t(makeTransform(0, 0, 3, 2));
+    int64_t out;
+    // takes the 96 bit path
+    ASSERT_TRUE(t.doForwardTransform(INT64_C(1) << 40, &out));
+    EXPECT_EQ(INT64_C(3) << 39, out);
+    ASSERT_TRUE(t.doForwardTransform(-((INT64_C(1) << 40) + 1), &out));
+    EXPECT_EQ(-(INT64_C(3) << 39) - 2, out);
+    EXPECT_FALSE(t.doForwardTransform(INT64_MAX, &out));
+
+    LinearTransform singular(makeTransform(0, 0, 0, 1));
+    EXPECT_FALSE(singular.doReverseTransform(1, &out));
+}
+
+TEST_F(LinearTransformTest, BatchMatchesSingleConversions) {
+    LinearTransform t(makeTransform(123456789, -987654321, 1000000, 44100));
+    int64_t in[64], out[64];
+    for (size_t i = 0; i < 64; i++) {
+        in[i] = 123456789 + int64_t(i) * 1000003 - 32000000;
+    }
+    ASSERT_EQ(64U, t.doForwardTransform(in, out, 64));
+    for (size_t i = 0; i < 64; i++) {
+        int64_t single;
+        ASSERT_TRUE(t.doForwardTransform(in[i], &single));
+        EXPECT_EQ(single, out[i]);
+    }
+
+    // in place, and back again within rounding
+    ASSERT_EQ(64U, t.doReverseTransform(out, out, 64));
+    for (size_t i = 0; i < 64; i++) {
+        EXPECT_LE(in[i] - 1, out[i]);
+        EXPECT_GE(in[i], out[i]);
+    }
+
+    // stops at the first overflow
+    in[10] = INT64_MAX;
+    EXPECT_EQ(10U, t.doForwardTransform(in, out, 64));
+}
+
+} // namespace android
@@ -6,6 +6,7 @@
 #include <utils/Timers.h>
 #include <utils/StopWatch.h>
 #include <gtest/gtest.h>
+#include <stdio.h>
 #include <unistd.h>
 #include <time.h>
 
@@ -437,6 +438,53 @@ TEST_F(LooperTest, PollOnce_WhenCallbackAddedTwice_OnlySecondCallbackShouldBeInv
             << "replacement handler callback should be invoked";
 }
 
+TEST_F(LooperTest, PollOnce_WhenCallbackRemovedThenAddedAgain_OnlySecondCallbackShouldBeInvoked) {
+    Pipe pipe;
+    StubCallbackHandler handler1(true);
+    StubCallbackHandler handler2(true);
+
+    handler1.setCallback(mLooper, pipe.receiveFd, ALOOPER_EVENT_INPUT);
+    pipe.writeSignal();
+    mLooper->removeFd(pipe.receiveFd);
+    handler2.setCallback(mLooper, pipe.receiveFd, ALOOPER_EVENT_INPUT);
+
+    int result = mLooper->pollOnce(0);
+
+    EXPECT_EQ(ALOOPER_POLL_CALLBACK, result)
+            << "pollOnce result should be ALOOPER_POLL_CALLBACK because FD was signalled";
+    EXPECT_EQ(0, handler1.callbackCount)
+            << "removed handler callback should not be invoked";
+    EXPECT_EQ(1, handler2.callbackCount)
+            << "handler callback added again should be invoked";
+}
+
+TEST_F(LooperTest, PollOnce_WhenManyFdsAdded_OnlySignalledCallbacksShouldBeInvoked) {
+    static const int PIPE_COUNT = 100;
+    Pipe pipes[PIPE_COUNT];
+    StubCallbackHandler* handlers[PIPE_COUNT];
+    for (int i = 0; i < PIPE_COUNT; i++) {
+        handlers[i] = new StubCallbackHandler(true);
+        handlers[i]->setCallback(mLooper, pipes[i].receiveFd, ALOOPER_EVENT_INPUT);
+    }
+    pipes[3].writeSignal();
+    pipes[PIPE_COUNT - 1].writeSignal();
+
+    int result = mLooper->pollOnce(0);
+
+    EXPECT_EQ(ALOOPER_POLL_CALLBACK, result)
+            << "pollOnce result should be ALOOPER_POLL_CALLBACK because FDs were signalled";
+    for (int i = 0; i < PIPE_COUNT; i++) {
+        EXPECT_EQ(i == 3 || i == PIPE_COUNT - 1 ? 1 : 0, handlers[i]->callbackCount)
+                << "only the signalled FDs' callbacks should be invoked, fd " << i;
+        if (handlers[i]->callbackCount) {
+            EXPECT_EQ(pipes[i].receiveFd, handlers[i]->fd)
+                    << "callback should have received its own pipe fd as parameter";
+        }
+        mLooper->removeFd(pipes[i].receiveFd);
+        delete handlers[i];
+    }
+}
+
 TEST_F(LooperTest, SendMessage_WhenOneMessageIsEnqueue_ShouldInvokeHandlerDuringNextPoll) {
     sp<StubMessageHandler> handler = new StubMessageHandler();
     mLooper->sendMessage(handler, Message(MSG_TEST1));
@@ -690,4 +738,73 @@ TEST_F(LooperTest, RemoveMessage_WhenRemovingSomeMessagesForHandler_ShouldRemove
             << "no more messages to handle";
 }
 
+TEST_F(LooperTest, SendMessageAtTime_WhenSentOutOfOrder_ShouldInvokeHandlersInTimeOrder) {
+    const int count = 1000;
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    sp<StubMessageHandler> handler = new StubMessageHandler();
+
+    // 7 is prime with count, so this visits every rank once, out of order
+    for (int i = 0; i < count; i++) {
+        int rank = (i * 7) % count;
+        mLooper->sendMessageAtTime(now - ms2ns(1000) + rank, handler, Message(rank));
+    }
+
+    int result = mLooper->pollOnce(0);
+
+    EXPECT_EQ(ALOOPER_POLL_CALLBACK, result)
+            << "pollOnce result should be ALOOPER_POLL_CALLBACK because messages were sent";
+    ASSERT_EQ(size_t(count), handler->messages.size())
+            << "handled all messages";
+    for (int i = 0; i < count; i++) {
+        EXPECT_EQ(i, handler->messages[i].what)
+                << "handled message in time order";
+    }
+}
+
+TEST_F(LooperTest, SendMessageAtTime_WhenSentWithSameTime_ShouldInvokeHandlersInSendOrder) {
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    sp<StubMessageHandler> handler = new StubMessageHandler();
+    mLooper->sendMessageAtTime(now, handler, Message(MSG_TEST1));
+    mLooper->sendMessageAtTime(now - ms2ns(10), handler, Message(MSG_TEST2));
+    mLooper->sendMessageAtTime(now, handler, Message(MSG_TEST3));
+    mLooper->sendMessageAtTime(now, handler, Message(MSG_TEST4));
+    mLooper->removeMessages(handler, MSG_TEST3);
+
+    int result = mLooper->pollOnce(0);
+
+    EXPECT_EQ(ALOOPER_POLL_CALLBACK, result)
+            << "pollOnce result should be ALOOPER_POLL_CALLBACK because messages were sent";
+    ASSERT_EQ(size_t(3), handler->messages.size())
+            << "handled messages";
+    EXPECT_EQ(MSG_TEST2, handler->messages[0].what)
+            << "handled earliest message first";
+    EXPECT_EQ(MSG_TEST1, handler->messages[1].what)
+            << "handled messages with the same time in send order";
+    EXPECT_EQ(MSG_TEST4, handler->messages[2].what)
+            << "handled messages with the same time in send order";
+}
+
+TEST_F(LooperTest, SendMessageAtTime_WhenManySentOutOfOrder_ShouldInvokeHandlersInTimeOrder) {
+    const int count = 1000;
+    sp<StubMessageHandler> handler = new StubMessageHandler();
+
+    // 7919 is prime, so this sends each offset from 0 to 999us exactly once
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < count; i++) {
+        int offset = (i * 7919) % count;
+        mLooper->sendMessageAtTime(now - ms2ns(1) + us2ns(offset),
+                handler, Message(offset));
+    }
+    while (handler->messages.size() < size_t(count)
+            && mLooper->pollOnce(0) == ALOOPER_POLL_CALLBACK) {
+    }
+
+    ASSERT_EQ(size_t(count), handler->messages.size())
+            << "handled all messages";
+    for (int i = 0; i < count; i++) {
+        ASSERT_EQ(i, handler->messages[i].what)
+                << "handled messages in time order";
+    }
+}
+
 } // namespace android
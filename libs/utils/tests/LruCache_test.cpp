@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "LruCache_test"
+
+#include <utils/GenerationCache.h>
+#include <utils/LruCache.h>
+#include <cutils/log.h>
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <unistd.h>
+
+namespace android {
+
+typedef int SimpleKey;
+typedef const char* StringValue;
+
+class EntryRemovedCallback : public OnEntryRemoved<SimpleKey, StringValue> {
+public:
+    EntryRemovedCallback() : callbackCount(0), lastKey(-1), lastValue(NULL) { }
+    ~EntryRemovedCallback() {}
+    void operator()(SimpleKey& k, StringValue& v) {
+        callbackCount += 1;
+        lastKey = k;
+        lastValue = v;
+    }
+    ssize_t callbackCount;
+    SimpleKey lastKey;
+    StringValue lastValue;
+};
+
+class LruCacheTest : public testing::Test {
+};
+
+TEST_F(LruCacheTest, Empty) {
+    LruCache<SimpleKey, StringValue> cache(100);
+
+    EXPECT_EQ(NULL, cache.get(0));
+    EXPECT_EQ(0u, cache.size());
+}
+
+TEST_F(LruCacheTest, Simple) {
+    LruCache<SimpleKey, StringValue> cache(100);
+
+    EXPECT_TRUE(cache.put(1, "one"));
+    EXPECT_TRUE(cache.put(2, "two"));
+    EXPECT_TRUE(cache.put(3, "three"));
+    EXPECT_FALSE(cache.put(1, "uno"));
+    EXPECT_STREQ("one", cache.get(1));
+    EXPECT_STREQ("two", cache.get(2));
+    EXPECT_STREQ("three", cache.get(3));
+    EXPECT_TRUE(cache.contains(2));
+    EXPECT_FALSE(cache.contains(4));
+    EXPECT_EQ(3u, cache.size());
+}
+
+TEST_F(LruCacheTest, MaxCapacity) {
+    LruCache<SimpleKey, StringValue> cache(2);
+
+    cache.put(1, "one");
+    cache.put(2, "two");
+    cache.put(3, "three");
+    EXPECT_EQ(NULL, cache.get(1));
+    EXPECT_STREQ("two", cache.get(2));
+    EXPECT_STREQ("three", cache.get(3));
+    EXPECT_EQ(2u, cache.size());
+}
+
+TEST_F(LruCacheTest, RemoveLru) {
+    LruCache<SimpleKey, StringValue> cache(100);
+
+    cache.put(1, "one");
+    cache.put(2, "two");
+    cache.put(3, "three");
+    EXPECT_TRUE(cache.removeOldest());
+    EXPECT_EQ(NULL, cache.get(1));
+    EXPECT_STREQ("two", cache.get(2));
+    EXPECT_STREQ("three", cache.get(3));
+    EXPECT_EQ(2u, cache.size());
+}
+
+TEST_F(LruCacheTest, GetUpdatesLru) {
+    LruCache<SimpleKey, StringValue> cache(100);
+
+    cache.put(1, "one");
+    cache.put(2, "two");
+    cache.put(3, "three");
+    EXPECT_STREQ("one", cache.get(1));
+    EXPECT_TRUE(cache.removeOldest());
+    EXPECT_STREQ("one", cache.get(1));
+    EXPECT_EQ(NULL, cache.get(2));
+    EXPECT_STREQ("three", cache.get(3));
+    EXPECT_EQ(2u, cache.size());
+}
+
+TEST_F(LruCacheTest, Remove) {
+    LruCache<SimpleKey, StringValue> cache(100);
+
+    cache.put(1, "one");
+    cache.put(2, "two");
+    EXPECT_TRUE(cache.remove(1));
+    EXPECT_FALSE(cache.remove(1));
+    EXPECT_EQ(NULL, cache.get(1));
+    EXPECT_STREQ("two", cache.get(2));
+    EXPECT_TRUE(cache.removeOldest());
+    EXPECT_FALSE(cache.removeOldest());
+    EXPECT_EQ(0u, cache.size());
+}
+
+TEST_F(LruCacheTest, Callback) {
+    LruCache<SimpleKey, StringValue> cache(100);
+    EntryRemovedCallback callback;
+    cache.setOnEntryRemovedListener(&callback);
+
+    cache.put(1, "one");
+    cache.put(2, "two");
+    cache.put(3, "three");
+    EXPECT_EQ(3u, cache.size());
+    cache.removeOldest();
+    EXPECT_EQ(1, callback.callbackCount);
+    EXPECT_EQ(1, callback.lastKey);
+    EXPECT_STREQ("one", callback.lastValue);
+    cache.remove(3);
+    EXPECT_EQ(2, callback.callbackCount);
+    EXPECT_EQ(3, callback.lastKey);
+    cache.clear();
+    EXPECT_EQ(3, callback.callbackCount);
+    EXPECT_EQ(2, callback.lastKey);
+    EXPECT_EQ(0u, cache.size());
+}
+
+TEST_F(LruCacheTest, CallbackOnEviction) {
+    LruCache<SimpleKey, StringValue> cache(2);
+    EntryRemovedCallback callback;
+    cache.setOnEntryRemovedListener(&callback);
+
+    cache.put(1, "one");
+    cache.put(2, "two");
+    cache.get(1);
+    cache.put(3, "three");
+    EXPECT_EQ(1, callback.callbackCount);
+    EXPECT_EQ(2, callback.lastKey);
+    EXPECT_STREQ("two", callback.lastValue);
+}
+
+TEST_F(LruCacheTest, Iterator) {
+    LruCache<SimpleKey, StringValue> cache(100);
+
+    cache.put(1, "one");
+    cache.put(2, "two");
+    cache.put(3, "three");
+    cache.remove(2);
+
+    int keys = 0;
+    LruCache<SimpleKey, StringValue>::Iterator it(cache);
+    while (it.next()) {
+        keys |= 1 << it.key();
+        if (it.key() == 3) {
+            EXPECT_STREQ("three", it.value());
+        }
+    }
+    EXPECT_EQ((1 << 1) | (1 << 3), keys);
+}
+
+TEST_F(LruCacheTest, ManyEntries_KeepsLruOrder) {
+    const int count = 2000;
+    LruCache<SimpleKey, StringValue> cache(count / 2);
+
+    for (int i = 0; i < count; i++) {
+        cache.put(i, "value");
+    }
+    EXPECT_EQ(size_t(count / 2), cache.size());
+    for (int i = 0; i < count / 2; i++) {
+        EXPECT_FALSE(cache.contains(i));
+    }
+    for (int i = count / 2; i < count; i++) {
+        EXPECT_TRUE(cache.contains(i));
+    }
+}
+
+// Both caches evict the least recently used entry, so the same mix of
+// put/get/evict must leave them holding the same keys.
+template <typename Cache>
+static void exerciseCache(Cache& cache, int count) {
+    for (int i = 0; i < count * 4; i++) {
+        // keys are spread so that insertion isn't always at the end
+        const int key = (i * 7919) % (count * 2);
+        if (cache.get(key) == NULL) {
+            cache.put(key, "value");
+        }
+    }
+}
+
+TEST_F(LruCacheTest, EvictsLikeGenerationCache) {
+    const int count = 500;
+    GenerationCache<SimpleKey, StringValue> generationCache(count);
+    LruCache<SimpleKey, StringValue> lruCache(count);
+    exerciseCache(generationCache, count);
+    exerciseCache(lruCache, count);
+
+    ASSERT_EQ(generationCache.size(), lruCache.size());
+    for (int key = 0; key < count * 2; key++) {
+        EXPECT_EQ(generationCache.contains(key), lruCache.contains(key))
+                << "key " << key;
+    }
+}
+
+} // namespace android
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "Mutex_test"
+
+#include <utils/Condition.h>
+#include <utils/Mutex.h>
+#include <utils/String8.h>
+#include <utils/Thread.h>
+#include <gtest/gtest.h>
+
+namespace android {
+
+static const int kTypes[] = {
+    Mutex::PRIVATE,
+    Mutex::ADAPTIVE,
+    Mutex::PRIO_INHERIT | Mutex::ADAPTIVE,
+    Mutex::ADAPTIVE | Mutex::TRACK_CONTENTION,
+};
+
+class CountingThread : public Thread {
+public:
+    CountingThread(Mutex& lock, int* counter, int iterations) :
+            Thread(false), mLock(lock), mCounter(counter),
+            mIterations(iterations) { }
+
+    virtual bool threadLoop() {
+        for (int i=0 ; i<mIterations ; i++) {
+            Mutex::Autolock _l(mLock);
+            (*mCounter)++;
+        }
+        return false;
+    }
+
+private:
+    Mutex& mLock;
+    int* mCounter;
+    int mIterations;
+};
+
+class MutexTest : public testing::TestWithParam<int> {
+};
+
+TEST_P(MutexTest, TryLockFailsWhileLocked) {
+    Mutex lock(GetParam(), "MutexTest");
+    ASSERT_EQ(NO_ERROR, lock.tryLock());
+    EXPECT_NE(NO_ERROR, lock.tryLock());
+    lock.unlock();
+    ASSERT_EQ(NO_ERROR, lock.lock());
+    EXPECT_NE(NO_ERROR, lock.tryLock());
+    lock.unlock();
+}
+
+TEST_P(MutexTest, ExcludesOtherThreads) {
+    static const int kThreads = 4;
+    static const int kIterations = 10000;
+    Mutex lock(GetParam(), "MutexTest");
+    int counter = 0;
+    sp<CountingThread> threads[kThreads];
+    for (int i=0 ; i<kThreads ; i++) {
+        threads[i] = new CountingThread(lock, &counter, kIterations);
+        ASSERT_EQ(NO_ERROR, threads[i]->run("CountingThread"));
+    }
+    for (int i=0 ; i<kThreads ; i++) {
+        threads[i]->join();
+    }
+    EXPECT_EQ(kThreads * kIterations, counter);
+}
+
+TEST_P(MutexTest, ConditionWaitKeepsTheLock) {
+    Mutex lock(GetParam(), "MutexTest");
+    Condition cond;
+    Mutex::Autolock _l(lock);
+    EXPECT_EQ(-ETIMEDOUT, cond.waitRelative(lock, 1000000));
+    // still held after the wait
+    EXPECT_NE(NO_ERROR, lock.tryLock());
+}
+
+INSTANTIATE_TEST_CASE_P(Types, MutexTest, testing::ValuesIn(kTypes));
+
+TEST(MutexContentionTest, UntrackedMutexesAreNotDumped) {
+    // debug.mutex.track_contention isn't set by the test
+    Mutex lock(Mutex::TRACK_CONTENTION, "MutexContentionTest");
+    String8 result;
+    Mutex::dumpContention(result);
+    EXPECT_TRUE(strstr(result.string(), "MutexContentionTest") == NULL);
+}
+
+} // namespace android
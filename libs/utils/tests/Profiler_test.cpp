@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "Profiler_test"
+
+#include <utils/Profiler.h>
+#include <utils/Thread.h>
+#include <gtest/gtest.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace android {
+
+static void inner() {
+    PROFILE_SCOPE("profiler_test", "inner");
+    usleep(100);
+}
+
+static void outer() {
+    PROFILE_SCOPE("profiler_test", "outer");
+    inner();
+    inner();
+}
+
+static void untimed() {
+    PROFILE_SCOPE("profiler_test_off", "untimed");
+}
+
+class ProfiledThread : public Thread {
+public:
+    ProfiledThread() : Thread(false) { }
+    virtual bool threadLoop() {
+        outer();
+        return false;
+    }
+};
+
+class ProfilerTest : public testing::Test {
+protected:
+    virtual void SetUp() {
+        Profiler::setEnabledTags("profiler_test");
+        Profiler::clear();
+    }
+    virtual void TearDown() {
+        Profiler::setEnabledTags("");
+    }
+};
+
+TEST_F(ProfilerTest, NestedScopesAreShownUnderTheirOuterScope) {
+    outer();
+    untimed();
+    String8 result;
+    Profiler::dump(result);
+    const char* outerLine = strstr(result.string(), "\n  outer ");
+    const char* innerLine = strstr(result.string(), "\n    inner ");
+    ASSERT_TRUE(outerLine != NULL) << result.string();
+    ASSERT_TRUE(innerLine != NULL) << result.string();
+    EXPECT_LT(outerLine, innerLine);
+    EXPECT_TRUE(strstr(result.string(), "untimed") == NULL);
+}
+
+TEST_F(ProfilerTest, ExitedThreadsAreStillCounted) {
+    sp<ProfiledThread> thread = new ProfiledThread();
+    ASSERT_EQ(NO_ERROR, thread->run("ProfiledThread"));
+    thread->join();
+    outer();
+    String8 result;
+    Profiler::dump(result);
+    unsigned count = 0;
+    const char* innerLine = strstr(result.string(), "\n    inner ");
+    ASSERT_TRUE(innerLine != NULL) << result.string();
+    ASSERT_EQ(1, sscanf(innerLine, " inner %u", &count));
+    EXPECT_EQ(4U, count);
+}
+
+TEST_F(ProfilerTest, DisabledTagsAreNotTimed) {
+    Profiler::setEnabledTags("");
+    outer();
+    String8 result;
+    Profiler::dump(result);
+    EXPECT_TRUE(strstr(result.string(), "outer") == NULL);
+}
+
+} // namespace android
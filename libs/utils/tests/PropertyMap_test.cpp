@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "PropertyMap_test"
+#include <utils/PropertyMap.h>
+
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace android {
+
+class PropertyMapTest : public testing::Test {
+protected:
+    virtual void SetUp() {
+        const char* tmpDir = getenv("TMPDIR");
+        snprintf(mPath, sizeof(mPath), "%s/PropertyMap_test.XXXXXX",
+                tmpDir ? tmpDir : "/data/local/tmp");
+        int fd = mkstemp(mPath);
+        ASSERT_LE(0, fd);
+        close(fd);
+        PropertyMap::clearCache();
+    }
+
+    virtual void TearDown() {
+        unlink(mPath);
+        PropertyMap::clearCache();
+    }
+
+    void writeFile(const char* contents) {
+        int fd = open(mPath, O_WRONLY | O_TRUNC);
+        ASSERT_LE(0, fd);
+        ASSERT_EQ(ssize_t(strlen(contents)), write(fd, contents, strlen(contents)));
+        close(fd);
+    }
+
+    String8 getValue(const char* key) {
+        PropertyMap* map;
+        String8 value;
+        if (PropertyMap::load(String8(mPath), &map) == NO_ERROR) {
+            map->tryGetProperty(String8(key), value);
+            delete map;
+        }
+        return value;
+    }
+
+    char mPath[256];
+};
+
+TEST_F(PropertyMapTest, LoadParsesKeysAndValues) {
+    writeFile("# comment\n"
+            "touch.deviceType = touchScreen\n"
+            "\n"
+            "  device.internal=1\n");
+    PropertyMap* map;
+    ASSERT_EQ(NO_ERROR, PropertyMap::load(String8(mPath), &map));
+    EXPECT_EQ(2U, map->getProperties().size());
+    String8 type;
+    int32_t internal = 0;
+    EXPECT_TRUE(map->tryGetProperty(String8("touch.deviceType"), type));
+    EXPECT_STREQ("touchScreen", type.string());
+    EXPECT_TRUE(map->tryGetProperty(String8("device.internal"), internal));
+    EXPECT_EQ(1, internal);
+    delete map;
+}
+
+TEST_F(PropertyMapTest, CachedMapsAreIndependentCopies) {
+    writeFile("a = 1\n");
+    PropertyMap* first;
+    PropertyMap* second;
+    ASSERT_EQ(NO_ERROR, PropertyMap::load(String8(mPath), &first));
+    first->addProperty(String8("b"), String8("2"));
+    ASSERT_EQ(NO_ERROR, PropertyMap::load(String8(mPath), &second));
+    EXPECT_TRUE(second->hasProperty(String8("a")));
+    EXPECT_FALSE(second->hasProperty(String8("b")));
+    delete first;
+    delete second;
+}
+
+TEST_F(PropertyMapTest, ChangedFilesAreParsedAgain) {
+    writeFile("a = 1\n");
+    EXPECT_STREQ("1", getValue("a").string());
+    writeFile("a = 22\n");
+    EXPECT_STREQ("22", getValue("a").string());
+}
+
+TEST_F(PropertyMapTest, CachedMapsHoldEveryProperty) {
+    String8 contents;
+    for (int i = 0; i < 50; i++) {
+        char line[64];
+        snprintf(line, sizeof(line), "touch.property%d = value%d\n", i, i);
+        contents.append(line);
+    }
+    writeFile(contents.string());
+
+    // parsed, then from the cache
+    for (int pass = 0; pass < 2; pass++) {
+        PropertyMap* map;
+        ASSERT_EQ(NO_ERROR, PropertyMap::load(String8(mPath), &map));
+        EXPECT_EQ(50U, map->getProperties().size());
+        for (int i = 0; i < 50; i++) {
+            char key[32], expected[32];
+            snprintf(key, sizeof(key), "touch.property%d", i);
+            snprintf(expected, sizeof(expected), "value%d", i);
+            String8 value;
+            EXPECT_TRUE(map->tryGetProperty(String8(key), value)) << key;
+            EXPECT_STREQ(expected, value.string());
+        }
+        delete map;
+    }
+}
+
+} // namespace android
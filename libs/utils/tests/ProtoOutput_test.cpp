@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ProtoOutput_test"
+
+#include <utils/ProtoOutput.h>
+#include <gtest/gtest.h>
+
+namespace android {
+
+class ProtoOutputTest : public testing::Test {
+protected:
+    void expectBytes(const ProtoOutput& out, const uint8_t* expected, size_t size) {
+        ASSERT_EQ(size, out.size());
+        for (size_t i = 0; i < size; i++) {
+            EXPECT_EQ(expected[i], out.data()[i]) << "at byte " << i;
+        }
+    }
+};
+
+TEST_F(ProtoOutputTest, Varints) {
+    ProtoOutput out;
+    out.writeUInt32(1, 150);
+    out.writeBool(2, true);
+    out.writeInt32(3, -1);
+    out.writeUInt64(16, 1ULL << 35);
+
+    const uint8_t expected[] = {
+        0x08, 0x96, 0x01,
+        0x10, 0x01,
+        0x18, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01,
+        0x80, 0x01, 0x80, 0x80, 0x80, 0x80, 0x80, 0x01,
+    };
+    expectBytes(out, expected, sizeof(expected));
+}
+
+TEST_F(ProtoOutputTest, FixedAndStrings) {
+    ProtoOutput out;
+    out.writeFloat(1, 1.0f);
+    out.writeDouble(2, -2.0);
+    out.writeString(3, "abc");
+    out.writeString(4, String8(""));
+
+    const uint8_t expected[] = {
+        0x0d, 0x00, 0x00, 0x80, 0x3f,
+        0x11, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xc0,
+        0x1a, 0x03, 'a', 'b', 'c',
+        0x22, 0x00,
+    };
+    expectBytes(out, expected, sizeof(expected));
+}
+
+TEST_F(ProtoOutputTest, NestedMessages) {
+    ProtoOutput out;
+    size_t outer = out.beginMessage(1);
+    size_t inner = out.beginMessage(2);
+    out.writeUInt32(3, 1);
+    out.endMessage(inner);
+    size_t empty = out.beginMessage(4);
+    out.endMessage(empty);
+    out.endMessage(outer);
+    out.writeUInt32(5, 7);
+
+    const uint8_t expected[] = {
+        0x0a, 0x06,
+            0x12, 0x02, 0x18, 0x01,
+            0x22, 0x00,
+        0x28, 0x07,
+    };
+    expectBytes(out, expected, sizeof(expected));
+}
+
+TEST_F(ProtoOutputTest, LongNestedMessage) {
+    ProtoOutput out;
+    size_t token = out.beginMessage(1);
+    for (int i = 0; i < 100; i++) {
+        out.writeUInt32(2, 1);
+    }
+    out.endMessage(token);
+
+    // 200 bytes of content needs a two byte length
+    ASSERT_EQ(203U, out.size());
+    EXPECT_EQ(0x0a, out.data()[0]);
+    EXPECT_EQ(0xc8, out.data()[1]);
+    EXPECT_EQ(0x01, out.data()[2]);
+    EXPECT_EQ(0x10, out.data()[3]);
+    EXPECT_EQ(0x01, out.data()[202]);
+}
+
+} // namespace android
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "RefBase_test"
+
+#include <utils/CallStack.h>
+#include <utils/RefBase.h>
+#include <utils/String8.h>
+#include <utils/Thread.h>
+#include <cutils/log.h>
+#include <gtest/gtest.h>
+
+namespace android {
+
+class RefBaseTest : public testing::Test {
+};
+
+class LightCounted : public LightRefBase<LightCounted> {
+public:
+    explicit LightCounted(bool* destroyed) : mDestroyed(destroyed) { }
+
+private:
+    friend class LightRefBase<LightCounted>;
+    ~LightCounted() {
+        *mDestroyed = true;
+    }
+
+    bool* mDestroyed;
+};
+
+class VirtualLightCounted : public VirtualLightRefBase {
+public:
+    explicit VirtualLightCounted(bool* destroyed) : mDestroyed(destroyed) { }
+
+    virtual ~VirtualLightCounted() {
+        *mDestroyed = true;
+    }
+
+private:
+    bool* mDestroyed;
+};
+
+TEST_F(RefBaseTest, LightRefBase_DeletedWithLastReference) {
+    bool destroyed = false;
+    sp<LightCounted> first(new LightCounted(&destroyed));
+    EXPECT_EQ(1, first->getStrongCount());
+    {
+        sp<LightCounted> second(first);
+        EXPECT_EQ(2, first->getStrongCount());
+    }
+    EXPECT_EQ(1, first->getStrongCount());
+    EXPECT_FALSE(destroyed);
+
+    first.clear();
+    EXPECT_TRUE(destroyed);
+}
+
+TEST_F(RefBaseTest, VirtualLightRefBase_DeletesDerivedObject) {
+    bool destroyed = false;
+    sp<VirtualLightRefBase> base(new VirtualLightCounted(&destroyed));
+    sp<VirtualLightRefBase> copy(base);
+    base.clear();
+    EXPECT_FALSE(destroyed);
+
+    copy.clear();
+    EXPECT_TRUE(destroyed);
+}
+
+class RefThread : public Thread {
+public:
+    RefThread(const sp<LightCounted>& object, int count) :
+            Thread(false), mObject(object), mCount(count) { }
+
+private:
+    virtual bool threadLoop() {
+        for (int i = 0; i < mCount; i++) {
+            sp<LightCounted> copy(mObject);
+        }
+        mObject.clear();
+        return false;
+    }
+
+    sp<LightCounted> mObject;
+    const int mCount;
+};
+
+TEST_F(RefBaseTest, LightRefBase_SharedBetweenThreads_DeletedOnce) {
+    const int threadCount = 4;
+    bool destroyed = false;
+    sp<LightCounted> object(new LightCounted(&destroyed));
+    sp<RefThread> threads[threadCount];
+    for (int i = 0; i < threadCount; i++) {
+        threads[i] = new RefThread(object, 100000);
+    }
+    for (int i = 0; i < threadCount; i++) {
+        ASSERT_EQ(NO_ERROR, threads[i]->run("RefThread"));
+    }
+    for (int i = 0; i < threadCount; i++) {
+        threads[i]->join();
+    }
+    EXPECT_EQ(1, object->getStrongCount());
+    EXPECT_FALSE(destroyed);
+
+    object.clear();
+    EXPECT_TRUE(destroyed);
+}
+
+class Sampled : public RefBase {
+public:
+    virtual const char* getSampledTypeName() const { return "Sampled"; }
+};
+
+static size_t countOccurrences(const String8& text, const char* pattern) {
+    size_t count = 0;
+    for (const char* p = strstr(text.string(), pattern) ; p ;
+            p = strstr(p + 1, pattern)) {
+        count++;
+    }
+    return count;
+}
+
+TEST_F(RefBaseTest, SampledReferences_OneInPeriodObjectsTracked) {
+    const char* type = "Sampled";
+    RefBase::sampleReferences(type, 2);
+    sp<Sampled> objects[4];
+    for (int i = 0; i < 4; i++) {
+        objects[i] = new Sampled();
+    }
+    sp<Sampled> copy(objects[0]);
+
+    String8 dump;
+    RefBase::dumpSampledReferences(&dump);
+    EXPECT_EQ(2U, countOccurrences(dump, type));
+    EXPECT_EQ(1U, countOccurrences(dump, "2 strong references"));
+    EXPECT_EQ(1U, countOccurrences(dump, "1 strong references"));
+
+    // objects created once sampling stopped aren't tracked
+    RefBase::sampleReferences(type, 0);
+    sp<Sampled> unsampled(new Sampled());
+    copy.clear();
+    for (int i = 0; i < 4; i++) {
+        objects[i].clear();
+    }
+    dump.clear();
+    RefBase::dumpSampledReferences(&dump);
+    EXPECT_EQ(0U, countOccurrences(dump, type));
+}
+
+TEST_F(RefBaseTest, CallStack_InternedOnce) {
+    CallStack stacks[2];
+    for (int i = 0; i < 2; i++) {
+        stacks[i].update();
+    }
+
+    EXPECT_EQ(stacks[0].hash(), stacks[1].hash());
+    EXPECT_EQ(stacks[0].intern(), stacks[1].intern());
+    EXPECT_EQ(stacks[0].size(), stacks[0].intern()->size());
+}
+
+} // namespace android
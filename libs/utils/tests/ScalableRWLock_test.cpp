@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ScalableRWLock_test"
+
+#include <utils/ScalableRWLock.h>
+#include <utils/Thread.h>
+#include <gtest/gtest.h>
+
+namespace android {
+
+class ReadWriteThread : public Thread {
+public:
+    // writes once every writeEvery iterations, reads otherwise
+    ReadWriteThread(ScalableRWLock& lock, int* values, int iterations,
+            int writeEvery) :
+            Thread(false), mLock(lock), mValues(values),
+            mIterations(iterations), mWriteEvery(writeEvery),
+            mTornReads(0) { }
+
+    virtual bool threadLoop() {
+        for (int i=0 ; i<mIterations ; i++) {
+            if (mWriteEvery && (i % mWriteEvery) == 0) {
+                ScalableRWLock::AutoWLock _l(mLock);
+                mValues[0]++;
+                mValues[1]++;
+            } else {
+                ScalableRWLock::AutoRLock _l(mLock);
+                if (mValues[0] != mValues[1]) {
+                    mTornReads++;
+                }
+            }
+        }
+        return false;
+    }
+
+    int getTornReads() const { return mTornReads; }
+
+private:
+    ScalableRWLock& mLock;
+    volatile int* mValues;
+    int mIterations;
+    int mWriteEvery;
+    int mTornReads;
+};
+
+TEST(ScalableRWLockTest, ReadersShareTheLock) {
+    ScalableRWLock lock;
+    ASSERT_EQ(NO_ERROR, lock.readLock());
+    EXPECT_EQ(NO_ERROR, lock.tryReadLock());
+    EXPECT_NE(NO_ERROR, lock.tryWriteLock());
+    lock.unlock();
+    lock.unlock();
+    EXPECT_EQ(NO_ERROR, lock.tryWriteLock());
+    lock.unlock();
+}
+
+TEST(ScalableRWLockTest, WriterExcludesEveryone) {
+    ScalableRWLock lock;
+    ASSERT_EQ(NO_ERROR, lock.writeLock());
+    EXPECT_NE(NO_ERROR, lock.tryReadLock());
+    EXPECT_NE(NO_ERROR, lock.tryWriteLock());
+    lock.unlock();
+    EXPECT_EQ(NO_ERROR, lock.tryReadLock());
+    lock.unlock();
+}
+
+TEST(ScalableRWLockTest, WritersSeeNoReaders) {
+    static const int kThreads = 4;
+    static const int kIterations = 20000;
+    ScalableRWLock lock;
+    int values[2] = { 0, 0 };
+    sp<ReadWriteThread> threads[kThreads];
+    for (int i=0 ; i<kThreads ; i++) {
+        threads[i] = new ReadWriteThread(lock, values, kIterations, 100);
+        ASSERT_EQ(NO_ERROR, threads[i]->run("ReadWriteThread"));
+    }
+    for (int i=0 ; i<kThreads ; i++) {
+        threads[i]->join();
+        EXPECT_EQ(0, threads[i]->getTornReads());
+    }
+    EXPECT_EQ(kThreads * kIterations / 100, values[0]);
+    EXPECT_EQ(values[0], values[1]);
+}
+
+} // namespace android
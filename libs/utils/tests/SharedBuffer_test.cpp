@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "SharedBuffer_test"
+
+#include <utils/SharedBuffer.h>
+#include <utils/Thread.h>
+#include <gtest/gtest.h>
+#include <string.h>
+
+namespace android {
+
+class ChurnThread : public Thread {
+public:
+    ChurnThread(int iterations) : Thread(false), mIterations(iterations) { }
+
+    virtual bool threadLoop() {
+        for (int i=0 ; i<mIterations ; i++) {
+            SharedBuffer* sb = SharedBuffer::alloc(1 + (i % 300));
+            if (sb == NULL) {
+                return false;
+            }
+            memset(sb->data(), i, sb->size());
+            sb->release();
+        }
+        return false;
+    }
+
+private:
+    int mIterations;
+};
+
+TEST(SharedBufferTest, SmallBuffersAreReused) {
+    SharedBuffer::CacheStats before;
+    SharedBuffer::getCacheStats(&before);
+    if (before.maxCachedBytes == 0) {
+        // the cache is turned off
+        return;
+    }
+    SharedBuffer* sb = SharedBuffer::alloc(24);
+    ASSERT_TRUE(sb != NULL);
+    sb->release();
+    sb = SharedBuffer::alloc(20);
+    ASSERT_TRUE(sb != NULL);
+    EXPECT_EQ(20U, sb->size());
+    sb->release();
+
+    SharedBuffer::CacheStats after;
+    SharedBuffer::getCacheStats(&after);
+    EXPECT_LT(before.hits, after.hits);
+    EXPECT_GE(after.maxCachedBytes, after.cachedBytes);
+}
+
+TEST(SharedBufferTest, EditResizeKeepsTheData) {
+    SharedBuffer* sb = SharedBuffer::alloc(10);
+    ASSERT_TRUE(sb != NULL);
+    memcpy(sb->data(), "0123456789", 10);
+    // within the size class, then beyond it, then beyond any class
+    static const size_t sizes[] = { 16, 40, 1000, 5 };
+    for (size_t i=0 ; i<sizeof(sizes)/sizeof(sizes[0]) ; i++) {
+        sb = sb->editResize(sizes[i]);
+        ASSERT_TRUE(sb != NULL);
+        EXPECT_EQ(sizes[i], sb->size());
+        EXPECT_EQ(0, memcmp(sb->data(), "01234", 5));
+    }
+    sb->release();
+}
+
+TEST(SharedBufferTest, KeepStorageThenDealloc) {
+    SharedBuffer* sb = SharedBuffer::alloc(8);
+    ASSERT_TRUE(sb != NULL);
+    EXPECT_EQ(1, sb->release(SharedBuffer::eKeepStorage));
+    EXPECT_EQ(0, SharedBuffer::dealloc(sb));
+}
+
+TEST(SharedBufferTest, ThreadsChurnIndependently) {
+    static const int kThreads = 4;
+    sp<ChurnThread> threads[kThreads];
+    for (int i=0 ; i<kThreads ; i++) {
+        threads[i] = new ChurnThread(20000);
+        ASSERT_EQ(NO_ERROR, threads[i]->run("ChurnThread"));
+    }
+    for (int i=0 ; i<kThreads ; i++) {
+        threads[i]->join();
+    }
+    SharedBuffer::CacheStats stats;
+    SharedBuffer::getCacheStats(&stats);
+    EXPECT_GE(stats.maxCachedBytes, stats.cachedBytes);
+}
+
+} // namespace android
@@ -17,6 +17,7 @@
 #define LOG_TAG "String8_test"
 #include <utils/Log.h>
 #include <utils/String8.h>
+#include <utils/String16.h>
 
 #include <gtest/gtest.h>
 
@@ -72,4 +73,55 @@ TEST_F(String8Test, OperatorPlusEquals) {
     EXPECT_STREQ(src3, " Verify me.");
 }
 
+TEST_F(String8Test, AppendFormat) {
+    String8 str("x=");
+    EXPECT_EQ(NO_ERROR, str.appendFormat("%d, %s", 42, "short"));
+    EXPECT_STREQ("x=42, short", str.string());
+    EXPECT_EQ(strlen(str.string()), str.length());
+
+    // longer than what's formatted on the stack
+    String8 longArg;
+    for (int i = 0; i < 100; i++) {
+        longArg.append("abcde");
+    }
+    String8 expected(str);
+    expected.append(longArg);
+    EXPECT_EQ(NO_ERROR, str.appendFormat("%s", longArg.string()));
+    EXPECT_STREQ(expected.string(), str.string());
+    EXPECT_EQ(expected.length(), str.length());
+
+    EXPECT_EQ(NO_ERROR, str.appendFormat("%s", ""));
+    EXPECT_EQ(expected.length(), str.length());
+}
+
+TEST_F(String8Test, InternSharesBuffer) {
+    String8 a(String8::intern("SurfaceFlinger"));
+    String8 b(String8::intern(String8("SurfaceFlinger")));
+    String8 c(String8::intern("SurfaceView"));
+    EXPECT_STREQ("SurfaceFlinger", a.string());
+    EXPECT_EQ(a.string(), b.string());
+    EXPECT_NE(a.string(), c.string());
+    EXPECT_TRUE(a == b);
+    EXPECT_TRUE(a != c);
+
+    // the first interned copy is the one shared
+    String8 d("InternedOnce");
+    String8 e(String8::intern(d));
+    EXPECT_EQ(d.string(), e.string());
+    EXPECT_EQ(d.string(), String8::intern("InternedOnce").string());
+
+    EXPECT_TRUE(String8::intern("").isEmpty());
+}
+
+TEST_F(String8Test, String16InternSharesBuffer) {
+    String16 a(String16::intern(String16("android.ui.ISurfaceComposer")));
+    String16 b(String16("android.ui.ISurfaceComposer"));
+    String16 c(String16::intern(b.string(), b.size()));
+    EXPECT_EQ(a.string(), c.string());
+    EXPECT_NE(b.string(), c.string());
+    EXPECT_TRUE(a == b);
+    EXPECT_EQ(0, a.compare(c));
+    EXPECT_EQ(0U, String16::intern(String16()).size());
+}
+
 }
@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "SystemClock_test"
+
+#include <utils/SystemClock.h>
+#include <utils/Timers.h>
+#include <gtest/gtest.h>
+
+namespace android {
+
+TEST(SystemClockTest, ElapsedRealtimeDoesNotGoBackwards) {
+    int64_t prev = elapsedRealtimeNano();
+    for (int i = 0; i < 10000; i++) {
+        const int64_t now = elapsedRealtimeNano();
+        ASSERT_LE(prev, now);
+        prev = now;
+    }
+}
+
+TEST(SystemClockTest, ElapsedRealtimeIncludesUptime) {
+    const int64_t uptime = uptimeMillis();
+    EXPECT_LE(uptime, elapsedRealtime());
+    EXPECT_LE(uptime, nanoseconds_to_milliseconds(elapsedRealtimeNano()));
+}
+
+} // namespace android
@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ThreadPool_test"
+
+#include <utils/ThreadPool.h>
+#include <cutils/atomic.h>
+#include <cutils/log.h>
+#include <gtest/gtest.h>
+
+namespace android {
+
+class ThreadPoolTest : public testing::Test {
+};
+
+class CountingTask : public ThreadPool::Task {
+public:
+    explicit CountingTask(volatile int32_t* counter) :
+            mCounter(counter), mRan(false), mCompletedAfterRun(false) { }
+
+    virtual void run() {
+        android_atomic_inc(mCounter);
+        mRan = true;
+    }
+
+    virtual void onCompleted() {
+        mCompletedAfterRun = mRan;
+    }
+
+    volatile int32_t* const mCounter;
+    bool mRan;
+    bool mCompletedAfterRun;
+};
+
+// Blocks its thread until opened.
+class GateTask : public ThreadPool::Task {
+public:
+    GateTask() : mStarted(false), mOpen(false) { }
+
+    virtual void run() {
+        AutoMutex _l(mLock);
+        mStarted = true;
+        mCondition.broadcast();
+        while (!mOpen) {
+            mCondition.wait(mLock);
+        }
+    }
+
+    void waitForStart() {
+        AutoMutex _l(mLock);
+        while (!mStarted) {
+            mCondition.wait(mLock);
+        }
+    }
+
+    void open() {
+        AutoMutex _l(mLock);
+        mOpen = true;
+        mCondition.broadcast();
+    }
+
+private:
+    Mutex mLock;
+    Condition mCondition;
+    bool mStarted;
+    bool mOpen;
+};
+
+// Records the order in which tasks run.
+class OrderTask : public ThreadPool::Task {
+public:
+    OrderTask(Vector<int>* order, Mutex* lock, int id) :
+            mOrder(order), mLock(lock), mId(id) { }
+
+    virtual void run() {
+        AutoMutex _l(*mLock);
+        mOrder->push(mId);
+    }
+
+private:
+    Vector<int>* const mOrder;
+    Mutex* const mLock;
+    const int mId;
+};
+
+// Schedules more tasks from a pool thread.
+class FanOutTask : public ThreadPool::Task {
+public:
+    FanOutTask(ThreadPool* pool, volatile int32_t* counter, int depth) :
+            mPool(pool), mCounter(counter), mDepth(depth) { }
+
+    virtual void run() {
+        android_atomic_inc(mCounter);
+        if (mDepth > 0) {
+            for (int i = 0; i < 4; i++) {
+                mPool->schedule(new FanOutTask(mPool, mCounter, mDepth - 1));
+            }
+        }
+    }
+
+private:
+    ThreadPool* const mPool;
+    volatile int32_t* const mCounter;
+    const int mDepth;
+};
+
+TEST_F(ThreadPoolTest, Schedule_RunsAllTasks) {
+    const int count = 1000;
+    volatile int32_t counter = 0;
+    Vector<sp<CountingTask> > tasks;
+    {
+        ThreadPool pool(4);
+        EXPECT_EQ(4U, pool.getThreadCount());
+        for (int i = 0; i < count; i++) {
+            sp<CountingTask> task(new CountingTask(&counter));
+            tasks.push(task);
+            ASSERT_EQ(OK, pool.schedule(task));
+        }
+        pool.wait();
+        EXPECT_EQ(count, counter);
+    }
+    for (int i = 0; i < count; i++) {
+        EXPECT_TRUE(tasks[i]->isCompleted());
+        EXPECT_TRUE(tasks[i]->mCompletedAfterRun);
+    }
+}
+
+TEST_F(ThreadPoolTest, Schedule_WhenAlreadyScheduled_ReturnsInvalidOperation) {
+    volatile int32_t counter = 0;
+    ThreadPool pool(2);
+    sp<CountingTask> task(new CountingTask(&counter));
+    ASSERT_EQ(OK, pool.schedule(task));
+    task->wait();
+
+    EXPECT_EQ(INVALID_OPERATION, pool.schedule(task));
+    pool.wait();
+    EXPECT_EQ(1, counter);
+}
+
+TEST_F(ThreadPoolTest, Task_WithDependencies_RunsAfterThem) {
+    Vector<int> order;
+    Mutex lock;
+    ThreadPool pool(4);
+
+    // a diamond: 0 before 1 and 2, which are before 3
+    sp<GateTask> gate(new GateTask());
+    sp<ThreadPool::Task> first(new OrderTask(&order, &lock, 0));
+    sp<ThreadPool::Task> left(new OrderTask(&order, &lock, 1));
+    sp<ThreadPool::Task> right(new OrderTask(&order, &lock, 2));
+    sp<ThreadPool::Task> last(new OrderTask(&order, &lock, 3));
+    first->addDependency(gate);
+    left->addDependency(first);
+    right->addDependency(first);
+    last->addDependency(left);
+    last->addDependency(right);
+
+    ASSERT_EQ(OK, pool.schedule(last));
+    ASSERT_EQ(OK, pool.schedule(right));
+    ASSERT_EQ(OK, pool.schedule(left));
+    ASSERT_EQ(OK, pool.schedule(first));
+    ASSERT_EQ(OK, pool.schedule(gate));
+    gate->waitForStart();
+    EXPECT_FALSE(first->isCompleted());
+    EXPECT_FALSE(last->isCompleted());
+
+    gate->open();
+    last->wait();
+    ASSERT_EQ(4U, order.size());
+    EXPECT_EQ(0, order[0]);
+    EXPECT_EQ(3, order[3]);
+}
+
+TEST_F(ThreadPoolTest, Task_WithCompletedDependency_RunsRightAway) {
+    volatile int32_t counter = 0;
+    ThreadPool pool(1);
+    sp<CountingTask> dependency(new CountingTask(&counter));
+    ASSERT_EQ(OK, pool.schedule(dependency));
+    dependency->wait();
+
+    sp<CountingTask> task(new CountingTask(&counter));
+    task->addDependency(dependency);
+    ASSERT_EQ(OK, pool.schedule(task));
+    task->wait();
+    EXPECT_EQ(2, counter);
+}
+
+TEST_F(ThreadPoolTest, Schedule_RunsHigherPriorityTasksFirst) {
+    Vector<int> order;
+    Mutex lock;
+    ThreadPool pool(1);
+
+    sp<GateTask> gate(new GateTask());
+    ASSERT_EQ(OK, pool.schedule(gate));
+    gate->waitForStart();
+
+    ASSERT_EQ(OK, pool.schedule(new OrderTask(&order, &lock, 2), ThreadPool::PRIORITY_LOW));
+    ASSERT_EQ(OK, pool.schedule(new OrderTask(&order, &lock, 1), ThreadPool::PRIORITY_NORMAL));
+    ASSERT_EQ(OK, pool.schedule(new OrderTask(&order, &lock, 0), ThreadPool::PRIORITY_HIGH));
+    gate->open();
+    pool.wait();
+
+    ASSERT_EQ(3U, order.size());
+    EXPECT_EQ(0, order[0]);
+    EXPECT_EQ(1, order[1]);
+    EXPECT_EQ(2, order[2]);
+}
+
+TEST_F(ThreadPoolTest, Schedule_FromPoolThreads_RunsAllTasks) {
+    volatile int32_t counter = 0;
+    ThreadPool pool(4);
+    ASSERT_EQ(OK, pool.schedule(new FanOutTask(&pool, &counter, 5)));
+    pool.wait();
+
+    // 1 + 4 + 16 + 64 + 256 + 1024 tasks
+    EXPECT_EQ(1365, counter);
+}
+
+} // namespace android
@@ -18,6 +18,10 @@
 #include <utils/Log.h>
 #include <utils/Unicode.h>
 
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
+
 #include <gtest/gtest.h>
 
 namespace android {
@@ -112,4 +116,216 @@ TEST_F(UnicodeTest, UTF8toUTF16Normal) {
             << "should be NULL terminated";
 }
 
+// Builds "len" bytes of ASCII with a two byte character (U+00E9) at "pos",
+// or none if pos is past the end.
+static void makeMixedUTF8(uint8_t* str, size_t len, size_t pos) {
+    for (size_t i = 0; i < len; i++) {
+        str[i] = 'a' + (i % 26);
+    }
+    if (pos + 1 < len) {
+        str[pos] = 0xC3;
+        str[pos + 1] = 0xA9;
+    }
+}
+
+TEST_F(UnicodeTest, UTF8toUTF16LongASCII) {
+    // lengths around the 16 byte blocks of the fast path
+    for (size_t len = 1; len < 70; len++) {
+        uint8_t str[71];
+        char16_t output[71];
+        makeMixedUTF8(str, len, len);
+        str[len] = 0;
+
+        EXPECT_EQ((ssize_t)len, utf8_to_utf16_length(str, len));
+        utf8_to_utf16(str, len, output);
+        for (size_t i = 0; i < len; i++) {
+            ASSERT_EQ(str[i], output[i]) << "at " << i << " of " << len;
+        }
+        EXPECT_EQ(0, output[len]);
+        EXPECT_EQ((ssize_t)strlen((const char*)str),
+                utf8_length((const char*)str)) << "length " << len;
+    }
+}
+
+TEST_F(UnicodeTest, UTF8toUTF16MixedBlocks) {
+    const size_t len = 64;
+    for (size_t pos = 0; pos + 1 < len; pos++) {
+        uint8_t str[len + 1];
+        char16_t output[len + 1];
+        makeMixedUTF8(str, len, pos);
+        str[len] = 0;
+
+        ASSERT_EQ((ssize_t)len - 1, utf8_to_utf16_length(str, len));
+        ASSERT_EQ((ssize_t)len, utf8_length((const char*)str));
+        utf8_to_utf16(str, len, output);
+        EXPECT_EQ(0x00E9, output[pos]) << "at " << pos;
+        for (size_t i = 0; i < pos; i++) {
+            ASSERT_EQ(str[i], output[i]) << "at " << i;
+        }
+        for (size_t i = pos + 1; i < len - 1; i++) {
+            ASSERT_EQ(str[i + 1], output[i]) << "at " << i;
+        }
+        EXPECT_EQ(0, output[len - 1]);
+    }
+}
+
+TEST_F(UnicodeTest, UTF16toUTF8MixedBlocks) {
+    const size_t len = 64;
+    for (size_t pos = 0; pos < len; pos++) {
+        char16_t str[len];
+        char output[len + 2];
+        for (size_t i = 0; i < len; i++) {
+            str[i] = 'a' + (i % 26);
+        }
+        str[pos] = 0x00E9;
+
+        ASSERT_EQ((ssize_t)len + 1, utf16_to_utf8_length(str, len));
+        utf16_to_utf8(str, len, output);
+        EXPECT_EQ((char)0xC3, output[pos]) << "at " << pos;
+        EXPECT_EQ((char)0xA9, output[pos + 1]) << "at " << pos;
+        for (size_t i = 0; i < pos; i++) {
+            ASSERT_EQ(str[i], output[i]) << "at " << i;
+        }
+        for (size_t i = pos + 1; i < len; i++) {
+            ASSERT_EQ(str[i], output[i + 1]) << "at " << i;
+        }
+        EXPECT_EQ(0, output[len + 1]);
+    }
+}
+
+TEST_F(UnicodeTest, UTF8toUTF16AndLength) {
+    const uint8_t str[] = {
+        'a', 'b', 'c',
+        0xC4, 0x80, // U+0100, 1 UTF-16 character
+        0xE2, 0x8C, 0xA3, // U+2323, 1 UTF-16 character
+        0xF0, 0x90, 0x80, 0x80, // U+10000, 2 UTF-16 character
+        'd',
+    };
+    char16_t output[sizeof(str) + 1];
+
+    ASSERT_EQ(utf8_to_utf16_length(str, sizeof(str)),
+            utf8_to_utf16_and_length(str, sizeof(str), output));
+    EXPECT_EQ('c', output[2]);
+    EXPECT_EQ(0x0100, output[3]);
+    EXPECT_EQ(0x2323, output[4]);
+    EXPECT_EQ(0xD800, output[5]);
+    EXPECT_EQ(0xDC00, output[6]);
+    EXPECT_EQ('d', output[7]);
+    EXPECT_EQ(0, output[8]);
+
+    EXPECT_EQ(-1, utf8_to_utf16_and_length(str, sizeof(str) - 2, output))
+            << "Truncated UTF-8 should return -1 to indicate invalid";
+}
+
+TEST_F(UnicodeTest, UTF16toUTF8AndLength) {
+    const char16_t str[] = {
+        'a', 0x0100, 0x2323, 0xD800, 0xDC00, // U+10000
+        0xDC00, // unpaired low surrogate
+        'b', 0xD800, // unpaired high surrogate at the end
+    };
+    const size_t len = sizeof(str) / sizeof(str[0]);
+    char expected[len * 3 + 1];
+    char output[len * 3 + 1];
+
+    const ssize_t measured = utf16_to_utf8_length(str, len);
+    ASSERT_EQ(measured, (ssize_t)utf16_to_utf8_and_length(str, len, output));
+    utf16_to_utf8(str, len - 1, expected);
+    EXPECT_STREQ(expected, output);
+    EXPECT_EQ(1 + 2 + 3 + 4 + 1, measured);
+}
+
+// One code unit at a time, as the comparisons used to be.
+static int referenceStrzcmp16(const char16_t* s1, size_t n1,
+        const char16_t* s2, size_t n2) {
+    for (size_t i = 0; i < n1 && i < n2; i++) {
+        if (s1[i] != s2[i]) {
+            return (int)s1[i] - (int)s2[i];
+        }
+    }
+    return n1 < n2 ? -(int)s2[n1] : (n1 > n2 ? (int)s1[n2] : 0);
+}
+
+TEST_F(UnicodeTest, CompareFindsEveryDifference) {
+    const size_t maxLen = 40;
+    char16_t a[maxLen + 1];
+    char16_t b[maxLen + 1];
+    char16_t bN[maxLen + 1];
+    for (size_t len = 0; len <= maxLen; len++) {
+        for (size_t i = 0; i < len; i++) {
+            a[i] = b[i] = 0x0100 + i * 37;
+        }
+        a[len] = b[len] = 0;
+        EXPECT_EQ(0, strzcmp16(a, len, b, len)) << "length " << len;
+        EXPECT_EQ(0, strcmp16(a, b)) << "length " << len;
+        EXPECT_EQ(0, strncmp16(a, b, maxLen)) << "length " << len;
+
+        for (size_t pos = 0; pos < len; pos++) {
+            // differences in either byte, in either direction
+            const char16_t deltas[] = { 1, 0x0100, (char16_t)-1 };
+            for (size_t d = 0; d < sizeof(deltas) / sizeof(deltas[0]); d++) {
+                b[pos] = a[pos] + deltas[d];
+                for (size_t i = 0; i <= len; i++) {
+                    bN[i] = htons(b[i]);
+                }
+                const int expected = referenceStrzcmp16(a, len, b, len);
+                EXPECT_EQ(expected, strzcmp16(a, len, b, len))
+                        << "length " << len << ", difference at " << pos;
+                EXPECT_EQ(expected, strzcmp16_h_n(a, len, bN, len))
+                        << "length " << len << ", difference at " << pos;
+                EXPECT_EQ(expected, strcmp16(a, b))
+                        << "length " << len << ", difference at " << pos;
+                EXPECT_EQ(expected, strncmp16(a, b, len))
+                        << "length " << len << ", difference at " << pos;
+                EXPECT_EQ(0, strncmp16(a, b, pos))
+                        << "length " << len << ", difference at " << pos;
+            }
+            b[pos] = a[pos];
+        }
+
+        // a prefix compares lower
+        for (size_t i = 0; i <= len; i++) {
+            bN[i] = htons(b[i]);
+        }
+        for (size_t prefix = 0; prefix < len; prefix++) {
+            EXPECT_EQ(referenceStrzcmp16(a, prefix, b, len),
+                    strzcmp16(a, prefix, b, len)) << "prefix " << prefix;
+            EXPECT_EQ(referenceStrzcmp16(a, len, b, prefix),
+                    strzcmp16_h_n(a, len, bN, prefix)) << "prefix " << prefix;
+        }
+    }
+}
+
+TEST_F(UnicodeTest, OnePassMatchesTwoPassOnLongMixedText) {
+    const size_t len = 4096;
+    uint8_t* mixed = new uint8_t[len];
+    char16_t* u16TwoPass = new char16_t[len + 1];
+    char16_t* u16OnePass = new char16_t[len + 1];
+    char* u8TwoPass = new char[len * 3 + 1];
+    char* u8OnePass = new char[len * 3 + 1];
+    makeMixedUTF8(mixed, len, len);
+    for (size_t i = 0; i + 1 < len; i += 64) {
+        mixed[i] = 0xC3;
+        mixed[i + 1] = 0xA9;
+    }
+
+    const ssize_t u16len = utf8_to_utf16_length(mixed, len);
+    ASSERT_EQ((ssize_t)(len - len / 64), u16len);
+    utf8_to_utf16(mixed, len, u16TwoPass);
+    ASSERT_EQ(u16len, utf8_to_utf16_and_length(mixed, len, u16OnePass));
+    EXPECT_EQ(0, memcmp(u16TwoPass, u16OnePass, (u16len + 1) * sizeof(char16_t)));
+
+    const ssize_t u8len = utf16_to_utf8_length(u16TwoPass, u16len);
+    ASSERT_EQ((ssize_t)len, u8len);
+    utf16_to_utf8(u16TwoPass, u16len, u8TwoPass);
+    ASSERT_EQ((size_t)u8len, utf16_to_utf8_and_length(u16OnePass, u16len, u8OnePass));
+    EXPECT_EQ(0, memcmp(mixed, u8TwoPass, len));
+    EXPECT_EQ(0, memcmp(mixed, u8OnePass, len));
+
+    delete[] mixed;
+    delete[] u16TwoPass;
+    delete[] u16OnePass;
+    delete[] u8TwoPass;
+    delete[] u8OnePass;
+}
+
 }
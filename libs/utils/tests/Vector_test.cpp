@@ -16,6 +16,10 @@
 
 #define LOG_TAG "Vector_test"
 
+#include <utils/RefBase.h>
+#include <utils/SortedVector.h>
+#include <utils/SplitKeyedVector.h>
+#include <utils/String8.h>
 #include <utils/Vector.h>
 #include <cutils/log.h>
 #include <gtest/gtest.h>
@@ -71,5 +75,171 @@ TEST_F(VectorTest, CopyOnWrite_CopyAndAddElements) {
     EXPECT_EQ(other[3], 5);
 }
 
+class Counted : public RefBase {
+public:
+    Counted(int id) : id(id) { }
+    int id;
+};
+
+TEST_F(VectorTest, StrongPointersSurviveRelocation) {
+    Vector<sp<Counted> > vector;
+    sp<Counted> objects[100];
+    for (int i = 0; i < 100; i++) {
+        objects[i] = new Counted(i);
+        // insertions at the front move everything, growing as they go
+        vector.insertAt(objects[i], 0);
+    }
+    ASSERT_EQ(100U, vector.size());
+    for (int i = 0; i < 100; i++) {
+        EXPECT_EQ(99 - i, vector[i]->id);
+        EXPECT_EQ(2, objects[i]->getStrongCount());
+    }
+
+    // removals from the front shrink the storage
+    vector.removeItemsAt(0, 90);
+    ASSERT_EQ(10U, vector.size());
+    for (int i = 0; i < 100; i++) {
+        EXPECT_EQ(i < 10 ? 2 : 1, objects[i]->getStrongCount());
+    }
+    for (int i = 0; i < 10; i++) {
+        EXPECT_EQ(9 - i, vector[i]->id);
+    }
+
+    vector.clear();
+    for (int i = 0; i < 100; i++) {
+        EXPECT_EQ(1, objects[i]->getStrongCount());
+    }
+}
+
+TEST_F(VectorTest, CopyOnWrite_SharedStrongPointersAreCopied) {
+    Vector<sp<Counted> > vector;
+    sp<Counted> a(new Counted(1));
+    sp<Counted> b(new Counted(2));
+    vector.add(a);
+    vector.add(b);
+
+    Vector<sp<Counted> > other(vector);
+    // the storage is shared, growing it mustn't steal other's references
+    for (int i = 0; i < 20; i++) {
+        vector.insertAt(a, 1);
+    }
+    ASSERT_EQ(2U, other.size());
+    EXPECT_EQ(1, other[0]->id);
+    EXPECT_EQ(2, other[1]->id);
+    EXPECT_EQ(22U, vector.size());
+    EXPECT_EQ(2, vector[21]->id);
+    EXPECT_EQ(1 + 1 + 21, a->getStrongCount());
+    EXPECT_EQ(1 + 1 + 1, b->getStrongCount());
+
+    other.clear();
+    EXPECT_EQ(1 + 21, a->getStrongCount());
+    EXPECT_EQ(1 + 1, b->getStrongCount());
+}
+
+TEST_F(VectorTest, StringsSurviveRelocation) {
+    SortedVector<String8> sorted;
+    for (int i = 0; i < 200; i++) {
+        sorted.add(String8::format("%03d", 199 - i));
+    }
+    ASSERT_EQ(200U, sorted.size());
+    for (int i = 0; i < 200; i++) {
+        EXPECT_EQ(String8::format("%03d", i), sorted[i]);
+    }
+    for (int i = 0; i < 200; i += 2) {
+        sorted.remove(String8::format("%03d", i));
+    }
+    ASSERT_EQ(100U, sorted.size());
+    EXPECT_EQ(String8("001"), sorted[0]);
+    EXPECT_EQ(String8("199"), sorted[99]);
+}
+
+TEST_F(VectorTest, SortedLookupsMatchLinearSearch) {
+    // every size up to a few powers of two, with odd keys present
+    for (int n = 0; n < 70; n++) {
+        SortedVector<int> sorted;
+        for (int i = 0; i < n; i++) {
+            sorted.add(2 * i + 1);
+        }
+        ASSERT_EQ(size_t(n), sorted.size());
+        for (int key = -1; key <= 2 * n + 1; key++) {
+            size_t order = 0;
+            while (order < sorted.size() && sorted[order] < key) {
+                order++;
+            }
+            EXPECT_EQ(order, sorted.orderOf(key)) << "n=" << n << " key=" << key;
+            const ssize_t expected = (key & 1 && key > 0 && key < 2 * n) ?
+                    ssize_t(order) : ssize_t(NAME_NOT_FOUND);
+            EXPECT_EQ(expected, sorted.indexOf(key));
+            EXPECT_EQ(expected, strictly_ordered_index_of(sorted.array(),
+                    sorted.size(), key));
+        }
+    }
+}
+
+// like SurfaceFlinger's LayerVector, orders its items with do_compare()
+class ReversedVector : public SortedVector<int> {
+protected:
+    virtual int do_compare(const void* lhs, const void* rhs) const {
+        return *reinterpret_cast<const int*>(rhs) - *reinterpret_cast<const int*>(lhs);
+    }
+};
+
+TEST_F(VectorTest, SortedVectorUsesTheOverriddenCompare) {
+    ReversedVector sorted;
+    for (int i = 0; i < 20; i++) {
+        sorted.add((i * 7) % 20);
+    }
+    ASSERT_EQ(20U, sorted.size());
+    for (size_t i = 0; i < sorted.size(); i++) {
+        EXPECT_EQ(int(19 - i), sorted[i]);
+        EXPECT_EQ(ssize_t(i), sorted.indexOf(int(19 - i)));
+    }
+    EXPECT_EQ(15, sorted.remove(4));
+    EXPECT_EQ(NAME_NOT_FOUND, sorted.indexOf(4));
+    EXPECT_EQ(15U, sorted.orderOf(4));
+}
+
+TEST_F(VectorTest, SplitKeyedVectorKeepsKeysAndValuesTogether) {
+    SplitKeyedVector<int, String8> keyed;
+    for (int i = 0; i < 100; i++) {
+        int key = (i * 37) % 100;
+        EXPECT_LE(0, keyed.add(key, String8::format("%d", key)));
+    }
+    ASSERT_EQ(100U, keyed.size());
+    for (size_t i = 0; i < keyed.size(); i++) {
+        EXPECT_EQ(int(i), keyed.keyAt(i));
+        EXPECT_EQ(String8::format("%d", int(i)), keyed.valueAt(i));
+    }
+
+    // adding an existing key replaces its value
+    EXPECT_EQ(42, keyed.add(42, String8("answer")));
+    EXPECT_EQ(100U, keyed.size());
+    EXPECT_EQ(String8("answer"), keyed.valueFor(42));
+
+    EXPECT_EQ(10, keyed.removeItem(10));
+    EXPECT_EQ(NAME_NOT_FOUND, keyed.indexOfKey(10));
+    EXPECT_EQ(NAME_NOT_FOUND, keyed.removeItem(10));
+    keyed.removeItemsAt(0, 5);
+    ASSERT_EQ(94U, keyed.size());
+    EXPECT_EQ(5, keyed.keyAt(0));
+    EXPECT_EQ(String8("5"), keyed.valueAt(0));
+    EXPECT_EQ(String8("11"), keyed.valueFor(11));
+}
+
+TEST_F(VectorTest, StrongPointersSurviveInsertsAndRemovesInTheMiddle) {
+    const int count = 300;
+    Vector<sp<Counted> > vector;
+    sp<Counted> object(new Counted(0));
+    for (int i = 0; i < count; i++) {
+        vector.insertAt(object, vector.size() / 2);
+    }
+    ASSERT_EQ(size_t(count), vector.size());
+    EXPECT_EQ(count + 1, object->getStrongCount());
+    while (!vector.isEmpty()) {
+        vector.removeAt(vector.size() / 2);
+        ASSERT_EQ(int(vector.size()) + 1, object->getStrongCount());
+    }
+    EXPECT_EQ(1, object->getStrongCount());
+}
 
 } // namespace android
@@ -16,24 +16,288 @@
 
 #define LOG_TAG "ZipFileRO_test"
 #include <utils/Log.h>
+#include <utils/ThreadPool.h>
+#include <utils/Vector.h>
 #include <utils/ZipFileRO.h>
 
 #include <gtest/gtest.h>
+#include <zlib.h>
 
 #include <fcntl.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
 
 namespace android {
 
 class ZipFileROTest : public testing::Test {
 protected:
+    static const size_t kBatchEntries = 8;
+
+    ZipFileROTest() : mFd(-1), mNumEntries(0) { }
+
     virtual void SetUp() {
+        const char* tmpDir = getenv("TMPDIR");
+        snprintf(mPath, sizeof(mPath), "%s/ZipFileRO_test.XXXXXX",
+                tmpDir ? tmpDir : "/data/local/tmp");
+        mFd = mkstemp(mPath);
+        ASSERT_LE(0, mFd);
     }
 
     virtual void TearDown() {
+        close(mFd);
+        unlink(mPath);
+    }
+
+    // Fills a buffer with data that compresses, but not to nothing.
+    static void fillData(Vector<uint8_t>& data, size_t size, uint32_t seed) {
+        data.clear();
+        for (size_t i = 0; i < size; i++) {
+            seed = seed * 1103515245 + 12345;
+            data.add((seed >> 16) & 0x0f);
+        }
     }
+
+    static void put2(Vector<uint8_t>& out, uint32_t v) {
+        out.add(v & 0xff);
+        out.add((v >> 8) & 0xff);
+    }
+
+    static void put4(Vector<uint8_t>& out, uint32_t v) {
+        put2(out, v & 0xffff);
+        put2(out, v >> 16);
+    }
+
+    static void putBytes(Vector<uint8_t>& out, const void* data, size_t len) {
+        out.appendArray(static_cast<const uint8_t*>(data), len);
+    }
+
+    // Appends an entry to the archive, deflated or stored.
+    void addEntry(const char* name, const Vector<uint8_t>& data, bool compressed) {
+        Vector<uint8_t> comp;
+        if (compressed) {
+            uLongf compLen = compressBound(data.size());
+            comp.insertAt(0, 0, compLen);
+            z_stream zs;
+            memset(&zs, 0, sizeof(zs));
+            ASSERT_EQ(Z_OK, deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED,
+                    -MAX_WBITS, 8, Z_DEFAULT_STRATEGY));
+            zs.next_in = const_cast<Bytef*>(data.array());
+            zs.avail_in = data.size();
+            zs.next_out = comp.editArray();
+            zs.avail_out = compLen;
+            ASSERT_EQ(Z_STREAM_END, deflate(&zs, Z_FINISH));
+            comp.removeItemsAt(zs.total_out, compLen - zs.total_out);
+            deflateEnd(&zs);
+        } else {
+            comp = data;
+        }
+
+        const uint32_t crc = crc32(0, data.array(), data.size());
+        const size_t nameLen = strlen(name);
+        const uint32_t localOffset = mArchive.size();
+        const int method = compressed ? ZipFileRO::kCompressDeflated :
+                ZipFileRO::kCompressStored;
+
+        put4(mArchive, 0x04034b50);
+        put2(mArchive, 20);             // version needed
+        put2(mArchive, 0);              // flags
+        put2(mArchive, method);
+        put4(mArchive, 0);              // mod time
+        put4(mArchive, crc);
+        put4(mArchive, comp.size());
+        put4(mArchive, data.size());
+        put2(mArchive, nameLen);
+        put2(mArchive, 0);              // extra length
+        putBytes(mArchive, name, nameLen);
+        putBytes(mArchive, comp.array(), comp.size());
+
+        put4(mDirectory, 0x02014b50);
+        put2(mDirectory, 20);           // version made by
+        put2(mDirectory, 20);           // version needed
+        put2(mDirectory, 0);            // flags
+        put2(mDirectory, method);
+        put4(mDirectory, 0);            // mod time
+        put4(mDirectory, crc);
+        put4(mDirectory, comp.size());
+        put4(mDirectory, data.size());
+        put2(mDirectory, nameLen);
+        put2(mDirectory, 0);            // extra length
+        put2(mDirectory, 0);            // comment length
+        put2(mDirectory, 0);            // disk number
+        put2(mDirectory, 0);            // internal attributes
+        put4(mDirectory, 0);            // external attributes
+        put4(mDirectory, localOffset);
+        putBytes(mDirectory, name, nameLen);
+        mNumEntries++;
+    }
+
+    // Writes out the archive and opens it.
+    void finishArchive() {
+        const uint32_t dirOffset = mArchive.size();
+        putBytes(mArchive, mDirectory.array(), mDirectory.size());
+        put4(mArchive, 0x06054b50);
+        put2(mArchive, 0);              // disk number
+        put2(mArchive, 0);              // disk with the directory
+        put2(mArchive, mNumEntries);
+        put2(mArchive, mNumEntries);
+        put4(mArchive, mDirectory.size());
+        put4(mArchive, dirOffset);
+        put2(mArchive, 0);              // comment length
+
+        ASSERT_EQ(ssize_t(mArchive.size()),
+                write(mFd, mArchive.array(), mArchive.size()));
+        ASSERT_EQ(NO_ERROR, mZip.open(mPath));
+    }
+
+    char mPath[PATH_MAX];
+    int mFd;
+    Vector<uint8_t> mArchive;
+    Vector<uint8_t> mDirectory;
+    size_t mNumEntries;
+    ZipFileRO mZip;
 };
 
+TEST_F(ZipFileROTest, ReaderStreamsDeflatedEntry) {
+    Vector<uint8_t> data;
+    fillData(data, 100000, 1);
+    addEntry("deflated", data, true);
+    finishArchive();
+
+    ZipEntryReader reader;
+    ASSERT_TRUE(reader.open(mZip, mZip.findEntryByName("deflated")));
+    EXPECT_EQ(data.size(), reader.getUncompressedLength());
+
+    // An odd window size so the reads don't line up with anything.
+    uint8_t window[777];
+    size_t offset = 0;
+    ssize_t n;
+    while ((n = reader.read(window, sizeof(window))) > 0) {
+        ASSERT_GE(data.size(), offset + n);
+        ASSERT_EQ(0, memcmp(data.array() + offset, window, n))
+                << "Mismatch in the window at offset " << offset;
+        offset += n;
+        EXPECT_EQ(offset, reader.getOffset());
+    }
+    EXPECT_EQ(0, n);
+    EXPECT_EQ(data.size(), offset);
+    EXPECT_EQ(0, reader.read(window, sizeof(window)));
+}
+
+TEST_F(ZipFileROTest, ReaderStreamsStoredEntry) {
+    Vector<uint8_t> data;
+    fillData(data, 5000, 2);
+    addEntry("stored", data, false);
+    finishArchive();
+
+    ZipEntryReader reader;
+    ASSERT_TRUE(reader.open(mZip, mZip.findEntryByName("stored")));
+
+    uint8_t window[4096];
+    ASSERT_EQ(4096, reader.read(window, sizeof(window)));
+    EXPECT_EQ(0, memcmp(data.array(), window, 4096));
+    ASSERT_EQ(5000 - 4096, reader.read(window, sizeof(window)));
+    EXPECT_EQ(0, memcmp(data.array() + 4096, window, 5000 - 4096));
+    EXPECT_EQ(0, reader.read(window, sizeof(window)));
+}
+
+TEST_F(ZipFileROTest, ReaderFailsWhenNotOpen) {
+    ZipEntryReader reader;
+    uint8_t window[16];
+    EXPECT_EQ(-1, reader.read(window, sizeof(window)));
+    EXPECT_FALSE(reader.open(mZip, NULL));
+    EXPECT_EQ(-1, reader.read(window, sizeof(window)));
+}
+
+TEST_F(ZipFileROTest, UncompressEntriesInParallel) {
+    Vector<uint8_t> data[kBatchEntries];
+    for (size_t i = 0; i < kBatchEntries; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "entry%d", int(i));
+        fillData(data[i], 20000 + i * 1000, i);
+        addEntry(name, data[i], i % 2 == 0);
+    }
+    finishArchive();
+
+    ZipEntryRO entries[kBatchEntries];
+    void* buffers[kBatchEntries];
+    for (size_t i = 0; i < kBatchEntries; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "entry%d", int(i));
+        entries[i] = mZip.findEntryByName(name);
+        ASSERT_TRUE(entries[i] != NULL);
+        buffers[i] = malloc(data[i].size());
+    }
+
+    EXPECT_TRUE(mZip.uncompressEntries(entries, buffers, kBatchEntries));
+    for (size_t i = 0; i < kBatchEntries; i++) {
+        EXPECT_EQ(0, memcmp(data[i].array(), buffers[i], data[i].size()))
+                << "Entry " << i << " was not uncompressed correctly.";
+        memset(buffers[i], 0, data[i].size());
+    }
+
+    // Again on a pool provided by the caller.
+    ThreadPool pool(3);
+    EXPECT_TRUE(mZip.uncompressEntries(entries, buffers, kBatchEntries, &pool));
+    for (size_t i = 0; i < kBatchEntries; i++) {
+        EXPECT_EQ(0, memcmp(data[i].array(), buffers[i], data[i].size()))
+                << "Entry " << i << " was not uncompressed correctly.";
+        free(buffers[i]);
+    }
+}
+
+TEST_F(ZipFileROTest, IndexIsMappedWhenItMatches) {
+    Vector<uint8_t> data[kBatchEntries];
+    for (size_t i = 0; i < kBatchEntries; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "entry%d", int(i));
+        fillData(data[i], 1000 + i * 100, i);
+        addEntry(name, data[i], i % 2 == 0);
+    }
+    finishArchive();
+    EXPECT_FALSE(mZip.isIndexMapped());
+
+    char indexPath[PATH_MAX];
+    snprintf(indexPath, sizeof(indexPath), "%s.idx", mPath);
+    ASSERT_EQ(NO_ERROR, mZip.writeIndex(indexPath));
+
+    ZipFileRO indexed;
+    ASSERT_EQ(NO_ERROR, indexed.open(mPath, indexPath));
+    EXPECT_TRUE(indexed.isIndexMapped());
+    EXPECT_EQ(mZip.getNumEntries(), indexed.getNumEntries());
+    EXPECT_TRUE(indexed.findEntryByName("missing") == NULL);
+    for (size_t i = 0; i < kBatchEntries; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "entry%d", int(i));
+        ZipEntryRO entry = indexed.findEntryByName(name);
+        ASSERT_TRUE(entry != NULL) << "Entry " << name << " not found.";
+
+        char buffer[16];
+        EXPECT_EQ(0, indexed.getEntryFileName(entry, buffer, sizeof(buffer)));
+        EXPECT_STREQ(name, buffer);
+
+        size_t uncompLen;
+        ASSERT_TRUE(indexed.getEntryInfo(entry, NULL, &uncompLen, NULL, NULL,
+                NULL, NULL));
+        ASSERT_EQ(data[i].size(), uncompLen);
+        Vector<uint8_t> out;
+        out.insertAt(0, 0, uncompLen);
+        ASSERT_TRUE(indexed.uncompressEntry(entry, out.editArray()));
+        EXPECT_EQ(0, memcmp(data[i].array(), out.array(), uncompLen));
+    }
+
+    // Once the archive has changed the index is ignored.
+    struct timeval times[2];
+    memset(times, 0, sizeof(times));
+    ASSERT_EQ(0, utimes(mPath, times));
+    ZipFileRO stale;
+    ASSERT_EQ(NO_ERROR, stale.open(mPath, indexPath));
+    EXPECT_FALSE(stale.isIndexMapped());
+    EXPECT_TRUE(stale.findEntryByName("entry1") != NULL);
+
+    unlink(indexPath);
+}
+
 TEST_F(ZipFileROTest, ZipTimeConvertSuccess) {
     struct tm t;
 
@@ -0,0 +1,30 @@
+# Build the benchmarks. They print their results instead of asserting them,
+# so they are plain executables rather than gtests.
+LOCAL_PATH := $(call my-dir)
+
+benchmark_src_files := \
+	BasicHashtable_benchmark.cpp \
+	LinearTransform_benchmark.cpp \
+	Looper_benchmark.cpp \
+	LruCache_benchmark.cpp \
+	PropertyMap_benchmark.cpp \
+	RefBase_benchmark.cpp \
+	SystemClock_benchmark.cpp \
+	Unicode_benchmark.cpp \
+	Vector_benchmark.cpp
+
+shared_libraries := \
+	liblog \
+	libcutils \
+	libutils
+
+module_tags := tests
+
+$(foreach file,$(benchmark_src_files), \
+    $(eval include $(CLEAR_VARS)) \
+    $(eval LOCAL_SHARED_LIBRARIES := $(shared_libraries)) \
+    $(eval LOCAL_SRC_FILES := $(file)) \
+    $(eval LOCAL_MODULE := $(notdir $(file:%.cpp=%))) \
+    $(eval LOCAL_MODULE_TAGS := $(module_tags)) \
+    $(eval include $(BUILD_EXECUTABLE)) \
+)
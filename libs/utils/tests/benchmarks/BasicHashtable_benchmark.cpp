@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "BasicHashtableBenchmark"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <utils/BasicHashtable.h>
+#include <utils/LinearHashtable.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+// ---------------------------------------------------------------------------
+
+/*
+ * Compares the chained BasicHashtable with the linear probing
+ * LinearHashtable on scattered int keys, like those of pointers or strings:
+ *
+ *   add     the keys, growing the table from its default capacity
+ *   hit     find() each added key
+ *   miss    find() keys that were not added
+ *   remove  find() and removeAt() each added key, emptying the table
+ *
+ * Results are printed to stdout as CSV with a header line.
+ */
+
+typedef key_value_pair_t<int, int> Entry;
+
+struct Options {
+    int count;
+    int passes;             // lookups per key
+    int repeat;
+};
+
+// even keys are added, so that odd ones miss
+static int keyAt(uint32_t* seed, bool added)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return added ? int(*seed & ~1) : int(*seed | 1);
+}
+
+static void report(const char* table, const char* operation, int count,
+        nsecs_t total)
+{
+    printf("%s,%s,%d,%.3f,%.1f\n", table, operation, count, total / 1e6,
+            count ? double(total) / count : 0.0);
+    fflush(stdout);
+}
+
+template <typename THashtable>
+static bool run(const char* table, const Options& options)
+{
+    THashtable h;
+    const int count = options.count;
+    uint32_t seed = 1;
+    nsecs_t start = systemTime();
+    for (int i = 0; i < count; i++) {
+        const int key = keyAt(&seed, true);
+        h.add(hash_type(key), Entry(key, i));
+    }
+    report(table, "add", count, systemTime() - start);
+    bool ok = h.size() == size_t(count);
+
+    for (int added = 1; added >= 0; added--) {
+        int found = 0;
+        start = systemTime();
+        for (int pass = 0; pass < options.passes; pass++) {
+            seed = 1;
+            for (int i = 0; i < count; i++) {
+                const int key = keyAt(&seed, added);
+                found += h.find(-1, hash_type(key), key) >= 0;
+            }
+        }
+        report(table, added ? "hit" : "miss", count * options.passes,
+                systemTime() - start);
+        ok &= found == (added ? count * options.passes : 0);
+    }
+
+    seed = 1;
+    start = systemTime();
+    for (int i = 0; i < count; i++) {
+        const int key = keyAt(&seed, true);
+        const ssize_t index = h.find(-1, hash_type(key), key);
+        if (index < 0) {
+            ok = false;
+            break;
+        }
+        h.removeAt(index);
+    }
+    report(table, "remove", count, systemTime() - start);
+    return ok && h.size() == 0;
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+            "usage: %s [-n count] [-p passes] [-r repeat]\n"
+            "  -n  keys per table (10000)\n"
+            "  -p  lookups of each key (10)\n"
+            "  -r  runs of each table (3)\n", name);
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    options.count = 10000;
+    options.passes = 10;
+    options.repeat = 3;
+
+    int c;
+    while ((c = getopt(argc, argv, "n:p:r:")) != -1) {
+        switch (c) {
+            case 'n': options.count = atoi(optarg); break;
+            case 'p': options.passes = atoi(optarg); break;
+            case 'r': options.repeat = atoi(optarg); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (options.count < 1 || options.passes < 1 || options.repeat < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("table,operation,count,total_ms,ns_per_op\n");
+    int result = 0;
+    for (int r=0 ; r<options.repeat ; r++) {
+        if (!run<BasicHashtable<int, Entry> >("basic", options)) {
+            fprintf(stderr, "basic: wrong lookup results\n");
+            result = 1;
+        }
+        if (!run<LinearHashtable<int, Entry> >("linear", options)) {
+            fprintf(stderr, "linear: wrong lookup results\n");
+            result = 1;
+        }
+    }
+    return result;
+}
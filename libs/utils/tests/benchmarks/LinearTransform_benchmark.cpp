@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "LinearTransformBenchmark"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <utils/LinearTransform.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+// ---------------------------------------------------------------------------
+
+/*
+ * Measures LinearTransform conversions of 48kHz audio frames to
+ * microseconds, the way audio timestamps use it:
+ *
+ *   small    deltas from the zero point that take the single division path
+ *   large    deltas beyond 2^32, which take the 96 bit path
+ *   batch    the small deltas, converted 1024 at a time
+ *   reverse  the small deltas, microseconds back to frames
+ *   shift    small deltas with a power of two denominator
+ *
+ * Results are printed to stdout as CSV with a header line.
+ */
+
+static LinearTransform makeTransform(int32_t numer, uint32_t denom)
+{
+    LinearTransform t;
+    t.a_zero = 0;
+    t.b_zero = 0;
+    t.a_to_b_numer = numer;
+    t.a_to_b_denom = denom;
+    return t;
+}
+
+static int64_t sSink;
+
+static void report(const char* path, size_t count, nsecs_t total)
+{
+    printf("%s,%u,%.3f,%.2f\n", path, unsigned(count), total / 1e6,
+            count ? double(total) / count : 0.0);
+    fflush(stdout);
+}
+
+// returns false if a conversion failed
+static bool runSingle(const char* path, const LinearTransform& t,
+        int64_t base, bool reverse, size_t count)
+{
+    size_t converted = 0;
+    int64_t out;
+    const nsecs_t start = systemTime();
+    for (size_t i = 0; i < count; i++) {
+        const int64_t in = base + int64_t(i) * 1024;
+        if (reverse ? t.doReverseTransform(in, &out) : t.doForwardTransform(in, &out)) {
+            converted++;
+            sSink += out;
+        }
+    }
+    report(path, count, systemTime() - start);
+    return converted == count;
+}
+
+static bool runBatch(const LinearTransform& t, size_t count)
+{
+    static int64_t values[1024], converted[1024];
+    for (size_t i = 0; i < 1024; i++) {
+        values[i] = int64_t(i) * 1024;
+    }
+    const size_t batches = count / 1024;
+    size_t done = 0;
+    const nsecs_t start = systemTime();
+    for (size_t i = 0; i < batches; i++) {
+        done += t.doForwardTransform(values, converted, 1024);
+        sSink += converted[1];
+    }
+    report("batch", batches * 1024, systemTime() - start);
+    return done == batches * 1024;
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+            "usage: %s [-n count]\n"
+            "  -n  conversions per path (1000000)\n", name);
+}
+
+int main(int argc, char** argv)
+{
+    size_t count = 1000000;
+
+    int c;
+    while ((c = getopt(argc, argv, "n:")) != -1) {
+        switch (c) {
+            case 'n': count = atoi(optarg); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (count < 1024) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const LinearTransform frames(makeTransform(1000000, 48000));
+    const LinearTransform shifted(makeTransform(1000, 1024));
+
+    printf("path,count,total_ms,ns_per_conversion\n");
+    bool ok = runSingle("small", frames, 0, false, count);
+    ok &= runSingle("large", frames, INT64_C(1) << 33, false, count);
+    ok &= runBatch(frames, count);
+    ok &= runSingle("reverse", frames, 0, true, count);
+    ok &= runSingle("shift", shifted, 0, false, count);
+    // keeps the conversions from being optimized away
+    fprintf(stderr, "checksum %lld\n", (long long)sSink);
+    if (!ok) {
+        fprintf(stderr, "some conversions overflowed\n");
+        return 1;
+    }
+    return 0;
+}
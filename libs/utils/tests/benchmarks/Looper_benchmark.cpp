@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "LooperBenchmark"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <utils/Looper.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+// ---------------------------------------------------------------------------
+
+/*
+ * Measures the Looper message queue and wake path:
+ *
+ *   messages  sendMessageAtTime() of messages spread out of order over the
+ *             last millisecond, then pollOnce() until all are handled
+ *   remove    removeMessages() of every other handler from a full queue
+ *   wakes     wake() followed by pollOnce(0) on the same thread
+ *
+ * Results are printed to stdout as CSV with a header line.
+ */
+
+struct Options {
+    int count;
+    int repeat;
+    const char* benchmark;  // NULL for all
+};
+
+class CountingHandler : public MessageHandler {
+public:
+    CountingHandler() : count(0) { }
+    virtual void handleMessage(const Message&) { count++; }
+    int count;
+};
+
+static void report(const char* benchmark, int count, nsecs_t total)
+{
+    printf("%s,%d,%.3f,%.0f\n", benchmark, count, total / 1e6,
+            total > 0 ? count * 1e9 / total : 0.0);
+    fflush(stdout);
+}
+
+// spreads the messages over the last millisecond, out of order
+static nsecs_t messageTime(nsecs_t now, int i)
+{
+    return now - ms2ns(1) + (i * 7919ll) % 1000000;
+}
+
+static bool benchmarkMessages(const Options& options)
+{
+    sp<Looper> looper(new Looper(true));
+    sp<CountingHandler> handler(new CountingHandler());
+    const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < options.count; i++) {
+        looper->sendMessageAtTime(messageTime(start, i), handler, Message(i));
+    }
+    while (handler->count < options.count) {
+        looper->pollOnce(0);
+    }
+    report("messages", options.count, systemTime(SYSTEM_TIME_MONOTONIC) - start);
+    return handler->count == options.count;
+}
+
+static bool benchmarkRemove(const Options& options)
+{
+    sp<Looper> looper(new Looper(true));
+    sp<CountingHandler> handlers[2] = {
+            new CountingHandler(), new CountingHandler() };
+    // far enough in the future not to be dispatched by the final poll
+    const nsecs_t when = systemTime(SYSTEM_TIME_MONOTONIC) + s2ns(3600);
+    for (int i = 0; i < options.count; i++) {
+        looper->sendMessageAtTime(messageTime(when, i), handlers[i & 1],
+                Message(i));
+    }
+    const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    looper->removeMessages(handlers[0]);
+    report("remove", options.count, systemTime(SYSTEM_TIME_MONOTONIC) - start);
+    looper->removeMessages(handlers[1]);
+    looper->pollOnce(0);
+    return handlers[0]->count == 0 && handlers[1]->count == 0;
+}
+
+static bool benchmarkWakes(const Options& options)
+{
+    sp<Looper> looper(new Looper(true));
+    int woken = 0;
+    const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < options.count; i++) {
+        looper->wake();
+        woken += looper->pollOnce(0) == ALOOPER_POLL_WAKE;
+    }
+    report("wakes", options.count, systemTime(SYSTEM_TIME_MONOTONIC) - start);
+    return woken == options.count;
+}
+
+static const struct {
+    const char* name;
+    bool (*run)(const Options&);
+} kBenchmarks[] = {
+    { "messages", benchmarkMessages },
+    { "remove", benchmarkRemove },
+    { "wakes", benchmarkWakes },
+};
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+            "usage: %s [-b messages|remove|wakes] [-n count] [-r repeat]\n"
+            "  -b  benchmark to run, all of them by default\n"
+            "  -n  messages or wakes per run (100000)\n"
+            "  -r  runs of each benchmark (5)\n", name);
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    options.count = 100000;
+    options.repeat = 5;
+    options.benchmark = NULL;
+
+    int c;
+    while ((c = getopt(argc, argv, "b:n:r:")) != -1) {
+        switch (c) {
+            case 'b': options.benchmark = optarg; break;
+            case 'n': options.count = atoi(optarg); break;
+            case 'r': options.repeat = atoi(optarg); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (options.count < 1 || options.repeat < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("benchmark,count,total_ms,per_sec\n");
+    int result = 0;
+    bool found = false;
+    for (size_t i=0 ; i<sizeof(kBenchmarks)/sizeof(*kBenchmarks) ; i++) {
+        if (options.benchmark && strcmp(options.benchmark, kBenchmarks[i].name)) {
+            continue;
+        }
+        found = true;
+        for (int r=0 ; r<options.repeat ; r++) {
+            if (!kBenchmarks[i].run(options)) {
+                fprintf(stderr, "%s: wrong result\n", kBenchmarks[i].name);
+                result = 1;
+            }
+        }
+    }
+    if (!found) {
+        usage(argv[0]);
+        return 1;
+    }
+    return result;
+}
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "LruCacheBenchmark"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <utils/GenerationCache.h>
+#include <utils/LruCache.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+using namespace android;
+
+// ---------------------------------------------------------------------------
+
+/*
+ * Compares LruCache with the GenerationCache it replaces. For each capacity,
+ * both caches run the same mix of get() and put(): pseudo-random keys from
+ * a key space of twice the capacity, so about half the gets hit and every
+ * miss evicts once the cache is full.
+ *
+ * Results are printed to stdout as CSV with a header line.
+ */
+
+typedef const char* StringValue;
+
+struct Options {
+    Vector<int> capacities;
+    int passes;             // operations per run, in multiples of the capacity
+    int repeat;
+};
+
+template <typename Cache>
+static nsecs_t timeCache(Cache& cache, int capacity, int passes, int* outHits)
+{
+    int hits = 0;
+    uint32_t seed = 1;
+    const nsecs_t start = systemTime();
+    for (int i = 0; i < capacity * passes; i++) {
+        // the same sequence for each cache
+        seed = seed * 1103515245 + 12345;
+        const int key = (seed >> 8) % (capacity * 2);
+        if (cache.get(key) == NULL) {
+            cache.put(key, "value");
+        } else {
+            hits++;
+        }
+    }
+    *outHits = hits;
+    return systemTime() - start;
+}
+
+static void report(const char* cache, int capacity, int operations, int hits,
+        nsecs_t total)
+{
+    printf("%s,%d,%d,%d,%.3f,%.1f\n", cache, capacity, operations, hits,
+            total / 1e6, operations ? double(total) / operations : 0.0);
+    fflush(stdout);
+}
+
+static bool run(const Options& options, int capacity)
+{
+    const int operations = capacity * options.passes;
+    GenerationCache<int, StringValue> generationCache(capacity);
+    int generationHits;
+    nsecs_t total = timeCache(generationCache, capacity, options.passes,
+            &generationHits);
+    report("generation", capacity, operations, generationHits, total);
+
+    LruCache<int, StringValue> lruCache(capacity);
+    int lruHits;
+    total = timeCache(lruCache, capacity, options.passes, &lruHits);
+    report("lru", capacity, operations, lruHits, total);
+
+    // both are least recently used caches
+    return generationHits == lruHits
+            && generationCache.size() == lruCache.size();
+}
+
+static bool parseList(char* list, Vector<int>* out)
+{
+    out->clear();
+    for (char* item = strtok(list, ","); item; item = strtok(NULL, ",")) {
+        const int value = atoi(item);
+        if (value < 1) {
+            return false;
+        }
+        out->add(value);
+    }
+    return !out->isEmpty();
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+            "usage: %s [-c capacity,...] [-p passes] [-r repeat]\n"
+            "  -c  cache capacities (100,1000,4000)\n"
+            "  -p  operations per run, in multiples of the capacity (4)\n"
+            "  -r  runs of each capacity (3)\n", name);
+}
+
+int main(int argc, char** argv)
+{
+    static const int kCapacities[] = { 100, 1000, 4000 };
+    Options options;
+    options.capacities.appendArray(kCapacities,
+            sizeof(kCapacities)/sizeof(*kCapacities));
+    options.passes = 4;
+    options.repeat = 3;
+
+    int c;
+    while ((c = getopt(argc, argv, "c:p:r:")) != -1) {
+        switch (c) {
+            case 'c':
+                if (!parseList(optarg, &options.capacities)) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'p': options.passes = atoi(optarg); break;
+            case 'r': options.repeat = atoi(optarg); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (options.passes < 1 || options.repeat < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("cache,capacity,operations,hits,total_ms,ns_per_op\n");
+    int result = 0;
+    for (size_t i=0 ; i<options.capacities.size() ; i++) {
+        for (int r=0 ; r<options.repeat ; r++) {
+            if (!run(options, options.capacities[i])) {
+                fprintf(stderr, "%d: the caches disagree\n",
+                        options.capacities[i]);
+                result = 1;
+            }
+        }
+    }
+    return result;
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "PropertyMapBenchmark"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <utils/PropertyMap.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+// ---------------------------------------------------------------------------
+
+/*
+ * Measures PropertyMap::load() of a generated configuration file, like the
+ * input device configuration files, parsed every time (the cache cleared
+ * before each load) and served from the cache.
+ *
+ * The file is written to $TMPDIR, or /data/local/tmp, and removed after.
+ * Results are printed to stdout as CSV with a header line.
+ */
+
+static bool writeFile(const char* path, int properties)
+{
+    String8 contents;
+    for (int i = 0; i < properties; i++) {
+        char line[64];
+        snprintf(line, sizeof(line), "touch.property%d = value%d\n", i, i);
+        contents.append(line);
+    }
+    int fd = open(path, O_WRONLY | O_TRUNC);
+    if (fd < 0) {
+        return false;
+    }
+    const bool written = write(fd, contents.string(), contents.length())
+            == ssize_t(contents.length());
+    close(fd);
+    return written;
+}
+
+// returns false if a load failed or gave the wrong number of properties
+static bool run(const char* mode, const String8& path, int properties,
+        int count, bool cached)
+{
+    PropertyMap::clearCache();
+    bool ok = true;
+    const nsecs_t start = systemTime();
+    for (int i = 0; i < count; i++) {
+        if (!cached) {
+            PropertyMap::clearCache();
+        }
+        PropertyMap* map;
+        if (PropertyMap::load(path, &map) != NO_ERROR) {
+            return false;
+        }
+        ok &= map->getProperties().size() == size_t(properties);
+        delete map;
+    }
+    const nsecs_t total = systemTime() - start;
+    printf("%s,%d,%d,%.3f,%.2f\n", mode, properties, count, total / 1e6,
+            total / 1e3 / count);
+    fflush(stdout);
+    return ok;
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+            "usage: %s [-p properties] [-n count]\n"
+            "  -p  properties in the file (50)\n"
+            "  -n  loads of each kind (1000)\n", name);
+}
+
+int main(int argc, char** argv)
+{
+    int properties = 50;
+    int count = 1000;
+
+    int c;
+    while ((c = getopt(argc, argv, "p:n:")) != -1) {
+        switch (c) {
+            case 'p': properties = atoi(optarg); break;
+            case 'n': count = atoi(optarg); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (properties < 1 || count < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const char* tmpDir = getenv("TMPDIR");
+    char path[256];
+    snprintf(path, sizeof(path), "%s/PropertyMap_benchmark.XXXXXX",
+            tmpDir ? tmpDir : "/data/local/tmp");
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        fprintf(stderr, "can't create %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    close(fd);
+
+    int result = 0;
+    if (!writeFile(path, properties)) {
+        fprintf(stderr, "can't write %s\n", path);
+        result = 1;
+    } else {
+        printf("mode,properties,loads,total_ms,us_per_load\n");
+        if (!run("parsed", String8(path), properties, count, false) ||
+                !run("cached", String8(path), properties, count, true)) {
+            fprintf(stderr, "wrong properties loaded from %s\n", path);
+            result = 1;
+        }
+    }
+    unlink(path);
+    PropertyMap::clearCache();
+    return result;
+}
@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "RefBaseBenchmark"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cutils/atomic.h>
+
+#include <utils/RefBase.h>
+#include <utils/Thread.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+using namespace android;
+
+// ---------------------------------------------------------------------------
+
+/*
+ * Compares the reference counting of RefBase, LightRefBase and
+ * VirtualLightRefBase objects:
+ *
+ *   create   new object held by an sp<> and one copy of it, then released
+ *   copy     sp<> copied from and released back to a long lived object,
+ *            by one or more threads at once
+ *   promote  wp<>::promote() of a live RefBase object
+ *
+ * Results are printed to stdout as CSV with a header line.
+ */
+
+static int32_t sLive = 0;
+
+class Counted : public RefBase {
+public:
+    Counted() { android_atomic_inc(&sLive); }
+    virtual ~Counted() { android_atomic_dec(&sLive); }
+};
+
+class LightCounted : public LightRefBase<LightCounted> {
+public:
+    LightCounted() { android_atomic_inc(&sLive); }
+private:
+    friend class LightRefBase<LightCounted>;
+    ~LightCounted() { android_atomic_dec(&sLive); }
+};
+
+class VirtualLightCounted : public VirtualLightRefBase {
+public:
+    VirtualLightCounted() { android_atomic_inc(&sLive); }
+    virtual ~VirtualLightCounted() { android_atomic_dec(&sLive); }
+};
+
+struct Options {
+    int count;              // operations per thread
+    Vector<int> threads;
+};
+
+static void report(const char* type, const char* operation, int threads,
+        int count, nsecs_t total)
+{
+    printf("%s,%s,%d,%d,%.3f,%.1f\n", type, operation, threads, count,
+            total / 1e6, count ? double(total) / count : 0.0);
+    fflush(stdout);
+}
+
+template <typename T>
+static void timeCreate(const char* type, int count)
+{
+    const nsecs_t start = systemTime();
+    for (int i = 0; i < count; i++) {
+        sp<T> object(new T());
+        sp<T> copy(object);
+    }
+    report(type, "create", 1, count, systemTime() - start);
+}
+
+template <typename T>
+class CopyThread : public Thread {
+public:
+    CopyThread(const sp<T>& object, int count)
+        : Thread(false), mObject(object), mCount(count) { }
+private:
+    virtual bool threadLoop() {
+        for (int i = 0; i < mCount; i++) {
+            sp<T> copy(mObject);
+        }
+        // the thread may drop its last reference to itself after join()
+        mObject.clear();
+        return false;
+    }
+    sp<T> mObject;
+    const int mCount;
+};
+
+template <typename T>
+static void timeCopy(const char* type, int threads, int count)
+{
+    sp<T> object(new T());
+    Vector<sp<Thread> > workers;
+    for (int i = 0; i < threads; i++) {
+        workers.add(new CopyThread<T>(object, count));
+    }
+    const nsecs_t start = systemTime();
+    for (int i = 0; i < threads; i++) {
+        workers[i]->run("RefBaseBenchmark");
+    }
+    for (int i = 0; i < threads; i++) {
+        workers[i]->join();
+    }
+    report(type, "copy", threads, count * threads, systemTime() - start);
+}
+
+static void timePromote(int count)
+{
+    sp<Counted> object(new Counted());
+    wp<Counted> weak(object);
+    int promoted = 0;
+    const nsecs_t start = systemTime();
+    for (int i = 0; i < count; i++) {
+        promoted += weak.promote() != NULL;
+    }
+    report("RefBase", "promote", 1, promoted, systemTime() - start);
+}
+
+template <typename T>
+static void run(const char* type, const Options& options)
+{
+    timeCreate<T>(type, options.count);
+    for (size_t i=0 ; i<options.threads.size() ; i++) {
+        timeCopy<T>(type, options.threads[i], options.count);
+    }
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+            "usage: %s [-n count] [-t threads,...]\n"
+            "  -n  operations of each kind per thread (100000)\n"
+            "  -t  threads copying the same object at once (1,2,4)\n", name);
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    options.count = 100000;
+    options.threads.add(1);
+    options.threads.add(2);
+    options.threads.add(4);
+
+    int c;
+    while ((c = getopt(argc, argv, "n:t:")) != -1) {
+        switch (c) {
+            case 'n': options.count = atoi(optarg); break;
+            case 't': {
+                options.threads.clear();
+                for (char* t = strtok(optarg, ","); t; t = strtok(NULL, ",")) {
+                    if (atoi(t) < 1) {
+                        usage(argv[0]);
+                        return 1;
+                    }
+                    options.threads.add(atoi(t));
+                }
+                break;
+            }
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (options.count < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("type,operation,threads,count,total_ms,ns_per_op\n");
+    run<Counted>("RefBase", options);
+    run<LightCounted>("LightRefBase", options);
+    run<VirtualLightCounted>("VirtualLightRefBase", options);
+    timePromote(options.count);
+
+    // every object must have been destroyed exactly once
+    if (sLive != 0) {
+        fprintf(stderr, "%d objects leaked or destroyed twice\n", sLive);
+        return 1;
+    }
+    return 0;
+}
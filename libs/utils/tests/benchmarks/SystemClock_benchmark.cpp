@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "SystemClockBenchmark"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef HAVE_ANDROID_OS
+#include <sys/ioctl.h>
+#include <linux/android_alarm.h>
+#endif
+
+#include <utils/SystemClock.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+// ---------------------------------------------------------------------------
+
+/*
+ * Measures the cost of a call to each clock elapsedRealtime() can be built
+ * on, next to elapsedRealtimeNano() and uptimeMillis() themselves: the
+ * CLOCK_MONOTONIC and CLOCK_BOOTTIME clocks and, when it can be opened, the
+ * /dev/alarm ioctl. Each clock is called in a tight loop; the fastest of
+ * the runs is reported, since the others were disturbed.
+ *
+ * Results are printed to stdout as CSV with a header line.
+ */
+
+typedef int64_t (*ClockFunction)();
+
+static int64_t monotonicClock() { return systemTime(SYSTEM_TIME_MONOTONIC); }
+static int64_t boottimeClock() { return systemTime(SYSTEM_TIME_BOOTTIME); }
+
+#ifdef HAVE_ANDROID_OS
+static int gAlarmFd = -1;
+static int64_t alarmClock() {
+    struct timespec ts;
+    ioctl(gAlarmFd, ANDROID_ALARM_GET_TIME(ANDROID_ALARM_ELAPSED_REALTIME), &ts);
+    return seconds_to_nanoseconds(ts.tv_sec) + ts.tv_nsec;
+}
+#endif
+
+static void run(const char* name, ClockFunction clock, int count, int repeat)
+{
+    volatile int64_t sink = 0;
+    nsecs_t best = 0;
+    for (int r = 0; r < repeat; r++) {
+        const nsecs_t start = systemTime();
+        for (int i = 0; i < count; i++) {
+            sink += clock();
+        }
+        const nsecs_t elapsed = systemTime() - start;
+        if (r == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    printf("%s,%d,%d,%.1f\n", name, count, repeat, double(best) / count);
+    fflush(stdout);
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+            "usage: %s [-n count] [-r repeat]\n"
+            "  -n  calls per run (100000)\n"
+            "  -r  runs of each clock (5)\n", name);
+}
+
+int main(int argc, char** argv)
+{
+    int count = 100000;
+    int repeat = 5;
+
+    int c;
+    while ((c = getopt(argc, argv, "n:r:")) != -1) {
+        switch (c) {
+            case 'n': count = atoi(optarg); break;
+            case 'r': repeat = atoi(optarg); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (count < 1 || repeat < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("clock,count,runs,ns_per_call\n");
+    run("elapsedRealtimeNano", elapsedRealtimeNano, count, repeat);
+    run("uptimeMillis", uptimeMillis, count, repeat);
+    run("CLOCK_MONOTONIC", monotonicClock, count, repeat);
+    run("CLOCK_BOOTTIME", boottimeClock, count, repeat);
+#ifdef HAVE_ANDROID_OS
+    gAlarmFd = open("/dev/alarm", O_RDONLY);
+    if (gAlarmFd >= 0) {
+        run("/dev/alarm", alarmClock, count, repeat);
+        close(gAlarmFd);
+    } else {
+        fprintf(stderr, "can't open /dev/alarm, skipping it\n");
+    }
+#endif
+    return 0;
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "UnicodeBenchmark"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <utils/Timers.h>
+#include <utils/Unicode.h>
+
+using namespace android;
+
+// ---------------------------------------------------------------------------
+
+/*
+ * Measures the UTF-8 <-> UTF-16 conversions, measuring the length first and
+ * converting after it ("two-pass") or both at once ("one-pass"), on:
+ *
+ *   ascii   only ASCII, the fast path
+ *   mixed   ASCII with a 2 byte sequence every 64 bytes
+ *   cjk     only 3 byte sequences
+ *
+ * Results are printed to stdout as CSV with a header line.
+ */
+
+struct Options {
+    size_t length;          // bytes of UTF-8 per conversion
+    int iterations;
+};
+
+static void makeInput(const char* name, uint8_t* str, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        str[i] = 'a' + (i % 26);
+    }
+    if (!strcmp(name, "mixed")) {
+        for (size_t i = 0; i + 1 < len; i += 64) {
+            str[i] = 0xC3;      // U+00E9
+            str[i + 1] = 0xA9;
+        }
+    } else if (!strcmp(name, "cjk")) {
+        for (size_t i = 0; i + 2 < len; i += 3) {
+            str[i] = 0xE4;      // U+4E2D
+            str[i + 1] = 0xB8;
+            str[i + 2] = 0xAD;
+        }
+    }
+}
+
+static void report(const char* input, const char* conversion, size_t length,
+        int iterations, nsecs_t total)
+{
+    printf("%s,%s,%u,%d,%.3f,%.1f\n", input, conversion, unsigned(length),
+            iterations, total / 1e6,
+            total > 0 ? double(length) * iterations * 1e3 / total : 0.0);
+    fflush(stdout);
+}
+
+static bool run(const char* name, const Options& options)
+{
+    const size_t len = options.length;
+    const int iterations = options.iterations;
+    uint8_t* input = new uint8_t[len];
+    char16_t* u16 = new char16_t[len + 1];
+    char* u8 = new char[len * 3 + 1];
+    makeInput(name, input, len);
+    bool ok = true;
+
+    nsecs_t start = systemTime();
+    ssize_t u16len = 0;
+    for (int i = 0; i < iterations; i++) {
+        u16len = utf8_to_utf16_length(input, len);
+        utf8_to_utf16(input, len, u16);
+    }
+    report(name, "utf8_to_utf16,two-pass", len, iterations, systemTime() - start);
+
+    start = systemTime();
+    for (int i = 0; i < iterations; i++) {
+        ok &= utf8_to_utf16_and_length(input, len, u16) == u16len;
+    }
+    report(name, "utf8_to_utf16,one-pass", len, iterations, systemTime() - start);
+
+    start = systemTime();
+    ssize_t u8len = 0;
+    for (int i = 0; i < iterations; i++) {
+        u8len = utf16_to_utf8_length(u16, u16len);
+        utf16_to_utf8(u16, u16len, u8);
+    }
+    report(name, "utf16_to_utf8,two-pass", len, iterations, systemTime() - start);
+
+    start = systemTime();
+    for (int i = 0; i < iterations; i++) {
+        ok &= utf16_to_utf8_and_length(u16, u16len, u8) == size_t(u8len);
+    }
+    report(name, "utf16_to_utf8,one-pass", len, iterations, systemTime() - start);
+
+    ok &= u8len == ssize_t(len) && !memcmp(input, u8, len);
+    delete[] input;
+    delete[] u16;
+    delete[] u8;
+    return ok;
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+            "usage: %s [-i ascii|mixed|cjk] [-l length] [-n iterations]\n"
+            "  -i  input to convert, all of them by default\n"
+            "  -l  bytes of UTF-8 per conversion (4096)\n"
+            "  -n  conversions of each kind (2000)\n", name);
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    options.length = 4096;
+    options.iterations = 2000;
+    const char* input = NULL;
+
+    int c;
+    while ((c = getopt(argc, argv, "i:l:n:")) != -1) {
+        switch (c) {
+            case 'i': input = optarg; break;
+            case 'l': options.length = atoi(optarg); break;
+            case 'n': options.iterations = atoi(optarg); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (options.length < 3 || options.iterations < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("input,conversion,mode,bytes,iterations,total_ms,mb_per_sec\n");
+    static const char* const inputs[] = { "ascii", "mixed", "cjk" };
+    int result = 0;
+    bool found = false;
+    for (size_t i=0 ; i<sizeof(inputs)/sizeof(*inputs) ; i++) {
+        if (input && strcmp(input, inputs[i])) {
+            continue;
+        }
+        found = true;
+        if (!run(inputs[i], options)) {
+            fprintf(stderr, "%s: the conversions disagree\n", inputs[i]);
+            result = 1;
+        }
+    }
+    if (!found) {
+        usage(argv[0]);
+        return 1;
+    }
+    return result;
+}
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "VectorBenchmark"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <utils/RefBase.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+using namespace android;
+
+// ---------------------------------------------------------------------------
+
+/*
+ * Measures how Vector moves its items when it grows, shrinks or opens and
+ * closes gaps, for items that are trivially movable (int, sp<>, String8)
+ * and for one that isn't:
+ *
+ *   append   add() to the end, growing the storage as it goes
+ *   front    insertAt() the front, then removeAt() the front
+ *   middle   insertAt() the middle, then removeAt() the middle
+ *
+ * Results are printed to stdout as CSV with a header line.
+ */
+
+class Counted : public RefBase {
+};
+
+// has a copy constructor and no trivial move trait, so Vector relocates it
+// through do_move_forward/backward
+struct Boxed {
+    Boxed() : value(0) { }
+    Boxed(const Boxed& rhs) : value(rhs.value) { }
+    Boxed& operator=(const Boxed& rhs) { value = rhs.value; return *this; }
+    int value;
+};
+
+enum Pattern { APPEND, FRONT, MIDDLE };
+
+static const char* const kPatternNames[] = { "append", "front", "middle" };
+
+struct Options {
+    int count;              // items per run
+    int repeat;
+};
+
+static void report(const char* type, Pattern pattern, int count, nsecs_t total)
+{
+    printf("%s,%s,%d,%.3f,%.1f\n", type, kPatternNames[pattern], count,
+            total / 1e6, count ? double(total) / count : 0.0);
+    fflush(stdout);
+}
+
+template <typename TYPE>
+static bool run(const char* type, Pattern pattern, const TYPE& item,
+        const Options& options)
+{
+    Vector<TYPE> vector;
+    const nsecs_t start = systemTime();
+    for (int i = 0; i < options.count; i++) {
+        switch (pattern) {
+            case APPEND: vector.add(item); break;
+            case FRONT:  vector.insertAt(item, 0); break;
+            case MIDDLE: vector.insertAt(item, vector.size() / 2); break;
+        }
+    }
+    const bool filled = vector.size() == size_t(options.count);
+    while (!vector.isEmpty()) {
+        switch (pattern) {
+            case APPEND: vector.removeAt(vector.size() - 1); break;
+            case FRONT:  vector.removeAt(0); break;
+            case MIDDLE: vector.removeAt(vector.size() / 2); break;
+        }
+    }
+    report(type, pattern, options.count, systemTime() - start);
+    return filled;
+}
+
+static bool runAll(Pattern pattern, const Options& options)
+{
+    sp<Counted> object(new Counted());
+    bool ok = run("int", pattern, 42, options);
+    ok &= run("sp", pattern, object, options);
+    ok &= run("String8", pattern, String8("item"), options);
+    ok &= run("copied", pattern, Boxed(), options);
+    // each sp<> copy in the vector must have been released
+    return ok && object->getStrongCount() == 1;
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+            "usage: %s [-p append|front|middle] [-n count] [-r repeat]\n"
+            "  -p  pattern to run, all of them by default\n"
+            "  -n  items inserted and removed per run (2000)\n"
+            "  -r  runs of each pattern (3)\n", name);
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    options.count = 2000;
+    options.repeat = 3;
+    const char* pattern = NULL;
+
+    int c;
+    while ((c = getopt(argc, argv, "p:n:r:")) != -1) {
+        switch (c) {
+            case 'p': pattern = optarg; break;
+            case 'n': options.count = atoi(optarg); break;
+            case 'r': options.repeat = atoi(optarg); break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (options.count < 1 || options.repeat < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("type,pattern,count,total_ms,ns_per_item\n");
+    int result = 0;
+    bool found = false;
+    for (int p = APPEND; p <= MIDDLE; p++) {
+        if (pattern && strcmp(pattern, kPatternNames[p])) {
+            continue;
+        }
+        found = true;
+        for (int r=0 ; r<options.repeat ; r++) {
+            if (!runAll(Pattern(p), options)) {
+                fprintf(stderr, "%s: wrong size or reference count\n",
+                        kPatternNames[p]);
+                result = 1;
+            }
+        }
+    }
+    if (!found) {
+        usage(argv[0]);
+        return 1;
+    }
+    return result;
+}
@@ -67,18 +67,49 @@ etc1_uint32 etc1_get_encoded_data_size(etc1_uint32 width, etc1_uint32 height);
 int etc1_encode_image(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 height,
         etc1_uint32 pixelSize, etc1_uint32 stride, etc1_byte* pOut);
 
+// Encoding quality levels for etc1_encode_image_ex().
+// ETC1_QUALITY_FAST only tries the modifier tables closest to the spread of
+// each sub-block's colors, ETC1_QUALITY_HIGH tries them all (this is what
+// etc1_encode_block() and etc1_encode_image() do). Both produce standard
+// ETC1 data.
+
+#define ETC1_QUALITY_FAST 0
+#define ETC1_QUALITY_HIGH 1
+
+// Maximum number of threads etc1_encode_image_ex() and etc1_decode_image_ex() use.
+
+#define ETC1_MAX_THREADS 16
+
+// Encode an entire image, like etc1_encode_image().
+// quality is ETC1_QUALITY_FAST or ETC1_QUALITY_HIGH.
+// numThreads is the number of threads to encode with, 0 means one per CPU.
+// The output doesn't depend on numThreads.
+// returns non-zero if there is an error.
+
+int etc1_encode_image_ex(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 height,
+        etc1_uint32 pixelSize, etc1_uint32 stride, etc1_byte* pOut,
+        int quality, etc1_uint32 numThreads);
+
 // Decode an entire image.
 // pIn - pointer to encoded data.
 // pOut - pointer to the image data. Will be written such that
 //        pixel (x,y) is at pIn + pixelSize * x + stride * y. Must be
 //        large enough to store entire image.
-// pixelSize can be 2 or 3. 2 is an GL_UNSIGNED_SHORT_5_6_5 image, 3 is a GL_BYTE RGB image.
+// pixelSize can be 2, 3 or 4. 2 is an GL_UNSIGNED_SHORT_5_6_5 image, 3 is a GL_BYTE RGB image,
+// 4 is a GL_BYTE RGBA image with an opaque alpha.
 // returns non-zero if there is an error.
 
 int etc1_decode_image(const etc1_byte* pIn, etc1_byte* pOut,
         etc1_uint32 width, etc1_uint32 height,
         etc1_uint32 pixelSize, etc1_uint32 stride);
 
+// Decode an entire image, like etc1_decode_image().
+// numThreads is the number of threads to decode with, 0 means one per CPU.
+
+int etc1_decode_image_ex(const etc1_byte* pIn, etc1_byte* pOut,
+        etc1_uint32 width, etc1_uint32 height,
+        etc1_uint32 pixelSize, etc1_uint32 stride, etc1_uint32 numThreads);
+
 // Size of a PKM header, in bytes.
 
 #define ETC_PKM_HEADER_SIZE 16
@@ -18,12 +18,13 @@
 #include <stdlib.h>
 #include "context.h"
 #include "TextureObjectManager.h"
+#include "dxt.h"
 
 namespace android {
 // ----------------------------------------------------------------------------
 
 EGLTextureObject::EGLTextureObject()
-    : mSize(0)
+    : mSize(0), mCompressedData(0), mCompressedLevels(0)
 {
     init();
 }
@@ -36,6 +37,10 @@ EGLTextureObject::~EGLTextureObject()
         if (mMipmaps)
             freeMipmaps();
     }
+    if (mCompressedData) {
+        freeCompressedData(0);
+        free(mCompressedData);
+    }
 }
 
 void EGLTextureObject::init()
@@ -71,7 +76,7 @@ status_t EGLTextureObject::allocateMipmaps()
 {
     // here, by construction, mMipmaps=0 && mNumExtraLod=0
 
-    if (!surface.data)
+    if (!surface.data && isDecoded(0))
         return NO_INIT;
 
     int w = surface.width;
@@ -96,6 +101,7 @@ void EGLTextureObject::freeMipmaps()
             if (mMipmaps[i].data) {
                 free(mMipmaps[i].data);
             }
+            freeCompressedData(i+1);
         }
         free(mMipmaps);
         mMipmaps = 0;
@@ -116,12 +122,70 @@ GGLSurface& EGLTextureObject::editMip(int lod)
     return const_cast<GGLSurface&>(mip(lod));
 }
 
+int EGLTextureObject::levelOf(int lod) const
+{
+    // the level returned by mip(lod)
+    if (lod<=0 || !mMipmaps)
+        return 0;
+    return min(lod, mNumExtraLod);
+}
+
+status_t EGLTextureObject::setCompressedData(
+        GLint lod, const GLvoid* data, size_t size)
+{
+    const int level = levelOf(lod);
+    if (!mCompressedData) {
+        mCompressedData = (void**)calloc(32, sizeof(void*));
+        if (!mCompressedData)
+            return NO_MEMORY;
+    }
+    freeCompressedData(level);
+    void* copy = malloc(size);
+    if (!copy) {
+        mIsComplete = false;
+        return NO_MEMORY;
+    }
+    memcpy(copy, data, size);
+    mCompressedData[level] = copy;
+    mCompressedLevels |= 1LU << level;
+    return NO_ERROR;
+}
+
+void EGLTextureObject::freeCompressedData(int level)
+{
+    if (mCompressedLevels & (1LU << level)) {
+        free(mCompressedData[level]);
+        mCompressedData[level] = 0;
+        mCompressedLevels &= ~(1LU << level);
+    }
+}
+
+status_t EGLTextureObject::decodeLevel(int level)
+{
+    if (!(mCompressedLevels & (1LU << level)))
+        return NO_ERROR;
+
+    GGLSurface& s = editMip(level);
+    const GGLFormat& pixelFormat(gglGetPixelFormatTable()[s.format]);
+    const size_t size = s.stride * s.height * pixelFormat.size;
+    s.data = (GGLubyte*)malloc(size);
+    if (!s.data) {
+        mIsComplete = false;
+        return NO_MEMORY;
+    }
+    decodeDXT(mCompressedData[level], s.width, s.height,
+            s.data, s.stride, s.compressedFormat);
+    freeCompressedData(level);
+    return NO_ERROR;
+}
+
 status_t EGLTextureObject::setSurface(GGLSurface const* s)
 {
     // XXX: glFlush() on 's'
     if (mSize && surface.data) {
         free(surface.data);
     }
+    freeCompressedData(0);
     surface = *s;
     internalformat = 0;
     buffer = 0;
@@ -164,7 +228,15 @@ status_t EGLTextureObject::reallocate(
     const size_t size = h * bpr;
     if (level == 0)
     {
-        if (size!=mSize || !surface.data) {
+        freeCompressedData(0);
+        if (compressedFormat) {
+            // the storage is allocated by decodeLevel()
+            if (mSize && surface.data) {
+                free(surface.data);
+            }
+            surface.data = 0;
+            mSize = size;
+        } else if (size!=mSize || !surface.data) {
             if (mSize && surface.data) {
                 free(surface.data);
             }
@@ -200,9 +272,11 @@ status_t EGLTextureObject::reallocate(
         GGLSurface& mipmap = editMip(level);
         if (mipmap.data)
             free(mipmap.data);
+        freeCompressedData(levelOf(level));
 
-        mipmap.data = (GGLubyte*)malloc(size);
-        if (!mipmap.data) {
+        // the storage of compressed levels is allocated by decodeLevel()
+        mipmap.data = compressedFormat ? 0 : (GGLubyte*)malloc(size);
+        if (!mipmap.data && !compressedFormat) {
             memset(&mipmap, 0, sizeof(GGLSurface));
             mIsComplete = false;
             return NO_MEMORY;
@@ -61,14 +61,31 @@ public:
     bool                isComplete() const { return mIsComplete; }
     void                copyParameters(const sp<EGLTextureObject>& old);
 
+    // A level reallocated with a compressedFormat gets no storage, it
+    // keeps a copy of its compressed data instead and is only decoded
+    // the first time it is needed, see decode().
+    status_t            setCompressedData(GLint lod,
+                            const GLvoid* data, size_t size);
+    bool                isDecoded(int lod) const {
+        return !(mCompressedLevels & (1LU << levelOf(lod)));
+    }
+    inline status_t     decode(int lod) {
+        return ggl_likely(!mCompressedLevels) ? NO_ERROR : decodeLevel(levelOf(lod));
+    }
+
 private:
         status_t        allocateMipmaps();
             void        freeMipmaps();
             void        init();
+            int         levelOf(int lod) const;
+        status_t        decodeLevel(int level);
+            void        freeCompressedData(int level);
     size_t              mSize;
     GGLSurface          *mMipmaps;
     int                 mNumExtraLod;
     bool                mIsComplete;
+    void**              mCompressedData;    // per level, while not decoded
+    uint32_t            mCompressedLevels;  // a bit per level not decoded
 
 public:
     GGLSurface          surface;
@@ -17,6 +17,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
 #include "context.h"
 #include "fp.h"
 #include "state.h"
@@ -27,17 +30,23 @@
 #include "texture.h"
 #include "BufferObjectManager.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
 // ----------------------------------------------------------------------------
 
-#define VC_CACHE_STATISTICS     0
 #define VC_CACHE_TYPE_NONE      0
 #define VC_CACHE_TYPE_INDEXED   1
 #define VC_CACHE_TYPE_LRU       2
-#define VC_CACHE_TYPE           VC_CACHE_TYPE_INDEXED
+#define VC_CACHE_TYPE_SET_ASSOC 3
+#define VC_CACHE_TYPE           VC_CACHE_TYPE_SET_ASSOC
 
-#if VC_CACHE_STATISTICS
-#include <utils/Timers.h>
-#endif
+// draws between two reports, when debug.libagl.vcstats or
+// debug.libagl.xformstats is set
+#define VC_STATS_PERIOD         1024
 
 // ----------------------------------------------------------------------------
 
@@ -49,6 +58,9 @@ static void compileElements__generic(ogles_context_t*,
         vertex_t*, GLint, GLsizei);
 static void compileElement__generic(ogles_context_t*,
         vertex_t*, GLint);
+template <bool TEXCOORDS>
+static void compileElements__batched(ogles_context_t*,
+        vertex_t*, GLint, GLsizei);
 
 static void drawPrimitivesPoints(ogles_context_t*, GLint, GLsizei);
 static void drawPrimitivesLineStrip(ogles_context_t*, GLint, GLsizei);
@@ -360,6 +372,12 @@ void vertex_cache_t::init()
         vCache = vBuffer + VERTEX_BUFFER_SIZE;
         sequence = 0;
     }
+    state.valid = GL_FALSE;
+
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.libagl.vcstats", value, "0");
+    stats = atoi(value);
+    draws = kept = total = misses = 0;
 }
 
 void vertex_cache_t::uninit()
@@ -370,12 +388,6 @@ void vertex_cache_t::uninit()
 
 void vertex_cache_t::clear()
 {
-#if VC_CACHE_STATISTICS
-    startTime = systemTime(SYSTEM_TIME_THREAD);
-    total = 0;
-    misses = 0;
-#endif
-
 #if VC_CACHE_TYPE == VC_CACHE_TYPE_LRU
     vertex_t* v = vBuffer;
     size_t count = VERTEX_BUFFER_SIZE + VERTEX_CACHE_SIZE;
@@ -397,28 +409,13 @@ void vertex_cache_t::clear()
     }
 }
 
-void vertex_cache_t::dump_stats(GLenum mode)
+void vertex_cache_t::dump_stats()
 {
-#if VC_CACHE_STATISTICS
-    nsecs_t time = systemTime(SYSTEM_TIME_THREAD) - startTime;
-    uint32_t hits = total - misses;
-    uint32_t prim_count;
-    switch (mode) {
-    case GL_POINTS:             prim_count = total;         break;
-    case GL_LINE_STRIP:         prim_count = total - 1;     break;
-    case GL_LINE_LOOP:          prim_count = total - 1;     break;
-    case GL_LINES:              prim_count = total / 2;     break;
-    case GL_TRIANGLE_STRIP:     prim_count = total - 2;     break;
-    case GL_TRIANGLE_FAN:       prim_count = total - 2;     break;
-    case GL_TRIANGLES:          prim_count = total / 3;     break;
-    default:    return;
-    }
-    printf( "total=%5u, hits=%5u, miss=%5u, hitrate=%3u%%,"
-            " prims=%5u, time=%6u us, prims/s=%d, v/t=%f\n",
-            total, hits, misses, (hits*100)/total,
-            prim_count, int(ns2us(time)), int(prim_count*float(seconds(1))/time),
-            float(misses) / prim_count);
-#endif
+    const uint32_t hits = total - misses;
+    ALOGD("vertex cache: %u draws (%u reused it), "
+            "%u vertices, %u hits (%u%%)",
+            draws, kept, total, hits, total ? (hits*100)/total : 0);
+    draws = kept = total = misses = 0;
 }
 
 // ----------------------------------------------------------------------------
@@ -452,9 +449,7 @@ void enableDisableClientState(ogles_context_t* c, GLenum array, bool enable)
 static __attribute__((noinline))
 vertex_t* cache_vertex(ogles_context_t* c, vertex_t* v, uint32_t index)
 {
-    #if VC_CACHE_STATISTICS
-        c->vc.misses++;
-    #endif
+    c->vc.misses++;
     if (ggl_unlikely(v->locked)) {
         // we're just looking for an entry in the cache that is not locked.
         // and we know that there cannot be more than 2 locked entries
@@ -511,6 +506,24 @@ vertex_t* fetch_vertex(ogles_context_t* c, size_t index)
     v[0].mru = lru;
     return cache_vertex(c, &v[lru], index);
 
+#elif VC_CACHE_TYPE == VC_CACHE_TYPE_SET_ASSOC
+
+    const int ways = vertex_cache_t::VERTEX_CACHE_WAYS;
+    vertex_t* const set = c->vc.vCache + ways *
+            (index & (vertex_cache_t::VERTEX_CACHE_SIZE/ways - 1));
+
+    for (int i=0 ; i<ways ; i++) {
+        if (ggl_likely(set[i].index == index)) {
+            set[i].locked = 1;
+            return &set[i];
+        }
+    }
+
+    // the ways of a set are replaced in turn, set[0].mru is the next one
+    const int next = set[0].mru & (ways - 1);
+    set[0].mru = (next + 1) & (ways - 1);
+    return cache_vertex(c, &set[next], index);
+
 #elif VC_CACHE_TYPE == VC_CACHE_TYPE_NONE
 
     // just for debugging...
@@ -520,6 +533,55 @@ vertex_t* fetch_vertex(ogles_context_t* c, size_t index)
 #endif
 }
 
+/*
+ * Called by glDrawElements() once the arrays are validated: keeps the
+ * cached vertices if they were computed from the same state by the
+ * previous call, otherwise starts a new sequence.  Vertices fetched from
+ * client memory are never kept, as it can change behind our back.
+ */
+static void validate_vertex_cache(ogles_context_t* c)
+{
+    vertex_cache_t::state_t s;
+    memset(&s, 0, sizeof(s));
+
+    const array_machine_t& am = c->arrays;
+    s.arrays[0] = am.vertex;
+    s.arrays[1] = am.normal;
+    s.arrays[2] = am.color;
+    for (int i=0 ; i<GGL_TEXTURE_UNIT_COUNT ; i++) {
+        s.arrays[3+i] = am.texture[i];
+        s.texture[i] = c->current.texture[i];
+        if (c->rasterizer.state.texture[i].enable)
+            s.textures |= 1<<i;
+    }
+    s.color = c->current.color;
+    s.colorClamped = c->currentColorClamped;
+    s.normal = c->currentNormal;
+    s.transformSerial = c->transforms.serial;
+    s.lightingSerial = c->lighting.serial;
+    s.enables = c->rasterizer.state.enables & (GGL_ENABLE_DEPTH_TEST |
+            GGL_ENABLE_FOG | GGL_ENABLE_SMOOTH | GGL_ENABLE_TMUS);
+    s.clipPlanes = c->clipPlanes.enable;
+    s.lights = c->lighting.enabledLights;
+    s.shadeModel = c->lighting.shadeModel;
+    s.rescaleNormals = c->transforms.rescaleNormals;
+    s.lighting = c->lighting.enable;
+    s.colorMaterial = c->lighting.colorMaterial.enable;
+
+    s.valid = GL_TRUE;
+    for (int i=0 ; i<3+GGL_TEXTURE_UNIT_COUNT ; i++) {
+        if (s.arrays[i].enable && !s.arrays[i].bo)
+            s.valid = GL_FALSE;
+    }
+
+    if (c->vc.state.valid && !memcmp(&s, &c->vc.state, sizeof(s))) {
+        c->vc.kept++;
+        return;
+    }
+    c->vc.clear();
+    c->vc.state = s;
+}
+
 // ----------------------------------------------------------------------------
 #if 0
 #pragma mark -
@@ -532,9 +594,7 @@ void drawPrimitivesPoints(ogles_context_t* c, GLint first, GLsizei count)
         return;
 
     // vertex cache size must be multiple of 1
-    const GLsizei vcs =
-            (vertex_cache_t::VERTEX_BUFFER_SIZE +
-             vertex_cache_t::VERTEX_CACHE_SIZE);
+    const GLsizei vcs = vertex_cache_t::ARRAY_CHUNK_SIZE;
     do {
         vertex_t* v = c->vc.vBuffer;
         GLsizei num = count > vcs ? vcs : count;
@@ -569,9 +629,7 @@ void drawPrimitivesLineStrip(ogles_context_t* c, GLint first, GLsizei count)
     count -= 1;
 
     // vertex cache size must be multiple of 1
-    const GLsizei vcs =
-        (vertex_cache_t::VERTEX_BUFFER_SIZE +
-         vertex_cache_t::VERTEX_CACHE_SIZE - 1);
+    const GLsizei vcs = vertex_cache_t::ARRAY_CHUNK_SIZE - 1;
     do {
         v0 = c->vc.vBuffer + 0;
         v  = c->vc.vBuffer + 1;
@@ -618,8 +676,7 @@ void drawPrimitivesLines(ogles_context_t* c, GLint first, GLsizei count)
 
     // vertex cache size must be multiple of 2
     const GLsizei vcs =
-        ((vertex_cache_t::VERTEX_BUFFER_SIZE +
-        vertex_cache_t::VERTEX_CACHE_SIZE) / 2) * 2;
+        (vertex_cache_t::ARRAY_CHUNK_SIZE / 2) * 2;
     do {
         vertex_t* v = c->vc.vBuffer;
         GLsizei num = count > vcs ? vcs : count;
@@ -663,8 +720,7 @@ static void drawPrimitivesTriangleFanOrStrip(ogles_context_t* c,
     // batch is culled. We also need 2 extra vertices in the array, because
     // we always keep the two first ones.
     const GLsizei vcs =
-        ((vertex_cache_t::VERTEX_BUFFER_SIZE +
-          vertex_cache_t::VERTEX_CACHE_SIZE - 2) / 2) * 2;
+        ((vertex_cache_t::ARRAY_CHUNK_SIZE - 2) / 2) * 2;
     do {
         v0 = c->vc.vBuffer + 0;
         v1 = c->vc.vBuffer + 1;
@@ -714,8 +770,7 @@ void drawPrimitivesTriangles(ogles_context_t* c, GLint first, GLsizei count)
 
     // vertex cache size must be multiple of 3
     const GLsizei vcs =
-        ((vertex_cache_t::VERTEX_BUFFER_SIZE +
-        vertex_cache_t::VERTEX_CACHE_SIZE) / 3) * 3;
+        (vertex_cache_t::ARRAY_CHUNK_SIZE / 3) * 3;
     do {
         vertex_t* v = c->vc.vBuffer;
         GLsizei num = count > vcs ? vcs : count;
@@ -944,6 +999,25 @@ void drawIndexedPrimitivesTriangles(ogles_context_t* c,
 #pragma mark Array compilers
 #endif
 
+// the kernel transform_t::picker() chose for the mvp
+static inline int transformPath(const transform_t& t)
+{
+    if (t.flags & transform_t::FLAGS_TRANSLATE)
+        return transform_state_t::PATH_TRANSLATE;
+    if (t.flags & transform_t::FLAGS_AFFINE_2D)
+        return transform_state_t::PATH_AFFINE_2D;
+    return transform_state_t::PATH_GENERIC;
+}
+
+// the mvp_transform picked for 4-component vertices is always generic
+static void countTransformed(ogles_context_t* c, GLsizei count)
+{
+    const transform_t& mvp = c->transforms.mvp;
+    const int path = (c->arrays.vertex.size == 4) ?
+            int(transform_state_t::PATH_GENERIC) : transformPath(mvp);
+    c->transforms.vertices[0][path] += count;
+}
+
 void compileElement__generic(ogles_context_t* c,
         vertex_t* v, GLint first)
 {
@@ -956,6 +1030,8 @@ void compileElement__generic(ogles_context_t* c,
     c->arrays.vertex.fetch(c, v->obj.v, vp);
     c->arrays.mvp_transform(&c->transforms.mvp, &v->clip, &v->obj);
     c->arrays.perspective(c, v);
+    if (ggl_unlikely(c->transforms.stats))
+        countTransformed(c, 1);
 }
 
 void compileElements__generic(ogles_context_t* c,
@@ -965,6 +1041,8 @@ void compileElements__generic(ogles_context_t* c,
             first & vertex_cache_t::INDEX_MASK);
     const size_t stride = c->arrays.vertex.stride;
     transform_t const* const mvp = &c->transforms.mvp;
+    if (ggl_unlikely(c->transforms.stats))
+        countTransformed(c, count);
     do {
         v->flags = 0;
         v->index = first++;
@@ -978,6 +1056,347 @@ void compileElements__generic(ogles_context_t* c,
     } while (--count);
 }
 
+// ----------------------------------------------------------------------------
+#if 0
+#pragma mark -
+#pragma mark Batched array compilers
+#endif
+
+/*
+ * The batched compilers fetch and transform BATCH_SIZE vertices at a time,
+ * one component of all of them per SIMD register, instead of going through
+ * a fetcher and a transform per vertex.  They give bit-exact results with
+ * the generic compiler: the float to fixed-point conversion is the one
+ * gglFloatToFixed() does on the same CPU, and the transform keeps the
+ * 64-bit intermediates of mla3a().
+ *
+ * When a single texture unit is enabled, with a texture coordinate array
+ * and an identity texture matrix, the coordinates are fetched along with
+ * the positions instead of lazily, per triangle.
+ */
+
+static const int BATCH_SIZE = 4;
+
+typedef GLfixed batch_t[BATCH_SIZE];
+typedef void (*batch_fetcher_t)(batch_t*, const GLubyte*, size_t, int);
+
+// Each toFixed() converts the component j of the BATCH_SIZE elements e[]
+
+static inline void toFixed(batch_t& d, const GLfixed* const* e, int j) {
+    for (int i=0 ; i<BATCH_SIZE ; i++)
+        d[i] = e[i][j];
+}
+
+static inline void toFixed(batch_t& d, const GLshort* const* e, int j) {
+    for (int i=0 ; i<BATCH_SIZE ; i++)
+        d[i] = gglIntToFixed(e[i][j]);
+}
+
+static inline void toFixed(batch_t& d, const GLbyte* const* e, int j) {
+    for (int i=0 ; i<BATCH_SIZE ; i++)
+        d[i] = gglIntToFixed(e[i][j]);
+}
+
+static inline void toFixed(batch_t& d, const GLfloat* const* e, int j)
+{
+#if defined(__SSE2__)
+    // the C version of gglFloatToFixed(): floorf(v * 65536.0f + 0.5f)
+    const __m128 s = _mm_set_ps(e[3][j], e[2][j], e[1][j], e[0][j]);
+    const __m128 v = _mm_add_ps(_mm_mul_ps(s, _mm_set1_ps(65536.0f)),
+            _mm_set1_ps(0.5f));
+    __m128i r = _mm_cvttps_epi32(v);
+    // truncation rounds negative values up, take one back unless the
+    // value was out of range and converted to 0x80000000
+    const __m128i up = _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(r), v));
+    const __m128i overflow = _mm_cmpeq_epi32(r, _mm_set1_epi32(0x80000000));
+    r = _mm_add_epi32(r, _mm_andnot_si128(overflow, up));
+    _mm_storeu_si128((__m128i*)d, r);
+#elif defined(__ARM_NEON__)
+    // same as gglFloatToFixed() in fixed_asm.S: round-to-nearest, with
+    // saturation of the values out of the s15.16 range
+    uint32x4_t bits = vdupq_n_u32(0);
+    bits = vld1q_lane_u32((const uint32_t*)(e[0] + j), bits, 0);
+    bits = vld1q_lane_u32((const uint32_t*)(e[1] + j), bits, 1);
+    bits = vld1q_lane_u32((const uint32_t*)(e[2] + j), bits, 2);
+    bits = vld1q_lane_u32((const uint32_t*)(e[3] + j), bits, 3);
+    const int32x4_t exponent = vreinterpretq_s32_u32(
+            vshrq_n_u32(vshlq_n_u32(bits, 1), 24));
+    const int32x4_t shift = vsubq_s32(vdupq_n_s32(0x8E), exponent);
+    const uint32x4_t m = vorrq_u32(vshlq_n_u32(bits, 8),
+            vdupq_n_u32(0x80000000));
+    // shift by one bit less, the extra bit is the rounding carry
+    uint32x4_t r = vshlq_u32(m, vsubq_s32(vdupq_n_s32(1), shift));
+    r = vshrq_n_u32(vaddq_u32(r, vdupq_n_u32(1)), 1);
+    const uint32x4_t sign = vreinterpretq_u32_s32(
+            vshrq_n_s32(vreinterpretq_s32_u32(bits), 31));
+    r = vsubq_u32(veorq_u32(r, sign), sign);
+    const uint32x4_t saturated = veorq_u32(vdupq_n_u32(0x7FFFFFFF), sign);
+    r = vbslq_u32(vcleq_s32(shift, vdupq_n_s32(0)), saturated, r);
+    vst1q_s32(d, vreinterpretq_s32_u32(r));
+#else
+    for (int i=0 ; i<BATCH_SIZE ; i++)
+        d[i] = gglFloatToFixed(e[i][j]);
+#endif
+}
+
+// stands in for the missing elements of a partial batch
+static const GLfixed gZeroElement[4] = { 0, 0, 0, 0 };
+
+template <typename T, int SIZE>
+static void fetchBatch(batch_t* d, const GLubyte* p, size_t stride, int n)
+{
+    const T* e[BATCH_SIZE];
+    for (int i=0 ; i<BATCH_SIZE ; i++) {
+        e[i] = reinterpret_cast<const T*>(i<n ? p : (const GLubyte*)gZeroElement);
+        p += stride;
+    }
+    for (int j=0 ; j<SIZE ; j++)
+        toFixed(d[j], e, j);
+}
+
+static batch_fetcher_t batchFetcher(const array_t& a)
+{
+    if (a.size == 2) {
+        switch (a.type) {
+        case GL_BYTE:   return fetchBatch<GLbyte, 2>;
+        case GL_SHORT:  return fetchBatch<GLshort, 2>;
+        case GL_FIXED:  return fetchBatch<GLfixed, 2>;
+        case GL_FLOAT:  return fetchBatch<GLfloat, 2>;
+        }
+    } else if (a.size == 3) {
+        switch (a.type) {
+        case GL_BYTE:   return fetchBatch<GLbyte, 3>;
+        case GL_SHORT:  return fetchBatch<GLshort, 3>;
+        case GL_FIXED:  return fetchBatch<GLfixed, 3>;
+        case GL_FLOAT:  return fetchBatch<GLfloat, 3>;
+        }
+    }
+    return 0;
+}
+
+#if defined(__SSE2__)
+// signed 32x32 -> 64 bits product of the even lanes; SSE2 only has the
+// unsigned one, the sign is fixed up in the high words
+static inline __m128i mul_epi32(__m128i a, __m128i b)
+{
+    const __m128i p = _mm_mul_epu32(a, b);
+    const __m128i fixup = _mm_add_epi32(
+            _mm_and_si128(_mm_srai_epi32(a, 31), b),
+            _mm_and_si128(_mm_srai_epi32(b, 31), a));
+    return _mm_sub_epi64(p, _mm_slli_epi64(fixup, 32));
+}
+#endif
+
+typedef void (*batch_transform_t)(const GLfixed*, batch_t*, const batch_t*);
+
+#if defined(__SSE2__)
+// (products >> 16) + c, from the 64-bit products of the even and the odd
+// lanes
+static inline __m128i shiftAdd(__m128i even, __m128i odd, GLfixed c)
+{
+    // only the low 32 bits of the shifted sums are kept, so a
+    // logical shift does as well as an arithmetic one
+    even = _mm_shuffle_epi32(_mm_srli_epi64(even, 16), 0x08);
+    odd  = _mm_shuffle_epi32(_mm_srli_epi64(odd,  16), 0x08);
+    return _mm_add_epi32(_mm_unpacklo_epi32(even, odd), _mm_set1_epi32(c));
+}
+#elif defined(__ARM_NEON__)
+// (products >> 16) + c, from the 64-bit products of the low and the high
+// lanes
+static inline int32x4_t shiftAdd(int64x2_t lo, int64x2_t hi, GLfixed c)
+{
+    return vaddq_s32(vcombine_s32(vshrn_n_s64(lo, 16), vshrn_n_s64(hi, 16)),
+            vdupq_n_s32(c));
+}
+#endif
+
+// clip[i] = mvp * obj for the 4 coordinates i, with obj.w = 1
+static void transformBatch__generic(const GLfixed* m,
+        batch_t* clip, const batch_t* obj)
+{
+#if defined(__SSE2__)
+    const __m128i x = _mm_loadu_si128((const __m128i*)obj[0]);
+    const __m128i y = _mm_loadu_si128((const __m128i*)obj[1]);
+    const __m128i z = _mm_loadu_si128((const __m128i*)obj[2]);
+    const __m128i xo = _mm_srli_epi64(x, 32);
+    const __m128i yo = _mm_srli_epi64(y, 32);
+    const __m128i zo = _mm_srli_epi64(z, 32);
+    for (int i=0 ; i<4 ; i++) {
+        const __m128i a = _mm_set1_epi32(m[i]);
+        const __m128i b = _mm_set1_epi32(m[4+i]);
+        const __m128i c = _mm_set1_epi32(m[8+i]);
+        const __m128i even = _mm_add_epi64(_mm_add_epi64(
+                mul_epi32(x, a), mul_epi32(y, b)), mul_epi32(z, c));
+        const __m128i odd = _mm_add_epi64(_mm_add_epi64(
+                mul_epi32(xo, a), mul_epi32(yo, b)), mul_epi32(zo, c));
+        _mm_storeu_si128((__m128i*)clip[i], shiftAdd(even, odd, m[12+i]));
+    }
+#elif defined(__ARM_NEON__)
+    const int32x4_t x = vld1q_s32(obj[0]);
+    const int32x4_t y = vld1q_s32(obj[1]);
+    const int32x4_t z = vld1q_s32(obj[2]);
+    for (int i=0 ; i<4 ; i++) {
+        const int32x2_t a = vdup_n_s32(m[i]);
+        const int32x2_t b = vdup_n_s32(m[4+i]);
+        const int32x2_t c = vdup_n_s32(m[8+i]);
+        int64x2_t lo = vmull_s32(vget_low_s32(x), a);
+        int64x2_t hi = vmull_s32(vget_high_s32(x), a);
+        lo = vmlal_s32(lo, vget_low_s32(y), b);
+        hi = vmlal_s32(hi, vget_high_s32(y), b);
+        lo = vmlal_s32(lo, vget_low_s32(z), c);
+        hi = vmlal_s32(hi, vget_high_s32(z), c);
+        vst1q_s32(clip[i], shiftAdd(lo, hi, m[12+i]));
+    }
+#else
+    for (int i=0 ; i<4 ; i++) {
+        for (int j=0 ; j<BATCH_SIZE ; j++) {
+            clip[i][j] = mla3a(obj[0][j], m[i], obj[1][j], m[4+i],
+                    obj[2][j], m[8+i], m[12+i]);
+        }
+    }
+#endif
+}
+
+// same, for a transform_t::FLAGS_AFFINE_2D mvp
+static void transformBatch__affine2d(const GLfixed* m,
+        batch_t* clip, const batch_t* obj)
+{
+#if defined(__SSE2__)
+    const __m128i x = _mm_loadu_si128((const __m128i*)obj[0]);
+    const __m128i y = _mm_loadu_si128((const __m128i*)obj[1]);
+    const __m128i z = _mm_loadu_si128((const __m128i*)obj[2]);
+    const __m128i xo = _mm_srli_epi64(x, 32);
+    const __m128i yo = _mm_srli_epi64(y, 32);
+    const __m128i zo = _mm_srli_epi64(z, 32);
+    for (int i=0 ; i<2 ; i++) {
+        const __m128i a = _mm_set1_epi32(m[i]);
+        const __m128i b = _mm_set1_epi32(m[4+i]);
+        const __m128i even = _mm_add_epi64(mul_epi32(x, a), mul_epi32(y, b));
+        const __m128i odd = _mm_add_epi64(mul_epi32(xo, a), mul_epi32(yo, b));
+        _mm_storeu_si128((__m128i*)clip[i], shiftAdd(even, odd, m[12+i]));
+    }
+    const __m128i c = _mm_set1_epi32(m[10]);
+    _mm_storeu_si128((__m128i*)clip[2],
+            shiftAdd(mul_epi32(z, c), mul_epi32(zo, c), m[14]));
+    _mm_storeu_si128((__m128i*)clip[3], _mm_set1_epi32(0x10000));
+#elif defined(__ARM_NEON__)
+    const int32x4_t x = vld1q_s32(obj[0]);
+    const int32x4_t y = vld1q_s32(obj[1]);
+    const int32x4_t z = vld1q_s32(obj[2]);
+    for (int i=0 ; i<2 ; i++) {
+        const int32x2_t a = vdup_n_s32(m[i]);
+        const int32x2_t b = vdup_n_s32(m[4+i]);
+        int64x2_t lo = vmull_s32(vget_low_s32(x), a);
+        int64x2_t hi = vmull_s32(vget_high_s32(x), a);
+        lo = vmlal_s32(lo, vget_low_s32(y), b);
+        hi = vmlal_s32(hi, vget_high_s32(y), b);
+        vst1q_s32(clip[i], shiftAdd(lo, hi, m[12+i]));
+    }
+    const int32x2_t c = vdup_n_s32(m[10]);
+    vst1q_s32(clip[2], shiftAdd(vmull_s32(vget_low_s32(z), c),
+            vmull_s32(vget_high_s32(z), c), m[14]));
+    vst1q_s32(clip[3], vdupq_n_s32(0x10000));
+#else
+    for (int j=0 ; j<BATCH_SIZE ; j++) {
+        clip[0][j] = mla2a(obj[0][j], m[0], obj[1][j], m[4], m[12]);
+        clip[1][j] = mla2a(obj[0][j], m[1], obj[1][j], m[5], m[13]);
+        clip[2][j] = GLfixed((int64_t(obj[2][j])*m[10])>>16) + m[14];
+        clip[3][j] = 0x10000;
+    }
+#endif
+}
+
+// same, for a transform_t::FLAGS_TRANSLATE mvp
+static void transformBatch__translate(const GLfixed* m,
+        batch_t* clip, const batch_t* obj)
+{
+#if defined(__SSE2__)
+    for (int i=0 ; i<3 ; i++) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)obj[i]);
+        _mm_storeu_si128((__m128i*)clip[i],
+                _mm_add_epi32(v, _mm_set1_epi32(m[12+i])));
+    }
+    _mm_storeu_si128((__m128i*)clip[3], _mm_set1_epi32(0x10000));
+#elif defined(__ARM_NEON__)
+    for (int i=0 ; i<3 ; i++) {
+        vst1q_s32(clip[i], vaddq_s32(vld1q_s32(obj[i]), vdupq_n_s32(m[12+i])));
+    }
+    vst1q_s32(clip[3], vdupq_n_s32(0x10000));
+#else
+    for (int i=0 ; i<3 ; i++) {
+        for (int j=0 ; j<BATCH_SIZE ; j++)
+            clip[i][j] = obj[i][j] + m[12+i];
+    }
+    for (int j=0 ; j<BATCH_SIZE ; j++)
+        clip[3][j] = 0x10000;
+#endif
+}
+
+static const batch_transform_t gBatchTransforms[transform_state_t::PATH_COUNT] = {
+    transformBatch__generic,
+    transformBatch__affine2d,
+    transformBatch__translate
+};
+
+template <bool TEXCOORDS>
+void compileElements__batched(ogles_context_t* c,
+        vertex_t* v, GLint first, GLsizei count)
+{
+    const array_t& va = c->arrays.vertex;
+    const batch_fetcher_t fetchPositions = batchFetcher(va);
+    const GLubyte* vp = va.element(first & vertex_cache_t::INDEX_MASK);
+    const size_t stride = va.stride;
+    const GLfixed* const m = c->transforms.mvp.matrix.m;
+    const int path = transformPath(c->transforms.mvp);
+    const batch_transform_t transformBatch = gBatchTransforms[path];
+    if (ggl_unlikely(c->transforms.stats))
+        c->transforms.vertices[1][path] += count;
+
+    const int tmu = c->arrays.tmu;
+    const array_t& ta = c->arrays.texture[tmu];
+    const batch_fetcher_t fetchTexCoords = TEXCOORDS ? batchFetcher(ta) : 0;
+    const GLubyte* tp = TEXCOORDS ?
+            ta.element(first & vertex_cache_t::INDEX_MASK) : 0;
+    const size_t tstride = ta.stride;
+
+    batch_t obj[3];
+    batch_t clip[4];
+    batch_t tex[2];
+    memset(obj[2], 0, sizeof(batch_t));
+    do {
+        const int n = count < BATCH_SIZE ? count : BATCH_SIZE;
+        fetchPositions(obj, vp, stride, n);
+        vp += n * stride;
+        transformBatch(m, clip, obj);
+        if (TEXCOORDS) {
+            fetchTexCoords(tex, tp, tstride, n);
+            tp += n * tstride;
+        }
+        for (int i=0 ; i<n ; i++) {
+            v->flags = 0;
+            v->index = first++;
+            v->obj.x = obj[0][i];
+            v->obj.y = obj[1][i];
+            v->obj.z = obj[2][i];
+            v->obj.w = 0x10000;
+            v->clip.x = clip[0][i];
+            v->clip.y = clip[1][i];
+            v->clip.z = clip[2][i];
+            v->clip.w = clip[3][i];
+            if (TEXCOORDS) {
+                vec4_t& coords = v->texture[tmu];
+                coords.S = tex[0][i];
+                coords.T = tex[1][i];
+                coords.Q = 0x10000;
+                v->flags = vertex_t::TT;
+            }
+            c->arrays.perspective(c, v);
+            v++;
+        }
+        count -= n;
+    } while (count > 0);
+}
+
 /*
 void compileElements__3x_full(ogles_context_t* c,
         vertex_t* v, GLint first, GLsizei count)
@@ -1201,6 +1620,17 @@ void validate_arrays(ogles_context_t* c, GLenum mode)
         }
     }
 
+    // the batched vertex compilers handle the common array formats
+    if (am.vertex.fetch != fetchNop && batchFetcher(am.vertex)) {
+        c->arrays.compileElements = compileElements__batched<false>;
+        const array_t& ta = am.texture[am.tmu];
+        if (activeTmuCount == 1 && ta.fetch != currentTexCoord &&
+                ta.size == 2 && batchFetcher(ta) &&
+                !c->transforms.texture[am.tmu].transform.ops) {
+            c->arrays.compileElements = compileElements__batched<true>;
+        }
+    }
+
     // pick the vertex-clipper
     uint32_t clipper = 0;
     // we must reload 'enables' here
@@ -1371,15 +1801,20 @@ void glDrawArrays(GLenum mode, GLint first, GLsizei count)
     if (enables & GGL_ENABLE_TMUS)
         ogles_lock_textures(c);
 
+    // the vertices compiled here go through the cache's storage, tagged
+    // with their plain index, which must not alias a sequence tag
+    if (ggl_unlikely(uint32_t(first) + count > vertex_cache_t::INDEX_SEQ))
+        c->vc.invalidate();
+
     drawArraysPrims[mode](c, first, count);
 
     if (enables & GGL_ENABLE_TMUS)
         ogles_unlock_textures(c);
 
-#if VC_CACHE_STATISTICS
-    c->vc.total = count;
-    c->vc.dump_stats(mode);
-#endif
+    if (ggl_unlikely(c->transforms.stats)) {
+        if (++c->transforms.draws == VC_STATS_PERIOD)
+            c->transforms.dump_stats();
+    }
 }
 
 void glDrawElements(
@@ -1417,9 +1852,8 @@ void glDrawElements(
     if ((c->cull.enable) && (c->cull.cullFace == GL_FRONT_AND_BACK))
         return; // all triangles are culled
 
-    // clear the vertex-cache
-    c->vc.clear();
     validate_arrays(c, mode);
+    validate_vertex_cache(c);
 
     // if indices are in a buffer object, the pointer is treated as an
     // offset in that buffer.
@@ -1436,11 +1870,15 @@ void glDrawElements(
     if (enables & GGL_ENABLE_TMUS)
         ogles_unlock_textures(c);
 
-    
-#if VC_CACHE_STATISTICS
-    c->vc.total = count;
-    c->vc.dump_stats(mode);
-#endif
+    if (ggl_unlikely(c->vc.stats)) {
+        c->vc.total += count;
+        if (++c->vc.draws == VC_STATS_PERIOD)
+            c->vc.dump_stats();
+    }
+    if (ggl_unlikely(c->transforms.stats)) {
+        if (++c->transforms.draws == VC_STATS_PERIOD)
+            c->transforms.dump_stats();
+    }
 }
 
 // ----------------------------------------------------------------------------
@@ -1499,6 +1937,7 @@ void glBufferData(GLenum target, GLsizeiptr size, const GLvoid* data, GLenum usa
     if (data) {
         memcpy(bo->data, data, size);
     }
+    c->vc.invalidate();
 }
 
 void glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const GLvoid* data)
@@ -1525,6 +1964,7 @@ void glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const GLvo
         return;
     }
     memcpy(bo->data + offset, data, size);
+    c->vc.invalidate();
 }
 
 void glDeleteBuffers(GLsizei n, const GLuint* buffers)
@@ -1575,6 +2015,7 @@ void glDeleteBuffers(GLsizei n, const GLuint* buffers)
     }
     c->bufferObjectManager->deleteBuffers(n, buffers);
     c->bufferObjectManager->recycleTokens(n, buffers);
+    c->vc.invalidate();
 }
 
 void glGenBuffers(GLsizei n, GLuint* buffers)
@@ -37,12 +37,16 @@ namespace android {
 const unsigned int OGLES_NUM_COMPRESSED_TEXTURE_FORMATS = 10
 #ifdef GL_OES_compressed_ETC1_RGB8_texture
         + 1
+#endif
+#ifdef GL_EXT_texture_compression_dxt1
+        + 4
 #endif
         ;
 
 class EGLTextureObject;
 class EGLSurfaceManager;
 class EGLBufferObjectManager;
+struct tiling_t;
 
 namespace gl {
 
@@ -226,23 +230,58 @@ struct vertex_cache_t {
         // or 2 + 2 for indexed triangles w/ cache contention
         VERTEX_BUFFER_SIZE  = 8,
         // must be a power of two and at least 3
-        VERTEX_CACHE_SIZE   = 64,   // 8 KB
+        VERTEX_CACHE_SIZE   = 256,  // 32 KB
+        // entries an index can be cached in, must be a power of two
+        VERTEX_CACHE_WAYS   = 4,
+        // vertices glDrawArrays() compiles at a time, from vBuffer on
+        ARRAY_CHUNK_SIZE    = VERTEX_BUFFER_SIZE + 64,
 
         INDEX_BITS      = 16,
         INDEX_MASK      = ((1LU<<INDEX_BITS)-1),
         INDEX_SEQ       = 1LU<<INDEX_BITS,
     };
+
+    // Everything the cached vertices were computed from. Entries are tagged
+    // with 'sequence', which only moves on when this changes, so the cache
+    // survives across glDrawElements() calls that source their vertices
+    // from the same buffer objects with the same transforms and lighting.
+    struct state_t {
+        array_t         arrays[3 + GGL_TEXTURE_UNIT_COUNT];
+        vec4_t          color;
+        vec4_t          colorClamped;
+        vec3_t          normal;
+        vec4_t          texture[GGL_TEXTURE_UNIT_COUNT];
+        uint32_t        transformSerial;
+        uint32_t        lightingSerial;
+        uint32_t        enables;
+        uint32_t        textures;
+        uint32_t        clipPlanes;
+        uint32_t        lights;
+        GLenum          shadeModel;
+        GLenum          rescaleNormals;
+        GLboolean       lighting;
+        GLboolean       colorMaterial;
+        GLboolean       valid;
+        GLboolean       reserved;
+    };
+
     vertex_t*       vBuffer;
     vertex_t*       vCache;
     uint32_t        sequence;
     void*           base;
+    state_t         state;
+
+    // statistics, gathered when debug.libagl.vcstats is set
+    uint32_t        stats;
+    uint32_t        draws;
+    uint32_t        kept;
     uint32_t        total;
     uint32_t        misses;
-    int64_t         startTime;
     void init();
     void uninit();
     void clear();
-    void dump_stats(GLenum mode);
+    void invalidate() { state.valid = GL_FALSE; }
+    void dump_stats();
 };
 
 // ----------------------------------------------------------------------------
@@ -328,6 +367,8 @@ struct lighting_t {
     uint32_t            enabledLights;
     GLboolean           enable;
     GLenum              shadeModel;
+    // changes whenever anything vertex colors depend on does
+    uint32_t            serial;
     typedef void (*light_fct_t)(ogles_context_t*, vertex_t*);
     void (*lightVertex)(ogles_context_t* c, vertex_t* v);
     void (*lightTriangle)(ogles_context_t* c,
@@ -412,7 +453,12 @@ enum {
 
 struct transform_t {
     enum {
-        FLAGS_2D_PROJECTION = 0x1
+        FLAGS_2D_PROJECTION = 0x1,
+        // w is left alone, x and y don't depend on z, z doesn't depend
+        // on x and y
+        FLAGS_AFFINE_2D     = 0x2,
+        // FLAGS_AFFINE_2D, without scaling nor rotation
+        FLAGS_TRANSLATE     = 0x4
     };
     matrixx_t       matrix;
     uint32_t        flags;
@@ -487,6 +533,13 @@ struct transform_state_t {
         MVIT                = 0x20,
         MVP                 = 0x40,
     };
+    // the kernels transforming vertices with the mvp
+    enum {
+        PATH_GENERIC        = 0,
+        PATH_AFFINE_2D      = 1,
+        PATH_TRANSLATE      = 2,
+        PATH_COUNT          = 3
+    };
     matrix_stack_t      *current;
     matrix_stack_t      modelview;
     matrix_stack_t      projection;
@@ -506,10 +559,20 @@ struct transform_state_t {
     GLenum              matrixMode;
     GLenum              rescaleNormals;
     uint32_t            dirty;
+    // changes whenever a matrix, the viewport or a clip plane does
+    uint32_t            serial;
+
+    // vertices transformed by each path, one at a time and batched,
+    // gathered when debug.libagl.xformstats is set
+    uint32_t            stats;
+    uint32_t            draws;
+    uint32_t            vertices[2][PATH_COUNT];
+
     void invalidate();
     void update_mvp();
     void update_mvit();
     void update_mvui();
+    void dump_stats();
 };
 
 struct viewport_t {
@@ -624,6 +687,7 @@ struct ogles_context_t {
     uint32_t                transformTextures : 1;
     EGLSurfaceManager*      surfaceManager;
     EGLBufferObjectManager* bufferObjectManager;
+    tiling_t*               tiling;
 
     GLenum                  error;
 
@@ -27,6 +27,13 @@
 #include <utils/Endian.h>
 
 #include "context.h"
+#include "dxt.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
 
 #define TIMING 0
 
@@ -54,47 +61,30 @@ static volatile int tables_initialized = 0;
 #define blue(x)  ( (x)        & 0x1f)
 
 /*
- * Convert 5/6/5 RGB (as 3 ints) to 8/8/8
+ * Convert 5/6/5 RGB (as 3 ints) to 8/8/8/8 RGBA as laid out in memory
+ * by GL_RGBA/GL_UNSIGNED_BYTE, with a zero alpha.
  *
- * Operation count: 8 <<, 0 &, 5 |
+ * Operation count: 6 <<, 0 &, 5 |
  */
-inline static int rgb565SepTo888(int r, int g, int b)
+inline static uint32_t rgb565SepTo8888(int r, int g, int b)
 
 {
-    return ((((r << 3) | (r >> 2)) << 16) |
-            (((g << 2) | (g >> 4)) <<  8) |
-             ((b << 3) | (b >> 2)));
+    r = (r << 3) | (r >> 2);
+    g = (g << 2) | (g >> 4);
+    b = (b << 3) | (b >> 2);
+#if __BYTE_ORDER == __BIG_ENDIAN
+    return (uint32_t)((r << 24) | (g << 16) | (b << 8));
+#else
+    return (uint32_t)((b << 16) | (g << 8) | r);
+#endif
 }
 
-/*
- * Convert 5/6/5 RGB (as a single 16-bit word) to 8/8/8
- *
- *                   r4r3r2r1 r0g5g4g3 g2g1g0b4 b3b2b1b0   rgb
- *            r4r3r2 r1r0g5g4 g3g2g1g0 b4b3b2b1 b0 0 0 0   rgb << 3
- * r4r3r2r1 r0r4r3r2 g5g4g3g2 g1g0g5g4 b4b3b2b1 b0b4b3b2   desired result
- *
- * Construct the 24-bit RGB word as:
- *
- * r4r3r2r1 r0------ -------- -------- -------- --------  (rgb << 8) & 0xf80000
- *            r4r3r2 -------- -------- -------- --------  (rgb << 3) & 0x070000
- *                   g5g4g3g2 g1g0---- -------- --------  (rgb << 5) & 0x00fc00
- *                                g5g4 -------- --------  (rgb >> 1) & 0x000300
- *                                     b4b3b2b1 b0------  (rgb << 3) & 0x0000f8
- *                                                b4b3b2  (rgb >> 2) & 0x000007
- *
- * Operation count: 5 <<, 6 &, 5 | (n.b. rgb >> 3 is used twice)
- */
-inline static int rgb565To888(int rgb)
-
-{
-    int rgb3 = rgb >> 3;
-    return (((rgb << 8) & 0xf80000) |
-            ( rgb3      & 0x070000) |
-            ((rgb << 5) & 0x00fc00) |
-            ((rgb >> 1) & 0x000300) |
-            ( rgb3      & 0x0000f8) |
-            ((rgb >> 2) & 0x000007));
-}
+// Position of the alpha byte in a texel made by rgb565SepTo8888()
+#if __BYTE_ORDER == __BIG_ENDIAN
+#define ALPHA_SHIFT 0
+#else
+#define ALPHA_SHIFT 24
+#endif
 
 #if __BYTE_ORDER == __BIG_ENDIAN
 static uint32_t swap(uint32_t x) {
@@ -190,40 +180,297 @@ DXT1HasAlpha(const GLvoid *data, int width, int height) {
     return hasAlpha;
 }
 
+/*
+ * Color table of a DXT1 block as 5/6/5 RGB, or as 5/5/5/1 RGBA when
+ * 'hasAlpha' is set.  The whole table is always computed so that it can
+ * be reused by any following block with the same raw colors.
+ */
+static void
+colorTable16(uint16_t color0, uint16_t color1, bool hasAlpha, uint16_t c[4])
+
+{
+    int r0 =   red(color0);
+    int g0 = green(color0);
+    int b0 =  blue(color0);
+
+    int r1 =   red(color1);
+    int g1 = green(color1);
+    int b1 =  blue(color1);
+
+    int r2, g2, b2, r3, g3, b3, a3;
+    if (color0 > color1) {
+        r2 = avg23(r0, r1);
+        g2 = avg23(g0, g1);
+        b2 = avg23(b0, b1);
+
+        r3 = avg23(r1, r0);
+        g3 = avg23(g1, g0);
+        b3 = avg23(b1, b0);
+        a3 = 1;
+    } else {
+        r2 = (r0 + r1) >> 1;
+        g2 = (g0 + g1) >> 1;
+        b2 = (b0 + b1) >> 1;
+
+        r3 = g3 = b3 = a3 = 0;
+    }
+
+    if (hasAlpha) {
+        c[0] = (r0 << 11) | ((g0 >> 1) << 6) | (b0 << 1) | 0x1;
+        c[1] = (r1 << 11) | ((g1 >> 1) << 6) | (b1 << 1) | 0x1;
+        c[2] = (r2 << 11) | ((g2 >> 1) << 6) | (b2 << 1) | 0x1;
+        c[3] = (r3 << 11) | ((g3 >> 1) << 6) | (b3 << 1) | a3;
+    } else {
+        c[0] = color0;
+        c[1] = color1;
+        c[2] = (r2 << 11) | (g2 << 5) | b2;
+        c[3] = (r3 << 11) | (g3 << 5) | b3;
+    }
+}
+
+/*
+ * Color table of a DXT3 or DXT5 block as 8/8/8/8 RGBA with a zero alpha.
+ * These formats always use the four color mode.
+ */
+static void
+colorTable32(uint16_t color0, uint16_t color1, uint32_t c[4])
+
+{
+    int r0 =   red(color0);
+    int g0 = green(color0);
+    int b0 =  blue(color0);
+
+    int r1 =   red(color1);
+    int g1 = green(color1);
+    int b1 =  blue(color1);
+
+    c[0] = rgb565SepTo8888(r0, g0, b0);
+    c[1] = rgb565SepTo8888(r1, g1, b1);
+    c[2] = rgb565SepTo8888(avg23(r0, r1), avg23(g0, g1), avg23(b0, b1));
+    c[3] = rgb565SepTo8888(avg23(r1, r0), avg23(g1, g0), avg23(b1, b0));
+}
+
+/*
+ * Alpha table of a DXT5 block
+ */
+static void
+alphaTable(int alpha0, int alpha1, uint8_t a[8])
+
+{
+    a[0] = alpha0;
+    a[1] = alpha1;
+    int a01 = alpha0 + alpha1 - 1;
+    if (alpha0 > alpha1) {
+        a[2] = div7(6*alpha0 +   alpha1);
+        a[4] = div7(4*alpha0 + 3*alpha1);
+        a[6] = div7(2*alpha0 + 5*alpha1);
+
+        // Use symmetry to derive half of the values
+        // A few values will be off by 1 (~.5%)
+        // Alternate which values are computed directly
+        // and which are derived to try to reduce bias
+        a[3] = a01 - a[6];
+        a[5] = a01 - a[4];
+        a[7] = a01 - a[2];
+    } else {
+        a[2] = div5(4*alpha0 +   alpha1);
+        a[4] = div5(2*alpha0 + 3*alpha1);
+        a[3] = a01 - a[4];
+        a[5] = a01 - a[2];
+        a[6] = 0x00;
+        a[7] = 0xff;
+    }
+}
+
+/*
+ * Expand the 2-bit codes of a block into its 16 texels, looking them up
+ * in the color table 'c'.  Texel (x, y) goes to out[x + y*stride].
+ *
+ * The SIMD versions select between the colors with masks built from the
+ * code bits (SSE2) or look the colors up with a byte shuffle (NEON), so
+ * a whole row or two is written at once, without any branch.
+ */
+static inline void
+expandBlock16(const uint16_t c[4], uint32_t bits, uint16_t* out, int stride)
+
+{
+#if defined(__SSE2__)
+    const __m128i lowBits  = _mm_setr_epi16(
+            1<<0, 1<<2, 1<<4, 1<<6, 1<<8, 1<<10, 1<<12, 1<<14);
+    const __m128i highBits = _mm_setr_epi16(
+            2<<0, 2<<2, 2<<4, 2<<6, 2<<8, 2<<10, 2<<12, (short)(2<<14));
+    const __m128i c0 = _mm_set1_epi16(c[0]);
+    const __m128i c2 = _mm_set1_epi16(c[2]);
+    const __m128i d01 = _mm_xor_si128(c0, _mm_set1_epi16(c[1]));
+    const __m128i d23 = _mm_xor_si128(c2, _mm_set1_epi16(c[3]));
+    for (int y = 0; y < 4; y += 2, bits >>= 16, out += 2*stride) {
+        // 8 texels, two rows
+        const __m128i b = _mm_set1_epi16((short)bits);
+        const __m128i m0 = _mm_cmpeq_epi16(_mm_and_si128(b, lowBits), lowBits);
+        const __m128i m1 = _mm_cmpeq_epi16(_mm_and_si128(b, highBits), highBits);
+        const __m128i lo = _mm_xor_si128(c0, _mm_and_si128(m0, d01));
+        const __m128i hi = _mm_xor_si128(c2, _mm_and_si128(m0, d23));
+        const __m128i px = _mm_xor_si128(lo,
+                _mm_and_si128(m1, _mm_xor_si128(lo, hi)));
+        _mm_storel_epi64((__m128i*)out, px);
+        _mm_storel_epi64((__m128i*)(out + stride), _mm_srli_si128(px, 8));
+    }
+#elif defined(__ARM_NEON__)
+    static const int16_t shifts[4] = { 0, -2, -4, -6 };
+    const int16x4_t shift = vld1_s16(shifts);
+    const uint16x4_t three = vdup_n_u16(3);
+    const uint16x4_t base = vdup_n_u16(0x0100);
+    const uint8x8_t palette = vreinterpret_u8_u16(vld1_u16(c));
+    for (int y = 0; y < 4; y++, bits >>= 8, out += stride) {
+        // byte indices of each texel's color in the palette
+        const uint16x4_t codes = vand_u16(
+                vshl_u16(vdup_n_u16((uint16_t)bits), shift), three);
+        const uint16x4_t index = vmla_n_u16(base, codes, 0x0202);
+        vst1_u16(out, vreinterpret_u16_u8(
+                vtbl1_u8(palette, vreinterpret_u8_u16(index))));
+    }
+#else
+    for (int y = 0; y < 4; y++, out += stride) {
+        for (int x = 0; x < 4; x++) {
+            out[x] = c[bits & 0x3];
+            bits >>= 2;
+        }
+    }
+#endif
+}
+
+/*
+ * Same as expandBlock16() for 32-bit texels, also merging in the alpha
+ * of each texel from 'alpha' (16 values in texel order).
+ */
+static inline void
+expandBlock32(const uint32_t c[4], uint32_t bits, const uint8_t* alpha,
+              uint32_t* out, int stride)
+
+{
+#if defined(__SSE2__)
+    const __m128i lowBits  = _mm_setr_epi32(1<<0, 1<<2, 1<<4, 1<<6);
+    const __m128i highBits = _mm_setr_epi32(2<<0, 2<<2, 2<<4, 2<<6);
+    const __m128i c0 = _mm_set1_epi32(c[0]);
+    const __m128i c2 = _mm_set1_epi32(c[2]);
+    const __m128i d01 = _mm_xor_si128(c0, _mm_set1_epi32(c[1]));
+    const __m128i d23 = _mm_xor_si128(c2, _mm_set1_epi32(c[3]));
+
+    // alpha << 24, one vector per row
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i a8 = _mm_loadu_si128((const __m128i*)alpha);
+    const __m128i a01 = _mm_unpacklo_epi8(zero, a8);
+    const __m128i a23 = _mm_unpackhi_epi8(zero, a8);
+    __m128i a[4];
+    a[0] = _mm_unpacklo_epi16(zero, a01);
+    a[1] = _mm_unpackhi_epi16(zero, a01);
+    a[2] = _mm_unpacklo_epi16(zero, a23);
+    a[3] = _mm_unpackhi_epi16(zero, a23);
+
+    for (int y = 0; y < 4; y++, bits >>= 8, out += stride) {
+        const __m128i b = _mm_set1_epi32(bits);
+        const __m128i m0 = _mm_cmpeq_epi32(_mm_and_si128(b, lowBits), lowBits);
+        const __m128i m1 = _mm_cmpeq_epi32(_mm_and_si128(b, highBits), highBits);
+        const __m128i lo = _mm_xor_si128(c0, _mm_and_si128(m0, d01));
+        const __m128i hi = _mm_xor_si128(c2, _mm_and_si128(m0, d23));
+        const __m128i px = _mm_xor_si128(lo,
+                _mm_and_si128(m1, _mm_xor_si128(lo, hi)));
+        _mm_storeu_si128((__m128i*)out, _mm_or_si128(px, a[y]));
+    }
+#elif defined(__ARM_NEON__)
+    static const int32_t shifts[4] = { 0, -2, -4, -6 };
+    const int32x4_t shift = vld1q_s32(shifts);
+    const uint32x4_t three = vdupq_n_u32(3);
+    const uint32x4_t base = vdupq_n_u32(0x03020100);
+    uint8x8x2_t palette;
+    palette.val[0] = vreinterpret_u8_u32(vld1_u32(c));
+    palette.val[1] = vreinterpret_u8_u32(vld1_u32(c + 2));
+
+    // alpha << 24, one vector per row
+    const uint8x16_t a8 = vld1q_u8(alpha);
+    const uint16x8_t a01 = vmovl_u8(vget_low_u8(a8));
+    const uint16x8_t a23 = vmovl_u8(vget_high_u8(a8));
+    uint32x4_t a[4];
+    a[0] = vshlq_n_u32(vmovl_u16(vget_low_u16(a01)), 24);
+    a[1] = vshlq_n_u32(vmovl_u16(vget_high_u16(a01)), 24);
+    a[2] = vshlq_n_u32(vmovl_u16(vget_low_u16(a23)), 24);
+    a[3] = vshlq_n_u32(vmovl_u16(vget_high_u16(a23)), 24);
+
+    for (int y = 0; y < 4; y++, bits >>= 8, out += stride) {
+        // byte indices of each texel's color in the palette
+        const uint32x4_t codes = vandq_u32(
+                vshlq_u32(vdupq_n_u32(bits), shift), three);
+        const uint8x16_t index = vreinterpretq_u8_u32(
+                vmlaq_n_u32(base, codes, 0x04040404));
+        const uint8x8_t lo = vtbl2_u8(palette, vget_low_u8(index));
+        const uint8x8_t hi = vtbl2_u8(palette, vget_high_u8(index));
+        vst1q_u32(out, vorrq_u32(a[y],
+                vreinterpretq_u32_u8(vcombine_u8(lo, hi))));
+    }
+#else
+    for (int y = 0; y < 4; y++, out += stride, alpha += 4) {
+        for (int x = 0; x < 4; x++) {
+            out[x] = c[bits & 0x3] | (alpha[x] << ALPHA_SHIFT);
+            bits >>= 2;
+        }
+    }
+#endif
+}
+
+/*
+ * Copy the visible part of a block expanded into 'block' (4 texels per
+ * row) to a block at the right or bottom edge of the texture.
+ */
+template <typename T>
+static inline void
+copyEdgeBlock(const T* block, int w, int h, T* out, int stride)
+
+{
+    for (int y = 0; y < h; y++, block += 4, out += stride) {
+        for (int x = 0; x < w; x++) {
+            out[x] = block[x];
+        }
+    }
+}
+
 static void
 decodeDXT1(const GLvoid *data, int width, int height,
            void *surface, int stride,
            bool hasAlpha)
-    
+
 {
     init_tables();
-    
+
     uint32_t const *d32 = (uint32_t *)data;
-    
-    // Color table for the current block
-    uint16_t c[4];
-    c[0] = c[1] = c[2] = c[3] = 0;
-    
+
     // Specified colors from the previous block
     uint16_t prev_color0 = 0x0000;
     uint16_t prev_color1 = 0x0000;
-    
+
+    // Color table for the current block
+    uint16_t c[4];
+    colorTable16(prev_color0, prev_color1, hasAlpha, c);
+
+    // Texels of the blocks at the right and bottom edges
+    uint16_t edge[16];
+
     uint16_t* rowPtr = (uint16_t*)surface;
     for (int base_y = 0; base_y < height; base_y += 4, rowPtr += 4*stride) {
         uint16_t *blockPtr = rowPtr;
+        const int h = min(height - base_y, 4);
         for (int base_x = 0; base_x < width; base_x += 4, blockPtr += 4) {
             uint32_t colors = *d32++;
             uint32_t bits = *d32++;
-            
+
 #if __BYTE_ORDER == __BIG_ENDIAN
             colors = swap(colors);
             bits = swap(bits);
 #endif
-            
+
             // Raw colors
             uint16_t color0 = colors & 0xffff;
             uint16_t color1 = colors >> 16;
-            
+
             // If the new block has the same base colors as the
             // previous one, we don't need to recompute the color
             // table c[]
@@ -231,77 +478,20 @@ decodeDXT1(const GLvoid *data, int width, int height,
                 // Store raw colors for comparison with next block
                 prev_color0 = color0;
                 prev_color1 = color1;
-                
-                int r0 =   red(color0);
-                int g0 = green(color0);
-                int b0 =  blue(color0);
-
-                int r1 =   red(color1);
-                int g1 = green(color1);
-                int b1 =  blue(color1);                
-                
-                if (hasAlpha) {
-                    c[0] = (r0 << 11) | ((g0 >> 1) << 6) | (b0 << 1) | 0x1;
-                    c[1] = (r1 << 11) | ((g1 >> 1) << 6) | (b1 << 1) | 0x1;
-                } else {
-                    c[0] = color0;
-                    c[1] = color1;
-                }
-                
-                int r2, g2, b2, r3, g3, b3, a3;
-                
-                int bbits = bits >> 1;
-                bool has2 = ((bbits & ~bits) & 0x55555555) != 0;
-                bool has3 = ((bbits &  bits) & 0x55555555) != 0;
-                
-                if (has2 || has3) {
-                    if (color0 > color1) {
-                        r2 = avg23(r0, r1);
-                        g2 = avg23(g0, g1);
-                        b2 = avg23(b0, b1);
-                        
-                        r3 = avg23(r1, r0);
-                        g3 = avg23(g1, g0);
-                        b3 = avg23(b1, b0);
-                        a3 = 1;
-                    } else {
-                        r2 = (r0 + r1) >> 1;
-                        g2 = (g0 + g1) >> 1;
-                        b2 = (b0 + b1) >> 1;
-                        
-                        r3 = g3 = b3 = a3 = 0;
-                    }
-                    if (hasAlpha) {
-                        c[2] = (r2 << 11) | ((g2 >> 1) << 6) |
-                            (b2 << 1) | 0x1;
-                        c[3] = (r3 << 11) | ((g3 >> 1) << 6) |
-                            (b3 << 1) | a3;
-                    } else {
-                        c[2] = (r2 << 11) | (g2 << 5) | b2;
-                        c[3] = (r3 << 11) | (g3 << 5) | b3;
-                    }
-                }
+                colorTable16(color0, color1, hasAlpha, c);
             }
-            
-            uint16_t* blockRowPtr = blockPtr;
-            for (int y = 0; y < 4; y++, blockRowPtr += stride) {
-                // Don't process rows past the botom
-                if (base_y + y >= height) {
-                    break;
-                }
-                
-                int w = min(width - base_x, 4);
-                for (int x = 0; x < w; x++) {
-                    int code = bits & 0x3;
-                    bits >>= 2;
-                    
-                    blockRowPtr[x] = c[code];
-                }
+
+            const int w = min(width - base_x, 4);
+            if (ggl_likely((w & h) == 4)) {
+                expandBlock16(c, bits, blockPtr, stride);
+            } else {
+                expandBlock16(c, bits, edge, 4);
+                copyEdgeBlock(edge, w, h, blockPtr, stride);
             }
         }
     }
 }
-    
+
 // Output data as internalformat=GL_RGBA, type=GL_UNSIGNED_BYTE
 static void
 decodeDXT3(const GLvoid *data, int width, int height,
@@ -309,41 +499,45 @@ decodeDXT3(const GLvoid *data, int width, int height,
 
 {
     init_tables();
-    
+
     uint32_t const *d32 = (uint32_t *)data;
-    
+
     // Specified colors from the previous block
     uint16_t prev_color0 = 0x0000;
     uint16_t prev_color1 = 0x0000;
 
     // Color table for the current block
     uint32_t c[4];
-    c[0] = c[1] = c[2] = c[3] = 0;
+    colorTable32(prev_color0, prev_color1, c);
+
+    // Alpha of each texel of the current block
+    uint8_t a[16];
+
+    // Texels of the blocks at the right and bottom edges
+    uint32_t edge[16];
 
     uint32_t* rowPtr = (uint32_t*)surface;
     for (int base_y = 0; base_y < height; base_y += 4, rowPtr += 4*stride) {
         uint32_t *blockPtr = rowPtr;
+        const int h = min(height - base_y, 4);
         for (int base_x = 0; base_x < width; base_x += 4, blockPtr += 4) {
-            
-#if __BYTE_ORDER == __BIG_ENDIAN
-            uint32_t alphahi = *d32++;
-            uint32_t alphalo = *d32++;
-            alphahi = swap(alphahi);
-            alphalo = swap(alphalo);
-#else
-            uint32_t alphalo = *d32++;
-            uint32_t alphahi = *d32++;
-#endif
+
+            // 4-bit alphas, two per byte, lowest nibble first
+            uint8_t const *alphaPtr = (uint8_t const *)d32;
+            for (int i = 0; i < 8; i++) {
+                int a2 = alphaPtr[i];
+                a[2*i  ] = (a2 & 0xf) * 0x11;
+                a[2*i+1] = (a2 >> 4)  * 0x11;
+            }
+            d32 += 2;
 
             uint32_t colors = *d32++;
             uint32_t bits = *d32++;
-            
+
 #if __BYTE_ORDER == __BIG_ENDIAN
             colors = swap(colors);
             bits = swap(bits);
 #endif
-            
-            uint64_t alpha = ((uint64_t)alphahi << 32) | alphalo;
 
             // Raw colors
             uint16_t color0 = colors & 0xffff;
@@ -356,56 +550,15 @@ decodeDXT3(const GLvoid *data, int width, int height,
                 // Store raw colors for comparison with next block
                 prev_color0 = color0;
                 prev_color1 = color1;
-                
-                int bbits = bits >> 1;
-                bool has2 = ((bbits & ~bits) & 0x55555555) != 0;
-                bool has3 = ((bbits &  bits) & 0x55555555) != 0;
-                
-                if (has2 || has3) {
-                    int r0 =   red(color0);
-                    int g0 = green(color0);
-                    int b0 =  blue(color0);
-                    
-                    int r1 =   red(color1);
-                    int g1 = green(color1);
-                    int b1 =  blue(color1);
-                    
-                    int r2 = avg23(r0, r1);
-                    int g2 = avg23(g0, g1);
-                    int b2 = avg23(b0, b1);
-                    
-                    int r3 = avg23(r1, r0);
-                    int g3 = avg23(g1, g0);
-                    int b3 = avg23(b1, b0);
-
-                    c[0] = rgb565SepTo888(r0, g0, b0);
-                    c[1] = rgb565SepTo888(r1, g1, b1);
-                    c[2] = rgb565SepTo888(r2, g2, b2);
-                    c[3] = rgb565SepTo888(r3, g3, b3);
-                } else {
-                    // Convert to 8 bits
-                    c[0] = rgb565To888(color0);
-                    c[1] = rgb565To888(color1);
-                }
+                colorTable32(color0, color1, c);
             }
 
-            uint32_t* blockRowPtr = blockPtr;
-            for (int y = 0; y < 4; y++, blockRowPtr += stride) {
-                // Don't process rows past the botom
-                if (base_y + y >= height) {
-                    break;
-                }
-                
-                int w = min(width - base_x, 4);
-                for (int x = 0; x < w; x++) {
-                    int a = alpha & 0xf;
-                    alpha >>= 4;
-
-                    int code = bits & 0x3;
-                    bits >>= 2;
-
-                    blockRowPtr[x] = c[code] | (a << 28) | (a << 24);
-                }
+            const int w = min(width - base_x, 4);
+            if (ggl_likely((w & h) == 4)) {
+                expandBlock32(c, bits, a, blockPtr, stride);
+            } else {
+                expandBlock32(c, bits, a, edge, 4);
+                copyEdgeBlock(edge, w, h, blockPtr, stride);
             }
         }
     }
@@ -418,88 +571,75 @@ decodeDXT5(const GLvoid *data, int width, int height,
 
 {
     init_tables();
-    
+
     uint32_t const *d32 = (uint32_t *)data;
-    
+
     // Specified alphas from the previous block
     uint8_t prev_alpha0 = 0x00;
     uint8_t prev_alpha1 = 0x00;
 
     // Specified colors from the previous block
     uint16_t prev_color0 = 0x0000;
-     uint16_t prev_color1 = 0x0000;
+    uint16_t prev_color1 = 0x0000;
 
     // Alpha table for the current block
-    uint8_t a[8];
-    a[0] = a[1] = a[2] = a[3] = a[4] = a[5] = a[6] = a[7] = 0;
+    uint8_t at[8];
+    alphaTable(prev_alpha0, prev_alpha1, at);
 
     // Color table for the current block
     uint32_t c[4];
-    c[0] = c[1] = c[2] = c[3] = 0;
+    colorTable32(prev_color0, prev_color1, c);
+
+    // Alpha of each texel of the current block
+    uint8_t a[16];
 
-    int good_a5 = 0;
-    int bad_a5 = 0;
-    int good_a6 = 0;
-    int bad_a6 = 0;
-    int good_a7 = 0;
-    int bad_a7 = 0;
+    // Texels of the blocks at the right and bottom edges
+    uint32_t edge[16];
 
     uint32_t* rowPtr = (uint32_t*)surface;
     for (int base_y = 0; base_y < height; base_y += 4, rowPtr += 4*stride) {
         uint32_t *blockPtr = rowPtr;
+        const int h = min(height - base_y, 4);
         for (int base_x = 0; base_x < width; base_x += 4, blockPtr += 4) {
-            
+
 #if __BYTE_ORDER == __BIG_ENDIAN
             uint32_t alphahi = *d32++;
             uint32_t alphalo = *d32++;
             alphahi = swap(alphahi);
             alphalo = swap(alphalo);
 #else
-             uint32_t alphalo = *d32++;
-             uint32_t alphahi = *d32++;
+            uint32_t alphalo = *d32++;
+            uint32_t alphahi = *d32++;
 #endif
 
             uint32_t colors = *d32++;
             uint32_t bits = *d32++;
-            
-#if __BYTE_ORDER == __BIG_ENDIANx
+
+#if __BYTE_ORDER == __BIG_ENDIAN
             colors = swap(colors);
             bits = swap(bits);
 #endif
-            
+
             uint64_t alpha = ((uint64_t)alphahi << 32) | alphalo;
-            uint64_t alpha0 = alpha & 0xff;
+            uint8_t alpha0 = alpha & 0xff;
             alpha >>= 8;
-            uint64_t alpha1 = alpha & 0xff;
+            uint8_t alpha1 = alpha & 0xff;
             alpha >>= 8;
 
             if (alpha0 != prev_alpha0 || alpha1 != prev_alpha1) {
                 prev_alpha0 = alpha0;
                 prev_alpha1 = alpha1;
-                
-                a[0] = alpha0;
-                a[1] = alpha1;
-                int a01 = alpha0 + alpha1 - 1;
-                if (alpha0 > alpha1) {
-                    a[2] = div7(6*alpha0 +   alpha1);
-                    a[4] = div7(4*alpha0 + 3*alpha1);
-                    a[6] = div7(2*alpha0 + 5*alpha1);
-
-                    // Use symmetry to derive half of the values
-                    // A few values will be off by 1 (~.5%)
-                    // Alternate which values are computed directly
-                    // and which are derived to try to reduce bias
-                    a[3] = a01 - a[6];
-                    a[5] = a01 - a[4];
-                    a[7] = a01 - a[2];
-                } else {
-                    a[2] = div5(4*alpha0 +   alpha1);
-                    a[4] = div5(2*alpha0 + 3*alpha1);
-                    a[3] = a01 - a[4];
-                    a[5] = a01 - a[2];
-                    a[6] = 0x00;
-                    a[7] = 0xff;
-                }
+                alphaTable(alpha0, alpha1, at);
+            }
+
+            // 3-bit alpha codes, in two halves of 24 bits
+            uint32_t acodes = (uint32_t)alpha & 0xffffff;
+            for (int i = 0; i < 8; i++, acodes >>= 3) {
+                a[i] = at[acodes & 0x7];
+            }
+            acodes = (uint32_t)(alpha >> 24);
+            for (int i = 8; i < 16; i++, acodes >>= 3) {
+                a[i] = at[acodes & 0x7];
             }
 
             // Raw colors
@@ -513,61 +653,39 @@ decodeDXT5(const GLvoid *data, int width, int height,
                 // Store raw colors for comparison with next block
                 prev_color0 = color0;
                 prev_color1 = color1;
-                
-                int bbits = bits >> 1;
-                bool has2 = ((bbits & ~bits) & 0x55555555) != 0;
-                bool has3 = ((bbits &  bits) & 0x55555555) != 0;
-                
-                if (has2 || has3) {
-                    int r0 =   red(color0);
-                    int g0 = green(color0);
-                    int b0 =  blue(color0);
-                    
-                    int r1 =   red(color1);
-                    int g1 = green(color1);
-                    int b1 =  blue(color1);
-                
-                    int r2 = avg23(r0, r1);
-                    int g2 = avg23(g0, g1);
-                    int b2 = avg23(b0, b1);
-                    
-                    int r3 = avg23(r1, r0);
-                    int g3 = avg23(g1, g0);
-                    int b3 = avg23(b1, b0);
-
-                    c[0] = rgb565SepTo888(r0, g0, b0);
-                    c[1] = rgb565SepTo888(r1, g1, b1);
-                    c[2] = rgb565SepTo888(r2, g2, b2);
-                    c[3] = rgb565SepTo888(r3, g3, b3);
-                } else {
-                    // Convert to 8 bits
-                    c[0] = rgb565To888(color0);
-                    c[1] = rgb565To888(color1);
-                }                
+                colorTable32(color0, color1, c);
             }
 
-            uint32_t* blockRowPtr = blockPtr;
-            for (int y = 0; y < 4; y++, blockRowPtr += stride) {
-                // Don't process rows past the botom
-                if (base_y + y >= height) {
-                    break;
-                }
-                
-                int w = min(width - base_x, 4);
-                for (int x = 0; x < w; x++) {
-                    int acode = alpha & 0x7;
-                    alpha >>= 3;
-
-                    int code = bits & 0x3;
-                    bits >>= 2;
-
-                    blockRowPtr[x] = c[code] | (a[acode] << 24);
-                }
+            const int w = min(width - base_x, 4);
+            if (ggl_likely((w & h) == 4)) {
+                expandBlock32(c, bits, a, blockPtr, stride);
+            } else {
+                expandBlock32(c, bits, a, edge, 4);
+                copyEdgeBlock(edge, w, h, blockPtr, stride);
             }
         }
     }
 }
-   
+
+/*
+ * Size in bytes of a DXT-compressed texture: 8 bytes per 4x4 block for
+ * DXT1, 16 for DXT3 and DXT5, or 0 if 'format' is none of them.
+ */
+size_t
+DXTDataSize(int width, int height, int format)
+{
+    const size_t numblocks = ((width + 3)/4) * ((height + 3)/4);
+    switch (format) {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+        return numblocks * 8;
+    case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        return numblocks * 16;
+    }
+    return 0;
+}
+
 /*
  * Decode a DXT-compressed texture into memory.  DXT textures consist of
  * a series of 4x4 pixel blocks in left-to-right, top-down order.
@@ -592,8 +710,12 @@ decodeDXT5(const GLvoid *data, int width, int height,
  *
  *   GL_COMPRESSED_RGBA_S3TC_DXT3_EXT
  *   GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
- *      The output is written as 8/8/8/8 ARGB (32 bit words)
+ *      The output is written as 8/8/8/8 RGBA (R first in memory, 32 bit
+ *      words), as GL_RGBA/GL_UNSIGNED_BYTE.
  *      16 bytes are read from 'data' for each block.
+ *
+ * Blocks that lie entirely inside the texture are written with SSE2 or
+ * NEON where available.
  */
 void
 decodeDXT(const GLvoid *data, int width, int height,
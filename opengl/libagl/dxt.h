@@ -15,19 +15,29 @@
 ** limitations under the License.
 */
 
-#ifndef ANDROID_OPENGLES_TEXTURE_H
-#define ANDROID_OPENGLES_TEXTURE_H
+#ifndef ANDROID_OPENGLES_DXT_H
+#define ANDROID_OPENGLES_DXT_H
 
 #include <stdlib.h>
 
 #include <GLES/gl.h>
+#include <GLES/glext.h>
+
+// GL_EXT_texture_compression_s3tc tokens, not in the GLES headers
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT3_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT3_EXT                        0x83F2
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT                        0x83F3
+#endif
 
 namespace android {
 
   bool DXT1HasAlpha(const GLvoid *data, int width, int height);
+  size_t DXTDataSize(int width, int height, int format);
   void decodeDXT(const GLvoid *data, int width, int height,
                  void *surface, int stride, int format);
 
 } // namespace android
 
-#endif // ANDROID_OPENGLES_TEXTURE_H
+#endif // ANDROID_OPENGLES_DXT_H
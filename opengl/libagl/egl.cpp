@@ -45,6 +45,7 @@
 #include "state.h"
 #include "texture.h"
 #include "matrix.h"
+#include "tiling.h"
 
 #undef NELEM
 #define NELEM(x) (sizeof(x)/sizeof(*(x)))
@@ -164,6 +165,7 @@ struct egl_surface_t
     virtual     EGLint      getVerticalResolution() const;
     virtual     EGLint      getRefreshRate() const;
     virtual     EGLint      getSwapBehavior() const;
+    virtual     EGLBoolean  setSwapBehavior(EGLint behavior);
     virtual     EGLBoolean  swapBuffers();
     virtual     EGLBoolean  setSwapRectangle(EGLint l, EGLint t, EGLint w, EGLint h);
 protected:
@@ -204,6 +206,9 @@ EGLint egl_surface_t::getRefreshRate() const {
 EGLint egl_surface_t::getSwapBehavior() const {
     return EGL_BUFFER_PRESERVED;
 }
+EGLBoolean egl_surface_t::setSwapBehavior(EGLint behavior) {
+    return behavior == EGL_BUFFER_PRESERVED;
+}
 EGLBoolean egl_surface_t::setSwapRectangle(
         EGLint l, EGLint t, EGLint w, EGLint h)
 {
@@ -233,6 +238,7 @@ struct egl_window_surface_v2_t : public egl_surface_t
     virtual     EGLint      getVerticalResolution() const;
     virtual     EGLint      getRefreshRate() const;
     virtual     EGLint      getSwapBehavior() const;
+    virtual     EGLBoolean  setSwapBehavior(EGLint behavior);
     virtual     EGLBoolean  setSwapRectangle(EGLint l, EGLint t, EGLint w, EGLint h);
     
 private:
@@ -246,7 +252,11 @@ private:
     int height;
     void* bits;
     GGLFormat const* pixelFormatTable;
-    
+
+    // number of past frames whose dirty area is remembered, the buffers
+    // queued longer ago than that are copied back entirely
+    enum { DIRTY_HISTORY = 4 };
+
     struct Rect {
         inline Rect() { };
         inline Rect(int32_t w, int32_t h)
@@ -263,6 +273,10 @@ private:
         bool isEmpty() const {
             return (left>=right || top>=bottom);
         }
+        bool contains(const Rect& r) const {
+            return left<=r.left && top<=r.top &&
+                    right>=r.right && bottom>=r.bottom;
+        }
         void dump(char const* what) {
             ALOGD("%s { %5d, %5d, w=%5d, h=%5d }",
                     what, left, top, right-left, bottom-top);
@@ -322,8 +336,18 @@ private:
         bool isEmpty() const {
             return count<=0;
         }
+        // appends the rects of rhs, returns false if they don't all fit
+        bool add(const Region& rhs) {
+            for (const_iterator r = rhs.begin() ; r != rhs.end() ; r++) {
+                if (count >= ssize_t(NUM_RECTS))
+                    return false;
+                storage[count++] = *r;
+            }
+            return true;
+        }
     private:
-        Rect storage[4];
+        enum { NUM_RECTS = 4 * DIRTY_HISTORY };
+        Rect storage[NUM_RECTS];
         ssize_t count;
     };
     
@@ -333,7 +357,24 @@ private:
             const Region& clip);
 
     Rect dirtyRegion;
-    Rect oldDirtyRegion;
+
+    // when false (EGL_BUFFER_DESTROYED) the content outside of the swap
+    // rectangle isn't copied back
+    bool preserveOnSwap;
+
+    // the area drawn in each of the last DIRTY_HISTORY frames, and the
+    // frame each buffer was last queued in
+    uint32_t frameCount;
+    Rect frameDirty[DIRTY_HISTORY];
+    struct BufferAge {
+        ANativeWindowBuffer* buffer;
+        uint32_t frame;
+    };
+    BufferAge bufferAge[DIRTY_HISTORY];
+    void resetDirtyHistory();
+    // returns the frame buf was last queued in, or 0 if it isn't known
+    uint32_t getLastQueuedFrame(ANativeWindowBuffer const* buf) const;
+    void setLastQueuedFrame(ANativeWindowBuffer* buf);
 };
 
 egl_window_surface_v2_t::egl_window_surface_v2_t(EGLDisplay dpy,
@@ -342,8 +383,9 @@ egl_window_surface_v2_t::egl_window_surface_v2_t(EGLDisplay dpy,
         ANativeWindow* window)
     : egl_surface_t(dpy, config, depthFormat), 
     nativeWindow(window), buffer(0), previousBuffer(0), module(0),
-    bits(NULL)
+    bits(NULL), preserveOnSwap(true)
 {
+    resetDirtyHistory();
     hw_module_t const* pModule;
     hw_get_module(GRALLOC_HARDWARE_MODULE_ID, &pModule);
     module = reinterpret_cast<gralloc_module_t const*>(pModule);
@@ -497,14 +539,34 @@ EGLBoolean egl_window_surface_v2_t::swapBuffers()
     
     /*
      * Handle eglSetSwapRectangleANDROID()
-     * We copyback from the front buffer 
+     * We copyback from the front buffer the areas drawn since this buffer
+     * was last queued, except what was drawn in it this frame. The front
+     * buffer is always complete.
      */
+    const Rect bounds(buffer->width, buffer->height);
+    Rect dirty(bounds);
     if (!dirtyRegion.isEmpty()) {
-        dirtyRegion.andSelf(Rect(buffer->width, buffer->height));
-        if (previousBuffer) {
-            // This was const Region copyBack, but that causes an
-            // internal compile error on simulator builds
-            /*const*/ Region copyBack(Region::subtract(oldDirtyRegion, dirtyRegion));
+        dirtyRegion.andSelf(bounds);
+        dirty = dirtyRegion;
+        if (previousBuffer && preserveOnSwap) {
+            const uint32_t last = getLastQueuedFrame(buffer);
+            Region copyBack;
+            bool complete = last != 0 && frameCount - last <= DIRTY_HISTORY;
+            for (uint32_t f = last + 1 ; complete && f != frameCount + 1 ; f++) {
+                const Rect& drawn(frameDirty[f % DIRTY_HISTORY]);
+                // areas drawn in several frames are copied once
+                bool seen = false;
+                for (uint32_t g = last + 1 ; g != f && !seen ; g++) {
+                    seen = frameDirty[g % DIRTY_HISTORY].contains(drawn);
+                }
+                if (!seen) {
+                    complete = copyBack.add(Region::subtract(drawn, dirty));
+                }
+            }
+            if (!complete) {
+                // the stale areas aren't known, copy everything else
+                copyBack = Region::subtract(bounds, dirty);
+            }
             if (!copyBack.isEmpty()) {
                 void* prevBits;
                 if (lock(previousBuffer, 
@@ -515,8 +577,10 @@ EGLBoolean egl_window_surface_v2_t::swapBuffers()
                 }
             }
         }
-        oldDirtyRegion = dirtyRegion;
     }
+    frameCount++;
+    frameDirty[frameCount % DIRTY_HISTORY] = dirty;
+    setLastQueuedFrame(buffer);
 
     if (previousBuffer) {
         previousBuffer->common.decRef(&previousBuffer->common); 
@@ -543,6 +607,7 @@ EGLBoolean egl_window_surface_v2_t::swapBuffers()
             // if the window size has changed
             width = buffer->width;
             height = buffer->height;
+            resetDirtyHistory();
             if (depth.data) {
                 free(depth.data);
                 depth.width   = width;
@@ -581,6 +646,41 @@ EGLBoolean egl_window_surface_v2_t::setSwapRectangle(
     return EGL_TRUE;
 }
 
+void egl_window_surface_v2_t::resetDirtyHistory()
+{
+    frameCount = 0;
+    for (size_t i=0 ; i<DIRTY_HISTORY ; i++) {
+        bufferAge[i].buffer = 0;
+        bufferAge[i].frame = 0;
+    }
+}
+
+uint32_t egl_window_surface_v2_t::getLastQueuedFrame(
+        ANativeWindowBuffer const* buf) const
+{
+    for (size_t i=0 ; i<DIRTY_HISTORY ; i++) {
+        if (bufferAge[i].buffer == buf)
+            return bufferAge[i].frame;
+    }
+    return 0;
+}
+
+void egl_window_surface_v2_t::setLastQueuedFrame(ANativeWindowBuffer* buf)
+{
+    // replace this buffer's entry, or the oldest one
+    size_t oldest = 0;
+    for (size_t i=0 ; i<DIRTY_HISTORY ; i++) {
+        if (bufferAge[i].buffer == buf) {
+            oldest = i;
+            break;
+        }
+        if (bufferAge[i].frame < bufferAge[oldest].frame)
+            oldest = i;
+    }
+    bufferAge[oldest].buffer = buf;
+    bufferAge[oldest].frame = frameCount;
+}
+
 EGLBoolean egl_window_surface_v2_t::bindDrawSurface(ogles_context_t* gl)
 {
     GGLSurface buffer;
@@ -635,6 +735,22 @@ EGLint egl_window_surface_v2_t::getSwapBehavior() const
 
     return EGL_BUFFER_DESTROYED;
 }
+EGLBoolean egl_window_surface_v2_t::setSwapBehavior(EGLint behavior)
+{
+    /*
+     * EGL_BUFFER_DESTROYED tells that the client redraws everything, even
+     * with a swap rectangle, so nothing is copied back.
+     */
+    if (behavior != EGL_BUFFER_PRESERVED && behavior != EGL_BUFFER_DESTROYED)
+        return EGL_FALSE;
+    const bool preserve = (behavior == EGL_BUFFER_PRESERVED);
+    if (preserve != preserveOnSwap) {
+        // the areas drawn meanwhile aren't meaningful
+        resetDirtyHistory();
+        preserveOnSwap = preserve;
+    }
+    return EGL_TRUE;
+}
 
 // ----------------------------------------------------------------------------
 
@@ -1581,6 +1697,7 @@ EGLBoolean eglDestroySurface(EGLDisplay dpy, EGLSurface eglSurface)
             return setError(EGL_BAD_DISPLAY, EGL_FALSE);
         if (surface->ctx) {
             // FIXME: this surface is current check what the spec says
+            ogles_flush_tiles((ogles_context_t*)surface->ctx);
             surface->disconnect();
             surface->ctx = 0;
         }
@@ -1735,6 +1852,7 @@ EGLBoolean eglMakeCurrent(  EGLDisplay dpy, EGLSurface draw,
             
             if (c->draw) {
                 egl_surface_t* s = reinterpret_cast<egl_surface_t*>(c->draw);
+                ogles_flush_tiles(gl);
                 s->disconnect();
             }
             if (c->read) {
@@ -1863,6 +1981,10 @@ EGLBoolean eglSwapBuffers(EGLDisplay dpy, EGLSurface draw)
     if (d->dpy != dpy)
         return setError(EGL_BAD_DISPLAY, EGL_FALSE);
 
+    // render what was deferred before the buffer goes away
+    if (d->ctx != EGL_NO_CONTEXT)
+        ogles_flush_tiles((ogles_context_t*)d->ctx);
+
     // post the surface
     d->swapBuffers();
 
@@ -1922,7 +2044,18 @@ EGLBoolean eglSurfaceAttrib(
 {
     if (egl_display_t::is_valid(dpy) == EGL_FALSE)
         return setError(EGL_BAD_DISPLAY, EGL_FALSE);
-    // TODO: eglSurfaceAttrib()
+    egl_surface_t* d = static_cast<egl_surface_t*>(surface);
+    if (!d->isValid())
+        return setError(EGL_BAD_SURFACE, EGL_FALSE);
+    if (d->dpy != dpy)
+        return setError(EGL_BAD_DISPLAY, EGL_FALSE);
+    switch (attribute) {
+        case EGL_SWAP_BEHAVIOR:
+            if (d->setSwapBehavior(value))
+                return EGL_TRUE;
+            return setError(EGL_BAD_MATCH, EGL_FALSE);
+    }
+    // TODO: other eglSurfaceAttrib() attributes
     return setError(EGL_BAD_PARAMETER, EGL_FALSE);
 }
 
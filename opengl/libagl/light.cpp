@@ -278,6 +278,7 @@ void invalidate_lighting(ogles_context_t* c)
     // TODO: pick lightVertexValidate or lightVertexValidateMVI
     // instead of systematically the heavier lightVertexValidate()
     c->lighting.lightVertex = lightVertexValidate;
+    c->lighting.serial++;
 }
 
 void ogles_invalidate_lighting_mvui(ogles_context_t* c)
@@ -578,6 +579,8 @@ static void materialx(GLenum face, GLenum pname, GLfixed param, ogles_context_t*
 
 static void fogx(GLenum pname, GLfixed param, ogles_context_t* c)
 {
+    // the fog factor is cached along with the lit color
+    c->lighting.serial++;
     switch (pname) {
     case GL_FOG_DENSITY:
         if (param >= 0) {
@@ -17,6 +17,9 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+
+#include <cutils/properties.h>
 
 #include "context.h"
 #include "fp.h"
@@ -57,6 +60,10 @@ static void point3__generic(transform_t const*, vec4_t* c, vec4_t const* o);
 static void point4__generic(transform_t const*, vec4_t* c, vec4_t const* o);
 static void point3__mvui(transform_t const*, vec4_t* c, vec4_t const* o);
 static void point4__mvui(transform_t const*, vec4_t* c, vec4_t const* o);
+static void point2__affine2d(transform_t const*, vec4_t* c, vec4_t const* o);
+static void point3__affine2d(transform_t const*, vec4_t* c, vec4_t const* o);
+static void point2__translate(transform_t const*, vec4_t* c, vec4_t const* o);
+static void point3__translate(transform_t const*, vec4_t* c, vec4_t const* o);
 
 // ----------------------------------------------------------------------------
 #if 0
@@ -83,6 +90,12 @@ void ogles_init_matrix(ogles_context_t* c)
     c->transforms.vpt.loadIdentity();
     c->transforms.vpt.zNear = 0.0f;
     c->transforms.vpt.zFar  = 1.0f;
+
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.libagl.xformstats", value, "0");
+    c->transforms.stats = atoi(value);
+    c->transforms.draws = 0;
+    memset(c->transforms.vertices, 0, sizeof(c->transforms.vertices));
 }
 
 void ogles_uninit_matrix(ogles_context_t* c)
@@ -204,6 +217,24 @@ void transform_t::picker()
     if (!(notZero(m[3]) | notZero(m[7]) | notZero(m[11]) | notOne(m[15]))) {
         flags |= FLAGS_2D_PROJECTION;
     }
+
+    // the 2D UI case (orthographic projection, affine modelview) needs 4
+    // multiplies per point instead of 12, and none when only translating.
+    // unlike above the test is exact, these give the same results as the
+    // generic transforms.
+    if (!(m[3] | m[7] | m[11] | m[2] | m[6] | m[8] | m[9]) &&
+            m[15] == 0x10000) {
+        flags |= FLAGS_AFFINE_2D;
+        point2 = point2__affine2d;
+        point3 = point3__affine2d;
+        if (!(m[1] | m[4]) && m[0] == 0x10000 && m[5] == 0x10000 &&
+                m[10] == 0x10000) {
+            flags |= FLAGS_TRANSLATE;
+            ops = OP_TRANSLATE;
+            point2 = point2__translate;
+            point3 = point3__translate;
+        }
+    }
 }
 
 void mvui_transform_t::picker()
@@ -501,6 +532,7 @@ void transform_state_t::invalidate()
     }
     current->dirty =    matrix_stack_t::DO_PICKER |
                         matrix_stack_t::DO_FLOAT_TO_FIXED;
+    serial++;
 }
 
 void transform_state_t::update_mvp()
@@ -524,6 +556,17 @@ void transform_state_t::update_mvp()
     }
 }
 
+void transform_state_t::dump_stats()
+{
+    ALOGD("vertex transforms: generic %u+%u, affine 2D %u+%u, "
+            "translate %u+%u (one at a time+batched)",
+            vertices[0][PATH_GENERIC], vertices[1][PATH_GENERIC],
+            vertices[0][PATH_AFFINE_2D], vertices[1][PATH_AFFINE_2D],
+            vertices[0][PATH_TRANSLATE], vertices[1][PATH_TRANSLATE]);
+    draws = 0;
+    memset(vertices, 0, sizeof(vertices));
+}
+
 static inline 
 GLfloat det22(GLfloat a, GLfloat b, GLfloat c, GLfloat d) {
     return a*d - b*c;
@@ -711,6 +754,7 @@ void ogles_viewport(ogles_context_t* c,
     f[2] = 0;   f[6] = 0;   f[10] = A;  f[14] = B;
     f[3] = 0;   f[7] = 0;   f[11] = 0;  f[15] = 1;
     c->transforms.dirty |= transform_state_t::VIEWPORT;
+    c->transforms.serial++;
     if (c->transforms.mvp4.flags & transform_t::FLAGS_2D_PROJECTION)
         c->transforms.dirty |= transform_state_t::MVP;
 }
@@ -783,6 +827,43 @@ void point4__mvui(transform_t const* mx, vec4_t* lhs, vec4_t const* rhs) {
     lhs->w = rw;
 }
 
+void point2__affine2d(transform_t const* mx, vec4_t* lhs, vec4_t const* rhs) {
+    const GLfixed* const m = mx->matrix.m;
+    const GLfixed rx = rhs->x;
+    const GLfixed ry = rhs->y;
+    lhs->x = mla2a(rx, m[ 0], ry, m[ 4], m[12]);
+    lhs->y = mla2a(rx, m[ 1], ry, m[ 5], m[13]);
+    lhs->z = m[14];
+    lhs->w = 0x10000;
+}
+
+void point3__affine2d(transform_t const* mx, vec4_t* lhs, vec4_t const* rhs) {
+    const GLfixed* const m = mx->matrix.m;
+    const GLfixed rx = rhs->x;
+    const GLfixed ry = rhs->y;
+    const GLfixed rz = rhs->z;
+    lhs->x = mla2a(rx, m[ 0], ry, m[ 4], m[12]);
+    lhs->y = mla2a(rx, m[ 1], ry, m[ 5], m[13]);
+    lhs->z = GLfixed((int64_t(rz)*m[10])>>16) + m[14];
+    lhs->w = 0x10000;
+}
+
+void point2__translate(transform_t const* mx, vec4_t* lhs, vec4_t const* rhs) {
+    const GLfixed* const m = mx->matrix.m;
+    lhs->x = rhs->x + m[12];
+    lhs->y = rhs->y + m[13];
+    lhs->z = m[14];
+    lhs->w = 0x10000;
+}
+
+void point3__translate(transform_t const* mx, vec4_t* lhs, vec4_t const* rhs) {
+    const GLfixed* const m = mx->matrix.m;
+    lhs->x = rhs->x + m[12];
+    lhs->y = rhs->y + m[13];
+    lhs->z = rhs->z + m[14];
+    lhs->w = 0x10000;
+}
+
 void point2__nop(transform_t const*, vec4_t* lhs, vec4_t const* rhs) {
     lhs->z = 0;
     lhs->w = 0x10000;
@@ -896,6 +977,7 @@ static void depthRangef(GLclampf zNear, GLclampf zFar, ogles_context_t* c)
     f[10] = div2f(zFar - zNear);
     f[14] = div2f(zFar + zNear);
     c->transforms.dirty |= transform_state_t::VIEWPORT;
+    c->transforms.serial++;
     c->transforms.vpt.zNear = zNear;
     c->transforms.vpt.zFar  = zFar;
 }
@@ -23,10 +23,210 @@
 #include "texture.h"
 #include "TextureObjectManager.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
 namespace android {
 
 // ----------------------------------------------------------------------------
 
+/*
+ * 2x2 box filters for the most common formats.  Each one filters a row of
+ * w destination pixels from the two source rows s0 and s1, a vector at a
+ * time when it can, and gives the same results as the scalar code, which
+ * handles what's left of the row.
+ */
+
+static void downsampleRow565(uint16_t* dst,
+        uint16_t const* s0, uint16_t const* s1, int w)
+{
+    int x = 0;
+#if defined(__SSE2__)
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i mask5 = _mm_set1_epi16(0x1F);
+    const __m128i mask6 = _mm_set1_epi16(0x3F);
+    for ( ; x+8 <= w ; x += 8) {
+        const __m128i a0 = _mm_loadu_si128((__m128i const*)(s0 + 2*x));
+        const __m128i a1 = _mm_loadu_si128((__m128i const*)(s0 + 2*x + 8));
+        const __m128i b0 = _mm_loadu_si128((__m128i const*)(s1 + 2*x));
+        const __m128i b1 = _mm_loadu_si128((__m128i const*)(s1 + 2*x + 8));
+        // vertical sums of each field, then horizontal ones
+        __m128i r0 = _mm_add_epi16(_mm_srli_epi16(a0, 11), _mm_srli_epi16(b0, 11));
+        __m128i r1 = _mm_add_epi16(_mm_srli_epi16(a1, 11), _mm_srli_epi16(b1, 11));
+        __m128i g0 = _mm_add_epi16(
+                _mm_and_si128(_mm_srli_epi16(a0, 5), mask6),
+                _mm_and_si128(_mm_srli_epi16(b0, 5), mask6));
+        __m128i g1 = _mm_add_epi16(
+                _mm_and_si128(_mm_srli_epi16(a1, 5), mask6),
+                _mm_and_si128(_mm_srli_epi16(b1, 5), mask6));
+        __m128i c0 = _mm_add_epi16(
+                _mm_and_si128(a0, mask5), _mm_and_si128(b0, mask5));
+        __m128i c1 = _mm_add_epi16(
+                _mm_and_si128(a1, mask5), _mm_and_si128(b1, mask5));
+        const __m128i r = _mm_srli_epi16(_mm_packs_epi32(
+                _mm_madd_epi16(r0, ones), _mm_madd_epi16(r1, ones)), 2);
+        const __m128i g = _mm_srli_epi16(_mm_packs_epi32(
+                _mm_madd_epi16(g0, ones), _mm_madd_epi16(g1, ones)), 2);
+        const __m128i b = _mm_srli_epi16(_mm_packs_epi32(
+                _mm_madd_epi16(c0, ones), _mm_madd_epi16(c1, ones)), 2);
+        _mm_storeu_si128((__m128i*)(dst + x), _mm_or_si128(
+                _mm_or_si128(_mm_slli_epi16(r, 11), _mm_slli_epi16(g, 5)), b));
+    }
+#elif defined(__ARM_NEON__)
+    const uint16x8_t mask5 = vdupq_n_u16(0x1F);
+    const uint16x8_t mask6 = vdupq_n_u16(0x3F);
+    for ( ; x+8 <= w ; x += 8) {
+        const uint16x8_t a0 = vld1q_u16(s0 + 2*x);
+        const uint16x8_t a1 = vld1q_u16(s0 + 2*x + 8);
+        const uint16x8_t b0 = vld1q_u16(s1 + 2*x);
+        const uint16x8_t b1 = vld1q_u16(s1 + 2*x + 8);
+        // vertical sums of each field, then horizontal ones
+        uint16x8_t r0 = vaddq_u16(vshrq_n_u16(a0, 11), vshrq_n_u16(b0, 11));
+        uint16x8_t r1 = vaddq_u16(vshrq_n_u16(a1, 11), vshrq_n_u16(b1, 11));
+        uint16x8_t g0 = vaddq_u16(vandq_u16(vshrq_n_u16(a0, 5), mask6),
+                vandq_u16(vshrq_n_u16(b0, 5), mask6));
+        uint16x8_t g1 = vaddq_u16(vandq_u16(vshrq_n_u16(a1, 5), mask6),
+                vandq_u16(vshrq_n_u16(b1, 5), mask6));
+        uint16x8_t c0 = vaddq_u16(vandq_u16(a0, mask5), vandq_u16(b0, mask5));
+        uint16x8_t c1 = vaddq_u16(vandq_u16(a1, mask5), vandq_u16(b1, mask5));
+        const uint16x8_t r = vshrq_n_u16(vcombine_u16(
+                vmovn_u32(vpaddlq_u16(r0)), vmovn_u32(vpaddlq_u16(r1))), 2);
+        const uint16x8_t g = vshrq_n_u16(vcombine_u16(
+                vmovn_u32(vpaddlq_u16(g0)), vmovn_u32(vpaddlq_u16(g1))), 2);
+        const uint16x8_t b = vshrq_n_u16(vcombine_u16(
+                vmovn_u32(vpaddlq_u16(c0)), vmovn_u32(vpaddlq_u16(c1))), 2);
+        vst1q_u16(dst + x, vorrq_u16(vorrq_u16(
+                vshlq_n_u16(r, 11), vshlq_n_u16(g, 5)), b));
+    }
+#endif
+    const uint32_t mask = 0x07E0F81F;
+    for ( ; x<w ; x++) {
+        uint32_t p00 = s0[2*x];
+        uint32_t p10 = s0[2*x+1];
+        uint32_t p01 = s1[2*x];
+        uint32_t p11 = s1[2*x+1];
+        p00 = (p00 | (p00 << 16)) & mask;
+        p01 = (p01 | (p01 << 16)) & mask;
+        p10 = (p10 | (p10 << 16)) & mask;
+        p11 = (p11 | (p11 << 16)) & mask;
+        uint32_t grb = ((p00 + p10 + p01 + p11) >> 2) & mask;
+        uint32_t rgb = (grb & 0xFFFF) | (grb >> 16);
+        dst[x] = rgb;
+    }
+}
+
+static void downsampleRow8888(uint32_t* dst,
+        uint32_t const* s0, uint32_t const* s1, int w)
+{
+    int x = 0;
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for ( ; x+4 <= w ; x += 4) {
+        const __m128i a0 = _mm_loadu_si128((__m128i const*)(s0 + 2*x));
+        const __m128i a1 = _mm_loadu_si128((__m128i const*)(s0 + 2*x + 4));
+        const __m128i b0 = _mm_loadu_si128((__m128i const*)(s1 + 2*x));
+        const __m128i b1 = _mm_loadu_si128((__m128i const*)(s1 + 2*x + 4));
+        // vertical sums of the components, two pixels per register
+        const __m128i v01 = _mm_add_epi16(
+                _mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+        const __m128i v23 = _mm_add_epi16(
+                _mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+        const __m128i v45 = _mm_add_epi16(
+                _mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+        const __m128i v67 = _mm_add_epi16(
+                _mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+        // then horizontal ones
+        const __m128i h0 = _mm_add_epi16(
+                _mm_unpacklo_epi64(v01, v23), _mm_unpackhi_epi64(v01, v23));
+        const __m128i h1 = _mm_add_epi16(
+                _mm_unpacklo_epi64(v45, v67), _mm_unpackhi_epi64(v45, v67));
+        _mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(
+                _mm_srli_epi16(h0, 2), _mm_srli_epi16(h1, 2)));
+    }
+#elif defined(__ARM_NEON__)
+    for ( ; x+4 <= w ; x += 4) {
+        // even and odd pixels of each row
+        const uint32x4x2_t a = vld2q_u32(s0 + 2*x);
+        const uint32x4x2_t b = vld2q_u32(s1 + 2*x);
+        const uint8x16_t a0 = vreinterpretq_u8_u32(a.val[0]);
+        const uint8x16_t a1 = vreinterpretq_u8_u32(a.val[1]);
+        const uint8x16_t b0 = vreinterpretq_u8_u32(b.val[0]);
+        const uint8x16_t b1 = vreinterpretq_u8_u32(b.val[1]);
+        const uint16x8_t lo = vaddq_u16(
+                vaddl_u8(vget_low_u8(a0), vget_low_u8(a1)),
+                vaddl_u8(vget_low_u8(b0), vget_low_u8(b1)));
+        const uint16x8_t hi = vaddq_u16(
+                vaddl_u8(vget_high_u8(a0), vget_high_u8(a1)),
+                vaddl_u8(vget_high_u8(b0), vget_high_u8(b1)));
+        vst1q_u32(dst + x, vreinterpretq_u32_u8(
+                vcombine_u8(vshrn_n_u16(lo, 2), vshrn_n_u16(hi, 2))));
+    }
+#endif
+    for ( ; x<w ; x++) {
+        uint32_t p00 = s0[2*x];
+        uint32_t p10 = s0[2*x+1];
+        uint32_t p01 = s1[2*x];
+        uint32_t p11 = s1[2*x+1];
+        uint32_t rb00 = p00 & 0x00FF00FF;
+        uint32_t rb01 = p01 & 0x00FF00FF;
+        uint32_t rb10 = p10 & 0x00FF00FF;
+        uint32_t rb11 = p11 & 0x00FF00FF;
+        uint32_t ga00 = (p00 >> 8) & 0x00FF00FF;
+        uint32_t ga01 = (p01 >> 8) & 0x00FF00FF;
+        uint32_t ga10 = (p10 >> 8) & 0x00FF00FF;
+        uint32_t ga11 = (p11 >> 8) & 0x00FF00FF;
+        uint32_t rb = (rb00 + rb01 + rb10 + rb11)>>2;
+        uint32_t ga = (ga00 + ga01 + ga10 + ga11)>>2;
+        uint32_t rgba = (rb & 0x00FF00FF) | ((ga & 0x00FF00FF)<<8);
+        dst[x] = rgba;
+    }
+}
+
+static void downsampleRow8(uint8_t* dst,
+        uint8_t const* s0, uint8_t const* s1, int w)
+{
+    int x = 0;
+#if defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi16(0x00FF);
+    for ( ; x+16 <= w ; x += 16) {
+        const __m128i a0 = _mm_loadu_si128((__m128i const*)(s0 + 2*x));
+        const __m128i a1 = _mm_loadu_si128((__m128i const*)(s0 + 2*x + 16));
+        const __m128i b0 = _mm_loadu_si128((__m128i const*)(s1 + 2*x));
+        const __m128i b1 = _mm_loadu_si128((__m128i const*)(s1 + 2*x + 16));
+        // even + odd bytes of both rows
+        const __m128i h0 = _mm_add_epi16(
+                _mm_add_epi16(_mm_and_si128(a0, mask), _mm_srli_epi16(a0, 8)),
+                _mm_add_epi16(_mm_and_si128(b0, mask), _mm_srli_epi16(b0, 8)));
+        const __m128i h1 = _mm_add_epi16(
+                _mm_add_epi16(_mm_and_si128(a1, mask), _mm_srli_epi16(a1, 8)),
+                _mm_add_epi16(_mm_and_si128(b1, mask), _mm_srli_epi16(b1, 8)));
+        _mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(
+                _mm_srli_epi16(h0, 2), _mm_srli_epi16(h1, 2)));
+    }
+#elif defined(__ARM_NEON__)
+    for ( ; x+16 <= w ; x += 16) {
+        const uint16x8_t h0 = vaddq_u16(
+                vpaddlq_u8(vld1q_u8(s0 + 2*x)), vpaddlq_u8(vld1q_u8(s1 + 2*x)));
+        const uint16x8_t h1 = vaddq_u16(
+                vpaddlq_u8(vld1q_u8(s0 + 2*x + 16)),
+                vpaddlq_u8(vld1q_u8(s1 + 2*x + 16)));
+        vst1q_u8(dst + x, vcombine_u8(vshrn_n_u16(h0, 2), vshrn_n_u16(h1, 2)));
+    }
+#endif
+    for ( ; x<w ; x++) {
+        uint32_t p00 = s0[2*x];
+        uint32_t p10 = s0[2*x+1];
+        uint32_t p01 = s1[2*x];
+        uint32_t p11 = s1[2*x+1];
+        dst[x] = (p00 + p10 + p01 + p11) >> 2;
+    }
+}
+
+// ----------------------------------------------------------------------------
+
 status_t buildAPyramid(ogles_context_t* c, EGLTextureObject* tex)
 {
     int level = 0;
@@ -45,7 +245,7 @@ status_t buildAPyramid(ogles_context_t* c, EGLTextureObject* tex)
         ++level;
         const int bpr = w * pixelFormat.size;
         if (tex->reallocate(level, w, h, w,
-                base->format, base->compressedFormat, bpr) != NO_ERROR) {
+                base->format, 0, bpr) != NO_ERROR) {
             return NO_MEMORY;
         }
     
@@ -57,23 +257,10 @@ status_t buildAPyramid(ogles_context_t* c, EGLTextureObject* tex)
         {
             uint16_t const * src = (uint16_t const *)base->data;
             uint16_t* dst = (uint16_t*)cur.data;
-            const uint32_t mask = 0x07E0F81F;
             for (int y=0 ; y<h ; y++) {
                 size_t offset = (y*2) * bs;
-                for (int x=0 ; x<w ; x++) {
-                    uint32_t p00 = src[offset];
-                    uint32_t p10 = src[offset+1];
-                    uint32_t p01 = src[offset+bs];
-                    uint32_t p11 = src[offset+bs+1];
-                    p00 = (p00 | (p00 << 16)) & mask;
-                    p01 = (p01 | (p01 << 16)) & mask;
-                    p10 = (p10 | (p10 << 16)) & mask;
-                    p11 = (p11 | (p11 << 16)) & mask;
-                    uint32_t grb = ((p00 + p10 + p01 + p11) >> 2) & mask;
-                    uint32_t rgb = (grb & 0xFFFF) | (grb >> 16);
-                    dst[x + y*stride] = rgb;
-                    offset += 2;
-                }
+                downsampleRow565(dst + y*stride,
+                        src + offset, src + offset + bs, w);
             }
         }
         else if (base->format == GGL_PIXEL_FORMAT_RGBA_5551)
@@ -102,25 +289,8 @@ status_t buildAPyramid(ogles_context_t* c, EGLTextureObject* tex)
             uint32_t* dst = (uint32_t*)cur.data;
             for (int y=0 ; y<h ; y++) {
                 size_t offset = (y*2) * bs;
-                for (int x=0 ; x<w ; x++) {
-                    uint32_t p00 = src[offset];
-                    uint32_t p10 = src[offset+1];
-                    uint32_t p01 = src[offset+bs];
-                    uint32_t p11 = src[offset+bs+1];
-                    uint32_t rb00 = p00 & 0x00FF00FF;
-                    uint32_t rb01 = p01 & 0x00FF00FF;
-                    uint32_t rb10 = p10 & 0x00FF00FF;
-                    uint32_t rb11 = p11 & 0x00FF00FF;
-                    uint32_t ga00 = (p00 >> 8) & 0x00FF00FF;
-                    uint32_t ga01 = (p01 >> 8) & 0x00FF00FF;
-                    uint32_t ga10 = (p10 >> 8) & 0x00FF00FF;
-                    uint32_t ga11 = (p11 >> 8) & 0x00FF00FF;
-                    uint32_t rb = (rb00 + rb01 + rb10 + rb11)>>2;
-                    uint32_t ga = (ga00 + ga01 + ga10 + ga11)>>2;
-                    uint32_t rgba = (rb & 0x00FF00FF) | ((ga & 0x00FF00FF)<<8);
-                    dst[x + y*stride] = rgba;
-                    offset += 2;
-                }
+                downsampleRow8888(dst + y*stride,
+                        src + offset, src + offset + bs, w);
             }
         }
         else if ((base->format == GGL_PIXEL_FORMAT_RGB_888) ||
@@ -140,6 +310,11 @@ status_t buildAPyramid(ogles_context_t* c, EGLTextureObject* tex)
             stride *= skip;
             for (int y=0 ; y<h ; y++) {
                 size_t offset = (y*2) * bs;
+                if (skip == 1) {
+                    downsampleRow8(dst + y*stride,
+                            src + offset, src + offset + bs, w);
+                    continue;
+                }
                 for (int x=0 ; x<w ; x++) {
                     for (int c=0 ; c<skip ; c++) {
                         uint32_t p00 = src[c+offset];
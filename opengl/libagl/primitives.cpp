@@ -733,8 +733,9 @@ void lerp_texcoords(ogles_context_t* c,
         const GLenum min_filter = c->textures.tmu[i].texture->min_filter;
         if (ggl_unlikely(min_filter >= GL_NEAREST_MIPMAP_NEAREST)) {
             int lod = compute_lod(c, i, s0, t0, s1, t1, s2, t2);
-            c->rasterizer.procs.bindTextureLod(c, i,
-                    &c->textures.tmu[i].texture->mip(lod));
+            EGLTextureObject* tex = c->textures.tmu[i].texture;
+            if (tex->decode(lod) == NO_ERROR)
+                c->rasterizer.procs.bindTextureLod(c, i, &tex->mip(lod));
         }
 
         // premultiply (s,t) when clampling
@@ -790,8 +791,9 @@ void lerp_texcoords_w(ogles_context_t* c,
         const GLenum min_filter = c->textures.tmu[i].texture->min_filter;
         if (ggl_unlikely(min_filter >= GL_NEAREST_MIPMAP_NEAREST)) {
             int lod = compute_lod(c, i, s0, t0, s1, t1, s2, t2);
-            c->rasterizer.procs.bindTextureLod(c, i,
-                    &c->textures.tmu[i].texture->mip(lod));
+            EGLTextureObject* tex = c->textures.tmu[i].texture;
+            if (tex->decode(lod) == NO_ERROR)
+                c->rasterizer.procs.bindTextureLod(c, i, &tex->mip(lod));
         }
 
         // premultiply (s,t) when clampling
@@ -25,6 +25,8 @@
 #include "vertex.h"
 #include "light.h"
 #include "texture.h"
+#include "tiling.h"
+#include "dxt.h"
 #include "BufferObjectManager.h"
 #include "TextureObjectManager.h"
 
@@ -50,6 +52,10 @@ static char const * const gExtensionsString =
     "GL_OES_EGL_sync "                      // OK
 #ifdef GL_OES_compressed_ETC1_RGB8_texture
     "GL_OES_compressed_ETC1_RGB8_texture "  // OK
+#endif
+#ifdef GL_EXT_texture_compression_dxt1
+    "GL_EXT_texture_compression_dxt1 "      // OK
+    "GL_EXT_texture_compression_s3tc "      // OK
 #endif
     "GL_ARB_texture_compression "           // OK
     "GL_ARB_texture_non_power_of_two "      // OK
@@ -72,6 +78,7 @@ ogles_context_t *ogles_init(size_t extra)
             (ogles_context_t *)((ptrdiff_t(base) + extra + 31) & ~0x1FL);
     memset(c, 0, sizeof(ogles_context_t));
     ggl_init_context(&(c->rasterizer));
+    ogles_init_tiling(c);
 
     // XXX: this should be passed as an argument
     sp<EGLSurfaceManager> smgr(new EGLSurfaceManager());
@@ -103,6 +110,7 @@ ogles_context_t *ogles_init(size_t extra)
 
 void ogles_uninit(ogles_context_t* c)
 {
+    ogles_uninit_tiling(c);
     ogles_uninit_array(c);
     ogles_uninit_matrix(c);
     ogles_uninit_vertex(c);
@@ -309,11 +317,15 @@ void glDisable(GLenum cap) {
 }
 
 void glFinish()
-{ // nothing to do for our software implementation
+{
+    ogles_context_t* c = ogles_context_t::get();
+    ogles_flush_tiles(c);
 }
 
 void glFlush()
-{ // nothing to do for our software implementation
+{
+    ogles_context_t* c = ogles_context_t::get();
+    ogles_flush_tiles(c);
 }
 
 GLenum glGetError()
@@ -404,6 +416,12 @@ void glGetIntegerv(GLenum pname, GLint *params)
         i = 10;
 #ifdef GL_OES_compressed_ETC1_RGB8_texture
         params[i++] = GL_ETC1_RGB8_OES;
+#endif
+#ifdef GL_EXT_texture_compression_dxt1
+        params[i++] = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        params[i++] = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+        params[i++] = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+        params[i++] = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
 #endif
         break;
     case GL_DEPTH_BITS:
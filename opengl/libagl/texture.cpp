@@ -21,10 +21,18 @@
 #include "fp.h"
 #include "state.h"
 #include "texture.h"
+#include "tiling.h"
 #include "TextureObjectManager.h"
+#include "dxt.h"
 
 #include <ETC1/etc1.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
 namespace android {
 
 // ----------------------------------------------------------------------------
@@ -77,6 +85,7 @@ void validate_tmu(ogles_context_t* c, int i)
     if (u.dirty) {
         u.dirty = 0;
         c->rasterizer.procs.activeTexture(c, i);
+        u.texture->decode(0);
         c->rasterizer.procs.bindTexture(c, &(u.texture->surface));
         c->rasterizer.procs.texGeni(c, GGL_S,
                 GGL_TEXTURE_GEN_MODE, GGL_AUTOMATIC);
@@ -114,27 +123,46 @@ void invalidate_texture(ogles_context_t* c, int tmu, uint8_t flags = 0xFF) {
 
 /*
  * If the active textures are EGLImage, they need to be locked before
- * they can be used.
+ * they can be used. Compressed textures get their base level decoded
+ * here the first time they are used.
  *
  * FIXME: code below is far from being optimal
  *
  */
 
+static gralloc_module_t const* getGrallocModule()
+{
+    // hw_get_module() searches the file system each time, and the textures
+    // of EGLImages are locked and unlocked around every draw
+    static gralloc_module_t const* sModule = 0;
+    if (ggl_unlikely(!sModule)) {
+        hw_module_t const* pModule;
+        if (hw_get_module(GRALLOC_HARDWARE_MODULE_ID, &pModule) == 0)
+            sModule = reinterpret_cast<gralloc_module_t const*>(pModule);
+    }
+    return sModule;
+}
+
 void ogles_lock_textures(ogles_context_t* c)
 {
     for (int i=0 ; i<GGL_TEXTURE_UNIT_COUNT ; i++) {
         if (c->rasterizer.state.texture[i].enable) {
             texture_unit_t& u(c->textures.tmu[i]);
+            if (ggl_unlikely(!u.texture->isDecoded(0))) {
+                c->rasterizer.procs.activeTexture(c, i);
+                if (u.texture->decode(0) != NO_ERROR) {
+                    c->rasterizer.procs.disable(c, GGL_TEXTURE_2D);
+                    continue;
+                }
+                c->rasterizer.procs.bindTexture(c, &(u.texture->surface));
+            }
             ANativeWindowBuffer* native_buffer = u.texture->buffer;
             if (native_buffer) {
                 c->rasterizer.procs.activeTexture(c, i);
-                hw_module_t const* pModule;
-                if (hw_get_module(GRALLOC_HARDWARE_MODULE_ID, &pModule))
+                gralloc_module_t const* module = getGrallocModule();
+                if (!module)
                     continue;
 
-                gralloc_module_t const* module =
-                    reinterpret_cast<gralloc_module_t const*>(pModule);
-
                 void* vaddr;
                 int err = module->lock(module, native_buffer->handle,
                         GRALLOC_USAGE_SW_READ_OFTEN,
@@ -155,14 +183,13 @@ void ogles_unlock_textures(ogles_context_t* c)
             texture_unit_t& u(c->textures.tmu[i]);
             ANativeWindowBuffer* native_buffer = u.texture->buffer;
             if (native_buffer) {
+                // deferred rendering may still read from the buffer
+                ogles_flush_tiles(c);
                 c->rasterizer.procs.activeTexture(c, i);
-                hw_module_t const* pModule;
-                if (hw_get_module(GRALLOC_HARDWARE_MODULE_ID, &pModule))
+                gralloc_module_t const* module = getGrallocModule();
+                if (!module)
                     continue;
 
-                gralloc_module_t const* module =
-                    reinterpret_cast<gralloc_module_t const*>(pModule);
-
                 module->unlock(module, native_buffer->handle);
                 u.texture->setImageBits(NULL);
                 c->rasterizer.procs.bindTexture(c, &(u.texture->surface));
@@ -265,6 +292,192 @@ GGLContext* getRasterizer(ogles_context_t* c)
     return ggl;
 }
 
+/*
+ * Row converters for the copies pixelflinger would otherwise do one pixel
+ * at a time.  They give the same results as its blits: components are
+ * expanded by replicating their bits, narrowed by truncation (dithering is
+ * off), and the alpha of opaque formats reads as 1.
+ */
+
+typedef void (*row_converter_t)(GGLubyte* dst, const GGLubyte* src, int w);
+
+static void convertRow565To8888(GGLubyte* dst, const GGLubyte* src, int w)
+{
+    const uint16_t* s = (const uint16_t*)src;
+    int x = 0;
+#if defined(__SSE2__)
+    const __m128i mask5 = _mm_set1_epi16(0x1F);
+    const __m128i mask6 = _mm_set1_epi16(0x3F);
+    const __m128i alpha = _mm_set1_epi16(0xFF00);
+    for ( ; x+8 <= w ; x += 8) {
+        const __m128i p = _mm_loadu_si128((__m128i const*)(s + x));
+        const __m128i r = _mm_srli_epi16(p, 11);
+        const __m128i g = _mm_and_si128(_mm_srli_epi16(p, 5), mask6);
+        const __m128i b = _mm_and_si128(p, mask5);
+        const __m128i r8 = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+        const __m128i g8 = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+        const __m128i b8 = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+        const __m128i rg = _mm_or_si128(r8, _mm_slli_epi16(g8, 8));
+        const __m128i ba = _mm_or_si128(b8, alpha);
+        _mm_storeu_si128((__m128i*)(dst + 4*x), _mm_unpacklo_epi16(rg, ba));
+        _mm_storeu_si128((__m128i*)(dst + 4*x + 16), _mm_unpackhi_epi16(rg, ba));
+    }
+#elif defined(__ARM_NEON__)
+    for ( ; x+8 <= w ; x += 8) {
+        const uint16x8_t p = vld1q_u16(s + x);
+        const uint8x8_t r = vmovn_u16(vshrq_n_u16(p, 11));
+        const uint8x8_t g = vmovn_u16(vshrq_n_u16(vshlq_n_u16(p, 5), 10));
+        const uint8x8_t b = vmovn_u16(vshrq_n_u16(vshlq_n_u16(p, 11), 11));
+        uint8x8x4_t d;
+        d.val[0] = vorr_u8(vshl_n_u8(r, 3), vshr_n_u8(r, 2));
+        d.val[1] = vorr_u8(vshl_n_u8(g, 2), vshr_n_u8(g, 4));
+        d.val[2] = vorr_u8(vshl_n_u8(b, 3), vshr_n_u8(b, 2));
+        d.val[3] = vdup_n_u8(0xFF);
+        vst4_u8(dst + 4*x, d);
+    }
+#endif
+    for ( ; x<w ; x++) {
+        const uint32_t p = s[x];
+        const uint32_t r = p >> 11;
+        const uint32_t g = (p >> 5) & 0x3F;
+        const uint32_t b = p & 0x1F;
+        dst[4*x + 0] = (r << 3) | (r >> 2);
+        dst[4*x + 1] = (g << 2) | (g >> 4);
+        dst[4*x + 2] = (b << 3) | (b >> 2);
+        dst[4*x + 3] = 0xFF;
+    }
+}
+
+static void convertRow8888To565(GGLubyte* dst, const GGLubyte* src, int w)
+{
+    uint16_t* d = (uint16_t*)dst;
+    int x = 0;
+#if defined(__SSE2__)
+    const __m128i maskR = _mm_set1_epi32(0xF800);
+    const __m128i maskG = _mm_set1_epi32(0x07E0);
+    const __m128i maskB = _mm_set1_epi32(0x001F);
+    for ( ; x+8 <= w ; x += 8) {
+        __m128i p[2];
+        for (int i=0 ; i<2 ; i++) {
+            const __m128i q = _mm_loadu_si128((__m128i const*)(src + 4*x + 16*i));
+            const __m128i v = _mm_or_si128(
+                    _mm_and_si128(_mm_slli_epi32(q, 8), maskR), _mm_or_si128(
+                    _mm_and_si128(_mm_srli_epi32(q, 5), maskG),
+                    _mm_and_si128(_mm_srli_epi32(q, 19), maskB)));
+            // sign-extend, so that the pack below doesn't saturate
+            p[i] = _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+        }
+        _mm_storeu_si128((__m128i*)(d + x), _mm_packs_epi32(p[0], p[1]));
+    }
+#elif defined(__ARM_NEON__)
+    for ( ; x+8 <= w ; x += 8) {
+        const uint8x8x4_t p = vld4_u8(src + 4*x);
+        uint16x8_t v = vshll_n_u8(p.val[0], 8);
+        v = vsriq_n_u16(v, vshll_n_u8(p.val[1], 8), 5);
+        v = vsriq_n_u16(v, vshll_n_u8(p.val[2], 8), 11);
+        vst1q_u16(d + x, v);
+    }
+#endif
+    for ( ; x<w ; x++) {
+        const uint32_t r = src[4*x + 0];
+        const uint32_t g = src[4*x + 1];
+        const uint32_t b = src[4*x + 2];
+        d[x] = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+    }
+}
+
+static void convertRowX888To8888(GGLubyte* dst, const GGLubyte* src, int w)
+{
+    int x = 0;
+#if defined(__SSE2__)
+    const __m128i alpha = _mm_set1_epi32(0xFF000000);
+    for ( ; x+4 <= w ; x += 4) {
+        const __m128i p = _mm_loadu_si128((__m128i const*)(src + 4*x));
+        _mm_storeu_si128((__m128i*)(dst + 4*x), _mm_or_si128(p, alpha));
+    }
+#elif defined(__ARM_NEON__)
+    const uint8x16_t alpha = vreinterpretq_u8_u32(vdupq_n_u32(0xFF000000));
+    for ( ; x+4 <= w ; x += 4) {
+        vst1q_u8(dst + 4*x, vorrq_u8(vld1q_u8(src + 4*x), alpha));
+    }
+#endif
+    for ( ; x<w ; x++) {
+        dst[4*x + 0] = src[4*x + 0];
+        dst[4*x + 1] = src[4*x + 1];
+        dst[4*x + 2] = src[4*x + 2];
+        dst[4*x + 3] = 0xFF;
+    }
+}
+
+static row_converter_t rowConverter(int32_t dstFormat, int32_t srcFormat)
+{
+    switch (srcFormat) {
+    case GGL_PIXEL_FORMAT_RGB_565:
+        if (dstFormat == GGL_PIXEL_FORMAT_RGBA_8888)
+            return convertRow565To8888;
+        break;
+    case GGL_PIXEL_FORMAT_RGBA_8888:
+    case GGL_PIXEL_FORMAT_RGBX_8888:
+        if (dstFormat == GGL_PIXEL_FORMAT_RGB_565)
+            return convertRow8888To565;
+        if (dstFormat == GGL_PIXEL_FORMAT_RGBA_8888)
+            return convertRowX888To8888;
+        break;
+    }
+    return 0;
+}
+
+// address of a pixel, for a negative stride too (the last row comes first)
+static GGLubyte* pixelAddress(const GGLSurface& s, size_t size, int x, int y)
+{
+    const ssize_t bpr = s.stride * ssize_t(size);
+    GGLubyte* data = s.data;
+    if (bpr < 0)
+        data -= bpr * ssize_t(s.height - 1);
+    return data + y*bpr + x*ssize_t(size);
+}
+
+/*
+ * Copies between a source and a destination that are the same format, or
+ * one of the converters above handles, one row at a time.  Leaves the rest,
+ * including the rectangles that aren't entirely within both surfaces, to
+ * the pixelflinger blit.
+ */
+static bool copyPixelsFast(
+        ogles_context_t* c,
+        const GGLSurface& dst,
+        GLint xoffset, GLint yoffset,
+        const GGLSurface& src,
+        GLint x, GLint y, GLsizei w, GLsizei h)
+{
+    if ((x|y|xoffset|yoffset) < 0 ||
+            (x + w > GLint(src.width)) || (y + h > GLint(src.height)) ||
+            (xoffset + w > GLint(dst.width)) ||
+            (yoffset + h > GLint(dst.height))) {
+        return false;
+    }
+
+    row_converter_t convert = 0;
+    if (dst.format != src.format) {
+        convert = rowConverter(dst.format, src.format);
+        if (!convert)
+            return false;
+    }
+
+    const size_t dsize = c->rasterizer.formats[dst.format].size;
+    const size_t ssize = c->rasterizer.formats[src.format].size;
+    for (GLsizei i=0 ; i<h ; i++) {
+        GGLubyte* d = pixelAddress(dst, dsize, xoffset, yoffset + i);
+        const GGLubyte* s = pixelAddress(src, ssize, x, y + i);
+        if (convert) {
+            convert(d, s, w);
+        } else {
+            memcpy(d, s, w * ssize);
+        }
+    }
+    return true;
+}
+
 static __attribute__((noinline))
 int copyPixels(
         ogles_context_t* c,
@@ -288,6 +501,9 @@ int copyPixels(
         return 0;
     }
 
+    if (copyPixelsFast(c, dst, xoffset, yoffset, src, x, y, w, h))
+        return 0;
+
     // use pixel-flinger to handle all the conversions
     GGLContext* ggl = getRasterizer(c);
     if (!ggl) {
@@ -347,8 +563,13 @@ void bindTextureTmu(
 
     // free the reference to the previously bound object
     texture_unit_t& u(c->textures.tmu[tmu]);
-    if (u.texture)
+    if (u.texture) {
+        if (u.texture->getStrongCount() == 1) {
+            // the object goes away, render what still reads from it
+            ogles_flush_tiles(c);
+        }
         u.texture->decStrong(c);
+    }
 
     // bind this texture to the current active texture unit
     // and add a reference to this texture object
@@ -363,6 +584,9 @@ int createTextureSurface(ogles_context_t* c,
         GLenum format, GLenum type, GLsizei width, GLsizei height,
         GLenum compressedFormat = 0)
 {
+    // the storage of the texture may be reallocated
+    ogles_flush_tiles(c);
+
     // find out which texture is bound to the current unit
     const int active = c->textures.active;
     const GLuint name = c->textures.tmu[active].name;
@@ -492,26 +716,22 @@ static void decodePalette4(const GLvoid *data, int level, int width, int height,
     width  = (width  >> level) ? : 1;
     height = (height >> level) ? : 1;
 
+    // whole texels are copied from an aligned copy of the palette
     if (entrySize == 2) {
-        uint8_t const* const palette = (uint8_t*)data;
+        uint16_t palette[256];
+        memcpy(palette, data, paletteSize);
         for (int y=0 ; y<height ; y++) {
-            uint8_t* p = (uint8_t*)surface + y*stride*2;
+            uint16_t* p = (uint16_t*)surface + y*stride;
             if (indexBits == 8) {
                 for (int x=0 ; x<width ; x++) {
-                    int index = 2 * (*pixels++);
-                    *p++ = palette[index + 0];
-                    *p++ = palette[index + 1];
+                    p[x] = palette[*pixels++];
                 }
             } else {
                 for (int x=0 ; x<width ; x+=2) {
                     int v = *pixels++;
-                    int index = 2 * (v >> 4);
-                    *p++ = palette[index + 0];
-                    *p++ = palette[index + 1];
+                    p[x] = palette[v >> 4];
                     if (x+1 < width) {
-                        index = 2 * (v & 0xF);
-                        *p++ = palette[index + 0];
-                        *p++ = palette[index + 1];
+                        p[x+1] = palette[v & 0xF];
                     }
                 }
             }
@@ -544,31 +764,20 @@ static void decodePalette4(const GLvoid *data, int level, int width, int height,
             }
         }
     } else if (entrySize == 4) {
-        uint8_t const* const palette = (uint8_t*)data;
+        uint32_t palette[256];
+        memcpy(palette, data, paletteSize);
         for (int y=0 ; y<height ; y++) {
-            uint8_t* p = (uint8_t*)surface + y*stride*4;
+            uint32_t* p = (uint32_t*)surface + y*stride;
             if (indexBits == 8) {
                 for (int x=0 ; x<width ; x++) {
-                    int index = 4 * (*pixels++);
-                    *p++ = palette[index + 0];
-                    *p++ = palette[index + 1];
-                    *p++ = palette[index + 2];
-                    *p++ = palette[index + 3];
+                    p[x] = palette[*pixels++];
                 }
             } else {
                 for (int x=0 ; x<width ; x+=2) {
                     int v = *pixels++;
-                    int index = 4 * (v >> 4);
-                    *p++ = palette[index + 0];
-                    *p++ = palette[index + 1];
-                    *p++ = palette[index + 2];
-                    *p++ = palette[index + 3];
+                    p[x] = palette[v >> 4];
                     if (x+1 < width) {
-                        index = 4 * (v & 0xF);
-                        *p++ = palette[index + 0];
-                        *p++ = palette[index + 1];
-                        *p++ = palette[index + 2];
-                        *p++ = palette[index + 3];
+                        p[x+1] = palette[v & 0xF];
                     }
                 }
             }
@@ -907,6 +1116,9 @@ void glDeleteTextures(GLsizei n, const GLuint *textures)
         return;
     }
 
+    // the objects may still be read by deferred rendering
+    ogles_flush_tiles(c);
+
     // If deleting a bound texture, bind this unit to 0
     for (int t=0 ; t<GGL_TEXTURE_UNIT_COUNT ; t++) {
         if (c->textures.tmu[t].name == 0)
@@ -1103,6 +1315,21 @@ void glCompressedTexImage2D(
         format      = GL_RGB;
         type        = GL_UNSIGNED_BYTE;
         break;
+#endif
+#ifdef GL_EXT_texture_compression_dxt1
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        format      = GL_RGB;
+        type        = GL_UNSIGNED_SHORT_5_6_5;
+        break;
+    case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+        format      = GL_RGBA;
+        type        = GL_UNSIGNED_SHORT_5_5_5_1;
+        break;
+    case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        format      = GL_RGBA;
+        type        = GL_UNSIGNED_BYTE;
+        break;
 #endif
     default:
         ogles_error(c, GL_INVALID_ENUM);
@@ -1140,6 +1367,33 @@ void glCompressedTexImage2D(
     }
 #endif
 
+#ifdef GL_EXT_texture_compression_dxt1
+    const size_t dxtSize = DXTDataSize(width, height, internalformat);
+    if (dxtSize) {
+        if (level < 0) {
+            ogles_error(c, GL_INVALID_VALUE);
+            return;
+        }
+        if (GLsizei(dxtSize) > imageSize) {
+            ogles_error(c, GL_INVALID_VALUE);
+            return;
+        }
+        int error = createTextureSurface(c, &surface, &size,
+                level, format, type, width, height, internalformat);
+        if (error) {
+            ogles_error(c, error);
+            return;
+        }
+        // the level is only decoded when it gets used, until then
+        // we just keep the compressed data around.
+        EGLTextureObject* tex = c->textures.tmu[c->textures.active].texture;
+        if (tex->setCompressedData(level, data, dxtSize) != NO_ERROR) {
+            ogles_error(c, GL_OUT_OF_MEMORY);
+        }
+        return;
+    }
+#endif
+
     // all mipmap levels are specified at once.
     const int numLevels = level<0 ? -level : 1;
 
@@ -1253,6 +1507,11 @@ void glTexSubImage2D(
     // find out which texture is bound to the current unit
     const int active = c->textures.active;
     EGLTextureObject* tex = c->textures.tmu[active].texture;
+    ogles_flush_tiles(c);
+    if (tex->decode(level) != NO_ERROR) {
+        ogles_error(c, GL_OUT_OF_MEMORY);
+        return;
+    }
     const GGLSurface& surface(tex->mip(level));
 
     if (!tex->internalformat || tex->direct) {
@@ -1437,6 +1696,11 @@ void glCopyTexSubImage2D(
     // find out which texture is bound to the current unit
     const int active = c->textures.active;
     EGLTextureObject* tex = c->textures.tmu[active].texture;
+    ogles_flush_tiles(c);
+    if (tex->decode(level) != NO_ERROR) {
+        ogles_error(c, GL_OUT_OF_MEMORY);
+        return;
+    }
     const GGLSurface& surface(tex->mip(level));
 
     if (!tex->internalformat) {
@@ -1511,6 +1775,8 @@ void glReadPixels(
         return;
     }
 
+    ogles_flush_tiles(c);
+
     const GGLSurface& readSurface = c->rasterizer.state.buffers.read.s;
     if ((x+width > GLint(readSurface.width)) ||
             (y+height > GLint(readSurface.height))) {
@@ -1532,6 +1798,11 @@ void glReadPixels(
     userSurface.compressedFormat = 0;
     userSurface.data = (GLubyte*)pixels;
 
+    if (copyPixelsFast(c, userSurface, 0, 0, readSurface,
+            x, readSurface.height - (y + height), width, height)) {
+        return;
+    }
+
     // use pixel-flinger to handle all the conversions
     GGLContext* ggl = getRasterizer(c);
     if (!ggl) {
@@ -1624,8 +1895,19 @@ void glEGLImageTargetTexture2DOES(GLenum target, GLeglImageOES image)
         return;
     }
 
+    // the buffer is sampled in place, so it must be in a format
+    // pixelflinger reads
+    size_t numFormats;
+    const GGLFormat* formats = gglGetPixelFormatTable(&numFormats);
+    if (uint32_t(native_buffer->format) >= numFormats ||
+            !formats[native_buffer->format].size) {
+        ogles_error(c, GL_INVALID_OPERATION);
+        return;
+    }
+
     // bind it to the texture unit
     sp<EGLTextureObject> tex = getAndBindActiveTextureObject(c);
+    ogles_flush_tiles(c);
     tex->setImage(native_buffer);
 }
 
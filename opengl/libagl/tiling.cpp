@@ -0,0 +1,957 @@
+/* libs/opengles/tiling.cpp
+**
+** Copyright 2012, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <cutils/atomic.h>
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include <utils/threads.h>
+
+#include "context.h"
+#include "tiling.h"
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+
+/*
+ * The rasterizer procs of a tiled context are replaced by recorders.  State
+ * procs still reach the context's own rasterizer, so that everything libagl
+ * reads back from c->rasterizer.state stays accurate, and are also appended
+ * to a command stream; drawing procs are only appended, along with the rows
+ * of the color buffer they can touch.
+ *
+ * At flush time the color buffer is cut in horizontal bands, which suits
+ * pixelflinger's scanline rasterizer.  Each band owns a pixelflinger context
+ * that lives as long as the GL context, replays every state command and the
+ * drawing commands overlapping it, with its scissor rectangle clamped to the
+ * band.  Bands never share pixels so they need no synchronization; the
+ * calling thread renders bands too, and waits for the others to be done.
+ */
+
+static const int MAX_THREADS = 8;
+static const int BANDS_PER_THREAD = 4;
+static const int MAX_BANDS = MAX_THREADS * BANDS_PER_THREAD;
+
+// a stream larger than this is rendered right away
+static const size_t MAX_STREAM_SIZE = 4 * 1024 * 1024;
+
+enum {
+    TILE_COLOR_BUFFER,
+    TILE_READ_BUFFER,
+    TILE_DEPTH_BUFFER,
+    TILE_BIND_TEXTURE,
+    TILE_BIND_TEXTURE_LOD,
+    TILE_SCISSOR,
+    TILE_ENABLE,
+    TILE_DISABLE,
+    TILE_ENABLE_DISABLE,
+    TILE_SHADE_MODEL,
+    TILE_COLOR4,
+    TILE_COLOR_GRAD,
+    TILE_Z_GRAD,
+    TILE_W_GRAD,
+    TILE_FOG_GRAD,
+    TILE_FOG_COLOR,
+    TILE_BLEND_FUNC,
+    TILE_ALPHA_FUNC,
+    TILE_DEPTH_FUNC,
+    TILE_LOGIC_OP,
+    TILE_COLOR_MASK,
+    TILE_DEPTH_MASK,
+    TILE_STENCIL_MASK,
+    TILE_CLEAR_COLOR,
+    TILE_CLEAR_DEPTH,
+    TILE_CLEAR_STENCIL,
+    TILE_ACTIVE_TEXTURE,
+    TILE_TEX_GEN,
+    TILE_TEX_PARAMETER,
+    TILE_TEX_ENV,
+    TILE_TEX_ENV_V,
+    TILE_TEX_COORD,
+    TILE_TEX_COORD_GRAD,
+    // drawing commands, the only ones with a meaningful top and bottom
+    TILE_CLEAR,
+    TILE_POINT,
+    TILE_LINE,
+    TILE_RECT,
+    TILE_TRIANGLE
+};
+
+struct tile_cmd_t {
+    uint16_t    op;
+    uint16_t    size;       // in bytes, header included, multiple of 8
+    uint32_t    reserved;
+    int32_t     top;        // rows [top, bottom) a drawing command touches
+    int32_t     bottom;
+    int32_t     args[0];
+
+    // commands taking a surface store it after two words of arguments
+    inline GGLSurface* surface() {
+        return reinterpret_cast<GGLSurface*>(args + 2);
+    }
+};
+
+struct tile_band_t {
+    GGLContext* ggl;
+    int32_t     scissor[4];     // the application's, in buffer coordinates
+    bool        scissorTest;
+};
+
+struct tiling_t {
+    // the context's own rasterizer, and its original procs
+    context_t*      rasterizer;
+    GGLContext      procs;
+
+    uint8_t*        stream;
+    size_t          size;
+    size_t          capacity;
+    bool            hasDraws;
+    size_t          width;
+    size_t          height;
+
+    int             numBands;
+    tile_band_t     bands[MAX_BANDS];
+
+    int             numThreads;
+    pthread_t       threads[MAX_THREADS];
+    Mutex           lock;
+    Condition       workCondition;
+    Condition       doneCondition;
+    int32_t         generation;
+    bool            exitPending;
+    volatile int32_t nextBand;
+    volatile int32_t pendingBands;
+};
+
+static void renderStream(tiling_t* t);
+
+// ----------------------------------------------------------------------------
+#if 0
+#pragma mark -
+#pragma mark Recording
+#endif
+
+static inline tiling_t* tilingOf(void* con) {
+    return static_cast<ogles_context_t*>(con)->tiling;
+}
+
+static tile_cmd_t* newCommand(tiling_t* t, int op, size_t args,
+        bool hasSurface = false)
+{
+    size_t size = sizeof(tile_cmd_t) + args * sizeof(int32_t);
+    if (hasSurface)
+        size = sizeof(tile_cmd_t) + 2 * sizeof(int32_t) + sizeof(GGLSurface);
+    size = (size + 7) & ~7;
+
+    if (ggl_unlikely(t->size + size > t->capacity)) {
+        if (t->size + size > MAX_STREAM_SIZE) {
+            renderStream(t);
+        }
+        if (t->size + size > t->capacity) {
+            size_t capacity = t->capacity ? t->capacity * 2 : 64*1024;
+            uint8_t* stream = (uint8_t*)realloc(t->stream, capacity);
+            if (!stream) {
+                // not much we can do but render what we have, and hope
+                // the stream we already have is large enough
+                renderStream(t);
+                if (size > t->capacity)
+                    return 0;
+            } else {
+                t->stream = stream;
+                t->capacity = capacity;
+            }
+        }
+    }
+
+    tile_cmd_t* cmd = reinterpret_cast<tile_cmd_t*>(t->stream + t->size);
+    cmd->op = op;
+    cmd->size = size;
+    cmd->top = 0;
+    cmd->bottom = 0;
+    t->size += size;
+    return cmd;
+}
+
+static inline void recordInts(tiling_t* t, int op,
+        int32_t a0)
+{
+    tile_cmd_t* cmd = newCommand(t, op, 1);
+    if (cmd) {
+        cmd->args[0] = a0;
+    }
+}
+
+static inline void recordInts(tiling_t* t, int op,
+        int32_t a0, int32_t a1)
+{
+    tile_cmd_t* cmd = newCommand(t, op, 2);
+    if (cmd) {
+        cmd->args[0] = a0;
+        cmd->args[1] = a1;
+    }
+}
+
+static inline void recordInts(tiling_t* t, int op,
+        int32_t a0, int32_t a1, int32_t a2)
+{
+    tile_cmd_t* cmd = newCommand(t, op, 3);
+    if (cmd) {
+        cmd->args[0] = a0;
+        cmd->args[1] = a1;
+        cmd->args[2] = a2;
+    }
+}
+
+static inline void recordInts(tiling_t* t, int op,
+        int32_t a0, int32_t a1, int32_t a2, int32_t a3)
+{
+    tile_cmd_t* cmd = newCommand(t, op, 4);
+    if (cmd) {
+        cmd->args[0] = a0;
+        cmd->args[1] = a1;
+        cmd->args[2] = a2;
+        cmd->args[3] = a3;
+    }
+}
+
+static inline void recordVector(tiling_t* t, int op,
+        const int32_t* v, size_t count, size_t skip = 0,
+        int32_t a0 = 0, int32_t a1 = 0)
+{
+    // the first 'skip' words (at most 2) are a0, a1
+    tile_cmd_t* cmd = newCommand(t, op, skip + count);
+    if (cmd) {
+        if (skip > 0) cmd->args[0] = a0;
+        if (skip > 1) cmd->args[1] = a1;
+        memcpy(cmd->args + skip, v, count * sizeof(int32_t));
+    }
+}
+
+static inline void recordSurface(tiling_t* t, int op,
+        const GGLSurface* surface, int32_t a0 = 0)
+{
+    tile_cmd_t* cmd = newCommand(t, op, 0, true);
+    if (cmd) {
+        cmd->args[0] = a0;
+        memcpy(cmd->surface(), surface, sizeof(GGLSurface));
+    }
+}
+
+static inline void recordDraw(tiling_t* t, tile_cmd_t* cmd,
+        int32_t ymin, int32_t ymax, int32_t margin)
+{
+    // ymin and ymax are window coordinates with TRI_FRACTION_BITS of
+    // fraction; the margin covers antialiasing and rounding
+    cmd->top = (ymin >> TRI_FRACTION_BITS) - margin;
+    cmd->bottom = (ymax >> TRI_FRACTION_BITS) + 1 + margin;
+    t->hasDraws = true;
+}
+
+// ----------------------------------------------------------------------------
+
+static void rec_colorBuffer(void* con, const GGLSurface* surface)
+{
+    tiling_t* t = tilingOf(con);
+    // the bands are cut from the current color buffer, render what
+    // was meant for the previous one before switching
+    if (t->hasDraws)
+        renderStream(t);
+    t->procs.colorBuffer(con, surface);
+    recordSurface(t, TILE_COLOR_BUFFER, surface);
+}
+
+static void rec_readBuffer(void* con, const GGLSurface* surface)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.readBuffer(con, surface);
+    recordSurface(t, TILE_READ_BUFFER, surface);
+}
+
+static void rec_depthBuffer(void* con, const GGLSurface* surface)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.depthBuffer(con, surface);
+    recordSurface(t, TILE_DEPTH_BUFFER, surface);
+}
+
+static void rec_bindTexture(void* con, const GGLSurface* surface)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.bindTexture(con, surface);
+    recordSurface(t, TILE_BIND_TEXTURE, surface);
+}
+
+static void rec_bindTextureLod(void* con, GLuint tmu, const GGLSurface* lod)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.bindTextureLod(con, tmu, lod);
+    recordSurface(t, TILE_BIND_TEXTURE_LOD, lod, tmu);
+}
+
+static void rec_scissor(void* con, GLint x, GLint y, GLsizei w, GLsizei h)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.scissor(con, x, y, w, h);
+    recordInts(t, TILE_SCISSOR, x, y, w, h);
+}
+
+static void rec_enable(void* con, GLenum name)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.enable(con, name);
+    recordInts(t, TILE_ENABLE, name);
+}
+
+static void rec_disable(void* con, GLenum name)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.disable(con, name);
+    recordInts(t, TILE_DISABLE, name);
+}
+
+static void rec_enableDisable(void* con, GLenum name, GLboolean en)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.enableDisable(con, name, en);
+    recordInts(t, TILE_ENABLE_DISABLE, name, en);
+}
+
+static void rec_shadeModel(void* con, GLenum mode)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.shadeModel(con, mode);
+    recordInts(t, TILE_SHADE_MODEL, mode);
+}
+
+static void rec_color4xv(void* con, const GGLfixed* color)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.color4xv(con, color);
+    recordVector(t, TILE_COLOR4, color, 4);
+}
+
+static void rec_colorGrad12xv(void* con, const GGLcolor* grad)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.colorGrad12xv(con, grad);
+    recordVector(t, TILE_COLOR_GRAD, grad, 12);
+}
+
+static void rec_zGrad3xv(void* con, const int32_t* grad)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.zGrad3xv(con, grad);
+    recordVector(t, TILE_Z_GRAD, grad, 3);
+}
+
+static void rec_wGrad3xv(void* con, const int32_t* grad)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.wGrad3xv(con, grad);
+    recordVector(t, TILE_W_GRAD, grad, 3);
+}
+
+static void rec_fogGrad3xv(void* con, const GGLfixed* grad)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.fogGrad3xv(con, grad);
+    recordVector(t, TILE_FOG_GRAD, grad, 3);
+}
+
+static void rec_fogColor3xv(void* con, const GGLfixed* color)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.fogColor3xv(con, color);
+    recordVector(t, TILE_FOG_COLOR, color, 3);
+}
+
+static void rec_blendFunc(void* con, GLenum src, GLenum dst)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.blendFunc(con, src, dst);
+    recordInts(t, TILE_BLEND_FUNC, src, dst);
+}
+
+static void rec_alphaFuncx(void* con, GLenum func, GGLfixed ref)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.alphaFuncx(con, func, ref);
+    recordInts(t, TILE_ALPHA_FUNC, func, ref);
+}
+
+static void rec_depthFunc(void* con, GLenum func)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.depthFunc(con, func);
+    recordInts(t, TILE_DEPTH_FUNC, func);
+}
+
+static void rec_logicOp(void* con, GLenum opcode)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.logicOp(con, opcode);
+    recordInts(t, TILE_LOGIC_OP, opcode);
+}
+
+static void rec_colorMask(void* con,
+        GLboolean r, GLboolean g, GLboolean b, GLboolean a)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.colorMask(con, r, g, b, a);
+    recordInts(t, TILE_COLOR_MASK, r, g, b, a);
+}
+
+static void rec_depthMask(void* con, GLboolean flag)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.depthMask(con, flag);
+    recordInts(t, TILE_DEPTH_MASK, flag);
+}
+
+static void rec_stencilMask(void* con, GLuint mask)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.stencilMask(con, mask);
+    recordInts(t, TILE_STENCIL_MASK, mask);
+}
+
+static void rec_clearColorx(void* con,
+        GGLfixed r, GGLfixed g, GGLfixed b, GGLfixed a)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.clearColorx(con, r, g, b, a);
+    recordInts(t, TILE_CLEAR_COLOR, r, g, b, a);
+}
+
+static void rec_clearDepthx(void* con, GGLfixed depth)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.clearDepthx(con, depth);
+    recordInts(t, TILE_CLEAR_DEPTH, depth);
+}
+
+static void rec_clearStencil(void* con, GLint s)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.clearStencil(con, s);
+    recordInts(t, TILE_CLEAR_STENCIL, s);
+}
+
+static void rec_activeTexture(void* con, GLuint tmu)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.activeTexture(con, tmu);
+    recordInts(t, TILE_ACTIVE_TEXTURE, tmu);
+}
+
+static void rec_texGeni(void* con, GLenum coord, GLenum pname, GLint param)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.texGeni(con, coord, pname, param);
+    recordInts(t, TILE_TEX_GEN, coord, pname, param);
+}
+
+static void rec_texParameteri(void* con,
+        GLenum target, GLenum pname, GLint param)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.texParameteri(con, target, pname, param);
+    recordInts(t, TILE_TEX_PARAMETER, target, pname, param);
+}
+
+static void rec_texEnvi(void* con, GLenum target, GLenum pname, GLint param)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.texEnvi(con, target, pname, param);
+    recordInts(t, TILE_TEX_ENV, target, pname, param);
+}
+
+static void rec_texEnvxv(void* con,
+        GLenum target, GLenum pname, const GGLfixed* params)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.texEnvxv(con, target, pname, params);
+    // only GL_TEXTURE_ENV_COLOR takes a vector
+    recordVector(t, TILE_TEX_ENV_V, params, 4, 2, target, pname);
+}
+
+static void rec_texCoord2i(void* con, GLint s, GLint t0)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.texCoord2i(con, s, t0);
+    recordInts(t, TILE_TEX_COORD, s, t0);
+}
+
+static void rec_texCoordGradScale8xv(void* con,
+        GLint tmu, const int32_t* grad8)
+{
+    tiling_t* t = tilingOf(con);
+    t->procs.texCoordGradScale8xv(con, tmu, grad8);
+    recordVector(t, TILE_TEX_COORD_GRAD, grad8, 8, 1, tmu);
+}
+
+// ----------------------------------------------------------------------------
+
+static void rec_clear(void* con, GLbitfield mask)
+{
+    tiling_t* t = tilingOf(con);
+    tile_cmd_t* cmd = newCommand(t, TILE_CLEAR, 1);
+    if (cmd) {
+        cmd->args[0] = mask;
+        cmd->top = INT_MIN;
+        cmd->bottom = INT_MAX;
+        t->hasDraws = true;
+    }
+}
+
+static void rec_pointx(void* con, const GGLcoord* v, GGLcoord size)
+{
+    tiling_t* t = tilingOf(con);
+    tile_cmd_t* cmd = newCommand(t, TILE_POINT, 3);
+    if (cmd) {
+        cmd->args[0] = v[0];
+        cmd->args[1] = v[1];
+        cmd->args[2] = size;
+        const int32_t r = (size >> (TRI_FRACTION_BITS+1)) + 2;
+        recordDraw(t, cmd, v[1], v[1], r);
+    }
+}
+
+static void rec_linex(void* con,
+        const GGLcoord* v0, const GGLcoord* v1, GGLcoord width)
+{
+    tiling_t* t = tilingOf(con);
+    tile_cmd_t* cmd = newCommand(t, TILE_LINE, 5);
+    if (cmd) {
+        cmd->args[0] = v0[0];
+        cmd->args[1] = v0[1];
+        cmd->args[2] = v1[0];
+        cmd->args[3] = v1[1];
+        cmd->args[4] = width;
+        const int32_t r = (width >> (TRI_FRACTION_BITS+1)) + 2;
+        recordDraw(t, cmd, min(v0[1], v1[1]), max(v0[1], v1[1]), r);
+    }
+}
+
+static void rec_recti(void* con, GLint l, GLint tp, GLint r, GLint b)
+{
+    tiling_t* t = tilingOf(con);
+    tile_cmd_t* cmd = newCommand(t, TILE_RECT, 4);
+    if (cmd) {
+        cmd->args[0] = l;
+        cmd->args[1] = tp;
+        cmd->args[2] = r;
+        cmd->args[3] = b;
+        cmd->top = tp;
+        cmd->bottom = b;
+        t->hasDraws = true;
+    }
+}
+
+static void rec_trianglex(void* con,
+        const GGLcoord* v0, const GGLcoord* v1, const GGLcoord* v2)
+{
+    tiling_t* t = tilingOf(con);
+    tile_cmd_t* cmd = newCommand(t, TILE_TRIANGLE, 6);
+    if (cmd) {
+        cmd->args[0] = v0[0];
+        cmd->args[1] = v0[1];
+        cmd->args[2] = v1[0];
+        cmd->args[3] = v1[1];
+        cmd->args[4] = v2[0];
+        cmd->args[5] = v2[1];
+        const int32_t ymin = min(v0[1], min(v1[1], v2[1]));
+        const int32_t ymax = max(v0[1], max(v1[1], v2[1]));
+        recordDraw(t, cmd, ymin, ymax, 1);
+    }
+}
+
+// ----------------------------------------------------------------------------
+#if 0
+#pragma mark -
+#pragma mark Rendering
+#endif
+
+static void setBandScissor(tiling_t* t, tile_band_t& band,
+        int32_t top, int32_t bottom)
+{
+    int32_t l = 0;
+    int32_t r = t->width;
+    if (band.scissorTest) {
+        l   = max(l,   band.scissor[0]);
+        top = max(top, band.scissor[1]);
+        r   = min(r,   band.scissor[0] + band.scissor[2]);
+        bottom = min(bottom, band.scissor[1] + band.scissor[3]);
+    }
+    if (r < l)          r = l;
+    if (bottom < top)   bottom = top;
+    band.ggl->scissor(band.ggl, l, top, r - l, bottom - top);
+}
+
+static void renderBand(tiling_t* t, int index)
+{
+    tile_band_t& band(t->bands[index]);
+    GGLContext* const g = band.ggl;
+    const int32_t top = (t->height * index) / t->numBands;
+    const int32_t bottom = (t->height * (index + 1)) / t->numBands;
+    setBandScissor(t, band, top, bottom);
+
+    const uint8_t* p = t->stream;
+    const uint8_t* const end = t->stream + t->size;
+    while (p < end) {
+        tile_cmd_t* cmd = (tile_cmd_t*)p;
+        const int32_t* a = cmd->args;
+        p += cmd->size;
+        switch (cmd->op) {
+        case TILE_COLOR_BUFFER:
+            g->colorBuffer(g, cmd->surface());
+            break;
+        case TILE_READ_BUFFER:
+            g->readBuffer(g, cmd->surface());
+            break;
+        case TILE_DEPTH_BUFFER:
+            g->depthBuffer(g, cmd->surface());
+            break;
+        case TILE_BIND_TEXTURE:
+            g->bindTexture(g, cmd->surface());
+            break;
+        case TILE_BIND_TEXTURE_LOD:
+            g->bindTextureLod(g, a[0], cmd->surface());
+            break;
+        case TILE_SCISSOR:
+            memcpy(band.scissor, a, sizeof(band.scissor));
+            setBandScissor(t, band, top, bottom);
+            break;
+        case TILE_ENABLE:
+        case TILE_DISABLE:
+        case TILE_ENABLE_DISABLE: {
+            // the band's scissor test is always on, only the
+            // application's rectangle comes and goes
+            const bool en = (cmd->op == TILE_ENABLE) ||
+                    (cmd->op == TILE_ENABLE_DISABLE && a[1]);
+            if (a[0] == GGL_SCISSOR_TEST) {
+                band.scissorTest = en;
+                setBandScissor(t, band, top, bottom);
+            } else {
+                g->enableDisable(g, a[0], en);
+            }
+            break;
+        }
+        case TILE_SHADE_MODEL:
+            g->shadeModel(g, a[0]);
+            break;
+        case TILE_COLOR4:
+            g->color4xv(g, a);
+            break;
+        case TILE_COLOR_GRAD:
+            g->colorGrad12xv(g, a);
+            break;
+        case TILE_Z_GRAD:
+            g->zGrad3xv(g, a);
+            break;
+        case TILE_W_GRAD:
+            g->wGrad3xv(g, a);
+            break;
+        case TILE_FOG_GRAD:
+            g->fogGrad3xv(g, a);
+            break;
+        case TILE_FOG_COLOR:
+            g->fogColor3xv(g, a);
+            break;
+        case TILE_BLEND_FUNC:
+            g->blendFunc(g, a[0], a[1]);
+            break;
+        case TILE_ALPHA_FUNC:
+            g->alphaFuncx(g, a[0], a[1]);
+            break;
+        case TILE_DEPTH_FUNC:
+            g->depthFunc(g, a[0]);
+            break;
+        case TILE_LOGIC_OP:
+            g->logicOp(g, a[0]);
+            break;
+        case TILE_COLOR_MASK:
+            g->colorMask(g, a[0], a[1], a[2], a[3]);
+            break;
+        case TILE_DEPTH_MASK:
+            g->depthMask(g, a[0]);
+            break;
+        case TILE_STENCIL_MASK:
+            g->stencilMask(g, a[0]);
+            break;
+        case TILE_CLEAR_COLOR:
+            g->clearColorx(g, a[0], a[1], a[2], a[3]);
+            break;
+        case TILE_CLEAR_DEPTH:
+            g->clearDepthx(g, a[0]);
+            break;
+        case TILE_CLEAR_STENCIL:
+            g->clearStencil(g, a[0]);
+            break;
+        case TILE_ACTIVE_TEXTURE:
+            g->activeTexture(g, a[0]);
+            break;
+        case TILE_TEX_GEN:
+            g->texGeni(g, a[0], a[1], a[2]);
+            break;
+        case TILE_TEX_PARAMETER:
+            g->texParameteri(g, a[0], a[1], a[2]);
+            break;
+        case TILE_TEX_ENV:
+            g->texEnvi(g, a[0], a[1], a[2]);
+            break;
+        case TILE_TEX_ENV_V:
+            g->texEnvxv(g, a[0], a[1], a + 2);
+            break;
+        case TILE_TEX_COORD:
+            g->texCoord2i(g, a[0], a[1]);
+            break;
+        case TILE_TEX_COORD_GRAD:
+            g->texCoordGradScale8xv(g, a[0], a + 1);
+            break;
+        default:
+            // drawing commands
+            if (cmd->top >= bottom || cmd->bottom <= top)
+                break;
+            switch (cmd->op) {
+            case TILE_CLEAR:
+                g->clear(g, a[0]);
+                break;
+            case TILE_POINT:
+                g->pointx(g, a, a[2]);
+                break;
+            case TILE_LINE:
+                g->linex(g, a, a + 2, a[4]);
+                break;
+            case TILE_RECT:
+                g->recti(g, a[0], a[1], a[2], a[3]);
+                break;
+            case TILE_TRIANGLE:
+                g->trianglex(g, a, a + 2, a + 4);
+                break;
+            }
+            break;
+        }
+    }
+}
+
+static void renderBands(tiling_t* t)
+{
+    int32_t index;
+    while ((index = android_atomic_inc(&t->nextBand)) < t->numBands) {
+        renderBand(t, index);
+        if (android_atomic_dec(&t->pendingBands) == 1) {
+            Mutex::Autolock _l(t->lock);
+            t->doneCondition.signal();
+        }
+    }
+}
+
+static void* tileWorker(void* arg)
+{
+    tiling_t* t = static_cast<tiling_t*>(arg);
+    t->lock.lock();
+    int32_t generation = t->generation;
+    while (true) {
+        while (t->generation == generation && !t->exitPending)
+            t->workCondition.wait(t->lock);
+        if (t->exitPending)
+            break;
+        generation = t->generation;
+        t->lock.unlock();
+        renderBands(t);
+        t->lock.lock();
+    }
+    t->lock.unlock();
+    return 0;
+}
+
+static void renderStream(tiling_t* t)
+{
+    if (!t->size)
+        return;
+
+    t->width = t->rasterizer->state.buffers.color.width;
+    t->height = t->rasterizer->state.buffers.color.height;
+    t->pendingBands = t->numBands;
+    // late workers of the previous flush may pick up bands as soon as
+    // this is reset, everything above must be visible to them by then
+    android_atomic_release_store(0, &t->nextBand);
+    t->lock.lock();
+    t->generation++;
+    t->workCondition.broadcast();
+    t->lock.unlock();
+
+    renderBands(t);
+
+    t->lock.lock();
+    while (android_atomic_acquire_load(&t->pendingBands) > 0)
+        t->doneCondition.wait(t->lock);
+    t->lock.unlock();
+
+    t->size = 0;
+    t->hasDraws = false;
+}
+
+// ----------------------------------------------------------------------------
+#if 0
+#pragma mark -
+#pragma mark Setup
+#endif
+
+#define HOOK(_name) \
+    c->rasterizer.procs._name = \
+            (__typeof__(c->rasterizer.procs._name))rec_##_name
+
+void ogles_init_tiling(ogles_context_t* c)
+{
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.libagl.tiling", value, "0");
+    const int numThreads = min(atoi(value), MAX_THREADS);
+    if (numThreads <= 0)
+        return;
+
+    tiling_t* t = new tiling_t;
+    t->rasterizer = &c->rasterizer;
+    t->procs = c->rasterizer.procs;
+    t->stream = 0;
+    t->size = 0;
+    t->capacity = 0;
+    t->hasDraws = false;
+    t->width = 0;
+    t->height = 0;
+    t->generation = 0;
+    t->exitPending = false;
+    t->nextBand = 0;
+    t->pendingBands = 0;
+
+    t->numBands = 0;
+    for (int i=0 ; i<numThreads*BANDS_PER_THREAD ; i++) {
+        tile_band_t& band(t->bands[i]);
+        gglInit(&band.ggl);
+        if (!band.ggl)
+            break;
+        band.ggl->enable(band.ggl, GGL_SCISSOR_TEST);
+        band.scissor[0] = 0;
+        band.scissor[1] = 0;
+        band.scissor[2] = 0;
+        band.scissor[3] = 0;
+        band.scissorTest = false;
+        t->numBands++;
+    }
+
+    t->numThreads = 0;
+    for (int i=0 ; i<numThreads-1 ; i++) {
+        if (pthread_create(&t->threads[i], 0, tileWorker, t))
+            break;
+        t->numThreads++;
+    }
+
+    if (!t->numBands) {
+        ALOGE("tiling disabled, couldn't create the band contexts");
+        c->tiling = t;
+        ogles_uninit_tiling(c);
+        return;
+    }
+
+    c->tiling = t;
+
+    HOOK(colorBuffer);
+    HOOK(readBuffer);
+    HOOK(depthBuffer);
+    HOOK(bindTexture);
+    HOOK(bindTextureLod);
+    HOOK(scissor);
+    HOOK(enable);
+    HOOK(disable);
+    HOOK(enableDisable);
+    HOOK(shadeModel);
+    HOOK(color4xv);
+    HOOK(colorGrad12xv);
+    HOOK(zGrad3xv);
+    HOOK(wGrad3xv);
+    HOOK(fogGrad3xv);
+    HOOK(fogColor3xv);
+    HOOK(blendFunc);
+    HOOK(alphaFuncx);
+    HOOK(depthFunc);
+    HOOK(logicOp);
+    HOOK(colorMask);
+    HOOK(depthMask);
+    HOOK(stencilMask);
+    HOOK(clearColorx);
+    HOOK(clearDepthx);
+    HOOK(clearStencil);
+    HOOK(activeTexture);
+    HOOK(texGeni);
+    HOOK(texParameteri);
+    HOOK(texEnvi);
+    HOOK(texEnvxv);
+    HOOK(texCoord2i);
+    HOOK(texCoordGradScale8xv);
+    HOOK(clear);
+    HOOK(pointx);
+    HOOK(linex);
+    HOOK(recti);
+    HOOK(trianglex);
+
+    ALOGD("tiling enabled: %d threads, %d bands",
+            t->numThreads + 1, t->numBands);
+}
+
+#undef HOOK
+
+void ogles_uninit_tiling(ogles_context_t* c)
+{
+    tiling_t* t = c->tiling;
+    if (!t)
+        return;
+
+    // whatever wasn't flushed by now is dropped, like the rest of the
+    // context's rendering state
+    t->lock.lock();
+    t->exitPending = true;
+    t->workCondition.broadcast();
+    t->lock.unlock();
+    for (int i=0 ; i<t->numThreads ; i++) {
+        pthread_join(t->threads[i], 0);
+    }
+    for (int i=0 ; i<t->numBands ; i++) {
+        gglUninit(t->bands[i].ggl);
+    }
+    c->rasterizer.procs = t->procs;
+    free(t->stream);
+    delete t;
+    c->tiling = 0;
+}
+
+void ogles_flush_tiles(ogles_context_t* c)
+{
+    tiling_t* t = c->tiling;
+    if (ggl_likely(!t || !t->hasDraws))
+        return;
+    renderStream(t);
+}
+
+// ----------------------------------------------------------------------------
+}; // namespace android
@@ -0,0 +1,53 @@
+/* libs/opengles/tiling.h
+**
+** Copyright 2012, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#ifndef ANDROID_OPENGLES_TILING_H
+#define ANDROID_OPENGLES_TILING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include <private/pixelflinger/ggl_context.h>
+
+#include <GLES/gl.h>
+
+#include "context.h"
+
+namespace android {
+
+/*
+ * Deferred, multithreaded rasterization.
+ *
+ * When the debug.libagl.tiling property is set to a thread count, the
+ * rasterizer calls made by a context are recorded instead of executed, and
+ * replayed at the next flush point by that many threads, each rasterizing
+ * its own horizontal bands of the color buffer with a private pixelflinger
+ * context.  A flush point is anything that needs the pixels: glFlush,
+ * glFinish, eglSwapBuffers, glReadPixels, glCopyTex[Sub]Image2D, or a
+ * change of the memory the pending commands read or write.
+ */
+
+void ogles_init_tiling(ogles_context_t* c);
+void ogles_uninit_tiling(ogles_context_t* c);
+
+// Renders all the commands recorded so far; returns when they are done.
+void ogles_flush_tiles(ogles_context_t* c);
+
+}; // namespace android
+
+#endif // ANDROID_OPENGLES_TILING_H
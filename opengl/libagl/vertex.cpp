@@ -175,6 +175,7 @@ static void clipPlanex(GLenum plane, const GLfixed* equ, ogles_context_t* c)
     ogles_validate_transform(c, transform_state_t::MVIT);
     transform_t& mvit = c->transforms.mvit4;
     mvit.point4(&mvit, &equation, &equation);
+    c->transforms.serial++;
 }
 
 // ----------------------------------------------------------------------------
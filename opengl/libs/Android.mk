@@ -53,6 +53,11 @@ ifeq ($(ARCH_ARM_HAVE_TLS_REGISTER),true)
   LOCAL_CFLAGS += -DHAVE_ARM_TLS_REGISTER
 endif
 
+# the x86 GL entry points tail-call through the TLS slot, see GLES2/gl2.cpp
+ifeq ($(TARGET_ARCH),x86)
+  LOCAL_CFLAGS += -fomit-frame-pointer
+endif
+
 ifneq ($(MAX_EGL_CACHE_ENTRY_SIZE),)
   LOCAL_CFLAGS += -DMAX_EGL_CACHE_ENTRY_SIZE=$(MAX_EGL_CACHE_ENTRY_SIZE)
 endif
@@ -113,6 +118,11 @@ ifeq ($(ARCH_ARM_HAVE_TLS_REGISTER),true)
   LOCAL_CFLAGS += -DHAVE_ARM_TLS_REGISTER
 endif
 
+# the x86 GL entry points tail-call through the TLS slot, see GLES2/gl2.cpp
+ifeq ($(TARGET_ARCH),x86)
+  LOCAL_CFLAGS += -fomit-frame-pointer
+endif
+
 include $(BUILD_SHARED_LIBRARY)
 
 
@@ -145,6 +155,11 @@ ifeq ($(ARCH_ARM_HAVE_TLS_REGISTER),true)
   LOCAL_CFLAGS += -DHAVE_ARM_TLS_REGISTER
 endif
 
+# the x86 GL entry points tail-call through the TLS slot, see GLES2/gl2.cpp
+ifeq ($(TARGET_ARCH),x86)
+  LOCAL_CFLAGS += -fomit-frame-pointer
+endif
+
 include $(BUILD_SHARED_LIBRARY)
 
 ###############################################################################
@@ -99,6 +99,40 @@ static char const * getProcessCmdline() {
 
 // ----------------------------------------------------------------------------
 
+/*
+ * The GL entry points are resolved lazily: the hooks initially point to
+ * these functions, which look up the driver's entry point the first time
+ * they're called, patch it into the hooks and then forward the call to it.
+ * This saves looking up every entry point in entries.in, most of which are
+ * never used, the first time a process uses EGL.
+ */
+
+template <int INDEX>
+struct lazy_api {
+    #define GL_FORWARD(_r, _api, _params, _args)                            \
+    static _r _api _params {                                                \
+        typedef _r (*api_t) _params;                                        \
+        api_t const f = reinterpret_cast<api_t>(                            \
+                Loader::getInstance().resolve(INDEX,                         \
+                        __builtin_offsetof(gl_hooks_t, gl._api) /           \
+                                sizeof(__eglMustCastToProperFunctionPointerType))); \
+        return f _args;                                                     \
+    }
+    #include "forward.in"
+    #undef GL_FORWARD
+
+    static void init(gl_hooks_t::gl_t* gl) {
+        #define GL_FORWARD(_r, _api, _params, _args) gl->_api = _api;
+        #include "forward.in"
+        #undef GL_FORWARD
+    }
+};
+
+// the content of the hooks before anything was resolved
+static gl_hooks_t::gl_t sLazyHooks[2];
+
+// ----------------------------------------------------------------------------
+
 Loader::driver_t::driver_t(void* gles) 
 {
     dso[0] = gles;
@@ -137,7 +171,11 @@ status_t Loader::driver_t::set(void* hnd, int32_t api)
 // ----------------------------------------------------------------------------
 
 Loader::Loader()
+    : getProcAddress(0), mDriver(0), mGLESv1Pending(false)
 {
+    mGLES[egl_connection_t::GLESv1_INDEX] = 0;
+    mGLES[egl_connection_t::GLESv2_INDEX] = 0;
+
     char line[256];
     char tag[256];
 
@@ -179,6 +217,17 @@ void* Loader::open(egl_connection_t* cnx)
 {
     void* dso;
     driver_t* hnd = 0;
+
+    Mutex::Autolock _l(mLock);
+
+    lazy_api<egl_connection_t::GLESv1_INDEX>::init(
+            &sLazyHooks[egl_connection_t::GLESv1_INDEX]);
+    lazy_api<egl_connection_t::GLESv2_INDEX>::init(
+            &sLazyHooks[egl_connection_t::GLESv2_INDEX]);
+    cnx->hooks[egl_connection_t::GLESv1_INDEX]->gl =
+            sLazyHooks[egl_connection_t::GLESv1_INDEX];
+    cnx->hooks[egl_connection_t::GLESv2_INDEX]->gl =
+            sLazyHooks[egl_connection_t::GLESv2_INDEX];
     
     char const* tag = mDriverTag.string();
     if (tag) {
@@ -190,9 +239,10 @@ void* Loader::open(egl_connection_t* cnx)
             dso = load_driver("EGL", tag, cnx, EGL);
             if (dso) {
                 hnd = new driver_t(dso);
-                // TODO: make this more automated
-                hnd->set( load_driver("GLESv1_CM", tag, cnx, GLESv1_CM), GLESv1_CM );
                 hnd->set( load_driver("GLESv2",    tag, cnx, GLESv2),    GLESv2 );
+                // most processes never create a GLESv1 context, don't
+                // load its driver until one does
+                mGLESv1Pending = true;
             }
         }
     }
@@ -200,10 +250,53 @@ void* Loader::open(egl_connection_t* cnx)
     LOG_FATAL_IF(!index && !hnd,
             "couldn't find the default OpenGL ES implementation "
             "for default display");
-    
+
+    mDriver = hnd;
     return (void*)hnd;
 }
 
+void Loader::loadGLESv1(egl_connection_t* cnx)
+{
+    Mutex::Autolock _l(mLock);
+    loadGLESv1Locked(cnx);
+}
+
+void Loader::loadGLESv1Locked(egl_connection_t* cnx)
+{
+    if (mGLESv1Pending && mDriver) {
+        mGLESv1Pending = false;
+        mDriver->set( load_driver("GLESv1_CM", mDriverTag.string(), cnx,
+                GLESv1_CM), GLESv1_CM );
+    }
+}
+
+__eglMustCastToProperFunctionPointerType Loader::resolve(int index, size_t slot)
+{
+    Mutex::Autolock _l(mLock);
+
+    egl_connection_t* const cnx = &gEGLImpl;
+    __eglMustCastToProperFunctionPointerType* const curr =
+            (__eglMustCastToProperFunctionPointerType*)&cnx->hooks[index]->gl;
+    __eglMustCastToProperFunctionPointerType const* const lazy =
+            (__eglMustCastToProperFunctionPointerType const*)&sLazyHooks[index];
+    if (curr[slot] != lazy[slot]) {
+        // another thread got here first
+        return curr[slot];
+    }
+
+    if (index == egl_connection_t::GLESv1_INDEX) {
+        loadGLESv1Locked(cnx);
+    }
+
+    __eglMustCastToProperFunctionPointerType f =
+            (__eglMustCastToProperFunctionPointerType)gl_unimplemented;
+    if (mGLES[index]) {
+        f = find_api(mGLES[index], gl_names[slot], getProcAddress);
+    }
+    curr[slot] = f;
+    return f;
+}
+
 status_t Loader::close(void* driver)
 {
     driver_t* hnd = (driver_t*)driver;
@@ -211,60 +304,55 @@ status_t Loader::close(void* driver)
     return NO_ERROR;
 }
 
-void Loader::init_api(void* dso, 
-        char const * const * api, 
-        __eglMustCastToProperFunctionPointerType* curr, 
-        getProcAddressType getProcAddress) 
+__eglMustCastToProperFunctionPointerType Loader::find_api(void* dso,
+        char const * name,
+        getProcAddressType getProcAddress)
 {
     const ssize_t SIZE = 256;
     char scrap[SIZE];
-    while (*api) {
-        char const * name = *api;
-        __eglMustCastToProperFunctionPointerType f = 
-            (__eglMustCastToProperFunctionPointerType)dlsym(dso, name);
-        if (f == NULL) {
-            // couldn't find the entry-point, use eglGetProcAddress()
-            f = getProcAddress(name);
-        }
-        if (f == NULL) {
-            // Try without the OES postfix
-            ssize_t index = ssize_t(strlen(name)) - 3;
-            if ((index>0 && (index<SIZE-1)) && (!strcmp(name+index, "OES"))) {
-                strncpy(scrap, name, index);
-                scrap[index] = 0;
-                f = (__eglMustCastToProperFunctionPointerType)dlsym(dso, scrap);
-                //ALOGD_IF(f, "found <%s> instead", scrap);
-            }
+    __eglMustCastToProperFunctionPointerType f = 
+        (__eglMustCastToProperFunctionPointerType)dlsym(dso, name);
+    if (f == NULL) {
+        // couldn't find the entry-point, use eglGetProcAddress()
+        f = getProcAddress(name);
+    }
+    if (f == NULL) {
+        // Try without the OES postfix
+        ssize_t index = ssize_t(strlen(name)) - 3;
+        if ((index>0 && (index<SIZE-1)) && (!strcmp(name+index, "OES"))) {
+            strncpy(scrap, name, index);
+            scrap[index] = 0;
+            f = (__eglMustCastToProperFunctionPointerType)dlsym(dso, scrap);
+            //ALOGD_IF(f, "found <%s> instead", scrap);
         }
-        if (f == NULL) {
-            // Try with the OES postfix
-            ssize_t index = ssize_t(strlen(name)) - 3;
-            if (index>0 && strcmp(name+index, "OES")) {
-                snprintf(scrap, SIZE, "%sOES", name);
-                f = (__eglMustCastToProperFunctionPointerType)dlsym(dso, scrap);
-                //ALOGD_IF(f, "found <%s> instead", scrap);
-            }
+    }
+    if (f == NULL) {
+        // Try with the OES postfix
+        ssize_t index = ssize_t(strlen(name)) - 3;
+        if (index>0 && strcmp(name+index, "OES")) {
+            snprintf(scrap, SIZE, "%sOES", name);
+            f = (__eglMustCastToProperFunctionPointerType)dlsym(dso, scrap);
+            //ALOGD_IF(f, "found <%s> instead", scrap);
         }
-        if (f == NULL) {
-            //ALOGD("%s", name);
-            f = (__eglMustCastToProperFunctionPointerType)gl_unimplemented;
-
-            /*
-             * GL_EXT_debug_label is special, we always report it as
-             * supported, it's handled by GLES_trace. If GLES_trace is not
-             * enabled, then these are no-ops.
-             */
-            if (!strcmp(name, "glInsertEventMarkerEXT")) {
-                f = (__eglMustCastToProperFunctionPointerType)gl_noop;
-            } else if (!strcmp(name, "glPushGroupMarkerEXT")) {
-                f = (__eglMustCastToProperFunctionPointerType)gl_noop;
-            } else if (!strcmp(name, "glPopGroupMarkerEXT")) {
-                f = (__eglMustCastToProperFunctionPointerType)gl_noop;
-            }
+    }
+    if (f == NULL) {
+        //ALOGD("%s", name);
+        f = (__eglMustCastToProperFunctionPointerType)gl_unimplemented;
+
+        /*
+         * GL_EXT_debug_label is special, we always report it as
+         * supported, it's handled by GLES_trace. If GLES_trace is not
+         * enabled, then these are no-ops.
+         */
+        if (!strcmp(name, "glInsertEventMarkerEXT")) {
+            f = (__eglMustCastToProperFunctionPointerType)gl_noop;
+        } else if (!strcmp(name, "glPushGroupMarkerEXT")) {
+            f = (__eglMustCastToProperFunctionPointerType)gl_noop;
+        } else if (!strcmp(name, "glPopGroupMarkerEXT")) {
+            f = (__eglMustCastToProperFunctionPointerType)gl_noop;
         }
-        *curr++ = f;
-        api++;
     }
+    return f;
 }
 
 void *Loader::load_driver(const char* kind, const char *tag,
@@ -347,18 +435,13 @@ void *Loader::load_driver(const char* kind, const char *tag,
         }
     }
     
+    // the GL entry points are resolved on their first call, see resolve()
     if (mask & GLESv1_CM) {
-        init_api(dso, gl_names,
-            (__eglMustCastToProperFunctionPointerType*)
-                &cnx->hooks[egl_connection_t::GLESv1_INDEX]->gl,
-            getProcAddress);
+        mGLES[egl_connection_t::GLESv1_INDEX] = dso;
     }
 
     if (mask & GLESv2) {
-      init_api(dso, gl_names,
-            (__eglMustCastToProperFunctionPointerType*)
-                &cnx->hooks[egl_connection_t::GLESv2_INDEX]->gl,
-            getProcAddress);
+        mGLES[egl_connection_t::GLESv2_INDEX] = dso;
     }
     
     return dso;
@@ -24,6 +24,7 @@
 #include <utils/Errors.h>
 #include <utils/Singleton.h>
 #include <utils/String8.h>
+#include <utils/threads.h>
 
 #include <EGL/egl.h>
 
@@ -54,22 +55,39 @@ class Loader : public Singleton<Loader>
     
     String8 mDriverTag;
     getProcAddressType getProcAddress;
-    
+
+    // protects the fields below and the resolution of the GL entry points
+    Mutex mLock;
+    driver_t* mDriver;
+    // the driver each of the gl_hooks_t is resolved from, indexed by
+    // egl_connection_t::GLESv1_INDEX and GLESv2_INDEX
+    void* mGLES[2];
+    // the separate GLESv1_CM driver is only loaded for a GLESv1 context
+    bool mGLESv1Pending;
+
 public:
     ~Loader();
     
     void* open(egl_connection_t* cnx);
     status_t close(void* driver);
+
+    // loads the GLESv1_CM driver if it was deferred, must be called
+    // before creating a GLESv1 context
+    void loadGLESv1(egl_connection_t* cnx);
+
+    // called by the lazy entry points the first time they're called,
+    // returns the driver's entry point and patches it into the hooks
+    __eglMustCastToProperFunctionPointerType resolve(int index, size_t slot);
     
 private:
     Loader();
     void *load_driver(const char* kind, const char *tag, egl_connection_t* cnx, uint32_t mask);
+    void loadGLESv1Locked(egl_connection_t* cnx);
 
     static __attribute__((noinline))
-    void init_api(void* dso, 
-            char const * const * api, 
-            __eglMustCastToProperFunctionPointerType* curr, 
-            getProcAddressType getProcAddress); 
+    __eglMustCastToProperFunctionPointerType find_api(void* dso,
+            char const * name,
+            getProcAddressType getProcAddress);
 };
 
 // ----------------------------------------------------------------------------
@@ -66,6 +66,10 @@ EGLAPI pthread_key_t gGLTraceKey = -1;
  * 1. libs/EGL/trace.cpp: Traces all functions to systrace.
  *    To enable:
  *      - set system property "debug.egl.trace" to "systrace" to trace all apps.
+ *      - optionally set "debug.egl.trace.classes" to a comma separated list of
+ *        "draw", "state", "upload", "sync" and "egl" to only trace those calls.
+ *      - optionally set "debug.egl.trace.min_us" to only trace the calls that
+ *        take at least that long; the others are still counted per frame.
  * 2. libs/EGL/trace.cpp: Logs a stack trace for GL errors after each function call.
  *    To enable:
  *      - set system property "debug.egl.trace" to "error" to trace all apps.
@@ -77,12 +81,17 @@ EGLAPI pthread_key_t gGLTraceKey = -1;
  *    To enable:
  *        - set system property "debug.egl.debug_proc" to the application name.
  *      - or call setGLDebugLevel(1) from the app.
+ * 5. libs/EGL/trace.cpp: Counts the calls to all functions and their durations,
+ *    reported per frame to systrace, and periodically to logcat.
+ *    To enable:
+ *      - set system property "debug.egl.trace" to "stats" to trace all apps.
  */
 static int sEGLTraceLevel;
 static int sEGLApplicationTraceLevel;
 
-static bool sEGLSystraceEnabled;
+bool gEGLSystraceEnabled;
 static bool sEGLGetErrorEnabled;
+bool gEGLStatsEnabled;
 
 int gEGLDebugLevel;
 static int sEGLApplicationDebugLevel;
@@ -90,6 +99,9 @@ static int sEGLApplicationDebugLevel;
 extern gl_hooks_t gHooksTrace;
 extern gl_hooks_t gHooksSystrace;
 extern gl_hooks_t gHooksErrorTrace;
+extern gl_hooks_t gHooksStats;
+
+extern void GLSystrace_init(const char* classes, int minDurationUs);
 
 static inline void setGlTraceThreadSpecific(gl_hooks_t const *value) {
     pthread_setspecific(gGLTraceKey, value);
@@ -105,13 +117,25 @@ void initEglTraceLevel() {
 
     sEGLGetErrorEnabled = !strcasecmp(value, "error");
     if (sEGLGetErrorEnabled) {
-        sEGLSystraceEnabled = false;
+        gEGLSystraceEnabled = false;
+        gEGLStatsEnabled = false;
         sEGLTraceLevel = 0;
         return;
     }
 
-    sEGLSystraceEnabled = !strcasecmp(value, "systrace");
-    if (sEGLSystraceEnabled) {
+    gEGLSystraceEnabled = !strcasecmp(value, "systrace");
+    if (gEGLSystraceEnabled) {
+        char classes[PROPERTY_VALUE_MAX];
+        property_get("debug.egl.trace.classes", classes, "");
+        property_get("debug.egl.trace.min_us", value, "0");
+        GLSystrace_init(classes, atoi(value));
+        gEGLStatsEnabled = false;
+        sEGLTraceLevel = 0;
+        return;
+    }
+
+    gEGLStatsEnabled = !strcasecmp(value, "stats");
+    if (gEGLStatsEnabled) {
         sEGLTraceLevel = 0;
         return;
     }
@@ -159,9 +183,12 @@ void setGLHooksThreadSpecific(gl_hooks_t const *value) {
     if (sEGLGetErrorEnabled) {
         setGlTraceThreadSpecific(value);
         setGlThreadSpecific(&gHooksErrorTrace);
-    } else if (sEGLSystraceEnabled) {
+    } else if (gEGLSystraceEnabled) {
         setGlTraceThreadSpecific(value);
         setGlThreadSpecific(&gHooksSystrace);
+    } else if (gEGLStatsEnabled) {
+        setGlTraceThreadSpecific(value);
+        setGlThreadSpecific(&gHooksStats);
     } else if (sEGLTraceLevel > 0) {
         setGlTraceThreadSpecific(value);
         setGlThreadSpecific(&gHooksTrace);
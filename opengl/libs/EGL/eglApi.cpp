@@ -49,6 +49,7 @@
 #include "egl_object.h"
 #include "egl_tls.h"
 #include "egldefs.h"
+#include "Loader.h"
 
 using namespace android;
 
@@ -98,7 +99,14 @@ extern void setGLHooksThreadSpecific(gl_hooks_t const *value);
 extern EGLBoolean egl_init_drivers();
 extern const __eglMustCastToProperFunctionPointerType gExtensionForwarders[MAX_NUMBER_OF_GL_EXTENSIONS];
 extern int gEGLDebugLevel;
+extern bool gEGLStatsEnabled;
+extern bool gEGLSystraceEnabled;
 extern gl_hooks_t gHooksTrace;
+extern void GLStats_eglSwapBuffers();
+extern void GLStats_eglMakeCurrent(bool switched, nsecs_t duration);
+extern void GLSystrace_eglSwapBuffers();
+extern nsecs_t GLSystrace_eglCallBegin(const char* name);
+extern void GLSystrace_eglCallEnd(const char* name, nsecs_t start);
 } // namespace android;
 
 // ----------------------------------------------------------------------------
@@ -106,6 +114,26 @@ extern gl_hooks_t gHooksTrace;
 static inline void clearError() { egl_tls_t::clearError(); }
 static inline EGLContext getContext() { return egl_tls_t::getContext(); }
 
+#if EGL_TRACE
+// traces the EGL calls that can block or reach the driver when systrace GL
+// tracing is enabled for the "egl" class, see trace.cpp
+class EglSystraceCall {
+    const char* const mName;
+    const nsecs_t mStart;
+public:
+    inline EglSystraceCall(const char* name) : mName(name),
+        mStart(gEGLSystraceEnabled ? GLSystrace_eglCallBegin(name) : -1) {
+    }
+    inline ~EglSystraceCall() {
+        if (mStart >= 0)
+            GLSystrace_eglCallEnd(mName, mStart);
+    }
+};
+#define EGL_SYSTRACE_CALL() EglSystraceCall ___egl_systrace(__FUNCTION__)
+#else
+#define EGL_SYSTRACE_CALL()
+#endif
+
 // ----------------------------------------------------------------------------
 
 EGLDisplay eglGetDisplay(EGLNativeDisplayType display)
@@ -131,6 +159,7 @@ EGLDisplay eglGetDisplay(EGLNativeDisplayType display)
 
 EGLBoolean eglInitialize(EGLDisplay dpy, EGLint *major, EGLint *minor)
 {
+    EGL_SYSTRACE_CALL();
     clearError();
 
     egl_display_ptr dp = get_display(dpy);
@@ -143,6 +172,7 @@ EGLBoolean eglInitialize(EGLDisplay dpy, EGLint *major, EGLint *minor)
 
 EGLBoolean eglTerminate(EGLDisplay dpy)
 {
+    EGL_SYSTRACE_CALL();
     // NOTE: don't unload the drivers b/c some APIs can be called
     // after eglTerminate() has been called. eglTerminate() only
     // terminates an EGLDisplay, not a EGL itself.
@@ -284,6 +314,7 @@ EGLSurface eglCreateWindowSurface(  EGLDisplay dpy, EGLConfig config,
                                     NativeWindowType window,
                                     const EGLint *attrib_list)
 {
+    EGL_SYSTRACE_CALL();
     clearError();
 
     egl_connection_t* cnx = NULL;
@@ -355,6 +386,7 @@ EGLSurface eglCreatePixmapSurface(  EGLDisplay dpy, EGLConfig config,
 EGLSurface eglCreatePbufferSurface( EGLDisplay dpy, EGLConfig config,
                                     const EGLint *attrib_list)
 {
+    EGL_SYSTRACE_CALL();
     clearError();
 
     egl_connection_t* cnx = NULL;
@@ -373,6 +405,7 @@ EGLSurface eglCreatePbufferSurface( EGLDisplay dpy, EGLConfig config,
                                     
 EGLBoolean eglDestroySurface(EGLDisplay dpy, EGLSurface surface)
 {
+    EGL_SYSTRACE_CALL();
     clearError();
 
     const egl_display_ptr dp = validate_display(dpy);
@@ -435,6 +468,7 @@ void EGLAPI eglBeginFrame(EGLDisplay dpy, EGLSurface surface) {
 EGLContext eglCreateContext(EGLDisplay dpy, EGLConfig config,
                             EGLContext share_list, const EGLint *attrib_list)
 {
+    EGL_SYSTRACE_CALL();
     clearError();
 
     egl_connection_t* cnx = NULL;
@@ -444,24 +478,26 @@ EGLContext eglCreateContext(EGLDisplay dpy, EGLConfig config,
             egl_context_t* const c = get_context(share_list);
             share_list = c->context;
         }
+        // figure out if it's a GLESv1 or GLESv2
+        int version = 0;
+        if (attrib_list) {
+            for (const EGLint* attr = attrib_list ; *attr != EGL_NONE ; attr += 2) {
+                if (attr[0] == EGL_CONTEXT_CLIENT_VERSION) {
+                    if (attr[1] == 1) {
+                        version = egl_connection_t::GLESv1_INDEX;
+                    } else if (attr[1] == 2) {
+                        version = egl_connection_t::GLESv2_INDEX;
+                    }
+                }
+            }
+        }
+        if (version == egl_connection_t::GLESv1_INDEX) {
+            // the GLESv1_CM driver isn't loaded until it's needed
+            Loader::getInstance().loadGLESv1(cnx);
+        }
         EGLContext context = cnx->egl.eglCreateContext(
                 dp->disp.dpy, config, share_list, attrib_list);
         if (context != EGL_NO_CONTEXT) {
-            // figure out if it's a GLESv1 or GLESv2
-            int version = 0;
-            if (attrib_list) {
-                while (*attrib_list != EGL_NONE) {
-                    GLint attr = *attrib_list++;
-                    GLint value = *attrib_list++;
-                    if (attr == EGL_CONTEXT_CLIENT_VERSION) {
-                        if (value == 1) {
-                            version = egl_connection_t::GLESv1_INDEX;
-                        } else if (value == 2) {
-                            version = egl_connection_t::GLESv2_INDEX;
-                        }
-                    }
-                };
-            }
             egl_context_t* c = new egl_context_t(dpy, context, config, cnx,
                     version);
 #if EGL_TRACE
@@ -482,6 +518,7 @@ EGLContext eglCreateContext(EGLDisplay dpy, EGLConfig config,
 
 EGLBoolean eglDestroyContext(EGLDisplay dpy, EGLContext ctx)
 {
+    EGL_SYSTRACE_CALL();
     clearError();
 
     const egl_display_ptr dp = validate_display(dpy);
@@ -503,6 +540,7 @@ EGLBoolean eglDestroyContext(EGLDisplay dpy, EGLContext ctx)
 EGLBoolean eglMakeCurrent(  EGLDisplay dpy, EGLSurface draw,
                             EGLSurface read, EGLContext ctx)
 {
+    EGL_SYSTRACE_CALL();
     clearError();
 
     egl_display_ptr dp = validate_display(dpy);
@@ -516,6 +554,20 @@ EGLBoolean eglMakeCurrent(  EGLDisplay dpy, EGLSurface draw,
         if (!dp->isReady()) return setError(EGL_NOT_INITIALIZED, EGL_FALSE);
     }
 
+    // Nothing to do if the context is already current to this thread with
+    // these surfaces; the current context and its surfaces are valid.
+    if (ctx != EGL_NO_CONTEXT && ctx == getContext()) {
+        egl_context_t const * const cur = get_context(ctx);
+        if (cur->getDisplay() == dp.get() &&
+                cur->draw == draw && cur->read == read) {
+#if EGL_TRACE
+            if (gEGLStatsEnabled)
+                GLStats_eglMakeCurrent(false, 0);
+#endif
+            return EGL_TRUE;
+        }
+    }
+
     // get a reference to the object passed in
     ContextRef _c(dp.get(), ctx);
     SurfaceRef _d(dp.get(), draw);
@@ -569,10 +621,19 @@ EGLBoolean eglMakeCurrent(  EGLDisplay dpy, EGLSurface draw,
     }
 
 
+#if EGL_TRACE
+    const nsecs_t start = gEGLStatsEnabled ? systemTime() : 0;
+#endif
+
     EGLBoolean result = dp->makeCurrent(c, cur_c,
             draw, read, ctx,
             impl_draw, impl_read, impl_ctx);
 
+#if EGL_TRACE
+    if (gEGLStatsEnabled)
+        GLStats_eglMakeCurrent(true, systemTime() - start);
+#endif
+
     if (result == EGL_TRUE) {
         if (c) {
             setGLHooksThreadSpecific(c->cnx->hooks[c->version]);
@@ -662,6 +723,7 @@ EGLDisplay eglGetCurrentDisplay(void)
 
 EGLBoolean eglWaitGL(void)
 {
+    EGL_SYSTRACE_CALL();
     clearError();
 
     egl_connection_t* const cnx = &gEGLImpl;
@@ -673,6 +735,7 @@ EGLBoolean eglWaitGL(void)
 
 EGLBoolean eglWaitNative(EGLint engine)
 {
+    EGL_SYSTRACE_CALL();
     clearError();
 
     egl_connection_t* const cnx = &gEGLImpl;
@@ -863,6 +926,10 @@ EGLBoolean eglSwapBuffers(EGLDisplay dpy, EGLSurface draw)
 #if EGL_TRACE
     if (gEGLDebugLevel > 0)
         GLTrace_eglSwapBuffers(dpy, draw);
+    if (gEGLStatsEnabled)
+        GLStats_eglSwapBuffers();
+    if (gEGLSystraceEnabled)
+        GLSystrace_eglSwapBuffers();
 #endif
 
     egl_surface_t const * const s = get_surface(draw);
@@ -895,6 +962,7 @@ EGLBoolean eglSwapBuffers(EGLDisplay dpy, EGLSurface draw)
 EGLBoolean eglCopyBuffers(  EGLDisplay dpy, EGLSurface surface,
                             NativePixmapType target)
 {
+    EGL_SYSTRACE_CALL();
     clearError();
 
     const egl_display_ptr dp = validate_display(dpy);
@@ -958,6 +1026,7 @@ EGLBoolean eglSurfaceAttrib(
 EGLBoolean eglBindTexImage(
         EGLDisplay dpy, EGLSurface surface, EGLint buffer)
 {
+    EGL_SYSTRACE_CALL();
     clearError();
 
     const egl_display_ptr dp = validate_display(dpy);
@@ -978,6 +1047,7 @@ EGLBoolean eglBindTexImage(
 EGLBoolean eglReleaseTexImage(
         EGLDisplay dpy, EGLSurface surface, EGLint buffer)
 {
+    EGL_SYSTRACE_CALL();
     clearError();
 
     const egl_display_ptr dp = validate_display(dpy);
@@ -1018,6 +1088,7 @@ EGLBoolean eglSwapInterval(EGLDisplay dpy, EGLint interval)
 
 EGLBoolean eglWaitClient(void)
 {
+    EGL_SYSTRACE_CALL();
     clearError();
 
     egl_connection_t* const cnx = &gEGLImpl;
@@ -1148,6 +1219,7 @@ EGLBoolean eglUnlockSurfaceKHR(EGLDisplay dpy, EGLSurface surface)
 EGLImageKHR eglCreateImageKHR(EGLDisplay dpy, EGLContext ctx, EGLenum target,
         EGLClientBuffer buffer, const EGLint *attrib_list)
 {
+    EGL_SYSTRACE_CALL();
     clearError();
 
     const egl_display_ptr dp = validate_display(dpy);
@@ -1169,6 +1241,7 @@ EGLImageKHR eglCreateImageKHR(EGLDisplay dpy, EGLContext ctx, EGLenum target,
 
 EGLBoolean eglDestroyImageKHR(EGLDisplay dpy, EGLImageKHR img)
 {
+    EGL_SYSTRACE_CALL();
     clearError();
 
     const egl_display_ptr dp = validate_display(dpy);
@@ -1188,6 +1261,7 @@ EGLBoolean eglDestroyImageKHR(EGLDisplay dpy, EGLImageKHR img)
 
 EGLSyncKHR eglCreateSyncKHR(EGLDisplay dpy, EGLenum type, const EGLint *attrib_list)
 {
+    EGL_SYSTRACE_CALL();
     clearError();
 
     const egl_display_ptr dp = validate_display(dpy);
@@ -1203,6 +1277,7 @@ EGLSyncKHR eglCreateSyncKHR(EGLDisplay dpy, EGLenum type, const EGLint *attrib_l
 
 EGLBoolean eglDestroySyncKHR(EGLDisplay dpy, EGLSyncKHR sync)
 {
+    EGL_SYSTRACE_CALL();
     clearError();
 
     const egl_display_ptr dp = validate_display(dpy);
@@ -1219,6 +1294,7 @@ EGLBoolean eglDestroySyncKHR(EGLDisplay dpy, EGLSyncKHR sync)
 EGLint eglClientWaitSyncKHR(EGLDisplay dpy, EGLSyncKHR sync,
         EGLint flags, EGLTimeKHR timeout)
 {
+    EGL_SYSTRACE_CALL();
     clearError();
 
     const egl_display_ptr dp = validate_display(dpy);
@@ -1256,6 +1332,7 @@ EGLBoolean eglGetSyncAttribKHR(EGLDisplay dpy, EGLSyncKHR sync,
 
 EGLint eglDupNativeFenceFDANDROID(EGLDisplay dpy, EGLSyncKHR sync)
 {
+    EGL_SYSTRACE_CALL();
     clearError();
 
     const egl_display_ptr dp = validate_display(dpy);
@@ -1271,6 +1348,7 @@ EGLint eglDupNativeFenceFDANDROID(EGLDisplay dpy, EGLSyncKHR sync)
 
 EGLint eglWaitSyncANDROID(EGLDisplay dpy, EGLSyncKHR sync, EGLint flags)
 {
+    EGL_SYSTRACE_CALL();
     clearError();
 
     const egl_display_ptr dp = validate_display(dpy);
@@ -19,7 +19,10 @@
 #include "egl_impl.h"
 #include "egldefs.h"
 
+#include <cutils/properties.h>
+
 #include <fcntl.h>
+#include <pthread.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -37,15 +40,21 @@
 #define MAX_EGL_CACHE_SIZE (64 * 1024);
 #endif
 
-// Cache size limits.
+// Cache size limits, the value and total sizes are the defaults of the
+// ro.egl.blobcache.maxentry and ro.egl.blobcache.maxsize properties.
 static const size_t maxKeySize = MAX_EGL_CACHE_KEY_SIZE;
-static const size_t maxValueSize = MAX_EGL_CACHE_ENTRY_SIZE;
-static const size_t maxTotalSize = MAX_EGL_CACHE_SIZE;
+static const size_t defaultMaxValueSize = MAX_EGL_CACHE_ENTRY_SIZE;
+static const size_t defaultMaxTotalSize = MAX_EGL_CACHE_SIZE;
 
 // Cache file header
 static const char* cacheFileMagic = "EGL$";
 static const size_t cacheFileHeaderSize = 8;
 
+// Journal of the entries inserted since the cache file was last written,
+// each entry is a header followed by the key and the value.
+static const char* journalFileSuffix = ".journal";
+static const size_t journalEntryHeaderSize = 12;
+
 // The time in seconds to wait before saving newly inserted cache entries.
 static const unsigned int deferredSaveDelay = 4;
 
@@ -73,7 +82,28 @@ static EGLsizeiANDROID getBlob(const void* key, EGLsizeiANDROID keySize,
 //
 egl_cache_t::egl_cache_t() :
         mInitialized(false),
-        mBlobCache(NULL) {
+        mBlobCache(NULL),
+        mSharedBlobCache(NULL),
+        mSharedMappedFile(MAP_FAILED),
+        mSharedMappedFileSize(0),
+        mMaxValueSize(defaultMaxValueSize),
+        mMaxTotalSize(defaultMaxTotalSize),
+        mMappedFile(MAP_FAILED),
+        mMappedFileSize(0),
+        mSavePending(false) {
+}
+
+static size_t getSizeProperty(const char* name, size_t defaultValue) {
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get(name, value, NULL) > 0) {
+        char* end;
+        unsigned long size = strtoul(value, &end, 0);
+        if (end != value && *end == '\0' && size > 0) {
+            return size;
+        }
+        ALOGW("ignoring bad %s: %s", name, value);
+    }
+    return defaultValue;
 }
 
 egl_cache_t::~egl_cache_t() {
@@ -88,6 +118,14 @@ egl_cache_t* egl_cache_t::get() {
 void egl_cache_t::initialize(egl_display_t *display) {
     Mutex::Autolock lock(mMutex);
 
+    mMaxValueSize = getSizeProperty("ro.egl.blobcache.maxentry",
+            defaultMaxValueSize);
+    mMaxTotalSize = getSizeProperty("ro.egl.blobcache.maxsize",
+            defaultMaxTotalSize);
+    char value[PROPERTY_VALUE_MAX];
+    property_get("ro.egl.blobcache.shared", value, "");
+    mSharedFilename = value;
+
     egl_connection_t* const cnx = &gEGLImpl;
     if (cnx->dso && cnx->major >= 0 && cnx->minor >= 0) {
         const char* exts = display->disp.queryString.extensions;
@@ -124,14 +162,29 @@ void egl_cache_t::initialize(egl_display_t *display) {
 }
 
 void egl_cache_t::terminate() {
+    saveBlobCache();
     Mutex::Autolock lock(mMutex);
-    if (mBlobCache != NULL) {
-        saveBlobCacheLocked();
-        mBlobCache = NULL;
-    }
+    mBlobCache = NULL;
+    mSharedBlobCache = NULL;
+    unmapCacheFilesLocked();
     mInitialized = false;
 }
 
+void egl_cache_t::unmapCacheFilesLocked() {
+    // The cache entries loaded from the files referred to the mappings, so
+    // they can only go away with the caches.
+    if (mMappedFile != MAP_FAILED) {
+        munmap(mMappedFile, mMappedFileSize);
+        mMappedFile = MAP_FAILED;
+        mMappedFileSize = 0;
+    }
+    if (mSharedMappedFile != MAP_FAILED) {
+        munmap(mSharedMappedFile, mSharedMappedFileSize);
+        mSharedMappedFile = MAP_FAILED;
+        mSharedMappedFileSize = 0;
+    }
+}
+
 void egl_cache_t::setBlob(const void* key, EGLsizeiANDROID keySize,
         const void* value, EGLsizeiANDROID valueSize) {
     Mutex::Autolock lock(mMutex);
@@ -144,6 +197,7 @@ void egl_cache_t::setBlob(const void* key, EGLsizeiANDROID keySize,
     if (mInitialized) {
         sp<BlobCache> bc = getBlobCacheLocked();
         bc->set(key, keySize, value, valueSize);
+        journalBlobLocked(key, keySize, value, valueSize);
 
         if (!mSavePending) {
             class DeferredSaveThread : public Thread {
@@ -153,11 +207,16 @@ void egl_cache_t::setBlob(const void* key, EGLsizeiANDROID keySize,
                 virtual bool threadLoop() {
                     sleep(deferredSaveDelay);
                     egl_cache_t* c = egl_cache_t::get();
+                    // the file I/O is done without holding mMutex
+                    c->saveBlobCache();
                     Mutex::Autolock lock(c->mMutex);
-                    if (c->mInitialized) {
-                        c->saveBlobCacheLocked();
-                    }
                     c->mSavePending = false;
+                    if (!c->mJournal.isEmpty()) {
+                        // entries inserted during the save weren't
+                        // scheduled, save again
+                        c->mSavePending = true;
+                        return true;
+                    }
                     return false;
                 }
             };
@@ -182,6 +241,13 @@ EGLsizeiANDROID egl_cache_t::getBlob(const void* key, EGLsizeiANDROID keySize,
 
     if (mInitialized) {
         sp<BlobCache> bc = getBlobCacheLocked();
+        if (mSharedBlobCache != NULL) {
+            size_t size = mSharedBlobCache->get(key, keySize, value,
+                    valueSize);
+            if (size > 0) {
+                return size;
+            }
+        }
         return bc->get(key, keySize, value, valueSize);
     }
     return 0;
@@ -194,162 +260,349 @@ void egl_cache_t::setCacheFilename(const char* filename) {
 
 sp<BlobCache> egl_cache_t::getBlobCacheLocked() {
     if (mBlobCache == NULL) {
-        mBlobCache = new BlobCache(maxKeySize, maxValueSize, maxTotalSize);
+        mBlobCache = new BlobCache(maxKeySize, mMaxValueSize, mMaxTotalSize);
         loadBlobCacheLocked();
     }
     return mBlobCache;
 }
 
 static uint32_t crc32c(const uint8_t* buf, size_t len) {
-    const uint32_t polyBits = 0x82F63B78;
-    uint32_t r = 0;
-    for (size_t i = 0; i < len; i++) {
-        r ^= buf[i];
-        for (int j = 0; j < 8; j++) {
-            if (r & 1) {
-                r = (r >> 1) ^ polyBits;
-            } else {
-                r >>= 1;
+    // Table driven, one byte at a time; the whole file is checked on the
+    // first eglInitialize of each process.
+    static uint32_t table[256];
+    static pthread_once_t tableOnce = PTHREAD_ONCE_INIT;
+    struct Table {
+        static void init() {
+            const uint32_t polyBits = 0x82F63B78;
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t r = i;
+                for (int j = 0; j < 8; j++) {
+                    if (r & 1) {
+                        r = (r >> 1) ^ polyBits;
+                    } else {
+                        r >>= 1;
+                    }
+                }
+                table[i] = r;
             }
         }
+    };
+    pthread_once(&tableOnce, Table::init);
+
+    uint32_t r = 0;
+    for (size_t i = 0; i < len; i++) {
+        r = table[(r ^ buf[i]) & 0xff] ^ (r >> 8);
     }
     return r;
 }
 
-void egl_cache_t::saveBlobCacheLocked() {
-    if (mFilename.length() > 0) {
-        size_t cacheSize = mBlobCache->getFlattenedSize();
-        size_t headerSize = cacheFileHeaderSize;
-        const char* fname = mFilename.string();
-
-        // Try to create the file with no permissions so we can write it
-        // without anyone trying to read it.
-        int fd = open(fname, O_CREAT | O_EXCL | O_RDWR, 0);
-        if (fd == -1) {
-            if (errno == EEXIST) {
-                // The file exists, delete it and try again.
-                if (unlink(fname) == -1) {
-                    // No point in retrying if the unlink failed.
-                    ALOGE("error unlinking cache file %s: %s (%d)", fname,
-                            strerror(errno), errno);
-                    return;
-                }
-                // Retry now that we've unlinked the file.
-                fd = open(fname, O_CREAT | O_EXCL | O_RDWR, 0);
-            }
-            if (fd == -1) {
-                ALOGE("error creating cache file %s: %s (%d)", fname,
-                        strerror(errno), errno);
-                return;
-            }
-        }
+void egl_cache_t::journalBlobLocked(const void* key, EGLsizeiANDROID keySize,
+        const void* value, EGLsizeiANDROID valueSize) {
+    // entries the cache doesn't take aren't journaled either
+    if (mFilename.length() == 0 || size_t(keySize) > maxKeySize ||
+            size_t(valueSize) > mMaxValueSize ||
+            size_t(keySize + valueSize) > mMaxTotalSize) {
+        return;
+    }
+    uint32_t header[3];
+    header[0] = keySize;
+    header[1] = valueSize;
+    header[2] = crc32c(reinterpret_cast<const uint8_t*>(key), keySize) ^
+            crc32c(reinterpret_cast<const uint8_t*>(value), valueSize);
+    mJournal.appendArray(reinterpret_cast<const uint8_t*>(header),
+            journalEntryHeaderSize);
+    mJournal.appendArray(reinterpret_cast<const uint8_t*>(key), keySize);
+    mJournal.appendArray(reinterpret_cast<const uint8_t*>(value), valueSize);
+}
 
-        size_t fileSize = headerSize + cacheSize;
+// Replays the journal entries in buf into cache, up to the first one that
+// is torn or corrupt.
+static void replayJournal(const uint8_t* buf, size_t size,
+        const sp<BlobCache>& cache) {
+    while (size >= journalEntryHeaderSize) {
+        uint32_t header[3];
+        memcpy(header, buf, journalEntryHeaderSize);
+        const size_t keySize = header[0];
+        const size_t valueSize = header[1];
+        const size_t avail = size - journalEntryHeaderSize;
+        if (keySize > avail || valueSize > avail - keySize) {
+            break;
+        }
+        const uint8_t* key = buf + journalEntryHeaderSize;
+        const uint8_t* value = key + keySize;
+        if ((crc32c(key, keySize) ^ crc32c(value, valueSize)) != header[2]) {
+            ALOGE("cache journal entry failed CRC check");
+            break;
+        }
+        cache->set(key, keySize, value, valueSize);
+        const size_t entrySize = journalEntryHeaderSize + keySize + valueSize;
+        buf += entrySize;
+        size -= entrySize;
+    }
+}
 
-        uint8_t* buf = new uint8_t [fileSize];
-        if (!buf) {
-            ALOGE("error allocating buffer for cache contents: %s (%d)",
+// Reads a whole file, which must not be larger than maxSize. The caller
+// deletes *buf.
+static bool readFile(const char* fname, size_t maxSize, uint8_t** buf,
+        size_t* size) {
+    int fd = open(fname, O_RDONLY, 0);
+    if (fd == -1) {
+        if (errno != ENOENT) {
+            ALOGE("error opening cache file %s: %s (%d)", fname,
                     strerror(errno), errno);
-            close(fd);
-            unlink(fname);
-            return;
         }
+        return false;
+    }
+    struct stat statBuf;
+    if (fstat(fd, &statBuf) == -1 || size_t(statBuf.st_size) > maxSize) {
+        ALOGE("can't read cache file %s", fname);
+        close(fd);
+        return false;
+    }
+    *size = statBuf.st_size;
+    *buf = new uint8_t [*size];
+    ssize_t n = read(fd, *buf, *size);
+    close(fd);
+    if (n != ssize_t(*size)) {
+        ALOGE("error reading cache file %s", fname);
+        delete [] *buf;
+        return false;
+    }
+    return true;
+}
 
-        status_t err = mBlobCache->flatten(buf + headerSize, cacheSize, NULL,
-                0);
-        if (err != OK) {
-            ALOGE("error writing cache contents: %s (%d)", strerror(-err),
-                    -err);
-            delete [] buf;
-            close(fd);
-            unlink(fname);
-            return;
+// Rewrites the cache file from its previous contents and its journal,
+// which is then emptied.  The new file replaces the old one atomically, so
+// a crash leaves either of them in place, plus a journal that's still valid
+// for both.
+static void compactCacheFile(const String8& filename, const String8& journal,
+        size_t maxValueSize, size_t maxTotalSize, mode_t mode) {
+    sp<BlobCache> cache(new BlobCache(maxKeySize, maxValueSize, maxTotalSize));
+    uint8_t* buf;
+    size_t size;
+    if (readFile(filename.string(), maxTotalSize * 2, &buf, &size)) {
+        const size_t headerSize = cacheFileHeaderSize;
+        if (size >= headerSize && memcmp(buf, cacheFileMagic, 4) == 0) {
+            uint32_t crc;
+            memcpy(&crc, buf + 4, sizeof(crc));
+            if (crc32c(buf + headerSize, size - headerSize) == crc) {
+                cache->unflatten(buf + headerSize, size - headerSize, NULL, 0);
+            }
         }
+        delete [] buf;
+    }
+    if (readFile(journal.string(), maxTotalSize * 4, &buf, &size)) {
+        replayJournal(buf, size, cache);
+        delete [] buf;
+    }
 
-        // Write the file magic and CRC
-        memcpy(buf, cacheFileMagic, 4);
-        uint32_t* crc = reinterpret_cast<uint32_t*>(buf + 4);
-        *crc = crc32c(buf + headerSize, cacheSize);
-
-        if (write(fd, buf, fileSize) == -1) {
-            ALOGE("error writing cache file: %s (%d)", strerror(errno),
-                    errno);
-            delete [] buf;
-            close(fd);
-            unlink(fname);
-            return;
-        }
+    size_t cacheSize = cache->getFlattenedSize();
+    size_t headerSize = cacheFileHeaderSize;
+    size_t fileSize = headerSize + cacheSize;
+    buf = new uint8_t [fileSize];
+    status_t err = cache->flatten(buf + headerSize, cacheSize, NULL, 0);
+    if (err != OK) {
+        ALOGE("error writing cache contents: %s (%d)", strerror(-err), -err);
+        delete [] buf;
+        return;
+    }
 
+    // Write the file magic and CRC
+    memcpy(buf, cacheFileMagic, 4);
+    uint32_t crc = crc32c(buf + headerSize, cacheSize);
+    memcpy(buf + 4, &crc, sizeof(crc));
+
+    String8 tmpname(filename);
+    tmpname.append(".tmp");
+    const char* fname = tmpname.string();
+    int fd = open(fname, O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        ALOGE("error creating cache file %s: %s (%d)", fname,
+                strerror(errno), errno);
+        delete [] buf;
+        return;
+    }
+    if (write(fd, buf, fileSize) != ssize_t(fileSize) || fsync(fd) == -1) {
+        ALOGE("error writing cache file: %s (%d)", strerror(errno), errno);
         delete [] buf;
-        fchmod(fd, S_IRUSR);
         close(fd);
+        unlink(fname);
+        return;
+    }
+    delete [] buf;
+    fchmod(fd, mode);
+    close(fd);
+
+    if (rename(fname, filename.string()) == -1) {
+        ALOGE("error renaming cache file %s: %s (%d)", fname,
+                strerror(errno), errno);
+        unlink(fname);
+        return;
+    }
+    truncate(journal.string(), 0);
+}
+
+void egl_cache_t::saveBlobCache() {
+    Mutex::Autolock persistLock(mPersistMutex);
+
+    // only the new entries are taken from the cache, under the lock
+    Vector<uint8_t> entries;
+    String8 filename;
+    bool shared;
+    size_t maxValueSize, maxTotalSize;
+    {
+        Mutex::Autolock lock(mMutex);
+        entries = mJournal;
+        mJournal.clear();
+        filename = mFilename;
+        shared = mFilename == mSharedFilename;
+        maxValueSize = mMaxValueSize;
+        maxTotalSize = mMaxTotalSize;
+    }
+    if (filename.length() == 0 || entries.isEmpty()) {
+        return;
+    }
+
+    String8 journal(filename);
+    journal.append(journalFileSuffix);
+    const char* fname = journal.string();
+    int fd = open(fname, O_CREAT | O_APPEND | O_WRONLY, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        ALOGE("error opening cache journal %s: %s (%d)", fname,
+                strerror(errno), errno);
+        return;
+    }
+    // a crash while appending leaves a torn entry, which is ignored when
+    // the journal is replayed
+    if (write(fd, entries.array(), entries.size()) == -1) {
+        ALOGE("error writing cache journal: %s (%d)", strerror(errno), errno);
+    }
+    struct stat statBuf;
+    size_t journalSize = 0;
+    if (fstat(fd, &statBuf) == 0) {
+        journalSize = statBuf.st_size;
+    }
+    close(fd);
+
+    // The shared cache file is read by other processes, which don't look at
+    // the journal, so it's always up to date.
+    if (shared) {
+        compactCacheFile(filename, journal, maxValueSize, maxTotalSize,
+                S_IRUSR | S_IRGRP | S_IROTH);
+    } else if (journalSize > maxTotalSize) {
+        compactCacheFile(filename, journal, maxValueSize, maxTotalSize,
+                S_IRUSR);
     }
 }
 
 void egl_cache_t::loadBlobCacheLocked() {
     if (mFilename.length() > 0) {
-        size_t headerSize = cacheFileHeaderSize;
-
-        int fd = open(mFilename.string(), O_RDONLY, 0);
-        if (fd == -1) {
-            if (errno != ENOENT) {
-                ALOGE("error opening cache file %s: %s (%d)", mFilename.string(),
-                        strerror(errno), errno);
+        void* map;
+        size_t mapSize;
+        if (mapCacheFileLocked(mFilename.string(), mBlobCache, &map,
+                &mapSize)) {
+            if (mMappedFile != MAP_FAILED) {
+                munmap(mMappedFile, mMappedFileSize);
             }
-            return;
+            mMappedFile = map;
+            mMappedFileSize = mapSize;
         }
 
-        struct stat statBuf;
-        if (fstat(fd, &statBuf) == -1) {
-            ALOGE("error stat'ing cache file: %s (%d)", strerror(errno), errno);
-            close(fd);
-            return;
+        String8 journal(mFilename);
+        journal.append(journalFileSuffix);
+        uint8_t* buf;
+        size_t size;
+        if (readFile(journal.string(), mMaxTotalSize * 4, &buf, &size)) {
+            replayJournal(buf, size, mBlobCache);
+            delete [] buf;
         }
+    }
 
-        // Sanity check the size before trying to mmap it.
-        size_t fileSize = statBuf.st_size;
-        if (fileSize > maxTotalSize * 2) {
-            ALOGE("cache file is too large: %#llx", statBuf.st_size);
-            close(fd);
-            return;
+    // The process populating the shared cache has its entries already.
+    if (mSharedFilename.length() > 0 && mFilename != mSharedFilename &&
+            mSharedBlobCache == NULL) {
+        sp<BlobCache> shared(new BlobCache(maxKeySize, mMaxValueSize,
+                mMaxTotalSize));
+        void* map;
+        size_t mapSize;
+        if (mapCacheFileLocked(mSharedFilename.string(), shared, &map,
+                &mapSize)) {
+            mSharedBlobCache = shared;
+            mSharedMappedFile = map;
+            mSharedMappedFileSize = mapSize;
         }
+    }
+}
 
-        uint8_t* buf = reinterpret_cast<uint8_t*>(mmap(NULL, fileSize,
-                PROT_READ, MAP_PRIVATE, fd, 0));
-        if (buf == MAP_FAILED) {
-            ALOGE("error mmaping cache file: %s (%d)", strerror(errno),
-                    errno);
-            close(fd);
-            return;
-        }
+bool egl_cache_t::mapCacheFileLocked(const char* filename,
+        const sp<BlobCache>& cache, void** map, size_t* mapSize) {
+    size_t headerSize = cacheFileHeaderSize;
 
-        // Check the file magic and CRC
-        size_t cacheSize = fileSize - headerSize;
-        if (memcmp(buf, cacheFileMagic, 4) != 0) {
-            ALOGE("cache file has bad mojo");
-            close(fd);
-            return;
-        }
-        uint32_t* crc = reinterpret_cast<uint32_t*>(buf + 4);
-        if (crc32c(buf + headerSize, cacheSize) != *crc) {
-            ALOGE("cache file failed CRC check");
-            close(fd);
-            return;
+    int fd = open(filename, O_RDONLY, 0);
+    if (fd == -1) {
+        if (errno != ENOENT) {
+            ALOGE("error opening cache file %s: %s (%d)", filename,
+                    strerror(errno), errno);
         }
+        return false;
+    }
 
-        status_t err = mBlobCache->unflatten(buf + headerSize, cacheSize, NULL,
-                0);
-        if (err != OK) {
-            ALOGE("error reading cache contents: %s (%d)", strerror(-err),
-                    -err);
-            munmap(buf, fileSize);
-            close(fd);
-            return;
-        }
+    struct stat statBuf;
+    if (fstat(fd, &statBuf) == -1) {
+        ALOGE("error stat'ing cache file: %s (%d)", strerror(errno), errno);
+        close(fd);
+        return false;
+    }
+
+    // Sanity check the size before trying to mmap it.
+    size_t fileSize = statBuf.st_size;
+    if (fileSize > mMaxTotalSize * 2) {
+        ALOGE("cache file is too large: %#llx", statBuf.st_size);
+        close(fd);
+        return false;
+    }
+
+    uint8_t* buf = reinterpret_cast<uint8_t*>(mmap(NULL, fileSize,
+            PROT_READ, MAP_PRIVATE, fd, 0));
+    if (buf == MAP_FAILED) {
+        ALOGE("error mmaping cache file: %s (%d)", strerror(errno),
+                errno);
+        close(fd);
+        return false;
+    }
+
+    // Check the file magic and CRC
+    size_t cacheSize = fileSize - headerSize;
+    if (fileSize < headerSize || memcmp(buf, cacheFileMagic, 4) != 0) {
+        ALOGE("cache file has bad mojo");
+        munmap(buf, fileSize);
+        close(fd);
+        return false;
+    }
+    uint32_t* crc = reinterpret_cast<uint32_t*>(buf + 4);
+    if (crc32c(buf + headerSize, cacheSize) != *crc) {
+        ALOGE("cache file failed CRC check");
+        munmap(buf, fileSize);
+        close(fd);
+        return false;
+    }
 
+    // Load the entries in place rather than copying them out of the
+    // mapping; it stays mapped until terminate(), and remains valid even
+    // after compactCacheFile() replaces the file.
+    status_t err = cache->unflattenInPlace(buf + headerSize, cacheSize);
+    if (err != OK) {
+        ALOGE("error reading cache contents: %s (%d)", strerror(-err),
+                -err);
         munmap(buf, fileSize);
         close(fd);
+        return false;
     }
+
+    *map = buf;
+    *mapSize = fileSize;
+    close(fd);
+    return true;
 }
 
 // ----------------------------------------------------------------------------
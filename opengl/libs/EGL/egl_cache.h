@@ -23,6 +23,7 @@
 #include <utils/BlobCache.h>
 #include <utils/String8.h>
 #include <utils/StrongPointer.h>
+#include <utils/Vector.h>
 
 // ----------------------------------------------------------------------------
 namespace android {
@@ -62,7 +63,9 @@ public:
         void* value, EGLsizeiANDROID valueSize);
 
     // setCacheFilename sets the name of the file that should be used to store
-    // cache contents from one program invocation to another.
+    // cache contents from one program invocation to another.  A process
+    // setting it to the shared cache file (see mSharedFilename) populates
+    // the shared cache for all the others.
     void setCacheFilename(const char* filename);
 
 private:
@@ -80,14 +83,30 @@ private:
     // possible.
     sp<BlobCache> getBlobCacheLocked();
 
-    // saveBlobCache attempts to save the current contents of mBlobCache to
-    // disk.
-    void saveBlobCacheLocked();
+    // saveBlobCache appends the entries inserted since the last save to the
+    // journal of the cache file, and compacts the journal into the cache
+    // file once it gets large.  The file I/O is done with mPersistMutex
+    // held but not mMutex, so lookups don't wait for it.
+    void saveBlobCache();
+
+    // journalBlobLocked records a new entry for the next saveBlobCache.
+    void journalBlobLocked(const void* key, EGLsizeiANDROID keySize,
+            const void* value, EGLsizeiANDROID valueSize);
 
     // loadBlobCache attempts to load the saved cache contents from disk into
-    // mBlobCache.
+    // mBlobCache, and the shared cache into mSharedBlobCache.
     void loadBlobCacheLocked();
 
+    // mapCacheFileLocked maps a cache file and loads its entries in place
+    // into cache.  On success *map and *mapSize describe the mapping, which
+    // must stay mapped while cache exists.
+    bool mapCacheFileLocked(const char* filename, const sp<BlobCache>& cache,
+            void** map, size_t* mapSize);
+
+    // unmapCacheFilesLocked unmaps the cache files the caches were loaded
+    // from; the caches must be gone already.
+    void unmapCacheFilesLocked();
+
     // mInitialized indicates whether the egl_cache_t is in the initialized
     // state.  It is initialized to false at construction time, and gets set to
     // true when initialize is called.  It is set back to false when terminate
@@ -108,6 +127,39 @@ private:
     // from disk.
     String8 mFilename;
 
+    // mSharedBlobCache holds the entries of the system-wide shared cache
+    // file, it is consulted before mBlobCache and never written to.  It is
+    // NULL if the device has no shared cache, or if this process is the one
+    // populating it.
+    sp<BlobCache> mSharedBlobCache;
+
+    // mSharedFilename is the name of the system-wide shared cache file, from
+    // the ro.egl.blobcache.shared property.  It has the format of the per-
+    // process cache files and is mapped read-only, so its pages are shared
+    // by all the processes using it.  An empty string disables it.
+    String8 mSharedFilename;
+
+    // mSharedMappedFile is the mapping of the shared cache file, or
+    // MAP_FAILED.
+    void* mSharedMappedFile;
+    size_t mSharedMappedFileSize;
+
+    // mMaxValueSize and mMaxTotalSize are the cache size limits, they can be
+    // set per device with the ro.egl.blobcache.maxentry and
+    // ro.egl.blobcache.maxsize properties.
+    size_t mMaxValueSize;
+    size_t mMaxTotalSize;
+
+    // mMappedFile is the mapping of the cache file that mBlobCache was loaded
+    // from, or MAP_FAILED.  The cache entries loaded from it refer to it
+    // rather than to copies, so it must stay mapped while mBlobCache exists.
+    void* mMappedFile;
+    size_t mMappedFileSize;
+
+    // mJournal holds the journal entries of the key/value pairs inserted
+    // since the last save.
+    Vector<uint8_t> mJournal;
+
     // mSavePending indicates whether or not a deferred save operation is
     // pending.  Each time a key/value pair is inserted into the cache via
     // setBlob, a deferred save is initiated if one is not already pending.
@@ -119,6 +171,10 @@ private:
     // variables. It must be locked whenever the member variables are accessed.
     mutable Mutex mMutex;
 
+    // mPersistMutex serializes the writes to the cache file and its
+    // journal.  It is never acquired with mMutex held.
+    Mutex mPersistMutex;
+
     // sCache is the singleton egl_cache_t object.
     static egl_cache_t sCache;
 };
@@ -86,19 +86,29 @@ egl_display_t* egl_display_t::get(EGLDisplay dpy) {
     return (index >= NUM_DISPLAYS) ? NULL : &sDisplay[index];
 }
 
+size_t egl_display_t::getObjectStripe(egl_object_t const* object) {
+    // objects are allocated with at least 8-byte alignment, the low bits
+    // carry no information
+    const uint32_t h = uint32_t(uintptr_t(object) >> 3) * 2654435761U;
+    return (h >> 16) % OBJECT_STRIPES;
+}
+
 void egl_display_t::addObject(egl_object_t* object) {
-    Mutex::Autolock _l(lock);
-    objects.add(object);
+    ObjectStripe& stripe(objects[getObjectStripe(object)]);
+    Mutex::Autolock _l(stripe.lock);
+    stripe.objects.add(object);
 }
 
 void egl_display_t::removeObject(egl_object_t* object) {
-    Mutex::Autolock _l(lock);
-    objects.remove(object);
+    ObjectStripe& stripe(objects[getObjectStripe(object)]);
+    Mutex::Autolock _l(stripe.lock);
+    stripe.objects.remove(object);
 }
 
 bool egl_display_t::getObject(egl_object_t* object) const {
-    Mutex::Autolock _l(lock);
-    if (objects.indexOf(object) >= 0) {
+    ObjectStripe const& stripe(objects[getObjectStripe(object)]);
+    Mutex::Autolock _l(stripe.lock);
+    if (stripe.objects.indexOf(object) >= 0) {
         if (object->getDisplay() == this) {
             object->incRef();
             return true;
@@ -302,15 +312,23 @@ EGLBoolean egl_display_t::terminate() {
     // Mark all objects remaining in the list as terminated, unless
     // there are no reference to them, it which case, we're free to
     // delete them.
-    size_t count = objects.size();
-    ALOGW_IF(count, "eglTerminate() called w/ %d objects remaining", count);
-    for (size_t i=0 ; i<count ; i++) {
-        egl_object_t* o = objects.itemAt(i);
-        o->destroy();
-    }
+    size_t remaining = 0;
+    for (size_t s=0 ; s<OBJECT_STRIPES ; s++) {
+        ObjectStripe& stripe(objects[s]);
+        Mutex::Autolock _s(stripe.lock);
+        size_t count = stripe.objects.size();
+        remaining += count;
+        for (size_t i=0 ; i<count ; i++) {
+            egl_object_t* o = stripe.objects.itemAt(i);
+            android_atomic_release_store(1, &o->terminated);
+            o->destroy();
+        }
 
-    // this marks all object handles are "terminated"
-    objects.clear();
+        // this marks all object handles are "terminated"
+        stripe.objects.clear();
+    }
+    ALOGW_IF(remaining, "eglTerminate() called w/ %d objects remaining",
+            remaining);
 
     refs--;
     return res;
@@ -130,9 +130,19 @@ private:
     bool enter() { return mHibernation.incWakeCount(HibernationMachine::WEAK); }
     void leave() { return mHibernation.decWakeCount(HibernationMachine::WEAK); }
 
+    // The live objects are spread over a few independently locked sets,
+    // picked by a hash of the object's address, so that threads validating
+    // different objects rarely wait for each other.
+    enum { OBJECT_STRIPES = 16 };
+    struct ObjectStripe {
+        mutable Mutex                   lock;
+        SortedVector<egl_object_t*>     objects;
+    };
+    static size_t getObjectStripe(egl_object_t const* object);
+
             uint32_t                    refs;
     mutable Mutex                       lock;
-            SortedVector<egl_object_t*> objects;
+            ObjectStripe                objects[OBJECT_STRIPES];
             String8 mVendorString;
             String8 mVersionString;
             String8 mClientApiString;
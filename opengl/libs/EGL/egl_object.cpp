@@ -26,13 +26,14 @@
 #include <utils/threads.h>
 
 #include "egl_object.h"
+#include "egl_tls.h"
 
 // ----------------------------------------------------------------------------
 namespace android {
 // ----------------------------------------------------------------------------
 
 egl_object_t::egl_object_t(egl_display_t* disp) :
-    display(disp), count(1) {
+    display(disp), count(1), terminated(0) {
     // NOTE: this does an implicit incRef
     display->addObject(this);
 }
@@ -42,6 +43,7 @@ egl_object_t::~egl_object_t() {
 
 void egl_object_t::terminate() {
     // this marks the object as "terminated"
+    android_atomic_release_store(1, &terminated);
     display->removeObject(this);
     if (decRef() == 1) {
         // shouldn't happen because this is called from LocalRef
@@ -58,9 +60,35 @@ void egl_object_t::destroy() {
 bool egl_object_t::get(egl_display_t const* display, egl_object_t* object) {
     // used by LocalRef, this does an incRef() atomically with
     // checking that the object is valid.
+    if (getCurrent(display, object)) {
+        return true;
+    }
     return display->getObject(object);
 }
 
+bool egl_object_t::getCurrent(egl_display_t const* display, egl_object_t* object) {
+    // The context current to this thread and its draw and read surfaces
+    // hold a reference that only this thread can give up (by making
+    // something else current), so they can be validated without taking
+    // the display lock. The handle is only compared, never dereferenced,
+    // until it is known to be one of these objects.
+    egl_context_t* const c = get_context(egl_tls_t::getContext());
+    if (c == NULL) {
+        return false;
+    }
+    if (object != c &&
+            object != get_surface(c->draw) &&
+            object != get_surface(c->read)) {
+        return false;
+    }
+    if (object->getDisplay() != display ||
+            android_atomic_acquire_load(&object->terminated)) {
+        return false;
+    }
+    object->incRef();
+    return true;
+}
+
 // ----------------------------------------------------------------------------
 
 egl_surface_t::egl_surface_t(egl_display_t* dpy, EGLConfig config,
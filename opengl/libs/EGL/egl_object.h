@@ -43,6 +43,7 @@ struct egl_display_t;
 class egl_object_t {
     egl_display_t *display;
     mutable volatile int32_t count;
+    volatile int32_t terminated;
 
 protected:
     virtual ~egl_object_t();
@@ -54,10 +55,13 @@ public:
     inline int32_t incRef() { return android_atomic_inc(&count); }
     inline int32_t decRef() { return android_atomic_dec(&count); }
     inline egl_display_t* getDisplay() const { return display; }
+    inline bool isTerminated() const { return terminated != 0; }
 
 private:
+    friend class egl_display_t;
     void terminate();
     static bool get(egl_display_t const* display, egl_object_t* object);
+    static bool getCurrent(egl_display_t const* display, egl_object_t* object);
 
 public:
     template <typename N, typename T>
@@ -35,7 +35,7 @@ namespace android {
 #undef GL_EXTENSION_LIST
 #undef GET_TLS
 
-#if USE_FAST_TLS_KEY
+#if USE_FAST_TLS_KEY && defined(__arm__)
 
     #ifdef HAVE_ARM_TLS_REGISTER
         #define GET_TLS(reg) \
@@ -71,6 +71,35 @@ namespace android {
             CALL_GL_EXTENSION_API(_n);               \
         }
 
+#elif USE_FAST_TLS_KEY && defined(__i386__)
+
+    // see GLES2/gl2.cpp, this relies on -fomit-frame-pointer
+    #define API_ENTRY(_api) __attribute__((noinline)) _api
+
+    #define CALL_GL_EXTENSION_API(_api)                         \
+         asm volatile(                                          \
+            "mov   %%gs:0, %%eax         \n"                    \
+            "mov   %P[tls](%%eax), %%eax \n"                    \
+            "test  %%eax, %%eax          \n"                    \
+            "je    1f                    \n"                    \
+            "mov   %P[api](%%eax), %%eax \n"                    \
+            "test  %%eax, %%eax          \n"                    \
+            "je    1f                    \n"                    \
+            "jmp   *%%eax                \n"                    \
+            "1:                          \n"                    \
+            :                                                   \
+            : [tls] "i"(TLS_SLOT_OPENGL_API*4),                 \
+              [api] "i"(__builtin_offsetof(gl_hooks_t,          \
+                                      ext.extensions[_api]))    \
+            : "eax", "cc"                                       \
+            );
+
+    #define GL_EXTENSION_NAME(_n)   __glExtFwd##_n
+
+    #define GL_EXTENSION(_n)                         \
+        void API_ENTRY(GL_EXTENSION_NAME(_n))() {    \
+            CALL_GL_EXTENSION_API(_n);               \
+        }
 
 #else
 
@@ -16,8 +16,11 @@
 
 #if EGL_TRACE
 
+#include <pthread.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
@@ -30,8 +33,10 @@
 #include <utils/Trace.h>
 
 #include <utils/CallStack.h>
+#include <utils/Timers.h>
 
 #include "egl_tls.h"
+#include "egldefs.h"
 #include "hooks.h"
 
 // ----------------------------------------------------------------------------
@@ -384,20 +389,252 @@ extern "C" {
 // Systrace
 ///////////////////////////////////////////////////////////////////////////
 
+/*
+ * Tracing every GL call as a span makes the traces of real applications huge
+ * and slows them down too much to be useful, so the entry points are sorted
+ * in classes (draw calls, state changes, uploads, sync/flush and the EGL
+ * calls of eglApi.cpp) and only the classes listed in "debug.egl.trace.classes"
+ * are instrumented; the others go straight to the implementation.
+ *
+ * The calls and the time spent in each instrumented class are reported per
+ * frame as systrace counters from eglSwapBuffers. When "debug.egl.trace.min_us"
+ * is set, a call only gets a slice, named after the entry point and its
+ * duration and placed where it returned, if it took at least that long;
+ * otherwise every instrumented call is traced as a span.
+ */
+
+#define GL_ENTRY_COUNT          (sizeof(gl_hooks_t::gl_t) / sizeof(void*))
+#define GL_ENTRY_INDEX(_api)    (offsetof(gl_hooks_t::gl_t, _api) / sizeof(void*))
+
+enum {
+    SYSTRACE_DRAW,
+    SYSTRACE_STATE,
+    SYSTRACE_UPLOAD,
+    SYSTRACE_SYNC,
+    SYSTRACE_EGL,
+    SYSTRACE_CLASS_COUNT
+};
+
+static const char* const sSystraceClassNames[SYSTRACE_CLASS_COUNT] = {
+    "draw", "state", "upload", "sync", "egl"
+};
+
+static const char* const sSystraceCallCounters[SYSTRACE_CLASS_COUNT] = {
+    "GL draw calls", "GL state calls", "GL upload calls", "GL sync calls",
+    "EGL calls"
+};
+
+static const char* const sSystraceTimeCounters[SYSTRACE_CLASS_COUNT] = {
+    "GL draw time (us)", "GL state time (us)", "GL upload time (us)",
+    "GL sync time (us)", "EGL time (us)"
+};
+
+// entry points are matched by prefix, anything not listed is a state change
+static const struct {
+    const char* prefix;
+    uint8_t cls;
+} sSystraceClassPrefixes[] = {
+    { "glDrawArrays",           SYSTRACE_DRAW },
+    { "glDrawElements",         SYSTRACE_DRAW },
+    { "glDrawTex",              SYSTRACE_DRAW },
+    { "glBlitFramebuffer",      SYSTRACE_DRAW },
+    { "glResolveMultisample",   SYSTRACE_DRAW },
+    { "glTexImage",             SYSTRACE_UPLOAD },
+    { "glTexSubImage",          SYSTRACE_UPLOAD },
+    { "glCompressedTex",        SYSTRACE_UPLOAD },
+    { "glCopyTex",              SYSTRACE_UPLOAD },
+    { "glTexStorage",           SYSTRACE_UPLOAD },
+    { "glTextureStorage",       SYSTRACE_UPLOAD },
+    { "glBufferData",           SYSTRACE_UPLOAD },
+    { "glBufferSubData",        SYSTRACE_UPLOAD },
+    { "glMapBuffer",            SYSTRACE_UPLOAD },
+    { "glUnmapBuffer",          SYSTRACE_UPLOAD },
+    { "glGenerateMipmap",       SYSTRACE_UPLOAD },
+    { "glEGLImageTarget",       SYSTRACE_UPLOAD },
+    { "glShaderSource",         SYSTRACE_UPLOAD },
+    { "glShaderBinary",         SYSTRACE_UPLOAD },
+    { "glCompileShader",        SYSTRACE_UPLOAD },
+    { "glLinkProgram",          SYSTRACE_UPLOAD },
+    { "glProgramBinary",        SYSTRACE_UPLOAD },
+    { "glFinish",               SYSTRACE_SYNC },
+    { "glFlush",                SYSTRACE_SYNC },
+    { "glSetFence",             SYSTRACE_SYNC },
+    { "glTestFence",            SYSTRACE_SYNC },
+    { "glReadPixels",           SYSTRACE_SYNC },
+    { "glReadnPixels",          SYSTRACE_SYNC },
+};
+
+struct GLSystraceFrame {
+    uint32_t calls[SYSTRACE_CLASS_COUNT];
+    nsecs_t time[SYSTRACE_CLASS_COUNT];
+};
+
+static uint8_t sSystraceClass[GL_ENTRY_COUNT];
+static uint32_t sSystraceClassMask = (1 << SYSTRACE_CLASS_COUNT) - 1;
+static nsecs_t sSystraceMinDuration;
+
+static pthread_key_t sGLSystraceKey;
+static pthread_once_t sGLSystraceOnce = PTHREAD_ONCE_INIT;
+
+static void initGLSystrace() {
+    pthread_key_create(&sGLSystraceKey, free);
+    const size_t prefixCount =
+            sizeof(sSystraceClassPrefixes) / sizeof(sSystraceClassPrefixes[0]);
+    for (size_t i=0 ; i<GL_ENTRY_COUNT ; i++) {
+        sSystraceClass[i] = SYSTRACE_STATE;
+        for (size_t j=0 ; j<prefixCount ; j++) {
+            const char* prefix = sSystraceClassPrefixes[j].prefix;
+            if (!strncmp(gl_names[i], prefix, strlen(prefix))) {
+                sSystraceClass[i] = sSystraceClassPrefixes[j].cls;
+                break;
+            }
+        }
+    }
+    // glClear is the only one of its family that isn't a state change
+    sSystraceClass[GL_ENTRY_INDEX(glClear)] = SYSTRACE_DRAW;
+}
+
+static GLSystraceFrame* getGLSystraceFrame() {
+    GLSystraceFrame* frame = static_cast<GLSystraceFrame*>(
+            pthread_getspecific(sGLSystraceKey));
+    if (frame == NULL) {
+        frame = static_cast<GLSystraceFrame*>(
+                calloc(1, sizeof(GLSystraceFrame)));
+        pthread_setspecific(sGLSystraceKey, frame);
+    }
+    return frame;
+}
+
+/*
+ * Called from initEglTraceLevel() with the values of "debug.egl.trace.classes",
+ * a comma separated list of class names ("all" or empty for every class), and
+ * of "debug.egl.trace.min_us".
+ */
+void GLSystrace_init(const char* classes, int minDurationUs) {
+    pthread_once(&sGLSystraceOnce, initGLSystrace);
+
+    uint32_t mask = 0;
+    const char* p = classes;
+    while (*p) {
+        size_t len = strcspn(p, ",");
+        if (len == 3 && !strncasecmp(p, "all", len)) {
+            mask = (1 << SYSTRACE_CLASS_COUNT) - 1;
+        }
+        for (size_t i=0 ; i<SYSTRACE_CLASS_COUNT ; i++) {
+            if (len == strlen(sSystraceClassNames[i]) &&
+                    !strncasecmp(p, sSystraceClassNames[i], len)) {
+                mask |= 1 << i;
+            }
+        }
+        p += len;
+        if (*p == ',')
+            p++;
+    }
+    if (mask == 0) {
+        if (*classes)
+            ALOGW("debug.egl.trace.classes: no class in \"%s\"", classes);
+        mask = (1 << SYSTRACE_CLASS_COUNT) - 1;
+    }
+    sSystraceClassMask = mask;
+    sSystraceMinDuration = minDurationUs > 0 ? us2ns(minDurationUs) : 0;
+}
+
+static inline bool isSystraced(uint8_t cls) {
+    return sSystraceClassMask & (1 << cls);
+}
+
+static inline void beginSystraceCall(const char* name) {
+    if (sSystraceMinDuration == 0)
+        Tracer::traceBegin(ATRACE_TAG, name);
+}
+
+/*
+ * With a duration threshold the slow calls are marked after the fact, since
+ * there is no cheap way to open a slice retroactively.
+ */
+static void endSystraceCall(uint8_t cls, const char* name, nsecs_t start) {
+    const nsecs_t t = systemTime() - start;
+    if (sSystraceMinDuration == 0) {
+        Tracer::traceEnd(ATRACE_TAG);
+    } else if (t >= sSystraceMinDuration && ATRACE_ENABLED()) {
+        char slice[128];
+        snprintf(slice, sizeof(slice), "%s %lld us", name, ns2us(t));
+        Tracer::traceBegin(ATRACE_TAG, slice);
+        Tracer::traceEnd(ATRACE_TAG);
+    }
+    GLSystraceFrame* frame = getGLSystraceFrame();
+    if (frame) {
+        frame->calls[cls]++;
+        frame->time[cls] += t;
+    }
+}
+
+class GLSystraceCall {
+    const char* const mName;
+    const uint8_t mClass;
+    const nsecs_t mStart;
+public:
+    inline GLSystraceCall(uint8_t cls, const char* name)
+        : mName(name), mClass(cls), mStart(systemTime()) {
+        beginSystraceCall(mName);
+    }
+    inline ~GLSystraceCall() {
+        endSystraceCall(mClass, mName, mStart);
+    }
+};
+
+/*
+ * The EGL class covers the entry points of eglApi.cpp that can block or
+ * reach the driver; they are bracketed with these two calls. Begin returns
+ * a negative time when the class isn't traced.
+ */
+nsecs_t GLSystrace_eglCallBegin(const char* name) {
+    if (!isSystraced(SYSTRACE_EGL))
+        return -1;
+    beginSystraceCall(name);
+    return systemTime();
+}
+
+void GLSystrace_eglCallEnd(const char* name, nsecs_t start) {
+    endSystraceCall(SYSTRACE_EGL, name, start);
+}
+
+void GLSystrace_eglSwapBuffers() {
+    GLSystraceFrame* frame = getGLSystraceFrame();
+    if (frame == NULL)
+        return;
+
+    for (size_t i=0 ; i<SYSTRACE_CLASS_COUNT ; i++) {
+        if (isSystraced(i)) {
+            ATRACE_INT(sSystraceCallCounters[i], frame->calls[i]);
+            ATRACE_INT(sSystraceTimeCounters[i], int32_t(ns2us(frame->time[i])));
+        }
+    }
+    memset(frame, 0, sizeof(GLSystraceFrame));
+}
+
 #undef TRACE_GL_VOID
 #undef TRACE_GL
 
 #define TRACE_GL_VOID(_api, _args, _argList, ...)                         \
 static void Systrace_ ## _api _args {                                     \
-    ATRACE_NAME(#_api);                                                   \
+    const uint8_t _cls = sSystraceClass[GL_ENTRY_INDEX(_api)];            \
     gl_hooks_t::gl_t const * const _c = &getGLTraceThreadSpecific()->gl;  \
+    if (!isSystraced(_cls)) {                                             \
+        _c->_api _argList;                                                \
+        return;                                                           \
+    }                                                                     \
+    GLSystraceCall _s(_cls, #_api);                                       \
     _c->_api _argList;                                                    \
 }
 
 #define TRACE_GL(_type, _api, _args, _argList, ...)                       \
 static _type Systrace_ ## _api _args {                                    \
-    ATRACE_NAME(#_api);                                                   \
+    const uint8_t _cls = sSystraceClass[GL_ENTRY_INDEX(_api)];            \
     gl_hooks_t::gl_t const * const _c = &getGLTraceThreadSpecific()->gl;  \
+    if (!isSystraced(_cls))                                               \
+        return _c->_api _argList;                                         \
+    GLSystraceCall _s(_cls, #_api);                                       \
     return _c->_api _argList;                                             \
 }
 
@@ -473,6 +710,154 @@ EGLAPI gl_hooks_t gHooksErrorTrace = {
 #undef GL_ENTRY
 #undef CHECK_ERROR
 
+///////////////////////////////////////////////////////////////////////////
+// Stats
+///////////////////////////////////////////////////////////////////////////
+
+/*
+ * Only counts the calls to each GL entry point and the time spent in them,
+ * in a per thread table, so that applications can be profiled at close to
+ * their real speed. The totals of each frame are reported as systrace
+ * counters, and the totals of each entry point are logged every
+ * STATS_LOG_PERIOD frames. eglMakeCurrent calls that really switch the
+ * context or surfaces are counted and timed the same way.
+ */
+
+static const uint32_t STATS_LOG_PERIOD = 300;
+
+struct GLStats {
+    uint32_t frames;
+    uint32_t frameCalls;
+    nsecs_t frameTime;
+    uint32_t frameSwitches;
+    nsecs_t frameSwitchTime;
+    uint32_t makeCurrentCalls;
+    uint32_t switches;
+    nsecs_t switchTime;
+    uint32_t calls[GL_ENTRY_COUNT];
+    nsecs_t time[GL_ENTRY_COUNT];
+};
+
+static pthread_key_t sGLStatsKey;
+static pthread_once_t sGLStatsOnce = PTHREAD_ONCE_INIT;
+
+static void createGLStatsKey() {
+    pthread_key_create(&sGLStatsKey, free);
+}
+
+static GLStats* getGLStats() {
+    pthread_once(&sGLStatsOnce, createGLStatsKey);
+    GLStats* stats = static_cast<GLStats*>(pthread_getspecific(sGLStatsKey));
+    if (stats == NULL) {
+        stats = static_cast<GLStats*>(calloc(1, sizeof(GLStats)));
+        pthread_setspecific(sGLStatsKey, stats);
+    }
+    return stats;
+}
+
+class GLStatsCall {
+    GLStats* const mStats;
+    const size_t mIndex;
+    const nsecs_t mStart;
+public:
+    inline GLStatsCall(size_t index)
+        : mStats(getGLStats()), mIndex(index), mStart(systemTime()) {
+    }
+    inline ~GLStatsCall() {
+        if (mStats) {
+            const nsecs_t t = systemTime() - mStart;
+            mStats->calls[mIndex]++;
+            mStats->time[mIndex] += t;
+            mStats->frameCalls++;
+            mStats->frameTime += t;
+        }
+    }
+};
+
+void GLStats_eglMakeCurrent(bool switched, nsecs_t duration) {
+    GLStats* stats = getGLStats();
+    if (stats == NULL)
+        return;
+
+    stats->makeCurrentCalls++;
+    if (switched) {
+        stats->switches++;
+        stats->switchTime += duration;
+        stats->frameSwitches++;
+        stats->frameSwitchTime += duration;
+    }
+}
+
+void GLStats_eglSwapBuffers() {
+    GLStats* stats = getGLStats();
+    if (stats == NULL)
+        return;
+
+    ATRACE_INT("GL calls", stats->frameCalls);
+    ATRACE_INT("GL time (us)", int32_t(ns2us(stats->frameTime)));
+    ATRACE_INT("EGL context switches", stats->frameSwitches);
+    ATRACE_INT("EGL context switch time (us)",
+            int32_t(ns2us(stats->frameSwitchTime)));
+    stats->frameCalls = 0;
+    stats->frameTime = 0;
+    stats->frameSwitches = 0;
+    stats->frameSwitchTime = 0;
+
+    if (++stats->frames < STATS_LOG_PERIOD)
+        return;
+
+    ALOGD("EGL stats for the last %u frames: %u eglMakeCurrent, "
+            "%u switches, %lld us switching", stats->frames,
+            stats->makeCurrentCalls, stats->switches,
+            ns2us(stats->switchTime));
+    ALOGD("GL stats for the last %u frames: calls, total us, average ns",
+            stats->frames);
+    for (size_t i=0 ; i<GL_ENTRY_COUNT ; i++) {
+        if (stats->calls[i]) {
+            ALOGD("%-40s %8u %10lld %8lld", gl_names[i], stats->calls[i],
+                    ns2us(stats->time[i]), stats->time[i] / stats->calls[i]);
+        }
+    }
+    memset(stats, 0, sizeof(GLStats));
+}
+
+#undef TRACE_GL_VOID
+#undef TRACE_GL
+
+#define TRACE_GL_VOID(_api, _args, _argList, ...)                         \
+static void Stats_ ## _api _args {                                        \
+    GLStatsCall _s(GL_ENTRY_INDEX(_api));                                 \
+    gl_hooks_t::gl_t const * const _c = &getGLTraceThreadSpecific()->gl;  \
+    _c->_api _argList;                                                    \
+}
+
+#define TRACE_GL(_type, _api, _args, _argList, ...)                       \
+static _type Stats_ ## _api _args {                                       \
+    GLStatsCall _s(GL_ENTRY_INDEX(_api));                                 \
+    gl_hooks_t::gl_t const * const _c = &getGLTraceThreadSpecific()->gl;  \
+    return _c->_api _argList;                                             \
+}
+
+extern "C" {
+#include "../trace.in"
+}
+
+#undef TRACE_GL_VOID
+#undef TRACE_GL
+
+#define GL_ENTRY(_r, _api, ...) Stats_ ## _api,
+EGLAPI gl_hooks_t gHooksStats = {
+    {
+        #include "entries.in"
+    },
+    {
+        {0}
+    }
+};
+#undef GL_ENTRY
+#undef GL_ENTRY_INDEX
+#undef GL_ENTRY_COUNT
+
 #undef TRACE_GL_VOID
 #undef TRACE_GL
 
@@ -14,7 +14,15 @@
 
 #include <ETC1/etc1.h>
 
+#include <pthread.h>
 #include <string.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
 
 /* From http://www.khronos.org/registry/gles/extensions/OES/OES_compressed_ETC1_RGB8_texture.txt
 
@@ -163,41 +171,51 @@ inline int convertDiff(int base, int diff) {
     return convert5To8((0x1f & base) + kLookup[0x7 & diff]);
 }
 
+// Computes the four colors the pixels of a sub-block with the base color
+// (r, g, b) can take, in the order of the pixel index values, as R, G, B, A
+// bytes. Decoding a pixel is then a look-up instead of three clamps.
+
 static
-void decode_subblock(etc1_byte* pOut, int r, int g, int b, const int* table,
-        etc1_uint32 low, bool second, bool flipped) {
-    int baseX = 0;
-    int baseY = 0;
-    if (second) {
-        if (flipped) {
-            baseY = 2;
-        } else {
-            baseX = 2;
-        }
-    }
-    for (int i = 0; i < 8; i++) {
-        int x, y;
-        if (flipped) {
-            x = baseX + (i >> 1);
-            y = baseY + (i & 1);
-        } else {
-            x = baseX + (i >> 2);
-            y = baseY + (i & 3);
-        }
-        int k = y + (x * 4);
-        int offset = ((low >> k) & 1) | ((low >> (k + 15)) & 2);
-        int delta = table[offset];
-        etc1_byte* q = pOut + 3 * (x + 4 * y);
-        *q++ = clamp(r + delta);
-        *q++ = clamp(g + delta);
-        *q++ = clamp(b + delta);
+inline void decode_palette(etc1_byte* pPalette, int r, int g, int b,
+        const int* table) {
+#if defined(__SSE2__)
+    __m128i lo = _mm_setr_epi16(r + table[0], g + table[0], b + table[0], 255,
+            r + table[1], g + table[1], b + table[1], 255);
+    __m128i hi = _mm_setr_epi16(r + table[2], g + table[2], b + table[2], 255,
+            r + table[3], g + table[3], b + table[3], 255);
+    _mm_storeu_si128((__m128i*) pPalette, _mm_packus_epi16(lo, hi));
+#elif defined(__ARM_NEON__)
+    const int16_t d[8] = {
+            (int16_t) table[0], (int16_t) table[0], (int16_t) table[0], 0,
+            (int16_t) table[1], (int16_t) table[1], (int16_t) table[1], 0 };
+    const int16_t e[8] = {
+            (int16_t) table[2], (int16_t) table[2], (int16_t) table[2], 0,
+            (int16_t) table[3], (int16_t) table[3], (int16_t) table[3], 0 };
+    const int16_t c[8] = {
+            (int16_t) r, (int16_t) g, (int16_t) b, 255,
+            (int16_t) r, (int16_t) g, (int16_t) b, 255 };
+    const int16x8_t base = vld1q_s16(c);
+    vst1_u8(pPalette, vqmovun_s16(vaddq_s16(base, vld1q_s16(d))));
+    vst1_u8(pPalette + 8, vqmovun_s16(vaddq_s16(base, vld1q_s16(e))));
+#else
+    for (int i = 0; i < 4; i++) {
+        int delta = table[i];
+        *pPalette++ = clamp(r + delta);
+        *pPalette++ = clamp(g + delta);
+        *pPalette++ = clamp(b + delta);
+        *pPalette++ = 255;
     }
+#endif
 }
 
-// Input is an ETC1 compressed version of the data.
-// Output is a 4 x 4 square of 3-byte pixels in form R, G, B
+// Decodes an ETC1 block into the xEnd x yEnd top left pixels at pOut, with
+// lines stride bytes apart. FORMAT is the pixel size: 2 is RGB 565, 3 is
+// R, G, B and 4 is R, G, B, A.
 
-void etc1_decode_block(const etc1_byte* pIn, etc1_byte* pOut) {
+template <int FORMAT>
+static
+void decode_block(const etc1_byte* pIn, etc1_byte* pOut, etc1_uint32 stride,
+        etc1_uint32 xEnd, etc1_uint32 yEnd) {
     etc1_uint32 high = (pIn[0] << 24) | (pIn[1] << 16) | (pIn[2] << 8) | pIn[3];
     etc1_uint32 low = (pIn[4] << 24) | (pIn[5] << 16) | (pIn[6] << 8) | pIn[7];
     int r1, r2, g1, g2, b1, b2;
@@ -226,8 +244,47 @@ void etc1_decode_block(const etc1_byte* pIn, etc1_byte* pOut) {
     const int* tableA = kModifierTable + tableIndexA * 4;
     const int* tableB = kModifierTable + tableIndexB * 4;
     bool flipped = (high & 1) != 0;
-    decode_subblock(pOut, r1, g1, b1, tableA, low, false, flipped);
-    decode_subblock(pOut, r2, g2, b2, tableB, low, true, flipped);
+
+    etc1_byte palette[2][16];
+    decode_palette(palette[0], r1, g1, b1, tableA);
+    decode_palette(palette[1], r2, g2, b2, tableB);
+    unsigned short palette565[2][4];
+    if (FORMAT == 2) {
+        for (int i = 0; i < 8; i++) {
+            const etc1_byte* c = palette[i >> 2] + (i & 3) * 4;
+            palette565[i >> 2][i & 3] = (unsigned short)
+                    (((c[0] >> 3) << 11) | ((c[1] >> 2) << 5) | (c[2] >> 3));
+        }
+    }
+
+    for (etc1_uint32 y = 0; y < yEnd; y++) {
+        etc1_byte* q = pOut + stride * y;
+        for (etc1_uint32 x = 0; x < xEnd; x++) {
+            int k = y + (x * 4);
+            int offset = ((low >> k) & 1) | ((low >> (k + 15)) & 2);
+            int second = flipped ? (y >= 2) : (x >= 2);
+            if (FORMAT == 2) {
+                etc1_uint32 pixel = palette565[second][offset];
+                *q++ = (etc1_byte) pixel;
+                *q++ = (etc1_byte) (pixel >> 8);
+            } else {
+                const etc1_byte* c = palette[second] + offset * 4;
+                *q++ = c[0];
+                *q++ = c[1];
+                *q++ = c[2];
+                if (FORMAT == 4) {
+                    *q++ = c[3];
+                }
+            }
+        }
+    }
+}
+
+// Input is an ETC1 compressed version of the data.
+// Output is a 4 x 4 square of 3-byte pixels in form R, G, B
+
+void etc1_decode_block(const etc1_byte* pIn, etc1_byte* pOut) {
+    decode_block<3>(pIn, pOut, 4 * 3, 4, 4);
 }
 
 typedef struct {
@@ -295,17 +352,100 @@ inline int square(int x) {
     return x * x;
 }
 
-static etc1_uint32 chooseModifier(const etc1_byte* pBaseColors,
-        const etc1_byte* pIn, etc1_uint32 *pLow, int bitIndex,
-        const int* pModifierTable) {
+// Returns the index of the modifier of pModifierTable that best encodes the
+// pixel pIn with the base color (r, g, b), and its score in *pScore. Ties go
+// to the lowest index.
+
+#if defined(__SSE2__)
+
+static
+inline int findBestModifier(int r, int g, int b, const etc1_byte* pIn,
+        const int* pModifierTable, etc1_uint32* pScore) {
+    // green and red are interleaved in the 16-bit lanes so that
+    // _mm_madd_epi16() adds up their weighted squares for each modifier
+    const __m128i modifiers = _mm_setr_epi16(
+            pModifierTable[0], pModifierTable[0],
+            pModifierTable[1], pModifierTable[1],
+            pModifierTable[2], pModifierTable[2],
+            pModifierTable[3], pModifierTable[3]);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i max = _mm_set1_epi16(255);
+
+    __m128i gr = _mm_add_epi16(_mm_setr_epi16(g, r, g, r, g, r, g, r), modifiers);
+    gr = _mm_min_epi16(_mm_max_epi16(gr, zero), max);
+    gr = _mm_sub_epi16(gr, _mm_setr_epi16(pIn[1], pIn[0], pIn[1], pIn[0],
+            pIn[1], pIn[0], pIn[1], pIn[0]));
+    __m128i score = _mm_madd_epi16(gr,
+            _mm_mullo_epi16(gr, _mm_setr_epi16(6, 3, 6, 3, 6, 3, 6, 3)));
+
+    __m128i bb = _mm_add_epi16(_mm_set1_epi16(b), modifiers);
+    bb = _mm_min_epi16(_mm_max_epi16(bb, zero), max);
+    bb = _mm_sub_epi16(bb, _mm_set1_epi16(pIn[2]));
+    score = _mm_add_epi32(score, _mm_madd_epi16(bb,
+            _mm_and_si128(bb, _mm_setr_epi16(-1, 0, -1, 0, -1, 0, -1, 0))));
+
+    etc1_uint32 scores[4];
+    _mm_storeu_si128((__m128i*) scores, score);
+    int bestIndex = 0;
+    for (int i = 1; i < 4; i++) {
+        if (scores[i] < scores[bestIndex]) {
+            bestIndex = i;
+        }
+    }
+    *pScore = scores[bestIndex];
+    return bestIndex;
+}
+
+#elif defined(__ARM_NEON__)
+
+static
+inline int findBestModifier(int r, int g, int b, const etc1_byte* pIn,
+        const int* pModifierTable, etc1_uint32* pScore) {
+    // green in the low half of the lanes, red in the high half
+    const int16_t m[8] = {
+            (int16_t) pModifierTable[0], (int16_t) pModifierTable[1],
+            (int16_t) pModifierTable[2], (int16_t) pModifierTable[3],
+            (int16_t) pModifierTable[0], (int16_t) pModifierTable[1],
+            (int16_t) pModifierTable[2], (int16_t) pModifierTable[3] };
+    static const int16_t kWeights[8] = { 6, 6, 6, 6, 3, 3, 3, 3 };
+    const int16x8_t modifiers = vld1q_s16(m);
+    const int16x8_t zero = vdupq_n_s16(0);
+    const int16x8_t max = vdupq_n_s16(255);
+
+    int16x8_t gr = vcombine_s16(vdup_n_s16(g), vdup_n_s16(r));
+    gr = vminq_s16(vmaxq_s16(vaddq_s16(gr, modifiers), zero), max);
+    gr = vsubq_s16(gr, vcombine_s16(vdup_n_s16(pIn[1]), vdup_n_s16(pIn[0])));
+    const int16x8_t grw = vmulq_s16(gr, vld1q_s16(kWeights));
+    int32x4_t score = vmull_s16(vget_low_s16(gr), vget_low_s16(grw));
+    score = vmlal_s16(score, vget_high_s16(gr), vget_high_s16(grw));
+
+    int16x4_t bb = vadd_s16(vdup_n_s16(b), vget_low_s16(modifiers));
+    bb = vmin_s16(vmax_s16(bb, vget_low_s16(zero)), vget_low_s16(max));
+    bb = vsub_s16(bb, vdup_n_s16(pIn[2]));
+    score = vmlal_s16(score, bb, bb);
+
+    etc1_uint32 scores[4];
+    vst1q_u32(scores, vreinterpretq_u32_s32(score));
+    int bestIndex = 0;
+    for (int i = 1; i < 4; i++) {
+        if (scores[i] < scores[bestIndex]) {
+            bestIndex = i;
+        }
+    }
+    *pScore = scores[bestIndex];
+    return bestIndex;
+}
+
+#else
+
+static
+inline int findBestModifier(int r, int g, int b, const etc1_byte* pIn,
+        const int* pModifierTable, etc1_uint32* pScore) {
     etc1_uint32 bestScore = ~0;
     int bestIndex = 0;
     int pixelR = pIn[0];
     int pixelG = pIn[1];
     int pixelB = pIn[2];
-    int r = pBaseColors[0];
-    int g = pBaseColors[1];
-    int b = pBaseColors[2];
     for (int i = 0; i < 4; i++) {
         int modifier = pModifierTable[i];
         int decodedG = clamp(g + modifier);
@@ -325,6 +465,18 @@ static etc1_uint32 chooseModifier(const etc1_byte* pBaseColors,
             bestIndex = i;
         }
     }
+    *pScore = bestScore;
+    return bestIndex;
+}
+
+#endif
+
+static etc1_uint32 chooseModifier(const etc1_byte* pBaseColors,
+        const etc1_byte* pIn, etc1_uint32 *pLow, int bitIndex,
+        const int* pModifierTable) {
+    etc1_uint32 bestScore;
+    int bestIndex = findBestModifier(pBaseColors[0], pBaseColors[1],
+            pBaseColors[2], pIn, pModifierTable, &bestScore);
     etc1_uint32 lowMask = (((bestIndex >> 1) << 16) | (bestIndex & 1))
             << bitIndex;
     *pLow |= lowMask;
@@ -429,9 +581,45 @@ static void etc_encodeBaseColors(etc1_byte* pBaseColors,
     pBaseColors[5] = b2;
 }
 
+// Picks the modifier tables worth trying for a sub-block, without trying
+// them all: the pixels' largest (luma weighted) distance from the base color
+// falls between the large modifiers of two consecutive tables, and those
+// two are tried.
+
+static
+void etc_choose_tables_subblock(const etc1_byte* pIn, etc1_uint32 inMask,
+        bool flipped, bool second, const etc1_byte* pBaseColors,
+        int* pFirst, int* pLast) {
+    int maxDelta = 0;
+    for (int i = 0; i < 16; i++) {
+        int x = i & 3;
+        int y = i >> 2;
+        bool inSecond = flipped ? (y >= 2) : (x >= 2);
+        if (inSecond != second || !(inMask & (1 << i))) {
+            continue;
+        }
+        const etc1_byte* p = pIn + i * 3;
+        int delta = (3 * (p[0] - pBaseColors[0]) + 6 * (p[1] - pBaseColors[1])
+                + (p[2] - pBaseColors[2])) / 10;
+        if (delta < 0) {
+            delta = -delta;
+        }
+        if (delta > maxDelta) {
+            maxDelta = delta;
+        }
+    }
+    int last = 0;
+    while (last < 7 && kModifierTable[last * 4 + 1] < maxDelta) {
+        last++;
+    }
+    *pFirst = last > 0 ? last - 1 : 0;
+    *pLast = last;
+}
+
 static
 void etc_encode_block_helper(const etc1_byte* pIn, etc1_uint32 inMask,
-        const etc1_byte* pColors, etc_compressed* pCompressed, bool flipped) {
+        const etc1_byte* pColors, etc_compressed* pCompressed, bool flipped,
+        int quality) {
     pCompressed->score = ~0;
     pCompressed->high = (flipped ? 1 : 0);
     pCompressed->low = 0;
@@ -442,8 +630,14 @@ void etc_encode_block_helper(const etc1_byte* pIn, etc1_uint32 inMask,
 
     int originalHigh = pCompressed->high;
 
-    const int* pModifierTable = kModifierTable;
-    for (int i = 0; i < 8; i++, pModifierTable += 4) {
+    int first = 0;
+    int last = 7;
+    if (quality == ETC1_QUALITY_FAST) {
+        etc_choose_tables_subblock(pIn, inMask, flipped, false, pBaseColors,
+                &first, &last);
+    }
+    const int* pModifierTable = kModifierTable + first * 4;
+    for (int i = first; i <= last; i++, pModifierTable += 4) {
         etc_compressed temp;
         temp.score = 0;
         temp.high = originalHigh | (i << 5);
@@ -452,16 +646,20 @@ void etc_encode_block_helper(const etc1_byte* pIn, etc1_uint32 inMask,
                 pBaseColors, pModifierTable);
         take_best(pCompressed, &temp);
     }
-    pModifierTable = kModifierTable;
+    if (quality == ETC1_QUALITY_FAST) {
+        etc_choose_tables_subblock(pIn, inMask, flipped, true, pBaseColors + 3,
+                &first, &last);
+    }
+    pModifierTable = kModifierTable + first * 4;
     etc_compressed firstHalf = *pCompressed;
-    for (int i = 0; i < 8; i++, pModifierTable += 4) {
+    for (int i = first; i <= last; i++, pModifierTable += 4) {
         etc_compressed temp;
         temp.score = firstHalf.score;
         temp.high = firstHalf.high | (i << 2);
         temp.low = firstHalf.low;
         etc_encode_subblock_helper(pIn, inMask, &temp, flipped, true,
                 pBaseColors + 3, pModifierTable);
-        if (i == 0) {
+        if (i == first) {
             *pCompressed = temp;
         } else {
             take_best(pCompressed, &temp);
@@ -481,8 +679,9 @@ static void writeBigEndian(etc1_byte* pOut, etc1_uint32 d) {
 // pixel is valid or not. Invalid pixel color values are ignored when compressing.
 // Output is an ETC1 compressed version of the data.
 
-void etc1_encode_block(const etc1_byte* pIn, etc1_uint32 inMask,
-        etc1_byte* pOut) {
+static
+void etc_encode_block(const etc1_byte* pIn, etc1_uint32 inMask,
+        etc1_byte* pOut, int quality) {
     etc1_byte colors[6];
     etc1_byte flippedColors[6];
     etc_average_colors_subblock(pIn, inMask, colors, false, false);
@@ -491,73 +690,243 @@ void etc1_encode_block(const etc1_byte* pIn, etc1_uint32 inMask,
     etc_average_colors_subblock(pIn, inMask, flippedColors + 3, true, true);
 
     etc_compressed a, b;
-    etc_encode_block_helper(pIn, inMask, colors, &a, false);
-    etc_encode_block_helper(pIn, inMask, flippedColors, &b, true);
+    etc_encode_block_helper(pIn, inMask, colors, &a, false, quality);
+    etc_encode_block_helper(pIn, inMask, flippedColors, &b, true, quality);
     take_best(&a, &b);
     writeBigEndian(pOut, a.high);
     writeBigEndian(pOut + 4, a.low);
 }
 
+void etc1_encode_block(const etc1_byte* pIn, etc1_uint32 inMask,
+        etc1_byte* pOut) {
+    etc_encode_block(pIn, inMask, pOut, ETC1_QUALITY_HIGH);
+}
+
 // Return the size of the encoded image data (does not include size of PKM header).
 
 etc1_uint32 etc1_get_encoded_data_size(etc1_uint32 width, etc1_uint32 height) {
     return (((width + 3) & ~3) * ((height + 3) & ~3)) >> 1;
 }
 
-// Encode an entire image.
-// pIn - pointer to the image data. Formatted such that the Red component of
-//       pixel (x,y) is at pIn + pixelSize * x + stride * y + redOffset;
-// pOut - pointer to encoded data. Must be large enough to store entire encoded image.
+// Runs func(pArg, row) for rows 0 to numRows - 1 on up to numThreads threads
+// (one per CPU if numThreads is 0), handing out the rows to the threads as
+// they become idle.
 
-int etc1_encode_image(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 height,
-        etc1_uint32 pixelSize, etc1_uint32 stride, etc1_byte* pOut) {
-    if (pixelSize < 2 || pixelSize > 3) {
-        return -1;
+typedef void (*etc_row_func)(void* pArg, etc1_uint32 row);
+
+typedef struct {
+    etc_row_func func;
+    void* pArg;
+    pthread_mutex_t lock;
+    etc1_uint32 nextRow;
+    etc1_uint32 numRows;
+} etc_row_job;
+
+static
+void* etc_row_thread(void* arg) {
+    etc_row_job* pJob = (etc_row_job*) arg;
+    for (;;) {
+        pthread_mutex_lock(&pJob->lock);
+        etc1_uint32 row = pJob->nextRow++;
+        pthread_mutex_unlock(&pJob->lock);
+        if (row >= pJob->numRows) {
+            break;
+        }
+        pJob->func(pJob->pArg, row);
+    }
+    return NULL;
+}
+
+static
+void etc_run_rows(etc_row_func func, void* pArg, etc1_uint32 numRows,
+        etc1_uint32 numThreads) {
+    etc_row_job job;
+    job.func = func;
+    job.pArg = pArg;
+    job.nextRow = 0;
+    job.numRows = numRows;
+
+    if (numThreads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        numThreads = cpus > 0 ? (etc1_uint32) cpus : 1;
+    }
+    if (numThreads > numRows) {
+        numThreads = numRows;
+    }
+    if (numThreads > ETC1_MAX_THREADS) {
+        numThreads = ETC1_MAX_THREADS;
     }
+
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_t threads[ETC1_MAX_THREADS];
+    etc1_uint32 started = 0;
+    while (started + 1 < numThreads) {
+        if (pthread_create(&threads[started], NULL, etc_row_thread, &job)) {
+            // do with the threads we have
+            break;
+        }
+        started++;
+    }
+    etc_row_thread(&job);
+    for (etc1_uint32 i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&job.lock);
+}
+
+typedef struct {
+    const etc1_byte* pIn;
+    etc1_uint32 width;
+    etc1_uint32 height;
+    etc1_uint32 pixelSize;
+    etc1_uint32 stride;
+    etc1_byte* pOut;
+    int quality;
+} etc_encode_job;
+
+// Encodes the row of blocks starting at line y of the image.
+
+static
+void etc_encode_row(const etc_encode_job* pJob, etc1_uint32 y, etc1_byte* pOut) {
     static const unsigned short kYMask[] = { 0x0, 0xf, 0xff, 0xfff, 0xffff };
     static const unsigned short kXMask[] = { 0x0, 0x1111, 0x3333, 0x7777,
             0xffff };
     etc1_byte block[ETC1_DECODED_BLOCK_SIZE];
     etc1_byte encoded[ETC1_ENCODED_BLOCK_SIZE];
 
+    const etc1_uint32 width = pJob->width;
+    const etc1_uint32 pixelSize = pJob->pixelSize;
+    const etc1_uint32 stride = pJob->stride;
     etc1_uint32 encodedWidth = (width + 3) & ~3;
-    etc1_uint32 encodedHeight = (height + 3) & ~3;
 
-    for (etc1_uint32 y = 0; y < encodedHeight; y += 4) {
-        etc1_uint32 yEnd = height - y;
-        if (yEnd > 4) {
-            yEnd = 4;
+    etc1_uint32 yEnd = pJob->height - y;
+    if (yEnd > 4) {
+        yEnd = 4;
+    }
+    int ymask = kYMask[yEnd];
+    for (etc1_uint32 x = 0; x < encodedWidth; x += 4) {
+        etc1_uint32 xEnd = width - x;
+        if (xEnd > 4) {
+            xEnd = 4;
         }
-        int ymask = kYMask[yEnd];
-        for (etc1_uint32 x = 0; x < encodedWidth; x += 4) {
-            etc1_uint32 xEnd = width - x;
-            if (xEnd > 4) {
-                xEnd = 4;
-            }
-            int mask = ymask & kXMask[xEnd];
-            for (etc1_uint32 cy = 0; cy < yEnd; cy++) {
-                etc1_byte* q = block + (cy * 4) * 3;
-                const etc1_byte* p = pIn + pixelSize * x + stride * (y + cy);
-                if (pixelSize == 3) {
-                    memcpy(q, p, xEnd * 3);
-                } else {
-                    for (etc1_uint32 cx = 0; cx < xEnd; cx++) {
-                        int pixel = (p[1] << 8) | p[0];
-                        *q++ = convert5To8(pixel >> 11);
-                        *q++ = convert6To8(pixel >> 5);
-                        *q++ = convert5To8(pixel);
-                        p += pixelSize;
-                    }
+        int mask = ymask & kXMask[xEnd];
+        for (etc1_uint32 cy = 0; cy < yEnd; cy++) {
+            etc1_byte* q = block + (cy * 4) * 3;
+            const etc1_byte* p = pJob->pIn + pixelSize * x + stride * (y + cy);
+            if (pixelSize == 3) {
+                memcpy(q, p, xEnd * 3);
+            } else {
+                for (etc1_uint32 cx = 0; cx < xEnd; cx++) {
+                    int pixel = (p[1] << 8) | p[0];
+                    *q++ = convert5To8(pixel >> 11);
+                    *q++ = convert6To8(pixel >> 5);
+                    *q++ = convert5To8(pixel);
+                    p += pixelSize;
                 }
             }
-            etc1_encode_block(block, mask, encoded);
-            memcpy(pOut, encoded, sizeof(encoded));
-            pOut += sizeof(encoded);
         }
+        etc_encode_block(block, mask, encoded, pJob->quality);
+        memcpy(pOut, encoded, sizeof(encoded));
+        pOut += sizeof(encoded);
     }
+}
+
+static
+void etc_encode_row_func(void* pArg, etc1_uint32 row) {
+    const etc_encode_job* pJob = (const etc_encode_job*) pArg;
+    const etc1_uint32 rowSize =
+            ((pJob->width + 3) >> 2) * ETC1_ENCODED_BLOCK_SIZE;
+    etc_encode_row(pJob, row * 4, pJob->pOut + row * rowSize);
+}
+
+// Encode an entire image.
+// pIn - pointer to the image data. Formatted such that the Red component of
+//       pixel (x,y) is at pIn + pixelSize * x + stride * y + redOffset;
+// pOut - pointer to encoded data. Must be large enough to store entire encoded image.
+
+int etc1_encode_image(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 height,
+        etc1_uint32 pixelSize, etc1_uint32 stride, etc1_byte* pOut) {
+    return etc1_encode_image_ex(pIn, width, height, pixelSize, stride, pOut,
+            ETC1_QUALITY_HIGH, 1);
+}
+
+// Encode an entire image, with the given quality and on up to numThreads
+// threads (all the CPUs if numThreads is 0). Rows of blocks are handed out
+// to the threads as they become idle.
+
+int etc1_encode_image_ex(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 height,
+        etc1_uint32 pixelSize, etc1_uint32 stride, etc1_byte* pOut,
+        int quality, etc1_uint32 numThreads) {
+    if (pixelSize < 2 || pixelSize > 3) {
+        return -1;
+    }
+    if (quality != ETC1_QUALITY_FAST && quality != ETC1_QUALITY_HIGH) {
+        return -1;
+    }
+
+    etc_encode_job job;
+    job.pIn = pIn;
+    job.width = width;
+    job.height = height;
+    job.pixelSize = pixelSize;
+    job.stride = stride;
+    job.pOut = pOut;
+    job.quality = quality;
+    etc_run_rows(etc_encode_row_func, &job, (height + 3) >> 2, numThreads);
     return 0;
 }
 
+typedef struct {
+    const etc1_byte* pIn;
+    etc1_byte* pOut;
+    etc1_uint32 width;
+    etc1_uint32 height;
+    etc1_uint32 pixelSize;
+    etc1_uint32 stride;
+} etc_decode_job;
+
+// Decodes the row of blocks starting at line y of the image straight into
+// the image.
+
+template <int FORMAT>
+static
+void etc_decode_row(const etc_decode_job* pJob, etc1_uint32 y) {
+    const etc1_uint32 width = pJob->width;
+    etc1_uint32 encodedWidth = (width + 3) & ~3;
+    const etc1_byte* pIn = pJob->pIn + (encodedWidth >> 2) * (y >> 2)
+            * ETC1_ENCODED_BLOCK_SIZE;
+    etc1_byte* pOut = pJob->pOut + pJob->stride * y;
+
+    etc1_uint32 yEnd = pJob->height - y;
+    if (yEnd > 4) {
+        yEnd = 4;
+    }
+    for (etc1_uint32 x = 0; x < encodedWidth; x += 4) {
+        etc1_uint32 xEnd = width - x;
+        if (xEnd > 4) {
+            xEnd = 4;
+        }
+        decode_block<FORMAT>(pIn, pOut + FORMAT * x, pJob->stride, xEnd, yEnd);
+        pIn += ETC1_ENCODED_BLOCK_SIZE;
+    }
+}
+
+static
+void etc_decode_row_func(void* pArg, etc1_uint32 row) {
+    const etc_decode_job* pJob = (const etc_decode_job*) pArg;
+    switch (pJob->pixelSize) {
+        case 2:
+            etc_decode_row<2>(pJob, row * 4);
+            break;
+        case 3:
+            etc_decode_row<3>(pJob, row * 4);
+            break;
+        case 4:
+            etc_decode_row<4>(pJob, row * 4);
+            break;
+    }
+}
+
 // Decode an entire image.
 // pIn - pointer to encoded data.
 // pOut - pointer to the image data. Will be written such that the Red component of
@@ -568,44 +937,27 @@ int etc1_encode_image(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 heigh
 int etc1_decode_image(const etc1_byte* pIn, etc1_byte* pOut,
         etc1_uint32 width, etc1_uint32 height,
         etc1_uint32 pixelSize, etc1_uint32 stride) {
-    if (pixelSize < 2 || pixelSize > 3) {
-        return -1;
-    }
-    etc1_byte block[ETC1_DECODED_BLOCK_SIZE];
+    return etc1_decode_image_ex(pIn, pOut, width, height, pixelSize, stride, 1);
+}
 
-    etc1_uint32 encodedWidth = (width + 3) & ~3;
-    etc1_uint32 encodedHeight = (height + 3) & ~3;
+// Decode an entire image on up to numThreads threads (all the CPUs if
+// numThreads is 0), each row of blocks straight into the image.
 
-    for (etc1_uint32 y = 0; y < encodedHeight; y += 4) {
-        etc1_uint32 yEnd = height - y;
-        if (yEnd > 4) {
-            yEnd = 4;
-        }
-        for (etc1_uint32 x = 0; x < encodedWidth; x += 4) {
-            etc1_uint32 xEnd = width - x;
-            if (xEnd > 4) {
-                xEnd = 4;
-            }
-            etc1_decode_block(pIn, block);
-            pIn += ETC1_ENCODED_BLOCK_SIZE;
-            for (etc1_uint32 cy = 0; cy < yEnd; cy++) {
-                const etc1_byte* q = block + (cy * 4) * 3;
-                etc1_byte* p = pOut + pixelSize * x + stride * (y + cy);
-                if (pixelSize == 3) {
-                    memcpy(p, q, xEnd * 3);
-                } else {
-                    for (etc1_uint32 cx = 0; cx < xEnd; cx++) {
-                        etc1_byte r = *q++;
-                        etc1_byte g = *q++;
-                        etc1_byte b = *q++;
-                        etc1_uint32 pixel = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
-                        *p++ = (etc1_byte) pixel;
-                        *p++ = (etc1_byte) (pixel >> 8);
-                    }
-                }
-            }
-        }
+int etc1_decode_image_ex(const etc1_byte* pIn, etc1_byte* pOut,
+        etc1_uint32 width, etc1_uint32 height,
+        etc1_uint32 pixelSize, etc1_uint32 stride, etc1_uint32 numThreads) {
+    if (pixelSize < 2 || pixelSize > 4) {
+        return -1;
     }
+
+    etc_decode_job job;
+    job.pIn = pIn;
+    job.pOut = pOut;
+    job.width = width;
+    job.height = height;
+    job.pixelSize = pixelSize;
+    job.stride = stride;
+    etc_run_rows(etc_decode_row_func, &job, (height + 3) >> 2, numThreads);
     return 0;
 }
 
@@ -95,7 +95,7 @@ GL_API void GL_APIENTRY glWeightPointerOESBounds(GLint size, GLenum type,
 #undef CALL_GL_API
 #undef CALL_GL_API_RETURN
 
-#if USE_FAST_TLS_KEY && !CHECK_FOR_GL_ERRORS
+#if USE_FAST_TLS_KEY && !CHECK_FOR_GL_ERRORS && defined(__arm__)
 
     #ifdef HAVE_ARM_TLS_REGISTER
         #define GET_TLS(reg) \
@@ -126,6 +126,32 @@ GL_API void GL_APIENTRY glWeightPointerOESBounds(GLint size, GLenum type,
         CALL_GL_API(_api, __VA_ARGS__) \
         return 0; // placate gcc's warnings. never reached.
 
+#elif USE_FAST_TLS_KEY && !CHECK_FOR_GL_ERRORS && defined(__i386__)
+
+    // gcc has no naked functions on x86. Instead these entry points are
+    // built with -fomit-frame-pointer and only contain the asm below, so
+    // they have no prologue and the jmp tail-calls the implementation with
+    // the caller's arguments and return address still on the stack.
+    #define API_ENTRY(_api) __attribute__((noinline)) _api
+
+    #define CALL_GL_API(_api, ...)                              \
+         asm volatile(                                          \
+            "mov   %%gs:0, %%eax         \n"                    \
+            "mov   %P[tls](%%eax), %%eax \n"                    \
+            "test  %%eax, %%eax          \n"                    \
+            "je    1f                    \n"                    \
+            "jmp   *%P[api](%%eax)       \n"                    \
+            "1:                          \n"                    \
+            :                                                   \
+            : [tls] "i"(TLS_SLOT_OPENGL_API*4),                 \
+              [api] "i"(__builtin_offsetof(gl_hooks_t, gl._api)) \
+            : "eax", "cc"                                       \
+            );
+
+    #define CALL_GL_API_RETURN(_api, ...) \
+        CALL_GL_API(_api, __VA_ARGS__) \
+        return 0;
+
 #else
 
     #if CHECK_FOR_GL_ERRORS
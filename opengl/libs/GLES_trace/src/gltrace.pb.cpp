@@ -1058,6 +1058,7 @@ const int GLMessage_DataType::kFloatValueFieldNumber;
 const int GLMessage_DataType::kCharValueFieldNumber;
 const int GLMessage_DataType::kRawBytesFieldNumber;
 const int GLMessage_DataType::kBoolValueFieldNumber;
+const int GLMessage_DataType::kRawBytesIdFieldNumber;
 #endif  // !_MSC_VER
 
 GLMessage_DataType::GLMessage_DataType()
@@ -1078,6 +1079,7 @@ void GLMessage_DataType::SharedCtor() {
   _cached_size_ = 0;
   type_ = 1;
   isarray_ = false;
+  rawbytesid_ = 0;
   ::memset(_has_bits_, 0, sizeof(_has_bits_));
 }
 
@@ -1109,6 +1111,7 @@ void GLMessage_DataType::Clear() {
   if (_has_bits_[0 / 32] & (0xffu << (0 % 32))) {
     type_ = 1;
     isarray_ = false;
+    rawbytesid_ = 0;
   }
   intvalue_.Clear();
   floatvalue_.Clear();
@@ -1250,6 +1253,22 @@ bool GLMessage_DataType::MergePartialFromCodedStream(
           goto handle_uninterpreted;
         }
         if (input->ExpectTag(56)) goto parse_boolValue;
+        if (input->ExpectTag(64)) goto parse_rawBytesId;
+        break;
+      }
+      
+      // optional int32 rawBytesId = 8;
+      case 8: {
+        if (::google::protobuf::internal::WireFormatLite::GetTagWireType(tag) ==
+            ::google::protobuf::internal::WireFormatLite::WIRETYPE_VARINT) {
+         parse_rawBytesId:
+          DO_((::google::protobuf::internal::WireFormatLite::ReadPrimitive<
+                   ::google::protobuf::int32, ::google::protobuf::internal::WireFormatLite::TYPE_INT32>(
+                 input, &rawbytesid_)));
+          _set_bit(7);
+        } else {
+          goto handle_uninterpreted;
+        }
         if (input->ExpectAtEnd()) return true;
         break;
       }
@@ -1312,6 +1331,11 @@ void GLMessage_DataType::SerializeWithCachedSizes(
       7, this->boolvalue(i), output);
   }
   
+  // optional int32 rawBytesId = 8;
+  if (_has_bit(7)) {
+    ::google::protobuf::internal::WireFormatLite::WriteInt32(8, this->rawbytesid(), output);
+  }
+  
 }
 
 int GLMessage_DataType::ByteSize() const {
@@ -1329,6 +1353,13 @@ int GLMessage_DataType::ByteSize() const {
       total_size += 1 + 1;
     }
     
+    // optional int32 rawBytesId = 8;
+    if (has_rawbytesid()) {
+      total_size += 1 +
+        ::google::protobuf::internal::WireFormatLite::Int32Size(
+          this->rawbytesid());
+    }
+    
   }
   // repeated int32 intValue = 3;
   {
@@ -1393,6 +1424,9 @@ void GLMessage_DataType::MergeFrom(const GLMessage_DataType& from) {
     if (from._has_bit(1)) {
       set_isarray(from.isarray());
     }
+    if (from._has_bit(7)) {
+      set_rawbytesid(from.rawbytesid());
+    }
   }
 }
 
@@ -1417,6 +1451,7 @@ void GLMessage_DataType::Swap(GLMessage_DataType* other) {
     charvalue_.Swap(&other->charvalue_);
     rawbytes_.Swap(&other->rawbytes_);
     boolvalue_.Swap(&other->boolvalue_);
+    std::swap(rawbytesid_, other->rawbytesid_);
     std::swap(_has_bits_[0], other->_has_bits_[0]);
     std::swap(_cached_size_, other->_cached_size_);
   }
@@ -1433,6 +1468,7 @@ void GLMessage_DataType::Swap(GLMessage_DataType* other) {
 const int GLMessage_FrameBuffer::kWidthFieldNumber;
 const int GLMessage_FrameBuffer::kHeightFieldNumber;
 const int GLMessage_FrameBuffer::kContentsFieldNumber;
+const int GLMessage_FrameBuffer::kIsDeltaFieldNumber;
 #endif  // !_MSC_VER
 
 GLMessage_FrameBuffer::GLMessage_FrameBuffer()
@@ -1453,6 +1489,7 @@ void GLMessage_FrameBuffer::SharedCtor() {
   _cached_size_ = 0;
   width_ = 0;
   height_ = 0;
+  isdelta_ = false;
   ::memset(_has_bits_, 0, sizeof(_has_bits_));
 }
 
@@ -1484,6 +1521,7 @@ void GLMessage_FrameBuffer::Clear() {
   if (_has_bits_[0 / 32] & (0xffu << (0 % 32))) {
     width_ = 0;
     height_ = 0;
+    isdelta_ = false;
   }
   contents_.Clear();
   ::memset(_has_bits_, 0, sizeof(_has_bits_));
@@ -1537,6 +1575,22 @@ bool GLMessage_FrameBuffer::MergePartialFromCodedStream(
           goto handle_uninterpreted;
         }
         if (input->ExpectTag(26)) goto parse_contents;
+        if (input->ExpectTag(32)) goto parse_isDelta;
+        break;
+      }
+      
+      // optional bool isDelta = 4 [default = false];
+      case 4: {
+        if (::google::protobuf::internal::WireFormatLite::GetTagWireType(tag) ==
+            ::google::protobuf::internal::WireFormatLite::WIRETYPE_VARINT) {
+         parse_isDelta:
+          DO_((::google::protobuf::internal::WireFormatLite::ReadPrimitive<
+                   bool, ::google::protobuf::internal::WireFormatLite::TYPE_BOOL>(
+                 input, &isdelta_)));
+          _set_bit(3);
+        } else {
+          goto handle_uninterpreted;
+        }
         if (input->ExpectAtEnd()) return true;
         break;
       }
@@ -1574,6 +1628,11 @@ void GLMessage_FrameBuffer::SerializeWithCachedSizes(
       3, this->contents(i), output);
   }
   
+  // optional bool isDelta = 4 [default = false];
+  if (_has_bit(3)) {
+    ::google::protobuf::internal::WireFormatLite::WriteBool(4, this->isdelta(), output);
+  }
+  
 }
 
 int GLMessage_FrameBuffer::ByteSize() const {
@@ -1594,6 +1653,11 @@ int GLMessage_FrameBuffer::ByteSize() const {
           this->height());
     }
     
+    // optional bool isDelta = 4 [default = false];
+    if (has_isdelta()) {
+      total_size += 1 + 1;
+    }
+    
   }
   // repeated bytes contents = 3;
   total_size += 1 * this->contents_size();
@@ -1623,6 +1687,9 @@ void GLMessage_FrameBuffer::MergeFrom(const GLMessage_FrameBuffer& from) {
     if (from._has_bit(1)) {
       set_height(from.height());
     }
+    if (from._has_bit(3)) {
+      set_isdelta(from.isdelta());
+    }
   }
 }
 
@@ -1643,6 +1710,7 @@ void GLMessage_FrameBuffer::Swap(GLMessage_FrameBuffer* other) {
     std::swap(width_, other->width_);
     std::swap(height_, other->height_);
     contents_.Swap(&other->contents_);
+    std::swap(isdelta_, other->isdelta_);
     std::swap(_has_bits_[0], other->_has_bits_[0]);
     std::swap(_cached_size_, other->_cached_size_);
   }
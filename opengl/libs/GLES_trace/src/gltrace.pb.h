@@ -687,6 +687,13 @@ class GLMessage_DataType : public ::google::protobuf::MessageLite {
   inline ::google::protobuf::RepeatedField< bool >*
       mutable_boolvalue();
   
+  // optional int32 rawBytesId = 8;
+  inline bool has_rawbytesid() const;
+  inline void clear_rawbytesid();
+  static const int kRawBytesIdFieldNumber = 8;
+  inline ::google::protobuf::int32 rawbytesid() const;
+  inline void set_rawbytesid(::google::protobuf::int32 value);
+  
   // @@protoc_insertion_point(class_scope:android.gltrace.GLMessage.DataType)
  private:
   mutable int _cached_size_;
@@ -698,11 +705,12 @@ class GLMessage_DataType : public ::google::protobuf::MessageLite {
   ::google::protobuf::RepeatedPtrField< ::std::string> charvalue_;
   ::google::protobuf::RepeatedPtrField< ::std::string> rawbytes_;
   ::google::protobuf::RepeatedField< bool > boolvalue_;
+  ::google::protobuf::int32 rawbytesid_;
   friend void  protobuf_AddDesc_gltrace_2eproto();
   friend void protobuf_AssignDesc_gltrace_2eproto();
   friend void protobuf_ShutdownFile_gltrace_2eproto();
   
-  ::google::protobuf::uint32 _has_bits_[(7 + 31) / 32];
+  ::google::protobuf::uint32 _has_bits_[(8 + 31) / 32];
   
   // WHY DOES & HAVE LOWER PRECEDENCE THAN != !?
   inline bool _has_bit(int index) const {
@@ -793,6 +801,13 @@ class GLMessage_FrameBuffer : public ::google::protobuf::MessageLite {
   inline const ::google::protobuf::RepeatedPtrField< ::std::string>& contents() const;
   inline ::google::protobuf::RepeatedPtrField< ::std::string>* mutable_contents();
   
+  // optional bool isDelta = 4 [default = false];
+  inline bool has_isdelta() const;
+  inline void clear_isdelta();
+  static const int kIsDeltaFieldNumber = 4;
+  inline bool isdelta() const;
+  inline void set_isdelta(bool value);
+  
   // @@protoc_insertion_point(class_scope:android.gltrace.GLMessage.FrameBuffer)
  private:
   mutable int _cached_size_;
@@ -800,11 +815,12 @@ class GLMessage_FrameBuffer : public ::google::protobuf::MessageLite {
   ::google::protobuf::int32 width_;
   ::google::protobuf::int32 height_;
   ::google::protobuf::RepeatedPtrField< ::std::string> contents_;
+  bool isdelta_;
   friend void  protobuf_AddDesc_gltrace_2eproto();
   friend void protobuf_AssignDesc_gltrace_2eproto();
   friend void protobuf_ShutdownFile_gltrace_2eproto();
   
-  ::google::protobuf::uint32 _has_bits_[(3 + 31) / 32];
+  ::google::protobuf::uint32 _has_bits_[(4 + 31) / 32];
   
   // WHY DOES & HAVE LOWER PRECEDENCE THAN != !?
   inline bool _has_bit(int index) const {
@@ -1660,6 +1676,22 @@ GLMessage_DataType::mutable_boolvalue() {
   return &boolvalue_;
 }
 
+// optional int32 rawBytesId = 8;
+inline bool GLMessage_DataType::has_rawbytesid() const {
+  return _has_bit(7);
+}
+inline void GLMessage_DataType::clear_rawbytesid() {
+  rawbytesid_ = 0;
+  _clear_bit(7);
+}
+inline ::google::protobuf::int32 GLMessage_DataType::rawbytesid() const {
+  return rawbytesid_;
+}
+inline void GLMessage_DataType::set_rawbytesid(::google::protobuf::int32 value) {
+  _set_bit(7);
+  rawbytesid_ = value;
+}
+
 // -------------------------------------------------------------------
 
 // GLMessage_FrameBuffer
@@ -1740,6 +1772,22 @@ GLMessage_FrameBuffer::mutable_contents() {
   return &contents_;
 }
 
+// optional bool isDelta = 4 [default = false];
+inline bool GLMessage_FrameBuffer::has_isdelta() const {
+  return _has_bit(3);
+}
+inline void GLMessage_FrameBuffer::clear_isdelta() {
+  isdelta_ = false;
+  _clear_bit(3);
+}
+inline bool GLMessage_FrameBuffer::isdelta() const {
+  return isdelta_;
+}
+inline void GLMessage_FrameBuffer::set_isdelta(bool value) {
+  _set_bit(3);
+  isdelta_ = value;
+}
+
 // -------------------------------------------------------------------
 
 // GLMessage
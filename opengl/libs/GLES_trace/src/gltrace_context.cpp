@@ -17,10 +17,6 @@
 #include <pthread.h>
 #include <cutils/log.h>
 
-extern "C" {
-#include "liblzf/lzf.h"
-}
-
 #include "gltrace_context.h"
 
 namespace android {
@@ -56,17 +52,27 @@ void releaseContext() {
     }
 }
 
-GLTraceState::GLTraceState(TCPStream *stream) {
+GLTraceState::GLTraceState(TCPStream *stream, bool compress, bool fbDelta,
+        unsigned fbScale, bool payloadIds) {
     mTraceContextIds = 0;
     mStream = stream;
+    mFBScale = fbScale > 0 ? fbScale : 1;
+    mPayloadIds = payloadIds;
+
+    // serialization is done by the writer, away from the application threads,
+    // so it can afford a large buffer
+    const size_t DEFAULT_BUFFER_SIZE = 65536;
+    mWriter = new StreamWriter(stream, DEFAULT_BUFFER_SIZE, compress, fbDelta, payloadIds);
 
     mCollectFbOnEglSwap = false;
     mCollectFbOnGlDraw = false;
     mCollectTextureDataOnGlTexImage = false;
-    pthread_rwlock_init(&mTraceOptionsRwLock, NULL);
 }
 
 GLTraceState::~GLTraceState() {
+    delete mWriter;
+    mWriter = NULL;
+
     if (mStream) {
         mStream->closeStream();
         mStream = NULL;
@@ -77,17 +83,22 @@ TCPStream *GLTraceState::getStream() {
     return mStream;
 }
 
-void GLTraceState::safeSetValue(bool *ptr, bool value, pthread_rwlock_t *lock) {
-    pthread_rwlock_wrlock(lock);
+unsigned GLTraceState::getFBScale() {
+    return mFBScale;
+}
+
+bool GLTraceState::usePayloadIds() {
+    return mPayloadIds;
+}
+
+void GLTraceState::safeSetValue(bool *ptr, bool value, ScalableRWLock *lock) {
+    ScalableRWLock::AutoWLock _l(*lock);
     *ptr = value;
-    pthread_rwlock_unlock(lock);
 }
 
-bool GLTraceState::safeGetValue(bool *ptr, pthread_rwlock_t *lock) {
-    pthread_rwlock_rdlock(lock);
-    bool value = *ptr;
-    pthread_rwlock_unlock(lock);
-    return value;
+bool GLTraceState::safeGetValue(bool *ptr, ScalableRWLock *lock) {
+    ScalableRWLock::AutoRLock _l(*lock);
+    return *ptr;
 }
 
 void GLTraceState::setCollectFbOnEglSwap(bool en) {
@@ -117,9 +128,7 @@ bool GLTraceState::shouldCollectTextureDataOnGlTexImage() {
 GLTraceContext *GLTraceState::createTraceContext(int version, EGLContext eglContext) {
     int id = __sync_fetch_and_add(&mTraceContextIds, 1);
 
-    const size_t DEFAULT_BUFFER_SIZE = 8192;
-    BufferedOutputStream *stream = new BufferedOutputStream(mStream, DEFAULT_BUFFER_SIZE);
-    GLTraceContext *traceContext = new GLTraceContext(id, version, this, stream);
+    GLTraceContext *traceContext = new GLTraceContext(id, version, this, mWriter);
     mPerContextState[eglContext] = traceContext;
 
     return traceContext;
@@ -130,15 +139,29 @@ GLTraceContext *GLTraceState::getTraceContext(EGLContext c) {
 }
 
 GLTraceContext::GLTraceContext(int id, int version, GLTraceState *state,
-        BufferedOutputStream *stream) :
+        StreamWriter *writer) :
     mId(id),
     mVersion(version),
     mState(state),
-    mBufferedOutputStream(stream),
+    mWriter(writer),
     mElementArrayBuffers(DefaultKeyedVector<GLuint, ElementArrayBuffer*>(NULL))
 {
-    fbcontents = fbcompressed = NULL;
+    fbcontents = NULL;
     fbcontentsSize = 0;
+
+    const size_t MESSAGE_QUEUE_SIZE = 16384;
+    // room for a few large textures in flight
+    const size_t PAYLOAD_AREA_SIZE = 8 * 1024 * 1024;
+    mMessageQueue = new MessageQueue(MESSAGE_QUEUE_SIZE,
+            state->usePayloadIds() ? PAYLOAD_AREA_SIZE : 0);
+    mSampleCount = 0;
+    mDroppedMessages = 0;
+    mWriter->addQueue(mMessageQueue);
+}
+
+GLTraceContext::~GLTraceContext() {
+    mWriter->removeQueue(mMessageQueue);
+    delete mMessageQueue;
 }
 
 int GLTraceContext::getId() {
@@ -158,25 +181,41 @@ void GLTraceContext::resizeFBMemory(unsigned minSize) {
         return;
     }
 
-    if (fbcontents != NULL) {
-        free(fbcontents);
-        free(fbcompressed);
-    }
-
+    free(fbcontents);
     fbcontents = malloc(minSize);
-    fbcompressed = malloc(minSize);
 
     fbcontentsSize = minSize;
 }
 
-/** obtain a pointer to the compressed framebuffer image */
-void GLTraceContext::getCompressedFB(void **fb, unsigned *fbsize, unsigned *fbwidth, 
-                            unsigned *fbheight, FBBinding fbToRead) {
+/**
+ * Attach the framebuffer image to @msg, downscaled by the trace's FB scale.
+ * The image is left uncompressed, the writer thread encodes it. It is skipped
+ * if the writer has too many images to encode already.
+ */
+void GLTraceContext::addFBContents(GLMessage *msg, FBBinding fbToRead) {
+    if (!mWriter->reserveFB()) {
+        return;
+    }
+
     int viewport[4] = {};
     hooks->gl.glGetIntegerv(GL_VIEWPORT, viewport);
-    unsigned fbContentsSize = viewport[2] * viewport[3] * 4;
-
-    resizeFBMemory(fbContentsSize);
+    const unsigned scale = mState->getFBScale();
+    const unsigned fbwidth = (viewport[2] + scale - 1) / scale;
+    const unsigned fbheight = (viewport[3] + scale - 1) / scale;
+
+    GLMessage_FrameBuffer *fb = msg->mutable_fb();
+    fb->set_width(fbwidth);
+    fb->set_height(fbheight);
+    std::string *contents = fb->add_contents();
+    contents->resize(fbwidth * fbheight * 4);
+    uint32_t *dst = (uint32_t *)&(*contents)[0];
+
+    // read straight into the message, unless it has to be downscaled
+    void *pixels = dst;
+    if (scale > 1) {
+        resizeFBMemory(viewport[2] * viewport[3] * 4);
+        pixels = fbcontents;
+    }
 
     // switch current framebuffer binding if necessary
     GLint currentFb = -1;
@@ -191,29 +230,102 @@ void GLTraceContext::getCompressedFB(void **fb, unsigned *fbsize, unsigned *fbwi
     }
 
     hooks->gl.glReadPixels(viewport[0], viewport[1], viewport[2], viewport[3],
-                                        GL_RGBA, GL_UNSIGNED_BYTE, fbcontents);
+                                        GL_RGBA, GL_UNSIGNED_BYTE, pixels);
 
     // switch back to previously bound buffer if necessary
     if (fbSwitched) {
         hooks->gl.glBindFramebuffer(GL_FRAMEBUFFER, currentFb);
     }
 
-    *fbsize = lzf_compress(fbcontents, fbContentsSize, fbcompressed, fbContentsSize);
-    *fb = fbcompressed;
-    *fbwidth = viewport[2];
-    *fbheight = viewport[3];
+    if (scale > 1) {
+        // point sample every scale'th pixel of every scale'th row
+        for (unsigned y = 0; y < fbheight; y++) {
+            const uint32_t *src = (const uint32_t *)fbcontents + y * scale * viewport[2];
+            for (unsigned x = 0; x < fbwidth; x++) {
+                *dst++ = src[x * scale];
+            }
+        }
+    }
 }
 
+/**
+ * Payloads at least this large are staged in the payload area when payload
+ * ids are enabled, rather than copied into the message.
+ */
+static const size_t MIN_STAGED_PAYLOAD_SIZE = 4096;
+
+void GLTraceContext::addPayload(GLMessage *msg, int arg, const void *data, size_t len) {
+    // a message has at most one staged payload
+    if (len >= MIN_STAGED_PAYLOAD_SIZE && mPendingPayload.arg < 0
+            && mMessageQueue->stagePayload(arg, data, len, &mPendingPayload)) {
+        // the writer sets the argument's payload id
+        return;
+    }
+
+    msg->mutable_args(arg)->add_rawbytes(data, len);
+}
+
+/**
+ * Queue @msg for the writer thread. When the writer can't keep up, calls are
+ * first sampled and then dropped rather than make the application wait.
+ * Frame and context boundaries are never dropped, and neither are draw calls
+ * until the queue is full.
+ */
 void GLTraceContext::traceGLMessage(GLMessage *msg) {
-    mBufferedOutputStream->send(msg);
+    // slots at the end of the queue kept for the messages that are never dropped
+    const size_t QUEUE_RESERVE = 64;
+    // once the queue is half full, only 1 in SAMPLE_RATE other calls is kept
+    const unsigned SAMPLE_RATE = 8;
 
     GLMessage_Function func = msg->function();
-    if (func == GLMessage::eglSwapBuffers
+    bool isBoundary = func == GLMessage::eglSwapBuffers
         || func == GLMessage::eglCreateContext
-        || func == GLMessage::eglMakeCurrent
-        || func == GLMessage::glDrawArrays
-        || func == GLMessage::glDrawElements) {
-        mBufferedOutputStream->flush();
+        || func == GLMessage::eglMakeCurrent;
+    bool isDraw = func == GLMessage::glDrawArrays
+        || func == GLMessage::glDrawElements
+        || func == GLMessage::glVertexAttribPointerData;
+
+    const size_t queued = mMessageQueue->size();
+    const size_t capacity = mMessageQueue->capacity();
+    bool keep = true;
+    if (!isBoundary) {
+        if (queued >= capacity - QUEUE_RESERVE) {
+            keep = false;
+        } else if (queued >= capacity / 2 && !isDraw) {
+            keep = (mSampleCount++ % SAMPLE_RATE) == 0;
+        }
+    }
+
+    if (keep) {
+        // take over the contents of the message, which lives on the caller's stack
+        GLMessage *queuedMsg = new GLMessage();
+        queuedMsg->Swap(msg);
+        if (!mMessageQueue->push(queuedMsg, mPendingPayload)) {
+            msg->Swap(queuedMsg);
+            delete queuedMsg;
+            keep = false;
+        }
+    }
+
+    if (!keep) {
+        if (msg->has_fb()) {
+            mWriter->releaseFB();
+        }
+        if (mPendingPayload.arg >= 0) {
+            mMessageQueue->unstagePayload(mPendingPayload);
+        }
+        mDroppedMessages++;
+    }
+    mPendingPayload = Payload();
+
+    if (isBoundary && mDroppedMessages > 0) {
+        ALOGW("Context %d: dropped %u trace messages, the host is not keeping up",
+                mId, mDroppedMessages);
+        mDroppedMessages = 0;
+    }
+
+    if (isBoundary || isDraw || queued >= capacity / 2) {
+        mWriter->wakeup();
     }
 }
 
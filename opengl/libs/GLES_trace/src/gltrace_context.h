@@ -20,6 +20,7 @@
 #include <map>
 #include <pthread.h>
 #include <utils/KeyedVector.h>
+#include <utils/ScalableRWLock.h>
 
 #include "hooks.h"
 #include "gltrace_transport.h"
@@ -53,11 +54,14 @@ class GLTraceContext {
     int mVersion;               /* GL version, e.g: egl_connection_t::GLESv2_INDEX */
     GLTraceState *mState;       /* parent GL Trace state (for per process GL Trace State Info) */
 
-    void *fbcontents;           /* memory area to read framebuffer contents */
-    void *fbcompressed;         /* destination for lzf compressed framebuffer */
-    unsigned fbcontentsSize;    /* size of fbcontents & fbcompressed buffers */
+    void *fbcontents;           /* memory area to read framebuffer contents before downscaling */
+    unsigned fbcontentsSize;    /* size of fbcontents buffer */
 
-    BufferedOutputStream *mBufferedOutputStream; /* stream where trace info is sent */
+    StreamWriter *mWriter;      /* thread sending queued messages to the host */
+    MessageQueue *mMessageQueue; /* messages waiting to be sent by mWriter */
+    unsigned mSampleCount;      /* messages considered while the queue is filling up */
+    unsigned mDroppedMessages;  /* messages dropped since the last frame or context boundary */
+    Payload mPendingPayload;    /* staged for the message being traced */
 
     /* list of element array buffers in use. */
     DefaultKeyedVector<GLuint, ElementArrayBuffer*> mElementArrayBuffers;
@@ -66,13 +70,15 @@ class GLTraceContext {
 public:
     gl_hooks_t *hooks;
 
-    GLTraceContext(int id, int version, GLTraceState *state, BufferedOutputStream *stream);
+    GLTraceContext(int id, int version, GLTraceState *state, StreamWriter *writer);
+    ~GLTraceContext();
     int getId();
     int getVersion();
     GLTraceState *getGlobalTraceState();
-    void getCompressedFB(void **fb, unsigned *fbsize,
-                            unsigned *fbwidth, unsigned *fbheight,
-                            FBBinding fbToRead);
+    void addFBContents(GLMessage *msg, FBBinding fbToRead);
+
+    /** Add @len bytes at @data to argument @arg of @msg, staged if they are large. */
+    void addPayload(GLMessage *msg, int arg, const void *data, size_t len);
 
     // Methods to work with element array buffers
     void bindBuffer(GLuint bufferId, GLvoid *data, GLsizeiptr size);
@@ -87,6 +93,9 @@ public:
 class GLTraceState {
     int mTraceContextIds;
     TCPStream *mStream;
+    StreamWriter *mWriter;
+    unsigned mFBScale;          /* framebuffers are downscaled by this factor */
+    bool mPayloadIds;           /* large payloads are staged, and sent once */
     std::map<EGLContext, GLTraceContext*> mPerContextState;
 
     /* Options controlling additional data to be collected on
@@ -94,19 +103,24 @@ class GLTraceState {
     bool mCollectFbOnEglSwap;
     bool mCollectFbOnGlDraw;
     bool mCollectTextureDataOnGlTexImage;
-    pthread_rwlock_t mTraceOptionsRwLock;
+    /* read on every GL call by every traced thread, hence a lock whose
+       readers don't share a cache line. */
+    ScalableRWLock mTraceOptionsRwLock;
 
     /* helper methods to get/set values using provided lock for mutual exclusion. */
-    void safeSetValue(bool *ptr, bool value, pthread_rwlock_t *lock);
-    bool safeGetValue(bool *ptr, pthread_rwlock_t *lock);
+    void safeSetValue(bool *ptr, bool value, ScalableRWLock *lock);
+    bool safeGetValue(bool *ptr, ScalableRWLock *lock);
 public:
-    GLTraceState(TCPStream *stream);
+    GLTraceState(TCPStream *stream, bool compress, bool fbDelta, unsigned fbScale,
+            bool payloadIds);
     ~GLTraceState();
 
     GLTraceContext *createTraceContext(int version, EGLContext c);
     GLTraceContext *getTraceContext(EGLContext c);
 
     TCPStream *getStream();
+    unsigned getFBScale();
+    bool usePayloadIds();
 
     /* Methods to set trace options. */
     void setCollectFbOnEglSwap(bool en);
@@ -118,8 +118,21 @@ void GLTrace_start() {
     // create communication channel to the host
     TCPStream *stream = new TCPStream(clientSocket);
 
+    // lzf compression of the stream, delta encoded framebuffers, and payload
+    // ids, must be supported by the host
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.egl.trace.compress", value, "0");
+    bool compress = atoi(value) != 0;
+    property_get("debug.egl.trace.fbdelta", value, "0");
+    bool fbDelta = atoi(value) != 0;
+    property_get("debug.egl.trace.fbscale", value, "1");
+    int fbScale = atoi(value);
+    property_get("debug.egl.trace.payloads", value, "0");
+    bool payloadIds = atoi(value) != 0;
+
     // initialize tracing state
-    sGLTraceState = new GLTraceState(stream);
+    sGLTraceState = new GLTraceState(stream, compress, fbDelta, fbScale > 1 ? fbScale : 1,
+            payloadIds);
 
     pthread_create(&sReceiveThreadId, NULL, commandReceiveTask, sGLTraceState);
 }
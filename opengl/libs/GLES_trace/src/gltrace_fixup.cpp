@@ -145,18 +145,12 @@ void fixup_glGetString(GLMessage *glmsg, void *pointersToFixup[]) {
 
 /* Add the contents of the framebuffer to the protobuf message */
 void fixup_addFBContents(GLTraceContext *context, GLMessage *glmsg, FBBinding fbToRead) {
-    void *fbcontents;
-    unsigned fbsize, fbwidth, fbheight;
-    context->getCompressedFB(&fbcontents, &fbsize, &fbwidth, &fbheight, fbToRead);
-
-    GLMessage_FrameBuffer *fb = glmsg->mutable_fb();
-    fb->set_width(fbwidth);
-    fb->set_height(fbheight);
-    fb->add_contents(fbcontents, fbsize);
+    context->addFBContents(glmsg, fbToRead);
 }
 
 /** Common fixup routing for glTexImage2D & glTexSubImage2D. */
-void fixup_glTexImage(int widthIndex, int heightIndex, GLMessage *glmsg, void *dataSrc) {
+void fixup_glTexImage(GLTraceContext *context, int widthIndex, int heightIndex,
+        GLMessage *glmsg, void *dataSrc) {
     GLMessage_DataType arg_width  = glmsg->args(widthIndex);
     GLMessage_DataType arg_height = glmsg->args(heightIndex);
 
@@ -177,7 +171,7 @@ void fixup_glTexImage(int widthIndex, int heightIndex, GLMessage *glmsg, void *d
 
     if (data != NULL) {
         arg_data->set_isarray(true);
-        arg_data->add_rawbytes(data, bytesPerTexel * width * height);
+        context->addPayload(glmsg, 8, data, bytesPerTexel * width * height);
     } else {
         arg_data->set_isarray(false);
         arg_data->set_type(GLMessage::DataType::VOID);
@@ -185,7 +179,7 @@ void fixup_glTexImage(int widthIndex, int heightIndex, GLMessage *glmsg, void *d
 }
 
 
-void fixup_glTexImage2D(GLMessage *glmsg, void *pointersToFixup[]) {
+void fixup_glTexImage2D(GLTraceContext *context, GLMessage *glmsg, void *pointersToFixup[]) {
     /* void glTexImage2D(GLenum target,
                         GLint level,
                         GLint internalformat,
@@ -198,10 +192,11 @@ void fixup_glTexImage2D(GLMessage *glmsg, void *pointersToFixup[]) {
     */
     int widthIndex = 3;
     int heightIndex = 4;
-    fixup_glTexImage(widthIndex, heightIndex, glmsg, pointersToFixup[0]);
+    fixup_glTexImage(context, widthIndex, heightIndex, glmsg, pointersToFixup[0]);
 }
 
-void fixup_glTexSubImage2D(GLMessage *glmsg, void *pointersToFixup[]) {
+void fixup_glTexSubImage2D(GLTraceContext *context, GLMessage *glmsg,
+        void *pointersToFixup[]) {
     /*
     void glTexSubImage2D(GLenum target,
                         GLint level,
@@ -215,7 +210,7 @@ void fixup_glTexSubImage2D(GLMessage *glmsg, void *pointersToFixup[]) {
     */
     int widthIndex = 4;
     int heightIndex = 5;
-    fixup_glTexImage(widthIndex, heightIndex, glmsg, pointersToFixup[0]);
+    fixup_glTexImage(context, widthIndex, heightIndex, glmsg, pointersToFixup[0]);
 }
 
 void fixup_glShaderSource(GLMessage *glmsg, void *pointersToFixup[]) {
@@ -401,13 +396,14 @@ bool isUsingElementArrayBuffers(GLTraceContext *context) {
     return glGetInteger(context, GL_ELEMENT_ARRAY_BUFFER_BINDING) != 0;
 }
 
-/** Copy @len bytes of data from @src into the @dataIndex'th argument of the message. */
-void addGlBufferData(GLMessage *glmsg, int dataIndex, GLvoid *src, GLsizeiptr len) {
+/** Add @len bytes of data from @src to the @dataIndex'th argument of the message. */
+void addGlBufferData(GLTraceContext *context, GLMessage *glmsg, int dataIndex, GLvoid *src,
+        GLsizeiptr len) {
     GLMessage_DataType *arg_datap = glmsg->mutable_args(dataIndex);
     arg_datap->set_type(GLMessage::DataType::VOID);
     arg_datap->set_isarray(true);
     arg_datap->clear_intvalue();
-    arg_datap->add_rawbytes(src, len);
+    context->addPayload(glmsg, dataIndex, src, len);
 }
 
 void fixup_glBufferData(GLTraceContext *context, GLMessage *glmsg, void *pointersToFixup[]) {
@@ -425,7 +421,7 @@ void fixup_glBufferData(GLTraceContext *context, GLMessage *glmsg, void *pointer
 
     // add buffer data to the protobuf message
     if (datap != NULL) {
-        addGlBufferData(glmsg, 2, datap, size);
+        addGlBufferData(context, glmsg, 2, datap, size);
     }
 }
 
@@ -441,7 +437,7 @@ void fixup_glBufferSubData(GLTraceContext *context, GLMessage *glmsg, void *poin
     }
 
     // add buffer data to the protobuf message
-    addGlBufferData(glmsg, 3, datap, size);
+    addGlBufferData(context, glmsg, 3, datap, size);
 }
 
 /** Obtain the size of each vertex attribute. */
@@ -754,12 +750,12 @@ void fixupGLMessage(GLTraceContext *context, nsecs_t wallStart, nsecs_t wallEnd,
         break;
     case GLMessage::glTexImage2D:
         if (context->getGlobalTraceState()->shouldCollectTextureDataOnGlTexImage()) {
-            fixup_glTexImage2D(glmsg, pointersToFixup);
+            fixup_glTexImage2D(context, glmsg, pointersToFixup);
         }
         break;
     case GLMessage::glTexSubImage2D:
         if (context->getGlobalTraceState()->shouldCollectTextureDataOnGlTexImage()) {
-            fixup_glTexSubImage2D(glmsg, pointersToFixup);
+            fixup_glTexSubImage2D(context, glmsg, pointersToFixup);
         }
         break;
     case GLMessage::glShaderSource:
@@ -16,16 +16,24 @@
 
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <netinet/in.h>
 
+#include <cutils/ashmem.h>
 #include <cutils/log.h>
 #include <private/android_filesystem_config.h>
 
+extern "C" {
+#include "liblzf/lzf.h"
+}
+
 #include "gltrace_transport.h"
 
 namespace android {
@@ -138,20 +146,59 @@ int TCPStream::receive(void *data, size_t len) {
     return 0;
 }
 
-BufferedOutputStream::BufferedOutputStream(TCPStream *stream, size_t bufferSize) {
+/**
+ * A compressed block starts with its compressed size or'ed with this flag,
+ * which can't be set in the size of a single message, followed by its
+ * uncompressed size.
+ */
+static const uint32_t COMPRESSED_BLOCK_FLAG = 0x80000000;
+
+/** Buffers smaller than this are not worth compressing. */
+static const size_t MIN_COMPRESSED_BLOCK_SIZE = 256;
+
+/**
+ * A payload block starts with the payload's size or'ed with this flag,
+ * which can't be set in the size of a message either, followed by its id.
+ */
+static const uint32_t PAYLOAD_BLOCK_FLAG = 0x40000000;
+
+BufferedOutputStream::BufferedOutputStream(TCPStream *stream, size_t bufferSize,
+        bool compress) {
     mStream = stream;
 
     mBufferSize = bufferSize;
     mStringBuffer = "";
     mStringBuffer.reserve(bufferSize);
+
+    mCompress = compress;
 }
 
 int BufferedOutputStream::flush() {
-    if (mStringBuffer.size() == 0) {
+    const size_t len = mStringBuffer.size();
+    if (len == 0) {
         return 0;
     }
 
-    int n = mStream->send((void *)mStringBuffer.data(), mStringBuffer.size());
+    if (mCompress && len >= MIN_COMPRESSED_BLOCK_SIZE) {
+        const size_t headerSize = 2 * sizeof(uint32_t);
+        mCompressedBuffer.resize(headerSize + len);
+        char *block = &mCompressedBuffer[0];
+
+        // lzf_compress() fails if the output would not be smaller than the input,
+        // in which case the buffer is sent as is
+        unsigned compressedLen = lzf_compress(mStringBuffer.data(), len,
+                                              block + headerSize, len - 1);
+        if (compressedLen > 0) {
+            const uint32_t header[2] = {
+                compressedLen | COMPRESSED_BLOCK_FLAG, (uint32_t)len };
+            memcpy(block, header, headerSize);
+
+            mStringBuffer.clear();
+            return mStream->send(block, headerSize + compressedLen);
+        }
+    }
+
+    int n = mStream->send((void *)mStringBuffer.data(), len);
     mStringBuffer.clear();
     return n;
 }
@@ -173,5 +220,429 @@ int BufferedOutputStream::send(GLMessage *msg) {
     return 0;
 }
 
+int BufferedOutputStream::sendPayload(uint32_t id, const void *data, size_t len) {
+    // the messages buffered so far go first, they may define earlier payloads
+    if (flush() < 0) {
+        return -1;
+    }
+
+    const uint32_t header[2] = { (uint32_t)len | PAYLOAD_BLOCK_FLAG, id };
+    if (mStream->send((void *)header, sizeof(header)) < 0) {
+        return -1;
+    }
+    return mStream->send((void *)data, len) < 0 ? -1 : 0;
+}
+
+MessageQueue::MessageQueue(size_t capacity, size_t payloadsSize) {
+    mCapacity = 1;
+    while (mCapacity < capacity) {
+        mCapacity <<= 1;
+    }
+
+    mSlots = new Slot[mCapacity];
+    mHead = mTail = 0;
+
+    mPayloads = NULL;
+    mPayloadsSize = 0;
+    mPayloadsHead = mPayloadsTail = 0;
+    if (payloadsSize > 0) {
+        mPayloadsSize = 1;
+        while (mPayloadsSize < payloadsSize) {
+            mPayloadsSize <<= 1;
+        }
+
+        int fd = ashmem_create_region("gltrace payloads", mPayloadsSize);
+        if (fd >= 0) {
+            void *base = mmap(NULL, mPayloadsSize, PROT_READ | PROT_WRITE,
+                              MAP_SHARED, fd, 0);
+            close(fd);
+            if (base != MAP_FAILED) {
+                mPayloads = (uint8_t *)base;
+            }
+        }
+        if (mPayloads == NULL) {
+            ALOGW("No payload area (%s), payloads are copied into the messages",
+                    strerror(errno));
+            mPayloadsSize = 0;
+        }
+    }
+}
+
+MessageQueue::~MessageQueue() {
+    GLMessage *msg;
+    while ((msg = pop()) != NULL) {
+        delete msg;
+    }
+    delete[] mSlots;
+
+    if (mPayloads != NULL) {
+        munmap(mPayloads, mPayloadsSize);
+    }
+}
+
+size_t MessageQueue::capacity() {
+    return mCapacity;
+}
+
+size_t MessageQueue::size() {
+    return mTail - mHead;
+}
+
+bool MessageQueue::push(GLMessage *msg, const Payload &payload) {
+    const uint32_t tail = mTail;
+    if (tail - mHead >= mCapacity) {
+        return false;
+    }
+
+    Slot &slot = mSlots[tail & (mCapacity - 1)];
+    slot.msg = msg;
+    slot.payload = payload;
+
+    // the slot must be written before the consumer can see it
+    __sync_synchronize();
+    mTail = tail + 1;
+    return true;
+}
+
+GLMessage *MessageQueue::pop(Payload *payload) {
+    const uint32_t head = mHead;
+    if (head == mTail) {
+        return NULL;
+    }
+
+    __sync_synchronize();
+    const Slot &slot = mSlots[head & (mCapacity - 1)];
+    GLMessage *msg = slot.msg;
+    if (payload != NULL) {
+        *payload = slot.payload;
+    }
+
+    // the slot must be read before the producer can reuse it
+    __sync_synchronize();
+    mHead = head + 1;
+    return msg;
+}
+
+bool MessageQueue::stagePayload(int arg, const void *data, size_t len, Payload *payload) {
+    if (mPayloads == NULL || len > mPayloadsSize) {
+        return false;
+    }
+
+    // a payload is contiguous, it starts over at the beginning of the area
+    // rather than wrap around
+    const uint32_t tail = mPayloadsTail;
+    const uint32_t offset = tail & (mPayloadsSize - 1);
+    uint32_t start = tail;
+    if (offset + len > mPayloadsSize) {
+        start += mPayloadsSize - offset;
+    }
+
+    // the consumer must be done reading what it released
+    __sync_synchronize();
+    if (start + len - mPayloadsHead > mPayloadsSize) {
+        return false;
+    }
+
+    // push() makes the data visible to the consumer along with the message
+    memcpy(mPayloads + (start & (mPayloadsSize - 1)), data, len);
+    mPayloadsTail = start + len;
+
+    payload->arg = arg;
+    payload->begin = tail;
+    payload->end = start + len;
+    payload->len = len;
+    return true;
+}
+
+void MessageQueue::unstagePayload(const Payload &payload) {
+    mPayloadsTail = payload.begin;
+}
+
+const void *MessageQueue::payloadData(const Payload &payload) {
+    return mPayloads + ((payload.end - payload.len) & (mPayloadsSize - 1));
+}
+
+void MessageQueue::releasePayload(const Payload &payload) {
+    // the payload must be read before the producer can reuse its space
+    __sync_synchronize();
+    mPayloadsHead = payload.end;
+}
+
+/** Framebuffers that can be queued, raw, before new ones are skipped. */
+static const int32_t MAX_PENDING_FBS = 4;
+
+/** With delta encoding, a full framebuffer is still sent every so often. */
+static const unsigned MAX_DELTA_FBS = 30;
+
+/** Payloads copied into messages that are smaller than this are always sent. */
+static const size_t MIN_REPEATED_PAYLOAD_SIZE = 1024;
+
+/**
+ * Payload ids remembered at most. Past that, they are all forgotten, the
+ * next payloads get new ids.
+ */
+static const size_t MAX_PAYLOAD_IDS = 16384;
+
+StreamWriter::StreamWriter(TCPStream *stream, size_t bufferSize, bool compress,
+        bool fbDelta, bool payloadIds) {
+    mStream = new BufferedOutputStream(stream, bufferSize, compress);
+    mFBDelta = fbDelta;
+    mPendingFBs = 0;
+    mPayloadIds = payloadIds;
+    mNextPayloadId = 0;
+    mSleeping = 0;
+    mExit = 0;
+
+    pthread_mutex_init(&mLock, NULL);
+    pthread_cond_init(&mCondition, NULL);
+    pthread_create(&mThread, NULL, threadLoop, this);
+}
+
+StreamWriter::~StreamWriter() {
+    pthread_mutex_lock(&mLock);
+    mExit = 1;
+    pthread_cond_signal(&mCondition);
+    pthread_mutex_unlock(&mLock);
+
+    pthread_join(mThread, NULL);
+
+    pthread_cond_destroy(&mCondition);
+    pthread_mutex_destroy(&mLock);
+    delete mStream;
+}
+
+/** Serialize queued messages, returns true if there were any. Called with mLock held. */
+bool StreamWriter::drainQueues() {
+    bool sent = false;
+
+    for (size_t i = 0; i < mQueues.size(); i++) {
+        MessageQueue *queue = mQueues[i];
+
+        // only take what is queued now, so that a busy context doesn't starve the others
+        size_t count = queue->size();
+        GLMessage *msg;
+        Payload payload;
+        while (count-- > 0 && (msg = queue->pop(&payload)) != NULL) {
+            writeMessage(queue, msg, payload);
+            sent = true;
+        }
+    }
+
+    return sent;
+}
+
+/** Serialize @msg, popped from @queue with @payload, and free it. Called with mLock held. */
+void StreamWriter::writeMessage(MessageQueue *queue, GLMessage *msg, const Payload &payload) {
+    if (msg->has_fb()) {
+        encodeFB(msg);
+        __sync_fetch_and_sub(&mPendingFBs, 1);
+    }
+
+    if (payload.arg >= 0) {
+        writeStagedPayload(queue, msg, payload);
+    }
+    if (mPayloadIds) {
+        replaceRepeatedPayloads(msg);
+    }
+
+    mStream->send(msg);
+    delete msg;
+}
+
+/** 64 bit FNV-1a of @data, a word at a time, seeded with @len. */
+static uint64_t hashPayload(const void *data, size_t len) {
+    const uint64_t FNV_PRIME = 1099511628211ULL;
+    const uint8_t *p = (const uint8_t *)data;
+    uint64_t hash = 14695981039346656037ULL ^ len;
+
+    for (; len >= sizeof(uint32_t); len -= sizeof(uint32_t)) {
+        uint32_t word;
+        memcpy(&word, p, sizeof(word));
+        hash = (hash ^ word) * FNV_PRIME;
+        p += sizeof(word);
+    }
+    while (len-- > 0) {
+        hash = (hash ^ *p++) * FNV_PRIME;
+    }
+    return hash;
+}
+
+/**
+ * Returns true and the id of the payload with the same contents as @data if
+ * it was sent already. Otherwise, returns false and a new id for it.
+ */
+bool StreamWriter::findPayloadId(const void *data, size_t len, uint32_t *id) {
+    const uint64_t hash = hashPayload(data, len);
+    std::map<uint64_t, uint32_t>::iterator it = mPayloadsSent.find(hash);
+    if (it != mPayloadsSent.end()) {
+        *id = it->second;
+        return true;
+    }
+
+    if (mPayloadsSent.size() >= MAX_PAYLOAD_IDS) {
+        mPayloadsSent.clear();
+    }
+    *id = mNextPayloadId++;
+    mPayloadsSent[hash] = *id;
+    return false;
+}
+
+/** Send the staged @payload of @msg unless it was sent before, and refer to it by id. */
+void StreamWriter::writeStagedPayload(MessageQueue *queue, GLMessage *msg,
+        const Payload &payload) {
+    const void *data = queue->payloadData(payload);
+    uint32_t id;
+    if (!findPayloadId(data, payload.len, &id)) {
+        mStream->sendPayload(id, data, payload.len);
+    }
+    queue->releasePayload(payload);
+
+    msg->mutable_args(payload.arg)->set_rawbytesid(id);
+}
+
+/**
+ * Give an id to the large payloads copied into @msg, and drop the ones that
+ * were sent before.
+ */
+void StreamWriter::replaceRepeatedPayloads(GLMessage *msg) {
+    for (int i = 0; i < msg->args_size(); i++) {
+        GLMessage_DataType *arg = msg->mutable_args(i);
+        if (arg->rawbytes_size() != 1 || arg->has_rawbytesid()
+                || arg->rawbytes(0).size() < MIN_REPEATED_PAYLOAD_SIZE) {
+            continue;
+        }
+
+        const std::string &bytes = arg->rawbytes(0);
+        uint32_t id;
+        if (findPayloadId(bytes.data(), bytes.size(), &id)) {
+            arg->clear_rawbytes();
+        }
+        arg->set_rawbytesid(id);
+    }
+}
+
+/** Replace the raw framebuffer attached to @msg by its encoded version. */
+void StreamWriter::encodeFB(GLMessage *msg) {
+    GLMessage_FrameBuffer *fb = msg->mutable_fb();
+    if (fb->contents_size() == 0) {
+        return;
+    }
+
+    std::string *contents = fb->mutable_contents(0);
+    const size_t len = contents->size();
+
+    if (mFBDelta) {
+        PreviousFB &prev = mPreviousFBs[msg->context_id()];
+        if (prev.width == fb->width() && prev.height == fb->height()
+                && prev.contents.size() == len && prev.deltas < MAX_DELTA_FBS) {
+            // xor with the previous framebuffer, which becomes this one
+            uint32_t *cur = (uint32_t *)&(*contents)[0];
+            uint32_t *last = (uint32_t *)&prev.contents[0];
+            for (size_t i = 0; i < len / 4; i++) {
+                const uint32_t pixel = cur[i];
+                cur[i] = pixel ^ last[i];
+                last[i] = pixel;
+            }
+            fb->set_isdelta(true);
+            prev.deltas++;
+        } else {
+            prev.width = fb->width();
+            prev.height = fb->height();
+            prev.deltas = 0;
+            prev.contents = *contents;
+        }
+    }
+
+    // room for lzf's worst case expansion of incompressible data
+    mFBBuffer.resize(len + len / 16 + 64);
+    unsigned compressedLen = lzf_compress(contents->data(), len, &mFBBuffer[0],
+                                          mFBBuffer.size());
+    contents->assign(mFBBuffer.data(), compressedLen);
+}
+
+void *StreamWriter::threadLoop(void *arg) {
+    StreamWriter *writer = (StreamWriter *)arg;
+
+    // Producers wake the writer up at frame and draw call boundaries, this
+    // only bounds the latency of a wakeup that raced with going to sleep.
+    const long SLEEP_NS = 10 * 1000000;
+
+    pthread_mutex_lock(&writer->mLock);
+    while (!writer->mExit) {
+        if (writer->drainQueues()) {
+            continue;
+        }
+
+        // all queues are empty, send out what is buffered then wait for more
+        writer->mStream->flush();
+
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += SLEEP_NS;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_nsec -= 1000000000;
+            ts.tv_sec++;
+        }
+
+        writer->mSleeping = 1;
+        pthread_cond_timedwait(&writer->mCondition, &writer->mLock, &ts);
+        writer->mSleeping = 0;
+    }
+
+    while (writer->drainQueues()) {
+    }
+    writer->mStream->flush();
+    pthread_mutex_unlock(&writer->mLock);
+
+    return NULL;
+}
+
+void StreamWriter::addQueue(MessageQueue *queue) {
+    pthread_mutex_lock(&mLock);
+    mQueues.push_back(queue);
+    pthread_mutex_unlock(&mLock);
+}
+
+void StreamWriter::removeQueue(MessageQueue *queue) {
+    pthread_mutex_lock(&mLock);
+
+    GLMessage *msg;
+    Payload payload;
+    while ((msg = queue->pop(&payload)) != NULL) {
+        writeMessage(queue, msg, payload);
+    }
+    mStream->flush();
+
+    for (size_t i = 0; i < mQueues.size(); i++) {
+        if (mQueues[i] == queue) {
+            mQueues.erase(mQueues.begin() + i);
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&mLock);
+}
+
+void StreamWriter::wakeup() {
+    // the mutex is not taken here, so that producers never block: a wakeup
+    // that is missed because the writer is just going to sleep is only late
+    if (mSleeping) {
+        mSleeping = 0;
+        pthread_cond_signal(&mCondition);
+    }
+}
+
+bool StreamWriter::reserveFB() {
+    if (__sync_fetch_and_add(&mPendingFBs, 1) >= MAX_PENDING_FBS) {
+        __sync_fetch_and_sub(&mPendingFBs, 1);
+        return false;
+    }
+    return true;
+}
+
+void StreamWriter::releaseFB() {
+    __sync_fetch_and_sub(&mPendingFBs, 1);
+}
+
 };  // namespace gltrace
 };  // namespace android
@@ -17,7 +17,9 @@
 #ifndef __GLTRACE_TRANSPORT_H_
 #define __GLTRACE_TRANSPORT_H_
 
+#include <map>
 #include <pthread.h>
+#include <vector>
 
 #include "gltrace.pb.h"
 
@@ -51,7 +53,8 @@ public:
 
 /**
  * BufferedOutputStream provides buffering of data sent to the underlying
- * unbuffered channel.
+ * unbuffered channel. If compression is enabled, every flushed buffer is
+ * sent as a single lzf compressed block (see DESIGN.txt for the framing).
  */
 class BufferedOutputStream {
     TCPStream *mStream;
@@ -59,6 +62,9 @@ class BufferedOutputStream {
     size_t mBufferSize;
     std::string mStringBuffer;
 
+    bool mCompress;
+    std::string mCompressedBuffer;
+
     /** Enqueue message into internal buffer. */
     void enqueueMessage(GLMessage *msg);
 public:
@@ -66,7 +72,7 @@ public:
      * Construct a Buffered stream of size @bufferSize, using @stream as
      * its underlying channel for transport.
      */
-    BufferedOutputStream(TCPStream *stream, size_t bufferSize);
+    BufferedOutputStream(TCPStream *stream, size_t bufferSize, bool compress = false);
 
     /**
      * Send @msg. The message could be buffered and sent later with a
@@ -76,6 +82,153 @@ public:
 
     /** Send any buffered messages, returns -1 on error, 0 on success. */
     int flush();
+
+    /**
+     * Send @len bytes at @data as the payload with id @id, after what is
+     * buffered and without copying it. Returns -1 on error, 0 on success.
+     */
+    int sendPayload(uint32_t id, const void *data, size_t len);
+};
+
+/**
+ * The texture or buffer data of a message, staged in the payload area of
+ * its MessageQueue instead of being copied into the message.
+ */
+struct Payload {
+    int arg;                        /* argument of the message it is for, -1 if none */
+    uint32_t begin;                 /* staging position before it was staged */
+    uint32_t end;                   /* staging position after its last byte */
+    uint32_t len;
+    Payload() : arg(-1), begin(0), end(0), len(0) {}
+};
+
+/**
+ * MessageQueue is a fixed size, lock free queue of GLMessages with a single
+ * producer (the thread the GL context is current on) and a single consumer
+ * (the StreamWriter thread).
+ *
+ * It can also have a payload area, a ring buffer in an ashmem region where
+ * large payloads are staged for the messages, and released by the consumer
+ * in the same order.
+ */
+class MessageQueue {
+    struct Slot {
+        GLMessage *msg;
+        Payload payload;
+    };
+
+    Slot *mSlots;
+    uint32_t mCapacity;             /* a power of 2 */
+    volatile uint32_t mHead;        /* next slot to pop, written by the consumer */
+    volatile uint32_t mTail;        /* next slot to push, written by the producer */
+
+    uint8_t *mPayloads;             /* NULL if there is no payload area */
+    uint32_t mPayloadsSize;         /* a power of 2 */
+    volatile uint32_t mPayloadsHead; /* released up to here, written by the consumer */
+    uint32_t mPayloadsTail;         /* staged up to here, written by the producer */
+public:
+    MessageQueue(size_t capacity, size_t payloadsSize = 0);
+    ~MessageQueue();
+
+    size_t capacity();
+    size_t size();
+
+    /**
+     * Queue @msg, which is then owned by the queue, along with its staged
+     * @payload if any. Returns false if the queue is full.
+     */
+    bool push(GLMessage *msg, const Payload &payload = Payload());
+
+    /**
+     * Returns the oldest queued message, or NULL if the queue is empty. Its
+     * payload is returned in @payload, and must be released.
+     */
+    GLMessage *pop(Payload *payload = NULL);
+
+    /**
+     * Copy @len bytes at @data to the payload area, for argument @arg of the
+     * next message pushed. Returns false if there isn't room for them.
+     */
+    bool stagePayload(int arg, const void *data, size_t len, Payload *payload);
+
+    /** Give back @payload, the last one staged, whose message was not queued. */
+    void unstagePayload(const Payload &payload);
+
+    const void *payloadData(const Payload &payload);
+
+    /** Give back @payload of a popped message, once it has been sent. */
+    void releasePayload(const Payload &payload);
+};
+
+/**
+ * StreamWriter owns a thread that drains a set of MessageQueues, and
+ * serializes their messages to a BufferedOutputStream. None of the methods
+ * used by the producers of the queues block, except addQueue() and
+ * removeQueue().
+ *
+ * Framebuffer contents are queued raw, the writer compresses them, after
+ * xor'ing them with the previous framebuffer of the same context if delta
+ * encoding is enabled.
+ *
+ * If payload ids are enabled, large payloads are only sent the first time
+ * their contents are seen, and are referred to by id after that. Staged
+ * payloads are sent in blocks of their own, straight from the payload area.
+ */
+class StreamWriter {
+    struct PreviousFB {
+        int width;
+        int height;
+        unsigned deltas;            /* delta frames sent since the last full frame */
+        std::string contents;
+        PreviousFB() : width(0), height(0), deltas(0) {}
+    };
+
+    BufferedOutputStream *mStream;
+    std::vector<MessageQueue*> mQueues;
+
+    bool mFBDelta;
+    std::map<int, PreviousFB> mPreviousFBs;    /* by context id */
+    std::string mFBBuffer;
+    volatile int32_t mPendingFBs;   /* framebuffers queued but not encoded yet */
+
+    bool mPayloadIds;
+    std::map<uint64_t, uint32_t> mPayloadsSent;    /* payload ids, by content hash */
+    uint32_t mNextPayloadId;
+
+    pthread_t mThread;
+    pthread_mutex_t mLock;          /* protects mQueues and mStream */
+    pthread_cond_t mCondition;
+    volatile int32_t mSleeping;
+    volatile int32_t mExit;
+
+    static void *threadLoop(void *arg);
+    bool drainQueues();
+    void writeMessage(MessageQueue *queue, GLMessage *msg, const Payload &payload);
+    void encodeFB(GLMessage *msg);
+    bool findPayloadId(const void *data, size_t len, uint32_t *id);
+    void writeStagedPayload(MessageQueue *queue, GLMessage *msg, const Payload &payload);
+    void replaceRepeatedPayloads(GLMessage *msg);
+public:
+    StreamWriter(TCPStream *stream, size_t bufferSize, bool compress, bool fbDelta,
+            bool payloadIds);
+    ~StreamWriter();
+
+    void addQueue(MessageQueue *queue);
+
+    /** Remove @queue, after sending whatever is still queued in it. */
+    void removeQueue(MessageQueue *queue);
+
+    /** Have the writer thread send out what is queued so far. */
+    void wakeup();
+
+    /**
+     * Reserve room for a framebuffer to be queued. Returns false if too many
+     * are waiting to be encoded already, in which case it should be skipped.
+     */
+    bool reserveFB();
+
+    /** Release a reservation for a framebuffer that was not queued after all. */
+    void releaseFB();
 };
 
 /**
@@ -30,7 +30,7 @@
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
 
-#if !defined(__arm__)
+#if !defined(__arm__) && !defined(__i386__)
 #define USE_SLOW_BINDING            1
 #else
 #define USE_SLOW_BINDING            0
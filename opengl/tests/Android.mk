@@ -5,10 +5,12 @@ dirs := \
 	fillrate \
 	filter \
 	finish \
+	framepacing \
 	gl2_basic \
 	gl2_copyTexImage \
 	gl2_yuvtex \
 	gl_basic \
+	gl_dispatch \
 	gl_perf \
 	gl_yuvtex \
 	gralloc \
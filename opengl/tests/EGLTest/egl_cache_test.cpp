@@ -87,9 +87,16 @@ protected:
 
     virtual void TearDown() {
         unlink(mFilename.string());
+        unlink(getJournalFilename().string());
         EGLCacheTest::TearDown();
     }
 
+    String8 getJournalFilename() const {
+        String8 journal(mFilename);
+        journal.append(".journal");
+        return journal;
+    }
+
     String8 mFilename;
 };
 
@@ -107,4 +114,28 @@ TEST_F(EGLCacheSerializationTest, ReinitializedCacheContainsValues) {
     ASSERT_EQ('h', buf[3]);
 }
 
+TEST_F(EGLCacheSerializationTest, TornJournalEntryIsIgnored) {
+    char buf[4] = { 0xee, 0xee, 0xee, 0xee };
+    mCache->setCacheFilename(mFilename);
+    mCache->initialize(egl_display_t::get(EGL_DEFAULT_DISPLAY));
+    mCache->setBlob("abcd", 4, "efgh", 4);
+    mCache->terminate();
+
+    // the start of an entry, as left by a crash while appending
+    FILE* journal = fopen(getJournalFilename().string(), "a");
+    ASSERT_TRUE(journal != NULL);
+    const uint32_t header[3] = { 4, 4, 0 };
+    fwrite(header, sizeof(header), 1, journal);
+    fwrite("ijk", 3, 1, journal);
+    fclose(journal);
+
+    mCache->initialize(egl_display_t::get(EGL_DEFAULT_DISPLAY));
+    ASSERT_EQ(4, mCache->getBlob("abcd", 4, buf, 4));
+    ASSERT_EQ('e', buf[0]);
+    ASSERT_EQ('f', buf[1]);
+    ASSERT_EQ('g', buf[2]);
+    ASSERT_EQ('h', buf[3]);
+    ASSERT_EQ(0, mCache->getBlob("ijkl", 4, buf, 4));
+}
+
 }
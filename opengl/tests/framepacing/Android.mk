@@ -0,0 +1,21 @@
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	framepacing.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils \
+	libutils \
+	libbinder \
+    libui \
+    libgui
+
+LOCAL_STATIC_LIBRARIES := \
+	libcpustats
+
+LOCAL_MODULE:= test-opengl-framepacing
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,434 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Frame pacing benchmark: producer threads post frames to one or more
+ * surfaces, with the BufferQueue in synchronous (swap interval 1) and then
+ * asynchronous (swap interval 0) mode.  For every surface it reports how
+ * long queued frames took to reach the display, how regularly they got
+ * there, how many were never shown, and how long dequeueBuffer and the
+ * release fence it returns kept the producer waiting.
+ *
+ * Present times come from SurfaceFlinger's per-layer frame statistics
+ * (dumpsys SurfaceFlinger --latency), which are matched with the frames by
+ * the buffer timestamp set at queue time.  A frame is taken to reach the
+ * panel one refresh after the vsync of the composition that latched it.
+ *
+ * Results are printed as CSV, one line per mode and surface, so that runs
+ * can be compared by scripts.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cutils/memory.h>
+
+#include <utils/KeyedVector.h>
+#include <utils/String8.h>
+#include <utils/Thread.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+#include <binder/IPCThreadState.h>
+#include <binder/IServiceManager.h>
+#include <binder/ProcessState.h>
+
+#include <ui/Fence.h>
+#include <ui/GraphicBufferMapper.h>
+#include <ui/Rect.h>
+
+#include <gui/Surface.h>
+#include <gui/SurfaceComposerClient.h>
+
+#include <cpustats/CentralTendencyStatistics.h>
+#include <cpustats/LogHistogram.h>
+
+using namespace android;
+
+// SurfaceFlinger keeps the last 128 frames of each layer; polling at this
+// rate can't miss any at refresh rates up to 256 Hz.
+static const useconds_t kPollIntervalUs = 500000;
+
+struct Options {
+    int surfaces;
+    int frames;
+    int width;
+    int height;
+    int buffers;    // 0 for the BufferQueue default
+    int workUs;     // busy time per frame, on top of filling the buffer
+    bool sync;
+    bool async;
+};
+
+struct Frame {
+    nsecs_t queued;         // also the buffer timestamp
+    nsecs_t dequeueWait;    // in dequeueBuffer and waiting for its fence
+    nsecs_t present;        // 0 if the frame was never shown
+};
+
+// ---------------------------------------------------------------------------
+
+class Producer : public Thread {
+public:
+    Producer(const sp<Surface>& surface, const Options& options, bool sync)
+        : Thread(false), mSurface(surface), mOptions(options), mSync(sync),
+          mError(NO_ERROR), mDone(false) { }
+
+    const Vector<Frame>& frames() const { return mFrames; }
+    Vector<Frame>& editFrames() { return mFrames; }
+    status_t error() const { return mError; }
+    bool done() const { return mDone; }
+
+private:
+    virtual status_t readyToRun();
+    virtual bool threadLoop();
+    void fill(ANativeWindowBuffer* buffer, int frame);
+
+    sp<Surface> mSurface;
+    Options mOptions;
+    bool mSync;
+    Vector<Frame> mFrames;
+    status_t mError;
+    volatile bool mDone;
+};
+
+status_t Producer::readyToRun()
+{
+    ANativeWindow* window = mSurface.get();
+    native_window_api_connect(window, NATIVE_WINDOW_API_CPU);
+    native_window_set_usage(window, GRALLOC_USAGE_SW_WRITE_OFTEN);
+    if (mOptions.buffers > 0) {
+        native_window_set_buffer_count(window, mOptions.buffers);
+    }
+    window->setSwapInterval(window, mSync ? 1 : 0);
+    mFrames.setCapacity(mOptions.frames);
+    return NO_ERROR;
+}
+
+void Producer::fill(ANativeWindowBuffer* buffer, int frame)
+{
+    // alternate two colors, so that a missed frame is visible too
+    const uint32_t color = (frame & 1) ? 0xFF0000FF : 0xFF00FF00;
+    void* vaddr;
+    GraphicBufferMapper& mapper(GraphicBufferMapper::get());
+    if (mapper.lock(buffer->handle, GRALLOC_USAGE_SW_WRITE_OFTEN,
+            Rect(buffer->width, buffer->height), &vaddr) != NO_ERROR) {
+        return;
+    }
+    for (int y=0 ; y<buffer->height ; y++) {
+        uint32_t* row = static_cast<uint32_t*>(vaddr) + y * buffer->stride;
+        android_memset32(row, color, buffer->width * 4);
+    }
+    mapper.unlock(buffer->handle);
+}
+
+bool Producer::threadLoop()
+{
+    ANativeWindow* window = mSurface.get();
+    for (int i=0 ; i<mOptions.frames ; i++) {
+        Frame frame;
+        const nsecs_t start = systemTime();
+        ANativeWindowBuffer* buffer;
+        int fenceFd = -1;
+        status_t err = window->dequeueBuffer(window, &buffer, &fenceFd);
+        if (err != NO_ERROR) {
+            mError = err;
+            break;
+        }
+        sp<Fence> fence(new Fence(fenceFd));
+        fence->wait(Fence::TIMEOUT_NEVER);
+        frame.dequeueWait = systemTime() - start;
+
+        fill(buffer, i);
+        const nsecs_t workEnd = systemTime() + us2ns(mOptions.workUs);
+        while (systemTime() < workEnd) {
+        }
+
+        frame.queued = systemTime();
+        frame.present = 0;
+        native_window_set_buffers_timestamp(window, frame.queued);
+        err = window->queueBuffer(window, buffer, -1);
+        if (err != NO_ERROR) {
+            mError = err;
+            break;
+        }
+        mFrames.add(frame);
+    }
+    native_window_api_disconnect(window, NATIVE_WINDOW_API_CPU);
+    mDone = true;
+    return false;
+}
+
+// ---------------------------------------------------------------------------
+
+// Adds the frames SurfaceFlinger has presented for the named layer to
+// presents, keyed by buffer timestamp.
+static status_t pollPresents(const String8& name,
+        KeyedVector<nsecs_t, nsecs_t>& presents, nsecs_t* period)
+{
+    sp<IBinder> sf = defaultServiceManager()->checkService(
+            String16("SurfaceFlinger"));
+    if (sf == 0) {
+        return NAME_NOT_FOUND;
+    }
+
+    // the output of one layer is a few KB, well below the capacity of the
+    // pipe, so it can be read after the call returns
+    int fds[2];
+    if (pipe(fds) < 0) {
+        return -errno;
+    }
+    Vector<String16> args;
+    args.add(String16("--latency"));
+    args.add(String16(name));
+    status_t err = sf->dump(fds[1], args);
+    close(fds[1]);
+
+    String8 output;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = read(fds[0], buffer, sizeof(buffer))) > 0) {
+        output.append(buffer, n);
+    }
+    close(fds[0]);
+    if (err != NO_ERROR) {
+        return err;
+    }
+
+    // the refresh period, then "app-timestamp vsync latch-time" per frame
+    const char* line = output.string();
+    long long refresh = 0;
+    if (sscanf(line, "%lld", &refresh) != 1 || refresh <= 0) {
+        return BAD_VALUE;
+    }
+    *period = refresh;
+    while ((line = strchr(line, '\n')) != NULL) {
+        line++;
+        long long app, vsync, set;
+        if (sscanf(line, "%lld %lld %lld", &app, &vsync, &set) == 3 && app) {
+            presents.replaceValueFor(app, vsync + refresh);
+        }
+    }
+    return NO_ERROR;
+}
+
+static void report(const char* mode, int index, const Vector<Frame>& frames,
+        nsecs_t period)
+{
+    LogHistogram latency;
+    LogHistogram dequeueWait;
+    CentralTendencyStatistics interval;
+    int missedRefreshes = 0;
+    nsecs_t lastPresent = 0;
+    for (size_t i=0 ; i<frames.size() ; i++) {
+        const Frame& frame(frames[i]);
+        dequeueWait.sample(ns2us(frame.dequeueWait));
+        if (!frame.present) {
+            continue;
+        }
+        const nsecs_t delay = frame.present - frame.queued;
+        latency.sample(delay > 0 ? ns2us(delay) : 0);
+        if (lastPresent) {
+            const nsecs_t delta = frame.present - lastPresent;
+            interval.sample(ns2us(delta));
+            const int refreshes = int((delta + period / 2) / period);
+            if (refreshes > 1) {
+                missedRefreshes += refreshes - 1;
+            }
+        }
+        lastPresent = frame.present;
+    }
+
+    const uint64_t presented = latency.n();
+    printf("%s,%d,%u,%llu,%llu,%llu,%llu,%llu,%llu,%.0f,%.0f,%d,%llu,%llu\n",
+            mode, index, unsigned(frames.size()),
+            presented, uint64_t(frames.size()) - presented,
+            latency.percentile(50), latency.percentile(90),
+            latency.percentile(99), latency.maximum(),
+            interval.n() ? interval.mean() : 0,
+            interval.n() > 1 ? interval.stddev() : 0,
+            missedRefreshes,
+            dequeueWait.percentile(50), dequeueWait.percentile(99));
+}
+
+static status_t runMode(const sp<SurfaceComposerClient>& client,
+        const Options& options, bool sync)
+{
+    const char* mode = sync ? "sync" : "async";
+    Vector< sp<SurfaceControl> > controls;
+    Vector< sp<Producer> > producers;
+    Vector<String8> names;
+    Vector< KeyedVector<nsecs_t, nsecs_t> > presents;
+
+    SurfaceComposerClient::openGlobalTransaction();
+    for (int i=0 ; i<options.surfaces ; i++) {
+        String8 name;
+        name.appendFormat("framepacing-%s-%d", mode, i);
+        sp<SurfaceControl> control = client->createSurface(name,
+                options.width, options.height, PIXEL_FORMAT_RGBX_8888, 0);
+        if (control == 0 || !control->isValid()) {
+            SurfaceComposerClient::closeGlobalTransaction();
+            fprintf(stderr, "couldn't create surface %s\n", name.string());
+            return NO_INIT;
+        }
+        control->setLayer(0x40000000 + i);
+        control->setPosition(i * 32, i * 32);
+        control->show();
+        controls.add(control);
+        names.add(name);
+        presents.add();
+        producers.add(new Producer(control->getSurface(), options, sync));
+    }
+    SurfaceComposerClient::closeGlobalTransaction();
+
+    for (size_t i=0 ; i<producers.size() ; i++) {
+        producers[i]->run(names[i].string(), PRIORITY_URGENT_DISPLAY);
+    }
+
+    nsecs_t period = 0;
+    bool running = true;
+    while (running) {
+        usleep(kPollIntervalUs);
+        running = false;
+        for (size_t i=0 ; i<producers.size() ; i++) {
+            // check before polling, so the last poll sees every frame
+            running |= !producers[i]->done();
+            pollPresents(names[i], presents.editItemAt(i), &period);
+        }
+    }
+    // let the last frames reach the screen
+    usleep(kPollIntervalUs);
+
+    status_t result = NO_ERROR;
+    for (size_t i=0 ; i<producers.size() ; i++) {
+        producers[i]->join();
+        pollPresents(names[i], presents.editItemAt(i), &period);
+        if (producers[i]->error() != NO_ERROR) {
+            fprintf(stderr, "%s: error %d posting frames\n",
+                    names[i].string(), producers[i]->error());
+            result = producers[i]->error();
+        }
+        if (period <= 0) {
+            fprintf(stderr, "no frame statistics from SurfaceFlinger\n");
+            return NAME_NOT_FOUND;
+        }
+
+        const KeyedVector<nsecs_t, nsecs_t>& p(presents[i]);
+        Vector<Frame>& frames(producers[i]->editFrames());
+        for (size_t j=0 ; j<frames.size() ; j++) {
+            ssize_t index = p.indexOfKey(frames[j].queued);
+            if (index >= 0) {
+                frames.editItemAt(j).present = p.valueAt(index);
+            }
+        }
+        report(mode, i, frames, period);
+    }
+
+    for (size_t i=0 ; i<controls.size() ; i++) {
+        controls[i]->clear();
+    }
+    return result;
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+            "usage: %s [-n surfaces] [-f frames] [-s WxH] [-b buffers] "
+            "[-w work_us] [-m sync|async|both]\n"
+            "  -n  number of surfaces posting frames at the same time (1)\n"
+            "  -f  frames posted to each surface per mode (600)\n"
+            "  -s  size of the surfaces (256x256)\n"
+            "  -b  buffer count of the surfaces (BufferQueue default)\n"
+            "  -w  extra busy time per frame in microseconds (0)\n"
+            "  -m  BufferQueue mode(s) to measure (both)\n",
+            name);
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    options.surfaces = 1;
+    options.frames = 600;
+    options.width = 256;
+    options.height = 256;
+    options.buffers = 0;
+    options.workUs = 0;
+    options.sync = true;
+    options.async = true;
+
+    int c;
+    while ((c = getopt(argc, argv, "n:f:s:b:w:m:h")) != -1) {
+        switch (c) {
+            case 'n':
+                options.surfaces = atoi(optarg);
+                break;
+            case 'f':
+                options.frames = atoi(optarg);
+                break;
+            case 's':
+                if (sscanf(optarg, "%dx%d",
+                        &options.width, &options.height) != 2) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'b':
+                options.buffers = atoi(optarg);
+                break;
+            case 'w':
+                options.workUs = atoi(optarg);
+                break;
+            case 'm':
+                options.sync = strcmp(optarg, "async") != 0;
+                options.async = strcmp(optarg, "sync") != 0;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (options.surfaces <= 0 || options.frames <= 0 ||
+            options.width <= 0 || options.height <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    sp<ProcessState> proc(ProcessState::self());
+    ProcessState::self()->startThreadPool();
+
+    sp<SurfaceComposerClient> client = new SurfaceComposerClient();
+    if (client->initCheck() != NO_ERROR) {
+        fprintf(stderr, "couldn't connect to SurfaceFlinger\n");
+        return 1;
+    }
+
+    printf("mode,surface,frames,presented,dropped,"
+            "latency_p50_us,latency_p90_us,latency_p99_us,latency_max_us,"
+            "interval_mean_us,interval_stddev_us,missed_refreshes,"
+            "dequeue_p50_us,dequeue_p99_us\n");
+
+    status_t err = NO_ERROR;
+    if (options.sync && err == NO_ERROR) {
+        err = runMode(client, options, true);
+    }
+    if (options.async && err == NO_ERROR) {
+        err = runMode(client, options, false);
+    }
+    return err == NO_ERROR ? 0 : 1;
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures the per-call overhead of the EGL/GLES wrappers: GL calls
+ * dispatched through the calling thread's hooks, and EGL calls that
+ * validate an object that is (or isn't) current to the calling thread.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+
+#include <utils/Timers.h>
+
+using namespace android;
+
+static const int kIterations = 1000000;
+
+static void report(const char* what, nsecs_t start, nsecs_t end) {
+    printf("%-40s %8.1f ns/call\n", what,
+            double(end - start) / kIterations);
+}
+
+int main(int argc, char** argv)
+{
+    EGLint configAttribs[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+            EGL_NONE };
+    EGLint contextAttribs[] = {
+            EGL_CONTEXT_CLIENT_VERSION, 2,
+            EGL_NONE };
+    EGLint surfaceAttribs[] = {
+            EGL_WIDTH, 16,
+            EGL_HEIGHT, 16,
+            EGL_NONE };
+
+    EGLDisplay dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (!eglInitialize(dpy, NULL, NULL)) {
+        fprintf(stderr, "eglInitialize failed (%#x)\n", eglGetError());
+        return 1;
+    }
+
+    EGLConfig config;
+    EGLint numConfigs = 0;
+    if (!eglChooseConfig(dpy, configAttribs, &config, 1, &numConfigs) ||
+            numConfigs < 1) {
+        fprintf(stderr, "no pbuffer config for OpenGL ES 2.0\n");
+        return 1;
+    }
+
+    EGLSurface surface = eglCreatePbufferSurface(dpy, config, surfaceAttribs);
+    EGLSurface other = eglCreatePbufferSurface(dpy, config, surfaceAttribs);
+    EGLContext context = eglCreateContext(dpy, config, EGL_NO_CONTEXT,
+            contextAttribs);
+    if (surface == EGL_NO_SURFACE || other == EGL_NO_SURFACE ||
+            context == EGL_NO_CONTEXT) {
+        fprintf(stderr, "couldn't create the surfaces or context (%#x)\n",
+                eglGetError());
+        return 1;
+    }
+    if (!eglMakeCurrent(dpy, surface, surface, context)) {
+        fprintf(stderr, "eglMakeCurrent failed (%#x)\n", eglGetError());
+        return 1;
+    }
+
+    nsecs_t start, end;
+    EGLint value;
+
+    start = systemTime();
+    for (int i=0 ; i<kIterations ; i++) {
+        glGetError();
+    }
+    end = systemTime();
+    report("glGetError()", start, end);
+
+    start = systemTime();
+    for (int i=0 ; i<kIterations ; i++) {
+        glUniform1i(-1, i);
+    }
+    end = systemTime();
+    report("glUniform1i(-1)", start, end);
+
+    start = systemTime();
+    for (int i=0 ; i<kIterations ; i++) {
+        eglGetCurrentContext();
+    }
+    end = systemTime();
+    report("eglGetCurrentContext()", start, end);
+
+    start = systemTime();
+    for (int i=0 ; i<kIterations ; i++) {
+        eglQuerySurface(dpy, surface, EGL_WIDTH, &value);
+    }
+    end = systemTime();
+    report("eglQuerySurface(current surface)", start, end);
+
+    start = systemTime();
+    for (int i=0 ; i<kIterations ; i++) {
+        eglQuerySurface(dpy, other, EGL_WIDTH, &value);
+    }
+    end = systemTime();
+    report("eglQuerySurface(other surface)", start, end);
+
+    start = systemTime();
+    for (int i=0 ; i<kIterations ; i++) {
+        eglQueryContext(dpy, context, EGL_CONFIG_ID, &value);
+    }
+    end = systemTime();
+    report("eglQueryContext(current context)", start, end);
+
+    eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(dpy, context);
+    eglDestroySurface(dpy, other);
+    eglDestroySurface(dpy, surface);
+    eglTerminate(dpy);
+    return 0;
+}
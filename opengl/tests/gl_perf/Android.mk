@@ -20,3 +20,48 @@ LOCAL_MODULE_TAGS := optional
 LOCAL_CFLAGS := -DGL_GLEXT_PROTOTYPES
 
 include $(BUILD_EXECUTABLE)
+
+# Vertex throughput of the OpenGL ES 1.x implementation
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	vertex_perf.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils \
+	libutils \
+    libEGL \
+    libGLESv1_CM \
+    libui
+
+LOCAL_C_INCLUDES += $(call include-path-for, opengl-tests-includes)
+
+LOCAL_MODULE:= test-opengl-gl_vertex_perf
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+# Fill rate, texture, shader, overdraw and swap benchmarks, as CSV
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	gl2_bench.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils \
+	libutils \
+    libEGL \
+    libGLESv2 \
+    libETC1 \
+    libui
+
+LOCAL_C_INCLUDES += $(call include-path-for, opengl-tests-includes)
+
+LOCAL_MODULE:= test-opengl-gl2_bench
+
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_CFLAGS := -DGL_GLEXT_PROTOTYPES
+
+include $(BUILD_EXECUTABLE)
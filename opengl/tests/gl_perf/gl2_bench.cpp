@@ -0,0 +1,651 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * GPU benchmark suite for OpenGL ES 2.0, configured from the command line
+ * and printing one CSV line per measurement (suite, test, config, value,
+ * unit) so that results can be tracked over time:
+ *
+ *   fill      full-screen fills per render target format and blending
+ *   texture   full-screen texture sampling, RGBA8888 / RGB565 / ETC1
+ *   shader    the fragment shaders of test-opengl-gl2_perf
+ *   overdraw  N full-screen blended layers per frame, as SurfaceFlinger
+ *             composes them, including eglSwapBuffers
+ *   swap      cost of eglSwapBuffers itself, with swap interval 0 and 1
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+#include <ETC1/etc1.h>
+
+#include <ui/FramebufferNativeWindow.h>
+#include "EGLUtils.h"
+
+#include "fragment_shaders.cpp"
+
+using namespace android;
+
+enum {
+    SUITE_FILL      = 0x01,
+    SUITE_TEXTURE   = 0x02,
+    SUITE_SHADER    = 0x04,
+    SUITE_OVERDRAW  = 0x08,
+    SUITE_SWAP      = 0x10,
+};
+
+static const struct {
+    const char* name;
+    uint32_t mask;
+} gSuites[] = {
+    { "fill",       SUITE_FILL },
+    { "texture",    SUITE_TEXTURE },
+    { "shader",     SUITE_SHADER },
+    { "overdraw",   SUITE_OVERDRAW },
+    { "swap",       SUITE_SWAP },
+};
+
+enum {
+    A_POS,
+    A_COLOR,
+    A_TEX0,
+    A_TEX1
+};
+
+static const int kTextureSize = 1024;
+
+static EGLDisplay gDisplay;
+static EGLSurface gSurface;
+static EGLint gWidth, gHeight;
+static int gDraws = 100;      // draws per fill, texture and shader measurement
+static int gFrames = 120;     // frames per overdraw and swap measurement
+static int gMaxLayers = 8;
+static FILE* gOut = stdout;
+
+// ---------------------------------------------------------------------------
+
+static uint64_t getTime()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_nsec + ((uint64_t)t.tv_sec * 1000 * 1000 * 1000);
+}
+
+static void report(const char* suite, const char* test, const char* config,
+        double value, const char* unit)
+{
+    fprintf(gOut, "%s,%s,%s,%.3f,%s\n", suite, test, config, value, unit);
+    fflush(gOut);
+}
+
+static bool hasExtension(const char* name)
+{
+    const char* extensions = (const char*) glGetString(GL_EXTENSIONS);
+    if (!extensions) {
+        return false;
+    }
+    const size_t length = strlen(name);
+    for (const char* p = extensions; (p = strstr(p, name)) != NULL; p += length) {
+        if ((p == extensions || p[-1] == ' ') &&
+                (p[length] == ' ' || p[length] == '\0')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static GLuint loadShader(GLenum shaderType, const char* source)
+{
+    GLuint shader = glCreateShader(shaderType);
+    if (shader) {
+        glShaderSource(shader, 1, &source, NULL);
+        glCompileShader(shader);
+        GLint compiled = 0;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+        if (!compiled) {
+            char log[1024];
+            glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+            fprintf(stderr, "could not compile shader %d:\n%s\n", shaderType, log);
+            glDeleteShader(shader);
+            shader = 0;
+        }
+    }
+    return shader;
+}
+
+static GLuint createProgram(const char* vertexSource, const char* fragmentSource)
+{
+    GLuint vertexShader = loadShader(GL_VERTEX_SHADER, vertexSource);
+    GLuint fragmentShader = loadShader(GL_FRAGMENT_SHADER, fragmentSource);
+    if (!vertexShader || !fragmentShader) {
+        return 0;
+    }
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glBindAttribLocation(program, A_POS, "a_pos");
+    glBindAttribLocation(program, A_COLOR, "a_color");
+    glBindAttribLocation(program, A_TEX0, "a_tex0");
+    glBindAttribLocation(program, A_TEX1, "a_tex1");
+    glLinkProgram(program);
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+    if (linked != GL_TRUE) {
+        char log[1024];
+        glGetProgramInfoLog(program, sizeof(log), NULL, log);
+        fprintf(stderr, "could not link program:\n%s\n", log);
+        glDeleteProgram(program);
+        return 0;
+    }
+    glUseProgram(program);
+    GLint loc = glGetUniformLocation(program, "u_tex0");
+    if (loc >= 0) glUniform1i(loc, 0);
+    loc = glGetUniformLocation(program, "u_tex1");
+    if (loc >= 0) glUniform1i(loc, 0);
+    return program;
+}
+
+// same vertex shader as test-opengl-gl2_perf, so that its fragment
+// shaders can be reused as they are
+static const char gVertexShader[] =
+    "attribute vec4 a_pos;\n"
+    "attribute vec4 a_color;\n"
+    "attribute vec2 a_tex0;\n"
+    "attribute vec2 a_tex1;\n"
+    "varying vec4 v_color;\n"
+    "varying vec2 v_tex0;\n"
+    "varying vec2 v_tex1;\n"
+    "uniform vec2 u_texOff;\n"
+    "void main() {\n"
+    "    v_color = a_color;\n"
+    "    v_tex0 = a_tex0;\n"
+    "    v_tex1 = a_tex1;\n"
+    "    v_tex0.x += u_texOff.x;\n"
+    "    v_tex1.y += u_texOff.y;\n"
+    "    gl_Position = a_pos;\n"
+    "}\n";
+
+static const char gSolidShader[] =
+    "precision mediump float;\n"
+    "uniform vec4 u_color;\n"
+    "void main() {\n"
+    "  gl_FragColor = u_color;\n"
+    "}\n";
+
+static const char gTextureShader[] =
+    "precision mediump float;\n"
+    "varying vec2 v_tex0;\n"
+    "uniform sampler2D u_tex0;\n"
+    "uniform vec4 u_color;\n"
+    "void main() {\n"
+    "  gl_FragColor = texture2D(u_tex0, v_tex0) * u_color;\n"
+    "}\n";
+
+// A full-screen quad, with texture coordinates mapping one texel to one
+// pixel of a kTextureSize texture.
+static void setupQuad()
+{
+    static const float vtx[] = {
+        -1.0f,-1.0f,
+         1.0f,-1.0f,
+        -1.0f, 1.0f,
+         1.0f, 1.0f };
+    static const float color[] = {
+        1.0f,0.0f,1.0f,1.0f,
+        0.0f,0.0f,1.0f,1.0f,
+        1.0f,1.0f,0.0f,1.0f,
+        1.0f,1.0f,1.0f,1.0f };
+    static float tex[8];
+    const float s = float(gWidth) / kTextureSize;
+    const float t = float(gHeight) / kTextureSize;
+    tex[0] = 0; tex[1] = 0;
+    tex[2] = s; tex[3] = 0;
+    tex[4] = 0; tex[5] = t;
+    tex[6] = s; tex[7] = t;
+
+    glEnableVertexAttribArray(A_POS);
+    glEnableVertexAttribArray(A_COLOR);
+    glEnableVertexAttribArray(A_TEX0);
+    glEnableVertexAttribArray(A_TEX1);
+    glVertexAttribPointer(A_POS, 2, GL_FLOAT, false, 8, vtx);
+    glVertexAttribPointer(A_COLOR, 4, GL_FLOAT, false, 16, color);
+    glVertexAttribPointer(A_TEX0, 2, GL_FLOAT, false, 8, tex);
+    glVertexAttribPointer(A_TEX1, 2, GL_FLOAT, false, 8, tex);
+}
+
+static void setColor(GLuint program, float r, float g, float b, float a)
+{
+    GLint loc = glGetUniformLocation(program, "u_color");
+    if (loc >= 0) glUniform4f(loc, r, g, b, a);
+}
+
+// Draws the quad gDraws times and returns the fill rate in Mpixels/s.
+static double measureDraws(GLuint program)
+{
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glFinish();
+
+    const uint64_t start = getTime();
+    for (int i=0 ; i<gDraws ; i++) {
+        setColor(program, 0.5f, (i & 1) ? 0.25f : 0.75f, 0.5f, 0.5f);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    }
+    glFinish();
+    const double seconds = (getTime() - start) / 1e9;
+    return (double(gWidth) * gHeight * gDraws) / seconds / 1e6;
+}
+
+// ---------------------------------------------------------------------------
+
+static const struct {
+    const char* name;
+    GLenum srcFactor;
+    GLenum dstFactor;
+} gBlends[] = {
+    { "opaque",     GL_ONE,         GL_ZERO },
+    { "premult",    GL_ONE,         GL_ONE_MINUS_SRC_ALPHA },
+    { "alpha",      GL_SRC_ALPHA,   GL_ONE_MINUS_SRC_ALPHA },
+    { "additive",   GL_ONE,         GL_ONE },
+};
+
+static void runFill()
+{
+    static const struct {
+        const char* name;
+        GLenum format;
+        GLenum type;
+    } targets[] = {
+        { "window",     0,          0 },
+        { "RGBA8888",   GL_RGBA,    GL_UNSIGNED_BYTE },
+        { "RGB565",     GL_RGB,     GL_UNSIGNED_SHORT_5_6_5 },
+        { "RGBA4444",   GL_RGBA,    GL_UNSIGNED_SHORT_4_4_4_4 },
+        { "RGBA5551",   GL_RGBA,    GL_UNSIGNED_SHORT_5_5_5_1 },
+    };
+
+    GLuint program = createProgram(gVertexShader, gSolidShader);
+    if (!program) {
+        return;
+    }
+    for (size_t t=0 ; t<sizeof(targets)/sizeof(targets[0]) ; t++) {
+        GLuint texture = 0, fbo = 0;
+        if (targets[t].format) {
+            glGenTextures(1, &texture);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, targets[t].format, gWidth, gHeight,
+                    0, targets[t].format, targets[t].type, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glGenFramebuffers(1, &fbo);
+            glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                    GL_TEXTURE_2D, texture, 0);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) !=
+                    GL_FRAMEBUFFER_COMPLETE) {
+                fprintf(stderr, "fill: %s render target not supported\n",
+                        targets[t].name);
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                glDeleteFramebuffers(1, &fbo);
+                glDeleteTextures(1, &texture);
+                continue;
+            }
+        }
+        for (size_t b=0 ; b<sizeof(gBlends)/sizeof(gBlends[0]) ; b++) {
+            if (gBlends[b].dstFactor == GL_ZERO) {
+                glDisable(GL_BLEND);
+            } else {
+                glEnable(GL_BLEND);
+                glBlendFunc(gBlends[b].srcFactor, gBlends[b].dstFactor);
+            }
+            report("fill", targets[t].name, gBlends[b].name,
+                    measureDraws(program), "Mpix/s");
+        }
+        glDisable(GL_BLEND);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (fbo) {
+            glDeleteFramebuffers(1, &fbo);
+            glDeleteTextures(1, &texture);
+        }
+    }
+    glDeleteProgram(program);
+}
+
+// ---------------------------------------------------------------------------
+
+// A kTextureSize x kTextureSize RGB888 pattern, with enough detail that
+// texture caches can't hide the sampling cost.
+static uint8_t* makePattern()
+{
+    uint8_t* rgb = (uint8_t*) malloc(kTextureSize * kTextureSize * 3);
+    for (int y=0 ; y<kTextureSize ; y++) {
+        for (int x=0 ; x<kTextureSize ; x++) {
+            uint8_t* p = rgb + (y * kTextureSize + x) * 3;
+            p[0] = x;
+            p[1] = (((x + y) & 0xff) == 0x7f) ? 0xff : 0;
+            p[2] = y;
+        }
+    }
+    return rgb;
+}
+
+// Creates the texture sampled by the texture and overdraw suites, in the
+// given format; returns 0 if the format isn't supported.
+static GLuint createTexture(const char* format, const uint8_t* rgb)
+{
+    const int count = kTextureSize * kTextureSize;
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    if (!strcmp(format, "RGBA8888")) {
+        uint8_t* data = (uint8_t*) malloc(count * 4);
+        for (int i=0 ; i<count ; i++) {
+            data[i*4 + 0] = rgb[i*3 + 0];
+            data[i*4 + 1] = rgb[i*3 + 1];
+            data[i*4 + 2] = rgb[i*3 + 2];
+            data[i*4 + 3] = 0xff;
+        }
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, kTextureSize, kTextureSize,
+                0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+        free(data);
+    } else if (!strcmp(format, "RGB565")) {
+        uint16_t* data = (uint16_t*) malloc(count * 2);
+        for (int i=0 ; i<count ; i++) {
+            data[i] = ((rgb[i*3] >> 3) << 11) | ((rgb[i*3 + 1] >> 2) << 5) |
+                    (rgb[i*3 + 2] >> 3);
+        }
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, kTextureSize, kTextureSize,
+                0, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, data);
+        free(data);
+    } else if (!strcmp(format, "ETC1")) {
+        if (!hasExtension("GL_OES_compressed_ETC1_RGB8_texture")) {
+            glDeleteTextures(1, &texture);
+            return 0;
+        }
+        const etc1_uint32 size =
+                etc1_get_encoded_data_size(kTextureSize, kTextureSize);
+        etc1_byte* data = (etc1_byte*) malloc(size);
+        etc1_encode_image(rgb, kTextureSize, kTextureSize, 3,
+                kTextureSize * 3, data);
+        glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_ETC1_RGB8_OES,
+                kTextureSize, kTextureSize, 0, size, data);
+        free(data);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    return texture;
+}
+
+static const char* const gTextureFormats[] = { "RGBA8888", "RGB565", "ETC1" };
+
+static void runTexture(const uint8_t* rgb)
+{
+    GLuint program = createProgram(gVertexShader, gTextureShader);
+    if (!program) {
+        return;
+    }
+    setupQuad();
+    glDisable(GL_BLEND);
+    for (size_t f=0 ; f<sizeof(gTextureFormats)/sizeof(gTextureFormats[0]) ; f++) {
+        GLuint texture = createTexture(gTextureFormats[f], rgb);
+        if (!texture) {
+            fprintf(stderr, "texture: %s not supported\n", gTextureFormats[f]);
+            continue;
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        report("texture", gTextureFormats[f], "nearest",
+                measureDraws(program), "Mpix/s");
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        report("texture", gTextureFormats[f], "linear",
+                measureDraws(program), "Mpix/s");
+        glDeleteTextures(1, &texture);
+    }
+    glDeleteProgram(program);
+}
+
+// ---------------------------------------------------------------------------
+
+static void runShader(const uint8_t* rgb)
+{
+    GLuint texture = createTexture("RGBA8888", rgb);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    setupQuad();
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    for (size_t i=0 ; i<gFragmentTestCount ; i++) {
+        GLuint program = createProgram(gVertexShader, gFragmentTests[i]->txt);
+        if (!program) {
+            continue;
+        }
+        char config[16];
+        snprintf(config, sizeof(config), "%d", gFragmentTests[i]->texCount);
+        report("shader", gFragmentTests[i]->name, config,
+                measureDraws(program), "Mpix/s");
+        glDeleteProgram(program);
+    }
+    glDisable(GL_BLEND);
+    glDeleteTextures(1, &texture);
+}
+
+// ---------------------------------------------------------------------------
+
+static void runOverdraw(const uint8_t* rgb)
+{
+    GLuint program = createProgram(gVertexShader, gTextureShader);
+    GLuint texture = createTexture("RGBA8888", rgb);
+    if (!program || !texture) {
+        return;
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    setupQuad();
+    eglSwapInterval(gDisplay, 0);
+
+    for (int layers=1 ; layers<=gMaxLayers ; layers++) {
+        // the bottom layer is opaque, the ones above it translucent and
+        // premultiplied, like most windows over a wallpaper
+        uint64_t start = 0;
+        for (int frame=-1 ; frame<gFrames ; frame++) {
+            if (frame == 0) {
+                glFinish();
+                start = getTime();
+            }
+            glDisable(GL_BLEND);
+            setColor(program, 1, 1, 1, 1);
+            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+            for (int l=1 ; l<layers ; l++) {
+                setColor(program, 0.5f, 0.5f, 0.5f, 0.5f);
+                glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+            }
+            eglSwapBuffers(gDisplay, gSurface);
+        }
+        glFinish();
+        const double ms = (getTime() - start) / 1e6 / gFrames;
+        char config[16];
+        snprintf(config, sizeof(config), "%d", layers);
+        report("overdraw", "layers", config, ms, "ms/frame");
+    }
+    glDisable(GL_BLEND);
+    eglSwapInterval(gDisplay, 1);
+    glDeleteTextures(1, &texture);
+    glDeleteProgram(program);
+}
+
+// ---------------------------------------------------------------------------
+
+static void runSwap()
+{
+    for (int interval=0 ; interval<=1 ; interval++) {
+        eglSwapInterval(gDisplay, interval);
+        uint64_t total = 0, longest = 0;
+        for (int frame=-1 ; frame<gFrames ; frame++) {
+            glClearColor((frame & 1) ? 1 : 0, 0, 0, 1);
+            glClear(GL_COLOR_BUFFER_BIT);
+            const uint64_t start = getTime();
+            eglSwapBuffers(gDisplay, gSurface);
+            const uint64_t duration = getTime() - start;
+            if (frame >= 0) {
+                total += duration;
+                if (duration > longest)
+                    longest = duration;
+            }
+        }
+        const char* config = interval ? "interval1" : "interval0";
+        report("swap", "eglSwapBuffers", config, total / 1e3 / gFrames, "us-avg");
+        report("swap", "eglSwapBuffers", config, longest / 1e3, "us-max");
+    }
+    eglSwapInterval(gDisplay, 1);
+}
+
+// ---------------------------------------------------------------------------
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+            "usage: %s [-t suite,...] [-n draws] [-f frames] [-l layers] [-o file]\n"
+            "  -t  suites to run: fill, texture, shader, overdraw, swap (all)\n"
+            "  -n  draws per fill, texture and shader measurement (%d)\n"
+            "  -f  frames per overdraw and swap measurement (%d)\n"
+            "  -l  maximum number of layers of the overdraw suite (%d)\n"
+            "  -o  write the CSV results to file instead of stdout\n",
+            name, gDraws, gFrames, gMaxLayers);
+}
+
+static bool parseSuites(const char* list, uint32_t* suites)
+{
+    *suites = 0;
+    char* copy = strdup(list);
+    char* saveptr;
+    for (char* name = strtok_r(copy, ",", &saveptr); name;
+            name = strtok_r(NULL, ",", &saveptr)) {
+        size_t i;
+        for (i=0 ; i<sizeof(gSuites)/sizeof(gSuites[0]) ; i++) {
+            if (!strcmp(name, gSuites[i].name)) {
+                *suites |= gSuites[i].mask;
+                break;
+            }
+        }
+        if (i == sizeof(gSuites)/sizeof(gSuites[0])) {
+            fprintf(stderr, "unknown suite: %s\n", name);
+            free(copy);
+            return false;
+        }
+    }
+    free(copy);
+    return *suites != 0;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t suites = ~0;
+    const char* outPath = NULL;
+    int c;
+    while ((c = getopt(argc, argv, "t:n:f:l:o:h")) != -1) {
+        switch (c) {
+            case 't':
+                if (!parseSuites(optarg, &suites)) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'n':
+                gDraws = atoi(optarg);
+                break;
+            case 'f':
+                gFrames = atoi(optarg);
+                break;
+            case 'l':
+                gMaxLayers = atoi(optarg);
+                break;
+            case 'o':
+                outPath = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (gDraws <= 0 || gFrames <= 0 || gMaxLayers <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (outPath && (gOut = fopen(outPath, "w")) == NULL) {
+        fprintf(stderr, "couldn't open %s\n", outPath);
+        return 1;
+    }
+
+    EGLint contextAttribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+    EGLint configAttribs[] = {
+            EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+            EGL_NONE };
+    EGLConfig config;
+    EGLint majorVersion, minorVersion;
+
+    gDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (!eglInitialize(gDisplay, &majorVersion, &minorVersion)) {
+        fprintf(stderr, "eglInitialize failed\n");
+        return 1;
+    }
+    EGLNativeWindowType window = android_createDisplaySurface();
+    if (EGLUtils::selectConfigForNativeWindow(gDisplay, configAttribs,
+            window, &config)) {
+        fprintf(stderr, "couldn't find an EGLConfig matching the screen format\n");
+        return 1;
+    }
+    gSurface = eglCreateWindowSurface(gDisplay, config, window, NULL);
+    EGLContext context = eglCreateContext(gDisplay, config, EGL_NO_CONTEXT,
+            contextAttribs);
+    if (gSurface == EGL_NO_SURFACE || context == EGL_NO_CONTEXT ||
+            !eglMakeCurrent(gDisplay, gSurface, gSurface, context)) {
+        fprintf(stderr, "couldn't set up an OpenGL ES 2.0 context\n");
+        return 1;
+    }
+    eglQuerySurface(gDisplay, gSurface, EGL_WIDTH, &gWidth);
+    eglQuerySurface(gDisplay, gSurface, EGL_HEIGHT, &gHeight);
+    glViewport(0, 0, gWidth, gHeight);
+    glDisable(GL_DITHER);
+    setupQuad();
+
+    fprintf(stderr, "%dx%d, %s\n", gWidth, gHeight, glGetString(GL_RENDERER));
+    fprintf(gOut, "suite,test,config,value,unit\n");
+
+    uint8_t* pattern = makePattern();
+    if (suites & SUITE_FILL)        runFill();
+    if (suites & SUITE_TEXTURE)     runTexture(pattern);
+    if (suites & SUITE_SHADER)      runShader(pattern);
+    if (suites & SUITE_OVERDRAW)    runOverdraw(pattern);
+    if (suites & SUITE_SWAP)        runSwap();
+    free(pattern);
+
+    eglTerminate(gDisplay);
+    if (gOut != stdout) {
+        fclose(gOut);
+    }
+    return 0;
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Vertex throughput of the OpenGL ES 1.x implementation: draws batches of
+ * tiny triangles, so that the time goes to fetching, transforming and
+ * setting up vertices rather than filling pixels, with the vertex formats
+ * applications use most.  Run it with debug.egl.hw set to 0 to measure
+ * the software renderer.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <EGL/egl.h>
+#include <GLES/gl.h>
+#include <GLES/glext.h>
+
+#include <utils/Timers.h>
+#include <ui/FramebufferNativeWindow.h>
+#include "EGLUtils.h"
+
+using namespace android;
+
+// vertices per glDrawArrays() call, and calls per measurement
+static const int kVertexCount = 3 * 1024;
+static const int kDrawCount = 64;
+
+struct VertexTest {
+    const char* name;
+    GLint size;
+    GLenum type;
+    bool texture;
+    bool lighting;
+};
+
+static const VertexTest gTests[] = {
+    { "2 x GL_FLOAT",               2, GL_FLOAT,    false,  false },
+    { "3 x GL_FLOAT",               3, GL_FLOAT,    false,  false },
+    { "3 x GL_FIXED",               3, GL_FIXED,    false,  false },
+    { "3 x GL_SHORT",               3, GL_SHORT,    false,  false },
+    { "3 x GL_FLOAT, texcoords",    3, GL_FLOAT,    true,   false },
+    { "3 x GL_FLOAT, lighting",     3, GL_FLOAT,    false,  true  },
+};
+
+static GLfloat gPositions[kVertexCount][3];
+static GLfixed gPositionsx[kVertexCount][3];
+static GLshort gPositionss[kVertexCount][3];
+static GLfloat gTexCoords[kVertexCount][2];
+static GLfloat gNormals[kVertexCount][3];
+
+static void setupVertices(EGLint w, EGLint h)
+{
+    // one-pixel triangles spread over the window
+    for (int i=0 ; i<kVertexCount ; i++) {
+        const int t = i / 3;
+        const int x = (t * 7) % w;
+        const int y = (t * 13) % h;
+        const int corner = i % 3;
+        gPositions[i][0] = x + (corner == 1 ? 1 : 0);
+        gPositions[i][1] = y + (corner == 2 ? 1 : 0);
+        gPositions[i][2] = -0.5f;
+        for (int j=0 ; j<3 ; j++) {
+            gPositionsx[i][j] = GLfixed(gPositions[i][j] * 65536.0f);
+            gPositionss[i][j] = GLshort(gPositions[i][j]);
+        }
+        gTexCoords[i][0] = (corner == 1) ? 1 : 0;
+        gTexCoords[i][1] = (corner == 2) ? 1 : 0;
+        gNormals[i][0] = 0;
+        gNormals[i][1] = 0;
+        gNormals[i][2] = 1;
+    }
+}
+
+static void setupTest(const VertexTest& test)
+{
+    const GLvoid* positions = gPositions;
+    if (test.type == GL_FIXED)
+        positions = gPositionsx;
+    else if (test.type == GL_SHORT)
+        positions = gPositionss;
+
+    // always 3 components apart in memory
+    GLsizei stride = 3 * sizeof(GLfloat);
+    if (test.type == GL_SHORT)
+        stride = 3 * sizeof(GLshort);
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(test.size, test.type, stride, positions);
+
+    if (test.texture) {
+        glEnable(GL_TEXTURE_2D);
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glTexCoordPointer(2, GL_FLOAT, 0, gTexCoords);
+    } else {
+        glDisable(GL_TEXTURE_2D);
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    }
+
+    if (test.lighting) {
+        glEnable(GL_LIGHTING);
+        glEnable(GL_LIGHT0);
+        glEnableClientState(GL_NORMAL_ARRAY);
+        glNormalPointer(GL_FLOAT, 0, gNormals);
+    } else {
+        glDisable(GL_LIGHTING);
+        glDisableClientState(GL_NORMAL_ARRAY);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    EGLint configAttribs[] = {
+         EGL_DEPTH_SIZE, 0,
+         EGL_NONE
+    };
+
+    EGLint majorVersion;
+    EGLint minorVersion;
+    EGLContext context;
+    EGLConfig config;
+    EGLSurface surface;
+    EGLint w, h;
+    EGLDisplay dpy;
+
+    EGLNativeWindowType window = android_createDisplaySurface();
+
+    dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    eglInitialize(dpy, &majorVersion, &minorVersion);
+
+    status_t err = EGLUtils::selectConfigForNativeWindow(
+            dpy, configAttribs, window, &config);
+    if (err) {
+        fprintf(stderr, "couldn't find an EGLConfig matching the screen format\n");
+        return 0;
+    }
+
+    surface = eglCreateWindowSurface(dpy, config, window, NULL);
+    context = eglCreateContext(dpy, config, NULL, NULL);
+    eglMakeCurrent(dpy, surface, surface, context);
+    eglQuerySurface(dpy, surface, EGL_WIDTH, &w);
+    eglQuerySurface(dpy, surface, EGL_HEIGHT, &h);
+    eglSwapInterval(dpy, 0);
+
+    printf("w=%d, h=%d, %s\n", w, h, glGetString(GL_RENDERER));
+
+    setupVertices(w, h);
+
+    const uint16_t texels[4] = { 0xFFFF, 0x001F, 0xF800, 0x07E0 };
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 2, 2, 0,
+            GL_RGB, GL_UNSIGNED_SHORT_5_6_5, texels);
+    glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    // a non-trivial transform, as in most applications
+    glViewport(0, 0, w, h);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glOrthof(0, w, 0, h, 0, 1);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    glTranslatef(0.25f, 0.25f, 0);
+    glDisable(GL_DITHER);
+
+    printf("\nformat, Mvertices/s\n");
+    const size_t testCount = sizeof(gTests) / sizeof(gTests[0]);
+    for (size_t i=0 ; i<testCount ; i++) {
+        setupTest(gTests[i]);
+
+        // warm up, then measure
+        glClear(GL_COLOR_BUFFER_BIT);
+        glDrawArrays(GL_TRIANGLES, 0, kVertexCount);
+        glFinish();
+
+        nsecs_t now = systemTime();
+        for (int j=0 ; j<kDrawCount ; j++) {
+            glDrawArrays(GL_TRIANGLES, 0, kVertexCount);
+        }
+        glFinish();
+        nsecs_t t = systemTime() - now;
+
+        const double mvps = (double(kVertexCount) * kDrawCount * 1000.0) / t;
+        printf("%s, %.2f\n", gTests[i].name, mvps);
+        eglSwapBuffers(dpy, surface);
+    }
+
+    eglTerminate(dpy);
+    return 0;
+}
@@ -0,0 +1,373 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Gralloc benchmark: for every buffer size, pixel format and usage, times
+ * GraphicBufferAllocator::alloc and free, and GraphicBufferMapper::lock and
+ * unlock, and for the usages that can be locked for software access, the
+ * bandwidth of CPU writes into the locked buffer and of reads out of it.
+ *
+ * Latencies are reported as percentiles over all the iterations. The memory
+ * an allocation takes is estimated from how much MemFree drops while all of
+ * a configuration's buffers are alive, which counts ion pages taken from
+ * the system but not carveouts, and is only as precise as the rest of the
+ * system is quiet. The recycling pool of GraphicBufferAllocator is disabled
+ * unless -p is given, so that alloc measures the HAL.
+ *
+ * Results are printed as CSV, one line per measurement, so that runs on
+ * different devices can be compared by scripts.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <utils/String8.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+#include <ui/GraphicBufferAllocator.h>
+#include <ui/GraphicBufferMapper.h>
+#include <ui/PixelFormat.h>
+#include <ui/Rect.h>
+
+using namespace android;
+
+struct Size {
+    uint32_t w;
+    uint32_t h;
+};
+
+struct Format {
+    const char* name;
+    PixelFormat format;
+};
+
+struct Usage {
+    const char* name;
+    int usage;
+};
+
+static const Size kSizes[] = {
+    { 64, 64 },
+    { 256, 256 },
+    { 720, 1280 },
+    { 1080, 1920 },
+    { 2048, 2048 },
+};
+
+static const Format kFormats[] = {
+    { "RGBA_8888", HAL_PIXEL_FORMAT_RGBA_8888 },
+    { "RGBX_8888", HAL_PIXEL_FORMAT_RGBX_8888 },
+    { "RGB_565", HAL_PIXEL_FORMAT_RGB_565 },
+    { "YV12", HAL_PIXEL_FORMAT_YV12 },
+};
+
+static const Usage kUsages[] = {
+    { "sw_often", GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN },
+    { "sw_write_texture", GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_HW_TEXTURE },
+    { "texture", GRALLOC_USAGE_HW_TEXTURE },
+    { "render_texture", GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE },
+    { "composer", GRALLOC_USAGE_HW_COMPOSER | GRALLOC_USAGE_HW_TEXTURE },
+};
+
+#define NELEM(x) (sizeof(x) / sizeof((x)[0]))
+
+struct Options {
+    int iterations;     // allocations, and locks, per configuration
+    int copies;         // passes over the buffer per bandwidth measurement
+    size_t poolBytes;   // size of the allocator's recycling pool
+    const char* format; // only this format, or NULL for all
+    const char* usage;  // only this usage, or NULL for all
+};
+
+static int compareNsecs(const nsecs_t* lhs, const nsecs_t* rhs)
+{
+    return (*lhs > *rhs) - (*lhs < *rhs);
+}
+
+// the p-th percentile (0-100) of sorted samples, in microseconds
+static double percentile(const Vector<nsecs_t>& samples, int p)
+{
+    if (samples.isEmpty()) {
+        return 0;
+    }
+    size_t i = (samples.size() * p) / 100;
+    if (i >= samples.size()) {
+        i = samples.size() - 1;
+    }
+    return samples[i] / 1000.0;
+}
+
+static void printHeader()
+{
+    printf("measurement,width,height,format,usage,stride,bytes,samples,"
+            "p50_us,p90_us,p99_us,max_us,mb_per_sec,kb_per_buffer\n");
+}
+
+static void reportLatency(const char* what, const Size& size,
+        const Format& format, const Usage& usage, int32_t stride,
+        size_t bytes, Vector<nsecs_t>& samples, const char* kbPerBuffer = "")
+{
+    samples.sort(compareNsecs);
+    const size_t n = samples.size();
+    printf("%s,%u,%u,%s,%s,%d,%u,%u,%.2f,%.2f,%.2f,%.2f,,%s\n",
+            what, size.w, size.h, format.name, usage.name, stride, bytes, n,
+            percentile(samples, 50), percentile(samples, 90),
+            percentile(samples, 99), n ? samples[n - 1] / 1000.0 : 0.0,
+            kbPerBuffer);
+}
+
+static void reportBandwidth(const char* what, const Size& size,
+        const Format& format, const Usage& usage, int32_t stride,
+        size_t bytes, int copies, nsecs_t duration)
+{
+    printf("%s,%u,%u,%s,%s,%d,%u,%d,,,,,%.1f,\n",
+            what, size.w, size.h, format.name, usage.name, stride, bytes,
+            copies, duration > 0 ? (double(bytes) * copies * 1000.0) / duration : 0.0);
+}
+
+// the bytes of the buffer's first plane, which is all of it for RGB formats
+static size_t planeBytes(PixelFormat format, uint32_t h, int32_t stride)
+{
+    const ssize_t bpp = bytesPerPixel(format);
+    return bpp > 0 ? size_t(stride) * h * bpp : 0;
+}
+
+// sums the buffer so the reads can't be optimized away
+static uint32_t readBuffer(const void* vaddr, size_t bytes)
+{
+    const uint32_t* p = static_cast<const uint32_t*>(vaddr);
+    const uint32_t* const end = p + bytes / 4;
+    uint32_t sum = 0;
+    while (p < end) {
+        sum += p[0] + p[1] + p[2] + p[3] + p[4] + p[5] + p[6] + p[7];
+        p += 8;
+    }
+    return sum;
+}
+
+static volatile uint32_t gSink;
+
+// MemFree from /proc/meminfo, or -1
+static long readMemFreeKb()
+{
+    FILE* f = fopen("/proc/meminfo", "r");
+    if (f == NULL) {
+        return -1;
+    }
+    char line[128];
+    long kb = -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "MemFree: %ld kB", &kb) == 1) {
+            break;
+        }
+    }
+    fclose(f);
+    return kb;
+}
+
+static bool benchmarkAlloc(const Options& options, const Size& size,
+        const Format& format, const Usage& usage)
+{
+    GraphicBufferAllocator& allocator(GraphicBufferAllocator::get());
+    Vector<nsecs_t> allocs, frees;
+    Vector<buffer_handle_t> handles;
+    int32_t stride = 0;
+    const long memFreeBefore = readMemFreeKb();
+    for (int i=0 ; i<options.iterations ; i++) {
+        buffer_handle_t handle;
+        nsecs_t start = systemTime();
+        status_t err = allocator.alloc(size.w, size.h, format.format,
+                usage.usage, &handle, &stride);
+        allocs.add(systemTime() - start);
+        if (err != NO_ERROR) {
+            // not every HAL supports every combination
+            fprintf(stderr, "alloc %ux%u %s %s failed: %s\n", size.w, size.h,
+                    format.name, usage.name, strerror(-err));
+            for (size_t j=0 ; j<handles.size() ; j++) {
+                allocator.free(handles[j]);
+            }
+            return false;
+        }
+        handles.add(handle);
+    }
+    const long memFreeAfter = readMemFreeKb();
+    String8 kbPerBuffer;
+    if (memFreeBefore >= 0 && memFreeAfter >= 0) {
+        kbPerBuffer.appendFormat("%.1f",
+                double(memFreeBefore - memFreeAfter) / handles.size());
+    }
+
+    for (size_t i=0 ; i<handles.size() ; i++) {
+        nsecs_t start = systemTime();
+        allocator.free(handles[i]);
+        frees.add(systemTime() - start);
+    }
+
+    const size_t bytes = planeBytes(format.format, size.h, stride);
+    reportLatency("alloc", size, format, usage, stride, bytes, allocs,
+            kbPerBuffer.string());
+    reportLatency("free", size, format, usage, stride, bytes, frees);
+    return true;
+}
+
+static void benchmarkLock(const Options& options, const Size& size,
+        const Format& format, const Usage& usage)
+{
+    const int swUsage = usage.usage &
+            (GRALLOC_USAGE_SW_READ_MASK | GRALLOC_USAGE_SW_WRITE_MASK);
+    if (!swUsage) {
+        return;
+    }
+
+    GraphicBufferAllocator& allocator(GraphicBufferAllocator::get());
+    GraphicBufferMapper& mapper(GraphicBufferMapper::get());
+    buffer_handle_t handle;
+    int32_t stride;
+    if (allocator.alloc(size.w, size.h, format.format, usage.usage,
+            &handle, &stride) != NO_ERROR) {
+        return;
+    }
+
+    const Rect bounds(size.w, size.h);
+    const size_t bytes = planeBytes(format.format, size.h, stride);
+    Vector<nsecs_t> locks, unlocks;
+    for (int i=0 ; i<options.iterations ; i++) {
+        void* vaddr;
+        nsecs_t start = systemTime();
+        status_t err = mapper.lock(handle, swUsage, bounds, &vaddr);
+        locks.add(systemTime() - start);
+        if (err != NO_ERROR) {
+            fprintf(stderr, "lock %ux%u %s %s failed: %s\n", size.w, size.h,
+                    format.name, usage.name, strerror(-err));
+            allocator.free(handle);
+            return;
+        }
+        start = systemTime();
+        mapper.unlock(handle);
+        unlocks.add(systemTime() - start);
+    }
+    reportLatency("lock", size, format, usage, stride, bytes, locks);
+    reportLatency("unlock", size, format, usage, stride, bytes, unlocks);
+
+    void* vaddr;
+    if (bytes && mapper.lock(handle, swUsage, bounds, &vaddr) == NO_ERROR) {
+        void* temp = malloc(bytes);
+        memset(temp, 0x55, bytes);
+        if (usage.usage & GRALLOC_USAGE_SW_WRITE_MASK) {
+            nsecs_t start = systemTime();
+            for (int i=0 ; i<options.copies ; i++) {
+                memset(vaddr, i, bytes);
+            }
+            reportBandwidth("cpu_fill", size, format, usage, stride, bytes,
+                    options.copies, systemTime() - start);
+            start = systemTime();
+            for (int i=0 ; i<options.copies ; i++) {
+                memcpy(vaddr, temp, bytes);
+            }
+            reportBandwidth("cpu_copy_in", size, format, usage, stride, bytes,
+                    options.copies, systemTime() - start);
+        }
+        if (usage.usage & GRALLOC_USAGE_SW_READ_MASK) {
+            nsecs_t start = systemTime();
+            uint32_t sum = 0;
+            for (int i=0 ; i<options.copies ; i++) {
+                sum += readBuffer(vaddr, bytes);
+            }
+            gSink = sum;
+            reportBandwidth("cpu_read", size, format, usage, stride, bytes,
+                    options.copies, systemTime() - start);
+            start = systemTime();
+            for (int i=0 ; i<options.copies ; i++) {
+                memcpy(temp, vaddr, bytes);
+            }
+            reportBandwidth("cpu_copy_out", size, format, usage, stride, bytes,
+                    options.copies, systemTime() - start);
+        }
+        free(temp);
+        mapper.unlock(handle);
+    }
+    allocator.free(handle);
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+            "usage: %s [-n iterations] [-c copies] [-p pool_bytes] [-f format]"
+            " [-u usage]\n"
+            "  -n  allocations and locks per configuration (default 100)\n"
+            "  -c  passes over the buffer per bandwidth measurement"
+            " (default 20)\n"
+            "  -p  size of the allocator's recycling pool (default 0)\n"
+            "  -f  only this format, one of", name);
+    for (size_t i=0 ; i<NELEM(kFormats) ; i++) {
+        fprintf(stderr, " %s", kFormats[i].name);
+    }
+    fprintf(stderr, "\n  -u  only this usage, one of");
+    for (size_t i=0 ; i<NELEM(kUsages) ; i++) {
+        fprintf(stderr, " %s", kUsages[i].name);
+    }
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    options.iterations = 100;
+    options.copies = 20;
+    options.poolBytes = 0;
+    options.format = NULL;
+    options.usage = NULL;
+
+    int c;
+    while ((c = getopt(argc, argv, "n:c:p:f:u:")) != -1) {
+        switch (c) {
+            case 'n': options.iterations = atoi(optarg); break;
+            case 'c': options.copies = atoi(optarg); break;
+            case 'p': options.poolBytes = strtoul(optarg, NULL, 0); break;
+            case 'f': options.format = optarg; break;
+            case 'u': options.usage = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (options.iterations < 1 || options.copies < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    GraphicBufferAllocator::get().setRecyclingPoolSize(options.poolBytes);
+
+    printHeader();
+    for (size_t f=0 ; f<NELEM(kFormats) ; f++) {
+        if (options.format && strcmp(options.format, kFormats[f].name)) {
+            continue;
+        }
+        for (size_t u=0 ; u<NELEM(kUsages) ; u++) {
+            if (options.usage && strcmp(options.usage, kUsages[u].name)) {
+                continue;
+            }
+            for (size_t s=0 ; s<NELEM(kSizes) ; s++) {
+                if (benchmarkAlloc(options, kSizes[s], kFormats[f], kUsages[u])) {
+                    benchmarkLock(options, kSizes[s], kFormats[f], kUsages[u]);
+                }
+                fflush(stdout);
+            }
+        }
+    }
+    return 0;
+}
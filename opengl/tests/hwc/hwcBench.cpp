@@ -0,0 +1,293 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Hardware Composer Benchmark
+ *
+ * Synopsis
+ *   hwcBench [options] [graphicFormat] ...
+ *     options:
+ *       -n num - Maximum number of layers (default 8)
+ *       -i num - Prepare/set iterations per configuration (default 60)
+ *       -v - Verbose
+ *
+ *      graphic formats:
+ *        RGBA8888
+ *        RGBX8888
+ *        RGB888
+ *        RGB565
+ *        BGRA8888
+ *        RGBA5551
+ *        RGBA4444
+ *        YV12
+ *
+ * Description
+ *   Measures how long the Hardware Composer (HWC) takes to prepare
+ *   and set layer lists, and which composition type it gives each
+ *   layer, so that HWC implementations can be compared.  The list
+ *   configurations swept are every combination of:
+ *
+ *     - graphic format: the positional parameters, or all known formats
+ *     - blending: none, premult, coverage
+ *     - scaling: 2x upscale, none, 2x downscale
+ *     - number of layers: 1 through the -n option
+ *
+ *   Each configuration is built once and then prepared and set -i
+ *   times; only the first prepare has HWC_GEOMETRY_CHANGED set, as
+ *   happens when Surface Flinger posts frames without changing
+ *   geometry.  One line of results is printed per configuration:
+ *
+ *     format blend scale layers overlays framebuffers
+ *       prepareGeometryUs prepareAvgUs prepareMaxUs setAvgUs setMaxUs
+ *
+ *   followed by "unstable" when the composition types chosen by
+ *   prepare changed between iterations.  Configurations whose graphic
+ *   buffers can't be allocated are reported as skipped.
+ */
+
+#include <cerrno>
+#include <cstdlib>
+#include <libgen.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+#include <ui/FramebufferNativeWindow.h>
+#include <ui/GraphicBuffer.h>
+
+#define LOG_TAG "hwcBenchTest"
+#include <utils/Log.h>
+#include <testUtil.h>
+
+#include <hardware/hwcomposer.h>
+
+#include <glTestLib.h>
+#include "hwcTestLib.h"
+
+using namespace std;
+using namespace android;
+
+// Defaults
+const bool defaultVerbose = false;
+const uint32_t defaultMaxLayers = 8;
+const uint32_t defaultIterations = 60;
+
+// Global Constants
+const struct blendType {
+    const char *desc;
+    uint32_t id;
+} blendType[] = {
+    {"none", HWC_BLENDING_NONE},
+    {"premult", HWC_BLENDING_PREMULT},
+    {"coverage", HWC_BLENDING_COVERAGE},
+};
+const float scaleType[] = {0.5, 1.0, 2.0};
+
+// Defines
+#define MAXCMD               200
+#define CMD_STOP_FRAMEWORK   "stop 2>&1"
+#define CMD_START_FRAMEWORK  "start 2>&1"
+
+// Macros
+#define NUMA(a) (sizeof(a) / sizeof(a [0])) // Num elements in an array
+
+// Globals
+static hwc_composer_device_1_t *hwcDevice;
+static EGLDisplay dpy;
+static EGLSurface surface;
+static EGLint width, height;
+
+// Function prototypes
+void init(void);
+void printSyntax(const char *cmd);
+
+// Command-line option settings
+static bool verbose = defaultVerbose;
+static uint32_t maxLayers = defaultMaxLayers;
+static uint32_t iterations = defaultIterations;
+
+/*
+ * Main
+ *
+ * Performs the following high-level sequence of operations:
+ *
+ *   1. Command-line parsing
+ *
+ *   2. Form a list of command-line specified graphic formats.  If
+ *      no formats are specified, then form a list of all known formats.
+ *
+ *   3. Stop framework, so that Surface Flinger stops using the HWC
+ *
+ *   4. Initialization
+ *
+ *   5. Measure and report each configuration
+ *
+ *   6. Start framework
+ */
+int
+main(int argc, char *argv[])
+{
+    int     rv, opt;
+    char   *chptr;
+    char cmd[MAXCMD];
+    vector<const struct hwcTestGraphicFormat *> formats;
+
+    testSetLogCatTag(LOG_TAG);
+
+    // Parse command line arguments
+    while ((opt = getopt(argc, argv, "n:i:v?h")) != -1) {
+        switch (opt) {
+          case 'n': // Maximum number of layers
+            maxLayers = strtoul(optarg, &chptr, 10);
+            if ((*chptr != '\0') || (maxLayers == 0)) {
+                testPrintE("Invalid command-line specified maximum number "
+                           "of layers of: %s", optarg);
+                exit(1);
+            }
+            break;
+
+          case 'i': // Iterations per configuration
+            iterations = strtoul(optarg, &chptr, 10);
+            if ((*chptr != '\0') || (iterations == 0)) {
+                testPrintE("Invalid command-line specified number of "
+                           "iterations of: %s", optarg);
+                exit(2);
+            }
+            break;
+
+          case 'v': // Verbose
+            verbose = true;
+            break;
+
+          case 'h': // Help
+          case '?':
+          default:
+            printSyntax(basename(argv[0]));
+            exit(((optopt == 0) || (optopt == '?')) ? 0 : 3);
+        }
+    }
+
+    // Positional parameters name the graphic formats to measure
+    if (optind == argc) {
+        for (unsigned int n1 = 0; n1 < NUMA(hwcTestGraphicFormat); n1++) {
+            formats.push_back(&hwcTestGraphicFormat[n1]);
+        }
+    } else {
+        for (; argv[optind] != NULL; optind++) {
+            const struct hwcTestGraphicFormat *format;
+            format = hwcTestGraphicFormatLookup(argv[optind]);
+            if (format == NULL) {
+                testPrintE("Unknown graphic format of: %s", argv[optind]);
+                exit(4);
+            }
+            formats.push_back(format);
+        }
+    }
+
+    // Stop framework
+    rv = snprintf(cmd, sizeof(cmd), "%s", CMD_STOP_FRAMEWORK);
+    if (rv >= (signed) sizeof(cmd) - 1) {
+        testPrintE("Command too long for: %s", CMD_STOP_FRAMEWORK);
+        exit(5);
+    }
+    testExecCmd(cmd);
+    testDelay(1.0); // TODO - needs means to query whether asynchronous stop
+                    // framework operation has completed.  For now, just wait
+                    // a long time.
+
+    init();
+
+    testPrintI("display: %ix%i iterations: %u", width, height, iterations);
+    testPrintI("format blend scale layers overlays framebuffers "
+               "prepareGeometryUs prepareAvgUs prepareMaxUs "
+               "setAvgUs setMaxUs");
+    for (vector<const struct hwcTestGraphicFormat *>::iterator it
+             = formats.begin(); it != formats.end(); ++it) {
+        for (unsigned int blend = 0; blend < NUMA(blendType); blend++) {
+            for (unsigned int scale = 0; scale < NUMA(scaleType); scale++) {
+                for (uint32_t layers = 1; layers <= maxLayers; layers++) {
+                    struct hwcTestBenchConfig config;
+                    struct hwcTestBenchResult result;
+
+                    config.numLayers = layers;
+                    config.format = (*it)->format;
+                    config.blend = blendType[blend].id;
+                    config.scale = scaleType[scale];
+                    if (!hwcTestBenchmark(hwcDevice, dpy, surface,
+                                          width, height, config,
+                                          iterations, &result)) {
+                        testPrintI("%s %s %.1f %u skipped", (*it)->desc,
+                                   blendType[blend].desc, config.scale,
+                                   layers);
+                        continue;
+                    }
+                    testPrintI("%s %s %.1f %u %u %u "
+                               "%llu %llu %llu %llu %llu%s",
+                               (*it)->desc, blendType[blend].desc,
+                               config.scale, layers,
+                               result.numOverlay, result.numFramebuffer,
+                               result.prepareGeometry / 1000,
+                               result.prepareAvg / 1000,
+                               result.prepareMax / 1000,
+                               result.setAvg / 1000,
+                               result.setMax / 1000,
+                               result.unstable ? " unstable" : "");
+                }
+            }
+        }
+    }
+
+    // Start framework
+    rv = snprintf(cmd, sizeof(cmd), "%s", CMD_START_FRAMEWORK);
+    if (rv >= (signed) sizeof(cmd) - 1) {
+        testPrintE("Command too long for: %s", CMD_START_FRAMEWORK);
+        exit(6);
+    }
+    testExecCmd(cmd);
+
+    return 0;
+}
+
+void init(void)
+{
+    srand48(0);
+
+    hwcTestInitDisplay(verbose, &dpy, &surface, &width, &height);
+
+    hwcTestOpenHwc(&hwcDevice);
+}
+
+void printSyntax(const char *cmd)
+{
+    testPrintE("  %s [options] [graphicFormat] ...",
+               cmd);
+    testPrintE("    options:");
+    testPrintE("      -n num - Maximum number of layers");
+    testPrintE("      -i num - Prepare/set iterations per configuration");
+    testPrintE("      -v - Verbose");
+    testPrintE("");
+    testPrintE("    graphic formats:");
+    for (unsigned int n1 = 0; n1 < NUMA(hwcTestGraphicFormat); n1++) {
+        testPrintE("      %s", hwcTestGraphicFormat[n1].desc);
+    }
+}
@@ -20,8 +20,15 @@
  * Utility library functions for use by the Hardware Composer test cases
  */
 
+#include <algorithm>
+#include <cmath>
 #include <sstream>
 #include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <arpa/inet.h> // For ntohl() and htonl()
 
@@ -538,6 +545,158 @@ void hwcTestDisplayListHandles(hwc_display_contents_1_t *list)
     testPrintI("%s", str.str().c_str());
 }
 
+// Monotonic time in nanoseconds, for the benchmark measurements
+static uint64_t benchNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Round value up to a multiple of mod, with a minimum of mod
+static uint32_t benchRoundUp(float value, uint32_t mod)
+{
+    uint32_t rv = (uint32_t) ceilf(value);
+
+    rv = ((rv + mod - 1) / mod) * mod;
+    return (rv < mod) ? mod : rv;
+}
+
+/*
+ * Benchmark
+ *
+ * Builds the layer list described by config, then performs iterations
+ * worth of prepare and set operations on it, timing each of them and
+ * counting the composition types chosen by prepare.  Returns false
+ * when the configuration can't be set up, for example because its
+ * graphic buffers can't be allocated.
+ */
+bool hwcTestBenchmark(hwc_composer_device_1_t *hwcDevice, EGLDisplay dpy,
+                      EGLSurface surface, EGLint width, EGLint height,
+                      const struct hwcTestBenchConfig& config,
+                      uint32_t iterations, struct hwcTestBenchResult *result)
+{
+    static const int texUsage = GraphicBuffer::USAGE_HW_TEXTURE |
+            GraphicBuffer::USAGE_SW_WRITE_RARELY;
+    const struct hwcTestGraphicFormat *format;
+    vector<sp<GraphicBuffer> > buffers;
+    vector<int32_t> firstTypes;
+    hwc_display_contents_1_t *list;
+
+    memset(result, 0, sizeof(*result));
+    if ((config.numLayers == 0) || (iterations == 0)
+        || ((format = hwcTestGraphicFormatLookup(config.format)) == NULL)) {
+        return false;
+    }
+    if ((list = hwcTestCreateLayerList(config.numLayers)) == NULL) {
+        testPrintE("hwcTestBenchmark create list failed");
+        return false;
+    }
+
+    // Display frames are half the display, stepping diagonally
+    // across the other half
+    const uint32_t frameW = width / 2, frameH = height / 2;
+    HwcTestDim sourceDim(
+        benchRoundUp(frameW * config.scale, format->wMod),
+        benchRoundUp(frameH * config.scale, format->hMod));
+    const float alpha = (config.blend == HWC_BLENDING_NONE) ? 1.0 : 0.5;
+    for (uint32_t n1 = 0; n1 < config.numLayers; n1++) {
+        hwc_layer_1_t *layer = &list->hwLayers[n1];
+        sp<GraphicBuffer> texture = new GraphicBuffer(sourceDim.width(),
+            sourceDim.height(), config.format, texUsage);
+        if ((texture == NULL) || (texture->initCheck() != NO_ERROR)) {
+            testPrintE("hwcTestBenchmark allocate %s %s failed",
+                       format->desc, ((string) sourceDim).c_str());
+            hwcTestFreeLayerList(list);
+            return false;
+        }
+        hwcTestFillColor(texture.get(),
+                         ColorFract((n1 % 3) == 0, (n1 % 3) == 1,
+                                    (n1 % 3) == 2), alpha);
+        buffers.push_back(texture);
+
+        const uint32_t offsetX = n1 * frameW / config.numLayers;
+        const uint32_t offsetY = n1 * frameH / config.numLayers;
+        layer->handle = texture->handle;
+        layer->blending = config.blend;
+        layer->transform = 0;
+        layer->sourceCrop = sourceDim;
+        layer->displayFrame.left = offsetX;
+        layer->displayFrame.top = offsetY;
+        layer->displayFrame.right = offsetX + frameW;
+        layer->displayFrame.bottom = offsetY + frameH;
+        layer->visibleRegionScreen.numRects = 1;
+        layer->visibleRegionScreen.rects = &layer->displayFrame;
+        layer->acquireFenceFd = -1;
+        layer->releaseFenceFd = -1;
+    }
+    list->retireFenceFd = -1;
+
+    uint64_t prepareTotal = 0, setTotal = 0;
+    result->iterations = iterations;
+    result->prepareMin = result->setMin = ~(uint64_t) 0;
+    for (uint32_t iter = 0; iter < iterations; iter++) {
+        // Prepare, with only the first iteration changing geometry
+        list->flags = (iter == 0) ? HWC_GEOMETRY_CHANGED : 0;
+        for (uint32_t n1 = 0; n1 < config.numLayers; n1++) {
+            list->hwLayers[n1].compositionType = HWC_FRAMEBUFFER;
+            list->hwLayers[n1].hints = 0;
+            list->hwLayers[n1].flags = 0;
+        }
+        uint64_t start = benchNow();
+        hwcDevice->prepare(hwcDevice, 1, &list);
+        uint64_t duration = benchNow() - start;
+        if (iter == 0) {
+            result->prepareGeometry = duration;
+        }
+        if ((iter != 0) || (iterations == 1)) {
+            prepareTotal += duration;
+            result->prepareMin = min(result->prepareMin, duration);
+            result->prepareMax = max(result->prepareMax, duration);
+        }
+
+        // Composition type decisions
+        result->numOverlay = result->numFramebuffer = 0;
+        for (uint32_t n1 = 0; n1 < config.numLayers; n1++) {
+            int32_t type = list->hwLayers[n1].compositionType;
+            if (type == HWC_OVERLAY) { result->numOverlay++; }
+            if (type == HWC_FRAMEBUFFER) { result->numFramebuffer++; }
+            if (iter == 0) {
+                firstTypes.push_back(type);
+            } else if (firstTypes[n1] != type) {
+                result->unstable = true;
+            }
+        }
+
+        // Set
+        list->dpy = dpy;
+        list->sur = surface;
+        start = benchNow();
+        hwcDevice->set(hwcDevice, 1, &list);
+        duration = benchNow() - start;
+        setTotal += duration;
+        result->setMin = min(result->setMin, duration);
+        result->setMax = max(result->setMax, duration);
+
+        for (uint32_t n1 = 0; n1 < config.numLayers; n1++) {
+            if (list->hwLayers[n1].releaseFenceFd >= 0) {
+                close(list->hwLayers[n1].releaseFenceFd);
+                list->hwLayers[n1].releaseFenceFd = -1;
+            }
+        }
+        if (list->retireFenceFd >= 0) {
+            close(list->retireFenceFd);
+            list->retireFenceFd = -1;
+        }
+    }
+    result->prepareAvg = prepareTotal / ((iterations > 1) ? iterations - 1 : 1);
+    result->setAvg = setTotal / iterations;
+
+    hwcTestFreeLayerList(list);
+    return true;
+}
+
 // Returns a uint32_t that contains a format specific representation of a
 // single pixel of the given color and alpha values.
 uint32_t hwcTestColor2Pixel(uint32_t format, ColorFract color, float alpha)
@@ -104,6 +104,30 @@ class HwcTestDim {
     uint32_t _h;
 };
 
+// Benchmark configuration: numLayers layers of the given format and
+// blending, stacked diagonally so that they partially overlap.  Each
+// display frame is half the display in each direction and shows a
+// source buffer scale times its size (0.5 is a 2x upscale).
+struct hwcTestBenchConfig {
+    uint32_t numLayers;
+    uint32_t format;
+    uint32_t blend;
+    float    scale;
+};
+
+// Benchmark measurements for one configuration, times in nanoseconds.
+// Iteration 0 is prepared with HWC_GEOMETRY_CHANGED set and reported on
+// its own; the prepare statistics cover the iterations after it.
+struct hwcTestBenchResult {
+    uint32_t iterations;
+    uint64_t prepareGeometry;
+    uint64_t prepareMin, prepareAvg, prepareMax;
+    uint64_t setMin, setAvg, setMax;
+    uint32_t numOverlay;     // layers marked HWC_OVERLAY by the last prepare
+    uint32_t numFramebuffer; // layers left to HWC_FRAMEBUFFER
+    bool     unstable;       // composition types changed between prepares
+};
+
 // Function Prototypes
 void hwcTestInitDisplay(bool verbose, EGLDisplay *dpy, EGLSurface *surface,
     EGLint *width, EGLint *height);
@@ -119,6 +143,11 @@ void hwcTestDisplayList(hwc_display_contents_1_t *list);
 void hwcTestDisplayListPrepareModifiable(hwc_display_contents_1_t *list);
 void hwcTestDisplayListHandles(hwc_display_contents_1_t *list);
 
+bool hwcTestBenchmark(hwc_composer_device_1_t *hwcDevice, EGLDisplay dpy,
+                      EGLSurface surface, EGLint width, EGLint height,
+                      const struct hwcTestBenchConfig& config,
+                      uint32_t iterations, struct hwcTestBenchResult *result);
+
 uint32_t hwcTestColor2Pixel(uint32_t format, ColorFract color, float alpha);
 void hwcTestColorConvert(uint32_t fromFormat, uint32_t toFormat,
                   ColorFract& color);
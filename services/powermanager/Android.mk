@@ -2,7 +2,8 @@ LOCAL_PATH:= $(call my-dir)
 include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES:= \
-	IPowerManager.cpp
+	IPowerManager.cpp \
+	WakeLockProxy.cpp
 
 LOCAL_SHARED_LIBRARIES := \
 	libutils \
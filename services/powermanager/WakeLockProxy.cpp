@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "WakeLockProxy"
+//#define LOG_NDEBUG 0
+#include <utils/Log.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include <utils/String8.h>
+
+#include <binder/Binder.h>
+#include <binder/IServiceManager.h>
+
+#include <powermanager/WakeLockProxy.h>
+
+namespace android {
+
+ANDROID_SINGLETON_STATIC_INSTANCE( WakeLockProxy )
+
+// ----------------------------------------------------------------------------
+
+WakeLockProxy::WakeLockProxy()
+    : mReleaseDelay(DEFAULT_RELEASE_DELAY)
+{
+}
+
+WakeLockProxy::~WakeLockProxy()
+{
+}
+
+sp<IPowerManager> WakeLockProxy::getPowerManagerLocked()
+{
+    if (mPowerManager == NULL) {
+        sp<IBinder> binder =
+                defaultServiceManager()->checkService(String16("power"));
+        if (binder == NULL) {
+            ALOGW("power manager service not published yet");
+        } else {
+            mPowerManager = interface_cast<IPowerManager>(binder);
+        }
+    }
+    return mPowerManager;
+}
+
+status_t WakeLockProxy::acquire(const String16& tag, int flags)
+{
+    Mutex::Autolock _l(mLock);
+    ssize_t index = mWakeLocks.indexOfKey(tag);
+    if (index < 0) {
+        index = mWakeLocks.add(tag, WakeLock());
+    }
+    WakeLock& lock(mWakeLocks.editValueAt(index));
+    lock.count++;
+    lock.releaseTime = 0;
+    if (lock.token != NULL) {
+        // still held, possibly waiting for its deferred release
+        return NO_ERROR;
+    }
+
+    sp<IPowerManager> pm(getPowerManagerLocked());
+    if (pm == NULL) {
+        lock.count--;
+        return NO_INIT;
+    }
+    sp<IBinder> token = new BBinder();
+    status_t err = pm->acquireWakeLock(flags, token, tag, true);
+    if (err != NO_ERROR) {
+        ALOGE("acquireWakeLock(%s) failed (%s)",
+                String8(tag).string(), strerror(-err));
+        // the service may have died, look it up again next time
+        mPowerManager.clear();
+        lock.count--;
+        return err;
+    }
+    ALOGV("acquired wake lock %s", String8(tag).string());
+    lock.token = token;
+    lock.flags = flags;
+    return NO_ERROR;
+}
+
+status_t WakeLockProxy::release(const String16& tag)
+{
+    Mutex::Autolock _l(mLock);
+    ssize_t index = mWakeLocks.indexOfKey(tag);
+    if (index < 0 || mWakeLocks.valueAt(index).count == 0) {
+        ALOGE("release(%s) of a wake lock that isn't acquired",
+                String8(tag).string());
+        return INVALID_OPERATION;
+    }
+    WakeLock& lock(mWakeLocks.editValueAt(index));
+    if (--lock.count > 0) {
+        return NO_ERROR;
+    }
+
+    if (mReleaseDelay <= 0) {
+        releaseLocked(lock);
+        mWakeLocks.removeItemsAt(index);
+        return NO_ERROR;
+    }
+    lock.releaseTime = systemTime() + mReleaseDelay;
+    if (mReleaseThread == NULL) {
+        mReleaseThread = new ReleaseThread(*this);
+        mReleaseThread->run("WakeLockProxy");
+    }
+    mCondition.signal();
+    return NO_ERROR;
+}
+
+void WakeLockProxy::setReleaseDelay(nsecs_t delay)
+{
+    Mutex::Autolock _l(mLock);
+    mReleaseDelay = delay;
+    // the pending releases happen no later than the new delay says
+    const nsecs_t latest = systemTime() + delay;
+    for (size_t i=0 ; i<mWakeLocks.size() ; i++) {
+        WakeLock& lock(mWakeLocks.editValueAt(i));
+        if (lock.releaseTime > latest) {
+            lock.releaseTime = latest;
+        }
+    }
+    mCondition.signal();
+}
+
+void WakeLockProxy::releaseLocked(WakeLock& lock)
+{
+    lock.releaseTime = 0;
+    if (lock.token == NULL) {
+        return;
+    }
+    sp<IPowerManager> pm(getPowerManagerLocked());
+    if (pm != NULL) {
+        status_t err = pm->releaseWakeLock(lock.token, 0, true);
+        if (err != NO_ERROR) {
+            // the power manager releases the locks of dead tokens itself
+            ALOGE("releaseWakeLock failed (%s)", strerror(-err));
+            mPowerManager.clear();
+        }
+    }
+    lock.token.clear();
+}
+
+nsecs_t WakeLockProxy::releaseExpiredLocked(nsecs_t now)
+{
+    nsecs_t next = 0;
+    for (size_t i=0 ; i<mWakeLocks.size() ; ) {
+        WakeLock& lock(mWakeLocks.editValueAt(i));
+        if (lock.count == 0 && lock.releaseTime) {
+            if (lock.releaseTime <= now) {
+                releaseLocked(lock);
+            } else if (!next || lock.releaseTime < next) {
+                next = lock.releaseTime;
+            }
+        }
+        if (lock.count == 0 && lock.token == NULL) {
+            ALOGV("released wake lock %s",
+                    String8(mWakeLocks.keyAt(i)).string());
+            mWakeLocks.removeItemsAt(i);
+        } else {
+            i++;
+        }
+    }
+    return next;
+}
+
+bool WakeLockProxy::ReleaseThread::threadLoop()
+{
+    Mutex::Autolock _l(mProxy.mLock);
+    const nsecs_t next = mProxy.releaseExpiredLocked(systemTime());
+    if (next) {
+        mProxy.mCondition.waitRelative(mProxy.mLock, next - systemTime());
+    } else {
+        mProxy.mCondition.wait(mProxy.mLock);
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+
+}; // namespace android
@@ -14,6 +14,7 @@ LOCAL_SRC_FILES:= \
     SensorFusion.cpp \
     SensorInterface.cpp \
     SensorService.cpp \
+    SensorTrace.cpp \
 
 # Legacy virtual sensors used in combination from accelerometer & magnetometer.
 LOCAL_SRC_FILES += \
@@ -28,11 +29,14 @@ LOCAL_CFLAGS:= -DLOG_TAG=\"SensorService\"
 LOCAL_SHARED_LIBRARIES := \
 	libcutils \
 	libhardware \
+	libhardware_legacy \
 	libutils \
 	libbinder \
 	libui \
 	libgui
 
+LOCAL_STATIC_LIBRARIES := libcpustats
+
 ifneq ($(BOARD_USE_LEGACY_SENSORS_FUSION),false)
     LOCAL_CFLAGS += -DUSE_LEGACY_SENSORS_FUSION
 endif
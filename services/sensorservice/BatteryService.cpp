@@ -21,6 +21,8 @@
 #include <utils/Atomic.h>
 #include <utils/Errors.h>
 #include <utils/Singleton.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
 
 #include <binder/BinderService.h>
 #include <binder/Parcel.h>
@@ -30,34 +32,38 @@
 namespace android {
 // ---------------------------------------------------------------------------
 
-BatteryService::BatteryService() {
+// enables and disables closer than this are reported together, and the
+// ones that cancel out aren't reported at all
+static const nsecs_t NOTIFY_DEBOUNCE = ms2ns(100);
+
+BatteryService::BatteryService() : mUpdatePending(false) {
     const sp<IServiceManager> sm(defaultServiceManager());
     if (sm != NULL) {
         const String16 name("batteryinfo");
         mBatteryStatService = sm->getService(name);
     }
+    if (mBatteryStatService != 0) {
+        mNotifier = new Notifier(*this);
+        mNotifier->run("BatteryService", PRIORITY_BACKGROUND);
+    }
 }
 
 status_t BatteryService::noteStartSensor(int uid, int handle) {
-    Parcel data, reply;
+    Parcel data;
     data.writeInterfaceToken(DESCRIPTOR);
     data.writeInt32(uid);
     data.writeInt32(handle);
-    status_t err = mBatteryStatService->transact(
-            TRANSACTION_noteStartSensor, data, &reply, 0);
-    err = reply.readExceptionCode();
-    return err;
+    return mBatteryStatService->transact(
+            TRANSACTION_noteStartSensor, data, NULL, IBinder::FLAG_ONEWAY);
 }
 
 status_t BatteryService::noteStopSensor(int uid, int handle) {
-    Parcel data, reply;
+    Parcel data;
     data.writeInterfaceToken(DESCRIPTOR);
     data.writeInt32(uid);
     data.writeInt32(handle);
-    status_t err = mBatteryStatService->transact(
-            TRANSACTION_noteStopSensor, data, &reply, 0);
-    err = reply.readExceptionCode();
-    return err;
+    return mBatteryStatService->transact(
+            TRANSACTION_noteStopSensor, data, NULL, IBinder::FLAG_ONEWAY);
 }
 
 bool BatteryService::addSensor(uid_t uid, int handle) {
@@ -69,7 +75,11 @@ bool BatteryService::addSensor(uid_t uid, int handle) {
     }
     Info& info(mActivations.editItemAt(index));
     info.count++;
-    return info.count == 1;
+    if (info.count == 1) {
+        requestUpdateLocked();
+        return true;
+    }
+    return false;
 }
 
 bool BatteryService::removeSensor(uid_t uid, int handle) {
@@ -78,42 +88,83 @@ bool BatteryService::removeSensor(uid_t uid, int handle) {
     if (index < 0) return false;
     Info& info(mActivations.editItemAt(index));
     info.count--;
-    return info.count == 0;
+    if (info.count == 0) {
+        requestUpdateLocked();
+        return true;
+    }
+    return false;
+}
+
+void BatteryService::requestUpdateLocked() {
+    if (!mUpdatePending) {
+        mUpdatePending = true;
+        mUpdateCondition.signal();
+    }
 }
 
+bool BatteryService::notifyLoop() {
+    // what the battery stats service must be told, as the new state
+    Vector<Info> notes;
+    { // scope for the lock
+        Mutex::Autolock _l(mActivationsLock);
+        while (!mUpdatePending) {
+            mUpdateCondition.wait(mActivationsLock);
+        }
+
+        // let a burst of enables and disables settle
+        const nsecs_t deadline = systemTime() + NOTIFY_DEBOUNCE;
+        for (nsecs_t now = systemTime() ; now < deadline ; now = systemTime()) {
+            mUpdateCondition.waitRelative(mActivationsLock, deadline - now);
+        }
+        mUpdatePending = false;
+
+        for (size_t i=0 ; i<mActivations.size() ; ) {
+            Info& info(mActivations.editItemAt(i));
+            const bool active = info.count > 0;
+            if (active != info.reported) {
+                info.reported = active;
+                notes.add(info);
+            }
+            if (!active) {
+                mActivations.removeAt(i);
+            } else {
+                i++;
+            }
+        }
+    }
+
+    for (size_t i=0 ; i<notes.size() ; i++) {
+        const Info& note(notes[i]);
+        if (note.reported) {
+            noteStartSensor(note.uid, note.handle);
+        } else {
+            noteStopSensor(note.uid, note.handle);
+        }
+    }
+    return true;
+}
 
 void BatteryService::enableSensorImpl(uid_t uid, int handle) {
     if (mBatteryStatService != 0) {
-        if (addSensor(uid, handle)) {
-            int64_t identity = IPCThreadState::self()->clearCallingIdentity();
-            noteStartSensor(uid, handle);
-            IPCThreadState::self()->restoreCallingIdentity(identity);
-        }
+        addSensor(uid, handle);
     }
 }
 void BatteryService::disableSensorImpl(uid_t uid, int handle) {
     if (mBatteryStatService != 0) {
-        if (removeSensor(uid, handle)) {
-            int64_t identity = IPCThreadState::self()->clearCallingIdentity();
-            noteStopSensor(uid, handle);
-            IPCThreadState::self()->restoreCallingIdentity(identity);
-        }
+        removeSensor(uid, handle);
     }
 }
 
 void BatteryService::cleanupImpl(uid_t uid) {
     if (mBatteryStatService != 0) {
         Mutex::Autolock _l(mActivationsLock);
-        int64_t identity = IPCThreadState::self()->clearCallingIdentity();
-        for (ssize_t i=0 ; i<mActivations.size() ; i++) {
-            const Info& info(mActivations[i]);
+        for (size_t i=0 ; i<mActivations.size() ; i++) {
+            Info& info(mActivations.editItemAt(i));
             if (info.uid == uid) {
-                noteStopSensor(info.uid, info.handle);
-                mActivations.removeAt(i);
-                i--;
+                info.count = 0;
+                requestUpdateLocked();
             }
         }
-        IPCThreadState::self()->restoreCallingIdentity(identity);
     }
 }
 
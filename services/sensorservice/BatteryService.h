@@ -18,6 +18,8 @@
 #include <sys/types.h>
 
 #include <utils/Singleton.h>
+#include <utils/SortedVector.h>
+#include <utils/threads.h>
 
 namespace android {
 // ---------------------------------------------------------------------------
@@ -30,9 +32,21 @@ class BatteryService : public Singleton<BatteryService> {
     friend class Singleton<BatteryService>;
     sp<IBinder> mBatteryStatService;
 
+    // sends the notes to the battery stats service, so that enabling or
+    // disabling a sensor never waits for it
+    class Notifier : public Thread {
+        BatteryService& mService;
+        virtual bool threadLoop() { return mService.notifyLoop(); }
+    public:
+        Notifier(BatteryService& service) : mService(service) { }
+    };
+    sp<Notifier> mNotifier;
+
     BatteryService();
     status_t noteStartSensor(int uid, int handle);
     status_t noteStopSensor(int uid, int handle);
+    bool notifyLoop();
+    void requestUpdateLocked();
 
     void enableSensorImpl(uid_t uid, int handle);
     void disableSensorImpl(uid_t uid, int handle);
@@ -42,8 +56,11 @@ class BatteryService : public Singleton<BatteryService> {
         uid_t uid;
         int handle;
         int32_t count;
-        Info()  : uid(0), handle(0), count(0) { }
-        Info(uid_t uid, int handle) : uid(uid), handle(handle), count(0) { }
+        // whether the battery stats service was told the sensor started
+        bool reported;
+        Info()  : uid(0), handle(0), count(0), reported(false) { }
+        Info(uid_t uid, int handle)
+            : uid(uid), handle(handle), count(0), reported(false) { }
         bool operator < (const Info& rhs) const {
             return (uid == rhs.uid) ? (handle < rhs.handle) :  (uid < rhs.uid);
         }
@@ -51,6 +68,9 @@ class BatteryService : public Singleton<BatteryService> {
 
     Mutex mActivationsLock;
     SortedVector<Info> mActivations;
+    // protected by mActivationsLock
+    Condition mUpdateCondition;
+    bool mUpdatePending;
     bool addSensor(uid_t uid, int handle);
     bool removeSensor(uid_t uid, int handle);
 
@@ -89,28 +89,6 @@ static const float MIN_VALID_CROSS_PRODUCT_MAG_SQ =
 
 // -----------------------------------------------------------------------
 
-template <typename TYPE, size_t C, size_t R>
-static mat<TYPE, R, R> scaleCovariance(
-        const mat<TYPE, C, R>& A,
-        const mat<TYPE, C, C>& P) {
-    // A*P*transpose(A);
-    mat<TYPE, R, R> APAt;
-    for (size_t r=0 ; r<R ; r++) {
-        for (size_t j=r ; j<R ; j++) {
-            double apat(0);
-            for (size_t c=0 ; c<C ; c++) {
-                double v(A[c][r]*P[c][c]*0.5);
-                for (size_t k=c+1 ; k<C ; k++)
-                    v += A[k][r] * P[c][k];
-                apat += 2 * v * A[c][j];
-            }
-            APAt[j][r] = apat;
-            APAt[r][j] = apat;
-        }
-    }
-    return APAt;
-}
-
 template <typename TYPE, typename OTHER_TYPE>
 static mat<TYPE, 3, 3> crossMatrix(const vec<TYPE, 3>& p, OTHER_TYPE diag) {
     mat<TYPE, 3, 3> r;
@@ -127,6 +105,78 @@ static mat<TYPE, 3, 3> crossMatrix(const vec<TYPE, 3>& p, OTHER_TYPE diag) {
 }
 
 
+/*
+ * 3x3 kernels for predict() and update(), written out so each product
+ * is a straight sequence of multiply-adds into its destination instead of
+ * a temporary per operator. The destination must not alias the operands.
+ * As everywhere in this file, m[c][r] is column c, row r.
+ */
+
+// out = a*b
+static inline void mul33(mat33_t& out, const mat33_t& a, const mat33_t& b) {
+    for (size_t c=0 ; c<3 ; c++) {
+        for (size_t r=0 ; r<3 ; r++) {
+            out[c][r] = a[0][r]*b[c][0] + a[1][r]*b[c][1] + a[2][r]*b[c][2];
+        }
+    }
+}
+
+// out = transpose(a)*b
+static inline void mulTN33(mat33_t& out, const mat33_t& a, const mat33_t& b) {
+    for (size_t c=0 ; c<3 ; c++) {
+        for (size_t r=0 ; r<3 ; r++) {
+            out[c][r] = a[r][0]*b[c][0] + a[r][1]*b[c][1] + a[r][2]*b[c][2];
+        }
+    }
+}
+
+// out += a*transpose(b)
+static inline void mulAddNT33(mat33_t& out, const mat33_t& a, const mat33_t& b) {
+    for (size_t c=0 ; c<3 ; c++) {
+        for (size_t r=0 ; r<3 ; r++) {
+            out[c][r] += a[0][r]*b[0][c] + a[1][r]*b[1][c] + a[2][r]*b[2][c];
+        }
+    }
+}
+
+// out += a*b
+static inline void mulAdd33(mat33_t& out, const mat33_t& a, const mat33_t& b) {
+    for (size_t c=0 ; c<3 ; c++) {
+        for (size_t r=0 ; r<3 ; r++) {
+            out[c][r] += a[0][r]*b[c][0] + a[1][r]*b[c][1] + a[2][r]*b[c][2];
+        }
+    }
+}
+
+// out -= a*b
+static inline void mulSub33(mat33_t& out, const mat33_t& a, const mat33_t& b) {
+    for (size_t c=0 ; c<3 ; c++) {
+        for (size_t r=0 ; r<3 ; r++) {
+            out[c][r] -= a[0][r]*b[c][0] + a[1][r]*b[c][1] + a[2][r]*b[c][2];
+        }
+    }
+}
+
+// out = a*transpose(b)
+static inline void mulNT33(mat33_t& out, const mat33_t& a, const mat33_t& b) {
+    for (size_t c=0 ; c<3 ; c++) {
+        for (size_t r=0 ; r<3 ; r++) {
+            out[c][r] = a[0][r]*b[0][c] + a[1][r]*b[1][c] + a[2][r]*b[2][c];
+        }
+    }
+}
+
+// out = transpose(a)
+static inline void transpose33(mat33_t& out, const mat33_t& a) {
+    for (size_t c=0 ; c<3 ; c++) {
+        for (size_t r=0 ; r<3 ; r++) {
+            out[c][r] = a[r][c];
+        }
+    }
+}
+
+// -----------------------------------------------------------------------
+
 template<typename TYPE, size_t SIZE>
 class Covariance {
     mat<TYPE, SIZE, SIZE> mSumXX;
@@ -387,19 +437,46 @@ void Fusion::predict(const vec3_t& w, float dT) {
     //          - [w]x^2 * (||w||*dT - sin(||w||*dt))/||w||^3
     //          - I33*dT
 
-    const mat33_t I33(1);
-    const mat33_t I33dT(dT);
     const mat33_t wx(crossMatrix(we, 0));
-    const mat33_t wx2(wx*wx);
+    mat33_t wx2;
+    mul33(wx2, wx, wx);
     const float lwedT = length(we)*dT;
     const float ilwe = 1/length(we);
     const float k0 = (1-cosf(lwedT))*(ilwe*ilwe);
     const float k1 = sinf(lwedT);
+    const float k2 = k1*ilwe;
+    const float k3 = (ilwe*ilwe*ilwe)*(lwedT-k1);
+
+    for (size_t c=0 ; c<3 ; c++) {
+        for (size_t r=0 ; r<3 ; r++) {
+            const float i = (c == r) ? 1 : 0;
+            Phi[0][0][c][r] = i    - wx[c][r]*k2 + wx2[c][r]*k0;
+            Phi[1][0][c][r] = wx[c][r]*k0 - i*dT - wx2[c][r]*k3;
+        }
+    }
 
-    Phi[0][0] = I33 - wx*(k1*ilwe) + wx2*k0;
-    Phi[1][0] = wx*k0 - I33dT - wx2*(ilwe*ilwe*ilwe)*(lwedT-k1);
-
-    P = Phi*P*transpose(Phi) + GQGt;
+    // P = Phi*P*transpose(Phi) + GQGt, with the zero and identity blocks
+    // of Phi folded in:
+    //
+    //  P00 = (Phi00*P00 + Phi10*P01)*Phi00' + P10*Phi10'
+    //  P10 =  Phi00*P10 + Phi10*P11
+    //  P11 =  P11
+    //
+    // where the P10 used for P00 is the new one, before the noise.
+    const mat33_t& A(Phi[0][0]);
+    const mat33_t& B(Phi[1][0]);
+    mat33_t N, T;
+    mul33(N, A, P[0][0]);
+    mulAddNT33(N, B, P[1][0]);
+    mul33(T, A, P[1][0]);
+    mulAdd33(T, B, P[1][1]);
+    mulNT33(P[0][0], N, A);
+    mulAddNT33(P[0][0], T, B);
+
+    P[0][0] += GQGt[0][0];
+    P[1][0]  = T + GQGt[1][0];
+    P[1][1] += GQGt[1][1];
+    transpose33(P[0][1], P[1][0]);
 
     checkState();
 }
@@ -414,24 +491,32 @@ void Fusion::update(const vec3_t& z, const vec3_t& Bi, float sigma) {
     // H = [ L 0 ]
     const mat33_t L(crossMatrix(Bb, 0));
 
+    // both the gain and the update only need H*P = [ L*P00  L*P10 ]
+    mat33_t LP00, LP10;
+    mul33(LP00, L, P[0][0]);
+    mul33(LP10, L, P[1][0]);
+
     // gain...
     // K = P*Ht / [H*P*Ht + R]
-    vec<mat33_t, 2> K;
-    const mat33_t R(sigma*sigma);
-    const mat33_t S(scaleCovariance(L, P[0][0]) + R);
+    //
+    // since P00 is symmetric, P00*Lt = transpose(L*P00)
+    mat33_t S;
+    mulNT33(S, LP00, L);
+    const float R = sigma*sigma;
+    S[0][0] += R;
+    S[1][1] += R;
+    S[2][2] += R;
     const mat33_t Si(invert(S));
-    const mat33_t LtSi(transpose(L)*Si);
-    K[0] = P[0][0] * LtSi;
-    K[1] = transpose(P[1][0])*LtSi;
+    vec<mat33_t, 2> K;
+    mulTN33(K[0], LP00, Si);
+    mulTN33(K[1], LP10, Si);
 
     // update...
     // P -= K*H*P;
-    const mat33_t K0L(K[0] * L);
-    const mat33_t K1L(K[1] * L);
-    P[0][0] -= K0L*P[0][0];
-    P[1][1] -= K1L*P[1][0];
-    P[1][0] -= K0L*P[1][0];
-    P[0][1] = transpose(P[1][0]);
+    mulSub33(P[0][0], K[0], LP00);
+    mulSub33(P[1][1], K[1], LP10);
+    mulSub33(P[1][0], K[0], LP10);
+    transpose33(P[0][1], P[1][0]);
 
     const vec3_t e(z - Bb);
     const vec3_t dq(K[0]*e);
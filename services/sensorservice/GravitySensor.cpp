@@ -44,16 +44,10 @@ GravitySensor::GravitySensor(sensor_t const* list, size_t count)
 bool GravitySensor::process(sensors_event_t* outEvent,
         const sensors_event_t& event)
 {
-    const static double NS2S = 1.0 / 1000000000.0;
     if (event.type == SENSOR_TYPE_ACCELEROMETER) {
-        vec3_t g;
         if (!mSensorFusion.hasEstimate())
             return false;
-        const mat33_t R(mSensorFusion.getRotationMatrix());
-        // FIXME: we need to estimate the length of gravity because
-        // the accelerometer may have a small scaling error. This
-        // translates to an offset in the linear-acceleration sensor.
-        g = R[2] * GRAVITY_EARTH;
+        const vec3_t& g(mSensorFusion.getGravity());
 
         *outEvent = event;
         outEvent->data[0] = g.x;
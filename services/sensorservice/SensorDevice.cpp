@@ -15,9 +15,13 @@
  */
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <math.h>
+#include <unistd.h>
 #include <sys/types.h>
 
+#include <cutils/properties.h>
+
 #include <utils/Atomic.h>
 #include <utils/Errors.h>
 #include <utils/Singleton.h>
@@ -30,6 +34,7 @@
 
 #include "SensorDevice.h"
 #include "SensorService.h"
+#include "SensorTrace.h"
 
 #ifdef SYSFS_LIGHT_SENSOR
 #include <fcntl.h>
@@ -62,9 +67,20 @@ static ssize_t addDummyLightSensor(sensor_t const **list, ssize_t count) {
 }
 #endif
 
+#if defined(SENSORS_DEVICE_API_VERSION_1_0)
+// the batch() and flush() entry points follow the 0.1 ones
+static inline sensors_poll_device_1_t* asDevice1(sensors_poll_device_t* dev) {
+    return reinterpret_cast<sensors_poll_device_1_t*>(dev);
+}
+#endif
+
 SensorDevice::SensorDevice()
     :  mSensorDevice(0),
-       mSensorModule(0)
+       mSensorModule(0),
+       mHasBatching(false),
+       mReplay(0), mReplaySpeed(1),
+       mReplayWallStart(0), mReplayTraceStart(0),
+       mReplayBase(0), mReplayLast(0)
 {
     status_t err = hw_get_module(SENSORS_HARDWARE_MODULE_ID,
             (hw_module_t const**)&mSensorModule);
@@ -79,6 +95,10 @@ SensorDevice::SensorDevice()
                 SENSORS_HARDWARE_MODULE_ID, strerror(-err));
 
         if (mSensorDevice) {
+#if defined(SENSORS_DEVICE_API_VERSION_1_0)
+            mHasBatching = mSensorDevice->common.version >=
+                    SENSORS_DEVICE_API_VERSION_1_0;
+#endif
             sensor_t const* list;
             ssize_t count = mSensorModule->get_sensors_list(mSensorModule, &list);
 #ifdef SYSFS_LIGHT_SENSOR
@@ -92,6 +112,26 @@ SensorDevice::SensorDevice()
             }
         }
     }
+
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("debug.sensors.replay", value, NULL) > 0) {
+        SensorTrace* trace = new SensorTrace();
+        err = trace->open(value);
+        if (err == NO_ERROR && trace->size()) {
+            mReplay = trace;
+            property_get("debug.sensors.replay_speed", value, "1");
+            mReplaySpeed = atof(value);
+            if (mReplaySpeed < 0) {
+                mReplaySpeed = 1;
+            }
+            ALOGI("replaying %u sensor events at %gx",
+                    trace->size(), mReplaySpeed);
+        } else {
+            ALOGE("couldn't open sensor trace %s (%s)", value,
+                    err ? strerror(-err) : "empty");
+            delete trace;
+        }
+    }
 }
 
 void SensorDevice::dump(String8& result, char* buffer, size_t SIZE)
@@ -102,6 +142,11 @@ void SensorDevice::dump(String8& result, char* buffer, size_t SIZE)
 
     snprintf(buffer, SIZE, "%d h/w sensors:\n", int(count));
     result.append(buffer);
+    if (mReplay) {
+        snprintf(buffer, SIZE, "replaying %u recorded events at %gx\n",
+                mReplay->size(), mReplaySpeed);
+        result.append(buffer);
+    }
 
     Mutex::Autolock _l(mLock);
     for (size_t i=0 ; i<size_t(count) ; i++) {
@@ -116,7 +161,8 @@ void SensorDevice::dump(String8& result, char* buffer, size_t SIZE)
                     j<info.rates.size()-1 ? ", " : "");
             result.append(buffer);
         }
-        snprintf(buffer, SIZE, " }, selected=%4.1f ms\n",  info.delay / 1e6f);
+        snprintf(buffer, SIZE, " }, selected=%4.1f ms, latency=%4.1f ms\n",
+                info.delay / 1e6f, info.latency / 1e6f);
         result.append(buffer);
     }
 }
@@ -136,14 +182,61 @@ status_t SensorDevice::initCheck() const {
 }
 
 ssize_t SensorDevice::poll(sensors_event_t* buffer, size_t count) {
+    if (mReplay) return replay(buffer, count);
     if (!mSensorDevice) return NO_INIT;
     ssize_t c;
     do {
         c = mSensorDevice->poll(mSensorDevice, buffer, count);
     } while (c == -EINTR);
+#if defined(SENSORS_DEVICE_API_VERSION_1_0)
+    if (c > 0 && mHasBatching) {
+        // flush completions aren't events of any sensor, drop them
+        ssize_t n = 0;
+        for (ssize_t i=0 ; i<c ; i++) {
+            if (buffer[i].type != SENSOR_TYPE_META_DATA) {
+                buffer[n++] = buffer[i];
+            }
+        }
+        c = n;
+    }
+#endif
     return c;
 }
 
+ssize_t SensorDevice::replay(sensors_event_t* buffer, size_t count) {
+    size_t n = 0;
+    while (n < count) {
+        sensors_event_t const* event = mReplay->peek();
+        if (!event) {
+            if (n) break;
+            // start over, a bit after the last event we returned
+            mReplay->rewind();
+            mReplayWallStart = 0;
+            event = mReplay->peek();
+        }
+        const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        if (!mReplayWallStart) {
+            mReplayWallStart = now;
+            mReplayTraceStart = event->timestamp;
+            mReplayBase = mReplayLast ? mReplayLast + ms2ns(1) : now;
+        }
+        const nsecs_t elapsed = event->timestamp - mReplayTraceStart;
+        if (mReplaySpeed > 0) {
+            const nsecs_t due = mReplayWallStart + nsecs_t(elapsed / mReplaySpeed);
+            if (due > now) {
+                if (n) break;
+                usleep((due - now) / 1000);
+            }
+        }
+        buffer[n] = *event;
+        buffer[n].timestamp = mReplayBase + elapsed;
+        mReplayLast = buffer[n].timestamp;
+        mReplay->advance();
+        n++;
+    }
+    return n;
+}
+
 status_t SensorDevice::activate(void* ident, int handle, int enabled)
 {
     if (!mSensorDevice) return NO_INIT;
@@ -180,6 +273,7 @@ status_t SensorDevice::activate(void* ident, int handle, int enabled)
 
         if (info.rates.indexOfKey(ident) < 0) {
             info.rates.add(ident, DEFAULT_EVENTS_PERIOD);
+            info.latencies.add(ident, 0);
             if (info.rates.size() == 1) {
                 actuateHardware = true;
             }
@@ -192,6 +286,7 @@ status_t SensorDevice::activate(void* ident, int handle, int enabled)
                 info.rates.indexOfKey(ident));
 
         ssize_t idx = info.rates.removeItem(ident);
+        info.latencies.removeItem(ident);
         if (idx >= 0) {
             if (info.rates.size() == 0) {
                 actuateHardware = true;
@@ -212,8 +307,7 @@ status_t SensorDevice::activate(void* ident, int handle, int enabled)
 
     { // scope for the lock
         Mutex::Autolock _l(mLock);
-        nsecs_t ns = info.selectDelay();
-        mSensorDevice->setDelay(mSensorDevice, handle, ns);
+        updateRateLocked(handle, info);
     }
 
     return err;
@@ -226,7 +320,46 @@ status_t SensorDevice::setDelay(void* ident, int handle, int64_t ns)
     Info& info( mActivationCount.editValueFor(handle) );
     status_t err = info.setDelayForIdent(ident, ns);
     if (err < 0) return err;
-    ns = info.selectDelay();
+    return updateRateLocked(handle, info);
+}
+
+status_t SensorDevice::batch(void* ident, int handle, int64_t ns,
+        int64_t maxReportLatency)
+{
+    if (!mSensorDevice) return NO_INIT;
+    Mutex::Autolock _l(mLock);
+    Info& info( mActivationCount.editValueFor(handle) );
+    status_t err = info.setDelayForIdent(ident, ns);
+    if (err < 0) return err;
+    info.latencies.replaceValueFor(ident, maxReportLatency);
+    return updateRateLocked(handle, info);
+}
+
+status_t SensorDevice::flush(void* ident, int handle)
+{
+    if (!mSensorDevice) return NO_INIT;
+#if defined(SENSORS_DEVICE_API_VERSION_1_0)
+    if (mHasBatching) {
+        return asDevice1(mSensorDevice)->flush(asDevice1(mSensorDevice), handle);
+    }
+#endif
+    // nothing is held back in the h/w
+    return NO_ERROR;
+}
+
+status_t SensorDevice::updateRateLocked(int handle, Info& info)
+{
+    if (info.rates.isEmpty()) {
+        return NO_ERROR;
+    }
+    const nsecs_t ns = info.selectDelay();
+    const nsecs_t latency = info.selectLatency();
+#if defined(SENSORS_DEVICE_API_VERSION_1_0)
+    if (mHasBatching) {
+        return asDevice1(mSensorDevice)->batch(asDevice1(mSensorDevice),
+                handle, 0, ns, latency);
+    }
+#endif
     return mSensorDevice->setDelay(mSensorDevice, handle, ns);
 }
 
@@ -257,6 +390,20 @@ nsecs_t SensorDevice::Info::selectDelay()
     return ns;
 }
 
+nsecs_t SensorDevice::Info::selectLatency()
+{
+    // events are reported as soon as the most impatient client wants them
+    nsecs_t ns = latencies.size() ? latencies.valueAt(0) : 0;
+    for (size_t i=1 ; i<latencies.size() ; i++) {
+        nsecs_t cur = latencies.valueAt(i);
+        if (cur < ns) {
+            ns = cur;
+        }
+    }
+    latency = ns;
+    return ns;
+}
+
 // ---------------------------------------------------------------------------
 }; // namespace android
 
@@ -33,6 +33,8 @@ namespace android {
 
 static const nsecs_t DEFAULT_EVENTS_PERIOD = 200000000; //    5 Hz
 
+class SensorTrace;
+
 class SensorDevice : public Singleton<SensorDevice> {
     friend class Singleton<SensorDevice>;
     struct sensors_poll_device_t* mSensorDevice;
@@ -40,21 +42,43 @@ class SensorDevice : public Singleton<SensorDevice> {
     mutable Mutex mLock; // protect mActivationCount[].rates
     // fixed-size array after construction
     struct Info {
-        Info() : delay(0) { }
+        Info() : delay(0), latency(0) { }
         KeyedVector<void*, nsecs_t> rates;
+        KeyedVector<void*, nsecs_t> latencies;
         nsecs_t delay;
+        nsecs_t latency;
         status_t setDelayForIdent(void* ident, int64_t ns);
         nsecs_t selectDelay();
+        nsecs_t selectLatency();
     };
     DefaultKeyedVector<int, Info> mActivationCount;
+    // the HAL can hold events back in a h/w FIFO
+    bool mHasBatching;
+
+    // when set, poll() returns the events of this recording instead of
+    // the HAL's, mReplaySpeed times faster than they were recorded (as
+    // fast as possible for 0). Timestamps keep their spacing but start
+    // at mReplayBase, which moves forward each time the trace loops.
+    SensorTrace* mReplay;
+    float mReplaySpeed;
+    nsecs_t mReplayWallStart;
+    nsecs_t mReplayTraceStart;
+    nsecs_t mReplayBase;
+    nsecs_t mReplayLast;
 
     SensorDevice();
+    status_t updateRateLocked(int handle, Info& info);
+    ssize_t replay(sensors_event_t* buffer, size_t count);
 public:
     ssize_t getSensorList(sensor_t const** list);
     status_t initCheck() const;
     ssize_t poll(sensors_event_t* buffer, size_t count);
     status_t activate(void* ident, int handle, int enabled);
     status_t setDelay(void* ident, int handle, int64_t ns);
+    status_t batch(void* ident, int handle, int64_t ns,
+            int64_t maxReportLatency);
+    status_t flush(void* ident, int handle);
+    bool hasBatching() const { return mHasBatching; }
     void dump(String8& result, char* buffer, size_t SIZE);
 };
 
@@ -14,6 +14,10 @@
  * limitations under the License.
  */
 
+#include <math.h>
+
+#include <hardware/sensors.h>
+
 #include "SensorDevice.h"
 #include "SensorFusion.h"
 #include "SensorService.h"
@@ -25,7 +29,7 @@ ANDROID_SINGLETON_STATIC_INSTANCE(SensorFusion)
 
 SensorFusion::SensorFusion()
     : mSensorDevice(SensorDevice::getInstance()),
-      mEnabled(false), mGyroTime(0)
+      mEnabled(false), mGyroTime(0), mOutputs(0)
 {
     sensor_t const* list;
     ssize_t count = mSensorDevice.getSensorList(&list);
@@ -50,6 +54,7 @@ SensorFusion::SensorFusion()
 }
 
 void SensorFusion::process(const sensors_event_t& event) {
+    mOutputs = 0;
     if (event.type == SENSOR_TYPE_GYROSCOPE) {
         if (mGyroTime != 0) {
             const float dT = (event.timestamp - mGyroTime) / 1000000000.0f;
@@ -71,6 +76,39 @@ void SensorFusion::process(const sensors_event_t& event) {
     }
 }
 
+const mat33_t& SensorFusion::getRotationMatrix() const {
+    if (!(mOutputs & ROTATION)) {
+        mRotation = mFusion.getRotationMatrix();
+        mOutputs |= ROTATION;
+    }
+    return mRotation;
+}
+
+const vec3_t& SensorFusion::getGravity() const {
+    if (!(mOutputs & GRAVITY)) {
+        // FIXME: we need to estimate the length of gravity because
+        // the accelerometer may have a small scaling error. This
+        // translates to an offset in the linear-acceleration sensor.
+        mGravity = getRotationMatrix()[2] * GRAVITY_EARTH;
+        mOutputs |= GRAVITY;
+    }
+    return mGravity;
+}
+
+const vec3_t& SensorFusion::getOrientation() const {
+    if (!(mOutputs & ORIENTATION)) {
+        const float rad2deg = 180 / M_PI;
+        const mat33_t& R(getRotationMatrix());
+        mOrientation[0] = atan2f(-R[1][0], R[0][0])    * rad2deg;
+        mOrientation[1] = atan2f(-R[2][1], R[2][2])    * rad2deg;
+        mOrientation[2] = asinf ( R[2][0])             * rad2deg;
+        if (mOrientation[0] < 0)
+            mOrientation[0] += 360;
+        mOutputs |= ORIENTATION;
+    }
+    return mOrientation;
+}
+
 template <typename T> inline T min(T a, T b) { return a<b ? a : b; }
 template <typename T> inline T max(T a, T b) { return a>b ? a : b; }
 
@@ -101,6 +139,7 @@ status_t SensorFusion::activate(void* ident, bool enabled) {
         if (newState) {
             mFusion.init();
             mGyroTime = 0;
+            mOutputs = 0;
         }
     }
     return NO_ERROR;
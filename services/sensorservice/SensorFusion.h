@@ -50,6 +50,15 @@ class SensorFusion : public Singleton<SensorFusion> {
     vec4_t mAttitude;
     SortedVector<void*> mClients;
 
+    // what the virtual sensors derive from the attitude, computed at most
+    // once per poll when the first of them asks for it. threadLoop feeds
+    // all of a poll's events to process() before any virtual sensor runs.
+    enum { ROTATION = 0x1, GRAVITY = 0x2, ORIENTATION = 0x4 };
+    mutable uint32_t mOutputs;  // which of the below are up to date
+    mutable mat33_t mRotation;
+    mutable vec3_t mGravity;
+    mutable vec3_t mOrientation;
+
     SensorFusion();
 
 public:
@@ -57,8 +66,12 @@ public:
 
     bool isEnabled() const { return mEnabled; }
     bool hasEstimate() const { return mFusion.hasEstimate(); }
-    mat33_t getRotationMatrix() const { return mFusion.getRotationMatrix(); }
+    const mat33_t& getRotationMatrix() const;
     vec4_t getAttitude() const { return mAttitude; }
+    // gravity in m/s^2, in the device's frame
+    const vec3_t& getGravity() const;
+    // azimuth, pitch and roll, in degrees
+    const vec3_t& getOrientation() const;
     vec3_t getGyroBias() const { return mFusion.getBias(); }
     float getEstimatedRate() const { return mGyroRate; }
 
@@ -28,6 +28,17 @@ SensorInterface::~SensorInterface()
 {
 }
 
+status_t SensorInterface::batch(void* ident, int handle, int64_t ns,
+        int64_t maxReportLatency)
+{
+    return setDelay(ident, handle, ns);
+}
+
+status_t SensorInterface::flush(void* ident, int handle)
+{
+    return NO_ERROR;
+}
+
 // ---------------------------------------------------------------------------
 
 HardwareSensor::HardwareSensor(const sensor_t& sensor)
@@ -54,6 +65,15 @@ status_t HardwareSensor::setDelay(void* ident, int handle, int64_t ns) {
     return mSensorDevice.setDelay(ident, handle, ns);
 }
 
+status_t HardwareSensor::batch(void* ident, int handle, int64_t ns,
+        int64_t maxReportLatency) {
+    return mSensorDevice.batch(ident, handle, ns, maxReportLatency);
+}
+
+status_t HardwareSensor::flush(void* ident, int handle) {
+    return mSensorDevice.flush(ident, handle);
+}
+
 Sensor HardwareSensor::getSensor() const {
     return mSensor;
 }
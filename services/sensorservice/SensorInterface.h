@@ -38,6 +38,10 @@ public:
 
     virtual status_t activate(void* ident, bool enabled) = 0;
     virtual status_t setDelay(void* ident, int handle, int64_t ns) = 0;
+    // by default events aren't held back, which satisfies any latency
+    virtual status_t batch(void* ident, int handle, int64_t ns,
+            int64_t maxReportLatency);
+    virtual status_t flush(void* ident, int handle);
     virtual Sensor getSensor() const = 0;
     virtual bool isVirtual() const = 0;
 };
@@ -59,6 +63,9 @@ public:
 
     virtual status_t activate(void* ident, bool enabled);
     virtual status_t setDelay(void* ident, int handle, int64_t ns);
+    virtual status_t batch(void* ident, int handle, int64_t ns,
+            int64_t maxReportLatency);
+    virtual status_t flush(void* ident, int handle);
     virtual Sensor getSensor() const;
     virtual bool isVirtual() const { return false; }
 };
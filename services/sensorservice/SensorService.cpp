@@ -25,6 +25,8 @@
 #include <utils/threads.h>
 #include <utils/Atomic.h>
 #include <utils/Errors.h>
+#include <utils/Profiler.h>
+#include <utils/ProtoOutput.h>
 #include <utils/RefBase.h>
 #include <utils/Singleton.h>
 #include <utils/String16.h>
@@ -33,11 +35,14 @@
 #include <binder/IServiceManager.h>
 #include <binder/PermissionCache.h>
 
+#include <cpustats/ThreadCpuSampler.h>
+
 #include <gui/ISensorServer.h>
 #include <gui/ISensorEventConnection.h>
 #include <gui/SensorEventQueue.h>
 
 #include <hardware/sensors.h>
+#include <hardware_legacy/power.h>
 
 #include "BatteryService.h"
 #include "CorrectedGyroSensor.h"
@@ -48,6 +53,7 @@
 #include "RotationVectorSensor2.h"
 #include "SensorFusion.h"
 #include "SensorService.h"
+#include "SensorTrace.h"
 
 #ifdef USE_LEGACY_SENSORS_FUSION
 #include "legacy/LegacyGravitySensor.h"
@@ -68,7 +74,8 @@ namespace android {
  */
 
 SensorService::SensorService()
-    : mInitCheck(NO_INIT)
+    : mInitCheck(NO_INIT), mSubscribersGeneration(0), mRecording(NULL),
+      mCpuSampler(NULL)
 {
 }
 
@@ -175,7 +182,30 @@ void SensorService::onFirstRef()
                 }
             }
 
+            char value[PROPERTY_VALUE_MAX];
+            if (property_get("debug.sensors.record", value, NULL) > 0) {
+                // about 6 MB, or 20 minutes of a 9-axis fusion
+                char events[PROPERTY_VALUE_MAX];
+                property_get("debug.sensors.record_events", events, "65536");
+                SensorTrace* trace = new SensorTrace();
+                if (trace->create(value, atoi(events)) == NO_ERROR) {
+                    ALOGI("recording sensor events to %s", value);
+                    mRecording = trace;
+                } else {
+                    delete trace;
+                }
+            }
+
             run("SensorService", PRIORITY_URGENT_DISPLAY);
+            configureScheduling("sensorservice");
+
+            // period in ms of the CPU use sampling of threadLoop, 0 disables it
+            property_get("debug.sensors.cpu_sample_ms", value, "0");
+            if (atoi(value) > 0) {
+                mCpuSampler = new ThreadCpuSampler(atoi(value));
+                mCpuSampler->addThread(getTid(), "SensorService");
+                mCpuSampler->start();
+            }
             mInitCheck = NO_ERROR;
         }
     }
@@ -205,6 +235,8 @@ SensorService::~SensorService()
 {
     for (size_t i=0 ; i<mSensorMap.size() ; i++)
         delete mSensorMap.valueAt(i);
+    delete mRecording;
+    delete mCpuSampler;
 }
 
 static const String16 sDump("android.permission.DUMP");
@@ -221,12 +253,48 @@ status_t SensorService::dump(int fd, const Vector<String16>& args)
                 IPCThreadState::self()->getCallingUid());
         result.append(buffer);
     } else {
-        Mutex::Autolock _l(mLock);
+        // Copy what we need under the lock, and format it after releasing
+        // the lock, so that a dump doesn't hold up the sensor thread.
+        // mSensorList doesn't change once the service is running.
+        const size_t sensorCount = mSensorList.size();
+        Vector<DumpedSensor> sensors;
+        Vector<DumpedSensor> activeSensors;
+        SortedVector< wp<SensorEventConnection> > activeConnections;
+        {
+            Mutex::Autolock _l(mLock);
+            sensors.setCapacity(sensorCount);
+            for (size_t i=0 ; i<sensorCount ; i++) {
+                const int handle = mSensorList[i].getHandle();
+                const sensors_event_t& e(mLastEventSeen.valueFor(handle));
+                DumpedSensor sensor;
+                sensor.handle = handle;
+                sensor.count = 0;
+                memcpy(sensor.data, e.data, sizeof(sensor.data));
+                sensors.add(sensor);
+            }
+            activeSensors.setCapacity(mActiveSensors.size());
+            for (size_t i=0 ; i<mActiveSensors.size() ; i++) {
+                DumpedSensor sensor;
+                sensor.handle = mActiveSensors.keyAt(i);
+                sensor.count = int(mActiveSensors.valueAt(i)->getNumConnections());
+                activeSensors.add(sensor);
+            }
+            activeConnections = mActiveConnections;
+        }
+
+        if (args.size() && args[0] == String16("--proto")) {
+            // binary, so it can't be combined with the text below
+            ProtoOutput proto;
+            dumpProto(sensors, activeSensors, activeConnections, proto);
+            write(fd, proto.data(), proto.size());
+            return NO_ERROR;
+        }
+
         snprintf(buffer, SIZE, "Sensor List:\n");
         result.append(buffer);
-        for (size_t i=0 ; i<mSensorList.size() ; i++) {
+        for (size_t i=0 ; i<sensorCount ; i++) {
             const Sensor& s(mSensorList[i]);
-            const sensors_event_t& e(mLastEventSeen.valueFor(s.getHandle()));
+            const DumpedSensor& e(sensors[i]);
             snprintf(buffer, SIZE,
                     "%-48s| %-32s | 0x%08x | maxRate=%7.2fHz | "
                     "last=<%5.1f,%5.1f,%5.1f>\n",
@@ -241,34 +309,95 @@ status_t SensorService::dump(int fd, const Vector<String16>& args)
         SensorDevice::getInstance().dump(result, buffer, SIZE);
 
         snprintf(buffer, SIZE, "%d active connections\n",
-                mActiveConnections.size());
+                int(activeConnections.size()));
         result.append(buffer);
+        for (size_t i=0 ; i<activeConnections.size() ; i++) {
+            sp<SensorEventConnection> connection(activeConnections[i].promote());
+            if (connection != 0) {
+                connection->dump(result, buffer, SIZE);
+            }
+        }
         snprintf(buffer, SIZE, "Active sensors:\n");
         result.append(buffer);
-        for (size_t i=0 ; i<mActiveSensors.size() ; i++) {
-            int handle = mActiveSensors.keyAt(i);
+        for (size_t i=0 ; i<activeSensors.size() ; i++) {
+            const DumpedSensor& sensor(activeSensors[i]);
             snprintf(buffer, SIZE, "%s (handle=0x%08x, connections=%d)\n",
-                    getSensorName(handle).string(),
-                    handle,
-                    mActiveSensors.valueAt(i)->getNumConnections());
+                    getSensorName(sensor.handle).string(),
+                    sensor.handle,
+                    sensor.count);
             result.append(buffer);
         }
+        if (mCpuSampler) {
+            mCpuSampler->dump(result);
+        }
+        Profiler::dump(result);
     }
     write(fd, result.string(), result.size());
     return NO_ERROR;
 }
 
+void SensorService::dumpProto(const Vector<DumpedSensor>& sensors,
+        const Vector<DumpedSensor>& activeSensors,
+        const SortedVector< wp<SensorEventConnection> >& connections,
+        ProtoOutput& proto) const
+{
+    for (size_t i=0 ; i<sensors.size() ; i++) {
+        const Sensor& s(mSensorList[i]);
+        const DumpedSensor& e(sensors[i]);
+        const size_t token = proto.beginMessage(1);
+        proto.writeString(1, s.getName());
+        proto.writeString(2, s.getVendor());
+        proto.writeInt32(3, s.getHandle());
+        proto.writeInt32(4, s.getType());
+        proto.writeInt32(5, s.getMinDelay());
+        for (size_t j=0 ; j<3 ; j++) {
+            proto.writeFloat(6, e.data[j]);
+        }
+        proto.endMessage(token);
+    }
+    for (size_t i=0 ; i<connections.size() ; i++) {
+        sp<SensorEventConnection> connection(connections[i].promote());
+        if (connection != 0) {
+            const size_t token = proto.beginMessage(2);
+            connection->dumpProto(proto);
+            proto.endMessage(token);
+        }
+    }
+    for (size_t i=0 ; i<activeSensors.size() ; i++) {
+        const size_t token = proto.beginMessage(3);
+        proto.writeInt32(1, activeSensors[i].handle);
+        proto.writeInt32(2, activeSensors[i].count);
+        proto.endMessage(token);
+    }
+}
+
+static const char WAKE_LOCK_NAME[] = "SensorService";
+
 bool SensorService::threadLoop()
 {
     ALOGD("nuSensorService thread starting...");
 
-    const size_t numEventMax = 16;
+    SensorDevice& device(SensorDevice::getInstance());
+    // a h/w FIFO is drained in large chunks
+    const size_t numEventMax = device.hasBatching() ? 128 : 32;
     const size_t minBufferSize = numEventMax + numEventMax * mVirtualSensorList.size();
     sensors_event_t buffer[minBufferSize];
-    sensors_event_t scratch[minBufferSize];
-    SensorDevice& device(SensorDevice::getInstance());
     const size_t vcount = mVirtualSensorList.size();
 
+    DispatchIndex index;
+    index.generation = mSubscribersGeneration - 1;
+    // each connection's events, one after the other
+    Vector<sensors_event_t> batches;
+    const Vector<size_t> noSubscribers;
+    // the events of the virtual sensors, and the index in buffer of the
+    // event each was made from
+    Vector<sensors_event_t> virtualEvents;
+    Vector<size_t> virtualSources;
+    if (vcount) {
+        virtualEvents.insertAt(0, minBufferSize - numEventMax);
+        virtualSources.insertAt(size_t(0), 0, minBufferSize - numEventMax);
+    }
+
     ssize_t count;
     do {
         count = device.poll(buffer, numEventMax);
@@ -276,8 +405,13 @@ bool SensorService::threadLoop()
             ALOGE("sensor poll failed (%s)", strerror(-count));
             break;
         }
+        // everything but waiting for the HAL
+        PROFILE_SCOPE("sensors", "threadLoop");
 
         recordLastValue(buffer, count);
+        if (mRecording) {
+            mRecording->record(buffer, count);
+        }
 
         // handle virtual sensors
         if (count && vcount) {
@@ -299,6 +433,8 @@ bool SensorService::threadLoop()
                         rv2.process(event[i]);
                     }
                 }
+                sensors_event_t* const vevents = virtualEvents.editArray();
+                size_t* const vsources = virtualSources.editArray();
                 for (size_t i=0 ; i<size_t(count) && k<minBufferSize ; i++) {
                     for (size_t j=0 ; j<activeVirtualSensorCount ; j++) {
                         if (count + k >= minBufferSize) {
@@ -307,33 +443,98 @@ bool SensorService::threadLoop()
                                     count, k, minBufferSize);
                             break;
                         }
-                        sensors_event_t out;
                         SensorInterface* si = virtualSensors.valueAt(j);
-                        if (si->process(&out, event[i])) {
-                            buffer[count + k] = out;
+                        if (si->process(&vevents[k], event[i])) {
+                            vsources[k] = i;
                             k++;
                         }
                     }
                 }
                 if (k) {
                     // record the last synthesized values
-                    recordLastValue(&buffer[count], k);
+                    recordLastValue(vevents, k);
+                    // a virtual event has the time-stamp of the event it
+                    // was made from, so it goes right after it. Merging
+                    // from the end moves every event once, in place.
+                    size_t w = count + k;
+                    size_t h = count;
+                    for (size_t v=k ; v>0 ; v--) {
+                        const size_t source = vsources[v-1];
+                        while (h > source + 1) {
+                            buffer[--w] = buffer[--h];
+                        }
+                        buffer[--w] = vevents[v-1];
+                    }
                     count += k;
-                    // sort the buffer by time-stamps
-                    sortEventBuffer(buffer, count);
                 }
             }
         }
 
         // send our events to clients...
-        const SortedVector< wp<SensorEventConnection> > activeConnections(
-                getActiveConnections());
-        size_t numConnections = activeConnections.size();
-        for (size_t i=0 ; i<numConnections ; i++) {
-            sp<SensorEventConnection> connection(
-                    activeConnections[i].promote());
-            if (connection != 0) {
-                connection->sendEvents(buffer, count, scratch);
+        updateDispatchIndex(&index);
+        const size_t numConnections = index.connections.size();
+        if (count > 0 && numConnections) {
+            // count the events of each connection, then copy them to their
+            // place in the connection's batch, so each event is looked up
+            // once instead of once per connection
+            size_t offsets[numConnections + 1];
+            size_t next[numConnections];
+            memset(offsets, 0, sizeof(offsets));
+            for (int pass=0 ; pass<2 ; pass++) {
+                sensors_event_t* const out = pass ? batches.editArray() : NULL;
+                int32_t prev = -1;
+                Vector<size_t> const* subscribers = NULL;
+                for (size_t i=0 ; i<size_t(count) ; i++) {
+                    // events come grouped by sensor
+                    if (subscribers == NULL || buffer[i].sensor != prev) {
+                        prev = buffer[i].sensor;
+                        ssize_t j = index.subscribers.indexOfKey(prev);
+                        subscribers = j >= 0 ?
+                                &index.subscribers.valueAt(j) : &noSubscribers;
+                    }
+                    const size_t n = subscribers->size();
+                    for (size_t j=0 ; j<n ; j++) {
+                        const size_t c = subscribers->itemAt(j);
+                        if (pass == 0) {
+                            offsets[c+1]++;
+                        } else {
+                            out[next[c]++] = buffer[i];
+                        }
+                    }
+                }
+                if (pass == 0) {
+                    for (size_t c=0 ; c<numConnections ; c++) {
+                        offsets[c+1] += offsets[c];
+                        next[c] = offsets[c];
+                    }
+                    if (batches.size() < offsets[numConnections]) {
+                        batches.insertAt(batches.size(),
+                                offsets[numConnections] - batches.size());
+                    }
+                }
+            }
+            // only the wake-up connections keep the device awake, the
+            // others find their events in their ring when it resumes
+            bool wakeLockHeld = false;
+            for (size_t c=0 ; c<numConnections ; c++) {
+                if (offsets[c+1] == offsets[c]) {
+                    continue;
+                }
+                sp<SensorEventConnection> connection(
+                        index.connections[c].promote());
+                if (connection != 0) {
+                    if (!wakeLockHeld && connection->isWakeUp()) {
+                        acquire_wake_lock(PARTIAL_WAKE_LOCK, WAKE_LOCK_NAME);
+                        wakeLockHeld = true;
+                    }
+                    // the batch is ours, it can be thinned out in place
+                    sensors_event_t* batch = batches.editArray() + offsets[c];
+                    connection->sendEvents(batch, offsets[c+1] - offsets[c],
+                            batch);
+                }
+            }
+            if (wakeLockHeld) {
+                release_wake_lock(WAKE_LOCK_NAME);
             }
         }
     } while (count >= 0 || Thread::exitPending());
@@ -361,18 +562,6 @@ void SensorService::recordLastValue(
     mLastEventSeen.editValueFor(prev) = buffer[count-1];
 }
 
-void SensorService::sortEventBuffer(sensors_event_t* buffer, size_t count)
-{
-    struct compar {
-        static int cmp(void const* lhs, void const* rhs) {
-            sensors_event_t const* l = static_cast<sensors_event_t const*>(lhs);
-            sensors_event_t const* r = static_cast<sensors_event_t const*>(rhs);
-            return l->timestamp - r->timestamp;
-        }
-    };
-    qsort(buffer, count, sizeof(sensors_event_t), compar::cmp);
-}
-
 SortedVector< wp<SensorService::SensorEventConnection> >
 SensorService::getActiveConnections() const
 {
@@ -380,6 +569,31 @@ SensorService::getActiveConnections() const
     return mActiveConnections;
 }
 
+void SensorService::updateDispatchIndex(DispatchIndex* index) const
+{
+    Mutex::Autolock _l(mLock);
+    if (index->generation == mSubscribersGeneration) {
+        return;
+    }
+    index->generation = mSubscribersGeneration;
+    index->connections = mActiveConnections;
+    index->subscribers.clear();
+    for (size_t i=0 ; i<mActiveSensors.size() ; i++) {
+        const SortedVector< wp<SensorEventConnection> >& connections(
+                mActiveSensors.valueAt(i)->getConnections());
+        Vector<size_t> subscribers;
+        for (size_t j=0 ; j<connections.size() ; j++) {
+            ssize_t c = index->connections.indexOf(connections[j]);
+            if (c >= 0) {
+                subscribers.push(size_t(c));
+            }
+        }
+        if (!subscribers.isEmpty()) {
+            index->subscribers.add(mActiveSensors.keyAt(i), subscribers);
+        }
+    }
+}
+
 DefaultKeyedVector<int, SensorInterface*>
 SensorService::getActiveVirtualSensors() const
 {
@@ -449,6 +663,7 @@ void SensorService::cleanupConnection(SensorEventConnection* c)
         }
     }
     mActiveConnections.remove(connection);
+    mSubscribersGeneration++;
     BatteryService::cleanup(c->getUid());
 }
 
@@ -493,6 +708,7 @@ status_t SensorService::enable(const sp<SensorEventConnection>& connection,
                 if (mActiveConnections.indexOf(connection) < 0) {
                     mActiveConnections.add(connection);
                 }
+                mSubscribersGeneration++;
             } else {
                 ALOGW("sensor %08x already enabled in connection %p (ignoring)",
                         handle, connection.get());
@@ -525,6 +741,7 @@ status_t SensorService::disable(const sp<SensorEventConnection>& connection,
             mActiveVirtualSensors.removeItem(handle);
             delete rec;
         }
+        mSubscribersGeneration++;
         SensorInterface* sensor = mSensorMap.valueFor(handle);
         err = sensor ? sensor->activate(connection.get(), false) : status_t(BAD_VALUE);
     }
@@ -552,7 +769,59 @@ status_t SensorService::setEventRate(const sp<SensorEventConnection>& connection
     if (ns < MINIMUM_EVENTS_PERIOD)
         ns = MINIMUM_EVENTS_PERIOD;
 
-    return sensor->setDelay(connection.get(), handle, ns);
+    status_t err = sensor->setDelay(connection.get(), handle, ns);
+    if (err == NO_ERROR && sensor->getSensor().getMinDelay() != 0) {
+        connection->setRequestedPeriod(handle, ns);
+    }
+    return err;
+}
+
+status_t SensorService::batch(const sp<SensorEventConnection>& connection,
+        int handle, nsecs_t ns, nsecs_t maxReportLatency)
+{
+    if (mInitCheck != NO_ERROR)
+        return mInitCheck;
+
+    SensorInterface* sensor = mSensorMap.valueFor(handle);
+    if (!sensor)
+        return BAD_VALUE;
+
+    if (ns < 0 || maxReportLatency < 0)
+        return BAD_VALUE;
+
+    nsecs_t minDelayNs = sensor->getSensor().getMinDelayNs();
+    if (ns < minDelayNs) {
+        ns = minDelayNs;
+    }
+
+    if (ns < MINIMUM_EVENTS_PERIOD)
+        ns = MINIMUM_EVENTS_PERIOD;
+
+    status_t err = sensor->batch(connection.get(), handle, ns, maxReportLatency);
+    if (err == NO_ERROR) {
+        connection->setReportLatency(handle, maxReportLatency);
+        if (sensor->getSensor().getMinDelay() != 0) {
+            connection->setRequestedPeriod(handle, ns);
+        }
+    }
+    return err;
+}
+
+status_t SensorService::flush(const sp<SensorEventConnection>& connection,
+        int handle)
+{
+    if (mInitCheck != NO_ERROR)
+        return mInitCheck;
+
+    SensorInterface* sensor = mSensorMap.valueFor(handle);
+    if (!sensor || !connection->hasSensor(handle))
+        return BAD_VALUE;
+
+    // what the h/w holds back comes through threadLoop, what the
+    // connection holds back is delivered now
+    status_t err = sensor->flush(connection.get(), handle);
+    connection->flushPendingEvents();
+    return err;
 }
 
 // ---------------------------------------------------------------------------
@@ -585,9 +854,15 @@ bool SensorService::SensorRecord::removeConnection(
 
 // ---------------------------------------------------------------------------
 
+// events a client can fall behind by before they're dropped, about half
+// a second of a fast sensor
+static const size_t SENSOR_EVENT_RING_SIZE = 128;
+
 SensorService::SensorEventConnection::SensorEventConnection(
         const sp<SensorService>& service, uid_t uid)
-    : mService(service), mChannel(new BitTube()), mUid(uid)
+    : mService(service), mChannel(new BitTube()), mUid(uid),
+      mDoorbellPending(false), mOldestPending(0),
+      mDelivered(0), mDecimated(0), mWakeUp(false)
 {
 }
 
@@ -612,12 +887,144 @@ bool SensorService::SensorEventConnection::addSensor(int32_t handle) {
 
 bool SensorService::SensorEventConnection::removeSensor(int32_t handle) {
     Mutex::Autolock _l(mConnectionLock);
+    mReportLatencies.removeItem(handle);
+    mRates.removeItem(handle);
     if (mSensorInfo.remove(handle) >= 0) {
+        if (mDoorbellPending) {
+            // don't leave the other sensors' events waiting for a sensor
+            // that's gone
+            ringDoorbellLocked();
+        }
         return true;
     }
     return false;
 }
 
+void SensorService::SensorEventConnection::setReportLatency(int32_t handle,
+        nsecs_t maxReportLatency) {
+    Mutex::Autolock _l(mConnectionLock);
+    if (maxReportLatency > 0) {
+        mReportLatencies.replaceValueFor(handle, maxReportLatency);
+    } else {
+        mReportLatencies.removeItem(handle);
+        if (mDoorbellPending) {
+            ringDoorbellLocked();
+        }
+    }
+}
+
+void SensorService::SensorEventConnection::setRequestedPeriod(int32_t handle,
+        nsecs_t ns) {
+    Mutex::Autolock _l(mConnectionLock);
+    Rate rate;
+    rate.period = ns;
+    rate.next = 0;
+    mRates.replaceValueFor(handle, rate);
+}
+
+size_t SensorService::SensorEventConnection::decimateLocked(
+        sensors_event_t* events, size_t count) {
+    // the sensor runs at the rate of its fastest client, only let through
+    // the events due at the rate this client asked for. A quarter of a
+    // period of slack keeps a sensor running at exactly that rate, with
+    // some jitter, from losing every other event.
+    size_t n = 0;
+    int32_t prev = 0;
+    Rate* rate = NULL;
+    bool looked = false;
+    for (size_t i=0 ; i<count ; i++) {
+        const sensors_event_t& event(events[i]);
+        if (!looked || event.sensor != prev) {
+            prev = event.sensor;
+            looked = true;
+            ssize_t index = mRates.indexOfKey(prev);
+            rate = index >= 0 ? &mRates.editValueAt(index) : NULL;
+        }
+        if (rate) {
+            const nsecs_t t = event.timestamp;
+            if (t + rate->period / 4 < rate->next) {
+                mDecimated++;
+                continue;
+            }
+            // stay in phase, unless the sensor went quiet for a while
+            rate->next += rate->period;
+            if (rate->next <= t) {
+                rate->next = t + rate->period;
+            }
+        }
+        events[n++] = event;
+    }
+    return n;
+}
+
+void SensorService::SensorEventConnection::dump(String8& result,
+        char* buffer, size_t SIZE) const {
+    Mutex::Autolock _l(mConnectionLock);
+    snprintf(buffer, SIZE, "  connection %p: uid=%d, sensors=%d, %s, "
+            "delivered=%u, decimated=%u, dropped=%u\n",
+            this, int(mUid), int(mSensorInfo.size()),
+            mWakeUp ? "wake-up" : "non-wake-up",
+            mDelivered, mDecimated,
+            mRing != NULL ? mRing->getDroppedCount() : 0);
+    result.append(buffer);
+    for (size_t i=0 ; i<mRates.size() ; i++) {
+        snprintf(buffer, SIZE, "    handle=0x%08x, period=%4.1f ms\n",
+                mRates.keyAt(i), mRates.valueAt(i).period / 1e6f);
+        result.append(buffer);
+    }
+}
+
+void SensorService::SensorEventConnection::dumpProto(ProtoOutput& proto) const {
+    Mutex::Autolock _l(mConnectionLock);
+    proto.writeInt32(1, int(mUid));
+    proto.writeInt32(2, int(mSensorInfo.size()));
+    proto.writeBool(3, mWakeUp);
+    proto.writeUInt32(4, mDelivered);
+    proto.writeUInt32(5, mDecimated);
+    proto.writeUInt32(6, mRing != NULL ? mRing->getDroppedCount() : 0);
+    for (size_t i=0 ; i<mRates.size() ; i++) {
+        const size_t token = proto.beginMessage(7);
+        proto.writeInt32(1, mRates.keyAt(i));
+        proto.writeInt64(2, mRates.valueAt(i).period);
+        proto.endMessage(token);
+    }
+}
+
+bool SensorService::SensorEventConnection::isWakeUp() const {
+    Mutex::Autolock _l(mConnectionLock);
+    return mWakeUp;
+}
+
+void SensorService::SensorEventConnection::flushPendingEvents() {
+    Mutex::Autolock _l(mConnectionLock);
+    if (mDoorbellPending) {
+        ringDoorbellLocked();
+    }
+}
+
+nsecs_t SensorService::SensorEventConnection::getReportLatencyLocked() const {
+    // the most impatient sensor sets the pace, sensors that weren't
+    // batched don't wait at all
+    nsecs_t latency = 0;
+    for (size_t i=0 ; i<mSensorInfo.size() ; i++) {
+        ssize_t j = mReportLatencies.indexOfKey(mSensorInfo[i]);
+        if (j < 0) {
+            return 0;
+        }
+        const nsecs_t cur = mReportLatencies.valueAt(j);
+        if (i == 0 || cur < latency) {
+            latency = cur;
+        }
+    }
+    return latency;
+}
+
+void SensorService::SensorEventConnection::ringDoorbellLocked() {
+    const char doorbell = 0;
+    mChannel->write(&doorbell, sizeof(doorbell));
+    mDoorbellPending = false;
+}
+
 bool SensorService::SensorEventConnection::hasSensor(int32_t handle) const {
     Mutex::Autolock _l(mConnectionLock);
     return mSensorInfo.indexOf(handle) >= 0;
@@ -634,7 +1041,7 @@ status_t SensorService::SensorEventConnection::sendEvents(
 {
     // filter out events not for this connection
     size_t count = 0;
-    if (scratch) {
+    if (scratch && scratch != buffer) {
         Mutex::Autolock _l(mConnectionLock);
         size_t i=0;
         while (i<numEvents) {
@@ -648,10 +1055,47 @@ status_t SensorService::SensorEventConnection::sendEvents(
             }
         }
     } else {
-        scratch = const_cast<sensors_event_t *>(buffer);
         count = numEvents;
     }
 
+    { // scope for the lock
+        Mutex::Autolock _l(mConnectionLock);
+        if (scratch) {
+            if (mRates.size()) {
+                count = decimateLocked(scratch, count);
+            }
+        } else {
+            scratch = const_cast<sensors_event_t *>(buffer);
+        }
+        if (count == 0) {
+            return NO_ERROR;
+        }
+        mDelivered += count;
+        if (mRing != NULL) {
+            // NOTE: ASensorEvent and sensors_event_t are the same type
+            bool wake;
+            mRing->write(reinterpret_cast<ASensorEvent const*>(scratch),
+                    count, &wake);
+            if (wake && !mDoorbellPending) {
+                // the client drained the ring and went to sleep
+                mDoorbellPending = true;
+                mOldestPending = count ? scratch[0].timestamp :
+                        systemTime(SYSTEM_TIME_MONOTONIC);
+            }
+            if (mDoorbellPending) {
+                // let batched events pile up until the oldest one is due,
+                // or until the ring is half full
+                const nsecs_t latency = getReportLatencyLocked();
+                if (latency == 0 ||
+                        systemTime(SYSTEM_TIME_MONOTONIC) - mOldestPending >= latency ||
+                        mRing->getUnreadCount() >= mRing->getCapacity() / 2) {
+                    ringDoorbellLocked();
+                }
+            }
+            return NO_ERROR;
+        }
+    }
+
     // NOTE: ASensorEvent and sensors_event_t are the same type
     ssize_t size = SensorEventQueue::write(mChannel,
             reinterpret_cast<ASensorEvent const*>(scratch), count);
@@ -670,6 +1114,20 @@ sp<BitTube> SensorService::SensorEventConnection::getSensorChannel() const
     return mChannel;
 }
 
+sp<IMemoryHeap> SensorService::SensorEventConnection::getSensorEventRing()
+{
+    Mutex::Autolock _l(mConnectionLock);
+    if (mRing == NULL) {
+        sp<SensorEventRing> ring(new SensorEventRing(SENSOR_EVENT_RING_SIZE));
+        if (ring->initCheck() != NO_ERROR) {
+            // the events keep going through the BitTube
+            return NULL;
+        }
+        mRing = ring;
+    }
+    return mRing->getHeap();
+}
+
 status_t SensorService::SensorEventConnection::enableDisable(
         int handle, bool enabled)
 {
@@ -688,6 +1146,24 @@ status_t SensorService::SensorEventConnection::setEventRate(
     return mService->setEventRate(this, handle, ns);
 }
 
+status_t SensorService::SensorEventConnection::batch(
+        int handle, nsecs_t period, nsecs_t maxReportLatency)
+{
+    return mService->batch(this, handle, period, maxReportLatency);
+}
+
+status_t SensorService::SensorEventConnection::flush(int handle)
+{
+    return mService->flush(this, handle);
+}
+
+status_t SensorService::SensorEventConnection::setWakeUp(bool wakeUp)
+{
+    Mutex::Autolock _l(mConnectionLock);
+    mWakeUp = wakeUp;
+    return NO_ERROR;
+}
+
 // ---------------------------------------------------------------------------
 }; // namespace android
 
@@ -23,6 +23,7 @@
 #include <utils/Vector.h>
 #include <utils/SortedVector.h>
 #include <utils/KeyedVector.h>
+#include <utils/SplitKeyedVector.h>
 #include <utils/threads.h>
 #include <utils/RefBase.h>
 
@@ -32,6 +33,7 @@
 #include <gui/BitTube.h>
 #include <gui/ISensorServer.h>
 #include <gui/ISensorEventConnection.h>
+#include <gui/SensorEventRing.h>
 
 #include "SensorInterface.h"
 
@@ -45,6 +47,10 @@ struct sensors_module_t;
 namespace android {
 // ---------------------------------------------------------------------------
 
+class ProtoOutput;
+class SensorTrace;
+class ThreadCpuSampler;
+
 class SensorService :
         public BinderService<SensorService>,
         public BnSensorServer,
@@ -74,6 +80,15 @@ class SensorService :
         virtual sp<BitTube> getSensorChannel() const;
         virtual status_t enableDisable(int handle, bool enabled);
         virtual status_t setEventRate(int handle, nsecs_t ns);
+        virtual sp<IMemoryHeap> getSensorEventRing();
+        virtual status_t batch(int handle, nsecs_t period,
+                nsecs_t maxReportLatency);
+        virtual status_t flush(int handle);
+        virtual status_t setWakeUp(bool wakeUp);
+
+        nsecs_t getReportLatencyLocked() const;
+        void ringDoorbellLocked();
+        size_t decimateLocked(sensors_event_t* events, size_t count);
 
         sp<SensorService> const mService;
         sp<BitTube> const mChannel;
@@ -83,15 +98,48 @@ class SensorService :
         // protected by SensorService::mLock
         SortedVector<int> mSensorInfo;
 
+        // protected by mConnectionLock, which also keeps the service
+        // thread and enable() from writing to the ring at the same time
+        sp<SensorEventRing> mRing;
+        // sensors whose events may wait in the ring before the client is
+        // woken up, and for how long
+        KeyedVector<int32_t, nsecs_t> mReportLatencies;
+        // the client is asleep and events are waiting for it since
+        // mOldestPending
+        bool mDoorbellPending;
+        nsecs_t mOldestPending;
+        // the period the client asked for, for the continuous sensors
+        // whose events are thinned out to it, and when the next event is
+        // due
+        struct Rate {
+            nsecs_t period;
+            nsecs_t next;
+        };
+        KeyedVector<int32_t, Rate> mRates;
+        uint32_t mDelivered;
+        uint32_t mDecimated;
+        // the device stays awake until this connection's events are sent
+        bool mWakeUp;
+
     public:
         SensorEventConnection(const sp<SensorService>& service, uid_t uid);
 
+        // scratch receives the events of this connection, and may be
+        // buffer itself when buffer only has events of this connection.
+        // Without scratch the events are sent as they are.
         status_t sendEvents(sensors_event_t const* buffer, size_t count,
                 sensors_event_t* scratch = NULL);
         bool hasSensor(int32_t handle) const;
         bool hasAnySensor() const;
         bool addSensor(int32_t handle);
         bool removeSensor(int32_t handle);
+        void setReportLatency(int32_t handle, nsecs_t maxReportLatency);
+        void setRequestedPeriod(int32_t handle, nsecs_t ns);
+        bool isWakeUp() const;
+        void dump(String8& result, char* buffer, size_t SIZE) const;
+        // writes the fields of a Connection message, see sensorservice.proto
+        void dumpProto(ProtoOutput& proto) const;
+        void flushPendingEvents();
 
         uid_t getUid() const { return mUid; }
     };
@@ -103,14 +151,38 @@ class SensorService :
         bool addConnection(const sp<SensorEventConnection>& connection);
         bool removeConnection(const wp<SensorEventConnection>& connection);
         size_t getNumConnections() const { return mConnections.size(); }
+        const SortedVector< wp<SensorEventConnection> >& getConnections() const {
+            return mConnections;
+        }
+    };
+
+    // who threadLoop sends each sensor's events to: the active connections
+    // and, for each sensor handle, the indices of its subscribers among
+    // them. Rebuilt from mActiveSensors when mSubscribersGeneration changes.
+    struct DispatchIndex {
+        uint32_t generation;
+        SortedVector< wp<SensorEventConnection> > connections;
+        KeyedVector< int32_t, Vector<size_t> > subscribers;
     };
 
+    // what dump() copies out of mLock for each sensor
+    struct DumpedSensor {
+        int handle;
+        int count;      // number of connections, for active sensors
+        float data[3];  // start of the last event seen
+    };
+
+    void dumpProto(const Vector<DumpedSensor>& sensors,
+            const Vector<DumpedSensor>& activeSensors,
+            const SortedVector< wp<SensorEventConnection> >& connections,
+            ProtoOutput& proto) const;
+
     SortedVector< wp<SensorEventConnection> > getActiveConnections() const;
+    void updateDispatchIndex(DispatchIndex* index) const;
     DefaultKeyedVector<int, SensorInterface*> getActiveVirtualSensors() const;
 
     String8 getSensorName(int handle) const;
     void recordLastValue(sensors_event_t const * buffer, size_t count);
-    static void sortEventBuffer(sensors_event_t* buffer, size_t count);
     void registerSensor(SensorInterface* sensor);
     void registerVirtualSensor(SensorInterface* sensor);
 
@@ -127,9 +199,20 @@ class SensorService :
     DefaultKeyedVector<int, SensorRecord*> mActiveSensors;
     DefaultKeyedVector<int, SensorInterface*> mActiveVirtualSensors;
     SortedVector< wp<SensorEventConnection> > mActiveConnections;
+    // bumped whenever a connection subscribes to or drops a sensor
+    uint32_t mSubscribersGeneration;
+
+    // The size of this vector is constant, only the items are mutable. It's
+    // looked up for every event, so the handles are kept apart from the
+    // (much larger) events.
+    SplitKeyedVector<int32_t, sensors_event_t> mLastEventSeen;
+
+    // what the HAL returns is appended to this recording, if any. Only
+    // used by threadLoop once it runs.
+    SensorTrace* mRecording;
 
-    // The size of this vector is constant, only the items are mutable
-    KeyedVector<int32_t, sensors_event_t> mLastEventSeen;
+    // samples the CPU use of threadLoop, when enabled
+    ThreadCpuSampler* mCpuSampler;
 
 public:
     static char const* getServiceName() { return "sensorservice"; }
@@ -138,6 +221,9 @@ public:
     status_t enable(const sp<SensorEventConnection>& connection, int handle);
     status_t disable(const sp<SensorEventConnection>& connection, int handle);
     status_t setEventRate(const sp<SensorEventConnection>& connection, int handle, nsecs_t ns);
+    status_t batch(const sp<SensorEventConnection>& connection, int handle,
+            nsecs_t ns, nsecs_t maxReportLatency);
+    status_t flush(const sp<SensorEventConnection>& connection, int handle);
 };
 
 // ---------------------------------------------------------------------------
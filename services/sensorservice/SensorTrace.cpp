@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <utils/Log.h>
+
+#include "SensorTrace.h"
+
+namespace android {
+// ---------------------------------------------------------------------------
+
+static const uint32_t TRACE_MAGIC = 0x53454e54; // 'SENT'
+static const uint32_t TRACE_VERSION = 1;
+
+SensorTrace::SensorTrace()
+    : mHeader(NULL), mEvents(NULL), mMapSize(0), mReadIndex(0)
+{
+}
+
+SensorTrace::~SensorTrace()
+{
+    unmap();
+}
+
+status_t SensorTrace::map(int fd, size_t size, bool writable)
+{
+    void* addr = mmap(NULL, size,
+            writable ? PROT_READ|PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        return -errno;
+    }
+    mHeader = static_cast<Header*>(addr);
+    mEvents = reinterpret_cast<sensors_event_t*>(mHeader + 1);
+    mMapSize = size;
+    return NO_ERROR;
+}
+
+void SensorTrace::unmap()
+{
+    if (mHeader) {
+        munmap(mHeader, mMapSize);
+        mHeader = NULL;
+        mEvents = NULL;
+        mMapSize = 0;
+    }
+}
+
+status_t SensorTrace::create(const char* path, size_t capacity)
+{
+    unmap();
+    if (capacity == 0) {
+        return BAD_VALUE;
+    }
+    int fd = ::open(path, O_RDWR|O_CREAT|O_TRUNC, 0600);
+    if (fd < 0) {
+        ALOGE("can't create sensor trace %s (%s)", path, strerror(errno));
+        return -errno;
+    }
+    const size_t size = sizeof(Header) + capacity * sizeof(sensors_event_t);
+    status_t err = ftruncate(fd, size) < 0 ? status_t(-errno) : status_t(NO_ERROR);
+    if (err == NO_ERROR) {
+        err = map(fd, size, true);
+    }
+    close(fd);
+    if (err != NO_ERROR) {
+        ALOGE("can't map sensor trace %s (%s)", path, strerror(-err));
+        return err;
+    }
+    mHeader->magic = TRACE_MAGIC;
+    mHeader->version = TRACE_VERSION;
+    mHeader->eventSize = sizeof(sensors_event_t);
+    mHeader->capacity = capacity;
+    mHeader->written = 0;
+    return NO_ERROR;
+}
+
+void SensorTrace::record(sensors_event_t const* events, size_t count)
+{
+    if (!mHeader || !count) {
+        return;
+    }
+    const size_t capacity = mHeader->capacity;
+    if (count > capacity) {
+        // only the last ones would survive
+        mHeader->written += count - capacity;
+        events += count - capacity;
+        count = capacity;
+    }
+    const size_t offset = mHeader->written % capacity;
+    const size_t first = count < capacity - offset ? count : capacity - offset;
+    memcpy(mEvents + offset, events, first * sizeof(sensors_event_t));
+    memcpy(mEvents, events + first, (count - first) * sizeof(sensors_event_t));
+    mHeader->written += count;
+}
+
+status_t SensorTrace::open(const char* path)
+{
+    unmap();
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        return -errno;
+    }
+    struct stat st;
+    status_t err = fstat(fd, &st) < 0 ? status_t(-errno) : status_t(NO_ERROR);
+    if (err == NO_ERROR && size_t(st.st_size) < sizeof(Header)) {
+        err = BAD_VALUE;
+    }
+    if (err == NO_ERROR) {
+        err = map(fd, st.st_size, false);
+    }
+    close(fd);
+    if (err != NO_ERROR) {
+        return err;
+    }
+    if (mHeader->magic != TRACE_MAGIC ||
+            mHeader->version != TRACE_VERSION ||
+            mHeader->eventSize != sizeof(sensors_event_t) ||
+            mHeader->capacity == 0 ||
+            mHeader->capacity > (mMapSize - sizeof(Header)) / sizeof(sensors_event_t)) {
+        unmap();
+        return BAD_VALUE;
+    }
+    rewind();
+    return NO_ERROR;
+}
+
+size_t SensorTrace::size() const
+{
+    if (!mHeader) {
+        return 0;
+    }
+    return mHeader->written < mHeader->capacity ?
+            size_t(mHeader->written) : size_t(mHeader->capacity);
+}
+
+sensors_event_t const* SensorTrace::peek() const
+{
+    if (!mHeader || mReadIndex >= mHeader->written) {
+        return NULL;
+    }
+    return mEvents + (mReadIndex % mHeader->capacity);
+}
+
+void SensorTrace::advance()
+{
+    if (mHeader && mReadIndex < mHeader->written) {
+        mReadIndex++;
+    }
+}
+
+void SensorTrace::rewind()
+{
+    // the ring starts at the oldest event that wasn't overwritten
+    mReadIndex = mHeader ? mHeader->written - size() : 0;
+}
+
+// ---------------------------------------------------------------------------
+}; // namespace android
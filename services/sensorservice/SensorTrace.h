@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef ANDROID_SENSOR_TRACE_H
+#define ANDROID_SENSOR_TRACE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/Errors.h>
+
+#include <hardware/sensors.h>
+
+// ---------------------------------------------------------------------------
+
+namespace android {
+// ---------------------------------------------------------------------------
+
+/*
+ * A SensorTrace is a file of raw sensors_event_t, memory-mapped so that
+ * recording an event is a copy into the page cache. The file is written
+ * as a ring: once full, the oldest events are overwritten and a recording
+ * never grows beyond the size it was created with. It's read back oldest
+ * event first.
+ *
+ * A SensorTrace is either being recorded or being read, by one thread.
+ */
+class SensorTrace {
+public:
+    SensorTrace();
+    ~SensorTrace();
+
+    // Creates (or truncates) a trace file with room for capacity events.
+    status_t create(const char* path, size_t capacity);
+    void record(sensors_event_t const* events, size_t count);
+
+    // Maps an existing trace file for reading.
+    status_t open(const char* path);
+    // Returns the next event without consuming it, or NULL at the end.
+    sensors_event_t const* peek() const;
+    void advance();
+    void rewind();
+    // number of events in the trace
+    size_t size() const;
+
+private:
+    // at the start of the file, followed by the events
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t eventSize;
+        uint32_t capacity;
+        uint64_t written;   // events ever recorded
+    };
+
+    SensorTrace(const SensorTrace&);
+    SensorTrace& operator = (const SensorTrace&);
+
+    status_t map(int fd, size_t size, bool writable);
+    void unmap();
+
+    Header* mHeader;
+    sensors_event_t* mEvents;
+    size_t mMapSize;
+    // events read so far, for replay
+    uint64_t mReadIndex;
+};
+
+// ---------------------------------------------------------------------------
+}; // namespace android
+
+#endif // ANDROID_SENSOR_TRACE_H
@@ -12,3 +12,36 @@ LOCAL_MODULE:= test-sensorservice
 LOCAL_MODULE_TAGS := optional
 
 include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	sensorlatency.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils libutils libui libgui
+
+LOCAL_STATIC_LIBRARIES := \
+	libcpustats
+
+LOCAL_MODULE:= sensorlatency
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	fusionbench.cpp \
+	../Fusion.cpp \
+	../SensorTrace.cpp
+
+LOCAL_STATIC_LIBRARIES := \
+	libutils libcutils liblog
+
+LOCAL_MODULE:= fusionbench
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_HOST_EXECUTABLE)
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Replays a sensor trace through Fusion and reports the time spent per
+ * sample. The trace is either a SensorTrace recorded by SensorService
+ * (see debug.sensors.record), or a text file with one sample per line:
+ *
+ *      <a|g|m> <timestamp in ns> <x> <y> <z>
+ *
+ * for accelerometer (m/s^2), gyroscope (rad/s) and magnetometer (uT)
+ * samples, as recorded by an app on the device. Without a trace, a
+ * synthetic one of a device slowly turning around is used.
+ *
+ * usage: fusionbench [trace [iterations]]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+#include "../Fusion.h"
+#include "../SensorTrace.h"
+
+using namespace android;
+
+struct Sample {
+    char type;
+    nsecs_t timestamp;
+    vec3_t v;
+};
+
+static bool loadSensorTrace(const char* path, Vector<Sample>& trace) {
+    SensorTrace recording;
+    if (recording.open(path) != NO_ERROR) {
+        return false;
+    }
+    for (sensors_event_t const* e ; (e = recording.peek()) ; recording.advance()) {
+        Sample s;
+        switch (e->type) {
+            case SENSOR_TYPE_ACCELEROMETER:     s.type = 'a'; break;
+            case SENSOR_TYPE_GYROSCOPE:         s.type = 'g'; break;
+            case SENSOR_TYPE_MAGNETIC_FIELD:    s.type = 'm'; break;
+            default: continue;
+        }
+        s.timestamp = e->timestamp;
+        s.v = vec3_t(e->data);
+        trace.push(s);
+    }
+    return true;
+}
+
+static bool loadTrace(const char* path, Vector<Sample>& trace) {
+    if (loadSensorTrace(path, trace)) {
+        return true;
+    }
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "can't open %s\n", path);
+        return false;
+    }
+    Sample s;
+    long long t;
+    while (fscanf(f, " %c %lld %f %f %f",
+            &s.type, &t, &s.v.x, &s.v.y, &s.v.z) == 5) {
+        s.timestamp = t;
+        trace.push(s);
+    }
+    fclose(f);
+    return true;
+}
+
+// 200 Hz gyro, 50 Hz accelerometer and magnetometer for 60 seconds, with a
+// constant rotation about the vertical axis
+static void makeTrace(Vector<Sample>& trace) {
+    const float rate = 0.5f;    // rad/s
+    const nsecs_t period = ms2ns(5);
+    srand(1);
+    for (int i=0 ; i<200*60 ; i++) {
+        const nsecs_t t = i * period;
+        const float noise = (rand() / float(RAND_MAX) - 0.5f) * 0.01f;
+        Sample s;
+        s.timestamp = t;
+        s.type = 'g';
+        s.v.x = noise;
+        s.v.y = -noise;
+        s.v.z = rate + noise;
+        trace.push(s);
+        if (i % 4 == 0) {
+            const float a = -rate * t / 1e9f;
+            s.type = 'a';
+            s.v.x = noise;
+            s.v.y = noise;
+            s.v.z = 9.81f;
+            trace.push(s);
+            s.type = 'm';
+            s.v.x = 30.0f * sinf(-a);
+            s.v.y = 30.0f * cosf(-a);
+            s.v.z = -20.0f;
+            trace.push(s);
+        }
+    }
+}
+
+static void replay(Fusion& fusion, const Vector<Sample>& trace) {
+    nsecs_t lastGyro = 0;
+    for (size_t i=0 ; i<trace.size() ; i++) {
+        const Sample& s(trace[i]);
+        switch (s.type) {
+            case 'g':
+                if (lastGyro) {
+                    fusion.handleGyro(s.v, (s.timestamp - lastGyro) / 1e9f);
+                }
+                lastGyro = s.timestamp;
+                break;
+            case 'a':
+                fusion.handleAcc(s.v);
+                break;
+            case 'm':
+                fusion.handleMag(s.v);
+                break;
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Vector<Sample> trace;
+    if (argc > 1) {
+        if (!loadTrace(argv[1], trace)) {
+            return 1;
+        }
+    } else {
+        makeTrace(trace);
+    }
+    const int iterations = argc > 2 ? atoi(argv[2]) : 20;
+    if (trace.isEmpty() || iterations <= 0) {
+        fprintf(stderr, "nothing to replay\n");
+        return 1;
+    }
+
+    Fusion fusion;
+    const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i=0 ; i<iterations ; i++) {
+        fusion.init();
+        replay(fusion, trace);
+    }
+    const nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    const vec4_t q(fusion.getAttitude());
+    printf("%u samples x %d: %.1f ns/sample\n",
+            unsigned(trace.size()), iterations,
+            double(elapsed) / (double(trace.size()) * iterations));
+    printf("attitude=(%f, %f, %f, %f)%s\n", q.x, q.y, q.z, q.w,
+            fusion.hasEstimate() ? "" : " (no estimate)");
+    return 0;
+}
@@ -0,0 +1,386 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Sensor latency benchmark: opens one SensorEventQueue per requested rate
+ * on the same sensor, all read by one thread through a shared Looper, and
+ * reports for every queue how long events took from their HAL timestamp
+ * to the client, how regularly they arrived, and how many wakeups it took
+ * to deliver them. It also reports the CPU time and the context switches
+ * of the SensorService thread over the run, read from /proc, and the CPU
+ * time of the receiving thread.
+ *
+ * Events can come from a recorded trace rather than the hardware: set
+ * debug.sensors.replay to a trace recorded with debug.sensors.record and
+ * restart the system server, its timestamps are moved to the time of the
+ * replay (see SensorDevice).
+ *
+ * Results are printed as CSV, one line per queue and one for the service,
+ * so that runs can be compared by scripts.
+ */
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <utils/Looper.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+#include <android/sensor.h>
+
+#include <gui/Sensor.h>
+#include <gui/SensorEventQueue.h>
+#include <gui/SensorManager.h>
+
+#include <cpustats/CentralTendencyStatistics.h>
+#include <cpustats/LogHistogram.h>
+#include <cpustats/ThreadCpuUsage.h>
+
+using namespace android;
+
+struct Options {
+    int type;
+    Vector<nsecs_t> periods;
+    nsecs_t maxReportLatency;   // 0 unless batching
+    int seconds;
+};
+
+// CPU time and context switches of a thread, from /proc
+struct ThreadStats {
+    nsecs_t cpu;
+    long long voluntarySwitches;
+    long long involuntarySwitches;
+};
+
+// ---------------------------------------------------------------------------
+
+class QueueStats : public SensorEventQueue::EventListener {
+public:
+    QueueStats(nsecs_t period)
+        : mPeriod(period), mWakeups(0), mEvents(0), mBroken(false),
+          mLastTimestamp(0), mLastReceived(0) { }
+
+    virtual void onSensorEvents(const sp<SensorEventQueue>& queue,
+            ASensorEvent const* events, size_t count);
+
+    void report(int index) const;
+    bool broken() const { return mBroken; }
+
+private:
+    const nsecs_t mPeriod;
+    uint64_t mWakeups;
+    uint64_t mEvents;
+    bool mBroken;
+    nsecs_t mLastTimestamp;
+    nsecs_t mLastReceived;
+    LogHistogram mLatency;
+    // how much the time between deliveries differs from the time between
+    // events, in us
+    LogHistogram mJitter;
+    CentralTendencyStatistics mInterval;
+};
+
+void QueueStats::onSensorEvents(const sp<SensorEventQueue>& queue,
+        ASensorEvent const* events, size_t count)
+{
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (!count) {
+        mBroken = true;
+        return;
+    }
+    mWakeups++;
+    for (size_t i=0 ; i<count ; i++) {
+        const nsecs_t timestamp = events[i].timestamp;
+        const nsecs_t latency = now - timestamp;
+        mLatency.sample(latency > 0 ? ns2us(latency) : 0);
+        if (mLastTimestamp) {
+            const nsecs_t interval = timestamp - mLastTimestamp;
+            mInterval.sample(ns2us(interval));
+            const nsecs_t delivery = now - mLastReceived;
+            const nsecs_t jitter = delivery > interval ?
+                    delivery - interval : interval - delivery;
+            mJitter.sample(ns2us(jitter));
+        }
+        mLastTimestamp = timestamp;
+        mLastReceived = now;
+        mEvents++;
+    }
+}
+
+void QueueStats::report(int index) const
+{
+    printf("queue,%d,%lld,%llu,%llu,%.2f,%llu,%llu,%llu,%llu,%.0f,%.0f,%llu,%llu\n",
+            index, ns2us(mPeriod), mEvents, mWakeups,
+            mWakeups ? double(mEvents) / mWakeups : 0,
+            mLatency.percentile(50), mLatency.percentile(90),
+            mLatency.percentile(99), mLatency.maximum(),
+            mInterval.n() ? mInterval.mean() : 0,
+            mInterval.n() > 1 ? mInterval.stddev() : 0,
+            mJitter.percentile(50), mJitter.percentile(99));
+}
+
+// ---------------------------------------------------------------------------
+
+static bool readFile(const char* path, char* buffer, size_t size)
+{
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return false;
+    }
+    size_t n = fread(buffer, 1, size - 1, f);
+    fclose(f);
+    buffer[n] = '\0';
+    return n > 0;
+}
+
+// Finds the thread named name in any process, returns its /proc directory
+// ("/proc/<pid>/task/<tid>"), or an empty string.
+static String8 findThread(const char* name)
+{
+    String8 result;
+    DIR* proc = opendir("/proc");
+    if (!proc) {
+        return result;
+    }
+    struct dirent* p;
+    while (result.isEmpty() && (p = readdir(proc)) != NULL) {
+        if (!isdigit(p->d_name[0])) {
+            continue;
+        }
+        String8 tasks("/proc/");
+        tasks.append(p->d_name);
+        tasks.append("/task");
+        DIR* task = opendir(tasks.string());
+        if (!task) {
+            continue;
+        }
+        struct dirent* t;
+        while ((t = readdir(task)) != NULL) {
+            if (!isdigit(t->d_name[0])) {
+                continue;
+            }
+            String8 dir(tasks);
+            dir.append("/");
+            dir.append(t->d_name);
+            char comm[32];
+            if (readFile((dir + "/comm").string(), comm, sizeof(comm)) &&
+                    !strncmp(comm, name, strlen(name)) &&
+                    (comm[strlen(name)] == '\n' || !comm[strlen(name)])) {
+                result = dir;
+                break;
+            }
+        }
+        closedir(task);
+    }
+    closedir(proc);
+    return result;
+}
+
+static bool readThreadStats(const String8& dir, ThreadStats* stats)
+{
+    // the context switches are at the end of a couple KB of status
+    char buffer[4096];
+    if (!readFile((dir + "/stat").string(), buffer, sizeof(buffer))) {
+        return false;
+    }
+    // the name can have spaces, the fields start after its ')'
+    const char* fields = strrchr(buffer, ')');
+    unsigned long utime, stime;
+    if (!fields || sscanf(fields + 2,
+            "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+            &utime, &stime) != 2) {
+        return false;
+    }
+    stats->cpu = nsecs_t(utime + stime) * s2ns(1) / sysconf(_SC_CLK_TCK);
+
+    if (!readFile((dir + "/status").string(), buffer, sizeof(buffer))) {
+        return false;
+    }
+    const char* v = strstr(buffer, "\nvoluntary_ctxt_switches:");
+    const char* nv = strstr(buffer, "\nnonvoluntary_ctxt_switches:");
+    if (!v || !nv) {
+        return false;
+    }
+    stats->voluntarySwitches = atoll(strchr(v, ':') + 1);
+    stats->involuntarySwitches = atoll(strchr(nv, ':') + 1);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+
+static status_t run(const Options& options)
+{
+    SensorManager& mgr(SensorManager::getInstance());
+    Sensor const* sensor = mgr.getDefaultSensor(options.type);
+    if (!sensor) {
+        fprintf(stderr, "no sensor of type %d\n", options.type);
+        return NAME_NOT_FOUND;
+    }
+    fprintf(stderr, "%s, min delay %d us\n",
+            sensor->getName().string(), sensor->getMinDelay());
+
+    const String8 service(findThread("SensorService"));
+    ThreadStats serviceStart;
+    const bool haveService = !service.isEmpty() &&
+            readThreadStats(service, &serviceStart);
+    if (!haveService) {
+        fprintf(stderr, "SensorService thread not found, "
+                "its CPU usage isn't reported\n");
+    }
+
+    sp<Looper> looper = new Looper(false);
+    Vector< sp<SensorEventQueue> > queues;
+    Vector< sp<QueueStats> > stats;
+    for (size_t i=0 ; i<options.periods.size() ; i++) {
+        sp<SensorEventQueue> queue = mgr.createEventQueue();
+        if (queue == 0) {
+            fprintf(stderr, "couldn't create event queue %u\n", unsigned(i));
+            return NO_INIT;
+        }
+        sp<QueueStats> s = new QueueStats(options.periods[i]);
+        status_t err = queue->attachLooper(looper, s);
+        if (err == NO_ERROR) {
+            err = options.maxReportLatency ?
+                    queue->batch(sensor, options.periods[i],
+                            options.maxReportLatency) :
+                    queue->enableSensor(sensor);
+        }
+        if (err == NO_ERROR && !options.maxReportLatency) {
+            err = queue->setEventRate(sensor, options.periods[i]);
+        }
+        if (err != NO_ERROR) {
+            fprintf(stderr, "couldn't enable queue %u (%s)\n",
+                    unsigned(i), strerror(-err));
+            return err;
+        }
+        queues.add(queue);
+        stats.add(s);
+    }
+
+    ThreadCpuUsage cpu;
+    double clientCpu = 0;
+    cpu.enable();
+    const nsecs_t end = systemTime() + s2ns(options.seconds);
+    for (nsecs_t now = systemTime() ; now < end ; now = systemTime()) {
+        looper->pollOnce(int(ns2ms(end - now)) + 1);
+    }
+    cpu.sample(clientCpu);
+
+    ThreadStats serviceEnd;
+    const bool serviceStats = haveService &&
+            readThreadStats(service, &serviceEnd);
+
+    for (size_t i=0 ; i<queues.size() ; i++) {
+        queues[i]->disableSensor(sensor);
+        queues[i]->detachLooper();
+    }
+
+    printf("queue,index,period_us,events,wakeups,events_per_wakeup,"
+            "latency_p50_us,latency_p90_us,latency_p99_us,latency_max_us,"
+            "interval_mean_us,interval_stddev_us,jitter_p50_us,jitter_p99_us\n");
+    for (size_t i=0 ; i<stats.size() ; i++) {
+        stats[i]->report(i);
+        if (stats[i]->broken()) {
+            fprintf(stderr, "queue %u lost its connection\n", unsigned(i));
+        }
+    }
+
+    printf("threads,seconds,client_cpu_ms,service_cpu_ms,"
+            "service_voluntary_switches,service_involuntary_switches\n");
+    if (serviceStats) {
+        printf("threads,%d,%.2f,%.2f,%lld,%lld\n", options.seconds,
+                clientCpu / 1e6,
+                (serviceEnd.cpu - serviceStart.cpu) / 1e6,
+                serviceEnd.voluntarySwitches - serviceStart.voluntarySwitches,
+                serviceEnd.involuntarySwitches - serviceStart.involuntarySwitches);
+    } else {
+        printf("threads,%d,%.2f,,,\n", options.seconds, clientCpu / 1e6);
+    }
+    return NO_ERROR;
+}
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+            "usage: %s [-t type] [-r period_us[,period_us...]] "
+            "[-b max_latency_ms] [-d seconds]\n"
+            "  -t  sensor type, see Sensor::TYPE_* (1, accelerometer)\n"
+            "  -r  rates of the queues, one queue per period (5000,20000,66667)\n"
+            "  -b  batch events up to this latency instead of delivering "
+            "them as they come (0)\n"
+            "  -d  length of the run (10)\n",
+            name);
+}
+
+static bool parsePeriods(const char* list, Vector<nsecs_t>& periods)
+{
+    periods.clear();
+    while (*list) {
+        char* end;
+        long us = strtol(list, &end, 10);
+        if (end == list || us <= 0 || (*end && *end != ',')) {
+            return false;
+        }
+        periods.add(us2ns(us));
+        list = *end ? end + 1 : end;
+    }
+    return !periods.isEmpty();
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    options.type = Sensor::TYPE_ACCELEROMETER;
+    options.maxReportLatency = 0;
+    options.seconds = 10;
+    parsePeriods("5000,20000,66667", options.periods);
+
+    int c;
+    while ((c = getopt(argc, argv, "t:r:b:d:h")) != -1) {
+        switch (c) {
+            case 't':
+                options.type = atoi(optarg);
+                break;
+            case 'r':
+                if (!parsePeriods(optarg, options.periods)) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'b':
+                options.maxReportLatency = ms2ns(atoi(optarg));
+                break;
+            case 'd':
+                options.seconds = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (options.seconds <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    return run(options) == NO_ERROR ? 0 : 1;
+}
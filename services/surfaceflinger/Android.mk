@@ -3,8 +3,13 @@ include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES:= \
     Client.cpp                              \
+    CompositionCache.cpp                    \
+    DisplayComposer.cpp                     \
     DisplayDevice.cpp                       \
+    DisplayMirror.cpp                       \
     EventThread.cpp                         \
+    FrameCommitter.cpp                      \
+    LatencyHistogram.cpp                    \
     Layer.cpp                               \
     LayerBase.cpp                           \
     LayerDim.cpp                            \
@@ -14,10 +19,12 @@ LOCAL_SRC_FILES:= \
     DisplayHardware/HWComposer.cpp          \
     DisplayHardware/PowerHAL.cpp            \
     GLExtensions.cpp                        \
+    GLStateCache.cpp                        \
     MessageQueue.cpp                        \
     SurfaceFlinger.cpp                      \
     SurfaceTextureLayer.cpp                 \
     Transform.cpp                           \
+    VSyncModel.cpp                          \
     
 
 LOCAL_CFLAGS:= -DLOG_TAG=\"SurfaceFlinger\"
@@ -54,6 +61,8 @@ LOCAL_SHARED_LIBRARIES := \
 	libui \
 	libgui
 
+LOCAL_STATIC_LIBRARIES := libcpustats
+
 ifeq ($(BOARD_USES_SAMSUNG_HDMI),true)
         LOCAL_CFLAGS += -DSAMSUNG_HDMI_SUPPORT
         LOCAL_SHARED_LIBRARIES += libTVOut libhdmiclient
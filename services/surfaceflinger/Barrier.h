@@ -17,17 +17,52 @@
 #ifndef ANDROID_BARRIER_H
 #define ANDROID_BARRIER_H
 
+#include <limits.h>
 #include <stdint.h>
 #include <sys/types.h>
 #include <utils/threads.h>
 
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cutils/atomic.h>
+#endif
+
 namespace android {
 
+/*
+ * On Linux the state is a futex: opening an opened barrier or waiting on
+ * one doesn't enter the kernel, and no lock is taken. Once a waiter may
+ * have returned open() only hands the address to the kernel, so a waiter
+ * can destroy the Barrier right after wait().
+ */
 class Barrier
 {
 public:
     inline Barrier() : state(CLOSED) { }
     inline ~Barrier() { }
+#if defined(__linux__)
+    void open() {
+        if (android_atomic_acquire_load(&state) != OPENED) {
+            android_atomic_release_store(OPENED, &state);
+            // a spurious wake-up of whatever reuses this address is fine,
+            // futex waiters always check their condition again
+            syscall(__NR_futex, &state, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+        }
+    }
+    void close() {
+        android_atomic_release_store(CLOSED, &state);
+    }
+    void wait() const {
+        while (android_atomic_acquire_load(&state) == CLOSED) {
+            syscall(__NR_futex, &state, FUTEX_WAIT, CLOSED, NULL, NULL, 0);
+        }
+    }
+private:
+    enum { OPENED, CLOSED };
+    mutable volatile int32_t state;
+#else
     void open() {
         Mutex::Autolock _l(lock);
         state = OPENED;
@@ -48,6 +83,7 @@ private:
     mutable     Mutex       lock;
     mutable     Condition   cv;
     volatile    int         state;
+#endif
 };
 
 }; // namespace android
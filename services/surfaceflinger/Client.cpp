@@ -17,9 +17,11 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+#include <binder/IPCThreadState.h>
 #include <binder/PermissionCache.h>
 
 #include <private/android_filesystem_config.h>
+#include <private/gui/LayerStateChannel.h>
 
 #include "Client.h"
 #include "Layer.h"
@@ -32,22 +34,32 @@ namespace android {
 
 const String16 sAccessSurfaceFlinger("android.permission.ACCESS_SURFACE_FLINGER");
 
+// room for a few hundred compact layer states
+static const size_t kStateChannelSize = 16384;
+
 // ---------------------------------------------------------------------------
 
 Client::Client(const sp<SurfaceFlinger>& flinger)
-    : mFlinger(flinger), mNameGenerator(1)
+    : mFlinger(flinger),
+      mPid(IPCThreadState::self()->getCallingPid())
 {
 }
 
 Client::~Client()
 {
+    // when the client's process dies, all its layers go away in a single
+    // transaction
+    Vector< sp<LayerBase> > layers;
     const size_t count = mLayers.size();
     for (size_t i=0 ; i<count ; i++) {
-        sp<LayerBaseClient> layer(mLayers.valueAt(i).promote());
+        sp<LayerBaseClient> layer(mLayers[i].layer.promote());
         if (layer != 0) {
-            mFlinger->removeLayer(layer);
+            layers.add(layer);
         }
     }
+    if (!layers.isEmpty()) {
+        mFlinger->removeLayers(layers);
+    }
 }
 
 status_t Client::initCheck() const {
@@ -57,9 +69,18 @@ status_t Client::initCheck() const {
 size_t Client::attachLayer(const sp<LayerBaseClient>& layer)
 {
     Mutex::Autolock _l(mLock);
-    size_t name = mNameGenerator++;
-    mLayers.add(name, layer);
-    return name;
+    size_t slot;
+    if (!mFreeSlots.isEmpty()) {
+        slot = mFreeSlots.top();
+        mFreeSlots.pop();
+    } else {
+        slot = mLayers.add();
+        LOG_ALWAYS_FATAL_IF(slot > SLOT_MASK,
+                "too many layers for client %p", this);
+    }
+    LayerSlot& s(mLayers.editItemAt(slot));
+    s.layer = layer;
+    return (s.generation << SLOT_BITS) | slot;
 }
 
 void Client::detachLayer(const LayerBaseClient* layer)
@@ -68,20 +89,32 @@ void Client::detachLayer(const LayerBaseClient* layer)
     // we do a linear search here, because this doesn't happen often
     const size_t count = mLayers.size();
     for (size_t i=0 ; i<count ; i++) {
-        if (mLayers.valueAt(i) == layer) {
-            mLayers.removeItemsAt(i, 1);
+        if (mLayers[i].layer == layer) {
+            LayerSlot& s(mLayers.editItemAt(i));
+            s.layer.clear();
+            s.generation = (s.generation + 1) & GENERATION_MASK;
+            if (s.generation == 0) {
+                // names are never 0
+                s.generation = 1;
+            }
+            mFreeSlots.push(i);
             break;
         }
     }
 }
+
 sp<LayerBaseClient> Client::getLayerUser(int32_t i) const
 {
     Mutex::Autolock _l(mLock);
     sp<LayerBaseClient> lbc;
-    wp<LayerBaseClient> layer(mLayers.valueFor(i));
-    if (layer != 0) {
-        lbc = layer.promote();
-        ALOGE_IF(lbc==0, "getLayerUser(name=%d) is dead", int(i));
+    const uint32_t slot = uint32_t(i) & SLOT_MASK;
+    const uint32_t generation = uint32_t(i) >> SLOT_BITS;
+    if (slot < mLayers.size() && mLayers[slot].generation == generation) {
+        const wp<LayerBaseClient>& layer(mLayers[slot].layer);
+        if (layer != 0) {
+            lbc = layer.promote();
+            ALOGE_IF(lbc==0, "getLayerUser(name=%d) is dead", int(i));
+        }
     }
     return lbc;
 }
@@ -119,7 +152,7 @@ sp<ISurface> Client::createSurface(
      * have access to the GL context.
      */
 
-    class MessageCreateLayer : public MessageBase {
+    class MessageCreateLayer : public SyncMessage {
         sp<ISurface> result;
         SurfaceFlinger* flinger;
         ISurfaceComposerClient::surface_data_t* params;
@@ -146,14 +179,36 @@ sp<ISurface> Client::createSurface(
         }
     };
 
-    sp<MessageBase> msg = new MessageCreateLayer(mFlinger.get(),
+    MessageCreateLayer msg(mFlinger.get(),
             params, name, this, w, h, format, flags);
     mFlinger->postMessageSync(msg);
-    return static_cast<MessageCreateLayer*>( msg.get() )->getResult();
+    return msg.getResult();
 }
 status_t Client::destroySurface(SurfaceID sid) {
     return mFlinger->onLayerRemoved(this, sid);
 }
 
+sp<IMemoryHeap> Client::getStateChannel() {
+    Mutex::Autolock _l(mLock);
+    if (mStateChannel == NULL) {
+        sp<LayerStateChannel> channel(
+                new LayerStateChannel(kStateChannelSize));
+        if (channel->initCheck() != NO_ERROR) {
+            return NULL;
+        }
+        mStateChannel = channel;
+    }
+    return mStateChannel->getHeap();
+}
+
+void Client::signalStateChannel() {
+    mFlinger->signalLayerStateChannel(this);
+}
+
+sp<LayerStateChannel> Client::getLayerStateChannel() const {
+    Mutex::Autolock _l(mLock);
+    return mStateChannel;
+}
+
 // ---------------------------------------------------------------------------
 }; // namespace android
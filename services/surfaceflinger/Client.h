@@ -21,8 +21,8 @@
 #include <sys/types.h>
 
 #include <utils/Errors.h>
-#include <utils/KeyedVector.h>
 #include <utils/Mutex.h>
+#include <utils/Vector.h>
 
 #include <gui/ISurfaceComposerClient.h>
 
@@ -31,6 +31,7 @@ namespace android {
 // ---------------------------------------------------------------------------
 
 class LayerBaseClient;
+class LayerStateChannel;
 class SurfaceFlinger;
 
 // ---------------------------------------------------------------------------
@@ -43,6 +44,9 @@ public:
 
     status_t initCheck() const;
 
+    // the process that created the connection
+    pid_t getPid() const { return mPid; }
+
     // protected by SurfaceFlinger::mStateLock
     size_t attachLayer(const sp<LayerBaseClient>& layer);
 
@@ -50,6 +54,9 @@ public:
 
     sp<LayerBaseClient> getLayerUser(int32_t i) const;
 
+    // NULL until the client asks for one
+    sp<LayerStateChannel> getLayerStateChannel() const;
+
 private:
     // ISurfaceComposerClient interface
     virtual sp<ISurface> createSurface(
@@ -59,15 +66,36 @@ private:
 
     virtual status_t destroySurface(SurfaceID surfaceId);
 
+    virtual sp<IMemoryHeap> getStateChannel();
+
+    virtual void signalStateChannel();
+
     virtual status_t onTransact(
         uint32_t code, const Parcel& data, Parcel* reply, uint32_t flags);
 
+    // a layer's name is the index of its slot in mLayers, with the slot's
+    // generation in the upper bits so that names of destroyed layers
+    // don't resolve to the layer that reuses the slot
+    enum {
+        SLOT_BITS       = 20,
+        SLOT_MASK       = (1 << SLOT_BITS) - 1,
+        GENERATION_MASK = 0x7FF
+    };
+
+    struct LayerSlot {
+        LayerSlot() : generation(1) { }
+        wp<LayerBaseClient> layer;
+        uint32_t generation;
+    };
+
     // constant
     sp<SurfaceFlinger> mFlinger;
+    const pid_t mPid;
 
     // protected by mLock
-    DefaultKeyedVector< size_t, wp<LayerBaseClient> > mLayers;
-    size_t mNameGenerator;
+    Vector<LayerSlot> mLayers;
+    Vector<uint32_t> mFreeSlots;
+    sp<LayerStateChannel> mStateChannel;
 
     // thread-safe
     mutable Mutex mLock;
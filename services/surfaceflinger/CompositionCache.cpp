@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include <GLES/gl.h>
+#include <GLES/glext.h>
+
+#include <binder/IBinder.h>
+
+#include <utils/Log.h>
+#include <utils/Trace.h>
+
+#include <ui/GraphicBuffer.h>
+
+#include "CompositionCache.h"
+#include "DisplayDevice.h"
+#include "GLExtensions.h"
+#include "GLStateCache.h"
+#include "LayerBase.h"
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+// the cache is only worth a copy if it holds at least this many layers
+static const size_t MIN_CACHED_LAYERS = 2;
+
+// the buffer is released after this many compositions without the cache
+static const uint32_t MAX_UNUSED_FRAMES = 120;
+
+bool CompositionCache::LayerState::operator == (const LayerState& rhs) const
+{
+    if (layer != rhs.layer || sequence != rhs.sequence ||
+            updated != rhs.updated) {
+        return false;
+    }
+    // regions are compared rectangle by rectangle: the same rectangles
+    // always mean the same region, and the other way around it only costs
+    // a composition without the cache
+    size_t count, rhsCount;
+    const Rect* rects = visibleRegion.getArray(&count);
+    const Rect* rhsRects = rhs.visibleRegion.getArray(&rhsCount);
+    if (count != rhsCount) {
+        return false;
+    }
+    for (size_t i=0 ; i<count ; i++) {
+        if (rects[i] != rhsRects[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+CompositionCache::CompositionCache()
+    : mOrientation(0), mDisplay(EGL_NO_DISPLAY), mImage(EGL_NO_IMAGE_KHR),
+      mTextureName(0), mFramebufferName(0), mFailed(false),
+      mUnusedFrames(0), mHits(0), mRenders(0)
+{
+}
+
+CompositionCache::~CompositionCache()
+{
+    release();
+}
+
+void CompositionCache::release()
+{
+    if (mFramebufferName) {
+        glDeleteFramebuffersOES(1, &mFramebufferName);
+        mFramebufferName = 0;
+    }
+    if (mTextureName) {
+        glDeleteTextures(1, &mTextureName);
+        mTextureName = 0;
+        // the name can be handed out again, bound or not
+        GLStateCache::getInstance().invalidate();
+    }
+    if (mImage != EGL_NO_IMAGE_KHR) {
+        eglDestroyImageKHR(mDisplay, mImage);
+        mImage = EGL_NO_IMAGE_KHR;
+    }
+    mBuffer.clear();
+    mCachedStates.clear();
+}
+
+bool CompositionCache::allocate(EGLDisplay dpy, uint32_t w, uint32_t h)
+{
+    if (mBuffer != 0 && mBuffer->getWidth() == w && mBuffer->getHeight() == h) {
+        return true;
+    }
+    release();
+
+    mBuffer = new GraphicBuffer(w, h, PIXEL_FORMAT_RGBA_8888,
+            GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE);
+    if (mBuffer->initCheck() != NO_ERROR) {
+        ALOGE("composition cache: can't allocate a %ux%u buffer", w, h);
+        release();
+        return false;
+    }
+
+    EGLint attrs[] = {
+        EGL_IMAGE_PRESERVED_KHR,    EGL_TRUE,
+        EGL_NONE,
+    };
+    mDisplay = dpy;
+    mImage = eglCreateImageKHR(dpy, EGL_NO_CONTEXT,
+            EGL_NATIVE_BUFFER_ANDROID,
+            (EGLClientBuffer)mBuffer->getNativeBuffer(), attrs);
+    if (mImage == EGL_NO_IMAGE_KHR) {
+        ALOGE("composition cache: eglCreateImageKHR failed (%#x)",
+                eglGetError());
+        release();
+        return false;
+    }
+
+    // make sure to clear all GL error flags
+    while ( glGetError() != GL_NO_ERROR ) ;
+
+    glGenTextures(1, &mTextureName);
+    glBindTexture(GL_TEXTURE_2D, mTextureName);
+    glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, (GLeglImageOES)mImage);
+    glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    GLStateCache::getInstance().invalidate();
+
+    glGenFramebuffersOES(1, &mFramebufferName);
+    glBindFramebufferOES(GL_FRAMEBUFFER_OES, mFramebufferName);
+    glFramebufferTexture2DOES(GL_FRAMEBUFFER_OES,
+            GL_COLOR_ATTACHMENT0_OES, GL_TEXTURE_2D, mTextureName, 0);
+    const GLenum status = glCheckFramebufferStatusOES(GL_FRAMEBUFFER_OES);
+    glBindFramebufferOES(GL_FRAMEBUFFER_OES, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE_OES || glGetError() != GL_NO_ERROR) {
+        ALOGE("composition cache: can't render into the cache (%#x)", status);
+        release();
+        return false;
+    }
+    return true;
+}
+
+size_t CompositionCache::update(const sp<const DisplayDevice>& hw,
+        EGLDisplay dpy, size_t count, uint32_t stableFrames)
+{
+    const Vector< sp<LayerBase> >& layers(hw->getVisibleLayersSortedByZ());
+    const Transform& tr(hw->getTransform());
+
+    // count how many compositions in a row each bottom layer was the same
+    Vector<LayerState> states;
+    Vector<uint32_t> frames;
+    states.setCapacity(count);
+    frames.setCapacity(count);
+    size_t stable = 0;
+    for (size_t i=0 ; i<count ; i++) {
+        const sp<LayerBase>& layer(layers[i]);
+        LayerState state;
+        state.layer = layer->sequence;
+        state.sequence = layer->drawingState().sequence;
+        state.updated = layer->getLastUpdateTime();
+        state.visibleRegion = tr.transform(layer->visibleRegion);
+        uint32_t n = 0;
+        if (i < mStates.size() && mStates[i] == state) {
+            n = mStableFrames[i] + 1;
+        }
+        if (stable == i && n >= stableFrames) {
+            stable++;
+        }
+        states.add(state);
+        frames.add(n);
+    }
+    mStates = states;
+    mStableFrames = frames;
+
+    if (mFailed || stable < MIN_CACHED_LAYERS) {
+        if (mBuffer != 0 && ++mUnusedFrames >= MAX_UNUSED_FRAMES) {
+            release();
+        }
+        return 0;
+    }
+    mUnusedFrames = 0;
+
+    // the cache is still valid if it holds these very layers in the same
+    // orientation, which the visible regions alone don't tell
+    bool valid = mBuffer != 0 && mOrientation == hw->getOrientation() &&
+            mCachedStates.size() == stable;
+    for (size_t i=0 ; valid && i<stable ; i++) {
+        valid = mCachedStates[i] == states[i];
+    }
+    if (!valid) {
+        if (!allocate(dpy, hw->getWidth(), hw->getHeight()) ||
+                !render(hw, stable)) {
+            // don't try again on this display
+            mFailed = true;
+            release();
+            return 0;
+        }
+        mCachedStates.clear();
+        mCachedStates.appendArray(states.array(), stable);
+        mOrientation = hw->getOrientation();
+        mRenders++;
+    }
+    mHits++;
+    return stable;
+}
+
+bool CompositionCache::render(const sp<const DisplayDevice>& hw, size_t count)
+{
+    ATRACE_CALL();
+
+    glBindFramebufferOES(GL_FRAMEBUFFER_OES, mFramebufferName);
+    glDisable(GL_SCISSOR_TEST);
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    // the layers are drawn whole, as they would be in a full composition
+    const Vector< sp<LayerBase> >& layers(hw->getVisibleLayersSortedByZ());
+    const Transform& tr(hw->getTransform());
+    for (size_t i=0 ; i<count ; i++) {
+        const sp<LayerBase>& layer(layers[i]);
+        const Region clip(tr.transform(layer->visibleRegion));
+        if (!clip.isEmpty()) {
+            layer->draw(hw, clip);
+        }
+    }
+
+    glBindFramebufferOES(GL_FRAMEBUFFER_OES, 0);
+    return glGetError() == GL_NO_ERROR;
+}
+
+void CompositionCache::draw(const sp<const DisplayDevice>& hw,
+        const Region& clip) const
+{
+    // the texture has the size of the display, drawn as is
+    const GLfloat w = hw->getWidth();
+    const GLfloat h = hw->getHeight();
+
+    GLStateCache& gl(GLStateCache::getInstance());
+    gl.setBlending(false);
+    gl.setTexture(GL_TEXTURE_2D, mTextureName);
+    gl.setTexEnvMode(GL_REPLACE);
+    gl.setTextureMatrix(NULL);
+    gl.drawRegion(clip, w, h, true);
+}
+
+void CompositionCache::dump(String8& result) const
+{
+    result.appendFormat("   composition cache: %u layers, %s, hits=%u, renders=%u\n",
+            mCachedStates.size(), mBuffer != 0 ? "allocated" : "released",
+            mHits, mRenders);
+}
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SF_COMPOSITION_CACHE_H
+#define ANDROID_SF_COMPOSITION_CACHE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES/gl.h>
+
+#include <utils/RefBase.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+#include <ui/Region.h>
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+class DisplayDevice;
+class GraphicBuffer;
+
+/*
+ * CompositionCache flattens the bottom layers of a display that are
+ * composed with GLES into a single texture while they don't change, so
+ * that each frame copies that texture instead of drawing all of them.
+ *
+ * A layer is stable once its buffer, its drawing state and its visible
+ * region have been the same for a given number of compositions. The
+ * longest run of stable layers at the bottom of the stack is rendered
+ * into an offscreen buffer cleared to transparent, which is exactly what
+ * the framebuffer holds once they are drawn, since the framebuffer is
+ * cleared (or the wormhole is drawn) to the same color first. Only the
+ * bottom of the stack is cached, because translucent layers drawn in the
+ * middle of the stack don't blend the same way into an empty buffer as
+ * they do into the framebuffer.
+ *
+ * This is only accessed from the main thread, with the GL context current.
+ */
+class CompositionCache
+{
+public:
+    CompositionCache();
+    ~CompositionCache();
+
+    // Called once per GLES composition of hw, before anything is drawn,
+    // with the number of layers at the bottom of its visible layers that
+    // are composed with GLES. Renders the cache if needed and returns how
+    // many of these layers it holds, in which case draw() must be used
+    // instead of drawing them, or 0.
+    size_t update(const sp<const DisplayDevice>& hw, EGLDisplay dpy,
+            size_t count, uint32_t stableFrames);
+
+    // Copies the cache into the given region, in screen space.
+    void draw(const sp<const DisplayDevice>& hw, const Region& clip) const;
+
+    // Drops the cache and its buffer.
+    void release();
+
+    void dump(String8& result) const;
+
+private:
+    struct LayerState {
+        int32_t     layer;          // LayerBase::sequence, unique per layer
+        int32_t     sequence;       // LayerBase::State::sequence
+        nsecs_t     updated;        // LayerBase::getLastUpdateTime()
+        Region      visibleRegion;  // in screen space
+        bool operator == (const LayerState& rhs) const;
+        inline bool operator != (const LayerState& rhs) const {
+            return !operator == (rhs);
+        }
+    };
+
+    bool allocate(EGLDisplay dpy, uint32_t w, uint32_t h);
+    bool render(const sp<const DisplayDevice>& hw, size_t count);
+
+    // how many compositions in a row each layer has been the same, from
+    // the bottom of the stack
+    Vector<LayerState> mStates;
+    Vector<uint32_t> mStableFrames;
+
+    // the layers in the cache
+    Vector<LayerState> mCachedStates;
+    int mOrientation;
+
+    EGLDisplay mDisplay;
+    sp<GraphicBuffer> mBuffer;
+    EGLImageKHR mImage;
+    GLuint mTextureName;
+    GLuint mFramebufferName;
+    bool mFailed;
+
+    // compositions since the cache was last used, it is released when
+    // it isn't used for a while
+    uint32_t mUnusedFrames;
+
+    uint32_t mHits;
+    uint32_t mRenders;
+};
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
+
+#endif // ANDROID_SF_COMPOSITION_CACHE_H
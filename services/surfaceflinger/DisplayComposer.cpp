@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <EGL/egl.h>
+#include <GLES/gl.h>
+
+#include <binder/IBinder.h>
+
+#include <utils/Log.h>
+#include <utils/Timers.h>
+#include <utils/Trace.h>
+
+#include "DisplayComposer.h"
+#include "DisplayDevice.h"
+#include "GLStateCache.h"
+#include "SurfaceFlinger.h"
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+DisplayComposer::DisplayComposer(SurfaceFlinger& flinger,
+        const sp<const DisplayDevice>& hw,
+        EGLDisplay display, EGLConfig config, EGLContext shareContext)
+    : Thread(false),
+      mFlinger(flinger),
+      mDisplayDevice(hw),
+      mEGLDisplay(display),
+      mEGLContext(EGL_NO_CONTEXT),
+      mGLState(NULL),
+      mInitialized(false),
+      mPending(false),
+      mRepaintEverything(false),
+      mSkipped(0),
+      mFrames(0),
+      mLastDuration(0)
+{
+    // the context is created here, so that a failure is known right away
+    mEGLContext = SurfaceFlinger::createGLContext(display, config, shareContext);
+}
+
+status_t DisplayComposer::initCheck() const
+{
+    return mEGLContext != EGL_NO_CONTEXT ? NO_ERROR : NO_INIT;
+}
+
+void DisplayComposer::onFirstRef()
+{
+    if (initCheck() == NO_ERROR) {
+        run("DisplayComposer", PRIORITY_URGENT_DISPLAY);
+    }
+}
+
+void DisplayComposer::compose(bool repaintEverything)
+{
+    Mutex::Autolock _l(mLock);
+    mRepaintEverything = repaintEverything;
+    mPending = true;
+    mCondition.broadcast();
+}
+
+void DisplayComposer::waitForComposition()
+{
+    Mutex::Autolock _l(mLock);
+    while (mPending) {
+        mCondition.wait(mLock);
+    }
+}
+
+void DisplayComposer::stop()
+{
+    {
+        Mutex::Autolock _l(mLock);
+        requestExit();
+        mCondition.broadcast();
+    }
+    if (initCheck() == NO_ERROR) {
+        join();
+        eglDestroyContext(mEGLDisplay, mEGLContext);
+        mEGLContext = EGL_NO_CONTEXT;
+    }
+}
+
+void DisplayComposer::initializeGL()
+{
+    // the state SurfaceFlinger::initializeGL() sets in the main context
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glShadeModel(GL_FLAT);
+    if (mFlinger.mUseDithering == 2) {
+        glEnable(GL_DITHER);
+    } else {
+        glDisable(GL_DITHER);
+    }
+    glDisable(GL_CULL_FACE);
+    mGLState = &GLStateCache::getInstance();
+    mInitialized = true;
+}
+
+bool DisplayComposer::threadLoop()
+{
+    bool repaintEverything;
+    {
+        Mutex::Autolock _l(mLock);
+        while (!mPending && !exitPending()) {
+            mCondition.wait(mLock);
+        }
+        if (exitPending()) {
+            return false;
+        }
+        repaintEverything = mRepaintEverything;
+    }
+
+    ATRACE_CALL();
+    const nsecs_t start = systemTime();
+    if (DisplayDevice::makeCurrent(mEGLDisplay, mDisplayDevice, mEGLContext)) {
+        if (!mInitialized) {
+            initializeGL();
+        }
+        // with our context current on the display's surface, the
+        // makeCurrent() done while composing it doesn't change anything
+        mFlinger.composeDisplay(mDisplayDevice, repaintEverything, NULL);
+
+        // The layers' buffers are released with fences created in the
+        // main context, which don't cover what this one still reads.
+        glFinish();
+        eglMakeCurrent(mEGLDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                EGL_NO_CONTEXT);
+        mFrames++;
+    } else {
+        ALOGE("DisplayComposer: makeCurrent failed for display %s (%#x)",
+                mDisplayDevice->getDisplayName().string(), eglGetError());
+    }
+    mLastDuration = systemTime() - start;
+
+    Mutex::Autolock _l(mLock);
+    mPending = false;
+    mCondition.broadcast();
+    return true;
+}
+
+void DisplayComposer::dump(String8& result) const
+{
+    result.appendFormat("   composer thread: frames=%u, composed by main "
+            "thread=%u, last=%.2f ms\n",
+            mFrames, mSkipped, mLastDuration / 1000000.0);
+    if (mGLState) {
+        result.append("   ");
+        mGLState->dump(result);
+    }
+}
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
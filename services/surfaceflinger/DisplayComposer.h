@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SF_DISPLAY_COMPOSER_H
+#define ANDROID_SF_DISPLAY_COMPOSER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <EGL/egl.h>
+
+#include <utils/String8.h>
+#include <utils/threads.h>
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+class DisplayDevice;
+class GLStateCache;
+class SurfaceFlinger;
+
+/*
+ * DisplayComposer composes a display other than the primary one on its
+ * own thread, so that its composition runs alongside the primary
+ * display's instead of adding to it.
+ *
+ * The thread has its own GL context, in the share group of the main
+ * context so that it can sample the layers' textures. Each refresh, the
+ * main thread calls compose() once the frame's buffers are latched, then
+ * waitForComposition() before posting the frame; in between the thread
+ * owns the display. It only has the display's surface current while it
+ * composes, so that the main thread can still compose it the usual way.
+ */
+class DisplayComposer : public Thread
+{
+public:
+    DisplayComposer(SurfaceFlinger& flinger,
+            const sp<const DisplayDevice>& hw,
+            EGLDisplay display, EGLConfig config, EGLContext shareContext);
+
+    // NO_INIT if the context couldn't be created, the thread isn't started
+    status_t initCheck() const;
+
+    const sp<const DisplayDevice>& getDisplay() const { return mDisplayDevice; }
+
+    // starts composing the display, as SurfaceFlinger::composeDisplay()
+    void compose(bool repaintEverything);
+
+    // returns once the composition started by compose() is done
+    void waitForComposition();
+
+    // the main thread composed the display itself
+    void skippedFrame() { mSkipped++; }
+
+    // stops the thread and releases its context, must not be composing
+    void stop();
+
+    void dump(String8& result) const;
+
+private:
+    virtual bool threadLoop();
+    virtual void onFirstRef();
+    void initializeGL();
+
+    SurfaceFlinger& mFlinger;
+    const sp<const DisplayDevice> mDisplayDevice;
+    const EGLDisplay mEGLDisplay;
+    EGLContext mEGLContext;
+    // composer thread
+    GLStateCache* mGLState;
+    bool mInitialized;
+
+    mutable Mutex mLock;
+    Condition mCondition;
+    bool mPending;
+    bool mRepaintEverything;
+
+    // main thread
+    uint32_t mSkipped;
+    // composer thread, read racily by dump()
+    uint32_t mFrames;
+    nsecs_t mLastDuration;
+};
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
+
+#endif // ANDROID_SF_DISPLAY_COMPOSER_H
@@ -25,6 +25,7 @@
 #include <utils/Log.h>
 
 #include <ui/DisplayInfo.h>
+#include <ui/GraphicBuffer.h>
 #include <ui/PixelFormat.h>
 
 #include <gui/SurfaceTextureClient.h>
@@ -78,7 +79,9 @@ DisplayDevice::DisplayDevice(
         const sp<ANativeWindow>& nativeWindow,
         const sp<FramebufferSurface>& framebufferSurface,
         EGLConfig config)
-    : mFlinger(flinger),
+    : lastFrameGlesOnly(false),
+      lastFramebufferTargetValid(false),
+      mFlinger(flinger),
       mType(type), mHwcDisplayId(-1),
       mDisplayToken(displayToken),
       mNativeWindow(nativeWindow),
@@ -125,12 +128,34 @@ EGLSurface DisplayDevice::getEGLSurface() const {
     return mSurface;
 }
 
+sp<GraphicBuffer> DisplayDevice::getFramebufferTargetBuffer() const {
+    if (mFramebufferSurface == NULL) {
+        return NULL;
+    }
+    return mFramebufferSurface->getCurrentBuffer();
+}
+
+sp<GraphicBuffer> DisplayDevice::holdFramebufferTargetBuffer() const {
+    if (mFramebufferSurface == NULL) {
+        return NULL;
+    }
+    return mFramebufferSurface->holdCurrentBuffer();
+}
+
+void DisplayDevice::releaseFramebufferTargetBuffer(
+        const sp<GraphicBuffer>& buffer) const {
+    if (mFramebufferSurface != NULL) {
+        mFramebufferSurface->releaseHeldBuffer(buffer);
+    }
+}
+
 void DisplayDevice::init(EGLConfig config)
 {
 #ifndef BOARD_EGL_NEEDS_LEGACY_FB
     ANativeWindow* const window = mNativeWindow.get();
 #else
-    ANativeWindow* const window = new FramebufferNativeWindow();
+    mLegacyFramebuffer = new FramebufferNativeWindow();
+    ANativeWindow* const window = mLegacyFramebuffer.get();
 #endif
 
     int format;
@@ -147,6 +172,22 @@ void DisplayDevice::init(EGLConfig config)
     eglQuerySurface(display, surface, EGL_WIDTH,  &mDisplayWidth);
     eglQuerySurface(display, surface, EGL_HEIGHT, &mDisplayHeight);
 
+    if (mFlinger->usePartialUpdates()) {
+        // a partial redraw needs the back buffer to still hold the last frame
+        EGLint surfaceType = 0;
+        eglGetConfigAttrib(display, config, EGL_SURFACE_TYPE, &surfaceType);
+        if ((surfaceType & EGL_SWAP_BEHAVIOR_PRESERVED_BIT) &&
+                eglSurfaceAttrib(display, surface,
+                        EGL_SWAP_BEHAVIOR, EGL_BUFFER_PRESERVED)) {
+            mFlags |= BUFFER_PRESERVED;
+        }
+        // and if the framebuffer supports it, only post what was redrawn
+        if ((mFlags & BUFFER_PRESERVED) && mFramebufferSurface != NULL &&
+                mFramebufferSurface->isUpdateOnDemand()) {
+            mFlags |= PARTIAL_UPDATES;
+        }
+    }
+
     mDisplay = display;
     mSurface = surface;
     mFormat  = format;
@@ -216,6 +257,15 @@ void DisplayDevice::flip(const Region& dirty) const
 }
 
 void DisplayDevice::swapBuffers(HWComposer& hwc) const {
+    if (mFlags & PARTIAL_UPDATES) {
+        // the frame is posted as soon as it's queued, either by
+        // eglSwapBuffers() below or by HWComposer::commit()
+        const Rect b(swapRegion.bounds());
+        if (!b.isEmpty()) {
+            mFramebufferSurface->setUpdateRectangle(b);
+        }
+    }
+
     EGLBoolean success = EGL_TRUE;
     if (hwc.initCheck() != NO_ERROR) {
         // no HWC, we call eglSwapBuffers()
@@ -343,6 +393,7 @@ bool DisplayDevice::isScreenAcquired() const {
 void DisplayDevice::setLayerStack(uint32_t stack) {
     mLayerStack = stack;
     dirtyRegion.set(bounds());
+    visibleRegionCache.clear();
 }
 
 // ----------------------------------------------------------------------------
@@ -423,6 +474,7 @@ void DisplayDevice::updateGeometryTransform() {
                 swap(viewport.right, viewport.bottom);
             }
         }
+        mSourceViewport = viewport;
 
         float src_width  = viewport.width();
         float src_height = viewport.height();
@@ -457,12 +509,12 @@ void DisplayDevice::dump(String8& result, char* buffer, size_t SIZE) const {
     snprintf(buffer, SIZE,
         "+ DisplayDevice: %s\n"
         "   type=%x, layerStack=%u, (%4dx%4d), ANativeWindow=%p, orient=%2d (type=%08x), "
-        "flips=%u, isSecure=%d, secureVis=%d, acquired=%d, numLayers=%u\n"
+        "flips=%u, flags=%08x, isSecure=%d, secureVis=%d, acquired=%d, numLayers=%u\n"
         "   v:[%d,%d,%d,%d], f:[%d,%d,%d,%d], "
         "transform:[[%0.3f,%0.3f,%0.3f][%0.3f,%0.3f,%0.3f][%0.3f,%0.3f,%0.3f]]\n",
         mDisplayName.string(), mType,
         mLayerStack, mDisplayWidth, mDisplayHeight, mNativeWindow.get(),
-        mOrientation, tr.getType(), getPageFlipCount(),
+        mOrientation, tr.getType(), getPageFlipCount(), mFlags,
         mIsSecure, mSecureLayerVisible, mScreenAcquired, mVisibleLayersSortedByZ.size(),
         mViewport.left, mViewport.top, mViewport.right, mViewport.bottom,
         mFrame.left, mFrame.top, mFrame.right, mFrame.bottom,
@@ -477,4 +529,11 @@ void DisplayDevice::dump(String8& result, char* buffer, size_t SIZE) const {
         mFramebufferSurface->dump(fbtargetDump);
         result.append(fbtargetDump);
     }
+#ifdef BOARD_EGL_NEEDS_LEGACY_FB
+    if (mLegacyFramebuffer != NULL) {
+        mLegacyFramebuffer->dump(result);
+    }
+#endif
+    compositionCache.dump(result);
+    mirror.dump(result);
 }
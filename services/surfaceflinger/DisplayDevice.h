@@ -26,18 +26,26 @@
 #include <EGL/eglext.h>
 
 #include <utils/Mutex.h>
+#include <utils/SortedVector.h>
 #include <utils/Timers.h>
+#include <utils/Vector.h>
 
 #include <hardware/hwcomposer_defs.h>
 
+#include "CompositionCache.h"
+#include "DisplayMirror.h"
+#include "LatencyHistogram.h"
 #include "Transform.h"
+#include "VisibleRegionCache.h"
 
 struct ANativeWindow;
 
 namespace android {
 
 class DisplayInfo;
+class FramebufferNativeWindow;
 class FramebufferSurface;
+class GraphicBuffer;
 class LayerBase;
 class SurfaceFlinger;
 class HWComposer;
@@ -49,8 +57,38 @@ public:
     mutable Region dirtyRegion;
     // region in screen space
     mutable Region swapRegion;
+    // whether the last frame was composed entirely with GLES, in which case
+    // a preserved back buffer holds all of it
+    mutable bool lastFrameGlesOnly;
     // region in screen space
     Region undefinedRegion;
+    // results of the last visible region pass on this display's layer stack
+    VisibleRegionCache visibleRegionCache;
+    // time spent composing this display with GLES, including swapBuffers
+    mutable LatencyHistogram compositionHistogram;
+
+    // how h/w composer composed each layer of the last frame, to tell
+    // whether the GLES composited part of it, which is in the framebuffer
+    // target, can be posted again as is
+    struct HwcLayerState {
+        int32_t layer;              // LayerBase::sequence, unique per layer
+        int32_t compositionType;
+        uint32_t hints;
+    };
+    mutable Vector<HwcLayerState> lastHwcLayers;
+    // region in screen space that the last framebuffer target was drawn from
+    mutable Region lastFramebufferRegion;
+    mutable bool lastFramebufferTargetValid;
+    // the layers that are kept out of h/w composer's overlays because they
+    // haven't been updated lately (see SurfaceFlinger::setUpHWComposer()),
+    // by LayerBase::sequence
+    mutable SortedVector<int32_t> hwcStaticLayers;
+    // the bottom layers composed with GLES, flattened while they don't
+    // change (see SurfaceFlinger::doComposeSurfaces())
+    mutable CompositionCache compositionCache;
+    // draws another display's last frame when this one mirrors it
+    // (see SurfaceFlinger::doComposition())
+    mutable DisplayMirror mirror;
 
     enum DisplayType {
         DISPLAY_ID_INVALID = -1,
@@ -61,8 +99,9 @@ public:
     };
 
     enum {
-        PARTIAL_UPDATES = 0x00020000, // video driver feature
-        SWAP_RECTANGLE  = 0x00080000,
+        BUFFER_PRESERVED = 0x00010000,
+        PARTIAL_UPDATES  = 0x00020000, // video driver feature
+        SWAP_RECTANGLE   = 0x00080000,
     };
 
     DisplayDevice(
@@ -95,6 +134,13 @@ public:
 
     EGLSurface  getEGLSurface() const;
 
+    // the buffer last posted to the framebuffer target, or NULL
+    sp<GraphicBuffer> getFramebufferTargetBuffer() const;
+    // same, but the buffer isn't drawn into again until it's given back
+    // with releaseFramebufferTargetBuffer(); NULL if that's not possible
+    sp<GraphicBuffer> holdFramebufferTargetBuffer() const;
+    void releaseFramebufferTargetBuffer(const sp<GraphicBuffer>& buffer) const;
+
     void                    setVisibleLayersSortedByZ(const Vector< sp<LayerBase> >& layers);
     const Vector< sp<LayerBase> >& getVisibleLayersSortedByZ() const;
     bool                    getSecureLayerVisible() const;
@@ -106,6 +152,8 @@ public:
     int                     getOrientation() const { return mOrientation; }
     const Transform&        getTransform() const { return mGlobalTransform; }
     const Rect&             getViewport() const { return mViewport; }
+    // the viewport, or the whole display if it was never set
+    const Rect&             getSourceViewport() const { return mSourceViewport; }
     const Rect&             getFrame() const { return mFrame; }
     bool                    needsFiltering() const { return mNeedsFiltering; }
 
@@ -164,6 +212,11 @@ private:
     // set if mNativeWindow is a FramebufferSurface
     sp<FramebufferSurface> mFramebufferSurface;
 
+#ifdef BOARD_EGL_NEEDS_LEGACY_FB
+    // the window EGL actually renders into, kept for dump()
+    sp<FramebufferNativeWindow> mLegacyFramebuffer;
+#endif
+
     EGLDisplay      mDisplay;
     EGLSurface      mSurface;
     EGLContext      mContext;
@@ -201,6 +254,7 @@ private:
     uint32_t mLayerStack;
     int mOrientation;
     Rect mViewport;
+    Rect mSourceViewport;
     Rect mFrame;
     Transform mGlobalTransform;
     bool mNeedsFiltering;
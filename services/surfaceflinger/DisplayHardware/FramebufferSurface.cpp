@@ -40,10 +40,23 @@
 #define NUM_FRAMEBUFFER_SURFACE_BUFFERS (2)
 #endif
 
+// With two buffers, GLES composition that takes most of a vsync period makes
+// SurfaceFlinger wait in dequeueBuffer for HWC to release the previous
+// target. A third buffer is then added for as long as the display is busy.
+#define MAX_FRAMEBUFFER_SURFACE_BUFFERS (3)
+
 // ----------------------------------------------------------------------------
 namespace android {
 // ----------------------------------------------------------------------------
 
+// a frame stalled if dequeueBuffer blocked this long since the previous one
+static const nsecs_t STALL_TIME = 1000000;             // 1 ms
+// the third buffer is added after this many stalled frames within the window
+static const int STALLED_FRAMES_TO_GROW = 3;
+static const nsecs_t STALL_WINDOW = 500000000;         // 500 ms
+// and taken away when a frame comes after this long without any
+static const nsecs_t IDLE_TIME_TO_SHRINK = 1000000000; // 1 s
+
 /*
  * This implements the (main) framebuffer management. This class is used
  * mostly by SurfaceFlinger, but also by command line GL application.
@@ -51,10 +64,21 @@ namespace android {
  */
 
 FramebufferSurface::FramebufferSurface(HWComposer& hwc, int disp) :
-    ConsumerBase(new BufferQueue(true, new GraphicBufferAlloc())),
+    ConsumerBase(new BufferQueue(true, new GraphicBufferAlloc(getpid(),
+            String8("FramebufferSurface")))),
     mDisplayType(disp),
     mCurrentBufferSlot(-1),
     mCurrentBuffer(0),
+    mHeldBufferSlot(BufferQueue::INVALID_BUFFER_SLOT),
+    mBufferCount(NUM_FRAMEBUFFER_SURFACE_BUFFERS),
+    mLastBlockedTime(0),
+    mLastFrameTime(0),
+    mStallWindowStart(0),
+    mStalledFrames(0),
+    mTotalStalledFrames(0),
+    mBufferCountChanges(0),
+    mBufferCountReason("initial"),
+    mBufferCountChangeTime(0),
     mHwc(hwc)
 {
     mName = "FramebufferSurface";
@@ -68,9 +92,54 @@ FramebufferSurface::FramebufferSurface(HWComposer& hwc, int disp) :
     mBufferQueue->setDefaultMaxBufferCount(NUM_FRAMEBUFFER_SURFACE_BUFFERS);
 }
 
+void FramebufferSurface::updateBufferCountLocked() {
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    const nsecs_t blockedTime = mBufferQueue->getDequeueBlockedTime();
+    const bool stalled = blockedTime - mLastBlockedTime >= STALL_TIME;
+    const bool wasIdle = mLastFrameTime &&
+            now - mLastFrameTime >= IDLE_TIME_TO_SHRINK;
+    mLastBlockedTime = blockedTime;
+    mLastFrameTime = now;
+
+    if (now - mStallWindowStart > STALL_WINDOW) {
+        mStallWindowStart = now;
+        mStalledFrames = 0;
+    }
+    if (stalled) {
+        mStalledFrames++;
+        mTotalStalledFrames++;
+    }
+
+    if (mBufferCount < MAX_FRAMEBUFFER_SURFACE_BUFFERS &&
+            mStalledFrames >= STALLED_FRAMES_TO_GROW) {
+        setBufferCountLocked(mBufferCount + 1, "dequeue stalls");
+    } else if (mBufferCount > NUM_FRAMEBUFFER_SURFACE_BUFFERS && wasIdle &&
+            mHeldBuffer == NULL) {
+        // a held buffer needs the extra one, see holdCurrentBuffer()
+        setBufferCountLocked(NUM_FRAMEBUFFER_SURFACE_BUFFERS, "idle");
+    }
+}
+
+void FramebufferSurface::setBufferCountLocked(int count, const char* reason) {
+    status_t err = mBufferQueue->setDefaultMaxBufferCount(count);
+    if (err != NO_ERROR) {
+        ALOGE("error setting the buffer count to %d: %s (%d)",
+                count, strerror(-err), err);
+        return;
+    }
+    ALOGD("FramebufferSurface %d: %d buffers (%s)", mDisplayType, count, reason);
+    mBufferCount = count;
+    mStalledFrames = 0;
+    mBufferCountChanges++;
+    mBufferCountReason = reason;
+    mBufferCountChangeTime = mLastFrameTime;
+}
+
 status_t FramebufferSurface::nextBuffer(sp<GraphicBuffer>& outBuffer, sp<Fence>& outFence) {
     Mutex::Autolock lock(mMutex);
 
+    updateBufferCountLocked();
+
     BufferQueue::BufferItem item;
     status_t err = acquireBufferLocked(&item);
     if (err == BufferQueue::NO_BUFFER_AVAILABLE) {
@@ -90,7 +159,8 @@ status_t FramebufferSurface::nextBuffer(sp<GraphicBuffer>& outBuffer, sp<Fence>&
     // releaseBuffer call and we should be in the same state we'd be in if we
     // had released the old buffer first.
     if (mCurrentBufferSlot != BufferQueue::INVALID_BUFFER_SLOT &&
-        item.mBuf != mCurrentBufferSlot) {
+        item.mBuf != mCurrentBufferSlot &&
+        mCurrentBufferSlot != mHeldBufferSlot) {
         // Release the previous buffer.
         err = releaseBufferLocked(mCurrentBufferSlot, EGL_NO_DISPLAY,
                 EGL_NO_SYNC_KHR);
@@ -127,6 +197,9 @@ void FramebufferSurface::freeBufferLocked(int slotIndex) {
     if (slotIndex == mCurrentBufferSlot) {
         mCurrentBufferSlot = BufferQueue::INVALID_BUFFER_SLOT;
     }
+    if (slotIndex == mHeldBufferSlot) {
+        mHeldBufferSlot = BufferQueue::INVALID_BUFFER_SLOT;
+    }
 }
 
 status_t FramebufferSurface::setReleaseFenceFd(int fenceFd) {
@@ -142,9 +215,16 @@ status_t FramebufferSurface::setReleaseFenceFd(int fenceFd) {
     return err;
 }
 
+bool FramebufferSurface::isUpdateOnDemand() const
+{
+    return mHwc.fbSupportsUpdateRect();
+}
+
 status_t FramebufferSurface::setUpdateRectangle(const Rect& r)
 {
-    return INVALID_OPERATION;
+    // the FB HAL only updates r on the next post(), which happens when
+    // the frame is queued, so this must be called before eglSwapBuffers()
+    return mHwc.fbSetUpdateRect(r);
 }
 
 status_t FramebufferSurface::compositionComplete()
@@ -152,8 +232,54 @@ status_t FramebufferSurface::compositionComplete()
     return mHwc.fbCompositionComplete();
 }
 
+sp<GraphicBuffer> FramebufferSurface::getCurrentBuffer() const {
+    Mutex::Autolock lock(mMutex);
+    return mCurrentBuffer;
+}
+
+sp<GraphicBuffer> FramebufferSurface::holdCurrentBuffer() {
+    Mutex::Autolock lock(mMutex);
+    // the producer must still be able to dequeue a buffer while the one
+    // on screen is acquired, or it would block forever
+    if (mBufferCount < 3 ||
+            mCurrentBufferSlot == BufferQueue::INVALID_BUFFER_SLOT ||
+            mHeldBuffer != NULL) {
+        return NULL;
+    }
+    mHeldBufferSlot = mCurrentBufferSlot;
+    mHeldBuffer = mCurrentBuffer;
+    return mHeldBuffer;
+}
+
+void FramebufferSurface::releaseHeldBuffer(const sp<GraphicBuffer>& buffer) {
+    Mutex::Autolock lock(mMutex);
+    if (buffer == NULL || buffer != mHeldBuffer) {
+        return;
+    }
+    if (mHeldBufferSlot != BufferQueue::INVALID_BUFFER_SLOT &&
+            mHeldBufferSlot != mCurrentBufferSlot) {
+        // nextBuffer() has moved on, give it back now
+        status_t err = releaseBufferLocked(mHeldBufferSlot, EGL_NO_DISPLAY,
+                EGL_NO_SYNC_KHR);
+        ALOGE_IF(err != NO_ERROR && err != BufferQueue::STALE_BUFFER_SLOT,
+                "error releasing held buffer: %s (%d)", strerror(-err), err);
+    }
+    mHeldBufferSlot = BufferQueue::INVALID_BUFFER_SLOT;
+    mHeldBuffer = NULL;
+}
+
 void FramebufferSurface::dump(String8& result) {
     mHwc.fbDump(result);
+    {
+        Mutex::Autolock lock(mMutex);
+        const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        result.appendFormat("  FramebufferSurface: %d buffers (%s, %.1f s ago), "
+                "%u changes, %u frames stalled, dequeue blocked %.2f ms\n",
+                mBufferCount, mBufferCountReason,
+                mBufferCountChangeTime ? (now - mBufferCountChangeTime) / 1e9 : 0.0,
+                mBufferCountChanges, mTotalStalledFrames,
+                mLastBlockedTime / 1e6);
+    }
     ConsumerBase::dump(result);
 }
 
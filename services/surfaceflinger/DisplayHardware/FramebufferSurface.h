@@ -36,7 +36,8 @@ class FramebufferSurface : public ConsumerBase {
 public:
     FramebufferSurface(HWComposer& hwc, int disp);
 
-    bool isUpdateOnDemand() const { return false; }
+    // whether setUpdateRectangle() can restrict what the next post updates
+    bool isUpdateOnDemand() const;
     status_t setUpdateRectangle(const Rect& updateRect);
     status_t compositionComplete();
 
@@ -50,6 +51,16 @@ public:
     // when finished with it.
     status_t setReleaseFenceFd(int fenceFd);
 
+    // returns the buffer last posted, or NULL
+    sp<GraphicBuffer> getCurrentBuffer() const;
+
+    // keeps the buffer last posted from going back to the BufferQueue, so
+    // that it can be read after the next frames are posted, until
+    // releaseHeldBuffer() is called. Returns NULL if there's no current
+    // buffer, if one is already held or if too few buffers would be left.
+    sp<GraphicBuffer> holdCurrentBuffer();
+    void releaseHeldBuffer(const sp<GraphicBuffer>& buffer);
+
 private:
     virtual ~FramebufferSurface() { }; // this class cannot be overloaded
 
@@ -61,6 +72,12 @@ private:
     // BufferQueue.  The new buffer is returned in the 'buffer' argument.
     status_t nextBuffer(sp<GraphicBuffer>& outBuffer, sp<Fence>& outFence);
 
+    // updateBufferCountLocked adds a buffer when the producer keeps blocking
+    // in dequeueBuffer, and takes it away when a frame comes after the
+    // display was idle. It's called for each frame.
+    void updateBufferCountLocked();
+    void setBufferCountLocked(int count, const char* reason);
+
     // mDisplayType must match one of the HWC display types
     int mDisplayType;
 
@@ -73,6 +90,27 @@ private:
     // no current buffer.
     sp<GraphicBuffer> mCurrentBuffer;
 
+    // the slot and buffer kept by holdCurrentBuffer(), which nextBuffer()
+    // doesn't release.
+    int mHeldBufferSlot;
+    sp<GraphicBuffer> mHeldBuffer;
+
+    // the current buffer count, and what is needed to decide when to change
+    // it: the BufferQueue's dequeue blocked time at the last frame, when the
+    // last frame was posted and the frames that blocked since mStallWindowStart.
+    int mBufferCount;
+    nsecs_t mLastBlockedTime;
+    nsecs_t mLastFrameTime;
+    nsecs_t mStallWindowStart;
+    int mStalledFrames;
+
+    // for dump(): how many frames blocked in dequeueBuffer and how often
+    // the buffer count changed, last for what reason and when.
+    uint32_t mTotalStalledFrames;
+    uint32_t mBufferCountChanges;
+    const char* mBufferCountReason;
+    nsecs_t mBufferCountChangeTime;
+
     // Hardware composer, owned by SurfaceFlinger.
     HWComposer& mHwc;
 };
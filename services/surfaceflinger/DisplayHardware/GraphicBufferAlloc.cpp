@@ -17,6 +17,8 @@
 
 #include <cutils/log.h>
 
+#include <cutils/atomic.h>
+
 #include <ui/GraphicBuffer.h>
 
 #include "DisplayHardware/GraphicBufferAlloc.h"
@@ -25,13 +27,35 @@
 namespace android {
 // ----------------------------------------------------------------------------
 
-GraphicBufferAlloc::GraphicBufferAlloc() {
+Mutex GraphicBufferAlloc::sLock;
+KeyedVector<int32_t, GraphicBufferAlloc::Owner> GraphicBufferAlloc::sOwners;
+int32_t GraphicBufferAlloc::sNextId = 1;
+
+GraphicBufferAlloc::GraphicBufferAlloc(pid_t pid, const String8& name)
+    : mId(android_atomic_inc(&sNextId)) {
 #ifdef QCOM_BSP
     mBufferSize = 0;
 #endif
+    Owner owner;
+    owner.pid = pid;
+    owner.name = name;
+    owner.alive = true;
+    Mutex::Autolock _l(sLock);
+    sOwners.add(mId, owner);
 }
 
 GraphicBufferAlloc::~GraphicBufferAlloc() {
+    GraphicBufferAllocator::get().releaseOwner(mId);
+    OwnerTotals totals;
+    Mutex::Autolock _l(sLock);
+    sOwners.editValueFor(mId).alive = false;
+    GraphicBufferAllocator::get().getOwnerUsage(&totals);
+    pruneOwnersLocked(totals);
+}
+
+void GraphicBufferAlloc::setName(const String8& name) {
+    Mutex::Autolock _l(sLock);
+    sOwners.editValueFor(mId).name = name;
 }
 
 sp<GraphicBuffer> GraphicBufferAlloc::createGraphicBuffer(uint32_t w, uint32_t h,
@@ -39,11 +63,12 @@ sp<GraphicBuffer> GraphicBufferAlloc::createGraphicBuffer(uint32_t w, uint32_t h
 #ifdef QCOM_BSP
     sp<GraphicBuffer> graphicBuffer(new GraphicBuffer(w, h, format,
                                                       usage, mBufferSize));
+    status_t err = graphicBuffer->initCheck();
 #else
-    sp<GraphicBuffer> graphicBuffer(new GraphicBuffer(w, h, format, usage));
+    // a recycled buffer only ever comes back to the same owner
+    sp<GraphicBuffer> graphicBuffer(new GraphicBuffer());
+    status_t err = graphicBuffer->allocOwned(w, h, format, usage, mId);
 #endif
-
-    status_t err = graphicBuffer->initCheck();
     *error = err;
     if (err != 0 || graphicBuffer->handle == 0) {
         if (err == NO_MEMORY) {
@@ -54,15 +79,80 @@ sp<GraphicBuffer> GraphicBufferAlloc::createGraphicBuffer(uint32_t w, uint32_t h
                 w, h, strerror(-err), graphicBuffer->handle);
         return 0;
     }
+
+#ifdef QCOM_BSP
+    GraphicBufferAllocator::get().setOwner(graphicBuffer->handle, mId);
+#endif
     return graphicBuffer;
 }
 
+status_t GraphicBufferAlloc::createGraphicBuffers(uint32_t w, uint32_t h,
+        PixelFormat format, uint32_t usage, size_t count,
+        Vector< sp<GraphicBuffer> >* outBuffers) {
+    outBuffers->setCapacity(outBuffers->size() + count);
+    for (size_t i = 0; i < count; i++) {
+        status_t err;
+        sp<GraphicBuffer> graphicBuffer(
+                createGraphicBuffer(w, h, format, usage, &err));
+        if (graphicBuffer == 0) {
+            return (err != NO_ERROR) ? err : NO_MEMORY;
+        }
+        outBuffers->add(graphicBuffer);
+    }
+    return NO_ERROR;
+}
+
 #ifdef QCOM_BSP
 void GraphicBufferAlloc::setGraphicBufferSize(int size) {
     mBufferSize = size;
 }
 #endif
 
+void GraphicBufferAlloc::pruneOwnersLocked(const OwnerTotals& totals) {
+    for (size_t i = 0; i < sOwners.size(); ) {
+        if (!sOwners.valueAt(i).alive &&
+                totals.indexOfKey(sOwners.keyAt(i)) < 0) {
+            sOwners.removeItemsAt(i);
+        } else {
+            i++;
+        }
+    }
+}
+
+void GraphicBufferAlloc::getUsage(Vector<GraphicMemoryUsage>* usage) {
+    OwnerTotals totals;
+    usage->clear();
+    Mutex::Autolock _l(sLock);
+    GraphicBufferAllocator::get().getOwnerUsage(&totals);
+    pruneOwnersLocked(totals);
+    for (size_t i = 0; i < sOwners.size(); i++) {
+        const Owner& owner(sOwners.valueAt(i));
+        ssize_t index = totals.indexOfKey(sOwners.keyAt(i));
+        if (index < 0) {
+            continue;
+        }
+        const GraphicBufferAllocator::owner_usage_t& t(totals.valueAt(index));
+        // the buffers of a process that aren't for a layer are merged
+        GraphicMemoryUsage* u = NULL;
+        if (owner.name.isEmpty()) {
+            for (size_t j = 0; j < usage->size() && u == NULL; j++) {
+                GraphicMemoryUsage& other(usage->editItemAt(j));
+                if (other.pid == owner.pid && other.name.isEmpty()) {
+                    u = &other;
+                }
+            }
+        }
+        if (u == NULL) {
+            u = &usage->editItemAt(usage->add());
+            u->pid = owner.pid;
+            u->name = owner.name;
+        }
+        u->usage |= t.usage;
+        u->count += t.count;
+        u->bytes += t.size;
+    }
+}
+
 // ----------------------------------------------------------------------------
 }; // namespace android
 // ----------------------------------------------------------------------------
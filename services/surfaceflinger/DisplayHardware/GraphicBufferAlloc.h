@@ -20,26 +20,66 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+#include <gui/GraphicMemoryUsage.h>
 #include <gui/IGraphicBufferAlloc.h>
+#include <ui/GraphicBufferAllocator.h>
 #include <ui/PixelFormat.h>
 #include <utils/Errors.h>
+#include <utils/KeyedVector.h>
+#include <utils/String8.h>
+#include <utils/threads.h>
 
 namespace android {
 // ---------------------------------------------------------------------------
 
 class GraphicBuffer;
 
+// The buffers are accounted to the process and layer given at creation
+// until they are destroyed, see getUsage().
 class GraphicBufferAlloc : public BnGraphicBufferAlloc {
 public:
-    GraphicBufferAlloc();
+    // name is the layer's, empty if the buffers aren't made for a layer
+    GraphicBufferAlloc(pid_t pid, const String8& name = String8());
     virtual ~GraphicBufferAlloc();
+    void setName(const String8& name);
     virtual sp<GraphicBuffer> createGraphicBuffer(uint32_t w, uint32_t h,
         PixelFormat format, uint32_t usage, status_t* error);
+    virtual status_t createGraphicBuffers(uint32_t w, uint32_t h,
+        PixelFormat format, uint32_t usage, size_t count,
+        Vector< sp<GraphicBuffer> >* outBuffers);
 #ifdef QCOM_BSP
     virtual void setGraphicBufferSize(int size);
+#endif
+
+    // replaces the content of usage with the totals of the live buffers
+    // allocated by GraphicBufferAlloc objects, one entry per layer and one
+    // per process for the other buffers
+    static void getUsage(Vector<GraphicMemoryUsage>* usage);
+
 private:
+    struct Owner {
+        pid_t pid;
+        String8 name;
+        // false once the GraphicBufferAlloc is destroyed, the owner is
+        // forgotten when its buffers are too
+        bool alive;
+    };
+
+    // the key of this in sOwners, and GraphicBufferAllocator's owner id
+    const int32_t mId;
+#ifdef QCOM_BSP
     int mBufferSize;
 #endif
+
+    typedef KeyedVector<int32_t,
+            GraphicBufferAllocator::owner_usage_t> OwnerTotals;
+
+    // forgets the destroyed owners that have no buffers in totals anymore
+    static void pruneOwnersLocked(const OwnerTotals& totals);
+
+    static Mutex sLock;
+    static KeyedVector<int32_t, Owner> sOwners;
+    static int32_t sNextId;
 };
 
 
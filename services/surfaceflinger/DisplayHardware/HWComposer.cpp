@@ -19,11 +19,15 @@
 // Uncomment this to remove support for HWC_DEVICE_API_VERSION_0_3 and older
 // #define HWC_REMOVE_DEPRECATED_VERSIONS 1
 
+#include <errno.h>
+#include <sched.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #include <utils/Errors.h>
 #include <utils/misc.h>
@@ -32,14 +36,17 @@
 #include <utils/Trace.h>
 #include <utils/Vector.h>
 
+#include <ui/Fence.h>
 #include <ui/GraphicBuffer.h>
 
 #include <hardware/hardware.h>
 #include <hardware/hwcomposer.h>
 
+#include <cutils/atomic.h>
 #include <cutils/log.h>
 #include <cutils/properties.h>
 
+#include "DumpProto.h"
 #include "Layer.h"           // needed only for debugging
 #include "LayerBase.h"
 #include "HWComposer.h"
@@ -217,7 +224,10 @@ HWComposer::HWComposer(
       mFbDev(0), mHwc(0), mNumDisplays(1),
       mCBContext(new cb_context),
       mEventHandler(handler),
-      mVSyncCount(0), mDebugForceFakeVSync(false)
+      mVSyncCount(0), mDebugForceFakeVSync(false),
+      mCachePrepare(false), mBackgroundLayerSupported(false),
+      mForcePrepare(0),
+      mPrepareCount(0), mPrepareSkipCount(0)
 {
     for (size_t i =0 ; i<MAX_DISPLAYS ; i++) {
         mLists[i] = 0;
@@ -227,6 +237,9 @@ HWComposer::HWComposer(
     property_get("debug.sf.no_hw_vsync", value, "0");
     mDebugForceFakeVSync = atoi(value);
 
+    property_get("debug.sf.hwc_cache", value, "0");
+    mCachePrepare = atoi(value) != 0;
+
     bool needVSyncThread = true;
 
     // Note: some devices may insist that the FB HAL be opened before HWC.
@@ -269,6 +282,12 @@ HWComposer::HWComposer(
                 memset(mCBContext->procs.zero, 0, sizeof(mCBContext->procs.zero));
                 mHwc->registerProcs(mHwc, &mCBContext->procs);
             }
+            int value = 0;
+            if (mHwc->query && mHwc->query(mHwc,
+                    HWC_BACKGROUND_LAYER_SUPPORTED, &value) == NO_ERROR) {
+                mBackgroundLayerSupported = value != 0;
+            }
+            ALOGI_IF(mBackgroundLayerSupported, "background layer supported");
         } else {
             hwc_composer_device_t* hwc0 = reinterpret_cast<hwc_composer_device_t*>(mHwc);
             if (hwc0->registerProcs) {
@@ -423,6 +442,8 @@ void HWComposer::hook_hotplug(const struct hwc_procs* procs, int disp,
 }
 
 void HWComposer::invalidate() {
+    // the HAL wants to see the next frame regardless of what changed
+    android_atomic_or(1, &mForcePrepare);
     mFlinger->repaintEverything();
 }
 
@@ -697,7 +718,107 @@ status_t HWComposer::setFramebufferTarget(int32_t id,
     return NO_ERROR;
 }
 
+template <typename T>
+static void resizeVector(Vector<T>& v, size_t size) {
+    if (size > v.size()) {
+        v.insertAt(v.size(), size - v.size());
+    } else if (size < v.size()) {
+        v.removeItemsAt(size, v.size() - size);
+    }
+}
+
+bool HWComposer::updatePreparedGeometry(size_t i) {
+    DisplayData& disp(mDisplayData[i]);
+    if (disp.list == NULL) {
+        const bool unchanged = disp.preparedValid &&
+                disp.preparedLayers.isEmpty();
+        disp.preparedLayers.clear();
+        disp.preparedVisibleRects.clear();
+        disp.preparedValid = true;
+        return unchanged;
+    }
+
+    bool unchanged = disp.preparedValid &&
+            !(hwcFlags(mHwc, disp.list) & HWC_GEOMETRY_CHANGED);
+
+    // the framebuffer target, if any, is always last and never changes
+    // (once the list is created) other than by its handle
+    size_t count = hwcNumHwLayers(mHwc, disp.list);
+    if (disp.framebufferTarget && count) {
+        count--;
+    }
+    if (count != disp.preparedLayers.size()) {
+        unchanged = false;
+        resizeVector(disp.preparedLayers, count);
+    }
+
+    size_t rectIndex = 0;
+    for (size_t j=0 ; j<count ; j++) {
+        const hwc_layer_1_t& l(disp.list->hwLayers[j]);
+        LayerGeometry g;
+        g.flags = l.flags;
+        g.hasBuffer = l.handle != NULL;
+        g.transform = l.transform;
+        g.blending = l.blending;
+        g.sourceCrop = reinterpret_cast<const Rect&>(l.sourceCrop);
+        g.displayFrame = reinterpret_cast<const Rect&>(l.displayFrame);
+        g.numVisibleRects = l.visibleRegionScreen.numRects;
+
+        LayerGeometry& prev(disp.preparedLayers.editItemAt(j));
+        if (unchanged && (g.flags != prev.flags ||
+                g.hasBuffer != prev.hasBuffer ||
+                g.transform != prev.transform ||
+                g.blending != prev.blending ||
+                g.sourceCrop != prev.sourceCrop ||
+                g.displayFrame != prev.displayFrame ||
+                g.numVisibleRects != prev.numVisibleRects)) {
+            unchanged = false;
+        }
+        prev = g;
+
+        const Rect* rects = reinterpret_cast<const Rect*>(
+                l.visibleRegionScreen.rects);
+        if (rectIndex + g.numVisibleRects > disp.preparedVisibleRects.size()) {
+            unchanged = false;
+            resizeVector(disp.preparedVisibleRects,
+                    rectIndex + g.numVisibleRects);
+        }
+        for (size_t k=0 ; k<g.numVisibleRects ; k++, rectIndex++) {
+            Rect& prevRect(disp.preparedVisibleRects.editItemAt(rectIndex));
+            if (prevRect != rects[k]) {
+                unchanged = false;
+                prevRect = rects[k];
+            }
+        }
+    }
+    if (rectIndex != disp.preparedVisibleRects.size()) {
+        unchanged = false;
+        resizeVector(disp.preparedVisibleRects, rectIndex);
+    }
+
+    disp.preparedValid = true;
+    return unchanged;
+}
+
 status_t HWComposer::prepare() {
+    // with nothing but buffer handles changed since the last frame, the
+    // HAL would take the same decisions again; keep the ones it made then.
+    // This is only possible with the hwc_layer_1_t list, and the record of
+    // what was prepared must be kept current even when it's of no use.
+    bool unchanged = mCachePrepare &&
+            hwcHasApiVersion(mHwc, HWC_DEVICE_API_VERSION_1_0);
+    if (unchanged) {
+        unchanged = !android_atomic_and(0, &mForcePrepare);
+        for (size_t i=0 ; i<mNumDisplays ; i++) {
+            unchanged = updatePreparedGeometry(i) && unchanged;
+        }
+    }
+    mPrepareCount++;
+    if (unchanged) {
+        mPrepareSkipCount++;
+        return NO_ERROR;
+    }
+
     for (size_t i=0 ; i<mNumDisplays ; i++) {
         DisplayData& disp(mDisplayData[i]);
         if (disp.framebufferTarget) {
@@ -730,6 +851,13 @@ status_t HWComposer::prepare() {
     int err = hwcPrepare(mHwc, mNumDisplays, mLists);
     ALOGE_IF(err, "HWComposer: prepare failed (%s)", strerror(-err));
 
+    if (err != NO_ERROR) {
+        // don't reuse the decisions of a failed prepare()
+        for (size_t i=0 ; i<mNumDisplays ; i++) {
+            mDisplayData[i].preparedValid = false;
+        }
+    }
+
     if (err == NO_ERROR) {
         if (hwcHasApiVersion(mHwc, HWC_DEVICE_API_VERSION_1_0)) {
             // here we're just making sure that "skip" layers are set
@@ -752,7 +880,10 @@ status_t HWComposer::prepare() {
                         if (l.compositionType == HWC_FRAMEBUFFER) {
                             disp.hasFbComp = true;
                         }
-                        if (l.compositionType == HWC_OVERLAY) {
+                        // an accepted background layer covers what
+                        // GLES leaves transparent, like an overlay
+                        if (l.compositionType == HWC_OVERLAY ||
+                                l.compositionType == HWC_BACKGROUND) {
                             disp.hasOvComp = true;
                         }
                     }
@@ -816,6 +947,13 @@ int HWComposer::getAndResetReleaseFenceFd(int32_t id) {
     return fd;
 }
 
+sp<Fence> HWComposer::getDisplayFence(int32_t id) const {
+    if (uint32_t(id)>31 || !mAllocatedDisplayIDs.hasBit(id))
+        return Fence::NO_FENCE;
+    const sp<Fence>& fence(mDisplayData[id].lastRetireFence);
+    return fence != NULL ? fence : Fence::NO_FENCE;
+}
+
 status_t HWComposer::commit() {
     int err = NO_ERROR;
     if (mHwc) {
@@ -839,8 +977,10 @@ status_t HWComposer::commit() {
             DisplayData& disp(mDisplayData[i]);
             if (disp.list) {
                 if (hwcHasApiVersion(mHwc, HWC_DEVICE_API_VERSION_1_0)) {
+                    // the Fence owns the file descriptor from now on
+                    disp.lastRetireFence = Fence::NO_FENCE;
                     if (disp.list->retireFenceFd != -1) {
-                        close(disp.list->retireFenceFd);
+                        disp.lastRetireFence = new Fence(disp.list->retireFenceFd);
                         disp.list->retireFenceFd = -1;
                     }
                 }
@@ -857,6 +997,7 @@ status_t HWComposer::release(int disp) {
         if (hwcHasVsyncEvent(mHwc)) {
             eventControl(disp, HWC_EVENT_VSYNC, 0);
         }
+        android_atomic_or(1, &mForcePrepare);
         return (status_t)hwcBlank(mHwc, disp, 1);
     }
     return NO_ERROR;
@@ -865,6 +1006,7 @@ status_t HWComposer::release(int disp) {
 status_t HWComposer::acquire(int disp) {
     LOG_FATAL_IF(disp >= HWC_NUM_DISPLAY_TYPES);
     if (mHwc) {
+        android_atomic_or(1, &mForcePrepare);
         return (status_t)hwcBlank(mHwc, disp, 0);
     }
     return NO_ERROR;
@@ -877,6 +1019,7 @@ void HWComposer::disconnectDisplay(int disp) {
         return;
     }
     DisplayData& dd(mDisplayData[disp]);
+    dd.preparedValid = false;
     if (dd.list != NULL) {
         free(dd.list);
         dd.list = NULL;
@@ -901,6 +1044,10 @@ bool HWComposer::supportsFramebufferTarget() const {
     return (mHwc && hwcHasApiVersion(mHwc, HWC_DEVICE_API_VERSION_1_1));
 }
 
+bool HWComposer::supportsBackgroundLayer() const {
+    return mBackgroundLayerSupported;
+}
+
 int HWComposer::fbPost(int32_t id,
         const sp<Fence>& acquireFence, const sp<GraphicBuffer>& buffer) {
     if (mHwc && hwcHasApiVersion(mHwc, HWC_DEVICE_API_VERSION_1_1)) {
@@ -909,7 +1056,11 @@ int HWComposer::fbPost(int32_t id,
         if (acquireFence != NULL) {
             acquireFence->waitForever(1000, "HWComposer::fbPost");
         }
-        return mFbDev->post(mFbDev, buffer->handle);
+        int err = mFbDev->post(mFbDev, buffer->handle);
+        if (err == NO_ERROR && mVSyncThread != NULL) {
+            mVSyncThread->onFramebufferPosted(systemTime(CLOCK_MONOTONIC));
+        }
+        return err;
     }
 }
 
@@ -924,6 +1075,21 @@ int HWComposer::fbCompositionComplete() {
     }
 }
 
+bool HWComposer::fbSupportsUpdateRect() const {
+    if (mHwc && hwcHasApiVersion(mHwc, HWC_DEVICE_API_VERSION_1_1))
+        return false;
+
+    return mFbDev && mFbDev->setUpdateRect;
+}
+
+int HWComposer::fbSetUpdateRect(const Rect& rect) {
+    if (!fbSupportsUpdateRect())
+        return INVALID_OPERATION;
+
+    return mFbDev->setUpdateRect(mFbDev,
+            rect.left, rect.top, rect.width(), rect.height());
+}
+
 void HWComposer::fbDump(String8& result) {
     if (mFbDev && mFbDev->common.version >= 1 && mFbDev->dump) {
         const size_t SIZE = 4096;
@@ -1034,6 +1200,9 @@ public:
             getLayer()->handle = buffer->handle;
         }
     }
+    virtual void setBackgroundColor(const hwc_color_t& color) {
+        // only offered with HWC 1.0 and up, see supportsBackgroundLayer()
+    }
     virtual void onDisplayed() {
         hwc_region_t& visibleRegion = getLayer()->visibleRegionScreen;
         SharedBuffer const* sb = SharedBuffer::bufferFromData(visibleRegion.rects);
@@ -1122,6 +1291,12 @@ public:
             getLayer()->handle = buffer->handle;
         }
     }
+    virtual void setBackgroundColor(const hwc_color_t& color) {
+        // backgroundColor shares its storage with the handle
+        getLayer()->compositionType = HWC_BACKGROUND;
+        getLayer()->flags &= ~HWC_SKIP_LAYER;
+        getLayer()->backgroundColor = color;
+    }
     virtual void onDisplayed() {
         hwc_region_t& visibleRegion = getLayer()->visibleRegionScreen;
         SharedBuffer const* sb = SharedBuffer::bufferFromData(visibleRegion.rects);
@@ -1188,6 +1363,10 @@ void HWComposer::dump(String8& result, char* buffer, size_t SIZE) const {
     if (mHwc) {
         result.appendFormat("Hardware Composer state (version %8x):\n", hwcApiVersion(mHwc));
         result.appendFormat("  mDebugForceFakeVSync=%d\n", mDebugForceFakeVSync);
+        if (mCachePrepare) {
+            result.appendFormat("  prepare: %u frames, %u skipped\n",
+                    mPrepareCount, mPrepareSkipCount);
+        }
         for (size_t i=0 ; i<mNumDisplays ; i++) {
             const DisplayData& disp(mDisplayData[i]);
 
@@ -1252,19 +1431,77 @@ void HWComposer::dump(String8& result, char* buffer, size_t SIZE) const {
             }
         }
     }
+    if (mVSyncThread != NULL) {
+        mVSyncThread->dump(result);
+    }
     if (mHwc) {
         hwcDump(mHwc, buffer, SIZE);
         result.append(buffer);
     }
 }
 
+void HWComposer::dumpProto(ProtoOutput& proto) const {
+    proto.writeBool(1, mHwc != NULL);
+    if (!mHwc) {
+        return;
+    }
+    proto.writeUInt32(3, hwcApiVersion(mHwc));
+    for (size_t i=0 ; i<mNumDisplays ; i++) {
+        const DisplayData& disp(mDisplayData[i]);
+        if (!disp.connected) {
+            continue;
+        }
+        const size_t token = proto.beginMessage(4);
+        proto.writeInt32(1, i);
+        proto.writeUInt32(2, disp.width);
+        proto.writeUInt32(3, disp.height);
+        proto.writeFloat(4, disp.xdpi);
+        proto.writeFloat(5, disp.ydpi);
+        proto.writeInt64(6, disp.refresh);
+        if (disp.list) {
+            proto.writeUInt32(7, disp.list->flags);
+            for (size_t j=0 ; j<disp.list->numHwLayers ; j++) {
+                const hwc_layer_1_t& l = disp.list->hwLayers[j];
+                const size_t layer = proto.beginMessage(8);
+                proto.writeInt32(1, l.compositionType);
+                proto.writeUInt32(2, l.hints);
+                proto.writeUInt32(3, l.flags);
+                proto.writeUInt32(4, l.transform);
+                proto.writeInt32(5, l.blending);
+                dumpProtoRect(proto, 6, Rect(l.sourceCrop.left, l.sourceCrop.top,
+                        l.sourceCrop.right, l.sourceCrop.bottom));
+                dumpProtoRect(proto, 7, Rect(l.displayFrame.left, l.displayFrame.top,
+                        l.displayFrame.right, l.displayFrame.bottom));
+                proto.endMessage(layer);
+            }
+        }
+        proto.endMessage(token);
+    }
+}
+
 // ---------------------------------------------------------------------------
 
 HWComposer::VSyncThread::VSyncThread(HWComposer& hwc)
     : mHwc(hwc), mEnabled(false),
       mNextFakeVSync(0),
-      mRefreshPeriod(hwc.getRefreshPeriod(HWC_DISPLAY_PRIMARY))
+      mRefreshPeriod(hwc.getRefreshPeriod(HWC_DISPLAY_PRIMARY)),
+      mTimerFd(-1), mRealTime(false), mCalibrate(false),
+      mPhaseCorrection(0), mCalibrationError(0),
+      mWakeCount(0), mMissedCount(0),
+      mWakeLatencyTotal(0), mWakeLatencyMax(0)
 {
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.sf.vsync_fifo", value, "0");
+    mRealTime = atoi(value) != 0;
+
+    property_get("debug.sf.vsync_calibrate", value, "0");
+    mCalibrate = atoi(value) != 0;
+}
+
+HWComposer::VSyncThread::~VSyncThread() {
+    if (mTimerFd >= 0) {
+        close(mTimerFd);
+    }
 }
 
 void HWComposer::VSyncThread::setEnabled(bool enabled) {
@@ -1279,40 +1516,137 @@ void HWComposer::VSyncThread::onFirstRef() {
     run("VSyncThread", PRIORITY_URGENT_DISPLAY + PRIORITY_MORE_FAVORABLE);
 }
 
+status_t HWComposer::VSyncThread::readyToRun() {
+    mTimerFd = timerfd_create(CLOCK_MONOTONIC, 0);
+    if (mTimerFd < 0) {
+        ALOGW("VSyncThread: timerfd_create failed (%s), using clock_nanosleep",
+                strerror(errno));
+    }
+    if (mRealTime) {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = 1;
+        if (sched_setscheduler(0, SCHED_FIFO, &param) != 0) {
+            ALOGW("VSyncThread: couldn't set SCHED_FIFO (%s)", strerror(errno));
+        }
+    }
+    return NO_ERROR;
+}
+
+bool HWComposer::VSyncThread::sleepUntil(nsecs_t when) {
+    struct timespec spec;
+    spec.tv_sec  = when / 1000000000;
+    spec.tv_nsec = when % 1000000000;
+
+    if (mTimerFd >= 0) {
+        // an absolute deadline on a timerfd isn't rounded up to the next
+        // timer slack boundary like a plain sleep may be
+        struct itimerspec timer;
+        memset(&timer, 0, sizeof(timer));
+        timer.it_value = spec;
+        if (timerfd_settime(mTimerFd, TFD_TIMER_ABSTIME, &timer, NULL) == 0) {
+            uint64_t expirations;
+            ssize_t n;
+            do {
+                n = read(mTimerFd, &expirations, sizeof(expirations));
+            } while (n < 0 && errno == EINTR);
+            return n == sizeof(expirations);
+        }
+        ALOGW("VSyncThread: timerfd_settime failed (%s)", strerror(errno));
+        close(mTimerFd);
+        mTimerFd = -1;
+    }
+
+    int err;
+    do {
+        err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &spec, NULL);
+    } while (err == EINTR);
+    return err == 0;
+}
+
+void HWComposer::VSyncThread::onFramebufferPosted(nsecs_t when) {
+    if (!mCalibrate) {
+        return;
+    }
+    Mutex::Autolock _l(mLock);
+    const nsecs_t period = mRefreshPeriod;
+    if (!mEnabled || mNextFakeVSync == 0 || period <= 0) {
+        return;
+    }
+    // distance from the completion to the nearest fake vsync, in
+    // [-period/2, period/2)
+    nsecs_t error = (when - mNextFakeVSync) % period;
+    if (error < 0)
+        error += period;
+    if (error >= period / 2)
+        error -= period;
+    mCalibrationError = error;
+    // only correct part of it, a single late completion shouldn't move
+    // every vsync by that much
+    mPhaseCorrection += error / 4;
+}
+
 bool HWComposer::VSyncThread::threadLoop() {
+    nsecs_t correction;
     { // scope for lock
         Mutex::Autolock _l(mLock);
         while (!mEnabled) {
             mCondition.wait(mLock);
         }
+        correction = mPhaseCorrection;
+        mPhaseCorrection = 0;
     }
 
     const nsecs_t period = mRefreshPeriod;
     const nsecs_t now = systemTime(CLOCK_MONOTONIC);
-    nsecs_t next_vsync = mNextFakeVSync;
+    nsecs_t next_vsync = mNextFakeVSync + correction;
     nsecs_t sleep = next_vsync - now;
+    bool missed = false;
     if (sleep < 0) {
         // we missed, find where the next vsync should be
+        missed = mNextFakeVSync != 0;
         sleep = (period - ((now - next_vsync) % period));
         next_vsync = now + sleep;
     }
-    mNextFakeVSync = next_vsync + period;
-
-    struct timespec spec;
-    spec.tv_sec  = next_vsync / 1000000000;
-    spec.tv_nsec = next_vsync % 1000000000;
-
-    int err;
-    do {
-        err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &spec, NULL);
-    } while (err<0 && errno == EINTR);
-
-    if (err == 0 && mEnabled) {
+    { // scope for lock
+        Mutex::Autolock _l(mLock);
+        mNextFakeVSync = next_vsync + period;
+    }
+
+    if (sleepUntil(next_vsync) && mEnabled) {
+        const nsecs_t latency = systemTime(CLOCK_MONOTONIC) - next_vsync;
+        { // scope for lock
+            Mutex::Autolock _l(mLock);
+            mWakeCount++;
+            if (missed)
+                mMissedCount++;
+            mWakeLatencyTotal += latency;
+            if (latency > mWakeLatencyMax)
+                mWakeLatencyMax = latency;
+        }
         mHwc.mEventHandler.onVSyncReceived(0, next_vsync);
     }
 
     return true;
 }
 
+void HWComposer::VSyncThread::dump(String8& result) const {
+    Mutex::Autolock _l(mLock);
+    result.appendFormat("  fake vsync: period=%lld, %s%s%s\n",
+            mRefreshPeriod, mTimerFd >= 0 ? "timerfd" : "clock_nanosleep",
+            mRealTime ? ", SCHED_FIFO" : "",
+            mCalibrate ? ", calibrated" : "");
+    result.appendFormat("    %u wakeups, %u missed, "
+            "latency avg=%lld us, max=%lld us",
+            mWakeCount, mMissedCount,
+            mWakeCount ? mWakeLatencyTotal / mWakeCount / 1000 : 0LL,
+            mWakeLatencyMax / 1000);
+    if (mCalibrate) {
+        result.appendFormat(", last post error=%lld us",
+                mCalibrationError / 1000);
+    }
+    result.append("\n");
+}
+
 // ---------------------------------------------------------------------------
 }; // namespace android
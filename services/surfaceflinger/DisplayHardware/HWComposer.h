@@ -30,10 +30,14 @@
 #include <utils/Vector.h>
 #include <utils/BitSet.h>
 
+#include <ui/Fence.h>
+#include <ui/Rect.h>
+
 extern "C" int clock_nanosleep(clockid_t clock_id, int flags,
                            const struct timespec *request,
                            struct timespec *remain);
 
+struct hwc_color;
 struct hwc_composer_device_1;
 struct hwc_display_contents_1;
 struct hwc_layer_1;
@@ -44,8 +48,8 @@ namespace android {
 // ---------------------------------------------------------------------------
 
 class GraphicBuffer;
-class Fence;
 class LayerBase;
+class ProtoOutput;
 class Region;
 class String8;
 class SurfaceFlinger;
@@ -85,7 +89,9 @@ public:
     status_t freeDisplayId(int32_t id);
 
 
-    // Asks the HAL what it can do
+    // Asks the HAL what it can do. When enabled with debug.sf.hwc_cache,
+    // the HAL isn't asked again if no display's layer list changed since
+    // the last successful prepare() other than by its buffer handles.
     status_t prepare();
 
     // commits the list
@@ -105,6 +111,10 @@ public:
 
     bool supportsFramebufferTarget() const;
 
+    // whether the bottom layer can be given as a solid color, see
+    // HWCLayerInterface::setBackgroundColor()
+    bool supportsBackgroundLayer() const;
+
     // does this display have layers handled by HWC
     bool hasHwcComposition(int32_t id) const;
 
@@ -115,6 +125,11 @@ public:
     // the release fence is only valid after commit()
     int getAndResetReleaseFenceFd(int32_t id);
 
+    // get the retire fence of the last commit() to the given display, it
+    // signals when that frame is retired by the display. NO_FENCE if the
+    // HAL doesn't provide one.
+    sp<Fence> getDisplayFence(int32_t id) const;
+
     // needed forward declarations
     class LayerListIterator;
 
@@ -126,6 +141,9 @@ public:
     int fbPost(int32_t id, const sp<Fence>& acquireFence, const sp<GraphicBuffer>& buf);
     int fbCompositionComplete();
     void fbDump(String8& result);
+    // whether the FB HAL can post only part of the next frame
+    bool fbSupportsUpdateRect() const;
+    int fbSetUpdateRect(const Rect& rect);
 
     /*
      * Interface to hardware composer's layers functionality.
@@ -150,6 +168,10 @@ public:
         virtual void setCrop(const Rect& crop) = 0;
         virtual void setVisibleRegionScreen(const Region& reg) = 0;
         virtual void setBuffer(const sp<GraphicBuffer>& buffer) = 0;
+        // makes this the HWC_BACKGROUND layer, filling the display with
+        // the given color, prepare() turns it to HWC_FRAMEBUFFER if the
+        // HAL can't do it
+        virtual void setBackgroundColor(const hwc_color& color) = 0;
         virtual void setAcquireFenceFd(int fenceFd) = 0;
         virtual void onDisplayed() = 0;
     };
@@ -249,17 +271,38 @@ public:
         bool mEnabled;
         mutable nsecs_t mNextFakeVSync;
         nsecs_t mRefreshPeriod;
+        // absolute CLOCK_MONOTONIC timer, or -1 to use clock_nanosleep()
+        int mTimerFd;
+        // debug.sf.vsync_fifo: run the thread SCHED_FIFO
+        bool mRealTime;
+        // debug.sf.vsync_calibrate: pull the phase toward post completions
+        bool mCalibrate;
+        // protected by mLock
+        nsecs_t mPhaseCorrection;
+        nsecs_t mCalibrationError;
+        size_t mWakeCount;
+        size_t mMissedCount;
+        nsecs_t mWakeLatencyTotal;
+        nsecs_t mWakeLatencyMax;
         virtual void onFirstRef();
+        virtual status_t readyToRun();
         virtual bool threadLoop();
+        bool sleepUntil(nsecs_t when);
     public:
         VSyncThread(HWComposer& hwc);
+        virtual ~VSyncThread();
         void setEnabled(bool enabled);
+        // the framebuffer finished a post at 'when', which happens on vsync
+        void onFramebufferPosted(nsecs_t when);
+        void dump(String8& result) const;
     };
 
     friend class VSyncThread;
 
     // for debugging ----------------------------------------------------------
     void dump(String8& out, char* scratch, size_t SIZE) const;
+    // writes the fields of a HwComposer message, see surfaceflinger.proto
+    void dumpProto(ProtoOutput& proto) const;
 
 private:
     void loadHwcModule();
@@ -284,12 +327,28 @@ private:
     status_t setFramebufferTarget(int32_t id,
             const sp<Fence>& acquireFence, const sp<GraphicBuffer>& buf);
 
+    // the parts of a layer prepare() depends on, buffer handle aside
+    struct LayerGeometry {
+        uint32_t flags;
+        bool hasBuffer;
+        uint32_t transform;
+        int32_t blending;
+        Rect sourceCrop;
+        Rect displayFrame;
+        size_t numVisibleRects;
+    };
+
+    // compares the layer list of disp with what it held when last
+    // prepared, and records it for the next frame
+    bool updatePreparedGeometry(size_t disp);
+
 
     struct DisplayData {
         DisplayData() : xdpi(0), ydpi(0), refresh(0),
             connected(false), hasFbComp(false), hasOvComp(false),
             capacity(0), list(NULL),
-            framebufferTarget(NULL), fbTargetHandle(NULL), events(0) { }
+            framebufferTarget(NULL), fbTargetHandle(NULL), events(0),
+            preparedValid(false) { }
         ~DisplayData() {
             free(list);
         }
@@ -308,6 +367,12 @@ private:
         buffer_handle_t fbTargetHandle;
         // protected by mEventControlLock
         int32_t events;
+        // the layer list given to the last successful prepare()
+        Vector<LayerGeometry> preparedLayers;
+        Vector<Rect> preparedVisibleRects;
+        bool preparedValid;
+        // retire fence of the last commit()
+        sp<Fence> lastRetireFence;
     };
 
     sp<SurfaceFlinger>              mFlinger;
@@ -324,6 +389,12 @@ private:
     size_t                          mVSyncCount;
     sp<VSyncThread>                 mVSyncThread;
     bool                            mDebugForceFakeVSync;
+    bool                            mCachePrepare;
+    bool                            mBackgroundLayerSupported;
+    // set by invalidate() and blank/unblank, makes the next prepare() happen
+    volatile int32_t                mForcePrepare;
+    size_t                          mPrepareCount;
+    size_t                          mPrepareSkipCount;
     BitSet32                        mAllocatedDisplayIDs;
 
     // protected by mLock
@@ -15,6 +15,7 @@
  */
 
 #include <stdint.h>
+#include <string.h>
 #include <sys/types.h>
 
 #include <cutils/log.h>
@@ -25,10 +26,13 @@
 namespace android {
 // ---------------------------------------------------------------------------
 
-PowerHAL::PowerHAL() : mPowerModule(0), mVSyncHintEnabled(false) {
+PowerHAL::PowerHAL() : mPowerModule(0), mVSyncHintEnabled(false),
+        mBoostInterval(0), mLastBoost(0) {
     int err = hw_get_module(POWER_HARDWARE_MODULE_ID,
             (const hw_module_t **)&mPowerModule);
     ALOGW_IF(err, "%s module not found", POWER_HARDWARE_MODULE_ID);
+    memset(mBoostsSent, 0, sizeof(mBoostsSent));
+    memset(mBoostsSkipped, 0, sizeof(mBoostsSkipped));
 }
 
 PowerHAL::~PowerHAL() {
@@ -54,6 +58,56 @@ status_t PowerHAL::vsyncHint(bool enabled) {
     return NO_ERROR;
 }
 
+void PowerHAL::setBoostInterval(nsecs_t interval) {
+    Mutex::Autolock _l(mBoostLock);
+    mBoostInterval = interval;
+}
+
+status_t PowerHAL::boostHint(BoostReason reason) {
+    if (!mPowerModule) {
+        return NO_INIT;
+    }
+    if (mPowerModule->common.module_api_version < POWER_MODULE_API_VERSION_0_2 ||
+            !mPowerModule->powerHint) {
+        return INVALID_OPERATION;
+    }
+    const nsecs_t now = systemTime();
+    { // scope for lock
+        Mutex::Autolock _l(mBoostLock);
+        if (!mBoostInterval) {
+            return INVALID_OPERATION;
+        }
+        // the HAL's boost outlasts the call, more hints would only wake
+        // it up for nothing
+        if (mLastBoost && now - mLastBoost < mBoostInterval) {
+            mBoostsSkipped[reason]++;
+            return NO_ERROR;
+        }
+        mLastBoost = now;
+        mBoostsSent[reason]++;
+    }
+    mPowerModule->powerHint(mPowerModule, POWER_HINT_INTERACTION, NULL);
+    return NO_ERROR;
+}
+
+void PowerHAL::dumpBoostHints(String8& result) const {
+    static const char* const names[NUM_BOOST_REASONS] = {
+            "animation",
+            "load",
+            "deadline missed"
+    };
+    Mutex::Autolock _l(mBoostLock);
+    if (!mBoostInterval) {
+        return;
+    }
+    result.appendFormat("Power boost hints (interval=%lld ms):\n",
+            ns2ms(mBoostInterval));
+    for (size_t i=0 ; i<NUM_BOOST_REASONS ; i++) {
+        result.appendFormat("  %-16s: %u sent, %u skipped\n",
+                names[i], mBoostsSent[i], mBoostsSkipped[i]);
+    }
+}
+
 // ---------------------------------------------------------------------------
 }; // namespace android
 
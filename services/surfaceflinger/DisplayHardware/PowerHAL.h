@@ -20,6 +20,10 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+#include <utils/Mutex.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
 #include <hardware/power.h>
 
 namespace android {
@@ -34,9 +38,29 @@ public:
     status_t initCheck() const;
     status_t vsyncHint(bool enabled);
 
+    // why the compositor expects more work than the governor has seen
+    enum BoostReason {
+        BOOST_ANIMATION,        // an animation started
+        BOOST_LOAD,             // the composition got much more expensive
+        BOOST_DEADLINE_MISSED,  // a refresh took longer than a vsync period
+        NUM_BOOST_REASONS
+    };
+
+    // asks for a boost with POWER_HINT_INTERACTION, at most once per
+    // interval, 0 disables these hints. thread safe.
+    void setBoostInterval(nsecs_t interval);
+    status_t boostHint(BoostReason reason);
+    void dumpBoostHints(String8& result) const;
+
 private:
     power_module_t*   mPowerModule;
     bool mVSyncHintEnabled;
+
+    mutable Mutex mBoostLock;
+    nsecs_t mBoostInterval;
+    nsecs_t mLastBoost;
+    uint32_t mBoostsSent[NUM_BOOST_REASONS];
+    uint32_t mBoostsSkipped[NUM_BOOST_REASONS];
 };
 
 // ---------------------------------------------------------------------------
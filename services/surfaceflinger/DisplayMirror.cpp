@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <GLES/gl.h>
+#include <GLES/glext.h>
+
+#include <binder/IBinder.h>
+
+#include <utils/Log.h>
+#include <utils/Trace.h>
+
+#include <ui/GraphicBuffer.h>
+
+#include "DisplayDevice.h"
+#include "DisplayMirror.h"
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+DisplayMirror::DisplayMirror()
+    : mDisplay(EGL_NO_DISPLAY), mFailed(false), mFrames(0)
+{
+}
+
+DisplayMirror::~DisplayMirror()
+{
+    release();
+}
+
+void DisplayMirror::release()
+{
+    for (size_t i=0 ; i<mImages.size() ; i++) {
+        const Image& image(mImages[i]);
+        glDeleteTextures(1, &image.textureName);
+        eglDestroyImageKHR(mDisplay, image.image);
+    }
+    mImages.clear();
+}
+
+bool DisplayMirror::canMirror(const sp<const DisplayDevice>& hw,
+        const sp<const DisplayDevice>& source)
+{
+    if (hw == source || source == 0 ||
+            hw->getDisplayType() != DisplayDevice::DISPLAY_VIRTUAL ||
+            !source->canDraw()) {
+        return false;
+    }
+
+    // the same layers must be drawn the same way
+    if (hw->getLayerStack() != source->getLayerStack() ||
+            hw->getSourceViewport() != source->getSourceViewport()) {
+        return false;
+    }
+    if (source->getSecureLayerVisible() && hw->isSecure() != source->isSecure()) {
+        // secure layers are blacked out on one of them only
+        return false;
+    }
+
+    // and the source must show all of them
+    const Rect shown(source->getTransform().transform(source->getSourceViewport()));
+    Rect visible;
+    return shown.intersect(source->getBounds(), &visible) && visible == shown;
+}
+
+GLuint DisplayMirror::getTexture(EGLDisplay dpy, const sp<GraphicBuffer>& buffer)
+{
+    for (size_t i=0 ; i<mImages.size() ; i++) {
+        if (mImages[i].buffer == buffer) {
+            return mImages[i].textureName;
+        }
+    }
+
+    // the oldest image goes away
+    if (mImages.size() >= MAX_IMAGES) {
+        const Image& image(mImages[0]);
+        glDeleteTextures(1, &image.textureName);
+        eglDestroyImageKHR(mDisplay, image.image);
+        mImages.removeAt(0);
+    }
+
+    Image image;
+    image.buffer = buffer;
+    image.image = eglCreateImageKHR(dpy, EGL_NO_CONTEXT,
+            EGL_NATIVE_BUFFER_ANDROID,
+            (EGLClientBuffer)buffer->getNativeBuffer(), 0);
+    if (image.image == EGL_NO_IMAGE_KHR) {
+        ALOGE("display mirror: eglCreateImageKHR failed (%#x)", eglGetError());
+        return 0;
+    }
+    mDisplay = dpy;
+
+    // make sure to clear all GL error flags
+    while ( glGetError() != GL_NO_ERROR ) ;
+
+    glGenTextures(1, &image.textureName);
+    glBindTexture(GL_TEXTURE_2D, image.textureName);
+    glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, (GLeglImageOES)image.image);
+    glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    if (glGetError() != GL_NO_ERROR) {
+        ALOGE("display mirror: can't texture from the framebuffer target");
+        glDeleteTextures(1, &image.textureName);
+        eglDestroyImageKHR(dpy, image.image);
+        return 0;
+    }
+    mImages.add(image);
+    return image.textureName;
+}
+
+bool DisplayMirror::draw(const sp<const DisplayDevice>& hw,
+        const sp<const DisplayDevice>& source, EGLDisplay dpy)
+{
+    ATRACE_CALL();
+
+    const sp<GraphicBuffer> buffer(source->getFramebufferTargetBuffer());
+    if (mFailed || buffer == 0) {
+        return false;
+    }
+    const GLuint textureName = getTexture(dpy, buffer);
+    if (!textureName) {
+        // don't try again on this display
+        mFailed = true;
+        release();
+        return false;
+    }
+
+    // Both displays show the same viewport of the layer stack, so each of
+    // its corners gives a vertex on hw and the matching texture coordinate
+    // in the source's buffer, whose rows are laid out top to bottom.
+    // Downscaling or rotating the frame is done by the same quad.
+    const Rect& viewport(hw->getSourceViewport());
+    const Transform& tr(hw->getTransform());
+    const Transform& sourceTr(source->getTransform());
+    const GLfloat height = hw->getHeight();
+    const GLfloat sw = buffer->getWidth();
+    const GLfloat sh = buffer->getHeight();
+    const int32_t corners[4][2] = {
+            { viewport.left,  viewport.top },
+            { viewport.left,  viewport.bottom },
+            { viewport.right, viewport.bottom },
+            { viewport.right, viewport.top }
+    };
+    GLfloat vertices[4][2];
+    GLfloat texCoords[4][2];
+    for (size_t i=0 ; i<4 ; i++) {
+        float p[2];
+        tr.transform(p, corners[i][0], corners[i][1]);
+        vertices[i][0] = p[0];
+        vertices[i][1] = height - p[1];
+        sourceTr.transform(p, corners[i][0], corners[i][1]);
+        texCoords[i][0] = p[0] / sw;
+        texCoords[i][1] = p[1] / sh;
+    }
+
+    // the same size in either orientation is copied as is
+    const Rect dst(tr.transform(viewport));
+    const Rect src(sourceTr.transform(viewport));
+    const bool sameSize =
+            (dst.width() == src.width() && dst.height() == src.height()) ||
+            (dst.width() == src.height() && dst.height() == src.width());
+    const GLenum filter = sameSize ? GL_NEAREST : GL_LINEAR;
+
+    // what's outside of the viewport is cleared, as a composition would
+    glDisable(GL_SCISSOR_TEST);
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    glDisable(GL_BLEND);
+    glDisable(GL_TEXTURE_EXTERNAL_OES);
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, textureName);
+    glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    glTexEnvx(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+    glMatrixMode(GL_TEXTURE);
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glTexCoordPointer(2, GL_FLOAT, 0, texCoords);
+    glVertexPointer(2, GL_FLOAT, 0, vertices);
+    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisable(GL_TEXTURE_2D);
+
+    mFrames++;
+    return true;
+}
+
+void DisplayMirror::dump(String8& result) const
+{
+    result.appendFormat("   mirror: %s, frames=%u, textures=%u\n",
+            mFailed ? "failed" : "ok", mFrames, mImages.size());
+}
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SF_DISPLAY_MIRROR_H
+#define ANDROID_SF_DISPLAY_MIRROR_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES/gl.h>
+
+#include <utils/RefBase.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+class DisplayDevice;
+class GraphicBuffer;
+
+/*
+ * DisplayMirror shows on a display the last frame composed for another
+ * display of the same layer stack, instead of composing all the layers
+ * again. This is meant for virtual displays mirroring the primary display:
+ * its framebuffer target is drawn as a single textured quad, scaled to the
+ * virtual display's projection in the same pass.
+ *
+ * This only works while the source display is composed entirely with GLES,
+ * since its framebuffer target then holds the whole frame.
+ *
+ * This is only accessed from the main thread, with the GL context current.
+ */
+class DisplayMirror
+{
+public:
+    DisplayMirror();
+    ~DisplayMirror();
+
+    // returns true if hw shows the same content as source, in which case
+    // draw() can be used to compose it
+    static bool canMirror(const sp<const DisplayDevice>& hw,
+            const sp<const DisplayDevice>& source);
+
+    // Draws the last frame of source on hw, which must be current.
+    // Returns false if that's not possible, in which case hw must be
+    // composed as usual.
+    bool draw(const sp<const DisplayDevice>& hw,
+            const sp<const DisplayDevice>& source, EGLDisplay dpy);
+
+    // Drops the textures of the source's buffers.
+    void release();
+
+    void dump(String8& result) const;
+
+private:
+    struct Image {
+        sp<GraphicBuffer> buffer;
+        EGLImageKHR image;
+        GLuint textureName;
+    };
+
+    // the source's framebuffer target cycles through a few buffers, the
+    // textures of the last ones used are kept
+    enum { MAX_IMAGES = 4 };
+
+    GLuint getTexture(EGLDisplay dpy, const sp<GraphicBuffer>& buffer);
+
+    Vector<Image> mImages;
+    EGLDisplay mDisplay;
+    bool mFailed;
+    uint32_t mFrames;
+};
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
+
+#endif // ANDROID_SF_DISPLAY_MIRROR_H
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SF_DUMP_PROTO_H
+#define ANDROID_SF_DUMP_PROTO_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <ui/Rect.h>
+#include <ui/Region.h>
+
+#include <utils/ProtoOutput.h>
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+// Helpers for "dumpsys SurfaceFlinger --proto", whose output is described
+// in surfaceflinger.proto.
+
+// writes a Rect message
+inline void dumpProtoRect(ProtoOutput& proto, uint32_t field, const Rect& r) {
+    const size_t token = proto.beginMessage(field);
+    proto.writeInt32(1, r.left);
+    proto.writeInt32(2, r.top);
+    proto.writeInt32(3, r.right);
+    proto.writeInt32(4, r.bottom);
+    proto.endMessage(token);
+}
+
+// writes a region as repeated Rect messages
+inline void dumpProtoRegion(ProtoOutput& proto, uint32_t field, const Region& region) {
+    Region::const_iterator head = region.begin();
+    Region::const_iterator const tail = region.end();
+    while (head != tail) {
+        dumpProtoRect(proto, field, *head++);
+    }
+}
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
+
+#endif // ANDROID_SF_DUMP_PROTO_H
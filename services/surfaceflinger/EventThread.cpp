@@ -31,14 +31,28 @@
 
 #include "EventThread.h"
 #include "SurfaceFlinger.h"
+#include "VSyncModel.h"
 
 // ---------------------------------------------------------------------------
 namespace android {
 // ---------------------------------------------------------------------------
 
-EventThread::EventThread(const sp<SurfaceFlinger>& flinger)
+EventThread::EventThread(const sp<SurfaceFlinger>& flinger,
+        VSyncModel* vsyncModel, nsecs_t phaseOffset, const char* name)
     : mFlinger(flinger),
+      mVSyncModel(vsyncModel),
+      mPhaseOffset(phaseOffset),
+      mName(name),
+      mLock(Mutex::PRIO_INHERIT | Mutex::ADAPTIVE | Mutex::TRACK_CONTENTION,
+              "EventThread::mLock"),
       mUseSoftwareVSync(false),
+      mVSyncDivisor(1),
+      mLastPredictedVSync(0),
+      mPredictedEventCount(0),
+      mWakeupJitterTotal(0),
+      mWakeupJitterMax(0),
+      mWakeupJitterCount(0),
+      mWakeupJitterLateCount(0),
       mDebugVsyncEnabled(false) {
 
     for (int32_t i=0 ; i<HWC_DISPLAY_TYPES_SUPPORTED ; i++) {
@@ -50,7 +64,8 @@ EventThread::EventThread(const sp<SurfaceFlinger>& flinger)
 }
 
 void EventThread::onFirstRef() {
-    run("EventThread", PRIORITY_URGENT_DISPLAY + PRIORITY_MORE_FAVORABLE);
+    run(mName, PRIORITY_URGENT_DISPLAY + PRIORITY_MORE_FAVORABLE);
+    configureScheduling(mName);
 }
 
 sp<EventThread::Connection> EventThread::createEventConnection() const {
@@ -60,6 +75,9 @@ sp<EventThread::Connection> EventThread::createEventConnection() const {
 status_t EventThread::registerDisplayEventConnection(
         const sp<EventThread::Connection>& connection) {
     Mutex::Autolock _l(mLock);
+    // inactive connections are not looked at on vsync, so this is where
+    // the ones that died are cleaned-up
+    purgeDeadConnectionsLocked();
     mDisplayEventConnections.add(connection);
     mCondition.broadcast();
     return NO_ERROR;
@@ -69,6 +87,28 @@ void EventThread::removeDisplayEventConnection(
         const wp<EventThread::Connection>& connection) {
     Mutex::Autolock _l(mLock);
     mDisplayEventConnections.remove(connection);
+    mActiveConnections.remove(connection);
+}
+
+void EventThread::updateActiveConnectionLocked(
+        const sp<EventThread::Connection>& connection) {
+    if (connection->count >= 0) {
+        mActiveConnections.add(connection);
+    } else {
+        mActiveConnections.remove(connection);
+    }
+}
+
+void EventThread::purgeDeadConnectionsLocked() {
+    size_t count = mDisplayEventConnections.size();
+    for (size_t i=0 ; i<count ; i++) {
+        const wp<Connection>& connection(mDisplayEventConnections[i]);
+        if (connection.promote() == NULL) {
+            mActiveConnections.remove(connection);
+            mDisplayEventConnections.removeAt(i);
+            --i; --count;
+        }
+    }
 }
 
 void EventThread::setVsyncRate(uint32_t count,
@@ -78,6 +118,7 @@ void EventThread::setVsyncRate(uint32_t count,
         const int32_t new_count = (count == 0) ? -1 : count;
         if (connection->count != new_count) {
             connection->count = new_count;
+            updateActiveConnectionLocked(connection);
             mCondition.broadcast();
         }
     }
@@ -88,6 +129,7 @@ void EventThread::requestNextVsync(
     Mutex::Autolock _l(mLock);
     if (connection->count < 0) {
         connection->count = 0;
+        updateActiveConnectionLocked(connection);
         mCondition.broadcast();
     }
 }
@@ -116,6 +158,13 @@ void EventThread::onVSyncReceived(int type, nsecs_t timestamp) {
             "received event for an invalid display (id=%d)", type);
 
     Mutex::Autolock _l(mLock);
+    if (mVSyncModel && type == HWC_DISPLAY_PRIMARY &&
+            mVSyncModel->isLocked()) {
+        // the events are generated from the model's predictions,
+        // this sample was only needed to train it
+        mCondition.broadcast();
+        return;
+    }
     if (type < HWC_DISPLAY_TYPES_SUPPORTED) {
         mVSyncEvent[type].header.type = DisplayEventReceiver::DISPLAY_EVENT_VSYNC;
         mVSyncEvent[type].header.id = type;
@@ -141,18 +190,32 @@ void EventThread::onHotplugReceived(int type, bool connected) {
     }
 }
 
+void EventThread::setVSyncDivisor(uint32_t divisor) {
+    Mutex::Autolock _l(mLock);
+    mVSyncDivisor = divisor ? divisor : 1;
+}
+
 bool EventThread::threadLoop() {
     DisplayEventReceiver::Event event;
     Vector< sp<EventThread::Connection> > signalConnections;
     signalConnections = waitForEvent(&event);
 
-    // dispatch events to listeners...
+    // dispatch events to listeners, without holding mLock
     const size_t count = signalConnections.size();
     for (size_t i=0 ; i<count ; i++) {
         const sp<Connection>& conn(signalConnections[i]);
         // now see if we still need to report this event
         status_t err = conn->postEvent(event);
-        if (err == -EAGAIN || err == -EWOULDBLOCK) {
+        if (err == NO_ERROR) {
+            const nsecs_t latency = systemTime(SYSTEM_TIME_MONOTONIC) -
+                    event.header.timestamp;
+            conn->deliveredCount++;
+            conn->deliveryLatencyTotal += latency;
+            if (latency > conn->deliveryLatencyMax) {
+                conn->deliveryLatencyMax = latency;
+            }
+        } else if (err == -EAGAIN || err == -EWOULDBLOCK) {
+            conn->droppedCount++;
             // The destination doesn't accept events anymore, it's probably
             // full. For now, we just drop the events on the floor.
             // FIXME: Note that some events cannot be dropped and would have
@@ -191,6 +254,12 @@ Vector< sp<EventThread::Connection> > EventThread::waitForEvent(
                 *event = mVSyncEvent[i];
                 mVSyncEvent[i].header.timestamp = 0;
                 vsyncCount = mVSyncEvent[i].vsync.count;
+                if (i == HWC_DISPLAY_PRIMARY && mVSyncDivisor > 1 &&
+                        (vsyncCount % mVSyncDivisor) != 0) {
+                    // skipped to lower the refresh rate, wait for the next
+                    timestamp = 0;
+                    continue;
+                }
                 break;
             }
         }
@@ -205,49 +274,68 @@ Vector< sp<EventThread::Connection> > EventThread::waitForEvent(
             }
         }
 
-        // find out connections waiting for events
-        size_t count = mDisplayEventConnections.size();
-        for (size_t i=0 ; i<count ; i++) {
-            sp<Connection> connection(mDisplayEventConnections[i].promote());
-            if (connection != NULL) {
-                bool added = false;
-                if (connection->count >= 0) {
-                    // we need vsync events because at least
-                    // one connection is waiting for it
-                    waitForVSync = true;
-                    if (timestamp) {
-                        // we consume the event only if it's time
-                        // (ie: we received a vsync event)
-                        if (connection->count == 0) {
-                            // fired this time around
-                            connection->count = -1;
-                            signalConnections.add(connection);
-                            added = true;
-                        } else if (connection->count == 1 ||
-                                (vsyncCount % connection->count) == 0) {
-                            // continuous event, and time to report it
-                            signalConnections.add(connection);
-                            added = true;
-                        }
-                    }
-                }
-
-                if (eventPending && !timestamp && !added) {
-                    // we don't have a vsync event to process
-                    // (timestamp==0), but we have some pending
-                    // messages.
+        if (eventPending) {
+            // other events go to everybody
+            size_t count = mDisplayEventConnections.size();
+            for (size_t i=0 ; i<count ; i++) {
+                sp<Connection> connection(mDisplayEventConnections[i].promote());
+                if (connection != NULL) {
                     signalConnections.add(connection);
+                } else {
+                    // we couldn't promote this reference, the connection has
+                    // died, so clean-up!
+                    mActiveConnections.remove(mDisplayEventConnections[i]);
+                    mDisplayEventConnections.removeAt(i);
+                    --i; --count;
                 }
-            } else {
+            }
+        }
+
+        // find out connections waiting for vsync events, connections
+        // that don't want them aren't in mActiveConnections at all
+        size_t count = mActiveConnections.size();
+        for (size_t i=0 ; i<count ; i++) {
+            sp<Connection> connection(mActiveConnections[i].promote());
+            if (connection == NULL) {
                 // we couldn't promote this reference, the connection has
                 // died, so clean-up!
-                mDisplayEventConnections.removeAt(i);
+                mDisplayEventConnections.remove(mActiveConnections[i]);
+                mActiveConnections.removeAt(i);
                 --i; --count;
+                continue;
+            }
+            // we need vsync events because at least
+            // one connection is waiting for it
+            waitForVSync = true;
+            if (timestamp) {
+                // we consume the event only if it's time
+                // (ie: we received a vsync event)
+                if (connection->count == 0) {
+                    // fired this time around
+                    connection->count = -1;
+                    mActiveConnections.removeAt(i);
+                    --i; --count;
+                    signalConnections.add(connection);
+                } else if (connection->count == 1 ||
+                        (vsyncCount % connection->count) == 0) {
+                    // continuous event, and time to report it
+                    signalConnections.add(connection);
+                }
             }
         }
 
         // Here we figure out if we need to enable or disable vsyncs
-        if (timestamp && !waitForVSync) {
+        if (mVSyncModel) {
+            // h/w vsync is only needed while the model learns the
+            // display's timing, or when its predictions may have drifted
+            const bool needHwVSync = waitForVSync && mVSyncModel->needsHwSamples(
+                    systemTime(SYSTEM_TIME_MONOTONIC));
+            if (needHwVSync) {
+                enableVSyncLocked();
+            } else if (mDebugVsyncEnabled) {
+                disableVSyncLocked();
+            }
+        } else if (timestamp && !waitForVSync) {
             // we received a VSYNC but we have no clients
             // don't report it, and disable VSYNC events
             disableVSyncLocked();
@@ -277,6 +365,10 @@ Vector< sp<EventThread::Connection> > EventThread::waitForEvent(
                 // use a (long) timeout when waiting for h/w vsync, and
                 // generate fake events when necessary.
                 bool softwareSync = mUseSoftwareVSync;
+                if (!softwareSync && mVSyncModel && mVSyncModel->isLocked()) {
+                    waitForPredictedVSyncLocked();
+                    continue;
+                }
                 nsecs_t timeout = softwareSync ? ms2ns(16) : ms2ns(1000);
                 if (mCondition.waitRelative(mLock, timeout) == TIMED_OUT) {
                     if (!softwareSync) {
@@ -299,41 +391,108 @@ Vector< sp<EventThread::Connection> > EventThread::waitForEvent(
         }
     } while (signalConnections.isEmpty());
 
+    if (event->header.type == DisplayEventReceiver::DISPLAY_EVENT_VSYNC) {
+        recordWakeupLocked(*event);
+    }
+
     // here we're guaranteed to have a timestamp and some connections to signal
     // (The connections might have dropped out of mDisplayEventConnections
     // while we were asleep, but we'll still have strong references to them.)
     return signalConnections;
 }
 
+// Waits for the next vsync predicted by mVSyncModel (plus our phase
+// offset) and makes it pending, unless woken up before that.
+void EventThread::waitForPredictedVSyncLocked() {
+    const nsecs_t period = mVSyncModel->getPeriod();
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    // never report the same vsync twice
+    nsecs_t after = mLastPredictedVSync + mPhaseOffset + period / 2;
+    if (after < now) {
+        after = now;
+    }
+    const nsecs_t next = mVSyncModel->computeNextVSync(after, mPhaseOffset);
+    if (next > now) {
+        mCondition.waitRelative(mLock, next - now);
+        now = systemTime(SYSTEM_TIME_MONOTONIC);
+    }
+    if (now < next) {
+        // something else happened
+        return;
+    }
+
+    mLastPredictedVSync = next - mPhaseOffset;
+    mPredictedEventCount++;
+    mVSyncEvent[0].header.type = DisplayEventReceiver::DISPLAY_EVENT_VSYNC;
+    mVSyncEvent[0].header.id = HWC_DISPLAY_PRIMARY;
+    mVSyncEvent[0].header.timestamp = next;
+    mVSyncEvent[0].vsync.count++;
+}
+
+void EventThread::recordWakeupLocked(const DisplayEventReceiver::Event& event) {
+    nsecs_t jitter = systemTime(SYSTEM_TIME_MONOTONIC) - event.header.timestamp;
+    if (jitter < 0) {
+        jitter = 0;
+    }
+    mWakeupJitterTotal += jitter;
+    mWakeupJitterCount++;
+    if (jitter > mWakeupJitterMax) {
+        mWakeupJitterMax = jitter;
+    }
+    if (jitter > ms2ns(1)) {
+        mWakeupJitterLateCount++;
+    }
+}
+
 void EventThread::enableVSyncLocked() {
     if (!mUseSoftwareVSync) {
         // never enable h/w VSYNC when screen is off
-        mFlinger->eventControl(HWC_DISPLAY_PRIMARY, SurfaceFlinger::EVENT_VSYNC, true);
+        mFlinger->requestHwVSync(this, true);
         mPowerHAL.vsyncHint(true);
     }
     mDebugVsyncEnabled = true;
 }
 
 void EventThread::disableVSyncLocked() {
-    mFlinger->eventControl(HWC_DISPLAY_PRIMARY, SurfaceFlinger::EVENT_VSYNC, false);
+    mFlinger->requestHwVSync(this, false);
     mPowerHAL.vsyncHint(false);
     mDebugVsyncEnabled = false;
 }
 
 void EventThread::dump(String8& result, char* buffer, size_t SIZE) const {
     Mutex::Autolock _l(mLock);
-    result.appendFormat("VSYNC state: %s\n",
+    result.appendFormat("%s VSYNC state: %s\n", mName,
             mDebugVsyncEnabled?"enabled":"disabled");
     result.appendFormat("  soft-vsync: %s\n",
             mUseSoftwareVSync?"enabled":"disabled");
-    result.appendFormat("  numListeners=%u,\n  events-delivered: %u\n",
-            mDisplayEventConnections.size(),
+    result.appendFormat("  vsync divisor: %u\n", mVSyncDivisor);
+    if (mVSyncModel) {
+        result.appendFormat("  predicted events: %u, phase offset=%.3f ms\n",
+                mPredictedEventCount, mPhaseOffset / 1e6);
+    }
+    result.appendFormat("  wake-up jitter: avg=%.1f us, max=%.1f us, "
+            ">1ms: %u of %u\n",
+            mWakeupJitterCount ? mWakeupJitterTotal / 1e3 / mWakeupJitterCount : 0.0,
+            mWakeupJitterMax / 1e3,
+            mWakeupJitterLateCount, mWakeupJitterCount);
+    result.appendFormat("  numListeners=%u, active=%u,\n  events-delivered: %u\n",
+            mDisplayEventConnections.size(), mActiveConnections.size(),
             mVSyncEvent[HWC_DISPLAY_PRIMARY].vsync.count);
     for (size_t i=0 ; i<mDisplayEventConnections.size() ; i++) {
         sp<Connection> connection =
                 mDisplayEventConnections.itemAt(i).promote();
-        result.appendFormat("    %p: count=%d\n",
-                connection.get(), connection!=NULL ? connection->count : 0);
+        if (connection == NULL) {
+            result.append("    (dead)\n");
+            continue;
+        }
+        const uint32_t delivered = connection->deliveredCount;
+        result.appendFormat("    %p: count=%d, delivered=%u, dropped=%u, "
+                "latency avg=%.1f us, max=%.1f us\n",
+                connection.get(), connection->count,
+                delivered, connection->droppedCount,
+                delivered ? connection->deliveryLatencyTotal / 1e3 / delivered : 0.0,
+                connection->deliveryLatencyMax / 1e3);
     }
 }
 
@@ -341,7 +500,10 @@ void EventThread::dump(String8& result, char* buffer, size_t SIZE) const {
 
 EventThread::Connection::Connection(
         const sp<EventThread>& eventThread)
-    : count(-1), mEventThread(eventThread), mChannel(new BitTube())
+    : count(-1),
+      deliveredCount(0), droppedCount(0),
+      deliveryLatencyTotal(0), deliveryLatencyMax(0),
+      mEventThread(eventThread), mChannel(new BitTube())
 {
 }
 
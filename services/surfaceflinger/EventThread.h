@@ -37,6 +37,7 @@ namespace android {
 
 class SurfaceFlinger;
 class String8;
+class VSyncModel;
 
 // ---------------------------------------------------------------------------
 
@@ -51,6 +52,12 @@ class EventThread : public Thread {
         // count ==-1 : one-shot event that fired this round / disabled
         int32_t count;
 
+        // delivery statistics, only updated by the EventThread's loop
+        uint32_t deliveredCount;
+        uint32_t droppedCount;
+        nsecs_t deliveryLatencyTotal;
+        nsecs_t deliveryLatencyMax;
+
     private:
         virtual ~Connection();
         virtual void onFirstRef();
@@ -63,7 +70,13 @@ class EventThread : public Thread {
 
 public:
 
-    EventThread(const sp<SurfaceFlinger>& flinger);
+    // with a VSyncModel, vsync events are generated from its predictions,
+    // phaseOffset after each predicted vsync, as soon as it is locked.
+    // The model is trained by SurfaceFlinger, several EventThreads with
+    // different offsets can share it.
+    EventThread(const sp<SurfaceFlinger>& flinger,
+            VSyncModel* vsyncModel = NULL, nsecs_t phaseOffset = 0,
+            const char* name = "EventThread");
 
     sp<Connection> createEventConnection() const;
     status_t registerDisplayEventConnection(const sp<Connection>& connection);
@@ -81,6 +94,10 @@ public:
     void onVSyncReceived(int type, nsecs_t timestamp);
     void onHotplugReceived(int type, bool connected);
 
+    // only report one primary display vsync out of 'divisor', to lower
+    // the effective refresh rate
+    void setVSyncDivisor(uint32_t divisor);
+
     Vector< sp<EventThread::Connection> > waitForEvent(
             DisplayEventReceiver::Event* event);
 
@@ -91,21 +108,41 @@ private:
     virtual void        onFirstRef();
 
     void removeDisplayEventConnection(const wp<Connection>& connection);
+    void updateActiveConnectionLocked(const sp<Connection>& connection);
+    void purgeDeadConnectionsLocked();
     void enableVSyncLocked();
     void disableVSyncLocked();
+    void waitForPredictedVSyncLocked();
+    void recordWakeupLocked(const DisplayEventReceiver::Event& event);
 
     // constants
     sp<SurfaceFlinger> mFlinger;
     PowerHAL mPowerHAL;
+    VSyncModel* const mVSyncModel;
+    const nsecs_t mPhaseOffset;
+    const char* const mName;
 
     mutable Mutex mLock;
     mutable Condition mCondition;
 
     // protected by mLock
     SortedVector< wp<Connection> > mDisplayEventConnections;
+    // the connections with count >= 0, the only ones scanned on vsync
+    SortedVector< wp<Connection> > mActiveConnections;
     Vector< DisplayEventReceiver::Event > mPendingEvents;
     DisplayEventReceiver::Event mVSyncEvent[HWC_DISPLAY_TYPES_SUPPORTED];
     bool mUseSoftwareVSync;
+    uint32_t mVSyncDivisor;
+    // vsync (without phase offset) of the last event generated from
+    // mVSyncModel
+    nsecs_t mLastPredictedVSync;
+    uint32_t mPredictedEventCount;
+
+    // how late we wake up for vsync events, relative to their timestamp
+    nsecs_t mWakeupJitterTotal;
+    nsecs_t mWakeupJitterMax;
+    uint32_t mWakeupJitterCount;
+    uint32_t mWakeupJitterLateCount;
 
     // for debugging
     bool mDebugVsyncEnabled;
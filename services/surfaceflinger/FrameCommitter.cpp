@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/Log.h>
+#include <utils/Timers.h>
+#include <utils/Trace.h>
+
+#include "FrameCommitter.h"
+#include "LayerBase.h"
+#include "SurfaceFlinger.h"
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+FrameCommitter::FrameCommitter(SurfaceFlinger& flinger)
+    : Thread(false),
+      mFlinger(flinger),
+      mPending(false),
+      mWaits(0),
+      mWaitTime(0),
+      mFrames(0),
+      mLastDuration(0),
+      mTotalDuration(0)
+{
+}
+
+void FrameCommitter::onFirstRef()
+{
+    run("FrameCommitter", PRIORITY_URGENT_DISPLAY);
+}
+
+void FrameCommitter::commit(const SurfaceFlinger::PostedFrame& frame)
+{
+    waitForCommit();
+    Mutex::Autolock _l(mLock);
+    mFrame = frame;
+    mPending = true;
+    mCondition.broadcast();
+}
+
+void FrameCommitter::waitForCommit()
+{
+    // the references to the last frame are dropped here, so that the
+    // layers removed meanwhile are destroyed on the main thread as usual
+    SurfaceFlinger::PostedFrame frame;
+    {
+        Mutex::Autolock _l(mLock);
+        if (mPending) {
+            ATRACE_CALL();
+            const nsecs_t start = systemTime();
+            while (mPending) {
+                mCondition.wait(mLock);
+            }
+            mWaitTime += systemTime() - start;
+            mWaits++;
+        }
+        frame.displays = mFrame.displays;
+        frame.layers = mFrame.layers;
+        mFrame.displays.clear();
+        mFrame.layers.clear();
+    }
+}
+
+void FrameCommitter::stop()
+{
+    {
+        Mutex::Autolock _l(mLock);
+        requestExit();
+        mCondition.broadcast();
+    }
+    join();
+}
+
+bool FrameCommitter::threadLoop()
+{
+    {
+        Mutex::Autolock _l(mLock);
+        while (!mPending && !exitPending()) {
+            mCondition.wait(mLock);
+        }
+        if (exitPending()) {
+            return false;
+        }
+    }
+
+    ATRACE_CALL();
+    const nsecs_t start = systemTime();
+    mFlinger.commitFrame(mFrame);
+    const Vector< sp<LayerBase> >& layers(mFrame.layers);
+    for (size_t i=0 ; i<layers.size() ; i++) {
+        layers[i]->onPostComposition();
+    }
+    mLastDuration = systemTime() - start;
+    mTotalDuration += mLastDuration;
+    mFrames++;
+
+    Mutex::Autolock _l(mLock);
+    mPending = false;
+    mCondition.broadcast();
+    return true;
+}
+
+void FrameCommitter::dump(String8& result) const
+{
+    const uint32_t waits = mWaits;
+    const uint32_t frames = mFrames;
+    result.appendFormat("  commit thread: frames=%u, last=%.1f us, "
+            "avg=%.1f us, main thread waited %u times, avg=%.1f us\n",
+            frames, mLastDuration / 1000.0,
+            frames ? mTotalDuration / 1000.0 / frames : 0.0,
+            waits, waits ? mWaitTime / 1000.0 / waits : 0.0);
+}
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
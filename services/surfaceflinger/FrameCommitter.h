@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SF_FRAME_COMMITTER_H
+#define ANDROID_SF_FRAME_COMMITTER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/String8.h>
+#include <utils/threads.h>
+
+#include "SurfaceFlinger.h"
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+/*
+ * FrameCommitter hands a composed frame to the HWComposer on its own
+ * thread, so that the main thread doesn't block in set() and can handle
+ * the next transactions, the screen captures and the post-composition
+ * bookkeeping meanwhile.
+ *
+ * The thread runs SurfaceFlinger::commitFrame() and then the layers'
+ * onPostComposition(), which need the fences set() returns. The main
+ * thread calls commit() at the end of its composition, and
+ * waitForCommit() before anything that uses the HWComposer or releases
+ * the layers' buffers; in between the thread owns the HWComposer. It is
+ * only used with a framebuffer target, set() doesn't need EGL then.
+ */
+class FrameCommitter : public Thread
+{
+public:
+    FrameCommitter(SurfaceFlinger& flinger);
+
+    // starts committing the frame, waits for the previous one if needed
+    void commit(const SurfaceFlinger::PostedFrame& frame);
+
+    // returns once the frame given to commit() is committed
+    void waitForCommit();
+
+    // stops the thread, must not be committing
+    void stop();
+
+    void dump(String8& result) const;
+
+private:
+    virtual bool threadLoop();
+    virtual void onFirstRef();
+
+    SurfaceFlinger& mFlinger;
+
+    mutable Mutex mLock;
+    Condition mCondition;
+    bool mPending;
+    // owned by the committer thread while mPending is set
+    SurfaceFlinger::PostedFrame mFrame;
+
+    // main thread
+    uint32_t mWaits;
+    nsecs_t mWaitTime;
+    // committer thread, read racily by dump()
+    uint32_t mFrames;
+    nsecs_t mLastDuration;
+    nsecs_t mTotalDuration;
+};
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
+
+#endif // ANDROID_SF_FRAME_COMMITTER_H
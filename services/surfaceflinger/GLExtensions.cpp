@@ -28,7 +28,10 @@ ANDROID_SINGLETON_STATIC_INSTANCE( GLExtensions )
 GLExtensions::GLExtensions()
     : mHaveTextureExternal(false),
       mHaveNpot(false),
-      mHaveDirectTexture(false)
+      mHaveDirectTexture(false),
+      mHaveFramebufferObject(false),
+      mHaveNativeFenceSync(false),
+      mHaveWaitSync(false)
 {
 }
 
@@ -96,6 +99,13 @@ void GLExtensions::initWithGLStrings(
     if (hasExtension("GL_OES_framebuffer_object")) {
         mHaveFramebufferObject = true;
     }
+
+    if (hasExtension("EGL_ANDROID_native_fence_sync")) {
+        mHaveNativeFenceSync = true;
+        if (hasExtension("EGL_ANDROID_wait_sync")) {
+            mHaveWaitSync = true;
+        }
+    }
 }
 
 bool GLExtensions::hasExtension(char const* extension) const
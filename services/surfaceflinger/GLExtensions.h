@@ -40,6 +40,8 @@ class GLExtensions : public Singleton<GLExtensions>
     bool mHaveNpot              : 1;
     bool mHaveDirectTexture     : 1;
     bool mHaveFramebufferObject : 1;
+    bool mHaveNativeFenceSync   : 1;
+    bool mHaveWaitSync          : 1;
 
     String8 mVendor;
     String8 mRenderer;
@@ -71,6 +73,14 @@ public:
         return mHaveFramebufferObject;
     }
 
+    // GPU-side fence waits (see SurfaceTexture::doGLFenceWait) need both
+    inline bool haveNativeFenceSync() const {
+        return mHaveNativeFenceSync;
+    }
+    inline bool haveWaitSync() const {
+        return mHaveWaitSync;
+    }
+
     void initWithGLStrings(
             GLubyte const* vendor,
             GLubyte const* renderer,
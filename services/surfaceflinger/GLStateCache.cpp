@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "GLStateCache.h"
+
+namespace android {
+// ---------------------------------------------------------------------------
+
+static const GLuint UNKNOWN_TEXTURE = GLuint(-1);
+
+static pthread_key_t gStateCacheKey;
+static pthread_once_t gStateCacheOnce = PTHREAD_ONCE_INIT;
+
+static void destroyStateCache(void* p)
+{
+    delete static_cast<GLStateCache*>(p);
+}
+
+static void createStateCacheKey()
+{
+    pthread_key_create(&gStateCacheKey, destroyStateCache);
+}
+
+GLStateCache& GLStateCache::getInstance()
+{
+    pthread_once(&gStateCacheOnce, createStateCacheKey);
+    GLStateCache* cache =
+            static_cast<GLStateCache*>(pthread_getspecific(gStateCacheKey));
+    if (cache == NULL) {
+        cache = new GLStateCache();
+        pthread_setspecific(gStateCacheKey, cache);
+    }
+    return *cache;
+}
+
+GLStateCache::GLStateCache()
+    : mCalls(0), mSkipped(0)
+{
+    invalidate();
+}
+
+void GLStateCache::invalidate()
+{
+    mBlend = UNKNOWN;
+    mBlendSrc = 0;
+    mDither = UNKNOWN;
+    mColorValid = false;
+    mTexEnvMode = UNKNOWN;
+    mTextureTarget = 0;
+    mTextureTargetValid = false;
+    mTexture2D = UNKNOWN_TEXTURE;
+    mTextureExternal = UNKNOWN_TEXTURE;
+    mTextureMatrixValid = false;
+    mTexCoordArray = UNKNOWN;
+}
+
+void GLStateCache::restore()
+{
+    setBlending(false);
+    setTexture(0, 0);
+    setTexCoords(NULL);
+}
+
+void GLStateCache::setBlending(bool enable, GLenum src)
+{
+    mCalls++;
+    bool changed = false;
+    if (mBlend != int(enable)) {
+        if (enable) {
+            glEnable(GL_BLEND);
+        } else {
+            glDisable(GL_BLEND);
+        }
+        mBlend = enable;
+        changed = true;
+    }
+    // the blend function only matters while blending is enabled
+    if (enable && mBlendSrc != src) {
+        glBlendFunc(src, GL_ONE_MINUS_SRC_ALPHA);
+        mBlendSrc = src;
+        changed = true;
+    }
+    if (!changed) {
+        mSkipped++;
+    }
+}
+
+void GLStateCache::setDithering(bool enable)
+{
+    mCalls++;
+    if (mDither == int(enable)) {
+        mSkipped++;
+        return;
+    }
+    if (enable) {
+        glEnable(GL_DITHER);
+    } else {
+        glDisable(GL_DITHER);
+    }
+    mDither = enable;
+}
+
+void GLStateCache::setColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a)
+{
+    mCalls++;
+    if (mColorValid && mColor[0] == r && mColor[1] == g &&
+            mColor[2] == b && mColor[3] == a) {
+        mSkipped++;
+        return;
+    }
+    glColor4f(r, g, b, a);
+    mColor[0] = r;
+    mColor[1] = g;
+    mColor[2] = b;
+    mColor[3] = a;
+    mColorValid = true;
+}
+
+void GLStateCache::setTexEnvMode(GLint mode)
+{
+    mCalls++;
+    if (mTexEnvMode == mode) {
+        mSkipped++;
+        return;
+    }
+    glTexEnvx(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, mode);
+    mTexEnvMode = mode;
+}
+
+void GLStateCache::setTexture(GLenum target, GLuint name)
+{
+    mCalls++;
+    bool changed = false;
+    if (!mTextureTargetValid || mTextureTarget != target) {
+        // only one of the targets is ever enabled
+        if (target == GL_TEXTURE_2D) {
+            glDisable(GL_TEXTURE_EXTERNAL_OES);
+            glEnable(GL_TEXTURE_2D);
+        } else if (target == GL_TEXTURE_EXTERNAL_OES) {
+            glDisable(GL_TEXTURE_2D);
+            glEnable(GL_TEXTURE_EXTERNAL_OES);
+        } else {
+            glDisable(GL_TEXTURE_EXTERNAL_OES);
+            glDisable(GL_TEXTURE_2D);
+        }
+        mTextureTarget = target;
+        mTextureTargetValid = true;
+        changed = true;
+    }
+    GLuint* binding = NULL;
+    if (target == GL_TEXTURE_2D) {
+        binding = &mTexture2D;
+    } else if (target == GL_TEXTURE_EXTERNAL_OES) {
+        binding = &mTextureExternal;
+    }
+    if (binding && *binding != name) {
+        glBindTexture(target, name);
+        *binding = name;
+        changed = true;
+    }
+    if (!changed) {
+        mSkipped++;
+    }
+}
+
+void GLStateCache::setTextureMatrix(const GLfloat* matrix)
+{
+    static const GLfloat identity[16] = {
+            1, 0, 0, 0,
+            0, 1, 0, 0,
+            0, 0, 1, 0,
+            0, 0, 0, 1
+    };
+    if (matrix == NULL) {
+        matrix = identity;
+    }
+    mCalls++;
+    if (mTextureMatrixValid &&
+            !memcmp(mTextureMatrix, matrix, sizeof(mTextureMatrix))) {
+        mSkipped++;
+        return;
+    }
+    glMatrixMode(GL_TEXTURE);
+    glLoadMatrixf(matrix);
+    glMatrixMode(GL_MODELVIEW);
+    memcpy(mTextureMatrix, matrix, sizeof(mTextureMatrix));
+    mTextureMatrixValid = true;
+}
+
+void GLStateCache::setTexCoords(const GLfloat* texCoords)
+{
+    mCalls++;
+    if (texCoords == NULL) {
+        if (mTexCoordArray == 0) {
+            mSkipped++;
+            return;
+        }
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+        mTexCoordArray = 0;
+        return;
+    }
+    if (mTexCoordArray != 1) {
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        mTexCoordArray = 1;
+    }
+    // the array is read when drawing, so its address is always given
+    glTexCoordPointer(2, GL_FLOAT, 0, texCoords);
+}
+
+void GLStateCache::drawRegion(const Region& region,
+        uint32_t width, uint32_t height, bool textured)
+{
+    size_t count;
+    Rect const* rects = region.getArray(&count);
+    if (!count) {
+        return;
+    }
+
+    // two triangles per rectangle, so that they can all go in one call
+    const size_t size = count * 6 * 2;
+    if (mVertices.size() < size) {
+        mVertices.insertAt(0.0f, mVertices.size(), size - mVertices.size());
+    }
+    GLfloat* v = mVertices.editArray();
+    const GLfloat h = height;
+    for (size_t i=0 ; i<count ; i++) {
+        const Rect& r(rects[i]);
+        const GLfloat left   = r.left;
+        const GLfloat right  = r.right;
+        const GLfloat top    = h - r.top;
+        const GLfloat bottom = h - r.bottom;
+        *v++ = left;  *v++ = top;
+        *v++ = left;  *v++ = bottom;
+        *v++ = right; *v++ = bottom;
+        *v++ = left;  *v++ = top;
+        *v++ = right; *v++ = bottom;
+        *v++ = right; *v++ = top;
+    }
+
+    if (textured) {
+        if (mTexCoords.size() < size) {
+            mTexCoords.insertAt(0.0f, mTexCoords.size(), size - mTexCoords.size());
+        }
+        // the texture is addressed like the display it stands for
+        const GLfloat sx = 1.0f / width;
+        const GLfloat sy = 1.0f / height;
+        const GLfloat* pos = mVertices.array();
+        GLfloat* t = mTexCoords.editArray();
+        for (size_t i=0 ; i<size ; i+=2) {
+            t[i]   = pos[i]   * sx;
+            t[i+1] = pos[i+1] * sy;
+        }
+        setTexCoords(mTexCoords.array());
+    } else {
+        setTexCoords(NULL);
+    }
+
+    glVertexPointer(2, GL_FLOAT, 0, mVertices.array());
+    glDrawArrays(GL_TRIANGLES, 0, count * 6);
+}
+
+void GLStateCache::dump(String8& result) const
+{
+    result.appendFormat("GL state cache: %u state changes requested, "
+            "%u skipped (%u%%)\n", mCalls, mSkipped,
+            mCalls ? uint32_t((uint64_t(mSkipped) * 100) / mCalls) : 0);
+}
+
+// ---------------------------------------------------------------------------
+}; // namespace android
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SF_GLSTATECACHE_H
+#define ANDROID_SF_GLSTATECACHE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+#include <ui/Region.h>
+
+#include <GLES/gl.h>
+#include <GLES/glext.h>
+
+namespace android {
+// ---------------------------------------------------------------------------
+
+/*
+ * Shadows the GL state used to compose layers, so that what a layer sets
+ * up is only sent to GL when it differs from what the previous layer left
+ * behind. Each thread composing has its own GL context, and so its own
+ * instance; see getInstance().
+ *
+ * Whoever changes any of this state with raw GL calls must invalidate()
+ * the cache afterwards. Between frames the state is restore()d to what
+ * the rest of SurfaceFlinger expects: blending, texturing and the texture
+ * coordinates array disabled.
+ */
+class GLStateCache
+{
+    enum { UNKNOWN = -1 };
+
+    int         mBlend;
+    GLenum      mBlendSrc;
+    int         mDither;
+    GLfloat     mColor[4];
+    bool        mColorValid;
+    GLint       mTexEnvMode;
+    GLenum      mTextureTarget;
+    bool        mTextureTargetValid;
+    GLuint      mTexture2D;
+    GLuint      mTextureExternal;
+    GLfloat     mTextureMatrix[16];
+    bool        mTextureMatrixValid;
+    int         mTexCoordArray;
+
+    // scratch space for drawRegion(), kept to avoid reallocating
+    Vector<GLfloat> mVertices;
+    Vector<GLfloat> mTexCoords;
+
+    uint32_t    mCalls;
+    uint32_t    mSkipped;
+
+    GLStateCache(const GLStateCache&);
+    GLStateCache& operator = (const GLStateCache&);
+
+    GLStateCache();
+
+public:
+    // the cache of the calling thread's context, created on first use
+    static GLStateCache& getInstance();
+
+    // forgets everything, the next request of each state goes to GL
+    void invalidate();
+
+    // puts GL back in the state SurfaceFlinger expects between frames
+    void restore();
+
+    // blending with (src, GL_ONE_MINUS_SRC_ALPHA)
+    void setBlending(bool enable, GLenum src = GL_ONE);
+    void setDithering(bool enable);
+    void setColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a);
+    void setTexEnvMode(GLint mode);
+
+    // enables texturing from the given texture on the given target, which
+    // is GL_TEXTURE_2D or GL_TEXTURE_EXTERNAL_OES; target 0 disables it
+    void setTexture(GLenum target, GLuint name);
+
+    // loads the texture matrix, NULL is the identity
+    void setTextureMatrix(const GLfloat* matrix);
+
+    // points the texture coordinates array, NULL disables it
+    void setTexCoords(const GLfloat* texCoords);
+
+    // draws all rectangles of a region (in display coordinates) with a
+    // single call. If textured, the texture coordinates address the whole
+    // display, as when drawing from a copy of it.
+    void drawRegion(const Region& region, uint32_t width, uint32_t height,
+            bool textured);
+
+    void dump(String8& result) const;
+};
+
+// ---------------------------------------------------------------------------
+}; // namespace android
+
+#endif // ANDROID_SF_GLSTATECACHE_H
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include <cutils/atomic.h>
+
+#include "LatencyHistogram.h"
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+LatencyHistogram::LatencyHistogram() {
+    clear();
+}
+
+void LatencyHistogram::add(nsecs_t duration) {
+    if (duration < 0) {
+        // timestamps in the future (e.g. a desired present time), ignore
+        duration = 0;
+    }
+    nsecs_t index = ns2us(duration) / BUCKET_WIDTH_US;
+    if (index >= NUM_BUCKETS) {
+        index = NUM_BUCKETS - 1;
+    }
+    android_atomic_inc(&mBuckets[index]);
+}
+
+void LatencyHistogram::clear() {
+    for (size_t i=0 ; i<NUM_BUCKETS ; i++) {
+        android_atomic_release_store(0, &mBuckets[i]);
+    }
+}
+
+void LatencyHistogram::snapshot(uint32_t* buckets, uint32_t* count) const {
+    uint32_t total = 0;
+    for (size_t i=0 ; i<NUM_BUCKETS ; i++) {
+        buckets[i] = uint32_t(android_atomic_acquire_load(&mBuckets[i]));
+        total += buckets[i];
+    }
+    *count = total;
+}
+
+uint32_t LatencyHistogram::getCount() const {
+    uint32_t buckets[NUM_BUCKETS];
+    uint32_t count;
+    snapshot(buckets, &count);
+    return count;
+}
+
+static nsecs_t percentileOf(const uint32_t* buckets, size_t numBuckets,
+        uint32_t count, uint32_t percentile) {
+    if (!count) {
+        return 0;
+    }
+    // rank of the sample we're looking for, rounded up
+    const uint64_t rank = (uint64_t(count) * percentile + 99) / 100;
+    uint64_t seen = 0;
+    for (size_t i=0 ; i<numBuckets ; i++) {
+        seen += buckets[i];
+        if (seen >= rank && seen) {
+            return us2ns(nsecs_t(i + 1) * LatencyHistogram::BUCKET_WIDTH_US);
+        }
+    }
+    return us2ns(nsecs_t(numBuckets) * LatencyHistogram::BUCKET_WIDTH_US);
+}
+
+nsecs_t LatencyHistogram::getPercentile(uint32_t percentile) const {
+    uint32_t buckets[NUM_BUCKETS];
+    uint32_t count;
+    snapshot(buckets, &count);
+    return percentileOf(buckets, NUM_BUCKETS, count, percentile);
+}
+
+void LatencyHistogram::dump(String8& result, const char* name) const {
+    uint32_t buckets[NUM_BUCKETS];
+    uint32_t count;
+    snapshot(buckets, &count);
+    result.appendFormat(
+            "  %s: count=%u p50=%.1f p90=%.1f p95=%.1f p99=%.1f ms"
+            " (>%d ms: %u)\n",
+            name, count,
+            percentileOf(buckets, NUM_BUCKETS, count, 50) / 1e6,
+            percentileOf(buckets, NUM_BUCKETS, count, 90) / 1e6,
+            percentileOf(buckets, NUM_BUCKETS, count, 95) / 1e6,
+            percentileOf(buckets, NUM_BUCKETS, count, 99) / 1e6,
+            ((NUM_BUCKETS - 1) * BUCKET_WIDTH_US) / 1000,
+            buckets[NUM_BUCKETS - 1]);
+}
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SF_LATENCY_HISTOGRAM_H
+#define ANDROID_SF_LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+/*
+ * LatencyHistogram accumulates durations in fixed-width buckets.
+ *
+ * add() only does atomic increments, so it can be called from any thread
+ * without taking a lock; readers take a snapshot of the buckets, which may
+ * be slightly inconsistent with respect to concurrent updates.
+ */
+class LatencyHistogram
+{
+public:
+    enum {
+        BUCKET_WIDTH_US = 500,      // 0.5 ms per bucket
+        NUM_BUCKETS     = 101       // up to 50 ms, the last one is overflow
+    };
+
+    LatencyHistogram();
+
+    void add(nsecs_t duration);
+    void clear();
+
+    // returns the number of samples
+    uint32_t getCount() const;
+
+    // returns the upper bound of the bucket containing the given percentile
+    // (0-100) or 0 if the histogram is empty.
+    nsecs_t getPercentile(uint32_t percentile) const;
+
+    // appends a one-line summary: "name: count=... p50=... p90=..."
+    void dump(String8& result, const char* name) const;
+
+private:
+    void snapshot(uint32_t* buckets, uint32_t* count) const;
+
+    volatile int32_t mBuckets[NUM_BUCKETS];
+};
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
+
+#endif // ANDROID_SF_LATENCY_HISTOGRAM_H
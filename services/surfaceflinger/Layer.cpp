@@ -27,21 +27,26 @@
 
 #include <utils/Errors.h>
 #include <utils/Log.h>
+#include <utils/ProtoOutput.h>
 #include <utils/StopWatch.h>
 #include <utils/Trace.h>
 
+#include <ui/Fence.h>
 #include <ui/GraphicBuffer.h>
 #include <ui/PixelFormat.h>
 
 #include <gui/Surface.h>
 
 #include "clz.h"
+#include "Client.h"
 #include "DisplayDevice.h"
 #include "GLExtensions.h"
+#include "GLStateCache.h"
 #include "Layer.h"
 #include "SurfaceFlinger.h"
 #include "SurfaceTextureLayer.h"
 
+#include "DisplayHardware/GraphicBufferAlloc.h"
 #include "DisplayHardware/HWComposer.h"
 
 #define DEBUG_RESIZE    0
@@ -60,6 +65,13 @@ Layer::Layer(SurfaceFlinger* flinger, const sp<Client>& client)
         mRefreshPending(false),
         mFrameLatencyNeeded(false),
         mFrameLatencyOffset(0),
+        mTextureFilter(0),
+        mLatchTime(0),
+        mLatchCost(0),
+        mDeferredFrames(0),
+        mDeferredLatches(0),
+        mTrimmedBytes(0),
+        mTrims(0),
         mFormat(PIXEL_FORMAT_NONE),
         mGLExtensions(GLExtensions::getInstance()),
         mOpaqueLayer(true),
@@ -96,13 +108,17 @@ void Layer::onFirstRef()
     };
 
     // Creates a custom BufferQueue for SurfaceTexture to use
-    sp<BufferQueue> bq = new SurfaceTextureLayer();
+    sp<Client> client(getClient());
+    mAllocator = new GraphicBufferAlloc(
+            client != NULL ? client->getPid() : getpid(), getName());
+    sp<BufferQueue> bq = new SurfaceTextureLayer(mAllocator);
     mSurfaceTexture = new SurfaceTexture(mTextureName, true,
             GL_TEXTURE_EXTERNAL_OES, false, bq);
 
     mSurfaceTexture->setConsumerUsageBits(getEffectiveUsage(0));
     mSurfaceTexture->setFrameAvailableListener(new FrameQueuedListener(this));
     mSurfaceTexture->setSynchronousMode(true);
+    mSurfaceTexture->setLazyBinding(mFlinger->mLazyLayerTextures);
 
 #ifdef TARGET_DISABLE_TRIPLE_BUFFERING
 #warning "disabling triple buffering"
@@ -135,6 +151,7 @@ void Layer::onRemoved()
 void Layer::setName(const String8& name) {
     LayerBase::setName(name);
     mSurfaceTexture->setName(name);
+    mAllocator->setName(name);
 }
 
 sp<ISurface> Layer::createSurface()
@@ -167,11 +184,10 @@ status_t Layer::setBuffers( uint32_t w, uint32_t h,
                             PixelFormat format, uint32_t flags)
 {
     // this surfaces pixel format
-    PixelFormatInfo info;
-    status_t err = getPixelFormatInfo(format, &info);
-    if (err) {
+    const PixelFormatDescriptor* desc = getPixelFormatDescriptor(format);
+    if (desc == NULL) {
         ALOGE("unsupported pixelformat %d", format);
-        return err;
+        return format <= 0 ? BAD_VALUE : BAD_INDEX;
     }
 
     uint32_t const maxSurfaceDims = min(
@@ -204,7 +220,7 @@ status_t Layer::setBuffers( uint32_t w, uint32_t h,
     case 1:
         displayMinColorDepth = mFlinger->getMinColorDepth();
         // we use the red index
-        layerRedsize = info.getSize(PixelFormatInfo::INDEX_RED);
+        layerRedsize = desc->getSize(PixelFormatInfo::INDEX_RED);
         mNeedsDithering = (layerRedsize > displayMinColorDepth);
         break;
     case 2:
@@ -358,7 +374,13 @@ void Layer::onDraw(const sp<const DisplayDevice>& hw, const Region& clip) const
         return;
     }
 
-    status_t err = mSurfaceTexture->doGLFenceWait();
+    // normally done before composition, but not for screenshots
+    status_t err = mSurfaceTexture->bindTextureImage();
+    if (err != NO_ERROR) {
+        ALOGE("onDraw: failed binding the buffer: %d", err);
+    }
+
+    err = mSurfaceTexture->doGLFenceWait();
     if (err != OK) {
         ALOGE("onDraw: failed waiting for fence: %d", err);
         // Go ahead and draw the buffer anyway; no matter what we do the screen
@@ -367,6 +389,7 @@ void Layer::onDraw(const sp<const DisplayDevice>& hw, const Region& clip) const
 
     bool blackOutLayer = isProtected() || (isSecure() && !hw->isSecure());
 
+    GLStateCache& gl(GLStateCache::getInstance());
     if (!blackOutLayer) {
         // TODO: we could be more subtle with isFixedSize()
         const bool useFiltering = getFiltering() || needsFiltering(hw) || isFixedSize();
@@ -377,31 +400,24 @@ void Layer::onDraw(const sp<const DisplayDevice>& hw, const Region& clip) const
         mSurfaceTexture->getTransformMatrix(textureMatrix);
 
         // Set things up for texturing.
-        glBindTexture(GL_TEXTURE_EXTERNAL_OES, mTextureName);
+        gl.setTexture(GL_TEXTURE_EXTERNAL_OES, mTextureName);
         GLenum filter = GL_NEAREST;
         if (useFiltering) {
             filter = GL_LINEAR;
         }
-        glTexParameterx(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, filter);
-        glTexParameterx(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, filter);
-        glMatrixMode(GL_TEXTURE);
-        glLoadMatrixf(textureMatrix);
-        glMatrixMode(GL_MODELVIEW);
-        glDisable(GL_TEXTURE_2D);
-        glEnable(GL_TEXTURE_EXTERNAL_OES);
+        // the filter belongs to the texture, so it only changes with ours
+        if (mTextureFilter != filter) {
+            glTexParameterx(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, filter);
+            glTexParameterx(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, filter);
+            mTextureFilter = filter;
+        }
+        gl.setTextureMatrix(textureMatrix);
     } else {
-        glBindTexture(GL_TEXTURE_2D, mFlinger->getProtectedTexName());
-        glMatrixMode(GL_TEXTURE);
-        glLoadIdentity();
-        glMatrixMode(GL_MODELVIEW);
-        glDisable(GL_TEXTURE_EXTERNAL_OES);
-        glEnable(GL_TEXTURE_2D);
+        gl.setTexture(GL_TEXTURE_2D, mFlinger->getProtectedTexName());
+        gl.setTextureMatrix(NULL);
     }
 
     drawWithOpenGL(hw, clip);
-
-    glDisable(GL_TEXTURE_EXTERNAL_OES);
-    glDisable(GL_TEXTURE_2D);
 }
 
 // As documented in libhardware header, formats in the range
@@ -416,10 +432,9 @@ bool Layer::getOpacityForFormat(uint32_t format)
     if (HARDWARE_IS_DEVICE_FORMAT(format)) {
         return true;
     }
-    PixelFormatInfo info;
-    status_t err = getPixelFormatInfo(PixelFormat(format), &info);
+    const PixelFormatDescriptor* desc = getPixelFormatDescriptor(PixelFormat(format));
     // in case of error (unknown format), we assume no blending
-    return (err || info.h_alpha <= info.l_alpha);
+    return (desc == NULL || desc->isOpaque());
 }
 
 
@@ -536,23 +551,75 @@ bool Layer::onPreComposition() {
     return mQueuedFrames > 0;
 }
 
+void Layer::bindTextureImage() {
+    status_t err = mSurfaceTexture->bindTextureImage();
+    if (err != NO_ERROR) {
+        ALOGE("bindTextureImage: failed binding the buffer: %d", err);
+    }
+}
+
+size_t Layer::trimBuffers() {
+    const size_t freed = mSurfaceTexture->getBufferQueue()->freeIdleBuffers();
+    if (freed) {
+        mTrimmedBytes += freed;
+        mTrims++;
+    }
+    return freed;
+}
+
 void Layer::onPostComposition() {
+    updatePresentTimes();
     if (mFrameLatencyNeeded) {
-        const HWComposer& hwc = mFlinger->getHwComposer();
+        HWComposer& hwc = mFlinger->getHwComposer();
         const size_t offset = mFrameLatencyOffset;
+        const nsecs_t now = systemTime();
         mFrameStats[offset].timestamp = mSurfaceTexture->getTimestamp();
-        mFrameStats[offset].set = systemTime();
+        mFrameStats[offset].set = now;
         mFrameStats[offset].vsync = hwc.getRefreshTimestamp(HWC_DISPLAY_PRIMARY);
+        // the end of the composition stands in for the present time until
+        // the retire fence signals
+        const sp<Fence> fence(hwc.getDisplayFence(HWC_DISPLAY_PRIMARY));
+        if (fence->isValid()) {
+            PendingPresent pending;
+            pending.fence = fence;
+            pending.offset = offset;
+            pending.latchTime = mLatchTime;
+            mPendingPresents.push(pending);
+        } else {
+            mLatchToPresent.add(now - mLatchTime);
+        }
         mFrameLatencyOffset = (mFrameLatencyOffset + 1) % 128;
         mFrameLatencyNeeded = false;
     }
 }
 
+void Layer::updatePresentTimes() {
+    // retire fences signal in order, stop at the first pending one. Frames
+    // that have waited for too long keep their approximate time.
+    static const size_t MAX_PENDING_PRESENTS = 8;
+    while (!mPendingPresents.isEmpty()) {
+        const PendingPresent& pending(mPendingPresents[0]);
+        const nsecs_t signalTime = pending.fence->getSignalTime();
+        if (signalTime == Fence::SIGNAL_TIME_PENDING &&
+                mPendingPresents.size() < MAX_PENDING_PRESENTS) {
+            break;
+        }
+        // a slot zeroed by clearStats() meanwhile stays cleared
+        if (signalTime != Fence::SIGNAL_TIME_PENDING &&
+                signalTime != Fence::SIGNAL_TIME_INVALID &&
+                mFrameStats[pending.offset].set != 0) {
+            mFrameStats[pending.offset].set = signalTime;
+            mLatchToPresent.add(signalTime - pending.latchTime);
+        }
+        mPendingPresents.removeAt(0);
+    }
+}
+
 bool Layer::isVisible() const {
     return LayerBaseClient::isVisible() && (mActiveBuffer != NULL);
 }
 
-Region Layer::latchBuffer(bool& recomputeVisibleRegions)
+Region Layer::latchBuffer(bool& recomputeVisibleRegions, nsecs_t deadline)
 {
     ATRACE_CALL();
 
@@ -572,6 +639,23 @@ Region Layer::latchBuffer(bool& recomputeVisibleRegions)
         const bool oldOpacity = isOpaque();
         sp<GraphicBuffer> oldActiveBuffer = mActiveBuffer;
 
+        // A buffer that isn't ready yet, or that can't be latched before the
+        // deadline, would hold up the whole composition. Keep showing the
+        // previous one and try again next time, but not twice in a row so
+        // that the layer still makes progress.
+        if (deadline && oldActiveBuffer != NULL && mDeferredFrames == 0) {
+            const sp<Fence> fence(mSurfaceTexture->getQueuedBufferFence());
+            const bool pending = fence != NULL &&
+                    fence->getSignalTime() == Fence::SIGNAL_TIME_PENDING;
+            if (pending || systemTime() + mLatchCost > deadline) {
+                mDeferredFrames++;
+                mDeferredLatches++;
+                mFlinger->signalLayerUpdate();
+                return outDirtyRegion;
+            }
+        }
+        mDeferredFrames = 0;
+
         // signal another event if we have more frames pending
         if (android_atomic_dec(&mQueuedFrames) > 1) {
             mFlinger->signalLayerUpdate();
@@ -662,7 +746,26 @@ Region Layer::latchBuffer(bool& recomputeVisibleRegions)
 
         Reject r(mDrawingState, currentState(), recomputeVisibleRegions);
 
-        if (mSurfaceTexture->updateTexImage(&r, true) < NO_ERROR) {
+        // this composition is shown on the next vsync, buffers with a
+        // producer set timestamp are shown on the vsync closest to it
+        nsecs_t presentWhen = 0;
+        if (mFlinger->mPresentTimeScheduling) {
+            HWComposer& hwc(mFlinger->getHwComposer());
+            const nsecs_t period = hwc.getRefreshPeriod(HWC_DISPLAY_PRIMARY);
+            presentWhen = hwc.getRefreshTimestamp(HWC_DISPLAY_PRIMARY) +
+                    period + period/2;
+        }
+
+        const nsecs_t latchStart = systemTime();
+        status_t err = mSurfaceTexture->updateTexImage(&r, true, presentWhen);
+        mLatchCost = (mLatchCost*7 + (systemTime() - latchStart)) / 8;
+        if (err == BufferQueue::PRESENT_LATER) {
+            // the buffer is still queued, look at it again on the next vsync
+            android_atomic_inc(&mQueuedFrames);
+            mFlinger->signalLayerUpdate();
+            return outDirtyRegion;
+        }
+        if (err < NO_ERROR) {
             // something happened!
             recomputeVisibleRegions = true;
             return outDirtyRegion;
@@ -677,6 +780,8 @@ Region Layer::latchBuffer(bool& recomputeVisibleRegions)
 
         mRefreshPending = true;
         mFrameLatencyNeeded = true;
+        mLatchTime = systemTime();
+        mQueueToLatch.add(mLatchTime - mSurfaceTexture->getTimestamp());
         if (oldActiveBuffer == NULL) {
              // the first time we receive a buffer, we need to trigger a
              // geometry invalidation.
@@ -738,9 +843,13 @@ void Layer::dump(String8& result, char* buffer, size_t SIZE) const
     snprintf(buffer, SIZE,
             "      "
             "format=%2d, activeBuffer=[%4ux%4u:%4u,%3X],"
-            " queued-frames=%d, mRefreshPending=%d\n",
+            " queued-frames=%d, mRefreshPending=%d\n"
+            "      latch-cost=%lld us, deferred-latches=%u,"
+            " trimmed=%u KB (%u times)\n",
             mFormat, w0, h0, s0,f0,
-            mQueuedFrames, mRefreshPending);
+            mQueuedFrames, mRefreshPending,
+            ns2us(mLatchCost), mDeferredLatches,
+            mTrimmedBytes / 1024, mTrims);
 
     result.append(buffer);
 
@@ -749,6 +858,30 @@ void Layer::dump(String8& result, char* buffer, size_t SIZE) const
     }
 }
 
+void Layer::dumpProto(ProtoOutput& proto) const
+{
+    LayerBaseClient::dumpProto(proto);
+
+    proto.writeInt32(19, mFormat);
+    sp<const GraphicBuffer> buf0(mActiveBuffer);
+    if (buf0 != 0) {
+        const size_t token = proto.beginMessage(20);
+        proto.writeUInt32(1, buf0->getWidth());
+        proto.writeUInt32(2, buf0->getHeight());
+        proto.writeUInt32(3, buf0->getStride());
+        proto.writeInt32(4, buf0->format);
+        proto.endMessage(token);
+    }
+    proto.writeInt32(21, mQueuedFrames);
+    proto.writeBool(22, mRefreshPending);
+
+    if (mSurfaceTexture != 0) {
+        const size_t token = proto.beginMessage(23);
+        mSurfaceTexture->getBufferQueue()->dumpProto(proto);
+        proto.endMessage(token);
+    }
+}
+
 void Layer::dumpStats(String8& result, char* buffer, size_t SIZE) const
 {
     LayerBaseClient::dumpStats(result, buffer, SIZE);
@@ -769,10 +902,19 @@ void Layer::dumpStats(String8& result, char* buffer, size_t SIZE) const
     result.append("\n");
 }
 
+void Layer::dumpLatencyHistograms(String8& result) const
+{
+    LayerBaseClient::dumpLatencyHistograms(result);
+    mQueueToLatch.dump(result, "queue-to-latch  ");
+    mLatchToPresent.dump(result, "latch-to-present");
+}
+
 void Layer::clearStats()
 {
     LayerBaseClient::clearStats();
     memset(mFrameStats, 0, sizeof(mFrameStats));
+    mQueueToLatch.clear();
+    mLatchToPresent.clear();
 }
 
 uint32_t Layer::getEffectiveUsage(uint32_t usage) const
@@ -34,6 +34,7 @@
 #include <GLES/gl.h>
 #include <GLES/glext.h>
 
+#include "LatencyHistogram.h"
 #include "LayerBase.h"
 #include "SurfaceTextureLayer.h"
 #include "Transform.h"
@@ -44,6 +45,7 @@ namespace android {
 
 class Client;
 class GLExtensions;
+class GraphicBufferAlloc;
 
 // ---------------------------------------------------------------------------
 
@@ -71,11 +73,19 @@ public:
     virtual void onLayerDisplayed(const sp<const DisplayDevice>& hw,
             HWComposer::HWCLayerInterface* layer);
     virtual bool onPreComposition();
+    virtual void bindTextureImage();
     virtual void onPostComposition();
+    virtual nsecs_t getLastUpdateTime() const { return mLatchTime; }
 
     virtual void onDraw(const sp<const DisplayDevice>& hw, const Region& clip) const;
     virtual uint32_t doTransaction(uint32_t transactionFlags);
-    virtual Region latchBuffer(bool& recomputeVisibleRegions);
+    virtual Region latchBuffer(bool& recomputeVisibleRegions, nsecs_t deadline);
+    // number of latches deferred by latchBuffer() so far
+    uint32_t getDeferredLatches() const { return mDeferredLatches; }
+    // frees the buffers the producer doesn't hold, but the current one,
+    // returns how many bytes that reclaimed (main thread)
+    size_t trimBuffers();
+    size_t getTrimmedBytes() const { return mTrimmedBytes; }
     virtual bool isOpaque() const;
     virtual bool needsDithering() const     { return mNeedsDithering; }
     virtual bool isSecure() const           { return mSecure; }
@@ -99,7 +109,9 @@ protected:
     virtual void onFirstRef();
     virtual void dump(String8& result, char* scratch, size_t size) const;
     virtual void dumpStats(String8& result, char* buffer, size_t SIZE) const;
+    virtual void dumpLatencyHistograms(String8& result) const;
     virtual void clearStats();
+    virtual void dumpProto(ProtoOutput& proto) const;
 
 private:
     friend class SurfaceTextureLayer;
@@ -114,6 +126,8 @@ private:
 
     // constants
     sp<SurfaceTexture> mSurfaceTexture;
+    // allocates the buffers of mSurfaceTexture, accounted to the client
+    sp<GraphicBufferAlloc> mAllocator;
     GLuint mTextureName;
 
     // thread-safe
@@ -128,17 +142,46 @@ private:
     bool mRefreshPending;
     bool mFrameLatencyNeeded;
     int mFrameLatencyOffset;
+    // filter last set on mTextureName, 0 until then
+    mutable GLenum mTextureFilter;
 
     struct Statistics {
         Statistics() : timestamp(0), set(0), vsync(0) { }
         nsecs_t timestamp;  // buffer timestamp
-        nsecs_t set;        // buffer displayed timestamp
+        nsecs_t set;        // buffer displayed timestamp, from the retire fence
+                            // when the HAL provides one
         nsecs_t vsync;      // vsync immediately before set
     };
 
     // protected by mLock
     Statistics mFrameStats[128];
 
+    // a frame whose 'set' time waits for the display's retire fence to
+    // signal (main thread)
+    struct PendingPresent {
+        sp<Fence> fence;
+        size_t offset;
+        nsecs_t latchTime;
+    };
+    Vector<PendingPresent> mPendingPresents;
+    void updatePresentTimes();
+
+    // time the current buffer was latched (main thread)
+    nsecs_t mLatchTime;
+    // buffer timestamp to latchBuffer()
+    LatencyHistogram mQueueToLatch;
+    // latchBuffer() to the retire of the frame it was displayed in, or to
+    // the end of that composition without a retire fence
+    LatencyHistogram mLatchToPresent;
+    // running average of the time updateTexImage() takes, the compositions
+    // in a row and in total a latch was deferred for (main thread)
+    nsecs_t mLatchCost;
+    uint32_t mDeferredFrames;
+    uint32_t mDeferredLatches;
+    // bytes reclaimed by trimBuffers() so far, and how many times
+    size_t mTrimmedBytes;
+    uint32_t mTrims;
+
     // constants
     PixelFormat mFormat;
     const GLExtensions& mGLExtensions;
@@ -30,6 +30,8 @@
 
 #include "clz.h"
 #include "Client.h"
+#include "DumpProto.h"
+#include "GLStateCache.h"
 #include "LayerBase.h"
 #include "Layer.h"
 #include "SurfaceFlinger.h"
@@ -47,7 +49,9 @@ LayerBase::LayerBase(SurfaceFlinger* flinger)
       mFlinger(flinger), mFiltering(false),
       mNeedsFiltering(false),
       mTransactionFlags(0),
-      mPremultipliedAlpha(true), mName("unnamed"), mDebug(false)
+      mPremultipliedAlpha(true), mName("unnamed"), mDebug(false),
+      mLastShownTime(systemTime()),
+      mHwcFlips(0)
 {
 }
 
@@ -80,6 +84,7 @@ void LayerBase::initStates(uint32_t w, uint32_t h, uint32_t flags)
     mCurrentState.layerStack = 0;
     mCurrentState.flags = layerFlags;
     mCurrentState.sequence = 0;
+    mCurrentState.frameRate = 0;
     mCurrentState.transform.set(0, 0);
     mCurrentState.requested = mCurrentState.active;
 
@@ -87,6 +92,45 @@ void LayerBase::initStates(uint32_t w, uint32_t h, uint32_t flags)
     mDrawingState = mCurrentState;
 }
 
+bool LayerBase::updateHwcCompositionType(int32_t id, int32_t type,
+        bool skipped, uint32_t holdFrames)
+{
+    ssize_t index = mHwcComposition.indexOfKey(id);
+    if (index < 0) {
+        HwcComposition c;
+        c.type = type;
+        c.heldFrames = 0;
+        mHwcComposition.add(id, c);
+        return false;
+    }
+
+    HwcComposition& c(mHwcComposition.editValueAt(index));
+    const int32_t previous = c.type;
+    c.type = type;
+    if (c.heldFrames) {
+        // the hold ends once the layer stayed in GLES long enough, the
+        // next frame h/w composer gets to pick again
+        return --c.heldFrames == 0;
+    }
+    if (skipped || previous == type) {
+        return false;
+    }
+    if ((previous == HWC_OVERLAY && type == HWC_FRAMEBUFFER) ||
+            (previous == HWC_FRAMEBUFFER && type == HWC_OVERLAY)) {
+        mHwcFlips++;
+        if (type == HWC_FRAMEBUFFER && holdFrames) {
+            c.heldFrames = holdFrames;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool LayerBase::isHeldInGles(int32_t id) const {
+    ssize_t index = mHwcComposition.indexOfKey(id);
+    return index >= 0 && mHwcComposition.valueAt(index).heldFrames;
+}
+
 bool LayerBase::needsFiltering(const sp<const DisplayDevice>& hw) const {
     return mNeedsFiltering || hw->needsFiltering();
 }
@@ -144,6 +188,10 @@ bool LayerBase::setAlpha(uint8_t alpha) {
     return true;
 }
 bool LayerBase::setMatrix(const layer_state_t::matrix22_t& matrix) {
+    const Transform& tr(mCurrentState.transform);
+    if (tr[0][0] == matrix.dsdx && tr[1][0] == matrix.dsdy &&
+            tr[0][1] == matrix.dtdx && tr[1][1] == matrix.dtdy)
+        return false;
     mCurrentState.sequence++;
     mCurrentState.transform.set(
             matrix.dsdx, matrix.dsdy, matrix.dtdx, matrix.dtdy);
@@ -151,6 +199,8 @@ bool LayerBase::setMatrix(const layer_state_t::matrix22_t& matrix) {
     return true;
 }
 bool LayerBase::setTransparentRegionHint(const Region& transparent) {
+    if (mCurrentState.transparentRegion.mergeExclusive(transparent).isEmpty())
+        return false;
     mCurrentState.sequence++;
     mCurrentState.transparentRegion = transparent;
     requestTransaction();
@@ -183,6 +233,15 @@ bool LayerBase::setLayerStack(uint32_t layerStack) {
     return true;
 }
 
+bool LayerBase::setFrameRate(float frameRate) {
+    if (mCurrentState.frameRate == frameRate)
+        return false;
+    // doesn't affect visible regions, no need to bump the sequence
+    mCurrentState.frameRate = frameRate;
+    requestTransaction();
+    return true;
+}
+
 void LayerBase::setVisibleRegion(const Region& visibleRegion) {
     // always called from main thread
     this->visibleRegion = visibleRegion;
@@ -262,7 +321,7 @@ Rect LayerBase::computeBounds() const {
     return s.transform.transform(win);
 }
 
-Region LayerBase::latchBuffer(bool& recomputeVisibleRegions) {
+Region LayerBase::latchBuffer(bool& recomputeVisibleRegions, nsecs_t deadline) {
     Region result;
     return result;
 }
@@ -349,12 +408,11 @@ void LayerBase::clearWithOpenGL(const sp<const DisplayDevice>& hw, const Region&
         GLclampf red, GLclampf green, GLclampf blue, GLclampf alpha) const
 {
     const uint32_t fbHeight = hw->getHeight();
-    glColor4f(red,green,blue,alpha);
-
-    glDisable(GL_TEXTURE_EXTERNAL_OES);
-    glDisable(GL_TEXTURE_2D);
-    glDisable(GL_BLEND);
-    glDisable(GL_DITHER);
+    GLStateCache& gl(GLStateCache::getInstance());
+    gl.setColor(red,green,blue,alpha);
+    gl.setTexture(0, 0);
+    gl.setBlending(false);
+    gl.setDithering(false);
 
     LayerMesh mesh;
     computeGeometry(hw, &mesh);
@@ -373,26 +431,21 @@ void LayerBase::drawWithOpenGL(const sp<const DisplayDevice>& hw, const Region&
     const uint32_t fbHeight = hw->getHeight();
     const State& s(drawingState());
 
+    GLStateCache& gl(GLStateCache::getInstance());
     GLenum src = mPremultipliedAlpha ? GL_ONE : GL_SRC_ALPHA;
     if (CC_UNLIKELY(s.alpha < 0xFF)) {
         const GLfloat alpha = s.alpha * (1.0f/255.0f);
         if (mPremultipliedAlpha) {
-            glColor4f(alpha, alpha, alpha, alpha);
+            gl.setColor(alpha, alpha, alpha, alpha);
         } else {
-            glColor4f(1, 1, 1, alpha);
+            gl.setColor(1, 1, 1, alpha);
         }
-        glEnable(GL_BLEND);
-        glBlendFunc(src, GL_ONE_MINUS_SRC_ALPHA);
-        glTexEnvx(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+        gl.setBlending(true, src);
+        gl.setTexEnvMode(GL_MODULATE);
     } else {
-        glColor4f(1, 1, 1, 1);
-        glTexEnvx(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
-        if (!isOpaque()) {
-            glEnable(GL_BLEND);
-            glBlendFunc(src, GL_ONE_MINUS_SRC_ALPHA);
-        } else {
-            glDisable(GL_BLEND);
-        }
+        gl.setColor(1, 1, 1, 1);
+        gl.setTexEnvMode(GL_REPLACE);
+        gl.setBlending(!isOpaque(), src);
     }
 
     LayerMesh mesh;
@@ -429,19 +482,10 @@ void LayerBase::drawWithOpenGL(const sp<const DisplayDevice>& hw, const Region&
         texCoords[i].v = 1.0f - texCoords[i].v;
     }
 
-    if (needsDithering()) {
-        glEnable(GL_DITHER);
-    } else {
-        glDisable(GL_DITHER);
-    }
-
-    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-    glTexCoordPointer(2, GL_FLOAT, 0, texCoords);
+    gl.setDithering(needsDithering());
+    gl.setTexCoords(&texCoords[0].u);
     glVertexPointer(2, GL_FLOAT, 0, mesh.getVertices());
     glDrawArrays(GL_TRIANGLE_FAN, 0, mesh.getVertexCount());
-
-    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
-    glDisable(GL_BLEND);
 }
 
 void LayerBase::dump(String8& result, char* buffer, size_t SIZE) const
@@ -460,17 +504,44 @@ void LayerBase::dump(String8& result, char* buffer, size_t SIZE) const
             "      "
             "layerStack=%4d, z=%9d, pos=(%g,%g), size=(%4d,%4d), crop=(%4d,%4d,%4d,%4d), "
             "isOpaque=%1d, needsDithering=%1d, invalidate=%1d, "
-            "alpha=0x%02x, flags=0x%08x, tr=[%.2f, %.2f][%.2f, %.2f]\n",
+            "alpha=0x%02x, flags=0x%08x, tr=[%.2f, %.2f][%.2f, %.2f], "
+            "frameRate=%.2f, hwcFlips=%u\n",
             s.layerStack, s.z, s.transform.tx(), s.transform.ty(), s.active.w, s.active.h,
             s.active.crop.left, s.active.crop.top,
             s.active.crop.right, s.active.crop.bottom,
             isOpaque(), needsDithering(), contentDirty,
             s.alpha, s.flags,
             s.transform[0][0], s.transform[0][1],
-            s.transform[1][0], s.transform[1][1]);
+            s.transform[1][0], s.transform[1][1],
+            s.frameRate, mHwcFlips);
     result.append(buffer);
 }
 
+void LayerBase::dumpProto(ProtoOutput& proto) const
+{
+    const Layer::State& s(drawingState());
+    proto.writeString(1, getName());
+    proto.writeString(2, getTypeId());
+    proto.writeUInt32(4, s.layerStack);
+    proto.writeUInt32(5, s.z);
+    proto.writeFloat(6, s.transform.tx());
+    proto.writeFloat(7, s.transform.ty());
+    proto.writeUInt32(8, s.active.w);
+    proto.writeUInt32(9, s.active.h);
+    dumpProtoRect(proto, 10, s.active.crop);
+    proto.writeUInt32(11, s.alpha);
+    proto.writeUInt32(12, s.flags);
+    proto.writeBool(13, isOpaque());
+    proto.writeFloat(14, s.transform[0][0]);
+    proto.writeFloat(14, s.transform[0][1]);
+    proto.writeFloat(14, s.transform[1][0]);
+    proto.writeFloat(14, s.transform[1][1]);
+    dumpProtoRegion(proto, 15, visibleRegion);
+    dumpProtoRegion(proto, 16, s.transparentRegion);
+    proto.writeBool(17, contentDirty);
+    proto.writeFloat(18, s.frameRate);
+}
+
 void LayerBase::shortDump(String8& result, char* scratch, size_t size) const {
     LayerBase::dump(result, scratch, size);
 }
@@ -478,6 +549,9 @@ void LayerBase::shortDump(String8& result, char* scratch, size_t size) const {
 void LayerBase::dumpStats(String8& result, char* scratch, size_t SIZE) const {
 }
 
+void LayerBase::dumpLatencyHistograms(String8& result) const {
+}
+
 void LayerBase::clearStats() {
 }
 
@@ -510,6 +584,11 @@ LayerBaseClient::~LayerBaseClient()
     }
 }
 
+sp<Client> LayerBaseClient::getClient() const
+{
+    return mClientRef.promote();
+}
+
 sp<ISurface> LayerBaseClient::createSurface()
 {
     class BSurface : public BnSurface, public LayerCleaner {
@@ -558,6 +637,12 @@ void LayerBaseClient::dump(String8& result, char* buffer, size_t SIZE) const
 }
 
 
+void LayerBaseClient::dumpProto(ProtoOutput& proto) const
+{
+    LayerBase::dumpProto(proto);
+    proto.writeUInt32(3, getIdentity());
+}
+
 void LayerBaseClient::shortDump(String8& result, char* scratch, size_t size) const
 {
     LayerBaseClient::dump(result, scratch, size);
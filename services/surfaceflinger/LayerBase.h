@@ -24,6 +24,7 @@
 #include <EGL/eglext.h>
 #include <GLES/gl.h>
 
+#include <utils/KeyedVector.h>
 #include <utils/RefBase.h>
 #include <utils/String8.h>
 
@@ -45,6 +46,7 @@ class DisplayDevice;
 class GraphicBuffer;
 class Layer;
 class LayerBaseClient;
+class ProtoOutput;
 class SurfaceFlinger;
 
 // ---------------------------------------------------------------------------
@@ -84,6 +86,7 @@ public:
                 uint8_t         flags;
                 uint8_t         reserved[2];
                 int32_t         sequence;   // changes when visible regions can change
+                float           frameRate;  // preferred frame rate, 0 if none
                 Transform       transform;
                 Region          transparentRegion;
             };
@@ -115,6 +118,7 @@ public:
             bool setFlags(uint8_t flags, uint8_t mask);
             bool setCrop(const Rect& crop);
             bool setLayerStack(uint32_t layerStack);
+            bool setFrameRate(float frameRate);
 
             void commitTransaction();
             bool requestTransaction();
@@ -189,14 +193,22 @@ public:
      * the visible regions need to be recomputed (this is a fairly heavy
      * operation, so this should be set only if needed). Typically this is used
      * to figure out if the content or size of a surface has changed.
+     * When deadline isn't 0, a new buffer that can't be latched by then
+     * without waiting may be left for the next composition.
      */
-    virtual Region latchBuffer(bool& recomputeVisibleRegions);
+    virtual Region latchBuffer(bool& recomputeVisibleRegions, nsecs_t deadline);
 
     /**
      * isOpaque - true if this surface is opaque
      */
     virtual bool isOpaque() const  { return true; }
 
+    /**
+     * getSolidColor - true if this surface is a single color, which is
+     * returned premultiplied
+     */
+    virtual bool getSolidColor(hwc_color* color) const { return false; }
+
     /**
      * needsDithering - true if this surface needs dithering
      */
@@ -228,6 +240,11 @@ public:
      *  current list */
     virtual void onRemoved() { }
 
+    /** called before composition if the layer is composed with GLES,
+     * binds the latched buffer to the layer's texture.
+     */
+    virtual void bindTextureImage() { }
+
     /** called after page-flip
      */
     virtual void onLayerDisplayed(const sp<const DisplayDevice>& hw,
@@ -242,6 +259,30 @@ public:
      */
     virtual void onPostComposition() { }
 
+    /**
+     * returns when the layer's content last changed, 0 if it never does
+     */
+    virtual nsecs_t getLastUpdateTime() const { return 0; }
+
+    /**
+     * when the layer was last visible on a display that isn't released,
+     * or created if it never was (main thread)
+     */
+    nsecs_t getLastShownTime() const { return mLastShownTime; }
+    void setLastShownTime(nsecs_t when) { mLastShownTime = when; }
+
+    /**
+     * records the composition type h/w composer picked for the layer on
+     * display id, a fallback from HWC_OVERLAY to HWC_FRAMEBUFFER holds
+     * the layer in GLES for holdFrames frames. skipped is true if the
+     * layer was kept out of h/w composer for another reason. Returns true
+     * if the hold started or ended, which changes the geometry (main thread)
+     */
+    bool updateHwcCompositionType(int32_t id, int32_t type,
+            bool skipped, uint32_t holdFrames);
+    bool isHeldInGles(int32_t id) const;
+    uint32_t getHwcFlips() const { return mHwcFlips; }
+
     /**
      * Updates the SurfaceTexture's transform hint, for layers that have
      * a SurfaceTexture.
@@ -252,7 +293,10 @@ public:
     virtual void dump(String8& result, char* scratch, size_t size) const;
     virtual void shortDump(String8& result, char* scratch, size_t size) const;
     virtual void dumpStats(String8& result, char* buffer, size_t SIZE) const;
+    virtual void dumpLatencyHistograms(String8& result) const;
     virtual void clearStats();
+    /** writes the fields of a Layer message, see surfaceflinger.proto */
+    virtual void dumpProto(ProtoOutput& proto) const;
 
 
     enum { // flags for doTransaction()
@@ -295,6 +339,17 @@ protected:
                 bool            mPremultipliedAlpha;
                 String8         mName;
     mutable     bool            mDebug;
+                nsecs_t         mLastShownTime;
+
+                // per h/w composer display, the composition type the
+                // layer got last and the frames it's still held in GLES
+                struct HwcComposition {
+                    int32_t type;
+                    uint32_t heldFrames;
+                };
+                KeyedVector<int32_t, HwcComposition> mHwcComposition;
+                // times the layer moved between overlay and GLES
+                uint32_t        mHwcFlips;
 
 
 public:
@@ -327,8 +382,11 @@ public:
     uint32_t getIdentity() const { return mIdentity; }
 
 protected:
+    sp<Client> getClient() const;
+
     virtual void dump(String8& result, char* scratch, size_t size) const;
     virtual void shortDump(String8& result, char* scratch, size_t size) const;
+    virtual void dumpProto(ProtoOutput& proto) const;
 
     class LayerCleaner {
         sp<SurfaceFlinger> mFlinger;
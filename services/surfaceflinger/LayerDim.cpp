@@ -21,11 +21,14 @@
 #include <GLES/gl.h>
 #include <GLES/glext.h>
 
+#include <hardware/hwcomposer.h>
+
 #include <utils/Errors.h>
 #include <utils/Log.h>
 
 #include <ui/GraphicBuffer.h>
 
+#include "GLStateCache.h"
 #include "LayerDim.h"
 #include "SurfaceFlinger.h"
 #include "DisplayDevice.h"
@@ -48,29 +51,30 @@ void LayerDim::onDraw(const sp<const DisplayDevice>& hw, const Region& clip) con
     if (s.alpha>0) {
         const GLfloat alpha = s.alpha/255.0f;
         const uint32_t fbHeight = hw->getHeight();
-        glDisable(GL_TEXTURE_EXTERNAL_OES);
-        glDisable(GL_TEXTURE_2D);
-
-        if (s.alpha == 0xFF) {
-            glDisable(GL_BLEND);
-        } else {
-            glEnable(GL_BLEND);
-            glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
-        }
-
-        glColor4f(0, 0, 0, alpha);
+        GLStateCache& gl(GLStateCache::getInstance());
+        gl.setTexture(0, 0);
+        gl.setTexCoords(NULL);
+        gl.setBlending(s.alpha != 0xFF, GL_ONE);
+        gl.setColor(0, 0, 0, alpha);
 
         LayerMesh mesh;
         computeGeometry(hw, &mesh);
 
         glVertexPointer(2, GL_FLOAT, 0, mesh.getVertices());
         glDrawArrays(GL_TRIANGLE_FAN, 0, mesh.getVertexCount());
-
-        glDisable(GL_BLEND);
-        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
     }
 }
 
+bool LayerDim::getSolidColor(hwc_color* color) const
+{
+    const State& s(drawingState());
+    color->r = 0;
+    color->g = 0;
+    color->b = 0;
+    color->a = s.alpha;
+    return true;
+}
+
 // ---------------------------------------------------------------------------
 
 }; // namespace android
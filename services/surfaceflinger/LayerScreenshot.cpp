@@ -26,6 +26,7 @@
 
 #include <ui/GraphicBuffer.h>
 
+#include "GLStateCache.h"
 #include "LayerScreenshot.h"
 #include "SurfaceFlinger.h"
 #include "DisplayDevice.h"
@@ -37,7 +38,8 @@ namespace android {
 LayerScreenshot::LayerScreenshot(SurfaceFlinger* flinger,
         const sp<Client>& client)
     : LayerBaseClient(flinger, client),
-      mTextureName(0), mFlinger(flinger), mIsSecure(false)
+      mTextureName(0), mFlinger(flinger), mIsSecure(false),
+      mImage(EGL_NO_IMAGE_KHR)
 {
 }
 
@@ -46,45 +48,93 @@ LayerScreenshot::~LayerScreenshot()
     if (mTextureName) {
         mFlinger->deleteTextureAsync(mTextureName);
     }
+    releaseFramebuffer();
 }
 
-status_t LayerScreenshot::captureLocked(int32_t layerStack) {
-    GLfloat u, v;
-    status_t result = mFlinger->renderScreenToTextureLocked(layerStack,
-            &mTextureName, &u, &v);
-    if (result != NO_ERROR) {
-        return result;
+void LayerScreenshot::releaseFramebuffer()
+{
+    if (mImage != EGL_NO_IMAGE_KHR) {
+        eglDestroyImageKHR(mFlinger->mEGLDisplay, mImage);
+        mImage = EGL_NO_IMAGE_KHR;
     }
-    initTexture(u, v);
+    if (mBuffer != NULL) {
+        mBufferDisplay->releaseFramebufferTargetBuffer(mBuffer);
+        mBuffer = NULL;
+        mBufferDisplay = NULL;
+    }
+}
 
-    // Currently screenshot always comes from the default display
-    mIsSecure = mFlinger->getDefaultDisplayDevice()->getSecureLayerVisible();
+status_t LayerScreenshot::captureFramebufferLocked(int32_t layerStack) {
+    // the last frame on screen is what would be rendered, it can be shown
+    // as is, without drawing all the layers again into a new texture
+    sp<GraphicBuffer> buffer(mFlinger->holdScreenBufferLocked(layerStack));
+    if (buffer == NULL) {
+        return NAME_NOT_FOUND;
+    }
+    mBufferDisplay = mFlinger->getDefaultDisplayDevice();
+    mBuffer = buffer;
+
+    const EGLDisplay dpy = mFlinger->mEGLDisplay;
+    mImage = eglCreateImageKHR(dpy, EGL_NO_CONTEXT, EGL_NATIVE_BUFFER_ANDROID,
+            (EGLClientBuffer)buffer->getNativeBuffer(), 0);
+    if (mImage == EGL_NO_IMAGE_KHR) {
+        releaseFramebuffer();
+        return INVALID_OPERATION;
+    }
+
+    // make sure to clear all GL error flags
+    while ( glGetError() != GL_NO_ERROR ) ;
+
+    glGenTextures(1, &mTextureName);
+    glBindTexture(GL_TEXTURE_2D, mTextureName);
+    glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, (GLeglImageOES)mImage);
+    glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    if (glGetError() != GL_NO_ERROR) {
+        glDeleteTextures(1, &mTextureName);
+        mTextureName = 0;
+        releaseFramebuffer();
+        return INVALID_OPERATION;
+    }
 
+    // the buffer's rows are laid out top to bottom
+    initTexture(1, 1, true);
     return NO_ERROR;
 }
 
-status_t LayerScreenshot::capture() {
-    GLfloat u, v;
-    status_t result = mFlinger->renderScreenToTexture(0, &mTextureName, &u, &v);
+status_t LayerScreenshot::captureLocked(int32_t layerStack) {
+    status_t result = captureFramebufferLocked(layerStack);
     if (result != NO_ERROR) {
-        return result;
+        GLfloat u, v;
+        result = mFlinger->renderScreenToTextureLocked(layerStack,
+                &mTextureName, &u, &v);
+        if (result != NO_ERROR) {
+            return result;
+        }
+        initTexture(u, v, false);
     }
-    initTexture(u, v);
 
     // Currently screenshot always comes from the default display
     mIsSecure = mFlinger->getDefaultDisplayDevice()->getSecureLayerVisible();
-    
+
     return NO_ERROR;
 }
 
-void LayerScreenshot::initTexture(GLfloat u, GLfloat v) {
+status_t LayerScreenshot::capture() {
+    Mutex::Autolock _l(mFlinger->mStateLock);
+    return captureLocked(0);
+}
+
+void LayerScreenshot::initTexture(GLfloat u, GLfloat v, bool topDown) {
     glBindTexture(GL_TEXTURE_2D, mTextureName);
     glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    mTexCoords[0] = 0;         mTexCoords[1] = v;
-    mTexCoords[2] = 0;         mTexCoords[3] = 0;
-    mTexCoords[4] = u;         mTexCoords[5] = 0;
-    mTexCoords[6] = u;         mTexCoords[7] = v;
+    const GLfloat top = topDown ? 0 : v;
+    const GLfloat bottom = topDown ? v : 0;
+    mTexCoords[0] = 0;         mTexCoords[1] = top;
+    mTexCoords[2] = 0;         mTexCoords[3] = bottom;
+    mTexCoords[4] = u;         mTexCoords[5] = bottom;
+    mTexCoords[6] = u;         mTexCoords[7] = top;
 }
 
 void LayerScreenshot::initStates(uint32_t w, uint32_t h, uint32_t flags) {
@@ -117,6 +167,7 @@ uint32_t LayerScreenshot::doTransaction(uint32_t flags)
             glDeleteTextures(1, &mTextureName);
             mTextureName = 0;
         }
+        releaseFramebuffer();
     }
     return LayerBaseClient::doTransaction(flags);
 }
@@ -128,13 +179,13 @@ void LayerScreenshot::onDraw(const sp<const DisplayDevice>& hw, const Region& cl
         const GLfloat alpha = s.alpha/255.0f;
         const uint32_t fbHeight = hw->getHeight();
 
+        GLStateCache& gl(GLStateCache::getInstance());
         if (s.alpha == 0xFF) {
-            glDisable(GL_BLEND);
-            glTexEnvx(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+            gl.setBlending(false);
+            gl.setTexEnvMode(GL_REPLACE);
         } else {
-            glEnable(GL_BLEND);
-            glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
-            glTexEnvx(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+            gl.setBlending(true, GL_ONE);
+            gl.setTexEnvMode(GL_MODULATE);
         }
 
         GLuint texName = mTextureName;
@@ -145,24 +196,12 @@ void LayerScreenshot::onDraw(const sp<const DisplayDevice>& hw, const Region& cl
         LayerMesh mesh;
         computeGeometry(hw, &mesh);
 
-        glColor4f(alpha, alpha, alpha, alpha);
-
-        glDisable(GL_TEXTURE_EXTERNAL_OES);
-        glEnable(GL_TEXTURE_2D);
-
-        glBindTexture(GL_TEXTURE_2D, texName);
-        glMatrixMode(GL_TEXTURE);
-        glLoadIdentity();
-        glMatrixMode(GL_MODELVIEW);
-
-        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-        glTexCoordPointer(2, GL_FLOAT, 0, mTexCoords);
+        gl.setColor(alpha, alpha, alpha, alpha);
+        gl.setTexture(GL_TEXTURE_2D, texName);
+        gl.setTextureMatrix(NULL);
+        gl.setTexCoords(mTexCoords);
         glVertexPointer(2, GL_FLOAT, 0, mesh.getVertices());
         glDrawArrays(GL_TRIANGLE_FAN, 0, mesh.getVertexCount());
-
-        glDisable(GL_BLEND);
-        glDisable(GL_TEXTURE_2D);
-        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
     }
 }
 
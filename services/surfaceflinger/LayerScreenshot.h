@@ -29,12 +29,19 @@
 
 namespace android {
 
+class GraphicBuffer;
+
 class LayerScreenshot : public LayerBaseClient
 {
     GLuint mTextureName;
     GLfloat mTexCoords[8];
     sp<SurfaceFlinger> mFlinger;
     bool mIsSecure;
+    // when the screenshot is the last frame of a display's framebuffer
+    // target, that display's buffer and its image, which mTextureName shows
+    sp<const DisplayDevice> mBufferDisplay;
+    sp<GraphicBuffer> mBuffer;
+    EGLImageKHR mImage;
 public:    
             LayerScreenshot(SurfaceFlinger* flinger, const sp<Client>& client);
         virtual ~LayerScreenshot();
@@ -52,7 +59,9 @@ public:
 
 private:
     status_t captureLocked(int32_t layerStack);
-    void initTexture(GLfloat u, GLfloat v);
+    status_t captureFramebufferLocked(int32_t layerStack);
+    void releaseFramebuffer();
+    void initTexture(GLfloat u, GLfloat v, bool topDown);
 };
 
 // ---------------------------------------------------------------------------
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SF_LAYER_SNAPSHOT_H
+#define ANDROID_SF_LAYER_SNAPSHOT_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/Vector.h>
+
+#include <ui/Rect.h>
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+/*
+ * LayerSnapshot holds, for each layer of the drawing state in z-order, the
+ * values the per-frame passes look at for every layer, one array per field,
+ * so that they can be walked without touching the layers themselves.
+ *
+ * It is rebuilt by SurfaceFlinger whenever the visible regions need to be
+ * recomputed, that is after a transaction or a buffer latch changed the
+ * drawing state. This is only accessed from the main thread.
+ */
+struct LayerSnapshot {
+    enum {
+        VISIBLE = 0x01,     // LayerBase::isVisible()
+        OPAQUE  = 0x02,     // LayerBase::isOpaque()
+    };
+
+    // sets the number of layers, existing entries keep their storage
+    void resize(size_t count) {
+        resizeVector(layerStack, count);
+        resizeVector(z, count);
+        resizeVector(sequence, count);
+        resizeVector(orientation, count);
+        resizeVector(bounds, count);
+        resizeVector(alpha, count);
+        resizeVector(flags, count);
+    }
+
+    inline size_t size() const { return layerStack.size(); }
+
+    Vector<uint32_t>    layerStack;
+    Vector<uint32_t>    z;
+    Vector<int32_t>     sequence;       // LayerBase::State::sequence
+    Vector<uint32_t>    orientation;    // of the layer's transform
+    Vector<Rect>        bounds;         // LayerBase::computeBounds()
+    Vector<uint8_t>     alpha;
+    Vector<uint8_t>     flags;
+
+private:
+    template <typename T>
+    static void resizeVector(Vector<T>& v, size_t count) {
+        if (v.size() < count) {
+            v.insertAt(v.size(), count - v.size());
+        } else if (v.size() > count) {
+            v.removeItemsAt(count, v.size() - count);
+        }
+    }
+};
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
+
+#endif // ANDROID_SF_LAYER_SNAPSHOT_H
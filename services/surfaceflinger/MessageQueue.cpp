@@ -17,6 +17,7 @@
 #include <stdint.h>
 #include <errno.h>
 #include <sys/types.h>
+#include <string.h>
 
 #include <binder/IPCThreadState.h>
 
@@ -65,6 +66,7 @@ void MessageQueue::Handler::handleMessage(const Message& message) {
     switch (message.what) {
         case INVALIDATE:
             android_atomic_and(~eventMaskInvalidate, &mEventMask);
+            mQueue.beginFrame();
             mQueue.mFlinger->onMessageReceived(message.what);
             break;
         case REFRESH:
@@ -77,7 +79,10 @@ void MessageQueue::Handler::handleMessage(const Message& message) {
 // ---------------------------------------------------------------------------
 
 MessageQueue::MessageQueue()
+    : mSyncHead(0), mSyncTail(0),
+      mPendingReasons(0), mCoalescedRequests(0), mFrames(0)
 {
+    memset((void*)mRequests, 0, sizeof(mRequests));
 }
 
 MessageQueue::~MessageQueue() {
@@ -103,6 +108,7 @@ void MessageQueue::waitMessage() {
     do {
         IPCThreadState::self()->flushCommands();
         int32_t ret = mLooper->pollOnce(-1);
+        dispatchSyncMessages();
         switch (ret) {
             case ALOOPER_POLL_WAKE:
             case ALOOPER_POLL_CALLBACK:
@@ -132,6 +138,44 @@ status_t MessageQueue::postMessage(
     return NO_ERROR;
 }
 
+status_t MessageQueue::postMessageSync(SyncMessage& message)
+{
+    message.next = 0;
+    message.postTime = systemTime();
+    message.barrier.close();
+    { // scope for lock
+        Mutex::Autolock _l(mSyncLock);
+        if (mSyncTail) {
+            mSyncTail->next = &message;
+        } else {
+            mSyncHead = &message;
+        }
+        mSyncTail = &message;
+    }
+    // pollOnce() returns after a wake(), whatever else it had to do
+    mLooper->wake();
+    message.barrier.wait();
+    return NO_ERROR;
+}
+
+void MessageQueue::dispatchSyncMessages()
+{
+    SyncMessage* message;
+    { // scope for lock
+        Mutex::Autolock _l(mSyncLock);
+        message = mSyncHead;
+        mSyncHead = mSyncTail = 0;
+    }
+    while (message) {
+        // the message is gone as soon as its barrier opens
+        SyncMessage* const next = message->next;
+        mSyncMessageDelay.add(systemTime() - message->postTime);
+        message->handler();
+        message->barrier.open();
+        message = next;
+    }
+}
+
 /* when INVALIDATE_ON_VSYNC is set SF only processes
  * buffer updates on VSYNC and performs a refresh immediately
  * after.
@@ -143,7 +187,13 @@ status_t MessageQueue::postMessage(
  */
 #define INVALIDATE_ON_VSYNC 1
 
-void MessageQueue::invalidate() {
+void MessageQueue::invalidate(uint32_t reason) {
+    android_atomic_inc(&mRequests[reason]);
+    if (android_atomic_or(1 << reason, &mPendingReasons) != 0) {
+        // the frame is scheduled already, it will see what changed
+        android_atomic_inc(&mCoalescedRequests);
+        return;
+    }
 #if INVALIDATE_ON_VSYNC
     mEvents->requestNextVsync();
 #else
@@ -151,6 +201,12 @@ void MessageQueue::invalidate() {
 #endif
 }
 
+void MessageQueue::beginFrame() {
+    // whatever is invalidated from now on needs the next frame
+    android_atomic_and(0, &mPendingReasons);
+    android_atomic_inc(&mFrames);
+}
+
 void MessageQueue::refresh() {
 #if INVALIDATE_ON_VSYNC
     mHandler->dispatchRefresh();
@@ -159,6 +215,15 @@ void MessageQueue::refresh() {
 #endif
 }
 
+void MessageQueue::dump(String8& result) const {
+    result.appendFormat("Frame scheduler: %d frames, %d invalidate requests "
+            "coalesced\n", mFrames, mCoalescedRequests);
+    result.appendFormat("  requests: transaction=%d, layer-update=%d, "
+            "repaint=%d, other=%d\n",
+            mRequests[REASON_TRANSACTION], mRequests[REASON_LAYER_UPDATE],
+            mRequests[REASON_REPAINT], mRequests[REASON_OTHER]);
+}
+
 int MessageQueue::cb_eventReceiver(int fd, int events, void* data) {
     MessageQueue* queue = reinterpret_cast<MessageQueue *>(data);
     return queue->eventReceiver(fd, events);
@@ -167,16 +232,18 @@ int MessageQueue::cb_eventReceiver(int fd, int events, void* data) {
 int MessageQueue::eventReceiver(int fd, int events) {
     ssize_t n;
     DisplayEventReceiver::Event buffer[8];
-    while ((n = DisplayEventReceiver::getEvents(mEventTube, buffer, 8)) > 0) {
-        for (int i=0 ; i<n ; i++) {
-            if (buffer[i].header.type == DisplayEventReceiver::DISPLAY_EVENT_VSYNC) {
+    // a backlog of vsync events only needs one refresh
+    while ((n = DisplayEventReceiver::getEventsWithLatestVsync(mEventTube,
+            buffer, 8)) > 0) {
+        if (buffer[n - 1].header.type == DisplayEventReceiver::DISPLAY_EVENT_VSYNC) {
 #if INVALIDATE_ON_VSYNC
-                mHandler->dispatchInvalidate();
+            mHandler->dispatchInvalidate();
 #else
-                mHandler->dispatchRefresh();
+            mHandler->dispatchRefresh();
 #endif
-                break;
-            }
+        }
+        if (n < 8) {
+            break;
         }
     }
     return 1;
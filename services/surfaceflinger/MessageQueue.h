@@ -24,10 +24,12 @@
 #include <utils/threads.h>
 #include <utils/Timers.h>
 #include <utils/Looper.h>
+#include <utils/String8.h>
 
 #include <gui/DisplayEventReceiver.h>
 
 #include "Barrier.h"
+#include "LatencyHistogram.h"
 
 namespace android {
 
@@ -57,6 +59,28 @@ private:
     mutable Barrier barrier;
 };
 
+/*
+ * A message for SurfaceFlinger::postMessageSync() that lives on the stack
+ * of the thread waiting for it: posting it allocates nothing and doesn't
+ * go through the Looper's message list.
+ */
+class SyncMessage
+{
+public:
+    SyncMessage() : next(0), postTime(0) { }
+
+    virtual bool handler() = 0;
+
+protected:
+    virtual ~SyncMessage() { }
+
+private:
+    friend class MessageQueue;
+    SyncMessage* next;
+    nsecs_t postTime;
+    Barrier barrier;
+};
+
 // ---------------------------------------------------------------------------
 
 class MessageQueue {
@@ -87,12 +111,31 @@ class MessageQueue {
     static int cb_eventReceiver(int fd, int events, void* data);
     int eventReceiver(int fd, int events);
 
+    void dispatchSyncMessages();
+    void beginFrame();
+
+    // SyncMessages in the order they were posted
+    Mutex mSyncLock;
+    SyncMessage* mSyncHead;
+    SyncMessage* mSyncTail;
+    // post to handling delay of the SyncMessages
+    LatencyHistogram mSyncMessageDelay;
+
 public:
     enum {
         INVALIDATE = 0,
         REFRESH    = 1,
     };
 
+    // why invalidate() is called
+    enum {
+        REASON_TRANSACTION  = 0,
+        REASON_LAYER_UPDATE = 1,
+        REASON_REPAINT      = 2,
+        REASON_OTHER        = 3,
+        REASON_COUNT
+    };
+
     MessageQueue();
     ~MessageQueue();
     void init(const sp<SurfaceFlinger>& flinger);
@@ -100,8 +143,25 @@ public:
 
     void waitMessage();
     status_t postMessage(const sp<MessageBase>& message, nsecs_t reltime=0);
-    void invalidate();
+    // returns once the main thread ran message's handler. A SyncMessage
+    // is handled once the Looper's messages and callbacks pending when it
+    // was posted are, or sooner.
+    status_t postMessageSync(SyncMessage& message);
+    LatencyHistogram& getSyncMessageDelay() { return mSyncMessageDelay; }
+    // schedules a frame: a transaction, invalidate and refresh cycle. All
+    // the calls made until the frame begins get the same one.
+    void invalidate(uint32_t reason = REASON_OTHER);
     void refresh();
+    void dump(String8& result) const;
+
+private:
+    // the reasons invalidate() was called for since the last frame began,
+    // a bit per reason. The first one schedules the frame, the others
+    // are coalesced into it.
+    volatile int32_t mPendingReasons;
+    volatile int32_t mRequests[REASON_COUNT];
+    volatile int32_t mCoalescedRequests;
+    volatile int32_t mFrames;
 };
 
 // ---------------------------------------------------------------------------
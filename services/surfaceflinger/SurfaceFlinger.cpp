@@ -33,6 +33,8 @@
 #include <binder/MemoryHeapBase.h>
 #include <binder/PermissionCache.h>
 
+#include <cpustats/ThreadCpuSampler.h>
+
 #include <ui/DisplayInfo.h>
 
 #include <gui/BitTube.h>
@@ -41,24 +43,34 @@
 #include <gui/IDisplayEventConnection.h>
 #include <gui/SurfaceTextureClient.h>
 
+#include <hardware/hwcomposer.h>
+
+#include <ui/GraphicBuffer.h>
 #include <ui/GraphicBufferAllocator.h>
 #include <ui/PixelFormat.h>
 #include <ui/UiConfig.h>
 
 #include <utils/misc.h>
+#include <utils/Profiler.h>
+#include <utils/SharedBuffer.h>
 #include <utils/String8.h>
 #include <utils/String16.h>
 #include <utils/StopWatch.h>
 #include <utils/Trace.h>
 
 #include <private/android_filesystem_config.h>
+#include <private/gui/LayerStateChannel.h>
 
 #include "clz.h"
 #include "DdmConnection.h"
+#include "DisplayComposer.h"
 #include "DisplayDevice.h"
+#include "DumpProto.h"
 #include "Client.h"
 #include "EventThread.h"
+#include "FrameCommitter.h"
 #include "GLExtensions.h"
+#include "GLStateCache.h"
 #include "Layer.h"
 #include "LayerDim.h"
 #include "LayerScreenshot.h"
@@ -88,6 +100,8 @@ const String16 sDump("android.permission.DUMP");
 
 SurfaceFlinger::SurfaceFlinger()
     :   BnSurfaceComposer(), Thread(false),
+        mStateLock(Mutex::PRIO_INHERIT | Mutex::ADAPTIVE | Mutex::TRACK_CONTENTION,
+                "SurfaceFlinger::mStateLock"),
         mTransactionFlags(0),
         mTransactionPending(false),
         mAnimTransactionPending(false),
@@ -105,7 +119,33 @@ SurfaceFlinger::SurfaceFlinger()
         mDebugInTransaction(0),
         mLastTransactionTime(0),
         mBootFinished(false),
-        mUseDithering(0)
+        mUseDithering(0),
+        mIncrementalVisibleRegions(true),
+        mPartialUpdates(false),
+        mHwcStaticLayers(false),
+        mHwcHoldFrames(0),
+        mCompositionCacheFrames(0),
+        mMirrorVirtualDisplays(false),
+        mParallelComposition(false),
+        mPipelinedComposition(false),
+        mScreenshotFromFramebuffer(true),
+        mLatchBudget(0),
+        mPresentTimeScheduling(true),
+        mLazyLayerTextures(true),
+        mTrimIdleTimeout(0),
+        mLastTrimTime(0),
+        mTrimmedBytes(0),
+        mGLStateCache(NULL),
+        mUseVSyncModel(false),
+        mAppVSyncPhaseOffset(0),
+        mSFVSyncPhaseOffset(0),
+        mVSyncDivisor(1),
+        mVSyncDivisorChanges(0),
+        mCpuSampler(NULL),
+        mParallelInit(true),
+        mReadyToRunTime(0),
+        mLastAnimationTransaction(0),
+        mLastCompositionLoad(0)
 {
     ALOGI("SurfaceFlinger is starting");
 
@@ -127,9 +167,97 @@ SurfaceFlinger::SurfaceFlinger()
     property_get("persist.sys.use_dithering", value, "1");
     mUseDithering = atoi(value);
 
+    property_get("debug.sf.incremental_vr", value, "1");
+    mIncrementalVisibleRegions = atoi(value) != 0;
+
+    property_get("debug.sf.partial_updates", value, "0");
+    mPartialUpdates = atoi(value) != 0;
+
+    property_get("debug.sf.hwc_static_layers", value, "0");
+    mHwcStaticLayers = atoi(value) != 0;
+
+    // frames a layer falling back from an overlay is kept in GLES for
+    property_get("debug.sf.hwc_hold_frames", value, "0");
+    mHwcHoldFrames = atoi(value) > 0 ? atoi(value) : 0;
+
+    property_get("debug.sf.composition_cache", value, "0");
+    mCompositionCacheFrames = atoi(value) > 0 ? atoi(value) : 0;
+
+    property_get("debug.sf.mirror_virtual_displays", value, "0");
+    mMirrorVirtualDisplays = atoi(value) != 0;
+
+    property_get("debug.sf.parallel_composition", value, "0");
+    mParallelComposition = atoi(value) != 0;
+
+    property_get("debug.sf.pipelined_composition", value, "0");
+    mPipelinedComposition = atoi(value) != 0;
+
+    property_get("debug.sf.screenshot_from_fb", value, "1");
+    mScreenshotFromFramebuffer = atoi(value) != 0;
+
+    // time in us all the layers must be latched in, 0 disables deferring
+    property_get("debug.sf.latch_budget_us", value, "0");
+    mLatchBudget = us2ns(atoi(value) > 0 ? atoi(value) : 0);
+
+    property_get("debug.sf.present_time", value, "1");
+    mPresentTimeScheduling = atoi(value) != 0;
+
+    property_get("debug.sf.lazy_textures", value, "1");
+    mLazyLayerTextures = atoi(value) != 0;
+
+    property_get("debug.sf.trim_idle_ms", value, "10000");
+    mTrimIdleTimeout = ms2ns(atoi(value) > 0 ? atoi(value) : 0);
+
+    property_get("debug.sf.vsync_model", value, "0");
+    mUseVSyncModel = atoi(value) != 0;
+    property_get("debug.sf.app_vsync_offset_us", value, "0");
+    mAppVSyncPhaseOffset = us2ns(atoi(value));
+    property_get("debug.sf.sf_vsync_offset_us", value, "0");
+    mSFVSyncPhaseOffset = us2ns(atoi(value));
+    property_get("debug.sf.vsync_drift_us", value, "500");
+    mPrimaryVSyncModel.setDriftThreshold(us2ns(atoi(value)));
+
+    // size in KiB of the pool of freed buffers kept for reuse, 0 disables it
+    property_get("debug.sf.gralloc_pool_kb", value, "0");
+    size_t grallocPoolSize = size_t(atoi(value)) * 1024;
+    GraphicBufferAllocator::get().setRecyclingPoolSize(grallocPoolSize);
+
+    // minimum time in ms between power boost hints, 0 disables them
+    property_get("debug.sf.power_boost_ms", value, "0");
+    mPowerHAL.setBoostInterval(ms2ns(atoi(value) > 0 ? atoi(value) : 0));
+
+    property_get("debug.sf.parallel_init", value, "1");
+    mParallelInit = atoi(value) != 0;
+
+    // period in ms of the CPU use sampling of our threads, 0 disables it
+    property_get("debug.sf.cpu_sample_ms", value, "0");
+    if (atoi(value) > 0) {
+        mCpuSampler = new ThreadCpuSampler(atoi(value));
+    }
+
     ALOGI_IF(mDebugRegion, "showupdates enabled");
     ALOGI_IF(mDebugDDMS, "DDMS debugging enabled");
     ALOGI_IF(mUseDithering, "use dithering");
+    ALOGI_IF(!mIncrementalVisibleRegions, "incremental visible regions disabled");
+    ALOGI_IF(mPartialUpdates, "partial updates enabled");
+    ALOGI_IF(mHwcStaticLayers, "static layers composed with GLES");
+    ALOGI_IF(mHwcHoldFrames, "overlay fallbacks held in GLES for %u frames",
+            mHwcHoldFrames);
+    ALOGI_IF(mCompositionCacheFrames, "composition cache enabled (%u frames)",
+            mCompositionCacheFrames);
+    ALOGI_IF(mMirrorVirtualDisplays, "virtual displays mirror the primary display");
+    ALOGI_IF(mParallelComposition, "displays composed in parallel");
+    ALOGI_IF(mPipelinedComposition, "frames committed on their own thread");
+    ALOGI_IF(!mScreenshotFromFramebuffer, "screenshot layers always rendered");
+    ALOGI_IF(mLatchBudget, "buffer latching budget %lld us", ns2us(mLatchBudget));
+    ALOGI_IF(!mPresentTimeScheduling, "buffer timestamps ignored");
+    ALOGI_IF(!mLazyLayerTextures, "layer textures bound when latched");
+    ALOGI_IF(!mTrimIdleTimeout, "idle layers never trimmed");
+    ALOGI_IF(mUseVSyncModel, "vsync model enabled (app offset %lld us, "
+            "sf offset %lld us)",
+            ns2us(mAppVSyncPhaseOffset), ns2us(mSFVSyncPhaseOffset));
+    ALOGI_IF(grallocPoolSize, "gralloc recycling pool enabled (%u KiB)",
+            grallocPoolSize / 1024);
 
 #ifdef SAMSUNG_HDMI_SUPPORT
     ALOGD(">>> Run service");
@@ -147,6 +275,7 @@ void SurfaceFlinger::onFirstRef()
     mEventQueue.init(this);
 
     run("SurfaceFlinger", PRIORITY_URGENT_DISPLAY);
+    configureScheduling("surfaceflinger");
     // Wait for the main thread to be done with its initialization
     mReadyToRunBarrier.wait();
 }
@@ -157,6 +286,7 @@ SurfaceFlinger::~SurfaceFlinger()
     EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
     eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
     eglTerminate(display);
+    delete mCpuSampler;
 }
 
 void SurfaceFlinger::binderDied(const wp<IBinder>& who)
@@ -219,7 +349,8 @@ sp<IBinder> SurfaceFlinger::getBuiltInDisplay(int32_t id) {
 
 sp<IGraphicBufferAlloc> SurfaceFlinger::createGraphicBufferAlloc()
 {
-    sp<GraphicBufferAlloc> gba(new GraphicBufferAlloc());
+    sp<GraphicBufferAlloc> gba(
+            new GraphicBufferAlloc(IPCThreadState::self()->getCallingPid()));
     return gba;
 }
 
@@ -401,7 +532,8 @@ success:
     return config;
 }
 
-EGLContext SurfaceFlinger::createGLContext(EGLDisplay display, EGLConfig config) {
+EGLContext SurfaceFlinger::createGLContext(EGLDisplay display, EGLConfig config,
+        EGLContext shareContext) {
     // Also create our EGLContext
     EGLint contextAttributes[] = {
 #ifdef EGL_IMG_context_priority
@@ -412,7 +544,8 @@ EGLContext SurfaceFlinger::createGLContext(EGLDisplay display, EGLConfig config)
 #endif
             EGL_NONE, EGL_NONE
     };
-    EGLContext ctxt = eglCreateContext(display, config, NULL, contextAttributes);
+    EGLContext ctxt = eglCreateContext(display, config, shareContext,
+            contextAttributes);
     ALOGE_IF(ctxt==EGL_NO_CONTEXT, "EGLContext creation failed");
     return ctxt;
 }
@@ -441,6 +574,7 @@ void SurfaceFlinger::initializeGL(EGLDisplay display) {
         glDisable(GL_DITHER);
     }
     glDisable(GL_CULL_FACE);
+    mGLStateCache = &GLStateCache::getInstance();
 
     struct pack565 {
         inline uint16_t operator() (int r, int g, int b) const {
@@ -482,28 +616,101 @@ void SurfaceFlinger::initializeGL(EGLDisplay display) {
     mMinColorDepth = r;
 }
 
+// Loads the EGL drivers and initializes the default display on its own
+// thread, so that it overlaps with the loading of the HWC and FB modules.
+class EGLInitThread : public Thread {
+public:
+    EGLInitThread() : Thread(false),
+        display(EGL_NO_DISPLAY), start(0), end(0) { }
+
+    // valid once join() returned
+    EGLDisplay display;
+    nsecs_t start;
+    nsecs_t end;
+
+private:
+    virtual bool threadLoop() {
+        start = systemTime();
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        eglInitialize(display, NULL, NULL);
+        end = systemTime();
+        return false;
+    }
+};
+
 status_t SurfaceFlinger::readyToRun()
 {
     ALOGI(  "SurfaceFlinger's main thread ready to run. "
             "Initializing graphics H/W...");
 
+    mReadyToRunTime = systemTime();
+    nsecs_t start = mReadyToRunTime;
+
     // initialize EGL for the default display
-    mEGLDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
-    eglInitialize(mEGLDisplay, NULL, NULL);
+    sp<EGLInitThread> eglInit;
+    if (mParallelInit) {
+        eglInit = new EGLInitThread();
+        if (eglInit->run("EGLInit", PRIORITY_URGENT_DISPLAY) != NO_ERROR) {
+            eglInit.clear();
+        }
+    }
+    if (eglInit == NULL) {
+        mEGLDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        eglInitialize(mEGLDisplay, NULL, NULL);
+        addBootPhase("egl-init", start, systemTime());
+        start = systemTime();
+    }
 
     // Initialize the H/W composer object.  There may or may not be an
     // actual hardware composer underneath.
     mHwc = new HWComposer(this,
             *static_cast<HWComposer::EventHandler *>(this));
+    addBootPhase("hwc-init", start, systemTime());
+
+    // without a framebuffer target, set() needs our EGL surface current
+    if (mPipelinedComposition) {
+        if (mHwc->initCheck() == NO_ERROR && mHwc->supportsFramebufferTarget()) {
+            mFrameCommitter = new FrameCommitter(*this);
+        } else {
+            ALOGW("pipelined composition needs a framebuffer target, disabled");
+            mPipelinedComposition = false;
+        }
+    }
+
+    // start the EventThread, its threads only need the HWC
+    start = systemTime();
+    if (mUseVSyncModel) {
+        // apps and composition each get their own phase of the same
+        // predicted vsync
+        mEventThread = new EventThread(this, &mPrimaryVSyncModel,
+                mAppVSyncPhaseOffset, "EventThread");
+        mSFEventThread = new EventThread(this, &mPrimaryVSyncModel,
+                mSFVSyncPhaseOffset, "SFEventThread");
+        mEventQueue.setEventThread(mSFEventThread);
+    } else {
+        mEventThread = new EventThread(this);
+        mEventQueue.setEventThread(mEventThread);
+    }
+    addBootPhase("event-threads", start, systemTime());
+
+    if (eglInit != NULL) {
+        eglInit->join();
+        mEGLDisplay = eglInit->display;
+        addBootPhase("egl-init (parallel)", eglInit->start, eglInit->end);
+        eglInit.clear();
+    }
 
     // initialize the config and context
+    start = systemTime();
     EGLint format = mHwc->getVisualID();
     mEGLConfig  = selectEGLConfig(mEGLDisplay, format);
     mEGLContext = createGLContext(mEGLDisplay, mEGLConfig);
 
     LOG_ALWAYS_FATAL_IF(mEGLContext == EGL_NO_CONTEXT,
             "couldn't create EGLContext");
+    addBootPhase("egl-config", start, systemTime());
 
+    start = systemTime();
     // initialize our non-virtual displays
     for (size_t i=0 ; i<DisplayDevice::NUM_DISPLAY_TYPES ; i++) {
         DisplayDevice::DisplayType type((DisplayDevice::DisplayType)i);
@@ -538,13 +745,23 @@ status_t SurfaceFlinger::readyToRun()
     //  for that.
     sp<const DisplayDevice> hw(getDefaultDisplayDevice());
 
+    addBootPhase("displays", start, systemTime());
+
     //  initialize OpenGL ES
+    start = systemTime();
     DisplayDevice::makeCurrent(mEGLDisplay, hw, mEGLContext);
     initializeGL(mEGLDisplay);
+    addBootPhase("gl-init", start, systemTime());
 
-    // start the EventThread
-    mEventThread = new EventThread(this);
-    mEventQueue.setEventThread(mEventThread);
+    if (mCpuSampler) {
+        mCpuSampler->addThread(gettid(), "surfaceflinger");
+        mCpuSampler->addThread(mEventThread->getTid(), "EventThread");
+        if (mSFEventThread != NULL) {
+            mCpuSampler->addThread(mSFEventThread->getTid(), "SFEventThread");
+        }
+        mCpuSampler->addThreadsNamed("Binder_");
+        mCpuSampler->start();
+    }
 
     // initialize our drawing state
     mDrawingState = mCurrentState;
@@ -554,14 +771,25 @@ status_t SurfaceFlinger::readyToRun()
     mReadyToRunBarrier.open();
 
     // set initial conditions (e.g. unblank default device)
+    start = systemTime();
     initializeDisplays();
+    addBootPhase("initialize-displays", start, systemTime());
 
     // start boot animation
     startBootAnim();
+    addBootPhase("total", mReadyToRunTime, systemTime());
 
     return NO_ERROR;
 }
 
+void SurfaceFlinger::addBootPhase(const char* name, nsecs_t start, nsecs_t end) {
+    BootPhase phase;
+    phase.name = name;
+    phase.start = start - mReadyToRunTime;
+    phase.duration = end - start;
+    mBootPhases.add(phase);
+}
+
 int32_t SurfaceFlinger::allocateHwcDisplayId(DisplayDevice::DisplayType type) {
     return (uint32_t(type) < DisplayDevice::NUM_DISPLAY_TYPES) ?
             type : mHwc->allocateDisplayId();
@@ -629,6 +857,12 @@ bool SurfaceFlinger::authenticateSurfaceTexture(
     return false;
 }
 
+status_t SurfaceFlinger::getGraphicMemoryUsage(
+        Vector<GraphicMemoryUsage>* usage) {
+    GraphicBufferAlloc::getUsage(usage);
+    return NO_ERROR;
+}
+
 status_t SurfaceFlinger::getDisplayInfo(const sp<IBinder>& display, DisplayInfo* info) {
     int32_t type = BAD_VALUE;
     for (int i=0 ; i<DisplayDevice::NUM_DISPLAY_TYPES ; i++) {
@@ -730,11 +964,11 @@ void SurfaceFlinger::waitForEvent() {
 }
 
 void SurfaceFlinger::signalTransaction() {
-    mEventQueue.invalidate();
+    mEventQueue.invalidate(MessageQueue::REASON_TRANSACTION);
 }
 
 void SurfaceFlinger::signalLayerUpdate() {
-    mEventQueue.invalidate();
+    mEventQueue.invalidate(MessageQueue::REASON_LAYER_UPDATE);
 }
 
 void SurfaceFlinger::signalRefresh() {
@@ -755,6 +989,10 @@ status_t SurfaceFlinger::postMessageSync(const sp<MessageBase>& msg,
     return res;
 }
 
+status_t SurfaceFlinger::postMessageSync(SyncMessage& msg) {
+    return mEventQueue.postMessageSync(msg);
+}
+
 bool SurfaceFlinger::threadLoop() {
     waitForEvent();
     return true;
@@ -770,7 +1008,14 @@ void SurfaceFlinger::onVSyncReceived(int type, nsecs_t timestamp) {
     }
     if (uint32_t(type) < DisplayDevice::NUM_DISPLAY_TYPES) {
         // we should only receive DisplayDevice::DisplayType from the vsync callback
+        if (mUseVSyncModel && type == DisplayDevice::DISPLAY_PRIMARY) {
+            // train the model once for all EventThreads sharing it
+            mPrimaryVSyncModel.addHwSample(timestamp);
+        }
         mEventThread->onVSyncReceived(type, timestamp);
+        if (mSFEventThread != NULL) {
+            mSFEventThread->onVSyncReceived(type, timestamp);
+        }
     }
 }
 
@@ -801,6 +1046,16 @@ void SurfaceFlinger::eventControl(int disp, int event, int enabled) {
     getHwComposer().eventControl(disp, event, enabled);
 }
 
+void SurfaceFlinger::requestHwVSync(const EventThread* thread, bool enabled) {
+    Mutex::Autolock _l(mHwVSyncLock);
+    if (enabled) {
+        mHwVSyncRequests.add(thread);
+    } else {
+        mHwVSyncRequests.remove(thread);
+    }
+    eventControl(HWC_DISPLAY_PRIMARY, EVENT_VSYNC, !mHwVSyncRequests.isEmpty());
+}
+
 void SurfaceFlinger::onMessageReceived(int32_t what) {
     ATRACE_CALL();
     switch (what) {
@@ -829,12 +1084,44 @@ void SurfaceFlinger::handleMessageInvalidate() {
 
 void SurfaceFlinger::handleMessageRefresh() {
     ATRACE_CALL();
+    PROFILE_SCOPE("surfaceflinger", "handleMessageRefresh");
+    waitForFrameCommit();
+    const nsecs_t start = systemTime();
+    nsecs_t t = start;
     preComposition();
+    t = recordRefreshStage(STAGE_PRE_COMPOSITION, t);
     rebuildLayerStacks();
+    t = recordRefreshStage(STAGE_REBUILD_LAYER_STACKS, t);
     setUpHWComposer();
+    t = recordRefreshStage(STAGE_SET_UP_HWCOMPOSER, t);
     doDebugFlashRegions();
     doComposition();
+    t = recordRefreshStage(STAGE_DO_COMPOSITION, t);
     postComposition();
+    notifyTransactionListeners();
+    handleScreenCaptureRequests();
+    t = recordRefreshStage(STAGE_POST_COMPOSITION, t);
+
+    // the next frames are likely as expensive, don't wait for the
+    // governor to notice
+    const nsecs_t period =
+            getHwComposer().getRefreshPeriod(HWC_DISPLAY_PRIMARY);
+    if (period > 0 && t - start > period) {
+        mPowerHAL.boostHint(PowerHAL::BOOST_DEADLINE_MISSED);
+    }
+}
+
+nsecs_t SurfaceFlinger::recordRefreshStage(RefreshStage stage, nsecs_t start) {
+    const nsecs_t now = systemTime();
+    const nsecs_t duration = now - start;
+    RefreshStageStats& stats(mRefreshStageStats[stage]);
+    stats.last = duration;
+    if (duration > stats.max) {
+        stats.max = duration;
+    }
+    stats.total += duration;
+    stats.count++;
+    return now;
 }
 
 void SurfaceFlinger::doDebugFlashRegions()
@@ -854,24 +1141,11 @@ void SurfaceFlinger::doDebugFlashRegions()
                 doComposeSurfaces(hw, Region(hw->bounds()));
 
                 // and draw the dirty region
-                glDisable(GL_TEXTURE_EXTERNAL_OES);
-                glDisable(GL_TEXTURE_2D);
-                glDisable(GL_BLEND);
-                glColor4f(1, 0, 1, 1);
-                const int32_t height = hw->getHeight();
-                Region::const_iterator it = dirtyRegion.begin();
-                Region::const_iterator const end = dirtyRegion.end();
-                while (it != end) {
-                    const Rect& r = *it++;
-                    GLfloat vertices[][2] = {
-                            { r.left,  height - r.top },
-                            { r.left,  height - r.bottom },
-                            { r.right, height - r.bottom },
-                            { r.right, height - r.top }
-                    };
-                    glVertexPointer(2, GL_FLOAT, 0, vertices);
-                    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-                }
+                GLStateCache& gl(GLStateCache::getInstance());
+                gl.setTexture(0, 0);
+                gl.setBlending(false);
+                gl.setColor(1, 0, 1, 1);
+                gl.drawRegion(dirtyRegion, hw->getWidth(), hw->getHeight(), false);
                 hw->compositionComplete();
                 hw->swapBuffers(getHwComposer());
             }
@@ -908,14 +1182,123 @@ void SurfaceFlinger::preComposition()
 
 void SurfaceFlinger::postComposition()
 {
+    // the FrameCommitter does this once the frame is committed
+    if (mFrameCommitter == NULL) {
+        const LayerVector& currentLayers(mDrawingState.layersSortedByZ);
+        const size_t count = currentLayers.size();
+        for (size_t i=0 ; i<count ; i++) {
+            currentLayers[i]->onPostComposition();
+        }
+    }
+    updateVSyncDivisor();
+
+    if (mTrimIdleTimeout) {
+        const nsecs_t now = systemTime();
+        for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
+            const sp<const DisplayDevice>& hw(mDisplays[dpy]);
+            if (hw->canDraw()) {
+                const Vector< sp<LayerBase> >& layers(
+                        hw->getVisibleLayersSortedByZ());
+                for (size_t i=0 ; i<layers.size() ; i++) {
+                    layers[i]->setLastShownTime(now);
+                }
+            }
+        }
+        // a second between passes is plenty at this timeout
+        if (now - mLastTrimTime >= s2ns(1)) {
+            trimIdleLayers();
+        }
+    }
+}
+
+void SurfaceFlinger::trimIdleLayers()
+{
+    ATRACE_CALL();
+    const nsecs_t now = systemTime();
+    mLastTrimTime = now;
     const LayerVector& currentLayers(mDrawingState.layersSortedByZ);
-    const size_t count = currentLayers.size();
-    for (size_t i=0 ; i<count ; i++) {
-        currentLayers[i]->onPostComposition();
+    for (size_t i=0 ; i<currentLayers.size() ; i++) {
+        const sp<LayerBase>& layer(currentLayers[i]);
+        if (now - layer->getLastShownTime() < mTrimIdleTimeout ||
+                now - layer->getLastUpdateTime() < mTrimIdleTimeout) {
+            continue;
+        }
+        const sp<Layer> l(layer->getLayer());
+        if (l != NULL) {
+            const size_t freed = l->trimBuffers();
+            mTrimmedBytes += freed;
+            ALOGD_IF(freed, "trimmed %u KB from idle layer '%s'",
+                    freed / 1024, layer->getName().string());
+        }
+    }
+}
+
+void SurfaceFlinger::updateVSyncDivisor()
+{
+    // a layer without a frame rate hint that changed more recently than
+    // this needs the full refresh rate
+    static const nsecs_t ACTIVE_LAYER_TIMEOUT = ms2ns(200);
+    static const uint32_t MAX_VSYNC_DIVISOR = 4;
+    // how far from a whole number of vsyncs a frame may be
+    static const float FRAME_RATE_TOLERANCE = 0.05f;
+
+    const nsecs_t period = getHwComposer().getRefreshPeriod(HWC_DISPLAY_PRIMARY);
+    const sp<const DisplayDevice> hw(getDefaultDisplayDevice());
+    if (period <= 0 || hw == NULL) {
+        return;
+    }
+    const float refreshRate = 1e9f / period;
+    const nsecs_t now = systemTime();
+
+    // collect the hints of the visible layers, until one needs every vsync
+    Vector<float> rates;
+    bool needsFullRate = false;
+    const Vector< sp<LayerBase> >& layers(hw->getVisibleLayersSortedByZ());
+    for (size_t i=0 ; i<layers.size() && !needsFullRate ; i++) {
+        const sp<LayerBase>& layer(layers[i]);
+        const float rate = layer->drawingState().frameRate;
+        if (rate > 0) {
+            rates.add(rate);
+        } else {
+            const nsecs_t updated = layer->getLastUpdateTime();
+            needsFullRate = updated && (now - updated) < ACTIVE_LAYER_TIMEOUT;
+        }
+    }
+
+    // use the lowest rate at which every hinted layer gets a whole number
+    // of vsyncs per frame
+    uint32_t divisor = 1;
+    if (!needsFullRate && !rates.isEmpty()) {
+        for (uint32_t d=MAX_VSYNC_DIVISOR ; d>1 ; d--) {
+            const float rate = refreshRate / d;
+            bool ok = true;
+            for (size_t i=0 ; i<rates.size() && ok ; i++) {
+                const float vsyncsPerFrame = rate / rates[i];
+                ok = vsyncsPerFrame >= 1.0f - FRAME_RATE_TOLERANCE &&
+                        fabsf(vsyncsPerFrame - floorf(vsyncsPerFrame + 0.5f))
+                                <= FRAME_RATE_TOLERANCE;
+            }
+            if (ok) {
+                divisor = d;
+                break;
+            }
+        }
+    }
+
+    if (divisor != mVSyncDivisor) {
+        ALOGV("effective refresh rate %.2f Hz (vsync divisor %u)",
+                refreshRate / divisor, divisor);
+        mVSyncDivisor = divisor;
+        mVSyncDivisorChanges++;
+        mEventThread->setVSyncDivisor(divisor);
+        if (mSFEventThread != NULL) {
+            mSFEventThread->setVSyncDivisor(divisor);
+        }
     }
 }
 
 void SurfaceFlinger::rebuildLayerStacks() {
+    PROFILE_SCOPE("surfaceflinger", "rebuildLayerStacks");
     // rebuild the visible layer list per screen
     if (CC_UNLIKELY(mVisibleRegionsDirty)) {
         ATRACE_CALL();
@@ -923,6 +1306,8 @@ void SurfaceFlinger::rebuildLayerStacks() {
         invalidateHwcGeometry();
 
         const LayerVector& currentLayers(mDrawingState.layersSortedByZ);
+        buildLayerSnapshot();
+        const LayerSnapshot& snapshot(mLayerSnapshot);
         for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
             Region opaqueRegion;
             Region dirtyRegion;
@@ -931,14 +1316,17 @@ void SurfaceFlinger::rebuildLayerStacks() {
             const Transform& tr(hw->getTransform());
             const Rect bounds(hw->getBounds());
             if (hw->canDraw()) {
-                SurfaceFlinger::computeVisibleRegions(currentLayers,
-                        hw->getLayerStack(), dirtyRegion, opaqueRegion);
-
-                const size_t count = currentLayers.size();
+                SurfaceFlinger::computeVisibleRegions(currentLayers, snapshot,
+                        hw->getLayerStack(), dirtyRegion, opaqueRegion,
+                        mIncrementalVisibleRegions ?
+                                &hw->visibleRegionCache : NULL);
+
+                const uint32_t layerStack = hw->getLayerStack();
+                const uint32_t* layerStacks = snapshot.layerStack.array();
+                const size_t count = snapshot.size();
                 for (size_t i=0 ; i<count ; i++) {
-                    const sp<LayerBase>& layer(currentLayers[i]);
-                    const Layer::State& s(layer->drawingState());
-                    if (s.layerStack == hw->getLayerStack()) {
+                    if (layerStacks[i] == layerStack) {
+                        const sp<LayerBase>& layer(currentLayers[i]);
                         Region drawRegion(tr.transform(
                                 layer->visibleNonTransparentRegion));
                         drawRegion.andSelf(bounds);
@@ -956,9 +1344,86 @@ void SurfaceFlinger::rebuildLayerStacks() {
     }
 }
 
+void SurfaceFlinger::buildLayerSnapshot() {
+    const LayerVector& currentLayers(mDrawingState.layersSortedByZ);
+    const size_t count = currentLayers.size();
+    LayerSnapshot& snapshot(mLayerSnapshot);
+    snapshot.resize(count);
+    uint32_t* layerStacks = snapshot.layerStack.editArray();
+    uint32_t* zs = snapshot.z.editArray();
+    int32_t* sequences = snapshot.sequence.editArray();
+    uint32_t* orientations = snapshot.orientation.editArray();
+    Rect* bounds = snapshot.bounds.editArray();
+    uint8_t* alphas = snapshot.alpha.editArray();
+    uint8_t* flags = snapshot.flags.editArray();
+    for (size_t i=0 ; i<count ; i++) {
+        const sp<LayerBase>& layer(currentLayers[i]);
+        const Layer::State& s(layer->drawingState());
+        layerStacks[i] = s.layerStack;
+        zs[i] = s.z;
+        sequences[i] = s.sequence;
+        orientations[i] = s.transform.getOrientation();
+        bounds[i] = layer->computeBounds();
+        alphas[i] = s.alpha;
+        flags[i] = (layer->isVisible() ? LayerSnapshot::VISIBLE : 0) |
+                   (layer->isOpaque()  ? LayerSnapshot::OPAQUE  : 0);
+    }
+}
+
+bool SurfaceFlinger::updateHwcStaticLayers()
+{
+    // a layer that hasn't latched a buffer for this long is static
+    static const nsecs_t STATIC_LAYER_TIMEOUT = ms2ns(1000);
+
+    const nsecs_t now = systemTime();
+    bool changed = false;
+    for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
+        sp<const DisplayDevice> hw(mDisplays[dpy]);
+        if (hw->getHwcDisplayId() < 0) {
+            continue;
+        }
+
+        // Static layers are only taken out of the overlays while other
+        // layers update: GLES then composes them once into the framebuffer
+        // target, which is posted again as long as they don't change (see
+        // reuseFramebufferTarget()), and the overlays are left to the
+        // layers that need them every frame.
+        SortedVector<int32_t> staticLayers;
+        bool updating = false;
+        const Vector< sp<LayerBase> >& layers(hw->getVisibleLayersSortedByZ());
+        for (size_t i=0 ; i<layers.size() ; i++) {
+            const nsecs_t updated = layers[i]->getLastUpdateTime();
+            if (updated && (now - updated) < STATIC_LAYER_TIMEOUT) {
+                updating = true;
+            } else {
+                staticLayers.add(layers[i]->sequence);
+            }
+        }
+        if (!updating) {
+            staticLayers.clear();
+        }
+
+        bool same = staticLayers.size() == hw->hwcStaticLayers.size();
+        for (size_t i=0 ; same && i<staticLayers.size() ; i++) {
+            same = staticLayers[i] == hw->hwcStaticLayers[i];
+        }
+        if (!same) {
+            hw->hwcStaticLayers = staticLayers;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
 void SurfaceFlinger::setUpHWComposer() {
+    PROFILE_SCOPE("surfaceflinger", "setUpHWComposer");
     HWComposer& hwc(getHwComposer());
     if (hwc.initCheck() == NO_ERROR) {
+        if (mHwcStaticLayers && updateHwcStaticLayers()) {
+            // the skip flags are part of the geometry
+            mHwWorkListDirty = true;
+        }
+
         // build the h/w work list
         if (CC_UNLIKELY(mHwWorkListDirty)) {
             mHwWorkListDirty = false;
@@ -975,8 +1440,16 @@ void SurfaceFlinger::setUpHWComposer() {
                         for (size_t i=0 ; cur!=end && i<count ; ++i, ++cur) {
                             const sp<LayerBase>& layer(currentLayers[i]);
                             layer->setGeometry(hw, *cur);
-                            if (mDebugDisableHWC || mDebugRegion) {
+                            hwc_color_t color;
+                            if (isHwcSkipped(hw, layer) || layer->isHeldInGles(id)) {
                                 cur->setSkip(true);
+                            } else if (i == 0 && hwc.supportsBackgroundLayer() &&
+                                    layer->getSolidColor(&color) &&
+                                    isBackgroundLayer(hw, layer, color)) {
+                                // a dim at the bottom of the stack is just
+                                // a black screen, no need to draw it
+                                color.a = 0xFF;
+                                cur->setBackgroundColor(color);
                             }
                         }
                     }
@@ -1005,34 +1478,300 @@ void SurfaceFlinger::setUpHWComposer() {
             }
         }
 
+        const nsecs_t start = systemTime();
         status_t err = hwc.prepare();
         ALOGE_IF(err, "HWComposer::prepare failed (%s)", strerror(-err));
+        mHwcPrepareHistogram.add(systemTime() - start);
+
+        // layers GLES composes count twice, they're drawn and then
+        // composed again as the framebuffer target
+        size_t load = 0;
+        for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
+            sp<const DisplayDevice> hw(mDisplays[dpy]);
+            const int32_t id = hw->getHwcDisplayId();
+            if (id >= 0) {
+                const Vector< sp<LayerBase> >& currentLayers(
+                    hw->getVisibleLayersSortedByZ());
+                const size_t count = currentLayers.size();
+                HWComposer::LayerListIterator cur = hwc.begin(id);
+                const HWComposer::LayerListIterator end = hwc.end(id);
+                for (size_t i=0 ; cur!=end ; ++i, ++cur) {
+                    const int32_t type = cur->getCompositionType();
+                    load += (type == HWC_FRAMEBUFFER) ? 2 : 1;
+                    if (i < count) {
+                        // a layer h/w composer just gave back to GLES is
+                        // kept there for a while, rather than flipping
+                        // back and forth and changing the geometry
+                        const sp<LayerBase>& layer(currentLayers[i]);
+                        if (layer->updateHwcCompositionType(id, type,
+                                isHwcSkipped(hw, layer), mHwcHoldFrames)) {
+                            mHwWorkListDirty = true;
+                        }
+                    }
+                }
+            }
+        }
+        if (load >= mLastCompositionLoad + 4 &&
+                load >= mLastCompositionLoad + mLastCompositionLoad / 2) {
+            mPowerHAL.boostHint(PowerHAL::BOOST_LOAD);
+        }
+        mLastCompositionLoad = load;
+    }
+}
+
+bool SurfaceFlinger::isHwcSkipped(const sp<const DisplayDevice>& hw,
+        const sp<LayerBase>& layer) const {
+    return mDebugDisableHWC || mDebugRegion ||
+            hw->hwcStaticLayers.indexOf(layer->sequence) >= 0;
+}
+
+bool SurfaceFlinger::isBackgroundLayer(const sp<const DisplayDevice>& hw,
+        const sp<LayerBase>& layer, const hwc_color& color) const {
+    // At the bottom of the stack, a solid color shows over the black the
+    // rest of the display shows (see drawWormhole()). Filling the whole
+    // display with it is only the same if it's black or covers it.
+    if (!color.r && !color.g && !color.b) {
+        return true;
+    }
+    const Transform& tr(hw->getTransform());
+    return Region(hw->bounds()).subtract(
+            tr.transform(layer->visibleRegion)).isEmpty();
+}
+
+void SurfaceFlinger::bindGlesLayerTextures() {
+    ATRACE_CALL();
+    // Layers composed by h/w composer overlays only never need an EGLImage
+    // nor a texture binding. The others are bound here, in the main
+    // context, so that composer threads find them ready.
+    HWComposer& hwc(getHwComposer());
+    for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
+        const sp<DisplayDevice>& hw(mDisplays[dpy]);
+        if (!hw->canDraw()) {
+            continue;
+        }
+        const Vector< sp<LayerBase> >& layers(hw->getVisibleLayersSortedByZ());
+        const size_t count = layers.size();
+        const int32_t id = hw->getHwcDisplayId();
+        if (id < 0 || hwc.initCheck() != NO_ERROR) {
+            for (size_t i=0 ; i<count ; i++) {
+                layers[i]->bindTextureImage();
+            }
+            continue;
+        }
+        HWComposer::LayerListIterator cur = hwc.begin(id);
+        const HWComposer::LayerListIterator end = hwc.end(id);
+        for (size_t i=0 ; cur != end && i<count ; ++i, ++cur) {
+            if (cur->getCompositionType() == HWC_FRAMEBUFFER) {
+                layers[i]->bindTextureImage();
+            }
+        }
     }
 }
 
 void SurfaceFlinger::doComposition() {
     ATRACE_CALL();
+    PROFILE_SCOPE("surfaceflinger", "doComposition");
     const bool repaintEverything = android_atomic_and(0, &mRepaintEverything);
+
+    if (mLazyLayerTextures) {
+        bindGlesLayerTextures();
+    }
+
+    // Displays with a composer thread, which don't show any layer shown
+    // elsewhere, are composed by it while the others are composed here.
+    Vector< sp<DisplayComposer> > composers;
+    if (mParallelComposition) {
+        updateDisplayComposers();
+        getParallelComposers(&composers);
+        if (!composers.isEmpty()) {
+            // their surfaces must not be current here, and what was just
+            // latched in this context must be visible in theirs
+            DisplayDevice::makeCurrent(mEGLDisplay,
+                    getDefaultDisplayDevice(), mEGLContext);
+            glFlush();
+            for (size_t i=0 ; i<composers.size() ; i++) {
+                composers[i]->compose(repaintEverything);
+            }
+        }
+    }
+
+    // Virtual displays showing the same thing as the primary display are
+    // composed last, from its framebuffer target if it was composed with
+    // GLES only, which saves composing all the layers a second time.
+    const sp<const DisplayDevice> primary(getDefaultDisplayDevice());
+    Vector< sp<DisplayDevice> > mirrors;
     for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
         const sp<DisplayDevice>& hw(mDisplays[dpy]);
-        if (hw->canDraw()) {
-            // transform the dirty region into this screen's coordinate space
-            const Region dirtyRegion(hw->getDirtyRegion(repaintEverything));
+        bool parallel = false;
+        for (size_t i=0 ; i<composers.size() && !parallel ; i++) {
+            parallel = composers[i]->getDisplay() == hw;
+        }
+        if (parallel) {
+            continue;
+        }
+        if (mMirrorVirtualDisplays && DisplayMirror::canMirror(hw, primary)) {
+            mirrors.add(hw);
+        } else {
+            composeDisplay(hw, repaintEverything, NULL);
+        }
+    }
+    if (!mirrors.isEmpty()) {
+        HWComposer& hwc(getHwComposer());
+        const bool primaryGlesOnly = hwc.initCheck() != NO_ERROR ||
+                !hwc.hasHwcComposition(primary->getHwcDisplayId());
+        for (size_t i=0 ; i<mirrors.size() ; i++) {
+            composeDisplay(mirrors[i], repaintEverything,
+                    primaryGlesOnly ? primary : NULL);
+        }
+    }
 
-            // repaint the framebuffer (if needed)
-            doDisplayComposition(hw, dirtyRegion);
+    // all displays are composed before the frame is posted
+    for (size_t i=0 ; i<composers.size() ; i++) {
+        composers[i]->waitForComposition();
+    }
+    if (mFrameCommitter != NULL) {
+        PostedFrame frame;
+        getPostedFrame(&frame);
+        const LayerVector& currentLayers(mDrawingState.layersSortedByZ);
+        for (size_t i=0 ; i<currentLayers.size() ; i++) {
+            frame.layers.add(currentLayers[i]);
+        }
+        mFrameCommitter->commit(frame);
+    } else {
+        postFramebuffer();
+    }
+}
 
-            hw->dirtyRegion.clear();
-            hw->flip(hw->swapRegion);
-            hw->swapRegion.clear();
+void SurfaceFlinger::updateDisplayComposers()
+{
+    // stop the composers of the displays that went away or were recreated
+    for (ssize_t i=mDisplayComposers.size()-1 ; i>=0 ; i--) {
+        const ssize_t j = mDisplays.indexOfKey(mDisplayComposers.keyAt(i));
+        const sp<DisplayComposer>& composer(mDisplayComposers.valueAt(i));
+        if (j < 0 || composer->getDisplay() != mDisplays.valueAt(j)) {
+            composer->stop();
+            Mutex::Autolock _l(mStateLock);
+            mDisplayComposers.removeItemsAt(i);
         }
-        // inform the h/w that we're done compositing
-        hw->compositionComplete();
     }
-    postFramebuffer();
+
+    // and start one for each other display
+    for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
+        const sp<DisplayDevice>& hw(mDisplays[dpy]);
+        const wp<IBinder>& token(mDisplays.keyAt(dpy));
+        if (hw->getDisplayType() == DisplayDevice::DISPLAY_PRIMARY ||
+                mDisplayComposers.indexOfKey(token) >= 0) {
+            continue;
+        }
+        // the composition cache only works in the main context, see
+        // doComposeSurfaces()
+        DisplayDevice::makeCurrent(mEGLDisplay,
+                getDefaultDisplayDevice(), mEGLContext);
+        hw->compositionCache.release();
+
+        sp<DisplayComposer> composer(new DisplayComposer(*this, hw,
+                mEGLDisplay, mEGLConfig, mEGLContext));
+        if (composer->initCheck() != NO_ERROR) {
+            ALOGE("can't create a context for display %s, "
+                    "parallel composition disabled",
+                    hw->getDisplayName().string());
+            Mutex::Autolock _l(mStateLock);
+            for (size_t i=0 ; i<mDisplayComposers.size() ; i++) {
+                mDisplayComposers.valueAt(i)->stop();
+            }
+            mDisplayComposers.clear();
+            mParallelComposition = false;
+            return;
+        }
+        Mutex::Autolock _l(mStateLock);
+        mDisplayComposers.add(token, composer);
+    }
+}
+
+void SurfaceFlinger::getParallelComposers(
+        Vector< sp<DisplayComposer> >* composers)
+{
+    // a layer can only be drawn by one thread at a time, the texture
+    // filtering and the buffer it samples are the layer's
+    SortedVector<const LayerBase*> seen;
+    SortedVector<const LayerBase*> shared;
+    for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
+        const Vector< sp<LayerBase> >& layers(
+                mDisplays[dpy]->getVisibleLayersSortedByZ());
+        for (size_t i=0 ; i<layers.size() ; i++) {
+            const LayerBase* layer = layers[i].get();
+            if (seen.indexOf(layer) >= 0) {
+                shared.add(layer);
+            } else {
+                seen.add(layer);
+            }
+        }
+    }
+
+    const sp<const DisplayDevice> primary(getDefaultDisplayDevice());
+    for (size_t i=0 ; i<mDisplayComposers.size() ; i++) {
+        const sp<DisplayComposer>& composer(mDisplayComposers.valueAt(i));
+        const sp<const DisplayDevice>& hw(composer->getDisplay());
+        // mirrors need the primary display's framebuffer target
+        bool independent = !mMirrorVirtualDisplays ||
+                !DisplayMirror::canMirror(hw, primary);
+        const Vector< sp<LayerBase> >& layers(hw->getVisibleLayersSortedByZ());
+        for (size_t j=0 ; independent && j<layers.size() ; j++) {
+            independent = shared.indexOf(layers[j].get()) < 0;
+        }
+        if (independent) {
+            composers->add(composer);
+        } else {
+            composer->skippedFrame();
+        }
+    }
+}
+
+void SurfaceFlinger::composeDisplay(const sp<const DisplayDevice>& hw,
+        bool repaintEverything, const sp<const DisplayDevice>& source)
+{
+    if (hw->canDraw()) {
+        // transform the dirty region into this screen's coordinate space
+        const Region dirtyRegion(hw->getDirtyRegion(repaintEverything));
+
+        // repaint the framebuffer (if needed)
+        const nsecs_t start = systemTime();
+        const bool mirrored = source != NULL &&
+                mirrorDisplayComposition(hw, source);
+        if (!mirrored && !reuseFramebufferTarget(hw, dirtyRegion)) {
+            doDisplayComposition(hw, dirtyRegion);
+        }
+        hw->compositionHistogram.add(systemTime() - start);
+
+        hw->dirtyRegion.clear();
+        hw->flip(hw->swapRegion);
+        hw->swapRegion.clear();
+    } else {
+        hw->lastFramebufferTargetValid = false;
+    }
+    // inform the h/w that we're done compositing
+    hw->compositionComplete();
+}
+
+void SurfaceFlinger::getPostedFrame(PostedFrame* frame) const
+{
+    frame->displays.setCapacity(mDisplays.size());
+    for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
+        PostedFrame::Display display;
+        display.hw = mDisplays[dpy];
+        display.layers = display.hw->getVisibleLayersSortedByZ();
+        frame->displays.add(display);
+    }
 }
 
 void SurfaceFlinger::postFramebuffer()
+{
+    PostedFrame frame;
+    getPostedFrame(&frame);
+    commitFrame(frame);
+}
+
+void SurfaceFlinger::commitFrame(const PostedFrame& frame)
 {
     ATRACE_CALL();
 
@@ -1049,11 +1788,12 @@ void SurfaceFlinger::postFramebuffer()
                     getDefaultDisplayDevice(), mEGLContext);
         }
         hwc.commit();
+        mHwcCommitHistogram.add(systemTime() - now);
     }
 
-    for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
-        sp<const DisplayDevice> hw(mDisplays[dpy]);
-        const Vector< sp<LayerBase> >& currentLayers(hw->getVisibleLayersSortedByZ());
+    for (size_t dpy=0 ; dpy<frame.displays.size() ; dpy++) {
+        const sp<const DisplayDevice>& hw(frame.displays[dpy].hw);
+        const Vector< sp<LayerBase> >& currentLayers(frame.displays[dpy].layers);
         hw->onSwapBuffersCompleted(hwc);
         const size_t count = currentLayers.size();
         int32_t id = hw->getHwcDisplayId();
@@ -1074,6 +1814,13 @@ void SurfaceFlinger::postFramebuffer()
     mDebugInSwapBuffers = 0;
 }
 
+void SurfaceFlinger::waitForFrameCommit()
+{
+    if (mFrameCommitter != NULL) {
+        mFrameCommitter->waitForCommit();
+    }
+}
+
 void SurfaceFlinger::handleTransaction(uint32_t transactionFlags)
 {
     ATRACE_CALL();
@@ -1089,6 +1836,7 @@ void SurfaceFlinger::handleTransaction(uint32_t transactionFlags)
     // until the transaction is committed.
 
     transactionFlags = getTransactionFlags(eTransactionMask);
+    transactionFlags |= applySignaledLayerStateChannelsLocked();
     handleTransactionLocked(transactionFlags);
 
     mLastTransactionTime = systemTime() - now;
@@ -1124,6 +1872,9 @@ void SurfaceFlinger::handleTransactionLocked(uint32_t transactionFlags)
      */
 
     if (transactionFlags & eDisplayTransactionNeeded) {
+        // the displays and their HWComposer state may go away
+        waitForFrameCommit();
+
         // here we take advantage of Vector's copy-on-write semantics to
         // improve performance by skipping the transaction entirely when
         // know that the lists are identical
@@ -1148,6 +1899,8 @@ void SurfaceFlinger::handleTransactionLocked(uint32_t transactionFlags)
                         // is current.
                         const sp<const DisplayDevice> hw(getDefaultDisplayDevice());
                         DisplayDevice::makeCurrent(mEGLDisplay, hw, mEGLContext);
+                        mDisplays.valueFor(draw.keyAt(i))->compositionCache.release();
+                        mDisplays.valueFor(draw.keyAt(i))->mirror.release();
                         mDisplays.removeItem(draw.keyAt(i));
                         getHwComposer().disconnectDisplay(draw[i].type);
                         mEventThread->onHotplugReceived(draw[i].type, false);
@@ -1339,11 +2092,18 @@ void SurfaceFlinger::commitTransaction()
     mTransactionPending = false;
     mAnimTransactionPending = false;
     mTransactionCV.broadcast();
+
+    if (!mPendingTransactionListeners.isEmpty()) {
+        mCommittedTransactionListeners.appendVector(mPendingTransactionListeners);
+        mPendingTransactionListeners.clear();
+    }
 }
 
 void SurfaceFlinger::computeVisibleRegions(
-        const LayerVector& currentLayers, uint32_t layerStack,
-        Region& outDirtyRegion, Region& outOpaqueRegion)
+        const LayerVector& currentLayers, const LayerSnapshot& snapshot,
+        uint32_t layerStack,
+        Region& outDirtyRegion, Region& outOpaqueRegion,
+        VisibleRegionCache* cache)
 {
     ATRACE_CALL();
 
@@ -1353,17 +2113,49 @@ void SurfaceFlinger::computeVisibleRegions(
 
     outDirtyRegion.clear();
 
-    size_t i = currentLayers.size();
-    while (i--) {
-        const sp<LayerBase>& layer = currentLayers[i];
-
-        // start with the whole surface at its current location
-        const Layer::State& s(layer->drawingState());
+    // number of cache entries still matching the layers walked so far
+    size_t cached = 0;
+    bool cacheValid = (cache != NULL);
 
+    const uint32_t* layerStacks = snapshot.layerStack.array();
+    size_t i = snapshot.size();
+    while (i--) {
         // only consider the layers on the given later stack
-        if (s.layerStack != layerStack)
+        if (layerStacks[i] != layerStack)
             continue;
 
+        const sp<LayerBase>& layer = currentLayers[i];
+        const bool layerVisible = snapshot.flags[i] & LayerSnapshot::VISIBLE;
+        const bool layerOpaque = snapshot.flags[i] & LayerSnapshot::OPAQUE;
+
+        VisibleRegionCache::Inputs inputs;
+        if (cache) {
+            inputs.sequence = snapshot.sequence[i];
+            inputs.orientation = snapshot.orientation[i];
+            inputs.bounds = snapshot.bounds[i];
+            inputs.alpha = snapshot.alpha[i];
+            inputs.visible = layerVisible;
+            inputs.opaque = layerOpaque;
+
+            if (cacheValid) {
+                if (cached < cache->entries.size() && !layer->contentDirty) {
+                    const VisibleRegionCache::Entry& e(cache->entries[cached]);
+                    if (e.layer == layer->sequence && e.inputs == inputs) {
+                        // this layer and all the ones above it are unchanged,
+                        // its visible and covered regions are still valid.
+                        aboveOpaqueLayers = e.aboveOpaqueLayers;
+                        aboveCoveredLayers = e.aboveCoveredLayers;
+                        cached++;
+                        continue;
+                    }
+                }
+                // everything below this layer needs to be recomputed
+                cache->entries.removeItemsAt(cached,
+                        cache->entries.size() - cached);
+                cacheValid = false;
+            }
+        }
+
         /*
          * opaqueRegion: area of a surface that is fully opaque.
          */
@@ -1395,14 +2187,14 @@ void SurfaceFlinger::computeVisibleRegions(
 
 
         // handle hidden surfaces by setting the visible region to empty
-        if (CC_LIKELY(layer->isVisible())) {
-            const bool translucent = !layer->isOpaque();
-            Rect bounds(layer->computeBounds());
-            visibleRegion.set(bounds);
+        if (CC_LIKELY(layerVisible)) {
+            const bool translucent = !layerOpaque;
+            visibleRegion.set(snapshot.bounds[i]);
             if (!visibleRegion.isEmpty()) {
                 // Remove the transparent area from the visible region
                 if (translucent) {
-                    const Transform tr(s.transform);
+                    const Layer::State& s(layer->drawingState());
+                    const Transform& tr(s.transform);
                     if (tr.transformed()) {
                         if (tr.preserveRects()) {
                             // transform the transparent region
@@ -1418,8 +2210,8 @@ void SurfaceFlinger::computeVisibleRegions(
                 }
 
                 // compute the opaque region
-                const int32_t layerOrientation = s.transform.getOrientation();
-                if (s.alpha==255 && !translucent &&
+                const uint32_t layerOrientation = snapshot.orientation[i];
+                if (snapshot.alpha[i]==255 && !translucent &&
                         ((layerOrientation & Transform::ROT_INVALID) == false)) {
                     // the opaque region is the layer's footprint
                     opaqueRegion = visibleRegion;
@@ -1475,6 +2267,20 @@ void SurfaceFlinger::computeVisibleRegions(
         layer->setCoveredRegion(coveredRegion);
         layer->setVisibleNonTransparentRegion(
                 visibleRegion.subtract(transparentRegion));
+
+        if (cache) {
+            VisibleRegionCache::Entry e;
+            e.layer = layer->sequence;
+            e.inputs = inputs;
+            e.aboveOpaqueLayers = aboveOpaqueLayers;
+            e.aboveCoveredLayers = aboveCoveredLayers;
+            cache->entries.add(e);
+        }
+    }
+
+    if (cacheValid && cached < cache->entries.size()) {
+        // layers were removed from the bottom of the stack
+        cache->entries.removeItemsAt(cached, cache->entries.size() - cached);
     }
 
     outOpaqueRegion = aboveOpaqueLayers;
@@ -1492,14 +2298,22 @@ void SurfaceFlinger::invalidateLayerStack(uint32_t layerStack,
 
 void SurfaceFlinger::handlePageFlip()
 {
+    // latching a buffer releases the previous one, with the fence the
+    // commit of the last frame returns
+    waitForFrameCommit();
+
     Region dirtyRegion;
 
+    // buffers that can't be latched within the budget are left for the
+    // next composition rather than delaying this one
+    const nsecs_t deadline = mLatchBudget ? systemTime() + mLatchBudget : 0;
+
     bool visibleRegions = false;
     const LayerVector& currentLayers(mDrawingState.layersSortedByZ);
     const size_t count = currentLayers.size();
     for (size_t i=0 ; i<count ; i++) {
         const sp<LayerBase>& layer(currentLayers[i]);
-        const Region dirty(layer->latchBuffer(visibleRegions));
+        const Region dirty(layer->latchBuffer(visibleRegions, deadline));
         const Layer::State& s(layer->drawingState());
         invalidateLayerStack(s.layerStack, dirty);
     }
@@ -1513,6 +2327,92 @@ void SurfaceFlinger::invalidateHwcGeometry()
 }
 
 
+bool SurfaceFlinger::mirrorDisplayComposition(const sp<const DisplayDevice>& hw,
+        const sp<const DisplayDevice>& source)
+{
+    if (!DisplayDevice::makeCurrent(mEGLDisplay, hw, mEGLContext)) {
+        return false;
+    }
+    if (!hw->mirror.draw(hw, source, mEGLDisplay)) {
+        return false;
+    }
+    hw->lastFrameGlesOnly = false;
+    hw->swapRegion.set(hw->bounds());
+    hw->swapBuffers(getHwComposer());
+    return true;
+}
+
+bool SurfaceFlinger::reuseFramebufferTarget(const sp<const DisplayDevice>& hw,
+        const Region& dirtyRegion)
+{
+    HWComposer& hwc(getHwComposer());
+    const int32_t id = hw->getHwcDisplayId();
+    const Vector< sp<LayerBase> >& layers(hw->getVisibleLayersSortedByZ());
+    const size_t count = layers.size();
+
+    // without a framebuffer target, or without h/w composer layers
+    // covering all the layers, there is nothing to reuse
+    bool reusable = id >= 0 && hwc.initCheck() == NO_ERROR &&
+            hwc.supportsFramebufferTarget() && hwc.hasGlesComposition(id);
+    if (reusable) {
+        HWComposer::LayerListIterator cur = hwc.begin(id);
+        const HWComposer::LayerListIterator end = hwc.end(id);
+        size_t n = 0;
+        for ( ; cur != end ; ++cur) {
+            n++;
+        }
+        reusable = n == count;
+    }
+    if (!reusable) {
+        hw->lastFramebufferTargetValid = false;
+        return false;
+    }
+
+    // record this frame's composition, and the screen region GLES draws
+    // from; the clear of an overlay doesn't depend on its contents
+    const Transform& tr(hw->getTransform());
+    Vector<DisplayDevice::HwcLayerState> state;
+    state.setCapacity(count);
+    Region framebufferRegion;
+    HWComposer::LayerListIterator cur = hwc.begin(id);
+    for (size_t i=0 ; i<count ; ++i, ++cur) {
+        DisplayDevice::HwcLayerState s;
+        s.layer = layers[i]->sequence;
+        s.compositionType = cur->getCompositionType();
+        s.hints = cur->getHints();
+        state.add(s);
+        if (s.compositionType == HWC_FRAMEBUFFER) {
+            framebufferRegion.orSelf(tr.transform(layers[i]->visibleRegion));
+        }
+    }
+
+    // The last framebuffer target can be posted again if the composition
+    // is the same and nothing changed where GLES draws, now or in the
+    // last frame. A video updating in an overlay over static layers then
+    // doesn't cost a GLES pass per frame.
+    bool same = hw->lastFramebufferTargetValid &&
+            state.size() == hw->lastHwcLayers.size();
+    for (size_t i=0 ; same && i<state.size() ; i++) {
+        const DisplayDevice::HwcLayerState& a(state[i]);
+        const DisplayDevice::HwcLayerState& b(hw->lastHwcLayers[i]);
+        same = a.layer == b.layer && a.compositionType == b.compositionType &&
+                a.hints == b.hints;
+    }
+    if (same) {
+        same = dirtyRegion.intersect(
+                framebufferRegion.merge(hw->lastFramebufferRegion)).isEmpty();
+    }
+
+    hw->lastHwcLayers = state;
+    hw->lastFramebufferRegion = framebufferRegion;
+    hw->lastFramebufferTargetValid = true;
+    if (same) {
+        // the back buffer isn't updated, see doDisplayComposition()
+        hw->lastFrameGlesOnly = false;
+    }
+    return same;
+}
+
 void SurfaceFlinger::doDisplayComposition(const sp<const DisplayDevice>& hw,
         const Region& inDirtyRegion)
 {
@@ -1521,24 +2421,29 @@ void SurfaceFlinger::doDisplayComposition(const sp<const DisplayDevice>& hw,
     // compute the invalid region
     hw->swapRegion.orSelf(dirtyRegion);
 
+    // a preserved back buffer only holds the whole last frame if h/w
+    // composer didn't handle part of it, in this frame or the last one
+    const bool glesOnly = !getHwComposer().hasHwcComposition(
+            hw->getHwcDisplayId());
+    const bool backBufferValid = glesOnly && hw->lastFrameGlesOnly;
+    hw->lastFrameGlesOnly = glesOnly;
+
     uint32_t flags = hw->getFlags();
     if (flags & DisplayDevice::SWAP_RECTANGLE) {
         // we can redraw only what's dirty, but since SWAP_RECTANGLE only
         // takes a rectangle, we must make sure to update that whole
         // rectangle in that case
         dirtyRegion.set(hw->swapRegion.bounds());
+    } else if ((flags & DisplayDevice::BUFFER_PRESERVED) && backBufferValid) {
+        // the back buffer still holds the last frame, so we only redraw
+        // the bounds of what changed (doComposeSurfaces() scissors to them).
+        // A single rectangle is also what PARTIAL_UPDATES can post
+        // (see DisplayDevice::swapBuffers()).
+        dirtyRegion.set(hw->swapRegion.bounds());
     } else {
-        if (flags & DisplayDevice::PARTIAL_UPDATES) {
-            // We need to redraw the rectangle that will be updated
-            // (pushed to the framebuffer).
-            // This is needed because PARTIAL_UPDATES only takes one
-            // rectangle instead of a region (see DisplayDevice::flip())
-            dirtyRegion.set(hw->swapRegion.bounds());
-        } else {
-            // we need to redraw everything (the whole screen)
-            dirtyRegion.set(hw->bounds());
-            hw->swapRegion = dirtyRegion;
-        }
+        // we need to redraw everything (the whole screen)
+        dirtyRegion.set(hw->bounds());
+        hw->swapRegion = dirtyRegion;
     }
 
     doComposeSurfaces(hw, dirtyRegion);
@@ -1558,12 +2463,34 @@ void SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const
     const HWComposer::LayerListIterator end = hwc.end(id);
 
     const bool hasGlesComposition = hwc.hasGlesComposition(id) || (cur==end);
+    size_t cachedLayers = 0;
     if (hasGlesComposition) {
         if (!DisplayDevice::makeCurrent(mEGLDisplay, hw, mEGLContext)) {
             ALOGW("DisplayDevice::makeCurrent failed. Aborting surface composition for display %s",
                   hw->getDisplayName().string());
             return;
         }
+        // whatever happened since the last composition went around it
+        GLStateCache::getInstance().invalidate();
+
+        // framebuffer objects aren't shared between contexts, so displays
+        // with a composer thread don't use the cache
+        if (mCompositionCacheFrames &&
+                mDisplayComposers.indexOfKey(hw->getDisplayToken()) < 0 &&
+                GLExtensions::getInstance().haveFramebufferObject()) {
+            // the bottom layers composed with GLES can come from the
+            // cache, which must be rendered before anything is drawn here
+            size_t glesLayers = hw->getVisibleLayersSortedByZ().size();
+            if (cur != end) {
+                glesLayers = 0;
+                for (HWComposer::LayerListIterator it(cur) ; it != end &&
+                        it->getCompositionType() == HWC_FRAMEBUFFER ; ++it) {
+                    glesLayers++;
+                }
+            }
+            cachedLayers = hw->compositionCache.update(hw, mEGLDisplay,
+                    glesLayers, mCompositionCacheFrames);
+        }
 
         // set the frame buffer
         glMatrixMode(GL_MODELVIEW);
@@ -1588,27 +2515,35 @@ void SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const
             }
         }
 
+        const Rect& bounds(hw->getBounds());
+        Rect scissor(bounds);
         if (hw->getDisplayType() >= DisplayDevice::DISPLAY_EXTERNAL) {
             // TODO: just to be on the safe side, we don't set the
             // scissor on the main display. It should never be needed
             // anyways (though in theory it could since the API allows it).
-            const Rect& bounds(hw->getBounds());
             const Transform& tr(hw->getTransform());
-            const Rect scissor(tr.transform(hw->getViewport()));
+            scissor = tr.transform(hw->getViewport());
             if (scissor != bounds) {
                 // scissor doesn't match the screen's dimensions, so we
                 // need to clear everything outside of it and enable
                 // the GL scissor so we don't draw anything where we shouldn't
-                const GLint height = hw->getHeight();
-                glScissor(scissor.left, height - scissor.bottom,
-                        scissor.getWidth(), scissor.getHeight());
-                // clear everything unscissored
                 glClearColor(0, 0, 0, 0);
                 glClear(GL_COLOR_BUFFER_BIT);
-                // enable scissor for this frame
-                glEnable(GL_SCISSOR_TEST);
             }
         }
+
+        // layers are drawn whole, so with a partial update we must make
+        // sure not to blend anything again outside of what's redrawn
+        if (!scissor.intersect(dirty.getBounds(), &scissor)) {
+            scissor = Rect(0, 0);
+        }
+        if (scissor != bounds) {
+            const GLint height = hw->getHeight();
+            glScissor(scissor.left, height - scissor.bottom,
+                    scissor.getWidth(), scissor.getHeight());
+            // enable scissor for this frame
+            glEnable(GL_SCISSOR_TEST);
+        }
     }
 
     /*
@@ -1618,12 +2553,18 @@ void SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const
     const Vector< sp<LayerBase> >& layers(hw->getVisibleLayersSortedByZ());
     const size_t count = layers.size();
     const Transform& tr = hw->getTransform();
+    if (cachedLayers) {
+        // this replaces the clear (or wormhole) too, the cache was
+        // cleared the same way
+        hw->compositionCache.draw(hw, dirty.intersect(hw->bounds()));
+    }
     if (cur != end) {
         // we're using h/w composer
         for (size_t i=0 ; i<count && cur!=end ; ++i, ++cur) {
             const sp<LayerBase>& layer(layers[i]);
             const Region clip(dirty.intersect(tr.transform(layer->visibleRegion)));
-            if (!clip.isEmpty()) {
+            // the layers in the cache were drawn with it
+            if (i >= cachedLayers && !clip.isEmpty()) {
                 switch (cur->getCompositionType()) {
                     case HWC_OVERLAY: {
                         if ((cur->getHints() & HWC_HINT_CLEAR_FB)
@@ -1640,6 +2581,10 @@ void SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const
                         layer->draw(hw, clip);
                         break;
                     }
+                    case HWC_BACKGROUND: {
+                        // h/w composer fills the display with its color
+                        break;
+                    }
                     case HWC_FRAMEBUFFER_TARGET: {
                         // this should not happen as the iterator shouldn't
                         // let us get there.
@@ -1652,7 +2597,7 @@ void SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const
         }
     } else {
         // we're not using h/w composer
-        for (size_t i=0 ; i<count ; ++i) {
+        for (size_t i=cachedLayers ; i<count ; ++i) {
             const sp<LayerBase>& layer(layers[i]);
             const Region clip(dirty.intersect(
                     tr.transform(layer->visibleRegion)));
@@ -1664,30 +2609,19 @@ void SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const
 
     // disable scissor at the end of the frame
     glDisable(GL_SCISSOR_TEST);
+    if (hasGlesComposition) {
+        GLStateCache::getInstance().restore();
+    }
 }
 
 void SurfaceFlinger::drawWormhole(const sp<const DisplayDevice>& hw,
         const Region& region) const
 {
-    glDisable(GL_TEXTURE_EXTERNAL_OES);
-    glDisable(GL_TEXTURE_2D);
-    glDisable(GL_BLEND);
-    glColor4f(0,0,0,0);
-
-    const int32_t height = hw->getHeight();
-    Region::const_iterator it = region.begin();
-    Region::const_iterator const end = region.end();
-    while (it != end) {
-        const Rect& r = *it++;
-        GLfloat vertices[][2] = {
-                { r.left,  height - r.top },
-                { r.left,  height - r.bottom },
-                { r.right, height - r.bottom },
-                { r.right, height - r.top }
-        };
-        glVertexPointer(2, GL_FLOAT, 0, vertices);
-        glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-    }
+    GLStateCache& gl(GLStateCache::getInstance());
+    gl.setTexture(0, 0);
+    gl.setBlending(false);
+    gl.setColor(0,0,0,0);
+    gl.drawRegion(region, hw->getWidth(), hw->getHeight(), false);
 }
 
 ssize_t SurfaceFlinger::addClientLayer(const sp<Client>& client,
@@ -1712,6 +2646,21 @@ status_t SurfaceFlinger::removeLayer(const sp<LayerBase>& layer)
     return err;
 }
 
+status_t SurfaceFlinger::removeLayers(const Vector< sp<LayerBase> >& layers)
+{
+    Mutex::Autolock _l(mStateLock);
+    bool removed = false;
+    const size_t count = layers.size();
+    for (size_t i=0 ; i<count ; i++) {
+        if (purgatorizeLayer_l(layers[i]) == NO_ERROR) {
+            removed = true;
+        }
+    }
+    if (removed)
+        setTransactionFlags(eTransactionNeeded);
+    return NO_ERROR;
+}
+
 status_t SurfaceFlinger::removeLayer_l(const sp<LayerBase>& layerBase)
 {
     ssize_t index = mCurrentState.layersSortedByZ.remove(layerBase);
@@ -1769,6 +2718,15 @@ void SurfaceFlinger::setTransactionState(
     uint32_t transactionFlags = 0;
 
     if (flags & eAnimation) {
+        // the first frame of an animation, the ones that follow will come
+        // every vsync
+        static const nsecs_t ANIMATION_IDLE_TIME = ms2ns(100);
+        const nsecs_t now = systemTime();
+        if (now - mLastAnimationTransaction > ANIMATION_IDLE_TIME) {
+            mPowerHAL.boostHint(PowerHAL::BOOST_ANIMATION);
+        }
+        mLastAnimationTransaction = now;
+
         // For window updates that are part of an animation we must wait for
         // previous animation "frames" to be handled.
         while (mAnimTransactionPending) {
@@ -1784,12 +2742,73 @@ void SurfaceFlinger::setTransactionState(
         }
     }
 
+    transactionFlags = applyTransactionStateLocked(state, displays);
+
+    if (transactionFlags) {
+        // this triggers the transaction
+        setTransactionFlags(transactionFlags);
+
+        // if this is a synchronous transaction, wait for it to take effect
+        // before returning.
+        if (flags & eSynchronous) {
+            mTransactionPending = true;
+        }
+        if (flags & eAnimation) {
+            mAnimTransactionPending = true;
+        }
+        while (mTransactionPending) {
+            status_t err = mTransactionCV.waitRelative(mStateLock, s2ns(5));
+            if (CC_UNLIKELY(err != NO_ERROR)) {
+                // just in case something goes wrong in SF, return to the
+                // called after a few seconds.
+                ALOGW_IF(err == TIMED_OUT, "setTransactionState timed out!");
+                mTransactionPending = false;
+                break;
+            }
+        }
+    }
+}
+
+void SurfaceFlinger::setTransactionStateAsync(
+        const Vector<ComposerState>& state,
+        const Vector<DisplayState>& displays,
+        uint32_t flags,
+        const Vector< sp<ITransactionCompletedListener> >& listeners)
+{
+    ATRACE_CALL();
+    Mutex::Autolock _l(mStateLock);
+
+    // the caller paces itself with the listeners, so we neither wait for
+    // this transaction nor for a previous animation frame
+    uint32_t transactionFlags = applyTransactionStateLocked(state, displays);
+    if (transactionFlags) {
+        mPendingTransactionListeners.appendVector(listeners);
+        // this triggers the transaction
+        setTransactionFlags(transactionFlags);
+    } else {
+        // nothing to wait for
+        for (size_t i=0 ; i<listeners.size() ; i++) {
+            listeners[i]->onTransactionCompleted(Fence::NO_FENCE);
+        }
+    }
+}
+
+uint32_t SurfaceFlinger::applyTransactionStateLocked(
+        const Vector<ComposerState>& state,
+        const Vector<DisplayState>& displays)
+{
+    uint32_t transactionFlags = 0;
+
     size_t count = displays.size();
     for (size_t i=0 ; i<count ; i++) {
         const DisplayState& s(displays[i]);
         transactionFlags |= setDisplayStateLocked(s);
     }
 
+    // the states are grouped by client, so the last client checked is
+    // remembered for the rest of the transaction
+    sp<ISurfaceComposerClient> checked;
+    sp<Client> client;
     count = state.size();
     for (size_t i=0 ; i<count ; i++) {
         const ComposerState& s(state[i]);
@@ -1800,41 +2819,74 @@ void SurfaceFlinger::setTransactionState(
         //
         // NOTE: it would be better to use RTTI as we could directly check
         // that we have a Client*. however, RTTI is disabled in Android.
-        if (s.client != NULL) {
-            sp<IBinder> binder = s.client->asBinder();
-            if (binder != NULL) {
-                String16 desc(binder->getInterfaceDescriptor());
-                if (desc == ISurfaceComposerClient::descriptor) {
-                    sp<Client> client( static_cast<Client *>(s.client.get()) );
-                    transactionFlags |= setClientStateLocked(client, s.state);
+        if (s.client != checked) {
+            checked = s.client;
+            client.clear();
+            if (s.client != NULL) {
+                sp<IBinder> binder = s.client->asBinder();
+                if (binder != NULL) {
+                    String16 desc(binder->getInterfaceDescriptor());
+                    if (desc == ISurfaceComposerClient::descriptor) {
+                        client = static_cast<Client *>(s.client.get());
+                        // what the client wrote in its channel came first
+                        transactionFlags |=
+                                applyLayerStateChannelLocked(client);
+                    }
                 }
             }
         }
+        if (client != NULL) {
+            transactionFlags |= setClientStateLocked(client, s.state);
+        }
     }
+    return transactionFlags;
+}
 
-    if (transactionFlags) {
-        // this triggers the transaction
-        setTransactionFlags(transactionFlags);
+void SurfaceFlinger::signalLayerStateChannel(const sp<Client>& client)
+{
+    Mutex::Autolock _l(mStateLock);
+    mSignaledStateChannels.add(client);
+    // the states are applied with the next transaction
+    setTransactionFlags(eTransactionNeeded);
+}
 
-        // if this is a synchronous transaction, wait for it to take effect
-        // before returning.
-        if (flags & eSynchronous) {
-            mTransactionPending = true;
-        }
-        if (flags & eAnimation) {
-            mAnimTransactionPending = true;
-        }
-        while (mTransactionPending) {
-            status_t err = mTransactionCV.waitRelative(mStateLock, s2ns(5));
-            if (CC_UNLIKELY(err != NO_ERROR)) {
-                // just in case something goes wrong in SF, return to the
-                // called after a few seconds.
-                ALOGW_IF(err == TIMED_OUT, "setTransactionState timed out!");
-                mTransactionPending = false;
+uint32_t SurfaceFlinger::applyLayerStateChannelLocked(
+        const sp<Client>& client)
+{
+    sp<LayerStateChannel> channel(client->getLayerStateChannel());
+    if (channel == NULL) {
+        return 0;
+    }
+
+    uint32_t flags = 0;
+    layer_state_t s;
+    size_t count;
+    uint32_t const* words;
+    channel->clearSignaled();
+    while ((words = channel->read(&count)) != NULL) {
+        uint32_t const* cursor = words;
+        uint32_t const* const end = words + count;
+        while (cursor < end) {
+            if (s.readCompact(cursor, end) != NO_ERROR) {
+                ALOGE("client %p wrote a malformed layer state",
+                        client.get());
                 break;
             }
+            flags |= setClientStateLocked(client, s);
         }
     }
+    return flags;
+}
+
+uint32_t SurfaceFlinger::applySignaledLayerStateChannelsLocked()
+{
+    uint32_t flags = 0;
+    const size_t count = mSignaledStateChannels.size();
+    for (size_t i=0 ; i<count ; i++) {
+        flags |= applyLayerStateChannelLocked(mSignaledStateChannels[i]);
+    }
+    mSignaledStateChannels.clear();
+    return flags;
 }
 
 uint32_t SurfaceFlinger::setDisplayStateLocked(const DisplayState& s)
@@ -1925,6 +2977,10 @@ uint32_t SurfaceFlinger::setClientStateLocked(
             if (layer->setCrop(s.crop))
                 flags |= eTraversalNeeded;
         }
+        if (what & layer_state_t::eFrameRateChanged) {
+            if (layer->setFrameRate(s.frameRate))
+                flags |= eTraversalNeeded;
+        }
         if (what & layer_state_t::eLayerStackChanged) {
             // NOTE: index needs to be calculated before we update the state
             ssize_t idx = mCurrentState.layersSortedByZ.indexOf(layer);
@@ -2121,6 +3177,7 @@ void SurfaceFlinger::onScreenAcquired(const sp<const DisplayDevice>& hw) {
         return;
     }
 
+    waitForFrameCommit();
     hw->acquireScreen();
     int32_t type = hw->getDisplayType();
     if (type < DisplayDevice::NUM_DISPLAY_TYPES) {
@@ -2129,7 +3186,14 @@ void SurfaceFlinger::onScreenAcquired(const sp<const DisplayDevice>& hw) {
 
         if (type == DisplayDevice::DISPLAY_PRIMARY) {
             // FIXME: eventthread only knows about the main display right now
+            if (mUseVSyncModel) {
+                // the display may not resume with the same timing
+                mPrimaryVSyncModel.reset();
+            }
             mEventThread->onScreenAcquired();
+            if (mSFEventThread != NULL) {
+                mSFEventThread->onScreenAcquired();
+            }
         }
     }
     mVisibleRegionsDirty = true;
@@ -2143,12 +3207,16 @@ void SurfaceFlinger::onScreenReleased(const sp<const DisplayDevice>& hw) {
         return;
     }
 
+    waitForFrameCommit();
     hw->releaseScreen();
     int32_t type = hw->getDisplayType();
     if (type < DisplayDevice::NUM_DISPLAY_TYPES) {
         if (type == DisplayDevice::DISPLAY_PRIMARY) {
             // FIXME: eventthread only knows about the main display right now
             mEventThread->onScreenReleased();
+            if (mSFEventThread != NULL) {
+                mSFEventThread->onScreenReleased();
+            }
         }
 
         // built-in display, tell the HWC
@@ -2156,10 +3224,27 @@ void SurfaceFlinger::onScreenReleased(const sp<const DisplayDevice>& hw) {
     }
     mVisibleRegionsDirty = true;
     // from this point on, SF will stop drawing on this display
+
+    // nothing is composed while the screen is off, so postComposition()
+    // won't trim the layers it showed, do it once they're idle
+    if (mTrimIdleTimeout) {
+        class MessageTrimIdleLayers : public MessageBase {
+            SurfaceFlinger* flinger;
+        public:
+            MessageTrimIdleLayers(SurfaceFlinger* flinger)
+                : flinger(flinger) { }
+            virtual bool handler() {
+                flinger->trimIdleLayers();
+                return true;
+            }
+        };
+        postMessageAsync(new MessageTrimIdleLayers(this),
+                mTrimIdleTimeout + s2ns(1));
+    }
 }
 
 void SurfaceFlinger::unblank(const sp<IBinder>& display) {
-    class MessageScreenAcquired : public MessageBase {
+    class MessageScreenAcquired : public SyncMessage {
         SurfaceFlinger& mFlinger;
         sp<IBinder> mDisplay;
     public:
@@ -2177,12 +3262,12 @@ void SurfaceFlinger::unblank(const sp<IBinder>& display) {
             return true;
         }
     };
-    sp<MessageBase> msg = new MessageScreenAcquired(*this, display);
+    MessageScreenAcquired msg(*this, display);
     postMessageSync(msg);
 }
 
 void SurfaceFlinger::blank(const sp<IBinder>& display) {
-    class MessageScreenReleased : public MessageBase {
+    class MessageScreenReleased : public SyncMessage {
         SurfaceFlinger& mFlinger;
         sp<IBinder> mDisplay;
     public:
@@ -2200,7 +3285,7 @@ void SurfaceFlinger::blank(const sp<IBinder>& display) {
             return true;
         }
     };
-    sp<MessageBase> msg = new MessageScreenReleased(*this, display);
+    MessageScreenReleased msg(*this, display);
     postMessageSync(msg);
 }
 
@@ -2226,7 +3311,8 @@ status_t SurfaceFlinger::dump(int fd, const Vector<String16>& args)
         while (mStateLock.tryLock()<0 && --retry>=0) {
             usleep(1000000);
         }
-        const bool locked(retry >= 0);
+        bool locked(retry >= 0);
+        const bool unresponsive = !locked;
         if (!locked) {
             snprintf(buffer, SIZE,
                     "SurfaceFlinger appears to be unresponsive, "
@@ -2234,29 +3320,78 @@ status_t SurfaceFlinger::dump(int fd, const Vector<String16>& args)
             result.append(buffer);
         }
 
-        bool dumpAll = true;
+        // Only the full dump formats under the lock. The options below are
+        // polled continuously by tools (--latency every frame or so) and
+        // work from a snapshot instead, so they don't hold up
+        // transactions, and the frames waiting on them, while formatting.
         size_t index = 0;
         size_t numArgs = args.size();
+        bool dumpAll = !numArgs || !isDumpOption(args[0]);
+        DumpSnapshot snapshot;
+        if (!dumpAll) {
+            snapshot.layers = mCurrentState.layersSortedByZ;
+            snapshot.displays = mDisplays;
+            if (locked) {
+                mStateLock.unlock();
+                locked = false;
+            }
+        }
+
+        if (numArgs && args[0] == String16("--proto")) {
+            // binary, so it can't be combined with anything else
+            ProtoOutput proto;
+            dumpProto(snapshot, unresponsive, proto);
+            write(fd, proto.data(), proto.size());
+            return NO_ERROR;
+        }
+
         if (numArgs) {
             if ((index < numArgs) &&
                     (args[index] == String16("--list"))) {
                 index++;
-                listLayersLocked(args, index, result, buffer, SIZE);
-                dumpAll = false;
+                listLayers(snapshot, args, index, result, buffer, SIZE);
             }
 
             if ((index < numArgs) &&
                     (args[index] == String16("--latency"))) {
                 index++;
-                dumpStatsLocked(args, index, result, buffer, SIZE);
-                dumpAll = false;
+                dumpStats(snapshot, args, index, result, buffer, SIZE);
             }
 
             if ((index < numArgs) &&
                     (args[index] == String16("--latency-clear"))) {
                 index++;
-                clearStatsLocked(args, index, result, buffer, SIZE);
-                dumpAll = false;
+                clearStats(snapshot, args, index, result, buffer, SIZE);
+            }
+
+            if ((index < numArgs) &&
+                    (args[index] == String16("--latency-histogram"))) {
+                index++;
+                dumpLatencyHistograms(snapshot, args, index, result, buffer, SIZE);
+            }
+
+            if ((index < numArgs) &&
+                    (args[index] == String16("--refresh-stages"))) {
+                index++;
+                dumpRefreshStagesLocked(result, buffer, SIZE);
+            }
+
+            if ((index < numArgs) &&
+                    (args[index] == String16("--cpu"))) {
+                index++;
+                dumpCpuUsage(result);
+            }
+
+            if ((index < numArgs) &&
+                    (args[index] == String16("--profile"))) {
+                index++;
+                // an optional list of tags to time from now on
+                if (index < numArgs && !isDumpOption(args[index])) {
+                    Profiler::setEnabledTags(String8(args[index]).string());
+                    Profiler::clear();
+                    index++;
+                }
+                Profiler::dump(result);
             }
         }
 
@@ -2272,10 +3407,23 @@ status_t SurfaceFlinger::dump(int fd, const Vector<String16>& args)
     return NO_ERROR;
 }
 
-void SurfaceFlinger::listLayersLocked(const Vector<String16>& args, size_t& index,
+/*static*/ bool SurfaceFlinger::isDumpOption(const String16& arg)
+{
+    return arg == String16("--list") ||
+            arg == String16("--latency") ||
+            arg == String16("--latency-clear") ||
+            arg == String16("--latency-histogram") ||
+            arg == String16("--refresh-stages") ||
+            arg == String16("--cpu") ||
+            arg == String16("--profile") ||
+            arg == String16("--proto");
+}
+
+void SurfaceFlinger::listLayers(const DumpSnapshot& snapshot,
+        const Vector<String16>& args, size_t& index,
         String8& result, char* buffer, size_t SIZE) const
 {
-    const LayerVector& currentLayers = mCurrentState.layersSortedByZ;
+    const LayerVector& currentLayers = snapshot.layers;
     const size_t count = currentLayers.size();
     for (size_t i=0 ; i<count ; i++) {
         const sp<LayerBase>& layer(currentLayers[i]);
@@ -2284,7 +3432,8 @@ void SurfaceFlinger::listLayersLocked(const Vector<String16>& args, size_t& inde
     }
 }
 
-void SurfaceFlinger::dumpStatsLocked(const Vector<String16>& args, size_t& index,
+void SurfaceFlinger::dumpStats(const DumpSnapshot& snapshot,
+        const Vector<String16>& args, size_t& index,
         String8& result, char* buffer, size_t SIZE) const
 {
     String8 name;
@@ -2293,7 +3442,7 @@ void SurfaceFlinger::dumpStatsLocked(const Vector<String16>& args, size_t& index
         index++;
     }
 
-    const LayerVector& currentLayers = mCurrentState.layersSortedByZ;
+    const LayerVector& currentLayers = snapshot.layers;
     const size_t count = currentLayers.size();
     for (size_t i=0 ; i<count ; i++) {
         const sp<LayerBase>& layer(currentLayers[i]);
@@ -2307,7 +3456,8 @@ void SurfaceFlinger::dumpStatsLocked(const Vector<String16>& args, size_t& index
     }
 }
 
-void SurfaceFlinger::clearStatsLocked(const Vector<String16>& args, size_t& index,
+void SurfaceFlinger::clearStats(const DumpSnapshot& snapshot,
+        const Vector<String16>& args, size_t& index,
         String8& result, char* buffer, size_t SIZE) const
 {
     String8 name;
@@ -2316,7 +3466,7 @@ void SurfaceFlinger::clearStatsLocked(const Vector<String16>& args, size_t& inde
         index++;
     }
 
-    const LayerVector& currentLayers = mCurrentState.layersSortedByZ;
+    const LayerVector& currentLayers = snapshot.layers;
     const size_t count = currentLayers.size();
     for (size_t i=0 ; i<count ; i++) {
         const sp<LayerBase>& layer(currentLayers[i]);
@@ -2324,6 +3474,80 @@ void SurfaceFlinger::clearStatsLocked(const Vector<String16>& args, size_t& inde
             layer->clearStats();
         }
     }
+
+    if (name.isEmpty()) {
+        mHwcPrepareHistogram.clear();
+        mHwcCommitHistogram.clear();
+        mEventQueue.getSyncMessageDelay().clear();
+        for (size_t dpy=0 ; dpy<snapshot.displays.size() ; dpy++) {
+            snapshot.displays[dpy]->compositionHistogram.clear();
+        }
+    }
+}
+
+void SurfaceFlinger::dumpLatencyHistograms(const DumpSnapshot& snapshot,
+        const Vector<String16>& args, size_t& index,
+        String8& result, char* buffer, size_t SIZE) const
+{
+    String8 name;
+    if (index < args.size()) {
+        name = String8(args[index]);
+        index++;
+    }
+
+    if (name.isEmpty()) {
+        result.append("SurfaceFlinger\n");
+        mHwcPrepareHistogram.dump(result, "hwc-prepare     ");
+        mHwcCommitHistogram.dump(result, "hwc-commit      ");
+        mEventQueue.getSyncMessageDelay().dump(result, "sync-message    ");
+        for (size_t dpy=0 ; dpy<snapshot.displays.size() ; dpy++) {
+            const sp<const DisplayDevice>& hw(snapshot.displays[dpy]);
+            snprintf(buffer, SIZE, "Display %d (%s)\n",
+                    hw->getDisplayType(), hw->getDisplayName().string());
+            result.append(buffer);
+            hw->compositionHistogram.dump(result, "composition     ");
+        }
+    }
+
+    const LayerVector& currentLayers = snapshot.layers;
+    const size_t count = currentLayers.size();
+    for (size_t i=0 ; i<count ; i++) {
+        const sp<LayerBase>& layer(currentLayers[i]);
+        if (name.isEmpty() || (name == layer->getName())) {
+            snprintf(buffer, SIZE, "%s\n", layer->getName().string());
+            result.append(buffer);
+            layer->dumpLatencyHistograms(result);
+        }
+    }
+}
+
+void SurfaceFlinger::dumpRefreshStagesLocked(
+        String8& result, char* buffer, size_t SIZE) const
+{
+    static const char* const names[NUM_REFRESH_STAGES] = {
+            "preComposition",
+            "rebuildLayerStacks",
+            "setUpHWComposer",
+            "doComposition",
+            "postComposition"
+    };
+
+    // these are written by the main thread without lock, we don't care
+    // if we get slightly inconsistent values here.
+    snprintf(buffer, SIZE, "Refresh stages (%u frames):\n",
+            mRefreshStageStats[STAGE_PRE_COMPOSITION].count);
+    result.append(buffer);
+    for (size_t i=0 ; i<NUM_REFRESH_STAGES ; i++) {
+        const RefreshStageStats& stats(mRefreshStageStats[i]);
+        const double avg = stats.count ? double(stats.total) / stats.count : 0;
+        snprintf(buffer, SIZE,
+                "  %-20s: last=%8.1f us, avg=%8.1f us, max=%8.1f us\n",
+                names[i], stats.last/1000.0, avg/1000.0, stats.max/1000.0);
+        result.append(buffer);
+    }
+    if (mFrameCommitter != NULL) {
+        mFrameCommitter->dump(result);
+    }
 }
 
 /*static*/ void SurfaceFlinger::appendSfConfigString(String8& result)
@@ -2398,6 +3622,11 @@ void SurfaceFlinger::dumpAllLocked(
     for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
         const sp<const DisplayDevice>& hw(mDisplays[dpy]);
         hw->dump(result, buffer, SIZE);
+        const sp<DisplayComposer> composer(
+                mDisplayComposers.valueFor(mDisplays.keyAt(dpy)));
+        if (composer != NULL) {
+            composer->dump(result);
+        }
     }
 
     /*
@@ -2423,6 +3652,20 @@ void SurfaceFlinger::dumpAllLocked(
     snprintf(buffer, SIZE, "EXTS: %s\n", extensions.getExtension());
     result.append(buffer);
 
+    snprintf(buffer, SIZE, "fence sync: native=%d, gpu wait=%d\n",
+            extensions.haveNativeFenceSync(), extensions.haveWaitSync());
+    result.append(buffer);
+    mGLStateCache->dump(result);
+
+    snprintf(buffer, SIZE, "boot phases (parallel init=%d):\n", mParallelInit);
+    result.append(buffer);
+    for (size_t i=0 ; i<mBootPhases.size() ; i++) {
+        const BootPhase& phase(mBootPhases[i]);
+        snprintf(buffer, SIZE, "  %-20s: +%7.2f ms, %7.2f ms\n",
+                phase.name, phase.start/1e6, phase.duration/1e6);
+        result.append(buffer);
+    }
+
     hw->undefinedRegion.dump(result, "undefinedRegion");
     snprintf(buffer, SIZE,
             "  orientation=%d, canDraw=%d\n",
@@ -2433,12 +3676,15 @@ void SurfaceFlinger::dumpAllLocked(
             "  last transaction time     : %f us\n"
             "  transaction-flags         : %08x\n"
             "  refresh-rate              : %f fps\n"
+            "  effective refresh-rate    : %f fps (vsync divisor %u, %u changes)\n"
             "  x-dpi                     : %f\n"
             "  y-dpi                     : %f\n",
             mLastSwapBufferTime/1000.0,
             mLastTransactionTime/1000.0,
             mTransactionFlags,
             1e9 / hwc.getRefreshPeriod(HWC_DISPLAY_PRIMARY),
+            1e9 / hwc.getRefreshPeriod(HWC_DISPLAY_PRIMARY) / mVSyncDivisor,
+            mVSyncDivisor, mVSyncDivisorChanges,
             hwc.getDpiX(HWC_DISPLAY_PRIMARY),
             hwc.getDpiY(HWC_DISPLAY_PRIMARY));
     result.append(buffer);
@@ -2451,10 +3697,65 @@ void SurfaceFlinger::dumpAllLocked(
             inTransactionDuration/1000.0);
     result.append(buffer);
 
+    if (mLatchBudget) {
+        uint32_t deferred = 0;
+        for (size_t i=0 ; i<currentLayers.size() ; i++) {
+            const sp<Layer> layer(currentLayers[i]->getLayer());
+            if (layer != NULL) {
+                deferred += layer->getDeferredLatches();
+            }
+        }
+        snprintf(buffer, SIZE, "  latch budget: %lld us, deferred latches: %u\n",
+                ns2us(mLatchBudget), deferred);
+        result.append(buffer);
+    }
+
+    if (mHwcHoldFrames) {
+        snprintf(buffer, SIZE, "  overlay fallbacks held in GLES for %u frames\n",
+                mHwcHoldFrames);
+        result.append(buffer);
+    }
+
+    if (mTrimIdleTimeout) {
+        snprintf(buffer, SIZE, "  idle layer trimming: after %lld ms, "
+                "%u KB reclaimed\n",
+                ns2ms(mTrimIdleTimeout), mTrimmedBytes / 1024);
+        result.append(buffer);
+    }
+
+    /*
+     * Refresh stage timings
+     */
+    dumpRefreshStagesLocked(result, buffer, SIZE);
+    mPowerHAL.dumpBoostHints(result);
+    mEventQueue.getSyncMessageDelay().dump(result, "Sync message delay");
+    Mutex::dumpContention(result);
+    Profiler::dump(result);
+    {
+        SharedBuffer::CacheStats sbStats;
+        SharedBuffer::getCacheStats(&sbStats);
+        snprintf(buffer, SIZE, "SharedBuffer cache: %u hits, %u misses, "
+                "%u trimmed, %u/%u bytes\n",
+                sbStats.hits, sbStats.misses, sbStats.trimmed,
+                sbStats.cachedBytes, sbStats.maxCachedBytes);
+        result.append(buffer);
+    }
+
     /*
      * VSYNC state
      */
+    mEventQueue.dump(result);
     mEventThread->dump(result, buffer, SIZE);
+    if (mSFEventThread != NULL) {
+        mSFEventThread->dump(result, buffer, SIZE);
+    }
+    if (mUseVSyncModel) {
+        mPrimaryVSyncModel.dump(result);
+    }
+
+    dumpCpuUsage(result);
+
+    PermissionCache::dump(result);
 
     /*
      * Dump HWComposer state
@@ -2472,6 +3773,72 @@ void SurfaceFlinger::dumpAllLocked(
      */
     const GraphicBufferAllocator& alloc(GraphicBufferAllocator::get());
     alloc.dump(result);
+
+    /*
+     * Dump who the buffers are for
+     */
+    Vector<GraphicMemoryUsage> usage;
+    GraphicBufferAlloc::getUsage(&usage);
+    uint64_t total = 0;
+    result.append("Graphic memory by owner:\n");
+    for (size_t i=0 ; i<usage.size() ; i++) {
+        const GraphicMemoryUsage& u(usage[i]);
+        snprintf(buffer, SIZE, "  pid %5d: %3u buffers, %7.2f KiB, "
+                "usage %08x  %s\n",
+                u.pid, u.count, u.bytes / 1024.0f, u.usage, u.name.string());
+        result.append(buffer);
+        total += u.bytes;
+    }
+    snprintf(buffer, SIZE, "Total accounted: %.2f KiB\n", total / 1024.0f);
+    result.append(buffer);
+}
+
+void SurfaceFlinger::dumpCpuUsage(String8& result) const
+{
+    if (mCpuSampler) {
+        mCpuSampler->dump(result);
+    } else {
+        result.append("Thread CPU usage: disabled (set debug.sf.cpu_sample_ms)\n");
+    }
+}
+
+void SurfaceFlinger::dumpProto(const DumpSnapshot& snapshot,
+        bool unresponsive, ProtoOutput& proto) const
+{
+    const LayerVector& currentLayers = snapshot.layers;
+    for (size_t i=0 ; i<currentLayers.size() ; i++) {
+        const size_t token = proto.beginMessage(1);
+        currentLayers[i]->dumpProto(proto);
+        proto.endMessage(token);
+    }
+
+    for (size_t dpy=0 ; dpy<snapshot.displays.size() ; dpy++) {
+        const sp<DisplayDevice>& hw(snapshot.displays[dpy]);
+        const size_t token = proto.beginMessage(2);
+        proto.writeString(1, hw->getDisplayName());
+        proto.writeInt32(2, hw->getDisplayType());
+        proto.writeUInt32(3, hw->getLayerStack());
+        proto.writeInt32(4, hw->getWidth());
+        proto.writeInt32(5, hw->getHeight());
+        proto.writeInt32(6, hw->getOrientation());
+        proto.writeBool(7, hw->isSecure());
+        proto.writeBool(8, hw->isScreenAcquired());
+        proto.writeUInt32(9, hw->getPageFlipCount());
+        dumpProtoRect(proto, 10, hw->getViewport());
+        dumpProtoRect(proto, 11, hw->getFrame());
+        const Vector< sp<LayerBase> > visible(hw->getVisibleLayersSortedByZ());
+        for (size_t i=0 ; i<visible.size() ; i++) {
+            proto.writeString(12, visible[i]->getName());
+        }
+        proto.endMessage(token);
+    }
+
+    const size_t token = proto.beginMessage(3);
+    getHwComposer().dumpProto(proto);
+    proto.writeBool(2, !(mDebugDisableHWC || mDebugRegion));
+    proto.endMessage(token);
+
+    proto.writeBool(4, unresponsive);
 }
 
 const Vector< sp<LayerBase> >&
@@ -2503,7 +3870,9 @@ status_t SurfaceFlinger::onTransact(
 {
     switch (code) {
         case CREATE_CONNECTION:
+        case GET_GRAPHIC_MEMORY_USAGE:
         case SET_TRANSACTION_STATE:
+        case SET_TRANSACTION_STATE_ASYNC:
         case BOOT_FINISHED:
         case BLANK:
         case UNBLANK:
@@ -2521,6 +3890,8 @@ status_t SurfaceFlinger::onTransact(
             break;
         }
         case CAPTURE_SCREEN:
+        case CAPTURE_SCREEN_TO_BUFFER:
+        case CAPTURE_SCREEN_ASYNC:
         {
             // codes that require permission check
             IPCThreadState* ipc = IPCThreadState::self();
@@ -2605,7 +3976,7 @@ status_t SurfaceFlinger::onTransact(
 
 void SurfaceFlinger::repaintEverything() {
     android_atomic_or(1, &mRepaintEverything);
-    signalTransaction();
+    mEventQueue.invalidate(MessageQueue::REASON_REPAINT);
 }
 
 // ---------------------------------------------------------------------------
@@ -2667,12 +4038,15 @@ status_t SurfaceFlinger::renderScreenToTextureLocked(uint32_t layerStack,
     glClear(GL_COLOR_BUFFER_BIT);
     glMatrixMode(GL_MODELVIEW);
     glLoadIdentity();
+    GLStateCache& gl(GLStateCache::getInstance());
+    gl.invalidate();
     const Vector< sp<LayerBase> >& layers(hw->getVisibleLayersSortedByZ());
     const size_t count = layers.size();
     for (size_t i=0 ; i<count ; ++i) {
         const sp<LayerBase>& layer(layers[i]);
         layer->draw(hw);
     }
+    gl.restore();
 
     hw->compositionComplete();
 
@@ -2686,8 +4060,76 @@ status_t SurfaceFlinger::renderScreenToTextureLocked(uint32_t layerStack,
     return NO_ERROR;
 }
 
+sp<GraphicBuffer> SurfaceFlinger::holdScreenBufferLocked(uint32_t layerStack)
+{
+    sp<const DisplayDevice> hw(getDefaultDisplayDevice());
+    if (!mScreenshotFromFramebuffer || hw->getLayerStack() != layerStack) {
+        return NULL;
+    }
+
+    // the framebuffer target only has the whole frame if h/w composer
+    // didn't handle any of it, and it's only current if nothing has been
+    // drawn since it was posted
+    if (!hw->lastFrameGlesOnly || !hw->canDraw() ||
+            !hw->swapRegion.isEmpty()) {
+        return NULL;
+    }
+    return hw->holdFramebufferTargetBuffer();
+}
+
 // ---------------------------------------------------------------------------
 
+status_t SurfaceFlinger::drawScreenForCaptureLocked(
+        const sp<const DisplayDevice>& hw, const Rect& sourceCrop,
+        uint32_t sw, uint32_t sh,
+        uint32_t minLayerZ, uint32_t maxLayerZ)
+{
+    const bool filtering = sw != uint32_t(sourceCrop.width()) ||
+            sh != uint32_t(sourceCrop.height());
+
+    // invert everything, b/c glReadPixel() will invert the FB. Rendering
+    // into an EGLImage lays out the rows the same way.
+    GLint  viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glViewport(0, 0, sw, sh);
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glOrthof(sourceCrop.left, sourceCrop.right,
+            sourceCrop.bottom, sourceCrop.top, 0, 1);
+    glMatrixMode(GL_MODELVIEW);
+
+    // redraw the screen entirely...
+    glClearColor(0,0,0,1);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    GLStateCache& gl(GLStateCache::getInstance());
+    gl.invalidate();
+    const Vector< sp<LayerBase> >& layers(hw->getVisibleLayersSortedByZ());
+    const size_t count = layers.size();
+    for (size_t i=0 ; i<count ; ++i) {
+        const sp<LayerBase>& layer(layers[i]);
+        const uint32_t z = layer->drawingState().z;
+        if (z >= minLayerZ && z <= maxLayerZ) {
+            if (filtering) layer->setFiltering(true);
+            layer->draw(hw);
+            if (filtering) layer->setFiltering(false);
+        }
+    }
+    gl.restore();
+
+    status_t result = NO_ERROR;
+    if (glGetError() != GL_NO_ERROR) {
+        result = INVALID_OPERATION;
+    }
+
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    return result;
+}
+
 status_t SurfaceFlinger::captureScreenImplLocked(const sp<IBinder>& display,
         sp<IMemoryHeap>* heap,
         uint32_t* w, uint32_t* h, PixelFormat* f,
@@ -2721,7 +4163,6 @@ status_t SurfaceFlinger::captureScreenImplLocked(const sp<IBinder>& display,
     sw = (!sw) ? hw_w : sw;
     sh = (!sh) ? hw_h : sh;
     const size_t size = sw * sh * 4;
-    const bool filtering = sw != hw_w || sh != hw_h;
 
 //    ALOGD("screenshot: sw=%d, sh=%d, minZ=%d, maxZ=%d",
 //            sw, sh, minLayerZ, maxLayerZ);
@@ -2744,34 +4185,9 @@ status_t SurfaceFlinger::captureScreenImplLocked(const sp<IBinder>& display,
 
     if (status == GL_FRAMEBUFFER_COMPLETE_OES) {
 
-        // invert everything, b/c glReadPixel() below will invert the FB
-        GLint  viewport[4];
-        glGetIntegerv(GL_VIEWPORT, viewport);
-        glViewport(0, 0, sw, sh);
-        glMatrixMode(GL_PROJECTION);
-        glPushMatrix();
-        glLoadIdentity();
-        glOrthof(0, hw_w, hw_h, 0, 0, 1);
-        glMatrixMode(GL_MODELVIEW);
-
-        // redraw the screen entirely...
-        glClearColor(0,0,0,1);
-        glClear(GL_COLOR_BUFFER_BIT);
-
-        const Vector< sp<LayerBase> >& layers(hw->getVisibleLayersSortedByZ());
-        const size_t count = layers.size();
-        for (size_t i=0 ; i<count ; ++i) {
-            const sp<LayerBase>& layer(layers[i]);
-            const uint32_t z = layer->drawingState().z;
-            if (z >= minLayerZ && z <= maxLayerZ) {
-                if (filtering) layer->setFiltering(true);
-                layer->draw(hw);
-                if (filtering) layer->setFiltering(false);
-            }
-        }
-
         // check for errors and return screen capture
-        if (glGetError() != GL_NO_ERROR) {
+        if (drawScreenForCaptureLocked(hw, Rect(hw_w, hw_h), sw, sh,
+                minLayerZ, maxLayerZ) != NO_ERROR) {
             // error while rendering
             result = INVALID_OPERATION;
         } else {
@@ -2795,10 +4211,6 @@ status_t SurfaceFlinger::captureScreenImplLocked(const sp<IBinder>& display,
                 result = NO_MEMORY;
             }
         }
-        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
-        glMatrixMode(GL_PROJECTION);
-        glPopMatrix();
-        glMatrixMode(GL_MODELVIEW);
     } else {
         result = BAD_VALUE;
     }
@@ -2815,6 +4227,306 @@ status_t SurfaceFlinger::captureScreenImplLocked(const sp<IBinder>& display,
     return result;
 }
 
+status_t SurfaceFlinger::renderScreenToBufferLocked(
+        const sp<const DisplayDevice>& hw, const Rect& sourceCrop,
+        const sp<GraphicBuffer>& buffer,
+        uint32_t minLayerZ, uint32_t maxLayerZ, sp<Fence>* outFence)
+{
+    EGLint attrs[] = {
+        EGL_IMAGE_PRESERVED_KHR,    EGL_TRUE,
+        EGL_NONE,
+    };
+    EGLImageKHR image = eglCreateImageKHR(mEGLDisplay, EGL_NO_CONTEXT,
+            EGL_NATIVE_BUFFER_ANDROID,
+            (EGLClientBuffer)buffer->getNativeBuffer(), attrs);
+    if (image == EGL_NO_IMAGE_KHR) {
+        ALOGE("renderScreenToBuffer: eglCreateImageKHR failed (%#x)",
+                eglGetError());
+        return INVALID_OPERATION;
+    }
+
+    status_t result = NO_ERROR;
+
+    // make sure to clear all GL error flags
+    while ( glGetError() != GL_NO_ERROR ) ;
+
+    // create a FBO backed by the buffer
+    GLuint name, tname;
+    glGenRenderbuffersOES(1, &tname);
+    glBindRenderbufferOES(GL_RENDERBUFFER_OES, tname);
+    glEGLImageTargetRenderbufferStorageOES(GL_RENDERBUFFER_OES,
+            (GLeglImageOES)image);
+
+    glGenFramebuffersOES(1, &name);
+    glBindFramebufferOES(GL_FRAMEBUFFER_OES, name);
+    glFramebufferRenderbufferOES(GL_FRAMEBUFFER_OES,
+            GL_COLOR_ATTACHMENT0_OES, GL_RENDERBUFFER_OES, tname);
+
+    GLenum status = glCheckFramebufferStatusOES(GL_FRAMEBUFFER_OES);
+    if (status == GL_FRAMEBUFFER_COMPLETE_OES) {
+        if (drawScreenForCaptureLocked(hw, sourceCrop,
+                buffer->getWidth(), buffer->getHeight(),
+                minLayerZ, maxLayerZ) != NO_ERROR) {
+            // error while rendering
+            result = INVALID_OPERATION;
+        } else {
+            sp<Fence> fence(Fence::NO_FENCE);
+            if (outFence) {
+                // let the client wait for the rendering instead of us
+                fence = createRenderingFence();
+            }
+            if (!fence->isValid()) {
+                // the client may use the buffer as soon as we return
+                ScopedTrace _t(ATRACE_TAG, "glFinish");
+                glFinish();
+            }
+            if (outFence) {
+                *outFence = fence;
+            }
+        }
+    } else {
+        result = BAD_VALUE;
+    }
+
+    // release FBO resources
+    glBindFramebufferOES(GL_FRAMEBUFFER_OES, 0);
+    glDeleteRenderbuffersOES(1, &tname);
+    glDeleteFramebuffersOES(1, &name);
+    eglDestroyImageKHR(mEGLDisplay, image);
+
+    hw->compositionComplete();
+
+    return result;
+}
+
+status_t SurfaceFlinger::captureScreenToBufferImplLocked(
+        const sp<IBinder>& display, sp<GraphicBuffer>* outBuffer,
+        uint32_t sw, uint32_t sh,
+        uint32_t minLayerZ, uint32_t maxLayerZ)
+{
+    ATRACE_CALL();
+
+    if (!GLExtensions::getInstance().haveFramebufferObject()) {
+        return INVALID_OPERATION;
+    }
+
+    // get screen geometry
+    sp<const DisplayDevice> hw(getDisplayDevice(display));
+    const uint32_t hw_w = hw->getWidth();
+    const uint32_t hw_h = hw->getHeight();
+
+    // if we have secure windows on this display, never allow the screen capture
+    if (hw->getSecureLayerVisible()) {
+        ALOGW("FB is protected: PERMISSION_DENIED");
+        return PERMISSION_DENIED;
+    }
+
+    if ((sw > hw_w) || (sh > hw_h)) {
+        ALOGE("size mismatch (%d, %d) > (%d, %d)", sw, sh, hw_w, hw_h);
+        return BAD_VALUE;
+    }
+
+    sw = (!sw) ? hw_w : sw;
+    sh = (!sh) ? hw_h : sh;
+
+    // the buffer the screen is rendered into and handed to the client
+    sp<GraphicBuffer> buffer(new GraphicBuffer(sw, sh, PIXEL_FORMAT_RGBA_8888,
+            GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE |
+            GRALLOC_USAGE_SW_READ_OFTEN));
+    if (buffer->initCheck() != NO_ERROR) {
+        return NO_MEMORY;
+    }
+
+    status_t result = renderScreenToBufferLocked(hw, Rect(hw_w, hw_h),
+            buffer, minLayerZ, maxLayerZ, NULL);
+    if (result == NO_ERROR) {
+        *outBuffer = buffer;
+    }
+    return result;
+}
+
+status_t SurfaceFlinger::captureScreenToBuffer(const sp<IBinder>& display,
+        sp<GraphicBuffer>* outBuffer,
+        uint32_t sw, uint32_t sh,
+        uint32_t minLayerZ, uint32_t maxLayerZ)
+{
+    if (CC_UNLIKELY(display == 0))
+        return BAD_VALUE;
+
+    if (!GLExtensions::getInstance().haveFramebufferObject())
+        return INVALID_OPERATION;
+
+    class MessageCaptureScreenToBuffer : public SyncMessage {
+        SurfaceFlinger* flinger;
+        sp<IBinder> display;
+        sp<GraphicBuffer>* outBuffer;
+        uint32_t sw;
+        uint32_t sh;
+        uint32_t minLayerZ;
+        uint32_t maxLayerZ;
+        status_t result;
+    public:
+        MessageCaptureScreenToBuffer(SurfaceFlinger* flinger,
+                const sp<IBinder>& display, sp<GraphicBuffer>* outBuffer,
+                uint32_t sw, uint32_t sh,
+                uint32_t minLayerZ, uint32_t maxLayerZ)
+            : flinger(flinger), display(display), outBuffer(outBuffer),
+              sw(sw), sh(sh), minLayerZ(minLayerZ), maxLayerZ(maxLayerZ),
+              result(PERMISSION_DENIED)
+        {
+        }
+        status_t getResult() const {
+            return result;
+        }
+        virtual bool handler() {
+            Mutex::Autolock _l(flinger->mStateLock);
+            result = flinger->captureScreenToBufferImplLocked(display,
+                    outBuffer, sw, sh, minLayerZ, maxLayerZ);
+            return true;
+        }
+    };
+
+    MessageCaptureScreenToBuffer msg(this,
+            display, outBuffer, sw, sh, minLayerZ, maxLayerZ);
+    status_t res = postMessageSync(msg);
+    if (res == NO_ERROR) {
+        res = msg.getResult();
+    }
+    return res;
+}
+
+status_t SurfaceFlinger::captureScreenAsync(const sp<IBinder>& display,
+        const sp<IScreenCaptureListener>& listener, const Rect& sourceCrop,
+        uint32_t reqWidth, uint32_t reqHeight, PixelFormat format,
+        uint32_t minLayerZ, uint32_t maxLayerZ)
+{
+    if (CC_UNLIKELY(display == 0 || listener == 0))
+        return BAD_VALUE;
+
+    if (format != PIXEL_FORMAT_RGBA_8888 && format != PIXEL_FORMAT_RGB_565)
+        return BAD_VALUE;
+
+    if (!GLExtensions::getInstance().haveFramebufferObject())
+        return INVALID_OPERATION;
+
+    // the request is serviced by the main thread right after the next
+    // composition, so neither the caller nor a transaction has to wait
+    // on mStateLock for it.
+    CaptureRequest request;
+    request.display = display;
+    request.listener = listener;
+    request.sourceCrop = sourceCrop;
+    request.reqWidth = reqWidth;
+    request.reqHeight = reqHeight;
+    request.format = format;
+    request.minLayerZ = minLayerZ;
+    request.maxLayerZ = maxLayerZ;
+    {
+        Mutex::Autolock _l(mCaptureLock);
+        mPendingCaptures.add(request);
+    }
+    signalRefresh();
+    return NO_ERROR;
+}
+
+sp<Fence> SurfaceFlinger::createRenderingFence() const
+{
+    sp<Fence> fence(Fence::NO_FENCE);
+    if (GLExtensions::getInstance().hasExtension(
+            "EGL_ANDROID_native_fence_sync")) {
+        EGLSyncKHR sync = eglCreateSyncKHR(mEGLDisplay,
+                EGL_SYNC_NATIVE_FENCE_ANDROID, NULL);
+        if (sync != EGL_NO_SYNC_KHR) {
+            glFlush();
+            int fd = eglDupNativeFenceFDANDROID(mEGLDisplay, sync);
+            eglDestroySyncKHR(mEGLDisplay, sync);
+            if (fd != EGL_NO_NATIVE_FENCE_FD_ANDROID) {
+                fence = new Fence(fd);
+            }
+        }
+    }
+    return fence;
+}
+
+void SurfaceFlinger::notifyTransactionListeners()
+{
+    if (mCommittedTransactionListeners.isEmpty()) {
+        return;
+    }
+
+    ATRACE_CALL();
+
+    // signals once the GL commands of this composition have completed
+    const sp<Fence> fence(createRenderingFence());
+    for (size_t i=0 ; i<mCommittedTransactionListeners.size() ; i++) {
+        mCommittedTransactionListeners[i]->onTransactionCompleted(fence);
+    }
+    mCommittedTransactionListeners.clear();
+}
+
+void SurfaceFlinger::handleScreenCaptureRequests()
+{
+    Vector<CaptureRequest> requests;
+    {
+        Mutex::Autolock _l(mCaptureLock);
+        if (mPendingCaptures.isEmpty()) {
+            return;
+        }
+        requests = mPendingCaptures;
+        mPendingCaptures.clear();
+    }
+
+    ATRACE_CALL();
+
+    for (size_t i=0 ; i<requests.size() ; i++) {
+        const CaptureRequest& request(requests[i]);
+        sp<GraphicBuffer> buffer;
+        sp<Fence> fence(Fence::NO_FENCE);
+        status_t result = NO_ERROR;
+
+        sp<const DisplayDevice> hw(getDisplayDevice(request.display));
+        if (hw == 0) {
+            result = NAME_NOT_FOUND;
+        } else if (hw->getSecureLayerVisible()) {
+            // if we have secure windows on this display, never allow the
+            // screen capture
+            ALOGW("FB is protected: PERMISSION_DENIED");
+            result = PERMISSION_DENIED;
+        } else {
+            const Rect bounds(hw->getWidth(), hw->getHeight());
+            Rect crop(request.sourceCrop);
+            if (crop.isEmpty()) {
+                crop = bounds;
+            }
+            uint32_t sw = request.reqWidth  ? request.reqWidth  : crop.width();
+            uint32_t sh = request.reqHeight ? request.reqHeight : crop.height();
+            if (crop.left < 0 || crop.top < 0 ||
+                    crop.right > bounds.right || crop.bottom > bounds.bottom ||
+                    sw > uint32_t(crop.width()) ||
+                    sh > uint32_t(crop.height())) {
+                ALOGE("invalid capture request [%d, %d, %d, %d] -> (%d, %d)",
+                        crop.left, crop.top, crop.right, crop.bottom, sw, sh);
+                result = BAD_VALUE;
+            } else {
+                buffer = new GraphicBuffer(sw, sh, request.format,
+                        GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE |
+                        GRALLOC_USAGE_SW_READ_OFTEN);
+                result = buffer->initCheck();
+                if (result == NO_ERROR) {
+                    result = renderScreenToBufferLocked(hw, crop, buffer,
+                            request.minLayerZ, request.maxLayerZ, &fence);
+                }
+                if (result != NO_ERROR) {
+                    buffer.clear();
+                    fence = Fence::NO_FENCE;
+                }
+            }
+        }
+
+        request.listener->onScreenCaptured(result, buffer, fence);
+    }
+}
+
 
 status_t SurfaceFlinger::captureScreen(const sp<IBinder>& display,
         sp<IMemoryHeap>* heap,
@@ -2828,7 +4540,7 @@ status_t SurfaceFlinger::captureScreen(const sp<IBinder>& display,
     if (!GLExtensions::getInstance().haveFramebufferObject())
         return INVALID_OPERATION;
 
-    class MessageCaptureScreen : public MessageBase {
+    class MessageCaptureScreen : public SyncMessage {
         SurfaceFlinger* flinger;
         sp<IBinder> display;
         sp<IMemoryHeap>* heap;
@@ -2862,11 +4574,11 @@ status_t SurfaceFlinger::captureScreen(const sp<IBinder>& display,
         }
     };
 
-    sp<MessageBase> msg = new MessageCaptureScreen(this,
+    MessageCaptureScreen msg(this,
             display, heap, width, height, format, sw, sh, minLayerZ, maxLayerZ);
     status_t res = postMessageSync(msg);
     if (res == NO_ERROR) {
-        res = static_cast<MessageCaptureScreen*>( msg.get() )->getResult();
+        res = msg.getResult();
     }
     return res;
 }
@@ -37,18 +37,24 @@
 
 #include <ui/PixelFormat.h>
 
+#include <gui/IScreenCaptureListener.h>
 #include <gui/ISurfaceComposer.h>
 #include <gui/ISurfaceComposerClient.h>
+#include <gui/ITransactionCompletedListener.h>
 
 #include <hardware/hwcomposer_defs.h>
 
 #include <private/gui/LayerState.h>
 
 #include "Barrier.h"
+#include "LatencyHistogram.h"
+#include "LayerSnapshot.h"
 #include "MessageQueue.h"
 #include "DisplayDevice.h"
+#include "VSyncModel.h"
 
 #include "DisplayHardware/HWComposer.h"
+#include "DisplayHardware/PowerHAL.h"
 
 #ifdef SAMSUNG_HDMI_SUPPORT
 #include "SecHdmiClient.h"
@@ -59,15 +65,21 @@ namespace android {
 // ---------------------------------------------------------------------------
 
 class Client;
+class DisplayComposer;
 class DisplayEventConnection;
 class EventThread;
+class Fence;
+class FrameCommitter;
+class GLStateCache;
 class IGraphicBufferAlloc;
 class Layer;
 class LayerBase;
 class LayerBaseClient;
 class LayerDim;
 class LayerScreenshot;
+class ProtoOutput;
 class SurfaceTextureClient;
+class ThreadCpuSampler;
 
 // ---------------------------------------------------------------------------
 
@@ -103,6 +115,9 @@ public:
     status_t postMessageSync(const sp<MessageBase>& msg, nsecs_t reltime = 0,
         uint32_t flags = 0);
 
+    // same, for a message on the caller's stack, see SyncMessage
+    status_t postMessageSync(SyncMessage& msg);
+
     // force full composition on all displays
     void repaintEverything();
 
@@ -114,6 +129,11 @@ public:
     status_t renderScreenToTextureLocked(uint32_t layerStack, GLuint* textureName,
         GLfloat* uOut, GLfloat* vOut);
 
+    // holds on to the last frame of the default display if it shows the
+    // given layer stack and was composed with GLES only, so that it can be
+    // used instead of renderScreenToTextureLocked(). w/o acquiring main lock
+    sp<GraphicBuffer> holdScreenBufferLocked(uint32_t layerStack);
+
     // returns the default Display
     sp<const DisplayDevice> getDefaultDisplayDevice() const {
         return getDisplayDevice(mDefaultDisplays[DisplayDevice::DISPLAY_PRIMARY]);
@@ -125,10 +145,17 @@ public:
     // allocate a h/w composer display id
     int32_t allocateHwcDisplayId(DisplayDevice::DisplayType type);
 
+    // whether displays should only redraw and post what changed
+    bool usePartialUpdates() const { return mPartialUpdates; }
+
     // enable/disable h/w composer event
     // TODO: this should be made accessible only to EventThread
     void eventControl(int disp, int event, int enabled);
 
+    // called by EventThreads instead of eventControl(): h/w vsync on the
+    // primary display stays on as long as one of them wants it
+    void requestHwVSync(const EventThread* thread, bool enabled);
+
     // called on the main thread by MessageQueue when an internal message
     // is received
     // TODO: this should be made accessible only to MessageQueue
@@ -140,7 +167,9 @@ public:
 
 private:
     friend class Client;
+    friend class DisplayComposer;
     friend class DisplayEventConnection;
+    friend class FrameCommitter;
     friend class LayerBase;
     friend class LayerBaseClient;
     friend class Layer;
@@ -197,6 +226,9 @@ private:
     virtual sp<IBinder> getBuiltInDisplay(int32_t id);
     virtual void setTransactionState(const Vector<ComposerState>& state,
             const Vector<DisplayState>& displays, uint32_t flags);
+    virtual void setTransactionStateAsync(const Vector<ComposerState>& state,
+            const Vector<DisplayState>& displays, uint32_t flags,
+            const Vector< sp<ITransactionCompletedListener> >& listeners);
     virtual void bootFinished();
     virtual bool authenticateSurfaceTexture(
         const sp<ISurfaceTexture>& surface) const;
@@ -205,11 +237,20 @@ private:
         uint32_t* width, uint32_t* height, PixelFormat* format,
         uint32_t reqWidth, uint32_t reqHeight, uint32_t minLayerZ,
         uint32_t maxLayerZ);
+    virtual status_t captureScreenToBuffer(const sp<IBinder>& display,
+        sp<GraphicBuffer>* outBuffer,
+        uint32_t reqWidth, uint32_t reqHeight, uint32_t minLayerZ,
+        uint32_t maxLayerZ);
+    virtual status_t captureScreenAsync(const sp<IBinder>& display,
+        const sp<IScreenCaptureListener>& listener, const Rect& sourceCrop,
+        uint32_t reqWidth, uint32_t reqHeight, PixelFormat format,
+        uint32_t minLayerZ, uint32_t maxLayerZ);
     // called when screen needs to turn off
     virtual void blank(const sp<IBinder>& display);
     // called when screen is turning back on
     virtual void unblank(const sp<IBinder>& display);
     virtual status_t getDisplayInfo(const sp<IBinder>& display, DisplayInfo* info);
+    virtual status_t getGraphicMemoryUsage(Vector<GraphicMemoryUsage>* usage);
 
     /* ------------------------------------------------------------------------
      * DeathRecipient interface
@@ -248,6 +289,28 @@ private:
     void handleMessageInvalidate();
     void handleMessageRefresh();
 
+    // stages of handleMessageRefresh(), used for timing statistics
+    enum RefreshStage {
+        STAGE_PRE_COMPOSITION,
+        STAGE_REBUILD_LAYER_STACKS,
+        STAGE_SET_UP_HWCOMPOSER,
+        STAGE_DO_COMPOSITION,
+        STAGE_POST_COMPOSITION,
+        NUM_REFRESH_STAGES
+    };
+
+    struct RefreshStageStats {
+        RefreshStageStats() : last(0), max(0), total(0), count(0) { }
+        nsecs_t last;
+        nsecs_t max;
+        nsecs_t total;
+        uint32_t count;
+    };
+
+    // records the time spent in a stage started at 'start' and returns
+    // the current time, so calls can be chained.
+    nsecs_t recordRefreshStage(RefreshStage stage, nsecs_t start);
+
     void handleTransaction(uint32_t transactionFlags);
     void handleTransactionLocked(uint32_t transactionFlags);
 
@@ -266,6 +329,15 @@ private:
     uint32_t setClientStateLocked(const sp<Client>& client,
         const layer_state_t& s);
     uint32_t setDisplayStateLocked(const DisplayState& s);
+    uint32_t applyTransactionStateLocked(const Vector<ComposerState>& state,
+            const Vector<DisplayState>& displays);
+    // a client wrote transactions in its LayerStateChannel
+    void signalLayerStateChannel(const sp<Client>& client);
+    uint32_t applyLayerStateChannelLocked(const sp<Client>& client);
+    uint32_t applySignaledLayerStateChannelsLocked();
+    // tells the listeners of the transactions committed since the last
+    // composition that they are on screen. only called from the main thread.
+    void notifyTransactionListeners();
 
     /* ------------------------------------------------------------------------
      * Layer management
@@ -297,6 +369,10 @@ private:
     // remove a layer from SurfaceFlinger immediately
     status_t removeLayer(const sp<LayerBase>& layer);
 
+    // remove several layers at once, e.g. all the layers of a client that
+    // went away, with a single transaction
+    status_t removeLayers(const Vector< sp<LayerBase> >& layers);
+
     // add a layer to SurfaceFlinger
     ssize_t addClientLayer(const sp<Client>& client,
         const sp<LayerBaseClient>& lbc);
@@ -310,18 +386,49 @@ private:
 
     void startBootAnim();
 
+    // records a step of readyToRun(), that started and ended at these times
+    void addBootPhase(const char* name, nsecs_t start, nsecs_t end);
+
     status_t captureScreenImplLocked(const sp<IBinder>& display, sp<IMemoryHeap>* heap,
         uint32_t* width, uint32_t* height, PixelFormat* format,
         uint32_t reqWidth, uint32_t reqHeight, uint32_t minLayerZ,
         uint32_t maxLayerZ);
 
+    status_t captureScreenToBufferImplLocked(const sp<IBinder>& display,
+        sp<GraphicBuffer>* outBuffer,
+        uint32_t reqWidth, uint32_t reqHeight, uint32_t minLayerZ,
+        uint32_t maxLayerZ);
+
+    // draws the sourceCrop area of the layers of hw within
+    // [minLayerZ, maxLayerZ] into the currently bound sw x sh FBO, upside
+    // down as screen captures expect.
+    status_t drawScreenForCaptureLocked(const sp<const DisplayDevice>& hw,
+        const Rect& sourceCrop, uint32_t sw, uint32_t sh,
+        uint32_t minLayerZ, uint32_t maxLayerZ);
+
+    // renders into buffer through an EGLImage-backed FBO. if outFence is
+    // non-NULL it may receive a fence signaling the end of the rendering,
+    // otherwise the rendering is complete when this returns.
+    status_t renderScreenToBufferLocked(const sp<const DisplayDevice>& hw,
+        const Rect& sourceCrop, const sp<GraphicBuffer>& buffer,
+        uint32_t minLayerZ, uint32_t maxLayerZ, sp<Fence>* outFence);
+
+    // returns a fence signaling when the GL commands issued so far in the
+    // current context have completed, NO_FENCE if that isn't supported.
+    sp<Fence> createRenderingFence() const;
+
+    // services the captureScreenAsync() requests queued since the last
+    // composition. only called from the main thread.
+    void handleScreenCaptureRequests();
+
     /* ------------------------------------------------------------------------
      * EGL
      */
     static status_t selectConfigForAttribute(EGLDisplay dpy,
         EGLint const* attrs, EGLint attribute, EGLint value, EGLConfig* outConfig);
     static EGLConfig selectEGLConfig(EGLDisplay disp, EGLint visualId);
-    static EGLContext createGLContext(EGLDisplay disp, EGLConfig config);
+    static EGLContext createGLContext(EGLDisplay disp, EGLConfig config,
+            EGLContext shareContext = EGL_NO_CONTEXT);
     void initializeGL(EGLDisplay display);
     uint32_t getMaxTextureSize() const;
     uint32_t getMinColorDepth() const;
@@ -360,22 +467,81 @@ private:
      * Compositing
      */
     void invalidateHwcGeometry();
+    // if cache is not NULL, the layers at the top of the stack that didn't
+    // change since the previous pass are skipped
     static void computeVisibleRegions(
-            const LayerVector& currentLayers, uint32_t layerStack,
-            Region& dirtyRegion, Region& opaqueRegion);
+            const LayerVector& currentLayers, const LayerSnapshot& snapshot,
+            uint32_t layerStack,
+            Region& dirtyRegion, Region& opaqueRegion,
+            VisibleRegionCache* cache = NULL);
 
     void preComposition();
     void postComposition();
+    // frees the spare buffers of the layers that have been hidden and idle
+    // for mTrimIdleTimeout
+    void trimIdleLayers();
+    // picks the vsync divisor satisfying the primary display's layers
+    void updateVSyncDivisor();
     void rebuildLayerStacks();
+    // captures the drawing state's per-layer values into mLayerSnapshot
+    void buildLayerSnapshot();
     void setUpHWComposer();
+    // whether layer is kept out of h/w composer on hw for debugging or
+    // because it is static, see updateHwcStaticLayers()
+    bool isHwcSkipped(const sp<const DisplayDevice>& hw,
+            const sp<LayerBase>& layer) const;
+    // whether a solid color layer at the bottom of hw's stack can be
+    // given to h/w composer as the background color instead
+    bool isBackgroundLayer(const sp<const DisplayDevice>& hw,
+            const sp<LayerBase>& layer, const hwc_color& color) const;
+    // finds the layers to keep out of h/w composer's overlays, returns
+    // true if that changed on any display
+    bool updateHwcStaticLayers();
+    // returns true if the GLES composited part of the display didn't
+    // change since the last frame, so the framebuffer target posted then
+    // can be posted again, and records this frame's composition
+    bool reuseFramebufferTarget(const sp<const DisplayDevice>& hw,
+            const Region& dirtyRegion);
+    // draws source's last frame on hw, returns false if hw must be composed
+    bool mirrorDisplayComposition(const sp<const DisplayDevice>& hw,
+            const sp<const DisplayDevice>& source);
     void doComposition();
+    // binds the buffers of the layers composed with GLES this frame on
+    // any display, before composer threads use them
+    void bindGlesLayerTextures();
+    // starts and stops the displays' composer threads as needed
+    void updateDisplayComposers();
+    // returns the composers to use this frame, those of displays that
+    // don't show any layer shown by another display
+    void getParallelComposers(Vector< sp<DisplayComposer> >* composers);
+    // composes hw, from source's last frame if not NULL and possible
+    void composeDisplay(const sp<const DisplayDevice>& hw,
+            bool repaintEverything, const sp<const DisplayDevice>& source);
     void doDebugFlashRegions();
     void doDisplayComposition(const sp<const DisplayDevice>& hw,
             const Region& dirtyRegion);
     void doComposeSurfaces(const sp<const DisplayDevice>& hw,
             const Region& dirty);
 
+    // what committing a composed frame needs, copied on the main thread
+    struct PostedFrame {
+        struct Display {
+            sp<const DisplayDevice> hw;
+            Vector< sp<LayerBase> > layers;
+        };
+        Vector<Display> displays;
+        // the layers whose onPostComposition() follows the commit, when
+        // it isn't done by postComposition()
+        Vector< sp<LayerBase> > layers;
+    };
+    void getPostedFrame(PostedFrame* frame) const;
+    // commits the displays' current frame on the main thread
     void postFramebuffer();
+    // hands the frame to the HWComposer, on the main thread or the
+    // FrameCommitter's
+    void commitFrame(const PostedFrame& frame);
+    // returns once the main thread owns the HWComposer again
+    void waitForFrameCommit();
     void drawWormhole(const sp<const DisplayDevice>& hw,
             const Region& region) const;
     GLuint getProtectedTexName() const {
@@ -390,13 +556,33 @@ private:
     /* ------------------------------------------------------------------------
      * Debugging & dumpsys
      */
-    void listLayersLocked(const Vector<String16>& args, size_t& index,
+
+    // The state the dump options other than the full dump look at, copied
+    // under mStateLock (the vectors are copy-on-write, so this only takes
+    // references) and formatted once the lock is released.
+    struct DumpSnapshot {
+        LayerVector layers;
+        DefaultKeyedVector< wp<IBinder>, sp<DisplayDevice> > displays;
+    };
+
+    static bool isDumpOption(const String16& arg);
+    void listLayers(const DumpSnapshot& snapshot,
+        const Vector<String16>& args, size_t& index,
+        String8& result, char* buffer, size_t SIZE) const;
+    void dumpStats(const DumpSnapshot& snapshot,
+        const Vector<String16>& args, size_t& index,
         String8& result, char* buffer, size_t SIZE) const;
-    void dumpStatsLocked(const Vector<String16>& args, size_t& index,
+    void clearStats(const DumpSnapshot& snapshot,
+        const Vector<String16>& args, size_t& index,
         String8& result, char* buffer, size_t SIZE) const;
-    void clearStatsLocked(const Vector<String16>& args, size_t& index,
+    void dumpLatencyHistograms(const DumpSnapshot& snapshot,
+        const Vector<String16>& args, size_t& index,
         String8& result, char* buffer, size_t SIZE) const;
+    void dumpRefreshStagesLocked(String8& result, char* buffer, size_t SIZE) const;
     void dumpAllLocked(String8& result, char* buffer, size_t SIZE) const;
+    void dumpCpuUsage(String8& result) const;
+    void dumpProto(const DumpSnapshot& snapshot, bool unresponsive,
+        ProtoOutput& proto) const;
     bool startDdmConnection();
     static void appendSfConfigString(String8& result);
 
@@ -406,6 +592,20 @@ private:
 
     // access must be protected by mStateLock
     mutable Mutex mStateLock;
+
+    // captureScreenAsync() requests, serviced after the next composition
+    struct CaptureRequest {
+        sp<IBinder> display;
+        sp<IScreenCaptureListener> listener;
+        Rect sourceCrop;
+        uint32_t reqWidth;
+        uint32_t reqHeight;
+        PixelFormat format;
+        uint32_t minLayerZ;
+        uint32_t maxLayerZ;
+    };
+    mutable Mutex mCaptureLock;
+    Vector<CaptureRequest> mPendingCaptures;
     State mCurrentState;
     volatile int32_t mTransactionFlags;
     Condition mTransactionCV;
@@ -413,6 +613,14 @@ private:
     bool mTransactionPending;
     bool mAnimTransactionPending;
     Vector<sp<LayerBase> > mLayersPendingRemoval;
+    // clients that rang their LayerStateChannel's doorbell since the last
+    // transaction
+    SortedVector< sp<Client> > mSignaledStateChannels;
+    // listeners of setTransactionStateAsync() transactions not committed yet
+    Vector< sp<ITransactionCompletedListener> > mPendingTransactionListeners;
+    // main thread only: listeners of the committed transactions, told after
+    // the next composition
+    Vector< sp<ITransactionCompletedListener> > mCommittedTransactionListeners;
 
     // protected by mStateLock (but we could use another lock)
     bool mLayersRemoved;
@@ -425,6 +633,8 @@ private:
     GLuint mProtectedTexName;
     nsecs_t mBootTime;
     sp<EventThread> mEventThread;
+    // drives composition when the vsync model is enabled, NULL otherwise
+    sp<EventThread> mSFEventThread;
     GLint mMaxViewportDims[2];
     GLint mMaxTextureSize;
     GLint mMinColorDepth;
@@ -438,6 +648,7 @@ private:
     State mDrawingState;
     bool mVisibleRegionsDirty;
     bool mHwWorkListDirty;
+    LayerSnapshot mLayerSnapshot;
 
     // this may only be written from the main thread with mStateLock held
     // it may be read from other threads with mStateLock held
@@ -454,6 +665,87 @@ private:
     nsecs_t mLastTransactionTime;
     bool mBootFinished;
     int mUseDithering;
+    bool mIncrementalVisibleRegions;
+    bool mPartialUpdates;
+    // when enabled, layers that haven't been updated lately are left to
+    // GLES while other layers update, see updateHwcStaticLayers()
+    bool mHwcStaticLayers;
+    // frames a layer h/w composer moved from an overlay to GLES is kept
+    // in GLES for, 0 lets h/w composer decide every frame
+    uint32_t mHwcHoldFrames;
+    // number of compositions a layer must stay the same for to be put in
+    // a display's composition cache, 0 if the cache is disabled
+    uint32_t mCompositionCacheFrames;
+    // when enabled, virtual displays showing the same layers as the primary
+    // display are drawn from its framebuffer target
+    bool mMirrorVirtualDisplays;
+    // when enabled, displays other than the primary one are composed on
+    // their own thread, see DisplayComposer (main thread)
+    bool mParallelComposition;
+    DefaultKeyedVector< wp<IBinder>, sp<DisplayComposer> > mDisplayComposers;
+    // when enabled, frames are handed to the HWComposer on their own
+    // thread, see FrameCommitter (main thread)
+    bool mPipelinedComposition;
+    sp<FrameCommitter> mFrameCommitter;
+    // when enabled, screenshot layers show the last frame of the primary
+    // display's framebuffer target when they can, see LayerScreenshot
+    bool mScreenshotFromFramebuffer;
+    // time handlePageFlip() may spend latching buffers, 0 if unlimited
+    nsecs_t mLatchBudget;
+    // when enabled, buffers whose producer set a timestamp are latched for
+    // the vsync closest to it, see Layer::latchBuffer()
+    bool mPresentTimeScheduling;
+    // when enabled, layers latch their buffers without binding them to
+    // their texture, which is only done for the layers composed with GLES,
+    // see bindGlesLayerTextures()
+    bool mLazyLayerTextures;
+    // layers neither shown nor updated for this long get their spare
+    // buffers freed, 0 if never, see trimIdleLayers()
+    nsecs_t mTrimIdleTimeout;
+    nsecs_t mLastTrimTime;
+    // bytes reclaimed by trimIdleLayers() so far
+    size_t mTrimmedBytes;
+    // the main thread's, for dump()
+    GLStateCache* mGLStateCache;
+    // when enabled, vsync events are predicted from mPrimaryVSyncModel,
+    // apps and composition get them with their own phase offset
+    bool mUseVSyncModel;
+    nsecs_t mAppVSyncPhaseOffset;
+    nsecs_t mSFVSyncPhaseOffset;
+    VSyncModel mPrimaryVSyncModel;
+    // EventThreads currently wanting h/w vsync
+    Mutex mHwVSyncLock;
+    SortedVector<const EventThread*> mHwVSyncRequests;
+    // only every mVSyncDivisor-th vsync of the primary display is used,
+    // while the visible layers' frame rate hints allow it (main thread)
+    uint32_t mVSyncDivisor;
+    // how many times it changed, for dumpsys (main thread)
+    uint32_t mVSyncDivisorChanges;
+    RefreshStageStats mRefreshStageStats[NUM_REFRESH_STAGES];
+    // samples the CPU use of our main threads, when enabled
+    ThreadCpuSampler* mCpuSampler;
+    // when enabled, EGL is initialized on its own thread while readyToRun()
+    // opens the HWC
+    bool mParallelInit;
+    // how long each step of readyToRun() took, for dump()
+    struct BootPhase {
+        const char* name;
+        nsecs_t start;      // since readyToRun() was called
+        nsecs_t duration;
+    };
+    Vector<BootPhase> mBootPhases;
+    nsecs_t mReadyToRunTime;
+    // debug.sf.power_boost_ms: boosts asked ahead of expensive frames
+    PowerHAL mPowerHAL;
+    // last transaction with eAnimation (protected by mStateLock)
+    nsecs_t mLastAnimationTransaction;
+    // layers drawn by each display plus the ones GLES composes, for the
+    // last prepare() (main thread)
+    size_t mLastCompositionLoad;
+
+    // these are updated lock-free, and may be cleared from dump()
+    mutable LatencyHistogram mHwcPrepareHistogram;
+    mutable LatencyHistogram mHwcCommitHistogram;
 
     // these are thread safe
     mutable MessageQueue mEventQueue;
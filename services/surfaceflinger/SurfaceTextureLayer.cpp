@@ -27,8 +27,9 @@ namespace android {
 // ---------------------------------------------------------------------------
 
 
-SurfaceTextureLayer::SurfaceTextureLayer()
-    : BufferQueue(true) {
+SurfaceTextureLayer::SurfaceTextureLayer(
+        const sp<IGraphicBufferAlloc>& allocator)
+    : BufferQueue(true, allocator) {
 }
 
 SurfaceTextureLayer::~SurfaceTextureLayer() {
@@ -34,7 +34,7 @@ class Layer;
 class SurfaceTextureLayer : public BufferQueue
 {
 public:
-    SurfaceTextureLayer();
+    SurfaceTextureLayer(const sp<IGraphicBufferAlloc>& allocator = NULL);
     ~SurfaceTextureLayer();
 
     virtual status_t connect(int api, QueueBufferOutput* output);
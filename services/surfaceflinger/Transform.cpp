@@ -18,6 +18,7 @@
 
 #include <cutils/compiler.h>
 #include <utils/String8.h>
+#include <utils/Vector.h>
 #include <ui/Region.h>
 
 #include "clz.h"
@@ -203,8 +204,83 @@ Rect Transform::makeBounds(int w, int h) const
     return transform( Rect(w, h) );
 }
 
+bool Transform::isExact(int* tx, int* ty) const
+{
+    const uint32_t orientation = getOrientation();
+    if (orientation & ROT_INVALID)
+        return false;
+
+    // the SCALE bit is also set by a single flip, look at the matrix
+    const mat33& M(mMatrix);
+    if (orientation & ROT_90) {
+        if (!absIsOne(M[1][0]) || !absIsOne(M[0][1]))
+            return false;
+    } else {
+        if (!absIsOne(M[0][0]) || !absIsOne(M[1][1]))
+            return false;
+    }
+
+    // beyond this, the float path isn't exact either
+    const float limit = float(1 << 30);
+    const float x = M[2][0];
+    const float y = M[2][1];
+    if (x != floorf(x) || y != floorf(y) || fabsf(x) > limit || fabsf(y) > limit)
+        return false;
+
+    *tx = int(x);
+    *ty = int(y);
+    return true;
+}
+
+/*
+ * The mapping of a point is x' = A*x + B*y + tx, y' = C*x + D*y + ty, with
+ * A, B, C and D each -1, 0 or 1, so each edge of the result is an edge of
+ * the source, negated or not, plus the translation.  Instantiating this
+ * for each orientation lets the compiler reduce it to a few moves and
+ * additions.
+ */
+template <int A, int B, int C, int D>
+Rect Transform::transformExact(const Rect& bounds, int tx, int ty)
+{
+    Rect r;
+    if (B == 0) {
+        r.left   = (A > 0 ? bounds.left  : -bounds.right)  + tx;
+        r.right  = (A > 0 ? bounds.right : -bounds.left)   + tx;
+        r.top    = (D > 0 ? bounds.top    : -bounds.bottom) + ty;
+        r.bottom = (D > 0 ? bounds.bottom : -bounds.top)    + ty;
+    } else {
+        r.left   = (B > 0 ? bounds.top    : -bounds.bottom) + tx;
+        r.right  = (B > 0 ? bounds.bottom : -bounds.top)    + tx;
+        r.top    = (C > 0 ? bounds.left  : -bounds.right)  + ty;
+        r.bottom = (C > 0 ? bounds.right : -bounds.left)   + ty;
+    }
+    return r;
+}
+
+Rect Transform::transformExact(const Rect& bounds, uint32_t orientation,
+        int tx, int ty)
+{
+    // see type() for the signs of each orientation
+    switch (orientation) {
+        case ROT_0:             return transformExact< 1, 0, 0, 1>(bounds, tx, ty);
+        case FLIP_H:            return transformExact<-1, 0, 0, 1>(bounds, tx, ty);
+        case FLIP_V:            return transformExact< 1, 0, 0,-1>(bounds, tx, ty);
+        case ROT_180:           return transformExact<-1, 0, 0,-1>(bounds, tx, ty);
+        case ROT_90:            return transformExact< 0,-1, 1, 0>(bounds, tx, ty);
+        case ROT_90|FLIP_H:     return transformExact< 0,-1,-1, 0>(bounds, tx, ty);
+        case ROT_90|FLIP_V:     return transformExact< 0, 1, 1, 0>(bounds, tx, ty);
+        default:                return transformExact< 0, 1,-1, 0>(bounds, tx, ty);
+    }
+}
+
 Rect Transform::transform(const Rect& bounds) const
 {
+    // the float path also sorts the edges of invalid rects
+    int tx, ty;
+    if (CC_LIKELY(bounds.isValid() && isExact(&tx, &ty))) {
+        return transformExact(bounds, getOrientation(), tx, ty);
+    }
+
     Rect r;
     vec2 lt( bounds.left,  bounds.top    );
     vec2 rt( bounds.right, bounds.top    );
@@ -224,11 +300,40 @@ Rect Transform::transform(const Rect& bounds) const
     return r;
 }
 
+// Unions the rects pairwise rather than one at a time, so that each rect
+// goes through log(count) boolean operations on small regions instead of
+// one on a region that keeps growing.
+static Region unionOfRects(const Rect* rects, size_t count)
+{
+    if (count == 1) {
+        return Region(rects[0]);
+    }
+    const size_t half = count / 2;
+    return unionOfRects(rects, half).merge(
+            unionOfRects(rects + half, count - half));
+}
+
 Region Transform::transform(const Region& reg) const
 {
     Region out;
     if (CC_UNLIKELY(transformed())) {
-        if (CC_LIKELY(preserveRects())) {
+        int tx, ty;
+        if (CC_LIKELY(isExact(&tx, &ty))) {
+            const uint32_t orientation = getOrientation();
+            Region::const_iterator it = reg.begin();
+            Region::const_iterator const end = reg.end();
+            const size_t count = end - it;
+            if (count == 1) {
+                out.set(transformExact(*it, orientation, tx, ty));
+            } else if (count) {
+                Vector<Rect> rects;
+                rects.setCapacity(count);
+                while (it != end) {
+                    rects.add(transformExact(*it++, orientation, tx, ty));
+                }
+                out = unionOfRects(rects.array(), count);
+            }
+        } else if (CC_LIKELY(preserveRects())) {
             Region::const_iterator it = reg.begin();
             Region::const_iterator const end = reg.end();
             while (it != end) {
@@ -114,6 +114,19 @@ private:
     vec2 transform(const vec2& v) const;
     vec3 transform(const vec3& v) const;
     uint32_t type() const;
+
+    // returns true if this transform is a combination of flips, 90 degrees
+    // rotations and a whole translation, which maps integer coordinates
+    // exactly to integer coordinates. the translation is returned in
+    // tx and ty.
+    bool isExact(int* tx, int* ty) const;
+
+    // exact integer version of transform(Rect) for the orientation
+    // given by the signs of the 2x2 matrix, see isExact()
+    template <int A, int B, int C, int D>
+    static Rect transformExact(const Rect& bounds, int tx, int ty);
+    static Rect transformExact(const Rect& bounds, uint32_t orientation,
+            int tx, int ty);
     static bool absIsOne(float f);
     static bool isZero(float f);
 
@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "VSyncModel.h"
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+// the fit must be at least this good to lock the model
+static const double MAX_RMS_ERROR = 300000.0;           // 0.3 ms
+
+// slower than this isn't a vsync, it's h/w vsync having been off
+static const nsecs_t MAX_PERIOD = 100000000;            // 100 ms
+
+// how fast the display clock may drift away from ours, beyond what the
+// fit accounts for
+static const double ASSUMED_CLOCK_DRIFT = 20e-6;        // 20 ppm
+
+static const nsecs_t DEFAULT_DRIFT_THRESHOLD = 500000;  // 0.5 ms
+
+VSyncModel::VSyncModel()
+    : mDriftThreshold(DEFAULT_DRIFT_THRESHOLD),
+      mSampleCount(0), mResyncCount(0), mResetCount(0)
+{
+    clearLocked();
+}
+
+void VSyncModel::reset() {
+    Mutex::Autolock _l(mLock);
+    clearLocked();
+    mResetCount++;
+}
+
+void VSyncModel::clearLocked() {
+    mFirstSample = 0;
+    mNumSamples = 0;
+    mResyncSamples = 0;
+    mLocked = false;
+    mReference = 0;
+    mPeriod = 0;
+    mPeriodStdError = 0;
+    mRmsError = 0;
+}
+
+void VSyncModel::setDriftThreshold(nsecs_t threshold) {
+    Mutex::Autolock _l(mLock);
+    mDriftThreshold = threshold;
+}
+
+void VSyncModel::addHwSample(nsecs_t timestamp) {
+    Mutex::Autolock _l(mLock);
+    mSampleCount++;
+
+    int64_t index = 0;
+    if (mNumSamples) {
+        const size_t last = (mFirstSample + mNumSamples - 1) % MAX_SAMPLES;
+        const nsecs_t delta = timestamp - mSampleTimes[last];
+        if (delta <= 0) {
+            // duplicate or out of order, ignore
+            return;
+        }
+
+        int64_t n = 1;
+        if (mLocked) {
+            n = int64_t(floor(double(delta) / mPeriod + 0.5));
+            if (n < 1) {
+                n = 1;
+            }
+            const double predicted = double(mSampleTimes[last]) +
+                    double(n) * mPeriod;
+            if (fabs(double(timestamp) - predicted) > mPeriod / 4) {
+                // the display changed its timing (or we were wrong
+                // all along), start over
+                clearLocked();
+                mResetCount++;
+            }
+        } else if (delta > MAX_PERIOD) {
+            // we can't tell how many vsyncs we missed before the model
+            // is locked, start over
+            clearLocked();
+        } else if (mPeriod > 0) {
+            n = int64_t(floor(double(delta) / mPeriod + 0.5));
+            if (n < 1) {
+                n = 1;
+            }
+        }
+
+        if (mNumSamples) {
+            // a sample following a gap starts a resync
+            if (delta > MAX_PERIOD ||
+                    (mPeriod > 0 && double(delta) > mPeriod * 1.5)) {
+                mResyncSamples = 0;
+                mResyncCount++;
+            }
+            index = mSampleIndices[last] + n;
+        }
+    }
+
+    if (mNumSamples == MAX_SAMPLES) {
+        mFirstSample = (mFirstSample + 1) % MAX_SAMPLES;
+        mNumSamples--;
+    }
+    const size_t slot = (mFirstSample + mNumSamples) % MAX_SAMPLES;
+    mSampleTimes[slot] = timestamp;
+    mSampleIndices[slot] = index;
+    mNumSamples++;
+    mResyncSamples++;
+
+    updateModelLocked();
+}
+
+void VSyncModel::updateModelLocked() {
+    if (mNumSamples < 2) {
+        mLocked = false;
+        mPeriod = 0;
+        return;
+    }
+
+    // least squares fit of the timestamps against their vsync number,
+    // relative to the first sample to keep the precision
+    const nsecs_t t0 = mSampleTimes[mFirstSample];
+    const int64_t i0 = mSampleIndices[mFirstSample];
+    double mx = 0, my = 0;
+    for (size_t i=0 ; i<mNumSamples ; i++) {
+        const size_t s = (mFirstSample + i) % MAX_SAMPLES;
+        mx += double(mSampleIndices[s] - i0);
+        my += double(mSampleTimes[s] - t0);
+    }
+    mx /= mNumSamples;
+    my /= mNumSamples;
+
+    double sxx = 0, sxy = 0;
+    for (size_t i=0 ; i<mNumSamples ; i++) {
+        const size_t s = (mFirstSample + i) % MAX_SAMPLES;
+        const double dx = double(mSampleIndices[s] - i0) - mx;
+        const double dy = double(mSampleTimes[s] - t0) - my;
+        sxx += dx * dx;
+        sxy += dx * dy;
+    }
+    if (sxx <= 0) {
+        mLocked = false;
+        mPeriod = 0;
+        return;
+    }
+
+    const double period = sxy / sxx;
+    const double intercept = my - period * mx;
+
+    double sse = 0;
+    for (size_t i=0 ; i<mNumSamples ; i++) {
+        const size_t s = (mFirstSample + i) % MAX_SAMPLES;
+        const double x = double(mSampleIndices[s] - i0);
+        const double r = double(mSampleTimes[s] - t0) - (intercept + period * x);
+        sse += r * r;
+    }
+
+    mPeriod = period;
+    mReference = t0 + nsecs_t(intercept);
+    mRmsError = sqrt(sse / mNumSamples);
+    mPeriodStdError = (mNumSamples > 2) ?
+            sqrt(sse / (mNumSamples - 2) / sxx) : period;
+    mLocked = mNumSamples >= MIN_SAMPLES_TO_LOCK &&
+            period > 0 && period < MAX_PERIOD &&
+            mRmsError < MAX_RMS_ERROR;
+}
+
+nsecs_t VSyncModel::estimateDriftLocked(nsecs_t now) const {
+    const size_t last = (mFirstSample + mNumSamples - 1) % MAX_SAMPLES;
+    const double elapsed = double(now - mSampleTimes[last]);
+    const double periods = elapsed / mPeriod;
+    return nsecs_t(mRmsError + periods * mPeriodStdError +
+            elapsed * ASSUMED_CLOCK_DRIFT);
+}
+
+bool VSyncModel::isLocked() const {
+    Mutex::Autolock _l(mLock);
+    return mLocked;
+}
+
+bool VSyncModel::needsHwSamples(nsecs_t now) const {
+    Mutex::Autolock _l(mLock);
+    if (!mLocked || mResyncSamples < RESYNC_SAMPLES) {
+        return true;
+    }
+    return estimateDriftLocked(now) > mDriftThreshold;
+}
+
+nsecs_t VSyncModel::computeNextVSync(nsecs_t after, nsecs_t offset) const {
+    Mutex::Autolock _l(mLock);
+    if (!mLocked) {
+        return after;
+    }
+    const double n = floor(double(after - offset - mReference) / mPeriod) + 1;
+    nsecs_t next = mReference + nsecs_t(n * mPeriod) + offset;
+    while (next <= after) {
+        // rounding
+        next += nsecs_t(mPeriod);
+    }
+    return next;
+}
+
+nsecs_t VSyncModel::getPeriod() const {
+    Mutex::Autolock _l(mLock);
+    return mLocked ? nsecs_t(mPeriod) : 0;
+}
+
+void VSyncModel::dump(String8& result) const {
+    Mutex::Autolock _l(mLock);
+    result.appendFormat("  vsync model: %s, period=%.3f ms, "
+            "rms error=%.1f us, period error=%.3f us, drift threshold=%.1f us\n",
+            mLocked ? "locked" : "learning", mPeriod / 1e6,
+            mRmsError / 1e3, mPeriodStdError / 1e3, mDriftThreshold / 1e3);
+    if (mLocked) {
+        result.appendFormat("    estimated drift=%.1f us\n",
+                estimateDriftLocked(systemTime(SYSTEM_TIME_MONOTONIC)) / 1e3);
+    }
+    result.appendFormat("    h/w samples=%u, resyncs=%u, resets=%u\n",
+            mSampleCount, mResyncCount, mResetCount);
+}
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SF_VSYNC_MODEL_H
+#define ANDROID_SF_VSYNC_MODEL_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/Mutex.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+/*
+ * VSyncModel learns the period and phase of a display's vsync from h/w
+ * vsync timestamps, and predicts the following ones so that h/w vsync
+ * interrupts can stay off most of the time.
+ *
+ * The h/w timestamps are fitted to a line (timestamp = phase + n * period)
+ * by least squares. The model is locked once enough samples fit it well.
+ * While it is locked, the prediction error is estimated from the quality
+ * of the fit and the time elapsed since the last h/w sample; past the
+ * drift threshold the model asks for h/w vsync again (resync).
+ *
+ * This class is thread-safe.
+ */
+class VSyncModel
+{
+public:
+    enum {
+        MAX_SAMPLES         = 32,   // samples the fit is computed from
+        MIN_SAMPLES_TO_LOCK = 6,    // samples needed to lock the model
+        RESYNC_SAMPLES      = 3     // samples taken by a resync
+    };
+
+    VSyncModel();
+
+    // forgets everything learned, e.g. when the display is turned on
+    void reset();
+
+    // sets how far predictions may drift before h/w vsync is needed again
+    void setDriftThreshold(nsecs_t threshold);
+
+    // adds a h/w vsync timestamp
+    void addHwSample(nsecs_t timestamp);
+
+    // returns whether the model is locked, so predictions can be used
+    bool isLocked() const;
+
+    // returns whether h/w vsync samples are needed, either because the
+    // model isn't locked or because its predictions may have drifted
+    bool needsHwSamples(nsecs_t now) const;
+
+    // returns the first predicted vsync strictly after 'after', shifted by
+    // 'offset'. Only meaningful if the model is locked.
+    nsecs_t computeNextVSync(nsecs_t after, nsecs_t offset) const;
+
+    // returns the learned period, or 0 if the model isn't locked
+    nsecs_t getPeriod() const;
+
+    void dump(String8& result) const;
+
+private:
+    void clearLocked();
+    void updateModelLocked();
+    nsecs_t estimateDriftLocked(nsecs_t now) const;
+
+    mutable Mutex mLock;
+
+    // h/w samples, as a ring buffer: timestamps and their vsync number
+    // relative to the first sample since the last reset
+    nsecs_t mSampleTimes[MAX_SAMPLES];
+    int64_t mSampleIndices[MAX_SAMPLES];
+    size_t mFirstSample;
+    size_t mNumSamples;
+    size_t mResyncSamples;
+
+    // the model: vsync n happens at mReference + n * mPeriod
+    bool mLocked;
+    nsecs_t mReference;
+    double mPeriod;
+    double mPeriodStdError;
+    double mRmsError;
+    nsecs_t mDriftThreshold;
+
+    // statistics
+    uint32_t mSampleCount;
+    uint32_t mResyncCount;
+    uint32_t mResetCount;
+};
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
+
+#endif // ANDROID_SF_VSYNC_MODEL_H
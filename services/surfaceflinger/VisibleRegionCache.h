@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SF_VISIBLE_REGION_CACHE_H
+#define ANDROID_SF_VISIBLE_REGION_CACHE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/Vector.h>
+
+#include <ui/Rect.h>
+#include <ui/Region.h>
+
+namespace android {
+
+// ---------------------------------------------------------------------------
+
+/*
+ * VisibleRegionCache remembers, for one layer stack, the inputs of each
+ * layer seen by the last SurfaceFlinger::computeVisibleRegions() pass and
+ * the opaque/covered regions accumulated once that layer was processed.
+ *
+ * The layers are walked front-to-back, so the results of a layer only
+ * depend on the layers above it. As long as the topmost layers are the same
+ * (same identity, same order) and their inputs didn't change, their results
+ * are still valid and the walk can resume right below them with the
+ * accumulated regions taken from the cache. A reordered stack simply
+ * stops matching at the first layer that moved.
+ *
+ * This is only accessed from the main thread.
+ */
+struct VisibleRegionCache {
+    struct Inputs {
+        int32_t     sequence;       // LayerBase::State::sequence
+        uint32_t    orientation;
+        Rect        bounds;
+        uint8_t     alpha;
+        bool        visible;
+        bool        opaque;
+        inline bool operator == (const Inputs& rhs) const {
+            return (sequence == rhs.sequence &&
+                    orientation == rhs.orientation &&
+                    bounds == rhs.bounds &&
+                    alpha == rhs.alpha &&
+                    visible == rhs.visible &&
+                    opaque == rhs.opaque);
+        }
+        inline bool operator != (const Inputs& rhs) const {
+            return !operator == (rhs);
+        }
+    };
+
+    struct Entry {
+        int32_t     layer;          // LayerBase::sequence, unique per layer
+        Inputs      inputs;
+        Region      aboveOpaqueLayers;
+        Region      aboveCoveredLayers;
+    };
+
+    inline void clear() { entries.clear(); }
+
+    Vector<Entry> entries;
+};
+
+// ---------------------------------------------------------------------------
+
+}; // namespace android
+
+#endif // ANDROID_SF_VISIBLE_REGION_CACHE_H
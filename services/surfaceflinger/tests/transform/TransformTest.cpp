@@ -14,11 +14,76 @@
  * limitations under the License.
  */
 
+#include <math.h>
+#include <stdio.h>
+
 #include <utils/Errors.h>
+#include <ui/Region.h>
 #include "../../Transform.h"
 
 using namespace android;
 
+// transforms a rect with the float math, to check the exact integer paths
+static Rect transformWithFloats(const Transform& tr, const Rect& r)
+{
+    float xs[4], ys[4];
+    const int px[4] = { r.left, r.right, r.left, r.right };
+    const int py[4] = { r.top, r.top, r.bottom, r.bottom };
+    for (int i=0 ; i<4 ; i++) {
+        xs[i] = tr[0][0]*px[i] + tr[1][0]*py[i] + tr[2][0];
+        ys[i] = tr[0][1]*px[i] + tr[1][1]*py[i] + tr[2][1];
+    }
+    return Rect(
+            int(floorf(fminf(fminf(xs[0], xs[1]), fminf(xs[2], xs[3])) + 0.5f)),
+            int(floorf(fminf(fminf(ys[0], ys[1]), fminf(ys[2], ys[3])) + 0.5f)),
+            int(floorf(fmaxf(fmaxf(xs[0], xs[1]), fmaxf(xs[2], xs[3])) + 0.5f)),
+            int(floorf(fmaxf(fmaxf(ys[0], ys[1]), fmaxf(ys[2], ys[3])) + 0.5f)));
+}
+
+static int checkExactTransforms()
+{
+    static const uint32_t orientations[] = {
+            Transform::ROT_0, Transform::FLIP_H, Transform::FLIP_V,
+            Transform::ROT_180, Transform::ROT_90,
+            Transform::ROT_90 | Transform::FLIP_H,
+            Transform::ROT_90 | Transform::FLIP_V, Transform::ROT_270 };
+    static const Rect rects[] = {
+            Rect(0, 0, 10, 20), Rect(5, 7, 100, 33), Rect(-40, -3, 12, 9) };
+
+    int failures = 0;
+    for (size_t i=0 ; i<sizeof(orientations)/sizeof(*orientations) ; i++) {
+        Transform tr;
+        tr.set(orientations[i], 480, 800);
+        Transform translate;
+        translate.set(13, -7);
+        tr = translate * tr;
+
+        Region reg, expected;
+        for (size_t j=0 ; j<sizeof(rects)/sizeof(*rects) ; j++) {
+            const Rect a(tr.transform(rects[j]));
+            const Rect b(transformWithFloats(tr, rects[j]));
+            if (a != b) {
+                printf("orientation %d: [%d,%d,%d,%d] gave [%d,%d,%d,%d], "
+                        "expected [%d,%d,%d,%d]\n", orientations[i],
+                        rects[j].left, rects[j].top, rects[j].right, rects[j].bottom,
+                        a.left, a.top, a.right, a.bottom,
+                        b.left, b.top, b.right, b.bottom);
+                failures++;
+            }
+            reg.orSelf(rects[j]);
+        }
+        for (Region::const_iterator it = reg.begin() ; it != reg.end() ; it++) {
+            expected.orSelf(transformWithFloats(tr, *it));
+        }
+        if (!tr.transform(reg).subtract(expected).isEmpty() ||
+                !expected.subtract(tr.transform(reg)).isEmpty()) {
+            printf("orientation %d: region mismatch\n", orientations[i]);
+            failures++;
+        }
+    }
+    return failures;
+}
+
 int main(int argc, char **argv)
 {
     Transform tr90(Transform::ROT_90);
@@ -41,5 +106,7 @@ int main(int argc, char **argv)
     (tr90*trFH).dump("tr90*trFH");
     (tr90*trFV).dump("tr90*trFV");
 
-    return 0;
+    int failures = checkExactTransforms();
+    printf("exact transforms: %s\n", failures ? "FAILED" : "passed");
+    return failures ? 1 : 0;
 }